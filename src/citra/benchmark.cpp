@@ -0,0 +1,193 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <vector>
+
+#include "common/common_funcs.h"
+#include "common/emu_window.h"
+#include "common/file_util.h"
+#include "common/key_map.h"
+#include "common/logging/log.h"
+#include "common/perf_counters.h"
+#include "common/profiler_reporting.h"
+
+#include "core/core.h"
+#include "core/settings.h"
+#include "core/arm/arm_interface.h"
+#include "core/hw/gpu.h"
+
+#include "citra/benchmark.h"
+
+namespace Benchmark {
+
+using Clock = std::chrono::steady_clock;
+
+struct ButtonName {
+    const char* name;
+    Service::HID::PadState state;
+};
+
+/// Buttons the script can press, their index is their key code on the script's device
+static const ButtonName buttons[] = {
+    { "A", Service::HID::PAD_A },           { "B", Service::HID::PAD_B },
+    { "X", Service::HID::PAD_X },           { "Y", Service::HID::PAD_Y },
+    { "L", Service::HID::PAD_L },           { "R", Service::HID::PAD_R },
+    { "ZL", Service::HID::PAD_ZL },         { "ZR", Service::HID::PAD_ZR },
+    { "START", Service::HID::PAD_START },   { "SELECT", Service::HID::PAD_SELECT },
+    { "UP", Service::HID::PAD_UP },         { "DOWN", Service::HID::PAD_DOWN },
+    { "LEFT", Service::HID::PAD_LEFT },     { "RIGHT", Service::HID::PAD_RIGHT },
+};
+
+struct InputEvent {
+    u64 frame;
+    int button;
+    bool pressed;
+};
+
+/// Events of the input script, sorted by frame
+static std::vector<InputEvent> input_events;
+static int script_device_id;
+
+bool LoadInputScript(const std::string& filename) {
+    std::string script;
+    if (FileUtil::ReadFileToString(true, filename.c_str(), script) == 0) {
+        LOG_ERROR(Frontend, "Failed to read input script %s", filename.c_str());
+        return false;
+    }
+
+    input_events.clear();
+    std::istringstream lines(script);
+    std::string line;
+    for (int line_number = 1; std::getline(lines, line); ++line_number) {
+        std::istringstream fields(line);
+        std::string button_name, action;
+        u64 frame;
+        if (line.empty() || line[0] == '#')
+            continue;
+        if (!(fields >> frame >> button_name >> action) || (action != "down" && action != "up")) {
+            LOG_ERROR(Frontend, "%s:%d: expected \"<frame> <button> down|up\"", filename.c_str(), line_number);
+            return false;
+        }
+
+        auto button = std::find_if(std::begin(buttons), std::end(buttons),
+                                   [&](const ButtonName& b) { return button_name == b.name; });
+        if (button == std::end(buttons)) {
+            LOG_ERROR(Frontend, "%s:%d: unknown button %s", filename.c_str(), line_number, button_name.c_str());
+            return false;
+        }
+        input_events.push_back({ frame, (int)(button - std::begin(buttons)), action == "down" });
+    }
+    std::stable_sort(input_events.begin(), input_events.end(),
+                     [](const InputEvent& a, const InputEvent& b) { return a.frame < b.frame; });
+
+    script_device_id = KeyMap::NewDeviceId();
+    for (int i = 0; i < (int)ARRAY_SIZE(buttons); ++i)
+        KeyMap::SetKeyMapping({ i, script_device_id }, buttons[i].state);
+    return true;
+}
+
+u64 GetFirstInputFrame() {
+    for (const InputEvent& event : input_events) {
+        if (event.pressed)
+            return event.frame;
+    }
+    return 0;
+}
+
+static double ToMilliseconds(Clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(duration).count();
+}
+
+void Run(EmuWindow* emu_window, u64 num_frames, const std::string& frame_times_path) {
+    using namespace Common::Profiling;
+
+    ProfilingManager& profiler = GetProfilingManager();
+    const std::vector<Duration> start_category_times = profiler.GetTotalTimePerCategory();
+    const std::vector<u64> start_counters = Common::Perf::GetCounterTotals();
+    const u64 start_instructions = Core::g_app_core->GetNumInstructions();
+    const u64 start_frame = GPU::GetFrameCount();
+
+    const Clock::time_point start_time = Clock::now();
+    Clock::time_point frame_start = start_time;
+    Clock::duration max_frame_time = Clock::duration::zero();
+    size_t next_event = 0;
+    u64 frames = 0;
+    std::vector<double> frame_times;
+    if (!frame_times_path.empty())
+        frame_times.reserve(static_cast<size_t>(num_frames));
+
+    const auto send_events = [&](u64 frame) {
+        for (; next_event < input_events.size() && input_events[next_event].frame <= frame; ++next_event) {
+            const InputEvent& event = input_events[next_event];
+            if (event.pressed)
+                emu_window->KeyPressed({ event.button, script_device_id });
+            else
+                emu_window->KeyReleased({ event.button, script_device_id });
+        }
+    };
+    send_events(start_frame);
+
+    // The window of headless runs is hidden, so it can't be closed
+    while (frames < num_frames) {
+        Core::RunLoop();
+
+        const u64 frame = GPU::GetFrameCount() - start_frame;
+        if (frame == frames)
+            continue;
+        frames = frame;
+
+        const Clock::time_point now = Clock::now();
+        max_frame_time = std::max(max_frame_time, now - frame_start);
+        if (!frame_times_path.empty())
+            frame_times.push_back(ToMilliseconds(now - frame_start));
+        frame_start = now;
+
+        send_events(start_frame + frames);
+    }
+
+    const Clock::duration host_time = Clock::now() - start_time;
+
+    // Written after the run, so that writing doesn't slow the frames down
+    if (!frame_times_path.empty()) {
+        FileUtil::IOFile file(frame_times_path, "w");
+        if (file.IsOpen()) {
+            std::fprintf(file.GetHandle(), "frame,host_ms\n");
+            for (size_t i = 0; i < frame_times.size(); ++i)
+                std::fprintf(file.GetHandle(), "%u,%.3f\n", (unsigned)(i + 1), frame_times[i]);
+        } else {
+            LOG_ERROR(Frontend, "Failed to write the frame times to %s", frame_times_path.c_str());
+        }
+    }
+    const u64 instructions = Core::g_app_core->GetNumInstructions() - start_instructions;
+    const std::vector<Duration> category_times = profiler.GetTotalTimePerCategory();
+    const auto& categories = profiler.GetTimingCategoriesInfo();
+    const std::vector<u64> counter_totals = Common::Perf::GetCounterTotals();
+    const auto& counters = Common::Perf::GetCountersInfo();
+
+    const double host_seconds = ToMilliseconds(host_time) / 1000.0;
+    std::printf("{\"frames\":%llu,\"host_seconds\":%.3f,\"emulated_fps\":%.2f,"
+                "\"avg_host_ms_per_frame\":%.3f,\"max_host_ms_per_frame\":%.3f,\"instructions\":%llu,"
+                "\"threaded_interpreter\":%s,\"category_ms\":{",
+                (unsigned long long)frames, host_seconds, host_seconds > 0 ? frames / host_seconds : 0.0,
+                frames != 0 ? ToMilliseconds(host_time) / frames : 0.0, ToMilliseconds(max_frame_time),
+                (unsigned long long)instructions, Settings::values.threaded_interpreter ? "true" : "false");
+    for (size_t i = 0; i < category_times.size(); ++i) {
+        const Duration start = i < start_category_times.size() ? start_category_times[i] : Duration::zero();
+        std::printf("%s\"%s\":%.3f", i != 0 ? "," : "", categories[i].name,
+                    ToMilliseconds(std::chrono::duration_cast<Clock::duration>(category_times[i] - start)));
+    }
+    std::printf("},\"counters\":{");
+    for (size_t i = 0; i < counter_totals.size(); ++i) {
+        std::printf("%s\"%s\":%llu", i != 0 ? "," : "", counters[i].name,
+                    (unsigned long long)(counter_totals[i] - start_counters[i]));
+    }
+    std::printf("}}\n");
+    std::fflush(stdout);
+}
+
+} // namespace
@@ -0,0 +1,40 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+
+class EmuWindow;
+
+/**
+ * Headless benchmark runs, for tracking the performance of the emulator over time. The booted title
+ * runs unthrottled for a number of frames, optionally with scripted or replayed input (see
+ * InputRecording), after which the results are printed to stdout as JSON.
+ */
+namespace Benchmark {
+
+/**
+ * Loads the buttons to press during the run. Each line of the script holds the frame the event
+ * happens at, counted from boot, a button (A, B, X, Y, L, R, ZL, ZR, START, SELECT, UP, DOWN, LEFT, RIGHT) and
+ * either "down" or "up". Empty lines and lines starting with # are ignored.
+ * @return Whether the script could be read and parsed
+ */
+bool LoadInputScript(const std::string& filename);
+
+/// Frame of the first button press of the input script, 0 if there's none
+u64 GetFirstInputFrame();
+
+/**
+ * Runs emulation until the given number of frames was emulated. A run that starts past boot, e.g.
+ * from a boot snapshot, holds the buttons the script pressed until then.
+ * @param emu_window Window the scripted input is sent to
+ * @param num_frames Number of VBlanks to run for
+ * @param frame_times_path CSV file receiving the host time of every frame, if not empty
+ */
+void Run(EmuWindow* emu_window, u64 num_frames, const std::string& frame_times_path);
+
+} // namespace
@@ -2,21 +2,37 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <cstdlib>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include "common/logging/log.h"
 #include "common/logging/text_formatter.h"
 #include "common/logging/backend.h"
 #include "common/logging/filter.h"
+#include "common/profiler_reporting.h"
 #include "common/scope_exit.h"
+#include "common/thread_policy.h"
 
+#include "core/boot_snapshot.h"
 #include "core/settings.h"
 #include "core/system.h"
 #include "core/core.h"
+#include "core/gpu_capture.h"
+#include "core/input_recording.h"
+#include "core/ipc_recording.h"
+#include "core/savestate.h"
 #include "core/loader/loader.h"
+#include "core/arm/dyncom/arm_dyncom_profile.h"
+#include "core/hle/svc.h"
+#include "core/hw/gpu.h"
 
+#include "citra/benchmark.h"
 #include "citra/config.h"
 #include "citra/emu_window/emu_window_glfw.h"
+#include "citra/emu_window/emu_window_null.h"
 
 #include "video_core/video_core.h"
 
@@ -25,20 +41,122 @@ int main(int argc, char **argv) {
     Log::Filter log_filter(Log::Level::Debug);
     Log::SetFilter(&log_filter);
 
-    if (argc < 2) {
+    // Usage: citra [--headless --frames N [--input script] [--frame-times csv]]
+    //              [--record-input file | --replay-input file] [--gpu-capture file [--capture-frames N]]
+    //              [--record-ipc file] [--boot-snapshot frame|input] [--binary-log file] rom [state]
+    //              [--next rom]...
+    std::string boot_filename;
+    // Optional state to restore once the ROM has booted
+    std::string state_filename;
+    bool headless = false;
+    u64 benchmark_frames = 0;
+    std::string input_script;
+    std::string frame_times_filename;
+    // Input recorded at the HID service, or replayed there instead of the window's
+    std::string record_input_filename;
+    std::string replay_input_filename;
+    // Optional GPU capture of the first frames after boot, for citra_gpu_replay
+    std::string gpu_capture_filename;
+    u32 gpu_capture_frames = 60;
+    // Optional recording of the service calls, for citra_ipc_replay
+    std::string record_ipc_filename;
+    // Frame after which the booted title is snapshotted for the next runs, or "input" for the
+    // frame of the first scripted or replayed input
+    std::string boot_snapshot;
+    // Optional binary log of the messages, for citra_logdecode
+    std::string binary_log_filename;
+    // Titles run after the first one in headless runs, each from boot after a reset of the system
+    std::vector<std::string> next_filenames;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            benchmark_frames = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--input" && i + 1 < argc) {
+            input_script = argv[++i];
+        } else if (arg == "--frame-times" && i + 1 < argc) {
+            frame_times_filename = argv[++i];
+        } else if (arg == "--record-input" && i + 1 < argc) {
+            record_input_filename = argv[++i];
+        } else if (arg == "--replay-input" && i + 1 < argc) {
+            replay_input_filename = argv[++i];
+        } else if (arg == "--gpu-capture" && i + 1 < argc) {
+            gpu_capture_filename = argv[++i];
+        } else if (arg == "--capture-frames" && i + 1 < argc) {
+            gpu_capture_frames = static_cast<u32>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--record-ipc" && i + 1 < argc) {
+            record_ipc_filename = argv[++i];
+        } else if (arg == "--boot-snapshot" && i + 1 < argc) {
+            boot_snapshot = argv[++i];
+        } else if (arg == "--binary-log" && i + 1 < argc) {
+            binary_log_filename = argv[++i];
+        } else if (arg == "--next" && i + 1 < argc) {
+            next_filenames.push_back(argv[++i]);
+        } else if (boot_filename.empty()) {
+            boot_filename = arg;
+        } else {
+            state_filename = arg;
+        }
+    }
+
+    if (boot_filename.empty()) {
         LOG_CRITICAL(Frontend, "Failed to load ROM: No ROM specified");
         return -1;
     }
+    if (headless && benchmark_frames == 0) {
+        LOG_CRITICAL(Frontend, "--headless needs the number of frames to run with --frames");
+        return -1;
+    }
+    if (!record_input_filename.empty() && !replay_input_filename.empty()) {
+        LOG_CRITICAL(Frontend, "--record-input and --replay-input can't be used together");
+        return -1;
+    }
+    if (!boot_snapshot.empty() && !state_filename.empty()) {
+        LOG_CRITICAL(Frontend, "--boot-snapshot can't be used with a state to restore");
+        return -1;
+    }
+    if (!next_filenames.empty() &&
+        (!headless || !frame_times_filename.empty() || !boot_snapshot.empty() || !state_filename.empty())) {
+        LOG_CRITICAL(Frontend, "--next only runs headless from boot, without --frame-times");
+        return -1;
+    }
 
     Config config;
     log_filter.ParseFilterString(Settings::values.log_filter);
+    if (!binary_log_filename.empty() && !Log::StartBinaryLog(binary_log_filename)) {
+        LOG_CRITICAL(Frontend, "Can't create the binary log %s", binary_log_filename.c_str());
+        return -1;
+    }
 
-    std::string boot_filename = argv[1];
-    EmuWindow_GLFW* emu_window = new EmuWindow_GLFW;
+    if (!input_script.empty() && !Benchmark::LoadInputScript(input_script))
+        return -1;
+
+    // Benchmark runs are unthrottled, to measure how fast emulation can go
+    if (headless)
+        Settings::values.speed_limit = 0;
+
+    // Headless runs with the null renderer need neither a display nor GLFW
+    EmuWindow_Null null_window;
+    EmuWindow_GLFW* glfw_window = nullptr;
+    EmuWindow* emu_window = &null_window;
+    if (!headless || Settings::values.renderer_backend != static_cast<int>(VideoCore::RendererBackend::Null)) {
+        glfw_window = new EmuWindow_GLFW(headless);
+        emu_window = glfw_window;
+    }
 
     VideoCore::g_hw_renderer_enabled = Settings::values.use_hw_renderer;
 
-    System::Init(emu_window);
+    System::Init(emu_window, boot_filename);
+    // The emulation runs on the main thread
+    Common::RegisterCurrentThread("EmuThread", Common::ThreadClass::Emulation);
+
+    if (!record_input_filename.empty() && !InputRecording::StartRecording(record_input_filename))
+        return -1;
+    if (!replay_input_filename.empty() && !InputRecording::StartReplay(replay_input_filename))
+        return -1;
+    if (!record_ipc_filename.empty() && !IPCRecording::StartRecording(record_ipc_filename))
+        return -1;
 
     Loader::ResultStatus load_result = Loader::LoadFile(boot_filename);
     if (Loader::ResultStatus::Success != load_result) {
@@ -46,13 +164,70 @@ int main(int argc, char **argv) {
         return -1;
     }
 
-    while (emu_window->IsOpen()) {
-        Core::RunLoop();
+    if (!state_filename.empty())
+        SaveState::RequestLoad(state_filename);
+
+    if (!boot_snapshot.empty()) {
+        // Snapshotted just before the title reacts to the first input, so that any input works
+        u64 snapshot_frame;
+        if (boot_snapshot == "input") {
+            snapshot_frame = InputRecording::IsReplaying() ? InputRecording::GetFirstInputFrame()
+                                                           : Benchmark::GetFirstInputFrame();
+        } else {
+            snapshot_frame = std::strtoull(boot_snapshot.c_str(), nullptr, 10);
+        }
+
+        if (snapshot_frame == 0) {
+            LOG_WARNING(Frontend, "No frame to take the boot snapshot at, the title boots as usual");
+        } else if (!record_input_filename.empty() || !record_ipc_filename.empty() || !gpu_capture_filename.empty()) {
+            // Recordings and captures have to start at boot to be replayed from it
+            LOG_WARNING(Frontend, "The boot snapshot isn't used while recording, the title boots as usual");
+        } else if (BootSnapshot::Start(boot_filename, snapshot_frame) && headless) {
+            // The run ends at the same emulated frame as one from boot, with the same input
+            const u64 skipped_frames = std::min(GPU::GetFrameCount(), benchmark_frames - 1);
+            benchmark_frames -= skipped_frames;
+            LOG_INFO(Frontend, "Skipped the first %llu frames of the run", (unsigned long long)skipped_frames);
+        }
+    }
+
+    if (!Settings::values.trace_file.empty())
+        Common::Profiling::StartTracing();
+
+    if (!gpu_capture_filename.empty())
+        GPUCapture::RequestCapture(gpu_capture_filename, gpu_capture_frames);
+
+    if (headless) {
+        Benchmark::Run(emu_window, benchmark_frames, frame_times_filename);
+
+        // The next titles reuse the renderer, the compiled shaders and the worker threads
+        for (const std::string& next_filename : next_filenames) {
+            if (!System::Reset(next_filename))
+                LOG_WARNING(Frontend, "The previous title left kernel objects behind");
+            load_result = Loader::LoadFile(next_filename);
+            if (Loader::ResultStatus::Success != load_result) {
+                LOG_CRITICAL(Frontend, "Failed to load ROM %s (Error %i)!", next_filename.c_str(), load_result);
+                break;
+            }
+            Benchmark::Run(emu_window, benchmark_frames, frame_times_filename);
+        }
+    } else {
+        while (glfw_window->IsOpen()) {
+            Core::RunFrame();
+        }
     }
 
+    if (Settings::values.profile_cpu)
+        GetExecutionProfile().LogReport();
+
+    if (!Settings::values.svc_statistics_file.empty())
+        SVC::DumpStatisticsCSV(Settings::values.svc_statistics_file);
+
+    if (!Settings::values.trace_file.empty())
+        Common::Profiling::ExportChromeTrace(Settings::values.trace_file);
+
     System::Shutdown();
 
-    delete emu_window;
+    delete glfw_window;
 
     return 0;
 }
@@ -64,12 +64,41 @@ void Config::ReadValues() {
     Settings::values.pad_cdown_key  = glfw_config->GetInteger("Controls", "pad_cdown",  GLFW_KEY_K);
     Settings::values.pad_cleft_key  = glfw_config->GetInteger("Controls", "pad_cleft",  GLFW_KEY_J);
     Settings::values.pad_cright_key = glfw_config->GetInteger("Controls", "pad_cright", GLFW_KEY_L);
+    Settings::values.hid_update_rate = glfw_config->GetInteger("Controls", "hid_update_rate", 60);
 
     // Core
     Settings::values.frame_skip = glfw_config->GetInteger("Core", "frame_skip", 0);
+    Settings::values.dynamic_frame_skip = glfw_config->GetBoolean("Core", "dynamic_frame_skip", false);
+    Settings::values.speed_limit = glfw_config->GetInteger("Core", "speed_limit", 100);
+    Settings::values.use_cpu_jit = glfw_config->GetBoolean("Core", "use_cpu_jit", false);
+    Settings::values.threaded_interpreter = glfw_config->GetBoolean("Core", "threaded_interpreter", false);
+    Settings::values.cpu_cache_size = glfw_config->GetInteger("Core", "cpu_cache_size", 32);
+    Settings::values.persist_cpu_blocks = glfw_config->GetBoolean("Core", "persist_cpu_blocks", true);
+    Settings::values.profile_cpu = glfw_config->GetBoolean("Core", "profile_cpu", false);
+    Settings::values.use_fastmem = glfw_config->GetBoolean("Core", "use_fastmem", false);
+    Settings::values.use_huge_pages = glfw_config->GetBoolean("Core", "use_huge_pages", false);
+    Settings::values.max_slice_length = glfw_config->GetInteger("Core", "max_slice_length", 1000000);
+    Settings::values.rewind_enabled = glfw_config->GetBoolean("Core", "rewind_enabled", false);
+    Settings::values.rewind_interval = glfw_config->GetInteger("Core", "rewind_interval", 60);
+    Settings::values.rewind_buffer_size = glfw_config->GetInteger("Core", "rewind_buffer_size", 256);
+    Settings::values.pin_threads = glfw_config->GetBoolean("Core", "pin_threads", false);
+    Settings::values.emu_thread_core = glfw_config->GetInteger("Core", "emu_thread_core", -1);
+    Settings::values.gpu_thread_core = glfw_config->GetInteger("Core", "gpu_thread_core", -1);
+    Settings::values.raise_thread_priority = glfw_config->GetBoolean("Core", "raise_thread_priority", false);
+    Settings::values.hle_guest_routines = glfw_config->GetBoolean("Core", "hle_guest_routines", true);
 
     // Renderer
+    Settings::values.renderer_backend = glfw_config->GetInteger("Renderer", "renderer_backend", 0);
     Settings::values.use_hw_renderer = glfw_config->GetBoolean("Renderer", "use_hw_renderer", false);
+    Settings::values.vertex_cache_size = glfw_config->GetInteger("Renderer", "vertex_cache_size", 32);
+    Settings::values.texture_cache_size = glfw_config->GetInteger("Renderer", "texture_cache_size", 256);
+    Settings::values.use_shader_jit = glfw_config->GetBoolean("Renderer", "use_shader_jit", false);
+    Settings::values.use_hw_vertex_shaders = glfw_config->GetBoolean("Renderer", "use_hw_vertex_shaders", false);
+    Settings::values.rasterizer_threads = glfw_config->GetInteger("Renderer", "rasterizer_threads", 1);
+    Settings::values.use_gpu_thread = glfw_config->GetBoolean("Renderer", "use_gpu_thread", false);
+    Settings::values.debug_capture = glfw_config->GetBoolean("Renderer", "debug_capture", false);
+    Settings::values.texture_disk_cache = glfw_config->GetBoolean("Renderer", "texture_disk_cache", false);
+    Settings::values.show_perf_overlay = glfw_config->GetBoolean("Renderer", "show_perf_overlay", false);
 
     Settings::values.bg_red   = (float)glfw_config->GetReal("Renderer", "bg_red",   1.0);
     Settings::values.bg_green = (float)glfw_config->GetReal("Renderer", "bg_green", 1.0);
@@ -77,12 +106,22 @@ void Config::ReadValues() {
 
     // Data Storage
     Settings::values.use_virtual_sd = glfw_config->GetBoolean("Data Storage", "use_virtual_sd", true);
+    Settings::values.async_file_io = glfw_config->GetBoolean("Data Storage", "async_file_io", false);
+    Settings::values.write_back_save_data = glfw_config->GetBoolean("Data Storage", "write_back_save_data", true);
 
     // System Region
     Settings::values.region_value = glfw_config->GetInteger("System Region", "region_value", 1);
 
     // Miscellaneous
     Settings::values.log_filter = glfw_config->Get("Miscellaneous", "log_filter", "*:Info");
+    Settings::values.svc_statistics_file = glfw_config->Get("Miscellaneous", "svc_statistics_file", "");
+    Settings::values.trace_file = glfw_config->Get("Miscellaneous", "trace_file", "");
+    Settings::values.guest_profile_file = glfw_config->Get("Miscellaneous", "guest_profile_file", "");
+    Settings::values.guest_profile_interval = glfw_config->GetInteger("Miscellaneous", "guest_profile_interval", 50000);
+    Settings::values.memory_stats_file = glfw_config->Get("Miscellaneous", "memory_stats_file", "");
+    Settings::values.memory_stats_interval = glfw_config->GetInteger("Miscellaneous", "memory_stats_interval", 64);
+    Settings::values.metrics_http_port = glfw_config->GetInteger("Miscellaneous", "metrics_http_port", 0);
+    Settings::values.metrics_statsd_address = glfw_config->Get("Miscellaneous", "metrics_statsd_address", "");
 }
 
 void Config::Reload() {
@@ -32,6 +32,10 @@ pad_cdown =
 pad_cleft =
 pad_cright =
 
+# How often the input is sampled when it isn't reported by the window as it changes, in Hz.
+# Applications are only notified when the input actually changed. Defaults to 60
+hid_update_rate =
+
 [Core]
 # The refresh rate for the GPU
 # Defaults to 30
@@ -41,11 +45,136 @@ gpu_refresh_rate =
 # 0 (default): No frameskip, 1: x2 frameskip, 2: x4 frameskip, 3: x8 frameskip, etc.
 frame_skip =
 
+# Whether to skip rendering frames only while emulation is slower than the speed limit, instead of
+# following frame_skip. 0 (default): Off, 1: On
+dynamic_frame_skip =
+
+# Emulation speed to limit to, in percent of the 3DS. 0 runs as fast as possible for benchmarking.
+# Defaults to 100
+speed_limit =
+
+# Whether to use the x86-64 JIT for the application core instead of the interpreter.
+# 0 (default): Interpreter, 1: JIT
+use_cpu_jit =
+
+# Whether the interpreter runs the common instructions through threaded handlers, functions of their
+# own that call each other, rather than through its main loop.
+# 0 (default): Main loop, 1: Threaded handlers
+threaded_interpreter =
+
+# Size of the cache holding translated CPU instructions, in megabytes. The oldest translations are
+# discarded when it fills up. Defaults to 32
+cpu_cache_size =
+
+# Whether to remember the blocks of code each title ran, so that its next boot translates them while
+# loading rather than while playing. The lists are stored in the cache directory.
+# 0: Off, 1 (default): On
+persist_cpu_blocks =
+
+# Whether to count the instructions executed by the interpreter, per instruction class and per
+# block. The report is logged on exit. Instructions run by the JIT are not counted.
+# 0 (default): Off, 1: On
+profile_cpu =
+
+# Whether to mirror the emulated address space into host memory so that memory accesses don't need
+# to look up the page table. Only supported on 64-bit Linux and macOS hosts.
+# 0 (default): Off, 1: On
+use_fastmem =
+
+# Whether to back guest memory and the CPU translation caches with 2 MB huge pages, which take far
+# fewer TLB entries. Falls back to normal pages if the host doesn't provide them: on Linux they
+# need transparent huge pages or reserved hugetlbfs pages, on Windows the "Lock pages in memory"
+# privilege. Not used for guest memory mirrored by fastmem.
+# 0 (default): Off, 1: On
+use_huge_pages =
+
+# Longest stretch of CPU cycles to run without checking for timed events. The CPU normally runs
+# until the next event is due, this only limits how long it can run when there is none soon.
+# Longer slices have less overhead, shorter ones make the emulator react faster to being stopped.
+# Defaults to 1000000
+max_slice_length =
+
+# Whether to keep snapshots of the last moments of emulation to rewind to. Only the pages of memory
+# written since the previous snapshot are stored. 0 (default): Off, 1: On
+rewind_enabled =
+
+# Number of frames between two rewind snapshots, which is how far one rewind steps back.
+# Defaults to 60
+rewind_interval =
+
+# Memory the rewind snapshots may use, in megabytes. The oldest ones are dropped beyond it.
+# Defaults to 256
+rewind_buffer_size =
+
+# Whether to give the emulation thread and the GPU thread a physical core each, SMT siblings
+# included, and run the other threads on the remaining cores. Needs at least 3 physical cores.
+# 0 (default): Off, 1: On
+pin_threads =
+
+# Physical cores the emulation and GPU threads are pinned to when pin_threads is on, counted from 0.
+# -1 (default): The first two cores
+emu_thread_core =
+gpu_thread_core =
+
+# Whether to raise the priority of the emulation, GPU and audio threads and lower that of the
+# background threads. Raising priorities may need extra privileges outside of Windows.
+# 0 (default): Off, 1: On
+raise_thread_priority =
+
+# Whether to run library routines found in the guest code, such as memcpy and the soft-float helpers,
+# natively. They are found by symbol, or by the signatures in sysdata/function_signatures.txt.
+# 0: Off, 1 (default): On
+hle_guest_routines =
+
 [Renderer]
+# Graphics API the frame is presented and hardware rendered with.
+# 0 (default): OpenGL, 1: Null (presents nothing, for benchmarking the CPU side without a display)
+renderer_backend =
+
 # Whether to use software or hardware rendering.
 # 0 (default): Software, 1: Hardware
 use_hw_renderer =
 
+# Number of transformed vertices to keep around for reuse within an indexed draw.
+# 0: Disabled, defaults to 32
+vertex_cache_size =
+
+# GPU memory the hardware renderer's texture cache may use, in megabytes. Beyond it, the textures
+# used the longest ago are dropped at the end of a frame and decoded again when they are next used.
+# 0: Unlimited, defaults to 256
+texture_cache_size =
+
+# Whether to compile vertex shaders to x86-64 code instead of interpreting them
+# 0 (default): Interpreter, 1: JIT
+use_shader_jit =
+
+# Whether the hardware renderer runs vertex shaders on the host GPU, translated to GLSL
+# 0 (default): On the CPU, 1: On the GPU
+use_hw_vertex_shaders =
+
+# Number of threads the software renderer draws triangles with, including the emulation thread.
+# Defaults to 1
+rasterizer_threads =
+
+# Whether to run the video core on a thread of its own, next to the emulated CPU
+# 0 (default): Off, 1: On
+use_gpu_thread =
+
+# Whether to dump the geometry, shaders and texture combiner setup of every draw for debugging.
+# This slows down rendering considerably and writes a lot of files.
+# 0 (default): Off, 1: On
+debug_capture =
+
+# Whether to keep decoded compressed textures of each title on disk, to not decode them again on
+# the next run. The cache files are stored in the user's cache directory.
+# 0 (default): Off, 1: On
+texture_disk_cache =
+
+# Whether to show the emulation speed, frame times and cache statistics over the top screen.
+# They are updated once per second.
+# 0 (default): Off, 1: On
+show_perf_overlay =
+
 # The clear color for the renderer. What shows up on the sides of the bottom screen.
 # Must be in range of 0.0-1.0. Defaults to 1.0 for all.
 bg_red =
@@ -57,6 +186,15 @@ bg_green =
 # 1 (default): Yes, 0: No
 use_virtual_sd =
 
+# Whether file reads and writes run on a separate thread, the requesting emulated thread waits meanwhile
+# 0 (default): No, 1: Yes
+async_file_io =
+
+# Whether save data is kept in memory while its files are open and written back by a separate thread
+# when the emulated program flushes or closes them, instead of right away
+# 0: No, 1 (default): Yes
+write_back_save_data =
+
 [System Region]
 # The system region that Citra will use during emulation
 # 0: Japan, 1: USA (default), 2: Europe, 3: Australia, 4: China, 5: Korea, 6: Taiwan
@@ -66,6 +204,38 @@ region_value =
 # A filter which removes logs below a certain logging level.
 # Examples: *:Debug Kernel.SVC:Trace Service.*:Critical
 log_filter = *:Info
+
+# File to write the number of calls and a host latency histogram of every SVC to when exiting, as CSV.
+# Leave empty (default) to not write one.
+svc_statistics_file =
+
+# File to write a timeline of the profiled sections on each thread to when exiting, in the Chrome
+# trace format that chrome://tracing and the Perfetto UI load. Only the last events are kept.
+# Leave empty (default) to not record one.
+trace_file =
+
+# File to write samples of the emulated program's PC to when exiting, as folded stacks for flame
+# graph tools. Functions are named after the loaded symbols. Leave empty (default) to not sample.
+guest_profile_file =
+
+# Number of emulated CPU cycles between two samples of the guest profiler. Defaults to 50000
+guest_profile_interval =
+
+# File to write statistics of the guest's memory accesses to when exiting, as CSV sections for
+# heatmaps: the CPU accesses by region and page, and the GPU reads by kind, size and physical page.
+# Sampling makes the CPU slower. Leave empty (default) to not collect them.
+memory_stats_file =
+
+# Sample one in this many CPU memory accesses for the memory statistics. Defaults to 64
+memory_stats_interval =
+
+# Port to serve performance metrics on in the Prometheus format, at http://<host>:<port>/metrics.
+# The port is opened on all network interfaces. 0 (default): Don't serve metrics
+metrics_http_port =
+
+# StatsD server to push performance metrics to once per second over UDP, as host:port.
+# Leave empty (default) to not push metrics.
+metrics_statsd_address =
 )";
 
 }
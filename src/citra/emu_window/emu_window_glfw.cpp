@@ -9,6 +9,7 @@
 #include "video_core/video_core.h"
 
 #include "core/settings.h"
+#include "core/hle/service/hid/hid.h"
 
 #include "citra/emu_window/emu_window_glfw.h"
 
@@ -27,11 +28,14 @@ void EmuWindow_GLFW::OnMouseButtonEvent(GLFWwindow* win, int button, int action,
             emu_window->TouchPressed(static_cast<unsigned>(x), static_cast<unsigned>(y));
         else if (action == GLFW_RELEASE)
             emu_window->TouchReleased();
+
+        Service::HID::NotifyInputChanged();
     }
 }
 
 void EmuWindow_GLFW::OnCursorPosEvent(GLFWwindow* win, double x, double y) {
     GetEmuWindow(win)->TouchMoved(static_cast<unsigned>(std::max(x, 0.0)), static_cast<unsigned>(std::max(y, 0.0)));
+    Service::HID::NotifyInputChanged();
 }
 
 /// Called by GLFW when a key event occurs
@@ -44,6 +48,7 @@ void EmuWindow_GLFW::OnKeyEvent(GLFWwindow* win, int key, int scancode, int acti
     } else if (action == GLFW_RELEASE) {
         emu_window->KeyReleased({key, keyboard_id});
     }
+    Service::HID::NotifyInputChanged();
 }
 
 /// Whether the window is still open, and a close request hasn't yet been sent
@@ -62,7 +67,7 @@ void EmuWindow_GLFW::OnClientAreaResizeEvent(GLFWwindow* win, int width, int hei
 }
 
 /// EmuWindow_GLFW constructor
-EmuWindow_GLFW::EmuWindow_GLFW() {
+EmuWindow_GLFW::EmuWindow_GLFW(bool hidden) {
     keyboard_id = KeyMap::NewDeviceId();
 
     ReloadSetKeymaps();
@@ -83,6 +88,8 @@ EmuWindow_GLFW::EmuWindow_GLFW() {
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     std::string window_title = Common::StringFromFormat("Citra | %s-%s", Common::g_scm_branch, Common::g_scm_desc);
+    if (hidden)
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
     m_render_window = glfwCreateWindow(VideoCore::kScreenTopWidth,
         (VideoCore::kScreenTopHeight + VideoCore::kScreenBottomHeight),
         window_title.c_str(), nullptr, nullptr);
@@ -92,6 +99,12 @@ EmuWindow_GLFW::EmuWindow_GLFW() {
         exit(1);
     }
 
+    // GLFW only creates contexts on the main thread, so the shared one is set up ahead of its use
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    m_shared_context_window = glfwCreateWindow(1, 1, "", nullptr, m_render_window);
+    if (m_shared_context_window == nullptr)
+        LOG_WARNING(Frontend, "Failed to create shared GLFW context, presenting on the emulation thread");
+
     glfwSetWindowUserPointer(m_render_window, this);
 
     // Notify base interface about window state
@@ -109,6 +122,10 @@ EmuWindow_GLFW::EmuWindow_GLFW() {
     glfwSetFramebufferSizeCallback(m_render_window, OnFramebufferResizeEvent);
     glfwSetWindowSizeCallback(m_render_window, OnClientAreaResizeEvent);
 
+    if (hidden) {
+        MakeCurrent();
+        glfwSwapInterval(0);
+    }
     DoneCurrent();
 }
 
@@ -137,6 +154,14 @@ void EmuWindow_GLFW::DoneCurrent() {
     glfwMakeContextCurrent(nullptr);
 }
 
+bool EmuWindow_GLFW::MakeSharedContextCurrent() {
+    if (m_shared_context_window == nullptr)
+        return false;
+
+    glfwMakeContextCurrent(m_shared_context_window);
+    return true;
+}
+
 void EmuWindow_GLFW::ReloadSetKeymaps() {
     KeyMap::SetKeyMapping({Settings::values.pad_a_key,      keyboard_id}, Service::HID::PAD_A);
     KeyMap::SetKeyMapping({Settings::values.pad_b_key,      keyboard_id}, Service::HID::PAD_B);
@@ -10,7 +10,8 @@ struct GLFWwindow;
 
 class EmuWindow_GLFW : public EmuWindow {
 public:
-    EmuWindow_GLFW();
+    /// @param hidden Whether the window is kept offscreen and presents without waiting for VSync
+    EmuWindow_GLFW(bool hidden = false);
     ~EmuWindow_GLFW();
 
     /// Swap buffers to display the next frame
@@ -25,6 +26,9 @@ public:
     /// Releases (dunno if this is the "right" word) the GLFW context from the caller thread
     void DoneCurrent() override;
 
+    /// Makes the hidden context sharing objects with the one of the window current for the caller thread
+    bool MakeSharedContextCurrent() override;
+
     static void OnKeyEvent(GLFWwindow* win, int key, int scancode, int action, int mods);
 
     static void OnMouseButtonEvent(GLFWwindow* window, int button, int action, int mods);
@@ -46,6 +50,7 @@ private:
     static EmuWindow_GLFW* GetEmuWindow(GLFWwindow* win);
 
     GLFWwindow* m_render_window; ///< Internal GLFW render window
+    GLFWwindow* m_shared_context_window; ///< Hidden window owning a context shared with the render window
 
     /// Device id of keyboard for use with KeyMap
     int keyboard_id;
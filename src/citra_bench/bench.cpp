@@ -0,0 +1,123 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "common/logging/backend.h"
+#include "common/logging/filter.h"
+
+#include "citra_bench/bench.h"
+
+namespace Bench {
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    u64 iterations;
+    double ns_per_iteration;
+};
+
+static std::vector<Benchmark> benchmarks;
+static volatile u32 sink;
+
+void Register(Benchmark benchmark) {
+    benchmarks.push_back(std::move(benchmark));
+}
+
+void Consume(u32 value) {
+    sink += value;
+}
+
+static Result Time(const Benchmark& benchmark, double min_seconds) {
+    // One untimed iteration warms up the caches and any lazily built state
+    benchmark.run(1);
+
+    for (u64 iterations = 1;; iterations *= 2) {
+        const Clock::time_point start = Clock::now();
+        benchmark.run(iterations);
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (seconds >= min_seconds || iterations >= (1ULL << 40))
+            return { iterations, seconds * 1e9 / iterations };
+    }
+}
+
+static void PrintUsage(const char* argv0) {
+    std::fprintf(stderr, "Usage: %s [--json] [--min-time <seconds>] [filter...]\n"
+                         "Runs the benchmarks whose names contain any of the filters, or all of them.\n", argv0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Log::Filter log_filter(Log::Level::Warning);
+    Log::SetFilter(&log_filter);
+
+    bool json = false;
+    double min_seconds = 0.5;
+    std::vector<std::string> filters;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_seconds = std::atof(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            Bench::PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            filters.push_back(argv[i]);
+        }
+    }
+
+    Bench::RegisterTextureBenchmarks();
+    Bench::RegisterLoaderBenchmarks();
+    Bench::RegisterMemoryBenchmarks();
+    Bench::RegisterVideoBenchmarks();
+
+    if (json)
+        std::printf("{\"benchmarks\":[");
+    else
+        std::printf("%-40s %14s %14s %12s\n", "benchmark", "iterations", "ns/iteration", "MB/s");
+
+    bool first = true;
+    for (const Bench::Benchmark& benchmark : Bench::benchmarks) {
+        bool selected = filters.empty();
+        for (const std::string& filter : filters)
+            selected |= benchmark.name.find(filter) != std::string::npos;
+        if (!selected)
+            continue;
+
+        if (benchmark.setup)
+            benchmark.setup();
+        const Bench::Result result = Bench::Time(benchmark, min_seconds);
+        if (benchmark.teardown)
+            benchmark.teardown();
+
+        const double mb_per_second = benchmark.bytes_per_iteration * 1e3 / result.ns_per_iteration;
+        if (json) {
+            std::printf("%s{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_iteration\":%.3f",
+                        first ? "" : ",", benchmark.name.c_str(), (unsigned long long)result.iterations,
+                        result.ns_per_iteration);
+            if (benchmark.bytes_per_iteration != 0)
+                std::printf(",\"mb_per_second\":%.3f", mb_per_second);
+            std::printf("}");
+        } else if (benchmark.bytes_per_iteration != 0) {
+            std::printf("%-40s %14llu %14.3f %12.1f\n", benchmark.name.c_str(),
+                        (unsigned long long)result.iterations, result.ns_per_iteration, mb_per_second);
+        } else {
+            std::printf("%-40s %14llu %14.3f %12s\n", benchmark.name.c_str(),
+                        (unsigned long long)result.iterations, result.ns_per_iteration, "-");
+        }
+        std::fflush(stdout);
+        first = false;
+    }
+
+    if (json)
+        std::printf("]}\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,41 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "common/common_types.h"
+
+/**
+ * Minimal harness for the micro-benchmarks of the hot paths of the emulator. Each benchmark is run
+ * with a doubling number of iterations until a run takes long enough to be timed reliably.
+ */
+namespace Bench {
+
+struct Benchmark {
+    std::string name;
+    /// Bytes processed by one iteration, used to report the throughput. 0 if it doesn't apply.
+    u64 bytes_per_iteration;
+    /// Called once before the benchmark is timed, may be empty
+    std::function<void()> setup;
+    /// Runs the given number of iterations of the benchmark
+    std::function<void(u64 iterations)> run;
+    /// Called once after the benchmark was timed, may be empty
+    std::function<void()> teardown;
+};
+
+void Register(Benchmark benchmark);
+
+/// Keeps the compiler from optimizing away the computation of a value that is otherwise unused
+void Consume(u32 value);
+
+// Each of these registers the benchmarks of one area of the emulator
+void RegisterTextureBenchmarks();
+void RegisterLoaderBenchmarks();
+void RegisterMemoryBenchmarks();
+void RegisterVideoBenchmarks();
+
+} // namespace
@@ -0,0 +1,78 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "common/logging/log.h"
+
+#include "core/loader/ncch.h"
+
+#include "citra_bench/bench.h"
+
+namespace Bench {
+
+/**
+ * Makes an LZSS compressed ExeFS section of about the given size, half of its tokens being copies
+ * of earlier data. The decompressor reads the stream backwards, so it's built in the order it's
+ * read and reversed at the end.
+ */
+static std::vector<u8> MakeCompressedSection(size_t compressed_size) {
+    std::mt19937 generator(1);
+    std::vector<u8> stream;
+    u32 decompressed_size = 0;
+
+    for (int group = 0; stream.size() + 8 < compressed_size; ++group) {
+        // The first groups only hold literals, for the copies to have something to copy from
+        const u8 control = group < 3 ? 0x00 : static_cast<u8>(generator());
+        stream.push_back(control);
+        for (unsigned i = 0; i < 8; ++i) {
+            if (control & (0x80 >> i)) {
+                const u32 size = generator() % 16;
+                const u32 offset = generator() % std::min<u32>(decompressed_size - 2, 0x1000);
+                const u16 segment = static_cast<u16>((size << 12) | offset);
+                stream.push_back(segment >> 8);
+                stream.push_back(segment & 0xFF);
+                decompressed_size += size + 3;
+            } else {
+                stream.push_back(static_cast<u8>(generator() % 64));
+                decompressed_size += 1;
+            }
+        }
+    }
+
+    std::vector<u8> section(stream.rbegin(), stream.rend());
+    const u32 size = static_cast<u32>(section.size() + 8);
+    const u32 buffer_top_and_bottom = (8 << 24) | size;
+    const u32 additional_size = decompressed_size - size;
+    section.resize(size);
+    std::memcpy(&section[size - 8], &buffer_top_and_bottom, sizeof(u32));
+    std::memcpy(&section[size - 4], &additional_size, sizeof(u32));
+    return section;
+}
+
+void RegisterLoaderBenchmarks() {
+    auto compressed = std::make_shared<std::vector<u8>>(MakeCompressedSection(1024 * 1024));
+    const u32 decompressed_size = Loader::LZSS_GetDecompressedSize(compressed->data(), compressed->size());
+    auto decompressed = std::make_shared<std::vector<u8>>(decompressed_size);
+
+    Register({ "loader/lzss_decompress", decompressed_size,
+               [=] {
+                   if (!Loader::LZSS_Decompress(compressed->data(), compressed->size(),
+                                                decompressed->data(), decompressed->size()))
+                       LOG_ERROR(Loader, "Failed to decompress the LZSS benchmark data");
+               },
+               [=](u64 iterations) {
+                   for (u64 i = 0; i < iterations; ++i) {
+                       Loader::LZSS_Decompress(compressed->data(), compressed->size(),
+                                               decompressed->data(), decompressed->size());
+                       Consume((*decompressed)[i % decompressed->size()]);
+                   }
+               }, nullptr });
+}
+
+} // namespace
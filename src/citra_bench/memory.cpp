@@ -0,0 +1,64 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "core/mem_map.h"
+#include "core/memory.h"
+#include "core/settings.h"
+
+#include "citra_bench/bench.h"
+
+namespace Bench {
+
+/// Size of the part of the heap that is accessed
+static const u32 WORKING_SET_SIZE = 4 * 1024 * 1024;
+static const u32 NUM_ACCESSES = 1024 * 1024;
+
+static void InitMemory() {
+    Settings::values.use_fastmem = false;
+    Memory::Init();
+    // The heap is only backed by memory once it's allocated, with a commit (3) of read-write (3) memory
+    Memory::MapBlock_Heap(WORKING_SET_SIZE, 3, 3);
+}
+
+/// Addresses of words in the working set, sequential or in random order
+static std::shared_ptr<std::vector<VAddr>> MakeAddresses(bool random) {
+    auto addresses = std::make_shared<std::vector<VAddr>>(NUM_ACCESSES);
+    std::mt19937 generator(1);
+    for (u32 i = 0; i < NUM_ACCESSES; ++i) {
+        const u32 offset = random ? generator() % WORKING_SET_SIZE : i * 4 % WORKING_SET_SIZE;
+        (*addresses)[i] = Memory::HEAP_VADDR + (offset & ~3);
+    }
+    return addresses;
+}
+
+void RegisterMemoryBenchmarks() {
+    for (bool random : { false, true }) {
+        auto addresses = MakeAddresses(random);
+        const std::string pattern = random ? "random" : "sequential";
+
+        Register({ "memory/read32/" + pattern, NUM_ACCESSES * 4, InitMemory,
+                   [addresses](u64 iterations) {
+                       u32 sum = 0;
+                       for (u64 i = 0; i < iterations; ++i) {
+                           for (VAddr address : *addresses)
+                               sum += Memory::Read32(address);
+                       }
+                       Consume(sum);
+                   }, Memory::Shutdown });
+
+        Register({ "memory/write32/" + pattern, NUM_ACCESSES * 4, InitMemory,
+                   [addresses](u64 iterations) {
+                       for (u64 i = 0; i < iterations; ++i) {
+                           for (VAddr address : *addresses)
+                               Memory::Write32(address, static_cast<u32>(i) ^ address);
+                       }
+                   }, Memory::Shutdown });
+    }
+}
+
+} // namespace
@@ -0,0 +1,112 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "video_core/pica.h"
+#include "video_core/utils.h"
+#include "video_core/debug_utils/debug_utils.h"
+
+#include "citra_bench/bench.h"
+
+namespace Bench {
+
+static const int TEXTURE_SIZE = 128;
+
+struct Format {
+    const char* name;
+    Pica::Regs::TextureFormat format;
+};
+
+static const Format formats[] = {
+    { "RGBA8",  Pica::Regs::TextureFormat::RGBA8 },
+    { "RGB8",   Pica::Regs::TextureFormat::RGB8 },
+    { "RGB5A1", Pica::Regs::TextureFormat::RGB5A1 },
+    { "RGB565", Pica::Regs::TextureFormat::RGB565 },
+    { "RGBA4",  Pica::Regs::TextureFormat::RGBA4 },
+    { "IA8",    Pica::Regs::TextureFormat::IA8 },
+    { "I8",     Pica::Regs::TextureFormat::I8 },
+    { "A8",     Pica::Regs::TextureFormat::A8 },
+    { "IA4",    Pica::Regs::TextureFormat::IA4 },
+    { "I4",     Pica::Regs::TextureFormat::I4 },
+    { "A4",     Pica::Regs::TextureFormat::A4 },
+    { "ETC1",   Pica::Regs::TextureFormat::ETC1 },
+    { "ETC1A4", Pica::Regs::TextureFormat::ETC1A4 },
+};
+
+/// Random texture data, the same for every run
+static std::shared_ptr<std::vector<u8>> MakeTextureData(size_t size) {
+    auto data = std::make_shared<std::vector<u8>>(size);
+    std::mt19937 generator(size);
+    for (u8& byte : *data)
+        byte = static_cast<u8>(generator());
+    return data;
+}
+
+static Pica::DebugUtils::TextureInfo MakeTextureInfo(const Format& format) {
+    Pica::DebugUtils::TextureInfo info;
+    info.physical_address = 0;
+    info.width = TEXTURE_SIZE;
+    info.height = TEXTURE_SIZE;
+    info.format = format.format;
+    info.stride = Pica::Regs::NibblesPerPixel(format.format) * TEXTURE_SIZE / 2;
+    return info;
+}
+
+void RegisterTextureBenchmarks() {
+    const u64 num_texels = TEXTURE_SIZE * TEXTURE_SIZE;
+
+    for (const Format& format : formats) {
+        const Pica::DebugUtils::TextureInfo info = MakeTextureInfo(format);
+        auto data = MakeTextureData(Pica::Regs::NibblesPerPixel(format.format) * num_texels / 2);
+
+        // Sampling every texel of the texture one at a time, as the rasterizer does
+        Register({ std::string("texture/lookup/") + format.name, num_texels * 4, nullptr,
+                   [info, data](u64 iterations) {
+                       for (u64 i = 0; i < iterations; ++i) {
+                           for (int t = 0; t < info.height; ++t) {
+                               for (int s = 0; s < info.width; ++s)
+                                   Consume(Pica::DebugUtils::LookupTexture(data->data(), s, t, info).r());
+                           }
+                       }
+                   }, nullptr });
+
+        auto decoded = std::make_shared<std::vector<Math::Vec4<u8>>>(num_texels);
+        Register({ std::string("texture/decode/") + format.name, num_texels * 4, nullptr,
+                   [info, data, decoded](u64 iterations) {
+                       for (u64 i = 0; i < iterations; ++i) {
+                           Pica::DebugUtils::DecodeTexture(data->data(), info, decoded->data());
+                           Consume((*decoded)[i % decoded->size()].r());
+                       }
+                   }, nullptr });
+    }
+
+    // Detiling a framebuffer into a linear image, like the renderer does to display it
+    for (u32 bytes_per_pixel : { 2, 3, 4 }) {
+        const u32 width = 400, height = 240;
+        auto tiled = MakeTextureData(width * height * bytes_per_pixel);
+        auto linear = std::make_shared<std::vector<u8>>(tiled->size());
+        Register({ "texture/morton_detile/" + std::to_string(bytes_per_pixel * 8) + "bpp",
+                   width * height * bytes_per_pixel, nullptr,
+                   [=](u64 iterations) {
+                       for (u64 i = 0; i < iterations; ++i) {
+                           for (u32 y = 0; y < height; ++y) {
+                               for (u32 x = 0; x < width; ++x) {
+                                   const u32 coarse_y = y & ~7;
+                                   const u32 src_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) +
+                                                          coarse_y * width * bytes_per_pixel;
+                                   std::memcpy(&(*linear)[(x + y * width) * bytes_per_pixel],
+                                               &(*tiled)[src_offset], bytes_per_pixel);
+                               }
+                           }
+                           Consume((*linear)[i % linear->size()]);
+                       }
+                   }, nullptr });
+    }
+}
+
+} // namespace
@@ -0,0 +1,220 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "core/mem_map.h"
+#include "core/memory.h"
+#include "core/settings.h"
+
+#include "video_core/derived_state.h"
+#include "video_core/pica.h"
+#include "video_core/rasterizer.h"
+#include "video_core/vertex_shader.h"
+#include "video_core/vertex_shader_ir.h"
+#include "video_core/vertex_shader_jit.h"
+
+#include "citra_bench/bench.h"
+
+namespace Bench {
+
+using Pica::VertexShader::InputVertex;
+using Pica::VertexShader::OutputVertex;
+
+static const int NUM_VERTICES = 1024;
+
+/// Encodes an instruction of the common arithmetic format
+static u32 ArithmeticInstruction(u32 opcode, u32 dest, u32 src1, u32 src2, u32 operand_desc) {
+    return (opcode << 26) | (dest << 21) | (src1 << 12) | (src2 << 7) | operand_desc;
+}
+
+/// Builds an operand descriptor with the given destination mask and no swizzling or negation
+static u32 OperandDescriptor(u32 dest_mask) {
+    const u32 identity_selector = 0x1B; // xyzw
+    return dest_mask | (identity_selector << 5) | (identity_selector << 14) | (identity_selector << 23);
+}
+
+/**
+ * Sets up the shader most titles run for untextured geometry: the position is transformed by the
+ * matrix in c0-c3 and the color is passed through.
+ */
+static void SetupShader() {
+    using Pica::Regs;
+    auto& regs = Pica::g_state.regs;
+    auto& vs = Pica::g_state.vs;
+
+    const u32 DP4 = 0x02, MOV = 0x13, END = 0x22;
+    const u32 v0 = 0x00, v1 = 0x01, c0 = 0x20, o0 = 0x00, o1 = 0x01;
+
+    for (u32 component = 0; component < 4; ++component) {
+        vs.swizzle_data[component] = OperandDescriptor(8 >> component);
+        vs.program_code[component] = ArithmeticInstruction(DP4, o0, c0 + component, v0, component);
+    }
+    vs.swizzle_data[4] = OperandDescriptor(0xF);
+    vs.program_code[4] = ArithmeticInstruction(MOV, o1, v1, 0, 4);
+    vs.program_code[5] = END << 26;
+
+    for (int row = 0; row < 4; ++row) {
+        for (int column = 0; column < 4; ++column)
+            vs.uniforms.f[row][column] = Pica::float24::FromFloat32(row == column ? 1.0f : 0.0f);
+    }
+
+    regs.vs_main_offset = 0;
+    regs.vs_input_register_map.attribute0_register = 0;
+    regs.vs_input_register_map.attribute1_register = 1;
+
+    for (auto& output : regs.vs_output_attributes) {
+        output.map_x = output.map_y = output.map_z = output.map_w = Regs::VSOutputAttributes::INVALID;
+    }
+    regs.vs_output_attributes[0].map_x = Regs::VSOutputAttributes::POSITION_X;
+    regs.vs_output_attributes[0].map_y = Regs::VSOutputAttributes::POSITION_Y;
+    regs.vs_output_attributes[0].map_z = Regs::VSOutputAttributes::POSITION_Z;
+    regs.vs_output_attributes[0].map_w = Regs::VSOutputAttributes::POSITION_W;
+    regs.vs_output_attributes[1].map_x = Regs::VSOutputAttributes::COLOR_R;
+    regs.vs_output_attributes[1].map_y = Regs::VSOutputAttributes::COLOR_G;
+    regs.vs_output_attributes[1].map_z = Regs::VSOutputAttributes::COLOR_B;
+    regs.vs_output_attributes[1].map_w = Regs::VSOutputAttributes::COLOR_A;
+
+    // The registers are written directly, not through the command processor
+    Pica::DerivedState::Invalidate();
+    Pica::VertexShader::InvalidateShaderProgram();
+}
+
+static void ShutdownShader() {
+    Pica::VertexShader::ShutdownJit();
+    Pica::VertexShader::ClearIRCache();
+    Pica::Shutdown();
+}
+
+static std::shared_ptr<std::vector<InputVertex>> MakeInputVertices() {
+    auto inputs = std::make_shared<std::vector<InputVertex>>(NUM_VERTICES);
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    for (InputVertex& input : *inputs) {
+        std::memset(&input, 0, sizeof(input));
+        for (int i = 0; i < 4; ++i) {
+            input.attr[0][i] = Pica::float24::FromFloat32(i == 3 ? 1.0f : distribution(generator));
+            input.attr[1][i] = Pica::float24::FromFloat32(distribution(generator) * 0.5f + 0.5f);
+        }
+    }
+    return inputs;
+}
+
+static void RegisterShaderBenchmarks() {
+    auto inputs = MakeInputVertices();
+    auto outputs = std::make_shared<std::vector<OutputVertex>>(NUM_VERTICES);
+
+    for (bool use_jit : { false, true }) {
+        const std::string engine = use_jit ? "jit" : "interpreter";
+        auto setup = [use_jit] {
+            Settings::values.use_shader_jit = use_jit;
+            SetupShader();
+        };
+
+        Register({ "video/shader/" + engine, 0, setup,
+                   [inputs](u64 iterations) {
+                       for (u64 i = 0; i < iterations; ++i) {
+                           const InputVertex& input = (*inputs)[i % inputs->size()];
+                           Consume(Pica::VertexShader::RunShader(input, 2).pos.x.ToFloat32() > 0);
+                       }
+                   }, ShutdownShader });
+
+        // Timed per vertex as well, for it to be comparable to running them one at a time
+        Register({ "video/shader_batch/" + engine, 0, setup,
+                   [inputs, outputs](u64 iterations) {
+                       for (u64 i = 0; i < iterations; i += NUM_VERTICES) {
+                           Pica::VertexShader::RunShaderBatch(inputs->data(), NUM_VERTICES, 2, outputs->data());
+                           Consume((*outputs)[i % outputs->size()].pos.x.ToFloat32() > 0);
+                       }
+                   }, ShutdownShader });
+    }
+}
+
+static const u32 FRAMEBUFFER_WIDTH = 400;
+static const u32 FRAMEBUFFER_HEIGHT = 240;
+
+/// Sets up an RGBA8 color buffer and a D16 depth buffer in VRAM, without texturing or blending
+static void SetupRasterizer() {
+    Settings::values.use_fastmem = false;
+    Settings::values.rasterizer_threads = 1;
+    Memory::Init();
+
+    auto& framebuffer = Pica::g_state.regs.framebuffer;
+    const PAddr color_buffer = Memory::VRAM_PADDR;
+    const PAddr depth_buffer = color_buffer + FRAMEBUFFER_WIDTH * FRAMEBUFFER_HEIGHT * 4;
+    framebuffer.color_format = Pica::Regs::ColorFormat::RGBA8;
+    framebuffer.depth_format = Pica::Regs::DepthFormat::D16;
+    framebuffer.color_buffer_address = color_buffer / 8;
+    framebuffer.depth_buffer_address = depth_buffer / 8;
+    framebuffer.width = FRAMEBUFFER_WIDTH;
+    framebuffer.height = FRAMEBUFFER_HEIGHT - 1;
+}
+
+static void ShutdownRasterizer() {
+    Pica::Rasterizer::Shutdown();
+    Pica::Shutdown();
+    Memory::Shutdown();
+}
+
+/// Triangles with the given size in pixels, spread over the framebuffer
+static std::shared_ptr<std::vector<OutputVertex>> MakeTriangles(int num_triangles, float size) {
+    auto vertices = std::make_shared<std::vector<OutputVertex>>(num_triangles * 3);
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> x_distribution(0.0f, FRAMEBUFFER_WIDTH - size);
+    std::uniform_real_distribution<float> y_distribution(0.0f, FRAMEBUFFER_HEIGHT - size);
+    std::uniform_real_distribution<float> color_distribution(0.0f, 1.0f);
+
+    for (int triangle = 0; triangle < num_triangles; ++triangle) {
+        const float x = x_distribution(generator), y = y_distribution(generator);
+        const float corners[3][2] = { { x, y }, { x + size, y }, { x, y + size } };
+        for (int i = 0; i < 3; ++i) {
+            OutputVertex& vertex = (*vertices)[triangle * 3 + i];
+            std::memset(&vertex, 0, sizeof(vertex));
+            vertex.pos.w = Pica::float24::FromFloat32(1.0f);
+            vertex.screenpos.x = Pica::float24::FromFloat32(corners[i][0]);
+            vertex.screenpos.y = Pica::float24::FromFloat32(corners[i][1]);
+            vertex.screenpos.z = Pica::float24::FromFloat32(0.5f);
+            for (int component = 0; component < 4; ++component)
+                vertex.color[component] = Pica::float24::FromFloat32(color_distribution(generator));
+        }
+    }
+    return vertices;
+}
+
+static void RegisterRasterizerBenchmarks() {
+    struct TriangleSet {
+        const char* name;
+        int num_triangles;
+        float size;
+    };
+    static const TriangleSet sets[] = {
+        { "small", 256, 8.0f },
+        { "medium", 64, 64.0f },
+        { "large", 4, 200.0f },
+    };
+
+    for (const TriangleSet& set : sets) {
+        auto vertices = MakeTriangles(set.num_triangles, set.size);
+        Register({ std::string("video/rasterizer/") + set.name, 0, SetupRasterizer,
+                   [vertices](u64 iterations) {
+                       for (u64 i = 0; i < iterations; ++i) {
+                           for (size_t vertex = 0; vertex < vertices->size(); vertex += 3) {
+                               Pica::Rasterizer::ProcessTriangle((*vertices)[vertex], (*vertices)[vertex + 1],
+                                                                 (*vertices)[vertex + 2]);
+                           }
+                           Pica::Rasterizer::Flush();
+                       }
+                   }, ShutdownRasterizer });
+    }
+}
+
+void RegisterVideoBenchmarks() {
+    RegisterShaderBenchmarks();
+    RegisterRasterizerBenchmarks();
+}
+
+} // namespace
@@ -0,0 +1,114 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "common/logging/log.h"
+#include "common/logging/backend.h"
+#include "common/logging/filter.h"
+
+#include "core/gpu_capture.h"
+#include "core/settings.h"
+#include "core/system.h"
+
+#include "citra/config.h"
+#include "citra/emu_window/emu_window_glfw.h"
+
+#include "video_core/gpu_thread.h"
+#include "video_core/video_core.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double ToMilliseconds(Clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(duration).count();
+}
+
+/// Replays a GPU capture through the renderer as fast as it goes and prints how long it took as JSON
+int main(int argc, char** argv) {
+    Log::Filter log_filter(Log::Level::Info);
+    Log::SetFilter(&log_filter);
+
+    // Usage: citra_gpu_replay [--sw | --hw] [--loops N] [--show] capture
+    std::string capture_filename;
+    int renderer = -1;
+    u64 loops = 1;
+    bool show = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--sw") {
+            renderer = 0;
+        } else if (arg == "--hw") {
+            renderer = 1;
+        } else if (arg == "--loops" && i + 1 < argc) {
+            loops = std::max<u64>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if (arg == "--show") {
+            show = true;
+        } else {
+            capture_filename = arg;
+        }
+    }
+
+    if (capture_filename.empty()) {
+        LOG_CRITICAL(Frontend, "Usage: citra_gpu_replay [--sw | --hw] [--loops N] [--show] capture");
+        return -1;
+    }
+
+    Config config;
+    log_filter.ParseFilterString(Settings::values.log_filter);
+    if (renderer != -1)
+        Settings::values.use_hw_renderer = renderer != 0;
+
+    // Without the window on screen, nothing waits for the display to refresh
+    EmuWindow_GLFW* emu_window = new EmuWindow_GLFW(!show);
+
+    VideoCore::g_hw_renderer_enabled = Settings::values.use_hw_renderer;
+
+    System::Init(emu_window);
+
+    if (!GPUCapture::LoadCapture(capture_filename)) {
+        System::Shutdown();
+        delete emu_window;
+        return -1;
+    }
+
+    u64 frames = 0;
+    Clock::duration max_frame_time = Clock::duration::zero();
+    const Clock::time_point start_time = Clock::now();
+    for (u64 loop = 0; loop < loops && emu_window->IsOpen(); ++loop) {
+        if (loop != 0)
+            GPUCapture::RestartReplay();
+
+        Clock::time_point frame_start = Clock::now();
+        while (emu_window->IsOpen() && GPUCapture::ReplayFrame()) {
+            // Window events have to be handled on the thread that created the window
+            if (GPUThread::IsEnabled())
+                emu_window->PollEvents();
+
+            const Clock::time_point now = Clock::now();
+            max_frame_time = std::max(max_frame_time, now - frame_start);
+            frame_start = now;
+            ++frames;
+        }
+    }
+    GPUThread::WaitIdle();
+    const Clock::duration host_time = Clock::now() - start_time;
+
+    const double seconds = ToMilliseconds(host_time) / 1000.0;
+    std::printf("{\"renderer\":\"%s\",\"frames\":%llu,\"host_seconds\":%.3f,\"fps\":%.2f,"
+                "\"avg_ms_per_frame\":%.3f,\"max_ms_per_frame\":%.3f}\n",
+                Settings::values.use_hw_renderer ? "hw" : "sw", (unsigned long long)frames, seconds,
+                seconds > 0 ? frames / seconds : 0.0, frames != 0 ? ToMilliseconds(host_time) / frames : 0.0,
+                ToMilliseconds(max_frame_time));
+    std::fflush(stdout);
+
+    System::Shutdown();
+
+    delete emu_window;
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/logging/log.h"
+#include "common/logging/backend.h"
+#include "common/logging/filter.h"
+
+#include "core/ipc_recording.h"
+#include "core/settings.h"
+#include "core/system.h"
+
+#include "citra/config.h"
+#include "citra/emu_window/emu_window_null.h"
+
+#include "video_core/video_core.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double ToMicroseconds(Common::Profiling::Duration duration) {
+    return std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(duration).count();
+}
+
+/// Host times of the replayed calls of one command of one service
+struct CommandTimes {
+    std::vector<double> microseconds;
+    double recorded_microseconds = 0.0;
+};
+
+/// Value below which the given fraction of the sorted samples lie
+static double GetPercentile(const std::vector<double>& sorted, double fraction) {
+    const size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+/// Replays the service calls of an IPC recording and prints the latency of each command as JSON
+int main(int argc, char** argv) {
+    Log::Filter log_filter(Log::Level::Info);
+    Log::SetFilter(&log_filter);
+
+    // Usage: citra_ipc_replay recording
+    if (argc != 2) {
+        LOG_CRITICAL(Frontend, "Usage: citra_ipc_replay recording");
+        return -1;
+    }
+
+    Config config;
+    log_filter.ParseFilterString(Settings::values.log_filter);
+    // Only the service layer runs: nothing is drawn, and file reads are timed until they're done
+    Settings::values.renderer_backend = static_cast<int>(VideoCore::RendererBackend::Null);
+    Settings::values.use_hw_renderer = false;
+    Settings::values.async_file_io = false;
+
+    EmuWindow_Null emu_window;
+    VideoCore::g_hw_renderer_enabled = false;
+    System::Init(&emu_window);
+
+    if (!IPCRecording::LoadRecording(argv[1])) {
+        System::Shutdown();
+        return -1;
+    }
+
+    std::map<std::pair<std::string, u32>, CommandTimes> commands;
+    u64 calls = 0, skipped = 0, mismatched_results = 0;
+    const Clock::time_point start_time = Clock::now();
+    IPCRecording::ReplayedCall call;
+    while (IPCRecording::ReplayNextCall(call)) {
+        if (!call.replayed) {
+            ++skipped;
+            continue;
+        }
+        ++calls;
+        if (!call.result_matches)
+            ++mismatched_results;
+
+        CommandTimes& times = commands[std::make_pair(call.name, call.header)];
+        times.microseconds.push_back(ToMicroseconds(call.host_time));
+        times.recorded_microseconds += ToMicroseconds(call.recorded_time);
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    std::printf("{\"calls\":%llu,\"skipped\":%llu,\"mismatched_results\":%llu,\"host_seconds\":%.3f,\"commands\":[",
+                (unsigned long long)calls, (unsigned long long)skipped, (unsigned long long)mismatched_results,
+                seconds);
+    bool first = true;
+    for (auto& command : commands) {
+        std::vector<double>& samples = command.second.microseconds;
+        std::sort(samples.begin(), samples.end());
+        double total = 0.0;
+        for (double sample : samples)
+            total += sample;
+
+        std::printf("%s{\"service\":\"%s\",\"header\":\"0x%08X\",\"count\":%u,\"mean_us\":%.3f,"
+                    "\"p50_us\":%.3f,\"p90_us\":%.3f,\"p99_us\":%.3f,\"max_us\":%.3f,\"recorded_mean_us\":%.3f}",
+                    first ? "" : ",", command.first.first.c_str(), command.first.second,
+                    (unsigned)samples.size(), total / samples.size(), GetPercentile(samples, 0.5),
+                    GetPercentile(samples, 0.9), GetPercentile(samples, 0.99), samples.back(),
+                    command.second.recorded_microseconds / samples.size());
+        first = false;
+    }
+    std::printf("]}\n");
+    std::fflush(stdout);
+
+    System::Shutdown();
+
+    return 0;
+}
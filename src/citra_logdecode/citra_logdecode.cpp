@@ -0,0 +1,117 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <array>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/logging/backend.h"
+#include "common/logging/text_formatter.h"
+
+/// Call site of the messages in a binary log, as recorded in it
+struct RecordedCallSite {
+    Log::Class log_class;
+    Log::Level log_level;
+    std::string location;
+    std::string format;
+};
+
+template <typename T>
+static bool Read(std::FILE* file, T& value) {
+    return std::fread(&value, sizeof(value), 1, file) == 1;
+}
+
+static bool ReadString(std::FILE* file, std::string& string) {
+    u16 length;
+    if (!Read(file, length))
+        return false;
+    string.resize(length);
+    return length == 0 || std::fread(&string[0], 1, length, file) == length;
+}
+
+/// Prints a binary log written with Log::StartBinaryLog as text, the way the log would have been printed
+int main(int argc, char** argv) {
+    // Usage: citra_logdecode log
+    if (argc != 2) {
+        std::fprintf(stderr, "Usage: citra_logdecode log\n");
+        return -1;
+    }
+
+    std::FILE* file = std::fopen(argv[1], "rb");
+    if (file == nullptr) {
+        std::fprintf(stderr, "Can't open %s\n", argv[1]);
+        return -1;
+    }
+
+    u32 magic, version;
+    if (!Read(file, magic) || !Read(file, version) || magic != Log::BINARY_LOG_MAGIC ||
+            version != Log::BINARY_LOG_VERSION) {
+        std::fprintf(stderr, "%s isn't a binary log of this version\n", argv[1]);
+        std::fclose(file);
+        return -1;
+    }
+
+    std::vector<RecordedCallSite> call_sites;
+    std::vector<u8> arguments;
+    std::array<char, 4 * 1024> text;
+    u8 type;
+    bool truncated = false;
+    while (Read(file, type)) {
+        if (type == static_cast<u8>(Log::BinaryRecord::CallSite)) {
+            u32 id, line_nr;
+            u8 log_class, log_level;
+            std::string filename, function;
+            RecordedCallSite call_site;
+            if (!Read(file, id) || !Read(file, log_class) || !Read(file, log_level) || !Read(file, line_nr) ||
+                    !ReadString(file, filename) || !ReadString(file, function) || !ReadString(file, call_site.format)) {
+                truncated = true;
+                break;
+            }
+            call_site.log_class = static_cast<Log::Class>(log_class);
+            call_site.log_level = static_cast<Log::Level>(log_level);
+            call_site.location = filename + ":" + function + ":" + std::to_string(line_nr);
+            if (call_sites.size() <= id)
+                call_sites.resize(id + 1);
+            call_sites[id] = std::move(call_site);
+        } else if (type == static_cast<u8>(Log::BinaryRecord::Message)) {
+            u32 id;
+            u64 timestamp;
+            u16 size;
+            if (!Read(file, id) || !Read(file, timestamp) || !Read(file, size)) {
+                truncated = true;
+                break;
+            }
+            arguments.resize(size);
+            if (size != 0 && std::fread(arguments.data(), 1, size, file) != size) {
+                truncated = true;
+                break;
+            }
+            if (id >= call_sites.size()) {
+                std::fprintf(stderr, "Message of unknown call site %u\n", id);
+                continue;
+            }
+
+            const RecordedCallSite& call_site = call_sites[id];
+            Log::Entry entry;
+            entry.timestamp = std::chrono::microseconds(timestamp);
+            entry.log_class = call_site.log_class;
+            entry.log_level = call_site.log_level;
+            entry.location = call_site.location;
+            entry.message = Log::FormatRawArguments(call_site.format.c_str(), arguments.data(), size);
+            Log::FormatLogMessage(entry, text.data(), text.size());
+            std::puts(text.data());
+        } else {
+            std::fprintf(stderr, "Unknown record type %u\n", type);
+            truncated = true;
+            break;
+        }
+    }
+
+    if (truncated)
+        std::fprintf(stderr, "%s ends with an incomplete record\n", argv[1]);
+    std::fclose(file);
+    return 0;
+}
@@ -11,8 +11,12 @@
 #include "bootmanager.h"
 #include "main.h"
 
+#include "common/thread_policy.h"
+
+#include "core/breakpoints.h"
 #include "core/core.h"
 #include "core/settings.h"
+#include "core/hle/service/hid/hid.h"
 #include "core/system.h"
 
 #include "video_core/debug_utils/debug_utils.h"
@@ -31,37 +35,37 @@ EmuThread::EmuThread(GRenderWindow* render_window) :
 }
 
 void EmuThread::run() {
+    Common::RegisterCurrentThread("EmuThread", Common::ThreadClass::Emulation);
     render_window->MakeCurrent();
 
     stop_run = false;
 
-    // holds whether the cpu was running during the last iteration,
-    // so that the DebugModeLeft signal can be emitted before the
-    // next execution step
-    bool was_active = false;
+    // The state is only looked at between frames, where DebugModeLeft and DebugModeEntered are
+    // emitted once when the CPU starts and stops instead of around every run of the CPU
     while (!stop_run) {
         if (running) {
-            if (!was_active)
-                emit DebugModeLeft();
+            emit DebugModeLeft();
+            Breakpoints::ResumeFrom(Core::g_app_core->GetPC());
 
-            Core::RunLoop();
+            while (running && !stop_run) {
+                if (Core::RunFrame())
+                    SetRunning(false);
+            }
 
-            was_active = running || exec_step;
-            if (!was_active && !stop_run)
+            if (!stop_run)
                 emit DebugModeEntered();
         } else if (exec_step) {
-            if (!was_active)
-                emit DebugModeLeft();
+            emit DebugModeLeft();
 
             exec_step = false;
+            Breakpoints::ResumeFrom(Core::g_app_core->GetPC());
             Core::SingleStep();
+            Breakpoints::ConsumeHit();
             emit DebugModeEntered();
             yieldCurrentThread();
-
-            was_active = false;
         } else {
             std::unique_lock<std::mutex> lock(running_mutex);
-            running_cv.wait(lock, [this]{ return IsRunning() || stop_run; });
+            running_cv.wait(lock, [this]{ return IsRunning() || exec_step || stop_run; });
         }
     }
 
@@ -214,11 +218,13 @@ QByteArray GRenderWindow::saveGeometry()
 void GRenderWindow::keyPressEvent(QKeyEvent* event)
 {
     this->KeyPressed({event->key(), keyboard_id});
+    Service::HID::NotifyInputChanged();
 }
 
 void GRenderWindow::keyReleaseEvent(QKeyEvent* event)
 {
     this->KeyReleased({event->key(), keyboard_id});
+    Service::HID::NotifyInputChanged();
 }
 
 void GRenderWindow::mousePressEvent(QMouseEvent *event)
@@ -227,6 +233,7 @@ void GRenderWindow::mousePressEvent(QMouseEvent *event)
     {
         auto pos = event->pos();
         this->TouchPressed(static_cast<unsigned>(pos.x()), static_cast<unsigned>(pos.y()));
+        Service::HID::NotifyInputChanged();
     }
 }
 
@@ -234,12 +241,15 @@ void GRenderWindow::mouseMoveEvent(QMouseEvent *event)
 {
     auto pos = event->pos();
     this->TouchMoved(static_cast<unsigned>(std::max(pos.x(), 0)), static_cast<unsigned>(std::max(pos.y(), 0)));
+    Service::HID::NotifyInputChanged();
 }
 
 void GRenderWindow::mouseReleaseEvent(QMouseEvent *event)
 {
-    if (event->button() == Qt::LeftButton)
+    if (event->button() == Qt::LeftButton) {
         this->TouchReleased();
+        Service::HID::NotifyInputChanged();
+    }
 }
 
 void GRenderWindow::ReloadSetKeymaps()
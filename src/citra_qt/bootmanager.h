@@ -35,10 +35,16 @@ public:
      * Steps the emulation thread by a single CPU instruction (if the CPU is not already running)
      * @note This function is thread-safe
      */
-    void ExecStep() { exec_step = true; }
+    void ExecStep() {
+        std::unique_lock<std::mutex> lock(running_mutex);
+        exec_step = true;
+        lock.unlock();
+        running_cv.notify_all();
+    }
 
     /**
-     * Sets whether the emulation thread is running or not
+     * Sets whether the emulation thread is running or not. Pausing takes effect at the end of the
+     * frame being emulated.
      * @param running Boolean value, set the emulation thread to running if true
      * @note This function is thread-safe
      */
@@ -65,8 +71,8 @@ public:
     };
 
 private:
-    bool exec_step;
-    bool running;
+    std::atomic<bool> exec_step;
+    std::atomic<bool> running;
     std::atomic<bool> stop_run;
     std::mutex running_mutex;
     std::condition_variable running_cv;
@@ -46,14 +46,42 @@ void Config::ReadValues() {
     Settings::values.pad_cdown_key  = qt_config->value("pad_cdown",  Qt::Key_K).toInt();
     Settings::values.pad_cleft_key  = qt_config->value("pad_cleft",  Qt::Key_J).toInt();
     Settings::values.pad_cright_key = qt_config->value("pad_cright", Qt::Key_L).toInt();
+    Settings::values.hid_update_rate = qt_config->value("hid_update_rate", 60).toInt();
     qt_config->endGroup();
 
     qt_config->beginGroup("Core");
     Settings::values.frame_skip = qt_config->value("frame_skip", 0).toInt();
+    Settings::values.dynamic_frame_skip = qt_config->value("dynamic_frame_skip", false).toBool();
+    Settings::values.speed_limit = qt_config->value("speed_limit", 100).toInt();
+    Settings::values.use_cpu_jit = qt_config->value("use_cpu_jit", false).toBool();
+    Settings::values.threaded_interpreter = qt_config->value("threaded_interpreter", false).toBool();
+    Settings::values.cpu_cache_size = qt_config->value("cpu_cache_size", 32).toInt();
+    Settings::values.persist_cpu_blocks = qt_config->value("persist_cpu_blocks", true).toBool();
+    Settings::values.profile_cpu = qt_config->value("profile_cpu", false).toBool();
+    Settings::values.use_fastmem = qt_config->value("use_fastmem", false).toBool();
+    Settings::values.use_huge_pages = qt_config->value("use_huge_pages", false).toBool();
+    Settings::values.max_slice_length = qt_config->value("max_slice_length", 1000000).toInt();
+    Settings::values.rewind_enabled = qt_config->value("rewind_enabled", false).toBool();
+    Settings::values.rewind_interval = qt_config->value("rewind_interval", 60).toInt();
+    Settings::values.rewind_buffer_size = qt_config->value("rewind_buffer_size", 256).toInt();
+    Settings::values.pin_threads = qt_config->value("pin_threads", false).toBool();
+    Settings::values.emu_thread_core = qt_config->value("emu_thread_core", -1).toInt();
+    Settings::values.gpu_thread_core = qt_config->value("gpu_thread_core", -1).toInt();
+    Settings::values.raise_thread_priority = qt_config->value("raise_thread_priority", false).toBool();
+    Settings::values.hle_guest_routines = qt_config->value("hle_guest_routines", true).toBool();
     qt_config->endGroup();
 
     qt_config->beginGroup("Renderer");
+    Settings::values.renderer_backend = qt_config->value("renderer_backend", 0).toInt();
     Settings::values.use_hw_renderer = qt_config->value("use_hw_renderer", false).toBool();
+    Settings::values.vertex_cache_size = qt_config->value("vertex_cache_size", 32).toInt();
+    Settings::values.texture_cache_size = qt_config->value("texture_cache_size", 256).toInt();
+    Settings::values.use_shader_jit = qt_config->value("use_shader_jit", false).toBool();
+    Settings::values.use_hw_vertex_shaders = qt_config->value("use_hw_vertex_shaders", false).toBool();
+    Settings::values.rasterizer_threads = qt_config->value("rasterizer_threads", 1).toInt();
+    Settings::values.debug_capture = qt_config->value("debug_capture", false).toBool();
+    Settings::values.texture_disk_cache = qt_config->value("texture_disk_cache", false).toBool();
+    Settings::values.show_perf_overlay = qt_config->value("show_perf_overlay", false).toBool();
 
     Settings::values.bg_red   = qt_config->value("bg_red",   1.0).toFloat();
     Settings::values.bg_green = qt_config->value("bg_green", 1.0).toFloat();
@@ -62,6 +90,8 @@ void Config::ReadValues() {
 
     qt_config->beginGroup("Data Storage");
     Settings::values.use_virtual_sd = qt_config->value("use_virtual_sd", true).toBool();
+    Settings::values.async_file_io = qt_config->value("async_file_io", false).toBool();
+    Settings::values.write_back_save_data = qt_config->value("write_back_save_data", true).toBool();
     qt_config->endGroup();
 
     qt_config->beginGroup("System Region");
@@ -70,6 +100,14 @@ void Config::ReadValues() {
 
     qt_config->beginGroup("Miscellaneous");
     Settings::values.log_filter = qt_config->value("log_filter", "*:Info").toString().toStdString();
+    Settings::values.svc_statistics_file = qt_config->value("svc_statistics_file", "").toString().toStdString();
+    Settings::values.trace_file = qt_config->value("trace_file", "").toString().toStdString();
+    Settings::values.guest_profile_file = qt_config->value("guest_profile_file", "").toString().toStdString();
+    Settings::values.guest_profile_interval = qt_config->value("guest_profile_interval", 50000).toInt();
+    Settings::values.memory_stats_file = qt_config->value("memory_stats_file", "").toString().toStdString();
+    Settings::values.memory_stats_interval = qt_config->value("memory_stats_interval", 64).toInt();
+    Settings::values.metrics_http_port = qt_config->value("metrics_http_port", 0).toInt();
+    Settings::values.metrics_statsd_address = qt_config->value("metrics_statsd_address", "").toString().toStdString();
     qt_config->endGroup();
 }
 
@@ -98,14 +136,42 @@ void Config::SaveValues() {
     qt_config->setValue("pad_cdown",  Settings::values.pad_cdown_key);
     qt_config->setValue("pad_cleft",  Settings::values.pad_cleft_key);
     qt_config->setValue("pad_cright", Settings::values.pad_cright_key);
+    qt_config->setValue("hid_update_rate", Settings::values.hid_update_rate);
     qt_config->endGroup();
 
     qt_config->beginGroup("Core");
     qt_config->setValue("frame_skip", Settings::values.frame_skip);
+    qt_config->setValue("dynamic_frame_skip", Settings::values.dynamic_frame_skip);
+    qt_config->setValue("speed_limit", Settings::values.speed_limit);
+    qt_config->setValue("use_cpu_jit", Settings::values.use_cpu_jit);
+    qt_config->setValue("threaded_interpreter", Settings::values.threaded_interpreter);
+    qt_config->setValue("cpu_cache_size", Settings::values.cpu_cache_size);
+    qt_config->setValue("persist_cpu_blocks", Settings::values.persist_cpu_blocks);
+    qt_config->setValue("profile_cpu", Settings::values.profile_cpu);
+    qt_config->setValue("use_fastmem", Settings::values.use_fastmem);
+    qt_config->setValue("use_huge_pages", Settings::values.use_huge_pages);
+    qt_config->setValue("max_slice_length", Settings::values.max_slice_length);
+    qt_config->setValue("rewind_enabled", Settings::values.rewind_enabled);
+    qt_config->setValue("rewind_interval", Settings::values.rewind_interval);
+    qt_config->setValue("rewind_buffer_size", Settings::values.rewind_buffer_size);
+    qt_config->setValue("pin_threads", Settings::values.pin_threads);
+    qt_config->setValue("emu_thread_core", Settings::values.emu_thread_core);
+    qt_config->setValue("gpu_thread_core", Settings::values.gpu_thread_core);
+    qt_config->setValue("raise_thread_priority", Settings::values.raise_thread_priority);
+    qt_config->setValue("hle_guest_routines", Settings::values.hle_guest_routines);
     qt_config->endGroup();
 
     qt_config->beginGroup("Renderer");
+    qt_config->setValue("renderer_backend", Settings::values.renderer_backend);
     qt_config->setValue("use_hw_renderer", Settings::values.use_hw_renderer);
+    qt_config->setValue("vertex_cache_size", Settings::values.vertex_cache_size);
+    qt_config->setValue("texture_cache_size", Settings::values.texture_cache_size);
+    qt_config->setValue("use_shader_jit", Settings::values.use_shader_jit);
+    qt_config->setValue("use_hw_vertex_shaders", Settings::values.use_hw_vertex_shaders);
+    qt_config->setValue("rasterizer_threads", Settings::values.rasterizer_threads);
+    qt_config->setValue("debug_capture", Settings::values.debug_capture);
+    qt_config->setValue("texture_disk_cache", Settings::values.texture_disk_cache);
+    qt_config->setValue("show_perf_overlay", Settings::values.show_perf_overlay);
 
     // Cast to double because Qt's written float values are not human-readable
     qt_config->setValue("bg_red",   (double)Settings::values.bg_red);
@@ -115,6 +181,8 @@ void Config::SaveValues() {
 
     qt_config->beginGroup("Data Storage");
     qt_config->setValue("use_virtual_sd", Settings::values.use_virtual_sd);
+    qt_config->setValue("async_file_io", Settings::values.async_file_io);
+    qt_config->setValue("write_back_save_data", Settings::values.write_back_save_data);
     qt_config->endGroup();
 
     qt_config->beginGroup("System Region");
@@ -123,6 +191,14 @@ void Config::SaveValues() {
 
     qt_config->beginGroup("Miscellaneous");
     qt_config->setValue("log_filter", QString::fromStdString(Settings::values.log_filter));
+    qt_config->setValue("svc_statistics_file", QString::fromStdString(Settings::values.svc_statistics_file));
+    qt_config->setValue("trace_file", QString::fromStdString(Settings::values.trace_file));
+    qt_config->setValue("guest_profile_file", QString::fromStdString(Settings::values.guest_profile_file));
+    qt_config->setValue("guest_profile_interval", Settings::values.guest_profile_interval);
+    qt_config->setValue("memory_stats_file", QString::fromStdString(Settings::values.memory_stats_file));
+    qt_config->setValue("memory_stats_interval", Settings::values.memory_stats_interval);
+    qt_config->setValue("metrics_http_port", Settings::values.metrics_http_port);
+    qt_config->setValue("metrics_statsd_address", QString::fromStdString(Settings::values.metrics_statsd_address));
     qt_config->endGroup();
 }
 
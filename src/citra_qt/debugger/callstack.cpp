@@ -5,6 +5,7 @@
 #include <QStandardItemModel>
 
 #include "callstack.h"
+#include "memory_snapshot.h"
 
 #include "core/core.h"
 #include "core/arm/arm_interface.h"
@@ -34,10 +35,16 @@ void CallstackWidget::OnDebugModeEntered()
 
     Clear();
 
+    // The stack is copied in one go rather than read a word at a time
+    const u32 stack_top = 0x10000000;
+    MemorySnapshot stack;
+    if (sp <= stack_top)
+        stack.Capture(sp, stack_top - sp + 4);
+
     int counter = 0;
-    for (u32 addr = 0x10000000; addr >= sp; addr -= 4)
+    for (u32 addr = stack_top; addr >= sp; addr -= 4)
     {
-        ret_addr = Memory::Read32(addr);
+        ret_addr = stack.Read32(addr);
         call_addr = ret_addr - 4; //get call address???
 
         if (Memory::GetPointer(call_addr) == nullptr)
@@ -64,7 +71,9 @@ void CallstackWidget::OnDebugModeEntered()
             callstack_model->setItem(counter, 1, new QStandardItem(QString("0x%1").arg(ret_addr, 8, 16, QLatin1Char('0'))));
             callstack_model->setItem(counter, 2, new QStandardItem(QString("0x%1").arg(call_addr, 8, 16, QLatin1Char('0'))));
 
-            name = Symbols::HasSymbol(func_addr) ? Symbols::GetSymbol(func_addr).name : "unknown";
+            name = Symbols::GetContainingSymbol(func_addr).name;
+            if (name.empty())
+                name = "unknown";
             callstack_model->setItem(counter, 3, new QStandardItem(QString("%1_%2").arg(QString::fromStdString(name))
                 .arg(QString("0x%1").arg(func_addr, 8, 16, QLatin1Char('0')))));
 
@@ -2,6 +2,10 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+
+#include <QScrollBar>
+
 #include "disassembler.h"
 
 #include "../bootmanager.h"
@@ -9,6 +13,7 @@
 
 #include "core/memory.h"
 
+#include "core/breakpoints.h"
 #include "core/core.h"
 #include "common/break_points.h"
 #include "common/symbols.h"
@@ -34,12 +39,17 @@ QVariant DisassemblerModel::data(const QModelIndex& index, int role) const {
         case Qt::DisplayRole:
         {
             u32 address = base_address + index.row() * 4;
-            u32 instr = Memory::Read32(address);
+            if (index.column() == 0)
+                return QString("0x%1").arg((uint)(address), 8, 16, QLatin1Char('0'));
+
+            // Rows scrolled into view are filled in at the next capture
+            if (!snapshot.Contains(address, 4))
+                break;
+
+            u32 instr = snapshot.Read32(address);
             std::string disassembly = ARM_Disasm::Disassemble(address, instr);
 
-            if (index.column() == 0) {
-                return QString("0x%1").arg((uint)(address), 8, 16, QLatin1Char('0'));
-            } else if (index.column() == 1) {
+            if (index.column() == 1) {
                 return QString::fromStdString(disassembly);
             } else if (index.column() == 2) {
                 if(Symbols::HasSymbol(address)) {
@@ -128,6 +138,16 @@ void DisassemblerModel::ParseFromAddress(unsigned int address) {
     SetNextInstruction(address);
 }
 
+void DisassemblerModel::CaptureRows(int first_row, int num_rows) {
+    first_row = std::max(first_row, 0);
+    num_rows = std::min(num_rows, rowCount() - first_row);
+    if (num_rows <= 0)
+        return;
+
+    snapshot.Capture(base_address + first_row * 4, num_rows * 4);
+    emit dataChanged(index(first_row, 1), index(first_row + num_rows - 1, 2));
+}
+
 void DisassemblerModel::OnSelectionChanged(const QModelIndex& new_selection) {
     selection = new_selection;
 }
@@ -140,8 +160,10 @@ void DisassemblerModel::OnSetOrUnsetBreakpoint() {
 
     if (breakpoints.IsAddressBreakPoint(address)) {
         breakpoints.Remove(address);
+        Breakpoints::RemoveCodeBreakpoint(address);
     } else {
         breakpoints.Add(address);
+        Breakpoints::AddCodeBreakpoint(address);
     }
 
     emit dataChanged(selection, selection);
@@ -158,10 +180,16 @@ void DisassemblerModel::SetNextInstruction(unsigned int address) {
 }
 
 DisassemblerWidget::DisassemblerWidget(QWidget* parent, EmuThread* emu_thread) :
-    QDockWidget(parent), emu_thread(emu_thread), base_addr(0) {
+    QDockWidget(parent), model(nullptr), base_addr(0), emu_thread(emu_thread) {
 
     disasm_ui.setupUi(this);
 
+    // Scrolling captures the rows in view a few times per second at most
+    refresh_throttle = new RefreshThrottle(100, this);
+    connect(refresh_throttle, SIGNAL(Refresh()), this, SLOT(OnRefresh()));
+    connect(disasm_ui.treeView->verticalScrollBar(), SIGNAL(valueChanged(int)), refresh_throttle, SLOT(Request()));
+    connect(disasm_ui.treeView->verticalScrollBar(), SIGNAL(rangeChanged(int, int)), refresh_throttle, SLOT(Request()));
+
     RegisterHotkey("Disassembler", "Start/Stop", QKeySequence(Qt::Key_F5), Qt::ApplicationShortcut);
     RegisterHotkey("Disassembler", "Step", QKeySequence(Qt::Key_F10), Qt::ApplicationShortcut);
     RegisterHotkey("Disassembler", "Step into", QKeySequence(Qt::Key_F11), Qt::ApplicationShortcut);
@@ -188,6 +216,7 @@ void DisassemblerWidget::Init() {
     QModelIndex model_index = model->IndexFromAbsoluteAddress(Core::g_app_core->GetPC());
     disasm_ui.treeView->scrollTo(model_index);
     disasm_ui.treeView->selectionModel()->setCurrentIndex(model_index, QItemSelectionModel::SelectCurrent | QItemSelectionModel::Rows);
+    OnRefresh();
 }
 
 void DisassemblerWidget::OnContinue() {
@@ -219,19 +248,35 @@ void DisassemblerWidget::OnToggleStartStop() {
 void DisassemblerWidget::OnDebugModeEntered() {
     ARMword next_instr = Core::g_app_core->GetPC();
 
-    if (model->GetBreakPoints().IsAddressBreakPoint(next_instr))
-        emu_thread->SetRunning(false);
-
     model->SetNextInstruction(next_instr);
 
     QModelIndex model_index = model->IndexFromAbsoluteAddress(next_instr);
     disasm_ui.treeView->scrollTo(model_index);
     disasm_ui.treeView->selectionModel()->setCurrentIndex(model_index, QItemSelectionModel::SelectCurrent | QItemSelectionModel::Rows);
+
+    // The emulation thread waits for this slot, so the capture sees the code it stopped in
+    OnRefresh();
 }
 
 void DisassemblerWidget::OnDebugModeLeft() {
 }
 
+void DisassemblerWidget::OnRefresh() {
+    if (model == nullptr || disasm_ui.treeView->model() != model)
+        return;
+
+    const QWidget* viewport = disasm_ui.treeView->viewport();
+    const QModelIndex top = disasm_ui.treeView->indexAt(QPoint(0, 0));
+    const QModelIndex bottom = disasm_ui.treeView->indexAt(QPoint(0, viewport->height() - 1));
+    const int first_row = top.isValid() ? top.row() : 0;
+    const int last_row = bottom.isValid() ? bottom.row() : model->rowCount() - 1;
+
+    // Captures a screen worth of rows above and below as well, so that small scrolls show the code
+    // straight away
+    const int visible_rows = last_row - first_row + 1;
+    model->CaptureRows(first_row - visible_rows, visible_rows * 3);
+}
+
 int DisassemblerWidget::SelectedRow() {
     QModelIndex index = disasm_ui.treeView->selectionModel()->currentIndex();
     if (!index.isValid())
@@ -258,6 +303,7 @@ void DisassemblerWidget::OnEmulationStarting(EmuThread* emu_thread) {
 void DisassemblerWidget::OnEmulationStopping() {
     disasm_ui.treeView->setModel(nullptr);
     delete model;
+    model = nullptr;
     emu_thread = nullptr;
     setEnabled(false);
 }
@@ -12,6 +12,8 @@
 #include "common/break_points.h"
 #include "common/common_types.h"
 
+#include "memory_snapshot.h"
+
 class QAction;
 class EmuThread;
 
@@ -35,6 +37,9 @@ public slots:
     void OnSetOrUnsetBreakpoint();
     void SetNextInstruction(unsigned int address);
 
+    /// Copies the code shown by a range of rows, which are the only ones displayed until the next call
+    void CaptureRows(int first_row, int num_rows);
+
 private:
     unsigned int base_address;
     unsigned int code_size;
@@ -42,6 +47,8 @@ private:
 
     QModelIndex selection;
 
+    MemorySnapshot snapshot;
+
     // TODO: Make BreakPoints less crappy (i.e. const-correct) so that this needn't be mutable.
     mutable BreakPoints breakpoints;
 };
@@ -68,6 +75,10 @@ public slots:
     void OnEmulationStarting(EmuThread* emu_thread);
     void OnEmulationStopping();
 
+private slots:
+    /// Captures the code of the rows in view
+    void OnRefresh();
+
 private:
     // returns -1 if no row is selected
     int SelectedRow();
@@ -78,5 +89,7 @@ private:
 
     u32 base_addr;
 
+    RefreshThrottle* refresh_throttle;
+
     EmuThread* emu_thread;
 };
@@ -2,8 +2,10 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <QCheckBox>
 #include <QMetaType>
 #include <QPushButton>
+#include <QTimer>
 #include <QTreeWidget>
 #include <QVBoxLayout>
 #include <QLabel>
@@ -16,9 +18,10 @@
 BreakPointModel::BreakPointModel(std::shared_ptr<Pica::DebugContext> debug_context, QObject* parent)
     : QAbstractListModel(parent), context_weak(debug_context),
       at_breakpoint(debug_context->at_breakpoint),
-      active_breakpoint(debug_context->active_breakpoint)
+      active_breakpoint(debug_context->active_breakpoint),
+      event_log_position(0)
 {
-
+    logged_counts.fill(0);
 }
 
 int BreakPointModel::columnCount(const QModelIndex& parent) const
@@ -55,7 +58,11 @@ QVariant BreakPointModel::data(const QModelIndex& index, int role) const
         }
 
         case 1:
-            return data(index, Role_IsEnabled).toBool() ? tr("Enabled") : tr("Disabled");
+            if (!data(index, Role_IsEnabled).toBool())
+                return tr("Disabled");
+            if (data(index, Role_IsLogOnly).toBool())
+                return tr("Logging (%1 hits)").arg(logged_counts[index.row()]);
+            return tr("Enabled");
 
         default:
             break;
@@ -75,7 +82,13 @@ QVariant BreakPointModel::data(const QModelIndex& index, int role) const
     case Role_IsEnabled:
     {
         auto context = context_weak.lock();
-        return context && context->breakpoints[event].enabled;
+        return context && context->GetBreakPoint(event).enabled;
+    }
+
+    case Role_IsLogOnly:
+    {
+        auto context = context_weak.lock();
+        return context && context->GetBreakPoint(event).log_only;
     }
 
     default:
@@ -108,12 +121,20 @@ bool BreakPointModel::setData(const QModelIndex& index, const QVariant& value, i
 
     switch (role) {
     case Role_IsEnabled:
+    case Role_IsLogOnly:
     {
         auto context = context_weak.lock();
         if (!context)
             return false;
 
-        context->breakpoints[event].enabled = value.toBool();
+        auto breakpoint = context->GetBreakPoint(event);
+        if (role == Role_IsEnabled) {
+            breakpoint.enabled = value.toBool();
+        } else {
+            breakpoint.log_only = value.toBool();
+        }
+        context->SetBreakPoint(event, breakpoint);
+
         QModelIndex changed_index = createIndex(index.row(), 1);
         emit dataChanged(changed_index, changed_index);
         return true;
@@ -148,6 +169,22 @@ void BreakPointModel::OnResumed()
     active_breakpoint = context->active_breakpoint;
 }
 
+void BreakPointModel::OnUpdateLoggedEvents()
+{
+    auto context = context_weak.lock();
+    if (!context)
+        return;
+
+    logged_events.clear();
+    event_log_position = context->ReadEventLog(event_log_position, logged_events);
+    if (logged_events.empty())
+        return;
+
+    for (const auto& logged_event : logged_events)
+        ++logged_counts[static_cast<size_t>(logged_event.event)];
+    emit dataChanged(createIndex(0, 1), createIndex(rowCount() - 1, 1));
+}
+
 
 GraphicsBreakPointsWidget::GraphicsBreakPointsWidget(std::shared_ptr<Pica::DebugContext> debug_context,
                                                      QWidget* parent)
@@ -167,6 +204,14 @@ GraphicsBreakPointsWidget::GraphicsBreakPointsWidget(std::shared_ptr<Pica::Debug
     toggle_breakpoint_button = new QPushButton(tr("Enable"));
     toggle_breakpoint_button->setEnabled(false);
 
+    log_only_checkbox = new QCheckBox(tr("Log without halting"));
+    log_only_checkbox->setEnabled(false);
+
+    // Logging breakpoints don't notify the observers, the hit counts are polled instead
+    QTimer* log_timer = new QTimer(this);
+    log_timer->start(500);
+    connect(log_timer, SIGNAL(timeout()), breakpoint_model, SLOT(OnUpdateLoggedEvents()));
+
     qRegisterMetaType<Pica::DebugContext::Event>("Pica::DebugContext::Event");
 
     connect(resume_button, SIGNAL(clicked()), this, SLOT(OnResumeRequested()));
@@ -188,6 +233,7 @@ GraphicsBreakPointsWidget::GraphicsBreakPointsWidget(std::shared_ptr<Pica::Debug
             this, SLOT(OnBreakpointSelectionChanged(QModelIndex)));
 
     connect(toggle_breakpoint_button, SIGNAL(clicked()), this, SLOT(OnToggleBreakpointEnabled()));
+    connect(log_only_checkbox, SIGNAL(toggled(bool)), this, SLOT(OnLogOnlyToggled(bool)));
 
     QWidget* main_widget = new QWidget;
     auto main_layout = new QVBoxLayout;
@@ -198,7 +244,12 @@ GraphicsBreakPointsWidget::GraphicsBreakPointsWidget(std::shared_ptr<Pica::Debug
         main_layout->addLayout(sub_layout);
     }
     main_layout->addWidget(breakpoint_list);
-    main_layout->addWidget(toggle_breakpoint_button);
+    {
+        auto sub_layout = new QHBoxLayout;
+        sub_layout->addWidget(toggle_breakpoint_button);
+        sub_layout->addWidget(log_only_checkbox);
+        main_layout->addLayout(sub_layout);
+    }
     main_widget->setLayout(main_layout);
 
     setWidget(main_widget);
@@ -238,10 +289,12 @@ void GraphicsBreakPointsWidget::OnBreakpointSelectionChanged(const QModelIndex&
 {
     if (!index.isValid()) {
         toggle_breakpoint_button->setEnabled(false);
+        log_only_checkbox->setEnabled(false);
         return;
     }
 
     toggle_breakpoint_button->setEnabled(true);
+    log_only_checkbox->setEnabled(true);
     UpdateToggleBreakpointButton(index);
 }
 
@@ -255,8 +308,17 @@ void GraphicsBreakPointsWidget::OnToggleBreakpointEnabled()
     UpdateToggleBreakpointButton(index);
 }
 
+void GraphicsBreakPointsWidget::OnLogOnlyToggled(bool log_only)
+{
+    QModelIndex index = breakpoint_list->selectionModel()->currentIndex();
+    if (index.isValid())
+        breakpoint_model->setData(index, log_only, BreakPointModel::Role_IsLogOnly);
+}
+
 void GraphicsBreakPointsWidget::UpdateToggleBreakpointButton(const QModelIndex& index)
 {
+    log_only_checkbox->setChecked(breakpoint_model->data(index, BreakPointModel::Role_IsLogOnly).toBool());
+
     if (true == breakpoint_model->data(index, BreakPointModel::Role_IsEnabled).toBool()) {
         toggle_breakpoint_button->setText(tr("Disable"));
     } else {
@@ -11,6 +11,7 @@
 
 #include "video_core/debug_utils/debug_utils.h"
 
+class QCheckBox;
 class QLabel;
 class QPushButton;
 class QTreeView;
@@ -35,6 +36,7 @@ public slots:
     void OnResumed();
     void OnBreakpointSelectionChanged(const QModelIndex&);
     void OnToggleBreakpointEnabled();
+    void OnLogOnlyToggled(bool log_only);
 
 signals:
     void Resumed();
@@ -47,6 +49,7 @@ private:
     QLabel* status_text;
     QPushButton* resume_button;
     QPushButton* toggle_breakpoint_button;
+    QCheckBox* log_only_checkbox;
 
     BreakPointModel* breakpoint_model;
     QTreeView* breakpoint_list;
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <array>
 #include <memory>
 
 #include <QAbstractListModel>
@@ -16,6 +17,7 @@ class BreakPointModel : public QAbstractListModel {
 public:
     enum {
         Role_IsEnabled = Qt::UserRole,
+        Role_IsLogOnly,
     };
 
     BreakPointModel(std::shared_ptr<Pica::DebugContext> context, QObject* parent);
@@ -31,8 +33,15 @@ public slots:
     void OnBreakPointHit(Pica::DebugContext::Event event);
     void OnResumed();
 
+    /// Counts the events recorded by the logging breakpoints since the last call
+    void OnUpdateLoggedEvents();
+
 private:
     std::weak_ptr<Pica::DebugContext> context_weak;
     bool at_breakpoint;
     Pica::DebugContext::Event active_breakpoint;
+
+    u64 event_log_position;
+    std::vector<Pica::DebugContext::LoggedEvent> logged_events;
+    std::array<u64, static_cast<size_t>(Pica::DebugContext::Event::NumEvents)> logged_counts;
 };
@@ -2,6 +2,10 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <vector>
+
+#include <QFileDialog>
+#include <QInputDialog>
 #include <QLabel>
 #include <QListView>
 #include <QMainWindow>
@@ -13,6 +17,8 @@
 
 #include "common/vector_math.h"
 
+#include "core/gpu_capture.h"
+
 #include "video_core/debug_utils/debug_utils.h"
 #include "video_core/pica.h"
 
@@ -20,8 +26,29 @@
 
 #include "util/spinbox.h"
 
-QImage LoadTexture(u8* src, const Pica::DebugUtils::TextureInfo& info) {
+/// Whether LookupTexture with disable_alpha only differs from DecodeTexture in the alpha it returns
+static bool HasOpaquePreview(Pica::Regs::TextureFormat format) {
+    using Format = Pica::Regs::TextureFormat;
+    return format != Format::IA8 && format != Format::A8 && format != Format::IA4 && format != Format::A4;
+}
+
+QImage LoadTexture(const u8* src, const Pica::DebugUtils::TextureInfo& info) {
     QImage decoded_image(info.width, info.height, QImage::Format_ARGB32);
+
+    // Decoded a tile at a time by the bulk decoder where it gives the same picture, the formats
+    // whose preview shows alpha as a color and sizes the tiles don't cover go texel by texel
+    if (info.width % 8 == 0 && info.height % 8 == 0 && HasOpaquePreview(info.format)) {
+        std::vector<Math::Vec4<u8>> texels(info.width * info.height);
+        Pica::DebugUtils::DecodeTexture(src, info, texels.data());
+        for (int y = 0; y < info.height; ++y) {
+            QRgb* line = reinterpret_cast<QRgb*>(decoded_image.scanLine(y));
+            const Math::Vec4<u8>* row = &texels[y * info.width];
+            for (int x = 0; x < info.width; ++x)
+                line[x] = qRgba(row[x].r(), row[x].g(), row[x].b(), 255);
+        }
+        return decoded_image;
+    }
+
     for (int y = 0; y < info.height; ++y) {
         for (int x = 0; x < info.width; ++x) {
             Math::Vec4<u8> color = Pica::DebugUtils::LookupTexture(src, x, y, info, true);
@@ -309,11 +336,15 @@ GPUCommandListWidget::GPUCommandListWidget(QWidget* parent) : QDockWidget(tr("Pi
     connect(this, SIGNAL(TracingFinished(const Pica::DebugUtils::PicaTrace&)),
             model, SLOT(OnPicaTraceFinished(const Pica::DebugUtils::PicaTrace&)));
 
+    capture_frames = new QPushButton(tr("Capture Frames..."));
+    connect(capture_frames, SIGNAL(clicked()), this, SLOT(OnCaptureFrames()));
+
     command_info_widget = new QWidget;
 
     QVBoxLayout* main_layout = new QVBoxLayout;
     main_layout->addWidget(list_widget);
     main_layout->addWidget(toggle_tracing);
+    main_layout->addWidget(capture_frames);
     main_layout->addWidget(command_info_widget);
     main_widget->setLayout(main_layout);
 
@@ -330,3 +361,19 @@ void GPUCommandListWidget::OnToggleTracing() {
         toggle_tracing->setText(tr("Start Tracing"));
     }
 }
+
+void GPUCommandListWidget::OnCaptureFrames() {
+    bool ok;
+    const int num_frames = QInputDialog::getInt(this, tr("Capture Frames"), tr("Number of frames to capture:"),
+                                                60, 1, 3600, 1, &ok);
+    if (!ok)
+        return;
+
+    const QString filename = QFileDialog::getSaveFileName(this, tr("Save GPU Capture"), QString(),
+                                                          tr("GPU capture (*.gpucap)"));
+    if (filename.isEmpty())
+        return;
+
+    // Recorded by the emulation thread from the next VBlank on, for citra_gpu_replay
+    GPUCapture::RequestCapture(filename.toStdString(), num_frames);
+}
@@ -6,6 +6,7 @@
 
 #include <QAbstractListModel>
 #include <QDockWidget>
+#include <QImage>
 
 #include "video_core/gpu_debugger.h"
 #include "video_core/debug_utils/debug_utils.h"
@@ -13,6 +14,9 @@
 class QPushButton;
 class QTreeView;
 
+/// Decodes a texture for display, with its alpha hidden or, in the alpha and intensity formats, shown as a color
+QImage LoadTexture(const u8* src, const Pica::DebugUtils::TextureInfo& info);
+
 class GPUCommandListModel : public QAbstractListModel
 {
     Q_OBJECT
@@ -45,6 +49,7 @@ public:
 
 public slots:
     void OnToggleTracing();
+    void OnCaptureFrames();
     void OnCommandDoubleClicked(const QModelIndex&);
 
     void SetCommandInfo(const QModelIndex&);
@@ -58,6 +63,7 @@ private:
     QTreeView* list_widget;
     QWidget* command_info_widget;
     QPushButton* toggle_tracing;
+    QPushButton* capture_frames;
 };
 
 class TextureInfoDockWidget : public QDockWidget {
@@ -17,6 +17,7 @@
 #include "video_core/pica.h"
 #include "video_core/utils.h"
 
+#include "graphics_cmdlists.h"
 #include "graphics_framebuffer.h"
 
 #include "util/spinbox.h"
@@ -24,7 +25,7 @@
 GraphicsFramebufferWidget::GraphicsFramebufferWidget(std::shared_ptr<Pica::DebugContext> debug_context,
                                                      QWidget* parent)
     : BreakPointObserverDock(debug_context, tr("Pica Framebuffer"), parent),
-      framebuffer_source(Source::PicaTarget)
+      framebuffer_source(Source::PicaTarget), context_weak(debug_context), viewed(false)
 {
     setObjectName("PicaFramebuffer");
 
@@ -69,6 +70,7 @@ GraphicsFramebufferWidget::GraphicsFramebufferWidget(std::shared_ptr<Pica::Debug
     connect(framebuffer_width_control, SIGNAL(valueChanged(int)), this, SLOT(OnFramebufferWidthChanged(int)));
     connect(framebuffer_height_control, SIGNAL(valueChanged(int)), this, SLOT(OnFramebufferHeightChanged(int)));
     connect(framebuffer_format_control, SIGNAL(currentIndexChanged(int)), this, SLOT(OnFramebufferFormatChanged(int)));
+    connect(this, SIGNAL(visibilityChanged(bool)), this, SLOT(OnVisibilityChanged(bool)));
 
     auto main_widget = new QWidget;
     auto main_layout = new QVBoxLayout;
@@ -113,6 +115,21 @@ GraphicsFramebufferWidget::GraphicsFramebufferWidget(std::shared_ptr<Pica::Debug
     widget()->setEnabled(false); // TODO: Only enable if currently at breakpoint
 }
 
+GraphicsFramebufferWidget::~GraphicsFramebufferWidget()
+{
+    OnVisibilityChanged(false);
+}
+
+void GraphicsFramebufferWidget::OnVisibilityChanged(bool visible)
+{
+    if (visible == viewed)
+        return;
+
+    viewed = visible;
+    if (auto context = context_weak.lock())
+        context->SetFramebufferViewed(visible);
+}
+
 void GraphicsFramebufferWidget::OnBreakPointHit(Pica::DebugContext::Event event, void* data)
 {
     emit Update();
@@ -214,64 +231,61 @@ void GraphicsFramebufferWidget::OnUpdate()
     }
 
     // TODO: Implement a good way to visualize alpha components!
-    // TODO: Unify this decoding code with the texture decoder
     u32 bytes_per_pixel = GraphicsFramebufferWidget::BytesPerPixel(framebuffer_format);
 
     QImage decoded_image(framebuffer_width, framebuffer_height, QImage::Format_ARGB32);
     u8* buffer = Memory::GetPhysicalPointer(framebuffer_address);
 
-    for (unsigned int y = 0; y < framebuffer_height; ++y) {
-        for (unsigned int x = 0; x < framebuffer_width; ++x) {
-            const u32 coarse_y = y & ~7;
-            u32 offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * framebuffer_width * bytes_per_pixel;
-            const u8* pixel = buffer + offset;
-            Math::Vec4<u8> color = { 0, 0, 0, 0 };
-
-            switch (framebuffer_format) {
-            case Format::RGBA8:
-                color = Color::DecodeRGBA8(pixel);
-                break;
-            case Format::RGB8:
-                color = Color::DecodeRGB8(pixel);
-                break;
-            case Format::RGB5A1:
-                color = Color::DecodeRGB5A1(pixel);
-                break;
-            case Format::RGB565:
-                color = Color::DecodeRGB565(pixel);
-                break;
-            case Format::RGBA4:
-                color = Color::DecodeRGBA4(pixel);
-                break;
-            case Format::D16:
-            {
-                u32 data = Color::DecodeD16(pixel);
-                color.r() = data & 0xFF;
-                color.g() = (data >> 8) & 0xFF;
-                break;
-            }
-            case Format::D24:
-            {
-                u32 data = Color::DecodeD24(pixel);
-                color.r() = data & 0xFF;
-                color.g() = (data >> 8) & 0xFF;
-                color.b() = (data >> 16) & 0xFF;
-                break;
-            }
-            case Format::D24S8:
-            {
-                Math::Vec2<u32> data = Color::DecodeD24S8(pixel);
-                color.r() = data.x & 0xFF;
-                color.g() = (data.x >> 8) & 0xFF;
-                color.b() = (data.x >> 16) & 0xFF;
-                break;
+    // The color formats are those of the textures with the same number, decoded by the bulk decoder
+    const bool is_color = framebuffer_format <= Format::RGBA4;
+    if (buffer != nullptr && is_color) {
+        Pica::DebugUtils::TextureInfo info;
+        info.physical_address = framebuffer_address;
+        info.width = framebuffer_width;
+        info.height = framebuffer_height;
+        info.stride = framebuffer_width * bytes_per_pixel;
+        info.format = static_cast<Pica::Regs::TextureFormat>(framebuffer_format);
+        decoded_image = LoadTexture(buffer, info);
+    } else if (buffer != nullptr) {
+        // Depth is shown as a color, a byte per channel
+        for (unsigned int y = 0; y < framebuffer_height; ++y) {
+            for (unsigned int x = 0; x < framebuffer_width; ++x) {
+                const u32 coarse_y = y & ~7;
+                u32 offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * framebuffer_width * bytes_per_pixel;
+                const u8* pixel = buffer + offset;
+                Math::Vec4<u8> color = { 0, 0, 0, 0 };
+
+                switch (framebuffer_format) {
+                case Format::D16:
+                {
+                    u32 data = Color::DecodeD16(pixel);
+                    color.r() = data & 0xFF;
+                    color.g() = (data >> 8) & 0xFF;
+                    break;
+                }
+                case Format::D24:
+                {
+                    u32 data = Color::DecodeD24(pixel);
+                    color.r() = data & 0xFF;
+                    color.g() = (data >> 8) & 0xFF;
+                    color.b() = (data >> 16) & 0xFF;
+                    break;
+                }
+                case Format::D24S8:
+                {
+                    Math::Vec2<u32> data = Color::DecodeD24S8(pixel);
+                    color.r() = data.x & 0xFF;
+                    color.g() = (data.x >> 8) & 0xFF;
+                    color.b() = (data.x >> 16) & 0xFF;
+                    break;
+                }
+                default:
+                    qDebug() << "Unknown fb depth format " << static_cast<int>(framebuffer_format);
+                    break;
+                }
+
+                decoded_image.setPixel(x, y, qRgba(color.r(), color.g(), color.b(), 255));
             }
-            default:
-                qDebug() << "Unknown fb color format " << static_cast<int>(framebuffer_format);
-                break;
-            }
-
-            decoded_image.setPixel(x, y, qRgba(color.r(), color.g(), color.b(), 255));
         }
     }
     pixmap = QPixmap::fromImage(decoded_image);
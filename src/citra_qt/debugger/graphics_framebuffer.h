@@ -42,6 +42,7 @@ class GraphicsFramebufferWidget : public BreakPointObserverDock {
 
 public:
     GraphicsFramebufferWidget(std::shared_ptr<Pica::DebugContext> debug_context, QWidget* parent = nullptr);
+    ~GraphicsFramebufferWidget();
 
 public slots:
     void OnFramebufferSourceChanged(int new_value);
@@ -55,6 +56,9 @@ private slots:
     void OnBreakPointHit(Pica::DebugContext::Event event, void* data) override;
     void OnResumed() override;
 
+    /// Makes breakpoints commit the hardware renderer's framebuffer while the widget is visible
+    void OnVisibilityChanged(bool visible);
+
 signals:
     void Update();
 
@@ -73,4 +77,8 @@ private:
     unsigned framebuffer_width;
     unsigned framebuffer_height;
     Format framebuffer_format;
+
+    // The context of the observer is private to BreakPointObserverDock
+    std::weak_ptr<Pica::DebugContext> context_weak;
+    bool viewed;
 };
@@ -0,0 +1,77 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+
+#include "core/memory.h"
+
+#include "memory_snapshot.h"
+
+MemorySnapshot::MemorySnapshot() : start(0) {
+}
+
+void MemorySnapshot::Capture(VAddr start, u32 size) {
+    this->start = start;
+    data.resize(size);
+    mapped.assign((size + Memory::PAGE_SIZE - 1) / Memory::PAGE_SIZE + 1, false);
+
+    // Copied a page at a time, since the neighbouring pages don't have to be backed by memory
+    u32 offset = 0;
+    while (offset < size) {
+        const VAddr address = start + offset;
+        const u32 span = std::min<u32>(Memory::PAGE_SIZE - (address & Memory::PAGE_MASK), size - offset);
+        const u8* source = Memory::GetContiguousPointer(address, span);
+        if (source != nullptr) {
+            std::memcpy(&data[offset], source, span);
+        } else {
+            std::memset(&data[offset], 0, span);
+        }
+        mapped[((start & Memory::PAGE_MASK) + offset) / Memory::PAGE_SIZE] = source != nullptr;
+        offset += span;
+    }
+}
+
+bool MemorySnapshot::Contains(VAddr address, u32 size) const {
+    if (address < start || address - start + size > data.size())
+        return false;
+    const u32 first_page = ((start & Memory::PAGE_MASK) + (address - start)) / Memory::PAGE_SIZE;
+    const u32 last_page = ((start & Memory::PAGE_MASK) + (address - start) + size - 1) / Memory::PAGE_SIZE;
+    for (u32 page = first_page; page <= last_page; ++page) {
+        if (!mapped[page])
+            return false;
+    }
+    return true;
+}
+
+u32 MemorySnapshot::Read32(VAddr address) const {
+    if (!Contains(address, 4))
+        return 0;
+    u32 value;
+    std::memcpy(&value, &data[address - start], sizeof(value));
+    return value;
+}
+
+RefreshThrottle::RefreshThrottle(int interval_ms, QObject* parent) : QObject(parent), pending(false) {
+    timer.setSingleShot(true);
+    timer.setInterval(interval_ms);
+    connect(&timer, SIGNAL(timeout()), this, SLOT(OnTimeout()));
+}
+
+void RefreshThrottle::Request() {
+    if (timer.isActive()) {
+        pending = true;
+        return;
+    }
+    emit Refresh();
+    timer.start();
+}
+
+void RefreshThrottle::OnTimeout() {
+    if (!pending)
+        return;
+    pending = false;
+    emit Refresh();
+    timer.start();
+}
@@ -0,0 +1,62 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include <QObject>
+#include <QTimer>
+
+#include "common/common_types.h"
+
+/**
+ * Copy of a range of emulated memory taken by the GUI thread, so that the debugger widgets read
+ * guest memory once per refresh, and only the part they show, instead of once per painted item.
+ * The emulation thread isn't stopped for the copy: while it's running, the copy is only as
+ * consistent as a single read of the memory would be.
+ */
+class MemorySnapshot {
+public:
+    MemorySnapshot();
+
+    /// Copies a range of memory, replacing the previous copy. Unmapped pages read as zero.
+    void Capture(VAddr start, u32 size);
+
+    /// Whether the whole range is part of the copy and backed by memory
+    bool Contains(VAddr address, u32 size) const;
+
+    /// Reads a word of the copy, or 0 if it isn't part of it
+    u32 Read32(VAddr address) const;
+
+private:
+    VAddr start;
+    std::vector<u8> data;
+    /// Whether each page of the copy was backed by memory
+    std::vector<bool> mapped;
+};
+
+/**
+ * Limits the refreshes of a widget to one per interval. The first request in a while is passed on
+ * at once, later ones are merged into a single refresh at the end of the interval.
+ */
+class RefreshThrottle : public QObject {
+    Q_OBJECT
+
+public:
+    RefreshThrottle(int interval_ms, QObject* parent = nullptr);
+
+public slots:
+    void Request();
+
+signals:
+    void Refresh();
+
+private slots:
+    void OnTimeout();
+
+private:
+    QTimer timer;
+    bool pending;
+};
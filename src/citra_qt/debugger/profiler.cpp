@@ -2,10 +2,18 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <cmath>
+
+#include <QFileDialog>
+
 #include "profiler.h"
 
+#include "common/perf_counters.h"
 #include "common/profiler_reporting.h"
 
+#include "core/settings.h"
+#include "core/arm/dyncom/arm_dyncom_profile.h"
+
 using namespace Common::Profiling;
 
 static QVariant GetDataForColumn(int col, const AggregatedDuration& duration)
@@ -23,6 +31,16 @@ static QVariant GetDataForColumn(int col, const AggregatedDuration& duration)
     }
 }
 
+static QVariant GetDataForColumn(int col, float avg, float min, float max)
+{
+    switch (col) {
+    case 1: return avg;
+    case 2: return min;
+    case 3: return max;
+    default: return QVariant();
+    }
+}
+
 static const TimingCategoryInfo* GetCategoryInfo(int id)
 {
     const auto& categories = GetProfilingManager().GetTimingCategoriesInfo();
@@ -33,11 +51,33 @@ static const TimingCategoryInfo* GetCategoryInfo(int id)
     }
 }
 
+static const SampleCategoryInfo* GetSampleCategoryInfo(int id)
+{
+    const auto& categories = GetProfilingManager().GetSampleCategoriesInfo();
+    if ((size_t)id >= categories.size()) {
+        return nullptr;
+    } else {
+        return &categories[id];
+    }
+}
+
+static const Common::Perf::CounterInfo* GetCounterInfo(int id)
+{
+    const auto& counters = Common::Perf::GetCountersInfo();
+    if ((size_t)id >= counters.size()) {
+        return nullptr;
+    } else {
+        return &counters[id];
+    }
+}
+
 ProfilerModel::ProfilerModel(QObject* parent) : QAbstractItemModel(parent)
 {
     updateProfilingInfo();
     const auto& categories = GetProfilingManager().GetTimingCategoriesInfo();
     results.time_per_category.resize(categories.size());
+    results.samples_per_category.resize(GetProfilingManager().GetSampleCategoriesInfo().size());
+    results.counts_per_counter.resize(Common::Perf::GetCountersInfo().size());
 }
 
 QVariant ProfilerModel::headerData(int section, Qt::Orientation orientation, int role) const
@@ -74,7 +114,9 @@ int ProfilerModel::rowCount(const QModelIndex& parent) const
     if (parent.isValid()) {
         return 0;
     } else {
-        return results.time_per_category.size() + 2;
+        // Each sample category has one row for the values and one for the number of samples
+        return results.time_per_category.size() + 2 * results.samples_per_category.size() +
+               results.counts_per_counter.size() + 2;
     }
 }
 
@@ -93,6 +135,36 @@ QVariant ProfilerModel::data(const QModelIndex& index, int role) const
             } else {
                 return GetDataForColumn(index.column(), results.interframe_time);
             }
+        } else if (index.row() - 2 >= (int)(results.time_per_category.size() + 2 * results.samples_per_category.size())) {
+            const int counter_row = index.row() - 2 - (int)(results.time_per_category.size() +
+                                                            2 * results.samples_per_category.size());
+            if (index.column() == 0) {
+                const Common::Perf::CounterInfo* info = GetCounterInfo(counter_row);
+                return info != nullptr ? QString(info->name) : QVariant();
+            } else {
+                if (counter_row >= (int)results.counts_per_counter.size())
+                    return QVariant();
+                const AggregatedCount& count = results.counts_per_counter[counter_row];
+                return GetDataForColumn(index.column(), count.avg, count.min, count.max);
+            }
+        } else if (index.row() - 2 >= (int)results.time_per_category.size()) {
+            const int sample_row = index.row() - 2 - (int)results.time_per_category.size();
+            const bool is_count = (sample_row % 2) != 0;
+            if (index.column() == 0) {
+                const SampleCategoryInfo* info = GetSampleCategoryInfo(sample_row / 2);
+                if (info == nullptr)
+                    return QVariant();
+                return QString(is_count ? info->count_name : info->name);
+            } else {
+                if (sample_row / 2 >= (int)results.samples_per_category.size())
+                    return QVariant();
+                const AggregatedSamples& samples = results.samples_per_category[sample_row / 2];
+                if (is_count) {
+                    return GetDataForColumn(index.column(), samples.avg_count, samples.min_count, samples.max_count);
+                } else {
+                    return GetDataForColumn(index.column(), samples.avg_value, samples.min_value, samples.max_value);
+                }
+            }
         } else {
             if (index.column() == 0) {
                 const TimingCategoryInfo* info = GetCategoryInfo(index.row() - 2);
@@ -116,6 +188,212 @@ void ProfilerModel::updateProfilingInfo()
     emit dataChanged(createIndex(0, 1), createIndex(rowCount() - 1, 3));
 }
 
+/**
+ * Returns the upper bound, in microseconds, of the latency histogram bucket that the given
+ * fraction of the calls of an SVC falls into.
+ */
+static float GetLatencyPercentile(const SVC::SVCStatistics& entry, double fraction)
+{
+    const u64 target = (u64)std::ceil(entry.calls * fraction);
+    u64 count = 0;
+    for (int bucket = 0; bucket < SVC::NUM_LATENCY_BUCKETS - 1; ++bucket) {
+        count += entry.latency_histogram[bucket];
+        if (count >= target)
+            return (2ull << bucket) / 1000.0f;
+    }
+    return entry.max_time_ns / 1000.0f;
+}
+
+SVCStatisticsModel::SVCStatisticsModel(QObject* parent) : QAbstractTableModel(parent)
+{
+    updateStatistics();
+}
+
+QVariant SVCStatisticsModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        switch (section) {
+        case 0: return tr("SVC");
+        case 1: return tr("Calls");
+        case 2: return tr("Calls/s");
+        case 3: return tr("Avg (us)");
+        case 4: return tr("Median (us)");
+        case 5: return tr("99% (us)");
+        case 6: return tr("Max (us)");
+        }
+    }
+
+    return QVariant();
+}
+
+int SVCStatisticsModel::columnCount(const QModelIndex& parent) const
+{
+    return 7;
+}
+
+int SVCStatisticsModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : (int)statistics.size();
+}
+
+QVariant SVCStatisticsModel::data(const QModelIndex& index, int role) const
+{
+    if (role != Qt::DisplayRole || index.row() >= (int)statistics.size())
+        return QVariant();
+
+    const SVC::SVCStatistics& entry = statistics[index.row()];
+    switch (index.column()) {
+    case 0: return QString("0x%1 %2").arg(entry.id, 2, 16, QLatin1Char('0')).arg(entry.name);
+    case 1: return (qulonglong)entry.calls;
+    case 2: return call_rates[index.row()];
+    case 3: return entry.total_time_ns / 1000.0f / entry.calls;
+    case 4: return GetLatencyPercentile(entry, 0.5);
+    case 5: return GetLatencyPercentile(entry, 0.99);
+    case 6: return entry.max_time_ns / 1000.0f;
+    default: return QVariant();
+    }
+}
+
+void SVCStatisticsModel::updateStatistics()
+{
+    const auto now = std::chrono::steady_clock::now();
+    const float elapsed = std::chrono::duration<float>(now - previous_update).count();
+    std::vector<SVC::SVCStatistics> new_statistics = SVC::GetStatistics();
+
+    std::vector<float> new_call_rates(new_statistics.size(), 0.0f);
+    std::map<u32, u64> new_calls;
+    for (size_t i = 0; i < new_statistics.size(); ++i) {
+        const SVC::SVCStatistics& entry = new_statistics[i];
+        auto previous = previous_calls.find(entry.id);
+        // The counters count up from zero again after being reset
+        const u64 previous_count = (previous != previous_calls.end() && previous->second <= entry.calls)
+                                   ? previous->second : 0;
+        if (!previous_calls.empty() && elapsed > 0.0f)
+            new_call_rates[i] = (entry.calls - previous_count) / elapsed;
+        new_calls[entry.id] = entry.calls;
+    }
+
+    const bool rows_changed = new_statistics.size() != statistics.size();
+    if (rows_changed)
+        beginResetModel();
+    statistics = std::move(new_statistics);
+    call_rates = std::move(new_call_rates);
+    previous_calls = std::move(new_calls);
+    previous_update = now;
+    if (rows_changed) {
+        endResetModel();
+    } else if (!statistics.empty()) {
+        emit dataChanged(createIndex(0, 0), createIndex(rowCount() - 1, columnCount() - 1));
+    }
+}
+
+KernelObjectsModel::KernelObjectsModel(QObject* parent) : QAbstractTableModel(parent)
+{
+    updateStatistics();
+}
+
+QVariant KernelObjectsModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        switch (section) {
+        case 0: return tr("Kernel object");
+        case 1: return tr("Live");
+        case 2: return tr("Peak");
+        case 3: return tr("Pool slots");
+        }
+    }
+
+    return QVariant();
+}
+
+int KernelObjectsModel::columnCount(const QModelIndex& parent) const
+{
+    return 4;
+}
+
+int KernelObjectsModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : (int)statistics.size();
+}
+
+QVariant KernelObjectsModel::data(const QModelIndex& index, int role) const
+{
+    if (role != Qt::DisplayRole || index.row() >= (int)statistics.size())
+        return QVariant();
+
+    const Kernel::ObjectPoolStatistics& entry = statistics[index.row()];
+    switch (index.column()) {
+    case 0: return QString(entry.type_name);
+    case 1: return (qulonglong)entry.live_objects;
+    case 2: return (qulonglong)entry.peak_live_objects;
+    case 3: return (qulonglong)entry.allocated_slots;
+    default: return QVariant();
+    }
+}
+
+void KernelObjectsModel::updateStatistics()
+{
+    std::vector<Kernel::ObjectPoolStatistics> new_statistics = Kernel::GetObjectPoolStatistics();
+
+    const bool rows_changed = new_statistics.size() != statistics.size();
+    if (rows_changed)
+        beginResetModel();
+    statistics = std::move(new_statistics);
+    if (rows_changed) {
+        endResetModel();
+    } else if (!statistics.empty()) {
+        emit dataChanged(createIndex(0, 0), createIndex(rowCount() - 1, columnCount() - 1));
+    }
+}
+
+MemoryUsageModel::MemoryUsageModel(QObject* parent) : QAbstractTableModel(parent)
+{
+    updateStatistics();
+}
+
+QVariant MemoryUsageModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        switch (section) {
+        case 0: return tr("Subsystem");
+        case 1: return tr("Used (MB)");
+        case 2: return tr("Peak (MB)");
+        }
+    }
+
+    return QVariant();
+}
+
+int MemoryUsageModel::columnCount(const QModelIndex& parent) const
+{
+    return 3;
+}
+
+int MemoryUsageModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : (int)usage.size();
+}
+
+QVariant MemoryUsageModel::data(const QModelIndex& index, int role) const
+{
+    if (role != Qt::DisplayRole || index.row() >= (int)usage.size())
+        return QVariant();
+
+    const Common::MemoryAccounting::TagUsage& entry = usage[index.row()];
+    switch (index.column()) {
+    case 0: return QString(Common::MemoryAccounting::GetTagName((Common::MemoryAccounting::Tag)index.row()));
+    case 1: return QString::number(entry.bytes / (1024.0 * 1024.0), 'f', 2);
+    case 2: return QString::number(entry.peak_bytes / (1024.0 * 1024.0), 'f', 2);
+    default: return QVariant();
+    }
+}
+
+void MemoryUsageModel::updateStatistics()
+{
+    usage = Common::MemoryAccounting::GetUsage();
+    emit dataChanged(createIndex(0, 0), createIndex(rowCount() - 1, columnCount() - 1));
+}
+
 ProfilerWidget::ProfilerWidget(QWidget* parent) : QDockWidget(parent)
 {
     ui.setupUi(this);
@@ -123,8 +401,30 @@ ProfilerWidget::ProfilerWidget(QWidget* parent) : QDockWidget(parent)
     model = new ProfilerModel(this);
     ui.treeView->setModel(model);
 
+    svc_model = new SVCStatisticsModel(this);
+    ui.svcView->setModel(svc_model);
+
+    kernel_objects_model = new KernelObjectsModel(this);
+    ui.kernelObjectsView->setModel(kernel_objects_model);
+
+    memory_usage_model = new MemoryUsageModel(this);
+    ui.memoryUsageView->setModel(memory_usage_model);
+
     connect(this, SIGNAL(visibilityChanged(bool)), SLOT(setProfilingInfoUpdateEnabled(bool)));
     connect(&update_timer, SIGNAL(timeout()), model, SLOT(updateProfilingInfo()));
+    connect(&update_timer, SIGNAL(timeout()), svc_model, SLOT(updateStatistics()));
+    connect(&update_timer, SIGNAL(timeout()), kernel_objects_model, SLOT(updateStatistics()));
+    connect(&update_timer, SIGNAL(timeout()), memory_usage_model, SLOT(updateStatistics()));
+
+    ui.countInstructions->setChecked(Settings::values.profile_cpu);
+    connect(ui.countInstructions, SIGNAL(toggled(bool)), SLOT(setInstructionCountingEnabled(bool)));
+    connect(ui.dumpInstructionCounts, SIGNAL(clicked()), SLOT(dumpInstructionCounts()));
+    connect(ui.resetInstructionCounts, SIGNAL(clicked()), SLOT(resetInstructionCounts()));
+    ui.recordTrace->setChecked(IsTracing());
+    connect(ui.recordTrace, SIGNAL(toggled(bool)), SLOT(setTracingEnabled(bool)));
+    connect(ui.saveTrace, SIGNAL(clicked()), SLOT(saveTrace()));
+    connect(ui.dumpSVCStatistics, SIGNAL(clicked()), SLOT(dumpSVCStatistics()));
+    connect(ui.resetSVCStatistics, SIGNAL(clicked()), SLOT(resetSVCStatistics()));
 }
 
 void ProfilerWidget::setProfilingInfoUpdateEnabled(bool enable)
@@ -132,7 +432,56 @@ void ProfilerWidget::setProfilingInfoUpdateEnabled(bool enable)
     if (enable) {
         update_timer.start(100);
         model->updateProfilingInfo();
+        svc_model->updateStatistics();
+        kernel_objects_model->updateStatistics();
+        memory_usage_model->updateStatistics();
     } else {
         update_timer.stop();
     }
 }
+
+void ProfilerWidget::setInstructionCountingEnabled(bool enable)
+{
+    Settings::values.profile_cpu = enable;
+    GetExecutionProfile().SetEnabled(enable);
+}
+
+void ProfilerWidget::dumpInstructionCounts()
+{
+    GetExecutionProfile().LogReport();
+}
+
+void ProfilerWidget::resetInstructionCounts()
+{
+    GetExecutionProfile().Reset();
+}
+
+void ProfilerWidget::setTracingEnabled(bool enable)
+{
+    if (enable)
+        StartTracing();
+    else
+        StopTracing();
+}
+
+void ProfilerWidget::saveTrace()
+{
+    QString filename = QFileDialog::getSaveFileName(this, tr("Save timeline trace"), QString(),
+                                                    tr("Chrome trace files (*.json)"));
+    if (!filename.isEmpty())
+        ExportChromeTrace(filename.toStdString());
+}
+
+void ProfilerWidget::dumpSVCStatistics()
+{
+    QString filename = QFileDialog::getSaveFileName(this, tr("Save SVC statistics"), QString(),
+                                                    tr("CSV files (*.csv)"));
+    if (!filename.isEmpty())
+        SVC::DumpStatisticsCSV(filename.toStdString());
+}
+
+void ProfilerWidget::resetSVCStatistics()
+{
+    SVC::ResetStatistics();
+    svc_model->updateStatistics();
+}
@@ -4,13 +4,23 @@
 
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <map>
+#include <vector>
+
 #include <QAbstractItemModel>
+#include <QAbstractTableModel>
 #include <QDockWidget>
 #include <QTimer>
 #include "ui_profiler.h"
 
+#include "common/memory_accounting.h"
 #include "common/profiler_reporting.h"
 
+#include "core/hle/svc.h"
+#include "core/hle/kernel/object_pool.h"
+
 class ProfilerModel : public QAbstractItemModel
 {
     Q_OBJECT
@@ -32,6 +42,71 @@ private:
     Common::Profiling::AggregatedFrameResult results;
 };
 
+/// Lists the number of calls, call rate and latency of every SVC that has been called
+class SVCStatisticsModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    SVCStatisticsModel(QObject* parent);
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+public slots:
+    void updateStatistics();
+
+private:
+    std::vector<SVC::SVCStatistics> statistics;
+    /// Calls per second of each entry in statistics since the previous update
+    std::vector<float> call_rates;
+    /// Number of calls of each SVC at the previous update, by SVC id
+    std::map<u32, u64> previous_calls;
+    std::chrono::steady_clock::time_point previous_update;
+};
+
+/// Lists the number of live kernel objects of each type that is allocated from a pool
+class KernelObjectsModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    KernelObjectsModel(QObject* parent);
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+public slots:
+    void updateStatistics();
+
+private:
+    std::vector<Kernel::ObjectPoolStatistics> statistics;
+};
+
+/// Lists the host memory accounted to each subsystem
+class MemoryUsageModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    MemoryUsageModel(QObject* parent);
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+public slots:
+    void updateStatistics();
+
+private:
+    std::array<Common::MemoryAccounting::TagUsage, Common::MemoryAccounting::NUM_TAGS> usage;
+};
+
 class ProfilerWidget : public QDockWidget
 {
     Q_OBJECT
@@ -41,10 +116,20 @@ public:
 
 private slots:
     void setProfilingInfoUpdateEnabled(bool enable);
+    void setInstructionCountingEnabled(bool enable);
+    void dumpInstructionCounts();
+    void resetInstructionCounts();
+    void setTracingEnabled(bool enable);
+    void saveTrace();
+    void dumpSVCStatistics();
+    void resetSVCStatistics();
 
 private:
     Ui::Profiler ui;
     ProfilerModel* model;
+    SVCStatisticsModel* svc_model;
+    KernelObjectsModel* kernel_objects_model;
+    MemoryUsageModel* memory_usage_model;
 
     QTimer update_timer;
 };
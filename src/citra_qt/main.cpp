@@ -40,6 +40,8 @@
 #include "core/settings.h"
 #include "core/system.h"
 #include "core/core.h"
+#include "core/rewind.h"
+#include "core/savestate.h"
 #include "core/loader/loader.h"
 #include "core/arm/disassembler/load_symbol_map.h"
 #include "citra_qt/config.h"
@@ -128,6 +130,8 @@ GMainWindow::GMainWindow() : emu_thread(nullptr)
     ui.action_Use_Hardware_Renderer->setChecked(Settings::values.use_hw_renderer);
     SetHardwareRendererEnabled(ui.action_Use_Hardware_Renderer->isChecked());
 
+    ui.action_Show_Perf_Overlay->setChecked(Settings::values.show_perf_overlay);
+
     ui.action_Single_Window_Mode->setChecked(settings.value("singleWindowMode", true).toBool());
     ToggleWindowMode();
 
@@ -137,10 +141,13 @@ GMainWindow::GMainWindow() : emu_thread(nullptr)
     // Setup connections
     connect(ui.action_Load_File, SIGNAL(triggered()), this, SLOT(OnMenuLoadFile()));
     connect(ui.action_Load_Symbol_Map, SIGNAL(triggered()), this, SLOT(OnMenuLoadSymbolMap()));
+    connect(ui.action_Save_State, SIGNAL(triggered()), this, SLOT(OnMenuSaveState()));
+    connect(ui.action_Load_State, SIGNAL(triggered()), this, SLOT(OnMenuLoadState()));
     connect(ui.action_Start, SIGNAL(triggered()), this, SLOT(OnStartGame()));
     connect(ui.action_Pause, SIGNAL(triggered()), this, SLOT(OnPauseGame()));
     connect(ui.action_Stop, SIGNAL(triggered()), this, SLOT(OnStopGame()));
     connect(ui.action_Use_Hardware_Renderer, SIGNAL(triggered(bool)), this, SLOT(SetHardwareRendererEnabled(bool)));
+    connect(ui.action_Show_Perf_Overlay, SIGNAL(triggered(bool)), this, SLOT(SetPerfOverlayShown(bool)));
     connect(ui.action_Single_Window_Mode, SIGNAL(triggered(bool)), this, SLOT(ToggleWindowMode()));
     connect(ui.action_Hotkeys, SIGNAL(triggered()), this, SLOT(OnOpenHotkeysDialog()));
 
@@ -154,10 +161,12 @@ GMainWindow::GMainWindow() : emu_thread(nullptr)
     // Setup hotkeys
     RegisterHotkey("Main Window", "Load File", QKeySequence::Open);
     RegisterHotkey("Main Window", "Start Emulation");
+    RegisterHotkey("Main Window", "Rewind", QKeySequence(Qt::Key_Backspace));
     LoadHotkeys(settings);
 
     connect(GetHotkey("Main Window", "Load File", this), SIGNAL(activated()), this, SLOT(OnMenuLoadFile()));
     connect(GetHotkey("Main Window", "Start Emulation", this), SIGNAL(activated()), this, SLOT(OnStartGame()));
+    connect(GetHotkey("Main Window", "Rewind", this), SIGNAL(activated()), this, SLOT(OnRewind()));
 
     std::string window_title = Common::StringFromFormat("Citra | %s-%s", Common::g_scm_branch, Common::g_scm_desc);
     setWindowTitle(window_title.c_str());
@@ -204,7 +213,7 @@ void GMainWindow::BootGame(std::string filename) {
     LOG_INFO(Frontend, "Citra starting...\n");
 
     // Initialize the core emulation
-    System::Init(render_window);
+    System::Init(render_window, filename);
 
     // Load the game
     if (Loader::ResultStatus::Success != Loader::LoadFile(filename)) {
@@ -258,6 +267,8 @@ void GMainWindow::ShutdownGame() {
     ui.action_Start->setEnabled(false);
     ui.action_Pause->setEnabled(false);
     ui.action_Stop->setEnabled(false);
+    ui.action_Save_State->setEnabled(false);
+    ui.action_Load_State->setEnabled(false);
     render_window->hide();
 }
 
@@ -279,6 +290,23 @@ void GMainWindow::OnMenuLoadSymbolMap() {
         LoadSymbolMap(filename.toLatin1().data());
 }
 
+void GMainWindow::OnMenuSaveState() {
+    QString filename = QFileDialog::getSaveFileName(this, tr("Save State"), QString(), tr("Citra state (*.cst)"));
+    // Done by the emulation thread the next time it runs
+    if (filename.size())
+        SaveState::RequestSave(filename.toLatin1().data());
+}
+
+void GMainWindow::OnMenuLoadState() {
+    QString filename = QFileDialog::getOpenFileName(this, tr("Load State"), QString(), tr("Citra state (*.cst)"));
+    if (filename.size())
+        SaveState::RequestLoad(filename.toLatin1().data());
+}
+
+void GMainWindow::OnRewind() {
+    Rewind::RequestRewind();
+}
+
 void GMainWindow::OnStartGame()
 {
     emu_thread->SetRunning(true);
@@ -286,6 +314,8 @@ void GMainWindow::OnStartGame()
     ui.action_Start->setEnabled(false);
     ui.action_Pause->setEnabled(true);
     ui.action_Stop->setEnabled(true);
+    ui.action_Save_State->setEnabled(true);
+    ui.action_Load_State->setEnabled(true);
 }
 
 void GMainWindow::OnPauseGame()
@@ -311,6 +341,10 @@ void GMainWindow::SetHardwareRendererEnabled(bool enabled) {
     VideoCore::g_hw_renderer_enabled = enabled;
 }
 
+void GMainWindow::SetPerfOverlayShown(bool shown) {
+    Settings::values.show_perf_overlay = shown;
+}
+
 void GMainWindow::ToggleWindowMode() {
     if (ui.action_Single_Window_Mode->isChecked()) {
         // Render in the main window...
@@ -66,10 +66,14 @@ private slots:
     void OnStopGame();
     void OnMenuLoadFile();
     void OnMenuLoadSymbolMap();
+    void OnMenuSaveState();
+    void OnMenuLoadState();
+    void OnRewind();
     void OnOpenHotkeysDialog();
     void OnConfigure();
     void OnDisplayTitleBars(bool);
     void SetHardwareRendererEnabled(bool);
+    void SetPerfOverlayShown(bool);
     void ToggleWindowMode();
 
 private:
@@ -34,6 +34,7 @@
 #include <set>
 #include <type_traits>
 
+#include "common/assert.h"
 #include "common/common_types.h"
 #include "common/file_util.h"
 #include "common/logging/log.h"
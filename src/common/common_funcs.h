@@ -92,6 +92,21 @@ inline u64 _rotr64(u64 x, unsigned int shift){
     #define Crash() {DebugBreak();}
 #endif // _MSC_VER ndef
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/// Returns the number of zero bits above the highest set bit. The value must not be zero.
+inline int CountLeadingZeros64(u64 value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return 63 - (int)index;
+#else
+    return __builtin_clzll(value);
+#endif
+}
+
 // Generic function to get last error message.
 // Call directly after the command or use the error num.
 // This function might change the error code.
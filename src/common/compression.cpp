@@ -0,0 +1,163 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+
+#include "common/compression.h"
+
+namespace Common {
+
+// Limits of the block format: matches are at least MIN_MATCH bytes long, the last LAST_LITERALS
+// bytes are literals and the last match starts at least MATCH_FIND_LIMIT bytes before the end
+static const size_t MIN_MATCH = 4;
+static const size_t LAST_LITERALS = 5;
+static const size_t MATCH_FIND_LIMIT = 12;
+static const size_t MAX_OFFSET = 0xFFFF;
+
+static const unsigned HASH_BITS = 16;
+
+static u32 Read32(const u8* data) {
+    u32 value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static u32 Hash(u32 sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/// Writes the part of a length that doesn't fit in its token
+static void WriteLengthExtension(std::vector<u8>& output, size_t length) {
+    for (; length >= 255; length -= 255)
+        output.push_back(255);
+    output.push_back(static_cast<u8>(length));
+}
+
+static void WriteSequence(std::vector<u8>& output, const u8* literals, size_t num_literals,
+                          size_t offset, size_t match_length) {
+    const size_t match_code = match_length - MIN_MATCH;
+    output.push_back(static_cast<u8>((std::min<size_t>(num_literals, 15) << 4) | std::min<size_t>(match_code, 15)));
+    if (num_literals >= 15)
+        WriteLengthExtension(output, num_literals - 15);
+    output.insert(output.end(), literals, literals + num_literals);
+
+    output.push_back(static_cast<u8>(offset));
+    output.push_back(static_cast<u8>(offset >> 8));
+    if (match_code >= 15)
+        WriteLengthExtension(output, match_code - 15);
+}
+
+static void WriteLastLiterals(std::vector<u8>& output, const u8* literals, size_t num_literals) {
+    output.push_back(static_cast<u8>(std::min<size_t>(num_literals, 15) << 4));
+    if (num_literals >= 15)
+        WriteLengthExtension(output, num_literals - 15);
+    output.insert(output.end(), literals, literals + num_literals);
+}
+
+std::vector<u8> CompressLZ4(const u8* data, size_t size) {
+    std::vector<u8> output;
+    output.reserve(size / 2 + 16);
+
+    size_t anchor = 0;
+    if (size > MATCH_FIND_LIMIT) {
+        // Last position a match is searched at, and the end of the bytes it may cover
+        const size_t search_limit = size - MATCH_FIND_LIMIT;
+        const size_t match_limit = size - LAST_LITERALS;
+
+        std::vector<u32> table(1 << HASH_BITS, 0);
+        size_t position = 1;
+        table[Hash(Read32(data))] = 0;
+
+        while (position <= search_limit) {
+            const u32 sequence = Read32(data + position);
+            const u32 hash = Hash(sequence);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<u32>(position);
+
+            if (position - candidate > MAX_OFFSET || Read32(data + candidate) != sequence) {
+                // Skip ahead faster the longer nothing has matched, incompressible data is passed
+                // over quickly that way
+                position += 1 + ((position - anchor) >> 6);
+                continue;
+            }
+
+            size_t match_end = position + MIN_MATCH;
+            while (match_end < match_limit && data[match_end] == data[candidate + match_end - position])
+                ++match_end;
+            while (position > anchor && candidate > 0 && data[position - 1] == data[candidate - 1]) {
+                --position;
+                --candidate;
+            }
+
+            WriteSequence(output, data + anchor, position - anchor, position - candidate, match_end - position);
+            position = anchor = match_end;
+        }
+    }
+
+    WriteLastLiterals(output, data + anchor, size - anchor);
+    return output;
+}
+
+/// Reads the part of a length that didn't fit in its token
+static bool ReadLengthExtension(const u8* source, size_t source_size, size_t& position, size_t& length) {
+    u8 byte;
+    do {
+        if (position >= source_size)
+            return false;
+        byte = source[position++];
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool DecompressLZ4(const u8* source, size_t source_size, u8* destination, size_t destination_size) {
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < source_size) {
+        const u8 token = source[in++];
+
+        size_t num_literals = token >> 4;
+        if (num_literals == 15 && !ReadLengthExtension(source, source_size, in, num_literals))
+            return false;
+        if (num_literals > source_size - in || num_literals > destination_size - out)
+            return false;
+        std::memcpy(destination + out, source + in, num_literals);
+        in += num_literals;
+        out += num_literals;
+
+        // The last sequence has no match
+        if (in == source_size)
+            break;
+
+        if (source_size - in < 2)
+            return false;
+        const size_t offset = source[in] | (source[in + 1] << 8);
+        in += 2;
+        if (offset == 0 || offset > out)
+            return false;
+
+        size_t match_length = token & 15;
+        if (match_length == 15 && !ReadLengthExtension(source, source_size, in, match_length))
+            return false;
+        match_length += MIN_MATCH;
+        if (match_length > destination_size - out)
+            return false;
+
+        // Matches may overlap the bytes they produce, which repeats them
+        const u8* match = destination + out - offset;
+        if (offset >= match_length) {
+            std::memcpy(destination + out, match, match_length);
+        } else {
+            for (size_t i = 0; i < match_length; ++i)
+                destination[out + i] = match[i];
+        }
+        out += match_length;
+    }
+
+    return out == destination_size;
+}
+
+} // namespace
@@ -0,0 +1,33 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "common/common_types.h"
+
+namespace Common {
+
+/**
+ * Compresses a block of memory into the LZ4 block format. This favours speed over ratio, it is
+ * meant for large amounts of data that have to be written quickly, like emulated memory.
+ * @param data Pointer to the data to compress
+ * @param size Number of bytes to compress
+ * @return The compressed block, which doesn't record the size of the data
+ */
+std::vector<u8> CompressLZ4(const u8* data, size_t size);
+
+/**
+ * Decompresses a block in the LZ4 block format
+ * @param source Pointer to the compressed block
+ * @param source_size Size of the compressed block
+ * @param destination Buffer for the decompressed data
+ * @param destination_size Size of the decompressed data
+ * @return Whether the block was valid and decompressed to exactly the given size
+ */
+bool DecompressLZ4(const u8* source, size_t source_size, u8* destination, size_t destination_size);
+
+} // namespace
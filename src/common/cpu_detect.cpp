@@ -0,0 +1,163 @@
+// Copyright 2013 Dolphin Emulator Project / 2014 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "common/common_types.h"
+#include "common/cpu_detect.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_DETECT_X86
+
+#ifdef _MSC_VER
+#include <intrin.h>
+
+static void CPUID(u32 function, u32 subfunction, u32 regs[4]) {
+    __cpuidex(reinterpret_cast<int*>(regs), function, subfunction);
+}
+
+static u64 GetXCR0() {
+    return _xgetbv(0);
+}
+
+#else
+#include <cpuid.h>
+
+static void CPUID(u32 function, u32 subfunction, u32 regs[4]) {
+    __cpuid_count(function, subfunction, regs[0], regs[1], regs[2], regs[3]);
+}
+
+static u64 GetXCR0() {
+    u32 eax, edx;
+    // xgetbv, spelled out for assemblers that don't know the mnemonic
+    __asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((u64)edx << 32) | eax;
+}
+
+#endif
+#endif
+
+CPUInfo cpu_info;
+
+CPUInfo::CPUInfo() {
+    Detect();
+}
+
+void CPUInfo::Detect() {
+    std::memset(this, 0, sizeof(*this));
+
+    num_cores = std::max(1u, std::thread::hardware_concurrency());
+    logical_cpu_count = num_cores;
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__)
+    OS64bit = true;
+    CPU64bit = true;
+    Mode64bit = true;
+#endif
+
+#ifdef CPU_DETECT_X86
+    u32 regs[4];
+
+    // The vendor string is stored in EBX, EDX, ECX
+    CPUID(0, 0, regs);
+    const u32 max_function = regs[0];
+    std::memcpy(&cpu_string[0], &regs[1], 4);
+    std::memcpy(&cpu_string[4], &regs[3], 4);
+    std::memcpy(&cpu_string[8], &regs[2], 4);
+
+    if (std::strcmp(cpu_string, "GenuineIntel") == 0)
+        vendor = VENDOR_INTEL;
+    else if (std::strcmp(cpu_string, "AuthenticAMD") == 0)
+        vendor = VENDOR_AMD;
+    else
+        vendor = VENDOR_OTHER;
+
+    CPUID(0x80000000, 0, regs);
+    const u32 max_ex_function = regs[0];
+    if (max_ex_function >= 0x80000004) {
+        for (u32 i = 0; i < 3; ++i) {
+            CPUID(0x80000002 + i, 0, regs);
+            std::memcpy(&brand_string[i * 16], regs, 16);
+        }
+    } else {
+        std::strcpy(brand_string, cpu_string);
+    }
+
+    if (max_function >= 1) {
+        CPUID(1, 0, regs);
+        const u32 ecx = regs[2], edx = regs[3];
+
+        HTT = (edx >> 28) & 1;
+        if (HTT)
+            logical_cpu_count = (regs[1] >> 16) & 0xFF;
+
+        bSSE    = (edx >> 25) & 1;
+        bSSE2   = (edx >> 26) & 1;
+        bSSE3   = (ecx >> 0) & 1;
+        bSSSE3  = (ecx >> 9) & 1;
+        bSSE4_1 = (ecx >> 19) & 1;
+        bSSE4_2 = (ecx >> 20) & 1;
+        bPOPCNT = (ecx >> 23) & 1;
+        bAES    = (ecx >> 25) & 1;
+
+        // AVX also needs the OS to save the YMM registers on context switches
+        const bool osxsave = (ecx >> 27) & 1;
+        if (((ecx >> 28) & 1) && osxsave)
+            bAVX = (GetXCR0() & 6) == 6;
+    }
+
+    if (max_ex_function >= 0x80000001) {
+        CPUID(0x80000001, 0, regs);
+        const u32 ecx = regs[2], edx = regs[3];
+
+        bLAHFSAHF64 = (ecx >> 0) & 1;
+        bLZCNT      = (ecx >> 5) & 1;
+        bSSE4A      = (ecx >> 6) & 1;
+        bLongMode   = (edx >> 29) & 1;
+        CPU64bit    = CPU64bit || bLongMode;
+    }
+#elif defined(__arm__) || defined(__aarch64__) || defined(_M_ARM)
+    vendor = VENDOR_ARM;
+    std::strcpy(cpu_string, "ARM");
+    std::strcpy(brand_string, "ARM");
+#if defined(__aarch64__)
+    bFP = true;
+    bASIMD = true;
+#elif defined(__ARM_NEON__)
+    bNEON = true;
+#endif
+#else
+    vendor = VENDOR_OTHER;
+    std::strcpy(cpu_string, "Unknown");
+    std::strcpy(brand_string, "Unknown");
+#endif
+}
+
+std::string CPUInfo::Summarize() {
+    std::string sum(brand_string);
+    sum += " (" + std::to_string(num_cores) + " threads)";
+
+    static const struct {
+        bool CPUInfo::*flag;
+        const char* name;
+    } features[] = {
+        { &CPUInfo::bSSE, "SSE" },       { &CPUInfo::bSSE2, "SSE2" },
+        { &CPUInfo::bSSE3, "SSE3" },     { &CPUInfo::bSSSE3, "SSSE3" },
+        { &CPUInfo::bSSE4_1, "SSE4.1" }, { &CPUInfo::bSSE4_2, "SSE4.2" },
+        { &CPUInfo::bSSE4A, "SSE4A" },   { &CPUInfo::bPOPCNT, "POPCNT" },
+        { &CPUInfo::bLZCNT, "LZCNT" },   { &CPUInfo::bAVX, "AVX" },
+        { &CPUInfo::bAES, "AES" },       { &CPUInfo::bNEON, "NEON" },
+        { &CPUInfo::bASIMD, "ASIMD" },
+    };
+    for (const auto& feature : features) {
+        if (this->*feature.flag)
+            sum += std::string(", ") + feature.name;
+    }
+    if (bLongMode)
+        sum += ", 64-bit support";
+    return sum;
+}
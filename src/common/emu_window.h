@@ -68,6 +68,13 @@ public:
     /// Releases (dunno if this is the "right" word) the GLFW context from the caller thread
     virtual void DoneCurrent() = 0;
 
+    /**
+     * Makes a context sharing its objects with the one of the window current for the caller thread,
+     * so that frames can be rendered on another thread than the one presenting them.
+     * @return False if the frontend doesn't provide such a context
+     */
+    virtual bool MakeSharedContextCurrent() { return false; }
+
     virtual void ReloadSetKeymaps() = 0;
 
     /// Signals a key press action to the HID module
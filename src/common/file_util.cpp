@@ -28,6 +28,7 @@
     #include <sys/param.h>
     #include <sys/types.h>
     #include <dirent.h>
+    #include <fcntl.h>
     #include <pwd.h>
     #include <unistd.h>
 #endif
@@ -257,6 +258,46 @@ bool Rename(const std::string &srcFilename, const std::string &destFilename)
     return false;
 }
 
+// renames file srcFilename to destFilename, replacing destFilename in a single step if it exists,
+// returns true on success
+bool Replace(const std::string &srcFilename, const std::string &destFilename)
+{
+    LOG_TRACE(Common_Filesystem, "%s --> %s",
+            srcFilename.c_str(), destFilename.c_str());
+#ifdef _WIN32
+    if (MoveFileEx(Common::UTF8ToTStr(srcFilename).c_str(), Common::UTF8ToTStr(destFilename).c_str(),
+                   MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        return true;
+#else
+    // POSIX rename already replaces the destination atomically
+    if (rename(srcFilename.c_str(), destFilename.c_str()) == 0)
+        return true;
+#endif
+    LOG_ERROR(Common_Filesystem, "failed %s --> %s: %s",
+              srcFilename.c_str(), destFilename.c_str(), GetLastErrorMsg());
+    return false;
+}
+
+// makes the host write the entries of directory to disk, returns true on success
+bool SyncDirectory(const std::string &directory)
+{
+#ifdef _WIN32
+    // Directories can't be synced on Windows, MOVEFILE_WRITE_THROUGH covers the renames
+    return true;
+#else
+    int fd = open(directory.c_str(), O_RDONLY);
+    if (fd < 0 || fsync(fd) != 0)
+    {
+        LOG_ERROR(Common_Filesystem, "failed %s: %s", directory.c_str(), GetLastErrorMsg());
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    close(fd);
+    return true;
+#endif
+}
+
 // copies file srcFilename to destFilename, returns true on success
 bool Copy(const std::string &srcFilename, const std::string &destFilename)
 {
@@ -989,6 +1030,20 @@ bool IOFile::Flush()
     return m_good;
 }
 
+bool IOFile::Sync()
+{
+    if (!Flush() || 0 !=
+#ifdef _WIN32
+        _commit(_fileno(m_file))
+#else
+        fsync(fileno(m_file))
+#endif
+    )
+        m_good = false;
+
+    return m_good;
+}
+
 bool IOFile::Resize(u64 size)
 {
     if (!IsOpen() || 0 !=
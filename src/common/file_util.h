@@ -91,6 +91,13 @@ bool DeleteDir(const std::string &filename);
 // renames file srcFilename to destFilename, returns true on success
 bool Rename(const std::string &srcFilename, const std::string &destFilename);
 
+// renames file srcFilename to destFilename, replacing destFilename in a single step if it exists,
+// returns true on success
+bool Replace(const std::string &srcFilename, const std::string &destFilename);
+
+// makes the host write the entries of directory to disk, returns true on success
+bool SyncDirectory(const std::string &directory);
+
 // copies file srcFilename to destFilename, returns true on success
 bool Copy(const std::string &srcFilename, const std::string &destFilename);
 
@@ -221,6 +228,8 @@ public:
     u64 GetSize();
     bool Resize(u64 size);
     bool Flush();
+    // Flushes the file and makes the host write it to disk
+    bool Sync();
 
     // clear error state
     void Clear() { m_good = true; std::clearerr(m_file); }
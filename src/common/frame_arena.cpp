@@ -0,0 +1,53 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <numeric>
+
+#include "common/frame_arena.h"
+
+namespace Common {
+
+/// Smallest block allocated, so that the first frames don't add a block for every allocation
+static const size_t MIN_BLOCK_SIZE = 64 * 1024;
+
+FrameArena::FrameArena(size_t initial_size) {
+    if (initial_size != 0)
+        AddBlock(initial_size);
+}
+
+void FrameArena::AddBlock(size_t min_size) {
+    const size_t size = std::max(min_size, MIN_BLOCK_SIZE);
+    blocks.emplace_back(new u8[size]);
+    block_sizes.push_back(size);
+    offset = 0;
+    ++num_heap_blocks;
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment) {
+    size_t aligned_offset = (offset + alignment - 1) & ~(alignment - 1);
+    if (blocks.empty() || aligned_offset + size > block_sizes.back()) {
+        // Blocks are aligned for any type, so a new one has room for the allocation at its start
+        AddBlock(size);
+        aligned_offset = 0;
+    }
+
+    used_size += aligned_offset - offset + size;
+    offset = aligned_offset + size;
+    return blocks.back().get() + aligned_offset;
+}
+
+void FrameArena::Reset() {
+    if (blocks.size() > 1) {
+        // Merged into one block of the total size, which the frames after this one fit into
+        const size_t total_size = std::accumulate(block_sizes.begin(), block_sizes.end(), size_t(0));
+        blocks.clear();
+        block_sizes.clear();
+        AddBlock(total_size);
+    }
+    offset = 0;
+    used_size = 0;
+}
+
+} // namespace Common
@@ -0,0 +1,60 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "common/common_types.h"
+
+namespace Common {
+
+/**
+ * Linear allocator for scratch memory that lives until the end of the frame, e.g. the buffers a
+ * draw converts data in. Allocating bumps a pointer, and everything is freed at once by Reset.
+ * When a frame needs more than the arena holds, more blocks are allocated from the heap, and the
+ * next Reset replaces them with a single block holding all of it, so that frames of the same
+ * workload don't touch the heap anymore after the first one. Not thread-safe.
+ */
+class FrameArena final : NonCopyable {
+public:
+    explicit FrameArena(size_t initial_size = 0);
+
+    /// Returns uninitialized memory for the given number of bytes, valid until the next Reset
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    /// Returns uninitialized memory for an array of trivial objects, valid until the next Reset
+    template <typename T>
+    T* AllocateArray(size_t count) {
+        return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    /// Frees all allocations at once, to be called at the end of every frame
+    void Reset();
+
+    /// Bytes allocated since the last Reset
+    size_t GetUsedSize() const {
+        return used_size;
+    }
+
+    /// Number of blocks the arena requested from the heap since startup
+    u64 GetNumHeapBlocks() const {
+        return num_heap_blocks;
+    }
+
+private:
+    void AddBlock(size_t min_size);
+
+    std::vector<std::unique_ptr<u8[]>> blocks;
+    /// Sizes of the blocks, by block index
+    std::vector<size_t> block_sizes;
+    /// Offset of the next free byte in the last block
+    size_t offset = 0;
+    size_t used_size = 0;
+    u64 num_heap_blocks = 0;
+};
+
+} // namespace Common
@@ -0,0 +1,89 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstring>
+
+#include "common/hash.h"
+
+namespace Common {
+
+// MurmurHash3 was written by Austin Appleby, and is placed in the public domain.
+// The author hereby disclaims copyright to this source code.
+
+static inline u64 RotateLeft64(u64 x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline u64 FinalMix64(u64 k) {
+    k ^= k >> 33;
+    k *= 0xFF51AFD7ED558CCDULL;
+    k ^= k >> 33;
+    k *= 0xC4CEB9FE1A85EC53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+u64 ComputeHash64(const void* data, size_t len) {
+    const u8* bytes = static_cast<const u8*>(data);
+    const size_t num_blocks = len / 16;
+
+    const u64 c1 = 0x87C37B91114253D5ULL;
+    const u64 c2 = 0x4CF5AD432745937FULL;
+
+    u64 h1 = 0;
+    u64 h2 = 0;
+
+    for (size_t i = 0; i < num_blocks; ++i) {
+        // Read through memcpy since the data needn't be aligned
+        u64 k1, k2;
+        std::memcpy(&k1, bytes + i * 16, sizeof(u64));
+        std::memcpy(&k2, bytes + i * 16 + 8, sizeof(u64));
+
+        k1 *= c1; k1 = RotateLeft64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = RotateLeft64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52DCE729;
+
+        k2 *= c2; k2 = RotateLeft64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = RotateLeft64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495AB5;
+    }
+
+    const u8* tail = bytes + num_blocks * 16;
+    u64 k1 = 0;
+    u64 k2 = 0;
+
+    switch (len & 15) {
+    case 15: k2 ^= u64(tail[14]) << 48;
+    case 14: k2 ^= u64(tail[13]) << 40;
+    case 13: k2 ^= u64(tail[12]) << 32;
+    case 12: k2 ^= u64(tail[11]) << 24;
+    case 11: k2 ^= u64(tail[10]) << 16;
+    case 10: k2 ^= u64(tail[ 9]) << 8;
+    case  9: k2 ^= u64(tail[ 8]) << 0;
+             k2 *= c2; k2 = RotateLeft64(k2, 33); k2 *= c1; h2 ^= k2;
+
+    case  8: k1 ^= u64(tail[ 7]) << 56;
+    case  7: k1 ^= u64(tail[ 6]) << 48;
+    case  6: k1 ^= u64(tail[ 5]) << 40;
+    case  5: k1 ^= u64(tail[ 4]) << 32;
+    case  4: k1 ^= u64(tail[ 3]) << 24;
+    case  3: k1 ^= u64(tail[ 2]) << 16;
+    case  2: k1 ^= u64(tail[ 1]) << 8;
+    case  1: k1 ^= u64(tail[ 0]) << 0;
+             k1 *= c1; k1 = RotateLeft64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= len;
+    h2 ^= len;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = FinalMix64(h1);
+    h2 = FinalMix64(h2);
+
+    h1 += h2;
+
+    return h1;
+}
+
+} // namespace
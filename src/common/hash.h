@@ -0,0 +1,22 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+
+#include "common/common_types.h"
+
+namespace Common {
+
+/**
+ * Computes a 64-bit hash of a block of memory, using the lower half of MurmurHash3_x64_128.
+ * It is meant for the quick detection of changed data, not for cryptographic purposes.
+ * @param data Pointer to the data to hash
+ * @param len Number of bytes to hash
+ * @return Hash of the data
+ */
+u64 ComputeHash64(const void* data, size_t len);
+
+} // namespace
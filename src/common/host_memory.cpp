@@ -0,0 +1,203 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "common/assert.h"
+#include "common/host_memory.h"
+#include "common/logging/log.h"
+#include "common/string_util.h"
+
+#if !defined(_WIN32) && (defined(__x86_64__) || defined(__aarch64__))
+#define HOST_MEMORY_SUPPORTED 1
+#else
+#define HOST_MEMORY_SUPPORTED 0
+#endif
+
+#if HOST_MEMORY_SUPPORTED
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Common {
+
+#if HOST_MEMORY_SUPPORTED
+
+// The fault handler is process-wide, so there is at most one view it handles faults for
+static u8* fault_view_base = nullptr;
+static size_t fault_view_size = 0;
+static HostMemory::FaultHandler fault_handler = nullptr;
+static struct sigaction previous_segv_action;
+static struct sigaction previous_bus_action;
+
+static void AccessViolationHandler(int sig, siginfo_t* info, void* context) {
+    u8* address = static_cast<u8*>(info->si_addr);
+    if (fault_handler != nullptr && address >= fault_view_base &&
+        address < fault_view_base + fault_view_size) {
+        if (fault_handler(address - fault_view_base))
+            return;
+    }
+
+    // Not ours, pass it on to whoever was there before us
+    const struct sigaction& previous = (sig == SIGSEGV) ? previous_segv_action : previous_bus_action;
+    if (previous.sa_flags & SA_SIGINFO) {
+        previous.sa_sigaction(sig, info, context);
+    } else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN) {
+        previous.sa_handler(sig);
+    } else {
+        // Restore the default action, returning re-executes the access and crashes as usual
+        sigaction(sig, &previous, nullptr);
+    }
+}
+
+HostMemory::~HostMemory() {
+    Release();
+}
+
+bool HostMemory::Init(size_t backing_size_, size_t view_size_) {
+    ASSERT(view_base == nullptr);
+
+    // Create an anonymous shared memory object by unlinking it right after creating it
+    const std::string name = StringFromFormat("/citra_memory_%d", (int)getpid());
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1) {
+        LOG_ERROR(Common_Memory, "Failed to create shared memory object");
+        return false;
+    }
+    shm_unlink(name.c_str());
+
+    if (ftruncate(fd, backing_size_) != 0) {
+        LOG_ERROR(Common_Memory, "Failed to resize shared memory object to %u MB",
+                  (unsigned)(backing_size_ >> 20));
+        Release();
+        return false;
+    }
+    backing_size = backing_size_;
+
+    void* backing = mmap(nullptr, backing_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (backing == MAP_FAILED) {
+        LOG_ERROR(Common_Memory, "Failed to map shared memory object");
+        Release();
+        return false;
+    }
+    backing_base = static_cast<u8*>(backing);
+
+    void* view = mmap(nullptr, view_size_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (view == MAP_FAILED) {
+        LOG_ERROR(Common_Memory, "Failed to reserve %u MB of address space",
+                  (unsigned)(view_size_ >> 20));
+        Release();
+        return false;
+    }
+    view_base = static_cast<u8*>(view);
+    view_size = view_size_;
+
+    return true;
+}
+
+void HostMemory::Release() {
+    if (fault_view_base == view_base) {
+        fault_handler = nullptr;
+        fault_view_base = nullptr;
+        fault_view_size = 0;
+    }
+    if (view_base != nullptr)
+        munmap(view_base, view_size);
+    if (backing_base != nullptr)
+        munmap(backing_base, backing_size);
+    if (fd != -1)
+        close(fd);
+
+    fd = -1;
+    backing_base = nullptr;
+    backing_size = 0;
+    view_base = nullptr;
+    view_size = 0;
+}
+
+void HostMemory::Map(size_t view_offset, size_t backing_offset, size_t size, bool writable) {
+    DEBUG_ASSERT(view_offset + size <= view_size && backing_offset + size <= backing_size);
+
+    const int protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    void* result = mmap(view_base + view_offset, size, protection, MAP_SHARED | MAP_FIXED, fd, backing_offset);
+    ASSERT_MSG(result != MAP_FAILED, "Failed to map shared memory into the view");
+}
+
+void HostMemory::MapPrivate(size_t view_offset, size_t size) {
+    DEBUG_ASSERT(view_offset + size <= view_size);
+
+    void* result = mmap(view_base + view_offset, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    ASSERT_MSG(result != MAP_FAILED, "Failed to map private memory into the view");
+}
+
+void HostMemory::Unmap(size_t view_offset, size_t size) {
+    DEBUG_ASSERT(view_offset + size <= view_size);
+
+    // Replacing the range with a fresh reservation keeps other allocations from landing in it
+    void* result = mmap(view_base + view_offset, size, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    ASSERT_MSG(result != MAP_FAILED, "Failed to unmap part of the view");
+}
+
+void HostMemory::Protect(size_t view_offset, size_t size, bool writable) {
+    DEBUG_ASSERT(view_offset + size <= view_size);
+
+    const int protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    int result = mprotect(view_base + view_offset, size, protection);
+    ASSERT_MSG(result == 0, "Failed to change the protection of part of the view");
+}
+
+void HostMemory::SetFaultHandler(FaultHandler handler) {
+    static bool installed = false;
+    if (!installed) {
+        struct sigaction action = {};
+        action.sa_sigaction = AccessViolationHandler;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &previous_segv_action);
+        sigaction(SIGBUS, &action, &previous_bus_action);
+        installed = true;
+    }
+
+    fault_view_base = view_base;
+    fault_view_size = view_size;
+    fault_handler = handler;
+}
+
+#else
+
+HostMemory::~HostMemory() {
+}
+
+bool HostMemory::Init(size_t backing_size_, size_t view_size_) {
+    LOG_ERROR(Common_Memory, "Shared memory views aren't supported on this host");
+    return false;
+}
+
+void HostMemory::Release() {
+}
+
+void HostMemory::Map(size_t view_offset, size_t backing_offset, size_t size, bool writable) {
+    UNREACHABLE();
+}
+
+void HostMemory::MapPrivate(size_t view_offset, size_t size) {
+    UNREACHABLE();
+}
+
+void HostMemory::Unmap(size_t view_offset, size_t size) {
+    UNREACHABLE();
+}
+
+void HostMemory::Protect(size_t view_offset, size_t size, bool writable) {
+    UNREACHABLE();
+}
+
+void HostMemory::SetFaultHandler(FaultHandler handler) {
+}
+
+#endif
+
+} // namespace
@@ -0,0 +1,91 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+
+#include "common/common_types.h"
+
+namespace Common {
+
+/**
+ * A block of host shared memory together with a reserved range of host address space ("view")
+ * the block can be mapped into at arbitrary page granular offsets, any number of times. Parts of
+ * the view that aren't mapped are inaccessible, so accessing them raises an access violation.
+ *
+ * This is only implemented for 64-bit POSIX hosts. On other hosts, Init always fails.
+ */
+class HostMemory {
+public:
+    HostMemory() = default;
+    HostMemory(const HostMemory&) = delete;
+    HostMemory& operator=(const HostMemory&) = delete;
+    ~HostMemory();
+
+    /**
+     * Creates the shared memory block and reserves the view.
+     * @param backing_size Size of the shared memory block. It's only committed once touched.
+     * @param view_size Size of the address space range to reserve
+     * @return true on success
+     */
+    bool Init(size_t backing_size, size_t view_size);
+
+    /// Releases the view and the shared memory block
+    void Release();
+
+    /// Pointer to a mapping of the whole shared memory block, outside of the view
+    u8* BackingBase() const {
+        return backing_base;
+    }
+
+    size_t BackingSize() const {
+        return backing_size;
+    }
+
+    /// Start of the reserved view
+    u8* ViewBase() const {
+        return view_base;
+    }
+
+    /// Returns whether a host pointer points into the shared memory block
+    bool IsBacking(const u8* pointer) const {
+        return backing_base != nullptr && pointer >= backing_base &&
+               pointer < backing_base + backing_size;
+    }
+
+    /// Maps part of the shared memory block into the view
+    void Map(size_t view_offset, size_t backing_offset, size_t size, bool writable);
+
+    /// Maps zeroed private memory that isn't part of the shared memory block into the view
+    void MapPrivate(size_t view_offset, size_t size);
+
+    /// Makes a range of the view inaccessible again
+    void Unmap(size_t view_offset, size_t size);
+
+    /// Changes whether a mapped range of the view can be written to
+    void Protect(size_t view_offset, size_t size, bool writable);
+
+    /**
+     * Handler for access violations inside of a view.
+     * @param view_offset Offset of the faulting address into the view
+     * @return true if the fault was resolved and the faulting access should be retried
+     */
+    typedef bool (*FaultHandler)(size_t view_offset);
+
+    /**
+     * Installs a process-wide handler for access violations inside of this object's view. Faults
+     * elsewhere are passed on to the previous handler.
+     */
+    void SetFaultHandler(FaultHandler handler);
+
+private:
+    int fd = -1;
+    u8* backing_base = nullptr;
+    size_t backing_size = 0;
+    u8* view_base = nullptr;
+    size_t view_size = 0;
+};
+
+} // namespace
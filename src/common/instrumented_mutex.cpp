@@ -0,0 +1,35 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <chrono>
+
+#include "common/instrumented_mutex.h"
+#include "common/string_util.h"
+
+namespace Common {
+
+#if ENABLE_LOCK_PROFILING
+
+LockStats::LockStats(const char* name) {
+    counter_names[ACQUISITIONS] = StringFromFormat("%s lock acquisitions", name);
+    counter_names[CONTENTIONS] = StringFromFormat("%s lock contentions", name);
+    counter_names[WAIT_TIME] = StringFromFormat("%s lock wait (ns)", name);
+    for (int i = 0; i <= static_cast<int>(ThreadClass::NumClasses); ++i) {
+        counter_names[FIRST_HOLDER_CONTENTIONS + i] = StringFromFormat("%s lock contentions on %s threads",
+                name, GetThreadClassName(static_cast<ThreadClass>(i)));
+    }
+
+    for (int i = 0; i < NUM_COUNTERS; ++i)
+        counters[i] = new Perf::Counter(counter_names[i].c_str());
+}
+
+void LockStats::AddContention(ThreadClass holder, Profiling::Duration wait_time) {
+    counters[CONTENTIONS]->Add();
+    counters[WAIT_TIME]->Add(std::chrono::duration_cast<std::chrono::nanoseconds>(wait_time).count());
+    counters[FIRST_HOLDER_CONTENTIONS + static_cast<int>(holder)]->Add();
+}
+
+#endif
+
+} // namespace
@@ -0,0 +1,123 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include "common/common_types.h"
+#include "common/perf_counters.h"
+#include "common/profiler.h"
+#include "common/thread_policy.h"
+
+namespace Common {
+
+// If this is defined to 0, InstrumentedMutexes are plain mutexes and LockStats count nothing.
+#ifndef ENABLE_LOCK_PROFILING
+#define ENABLE_LOCK_PROFILING 1
+#endif
+
+/**
+ * Contention of a named lock, counted by the InstrumentedMutexes reporting to it: how often the lock
+ * was acquired, how often and for how long it had to be waited for, and which class of thread held
+ * it then. The counts are Perf::Counters named after the lock, so they are reported like any other
+ * counter. Should be declared as a global variable.
+ */
+class LockStats final : NonCopyable {
+public:
+#if ENABLE_LOCK_PROFILING
+    explicit LockStats(const char* name);
+
+    void AddAcquisition() {
+        counters[ACQUISITIONS]->Add();
+    }
+
+    /// Counts an acquisition that had to wait, for the given time, for a thread of the given class
+    void AddContention(ThreadClass holder, Profiling::Duration wait_time);
+#else
+    explicit LockStats(const char*) {}
+#endif
+
+private:
+#if ENABLE_LOCK_PROFILING
+    enum {
+        ACQUISITIONS,
+        CONTENTIONS,
+        WAIT_TIME,
+        /// Contentions by the class of the holding thread, the last one for unregistered threads
+        FIRST_HOLDER_CONTENTIONS,
+
+        NUM_COUNTERS = FIRST_HOLDER_CONTENTIONS + static_cast<int>(ThreadClass::NumClasses) + 1
+    };
+
+    /// The counters keep pointers to their names
+    std::array<std::string, NUM_COUNTERS> counter_names;
+    /// Never freed, the counter registry refers to them until the program exits
+    std::array<Perf::Counter*, NUM_COUNTERS> counters;
+#endif
+};
+
+/**
+ * Mutex counting its acquisitions and contention in a LockStats. Uncontended locking only adds a
+ * try_lock and a few relaxed stores, the clock is only read when the lock has to be waited for.
+ * Meets the Lockable requirements, so it works with std::lock_guard, std::unique_lock,
+ * std::condition_variable_any and SynchronizedWrapper.
+ */
+class InstrumentedMutex final : NonCopyable {
+public:
+#if ENABLE_LOCK_PROFILING
+    explicit InstrumentedMutex(LockStats& stats) : stats(stats), holder(ThreadClass::NumClasses) {}
+
+    void lock() {
+        if (!mutex.try_lock()) {
+            // The holder may change before the wait is over, it tells who is usually in the way
+            const ThreadClass holder_class = holder.load(std::memory_order_relaxed);
+            const Profiling::Clock::time_point start = Profiling::Clock::now();
+            mutex.lock();
+            stats.AddContention(holder_class, Profiling::Clock::now() - start);
+        }
+        Acquired();
+    }
+
+    bool try_lock() {
+        if (!mutex.try_lock())
+            return false;
+        Acquired();
+        return true;
+    }
+#else
+    explicit InstrumentedMutex(LockStats&) {}
+
+    void lock() {
+        mutex.lock();
+    }
+
+    bool try_lock() {
+        return mutex.try_lock();
+    }
+#endif
+
+    void unlock() {
+        mutex.unlock();
+    }
+
+private:
+#if ENABLE_LOCK_PROFILING
+    void Acquired() {
+        holder.store(GetCurrentThreadClass(), std::memory_order_relaxed);
+        stats.AddAcquisition();
+    }
+
+    LockStats& stats;
+    /// Class of the thread that acquired the mutex last
+    std::atomic<ThreadClass> holder;
+#endif
+
+    std::mutex mutex;
+};
+
+} // namespace
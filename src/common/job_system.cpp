@@ -0,0 +1,200 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/job_system.h"
+#include "common/logging/log.h"
+#include "common/make_unique.h"
+#include "common/profiler.h"
+#include "common/string_util.h"
+#include "common/thread.h"
+#include "common/thread_policy.h"
+
+namespace Common {
+namespace JobSystem {
+
+struct Job {
+    std::function<void()> func;
+    JobCounter* counter;
+};
+
+/// Deque of jobs, the owner uses the back and thieves the front
+struct JobQueue {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+
+    bool PopBack(Job& job) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (jobs.empty())
+            return false;
+        job = std::move(jobs.back());
+        jobs.pop_back();
+        return true;
+    }
+
+    bool PopFront(Job& job) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (jobs.empty())
+            return false;
+        job = std::move(jobs.front());
+        jobs.pop_front();
+        return true;
+    }
+};
+
+static Profiling::TimingCategory jobs_category("Worker Jobs");
+
+static std::vector<std::unique_ptr<JobQueue>> worker_queues;
+static std::vector<std::thread> worker_threads;
+/// Jobs spawned by threads that aren't workers
+static JobQueue shared_queue;
+/// Index of the calling thread in worker_queues, -1 if it isn't a worker
+static thread_local int worker_index = -1;
+
+/// Protects the sleeping of the workers and of the threads waiting for a counter
+static std::mutex sleep_mutex;
+static std::condition_variable wake_up;
+static std::atomic<unsigned> num_queued(0);
+static bool stopping = false;
+static bool running = false;
+
+/// Takes a job from the calling worker's own deque, the shared queue, or another worker
+static bool TakeJob(Job& job) {
+    const int num_workers = static_cast<int>(worker_queues.size());
+    bool found = (worker_index >= 0 && worker_queues[worker_index]->PopBack(job)) || shared_queue.PopFront(job);
+    for (int i = 1; !found && i <= num_workers; ++i) {
+        // Start with the neighbour so that the thieves don't all pick the same victim
+        const int victim = (std::max(worker_index, 0) + i) % num_workers;
+        found = victim != worker_index && worker_queues[victim]->PopFront(job);
+    }
+    if (found)
+        --num_queued;
+    return found;
+}
+
+void FinishJob(JobCounter* counter) {
+    if (counter == nullptr || --counter->pending != 0)
+        return;
+    // Wakes up the thread waiting for the counter
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    wake_up.notify_all();
+}
+
+static void RunJob(Job& job) {
+    job.func();
+    FinishJob(job.counter);
+}
+
+static void WorkerLoop(int index) {
+    worker_index = index;
+    Common::RegisterCurrentThread(Common::StringFromFormat("JobWorker%d", index).c_str(),
+                                  ThreadClass::Worker);
+
+    Job job;
+    while (true) {
+        if (TakeJob(job)) {
+            Profiling::ScopeTimer timer(jobs_category);
+            RunJob(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake_up.wait(lock, [] { return num_queued != 0 || stopping; });
+        if (stopping && num_queued == 0)
+            break;
+    }
+}
+
+void JobCounter::Wait() {
+    Job job;
+    while (pending != 0) {
+        if (TakeJob(job)) {
+            RunJob(job);
+            continue;
+        }
+
+        // The remaining jobs are running on other threads
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake_up.wait(lock, [this] { return num_queued != 0 || pending == 0; });
+    }
+}
+
+void Init(unsigned num_workers) {
+    stopping = false;
+    running = num_workers != 0;
+    for (unsigned i = 0; i < num_workers; ++i)
+        worker_queues.emplace_back(Common::make_unique<JobQueue>());
+    for (unsigned i = 0; i < num_workers; ++i)
+        worker_threads.emplace_back(WorkerLoop, static_cast<int>(i));
+
+    LOG_DEBUG(Common, "Started %u job workers", num_workers);
+}
+
+void Shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake_up.notify_all();
+    for (std::thread& thread : worker_threads)
+        thread.join();
+
+    running = false;
+    worker_threads.clear();
+    worker_queues.clear();
+}
+
+unsigned GetNumWorkers() {
+    return static_cast<unsigned>(worker_threads.size());
+}
+
+void Spawn(std::function<void()> job, JobCounter* counter) {
+    if (!running) {
+        job();
+        return;
+    }
+
+    if (counter != nullptr)
+        ++counter->pending;
+
+    JobQueue& queue = worker_index >= 0 ? *worker_queues[worker_index] : shared_queue;
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back({ std::move(job), counter });
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        ++num_queued;
+    }
+    wake_up.notify_one();
+}
+
+void ParallelFor(unsigned begin, unsigned end, unsigned grain_size,
+                 const std::function<void(unsigned first, unsigned last)>& func) {
+    if (begin >= end)
+        return;
+    grain_size = std::max(grain_size, 1u);
+
+    // The calling thread takes the first range itself
+    JobCounter counter;
+    for (u64 first = (u64)begin + grain_size; first < end; first += grain_size) {
+        const unsigned range_first = static_cast<unsigned>(first);
+        const unsigned range_last = static_cast<unsigned>(std::min<u64>(first + grain_size, end));
+        Spawn([&func, range_first, range_last] { func(range_first, range_last); }, &counter);
+    }
+    func(begin, static_cast<unsigned>(std::min<u64>((u64)begin + grain_size, end)));
+    counter.Wait();
+}
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,64 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+#include "common/common_types.h"
+
+namespace Common {
+
+/**
+ * Pool of worker threads shared by the parts of the emulator that spread work over several
+ * threads. Every worker has a deque of jobs: it pushes the jobs it spawns at the back and takes its
+ * next job from there, and when it runs out it steals the oldest job of another worker. Jobs spawned
+ * by other threads go to a shared queue the workers take from as well.
+ *
+ * Waiting for jobs runs pending jobs rather than blocking, so that jobs can spawn jobs and wait for
+ * them. Until the pool is started, and with no workers, jobs are run as they are spawned.
+ */
+namespace JobSystem {
+
+/// Counts the unfinished jobs spawned with it, which can be waited for
+class JobCounter : NonCopyable {
+public:
+    JobCounter() : pending(0) {}
+
+    ~JobCounter() {
+        Wait();
+    }
+
+    /// Runs pending jobs until all jobs spawned with this counter are finished
+    void Wait();
+
+private:
+    friend void Spawn(std::function<void()> job, JobCounter* counter);
+    friend void FinishJob(JobCounter* counter);
+
+    std::atomic<unsigned> pending;
+};
+
+/// Starts the workers, which are Worker class threads
+void Init(unsigned num_workers);
+
+/// Stops the workers once they finished the pending jobs
+void Shutdown();
+
+unsigned GetNumWorkers();
+
+/// Queues a job to be run by any thread. The counter, if any, has to outlive the job.
+void Spawn(std::function<void()> job, JobCounter* counter = nullptr);
+
+/**
+ * Calls func(first, last) for consecutive ranges covering [begin, end), each at most grain_size
+ * long, on the workers and the calling thread. Returns once all ranges are done.
+ */
+void ParallelFor(unsigned begin, unsigned end, unsigned grain_size,
+                 const std::function<void(unsigned first, unsigned last)>& func);
+
+} // namespace
+
+} // namespace
@@ -4,13 +4,21 @@
 
 #include <algorithm>
 #include <array>
+#include <condition_variable>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "common/common_funcs.h" // snprintf compatibility define
 #include "common/logging/backend.h"
 #include "common/logging/filter.h"
 #include "common/logging/log.h"
 #include "common/logging/text_formatter.h"
+#include "common/memory_accounting.h"
 
 namespace Log {
 
@@ -82,18 +90,37 @@ const char* GetLevelName(Level log_level) {
 #undef LVL
 }
 
-Entry CreateEntry(Class log_class, Level log_level,
-                        const char* filename, unsigned int line_nr, const char* function,
-                        const char* format, va_list args) {
+/// Time since the first message was logged
+static std::chrono::microseconds GetTimestamp() {
     using std::chrono::steady_clock;
     using std::chrono::duration_cast;
 
     static steady_clock::time_point time_origin = steady_clock::now();
+    return duration_cast<std::chrono::microseconds>(steady_clock::now() - time_origin);
+}
 
+void RawArguments::Add(const char* value) {
+    if (value == nullptr)
+        value = "(null)";
+    if (size + 4u > CAPACITY)
+        return;
+
+    const u16 length = static_cast<u16>(std::min(std::strlen(value), CAPACITY - size - 4));
+    data[size++] = static_cast<u8>(ArgumentType::String);
+    data[size++] = 0;
+    std::memcpy(&data[size], &length, sizeof(length));
+    size += sizeof(length);
+    std::memcpy(&data[size], value, length);
+    size += length;
+}
+
+Entry CreateEntry(Class log_class, Level log_level,
+                        const char* filename, unsigned int line_nr, const char* function,
+                        const char* format, va_list args) {
     std::array<char, 4 * 1024> formatting_buffer;
 
     Entry entry;
-    entry.timestamp = duration_cast<std::chrono::microseconds>(steady_clock::now() - time_origin);
+    entry.timestamp = GetTimestamp();
     entry.log_class = log_class;
     entry.log_level = log_level;
 
@@ -112,6 +139,247 @@ void SetFilter(Filter* new_filter) {
     filter = new_filter;
 }
 
+bool IsLogged(Class log_class, Level log_level) {
+    return filter == nullptr || filter->CheckMessage(log_class, log_level);
+}
+
+/// Messages are written to it by the writer, and only errors printed, while a binary log is open
+static std::FILE* binary_log = nullptr;
+/// Ids of the call sites whose record was written to the binary log
+static std::unordered_map<const CallSite*, u32> binary_log_call_sites;
+/// Guards the binary log, which is written by the logging threads once the writer has stopped
+static std::mutex binary_log_mutex;
+
+static void WriteBinary(const void* data, size_t size) {
+    std::fwrite(data, 1, size, binary_log);
+}
+
+static void WriteBinaryString(const char* string) {
+    const u16 length = static_cast<u16>(std::min<size_t>(std::strlen(string), 0xFFFF));
+    WriteBinary(&length, sizeof(length));
+    WriteBinary(string, length);
+}
+
+bool StartBinaryLog(const std::string& path) {
+    std::lock_guard<std::mutex> lock(binary_log_mutex);
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    if (binary_log != nullptr)
+        std::fclose(binary_log);
+    binary_log = file;
+    binary_log_call_sites.clear();
+    WriteBinary(&BINARY_LOG_MAGIC, sizeof(BINARY_LOG_MAGIC));
+    WriteBinary(&BINARY_LOG_VERSION, sizeof(BINARY_LOG_VERSION));
+    return true;
+}
+
+/// Writes a deferred message to the binary log, returns false if there is none
+static bool WriteBinaryEntry(const Entry& entry) {
+    std::lock_guard<std::mutex> lock(binary_log_mutex);
+    if (binary_log == nullptr)
+        return false;
+
+    const CallSite& call_site = *entry.call_site;
+    auto inserted = binary_log_call_sites.emplace(&call_site, static_cast<u32>(binary_log_call_sites.size()));
+    const u32 id = inserted.first->second;
+    if (inserted.second) {
+        const u8 header[] = { static_cast<u8>(BinaryRecord::CallSite) };
+        const u8 class_level[] = { static_cast<u8>(call_site.log_class), static_cast<u8>(call_site.log_level) };
+        const u32 line_nr = call_site.line_nr;
+        WriteBinary(header, sizeof(header));
+        WriteBinary(&id, sizeof(id));
+        WriteBinary(class_level, sizeof(class_level));
+        WriteBinary(&line_nr, sizeof(line_nr));
+        WriteBinaryString(call_site.filename);
+        WriteBinaryString(call_site.function);
+        WriteBinaryString(call_site.format);
+    }
+
+    const u8 header[] = { static_cast<u8>(BinaryRecord::Message) };
+    const u64 timestamp = entry.timestamp.count();
+    WriteBinary(header, sizeof(header));
+    WriteBinary(&id, sizeof(id));
+    WriteBinary(&timestamp, sizeof(timestamp));
+    WriteBinary(&entry.arguments.size, sizeof(entry.arguments.size));
+    WriteBinary(entry.arguments.data.data(), entry.arguments.size);
+    return true;
+}
+
+static void FlushBinaryLog() {
+    std::lock_guard<std::mutex> lock(binary_log_mutex);
+    if (binary_log != nullptr)
+        std::fflush(binary_log);
+}
+
+/// Formats the location and message of a deferred entry
+static void FormatDeferredEntry(Entry& entry) {
+    const CallSite& call_site = *entry.call_site;
+    std::array<char, 1024> location;
+    snprintf(location.data(), location.size(), "%s:%s:%u", call_site.filename, call_site.function, call_site.line_nr);
+    entry.location = location.data();
+    entry.message = FormatRawArguments(call_site.format, entry.arguments.data.data(), entry.arguments.size);
+}
+
+/// Prints an entry, or writes it to the binary log
+static void OutputEntry(Entry& entry) {
+    if (entry.call_site != nullptr) {
+        if (WriteBinaryEntry(entry) && entry.log_level < Level::Error)
+            return;
+        FormatDeferredEntry(entry);
+    }
+    PrintColoredMessage(entry);
+}
+
+/// Number of entries that can be waiting to be printed before new ones get dropped
+static const size_t LOG_BUFFER_SIZE = 4096;
+
+/**
+ * Prints log entries on a dedicated thread, so the threads logging them don't have to wait on the
+ * console. Entries are queued in a fixed size ring buffer and printed in batches. When the buffer
+ * is full, new entries are dropped and only counted, the writer reports how many it lost.
+ */
+class AsyncWriter {
+public:
+    AsyncWriter() : buffer(LOG_BUFFER_SIZE) {
+        // The ring buffer and the writer's batch
+        Common::MemoryAccounting::Allocate(Common::MemoryAccounting::Tag::Logging, 2 * LOG_BUFFER_SIZE * sizeof(Entry));
+        writer_thread = std::thread(&AsyncWriter::WriterLoop, this);
+    }
+
+    /**
+     * Queues an entry to be printed, or prints it right away once the writer has been stopped.
+     * @param wait_for_space Wait for the writer to make room if the buffer is full, instead of
+     *                       dropping the entry
+     */
+    void Push(Entry&& entry, bool wait_for_space) {
+        std::unique_lock<std::mutex> lock(mutex);
+        // The writer thread can't wait for itself, it logs when the buffer overflowed
+        const bool is_writer = std::this_thread::get_id() == writer_thread.get_id();
+        if (wait_for_space && !is_writer)
+            entries_written.wait(lock, [this] { return count != buffer.size() || stopped; });
+
+        if (stopped || is_writer) {
+            lock.unlock();
+            OutputEntry(entry);
+            return;
+        }
+
+        if (count == buffer.size()) {
+            ++dropped;
+            return;
+        }
+        Common::MemoryAccounting::Allocate(Common::MemoryAccounting::Tag::Logging, GetTextSize(entry));
+        buffer[(read_index + count) % buffer.size()] = std::move(entry);
+        ++count;
+        ++pushed;
+        entry_added.notify_one();
+    }
+
+    /// Waits until all entries that have been pushed so far are printed
+    void Flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (std::this_thread::get_id() == writer_thread.get_id())
+            return;
+        const u64 target = pushed;
+        entries_written.wait(lock, [&] { return written >= target || stopped; });
+    }
+
+    /// Prints the remaining entries and stops the writer thread
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping)
+                return;
+            stopping = true;
+            entry_added.notify_one();
+        }
+        writer_thread.join();
+        FlushBinaryLog();
+    }
+
+private:
+    /// Bytes held by the strings of a queued entry
+    static size_t GetTextSize(const Entry& entry) {
+        return entry.location.capacity() + entry.message.capacity();
+    }
+
+    void WriterLoop() {
+        std::vector<Entry> batch;
+        batch.reserve(buffer.size());
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            entry_added.wait(lock, [this] { return count != 0 || stopping; });
+            if (count == 0)
+                break;
+
+            for (; count != 0; --count) {
+                batch.push_back(std::move(buffer[read_index]));
+                read_index = (read_index + 1) % buffer.size();
+            }
+            const u64 newly_dropped = dropped;
+            dropped = 0;
+            lock.unlock();
+
+            // Deferred entries only get their text here
+            size_t text_size = 0;
+            for (const Entry& entry : batch)
+                text_size += GetTextSize(entry);
+            Common::MemoryAccounting::Free(Common::MemoryAccounting::Tag::Logging, text_size);
+
+            for (Entry& entry : batch)
+                OutputEntry(entry);
+            FlushBinaryLog();
+            if (newly_dropped != 0)
+                LOG_WARNING(Log, "Log buffer was full, dropped %llu messages", (unsigned long long)newly_dropped);
+
+            lock.lock();
+            written += batch.size();
+            batch.clear();
+            entries_written.notify_all();
+        }
+
+        stopped = true;
+        entries_written.notify_all();
+    }
+
+    std::mutex mutex;
+    std::condition_variable entry_added;
+    std::condition_variable entries_written;
+
+    std::vector<Entry> buffer;
+    size_t read_index = 0;
+    size_t count = 0;
+
+    /// Number of entries pushed and printed so far, used to tell when a flush is complete
+    u64 pushed = 0;
+    u64 written = 0;
+    /// Number of entries dropped since the writer last reported it
+    u64 dropped = 0;
+
+    bool stopping = false;
+    bool stopped = false;
+
+    std::thread writer_thread;
+};
+
+static AsyncWriter* GetWriter() {
+    // Never destroyed, so that messages logged from static destructors still have somewhere to go.
+    // Instead, the writer is stopped at exit, which prints whatever is left in its buffer.
+    static AsyncWriter* writer = [] {
+        AsyncWriter* new_writer = new AsyncWriter;
+        std::atexit([] { GetWriter()->Stop(); });
+        return new_writer;
+    }();
+    return writer;
+}
+
+void FlushLog() {
+    GetWriter()->Flush();
+}
+
 void LogMessage(Class log_class, Level log_level,
                 const char* filename, unsigned int line_nr, const char* function,
                 const char* format, ...) {
@@ -124,7 +392,26 @@ void LogMessage(Class log_class, Level log_level,
             filename, line_nr, function, format, args);
     va_end(args);
 
-    PrintColoredMessage(entry);
+    AsyncWriter* writer = GetWriter();
+    const bool is_critical = log_level == Level::Critical;
+    writer->Push(std::move(entry), is_critical);
+    if (is_critical)
+        writer->Flush();
+}
+
+void LogDeferred(const CallSite& call_site, const RawArguments& arguments) {
+    Entry entry;
+    entry.timestamp = GetTimestamp();
+    entry.log_class = call_site.log_class;
+    entry.log_level = call_site.log_level;
+    entry.call_site = &call_site;
+    entry.arguments = arguments;
+
+    AsyncWriter* writer = GetWriter();
+    const bool is_critical = call_site.log_level == Level::Critical;
+    writer->Push(std::move(entry), is_critical);
+    if (is_critical)
+        writer->Flush();
 }
 
 }
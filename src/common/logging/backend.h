@@ -26,23 +26,32 @@ struct Entry {
     std::string location;
     std::string message;
 
+    /**
+     * Call site of a deferred message, whose location and message are only formatted from it and
+     * the arguments by the writer. nullptr if the entry was formatted when it was logged.
+     */
+    const CallSite* call_site = nullptr;
+    RawArguments arguments;
+
     Entry() = default;
 
     // TODO(yuriks) Use defaulted move constructors once MSVC supports them
 #define MOVE(member) member(std::move(o.member))
     Entry(Entry&& o)
         : MOVE(timestamp), MOVE(log_class), MOVE(log_level),
-        MOVE(location), MOVE(message)
+        MOVE(location), MOVE(message), MOVE(call_site), MOVE(arguments)
     {}
 #undef MOVE
 
-    Entry& operator=(const Entry&& o) {
+    Entry& operator=(Entry&& o) {
 #define MOVE(member) member = std::move(o.member)
         MOVE(timestamp);
         MOVE(log_class);
         MOVE(log_level);
         MOVE(location);
         MOVE(message);
+        MOVE(call_site);
+        MOVE(arguments);
 #undef MOVE
         return *this;
     }
@@ -66,4 +75,33 @@ Entry CreateEntry(Class log_class, Level log_level,
 
 void SetFilter(Filter* filter);
 
+/**
+ * Writes the deferred messages output from now on to a binary log file instead of formatting them,
+ * for citra_logdecode to turn into text later. Only errors are still printed.
+ * @return Whether the file could be created
+ */
+bool StartBinaryLog(const std::string& path);
+
+/// Identifies binary log files, followed by BINARY_LOG_VERSION as a u32
+const u32 BINARY_LOG_MAGIC = 0x474F4C43; // "CLOG"
+const u32 BINARY_LOG_VERSION = 1;
+
+/**
+ * Records following the header of a binary log. Every record starts with its type as a u8, strings
+ * are stored as a u16 length followed by their characters.
+ */
+enum class BinaryRecord : u8 {
+    /// u32 id, u8 class, u8 level, u32 line, string filename, string function, string format.
+    /// Written before the first message of each call site.
+    CallSite,
+    /// u32 call site id, u64 timestamp in microseconds, u16 size, raw arguments
+    Message,
+};
+
+/**
+ * Blocks until all messages logged so far have been printed. Messages of the Critical level are
+ * always flushed before LogMessage returns, since they usually precede a crash.
+ */
+void FlushLog();
+
 }
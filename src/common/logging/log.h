@@ -4,12 +4,23 @@
 
 #pragma once
 
+#include <array>
 #include <cassert>
 #include <chrono>
+#include <cstring>
 #include <string>
+#include <type_traits>
 
 #include "common/common_types.h"
 
+/**
+ * Whether log messages are formatted by the log writer thread rather than the thread logging them,
+ * which only copies the arguments. This also allows writing binary logs (see StartBinaryLog).
+ */
+#ifndef ENABLE_DEFERRED_LOGGING
+#define ENABLE_DEFERRED_LOGGING 1
+#endif
+
 namespace Log {
 
 /// Specifies the severity or level of detail of the log message.
@@ -91,11 +102,123 @@ void LogMessage(Class log_class, Level log_level,
 #endif
     ;
 
+/// Where a log message comes from and how it's formatted, one for each call site of the LOG_* macros
+struct CallSite {
+    Class log_class;
+    Level log_level;
+    const char* filename;
+    unsigned int line_nr;
+    const char* function;
+    const char* format;
+};
+
+/// Type of a value in RawArguments
+enum class ArgumentType : u8 {
+    Signed,   ///< Integer of the following size in bytes, stored as a s64
+    Unsigned, ///< Integer of the following size in bytes, stored as a u64
+    Float,    ///< Stored as a double
+    String,   ///< Stored as a u16 length followed by the characters
+    Pointer,  ///< Stored as a u64
+};
+
+/**
+ * The arguments of a message whose formatting is deferred, each a type byte followed by its value.
+ * Strings are copied, cut short if they don't fit.
+ */
+struct RawArguments {
+    static const size_t CAPACITY = 240;
+
+    std::array<u8, CAPACITY> data;
+    u16 size = 0;
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type Add(T value) {
+        if (std::is_signed<T>::value)
+            AddValue(ArgumentType::Signed, sizeof(T), static_cast<s64>(value));
+        else
+            AddValue(ArgumentType::Unsigned, sizeof(T), static_cast<u64>(value));
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_enum<T>::value>::type Add(T value) {
+        Add(static_cast<typename std::underlying_type<T>::type>(value));
+    }
+
+    void Add(double value) {
+        AddValue(ArgumentType::Float, sizeof(double), value);
+    }
+
+    void Add(const char* value);
+    void Add(char* value) {
+        Add(static_cast<const char*>(value));
+    }
+
+    void Add(const void* value) {
+        AddValue(ArgumentType::Pointer, sizeof(value), static_cast<u64>(reinterpret_cast<uintptr_t>(value)));
+    }
+
+private:
+    template <typename T>
+    void AddValue(ArgumentType type, size_t value_size, T value) {
+        if (size + 2 + sizeof(T) > CAPACITY)
+            return;
+        data[size++] = static_cast<u8>(type);
+        data[size++] = static_cast<u8>(value_size);
+        std::memcpy(&data[size], &value, sizeof(T));
+        size += sizeof(T);
+    }
+};
+
+/// Whether messages of the given class and level pass the filter
+bool IsLogged(Class log_class, Level log_level);
+
+/// Queues a message whose arguments were copied, to be formatted by the log writer
+void LogDeferred(const CallSite& call_site, const RawArguments& arguments);
+
+template <typename... Args>
+void LogDeferred(const CallSite& call_site, const char* /*format*/, const Args&... args) {
+    if (!IsLogged(call_site.log_class, call_site.log_level))
+        return;
+
+    RawArguments arguments;
+    // Expands the arguments in order, with a dummy element for when there are none
+    const int expand[] = { 0, (arguments.Add(args), 0)... };
+    (void)expand;
+    LogDeferred(call_site, arguments);
+}
+
+/// Never called, only makes the compiler check the arguments of deferred messages against their format
+inline void CheckFormat(
+#ifdef _MSC_VER
+    _Printf_format_string_
+#endif
+    const char* format, ...)
+#ifdef __GNUC__
+    __attribute__((format(printf, 1, 2)))
+#endif
+    ;
+inline void CheckFormat(const char* format, ...) {
+}
+
 } // namespace Log
 
+#if ENABLE_DEFERRED_LOGGING
+// The format has to be a string literal, it's kept in the call site
+#define LOG_EXPAND(x) x
+#define LOG_FIRST_ARGUMENT(first, ...) first
+#define LOG_GENERIC(log_class, log_level, ...) \
+    do { \
+        static const ::Log::CallSite log_call_site = { ::Log::Class::log_class, ::Log::Level::log_level, \
+            __FILE__, __LINE__, __func__, "" LOG_EXPAND(LOG_FIRST_ARGUMENT(__VA_ARGS__, 0)) }; \
+        if (false) \
+            ::Log::CheckFormat(__VA_ARGS__); \
+        ::Log::LogDeferred(log_call_site, __VA_ARGS__); \
+    } while (0)
+#else
 #define LOG_GENERIC(log_class, log_level, ...) \
     ::Log::LogMessage(::Log::Class::log_class, ::Log::Level::log_level, \
         __FILE__, __LINE__, __func__, __VA_ARGS__)
+#endif
 
 #ifdef _DEBUG
 #define LOG_TRACE(   log_class, ...) LOG_GENERIC(log_class, Trace,    __VA_ARGS__)
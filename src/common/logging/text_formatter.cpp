@@ -2,8 +2,10 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
 #include <array>
 #include <cstdio>
+#include <cstring>
 
 #ifdef _WIN32
 #   define WIN32_LEAN_AND_MEAN
@@ -42,6 +44,158 @@ const char* TrimSourcePath(const char* path, const char* root) {
     return path;
 }
 
+/// An argument read back from RawArguments
+struct RawArgument {
+    ArgumentType type;
+    /// Size of the integer the argument was, in bytes
+    u8 size;
+    u64 bits;
+    double real;
+    std::string string;
+
+    /// Integer value of the argument, sign extended or cut to the size it had
+    s64 GetSigned() const {
+        if (type == ArgumentType::Float)
+            return static_cast<s64>(real);
+        if (size >= 8 || size == 0)
+            return static_cast<s64>(bits);
+        const u32 shift = 64 - 8 * size;
+        return static_cast<s64>(bits << shift) >> shift;
+    }
+
+    u64 GetUnsigned() const {
+        if (type == ArgumentType::Float)
+            return static_cast<u64>(real);
+        if (size >= 8 || size == 0)
+            return bits;
+        return bits & ((1ull << (8 * size)) - 1);
+    }
+
+    double GetReal() const {
+        if (type == ArgumentType::Float)
+            return real;
+        return type == ArgumentType::Signed ? static_cast<double>(GetSigned()) : static_cast<double>(GetUnsigned());
+    }
+};
+
+/// Reads the next argument, returns false if there is none left
+static bool ReadRawArgument(const u8* arguments, size_t size, size_t& offset, RawArgument& argument) {
+    if (offset + 2 > size)
+        return false;
+    argument.type = static_cast<ArgumentType>(arguments[offset]);
+    argument.size = arguments[offset + 1];
+    offset += 2;
+
+    if (argument.type == ArgumentType::String) {
+        u16 length;
+        if (offset + sizeof(length) > size)
+            return false;
+        std::memcpy(&length, arguments + offset, sizeof(length));
+        offset += sizeof(length);
+        length = static_cast<u16>(std::min<size_t>(length, size - offset));
+        argument.string.assign(reinterpret_cast<const char*>(arguments + offset), length);
+        offset += length;
+        return true;
+    }
+
+    // Every other type is stored in 8 bytes
+    if (offset + 8 > size)
+        return false;
+    if (argument.type == ArgumentType::Float)
+        std::memcpy(&argument.real, arguments + offset, 8);
+    else
+        std::memcpy(&argument.bits, arguments + offset, 8);
+    offset += 8;
+    return true;
+}
+
+std::string FormatRawArguments(const char* format, const u8* arguments, size_t size) {
+    std::string result;
+    std::array<char, 1024> buffer;
+    size_t offset = 0;
+    RawArgument argument;
+
+    const char* p = format;
+    while (*p != '\0') {
+        if (*p != '%') {
+            result += *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            result += '%';
+            p += 2;
+            continue;
+        }
+
+        // Rebuild the conversion specification without its length modifier, the values are
+        // passed to snprintf as 64 bit integers or doubles
+        std::string spec = "%";
+        ++p;
+        while (*p != '\0' && std::strchr("-+ #0", *p) != nullptr)
+            spec += *p++;
+        for (int part = 0; part < 2; ++part) {
+            if (part == 1) {
+                if (*p != '.')
+                    break;
+                spec += *p++;
+            }
+            if (*p == '*') {
+                ++p;
+                if (ReadRawArgument(arguments, size, offset, argument))
+                    spec += std::to_string(argument.GetSigned());
+            } else {
+                while (*p >= '0' && *p <= '9')
+                    spec += *p++;
+            }
+        }
+        while (*p != '\0' && std::strchr("hlLqjzt", *p) != nullptr)
+            ++p;
+        const char conversion = *p;
+        if (conversion == '\0')
+            break;
+        ++p;
+
+        if (conversion == 'n' || !ReadRawArgument(arguments, size, offset, argument))
+            continue;
+
+        switch (conversion) {
+        case 'd':
+        case 'i':
+            spec += "lld";
+            snprintf(buffer.data(), buffer.size(), spec.c_str(), (long long)argument.GetSigned());
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            spec += "ll";
+            spec += conversion;
+            snprintf(buffer.data(), buffer.size(), spec.c_str(), (unsigned long long)argument.GetUnsigned());
+            break;
+        case 'c':
+            spec += 'c';
+            snprintf(buffer.data(), buffer.size(), spec.c_str(), (int)argument.GetSigned());
+            break;
+        case 's':
+            spec += 's';
+            snprintf(buffer.data(), buffer.size(), spec.c_str(),
+                     argument.type == ArgumentType::String ? argument.string.c_str() : "(not a string)");
+            break;
+        case 'p':
+            spec += 'p';
+            snprintf(buffer.data(), buffer.size(), spec.c_str(), (void*)(uintptr_t)argument.GetUnsigned());
+            break;
+        default:
+            // Floating point conversions
+            spec += conversion;
+            snprintf(buffer.data(), buffer.size(), spec.c_str(), argument.GetReal());
+            break;
+        }
+        result += buffer.data();
+    }
+    return result;
+}
+
 void FormatLogMessage(const Entry& entry, char* out_text, size_t text_len) {
     unsigned int time_seconds    = static_cast<unsigned int>(entry.timestamp.count() / 1000000);
     unsigned int time_fractional = static_cast<unsigned int>(entry.timestamp.count() % 1000000);
@@ -5,6 +5,9 @@
 #pragma once
 
 #include <cstddef>
+#include <string>
+
+#include "common/common_types.h"
 
 namespace Log {
 
@@ -22,6 +25,12 @@ struct Entry;
  */
 const char* TrimSourcePath(const char* path, const char* root = "src");
 
+/**
+ * Formats a deferred message like printf does, from the arguments in the encoding of RawArguments.
+ * Conversions without a matching argument are left out.
+ */
+std::string FormatRawArguments(const char* format, const u8* arguments, size_t size);
+
 /// Formats a log entry into the provided text buffer.
 void FormatLogMessage(const Entry& entry, char* out_text, size_t text_len);
 /// Formats and prints a log entry to stderr.
@@ -0,0 +1,98 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "common/file_util.h"
+#include "common/logging/log.h"
+#include "common/mapped_file.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Common {
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+#ifndef _WIN32
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t file_size = (size_t)info.st_size;
+    const size_t rounded_size = (file_size + page_size - 1) & ~(page_size - 1);
+
+    // A private writable mapping of a file opened read-only is copy-on-write
+    void* mapping = mmap(nullptr, rounded_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR(Common_Filesystem, "Failed to map %s", path.c_str());
+        return false;
+    }
+
+    data = static_cast<u8*>(mapping);
+    size = file_size;
+    mapped_size = rounded_size;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data != nullptr)
+        munmap(data, mapped_size);
+
+    data = nullptr;
+    size = 0;
+    mapped_size = 0;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+
+    FileUtil::IOFile file(path, "rb");
+    if (!file.IsOpen() || file.GetSize() == 0)
+        return false;
+
+    // Rounded up like a mapping would be
+    const size_t page_size = 0x1000;
+    size = (size_t)file.GetSize();
+    mapped_size = (size + page_size - 1) & ~(page_size - 1);
+    buffer.assign(mapped_size, 0);
+    if (file.ReadBytes(buffer.data(), size) != size) {
+        Close();
+        return false;
+    }
+
+    data = buffer.data();
+    return true;
+}
+
+void MappedFile::Close() {
+    buffer.clear();
+    buffer.shrink_to_fit();
+    data = nullptr;
+    size = 0;
+    mapped_size = 0;
+}
+
+#endif
+
+} // namespace
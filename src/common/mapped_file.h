@@ -0,0 +1,66 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "common/common_types.h"
+
+namespace Common {
+
+/**
+ * A file mapped into memory with copy-on-write semantics: writes to the mapping change a private
+ * copy of the touched pages and never reach the file. The pages that aren't written are shared
+ * with every other process mapping the same file, through the host's page cache, so that large
+ * read-only system data files only have to be in memory once even with several emulators running.
+ *
+ * The mapping is rounded up to whole host pages, the bytes past the end of the file read as zero.
+ * On hosts without mmap the file is read into a private buffer instead.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    /**
+     * Maps a file, replacing the previous mapping
+     * @return true on success
+     */
+    bool Open(const std::string& path);
+
+    /// Unmaps the file
+    void Close();
+
+    bool IsOpen() const {
+        return data != nullptr;
+    }
+
+    u8* Data() const {
+        return data;
+    }
+
+    /// Size of the file in bytes
+    size_t Size() const {
+        return size;
+    }
+
+    /// Size of the mapping, the size of the file rounded up to a multiple of the host page size
+    size_t MappedSize() const {
+        return mapped_size;
+    }
+
+private:
+    u8* data = nullptr;
+    size_t size = 0;
+    size_t mapped_size = 0;
+    /// Holds the contents of the file on hosts without mmap
+    std::vector<u8> buffer;
+};
+
+} // namespace
@@ -0,0 +1,205 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#include "common/memory_accounting.h"
+
+namespace Common {
+namespace MemoryAccounting {
+
+namespace {
+
+struct TagCounters {
+    std::atomic<u64> bytes;
+    std::atomic<u64> peak_bytes;
+};
+
+// Zero-initialized before any global is constructed, so globals can account memory too
+std::array<TagCounters, NUM_TAGS> counters;
+
+std::atomic<u64> num_heap_allocations;
+
+}
+
+const char* GetTagName(Tag tag) {
+    switch (tag) {
+    case Tag::GuestMemory:      return "Guest memory";
+    case Tag::TranslationCache: return "Translation cache";
+    case Tag::RomData:          return "ROM data";
+    case Tag::TextureCache:     return "Texture cache";
+    case Tag::Surfaces:         return "Surfaces";
+    case Tag::GPUBuffers:       return "GPU buffers";
+    case Tag::KernelObjects:    return "Kernel objects";
+    case Tag::Logging:          return "Logging";
+    default:                    return "Unknown";
+    }
+}
+
+void Allocate(Tag tag, size_t bytes) {
+    TagCounters& tag_counters = counters[static_cast<size_t>(tag)];
+    const u64 total = tag_counters.bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+
+    u64 peak = tag_counters.peak_bytes.load(std::memory_order_relaxed);
+    while (total > peak && !tag_counters.peak_bytes.compare_exchange_weak(peak, total, std::memory_order_relaxed)) {
+    }
+}
+
+void Free(Tag tag, size_t bytes) {
+    counters[static_cast<size_t>(tag)].bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+std::array<TagUsage, NUM_TAGS> GetUsage() {
+    std::array<TagUsage, NUM_TAGS> usage;
+    for (size_t i = 0; i < NUM_TAGS; ++i) {
+        usage[i].bytes = counters[i].bytes.load(std::memory_order_relaxed);
+        usage[i].peak_bytes = counters[i].peak_bytes.load(std::memory_order_relaxed);
+    }
+    return usage;
+}
+
+u64 GetNumHeapAllocations() {
+    return num_heap_allocations.load(std::memory_order_relaxed);
+}
+
+} // namespace MemoryAccounting
+} // namespace Common
+
+#if ENABLE_ALLOCATION_COUNTING
+
+// Replacements of the global allocation functions, which count the allocations and leave the rest
+// to malloc like the default ones. The other forms of operator new and delete call these.
+
+void* operator new(std::size_t size) {
+    Common::MemoryAccounting::num_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0)
+        size = 1;
+    while (true) {
+        if (void* pointer = std::malloc(size))
+            return pointer;
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return operator new(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+#ifdef __cpp_aligned_new
+
+// The over-aligned forms, which don't go through the ones above
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    Common::MemoryAccounting::num_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0)
+        size = 1;
+    while (true) {
+#ifdef _WIN32
+        void* pointer = _aligned_malloc(size, static_cast<std::size_t>(alignment));
+#else
+        void* pointer;
+        if (posix_memalign(&pointer, static_cast<std::size_t>(alignment), size) != 0)
+            pointer = nullptr;
+#endif
+        if (pointer != nullptr)
+            return pointer;
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    try {
+        return operator new(size, alignment);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return operator new(size, alignment, std::nothrow);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+#ifdef _WIN32
+    _aligned_free(pointer);
+#else
+    std::free(pointer);
+#endif
+}
+
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept {
+    operator delete(pointer, alignment);
+}
+
+void operator delete(void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    operator delete(pointer, alignment);
+}
+
+void operator delete[](void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    operator delete(pointer, alignment);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t alignment) noexcept {
+    operator delete(pointer, alignment);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t alignment) noexcept {
+    operator delete(pointer, alignment);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,102 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "common/common_types.h"
+
+/**
+ * Whether operator new is replaced by one counting the heap allocations of all threads, set by the
+ * ENABLE_ALLOCATION_COUNTING CMake option. Off by default, as every binary linking the common
+ * library gets the replacement, which costs an atomic increment on every allocation.
+ */
+#ifndef ENABLE_ALLOCATION_COUNTING
+#define ENABLE_ALLOCATION_COUNTING 0
+#endif
+
+namespace Common {
+namespace MemoryAccounting {
+
+/// Subsystems holding large amounts of host memory, which it is accounted to
+enum class Tag {
+    GuestMemory,        ///< FCRAM and the other areas of emulated memory, reserved in full
+    TranslationCache,   ///< Code translated by the CPU core and its lookup tables
+    RomData,            ///< Cached contents of the RomFS and other archives read from ROMs
+    TextureCache,       ///< Textures of the renderer's texture cache
+    Surfaces,           ///< Color and depth buffers kept on the GPU by the renderer
+    GPUBuffers,         ///< Vertex, index, uniform and upload buffers of the renderer
+    KernelObjects,      ///< Slabs the HLE kernel allocates its objects from
+    Logging,            ///< Log entries waiting to be printed
+
+    NumTags
+};
+
+const size_t NUM_TAGS = static_cast<size_t>(Tag::NumTags);
+
+/// Name of a tag, as shown in the debugger and used for metrics
+const char* GetTagName(Tag tag);
+
+/// Accounts bytes that were allocated. Can be called from any thread.
+void Allocate(Tag tag, size_t bytes);
+
+/// Accounts bytes that were freed, having been accounted by Allocate. Can be called from any thread.
+void Free(Tag tag, size_t bytes);
+
+struct TagUsage {
+    /// Bytes accounted to the tag now
+    u64 bytes;
+    /// Most bytes accounted to the tag at any time since startup
+    u64 peak_bytes;
+};
+
+/// Memory accounted to every tag, indexed by the tag. Can be called from any thread.
+std::array<TagUsage, NUM_TAGS> GetUsage();
+
+/**
+ * Number of heap allocations made through operator new by all threads since startup, e.g. for
+ * checking that a frame of steady emulation doesn't allocate. Always 0 without
+ * ENABLE_ALLOCATION_COUNTING. Can be called from any thread.
+ */
+u64 GetNumHeapAllocations();
+
+/**
+ * Bytes accounted to a tag for as long as this lives, e.g. as a member of the object holding them,
+ * so that they are freed along with it.
+ */
+class ScopedUsage final : NonCopyable {
+public:
+    explicit ScopedUsage(Tag tag) : tag(tag), bytes(0) {
+    }
+
+    ~ScopedUsage() {
+        Set(0);
+    }
+
+    /// Changes the accounted size to the given number of bytes
+    void Set(size_t new_bytes) {
+        if (new_bytes > bytes)
+            Allocate(tag, new_bytes - bytes);
+        else if (new_bytes < bytes)
+            MemoryAccounting::Free(tag, bytes - new_bytes);
+        bytes = new_bytes;
+    }
+
+    void Add(size_t more_bytes) {
+        Set(bytes + more_bytes);
+    }
+
+    size_t Get() const {
+        return bytes;
+    }
+
+private:
+    Tag tag;
+    size_t bytes;
+};
+
+} // namespace MemoryAccounting
+} // namespace Common
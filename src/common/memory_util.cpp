@@ -2,6 +2,9 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 
 #include "common/common_funcs.h"
 #include "common/logging/log.h"
@@ -100,6 +103,76 @@ void* AllocateMemoryPages(size_t size)
     return ptr;
 }
 
+#if !defined(_WIN32) && defined(MADV_HUGEPAGE)
+/// Whether the kernel backs memory with transparent huge pages when madvise asks for them
+static bool AreTransparentHugePagesEnabled()
+{
+    FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (file == nullptr)
+        return false;
+    char modes[64] = {};
+    const bool read = fgets(modes, sizeof(modes), file) != nullptr;
+    fclose(file);
+    // The selected mode is in brackets, "[never]" ignores madvise
+    return read && strstr(modes, "[never]") == nullptr;
+}
+#endif
+
+void* AllocateHugeMemoryPages(size_t size, bool executable, bool& huge_pages)
+{
+    huge_pages = false;
+#ifdef _WIN32
+    const DWORD protect = executable ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE;
+    // Large pages are only granted to users holding the "Lock pages in memory" privilege
+    const SIZE_T large_page_size = GetLargePageMinimum();
+    if (large_page_size != 0 && size % large_page_size == 0) {
+        void* ptr = VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, protect);
+        if (ptr != nullptr) {
+            huge_pages = true;
+            return ptr;
+        }
+    }
+    void* ptr = VirtualAlloc(0, size, MEM_COMMIT, protect);
+#else
+    const int prot = PROT_READ | PROT_WRITE | (executable ? PROT_EXEC : 0);
+#ifdef MAP_HUGETLB
+    // Only succeeds if the administrator reserved enough huge pages
+    if (size % HUGE_PAGE_SIZE == 0) {
+        void* ptr = mmap(0, size, prot, MAP_ANON | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            huge_pages = true;
+            return ptr;
+        }
+    }
+#endif
+#ifdef MADV_HUGEPAGE
+    // Transparent huge pages only back the parts of a mapping aligned to them, so map one more
+    // huge page worth of memory and trim it down to an aligned range
+    const size_t padded_size = size + HUGE_PAGE_SIZE;
+    void* padded = mmap(0, padded_size, prot, MAP_ANON | MAP_PRIVATE, -1, 0);
+    if (padded != MAP_FAILED) {
+        u8* const padded_start = static_cast<u8*>(padded);
+        const size_t head = -reinterpret_cast<uintptr_t>(padded_start) & (HUGE_PAGE_SIZE - 1);
+        u8* const start = padded_start + head;
+        if (head != 0)
+            munmap(padded_start, head);
+        munmap(start + size, padded_size - head - size);
+
+        huge_pages = madvise(start, size, MADV_HUGEPAGE) == 0 && AreTransparentHugePagesEnabled();
+        return start;
+    }
+#endif
+    void* ptr = mmap(0, size, prot, MAP_ANON | MAP_PRIVATE, -1, 0);
+    if (ptr == MAP_FAILED)
+        ptr = nullptr;
+#endif
+
+    if (ptr == nullptr)
+        LOG_ERROR(Common_Memory, "Failed to allocate raw memory");
+
+    return ptr;
+}
+
 void* AllocateAlignedMemory(size_t size,size_t alignment)
 {
 #ifdef _WIN32
@@ -11,6 +11,18 @@
 
 void* AllocateExecutableMemory(size_t size, bool low = true);
 void* AllocateMemoryPages(size_t size);
+
+/// Size of the huge pages AllocateHugeMemoryPages aligns its allocations to
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+/**
+ * Allocates memory pages like AllocateMemoryPages, backed by huge pages if the host provides them
+ * so that large allocations take far fewer TLB entries. Falls back to normal pages otherwise.
+ * The memory is freed with FreeMemoryPages.
+ * @param executable Whether code is going to be run from the memory
+ * @param huge_pages Set to whether huge pages were obtained
+ */
+void* AllocateHugeMemoryPages(size_t size, bool executable, bool& huge_pages);
 void FreeMemoryPages(void* ptr, size_t size);
 void* AllocateAlignedMemory(size_t size,size_t alignment);
 void FreeAlignedMemory(void* ptr);
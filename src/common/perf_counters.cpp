@@ -0,0 +1,186 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "common/assert.h"
+#include "common/perf_counters.h"
+
+namespace Common {
+namespace Perf {
+
+namespace {
+
+struct Registry {
+    std::vector<CounterInfo> counters;
+    std::vector<HistogramInfo> histograms;
+    /// Number of values taken by the counters and histograms registered so far
+    unsigned int num_values = 0;
+
+    /// Protects all_thread_values and the in_use flags
+    std::mutex thread_values_mutex;
+    std::vector<std::unique_ptr<ThreadValues>> all_thread_values;
+};
+
+Registry& GetRegistry() {
+    // Takes advantage of "magic" static initialization, the counters register while globals are constructed
+    static Registry registry;
+    return registry;
+}
+
+unsigned int AllocateValues(unsigned int count) {
+    Registry& registry = GetRegistry();
+    const unsigned int first = registry.num_values;
+    ASSERT_MSG(first + count <= MAX_PERF_VALUES, "too many performance counters, raise MAX_PERF_VALUES");
+    registry.num_values += count;
+    return first;
+}
+
+/// Sums a value up over all threads, the caller holds thread_values_mutex
+u64 SumValue(const Registry& registry, unsigned int index) {
+    u64 total = 0;
+    for (const auto& values : registry.all_thread_values)
+        total += values->values[index].load(std::memory_order_relaxed);
+    return total;
+}
+
+/// Hands the values of a thread over to the next one when it exits
+struct ThreadValuesRelease {
+    ThreadValues* values = nullptr;
+
+    ~ThreadValuesRelease() {
+        if (values == nullptr)
+            return;
+        std::lock_guard<std::mutex> lock(GetRegistry().thread_values_mutex);
+        values->in_use = false;
+    }
+};
+
+}
+
+thread_local ThreadValues* thread_values = nullptr;
+
+ThreadValues* RegisterThread() {
+    Registry& registry = GetRegistry();
+    ThreadValues* values = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(registry.thread_values_mutex);
+        // The values of a thread that exited carry on, they are totals since startup
+        for (auto& unused : registry.all_thread_values) {
+            if (!unused->in_use) {
+                values = unused.get();
+                break;
+            }
+        }
+        if (values == nullptr) {
+            registry.all_thread_values.emplace_back(new ThreadValues());
+            values = registry.all_thread_values.back().get();
+        }
+        values->in_use = true;
+    }
+
+    static thread_local ThreadValuesRelease release;
+    release.values = values;
+    thread_values = values;
+    return values;
+}
+
+Counter::Counter(const char* name) {
+    Registry& registry = GetRegistry();
+    value_index = AllocateValues(1);
+    counter_id = static_cast<unsigned int>(registry.counters.size());
+    registry.counters.push_back({ this, name });
+}
+
+u64 Counter::GetTotal() const {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.thread_values_mutex);
+    return SumValue(registry, value_index);
+}
+
+Histogram::Histogram(const char* name, std::vector<s64> bounds_) : bounds(std::move(bounds_)) {
+    ASSERT(std::is_sorted(bounds.begin(), bounds.end()));
+
+    Registry& registry = GetRegistry();
+    // The buckets, then the sum
+    first_value_index = AllocateValues(static_cast<unsigned int>(bounds.size()) + 2);
+    histogram_id = static_cast<unsigned int>(registry.histograms.size());
+    registry.histograms.push_back({ this, name });
+}
+
+/// Sums up the samples of a histogram over all threads, the caller holds thread_values_mutex
+static HistogramTotals SumHistogram(const Registry& registry, unsigned int first_value_index, size_t num_buckets) {
+    HistogramTotals totals;
+    totals.buckets.resize(num_buckets);
+    totals.count = 0;
+    for (size_t i = 0; i < num_buckets; ++i) {
+        totals.buckets[i] = SumValue(registry, first_value_index + static_cast<unsigned int>(i));
+        totals.count += totals.buckets[i];
+    }
+    totals.sum = static_cast<s64>(SumValue(registry, first_value_index + static_cast<unsigned int>(num_buckets)));
+    return totals;
+}
+
+HistogramTotals Histogram::GetTotals() const {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.thread_values_mutex);
+    return SumHistogram(registry, first_value_index, bounds.size() + 1);
+}
+
+const std::vector<CounterInfo>& GetCountersInfo() {
+    return GetRegistry().counters;
+}
+
+const std::vector<HistogramInfo>& GetHistogramsInfo() {
+    return GetRegistry().histograms;
+}
+
+std::vector<u64> GetCounterTotals() {
+    Registry& registry = GetRegistry();
+    std::vector<u64> totals(registry.counters.size());
+
+    std::lock_guard<std::mutex> lock(registry.thread_values_mutex);
+    for (size_t i = 0; i < totals.size(); ++i)
+        totals[i] = SumValue(registry, registry.counters[i].counter->value_index);
+    return totals;
+}
+
+std::vector<HistogramTotals> GetHistogramTotals() {
+    Registry& registry = GetRegistry();
+    std::vector<HistogramTotals> totals;
+    totals.reserve(registry.histograms.size());
+
+    std::lock_guard<std::mutex> lock(registry.thread_values_mutex);
+    for (const HistogramInfo& info : registry.histograms) {
+        const Histogram& histogram = *info.histogram;
+        totals.push_back(SumHistogram(registry, histogram.first_value_index, histogram.bounds.size() + 1));
+    }
+    return totals;
+}
+
+double EstimatePercentile(const std::vector<s64>& bounds, const std::vector<u64>& buckets, double fraction) {
+    u64 total = 0;
+    for (u64 count : buckets)
+        total += count;
+
+    const double rank = fraction * total;
+    u64 below = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        if (below + buckets[i] >= rank && buckets[i] != 0) {
+            const double lower = i == 0 ? 0.0 : (double)bounds[i - 1];
+            if (i == bounds.size())
+                return lower;
+            const double upper = (double)bounds[i];
+            return lower + (upper - lower) * (rank - below) / buckets[i];
+        }
+        below += buckets[i];
+    }
+    return 0.0;
+}
+
+} // namespace Perf
+} // namespace Common
@@ -0,0 +1,150 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <vector>
+
+#include "common/common_types.h"
+
+namespace Common {
+namespace Perf {
+
+/// Maximum number of values all Counters and Histograms can hold together, see ThreadValues
+const unsigned int MAX_PERF_VALUES = 256;
+
+/**
+ * Values added by one thread to each Counter and Histogram. Only that thread adds to them, so that
+ * threads counting the same events don't contend on shared counters. A Counter takes one value, a
+ * Histogram one per bucket and one for the sum of its samples.
+ */
+struct ThreadValues {
+    /// Amounts added since the thread started, by value index
+    std::array<std::atomic<u64>, MAX_PERF_VALUES> values;
+    /// Whether a running thread owns these values, they are reused after it exits
+    bool in_use;
+};
+
+/// Gives the calling thread values of its own
+ThreadValues* RegisterThread();
+
+extern thread_local ThreadValues* thread_values;
+
+/// Adds to one of the calling thread's values
+inline void AddToValue(unsigned int index, u64 amount) {
+    ThreadValues* values = thread_values != nullptr ? thread_values : RegisterThread();
+    std::atomic<u64>& value = values->values[index];
+    // Nobody else writes to it, no locked instruction is needed
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+/**
+ * Counts events, e.g. draw calls or cache misses. Should be declared as a global variable. Adding
+ * to it is as cheap as incrementing a plain integer, reading it sums up the values of all threads.
+ */
+class Counter final {
+public:
+    explicit Counter(const char* name);
+
+    unsigned int GetCounterId() const {
+        return counter_id;
+    }
+
+    /// Counts some events. Can safely be called from multiple threads at the same time.
+    void Add(u64 amount = 1) {
+        AddToValue(value_index, amount);
+    }
+
+    /// Events counted by all threads since startup. Takes a lock, meant for reporting.
+    u64 GetTotal() const;
+
+private:
+    friend std::vector<u64> GetCounterTotals();
+
+    unsigned int counter_id;
+    unsigned int value_index;
+};
+
+/// Samples taken by a Histogram so far
+struct HistogramTotals {
+    /// Number of samples in each bucket, the last one is unbounded
+    std::vector<u64> buckets;
+    /// Number of samples
+    u64 count;
+    /// Sum of the sampled values
+    s64 sum;
+};
+
+/**
+ * Counts how many samples of a quantity fall into each of a fixed set of buckets, e.g. of the
+ * times between frames, so that percentiles can be estimated. Should be declared as a global
+ * variable, and is as cheap to add to as a Counter.
+ */
+class Histogram final {
+public:
+    /**
+     * @param name Name of the sampled quantity, including its unit
+     * @param bounds Upper bounds of the buckets in ascending order, followed by an unbounded bucket
+     */
+    Histogram(const char* name, std::vector<s64> bounds);
+
+    unsigned int GetHistogramId() const {
+        return histogram_id;
+    }
+
+    const std::vector<s64>& GetBounds() const {
+        return bounds;
+    }
+
+    /// Adds a sample. Can safely be called from multiple threads at the same time.
+    void AddSample(s64 value) {
+        const size_t bucket = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+        AddToValue(first_value_index + static_cast<unsigned int>(bucket), 1);
+        AddToValue(first_value_index + static_cast<unsigned int>(bounds.size()) + 1, static_cast<u64>(value));
+    }
+
+    /// Samples taken by all threads since startup. Takes a lock, meant for reporting.
+    HistogramTotals GetTotals() const;
+
+private:
+    friend std::vector<HistogramTotals> GetHistogramTotals();
+
+    unsigned int histogram_id;
+    unsigned int first_value_index;
+    std::vector<s64> bounds;
+};
+
+struct CounterInfo {
+    Counter* counter;
+    const char* name;
+};
+
+struct HistogramInfo {
+    Histogram* histogram;
+    const char* name;
+};
+
+/// All Counters, indexed by their id. They register while globals are constructed.
+const std::vector<CounterInfo>& GetCountersInfo();
+
+/// All Histograms, indexed by their id
+const std::vector<HistogramInfo>& GetHistogramsInfo();
+
+/// Totals of all Counters, indexed by their id, summed up under a single lock. Can be called from any thread.
+std::vector<u64> GetCounterTotals();
+
+/// Totals of all Histograms, indexed by their id. Can be called from any thread.
+std::vector<HistogramTotals> GetHistogramTotals();
+
+/**
+ * Estimates the value below which the given fraction of the samples counted in some buckets fall,
+ * interpolating within the bucket it is in. Samples in the unbounded bucket count as its lower bound.
+ */
+double EstimatePercentile(const std::vector<s64>& bounds, const std::vector<u64>& buckets, double fraction);
+
+} // namespace Perf
+} // namespace Common
@@ -82,6 +82,19 @@
 #  define _M_SSE 0x402
 #endif
 
+/**
+ * Kernels using SSSE3 are built even when the build doesn't target it, marked with TARGET_SSSE3,
+ * and only called after checking cpu_info.bSSSE3. This way a single binary uses them whenever the
+ * host supports them.
+ */
+#if _M_SSE >= 0x301
+#  define HAVE_SSSE3_KERNELS
+#  define TARGET_SSSE3
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define HAVE_SSSE3_KERNELS
+#  define TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Compiler-Specific Definitions
 
@@ -0,0 +1,184 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cerrno>
+
+#include "common/logging/log.h"
+#include "common/positional_file.h"
+#include "common/string_util.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Common {
+
+PositionalFile::~PositionalFile() {
+    Close();
+}
+
+#ifdef _WIN32
+
+bool PositionalFile::Open(const std::string& path, Mode mode) {
+    Close();
+
+    const DWORD access = mode == Mode::Read ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE;
+    const DWORD disposition = mode == Mode::Create ? CREATE_ALWAYS : OPEN_EXISTING;
+    HANDLE file = CreateFileW(UTF8ToUTF16W(path).c_str(), access,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                              disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    handle = file;
+    return true;
+}
+
+void PositionalFile::Close() {
+    if (handle != nullptr)
+        CloseHandle(handle);
+    handle = nullptr;
+}
+
+bool PositionalFile::IsOpen() const {
+    return handle != nullptr;
+}
+
+size_t PositionalFile::ReadAt(u64 offset, void* data, size_t length) const {
+    size_t done = 0;
+    while (done < length) {
+        // The offset of a synchronous overlapped access doesn't move the handle's file pointer
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset + done);
+        overlapped.OffsetHigh = static_cast<DWORD>((offset + done) >> 32);
+        const DWORD chunk = static_cast<DWORD>(std::min<size_t>(length - done, 0x40000000));
+        DWORD read = 0;
+        if (!ReadFile(handle, static_cast<u8*>(data) + done, chunk, &read, &overlapped)) {
+            if (GetLastError() != ERROR_HANDLE_EOF)
+                return 0;
+        }
+        if (read == 0)
+            break;
+        done += read;
+    }
+    return done;
+}
+
+size_t PositionalFile::WriteAt(u64 offset, const void* data, size_t length) const {
+    size_t done = 0;
+    while (done < length) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset + done);
+        overlapped.OffsetHigh = static_cast<DWORD>((offset + done) >> 32);
+        const DWORD chunk = static_cast<DWORD>(std::min<size_t>(length - done, 0x40000000));
+        DWORD written = 0;
+        if (!WriteFile(handle, static_cast<const u8*>(data) + done, chunk, &written, &overlapped) || written == 0)
+            return 0;
+        done += written;
+    }
+    return done;
+}
+
+u64 PositionalFile::GetSize() const {
+    LARGE_INTEGER size;
+    if (!IsOpen() || !GetFileSizeEx(handle, &size))
+        return 0;
+    return static_cast<u64>(size.QuadPart);
+}
+
+bool PositionalFile::Resize(u64 size) const {
+    FILE_END_OF_FILE_INFO info;
+    info.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+    return IsOpen() && SetFileInformationByHandle(handle, FileEndOfFileInfo, &info, sizeof(info));
+}
+
+void PositionalFile::Advise(AccessHint hint) const {
+    // Windows only takes access hints when opening a file
+}
+
+#else
+
+bool PositionalFile::Open(const std::string& path, Mode mode) {
+    Close();
+
+    int flags = O_RDONLY;
+    if (mode == Mode::ReadWrite)
+        flags = O_RDWR;
+    else if (mode == Mode::Create)
+        flags = O_RDWR | O_CREAT | O_TRUNC;
+#ifdef O_CLOEXEC
+    flags |= O_CLOEXEC;
+#endif
+
+    fd = open(path.c_str(), flags, 0644);
+    return fd != -1;
+}
+
+void PositionalFile::Close() {
+    if (fd != -1)
+        close(fd);
+    fd = -1;
+}
+
+bool PositionalFile::IsOpen() const {
+    return fd != -1;
+}
+
+size_t PositionalFile::ReadAt(u64 offset, void* data, size_t length) const {
+    size_t done = 0;
+    while (done < length) {
+        const ssize_t read = pread(fd, static_cast<u8*>(data) + done, length - done,
+                                   static_cast<off_t>(offset + done));
+        if (read < 0 && errno == EINTR)
+            continue;
+        if (read < 0)
+            return 0;
+        if (read == 0)
+            break;
+        done += static_cast<size_t>(read);
+    }
+    return done;
+}
+
+size_t PositionalFile::WriteAt(u64 offset, const void* data, size_t length) const {
+    size_t done = 0;
+    while (done < length) {
+        const ssize_t written = pwrite(fd, static_cast<const u8*>(data) + done, length - done,
+                                       static_cast<off_t>(offset + done));
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return 0;
+        done += static_cast<size_t>(written);
+    }
+    return done;
+}
+
+u64 PositionalFile::GetSize() const {
+    struct stat info;
+    if (!IsOpen() || fstat(fd, &info) != 0)
+        return 0;
+    return static_cast<u64>(info.st_size);
+}
+
+bool PositionalFile::Resize(u64 size) const {
+    return IsOpen() && ftruncate(fd, static_cast<off_t>(size)) == 0;
+}
+
+void PositionalFile::Advise(AccessHint hint) const {
+#ifdef POSIX_FADV_NORMAL
+    static const int advice[] = { POSIX_FADV_NORMAL, POSIX_FADV_SEQUENTIAL, POSIX_FADV_RANDOM };
+    if (IsOpen() && posix_fadvise(fd, 0, 0, advice[static_cast<int>(hint)]) != 0)
+        LOG_DEBUG(Common_Filesystem, "posix_fadvise failed");
+#endif
+}
+
+#endif
+
+} // namespace
@@ -0,0 +1,75 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "common/common_types.h"
+
+namespace Common {
+
+/**
+ * A host file accessed with positional reads and writes (pread/pwrite, or overlapped ReadFile and
+ * WriteFile on Windows). Every access names its offset, so there is no file position shared by
+ * the users of a handle: a single call per access, and concurrent accesses from several threads
+ * are safe. The accesses aren't buffered in user space, which is what the callers caching the
+ * contents themselves want.
+ */
+class PositionalFile : NonCopyable {
+public:
+    enum class Mode {
+        Read,      ///< Reads an existing file
+        ReadWrite, ///< Reads and writes an existing file
+        Create,    ///< Reads and writes a file, created or emptied when opening it
+    };
+
+    /// How the file is going to be accessed, passed on to the host's page cache
+    enum class AccessHint {
+        Normal,
+        Sequential, ///< Read front to back, worth reading ahead aggressively
+        Random,     ///< Read in no particular order, reading ahead is wasted
+    };
+
+    PositionalFile() = default;
+    ~PositionalFile();
+
+    /// Opens a file, closing the previous one. Returns false on failure.
+    bool Open(const std::string& path, Mode mode);
+
+    void Close();
+
+    bool IsOpen() const;
+
+    /**
+     * Reads from the file, short of the requested length at the end of the file
+     * @return Number of bytes read, 0 on failure
+     */
+    size_t ReadAt(u64 offset, void* data, size_t length) const;
+
+    /**
+     * Writes to the file, extending it if needed
+     * @return Number of bytes written, 0 on failure
+     */
+    size_t WriteAt(u64 offset, const void* data, size_t length) const;
+
+    /// Size of the file in bytes
+    u64 GetSize() const;
+
+    /// Truncates or extends the file, with zeros
+    bool Resize(u64 size) const;
+
+    /// Tells the host how the file is going to be accessed, hosts without hints ignore it
+    void Advise(AccessHint hint) const;
+
+private:
+#ifdef _WIN32
+    void* handle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+} // namespace
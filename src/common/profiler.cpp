@@ -2,9 +2,19 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common/file_util.h"
+#include "common/logging/log.h"
 #include "common/profiler.h"
 #include "common/profiler_reporting.h"
 #include "common/assert.h"
+#include "common/string_util.h"
 
 #if defined(_MSC_VER) && _MSC_VER <= 1800 // MSVC 2013.
 #define WIN32_LEAN_AND_MEAN
@@ -18,6 +28,144 @@ namespace Profiling {
 thread_local Timer* Timer::current_timer = nullptr;
 #endif
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+u64 TSCClock::base_ticks;
+double TSCClock::ns_per_tick;
+
+void TSCClock::Calibrate() {
+    using namespace std::chrono;
+
+    // Long enough for the error of the steady clock to be negligible, short enough to go unnoticed
+    const steady_clock::time_point start = steady_clock::now();
+    const u64 start_ticks = __rdtsc();
+    steady_clock::time_point end;
+    do {
+        end = steady_clock::now();
+    } while (end - start < milliseconds(10));
+    const u64 end_ticks = __rdtsc();
+
+    base_ticks = start_ticks;
+    ns_per_tick = (double)duration_cast<nanoseconds>(end - start).count() / (end_ticks - start_ticks);
+}
+
+namespace {
+// Timers running while other globals are constructed, before this one, measure no time
+struct TSCCalibration {
+    TSCCalibration() {
+        TSCClock::Calibrate();
+    }
+} tsc_calibration;
+}
+#endif
+
+std::atomic<bool> g_tracing(false);
+
+namespace {
+
+struct TraceEvent {
+    Duration::rep time;
+    u32 thread_id;
+    u16 category_id;
+    bool begin;
+};
+
+/// Ring of recorded events, allocated when tracing starts for the first time and never freed so
+/// that threads still recording when it stops don't need to be waited for
+std::unique_ptr<TraceEvent[]> trace_events;
+/// Number of events recorded since tracing started, the next one goes at this index modulo the size
+std::atomic<u64> num_trace_events;
+Clock::time_point trace_start;
+
+std::mutex trace_threads_mutex;
+/// Names of the threads given one with SetTraceThreadName, by trace thread id
+std::map<u32, std::string> trace_thread_names;
+std::atomic<u32> next_trace_thread_id(1);
+thread_local u32 trace_thread_id = 0;
+
+}
+
+/// Returns the id the calling thread is known by in traces, which are smaller than native ids
+static u32 GetTraceThreadId() {
+    if (trace_thread_id == 0)
+        trace_thread_id = next_trace_thread_id++;
+    return trace_thread_id;
+}
+
+void RecordTraceEvent(unsigned int category_id, bool begin, Clock::time_point time) {
+    const u64 index = num_trace_events.fetch_add(1, std::memory_order_relaxed);
+    TraceEvent& event = trace_events[index % MAX_TRACE_EVENTS];
+    event.time = time.time_since_epoch().count();
+    event.thread_id = GetTraceThreadId();
+    event.category_id = static_cast<u16>(category_id);
+    event.begin = begin;
+}
+
+void StartTracing() {
+    g_tracing = false;
+    if (trace_events == nullptr)
+        trace_events.reset(new TraceEvent[MAX_TRACE_EVENTS]());
+    num_trace_events = 0;
+    trace_start = Clock::now();
+    g_tracing = true;
+}
+
+void StopTracing() {
+    g_tracing = false;
+}
+
+bool IsTracing() {
+    return g_tracing;
+}
+
+void SetTraceThreadName(const char* name) {
+    std::lock_guard<std::mutex> lock(trace_threads_mutex);
+    trace_thread_names[GetTraceThreadId()] = name;
+}
+
+bool ExportChromeTrace(const std::string& filename) {
+    if (trace_events == nullptr) {
+        LOG_ERROR(Common, "No trace was recorded");
+        return false;
+    }
+
+    const auto& categories = GetProfilingManager().GetTimingCategoriesInfo();
+    const u64 end = num_trace_events;
+    const u64 begin = end > MAX_TRACE_EVENTS ? end - MAX_TRACE_EVENTS : 0;
+    const Duration::rep start_time = trace_start.time_since_epoch().count();
+
+    std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    {
+        std::lock_guard<std::mutex> lock(trace_threads_mutex);
+        for (const auto& thread : trace_thread_names) {
+            json += Common::StringFromFormat("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,"
+                                             "\"args\":{\"name\":\"%s\"}},\n", thread.first, thread.second.c_str());
+        }
+    }
+    for (u64 i = begin; i < end; ++i) {
+        const TraceEvent& event = trace_events[i % MAX_TRACE_EVENTS];
+        // Events recorded while exporting may be half written, or from before tracing restarted
+        if (event.category_id >= categories.size() || event.time < start_time)
+            continue;
+
+        using FloatUs = std::chrono::duration<double, std::micro>;
+        const double timestamp = std::chrono::duration_cast<FloatUs>(Duration(event.time - start_time)).count();
+        json += Common::StringFromFormat("{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":0,\"tid\":%u},\n",
+                                         categories[event.category_id].name, event.begin ? 'B' : 'E',
+                                         timestamp, event.thread_id);
+    }
+    // The format allows a trailing comma, but not every tool does
+    if (json.back() == '\n' && json[json.size() - 2] == ',')
+        json.erase(json.size() - 2, 1);
+    json += "]}\n";
+
+    if (FileUtil::WriteStringToFile(true, json, filename.c_str()) != json.size()) {
+        LOG_ERROR(Common, "Failed to write the trace to %s", filename.c_str());
+        return false;
+    }
+    LOG_INFO(Common, "Wrote %llu trace events to %s", (unsigned long long)(end - begin), filename.c_str());
+    return true;
+}
+
 #if defined(_MSC_VER) && _MSC_VER <= 1800 // MSVC 2013
 QPCClock::time_point QPCClock::now() {
     static LARGE_INTEGER freq;
@@ -35,15 +183,81 @@ QPCClock::time_point QPCClock::now() {
 }
 #endif
 
-TimingCategory::TimingCategory(const char* name, TimingCategory* parent)
-        : accumulated_duration(0) {
+namespace {
+
+std::mutex thread_timings_mutex;
+std::vector<std::unique_ptr<ThreadTimings>> all_thread_timings;
+
+/// Hands the timings of a thread over to the next one when it exits
+struct ThreadTimingsRelease {
+    ThreadTimings* timings = nullptr;
+
+    ~ThreadTimingsRelease() {
+        if (timings == nullptr)
+            return;
+        std::lock_guard<std::mutex> lock(thread_timings_mutex);
+        timings->in_use = false;
+    }
+};
+
+}
+
+thread_local ThreadTimings* TimingCategory::thread_timings = nullptr;
+
+ThreadTimings* TimingCategory::RegisterThread() {
+    ThreadTimings* timings = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(thread_timings_mutex);
+        // The totals of a thread that exited carry on, the part of them it measured was retrieved
+        // already or will be with what this thread measures
+        for (auto& unused : all_thread_timings) {
+            if (!unused->in_use) {
+                timings = unused.get();
+                break;
+            }
+        }
+        if (timings == nullptr) {
+            all_thread_timings.emplace_back(new ThreadTimings());
+            timings = all_thread_timings.back().get();
+        }
+        timings->in_use = true;
+    }
+
+    static thread_local ThreadTimingsRelease release;
+    release.timings = timings;
+    thread_timings = timings;
+    return timings;
+}
+
+Duration TimingCategory::GetAccumulatedTime() {
+    std::lock_guard<std::mutex> lock(thread_timings_mutex);
+
+    Duration::rep accumulated = 0;
+    for (auto& timings : all_thread_timings) {
+        const Duration::rep total = timings->totals[category_id].load(std::memory_order_relaxed);
+        accumulated += total - timings->retrieved[category_id];
+        timings->retrieved[category_id] = total;
+    }
+    return Duration(accumulated);
+}
 
+TimingCategory::TimingCategory(const char* name, TimingCategory* parent) {
     ProfilingManager& manager = GetProfilingManager();
     category_id = manager.RegisterTimingCategory(this, name);
     if (parent != nullptr)
         manager.SetTimingCategoryParent(category_id, parent->category_id);
 }
 
+SampleCategory::SampleCategory(const char* name, const char* count_name)
+        : accumulated_count(0), accumulated_sum(0) {
+
+    category_id = GetProfilingManager().RegisterSampleCategory(this, name, count_name);
+}
+
+static Perf::Histogram frame_time_histogram("Frame time (us)", {
+    5000, 10000, 15000, 16700, 20000, 25000, 33300, 50000, 66700, 100000, 250000,
+});
+
 ProfilingManager::ProfilingManager()
         : last_frame_end(Clock::now()), this_frame_start(Clock::now()) {
 }
@@ -55,6 +269,7 @@ unsigned int ProfilingManager::RegisterTimingCategory(TimingCategory* category,
     info.parent = TimingCategoryInfo::NO_PARENT;
 
     unsigned int id = (unsigned int)timing_categories.size();
+    ASSERT_MSG(id < MAX_TIMING_CATEGORIES, "too many timing categories, raise MAX_TIMING_CATEGORIES");
     timing_categories.push_back(std::move(info));
 
     return id;
@@ -67,6 +282,19 @@ void ProfilingManager::SetTimingCategoryParent(unsigned int category, unsigned i
     timing_categories[category].parent = parent;
 }
 
+unsigned int ProfilingManager::RegisterSampleCategory(SampleCategory* category, const char* name,
+                                                      const char* count_name) {
+    SampleCategoryInfo info;
+    info.category = category;
+    info.name = name;
+    info.count_name = count_name;
+
+    unsigned int id = (unsigned int)sample_categories.size();
+    sample_categories.push_back(std::move(info));
+
+    return id;
+}
+
 void ProfilingManager::BeginFrame() {
     this_frame_start = Clock::now();
 }
@@ -81,10 +309,54 @@ void ProfilingManager::FinishFrame() {
     for (size_t i = 0; i < timing_categories.size(); ++i) {
         results.time_per_category[i] = timing_categories[i].category->GetAccumulatedTime();
     }
+    {
+        std::lock_guard<std::mutex> lock(total_time_mutex);
+        total_time_per_category.resize(timing_categories.size(), Duration::zero());
+        for (size_t i = 0; i < timing_categories.size(); ++i)
+            total_time_per_category[i] += results.time_per_category[i];
+    }
+
+    results.samples_per_category.resize(sample_categories.size());
+    for (size_t i = 0; i < sample_categories.size(); ++i) {
+        FrameSamples& samples = results.samples_per_category[i];
+        sample_categories[i].category->GetAccumulatedSamples(samples.count, samples.sum);
+    }
+    {
+        std::lock_guard<std::mutex> lock(total_time_mutex);
+        total_samples_per_category.resize(sample_categories.size(), FrameSamples{ 0, 0 });
+        for (size_t i = 0; i < sample_categories.size(); ++i) {
+            total_samples_per_category[i].count += results.samples_per_category[i].count;
+            total_samples_per_category[i].sum += results.samples_per_category[i].sum;
+        }
+    }
+
+    const std::vector<u64> counter_totals = Perf::GetCounterTotals();
+    last_counter_totals.resize(counter_totals.size(), 0);
+    results.counts_per_counter.resize(counter_totals.size());
+    for (size_t i = 0; i < counter_totals.size(); ++i)
+        results.counts_per_counter[i] = counter_totals[i] - last_counter_totals[i];
+    last_counter_totals = counter_totals;
+
+    frame_time_histogram.AddSample(
+            std::chrono::duration_cast<std::chrono::microseconds>(results.interframe_time).count());
 
     last_frame_end = now;
 }
 
+std::vector<Duration> ProfilingManager::GetTotalTimePerCategory() {
+    std::lock_guard<std::mutex> lock(total_time_mutex);
+    return total_time_per_category;
+}
+
+std::vector<FrameSamples> ProfilingManager::GetTotalSamplesPerCategory() {
+    std::lock_guard<std::mutex> lock(total_time_mutex);
+    return total_samples_per_category;
+}
+
+const Perf::Histogram& ProfilingManager::GetFrameTimeHistogram() const {
+    return frame_time_histogram;
+}
+
 TimingResultsAggregator::TimingResultsAggregator(size_t window_size)
         : max_window_size(window_size), window_size(0) {
     interframe_times.resize(window_size, Duration::zero());
@@ -107,14 +379,46 @@ void TimingResultsAggregator::SetNumberOfCategories(size_t n) {
     }
 }
 
+void TimingResultsAggregator::SetNumberOfSampleCategories(size_t n) {
+    size_t old_size = samples_per_category.size();
+    if (n == old_size)
+        return;
+
+    samples_per_category.resize(n);
+
+    for (size_t i = old_size; i < n; ++i) {
+        samples_per_category[i].resize(max_window_size, FrameSamples{ 0, 0 });
+    }
+}
+
+void TimingResultsAggregator::SetNumberOfCounters(size_t n) {
+    size_t old_size = counts_per_counter.size();
+    if (n == old_size)
+        return;
+
+    counts_per_counter.resize(n);
+
+    for (size_t i = old_size; i < n; ++i) {
+        counts_per_counter[i].resize(max_window_size, 0);
+    }
+}
+
 void TimingResultsAggregator::AddFrame(const ProfilingFrameResult& frame_result) {
     SetNumberOfCategories(frame_result.time_per_category.size());
+    SetNumberOfSampleCategories(frame_result.samples_per_category.size());
+    SetNumberOfCounters(frame_result.counts_per_counter.size());
 
     interframe_times[cursor] = frame_result.interframe_time;
     frame_times[cursor] = frame_result.frame_time;
     for (size_t i = 0; i < frame_result.time_per_category.size(); ++i) {
         times_per_category[i][cursor] = frame_result.time_per_category[i];
     }
+    for (size_t i = 0; i < frame_result.samples_per_category.size(); ++i) {
+        samples_per_category[i][cursor] = frame_result.samples_per_category[i];
+    }
+    for (size_t i = 0; i < frame_result.counts_per_counter.size(); ++i) {
+        counts_per_counter[i][cursor] = frame_result.counts_per_counter[i];
+    }
 
     ++cursor;
     if (cursor == max_window_size)
@@ -140,6 +444,53 @@ static AggregatedDuration AggregateField(const std::vector<Duration>& v, size_t
     return result;
 }
 
+static AggregatedSamples AggregateSamples(const std::vector<FrameSamples>& v, size_t len) {
+    AggregatedSamples result = {};
+    u64 total_count = 0;
+    s64 total_sum = 0;
+    bool first_value = true;
+
+    for (size_t i = 0; i < len; ++i) {
+        const FrameSamples& samples = v[i];
+        const float count = (float)samples.count;
+        total_count += samples.count;
+        total_sum += samples.sum;
+
+        result.min_count = (i == 0) ? count : std::min(result.min_count, count);
+        result.max_count = (i == 0) ? count : std::max(result.max_count, count);
+
+        // Frames without samples have no average value
+        if (samples.count != 0) {
+            const float value = (float)samples.sum / samples.count;
+            result.min_value = first_value ? value : std::min(result.min_value, value);
+            result.max_value = first_value ? value : std::max(result.max_value, value);
+            first_value = false;
+        }
+    }
+    if (len != 0)
+        result.avg_count = (float)total_count / len;
+    if (total_count != 0)
+        result.avg_value = (float)total_sum / total_count;
+
+    return result;
+}
+
+static AggregatedCount AggregateCounts(const std::vector<u64>& v, size_t len) {
+    AggregatedCount result = {};
+    u64 total = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        const float count = (float)v[i];
+        total += v[i];
+        result.min = (i == 0) ? count : std::min(result.min, count);
+        result.max = (i == 0) ? count : std::max(result.max, count);
+    }
+    if (len != 0)
+        result.avg = (float)total / len;
+
+    return result;
+}
+
 static float tof(Common::Profiling::Duration dur) {
     using FloatMs = std::chrono::duration<float, std::chrono::milliseconds::period>;
     return std::chrono::duration_cast<FloatMs>(dur).count();
@@ -162,6 +513,16 @@ AggregatedFrameResult TimingResultsAggregator::GetAggregatedResults() const {
         result.time_per_category[i] = AggregateField(times_per_category[i], window_size);
     }
 
+    result.samples_per_category.resize(samples_per_category.size());
+    for (size_t i = 0; i < samples_per_category.size(); ++i) {
+        result.samples_per_category[i] = AggregateSamples(samples_per_category[i], window_size);
+    }
+
+    result.counts_per_counter.resize(counts_per_counter.size());
+    for (size_t i = 0; i < counts_per_counter.size(); ++i) {
+        result.counts_per_counter[i] = AggregateCounts(counts_per_counter[i], window_size);
+    }
+
     return result;
 }
 
@@ -171,9 +532,11 @@ ProfilingManager& GetProfilingManager() {
     return manager;
 }
 
-SynchronizedRef<TimingResultsAggregator> GetTimingResultsAggregator() {
-    static SynchronizedWrapper<TimingResultsAggregator> aggregator(30);
-    return SynchronizedRef<TimingResultsAggregator>(aggregator);
+static LockStats aggregator_lock_stats("Profiler results");
+
+SynchronizedRef<TimingResultsAggregator, InstrumentedMutex> GetTimingResultsAggregator() {
+    static SynchronizedWrapper<TimingResultsAggregator, InstrumentedMutex> aggregator(ConstructMutex(), aggregator_lock_stats, 30);
+    return SynchronizedRef<TimingResultsAggregator, InstrumentedMutex>(aggregator);
 }
 
 } // namespace Profiling
@@ -4,10 +4,18 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <chrono>
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
 #include "common/assert.h"
+#include "common/common_types.h"
 #include "common/thread.h"
 
 namespace Common {
@@ -18,7 +26,45 @@ namespace Profiling {
 #define ENABLE_PROFILING 1
 #endif
 
-#if defined(_MSC_VER) && _MSC_VER <= 1800 // MSVC 2013
+// If this is defined to 0, the timers around every single vertex and triangle are compiled out, so
+// that they don't weigh on the timings of the batches they are part of.
+#ifndef ENABLE_FINE_PROFILING
+#define ENABLE_FINE_PROFILING 1
+#endif
+
+/// Declares a ScopeTimer for a scope that runs once per vertex or triangle, see ENABLE_FINE_PROFILING
+#if ENABLE_FINE_PROFILING
+#define FINE_SCOPE_TIMER(name, category) Common::Profiling::ScopeTimer name(category)
+#else
+#define FINE_SCOPE_TIMER(name, category) (void)(category)
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+// Reading the time stamp counter is several times cheaper than the OS clocks, which matters for
+// timers entered millions of times per second. The counter is calibrated against the steady clock
+// at startup, which relies on it running at a constant rate like it does on any recent x86 CPU.
+
+struct TSCClock {
+    using duration = std::chrono::nanoseconds;
+    using time_point = std::chrono::time_point<TSCClock>;
+    using rep = duration::rep;
+    using period = duration::period;
+    static const bool is_steady = true;
+
+    static time_point now() {
+        return time_point(duration((rep)((__rdtsc() - base_ticks) * ns_per_tick)));
+    }
+
+    /// Measures the rate of the counter, done once when the program starts
+    static void Calibrate();
+
+private:
+    static u64 base_ticks;
+    static double ns_per_tick;
+};
+
+using Clock = TSCClock;
+#elif defined(_MSC_VER) && _MSC_VER <= 1800 // MSVC 2013
 // MSVC up to 2013 doesn't use QueryPerformanceCounter for high_resolution_clock, so it has bad
 // precision. We manually implement a clock based on QPC to get good results.
 
@@ -39,6 +85,28 @@ using Clock = std::chrono::high_resolution_clock;
 
 using Duration = Clock::duration;
 
+/// Whether Timers record when they start and stop in the trace buffer, see StartTracing
+extern std::atomic<bool> g_tracing;
+
+/// Adds the start or stop of a Timer on the calling thread to the trace buffer
+void RecordTraceEvent(unsigned int category_id, bool begin, Clock::time_point time);
+
+/// Maximum number of TimingCategories that can be declared
+const unsigned int MAX_TIMING_CATEGORIES = 64;
+
+/**
+ * Time measured by one thread in each TimingCategory. Only that thread adds to its totals, so that
+ * threads timing the same categories don't contend on shared counters.
+ */
+struct ThreadTimings {
+    /// Time measured since the thread started, by category id
+    std::array<std::atomic<Duration::rep>, MAX_TIMING_CATEGORIES> totals;
+    /// Part of the totals already retrieved by GetAccumulatedTime, only accessed under its lock
+    std::array<Duration::rep, MAX_TIMING_CATEGORIES> retrieved;
+    /// Whether a running thread owns these timings, they are reused after it exits
+    bool in_use;
+};
+
 /**
  * Represents a timing category that measured time can be accounted towards. Should be declared as a
  * global variable and passed to Timers.
@@ -53,24 +121,69 @@ public:
 
     /// Adds some time to this category. Can safely be called from multiple threads at the same time.
     void AddTime(Duration amount) {
-        std::atomic_fetch_add_explicit(
-                &accumulated_duration, amount.count(),
-                std::memory_order_relaxed);
+        ThreadTimings* timings = thread_timings != nullptr ? thread_timings : RegisterThread();
+        std::atomic<Duration::rep>& total = timings->totals[category_id];
+        // Nobody else writes to it, no locked instruction is needed
+        total.store(total.load(std::memory_order_relaxed) + amount.count(), std::memory_order_relaxed);
     }
 
     /**
-     * Atomically retrieves the accumulated measured time for this category and resets the counter
-     * to zero. Can be safely called concurrently with AddTime.
+     * Retrieves the time measured in this category by all threads since the last call. Can be
+     * safely called concurrently with AddTime.
      */
-    Duration GetAccumulatedTime() {
-        return Duration(std::atomic_exchange_explicit(
-                &accumulated_duration, (Duration::rep)0,
-                std::memory_order_relaxed));
+    Duration GetAccumulatedTime();
+
+private:
+    /// Gives the calling thread timings of its own
+    static ThreadTimings* RegisterThread();
+
+    unsigned int category_id;
+    static thread_local ThreadTimings* thread_timings;
+};
+
+/**
+ * Represents a quantity that is sampled a varying number of times per frame, e.g. the length of each
+ * slice the CPU runs for. Reports both the average value of the samples and how many samples were
+ * taken in a frame. Should be declared as a global variable.
+ */
+class SampleCategory final {
+public:
+    /**
+     * @param name Name of the sampled value
+     * @param count_name Name of the number of samples taken
+     */
+    SampleCategory(const char* name, const char* count_name);
+
+    unsigned int GetCategoryId() const {
+        return category_id;
+    }
+
+    /// Adds a sample to this category. Can safely be called from multiple threads at the same time.
+    void AddSample(s64 value) {
+        std::atomic_fetch_add_explicit(&accumulated_count, (u64)1, std::memory_order_relaxed);
+        std::atomic_fetch_add_explicit(&accumulated_sum, value, std::memory_order_relaxed);
+    }
+
+    /// Adds a number of samples at once, given the sum of their values
+    void AddSamples(u64 count, s64 sum) {
+        std::atomic_fetch_add_explicit(&accumulated_count, count, std::memory_order_relaxed);
+        std::atomic_fetch_add_explicit(&accumulated_sum, sum, std::memory_order_relaxed);
+    }
+
+    /**
+     * Atomically retrieves the number and sum of the samples taken since the last call and resets
+     * them to zero. Can be safely called concurrently with AddSample, a concurrent sample may be
+     * counted in one call and summed in the next.
+     */
+    void GetAccumulatedSamples(u64& count, s64& sum) {
+        count = std::atomic_exchange_explicit(&accumulated_count, (u64)0, std::memory_order_relaxed);
+        sum = std::atomic_exchange_explicit(&accumulated_sum, (s64)0, std::memory_order_relaxed);
     }
 
 private:
     unsigned int category_id;
-    std::atomic<Duration::rep> accumulated_duration;
+    std::atomic<u64> accumulated_count;
+    std::atomic<s64> accumulated_sum;
 };
 
 /**
@@ -96,13 +209,18 @@ public:
             previous_timer->StopTiming();
 
         StartTiming();
+        if (g_tracing.load(std::memory_order_relaxed))
+            RecordTraceEvent(category.GetCategoryId(), true, start);
 #endif
     }
 
     void Stop() {
 #if ENABLE_PROFILING
         ASSERT(running);
-        StopTiming();
+        const Clock::time_point now = Clock::now();
+        StopTiming(now);
+        if (g_tracing.load(std::memory_order_relaxed))
+            RecordTraceEvent(category.GetCategoryId(), false, now);
 
         if (previous_timer != nullptr)
             previous_timer->StartTiming();
@@ -118,7 +236,11 @@ private:
     }
 
     void StopTiming() {
-        auto duration = Clock::now() - start;
+        StopTiming(Clock::now());
+    }
+
+    void StopTiming(Clock::time_point now) {
+        auto duration = now - start;
         running = false;
         category.AddTime(std::chrono::duration_cast<Duration>(duration));
     }
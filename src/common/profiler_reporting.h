@@ -5,11 +5,15 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <mutex>
+#include <string>
 #include <utility>
 #include <vector>
 
+#include "common/instrumented_mutex.h"
+#include "common/perf_counters.h"
 #include "common/profiler.h"
 #include "common/synchronized_wrapper.h"
 
@@ -24,6 +28,19 @@ struct TimingCategoryInfo {
     unsigned int parent;
 };
 
+struct SampleCategoryInfo {
+    SampleCategory* category;
+    const char* name;
+    const char* count_name;
+};
+
+struct FrameSamples {
+    /// Number of samples taken
+    u64 count;
+    /// Sum of the sampled values
+    s64 sum;
+};
+
 struct ProfilingFrameResult {
     /// Time since the last delivered frame
     Duration interframe_time;
@@ -33,6 +50,12 @@ struct ProfilingFrameResult {
 
     /// Total amount of time spent inside each category in this frame. Indexed by the category id
     std::vector<Duration> time_per_category;
+
+    /// Samples taken in each sample category in this frame. Indexed by the category id
+    std::vector<FrameSamples> samples_per_category;
+
+    /// Events counted by each Perf::Counter in this frame. Indexed by the counter id
+    std::vector<u64> counts_per_counter;
 };
 
 class ProfilingManager final {
@@ -46,6 +69,13 @@ public:
         return timing_categories;
     }
 
+    unsigned int RegisterSampleCategory(SampleCategory* category, const char* name,
+                                        const char* count_name);
+
+    const std::vector<SampleCategoryInfo>& GetSampleCategoriesInfo() const {
+        return sample_categories;
+    }
+
     /// This should be called after swapping screen buffers.
     void BeginFrame();
     /// This should be called before swapping screen buffers.
@@ -56,18 +86,53 @@ public:
         return results;
     }
 
+    /**
+     * Get the time spent inside each category in all frames finished so far, indexed by the
+     * category id. Can be called from any thread.
+     */
+    std::vector<Duration> GetTotalTimePerCategory();
+
+    /**
+     * Get the samples taken in each sample category in all frames finished so far, indexed by the
+     * category id. Can be called from any thread.
+     */
+    std::vector<FrameSamples> GetTotalSamplesPerCategory();
+
+    /// Histogram of the times between the frames finished so far, in microseconds
+    const Perf::Histogram& GetFrameTimeHistogram() const;
+
 private:
     std::vector<TimingCategoryInfo> timing_categories;
+    std::vector<SampleCategoryInfo> sample_categories;
     Clock::time_point last_frame_end;
     Clock::time_point this_frame_start;
 
     ProfilingFrameResult results;
+
+    std::mutex total_time_mutex;
+    std::vector<Duration> total_time_per_category;
+    std::vector<FrameSamples> total_samples_per_category;
+
+    /// Totals of the Perf::Counters when the last frame finished
+    std::vector<u64> last_counter_totals;
 };
 
 struct AggregatedDuration {
     Duration avg, min, max;
 };
 
+struct AggregatedSamples {
+    /// Average of all sampled values, and minimum and maximum of their per-frame averages
+    float avg_value, min_value, max_value;
+    /// Average, minimum and maximum number of samples taken per frame
+    float avg_count, min_count, max_count;
+};
+
+struct AggregatedCount {
+    /// Average, minimum and maximum number of events counted per frame
+    float avg, min, max;
+};
+
 struct AggregatedFrameResult {
     /// Time since the last delivered frame
     AggregatedDuration interframe_time;
@@ -79,6 +144,12 @@ struct AggregatedFrameResult {
 
     /// Total amount of time spent inside each category in this frame. Indexed by the category id
     std::vector<AggregatedDuration> time_per_category;
+
+    /// Samples taken in each sample category. Indexed by the category id
+    std::vector<AggregatedSamples> samples_per_category;
+
+    /// Events counted by each Perf::Counter. Indexed by the counter id
+    std::vector<AggregatedCount> counts_per_counter;
 };
 
 class TimingResultsAggregator final {
@@ -87,6 +158,8 @@ public:
 
     void Clear();
     void SetNumberOfCategories(size_t n);
+    void SetNumberOfSampleCategories(size_t n);
+    void SetNumberOfCounters(size_t n);
 
     void AddFrame(const ProfilingFrameResult& frame_result);
 
@@ -99,10 +172,35 @@ public:
     std::vector<Duration> interframe_times;
     std::vector<Duration> frame_times;
     std::vector<std::vector<Duration>> times_per_category;
+    std::vector<std::vector<FrameSamples>> samples_per_category;
+    std::vector<std::vector<u64>> counts_per_counter;
 };
 
 ProfilingManager& GetProfilingManager();
-SynchronizedRef<TimingResultsAggregator> GetTimingResultsAggregator();
+SynchronizedRef<TimingResultsAggregator, InstrumentedMutex> GetTimingResultsAggregator();
+
+/// Number of events the trace buffer holds, older ones are overwritten
+const size_t MAX_TRACE_EVENTS = 1 << 20;
+
+/**
+ * Starts recording when every Timer starts and stops, and on which thread, in a ring buffer that
+ * keeps the last MAX_TRACE_EVENTS events. Restarting discards the events recorded before.
+ */
+void StartTracing();
+
+/// Stops recording events, the ones recorded so far stay in the buffer to be exported
+void StopTracing();
+
+bool IsTracing();
+
+/**
+ * Writes the events in the trace buffer as a timeline in the Chrome trace event format, which
+ * chrome://tracing and the Perfetto UI load. Can be called while tracing.
+ */
+bool ExportChromeTrace(const std::string& filename);
+
+/// Names the calling thread in exported traces
+void SetTraceThreadName(const char* name);
 
 } // namespace Profiling
 } // namespace Common
@@ -0,0 +1,74 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace Common {
+
+/**
+ * Fixed-size queue of values for exactly one producer thread and one consumer thread. Neither
+ * side ever blocks or takes a lock, which makes it suitable for feeding real-time callbacks such
+ * as the host's audio thread. The capacity must be a power of two.
+ */
+template <typename T, size_t capacity>
+class RingBuffer {
+    static_assert(capacity != 0 && (capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    /**
+     * Appends values to the queue, as many of them as there is room for. Producer thread only.
+     * @return Number of values appended
+     */
+    size_t Push(const T* data, size_t count) {
+        const size_t write = write_index.load(std::memory_order_relaxed);
+        const size_t read = read_index.load(std::memory_order_acquire);
+        count = std::min(count, capacity - (write - read));
+
+        for (size_t i = 0; i < count; ++i)
+            buffer[(write + i) & (capacity - 1)] = data[i];
+
+        write_index.store(write + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * Takes values from the front of the queue, as many of them as are available. Consumer
+     * thread only.
+     * @return Number of values taken
+     */
+    size_t Pop(T* data, size_t max_count) {
+        const size_t read = read_index.load(std::memory_order_relaxed);
+        const size_t write = write_index.load(std::memory_order_acquire);
+        const size_t count = std::min(max_count, write - read);
+
+        for (size_t i = 0; i < count; ++i)
+            data[i] = buffer[(read + i) & (capacity - 1)];
+
+        read_index.store(read + count, std::memory_order_release);
+        return count;
+    }
+
+    /// Number of values in the queue, only a snapshot when called while the other side works
+    size_t Size() const {
+        return write_index.load(std::memory_order_acquire) - read_index.load(std::memory_order_acquire);
+    }
+
+    size_t Capacity() const {
+        return capacity;
+    }
+
+private:
+    // The indices only ever grow and are wrapped when indexing, so a full queue isn't mistaken
+    // for an empty one. Each is written by one side only and kept on its own cache line.
+    alignas(64) std::atomic<size_t> read_index{0};
+    alignas(64) std::atomic<size_t> write_index{0};
+    std::array<T, capacity> buffer;
+};
+
+} // namespace
@@ -40,6 +40,33 @@ namespace Symbols
 
         return symbol;
     }
+
+    TSymbol GetContainingSymbol(u32 _address)
+    {
+        // The symbols are sorted by address, the candidate is the last one starting at or before
+        // the address
+        TSymbolsMap::iterator foundSymbolItr = g_symbols.upper_bound(_address);
+        if (foundSymbolItr == g_symbols.begin())
+            return TSymbol();
+
+        --foundSymbolItr;
+        const TSymbol& symbol = foundSymbolItr->second;
+        if (_address == symbol.address || _address - symbol.address < symbol.size)
+            return symbol;
+
+        return TSymbol();
+    }
+
+    TSymbol GetSymbolByName(const std::string& _name)
+    {
+        for (const TSymbolsPair& pair : g_symbols)
+        {
+            if (pair.second.name == _name)
+                return pair.second;
+        }
+        return TSymbol();
+    }
+
     const std::string GetName(u32 _address)
     {
         return GetSymbol(_address).name;
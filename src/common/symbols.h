@@ -32,6 +32,16 @@ namespace Symbols
 
     void Add(u32 _address, const std::string& _name, u32 _size, u32 _type);
     TSymbol GetSymbol(u32 _address);
+
+    /**
+     * Looks up the symbol whose range contains the given address, in logarithmic time.
+     * A symbol of size 0 only contains its own address.
+     * @return The symbol, or a symbol with an empty name if no symbol contains the address
+     */
+    TSymbol GetContainingSymbol(u32 _address);
+
+    /// Looks up a symbol by name, in linear time. Returns a symbol with an empty name if none matches.
+    TSymbol GetSymbolByName(const std::string& _name);
     const std::string GetName(u32 _address);
     void Remove(u32 _address);
     void Clear();
@@ -8,12 +8,16 @@
 
 namespace Common {
 
+/// Passed first to a SynchronizedWrapper constructor to construct its mutex from the second argument
+struct ConstructMutex {};
+
 /**
  * Wraps an object, only allowing access to it via a locking reference wrapper. Good to ensure no
  * one forgets to lock a mutex before acessing an object. To access the wrapped object construct a
  * SyncronizedRef on this wrapper. Inspired by Rust's Mutex type (http://doc.rust-lang.org/std/sync/struct.Mutex.html).
+ * The mutex can be an InstrumentedMutex, constructed with ConstructMutex and its LockStats.
  */
-template <typename T>
+template <typename T, typename Mutex = std::mutex>
 class SynchronizedWrapper {
 public:
     template <typename... Args>
@@ -21,11 +25,16 @@ public:
         data(std::forward<Args>(args)...) {
     }
 
+    template <typename MutexArg, typename... Args>
+    SynchronizedWrapper(ConstructMutex, MutexArg&& mutex_arg, Args&&... args) :
+        mutex(std::forward<MutexArg>(mutex_arg)), data(std::forward<Args>(args)...) {
+    }
+
 private:
-    template <typename U>
+    template <typename U, typename M>
     friend class SynchronizedRef;
 
-    std::mutex mutex;
+    Mutex mutex;
     T data;
 };
 
@@ -34,10 +43,10 @@ private:
  * greatly reduces the chance that someone will access the wrapped resource without locking the
  * mutex.
  */
-template <typename T>
+template <typename T, typename Mutex = std::mutex>
 class SynchronizedRef {
 public:
-    SynchronizedRef(SynchronizedWrapper<T>& wrapper) : wrapper(&wrapper) {
+    SynchronizedRef(SynchronizedWrapper<T, Mutex>& wrapper) : wrapper(&wrapper) {
         wrapper.mutex.lock();
     }
 
@@ -63,7 +72,7 @@ public:
     const T* operator->() const { return &wrapper->data; }
 
 private:
-    SynchronizedWrapper<T>* wrapper;
+    SynchronizedWrapper<T, Mutex>* wrapper;
 };
 
 } // namespace Common
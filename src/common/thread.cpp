@@ -2,6 +2,13 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "common/profiler_reporting.h"
 #include "common/thread.h"
 
 #ifdef __APPLE__
@@ -12,6 +19,16 @@
 #include <Windows.h>
 #endif
 
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace Common
 {
 
@@ -36,14 +53,14 @@ void SleepCurrentThread(int ms)
 
 #ifdef _MSC_VER
 
-void SetThreadAffinity(std::thread::native_handle_type thread, u32 mask)
+void SetThreadAffinity(std::thread::native_handle_type thread, u64 mask)
 {
-    SetThreadAffinityMask(thread, mask);
+    SetThreadAffinityMask(thread, static_cast<DWORD_PTR>(mask));
 }
 
-void SetCurrentThreadAffinity(u32 mask)
+void SetCurrentThreadAffinity(u64 mask)
 {
-    SetThreadAffinityMask(GetCurrentThread(), mask);
+    SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(mask));
 }
 
 void SwitchCurrentThread()
@@ -59,6 +76,8 @@ void SwitchCurrentThread()
 // http://msdn.microsoft.com/en-us/library/xcb2z8hs(VS.100).aspx
 void SetCurrentThreadName(const char* szThreadName)
 {
+    Profiling::SetTraceThreadName(szThreadName);
+
     static const DWORD MS_VC_EXCEPTION = 0x406D1388;
 
     #pragma pack(push,8)
@@ -86,11 +105,13 @@ void SetCurrentThreadName(const char* szThreadName)
 
 #else // !MSVC_VER, so must be POSIX threads
 
-void SetThreadAffinity(std::thread::native_handle_type thread, u32 mask)
+void SetThreadAffinity(std::thread::native_handle_type thread, u64 mask)
 {
 #ifdef __APPLE__
+    // macOS only takes an affinity tag, threads with the same one are kept together
+    integer_t tag = static_cast<integer_t>(mask);
     thread_policy_set(pthread_mach_thread_np(thread),
-        THREAD_AFFINITY_POLICY, (integer_t *)&mask, 1);
+        THREAD_AFFINITY_POLICY, &tag, 1);
 #elif (defined __linux__ || defined BSD4_4) && !(defined ANDROID)
     cpu_set_t cpu_set;
     CPU_ZERO(&cpu_set);
@@ -103,7 +124,7 @@ void SetThreadAffinity(std::thread::native_handle_type thread, u32 mask)
 #endif
 }
 
-void SetCurrentThreadAffinity(u32 mask)
+void SetCurrentThreadAffinity(u64 mask)
 {
     SetThreadAffinity(pthread_self(), mask);
 }
@@ -124,6 +145,8 @@ void SwitchCurrentThread()
 #if !defined(_WIN32) || defined(_MSC_VER)
 void SetCurrentThreadName(const char* szThreadName)
 {
+    Profiling::SetTraceThreadName(szThreadName);
+
 #ifdef __APPLE__
     pthread_setname_np(szThreadName);
 #elif defined(__OpenBSD__)
@@ -136,4 +159,94 @@ void SetCurrentThreadName(const char* szThreadName)
 
 #endif
 
+bool SetCurrentThreadPriority(ThreadPriority priority)
+{
+#ifdef _WIN32
+    static const int priorities[] = {
+        THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_ABOVE_NORMAL
+    };
+    return SetThreadPriority(GetCurrentThread(), priorities[static_cast<int>(priority)]) != 0;
+#elif defined(__linux__)
+    // Linux threads have a nice value of their own, going below 0 needs CAP_SYS_NICE or RLIMIT_NICE
+    static const int nice_values[] = { 5, 0, -5 };
+    return setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)),
+                       nice_values[static_cast<int>(priority)]) == 0;
+#else
+    int policy;
+    sched_param param;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) != 0)
+        return false;
+
+    const int min = sched_get_priority_min(policy);
+    const int max = sched_get_priority_max(policy);
+    switch (priority) {
+    case ThreadPriority::Low:    param.sched_priority = min; break;
+    case ThreadPriority::Normal: param.sched_priority = (min + max) / 2; break;
+    case ThreadPriority::High:   param.sched_priority = max; break;
+    }
+    return pthread_setschedparam(pthread_self(), policy, &param) == 0;
+#endif
+}
+
+#ifdef __linux__
+// Parses a CPU list from sysfs, like "0-3,8", into a mask
+static u64 ParseCPUList(const std::string& list)
+{
+    u64 mask = 0;
+    std::istringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        unsigned first, last;
+        const int fields = std::sscanf(range.c_str(), "%u-%u", &first, &last);
+        if (fields < 1)
+            continue;
+        if (fields == 1)
+            last = first;
+        for (unsigned cpu = first; cpu <= last && cpu < 64; ++cpu)
+            mask |= 1ull << cpu;
+    }
+    return mask;
+}
+#endif
+
+std::vector<u64> GetPhysicalCores()
+{
+    std::vector<u64> cores;
+
+#ifdef _WIN32
+    DWORD size = 0;
+    GetLogicalProcessorInformation(nullptr, &size);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (!info.empty() && GetLogicalProcessorInformation(info.data(), &size)) {
+        for (const auto& entry : info) {
+            if (entry.Relationship == RelationProcessorCore)
+                cores.push_back(static_cast<u64>(entry.ProcessorMask));
+        }
+    }
+#elif defined(__linux__)
+    // Each CPU lists the CPUs sharing its core, itself included. CPUs that are offline have no
+    // topology and are skipped.
+    u64 seen = 0;
+    for (unsigned cpu = 0; cpu < 64; ++cpu) {
+        if ((seen >> cpu) & 1)
+            continue;
+        std::ifstream file("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+        std::string list;
+        if (!std::getline(file, list))
+            continue;
+        const u64 siblings = ParseCPUList(list) | (1ull << cpu);
+        seen |= siblings;
+        cores.push_back(siblings);
+    }
+#endif
+
+    // Without topology information, every logical CPU is taken for a core of its own
+    if (cores.empty()) {
+        const unsigned num_cpus = std::min(std::max(std::thread::hardware_concurrency(), 1u), 64u);
+        for (unsigned cpu = 0; cpu < num_cpus; ++cpu)
+            cores.push_back(1ull << cpu);
+    }
+    return cores;
+}
+
 } // namespace Common
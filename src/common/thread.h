@@ -10,6 +10,7 @@
 #include <thread>
 #include <condition_variable>
 #include <mutex>
+#include <vector>
 
 // This may not be defined outside _WIN32
 #ifndef _WIN32
@@ -47,8 +48,22 @@ namespace Common
 
 int CurrentThreadId();
 
-void SetThreadAffinity(std::thread::native_handle_type thread, u32 mask);
-void SetCurrentThreadAffinity(u32 mask);
+void SetThreadAffinity(std::thread::native_handle_type thread, u64 mask);
+void SetCurrentThreadAffinity(u64 mask);
+
+enum class ThreadPriority {
+    Low,
+    Normal,
+    High,
+};
+
+// Changes the scheduling priority of the calling thread. Returns false if the OS refused, raising
+// it usually needs extra privileges outside of Windows.
+bool SetCurrentThreadPriority(ThreadPriority priority);
+
+// Returns the affinity mask of each physical core of the host, which has the bits of the logical
+// CPUs running on it set, several of them with SMT. Only the first 64 logical CPUs are considered.
+std::vector<u64> GetPhysicalCores();
 
 class Event {
 public:
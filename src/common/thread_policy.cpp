@@ -0,0 +1,81 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <mutex>
+#include <string>
+
+#include "common/logging/log.h"
+#include "common/profiler_reporting.h"
+#include "common/string_util.h"
+#include "common/thread_policy.h"
+
+namespace Common {
+
+static std::mutex placements_mutex;
+static ThreadPlacement placements[static_cast<int>(ThreadClass::NumClasses)] = {
+    { 0, ThreadPriority::Normal },
+    { 0, ThreadPriority::Normal },
+    { 0, ThreadPriority::Normal },
+    { 0, ThreadPriority::Normal },
+};
+
+static thread_local ThreadClass current_thread_class = ThreadClass::NumClasses;
+
+static const char* GetPriorityName(ThreadPriority priority) {
+    switch (priority) {
+    case ThreadPriority::Low:  return "low";
+    case ThreadPriority::High: return "high";
+    default:                   return "normal";
+    }
+}
+
+void SetThreadPlacement(ThreadClass thread_class, const ThreadPlacement& placement) {
+    std::lock_guard<std::mutex> lock(placements_mutex);
+    placements[static_cast<int>(thread_class)] = placement;
+}
+
+void RegisterCurrentThread(const char* name, ThreadClass thread_class) {
+    ThreadPlacement placement;
+    {
+        std::lock_guard<std::mutex> lock(placements_mutex);
+        placement = placements[static_cast<int>(thread_class)];
+    }
+
+    SetCurrentThreadName(name);
+    current_thread_class = thread_class;
+
+    if (placement.affinity_mask != 0)
+        SetCurrentThreadAffinity(placement.affinity_mask);
+
+    bool priority_applied = true;
+    if (placement.priority != ThreadPriority::Normal && !SetCurrentThreadPriority(placement.priority)) {
+        LOG_WARNING(Common, "The OS refused %s priority for %s", GetPriorityName(placement.priority), name);
+        priority_applied = false;
+    }
+
+    const std::string cpus = placement.affinity_mask != 0
+            ? Common::StringFromFormat("CPUs 0x%llX", (unsigned long long)placement.affinity_mask)
+            : std::string("any CPU");
+    const std::string description = Common::StringFromFormat("%s (%s, %s, %s priority)", name,
+            GetThreadClassName(thread_class), cpus.c_str(),
+            GetPriorityName(priority_applied ? placement.priority : ThreadPriority::Normal));
+    Profiling::SetTraceThreadName(description.c_str());
+    LOG_INFO(Common, "Started thread %s", description.c_str());
+}
+
+ThreadClass GetCurrentThreadClass() {
+    return current_thread_class;
+}
+
+const char* GetThreadClassName(ThreadClass thread_class) {
+    switch (thread_class) {
+    case ThreadClass::Emulation: return "Emulation";
+    case ThreadClass::GPU:       return "GPU";
+    case ThreadClass::Audio:     return "Audio";
+    case ThreadClass::Worker:    return "Worker";
+    default:                     return "Unregistered";
+    }
+}
+
+} // namespace
@@ -0,0 +1,47 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+#include "common/thread.h"
+
+namespace Common {
+
+/// Threads of the emulator, grouped by how they are scheduled
+enum class ThreadClass {
+    Emulation, ///< Runs the emulated CPU, and the video core when there is no GPU thread
+    GPU,       ///< Runs the video core
+    Audio,     ///< Produces the audio output
+    Worker,    ///< Background work that the frames don't wait for, or that is spread over many threads
+
+    NumClasses
+};
+
+/// Where the threads of a class run
+struct ThreadPlacement {
+    /// Logical CPUs the threads may run on, 0 for any of them
+    u64 affinity_mask;
+    ThreadPriority priority;
+};
+
+/**
+ * Sets the placement of a class of threads. It applies to the threads registered afterwards, so it's
+ * set before the emulation starts its threads.
+ */
+void SetThreadPlacement(ThreadClass thread_class, const ThreadPlacement& placement);
+
+/**
+ * Names the calling thread like SetCurrentThreadName and applies the placement of its class to it.
+ * The name the thread has in profiler traces includes its class and placement.
+ */
+void RegisterCurrentThread(const char* name, ThreadClass thread_class);
+
+/// Class the calling thread was registered with, NumClasses if it wasn't registered
+ThreadClass GetCurrentThreadClass();
+
+/// Name of a thread class for reports, "Unregistered" for NumClasses
+const char* GetThreadClassName(ThreadClass thread_class);
+
+} // namespace
@@ -4,11 +4,15 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <deque>
 
 #include <boost/range/algorithm_ext/erase.hpp>
 
+#include "common/common_funcs.h"
+#include "common/common_types.h"
+
 namespace Common {
 
 template<class T, unsigned int N>
@@ -17,20 +21,21 @@ struct ThreadQueueList {
     //               (dynamically resizable) circular buffers to remove their overhead when
     //               inserting and popping.
 
+    static_assert(N <= 64, "The priority bitmap only has room for 64 levels");
+
     typedef unsigned int Priority;
 
     // Number of priority levels. (Valid levels are [0..NUM_QUEUES).)
     static const Priority NUM_QUEUES = N;
 
-    ThreadQueueList() {
-        first = nullptr;
+    ThreadQueueList() : used_priorities(0) {
     }
 
     // Only for debugging, returns priority level.
     Priority contains(const T& uid) {
         for (Priority i = 0; i < NUM_QUEUES; ++i) {
             Queue& cur = queues[i];
-            if (std::find(cur.data.cbegin(), cur.data.cend(), uid) != cur.data.cend()) {
+            if (std::find(cur.cbegin(), cur.cend(), uid) != cur.cend()) {
                 return i;
             }
         }
@@ -39,122 +44,98 @@ struct ThreadQueueList {
     }
 
     T get_first() {
-        Queue *cur = first;
-        while (cur != nullptr) {
-            if (!cur->data.empty()) {
-                return cur->data.front();
-            }
-            cur = cur->next_nonempty;
-        }
+        if (used_priorities == 0)
+            return T();
 
-        return T();
+        return queues[CountLeadingZeros64(used_priorities)].front();
     }
 
     T pop_first() {
-        Queue *cur = first;
-        while (cur != nullptr) {
-            if (!cur->data.empty()) {
-                auto tmp = std::move(cur->data.front());
-                cur->data.pop_front();
-                return tmp;
-            }
-            cur = cur->next_nonempty;
-        }
+        if (used_priorities == 0)
+            return T();
 
-        return T();
+        return pop_front(CountLeadingZeros64(used_priorities));
     }
 
     T pop_first_better(Priority priority) {
-        Queue *cur = first;
-        Queue *stop = &queues[priority];
-        while (cur < stop) {
-            if (!cur->data.empty()) {
-                auto tmp = std::move(cur->data.front());
-                cur->data.pop_front();
-                return tmp;
-            }
-            cur = cur->next_nonempty;
-        }
+        // Only keep the levels above the given one, which are the bits above its own
+        const u64 better_priorities = used_priorities & ~(~0ull >> priority);
+        if (better_priorities == 0)
+            return T();
 
-        return T();
+        return pop_front(CountLeadingZeros64(better_priorities));
     }
 
     void push_front(Priority priority, const T& thread_id) {
-        Queue *cur = &queues[priority];
-        cur->data.push_front(thread_id);
+        queues[priority].push_front(thread_id);
+        used_priorities |= PriorityBit(priority);
     }
 
     void push_back(Priority priority, const T& thread_id) {
-        Queue *cur = &queues[priority];
-        cur->data.push_back(thread_id);
+        queues[priority].push_back(thread_id);
+        used_priorities |= PriorityBit(priority);
     }
 
     void move(const T& thread_id, Priority old_priority, Priority new_priority) {
         remove(old_priority, thread_id);
-        prepare(new_priority);
         push_back(new_priority, thread_id);
     }
 
     void remove(Priority priority, const T& thread_id) {
-        Queue *cur = &queues[priority];
-        boost::remove_erase(cur->data, thread_id);
+        Queue& cur = queues[priority];
+        boost::remove_erase(cur, thread_id);
+        if (cur.empty())
+            used_priorities &= ~PriorityBit(priority);
     }
 
     void rotate(Priority priority) {
-        Queue *cur = &queues[priority];
+        Queue& cur = queues[priority];
 
-        if (cur->data.size() > 1) {
-            cur->data.push_back(std::move(cur->data.front()));
-            cur->data.pop_front();
+        if (cur.size() > 1) {
+            cur.push_back(std::move(cur.front()));
+            cur.pop_front();
         }
     }
 
     void clear() {
         queues.fill(Queue());
-        first = nullptr;
+        used_priorities = 0;
     }
 
     bool empty(Priority priority) const {
-        const Queue *cur = &queues[priority];
-        return cur->data.empty();
+        return (used_priorities & PriorityBit(priority)) == 0;
     }
 
-    void prepare(Priority priority) {
-        Queue* cur = &queues[priority];
-        if (cur->next_nonempty == UnlinkedTag())
-            link(priority);
+    /// Calls function(priority, thread) for every queued thread, in the order they would be popped
+    template <typename Function>
+    void for_each(Function function) const {
+        for (Priority i = 0; i < NUM_QUEUES; ++i) {
+            for (const T& thread : queues[i])
+                function(i, thread);
+        }
     }
 
 private:
-    struct Queue {
-        // Points to the next active priority, skipping over ones that have never been used.
-        Queue* next_nonempty = UnlinkedTag();
-        // Double-ended queue of threads in this priority level
-        std::deque<T> data;
-    };
-
-    /// Special tag used to mark priority levels that have never been used.
-    static Queue* UnlinkedTag() {
-        return reinterpret_cast<Queue*>(1);
-    }
-
-    void link(Priority priority) {
-        Queue *cur = &queues[priority];
+    // Double-ended queue of threads in a priority level
+    typedef std::deque<T> Queue;
 
-        for (int i = priority - 1; i >= 0; --i) {
-            if (queues[i].next_nonempty != UnlinkedTag()) {
-                cur->next_nonempty = queues[i].next_nonempty;
-                queues[i].next_nonempty = cur;
-                return;
-            }
-        }
+    /// Bit of a priority level in used_priorities. Level 0 is the highest bit, so the number of
+    /// leading zeros is the highest priority level in use.
+    static u64 PriorityBit(Priority priority) {
+        return 1ull << (63 - priority);
+    }
 
-        cur->next_nonempty = first;
-        first = cur;
+    T pop_front(Priority priority) {
+        Queue& cur = queues[priority];
+        auto tmp = std::move(cur.front());
+        cur.pop_front();
+        if (cur.empty())
+            used_priorities &= ~PriorityBit(priority);
+        return tmp;
     }
 
-    // The first queue that's ever been used.
-    Queue* first;
+    // One bit per priority level, set when its queue isn't empty
+    u64 used_priorities;
     // The priority level queues of thread ids.
     std::array<Queue, NUM_QUEUES> queues;
 };
@@ -32,6 +32,11 @@
 #pragma once
 
 #include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
 
 namespace Math {
 
@@ -527,6 +532,72 @@ Vec4<decltype(V{}*T{})> operator * (const V& f, const Vec4<T>& vec)
 
 typedef Vec4<float> Vec4f;
 
+#if defined(_M_X64) || defined(__SSE2__)
+// Vec4s of 32-bit floats, or of types wrapping one, keep their layout but do their arithmetic on all
+// components at once. Each component is computed by the same operation as in the scalar code, so the
+// results are bit-identical. DEFINE_VEC4_SSE_OPS has to be used right after T is defined, before
+// any of the operators get instantiated.
+
+template<typename T>
+static inline __m128 LoadVec4(const Vec4<T>& vec) {
+    static_assert(sizeof(T) == sizeof(float), "T has to be stored as a float");
+    return _mm_loadu_ps(reinterpret_cast<const float*>(&vec.x));
+}
+
+template<typename T>
+static inline Vec4<T> StoreVec4(__m128 value) {
+    Vec4<T> vec;
+    _mm_storeu_ps(reinterpret_cast<float*>(&vec.x), value);
+    return vec;
+}
+
+template<typename T>
+static inline __m128 LoadScalar(const T& f) {
+    float value;
+    std::memcpy(&value, &f, sizeof(float));
+    return _mm_set1_ps(value);
+}
+
+#define DEFINE_VEC4_SSE_OPS(T) \
+    template<> inline Vec4<T> Vec4<T>::operator +(const Vec4<T>& other) const { \
+        return StoreVec4<T>(_mm_add_ps(LoadVec4(*this), LoadVec4(other))); \
+    } \
+    template<> inline void Vec4<T>::operator +=(const Vec4<T>& other) { \
+        *this = *this + other; \
+    } \
+    template<> inline Vec4<T> Vec4<T>::operator -(const Vec4<T>& other) const { \
+        return StoreVec4<T>(_mm_sub_ps(LoadVec4(*this), LoadVec4(other))); \
+    } \
+    template<> inline void Vec4<T>::operator -=(const Vec4<T>& other) { \
+        *this = *this - other; \
+    } \
+    template<> inline Vec4<T> Vec4<T>::operator -() const { \
+        return StoreVec4<T>(_mm_xor_ps(LoadVec4(*this), _mm_set1_ps(-0.0f))); \
+    } \
+    template<> inline Vec4<T> Vec4<T>::operator *(const Vec4<T>& other) const { \
+        return StoreVec4<T>(_mm_mul_ps(LoadVec4(*this), LoadVec4(other))); \
+    } \
+    template<> template<> inline Vec4<T> Vec4<T>::operator *<T>(const T& f) const { \
+        return StoreVec4<T>(_mm_mul_ps(LoadVec4(*this), LoadScalar(f))); \
+    } \
+    template<> template<> inline void Vec4<T>::operator *=<T>(const T& f) { \
+        *this = *this * f; \
+    } \
+    template<> template<> inline Vec4<T> Vec4<T>::operator /<T>(const T& f) const { \
+        return StoreVec4<T>(_mm_div_ps(LoadVec4(*this), LoadScalar(f))); \
+    } \
+    /* The products are summed in the same order as by the scalar Dot */ \
+    template<> inline T Dot<T>(const Vec4<T>& a, const Vec4<T>& b) { \
+        const __m128 products = _mm_mul_ps(LoadVec4(a), LoadVec4(b)); \
+        __m128 sum = _mm_add_ss(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(1, 1, 1, 1))); \
+        sum = _mm_add_ss(sum, _mm_movehl_ps(products, products)); \
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(products, products, _MM_SHUFFLE(3, 3, 3, 3))); \
+        T result; \
+        _mm_store_ss(reinterpret_cast<float*>(&result), sum); \
+        return result; \
+    }
+#endif
+
 
 template<typename T>
 static inline decltype(T{}*T{}+T{}*T{}) Dot(const Vec2<T>& a, const Vec2<T>& b)
@@ -546,6 +617,10 @@ static inline decltype(T{}*T{}+T{}*T{}) Dot(const Vec4<T>& a, const Vec4<T>& b)
     return a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w;
 }
 
+#ifdef DEFINE_VEC4_SSE_OPS
+DEFINE_VEC4_SSE_OPS(float)
+#endif
+
 template<typename T>
 static inline Vec3<decltype(T{}*T{}-T{}*T{})> Cross(const Vec3<T>& a, const Vec3<T>& b)
 {
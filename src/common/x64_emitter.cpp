@@ -0,0 +1,297 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "common/assert.h"
+
+#include "common/x64_emitter.h"
+
+namespace Common {
+
+static u8 RegIndex(X64Reg reg) {
+    return static_cast<u8>(reg);
+}
+
+static u8 RegIndex(XmmReg reg) {
+    return static_cast<u8>(reg);
+}
+
+void X64Emitter::Write8(u8 value) {
+    DEBUG_ASSERT(code < end);
+    *code++ = value;
+}
+
+void X64Emitter::Write32(u32 value) {
+    Write8(value & 0xFF);
+    Write8((value >> 8) & 0xFF);
+    Write8((value >> 16) & 0xFF);
+    Write8((value >> 24) & 0xFF);
+}
+
+void X64Emitter::Write64(u64 value) {
+    Write32(static_cast<u32>(value));
+    Write32(static_cast<u32>(value >> 32));
+}
+
+void X64Emitter::WriteREX(bool w, u8 reg, u8 index, u8 base) {
+    u8 rex = 0x40;
+    if (w)
+        rex |= 0x08; // REX.W
+    if (reg & 8)
+        rex |= 0x04; // REX.R
+    if (index & 8)
+        rex |= 0x02; // REX.X
+    if (base & 8)
+        rex |= 0x01; // REX.B
+    if (rex != 0x40)
+        Write8(rex);
+}
+
+void X64Emitter::WriteREX(bool w, u8 reg, const MemOperand& mem) {
+    switch (mem.type) {
+    case MemOperand::Type::Base:
+        WriteREX(w, reg, 0, RegIndex(mem.base));
+        break;
+    case MemOperand::Type::BaseIndex:
+        WriteREX(w, reg, RegIndex(mem.index), RegIndex(mem.base));
+        break;
+    case MemOperand::Type::RipRelative:
+        WriteREX(w, reg, 0, 0);
+        break;
+    }
+}
+
+void X64Emitter::WriteModRMReg(u8 reg, u8 rm) {
+    Write8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+void X64Emitter::WriteModRMMem(u8 reg, const MemOperand& mem, int trailing_bytes) {
+    switch (mem.type) {
+    case MemOperand::Type::Base:
+        // mod = 10: [base + disp32]
+        Write8(0x80 | ((reg & 7) << 3) | (RegIndex(mem.base) & 7));
+        // RSP and R12 as a base can only be encoded through a SIB byte
+        if ((RegIndex(mem.base) & 7) == RegIndex(X64Reg::RSP))
+            Write8(0x24);
+        Write32(static_cast<u32>(mem.disp));
+        break;
+
+    case MemOperand::Type::BaseIndex:
+        // RSP can't be used as an index
+        DEBUG_ASSERT(mem.index != X64Reg::RSP);
+        Write8(0x84 | ((reg & 7) << 3));
+        Write8(((RegIndex(mem.index) & 7) << 3) | (RegIndex(mem.base) & 7));
+        Write32(static_cast<u32>(mem.disp));
+        break;
+
+    case MemOperand::Type::RipRelative:
+    {
+        // mod = 00, rm = 101: [rip + disp32], relative to the end of the instruction
+        Write8(((reg & 7) << 3) | 0x05);
+        const s64 disp = static_cast<const u8*>(mem.target) - (code + 4 + trailing_bytes);
+        ASSERT_MSG(disp == static_cast<s32>(disp), "RIP relative operand out of range");
+        Write32(static_cast<u32>(disp));
+        break;
+    }
+    }
+}
+
+void X64Emitter::WriteSSE(u8 prefix, u8 opcode, u8 reg, u8 rm) {
+    // Mandatory prefixes go in front of the REX prefix
+    if (prefix != 0)
+        Write8(prefix);
+    WriteREX(false, reg, 0, rm);
+    Write8(0x0F);
+    Write8(opcode);
+    WriteModRMReg(reg, rm);
+}
+
+void X64Emitter::WriteSSE(u8 prefix, u8 opcode, u8 reg, const MemOperand& mem) {
+    if (prefix != 0)
+        Write8(prefix);
+    WriteREX(false, reg, mem);
+    Write8(0x0F);
+    Write8(opcode);
+    WriteModRMMem(reg, mem);
+}
+
+void X64Emitter::MOV64(X64Reg dst, u64 imm) {
+    WriteREX(true, 0, 0, RegIndex(dst));
+    Write8(0xB8 + (RegIndex(dst) & 7));
+    Write64(imm);
+}
+
+void X64Emitter::MOV(X64Reg dst, X64Reg src) {
+    WriteREX(false, RegIndex(src), 0, RegIndex(dst));
+    Write8(0x89);
+    WriteModRMReg(RegIndex(src), RegIndex(dst));
+}
+
+void X64Emitter::MOV(X64Reg dst, u32 imm) {
+    WriteREX(false, 0, 0, RegIndex(dst));
+    Write8(0xB8 + (RegIndex(dst) & 7));
+    Write32(imm);
+}
+
+void X64Emitter::MOV_Load(X64Reg dst, const MemOperand& mem) {
+    WriteREX(false, RegIndex(dst), mem);
+    Write8(0x8B);
+    WriteModRMMem(RegIndex(dst), mem);
+}
+
+void X64Emitter::MOV_Store(const MemOperand& mem, X64Reg src) {
+    WriteREX(false, RegIndex(src), mem);
+    Write8(0x89);
+    WriteModRMMem(RegIndex(src), mem);
+}
+
+void X64Emitter::MOV_StoreImm(const MemOperand& mem, u32 imm) {
+    WriteREX(false, 0, mem);
+    Write8(0xC7);
+    WriteModRMMem(0, mem, 4);
+    Write32(imm);
+}
+
+void X64Emitter::MOV8_Store(const MemOperand& mem, X64Reg src) {
+    // Without a REX prefix, registers 4-7 would address AH-BH, with one SPL-DIL
+    DEBUG_ASSERT(RegIndex(src) < 4);
+    WriteREX(false, RegIndex(src), mem);
+    Write8(0x88);
+    WriteModRMMem(RegIndex(src), mem);
+}
+
+void X64Emitter::MOVZX8_Load(X64Reg dst, const MemOperand& mem) {
+    WriteREX(false, RegIndex(dst), mem);
+    Write8(0x0F);
+    Write8(0xB6);
+    WriteModRMMem(RegIndex(dst), mem);
+}
+
+void X64Emitter::ALU(AluOp op, X64Reg dst, X64Reg src) {
+    // The register-register forms live at opcode (digit * 8 + 1)
+    WriteREX(false, RegIndex(src), 0, RegIndex(dst));
+    Write8(static_cast<u8>(op) * 8 + 1);
+    WriteModRMReg(RegIndex(src), RegIndex(dst));
+}
+
+void X64Emitter::ALU(AluOp op, X64Reg dst, u32 imm) {
+    WriteREX(false, 0, 0, RegIndex(dst));
+    Write8(0x81);
+    WriteModRMReg(static_cast<u8>(op), RegIndex(dst));
+    Write32(imm);
+}
+
+void X64Emitter::ADD_Store(const MemOperand& mem, X64Reg src) {
+    WriteREX(false, RegIndex(src), mem);
+    Write8(0x01);
+    WriteModRMMem(RegIndex(src), mem);
+}
+
+void X64Emitter::Shift(ShiftOp op, X64Reg dst, u8 amount) {
+    WriteREX(false, 0, 0, RegIndex(dst));
+    Write8(0xC1);
+    WriteModRMReg(static_cast<u8>(op), RegIndex(dst));
+    Write8(amount);
+}
+
+void X64Emitter::TEST(X64Reg dst, X64Reg src) {
+    WriteREX(false, RegIndex(src), 0, RegIndex(dst));
+    Write8(0x85);
+    WriteModRMReg(RegIndex(src), RegIndex(dst));
+}
+
+void X64Emitter::NOT(X64Reg dst) {
+    WriteREX(false, 0, 0, RegIndex(dst));
+    Write8(0xF7);
+    WriteModRMReg(2, RegIndex(dst));
+}
+
+u8* X64Emitter::J_CC(Condition condition) {
+    Write8(0x0F);
+    Write8(0x80 + static_cast<u8>(condition));
+    u8* jump = code;
+    Write32(0);
+    return jump;
+}
+
+u8* X64Emitter::JMP() {
+    Write8(0xE9);
+    u8* jump = code;
+    Write32(0);
+    return jump;
+}
+
+void X64Emitter::JMP(const u8* target) {
+    Write8(0xE9);
+    const s64 disp = target - (code + 4);
+    ASSERT(disp == static_cast<s32>(disp));
+    Write32(static_cast<u32>(disp));
+}
+
+void X64Emitter::SetJumpTarget(u8* jump) {
+    // The displacement is relative to the end of the jump, which is where the displacement ends
+    const s64 disp = code - (jump + 4);
+    ASSERT(disp == static_cast<s32>(disp));
+    const u32 value = static_cast<u32>(disp);
+    jump[0] = value & 0xFF;
+    jump[1] = (value >> 8) & 0xFF;
+    jump[2] = (value >> 16) & 0xFF;
+    jump[3] = (value >> 24) & 0xFF;
+}
+
+void X64Emitter::RET() {
+    Write8(0xC3);
+}
+
+void X64Emitter::MOVUPS(XmmReg dst, const MemOperand& mem) {
+    WriteSSE(0, 0x10, RegIndex(dst), mem);
+}
+
+void X64Emitter::MOVUPS(const MemOperand& mem, XmmReg src) {
+    WriteSSE(0, 0x11, RegIndex(src), mem);
+}
+
+void X64Emitter::MOVAPS(XmmReg dst, XmmReg src) {
+    WriteSSE(0, 0x28, RegIndex(dst), RegIndex(src));
+}
+
+void X64Emitter::SSE(SSEOp op, XmmReg dst, XmmReg src) {
+    WriteSSE(0, static_cast<u8>(op), RegIndex(dst), RegIndex(src));
+}
+
+void X64Emitter::SSE(SSEOp op, XmmReg dst, const MemOperand& mem) {
+    WriteSSE(0, static_cast<u8>(op), RegIndex(dst), mem);
+}
+
+void X64Emitter::ADDSS(XmmReg dst, XmmReg src) {
+    WriteSSE(0xF3, 0x58, RegIndex(dst), RegIndex(src));
+}
+
+void X64Emitter::SHUFPS(XmmReg dst, XmmReg src, u8 shuffle) {
+    WriteSSE(0, 0xC6, RegIndex(dst), RegIndex(src));
+    Write8(shuffle);
+}
+
+void X64Emitter::CMPPS(XmmReg dst, XmmReg src, u8 predicate) {
+    WriteSSE(0, 0xC2, RegIndex(dst), RegIndex(src));
+    Write8(predicate);
+}
+
+void X64Emitter::CVTTPS2DQ(XmmReg dst, XmmReg src) {
+    WriteSSE(0xF3, 0x5B, RegIndex(dst), RegIndex(src));
+}
+
+void X64Emitter::CVTDQ2PS(XmmReg dst, XmmReg src) {
+    WriteSSE(0, 0x5B, RegIndex(dst), RegIndex(src));
+}
+
+void X64Emitter::MOVMSKPS(X64Reg dst, XmmReg src) {
+    WriteSSE(0, 0x50, RegIndex(dst), RegIndex(src));
+}
+
+void X64Emitter::MOVD(X64Reg dst, XmmReg src) {
+    // The XMM register goes into the reg field, the general purpose one into rm
+    WriteSSE(0x66, 0x7E, RegIndex(src), RegIndex(dst));
+}
+
+} // namespace
@@ -0,0 +1,185 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+
+#include "common/common_types.h"
+
+namespace Common {
+
+/// x86-64 general purpose registers, numbered as in their ModRM/REX encoding.
+enum class X64Reg : u8 {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+    R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15,
+};
+
+/// SSE registers, numbered as in their ModRM/REX encoding.
+enum class XmmReg : u8 {
+    XMM0 = 0, XMM1 = 1, XMM2 = 2, XMM3 = 3, XMM4 = 4, XMM5 = 5, XMM6 = 6, XMM7 = 7,
+};
+
+/// Two-operand integer ALU operations, numbered by their /digit in the 0x81 opcode group.
+enum class AluOp : u8 {
+    ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7,
+};
+
+/// Shift and rotate operations, numbered by their /digit in the 0xC1 opcode group.
+enum class ShiftOp : u8 {
+    ROR = 1, SHL = 4, SHR = 5, SAR = 7,
+};
+
+/// Condition codes of conditional jumps, numbered as in their encoding.
+enum class Condition : u8 {
+    B = 0x2, AE = 0x3, E = 0x4, NE = 0x5, BE = 0x6, A = 0x7,
+};
+
+/// Packed single precision SSE operations, numbered by their second opcode byte.
+enum class SSEOp : u8 {
+    SQRTPS = 0x51, ANDPS = 0x54, ANDNPS = 0x55, ORPS = 0x56, XORPS = 0x57,
+    ADDPS = 0x58, MULPS = 0x59, SUBPS = 0x5C, MINPS = 0x5D, DIVPS = 0x5E, MAXPS = 0x5F,
+};
+
+/// Memory operand, either [base + disp32], [base + index + disp32] or [rip + disp32].
+struct MemOperand {
+    enum class Type : u8 { Base, BaseIndex, RipRelative };
+
+    Type type;
+    X64Reg base;
+    X64Reg index;
+    s32 disp;
+    /// Absolute address of the operand, for RIP relative operands
+    const void* target;
+
+    static MemOperand Disp(X64Reg base, s32 disp) {
+        return { Type::Base, base, X64Reg::RAX, disp, nullptr };
+    }
+
+    static MemOperand Indexed(X64Reg base, X64Reg index, s32 disp) {
+        return { Type::BaseIndex, base, index, disp, nullptr };
+    }
+
+    /// The target has to be within 2 GB of the code referencing it
+    static MemOperand Rip(const void* target) {
+        return { Type::RipRelative, X64Reg::RAX, X64Reg::RAX, 0, target };
+    }
+};
+
+/**
+ * Minimal x86-64 machine code emitter covering the integer and SSE instructions the ARM and vertex
+ * shader JITs need. Integer operations are 32 bit unless noted otherwise.
+ */
+class X64Emitter {
+public:
+    X64Emitter() = default;
+    X64Emitter(u8* code_ptr, u8* code_end) : code(code_ptr), end(code_end) {}
+
+    void SetCodePtr(u8* code_ptr, u8* code_end) {
+        code = code_ptr;
+        end = code_end;
+    }
+
+    u8* GetCodePtr() const {
+        return code;
+    }
+
+    /// Returns the number of bytes that can still be emitted before the buffer end is reached.
+    size_t GetSpaceLeft() const {
+        return end - code;
+    }
+
+    /// mov dst, imm64
+    void MOV64(X64Reg dst, u64 imm);
+    /// mov dst, src
+    void MOV(X64Reg dst, X64Reg src);
+    /// mov dst, imm32
+    void MOV(X64Reg dst, u32 imm);
+    /// mov dst, dword [mem]
+    void MOV_Load(X64Reg dst, const MemOperand& mem);
+    /// mov dword [mem], src
+    void MOV_Store(const MemOperand& mem, X64Reg src);
+    /// mov dword [mem], imm32
+    void MOV_StoreImm(const MemOperand& mem, u32 imm);
+    /// mov byte [mem], src. src must be one of AL, CL, DL and BL.
+    void MOV8_Store(const MemOperand& mem, X64Reg src);
+    /// movzx dst, byte [mem]
+    void MOVZX8_Load(X64Reg dst, const MemOperand& mem);
+
+    /// op dst, src
+    void ALU(AluOp op, X64Reg dst, X64Reg src);
+    /// op dst, imm32
+    void ALU(AluOp op, X64Reg dst, u32 imm);
+    /// add dword [mem], src
+    void ADD_Store(const MemOperand& mem, X64Reg src);
+    /// op dst, imm8
+    void Shift(ShiftOp op, X64Reg dst, u8 amount);
+    /// test dst, src
+    void TEST(X64Reg dst, X64Reg src);
+    /// not dst
+    void NOT(X64Reg dst);
+
+    /// Emits a conditional jump with an unresolved target, to be filled in by SetJumpTarget.
+    u8* J_CC(Condition condition);
+    /// Emits an unconditional jump with an unresolved target, to be filled in by SetJumpTarget.
+    u8* JMP();
+    /// Emits a jump to a known target.
+    void JMP(const u8* target);
+    /// Points a previously emitted jump at the current code position.
+    void SetJumpTarget(u8* jump);
+    /// ret
+    void RET();
+
+    /// movups dst, [mem]
+    void MOVUPS(XmmReg dst, const MemOperand& mem);
+    /// movups [mem], src
+    void MOVUPS(const MemOperand& mem, XmmReg src);
+    /// movaps dst, src
+    void MOVAPS(XmmReg dst, XmmReg src);
+    /// op dst, src
+    void SSE(SSEOp op, XmmReg dst, XmmReg src);
+    /// op dst, [mem]
+    void SSE(SSEOp op, XmmReg dst, const MemOperand& mem);
+    /// addss dst, src
+    void ADDSS(XmmReg dst, XmmReg src);
+    /// shufps dst, src, imm8
+    void SHUFPS(XmmReg dst, XmmReg src, u8 shuffle);
+    /// cmpps dst, src, imm8
+    void CMPPS(XmmReg dst, XmmReg src, u8 predicate);
+    /// cvttps2dq dst, src
+    void CVTTPS2DQ(XmmReg dst, XmmReg src);
+    /// cvtdq2ps dst, src
+    void CVTDQ2PS(XmmReg dst, XmmReg src);
+    /// movmskps dst, src
+    void MOVMSKPS(X64Reg dst, XmmReg src);
+    /// movd dst, src
+    void MOVD(X64Reg dst, XmmReg src);
+
+private:
+    void Write8(u8 value);
+    void Write32(u32 value);
+    void Write64(u64 value);
+
+    /// Emits a REX prefix if any of the register fields refer to an extended register, or W is set.
+    void WriteREX(bool w, u8 reg, u8 index, u8 base);
+    void WriteREX(bool w, u8 reg, const MemOperand& mem);
+    /// Emits a register-direct ModRM byte.
+    void WriteModRMReg(u8 reg, u8 rm);
+    /**
+     * Emits the ModRM, SIB and displacement bytes addressing the given memory operand.
+     * @param trailing_bytes Number of immediate bytes following the displacement, needed to
+     *                       compute RIP relative displacements
+     */
+    void WriteModRMMem(u8 reg, const MemOperand& mem, int trailing_bytes = 0);
+
+    /// Emits an SSE instruction with an optional mandatory prefix (0 for none) and register operands.
+    void WriteSSE(u8 prefix, u8 opcode, u8 reg, u8 rm);
+    /// Emits an SSE instruction with an optional mandatory prefix (0 for none) and a memory operand.
+    void WriteSSE(u8 prefix, u8 opcode, u8 reg, const MemOperand& mem);
+
+    u8* code = nullptr;
+    u8* end = nullptr;
+};
+
+} // namespace
@@ -6,12 +6,17 @@
 
 #include "common/common_types.h"
 #include "core/arm/skyeye_common/arm_regformat.h"
+#include "core/core_timing.h"
 
 namespace Core {
     struct ThreadContext;
 }
 
-/// Generic ARM11 CPU interface
+/**
+ * Generic ARM11 CPU interface. The registers, tick counting and reschedule requests are the same
+ * for every core and aren't virtual, since the SVC wrappers and the kernel use them for every
+ * syscall: each core points the base class at the register file of the CPU state it operates on.
+ */
 class ARM_Interface : NonCopyable {
 public:
     ARM_Interface() {
@@ -39,27 +44,35 @@ public:
      * Set the Program Counter to an address
      * @param addr Address to set PC to
      */
-    virtual void SetPC(u32 addr) = 0;
+    void SetPC(u32 addr) {
+        registers[15] = addr;
+    }
 
     /*
      * Get the current Program Counter
      * @return Returns current PC
      */
-    virtual u32 GetPC() const = 0;
+    u32 GetPC() const {
+        return registers[15];
+    }
 
     /**
      * Get an ARM register
      * @param index Register index (0-15)
      * @return Returns the value in the register
      */
-    virtual u32 GetReg(int index) const = 0;
+    u32 GetReg(int index) const {
+        return registers[index];
+    }
 
     /**
      * Set an ARM register
      * @param index Register index (0-15)
      * @param value Value to set register to
      */
-    virtual void SetReg(int index, u32 value) = 0;
+    void SetReg(int index, u32 value) {
+        registers[index] = value;
+    }
 
     /**
      * Get the current CPSR register
@@ -91,7 +104,11 @@ public:
      * Advance the CPU core by the specified number of ticks (e.g. to simulate CPU execution time)
      * @param ticks Number of ticks to advance the CPU core
      */
-    virtual void AddTicks(u64 ticks) = 0;
+    void AddTicks(u64 ticks) {
+        down_count -= ticks;
+        if (down_count < 0)
+            CoreTiming::Advance();
+    }
 
     /**
      * Initializes a CPU context for use on this CPU
@@ -103,19 +120,48 @@ public:
     virtual void ResetContext(Core::ThreadContext& context, u32 stack_top, u32 entry_point, u32 arg) = 0;
 
     /**
-     * Saves the current CPU context
+     * Saves the current CPU context. This marks the VFP registers as saved, so ctx has to be the
+     * running thread's own context, the one it gets loaded from again, or its VFP state is lost.
      * @param ctx Thread context to save
      */
     virtual void SaveContext(Core::ThreadContext& ctx) = 0;
 
     /**
-     * Loads a CPU context
+     * Loads a CPU context. The VFP registers may be loaded lazily from ctx, so it has to stay
+     * alive until the next LoadContext call.
      * @param ctx Thread context to load
      */
     virtual void LoadContext(const Core::ThreadContext& ctx) = 0;
 
-    /// Prepare core for thread reschedule (if needed to correctly handle state)
-    virtual void PrepareReschedule() = 0;
+    /// Prepare core for thread reschedule, stopping execution at the next opportunity
+    void PrepareReschedule() {
+        *instructions_to_execute = 0;
+        reschedule_pending = true;
+    }
+
+    /**
+     * Discards any translated code derived from the given guest address range, e.g. because the
+     * memory has been written to.
+     * @param start_address Start of the modified range
+     * @param length Length of the modified range in bytes
+     */
+    virtual void InvalidateCacheRange(u32 start_address, u32 length) = 0;
+
+    /**
+     * Translates the block starting at the given address ahead of its execution, if it isn't
+     * translated yet
+     * @param pc Guest address of the first instruction of the block
+     * @param thumb Whether the block consists of Thumb instructions
+     */
+    virtual void TranslateBlock(u32 pc, bool thumb) = 0;
+
+    /**
+     * Gets how much of the cache of translated code is in use, for statistics. Can be called from
+     * any thread, the result may be slightly out of date.
+     * @param used_bytes Set to the number of bytes holding translated code
+     * @param capacity_bytes Set to the size of the cache
+     */
+    virtual void GetCacheUsage(size_t& used_bytes, size_t& capacity_bytes) const = 0;
 
     /// Getter for num_instructions
     u64 GetNumInstructions() {
@@ -126,6 +172,15 @@ public:
 
 protected:
 
+    /// Registers r0-r15 of the CPU state, to be set up by the core
+    u32* registers = nullptr;
+
+    /// Instruction budget of the interpreter, cleared to make it return at the next instruction
+    unsigned* instructions_to_execute = nullptr;
+
+    /// Set by PrepareReschedule, for cores that otherwise wouldn't notice until their slice ends
+    bool reschedule_pending = false;
+
     /**
      * Executes the given number of instructions
      * @param num_instructions Number of instructions to executes
@@ -9,6 +9,7 @@
 #include "common/file_util.h"
 
 #include "core/arm/disassembler/load_symbol_map.h"
+#include "core/hle/function_hooks.h"
 
 /*
  * Loads a symbol map file for use with the disassembler
@@ -29,4 +30,6 @@ void LoadSymbolMap(std::string filename) {
 
         Symbols::Add(address, function_name, size, 2);
     }
+
+    FunctionHooks::HookSymbols();
 }
@@ -4,6 +4,7 @@
 
 #include <cstring>
 
+#include "common/logging/log.h"
 #include "common/make_unique.h"
 
 #include "core/arm/skyeye_common/armdefs.h"
@@ -12,12 +13,15 @@
 #include "core/arm/dyncom/arm_dyncom.h"
 #include "core/arm/dyncom/arm_dyncom_interpreter.h"
 #include "core/arm/dyncom/arm_dyncom_run.h"
+#include "core/arm/dyncom/arm_dyncom_trans_cache.h"
 
 #include "core/core.h"
 #include "core/core_timing.h"
+#include "core/memory.h"
 
 ARM_DynCom::ARM_DynCom(PrivilegeMode initial_mode) {
     state = Common::make_unique<ARMul_State>();
+    translation_cache = CreateTranslationCache();
 
     ARMul_NewState(state.get());
     ARMul_SelectProcessor(state.get(), ARM_v6_Prop | ARM_v5_Prop | ARM_v5e_Prop);
@@ -37,25 +41,17 @@ ARM_DynCom::ARM_DynCom(PrivilegeMode initial_mode) {
 
     state->Reg[13] = 0x10000000; // Set stack pointer to the top of the stack
     state->Reg[15] = 0x00000000;
-}
-
-ARM_DynCom::~ARM_DynCom() {
-}
-
-void ARM_DynCom::SetPC(u32 pc) {
-    state->Reg[15] = pc;
-}
-
-u32 ARM_DynCom::GetPC() const {
-    return state->Reg[15];
-}
+    state->translation_cache = translation_cache.get();
+    state->memory_table = &Memory::GetFastAccessTable();
 
-u32 ARM_DynCom::GetReg(int index) const {
-    return state->Reg[index];
+    registers = state->Reg;
+    instructions_to_execute = &state->NumInstrsToExecute;
 }
 
-void ARM_DynCom::SetReg(int index, u32 value) {
-    state->Reg[index] = value;
+ARM_DynCom::~ARM_DynCom() {
+    LOG_DEBUG(Core_ARM11, "Block lookups: %llu hits, %llu misses",
+              (unsigned long long)translation_cache->GetHitCount(),
+              (unsigned long long)translation_cache->GetMissCount());
 }
 
 u32 ARM_DynCom::GetCPSR() const {
@@ -74,12 +70,6 @@ void ARM_DynCom::SetCP15Register(CP15Register reg, u32 value) {
     state->CP15[reg] = value;
 }
 
-void ARM_DynCom::AddTicks(u64 ticks) {
-    down_count -= ticks;
-    if (down_count < 0)
-        CoreTiming::Advance();
-}
-
 void ARM_DynCom::ExecuteInstructions(int num_instructions) {
     state->NumInstrsToExecute = num_instructions;
 
@@ -88,6 +78,7 @@ void ARM_DynCom::ExecuteInstructions(int num_instructions) {
     // instructions may actually be executed than specified.
     unsigned ticks_executed = InterpreterMainLoop(state.get());
     AddTicks(ticks_executed);
+    SkipIdleLoop(this, state.get());
 }
 
 void ARM_DynCom::ResetContext(Core::ThreadContext& context, u32 stack_top, u32 entry_point, u32 arg) {
@@ -101,30 +92,50 @@ void ARM_DynCom::ResetContext(Core::ThreadContext& context, u32 stack_top, u32 e
 
 void ARM_DynCom::SaveContext(Core::ThreadContext& ctx) {
     memcpy(ctx.cpu_registers, state->Reg, sizeof(ctx.cpu_registers));
-    memcpy(ctx.fpu_registers, state->ExtReg, sizeof(ctx.fpu_registers));
 
     ctx.sp = state->Reg[13];
     ctx.lr = state->Reg[14];
     ctx.pc = state->Reg[15];
     ctx.cpsr = state->Cpsr;
 
-    ctx.fpscr = state->VFP[1];
-    ctx.fpexc = state->VFP[2];
+    // The VFP registers only changed if a VFP instruction ran since they were last saved. If they
+    // were never loaded, the thread's VFP state is still in the context it was loaded from.
+    if (state->PendingVFPContext != nullptr) {
+        if (state->PendingVFPContext != &ctx) {
+            const Core::ThreadContext& pending = *state->PendingVFPContext;
+            memcpy(ctx.fpu_registers, pending.fpu_registers, sizeof(ctx.fpu_registers));
+            ctx.fpscr = pending.fpscr;
+            ctx.fpexc = pending.fpexc;
+        }
+    } else if (state->VFPDirty) {
+        VFPSaveContext(state.get(), ctx);
+    }
+    state->VFPDirty = false;
 }
 
 void ARM_DynCom::LoadContext(const Core::ThreadContext& ctx) {
     memcpy(state->Reg, ctx.cpu_registers, sizeof(ctx.cpu_registers));
-    memcpy(state->ExtReg, ctx.fpu_registers, sizeof(ctx.fpu_registers));
 
     state->Reg[13] = ctx.sp;
     state->Reg[14] = ctx.lr;
     state->Reg[15] = ctx.pc;
     state->Cpsr = ctx.cpsr;
 
-    state->VFP[1] = ctx.fpscr;
-    state->VFP[2] = ctx.fpexc;
+    // Threads that don't use VFP never pay for loading its registers, they are only loaded by the
+    // first VFP instruction the thread runs
+    state->PendingVFPContext = &ctx;
+    state->VFPDirty = false;
+}
+
+void ARM_DynCom::InvalidateCacheRange(u32 start_address, u32 length) {
+    translation_cache->InvalidateRange(start_address, length);
+}
+
+void ARM_DynCom::GetCacheUsage(size_t& used_bytes, size_t& capacity_bytes) const {
+    used_bytes = translation_cache->GetUsedSize();
+    capacity_bytes = translation_cache->GetCapacity();
 }
 
-void ARM_DynCom::PrepareReschedule() {
-    state->NumInstrsToExecute = 0;
+void ARM_DynCom::TranslateBlock(u32 pc, bool thumb) {
+    InterpreterTranslateBlock(state.get(), pc, thumb);
 }
@@ -11,29 +11,33 @@
 #include "core/arm/arm_interface.h"
 #include "core/arm/skyeye_common/armdefs.h"
 
+class TranslationCache;
+
 class ARM_DynCom final : virtual public ARM_Interface {
 public:
     ARM_DynCom(PrivilegeMode initial_mode);
     ~ARM_DynCom();
 
-    void SetPC(u32 pc) override;
-    u32 GetPC() const override;
-    u32 GetReg(int index) const override;
-    void SetReg(int index, u32 value) override;
     u32 GetCPSR() const override;
     void SetCPSR(u32 cpsr) override;
     u32 GetCP15Register(CP15Register reg) override;
     void SetCP15Register(CP15Register reg, u32 value) override;
 
-    void AddTicks(u64 ticks) override;
-
     void ResetContext(Core::ThreadContext& context, u32 stack_top, u32 entry_point, u32 arg) override;
     void SaveContext(Core::ThreadContext& ctx) override;
     void LoadContext(const Core::ThreadContext& ctx) override;
 
-    void PrepareReschedule() override;
+    void InvalidateCacheRange(u32 start_address, u32 length) override;
+    void TranslateBlock(u32 pc, bool thumb) override;
+    void GetCacheUsage(size_t& used_bytes, size_t& capacity_bytes) const override;
     void ExecuteInstructions(int num_instructions) override;
 
+    /// Gets the underlying interpreter state, e.g. for cores falling back to the interpreter
+    ARMul_State* GetState() const {
+        return state.get();
+    }
+
 private:
     std::unique_ptr<ARMul_State> state;
+    std::unique_ptr<TranslationCache> translation_cache;
 };
@@ -2,6 +2,9 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <array>
+#include <vector>
+
 #include "core/arm/skyeye_common/armdefs.h"
 #include "core/arm/dyncom/arm_dyncom_dec.h"
 
@@ -414,56 +417,128 @@ const ISEITEM arm_exclusion_code[] = {
     { "invalid", 0, INVALID,     { 0 }}
 };
 
-int decode_arm_instr(uint32_t instr, int32_t *idx) {
-    int n = 0;
+// Checks whether an instruction matches the encoding of arm_instruction[i] without being excluded
+// by arm_exclusion_code[i]
+static bool MatchesEncoding(int i, u32 instr) {
+    int n = arm_instruction[i].attribute_value;
     int base = 0;
-    int ret = DECODE_FAILURE;
-    int i = 0;
-    int instr_slots = sizeof(arm_instruction) / sizeof(ISEITEM);
 
-    for (i = 0; i < instr_slots; i++) {
-        n = arm_instruction[i].attribute_value;
-        base = 0;
-
-        while (n) {
-            if (arm_instruction[i].content[base + 1] == 31 && arm_instruction[i].content[base] == 0) {
-                // clrex
-                if (instr != arm_instruction[i].content[base + 2]) {
-                    break;
-                }
-            } else if (BITS(instr, arm_instruction[i].content[base], arm_instruction[i].content[base + 1]) != arm_instruction[i].content[base + 2]) {
-                break;
+    while (n) {
+        if (arm_instruction[i].content[base + 1] == 31 && arm_instruction[i].content[base] == 0) {
+            // clrex
+            if (instr != arm_instruction[i].content[base + 2]) {
+                return false;
             }
-            base += 3;
-            n--;
+        } else if (BITS(instr, arm_instruction[i].content[base], arm_instruction[i].content[base + 1]) != arm_instruction[i].content[base + 2]) {
+            return false;
         }
+        base += 3;
+        n--;
+    }
 
-        // All conditions is satisfied.
-        if (n == 0)
-            ret = DECODE_SUCCESS;
+    n = arm_exclusion_code[i].attribute_value;
+    if (n == 0)
+        return true;
 
-        if (ret == DECODE_SUCCESS) {
-            n = arm_exclusion_code[i].attribute_value;
-            if (n != 0) {
-                base = 0;
-                while (n) {
-                    if (BITS(instr, arm_exclusion_code[i].content[base], arm_exclusion_code[i].content[base + 1]) != arm_exclusion_code[i].content[base + 2]) {
-                        break;
-                    }
-                    base += 3;
-                    n--;
-                }
+    base = 0;
+    while (n) {
+        if (BITS(instr, arm_exclusion_code[i].content[base], arm_exclusion_code[i].content[base + 1]) != arm_exclusion_code[i].content[base + 2]) {
+            return true;
+        }
+        base += 3;
+        n--;
+    }
+
+    // All exclusion conditions are satisfied
+    return false;
+}
 
-                // All conditions is satisfied.
-                if (n == 0)
-                    ret = DECODE_FAILURE;
+namespace {
+
+/**
+ * Lookup table of the encodings an instruction can match, indexed by bits 20-27 and 4-7 of the
+ * instruction. Each bucket lists, in table order, the arm_instruction entries whose fixed bits
+ * don't contradict the bucket's key bits, so decoding only has to test a handful of candidates
+ * while still returning the same (first) match as a search over the whole table.
+ */
+class DecodeTable {
+public:
+    DecodeTable();
+
+    /// Returns the index of the first encoding matching the instruction, or -1 if none does
+    int Decode(u32 instr) const {
+        const u32 key = GetKey(instr);
+        for (u32 i = bucket_start[key]; i < bucket_start[key + 1]; ++i) {
+            if (MatchesEncoding(candidates[i], instr))
+                return candidates[i];
+        }
+        return -1;
+    }
+
+private:
+    static const u32 KEY_INSTR_MASK = 0x0FF000F0;
+    static const u32 NUM_BUCKETS = 1 << 12;
+
+    static u32 GetKey(u32 instr) {
+        return ((instr >> 16) & 0xFF0) | ((instr >> 4) & 0xF);
+    }
+
+    /// Inverse of GetKey, with all other bits cleared
+    static u32 GetKeyBits(u32 key) {
+        return ((key & 0xFF0) << 16) | ((key & 0xF) << 4);
+    }
+
+    /// First candidate of each bucket, the candidates of bucket i end where bucket i+1 starts
+    std::array<u32, NUM_BUCKETS + 1> bucket_start;
+    std::vector<u16> candidates;
+};
+
+DecodeTable::DecodeTable() {
+    const int instr_slots = sizeof(arm_instruction) / sizeof(ISEITEM);
+
+    // Compute which key bits each encoding requires to be set or cleared
+    std::vector<u32> required_mask(instr_slots);
+    std::vector<u32> required_bits(instr_slots);
+    std::vector<bool> satisfiable(instr_slots, true);
+    for (int i = 0; i < instr_slots; ++i) {
+        const ISEITEM& item = arm_instruction[i];
+        for (int field = 0; field < item.attribute_value; ++field) {
+            const u32 lo = item.content[field * 3];
+            const u32 hi = item.content[field * 3 + 1];
+            const u32 value = item.content[field * 3 + 2];
+            for (u32 bit = lo; bit <= hi; ++bit) {
+                if (!(KEY_INSTR_MASK & (1U << bit)))
+                    continue;
+
+                const u32 bit_value = ((value >> (bit - lo)) & 1) << bit;
+                if ((required_mask[i] & (1U << bit)) && (required_bits[i] & (1U << bit)) != bit_value)
+                    satisfiable[i] = false;
+                required_mask[i] |= 1U << bit;
+                required_bits[i] |= bit_value;
             }
         }
+    }
 
-        if (ret == DECODE_SUCCESS) {
-            *idx = i;
-            return ret;
+    for (u32 key = 0; key < NUM_BUCKETS; ++key) {
+        bucket_start[key] = static_cast<u32>(candidates.size());
+        const u32 key_bits = GetKeyBits(key);
+        for (int i = 0; i < instr_slots; ++i) {
+            if (satisfiable[i] && (key_bits & required_mask[i]) == required_bits[i])
+                candidates.push_back(static_cast<u16>(i));
         }
     }
-    return ret;
+    bucket_start[NUM_BUCKETS] = static_cast<u32>(candidates.size());
+}
+
+} // namespace
+
+int decode_arm_instr(uint32_t instr, int32_t *idx) {
+    static const DecodeTable table;
+
+    const int index = table.Decode(instr);
+    if (index < 0)
+        return DECODE_FAILURE;
+
+    *idx = index;
+    return DECODE_SUCCESS;
 }
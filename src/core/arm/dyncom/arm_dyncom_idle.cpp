@@ -0,0 +1,162 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "common/assert.h"
+
+#include "core/arm/dyncom/arm_dyncom_idle.h"
+
+// Resources an instruction can read or write. Bits 0-14 are the registers r0-r14; the PC is left
+// out, an instruction reading it always gets the same value.
+static const u32 FLAG_N = 1 << 16;
+static const u32 FLAG_Z = 1 << 17;
+static const u32 FLAG_C = 1 << 18;
+static const u32 FLAG_V = 1 << 19;
+
+static u32 Bits(u32 inst, int high, int low) {
+    return (inst >> low) & ((1 << (high - low + 1)) - 1);
+}
+
+static bool Bit(u32 inst, int bit) {
+    return ((inst >> bit) & 1) != 0;
+}
+
+static u32 RegisterMask(u32 reg) {
+    return reg == 15 ? 0 : 1 << reg;
+}
+
+/// Returns the flags that a condition code depends on
+static u32 ConditionFlags(u32 cond) {
+    static const u32 flags[15] = {
+        FLAG_Z, FLAG_Z,                            // EQ, NE
+        FLAG_C, FLAG_C,                            // CS, CC
+        FLAG_N, FLAG_N,                            // MI, PL
+        FLAG_V, FLAG_V,                            // VS, VC
+        FLAG_C | FLAG_Z, FLAG_C | FLAG_Z,          // HI, LS
+        FLAG_N | FLAG_V, FLAG_N | FLAG_V,          // GE, LT
+        FLAG_N | FLAG_Z | FLAG_V, FLAG_N | FLAG_Z | FLAG_V, // GT, LE
+        0,                                         // AL
+    };
+    DEBUG_ASSERT(cond < 15);
+    return flags[cond];
+}
+
+/**
+ * Determines the resources read and written by an instruction, if it's one that can be part of an
+ * idle loop: a data-processing instruction or a load without writeback, not writing the PC.
+ * @return false if the instruction can't be part of an idle loop
+ */
+static bool AnalyzeInstruction(u32 inst, u32& reads, u32& writes) {
+    const u32 cond = Bits(inst, 31, 28);
+    if (cond == 0xF)
+        return false;
+
+    reads = 0;
+    writes = 0;
+
+    const bool immediate = Bit(inst, 25);
+    const u32 rn = Bits(inst, 19, 16);
+    const u32 rd = Bits(inst, 15, 12);
+    const u32 rm = Bits(inst, 3, 0);
+    if (rd == 15)
+        return false;
+
+    if (Bits(inst, 27, 25) == 0 && Bit(inst, 7) && Bit(inst, 4)) {
+        // Multiplies and the halfword and signed byte loads and stores. Only accept the loads
+        // with offset addressing, LDRD and the stores have the L bit clear.
+        if (Bits(inst, 6, 5) == 0 || !Bit(inst, 20) || !Bit(inst, 24) || Bit(inst, 21))
+            return false;
+        reads = RegisterMask(rn) | (Bit(inst, 22) ? 0 : RegisterMask(rm));
+        writes = RegisterMask(rd);
+    } else if (Bits(inst, 27, 26) == 0) {
+        // Data-processing
+        const u32 opcode = Bits(inst, 24, 21);
+        const bool set_flags = Bit(inst, 20);
+        const bool is_compare = opcode >= 8 && opcode <= 11;
+        const bool is_logical = opcode <= 1 || (opcode >= 8 && opcode <= 9) || opcode >= 12;
+
+        // The compare opcodes without the S bit encode miscellaneous instructions
+        if (is_compare && !set_flags)
+            return false;
+
+        bool carry_out_may_be_unchanged = false;
+        if (immediate) {
+            // The carry of a rotated immediate is only produced if the rotation isn't 0
+            carry_out_may_be_unchanged = Bits(inst, 11, 8) == 0;
+        } else {
+            reads |= RegisterMask(rm);
+            if (Bit(inst, 4)) {
+                // Shift by register, which can be 0 at run time
+                reads |= RegisterMask(Bits(inst, 11, 8));
+                carry_out_may_be_unchanged = true;
+            } else {
+                const u32 shift_type = Bits(inst, 6, 5);
+                const u32 shift_amount = Bits(inst, 11, 7);
+                if (shift_type == 3 && shift_amount == 0)
+                    reads |= FLAG_C; // RRX
+                carry_out_may_be_unchanged = shift_type == 0 && shift_amount == 0;
+            }
+        }
+
+        if (opcode != 13 && opcode != 15) // MOV and MVN have no first operand
+            reads |= RegisterMask(rn);
+        if (opcode >= 5 && opcode <= 7) // ADC, SBC and RSC
+            reads |= FLAG_C;
+        if (!is_compare)
+            writes |= RegisterMask(rd);
+
+        if (set_flags) {
+            if (!is_logical) {
+                writes |= FLAG_N | FLAG_Z | FLAG_C | FLAG_V;
+            } else {
+                writes |= FLAG_N | FLAG_Z | FLAG_C;
+                // A flag that may keep its value carries it over from the previous iteration
+                if (carry_out_may_be_unchanged)
+                    reads |= FLAG_C;
+            }
+        }
+    } else if (Bits(inst, 27, 26) == 1) {
+        // Word and unsigned byte loads and stores. Only accept loads with offset addressing.
+        if (immediate && Bit(inst, 4))
+            return false; // Media instructions
+        if (!Bit(inst, 20) || !Bit(inst, 24) || Bit(inst, 21))
+            return false;
+        reads = RegisterMask(rn);
+        if (immediate) {
+            reads |= RegisterMask(rm);
+            if (Bits(inst, 6, 5) == 3 && Bits(inst, 11, 7) == 0)
+                reads |= FLAG_C; // RRX
+        }
+        writes = RegisterMask(rd);
+    } else {
+        return false;
+    }
+
+    // A conditional instruction may leave its destinations unchanged
+    if (cond != 0xE)
+        reads |= ConditionFlags(cond) | writes;
+
+    return true;
+}
+
+bool IsIdleLoop(const u32* body, size_t count, u32 branch_cond) {
+    if (count > MAX_IDLE_LOOP_INSTRUCTIONS || branch_cond == 0xF)
+        return false;
+
+    u32 written = 0;
+    // Resources read before they are written in an iteration, i.e. carried over from the last one
+    u32 carried = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        u32 reads, writes;
+        if (!AnalyzeInstruction(body[i], reads, writes))
+            return false;
+
+        carried |= reads & ~written;
+        written |= writes;
+    }
+    carried |= ConditionFlags(branch_cond) & ~written;
+
+    // Iterations only repeat themselves if nothing they change feeds into the next one
+    return (carried & written) == 0;
+}
@@ -0,0 +1,28 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstddef>
+
+#include "common/common_types.h"
+
+/// Longest loop body, in instructions, that is checked for being an idle loop
+static const size_t MAX_IDLE_LOOP_INSTRUCTIONS = 8;
+
+/**
+ * Checks whether a block that branches back to its own start is an idle loop: a loop that only
+ * loads from memory and computes on the loaded values, without carrying any register or flag from
+ * one iteration into the next. This is what polling a memory location looks like. Every iteration
+ * then does exactly the same as the previous one until something outside of the CPU changes
+ * memory, which can only happen in a CoreTiming event, so the CPU can skip straight to the next
+ * event without changing the outcome.
+ *
+ * @param body ARM encodings of the instructions before the closing branch. Thumb instructions
+ *             have to be translated to their ARM equivalents.
+ * @param count Number of instructions in body, at most MAX_IDLE_LOOP_INSTRUCTIONS
+ * @param branch_cond Condition code of the closing branch
+ * @return true if the block is an idle loop
+ */
+bool IsIdleLoop(const u32* body, size_t count, u32 branch_cond);
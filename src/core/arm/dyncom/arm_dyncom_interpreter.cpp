@@ -5,17 +5,31 @@
 #define CITRA_IGNORE_EXIT(x)
 
 #include <algorithm>
+#include <array>
 #include <cstdio>
+#include <cstring>
 
+#include "common/assert.h"
 #include "common/logging/log.h"
 #include "common/profiler.h"
+#include "common/thread.h"
 
+#include "core/block_list.h"
+#include "core/breakpoints.h"
+#include "core/core.h"
+#include "core/core_timing.h"
 #include "core/memory.h"
+#include "core/settings.h"
+#include "core/hle/function_hooks.h"
 #include "core/hle/svc.h"
+#include "core/arm/arm_interface.h"
 #include "core/arm/disassembler/arm_disasm.h"
 #include "core/arm/dyncom/arm_dyncom_dec.h"
+#include "core/arm/dyncom/arm_dyncom_idle.h"
 #include "core/arm/dyncom/arm_dyncom_interpreter.h"
+#include "core/arm/dyncom/arm_dyncom_profile.h"
 #include "core/arm/dyncom/arm_dyncom_thumb.h"
+#include "core/arm/dyncom/arm_dyncom_trans_cache.h"
 #include "core/arm/dyncom/arm_dyncom_run.h"
 #include "core/arm/skyeye_common/armdefs.h"
 #include "core/arm/skyeye_common/armmmu.h"
@@ -69,65 +83,33 @@ static void remove_exclusive(ARMul_State* state, ARMword addr){
     state->exclusive_tag = 0xFFFFFFFF;
 }
 
-static int CondPassed(ARMul_State* cpu, unsigned int cond) {
-    const u32 NFLAG = cpu->NFlag;
-    const u32 ZFLAG = cpu->ZFlag;
-    const u32 CFLAG = cpu->CFlag;
-    const u32 VFLAG = cpu->VFlag;
-
-    int temp = 0;
+/**
+ * Outcome of each condition for every combination of the flags. Bit n of the entry of a condition
+ * is set if the condition passes when the NZCV flags, read as a 4-bit number, are n.
+ */
+static const u16 condition_table[16] = {
+    0xF0F0, // EQ
+    0x0F0F, // NE
+    0xCCCC, // CS
+    0x3333, // CC
+    0xFF00, // MI
+    0x00FF, // PL
+    0xAAAA, // VS
+    0x5555, // VC
+    0x0C0C, // HI
+    0xF3F3, // LS
+    0xAA55, // GE
+    0x55AA, // LT
+    0x0A05, // GT
+    0xF5FA, // LE
+    0xFFFF, // AL
+    0xFFFF, // NV, treated like AL
+};
 
-    switch (cond) {
-    case 0x0:
-        temp = ZFLAG;
-        break;
-    case 0x1: // NE
-        temp = !ZFLAG;
-        break;
-    case 0x2: // CS
-        temp = CFLAG;
-        break;
-    case 0x3: // CC
-        temp = !CFLAG;
-        break;
-    case 0x4: // MI
-        temp = NFLAG;
-        break;
-    case 0x5: // PL
-        temp = !NFLAG;
-        break;
-    case 0x6: // VS
-        temp = VFLAG;
-        break;
-    case 0x7: // VC
-        temp = !VFLAG;
-        break;
-    case 0x8: // HI
-        temp = (CFLAG && !ZFLAG);
-        break;
-    case 0x9: // LS
-        temp = (!CFLAG || ZFLAG);
-        break;
-    case 0xa: // GE
-        temp = ((!NFLAG && !VFLAG) || (NFLAG && VFLAG));
-        break;
-    case 0xb: // LT
-        temp = ((NFLAG && !VFLAG) || (!NFLAG && VFLAG));
-        break;
-    case 0xc: // GT
-        temp = ((!NFLAG && !VFLAG && !ZFLAG) || (NFLAG && VFLAG && !ZFLAG));
-        break;
-    case 0xd: // LE
-        temp = ((NFLAG && !VFLAG) || (!NFLAG && VFLAG)) || ZFLAG;
-        break;
-    case 0xe: // AL
-        temp = 1;
-        break;
-    case 0xf:
-        temp = 1;
-        break;
-    }
-    return temp;
+static inline int CondPassed(ARMul_State* cpu, unsigned int cond) {
+    // The flags are always 0 or 1
+    const unsigned flags = (cpu->NFlag << 3) | (cpu->ZFlag << 2) | (cpu->CFlag << 1) | cpu->VFlag;
+    return (condition_table[cond] >> flags) & 1;
 }
 
 static unsigned int DPO(Immediate)(ARMul_State* cpu, unsigned int sht_oper) {
@@ -287,8 +269,12 @@ static unsigned int DPO(RotateRightByRegister)(ARMul_State* cpu, unsigned int sh
 typedef void (*get_addr_fp_t)(ARMul_State *cpu, unsigned int inst, unsigned int &virt_addr);
 
 struct ldst_inst {
+    union {
+        get_addr_fp_t get_addr;
+        /// Signed offset of the specialized immediate offset form
+        u32 offset;
+    };
     unsigned int inst;
-    get_addr_fp_t get_addr;
 };
 #define DEBUG_MSG LOG_DEBUG(Core_ARM11, "inst is %x", inst); CITRA_IGNORE_EXIT(0)
 
@@ -707,13 +693,20 @@ static void LnSWoUB(ScaledRegisterOffset)(ARMul_State* cpu, unsigned int inst, u
     virt_addr = addr;
 }
 
+/// Header of every instruction cream, followed by the instruction's own operands
 struct arm_inst {
-    unsigned int idx;
-    unsigned int cond;
-    int br;
+    u16 idx;
+    u8 cond;
+    u8 br;
     char component[0];
 };
 
+/// Precedes the creams of every translated block
+struct block_header {
+    /// Number of instructions in the block, accounted for as a whole when entering the block
+    unsigned int num_instrs;
+};
+
 struct generic_arm_inst {
     u32 Ra;
     u32 Rm;
@@ -723,56 +716,67 @@ struct generic_arm_inst {
     u8 op2;
 };
 
+// The data processing creams are the most common ones, their operands are packed into 16 bytes
 struct adc_inst {
-    unsigned int I;
-    unsigned int S;
-    unsigned int Rn;
-    unsigned int Rd;
-    unsigned int shifter_operand;
     shtop_fp_t shtop_func;
+    u16 shifter_operand;
+    u8 I;
+    u8 S;
+    u8 Rn;
+    u8 Rd;
 };
 
 struct add_inst {
-    unsigned int I;
-    unsigned int S;
-    unsigned int Rn;
-    unsigned int Rd;
-    unsigned int shifter_operand;
-    shtop_fp_t shtop_func;
+    union {
+        shtop_fp_t shtop_func;
+        /// Second operand of the specialized immediate form, already rotated
+        u32 immediate;
+    };
+    u16 shifter_operand;
+    u8 I;
+    u8 S;
+    u8 Rn;
+    u8 Rd;
 };
 
 struct orr_inst {
-    unsigned int I;
-    unsigned int S;
-    unsigned int Rn;
-    unsigned int Rd;
-    unsigned int shifter_operand;
-    shtop_fp_t shtop_func;
+    union {
+        shtop_fp_t shtop_func;
+        u32 immediate;
+    };
+    u16 shifter_operand;
+    u8 I;
+    u8 S;
+    u8 Rn;
+    u8 Rd;
 };
 
 struct and_inst {
-    unsigned int I;
-    unsigned int S;
-    unsigned int Rn;
-    unsigned int Rd;
-    unsigned int shifter_operand;
-    shtop_fp_t shtop_func;
+    union {
+        shtop_fp_t shtop_func;
+        u32 immediate;
+    };
+    u16 shifter_operand;
+    u8 I;
+    u8 S;
+    u8 Rn;
+    u8 Rd;
 };
 
 struct eor_inst {
-    unsigned int I;
-    unsigned int S;
-    unsigned int Rn;
-    unsigned int Rd;
-    unsigned int shifter_operand;
     shtop_fp_t shtop_func;
+    u16 shifter_operand;
+    u8 I;
+    u8 S;
+    u8 Rn;
+    u8 Rd;
 };
 
 struct bbl_inst {
-    unsigned int L;
     int signed_immed_24;
-    unsigned int next_addr;
-    unsigned int jmp_addr;
+    BlockLink link;
+    u8 L;
+    bool idle_loop; ///< Whether the branch closes an idle loop, see IsIdleLoop
 };
 
 struct bx_inst {
@@ -809,44 +813,47 @@ struct cpy_inst {
 };
 
 struct bic_inst {
-    unsigned int I;
-    unsigned int S;
-    unsigned int Rn;
-    unsigned int Rd;
-    unsigned int shifter_operand;
     shtop_fp_t shtop_func;
+    u16 shifter_operand;
+    u8 I;
+    u8 S;
+    u8 Rn;
+    u8 Rd;
 };
 
 struct sub_inst {
-    unsigned int I;
-    unsigned int S;
-    unsigned int Rn;
-    unsigned int Rd;
-    unsigned int shifter_operand;
-    shtop_fp_t shtop_func;
+    union {
+        shtop_fp_t shtop_func;
+        u32 immediate;
+    };
+    u16 shifter_operand;
+    u8 I;
+    u8 S;
+    u8 Rn;
+    u8 Rd;
 };
 
 struct tst_inst {
-    unsigned int I;
-    unsigned int S;
-    unsigned int Rn;
-    unsigned int Rd;
-    unsigned int shifter_operand;
     shtop_fp_t shtop_func;
+    u16 shifter_operand;
+    u8 I;
+    u8 S;
+    u8 Rn;
+    u8 Rd;
 };
 
 struct cmn_inst {
-    unsigned int I;
-    unsigned int Rn;
-    unsigned int shifter_operand;
     shtop_fp_t shtop_func;
+    u16 shifter_operand;
+    u8 I;
+    u8 Rn;
 };
 
 struct teq_inst {
-    unsigned int I;
-    unsigned int Rn;
-    unsigned int shifter_operand;
     shtop_fp_t shtop_func;
+    u16 shifter_operand;
+    u8 I;
+    u8 Rn;
 };
 
 struct stm_inst {
@@ -868,26 +875,32 @@ struct swi_inst {
 };
 
 struct cmp_inst {
-    unsigned int I;
-    unsigned int Rn;
-    unsigned int shifter_operand;
-    shtop_fp_t shtop_func;
+    union {
+        shtop_fp_t shtop_func;
+        u32 immediate;
+    };
+    u16 shifter_operand;
+    u8 I;
+    u8 Rn;
 };
 
 struct mov_inst {
-    unsigned int I;
-    unsigned int S;
-    unsigned int Rd;
-    unsigned int shifter_operand;
-    shtop_fp_t shtop_func;
+    union {
+        shtop_fp_t shtop_func;
+        u32 immediate;
+    };
+    u16 shifter_operand;
+    u8 I;
+    u8 S;
+    u8 Rd;
 };
 
 struct mvn_inst {
-    unsigned int I;
-    unsigned int S;
-    unsigned int Rd;
-    unsigned int shifter_operand;
     shtop_fp_t shtop_func;
+    u16 shifter_operand;
+    u8 I;
+    u8 S;
+    u8 Rd;
 };
 
 struct rev_inst {
@@ -898,30 +911,30 @@ struct rev_inst {
 };
 
 struct rsb_inst {
-    unsigned int I;
-    unsigned int S;
-    unsigned int Rn;
-    unsigned int Rd;
-    unsigned int shifter_operand;
     shtop_fp_t shtop_func;
+    u16 shifter_operand;
+    u8 I;
+    u8 S;
+    u8 Rn;
+    u8 Rd;
 };
 
 struct rsc_inst {
-    unsigned int I;
-    unsigned int S;
-    unsigned int Rn;
-    unsigned int Rd;
-    unsigned int shifter_operand;
     shtop_fp_t shtop_func;
+    u16 shifter_operand;
+    u8 I;
+    u8 S;
+    u8 Rn;
+    u8 Rd;
 };
 
 struct sbc_inst {
-    unsigned int I;
-    unsigned int S;
-    unsigned int Rn;
-    unsigned int Rd;
-    unsigned int shifter_operand;
     shtop_fp_t shtop_func;
+    u16 shifter_operand;
+    u8 I;
+    u8 S;
+    u8 Rn;
+    u8 Rd;
 };
 
 struct mul_inst {
@@ -1140,10 +1153,13 @@ struct setend_inst {
 
 struct b_2_thumb {
     unsigned int imm;
+    BlockLink link;
+    bool idle_loop;
 };
 struct b_cond_thumb {
     unsigned int imm;
-    unsigned int cond;
+    u8 cond;
+    bool idle_loop;
 };
 
 struct bl_1_thumb {
@@ -1166,17 +1182,11 @@ struct pkh_inst {
 
 typedef arm_inst * ARM_INST_PTR;
 
-#define CACHE_BUFFER_SIZE    (64 * 1024 * 2000)
-static char inst_buf[CACHE_BUFFER_SIZE];
-static int top = 0;
+/// Cache of the core whose block is being translated on this thread, the creams are allocated in it
+static thread_local TranslationCache* translating_cache = nullptr;
+
 static inline void *AllocBuffer(unsigned int size) {
-    int start = top;
-    top += size;
-    if (top > CACHE_BUFFER_SIZE) {
-        LOG_ERROR(Core_ARM11, "inst_buf is full");
-        CITRA_IGNORE_EXIT(-1);
-    }
-    return (void *)&inst_buf[start];
+    return translating_cache->Allocate(size);
 }
 
 static shtop_fp_t get_shtop(unsigned int inst) {
@@ -1331,6 +1341,8 @@ static ARM_INST_PTR INTERPRETER_TRANSLATE(bbl)(unsigned int inst, int index)
 
     inst_cream->L      = BIT(inst, 24);
     inst_cream->signed_immed_24 = BIT(inst, 23) ? NEGBRANCH : POSBRANCH;
+    TranslationCache::ResetLink(inst_cream->link);
+    inst_cream->idle_loop = false;
 
     return inst_base;
 }
@@ -3089,6 +3101,8 @@ static ARM_INST_PTR INTERPRETER_TRANSLATE(b_2_thumb)(unsigned int tinst, int ind
     b_2_thumb *inst_cream = (b_2_thumb *)inst_base->component;
 
     inst_cream->imm = ((tinst & 0x3FF) << 1) | ((tinst & (1 << 10)) ? 0xFFFFF800 : 0);
+    TranslationCache::ResetLink(inst_cream->link);
+    inst_cream->idle_loop = false;
 
     inst_base->idx = index;
     inst_base->br  = DIRECT_BRANCH;
@@ -3103,6 +3117,7 @@ static ARM_INST_PTR INTERPRETER_TRANSLATE(b_cond_thumb)(unsigned int tinst, int
 
     inst_cream->imm  = (((tinst & 0x7F) << 1) | ((tinst & (1 << 7)) ?    0xFFFFFF00 : 0));
     inst_cream->cond = ((tinst >> 8) & 0xf);
+    inst_cream->idle_loop = false;
     inst_base->idx   = index;
     inst_base->br    = DIRECT_BRANCH;
 
@@ -3485,6 +3500,216 @@ const transop_fp_t arm_instruction_trans[] = {
     INTERPRETER_TRANSLATE(blx_1_thumb)
 };
 
+static const unsigned NUM_INSTRUCTION_CLASSES = sizeof(arm_instruction_trans) / sizeof(arm_instruction_trans[0]);
+
+// The decoder table doesn't have entries for the Thumb branch variants
+static const char* const thumb_instruction_names[] = {
+    "b_2_thumb", "b_cond_thumb", "bl_1_thumb", "bl_2_thumb", "blx_1_thumb"
+};
+static const unsigned NUM_THUMB_INSTRUCTION_CLASSES = sizeof(thumb_instruction_names) / sizeof(thumb_instruction_names[0]);
+
+/**
+ * Superinstructions the translator substitutes for the first instruction of a frequent pair. The
+ * fused handler performs the first instruction and jumps straight to the handler of the second
+ * one, saving an indirect dispatch. Compare-and-branch pairs end most loops and conditionals, and
+ * are the pairs the execution profile counts most often.
+ */
+struct FusedInstruction {
+    const char* name;
+    /// Class of the instruction replaced, which has to be followed by a (conditional) branch
+    const char* first;
+};
+
+// Same order as the fused handlers in InstLabel
+static const FusedInstruction fused_instructions[] = {
+    { "cmp+b", "cmp" },
+    { "tst+b", "tst" },
+};
+static const unsigned NUM_FUSED_INSTRUCTION_CLASSES = sizeof(fused_instructions) / sizeof(fused_instructions[0]);
+
+// The fused handlers follow those of DISPATCH, INIT_INST_LENGTH and END
+static const unsigned FIRST_FUSED_INDEX = NUM_INSTRUCTION_CLASSES + 3;
+
+/// Operand forms the translator has specialized handlers for
+enum class OperandForm {
+    /// Data processing with an immediate, load/store with an immediate offset
+    Immediate,
+    /// Data processing with an unshifted register, load/store with an added register offset
+    Register,
+};
+
+typedef bool (*specialize_fp_t)(void* component, OperandForm form);
+
+/**
+ * Handlers specialized by operand form, which the translator substitutes for the generic handlers
+ * of the most common data processing and load/store instructions. The generic handlers compute
+ * their second operand or address through a function pointer, the specialized ones read an
+ * immediate rotated at translate time or a register directly. Only the forms that don't involve
+ * the PC or the shifter carry out are specialized.
+ */
+struct SpecializedInstruction {
+    const char* name;
+    /// Class of the generic instruction replaced
+    const char* generic;
+    OperandForm form;
+    /// Checks the operands of a generic cream, and rewrites them for the specialized handler
+    specialize_fp_t specialize;
+};
+
+// Specializes a data processing cream. The shifter carry out is only needed by the logical
+// instructions setting the flags, and is the C flag unless the immediate is rotated.
+template <typename T>
+static bool SpecializeShifterOperand(T* inst_cream, OperandForm form, bool needs_carry) {
+    const unsigned int sht_oper = inst_cream->shifter_operand;
+    if (form == OperandForm::Register)
+        return !inst_cream->I && BITS(sht_oper, 4, 11) == 0 && RM != 15;
+
+    const unsigned int rotate_imm = BITS(sht_oper, 8, 11);
+    if (!inst_cream->I || (needs_carry && rotate_imm != 0))
+        return false;
+    const unsigned int immed_8 = BITS(sht_oper, 0, 7);
+    inst_cream->immediate = ROTATE_RIGHT_32(immed_8, rotate_imm * 2);
+    return true;
+}
+
+template <typename T>
+static bool SpecializeArithmetic(void* component, OperandForm form) {
+    T* inst_cream = (T*)component;
+    return inst_cream->Rn != 15 && inst_cream->Rd != 15 && SpecializeShifterOperand(inst_cream, form, false);
+}
+
+template <typename T>
+static bool SpecializeLogical(void* component, OperandForm form) {
+    T* inst_cream = (T*)component;
+    return inst_cream->Rn != 15 && inst_cream->Rd != 15 &&
+           SpecializeShifterOperand(inst_cream, form, inst_cream->S != 0);
+}
+
+static bool SpecializeCmp(void* component, OperandForm form) {
+    cmp_inst* inst_cream = (cmp_inst*)component;
+    return inst_cream->Rn != 15 && SpecializeShifterOperand(inst_cream, form, false);
+}
+
+static bool SpecializeMov(void* component, OperandForm form) {
+    mov_inst* inst_cream = (mov_inst*)component;
+    return inst_cream->Rd != 15 && SpecializeShifterOperand(inst_cream, form, inst_cream->S != 0);
+}
+
+// Specializes the offset addressing of a load/store without writeback. Negative register offsets
+// are rare and left to the generic handler.
+static bool SpecializeLoadStore(void* component, OperandForm form) {
+    ldst_inst* inst_cream = (ldst_inst*)component;
+    const unsigned int inst = inst_cream->inst;
+    if (BITS(inst, 16, 19) == 15 || BITS(inst, 12, 15) == 15 || W_BIT)
+        return false;
+    if (form == OperandForm::Register)
+        return BITS(inst, 24, 27) == 7 && U_BIT && BITS(inst, 4, 11) == 0 && BITS(inst, 0, 3) != 15;
+
+    if (BITS(inst, 24, 27) != 5)
+        return false;
+    inst_cream->offset = U_BIT ? OFFSET_12 : 0 - OFFSET_12;
+    return true;
+}
+
+// Same order as the specialized handlers in InstLabel
+static const SpecializedInstruction specialized_instructions[] = {
+    { "add_imm", "add", OperandForm::Immediate, SpecializeArithmetic<add_inst> },
+    { "add_reg", "add", OperandForm::Register, SpecializeArithmetic<add_inst> },
+    { "sub_imm", "sub", OperandForm::Immediate, SpecializeArithmetic<sub_inst> },
+    { "sub_reg", "sub", OperandForm::Register, SpecializeArithmetic<sub_inst> },
+    { "and_imm", "and", OperandForm::Immediate, SpecializeLogical<and_inst> },
+    { "and_reg", "and", OperandForm::Register, SpecializeLogical<and_inst> },
+    { "orr_imm", "orr", OperandForm::Immediate, SpecializeLogical<orr_inst> },
+    { "orr_reg", "orr", OperandForm::Register, SpecializeLogical<orr_inst> },
+    { "cmp_imm", "cmp", OperandForm::Immediate, SpecializeCmp },
+    { "cmp_reg", "cmp", OperandForm::Register, SpecializeCmp },
+    { "mov_imm", "mov", OperandForm::Immediate, SpecializeMov },
+    { "mov_reg", "mov", OperandForm::Register, SpecializeMov },
+    { "ldr_imm", "ldr", OperandForm::Immediate, SpecializeLoadStore },
+    { "ldr_reg", "ldr", OperandForm::Register, SpecializeLoadStore },
+    { "str_imm", "str", OperandForm::Immediate, SpecializeLoadStore },
+    { "str_reg", "str", OperandForm::Register, SpecializeLoadStore },
+    { "ldrb_imm", "ldrb", OperandForm::Immediate, SpecializeLoadStore },
+    { "ldrb_reg", "ldrb", OperandForm::Register, SpecializeLoadStore },
+    { "strb_imm", "strb", OperandForm::Immediate, SpecializeLoadStore },
+    { "strb_reg", "strb", OperandForm::Register, SpecializeLoadStore },
+};
+static const unsigned NUM_SPECIALIZED_INSTRUCTION_CLASSES = sizeof(specialized_instructions) / sizeof(specialized_instructions[0]);
+
+// The specialized handlers follow the fused ones
+static const unsigned FIRST_SPECIALIZED_INDEX = FIRST_FUSED_INDEX + NUM_FUSED_INSTRUCTION_CLASSES;
+
+static_assert(FIRST_SPECIALIZED_INDEX + NUM_SPECIALIZED_INSTRUCTION_CLASSES <= ExecutionProfile::MAX_INSTRUCTION_CLASSES,
+              "The execution profile can't count all instruction classes");
+
+unsigned GetInstructionClassCount() {
+    return FIRST_SPECIALIZED_INDEX + NUM_SPECIALIZED_INSTRUCTION_CLASSES;
+}
+
+const char* GetInstructionClassName(unsigned index) {
+    ASSERT(index < GetInstructionClassCount());
+    if (index >= FIRST_SPECIALIZED_INDEX)
+        return specialized_instructions[index - FIRST_SPECIALIZED_INDEX].name;
+    if (index >= FIRST_FUSED_INDEX)
+        return fused_instructions[index - FIRST_FUSED_INDEX].name;
+    if (index >= NUM_INSTRUCTION_CLASSES)
+        return "";
+    const unsigned first_thumb_index = NUM_INSTRUCTION_CLASSES - NUM_THUMB_INSTRUCTION_CLASSES;
+    if (index >= first_thumb_index)
+        return thumb_instruction_names[index - first_thumb_index];
+    return arm_instruction[index].name;
+}
+
+static unsigned FindInstructionClass(const char* name) {
+    for (unsigned i = 0; i < NUM_INSTRUCTION_CLASSES; ++i) {
+        if (std::strcmp(GetInstructionClassName(i), name) == 0)
+            return i;
+    }
+    UNREACHABLE();
+}
+
+/// Replaces the first instruction of a pair by a superinstruction, if the pair can be fused
+static void FuseInstructions(ARM_INST_PTR first, ARM_INST_PTR second) {
+    static const unsigned bbl_index = FindInstructionClass("bbl");
+    static const unsigned b_cond_thumb_index = FindInstructionClass("b_cond_thumb");
+    static const std::array<unsigned, NUM_FUSED_INSTRUCTION_CLASSES> first_indices = [] {
+        std::array<unsigned, NUM_FUSED_INSTRUCTION_CLASSES> indices;
+        for (unsigned i = 0; i < NUM_FUSED_INSTRUCTION_CLASSES; ++i)
+            indices[i] = FindInstructionClass(fused_instructions[i].first);
+        return indices;
+    }();
+
+    if (second->idx != bbl_index && second->idx != b_cond_thumb_index)
+        return;
+    for (unsigned i = 0; i < NUM_FUSED_INSTRUCTION_CLASSES; ++i) {
+        if (first->idx == first_indices[i]) {
+            first->idx = FIRST_FUSED_INDEX + i;
+            return;
+        }
+    }
+}
+
+/**
+ * Substitutes the handler specialized for the operand form of an instruction, if there is one.
+ * Done once the instruction had its chance to be fused, the fused handlers use the generic creams.
+ */
+static void SpecializeOperands(ARM_INST_PTR inst_base) {
+    static const std::array<unsigned, NUM_SPECIALIZED_INSTRUCTION_CLASSES> generic_indices = [] {
+        std::array<unsigned, NUM_SPECIALIZED_INSTRUCTION_CLASSES> indices;
+        for (unsigned i = 0; i < NUM_SPECIALIZED_INSTRUCTION_CLASSES; ++i)
+            indices[i] = FindInstructionClass(specialized_instructions[i].generic);
+        return indices;
+    }();
+
+    for (unsigned i = 0; i < NUM_SPECIALIZED_INSTRUCTION_CLASSES; ++i) {
+        const SpecializedInstruction& specialized = specialized_instructions[i];
+        if (inst_base->idx == generic_indices[i] && specialized.specialize(inst_base->component, specialized.form)) {
+            inst_base->idx = FIRST_SPECIALIZED_INDEX + i;
+            return;
+        }
+    }
+}
+
 enum {
     FETCH_SUCCESS,
     FETCH_FAILURE
@@ -3544,15 +3769,89 @@ static tdstate decode_thumb_instr(u32 inst, u32 addr, u32* arm_inst, u32* inst_s
     return ret;
 }
 
+/// Result of decoding a Thumb halfword, which only depends on the halfword itself
+struct ThumbDecoding {
+    bool valid;
+    u8 state;         ///< tdstate returned by thumb_translate
+    u8 decode_status; ///< Result of decoding the equivalent ARM instruction
+    s16 idx;          ///< Instruction class of the equivalent ARM instruction
+    u32 arm_inst;     ///< Equivalent ARM instruction
+};
+
+/**
+ * Decodes a Thumb halfword, reusing the result of earlier translations of the same halfword. This
+ * skips both the Thumb to ARM conversion and the ARM decoding on every translation but the first.
+ */
+static const ThumbDecoding& DecodeThumbCached(u32 tinstr) {
+    static std::array<ThumbDecoding, 0x10000> cache;
+
+    ThumbDecoding& decoding = cache[tinstr & 0xFFFF];
+    if (!decoding.valid) {
+        u32 arm_inst;
+        u32 inst_size;
+        decoding.state = thumb_translate(0, tinstr & 0xFFFF, &arm_inst, &inst_size);
+        decoding.arm_inst = arm_inst;
+
+        int idx = 0;
+        if (decoding.state != t_branch) {
+            decoding.decode_status = decode_arm_instr(arm_inst, &idx);
+        } else {
+            decoding.decode_status = DECODE_SUCCESS;
+        }
+        decoding.idx = static_cast<s16>(idx);
+        decoding.valid = true;
+    }
+    return decoding;
+}
+
 enum {
     KEEP_GOING,
-    FETCH_EXCEPTION
+    FETCH_EXCEPTION,
+    /// The block starts at a breakpoint, the CPU stops before executing it
+    BREAKPOINT
 };
 
 typedef struct instruction_set_encoding_item ISEITEM;
 
 extern const ISEITEM arm_instruction[];
 
+/**
+ * Flags the branch ending a block if the block is an idle loop, see IsIdleLoop.
+ * @param branch Cream of the last instruction of the block
+ * @param thumb Whether the block is Thumb code
+ * @param branch_inst ARM encoding of the last instruction, unused in Thumb code
+ * @param branch_addr Guest address of the last instruction
+ * @param block_start Guest address of the block
+ * @param body ARM encodings of the instructions before the last one
+ * @param body_size Number of instructions before the last one
+ */
+static void DetectIdleLoop(ARM_INST_PTR branch, bool thumb, u32 branch_inst, u32 branch_addr,
+                           u32 block_start, const u32* body, size_t body_size) {
+    if (body_size > MAX_IDLE_LOOP_INSTRUCTIONS)
+        return;
+
+    // The Thumb branches are the last entries of the translation table
+    const unsigned b_2_thumb_index = NUM_INSTRUCTION_CLASSES - NUM_THUMB_INSTRUCTION_CLASSES;
+    const unsigned b_cond_thumb_index = b_2_thumb_index + 1;
+
+    if (thumb) {
+        if (branch->idx == b_2_thumb_index) {
+            b_2_thumb* inst_cream = (b_2_thumb*)branch->component;
+            if (branch_addr + 4 + inst_cream->imm == block_start)
+                inst_cream->idle_loop = IsIdleLoop(body, body_size, 0xE);
+        } else if (branch->idx == b_cond_thumb_index) {
+            b_cond_thumb* inst_cream = (b_cond_thumb*)branch->component;
+            if (branch_addr + 4 + inst_cream->imm == block_start)
+                inst_cream->idle_loop = IsIdleLoop(body, body_size, inst_cream->cond);
+        }
+    } else if ((branch_inst & 0x0F000000) == 0x0A000000 && branch->cond != 0xF) {
+        // B, not BL or BLX
+        bbl_inst* inst_cream = (bbl_inst*)branch->component;
+        if (branch_addr + 8 + inst_cream->signed_immed_24 == block_start)
+            inst_cream->idle_loop = IsIdleLoop(body, body_size, branch->cond);
+    }
+}
+
 static int InterpreterTranslate(ARMul_State* cpu, int& bb_start, u32 addr) {
     Common::Profiling::ScopeTimer timer_decode(profile_decode);
 
@@ -3565,28 +3864,54 @@ static int InterpreterTranslate(ARMul_State* cpu, int& bb_start, u32 addr) {
     int idx;
     int ret = NON_BRANCH;
     int size = 0; // instruction size of basic block
-    bb_start = top;
+    // A block resuming from a breakpoint is executed once without being cached, so that the
+    // breakpoint is hit again the next time the code is reached
+    bool cacheable = true;
+    if (Breakpoints::HasCodeBreakpoint(addr)) {
+        if (!Breakpoints::ConsumeResume(addr))
+            return BREAKPOINT;
+        cacheable = false;
+    }
+    // A hooked routine is only translated when its host implementation declined a call, the next
+    // call has to go through the hook again
+    if (FunctionHooks::HasHook(addr))
+        cacheable = false;
+
+    TranslationCache& cache = *cpu->translation_cache;
+    translating_cache = &cache;
+    bb_start = cache.BeginBlock();
+    block_header* header = (block_header*)cache.Allocate(sizeof(block_header));
+    bb_start += sizeof(block_header);
 
     u32 phys_addr = addr;
     u32 pc_start = cpu->Reg[15];
 
+    // ARM encodings of the first instructions of the block, for the idle loop detection
+    std::array<u32, MAX_IDLE_LOOP_INSTRUCTIONS + 1> block_insts;
+    size_t num_insts = 0;
+    ARM_INST_PTR prev_inst_base = nullptr;
+
     while (ret == NON_BRANCH) {
         inst = Memory::Read32(phys_addr & 0xFFFFFFFC);
 
         size++;
         // If we are in thumb instruction, we will translate one thumb to one corresponding arm instruction
         if (cpu->TFlag) {
-            uint32_t arm_inst;
-            tdstate state = decode_thumb_instr(inst, phys_addr, &arm_inst, &inst_size, &inst_base);
+            const ThumbDecoding& decoding = DecodeThumbCached(get_thumb_instr(inst, phys_addr));
 
-            // We have translated the branch instruction of thumb in thumb decoder
-            if(state == t_branch){
+            // Thumb branches have no ARM equivalent and are translated by the thumb decoder
+            if (decoding.state == t_branch) {
+                uint32_t arm_inst;
+                decode_thumb_instr(inst, phys_addr, &arm_inst, &inst_size, &inst_base);
                 goto translated;
             }
-            inst = arm_inst;
+            inst = decoding.arm_inst;
+            inst_size = 2;
+            idx = decoding.idx;
+            ret = decoding.decode_status;
+        } else {
+            ret = decode_arm_instr(inst, &idx);
         }
-
-        ret = decode_arm_instr(inst, &idx);
         if (ret == DECODE_FAILURE) {
             std::string disasm = ARM_Disasm::Disassemble(phys_addr, inst);
             LOG_ERROR(Core_ARM11, "Decode failure.\tPC : [0x%x]\tInstruction : %s [%x]", phys_addr, disasm.c_str(), inst);
@@ -3595,19 +3920,85 @@ static int InterpreterTranslate(ARMul_State* cpu, int& bb_start, u32 addr) {
         }
         inst_base = arm_instruction_trans[idx](inst, idx);
 translated:
+        if (prev_inst_base != nullptr) {
+            FuseInstructions(prev_inst_base, inst_base);
+            SpecializeOperands(prev_inst_base);
+        }
+        prev_inst_base = inst_base;
+
+        if (num_insts < block_insts.size())
+            block_insts[num_insts] = inst;
+        ++num_insts;
         phys_addr += inst_size;
 
-        if ((phys_addr & 0xfff) == 0) {
+        // Blocks end before the instructions with a breakpoint as well as at the end of a page
+        if ((phys_addr & 0xfff) == 0 ||
+                (inst_base->br == NON_BRANCH && Breakpoints::HasCodeBreakpoint(phys_addr))) {
             inst_base->br = END_OF_PAGE;
         }
         ret = inst_base->br;
     };
 
-    cpu->instruction_cache[pc_start] = bb_start;
+    SpecializeOperands(inst_base);
+    header->num_instrs = size;
+
+    if (num_insts <= block_insts.size()) {
+        DetectIdleLoop(inst_base, cpu->TFlag != 0, block_insts[num_insts - 1], phys_addr - inst_size,
+                       pc_start, block_insts.data(), num_insts - 1);
+    }
+
+    if (cacheable) {
+        cache.EndBlock(pc_start, bb_start);
+        BlockList::RecordBlock(pc_start, cpu->TFlag != 0);
+    }
 
     return KEEP_GOING;
 }
 
+void InterpreterTranslateBlock(ARMul_State* cpu, u32 pc, bool thumb) {
+    int offset;
+    if (cpu->translation_cache->Find(pc, offset))
+        return;
+
+    // The translation reads the instruction set and block address from the CPU state
+    const ARMword tflag = cpu->TFlag;
+    const ARMword reg15 = cpu->Reg[15];
+    cpu->TFlag = thumb;
+    cpu->Reg[15] = pc;
+    InterpreterTranslate(cpu, offset, pc);
+    cpu->TFlag = tflag;
+    cpu->Reg[15] = reg15;
+}
+
+static IdleLoopStatistics idle_loop_statistics;
+
+void SkipIdleLoop(ARM_Interface* core, ARMul_State* state) {
+    if (!state->IdleLoopReached)
+        return;
+    state->IdleLoopReached = false;
+
+    // CoreTiming only keeps track of the application core's cycles
+    if (core != Core::g_app_core)
+        return;
+
+    const u64 idle_ticks = CoreTiming::GetIdleTicks();
+    CoreTiming::Idle();
+    idle_loop_statistics.loops_skipped++;
+    idle_loop_statistics.cycles_skipped += CoreTiming::GetIdleTicks() - idle_ticks;
+
+    // Run the event the loop is waiting for right away
+    if (core->down_count < 0)
+        CoreTiming::Advance();
+}
+
+const IdleLoopStatistics& GetIdleLoopStatistics() {
+    return idle_loop_statistics;
+}
+
+void ResetIdleLoopStatistics() {
+    idle_loop_statistics = IdleLoopStatistics();
+}
+
 static int clz(unsigned int x) {
     int n;
     if (x == 0) return (32);
@@ -3620,6 +4011,13 @@ static int clz(unsigned int x) {
     return n;
 }
 
+/**
+ * Runs the creams from the given one on with the threaded handlers, see the end of the file.
+ * @param num_instrs Instructions accounted for so far, updated for the blocks entered on the way
+ * @return The cream to continue with in InterpreterMainLoop, or nullptr if the run ended at a branch
+ */
+static arm_inst* RunThreadedHandlers(ARMul_State* cpu, arm_inst* inst, unsigned& num_instrs);
+
 unsigned InterpreterMainLoop(ARMul_State* cpu) {
     Common::Profiling::ScopeTimer timer_execute(profile_execute);
 
@@ -3640,6 +4038,11 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
     #define LINK_RTN_ADDR   (cpu->Reg[14] = cpu->Reg[15] + 4)
     #define SET_PC          (cpu->Reg[15] = cpu->Reg[15] + 8 + inst_cream->signed_immed_24)
     #define SHIFTER_OPERAND inst_cream->shtop_func(cpu, inst_cream->shifter_operand)
+    // Operands of the handlers specialized by operand form, see SpecializeOperands
+    #define IMMEDIATE_OPERAND     inst_cream->immediate
+    #define REGISTER_OPERAND      cpu->Reg[BITS(inst_cream->shifter_operand, 0, 3)]
+    #define IMMEDIATE_OFFSET_ADDR (cpu->Reg[BITS(inst_cream->inst, 16, 19)] + inst_cream->offset)
+    #define REGISTER_OFFSET_ADDR  (cpu->Reg[BITS(inst_cream->inst, 16, 19)] + cpu->Reg[BITS(inst_cream->inst, 0, 3)])
 
     #define FETCH_INST if (inst_base->br != NON_BRANCH) goto DISPATCH; \
                        inst_base = (arm_inst *)&inst_buf[ptr]
@@ -3647,17 +4050,49 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
     #define INC_PC(l)   ptr += sizeof(arm_inst) + l
     #define INC_PC_STUB ptr += sizeof(arm_inst)
 
+    // Starts executing the block at ptr. Outside of single-stepping, the instruction budget is only
+    // checked here and the whole block is accounted for up front, so running a block may overshoot
+    // the budget by the rest of the block, like the end of a slice overshoots the next event.
+    // With the threaded interpreter, the threaded handlers run the block up to the first cream they
+    // have no handler for, which continues here.
+    #define ENTER_BLOCK \
+        if (num_instrs >= cpu->NumInstrsToExecute) goto END; \
+        if (!single_step) num_instrs += ((block_header*)&inst_buf[ptr - sizeof(block_header)])->num_instrs; \
+        if (profiling) profile.CountBlock(cpu->Reg[15]); \
+        inst_base = (arm_inst *)&inst_buf[ptr]; \
+        if (threaded) { \
+            inst_base = RunThreadedHandlers(cpu, inst_base, num_instrs); \
+            if (inst_base == nullptr) goto DISPATCH; \
+            ptr = (int)((char*)inst_base - inst_buf); \
+        } \
+        GOTO_NEXT_INST
+
+    // Continues a fused instruction with the branch after it. The branch handler is jumped to
+    // directly, unless the instructions are being counted or stepped one at a time.
+    #define GOTO_FUSED_BRANCH \
+        inst_base = (arm_inst *)&inst_buf[ptr]; \
+        if (instrumented) { GOTO_NEXT_INST; } \
+        if (cpu->TFlag) goto B_COND_THUMB; \
+        goto BBL_INST
+
+    // Ends the execution at the start of an idle loop, so that the core can skip to the next event
+    #define STOP_AT_IDLE_LOOP do { cpu->IdleLoopReached = true; cpu->NumInstrsToExecute = 0; } while (0)
+
 // GCC and Clang have a C++ extension to support a lookup table of labels. Otherwise, fallback to a
 // clunky switch statement.
 #if defined __GNUC__ || defined __clang__
 #define GOTO_NEXT_INST \
-    if (num_instrs >= cpu->NumInstrsToExecute) goto END; \
-    num_instrs++; \
+    if (instrumented) { \
+        if (single_step) { if (num_instrs != 0) goto END; num_instrs = 1; } \
+        if (profiling) profile.CountInstruction(inst_base->idx); \
+    } \
     goto *InstLabel[inst_base->idx]
 #else
 #define GOTO_NEXT_INST \
-    if (num_instrs >= cpu->NumInstrsToExecute) goto END; \
-    num_instrs++; \
+    if (instrumented) { \
+        if (single_step) { if (num_instrs != 0) goto END; num_instrs = 1; } \
+        if (profiling) profile.CountInstruction(inst_base->idx); \
+    } \
     switch(inst_base->idx) { \
     case 0: goto VMLA_INST; \
     case 1: goto VMLS_INST; \
@@ -3865,6 +4300,28 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
     case 203: goto DISPATCH; \
     case 204: goto INIT_INST_LENGTH; \
     case 205: goto END; \
+    case 206: goto CMP_B_INST; \
+    case 207: goto TST_B_INST; \
+    case 208: goto ADD_IMM_INST; \
+    case 209: goto ADD_REG_INST; \
+    case 210: goto SUB_IMM_INST; \
+    case 211: goto SUB_REG_INST; \
+    case 212: goto AND_IMM_INST; \
+    case 213: goto AND_REG_INST; \
+    case 214: goto ORR_IMM_INST; \
+    case 215: goto ORR_REG_INST; \
+    case 216: goto CMP_IMM_INST; \
+    case 217: goto CMP_REG_INST; \
+    case 218: goto MOV_IMM_INST; \
+    case 219: goto MOV_REG_INST; \
+    case 220: goto LDR_IMM_INST; \
+    case 221: goto LDR_REG_INST; \
+    case 222: goto STR_IMM_INST; \
+    case 223: goto STR_REG_INST; \
+    case 224: goto LDRB_IMM_INST; \
+    case 225: goto LDRB_REG_INST; \
+    case 226: goto STRB_IMM_INST; \
+    case 227: goto STRB_REG_INST; \
     }
 #endif
 
@@ -3914,9 +4371,21 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         &&LDRB_INST,&&STRB_INST,&&LDR_INST,&&LDRCOND_INST, &&STR_INST,&&CDP_INST,&&STC_INST,&&LDC_INST, &&LDREXD_INST,
         &&STREXD_INST,&&LDREXH_INST,&&STREXH_INST, &&NOP_INST, &&YIELD_INST, &&WFE_INST, &&WFI_INST, &&SEV_INST, &&SWI_INST,&&BBL_INST,
         &&B_2_THUMB, &&B_COND_THUMB,&&BL_1_THUMB, &&BL_2_THUMB, &&BLX_1_THUMB, &&DISPATCH,
-        &&INIT_INST_LENGTH,&&END
+        &&INIT_INST_LENGTH,&&END,&&CMP_B_INST,&&TST_B_INST,
+        &&ADD_IMM_INST,&&ADD_REG_INST,&&SUB_IMM_INST,&&SUB_REG_INST,&&AND_IMM_INST,&&AND_REG_INST,&&ORR_IMM_INST,&&ORR_REG_INST,&&CMP_IMM_INST,&&CMP_REG_INST,
+        &&MOV_IMM_INST,&&MOV_REG_INST,&&LDR_IMM_INST,&&LDR_REG_INST,&&STR_IMM_INST,&&STR_REG_INST,&&LDRB_IMM_INST,&&LDRB_REG_INST,&&STRB_IMM_INST,&&STRB_REG_INST
         };
 #endif
+    TranslationCache& trans_cache = *cpu->translation_cache;
+    char* const inst_buf = trans_cache.GetBuffer();
+    ExecutionProfile& profile = GetExecutionProfile();
+    const bool profiling = profile.IsEnabled();
+    // Stepping the debugger executes exactly one instruction, counted as it is dispatched
+    const bool single_step = cpu->NumInstrsToExecute == 1;
+    // Whether the per-instruction work is needed, the only check left on the fast path
+    const bool instrumented = profiling || single_step;
+    // The threaded handlers run as much of every block as they can, unless instrumented
+    const bool threaded = !instrumented && Settings::values.threaded_interpreter;
     arm_inst* inst_base;
     unsigned int addr;
     unsigned int phys_addr;
@@ -3941,16 +4410,31 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         phys_addr = cpu->Reg[15];
 
         // Find the cached instruction cream, otherwise translate it...
-        auto itr = cpu->instruction_cache.find(cpu->Reg[15]);
-        if (itr != cpu->instruction_cache.end()) {
-            ptr = itr->second;
-        } else {
-            if (InterpreterTranslate(cpu, ptr, cpu->Reg[15]) == FETCH_EXCEPTION)
+        if (!trans_cache.Find(cpu->Reg[15], ptr)) {
+            // Hooked routines run natively and return to LR, unless their implementation declines
+            if (FunctionHooks::HasHook(cpu->Reg[15]) && !Breakpoints::HasCodeBreakpoint(cpu->Reg[15])) {
+                u32 regs[4] = { cpu->Reg[0], cpu->Reg[1], cpu->Reg[2], cpu->Reg[3] };
+                unsigned cycles;
+                if (FunctionHooks::Call(cpu->Reg[15], regs, cycles)) {
+                    std::copy(regs, regs + 4, cpu->Reg);
+                    cpu->TFlag = cpu->Reg[14] & 1;
+                    cpu->Reg[15] = cpu->Reg[14] & ~1;
+                    num_instrs += cycles;
+                    if (num_instrs >= cpu->NumInstrsToExecute)
+                        goto END;
+                    goto DISPATCH;
+                }
+            }
+            switch (InterpreterTranslate(cpu, ptr, cpu->Reg[15])) {
+            case FETCH_EXCEPTION:
+                goto END;
+            case BREAKPOINT:
+                Breakpoints::ReportHit();
                 goto END;
+            }
         }
 
-        inst_base = (arm_inst *)&inst_buf[ptr];
-        GOTO_NEXT_INST;
+        ENTER_BLOCK;
     }
     ADC_INST:
     {
@@ -4018,6 +4502,52 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         FETCH_INST;
         GOTO_NEXT_INST;
     }
+    ADD_IMM_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            add_inst* const inst_cream = (add_inst*)inst_base->component;
+
+            if (inst_cream->S) {
+                bool carry;
+                bool overflow;
+                RD = AddWithCarry(RN, IMMEDIATE_OPERAND, 0, &carry, &overflow);
+
+                UPDATE_NFLAG(RD);
+                UPDATE_ZFLAG(RD);
+                cpu->CFlag = carry;
+                cpu->VFlag = overflow;
+            } else {
+                RD = RN + IMMEDIATE_OPERAND;
+            }
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(add_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+    ADD_REG_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            add_inst* const inst_cream = (add_inst*)inst_base->component;
+
+            if (inst_cream->S) {
+                bool carry;
+                bool overflow;
+                RD = AddWithCarry(RN, REGISTER_OPERAND, 0, &carry, &overflow);
+
+                UPDATE_NFLAG(RD);
+                UPDATE_ZFLAG(RD);
+                cpu->CFlag = carry;
+                cpu->VFlag = overflow;
+            } else {
+                RD = RN + REGISTER_OPERAND;
+            }
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(add_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
     AND_INST:
     {
         and_inst *inst_cream = (and_inst *)inst_base->component;
@@ -4046,6 +4576,39 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         FETCH_INST;
         GOTO_NEXT_INST;
     }
+    AND_IMM_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            and_inst* const inst_cream = (and_inst*)inst_base->component;
+
+            RD = RN & IMMEDIATE_OPERAND;
+            // The shifter carry out of the specialized forms is the C flag
+            if (inst_cream->S) {
+                UPDATE_NFLAG(RD);
+                UPDATE_ZFLAG(RD);
+            }
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(and_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+    AND_REG_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            and_inst* const inst_cream = (and_inst*)inst_base->component;
+
+            RD = RN & REGISTER_OPERAND;
+            if (inst_cream->S) {
+                UPDATE_NFLAG(RD);
+                UPDATE_ZFLAG(RD);
+            }
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(and_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
     BBL_INST:
     {
         if ((inst_base->cond == 0xe) || CondPassed(cpu, inst_base->cond)) {
@@ -4055,6 +4618,14 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             }
             SET_PC;
             INC_PC(sizeof(bbl_inst));
+            if (inst_cream->idle_loop) {
+                STOP_AT_IDLE_LOOP;
+                goto DISPATCH;
+            }
+            // The target is static, so jump straight into its block once it's been translated
+            if (trans_cache.ResolveLink(inst_cream->link, cpu->Reg[15], ptr)) {
+                ENTER_BLOCK;
+            }
             goto DISPATCH;
         }
         cpu->Reg[15] += GET_INST_SIZE(cpu);
@@ -4234,38 +4805,98 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         FETCH_INST;
         GOTO_NEXT_INST;
     }
-    CPS_INST:
+    CMP_B_INST:
     {
-        cps_inst *inst_cream = (cps_inst *)inst_base->component;
-        uint32_t aif_val = 0;
-        uint32_t aif_mask = 0;
-        if (InAPrivilegedMode(cpu)) {
-            if (inst_cream->imod1) {
-                if (inst_cream->A) {
-                    aif_val |= (inst_cream->imod0 << 8);
-                    aif_mask |= 1 << 8;
-                }
-                if (inst_cream->I) {
-                    aif_val |= (inst_cream->imod0 << 7);
-                    aif_mask |= 1 << 7;
-                }
-                if (inst_cream->F) {
-                    aif_val |= (inst_cream->imod0 << 6);
-                    aif_mask |= 1 << 6;
-                }
-                aif_mask = ~aif_mask;
-                cpu->Cpsr = (cpu->Cpsr & aif_mask) | aif_val;
-            }
-            if (inst_cream->mmod) {
-                cpu->Cpsr = (cpu->Cpsr & 0xffffffe0) | inst_cream->mode;
-                switch_mode(cpu, inst_cream->mode);
-            }
-        }
-        cpu->Reg[15] += GET_INST_SIZE(cpu);
-        INC_PC(sizeof(cps_inst));
-        FETCH_INST;
-        GOTO_NEXT_INST;
-    }
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            cmp_inst* const inst_cream = (cmp_inst*)inst_base->component;
+
+            u32 rn_val = RN;
+            if (inst_cream->Rn == 15)
+                rn_val += 2 * GET_INST_SIZE(cpu);
+
+            bool carry;
+            bool overflow;
+            u32 result = AddWithCarry(rn_val, ~SHIFTER_OPERAND, 1, &carry, &overflow);
+
+            UPDATE_NFLAG(result);
+            UPDATE_ZFLAG(result);
+            cpu->CFlag = carry;
+            cpu->VFlag = overflow;
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(cmp_inst));
+        GOTO_FUSED_BRANCH;
+    }
+    CMP_IMM_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            cmp_inst* const inst_cream = (cmp_inst*)inst_base->component;
+
+            bool carry;
+            bool overflow;
+            u32 result = AddWithCarry(RN, ~IMMEDIATE_OPERAND, 1, &carry, &overflow);
+
+            UPDATE_NFLAG(result);
+            UPDATE_ZFLAG(result);
+            cpu->CFlag = carry;
+            cpu->VFlag = overflow;
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(cmp_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+    CMP_REG_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            cmp_inst* const inst_cream = (cmp_inst*)inst_base->component;
+
+            bool carry;
+            bool overflow;
+            u32 result = AddWithCarry(RN, ~REGISTER_OPERAND, 1, &carry, &overflow);
+
+            UPDATE_NFLAG(result);
+            UPDATE_ZFLAG(result);
+            cpu->CFlag = carry;
+            cpu->VFlag = overflow;
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(cmp_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+    CPS_INST:
+    {
+        cps_inst *inst_cream = (cps_inst *)inst_base->component;
+        uint32_t aif_val = 0;
+        uint32_t aif_mask = 0;
+        if (InAPrivilegedMode(cpu)) {
+            if (inst_cream->imod1) {
+                if (inst_cream->A) {
+                    aif_val |= (inst_cream->imod0 << 8);
+                    aif_mask |= 1 << 8;
+                }
+                if (inst_cream->I) {
+                    aif_val |= (inst_cream->imod0 << 7);
+                    aif_mask |= 1 << 7;
+                }
+                if (inst_cream->F) {
+                    aif_val |= (inst_cream->imod0 << 6);
+                    aif_mask |= 1 << 6;
+                }
+                aif_mask = ~aif_mask;
+                cpu->Cpsr = (cpu->Cpsr & aif_mask) | aif_val;
+            }
+            if (inst_cream->mmod) {
+                cpu->Cpsr = (cpu->Cpsr & 0xffffffe0) | inst_cream->mode;
+                switch_mode(cpu, inst_cream->mode);
+            }
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(cps_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
     CPY_INST:
     {
         if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
@@ -4434,6 +5065,26 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         FETCH_INST;
         GOTO_NEXT_INST;
     }
+    LDR_IMM_INST:
+    {
+        ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
+        cpu->Reg[BITS(inst_cream->inst, 12, 15)] = ReadMemory32(cpu, IMMEDIATE_OFFSET_ADDR);
+
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(ldst_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+    LDR_REG_INST:
+    {
+        ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
+        cpu->Reg[BITS(inst_cream->inst, 12, 15)] = ReadMemory32(cpu, REGISTER_OFFSET_ADDR);
+
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(ldst_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
     LDRCOND_INST:
     {
         if (CondPassed(cpu, inst_base->cond)) {
@@ -4486,7 +5137,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
             inst_cream->get_addr(cpu, inst_cream->inst, addr);
 
-            cpu->Reg[BITS(inst_cream->inst, 12, 15)] = Memory::Read8(addr);
+            cpu->Reg[BITS(inst_cream->inst, 12, 15)] = ReadMemory8(cpu, addr);
 
             if (BITS(inst_cream->inst, 12, 15) == 15) {
                 INC_PC(sizeof(ldst_inst));
@@ -4498,13 +5149,35 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         FETCH_INST;
         GOTO_NEXT_INST;
     }
+    LDRB_IMM_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
+            cpu->Reg[BITS(inst_cream->inst, 12, 15)] = ReadMemory8(cpu, IMMEDIATE_OFFSET_ADDR);
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(ldst_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+    LDRB_REG_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
+            cpu->Reg[BITS(inst_cream->inst, 12, 15)] = ReadMemory8(cpu, REGISTER_OFFSET_ADDR);
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(ldst_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
     LDRBT_INST:
     {
         if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
             ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
             inst_cream->get_addr(cpu, inst_cream->inst, addr);
 
-            cpu->Reg[BITS(inst_cream->inst, 12, 15)] = Memory::Read8(addr);
+            cpu->Reg[BITS(inst_cream->inst, 12, 15)] = ReadMemory8(cpu, addr);
 
             if (BITS(inst_cream->inst, 12, 15) == 15) {
                 INC_PC(sizeof(ldst_inst));
@@ -4565,7 +5238,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             add_exclusive_addr(cpu, read_addr);
             cpu->exclusive_state = 1;
 
-            RD = Memory::Read8(read_addr);
+            RD = ReadMemory8(cpu, read_addr);
             if (inst_cream->Rd == 15) {
                 INC_PC(sizeof(generic_arm_inst));
                 goto DISPATCH;
@@ -4640,7 +5313,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
             ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
             inst_cream->get_addr(cpu, inst_cream->inst, addr);
-            unsigned int value = Memory::Read8(addr);
+            unsigned int value = ReadMemory8(cpu, addr);
             if (BIT(value, 7)) {
                 value |= 0xffffff00;
             }
@@ -4782,6 +5455,38 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         FETCH_INST;
         GOTO_NEXT_INST;
     }
+    MOV_IMM_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            mov_inst* const inst_cream = (mov_inst*)inst_base->component;
+
+            RD = IMMEDIATE_OPERAND;
+            if (inst_cream->S) {
+                UPDATE_NFLAG(RD);
+                UPDATE_ZFLAG(RD);
+            }
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(mov_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+    MOV_REG_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            mov_inst* const inst_cream = (mov_inst*)inst_base->component;
+
+            RD = REGISTER_OPERAND;
+            if (inst_cream->S) {
+                UPDATE_NFLAG(RD);
+                UPDATE_ZFLAG(RD);
+            }
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(mov_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
     MRC_INST:
     {
         if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
@@ -4965,6 +5670,38 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         FETCH_INST;
         GOTO_NEXT_INST;
     }
+    ORR_IMM_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            orr_inst* const inst_cream = (orr_inst*)inst_base->component;
+
+            RD = RN | IMMEDIATE_OPERAND;
+            if (inst_cream->S) {
+                UPDATE_NFLAG(RD);
+                UPDATE_ZFLAG(RD);
+            }
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(orr_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+    ORR_REG_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            orr_inst* const inst_cream = (orr_inst*)inst_base->component;
+
+            RD = RN | REGISTER_OPERAND;
+            if (inst_cream->S) {
+                UPDATE_NFLAG(RD);
+                UPDATE_ZFLAG(RD);
+            }
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(orr_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
 
     NOP_INST:
     {
@@ -6016,6 +6753,28 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         FETCH_INST;
         GOTO_NEXT_INST;
     }
+    STR_IMM_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
+            WriteMemory32(cpu, IMMEDIATE_OFFSET_ADDR, cpu->Reg[BITS(inst_cream->inst, 12, 15)]);
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(ldst_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+    STR_REG_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
+            WriteMemory32(cpu, REGISTER_OFFSET_ADDR, cpu->Reg[BITS(inst_cream->inst, 12, 15)]);
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(ldst_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
     UXTB_INST:
     {
         if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
@@ -6046,7 +6805,29 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
             inst_cream->get_addr(cpu, inst_cream->inst, addr);
             unsigned int value = cpu->Reg[BITS(inst_cream->inst, 12, 15)] & 0xff;
-            Memory::Write8(addr, value);
+            WriteMemory8(cpu, addr, value);
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(ldst_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+    STRB_IMM_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
+            WriteMemory8(cpu, IMMEDIATE_OFFSET_ADDR, cpu->Reg[BITS(inst_cream->inst, 12, 15)] & 0xff);
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(ldst_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+    STRB_REG_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
+            WriteMemory8(cpu, REGISTER_OFFSET_ADDR, cpu->Reg[BITS(inst_cream->inst, 12, 15)] & 0xff);
         }
         cpu->Reg[15] += GET_INST_SIZE(cpu);
         INC_PC(sizeof(ldst_inst));
@@ -6059,7 +6840,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
             ldst_inst* inst_cream = (ldst_inst*)inst_base->component;
             inst_cream->get_addr(cpu, inst_cream->inst, addr);
             unsigned int value = cpu->Reg[BITS(inst_cream->inst, 12, 15)] & 0xff;
-            Memory::Write8(addr, value);
+            WriteMemory8(cpu, addr, value);
         }
         cpu->Reg[15] += GET_INST_SIZE(cpu);
         INC_PC(sizeof(ldst_inst));
@@ -6114,7 +6895,7 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
                 remove_exclusive(cpu, write_addr);
                 cpu->exclusive_state = 0;
 
-                Memory::Write8(write_addr, cpu->Reg[inst_cream->Rm]);
+                WriteMemory8(cpu, write_addr, cpu->Reg[inst_cream->Rm]);
                 RD = 0;
             } else {
                 // Failed to write due to mutex access
@@ -6243,6 +7024,52 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         FETCH_INST;
         GOTO_NEXT_INST;
     }
+    SUB_IMM_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            sub_inst* const inst_cream = (sub_inst*)inst_base->component;
+
+            if (inst_cream->S) {
+                bool carry;
+                bool overflow;
+                RD = AddWithCarry(RN, ~IMMEDIATE_OPERAND, 1, &carry, &overflow);
+
+                UPDATE_NFLAG(RD);
+                UPDATE_ZFLAG(RD);
+                cpu->CFlag = carry;
+                cpu->VFlag = overflow;
+            } else {
+                RD = RN - IMMEDIATE_OPERAND;
+            }
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(sub_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
+    SUB_REG_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            sub_inst* const inst_cream = (sub_inst*)inst_base->component;
+
+            if (inst_cream->S) {
+                bool carry;
+                bool overflow;
+                RD = AddWithCarry(RN, ~REGISTER_OPERAND, 1, &carry, &overflow);
+
+                UPDATE_NFLAG(RD);
+                UPDATE_ZFLAG(RD);
+                cpu->CFlag = carry;
+                cpu->VFlag = overflow;
+            } else {
+                RD = RN - REGISTER_OPERAND;
+            }
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(sub_inst));
+        FETCH_INST;
+        GOTO_NEXT_INST;
+    }
     SWI_INST:
     {
         if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
@@ -6275,8 +7102,8 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
             swp_inst* inst_cream = (swp_inst*)inst_base->component;
             addr = RN;
-            unsigned int value = Memory::Read8(addr);
-            Memory::Write8(addr, (RM & 0xFF));
+            unsigned int value = ReadMemory8(cpu, addr);
+            WriteMemory8(cpu, addr, (RM & 0xFF));
             RD = value;
         }
         cpu->Reg[15] += GET_INST_SIZE(cpu);
@@ -6394,6 +7221,27 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         FETCH_INST;
         GOTO_NEXT_INST;
     }
+    TST_B_INST:
+    {
+        if (inst_base->cond == 0xE || CondPassed(cpu, inst_base->cond)) {
+            tst_inst* const inst_cream = (tst_inst*)inst_base->component;
+
+            u32 lop = RN;
+            u32 rop = SHIFTER_OPERAND;
+
+            if (inst_cream->Rn == 15)
+                lop += GET_INST_SIZE(cpu) * 2;
+
+            u32 result = lop & rop;
+
+            UPDATE_NFLAG(result);
+            UPDATE_ZFLAG(result);
+            UPDATE_CFLAG_WITH_SC;
+        }
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        INC_PC(sizeof(tst_inst));
+        GOTO_FUSED_BRANCH;
+    }
 
     UADD8_INST:
     UADD16_INST:
@@ -6712,16 +7560,26 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         b_2_thumb* inst_cream = (b_2_thumb*)inst_base->component;
         cpu->Reg[15] = cpu->Reg[15] + 4 + inst_cream->imm;
         INC_PC(sizeof(b_2_thumb));
+        if (inst_cream->idle_loop) {
+            STOP_AT_IDLE_LOOP;
+            goto DISPATCH;
+        }
+        if (trans_cache.ResolveLink(inst_cream->link, cpu->Reg[15], ptr)) {
+            ENTER_BLOCK;
+        }
         goto DISPATCH;
     }
     B_COND_THUMB:
     {
         b_cond_thumb* inst_cream = (b_cond_thumb*)inst_base->component;
 
-        if(CondPassed(cpu, inst_cream->cond))
+        if(CondPassed(cpu, inst_cream->cond)) {
             cpu->Reg[15] = cpu->Reg[15] + 4 + inst_cream->imm;
-        else
+            if (inst_cream->idle_loop)
+                STOP_AT_IDLE_LOOP;
+        } else {
             cpu->Reg[15] += 2;
+        }
 
         INC_PC(sizeof(b_cond_thumb));
         goto DISPATCH;
@@ -6978,6 +7836,8 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
 
     END:
     {
+        if (profiling)
+            profile.EndExecution();
         SAVE_NZCVT;
         cpu->NumInstrsToExecute = 0;
         return num_instrs;
@@ -6988,3 +7848,296 @@ unsigned InterpreterMainLoop(ARMul_State* cpu) {
         return num_instrs;
     }
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Threaded handlers
+//
+// An alternative to the dispatch of InterpreterMainLoop, enabled by the threaded_interpreter
+// setting. Every handler is a function of its own, which ends by tail calling the handler of the
+// next cream of the block. The NZCV flags and the instruction count are passed along as arguments
+// rather than kept in the ARMul_State, so that they can stay in registers from one instruction to
+// the next. Only the most common instruction classes have threaded handlers, the first cream of a
+// class without one is handed back to InterpreterMainLoop.
+
+#if defined(__has_cpp_attribute)
+#if __has_cpp_attribute(clang::musttail)
+#define THREADED_TAIL_CALL [[clang::musttail]]
+// The stack doesn't grow with guaranteed tail calls, so branches can go on into their target block
+#define THREADED_LINK_BLOCKS
+#endif
+#endif
+#ifndef THREADED_TAIL_CALL
+// Left to the optimizer, only the calls within a block are made when it doesn't turn them into jumps
+#define THREADED_TAIL_CALL
+#endif
+
+/// Where the threaded handlers stopped, written once when they do
+struct ThreadedExit {
+    /// Cream InterpreterMainLoop continues with, nullptr if a branch ended the run
+    arm_inst* resume;
+    /// NZCV flags packed like in CondPassed
+    u32 nzcv;
+    unsigned num_instrs;
+};
+
+typedef void (*ThreadedHandler)(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit);
+
+/// Threaded handler of each instruction class, ThreadedResume for the classes without one
+static ThreadedHandler threaded_handlers[ExecutionProfile::MAX_INSTRUCTION_CLASSES];
+
+static inline bool ThreadedCondPassed(unsigned int cond, u32 nzcv) {
+    return (condition_table[cond] >> nzcv) & 1;
+}
+
+/// Flags set by an arithmetic instruction
+static inline u32 ArithmeticFlags(u32 result, bool carry, bool overflow) {
+    return (BIT(result, 31) << 3) | ((result == 0) << 2) | (carry << 1) | overflow;
+}
+
+/// Flags set by a logical instruction, which keeps the V flag
+static inline u32 LogicalFlags(u32 result, bool carry, u32 nzcv) {
+    return (BIT(result, 31) << 3) | ((result == 0) << 2) | (carry << 1) | (nzcv & 1);
+}
+
+static inline void ExitThreaded(ThreadedExit* exit, arm_inst* resume, u32 nzcv, unsigned num_instrs) {
+    exit->resume = resume;
+    exit->nzcv = nzcv;
+    exit->num_instrs = num_instrs;
+}
+
+// Operands of the handlers specialized by operand form
+#define SPECIALIZED_OPERAND(form) \
+    ((form) == OperandForm::Immediate ? IMMEDIATE_OPERAND : REGISTER_OPERAND)
+#define SPECIALIZED_ADDR(form) \
+    ((form) == OperandForm::Immediate ? IMMEDIATE_OFFSET_ADDR : REGISTER_OFFSET_ADDR)
+
+// Goes on with the handler of the next cream, or leaves the handlers after the last one of the block
+#define THREADED_NEXT(cream_size) \
+    cpu->Reg[15] += GET_INST_SIZE(cpu); \
+    if (inst->br != NON_BRANCH) { \
+        ExitThreaded(exit, nullptr, nzcv, num_instrs); \
+        return; \
+    } \
+    inst = (arm_inst*)((char*)inst + sizeof(arm_inst) + (cream_size)); \
+    THREADED_TAIL_CALL return threaded_handlers[inst->idx](cpu, inst, nzcv, num_instrs, exit)
+
+static void ThreadedResume(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit) {
+    ExitThreaded(exit, inst, nzcv, num_instrs);
+}
+
+template <OperandForm form>
+static void ThreadedAdd(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit) {
+    add_inst* const inst_cream = (add_inst*)inst->component;
+    if (ThreadedCondPassed(inst->cond, nzcv)) {
+        if (inst_cream->S) {
+            bool carry;
+            bool overflow;
+            RD = AddWithCarry(RN, SPECIALIZED_OPERAND(form), 0, &carry, &overflow);
+            nzcv = ArithmeticFlags(RD, carry, overflow);
+        } else {
+            RD = RN + SPECIALIZED_OPERAND(form);
+        }
+    }
+    THREADED_NEXT(sizeof(add_inst));
+}
+
+template <OperandForm form>
+static void ThreadedSub(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit) {
+    sub_inst* const inst_cream = (sub_inst*)inst->component;
+    if (ThreadedCondPassed(inst->cond, nzcv)) {
+        if (inst_cream->S) {
+            bool carry;
+            bool overflow;
+            RD = AddWithCarry(RN, ~SPECIALIZED_OPERAND(form), 1, &carry, &overflow);
+            nzcv = ArithmeticFlags(RD, carry, overflow);
+        } else {
+            RD = RN - SPECIALIZED_OPERAND(form);
+        }
+    }
+    THREADED_NEXT(sizeof(sub_inst));
+}
+
+// The shifter carry out of the specialized forms is the C flag
+template <OperandForm form>
+static void ThreadedAnd(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit) {
+    and_inst* const inst_cream = (and_inst*)inst->component;
+    if (ThreadedCondPassed(inst->cond, nzcv)) {
+        RD = RN & SPECIALIZED_OPERAND(form);
+        if (inst_cream->S)
+            nzcv = LogicalFlags(RD, (nzcv >> 1) & 1, nzcv);
+    }
+    THREADED_NEXT(sizeof(and_inst));
+}
+
+template <OperandForm form>
+static void ThreadedOrr(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit) {
+    orr_inst* const inst_cream = (orr_inst*)inst->component;
+    if (ThreadedCondPassed(inst->cond, nzcv)) {
+        RD = RN | SPECIALIZED_OPERAND(form);
+        if (inst_cream->S)
+            nzcv = LogicalFlags(RD, (nzcv >> 1) & 1, nzcv);
+    }
+    THREADED_NEXT(sizeof(orr_inst));
+}
+
+template <OperandForm form>
+static void ThreadedMov(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit) {
+    mov_inst* const inst_cream = (mov_inst*)inst->component;
+    if (ThreadedCondPassed(inst->cond, nzcv)) {
+        RD = SPECIALIZED_OPERAND(form);
+        if (inst_cream->S)
+            nzcv = LogicalFlags(RD, (nzcv >> 1) & 1, nzcv);
+    }
+    THREADED_NEXT(sizeof(mov_inst));
+}
+
+template <OperandForm form>
+static void ThreadedCmp(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit) {
+    cmp_inst* const inst_cream = (cmp_inst*)inst->component;
+    if (ThreadedCondPassed(inst->cond, nzcv)) {
+        bool carry;
+        bool overflow;
+        const u32 result = AddWithCarry(RN, ~SPECIALIZED_OPERAND(form), 1, &carry, &overflow);
+        nzcv = ArithmeticFlags(result, carry, overflow);
+    }
+    THREADED_NEXT(sizeof(cmp_inst));
+}
+
+// Unconditional like the ldr class it is specialized from, conditional loads are ldrcond
+template <OperandForm form>
+static void ThreadedLdr(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit) {
+    ldst_inst* const inst_cream = (ldst_inst*)inst->component;
+    cpu->Reg[BITS(inst_cream->inst, 12, 15)] = ReadMemory32(cpu, SPECIALIZED_ADDR(form));
+    THREADED_NEXT(sizeof(ldst_inst));
+}
+
+template <OperandForm form>
+static void ThreadedStr(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit) {
+    ldst_inst* const inst_cream = (ldst_inst*)inst->component;
+    if (ThreadedCondPassed(inst->cond, nzcv))
+        WriteMemory32(cpu, SPECIALIZED_ADDR(form), cpu->Reg[BITS(inst_cream->inst, 12, 15)]);
+    THREADED_NEXT(sizeof(ldst_inst));
+}
+
+template <OperandForm form>
+static void ThreadedLdrb(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit) {
+    ldst_inst* const inst_cream = (ldst_inst*)inst->component;
+    if (ThreadedCondPassed(inst->cond, nzcv))
+        cpu->Reg[BITS(inst_cream->inst, 12, 15)] = ReadMemory8(cpu, SPECIALIZED_ADDR(form));
+    THREADED_NEXT(sizeof(ldst_inst));
+}
+
+template <OperandForm form>
+static void ThreadedStrb(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit) {
+    ldst_inst* const inst_cream = (ldst_inst*)inst->component;
+    if (ThreadedCondPassed(inst->cond, nzcv))
+        WriteMemory8(cpu, SPECIALIZED_ADDR(form), cpu->Reg[BITS(inst_cream->inst, 12, 15)] & 0xff);
+    THREADED_NEXT(sizeof(ldst_inst));
+}
+
+// The fused compares go on with the branch after them like any other cream. Their shifter
+// operands may read the C flag, which is stored for them.
+static void ThreadedCmpB(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit) {
+    cmp_inst* const inst_cream = (cmp_inst*)inst->component;
+    if (ThreadedCondPassed(inst->cond, nzcv)) {
+        cpu->CFlag = (nzcv >> 1) & 1;
+        u32 rn_val = RN;
+        if (inst_cream->Rn == 15)
+            rn_val += 2 * GET_INST_SIZE(cpu);
+
+        bool carry;
+        bool overflow;
+        const u32 result = AddWithCarry(rn_val, ~SHIFTER_OPERAND, 1, &carry, &overflow);
+        nzcv = ArithmeticFlags(result, carry, overflow);
+    }
+    THREADED_NEXT(sizeof(cmp_inst));
+}
+
+static void ThreadedTstB(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit) {
+    tst_inst* const inst_cream = (tst_inst*)inst->component;
+    if (ThreadedCondPassed(inst->cond, nzcv)) {
+        cpu->CFlag = (nzcv >> 1) & 1;
+        u32 lop = RN;
+        const u32 rop = SHIFTER_OPERAND;
+        if (inst_cream->Rn == 15)
+            lop += GET_INST_SIZE(cpu) * 2;
+
+        nzcv = LogicalFlags(lop & rop, cpu->shifter_carry_out != 0, nzcv);
+    }
+    THREADED_NEXT(sizeof(tst_inst));
+}
+
+static void ThreadedBbl(ARMul_State* cpu, arm_inst* inst, u32 nzcv, unsigned num_instrs, ThreadedExit* exit) {
+    bbl_inst* const inst_cream = (bbl_inst*)inst->component;
+    if (!ThreadedCondPassed(inst->cond, nzcv)) {
+        cpu->Reg[15] += GET_INST_SIZE(cpu);
+        ExitThreaded(exit, nullptr, nzcv, num_instrs);
+        return;
+    }
+
+    if (inst_cream->L)
+        LINK_RTN_ADDR;
+    SET_PC;
+    if (inst_cream->idle_loop) {
+        STOP_AT_IDLE_LOOP;
+        ExitThreaded(exit, nullptr, nzcv, num_instrs);
+        return;
+    }
+#ifdef THREADED_LINK_BLOCKS
+    // Enters the target block like ENTER_BLOCK does, once it's been translated
+    TranslationCache& trans_cache = *cpu->translation_cache;
+    int offset;
+    if (num_instrs < cpu->NumInstrsToExecute && trans_cache.ResolveLink(inst_cream->link, cpu->Reg[15], offset)) {
+        char* const block = trans_cache.GetBuffer() + offset;
+        num_instrs += ((block_header*)(block - sizeof(block_header)))->num_instrs;
+        inst = (arm_inst*)block;
+        THREADED_TAIL_CALL return threaded_handlers[inst->idx](cpu, inst, nzcv, num_instrs, exit);
+    }
+#endif
+    ExitThreaded(exit, nullptr, nzcv, num_instrs);
+}
+
+static bool InitThreadedHandlers() {
+    std::fill(std::begin(threaded_handlers), std::end(threaded_handlers), ThreadedResume);
+
+    // Same order as specialized_instructions
+    static const ThreadedHandler specialized_handlers[] = {
+        ThreadedAdd<OperandForm::Immediate>, ThreadedAdd<OperandForm::Register>,
+        ThreadedSub<OperandForm::Immediate>, ThreadedSub<OperandForm::Register>,
+        ThreadedAnd<OperandForm::Immediate>, ThreadedAnd<OperandForm::Register>,
+        ThreadedOrr<OperandForm::Immediate>, ThreadedOrr<OperandForm::Register>,
+        ThreadedCmp<OperandForm::Immediate>, ThreadedCmp<OperandForm::Register>,
+        ThreadedMov<OperandForm::Immediate>, ThreadedMov<OperandForm::Register>,
+        ThreadedLdr<OperandForm::Immediate>, ThreadedLdr<OperandForm::Register>,
+        ThreadedStr<OperandForm::Immediate>, ThreadedStr<OperandForm::Register>,
+        ThreadedLdrb<OperandForm::Immediate>, ThreadedLdrb<OperandForm::Register>,
+        ThreadedStrb<OperandForm::Immediate>, ThreadedStrb<OperandForm::Register>,
+    };
+    static_assert(sizeof(specialized_handlers) / sizeof(specialized_handlers[0]) == NUM_SPECIALIZED_INSTRUCTION_CLASSES,
+                  "Missing threaded handlers for the specialized instructions");
+    for (unsigned i = 0; i < NUM_SPECIALIZED_INSTRUCTION_CLASSES; ++i)
+        threaded_handlers[FIRST_SPECIALIZED_INDEX + i] = specialized_handlers[i];
+
+    // Same order as fused_instructions
+    threaded_handlers[FIRST_FUSED_INDEX + 0] = ThreadedCmpB;
+    threaded_handlers[FIRST_FUSED_INDEX + 1] = ThreadedTstB;
+    threaded_handlers[FindInstructionClass("bbl")] = ThreadedBbl;
+    return true;
+}
+
+static arm_inst* RunThreadedHandlers(ARMul_State* cpu, arm_inst* inst, unsigned& num_instrs) {
+    static const bool initialized = InitThreadedHandlers();
+    (void)initialized;
+
+    // The flags are always 0 or 1
+    const u32 nzcv = (cpu->NFlag << 3) | (cpu->ZFlag << 2) | (cpu->CFlag << 1) | cpu->VFlag;
+    ThreadedExit exit;
+    threaded_handlers[inst->idx](cpu, inst, nzcv, num_instrs, &exit);
+
+    cpu->NFlag = exit.nzcv >> 3;
+    cpu->ZFlag = (exit.nzcv >> 2) & 1;
+    cpu->CFlag = (exit.nzcv >> 1) & 1;
+    cpu->VFlag = exit.nzcv & 1;
+    num_instrs = exit.num_instrs;
+    return exit.resume;
+}
@@ -4,6 +4,41 @@
 
 #pragma once
 
+#include "common/common_types.h"
+
 #include "core/arm/skyeye_common/armdefs.h"
 
+class ARM_Interface;
+
 unsigned InterpreterMainLoop(ARMul_State* state);
+
+/**
+ * Translates the block starting at the given address into the state's translation cache, unless it
+ * is translated already
+ * @param thumb Whether the block consists of Thumb instructions
+ */
+void InterpreterTranslateBlock(ARMul_State* state, u32 pc, bool thumb);
+
+/// Returns the number of instruction classes, i.e. of distinct InstLabel indices
+unsigned GetInstructionClassCount();
+
+/// Returns the mnemonic of the instruction class with the given InstLabel index
+const char* GetInstructionClassName(unsigned index);
+
+/**
+ * Skips the CPU ahead to the next CoreTiming event if InterpreterMainLoop stopped because the
+ * guest reached an idle loop (see IsIdleLoop). Has to be called by the cores after adding the
+ * ticks of the execution.
+ * @param core The core that ran the interpreter. Only the application core is skipped ahead.
+ * @param state The state the interpreter ran on
+ */
+void SkipIdleLoop(ARM_Interface* core, ARMul_State* state);
+
+/// Statistics of the idle loop skipping since the last call to ResetIdleLoopStatistics
+struct IdleLoopStatistics {
+    u64 loops_skipped;  ///< Number of times an idle loop was skipped
+    u64 cycles_skipped; ///< Number of cycles the idle loops would have run for
+};
+
+const IdleLoopStatistics& GetIdleLoopStatistics();
+void ResetIdleLoopStatistics();
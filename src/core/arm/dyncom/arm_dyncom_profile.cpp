@@ -0,0 +1,128 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "common/logging/log.h"
+#include "common/string_util.h"
+#include "common/symbols.h"
+
+#include "core/arm/dyncom/arm_dyncom_interpreter.h"
+#include "core/arm/dyncom/arm_dyncom_profile.h"
+
+ExecutionProfile::ExecutionProfile() : enabled(false) {
+    for (auto& counter : instruction_counts)
+        counter.store(0, std::memory_order_relaxed);
+}
+
+void ExecutionProfile::SetEnabled(bool enable) {
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+void ExecutionProfile::Reset() {
+    for (auto& counter : instruction_counts)
+        counter.store(0, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(block_mutex);
+    block_counts.clear();
+    current_block = nullptr;
+}
+
+void ExecutionProfile::FlushPendingInstructions() {
+    if (current_block != nullptr)
+        current_block->instructions += pending_instructions;
+    pending_instructions = 0;
+}
+
+void ExecutionProfile::CountBlock(u32 pc) {
+    std::lock_guard<std::mutex> lock(block_mutex);
+    FlushPendingInstructions();
+    current_block = &block_counts[pc];
+    ++current_block->entries;
+}
+
+void ExecutionProfile::EndExecution() {
+    std::lock_guard<std::mutex> lock(block_mutex);
+    FlushPendingInstructions();
+    current_block = nullptr;
+}
+
+static std::string FormatShare(u64 count, u64 total) {
+    return Common::StringFromFormat("%6.2f%%", total ? count * 100.0 / total : 0.0);
+}
+
+std::string ExecutionProfile::GetReport(size_t max_entries) const {
+    std::vector<std::pair<u64, unsigned>> instructions;
+    u64 total_instructions = 0;
+    for (unsigned i = 0; i < GetInstructionClassCount(); ++i) {
+        const u64 count = instruction_counts[i].load(std::memory_order_relaxed);
+        if (count == 0)
+            continue;
+        instructions.emplace_back(count, i);
+        total_instructions += count;
+    }
+
+    std::vector<std::pair<BlockCounts, u32>> blocks;
+    {
+        std::lock_guard<std::mutex> lock(block_mutex);
+        blocks.reserve(block_counts.size());
+        for (const auto& block : block_counts)
+            blocks.emplace_back(block.second, block.first);
+    }
+
+    std::sort(instructions.begin(), instructions.end(),
+              [](const std::pair<u64, unsigned>& a, const std::pair<u64, unsigned>& b) {
+        return a.first > b.first;
+    });
+    std::sort(blocks.begin(), blocks.end(),
+              [](const std::pair<BlockCounts, u32>& a, const std::pair<BlockCounts, u32>& b) {
+        return a.first.instructions > b.first.instructions;
+    });
+
+    std::string report = Common::StringFromFormat("Executed %llu instructions in %u blocks\n",
+                                                  (unsigned long long)total_instructions,
+                                                  (unsigned)blocks.size());
+
+    report += "Hot instruction classes:\n";
+    for (size_t i = 0; i < std::min(max_entries, instructions.size()); ++i) {
+        const u64 count = instructions[i].first;
+        report += Common::StringFromFormat("  %-12s %14llu %s\n",
+                                           GetInstructionClassName(instructions[i].second),
+                                           (unsigned long long)count,
+                                           FormatShare(count, total_instructions).c_str());
+    }
+
+    report += "Hot blocks:\n";
+    for (size_t i = 0; i < std::min(max_entries, blocks.size()); ++i) {
+        const BlockCounts& counts = blocks[i].first;
+        report += Common::StringFromFormat("  0x%08X %14llu %s, %llu entries", blocks[i].second,
+                                           (unsigned long long)counts.instructions,
+                                           FormatShare(counts.instructions, total_instructions).c_str(),
+                                           (unsigned long long)counts.entries);
+
+        // Attributes the block to its function when a symbol map is loaded
+        const TSymbol symbol = Symbols::GetContainingSymbol(blocks[i].second);
+        if (!symbol.name.empty())
+            report += Common::StringFromFormat(" in %s+0x%X", symbol.name.c_str(), blocks[i].second - symbol.address);
+        report += "\n";
+    }
+
+    return report;
+}
+
+void ExecutionProfile::LogReport(size_t max_entries) const {
+    std::vector<std::string> lines;
+    Common::SplitString(GetReport(max_entries), '\n', lines);
+    for (const std::string& line : lines) {
+        if (!line.empty())
+            LOG_INFO(Core_ARM11, "%s", line.c_str());
+    }
+}
+
+ExecutionProfile& GetExecutionProfile() {
+    static ExecutionProfile profile;
+    return profile;
+}
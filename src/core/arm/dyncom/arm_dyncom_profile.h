@@ -0,0 +1,86 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "common/common_types.h"
+
+/**
+ * Optional execution counters of the DynCom interpreter. When enabled, InterpreterMainLoop counts
+ * how often each instruction class (InstLabel index) is executed, as well as how often each
+ * translated block is entered and how many instructions are executed inside of it. The
+ * interpreter charges one cycle per executed instruction, so instruction counts are cycle counts.
+ *
+ * Counting happens on the emulation thread only, while reports can be generated from any thread.
+ */
+class ExecutionProfile {
+public:
+    /// Upper bound of the number of InstLabel indices
+    static const size_t MAX_INSTRUCTION_CLASSES = 256;
+
+    ExecutionProfile();
+
+    bool IsEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /// Enables or disables counting. Counters are kept when counting is disabled.
+    void SetEnabled(bool enable);
+
+    /// Clears all counters
+    void Reset();
+
+    /// Counts the execution of an instruction of the given class. Only called by the interpreter.
+    void CountInstruction(unsigned index) {
+        std::atomic<u64>& counter = instruction_counts[index];
+        // Only the emulation thread writes the counters, so this doesn't need to be a locked add
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        ++pending_instructions;
+    }
+
+    /// Counts the entry into the block starting at the given address. Only called by the interpreter.
+    void CountBlock(u32 pc);
+
+    /// Attributes the instructions executed since the last block entry. Only called by the interpreter.
+    void EndExecution();
+
+    /**
+     * Generates a human readable report of the hottest instruction classes and blocks.
+     * @param max_entries Maximum number of instruction classes and blocks to list
+     */
+    std::string GetReport(size_t max_entries = 32) const;
+
+    /// Writes the report generated by GetReport to the log, one line per entry
+    void LogReport(size_t max_entries = 32) const;
+
+private:
+    struct BlockCounts {
+        u64 entries = 0;
+        u64 instructions = 0;
+    };
+
+    /// Adds the pending instructions to the current block
+    void FlushPendingInstructions();
+
+    std::atomic<bool> enabled;
+
+    std::array<std::atomic<u64>, MAX_INSTRUCTION_CLASSES> instruction_counts;
+
+    /// Protects the block counters
+    mutable std::mutex block_mutex;
+    std::unordered_map<u32, BlockCounts> block_counts;
+    /// Block the interpreter is currently executing, nullptr if none
+    BlockCounts* current_block = nullptr;
+    /// Executed instructions not yet attributed to current_block
+    u64 pending_instructions = 0;
+};
+
+/// Gets the execution profile shared by all DynCom cores
+ExecutionProfile& GetExecutionProfile();
@@ -0,0 +1,151 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "common/assert.h"
+#include "common/logging/log.h"
+#include "common/make_unique.h"
+#include "common/memory_util.h"
+
+#include "core/memory_setup.h"
+#include "core/settings.h"
+#include "core/arm/dyncom/arm_dyncom_trans_cache.h"
+
+/// Cache size used when none is configured, in megabytes
+static const size_t DEFAULT_CACHE_SIZE_MB = 32;
+
+const int TranslationCache::INVALID_OFFSET;
+
+TranslationCache::TranslationCache(size_t size, bool use_huge_pages) {
+    if (size < MIN_SIZE)
+        size = MIN_SIZE;
+    // Keeps the start of every generation, like that of every block, on a cache line
+    generation_size = (size / NUM_GENERATIONS) & ~(BLOCK_ALIGNMENT - 1);
+    buffer_size = generation_size * NUM_GENERATIONS;
+    // Pages are aligned way beyond BLOCK_ALIGNMENT
+    if (use_huge_pages) {
+        bool huge_pages;
+        base = static_cast<char*>(AllocateHugeMemoryPages(buffer_size, false, huge_pages));
+        LOG_INFO(Core_ARM11, "Translation cache is backed by %s pages", huge_pages ? "huge" : "normal");
+    } else {
+        base = static_cast<char*>(AllocateMemoryPages(buffer_size));
+    }
+    ASSERT_MSG(base != nullptr, "Failed to allocate the translation cache");
+    pages.resize(1 << (32 - PAGE_BITS));
+    memory_usage.Set(buffer_size + pages.size() * sizeof(pages[0]));
+
+    LOG_DEBUG(Core_ARM11, "Translation cache of %u KB (%u generations)",
+              (unsigned)(size / 1024), (unsigned)NUM_GENERATIONS);
+}
+
+TranslationCache::~TranslationCache() {
+    FreeMemoryPages(base, buffer_size);
+}
+
+int& TranslationCache::GetEntry(u32 pc) {
+    std::unique_ptr<PageEntries>& page = pages[pc >> PAGE_BITS];
+    if (page == nullptr) {
+        page.reset(new PageEntries);
+        page->fill(INVALID_OFFSET);
+        used_pages.push_back(pc >> PAGE_BITS);
+        memory_usage.Add(sizeof(PageEntries));
+    }
+    return (*page)[(pc & PAGE_MASK) >> 1];
+}
+
+int TranslationCache::BeginBlock() {
+    top = (top + BLOCK_ALIGNMENT - 1) & ~(BLOCK_ALIGNMENT - 1);
+    const size_t generation_end = (current_generation + 1) * generation_size;
+    if (top + MAX_BLOCK_SIZE > generation_end) {
+        current_generation = (current_generation + 1) % NUM_GENERATIONS;
+        EvictGeneration(current_generation);
+        top = current_generation * generation_size;
+    }
+    return static_cast<int>(top);
+}
+
+void* TranslationCache::Allocate(size_t size) {
+    ASSERT_MSG(top + size <= (current_generation + 1) * generation_size,
+               "Translated block exceeds the maximum block size");
+
+    void* ptr = &base[top];
+    top += size;
+    return ptr;
+}
+
+void TranslationCache::EndBlock(u32 pc, int offset) {
+    GetEntry(pc) = offset;
+    Memory::MarkCodePage(pc);
+    Generation& generation = generations[current_generation];
+    generation.blocks.push_back(pc);
+    generation.size += top - offset;
+    used_size.store(used_size.load(std::memory_order_relaxed) + (top - offset), std::memory_order_relaxed);
+}
+
+void TranslationCache::EvictGeneration(size_t index) {
+    const size_t begin = index * generation_size;
+    const size_t end = begin + generation_size;
+
+    LOG_DEBUG(Core_ARM11, "Evicting %u translated blocks from generation %u",
+              (unsigned)generations[index].blocks.size(), (unsigned)index);
+
+    for (u32 pc : generations[index].blocks) {
+        PageEntries* page = pages[pc >> PAGE_BITS].get();
+        if (page == nullptr)
+            continue;
+
+        // The entry may since have been invalidated or retranslated into a newer generation
+        int& entry = (*page)[(pc & PAGE_MASK) >> 1];
+        if (entry >= (int)begin && entry < (int)end)
+            entry = INVALID_OFFSET;
+    }
+    generations[index].blocks.clear();
+    used_size.store(used_size.load(std::memory_order_relaxed) - generations[index].size, std::memory_order_relaxed);
+    generations[index].size = 0;
+    BreakLinks();
+}
+
+void TranslationCache::Flush() {
+    for (auto& generation : generations) {
+        generation.blocks.clear();
+        generation.size = 0;
+    }
+    used_size.store(0, std::memory_order_relaxed);
+    for (u32 page : used_pages)
+        pages[page].reset();
+    memory_usage.Set(memory_usage.Get() - used_pages.size() * sizeof(PageEntries));
+    used_pages.clear();
+
+    current_generation = 0;
+    top = 0;
+    BreakLinks();
+}
+
+void TranslationCache::InvalidateRange(u32 start_address, u32 length) {
+    if (length == 0)
+        return;
+
+    bool invalidated = false;
+    const u32 first_page = start_address >> PAGE_BITS;
+    const u32 last_page = (start_address + length - 1) >> PAGE_BITS;
+    for (u32 page = first_page; page <= last_page; ++page) {
+        if (pages[page] != nullptr) {
+            pages[page]->fill(INVALID_OFFSET);
+            invalidated = true;
+        }
+    }
+
+    if (invalidated)
+        BreakLinks();
+}
+
+void TranslationCache::BreakLinks() {
+    if (++link_epoch == 0)
+        link_epoch = 1;
+}
+
+std::unique_ptr<TranslationCache> CreateTranslationCache() {
+    return Common::make_unique<TranslationCache>((Settings::values.cpu_cache_size ?
+        Settings::values.cpu_cache_size : DEFAULT_CACHE_SIZE_MB) * 1024 * 1024,
+        Settings::values.use_huge_pages);
+}
@@ -0,0 +1,204 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/memory_accounting.h"
+
+/**
+ * Cached successor of a direct branch. A link is only valid while the cache's link epoch is the
+ * one it was created in, so evicting or invalidating blocks implicitly breaks all links.
+ */
+struct BlockLink {
+    u32 epoch;
+    int offset;
+};
+
+/**
+ * Storage for the instruction creams produced by the DynCom translator. The buffer is split into
+ * a fixed number of generations that are filled round-robin. When the current generation can't
+ * hold another block, the oldest one is evicted as a whole and reused. This bounds the memory
+ * used by translated code without ever having to move creams that are still referenced.
+ *
+ * Every CPU core owns a cache of its own, reachable through its ARMul_State.
+ */
+class TranslationCache {
+public:
+    /// Number of generations the buffer is split into
+    static const size_t NUM_GENERATIONS = 4;
+
+    /// Blocks start on a cache line. Most blocks are short enough to fit in one or two lines.
+    static const size_t BLOCK_ALIGNMENT = 64;
+
+    /// Upper bound of the cream size of a single instruction, including its arm_inst header
+    static const size_t MAX_CREAM_SIZE = 96;
+    /// Upper bound of the size of a block, including the header the translator puts before its
+    /// creams. Blocks never cross a page and Thumb instructions are two bytes long.
+    static const size_t MAX_BLOCK_SIZE = (0x1000 / 2 + 1) * MAX_CREAM_SIZE;
+
+    /// Smallest accepted buffer size
+    static const size_t MIN_SIZE = NUM_GENERATIONS * MAX_BLOCK_SIZE * 2;
+
+    /**
+     * @param size Total size of the cream buffer in bytes
+     * @param use_huge_pages Whether to back the cream buffer with huge pages if available
+     */
+    explicit TranslationCache(size_t size, bool use_huge_pages = false);
+    ~TranslationCache();
+
+    /// Returns the start of the cream buffer. Block offsets are relative to this address.
+    char* GetBuffer() const {
+        return base;
+    }
+
+    /**
+     * Looks up the translated block starting at the given guest address.
+     * @param pc Guest address of the block
+     * @param offset Set to the buffer offset of the block if it was found
+     * @return true if the block has been translated
+     */
+    bool Find(u32 pc, int& offset) {
+        const PageEntries* page = pages[pc >> PAGE_BITS].get();
+        const int entry = page ? (*page)[(pc & PAGE_MASK) >> 1] : INVALID_OFFSET;
+        if (entry == INVALID_OFFSET) {
+            ++misses;
+            return false;
+        }
+        ++hits;
+        offset = entry;
+        return true;
+    }
+
+    /**
+     * Prepares the cache for the translation of a new block, evicting the oldest generation if
+     * the current one could overflow.
+     * @return Buffer offset the new block will start at
+     */
+    int BeginBlock();
+
+    /// Allocates space for an instruction cream of the block currently being translated
+    void* Allocate(size_t size);
+
+    /// Registers the block started by the last call to BeginBlock
+    void EndBlock(u32 pc, int offset);
+
+    /// Discards all translated blocks
+    void Flush();
+
+    /**
+     * Discards all blocks translated from the pages overlapping the given guest address range.
+     * Blocks never cross page boundaries, so this covers every block the range could be part of.
+     */
+    void InvalidateRange(u32 start_address, u32 length);
+
+    /// Marks a link as not yet resolved
+    static void ResetLink(BlockLink& link) {
+        link.epoch = 0;
+    }
+
+    /**
+     * Resolves the successor block of a direct branch without translating it, caching the
+     * result in the given link.
+     * @param link Link stored in the branch instruction's cream
+     * @param target Guest address the branch jumps to
+     * @param offset Set to the buffer offset of the successor block if it is available
+     * @return true if the successor block can be jumped to directly
+     */
+    bool ResolveLink(BlockLink& link, u32 target, int& offset) {
+        if (link.epoch == link_epoch) {
+            offset = link.offset;
+            return true;
+        }
+        if (!Find(target, offset))
+            return false;
+
+        link.epoch = link_epoch;
+        link.offset = offset;
+        return true;
+    }
+
+    /// Number of successful block lookups since the cache was created
+    u64 GetHitCount() const {
+        return hits;
+    }
+
+    /// Number of block lookups that required a translation since the cache was created
+    u64 GetMissCount() const {
+        return misses;
+    }
+
+    /// Number of bytes taken by the blocks in the cache, including invalidated ones. Can be read from any thread.
+    size_t GetUsedSize() const {
+        return used_size.load(std::memory_order_relaxed);
+    }
+
+    /// Size of the cream buffer in bytes
+    size_t GetCapacity() const {
+        return generation_size * NUM_GENERATIONS;
+    }
+
+private:
+    static const int PAGE_BITS = 12;
+    static const u32 PAGE_MASK = (1 << PAGE_BITS) - 1;
+    static const int INVALID_OFFSET = -1;
+
+    /// Block offsets of every halfword-aligned address in a page, INVALID_OFFSET if untranslated
+    typedef std::array<int, (1 << PAGE_BITS) / 2> PageEntries;
+
+    /// Returns the lookup table entry of a guest address, allocating its page if needed
+    int& GetEntry(u32 pc);
+
+    struct Generation {
+        /// Guest addresses of all blocks translated into this generation
+        std::vector<u32> blocks;
+        /// Bytes taken by those blocks
+        size_t size = 0;
+    };
+
+    /// Drops all blocks of the given generation from the lookup table
+    void EvictGeneration(size_t index);
+
+    /// Invalidates all block links
+    void BreakLinks();
+
+    /// Host pages holding the cream buffer
+    char* base;
+    size_t buffer_size;
+    size_t generation_size;
+
+    std::array<Generation, NUM_GENERATIONS> generations;
+    size_t current_generation = 0;
+    /// Next free byte in the buffer
+    size_t top = 0;
+
+    /**
+     * Block lookup table, laid out like the Memory page table: the first level is indexed by
+     * the page number of the guest address, the second level by the halfword within the page.
+     * Second level tables are only allocated for pages containing translated code.
+     */
+    std::vector<std::unique_ptr<PageEntries>> pages;
+    /// Indices of all allocated second level tables
+    std::vector<u32> used_pages;
+
+    /// Incremented whenever translated blocks are discarded, never 0
+    u32 link_epoch = 1;
+
+    u64 hits = 0;
+    u64 misses = 0;
+
+    /// Sum of the sizes of all generations
+    std::atomic<size_t> used_size{0};
+
+    /// The buffer and the lookup tables
+    Common::MemoryAccounting::ScopedUsage memory_usage{Common::MemoryAccounting::Tag::TranslationCache};
+};
+
+/// Creates a translation cache for a DynCom core, sized according to Settings::values.cpu_cache_size
+std::unique_ptr<TranslationCache> CreateTranslationCache();
@@ -30,6 +30,10 @@ ARMul_State* ARMul_NewState(ARMul_State* state)
     state->lateabtSig = HIGH;
     state->bigendSig = LOW;
 
+    state->IdleLoopReached = false;
+    state->PendingVFPContext = nullptr;
+    state->VFPDirty = false;
+
     return state;
 }
 
@@ -0,0 +1,517 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+
+#include "common/logging/log.h"
+#include "common/make_unique.h"
+#include "common/memory_util.h"
+#include "common/profiler.h"
+
+#include "core/block_list.h"
+#include "core/breakpoints.h"
+#include "core/core_timing.h"
+#include "core/memory.h"
+#include "core/memory_setup.h"
+#include "core/settings.h"
+#include "core/hle/function_hooks.h"
+#include "core/arm/dyncom/arm_dyncom_interpreter.h"
+#include "core/arm/jit/arm_jit.h"
+
+using Common::AluOp;
+using Common::MemOperand;
+using Common::ShiftOp;
+using Common::X64Emitter;
+using Common::X64Reg;
+
+Common::Profiling::TimingCategory profile_jit_compile("JIT::Compile");
+
+/// Size of the host code buffer. The whole cache is flushed when it fills up.
+static const size_t CODE_BUFFER_SIZE = 16 * 1024 * 1024;
+/// Maximum number of guest instructions recompiled into a single block
+static const unsigned MAX_BLOCK_INSTRUCTIONS = 64;
+/// Upper bound of the host code size of a single block, including its epilogue
+static const size_t MAX_BLOCK_CODE_SIZE = MAX_BLOCK_INSTRUCTIONS * 64 + 256;
+
+typedef u32 (*BlockFunction)(ARMul_State* state);
+
+/// Code buffer of the last destroyed JIT, reused by the next one so that resetting the emulated
+/// system between titles doesn't allocate it again
+static u8* spare_code_buffer = nullptr;
+
+// Compiled blocks are called as regular functions taking the CPU state as their only argument.
+// Guest registers are allocated from the caller-saved registers not used for that argument, so
+// blocks don't need a prologue. RAX is reserved as a scratch register.
+#ifdef _WIN32
+static const X64Reg STATE_REG = X64Reg::RCX;
+static const std::array<X64Reg, 5> host_register_pool = {{
+    X64Reg::RDX, X64Reg::R8, X64Reg::R9, X64Reg::R10, X64Reg::R11,
+}};
+#else
+static const X64Reg STATE_REG = X64Reg::RDI;
+static const std::array<X64Reg, 7> host_register_pool = {{
+    X64Reg::RCX, X64Reg::RDX, X64Reg::RSI, X64Reg::R8, X64Reg::R9, X64Reg::R10, X64Reg::R11,
+}};
+#endif
+static const X64Reg SCRATCH_REG = X64Reg::RAX;
+
+namespace {
+
+/// Operand 2 of a data processing instruction, either a constant or a value in SCRATCH_REG
+struct ShifterOperand {
+    bool is_immediate;
+    u32 immediate;
+};
+
+/// Translates the instructions of a single guest basic block into host code.
+class BlockCompiler {
+public:
+    BlockCompiler(X64Emitter& emitter, ARMul_State* state) : emit(emitter), state(state) {
+        host_reg.fill(-1);
+        dirty.fill(false);
+    }
+
+    /**
+     * Compiles the block starting at the given address.
+     * @return Number of guest instructions compiled, 0 if the first one is unsupported.
+     */
+    unsigned Compile(u32 start_pc) {
+        u32 pc = start_pc;
+        unsigned count = 0;
+        bool ended_by_branch = false;
+
+        while (count < MAX_BLOCK_INSTRUCTIONS) {
+            // Instructions with a breakpoint are left to the interpreter, which stops before them, and
+            // so are hooked routines, which it calls instead
+            if (Breakpoints::HasCodeBreakpoint(pc) || FunctionHooks::HasHook(pc))
+                break;
+
+            const u32 inst = Memory::Read32(pc);
+            const BranchResult result = CompileInstruction(inst, pc);
+            if (result == BranchResult::Unsupported)
+                break;
+
+            ++count;
+            if (result == BranchResult::Branch) {
+                ended_by_branch = true;
+                break;
+            }
+
+            pc += 4;
+            // Like the interpreter, don't let blocks cross a page boundary
+            if ((pc & 0xFFF) == 0)
+                break;
+        }
+
+        if (count == 0)
+            return 0;
+
+        WriteBack();
+        if (!ended_by_branch)
+            emit.MOV_StoreImm(MemOperand::Disp(STATE_REG, RegOffset(15)), pc);
+        emit.MOV(X64Reg::RAX, static_cast<u32>(count));
+        emit.RET();
+        return count;
+    }
+
+private:
+    enum class BranchResult {
+        Unsupported, ///< Instruction can't be recompiled, the block ends before it
+        Continue,    ///< Instruction was recompiled and execution continues with the next one
+        Branch,      ///< Instruction was recompiled and ends the block
+    };
+
+    s32 RegOffset(int guest_reg) const {
+        return static_cast<s32>(reinterpret_cast<const u8*>(&state->Reg[guest_reg]) -
+                                reinterpret_cast<const u8*>(state));
+    }
+
+    /// Returns whether the given guest registers (15 excluded) fit into the host register pool
+    bool CanAllocate(std::initializer_list<int> guest_regs) const {
+        size_t needed = 0;
+        std::array<bool, 16> counted{};
+        for (int reg : guest_regs) {
+            if (reg != 15 && host_reg[reg] == -1 && !counted[reg]) {
+                counted[reg] = true;
+                ++needed;
+            }
+        }
+        return next_free + needed <= host_register_pool.size();
+    }
+
+    /// Returns the host register holding a guest register, loading it from the state if needed
+    X64Reg HostReg(int guest_reg, bool load = true) {
+        if (host_reg[guest_reg] == -1) {
+            host_reg[guest_reg] = static_cast<int>(next_free++);
+            if (load)
+                emit.MOV_Load(host_register_pool[host_reg[guest_reg]],
+                              MemOperand::Disp(STATE_REG, RegOffset(guest_reg)));
+        }
+        return host_register_pool[host_reg[guest_reg]];
+    }
+
+    /// Returns the host register a guest register is about to be written to
+    X64Reg DestReg(int guest_reg) {
+        X64Reg reg = HostReg(guest_reg, false);
+        dirty[guest_reg] = true;
+        return reg;
+    }
+
+    /// Copies the value of a guest register (reads of r15 yield the instruction address + 8)
+    void MoveGuestReg(X64Reg dst, int guest_reg, u32 pc) {
+        if (guest_reg == 15) {
+            emit.MOV(dst, pc + 8);
+        } else {
+            X64Reg src = HostReg(guest_reg);
+            if (src != dst)
+                emit.MOV(dst, src);
+        }
+    }
+
+    void WriteBack() {
+        for (int i = 0; i < 15; ++i) {
+            if (dirty[i])
+                emit.MOV_Store(MemOperand::Disp(STATE_REG, RegOffset(i)), host_register_pool[host_reg[i]]);
+        }
+    }
+
+    /// Checks whether operand 2 of a data processing instruction can be recompiled
+    static bool IsSupportedShifterOperand(u32 inst) {
+        if (BIT(inst, 25))
+            return true;
+        // Register-shifted register operands (and the multiply/extra load-store space) use bit 4
+        if (BIT(inst, 4))
+            return false;
+        const u32 shift_type = BITS(inst, 5, 6);
+        const u32 shift_imm = BITS(inst, 7, 11);
+        // ROR #0 encodes RRX, which depends on the carry flag
+        return !(shift_type == 3 && shift_imm == 0);
+    }
+
+    ShifterOperand EmitShifterOperand(u32 inst, u32 pc) {
+        if (BIT(inst, 25)) {
+            const u32 rotate = BITS(inst, 8, 11) * 2;
+            const u32 imm8 = BITS(inst, 0, 7);
+            const u32 value = rotate ? ((imm8 >> rotate) | (imm8 << (32 - rotate))) : imm8;
+            return { true, value };
+        }
+
+        const int rm = BITS(inst, 0, 3);
+        const u32 shift_type = BITS(inst, 5, 6);
+        const u32 shift_imm = BITS(inst, 7, 11);
+
+        // LSR #0 encodes LSR #32, which always yields zero
+        if (shift_type == 1 && shift_imm == 0)
+            return { true, 0 };
+
+        MoveGuestReg(SCRATCH_REG, rm, pc);
+        switch (shift_type) {
+        case 0:
+            if (shift_imm != 0)
+                emit.Shift(ShiftOp::SHL, SCRATCH_REG, shift_imm);
+            break;
+        case 1:
+            emit.Shift(ShiftOp::SHR, SCRATCH_REG, shift_imm);
+            break;
+        case 2:
+            // ASR #0 encodes ASR #32, which is equivalent to ASR #31
+            emit.Shift(ShiftOp::SAR, SCRATCH_REG, shift_imm ? shift_imm : 31);
+            break;
+        case 3:
+            emit.Shift(ShiftOp::ROR, SCRATCH_REG, shift_imm);
+            break;
+        }
+        return { false, 0 };
+    }
+
+    BranchResult CompileInstruction(u32 inst, u32 pc) {
+        // Conditional instructions would require flag handling, leave them to the interpreter
+        if (BITS(inst, 28, 31) != AL)
+            return BranchResult::Unsupported;
+
+        // B / BL
+        if (BITS(inst, 25, 27) == 5) {
+            const bool link = BIT(inst, 24) != 0;
+            if (link && !CanAllocate({ 14 }))
+                return BranchResult::Unsupported;
+
+            const s32 offset = static_cast<s32>(inst << 8) >> 6;
+            if (link)
+                emit.MOV(DestReg(14), pc + 4);
+            WriteBack();
+            emit.MOV_StoreImm(MemOperand::Disp(STATE_REG, RegOffset(15)), pc + 8 + offset);
+            return BranchResult::Branch;
+        }
+
+        if (BITS(inst, 26, 27) != 0)
+            return BranchResult::Unsupported;
+        return CompileDataProcessing(inst, pc);
+    }
+
+    BranchResult CompileDataProcessing(u32 inst, u32 pc) {
+        enum : u32 {
+            OP_AND = 0, OP_EOR = 1, OP_SUB = 2, OP_RSB = 3, OP_ADD = 4,
+            OP_ORR = 12, OP_MOV = 13, OP_BIC = 14, OP_MVN = 15,
+        };
+
+        const u32 opcode = BITS(inst, 21, 24);
+        const bool set_flags = BIT(inst, 20) != 0;
+        const int rn = BITS(inst, 16, 19);
+        const int rd = BITS(inst, 12, 15);
+        const int rm = BITS(inst, 0, 3);
+
+        switch (opcode) {
+        case OP_AND: case OP_EOR: case OP_SUB: case OP_RSB: case OP_ADD:
+        case OP_ORR: case OP_MOV: case OP_BIC: case OP_MVN:
+            break;
+        default:
+            return BranchResult::Unsupported;
+        }
+
+        if (set_flags || rd == 15 || !IsSupportedShifterOperand(inst))
+            return BranchResult::Unsupported;
+
+        const bool uses_rn = opcode != OP_MOV && opcode != OP_MVN;
+        const bool uses_rm = !BIT(inst, 25);
+        if (!CanAllocate({ rd, uses_rn ? rn : 15, uses_rm ? rm : 15 }))
+            return BranchResult::Unsupported;
+
+        ShifterOperand op2 = EmitShifterOperand(inst, pc);
+
+        if (opcode == OP_MOV || opcode == OP_MVN) {
+            const X64Reg dst = DestReg(rd);
+            if (op2.is_immediate) {
+                emit.MOV(dst, opcode == OP_MVN ? ~op2.immediate : op2.immediate);
+            } else {
+                if (opcode == OP_MVN)
+                    emit.NOT(SCRATCH_REG);
+                emit.MOV(dst, SCRATCH_REG);
+            }
+            return BranchResult::Continue;
+        }
+
+        if (opcode == OP_RSB) {
+            // Rd = op2 - Rn
+            if (op2.is_immediate)
+                emit.MOV(SCRATCH_REG, op2.immediate);
+            if (rn == 15)
+                emit.ALU(AluOp::SUB, SCRATCH_REG, pc + 8);
+            else
+                emit.ALU(AluOp::SUB, SCRATCH_REG, HostReg(rn));
+            emit.MOV(DestReg(rd), SCRATCH_REG);
+            return BranchResult::Continue;
+        }
+
+        AluOp op;
+        switch (opcode) {
+        case OP_AND: op = AluOp::AND; break;
+        case OP_EOR: op = AluOp::XOR; break;
+        case OP_SUB: op = AluOp::SUB; break;
+        case OP_ADD: op = AluOp::ADD; break;
+        case OP_ORR: op = AluOp::OR;  break;
+        default:     op = AluOp::AND; break; // BIC
+        }
+
+        if (opcode == OP_BIC) {
+            if (op2.is_immediate)
+                op2.immediate = ~op2.immediate;
+            else
+                emit.NOT(SCRATCH_REG);
+        }
+
+        // Operand 2 is already in the scratch register (or a constant), so Rd may alias Rm
+        if (rd == rn) {
+            HostReg(rn);
+        } else {
+            const X64Reg dst = HostReg(rd, false);
+            MoveGuestReg(dst, rn, pc);
+        }
+        const X64Reg dst = DestReg(rd);
+        if (op2.is_immediate)
+            emit.ALU(op, dst, op2.immediate);
+        else
+            emit.ALU(op, dst, SCRATCH_REG);
+        return BranchResult::Continue;
+    }
+
+    X64Emitter& emit;
+    ARMul_State* state;
+
+    /// Index into host_register_pool for each guest register, -1 if not allocated
+    std::array<int, 16> host_reg;
+    /// Whether a guest register was modified by the block and needs to be written back
+    std::array<bool, 16> dirty;
+    size_t next_free = 0;
+};
+
+} // anonymous namespace
+
+ARM_JIT::ARM_JIT(PrivilegeMode initial_mode) {
+    interpreter = Common::make_unique<ARM_DynCom>(initial_mode);
+    state = interpreter->GetState();
+    registers = state->Reg;
+    instructions_to_execute = &state->NumInstrsToExecute;
+
+    if (spare_code_buffer != nullptr) {
+        code_buffer = spare_code_buffer;
+        spare_code_buffer = nullptr;
+    } else if (Settings::values.use_huge_pages) {
+        bool huge_pages;
+        code_buffer = static_cast<u8*>(AllocateHugeMemoryPages(CODE_BUFFER_SIZE, true, huge_pages));
+        LOG_INFO(Core_ARM11, "JIT code buffer is backed by %s pages", huge_pages ? "huge" : "normal");
+    } else {
+        code_buffer = static_cast<u8*>(AllocateExecutableMemory(CODE_BUFFER_SIZE, false));
+    }
+    emitter.SetCodePtr(code_buffer, code_buffer + CODE_BUFFER_SIZE);
+    code_buffer_usage.Set(CODE_BUFFER_SIZE);
+}
+
+ARM_JIT::~ARM_JIT() {
+    if (spare_code_buffer == nullptr)
+        spare_code_buffer = code_buffer;
+    else
+        FreeMemoryPages(code_buffer, CODE_BUFFER_SIZE);
+}
+
+void ARM_JIT::FreeSpareCodeBuffer() {
+    if (spare_code_buffer != nullptr) {
+        FreeMemoryPages(spare_code_buffer, CODE_BUFFER_SIZE);
+        spare_code_buffer = nullptr;
+    }
+}
+
+u32 ARM_JIT::GetCPSR() const {
+    return interpreter->GetCPSR();
+}
+
+void ARM_JIT::SetCPSR(u32 cpsr) {
+    interpreter->SetCPSR(cpsr);
+}
+
+u32 ARM_JIT::GetCP15Register(CP15Register reg) {
+    return interpreter->GetCP15Register(reg);
+}
+
+void ARM_JIT::SetCP15Register(CP15Register reg, u32 value) {
+    interpreter->SetCP15Register(reg, value);
+}
+
+void ARM_JIT::ResetContext(Core::ThreadContext& context, u32 stack_top, u32 entry_point, u32 arg) {
+    interpreter->ResetContext(context, stack_top, entry_point, arg);
+}
+
+void ARM_JIT::SaveContext(Core::ThreadContext& ctx) {
+    interpreter->SaveContext(ctx);
+}
+
+void ARM_JIT::LoadContext(const Core::ThreadContext& ctx) {
+    interpreter->LoadContext(ctx);
+}
+
+void ARM_JIT::InvalidateCacheRange(u32 start_address, u32 length) {
+    interpreter->InvalidateCacheRange(start_address, length);
+    if (length == 0)
+        return;
+
+    // The code itself is only reclaimed when the buffer is flushed
+    const u32 last_page = (start_address + length - 1) >> Memory::PAGE_BITS;
+    for (u32 page = start_address >> Memory::PAGE_BITS; page <= last_page; ++page) {
+        auto itr = page_blocks.find(page);
+        if (itr == page_blocks.end())
+            continue;
+
+        for (u32 pc : itr->second)
+            block_cache.erase(pc);
+        page_blocks.erase(itr);
+    }
+}
+
+void ARM_JIT::TranslateBlock(u32 pc, bool thumb) {
+    // Thumb code and blocks starting with an instruction the compiler leaves out are interpreted
+    if (thumb || GetBlock(pc).entry == nullptr)
+        interpreter->TranslateBlock(pc, thumb);
+}
+
+void ARM_JIT::GetCacheUsage(size_t& used_bytes, size_t& capacity_bytes) const {
+    used_bytes = code_used.load(std::memory_order_relaxed);
+    capacity_bytes = CODE_BUFFER_SIZE;
+}
+
+void ARM_JIT::ClearCache() {
+    block_cache.clear();
+    page_blocks.clear();
+    emitter.SetCodePtr(code_buffer, code_buffer + CODE_BUFFER_SIZE);
+    code_used.store(0, std::memory_order_relaxed);
+}
+
+ARM_JIT::Block ARM_JIT::CompileBlock(u32 pc) {
+    Common::Profiling::ScopeTimer timer_compile(profile_jit_compile);
+
+    if (emitter.GetSpaceLeft() < MAX_BLOCK_CODE_SIZE) {
+        LOG_DEBUG(Core_ARM11, "JIT code buffer full, flushing");
+        ClearCache();
+    }
+
+    u8* entry = emitter.GetCodePtr();
+    BlockCompiler compiler(emitter, state);
+    if (compiler.Compile(pc) == 0) {
+        // Nothing was emitted, the first instruction has to be interpreted
+        emitter.SetCodePtr(entry, code_buffer + CODE_BUFFER_SIZE);
+        return { nullptr };
+    }
+    return { entry };
+}
+
+const ARM_JIT::Block& ARM_JIT::GetBlock(u32 pc) {
+    auto itr = block_cache.find(pc);
+    if (itr != block_cache.end())
+        return itr->second;
+
+    // Compiling may flush the cache, so only register the block afterwards
+    const Block block = CompileBlock(pc);
+    code_used.store(emitter.GetCodePtr() - code_buffer, std::memory_order_relaxed);
+    Memory::MarkCodePage(pc);
+    BlockList::RecordBlock(pc, false);
+    page_blocks[pc >> Memory::PAGE_BITS].push_back(pc);
+    return block_cache.emplace(pc, block).first->second;
+}
+
+unsigned ARM_JIT::Interpret(unsigned num_instructions) {
+    state->NumInstrsToExecute = num_instructions;
+    unsigned ticks_executed = InterpreterMainLoop(state);
+    AddTicks(ticks_executed);
+    SkipIdleLoop(this, state);
+    return ticks_executed;
+}
+
+void ARM_JIT::ExecuteInstructions(int num_instructions) {
+    reschedule_pending = false;
+
+    unsigned executed = 0;
+    while (executed < static_cast<unsigned>(num_instructions) && !reschedule_pending) {
+        // The CPSR is authoritative outside of the interpreter loop, TFlag may be stale
+        if (state->Cpsr & TBIT) {
+            executed += Interpret(num_instructions - executed);
+            break;
+        }
+
+        const u32 pc = state->Reg[15] & ~3;
+        state->Reg[15] = pc;
+        const Block& block = GetBlock(pc);
+
+        unsigned ticks;
+        if (block.entry != nullptr) {
+            ticks = reinterpret_cast<BlockFunction>(block.entry)(state);
+            AddTicks(ticks);
+        } else {
+            ticks = Interpret(1);
+        }
+
+        if (ticks == 0)
+            break;
+        executed += ticks;
+    }
+}
@@ -0,0 +1,83 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/memory_accounting.h"
+#include "common/x64_emitter.h"
+
+#include "core/arm/arm_interface.h"
+#include "core/arm/dyncom/arm_dyncom.h"
+#include "core/arm/skyeye_common/armdefs.h"
+
+/**
+ * ARM11 CPU core that recompiles guest basic blocks into host x86-64 code. Guest registers are
+ * kept in host registers for the duration of a block. Only a subset of the ARM instruction set
+ * is currently recompiled (unconditional, flag-preserving data processing and direct branches);
+ * blocks end at the first instruction that isn't supported, which is then executed by the DynCom
+ * interpreter the JIT shares its CPU state with. Thumb code is always interpreted.
+ */
+class ARM_JIT final : virtual public ARM_Interface {
+public:
+    ARM_JIT(PrivilegeMode initial_mode);
+    ~ARM_JIT();
+
+    u32 GetCPSR() const override;
+    void SetCPSR(u32 cpsr) override;
+    u32 GetCP15Register(CP15Register reg) override;
+    void SetCP15Register(CP15Register reg, u32 value) override;
+
+    void ResetContext(Core::ThreadContext& context, u32 stack_top, u32 entry_point, u32 arg) override;
+    void SaveContext(Core::ThreadContext& ctx) override;
+    void LoadContext(const Core::ThreadContext& ctx) override;
+
+    void InvalidateCacheRange(u32 start_address, u32 length) override;
+    void TranslateBlock(u32 pc, bool thumb) override;
+    void GetCacheUsage(size_t& used_bytes, size_t& capacity_bytes) const override;
+    void ExecuteInstructions(int num_instructions) override;
+
+    /// Discards all recompiled code, e.g. after guest code memory has been modified
+    void ClearCache();
+
+    /// Frees the code buffer a destroyed JIT kept for the next one to reuse
+    static void FreeSpareCodeBuffer();
+
+private:
+    struct Block {
+        /// Host entry point of the block, or nullptr if its first instruction must be interpreted
+        u8* entry;
+    };
+
+    /// Returns the compiled block starting at the given guest address, compiling it if needed
+    const Block& GetBlock(u32 pc);
+
+    /// Recompiles the basic block starting at the given guest address
+    Block CompileBlock(u32 pc);
+
+    /**
+     * Runs the interpreter for (at least) the given number of instructions
+     * @return Number of instructions actually executed
+     */
+    unsigned Interpret(unsigned num_instructions);
+
+    /// Interpreter the JIT falls back to. It owns the CPU state both cores operate on.
+    std::unique_ptr<ARM_DynCom> interpreter;
+    ARMul_State* state;
+
+    std::unordered_map<u32, Block> block_cache;
+    /// Guest addresses of the compiled blocks in each guest page, used for invalidation
+    std::unordered_map<u32, std::vector<u32>> page_blocks;
+
+    u8* code_buffer;
+    Common::X64Emitter emitter;
+    /// Bytes of the code buffer in use, for GetCacheUsage
+    std::atomic<size_t> code_used{0};
+    Common::MemoryAccounting::ScopedUsage code_buffer_usage{Common::MemoryAccounting::Tag::TranslationCache};
+};
@@ -17,8 +17,6 @@
 
 #pragma once
 
-#include <unordered_map>
-
 #include "common/common_types.h"
 #include "core/arm/skyeye_common/arm_regformat.h"
 
@@ -56,6 +54,17 @@ typedef u16 ARMhword;  // must be 16 bits wide
 typedef u8 ARMbyte;    // must be 8 bits wide
 
 #define VFP_REG_NUM 64
+
+namespace Core {
+struct ThreadContext;
+}
+
+namespace Memory {
+struct FastAccessTable;
+}
+
+class TranslationCache;
+
 struct ARMul_State
 {
     ARMword Emulate;       // To start and stop emulation
@@ -87,6 +96,18 @@ struct ARMul_State
     ARMword ExtReg[VFP_REG_NUM];
     /* ---- End of the ordered registers ---- */
 
+    // Lazy VFP context switching: if set, the VFP registers above don't belong to the running
+    // thread yet and are loaded from this context before the next VFP instruction. The caller of
+    // LoadContext keeps it alive, see ARM_Interface::LoadContext.
+    const Core::ThreadContext* PendingVFPContext;
+    // Set when a VFP instruction ran, so the VFP registers need to be saved on a context switch
+    bool VFPDirty;
+
+    // Translated blocks of this core, owned by the ARM_DynCom the state belongs to
+    TranslationCache* translation_cache;
+    // Tables the loads and stores access memory through, see ReadMemory32 and WriteMemory32
+    const Memory::FastAccessTable* memory_table;
+
     ARMword NFlag, ZFlag, CFlag, VFlag, IFFlags; // Dummy flags for speed
     unsigned int shifter_carry_out;
 
@@ -97,6 +118,7 @@ struct ARMul_State
 
     unsigned long long NumInstrs; // The number of instructions executed
     unsigned NumInstrsToExecute;
+    bool IdleLoopReached; // Set when the interpreter stopped at an idle loop, see SkipIdleLoop
 
     unsigned NresetSig; // Reset the processor
     unsigned NfiqSig;
@@ -150,10 +172,6 @@ So, if lateabtSig=1, then it means Late Abort Model(Base Updated Abort Model)
     // ARM_ARM A2-18
     // 0 Base Restored Abort Model, 1 the Early Abort Model, 2 Base Updated Abort Model
     int abort_model;
-
-    // TODO(bunnei): Move this cache to a better place - it should be per codeset (likely per
-    // process for our purposes), not per ARMul_State (which tracks CPU core state).
-    std::unordered_map<u32, int> instruction_cache;
 };
 
 /***************************************************************************\
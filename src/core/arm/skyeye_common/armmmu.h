@@ -52,8 +52,13 @@ enum
 
 // Reads data in big/little endian format based on the
 // state of the E (endian) bit in the emulated CPU's APSR.
+// Accesses to plain memory are inlined, see Memory::FastRead.
+inline u8 ReadMemory8(ARMul_State* cpu, u32 address) {
+    return Memory::FastRead<u8>(*cpu->memory_table, address);
+}
+
 inline u16 ReadMemory16(ARMul_State* cpu, u32 address) {
-    u16 data = Memory::Read16(address);
+    u16 data = Memory::FastRead<u16_le>(*cpu->memory_table, address);
 
     if (InBigEndianMode(cpu))
         data = Common::swap16(data);
@@ -62,7 +67,7 @@ inline u16 ReadMemory16(ARMul_State* cpu, u32 address) {
 }
 
 inline u32 ReadMemory32(ARMul_State* cpu, u32 address) {
-    u32 data = Memory::Read32(address);
+    u32 data = Memory::FastRead<u32_le>(*cpu->memory_table, address);
 
     if (InBigEndianMode(cpu))
         data = Common::swap32(data);
@@ -71,7 +76,7 @@ inline u32 ReadMemory32(ARMul_State* cpu, u32 address) {
 }
 
 inline u64 ReadMemory64(ARMul_State* cpu, u32 address) {
-    u64 data = Memory::Read64(address);
+    u64 data = Memory::FastRead<u64_le>(*cpu->memory_table, address);
 
     if (InBigEndianMode(cpu))
         data = Common::swap64(data);
@@ -81,23 +86,28 @@ inline u64 ReadMemory64(ARMul_State* cpu, u32 address) {
 
 // Writes data in big/little endian format based on the
 // state of the E (endian) bit in the emulated CPU's APSR.
+// Writes to plain memory that isn't write-watched are inlined, see Memory::FastWrite.
+inline void WriteMemory8(ARMul_State* cpu, u32 address, u8 data) {
+    Memory::FastWrite<u8>(*cpu->memory_table, address, data);
+}
+
 inline void WriteMemory16(ARMul_State* cpu, u32 address, u16 data) {
     if (InBigEndianMode(cpu))
         data = Common::swap16(data);
 
-    Memory::Write16(address, data);
+    Memory::FastWrite<u16_le>(*cpu->memory_table, address, data);
 }
 
 inline void WriteMemory32(ARMul_State* cpu, u32 address, u32 data) {
     if (InBigEndianMode(cpu))
         data = Common::swap32(data);
 
-    Memory::Write32(address, data);
+    Memory::FastWrite<u32_le>(*cpu->memory_table, address, data);
 }
 
 inline void WriteMemory64(ARMul_State* cpu, u32 address, u64 data) {
     if (InBigEndianMode(cpu))
         data = Common::swap64(data);
 
-    Memory::Write64(address, data);
+    Memory::FastWrite<u64_le>(*cpu->memory_table, address, data);
 }
@@ -22,6 +22,9 @@
 
 #include "common/logging/log.h"
 
+#include <cstring>
+
+#include "core/core.h"
 #include "core/arm/skyeye_common/armdefs.h"
 #include "core/arm/skyeye_common/vfp/asm_vfp.h"
 #include "core/arm/skyeye_common/vfp/vfp.h"
@@ -36,6 +39,23 @@ unsigned VFPInit(ARMul_State* state)
     return 0;
 }
 
+void VFPSaveContext(ARMul_State* state, Core::ThreadContext& ctx)
+{
+    memcpy(ctx.fpu_registers, state->ExtReg, sizeof(ctx.fpu_registers));
+    ctx.fpscr = state->VFP[VFP_FPSCR];
+    ctx.fpexc = state->VFP[VFP_FPEXC];
+}
+
+void VFPLoadPendingContext(ARMul_State* state)
+{
+    const Core::ThreadContext& ctx = *state->PendingVFPContext;
+    memcpy(state->ExtReg, ctx.fpu_registers, sizeof(ctx.fpu_registers));
+    state->VFP[VFP_FPSCR] = ctx.fpscr;
+    state->VFP[VFP_FPEXC] = ctx.fpexc;
+
+    state->PendingVFPContext = nullptr;
+}
+
 void VMSR(ARMul_State* state, ARMword reg, ARMword Rt)
 {
     if (reg == 1)
@@ -24,11 +24,23 @@
 
 #define VFP_DEBUG_UNIMPLEMENTED(x) LOG_ERROR(Core_ARM11, "in func %s, " #x " unimplemented\n", __FUNCTION__); exit(-1);
 #define VFP_DEBUG_UNTESTED(x) LOG_TRACE(Core_ARM11, "in func %s, " #x " untested\n", __FUNCTION__);
-#define CHECK_VFP_ENABLED
+// Every VFP instruction starts with this, it loads the VFP registers of a thread that got switched
+// in without them
+#define CHECK_VFP_ENABLED \
+    do { \
+        if (cpu->PendingVFPContext != nullptr) \
+            VFPLoadPendingContext(cpu); \
+        cpu->VFPDirty = true; \
+    } while (0)
 #define CHECK_VFP_CDP_RET vfp_raise_exceptions(cpu, ret, inst_cream->instr, cpu->VFP[VFP_FPSCR]);
 
 unsigned VFPInit(ARMul_State* state);
 
+/// Copies the VFP registers of the running thread into its context
+void VFPSaveContext(ARMul_State* state, Core::ThreadContext& ctx);
+/// Loads the VFP registers from the context in PendingVFPContext, see CHECK_VFP_ENABLED
+void VFPLoadPendingContext(ARMul_State* state);
+
 s32 vfp_get_float(ARMul_State* state, u32 reg);
 void vfp_put_float(ARMul_State* state, s32 val, u32 reg);
 u64 vfp_get_double(ARMul_State* state, u32 reg);
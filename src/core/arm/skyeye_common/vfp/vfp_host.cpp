@@ -0,0 +1,179 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cfenv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "common/logging/log.h"
+
+#include "core/arm/skyeye_common/armdefs.h"
+#include "core/arm/skyeye_common/vfp/asm_vfp.h"
+#include "core/arm/skyeye_common/vfp/vfp.h"
+#include "core/arm/skyeye_common/vfp/vfp_helper.h"
+#include "core/arm/skyeye_common/vfp/vfp_host.h"
+
+// The fast path relies on the host evaluating float and double operations in their own precision
+// (no x87 excess precision) with IEEE round-to-nearest, which is the default on these hosts.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__)
+#define VFP_HOST_FPU 1
+#else
+#define VFP_HOST_FPU 0
+#endif
+
+#if VFP_HOST_FPU
+
+enum class HostOp {
+    Add, Sub, Mul, NegMul, Div, Sqrt, Unsupported
+};
+
+static HostOp DecodeHostOp(u32 inst) {
+    switch (inst & FOP_MASK) {
+    case FOP_FADD:  return HostOp::Add;
+    case FOP_FSUB:  return HostOp::Sub;
+    case FOP_FMUL:  return HostOp::Mul;
+    case FOP_FNMUL: return HostOp::NegMul;
+    case FOP_FDIV:  return HostOp::Div;
+    case FOP_EXT:
+        if ((inst & FEXT_MASK) == FEXT_FSQRT)
+            return HostOp::Sqrt;
+        return HostOp::Unsupported;
+    default:
+        return HostOp::Unsupported;
+    }
+}
+
+template <typename Float>
+static bool IsNormalOrZero(Float value) {
+    const int type = std::fpclassify(value);
+    return type == FP_NORMAL || type == FP_ZERO;
+}
+
+template <typename Float>
+static Float Evaluate(HostOp op, Float n, Float m) {
+    // Reading the operands through volatiles keeps the compiler from moving the operation across
+    // the calls that clear and test the host exception flags.
+    volatile Float vn = n;
+    volatile Float vm = m;
+    volatile Float result;
+    switch (op) {
+    case HostOp::Add:    result = vn + vm; break;
+    case HostOp::Sub:    result = vn - vm; break;
+    case HostOp::Mul:    result = vn * vm; break;
+    case HostOp::NegMul: result = -(vn * vm); break;
+    case HostOp::Div:    result = vn / vm; break;
+    case HostOp::Sqrt:   result = std::sqrt((Float)vm); break;
+    default:             result = 0; break;
+    }
+    return result;
+}
+
+template <typename Float>
+static bool ExecuteHostOp(u32 inst, u32 fpscr, Float n, Float m, Float* result, u32* exceptions) {
+    if ((fpscr & FPSCR_RMODE_MASK) != FPSCR_ROUND_NEAREST)
+        return false;
+
+    const HostOp op = DecodeHostOp(inst);
+    if (op == HostOp::Unsupported)
+        return false;
+
+    // Denormal, infinite and NaN operands are where flush-to-zero, default NaN mode and NaN
+    // propagation rules differ from the host
+    if (!IsNormalOrZero(m) || (op != HostOp::Sqrt && !IsNormalOrZero(n)))
+        return false;
+
+    // Inexact is the only exception normal operands can raise without producing a result that
+    // is rejected below. It's sticky, so it only needs to be tracked until it is first set.
+    const bool track_inexact = (fpscr & FPSCR_IXC) == 0;
+    if (track_inexact)
+        std::feclearexcept(FE_INEXACT);
+
+    const Float value = Evaluate(op, n, m);
+
+    if (value == 0) {
+        // Sums are exact when they cancel out, other operations only produce a zero from a zero
+        // operand. Anything else underflowed.
+        const bool exact = op == HostOp::Add || op == HostOp::Sub || m == 0 ||
+                           (op != HostOp::Sqrt && n == 0);
+        if (!exact)
+            return false;
+    } else {
+        // A result of the smallest normal magnitude may have been tiny before rounding, in which
+        // case VFP flags an underflow or flushes it to zero. Overflows and NaNs are rejected too.
+        if (std::fpclassify(value) != FP_NORMAL ||
+            std::fabs(value) <= std::numeric_limits<Float>::min())
+            return false;
+    }
+
+    *exceptions = (track_inexact && std::fetestexcept(FE_INEXACT)) ? FPSCR_IXC : 0;
+    *result = value;
+    return true;
+}
+
+template <typename Float, typename Bits>
+static Float BitsToFloat(Bits bits) {
+    static_assert(sizeof(Float) == sizeof(Bits), "Size mismatch");
+    Float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+template <typename Bits, typename Float>
+static Bits FloatToBits(Float value) {
+    static_assert(sizeof(Float) == sizeof(Bits), "Size mismatch");
+    Bits bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+bool vfp_single_cpdo_host(ARMul_State* state, u32 inst, u32 fpscr, s32* result, u32* exceptions) {
+    const float n = BitsToFloat<float>(state->ExtReg[vfp_get_sn(inst)]);
+    const float m = BitsToFloat<float>(state->ExtReg[vfp_get_sm(inst)]);
+
+    float value;
+    if (!ExecuteHostOp(inst, fpscr, n, m, &value, exceptions))
+        return false;
+
+    *result = FloatToBits<s32>(value);
+    return true;
+}
+
+bool vfp_double_cpdo_host(ARMul_State* state, u32 inst, u32 fpscr, u64* result, u32* exceptions) {
+    const double n = BitsToFloat<double>(vfp_get_double(state, vfp_get_dn(inst)));
+    const double m = BitsToFloat<double>(vfp_get_double(state, vfp_get_dm(inst)));
+
+    double value;
+    if (!ExecuteHostOp(inst, fpscr, n, m, &value, exceptions))
+        return false;
+
+    *result = FloatToBits<u64>(value);
+    return true;
+}
+
+#else
+
+bool vfp_single_cpdo_host(ARMul_State* state, u32 inst, u32 fpscr, s32* result, u32* exceptions) {
+    return false;
+}
+
+bool vfp_double_cpdo_host(ARMul_State* state, u32 inst, u32 fpscr, u64* result, u32* exceptions) {
+    return false;
+}
+
+#endif
+
+void vfp_verify_host_result(u32 inst, u32 fpscr, u64 soft_result, u32 soft_exceptions,
+                            u64 host_result, u32 host_exceptions) {
+    // Inexact is sticky, only compare it if it wasn't set before
+    const u32 ignored_exceptions = fpscr & FPSCR_IXC;
+    if (soft_result == host_result &&
+        (soft_exceptions & ~ignored_exceptions) == (host_exceptions & ~ignored_exceptions))
+        return;
+
+    LOG_ERROR(Core_ARM11, "VFP host result mismatch for inst=%08X fpscr=%08X: "
+              "softfloat %016llX (exceptions %08X), host %016llX (exceptions %08X)",
+              inst, fpscr, (unsigned long long)soft_result, soft_exceptions,
+              (unsigned long long)host_result, host_exceptions);
+}
@@ -0,0 +1,40 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+struct ARMul_State;
+
+// If this is defined to 1, every VFP operation executed on the host FPU is also executed by the
+// softfloat implementation, and any difference between the two results is logged.
+#ifndef VFP_VERIFY_HOST_RESULTS
+#define VFP_VERIFY_HOST_RESULTS 0
+#endif
+
+/**
+ * Tries to execute a scalar single precision data-processing instruction on the host FPU.
+ *
+ * This is only done when the host is guaranteed to produce the same result and exception flags
+ * as the softfloat implementation: in round-to-nearest mode, with normal or zero operands and a
+ * normal or exactly zero result. In that case, flush-to-zero and default NaN mode don't affect
+ * the result either. All other cases, and the multiply-accumulate instructions (which softfloat
+ * doesn't round between the multiplication and the addition), are left to softfloat.
+ *
+ * @param state ARM state the operands are read from
+ * @param inst Instruction to execute
+ * @param fpscr Current value of the FPSCR
+ * @param result Set to the value to write to the destination register on success
+ * @param exceptions Set to the raised cumulative exception flags on success
+ * @return true if the instruction was executed, false if softfloat has to execute it
+ */
+bool vfp_single_cpdo_host(ARMul_State* state, u32 inst, u32 fpscr, s32* result, u32* exceptions);
+
+/// Double precision version of vfp_single_cpdo_host
+bool vfp_double_cpdo_host(ARMul_State* state, u32 inst, u32 fpscr, u64* result, u32* exceptions);
+
+/// Logs an error if a host FPU result doesn't match the softfloat result of the same instruction
+void vfp_verify_host_result(u32 inst, u32 fpscr, u64 soft_result, u32 soft_exceptions,
+                            u64 host_result, u32 host_exceptions);
@@ -55,6 +55,7 @@
 #include "core/arm/skyeye_common/vfp/vfp.h"
 #include "core/arm/skyeye_common/vfp/vfp_helper.h"
 #include "core/arm/skyeye_common/vfp/asm_vfp.h"
+#include "core/arm/skyeye_common/vfp/vfp_host.h"
 
 static struct vfp_double vfp_double_default_qnan = {
     2047,
@@ -1227,6 +1228,20 @@ u32 vfp_double_cpdo(ARMul_State* state, u32 inst, u32 fpscr)
         goto invalid;
     }
 
+    if (veclen == 0) {
+        u64 result;
+        u32 host_exceptions;
+        if (vfp_double_cpdo_host(state, inst, fpscr, &result, &host_exceptions)) {
+#if VFP_VERIFY_HOST_RESULTS
+            u32 soft_exceptions = fop->fn(state, dest, dn, dm, fpscr);
+            vfp_verify_host_result(inst, fpscr, vfp_get_double(state, dest), soft_exceptions,
+                                   result, host_exceptions);
+#endif
+            vfp_put_double(state, result, dest);
+            return host_exceptions;
+        }
+    }
+
     for (vecitr = 0; vecitr <= veclen; vecitr += 1 << FPSCR_LENGTH_BIT) {
         u32 except;
         char type;
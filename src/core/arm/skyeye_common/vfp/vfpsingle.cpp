@@ -58,6 +58,7 @@
 #include "core/arm/skyeye_common/vfp/vfp_helper.h"
 #include "core/arm/skyeye_common/vfp/asm_vfp.h"
 #include "core/arm/skyeye_common/vfp/vfp.h"
+#include "core/arm/skyeye_common/vfp/vfp_host.h"
 
 static struct vfp_single vfp_single_default_qnan = {
     255,
@@ -1250,6 +1251,20 @@ u32 vfp_single_cpdo(ARMul_State* state, u32 inst, u32 fpscr)
         goto invalid;
     }
 
+    if (veclen == 0) {
+        s32 result;
+        u32 host_exceptions;
+        if (vfp_single_cpdo_host(state, inst, fpscr, &result, &host_exceptions)) {
+#if VFP_VERIFY_HOST_RESULTS
+            u32 soft_exceptions = fop->fn(state, dest, sn, vfp_get_float(state, sm), fpscr);
+            vfp_verify_host_result(inst, fpscr, (u32)vfp_get_float(state, dest), soft_exceptions,
+                                   (u32)result, host_exceptions);
+#endif
+            vfp_put_float(state, result, dest);
+            return host_exceptions;
+        }
+    }
+
     for (vecitr = 0; vecitr <= veclen; vecitr += 1 << FPSCR_LENGTH_BIT) {
         s32 m = vfp_get_float(state, sm);
         u32 except;
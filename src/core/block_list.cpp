@@ -0,0 +1,146 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "common/common_paths.h"
+#include "common/common_types.h"
+#include "common/file_util.h"
+#include "common/hash.h"
+#include "common/logging/log.h"
+#include "common/string_util.h"
+
+#include "core/block_list.h"
+#include "core/core.h"
+#include "core/memory.h"
+#include "core/settings.h"
+#include "core/arm/arm_interface.h"
+#include "core/loader/loader.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace BlockList
+
+namespace BlockList {
+
+static const u32 LIST_MAGIC = Loader::MakeMagic('C', 'B', 'L', 'K');
+static const u32 LIST_VERSION = 1;
+
+struct ListHeader {
+    u32 magic;
+    u32 version;
+    u64 program_id;
+    /// Hash of the code the blocks were translated from
+    u64 code_hash;
+    u32 num_blocks;
+    u32 reserved;
+};
+static_assert(sizeof(ListHeader) == 32, "ListHeader has incorrect size");
+
+static bool recording = false;
+static u64 current_program_id;
+static u64 current_code_hash;
+static VAddr code_start;
+static VAddr code_end;
+/// Addresses of the blocks, with bit 0 set for Thumb blocks like in an interworking branch
+static std::unordered_set<u32> blocks;
+
+static std::string GetListDir() {
+    return FileUtil::GetUserPath(D_CACHE_IDX) + "blocks" DIR_SEP;
+}
+
+static std::string GetListPath(u64 program_id) {
+    return GetListDir() + Common::StringFromFormat("%016llX.bin", program_id);
+}
+
+/// Reads the list of an earlier boot, which is dropped if it was made from different code
+static std::vector<u32> ReadList(const std::string& path) {
+    FileUtil::IOFile file(path, "rb");
+    ListHeader header;
+    if (!file.IsOpen() || !file.ReadArray(&header, 1))
+        return {};
+
+    if (header.magic != LIST_MAGIC || header.version != LIST_VERSION ||
+            header.program_id != current_program_id || header.code_hash != current_code_hash) {
+        LOG_INFO(Core, "Block list %s is outdated, starting a new one", path.c_str());
+        return {};
+    }
+
+    std::vector<u32> list(header.num_blocks);
+    if (file.ReadArray(list.data(), list.size()) != list.size()) {
+        LOG_WARNING(Core, "Block list %s is truncated", path.c_str());
+        return {};
+    }
+    return list;
+}
+
+static void WriteList(const std::string& path) {
+    if (!FileUtil::CreateFullPath(GetListDir())) {
+        LOG_WARNING(Core, "Failed to create the block list directory");
+        return;
+    }
+
+    std::vector<u32> list(blocks.begin(), blocks.end());
+    std::sort(list.begin(), list.end());
+
+    ListHeader header = {};
+    header.magic = LIST_MAGIC;
+    header.version = LIST_VERSION;
+    header.program_id = current_program_id;
+    header.code_hash = current_code_hash;
+    header.num_blocks = (u32)list.size();
+
+    // A partially written file is rejected by ReadList for its size
+    FileUtil::IOFile file(path, "wb");
+    if (!file.IsOpen() || !file.WriteArray(&header, 1) ||
+            file.WriteArray(list.data(), list.size()) != list.size())
+        LOG_WARNING(Core, "Failed to write %s", path.c_str());
+}
+
+void Init(u64 program_id, VAddr code_address, u32 code_size) {
+    if (!Settings::values.persist_cpu_blocks || code_size == 0)
+        return;
+
+    const u8* code = Memory::GetPointer(code_address);
+    if (code == nullptr)
+        return;
+
+    current_program_id = program_id;
+    current_code_hash = Common::ComputeHash64(code, code_size);
+    code_start = code_address;
+    code_end = code_address + code_size;
+    blocks.clear();
+
+    // Blocks that don't belong to the code anymore are dropped when the list is written again
+    for (u32 entry : ReadList(GetListPath(program_id))) {
+        const VAddr pc = entry & ~1;
+        if (pc < code_start || pc >= code_end)
+            continue;
+        Core::g_app_core->TranslateBlock(pc, (entry & 1) != 0);
+        blocks.insert(entry);
+    }
+    if (!blocks.empty())
+        LOG_INFO(Core, "Translated %u blocks of earlier boots ahead of time", (unsigned)blocks.size());
+
+    recording = true;
+}
+
+void Shutdown() {
+    if (!recording)
+        return;
+
+    recording = false;
+    WriteList(GetListPath(current_program_id));
+    blocks.clear();
+}
+
+void RecordBlock(u32 pc, bool thumb) {
+    if (!recording || pc < code_start || pc >= code_end)
+        return;
+    blocks.insert(pc | (thumb ? 1 : 0));
+}
+
+} // namespace
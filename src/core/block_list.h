@@ -0,0 +1,41 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace BlockList
+
+/**
+ * Per title lists of the blocks of code the CPU translated, kept in the cache directory so that
+ * later boots of the title can translate them ahead of time instead of while the game is played.
+ * Only the guest addresses of the blocks are stored: the translations themselves are made of host
+ * pointers and are rebuilt at load time. A list is tied to the title and to a hash of its code, an
+ * update of the title starts a new one.
+ */
+namespace BlockList {
+
+/**
+ * Translates the blocks listed for the title by its earlier boots, then starts recording the blocks
+ * translated from its code. Called by the loader once the code is in memory.
+ * @param program_id Program ID of the title
+ * @param code_address Address the code was loaded to
+ * @param code_size Size of the code in bytes
+ */
+void Init(u64 program_id, VAddr code_address, u32 code_size);
+
+/// Writes the list of the running title and stops recording
+void Shutdown();
+
+/**
+ * Adds a block to the list of the running title, if it was translated from the title's code.
+ * Called by the CPU cores whenever they translate a block.
+ * @param pc Guest address of the first instruction of the block
+ * @param thumb Whether the block consists of Thumb instructions
+ */
+void RecordBlock(u32 pc, bool thumb);
+
+} // namespace
@@ -0,0 +1,84 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstring>
+
+#include "common/common_paths.h"
+#include "common/file_util.h"
+#include "common/hash.h"
+#include "common/logging/log.h"
+#include "common/mapped_file.h"
+#include "common/scm_rev.h"
+#include "common/string_util.h"
+
+#include "core/boot_snapshot.h"
+#include "core/savestate.h"
+#include "core/hle/kernel/process.h"
+#include "core/hw/gpu.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace BootSnapshot
+
+namespace BootSnapshot {
+
+/// Whether the snapshot is still to be saved
+static bool pending = false;
+static u64 snapshot_frame;
+static std::string snapshot_path;
+
+static u64 GetBuildId() {
+    return Common::ComputeHash64(Common::g_scm_rev, std::strlen(Common::g_scm_rev));
+}
+
+bool Start(const std::string& boot_filename, u64 frame) {
+    pending = false;
+
+    // A title's files may be replaced without its program id changing, e.g. by an update
+    Common::MappedFile file;
+    if (!file.Open(boot_filename)) {
+        LOG_ERROR(Core, "Can't read %s to look up its boot snapshot", boot_filename.c_str());
+        return false;
+    }
+    const u64 content_hash = Common::ComputeHash64(file.Data(), file.Size());
+    const u64 program_id = Kernel::g_current_process->program_id;
+
+    const std::string directory = FileUtil::GetUserPath(D_STATESAVES_IDX) + "boot" DIR_SEP;
+    snapshot_path = directory + Common::StringFromFormat("%016llX-%016llX-%016llX.cst",
+            (unsigned long long)program_id, (unsigned long long)content_hash,
+            (unsigned long long)GetBuildId());
+
+    if (FileUtil::Exists(snapshot_path)) {
+        if (SaveState::Load(snapshot_path)) {
+            LOG_INFO(Core, "Resumed from the boot snapshot %s at frame %llu", snapshot_path.c_str(),
+                     (unsigned long long)GPU::GetFrameCount());
+            return true;
+        }
+        LOG_WARNING(Core, "Boot snapshot %s was rejected, it's saved again", snapshot_path.c_str());
+    }
+
+    if (!FileUtil::CreateFullPath(directory)) {
+        LOG_ERROR(Core, "Can't create the directory of the boot snapshots %s", directory.c_str());
+        return false;
+    }
+    snapshot_frame = frame;
+    pending = true;
+    return false;
+}
+
+void OnFrame() {
+    if (!pending || GPU::GetFrameCount() < snapshot_frame)
+        return;
+
+    // Saved before the CPU runs again, once nothing is in flight that a state can't describe
+    SaveState::RequestSave(snapshot_path);
+    pending = false;
+    LOG_INFO(Core, "Saving the boot snapshot %s at frame %llu", snapshot_path.c_str(),
+             (unsigned long long)GPU::GetFrameCount());
+}
+
+void Shutdown() {
+    pending = false;
+}
+
+} // namespace
@@ -0,0 +1,38 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace BootSnapshot
+
+/**
+ * Save states of titles past their boot, logo and intro sequences, for later runs to start from
+ * instead of emulating those again. The first run of a title saves the snapshot once it reaches a
+ * given frame, the runs after it resume from there. Snapshots are kept in the state saves
+ * directory, keyed by the program id and a hash of the contents of the title and by the build,
+ * since a state can only be loaded by the build that saved it.
+ */
+namespace BootSnapshot {
+
+/**
+ * Resumes the booted title from its snapshot, or arranges for the snapshot to be saved. To be
+ * called on the emulation thread after the title was loaded, before the CPU runs.
+ * @param boot_filename File the title was loaded from, its contents are part of the key
+ * @param frame Number of VBlanks after which the snapshot is saved
+ * @return Whether the title resumed from its snapshot
+ */
+bool Start(const std::string& boot_filename, u64 frame);
+
+/// Saves the snapshot once its frame is reached. Called on VBlank.
+void OnFrame();
+
+/// Forgets the pending snapshot, when the emulated system is shut down
+void Shutdown();
+
+} // namespace
@@ -0,0 +1,232 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/logging/log.h"
+
+#include "core/breakpoints.h"
+#include "core/core.h"
+#include "core/memory.h"
+#include "core/memory_setup.h"
+#include "core/mmio.h"
+#include "core/arm/arm_interface.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace Breakpoints
+
+namespace Breakpoints {
+
+struct Watchpoint {
+    VAddr start;
+    u32 size;
+    bool on_read;
+    bool on_write;
+};
+
+static std::unordered_set<VAddr> code_breakpoints;
+
+struct BreakpointRequest {
+    VAddr address;
+    bool add;
+};
+
+static std::mutex request_mutex;
+static std::atomic<bool> request_pending(false);
+static std::vector<BreakpointRequest> requests;
+
+/// Address execution is resuming from, whose breakpoint is ignored once
+static VAddr resume_address;
+static bool resuming = false;
+static bool hit = false;
+
+static std::vector<Watchpoint> watchpoints;
+/// Host memory backing each page diverted to the watch region, by page number
+static std::unordered_map<u32, u8*> watched_pages;
+
+/// Performs the accesses to the watched pages on their memory, after checking the watchpoints
+class WatchRegion final : public Memory::MMIORegion {
+public:
+    u8 Read8(VAddr addr) override { return Read<u8>(addr); }
+    u16 Read16(VAddr addr) override { return Read<u16>(addr); }
+    u32 Read32(VAddr addr) override { return Read<u32>(addr); }
+    u64 Read64(VAddr addr) override { return Read<u64>(addr); }
+
+    void Write8(VAddr addr, u8 data) override { Write<u8>(addr, data); }
+    void Write16(VAddr addr, u16 data) override { Write<u16>(addr, data); }
+    void Write32(VAddr addr, u32 data) override { Write<u32>(addr, data); }
+    void Write64(VAddr addr, u64 data) override { Write<u64>(addr, data); }
+
+private:
+    template <typename T>
+    T Read(VAddr addr) {
+        Check(addr, sizeof(T), false);
+        return *reinterpret_cast<const T*>(GetHostPointer(addr));
+    }
+
+    template <typename T>
+    void Write(VAddr addr, T data) {
+        Check(addr, sizeof(T), true);
+        *reinterpret_cast<T*>(GetHostPointer(addr)) = data;
+        Memory::InvalidateCodeRange(addr, sizeof(T));
+    }
+
+    static u8* GetHostPointer(VAddr addr) {
+        return watched_pages.at(addr >> Memory::PAGE_BITS) + (addr & Memory::PAGE_MASK);
+    }
+
+    static void Check(VAddr addr, u32 size, bool write) {
+        for (const Watchpoint& watchpoint : watchpoints) {
+            if ((write ? watchpoint.on_write : watchpoint.on_read) &&
+                    addr < watchpoint.start + watchpoint.size && watchpoint.start < addr + size) {
+                LOG_INFO(Debug_Breakpoint, "Watchpoint at 0x%08X hit by a %u byte %s @ 0x%08X",
+                         watchpoint.start, size, write ? "write" : "read", addr);
+                ReportHit();
+                // The access completes, the CPU stops at the end of the block
+                Core::g_app_core->PrepareReschedule();
+                return;
+            }
+        }
+    }
+};
+
+static WatchRegion watch_region;
+
+void AddCodeBreakpoint(VAddr address) {
+    std::lock_guard<std::mutex> lock(request_mutex);
+    requests.push_back({ address, true });
+    request_pending = true;
+}
+
+void RemoveCodeBreakpoint(VAddr address) {
+    std::lock_guard<std::mutex> lock(request_mutex);
+    requests.push_back({ address, false });
+    request_pending = true;
+}
+
+void ProcessRequests() {
+    if (!request_pending)
+        return;
+
+    std::lock_guard<std::mutex> lock(request_mutex);
+    for (const BreakpointRequest& request : requests) {
+        const bool changed = request.add ? code_breakpoints.insert(request.address).second
+                                         : code_breakpoints.erase(request.address) != 0;
+        // Code translated before a breakpoint was set doesn't stop at it, and blocks that were
+        // ended early for a removed breakpoint can be translated in one piece again
+        if (changed)
+            Memory::InvalidateCodeRange(request.address, 4);
+    }
+    requests.clear();
+    request_pending = false;
+}
+
+bool HasCodeBreakpoint(VAddr address) {
+    return !code_breakpoints.empty() && code_breakpoints.count(address) != 0;
+}
+
+void ResumeFrom(VAddr address) {
+    if (!HasCodeBreakpoint(address))
+        return;
+    resume_address = address;
+    resuming = true;
+}
+
+bool ConsumeResume(VAddr address) {
+    if (!resuming || resume_address != address)
+        return false;
+    resuming = false;
+    return true;
+}
+
+void ReportHit() {
+    hit = true;
+}
+
+/// Whether a page is covered by any watchpoint
+static bool IsPageWatched(u32 page) {
+    return std::any_of(watchpoints.begin(), watchpoints.end(), [page](const Watchpoint& watchpoint) {
+        return page >= (watchpoint.start >> Memory::PAGE_BITS) &&
+               page <= ((watchpoint.start + watchpoint.size - 1) >> Memory::PAGE_BITS);
+    });
+}
+
+/// Maps a watched page back to its memory
+static void RestorePage(u32 page) {
+    const VAddr address = page << Memory::PAGE_BITS;
+    Memory::UnmapRegion(address, Memory::PAGE_SIZE);
+    Memory::MapMemoryRegion(address, Memory::PAGE_SIZE, watched_pages[page]);
+    watched_pages.erase(page);
+}
+
+bool AddWatchpoint(VAddr start, u32 size, bool on_read, bool on_write) {
+    if (size == 0)
+        return false;
+
+    // Accesses through the fastmem view never reach the page table
+    if (Memory::GetFastmemBase() != nullptr) {
+        LOG_ERROR(Debug_Breakpoint, "Watchpoints are unavailable with fastmem enabled");
+        return false;
+    }
+
+    const u32 first_page = start >> Memory::PAGE_BITS;
+    const u32 last_page = (start + size - 1) >> Memory::PAGE_BITS;
+    for (u32 page = first_page; page <= last_page; ++page) {
+        if (watched_pages.count(page) == 0 && Memory::GetPointer(page << Memory::PAGE_BITS) == nullptr) {
+            LOG_ERROR(Debug_Breakpoint, "Can't watch 0x%08X-0x%08X, it isn't backed by memory", start, start + size);
+            return false;
+        }
+    }
+
+    for (u32 page = first_page; page <= last_page; ++page) {
+        if (watched_pages.count(page) != 0)
+            continue;
+        const VAddr address = page << Memory::PAGE_BITS;
+        watched_pages[page] = Memory::GetPointer(address);
+        Memory::UnmapRegion(address, Memory::PAGE_SIZE);
+        Memory::MapIoRegion(address, Memory::PAGE_SIZE, &watch_region);
+    }
+
+    watchpoints.push_back({ start, size, on_read, on_write });
+    return true;
+}
+
+void RemoveWatchpoint(VAddr start) {
+    auto itr = std::find_if(watchpoints.begin(), watchpoints.end(), [start](const Watchpoint& watchpoint) {
+        return watchpoint.start == start;
+    });
+    if (itr == watchpoints.end())
+        return;
+
+    const u32 first_page = itr->start >> Memory::PAGE_BITS;
+    const u32 last_page = (itr->start + itr->size - 1) >> Memory::PAGE_BITS;
+    watchpoints.erase(itr);
+
+    for (u32 page = first_page; page <= last_page; ++page) {
+        if (!IsPageWatched(page))
+            RestorePage(page);
+    }
+}
+
+bool ConsumeHit() {
+    const bool was_hit = hit;
+    hit = false;
+    return was_hit;
+}
+
+void Shutdown() {
+    watchpoints.clear();
+    while (!watched_pages.empty())
+        RestorePage(watched_pages.begin()->first);
+    resuming = false;
+    hit = false;
+}
+
+} // namespace
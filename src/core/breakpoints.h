@@ -0,0 +1,67 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace Breakpoints
+
+/**
+ * CPU breakpoints and memory watchpoints that don't slow down the code that doesn't hit them.
+ *
+ * Setting a code breakpoint discards the code translated from its page. The translators only look
+ * at the breakpoints when translating: blocks end before an instruction with a breakpoint, and a
+ * block starting at a breakpoint is never cached, so that entering it always goes through the
+ * translator, which stops the CPU instead.
+ *
+ * Watchpoints turn the pages they cover into I/O pages whose handler checks the accesses before
+ * performing them on the memory backing the page. They aren't available with fastmem.
+ *
+ * Code breakpoints can be set from any thread, they take effect at the next ProcessRequests. The
+ * other functions are to be called from the emulation thread, or while it is paused.
+ */
+namespace Breakpoints {
+
+void AddCodeBreakpoint(VAddr address);
+void RemoveCodeBreakpoint(VAddr address);
+
+/// Applies the code breakpoints set since the last call. Called before running the CPU.
+void ProcessRequests();
+
+/// Whether there is a breakpoint on the instruction at the given address. Called by the translators.
+bool HasCodeBreakpoint(VAddr address);
+
+/**
+ * Lets the CPU run the instruction at the given address once, even if it has a breakpoint. Called
+ * with the PC before resuming or stepping, does nothing if there is no breakpoint at the address.
+ */
+void ResumeFrom(VAddr address);
+
+/**
+ * Checks whether execution is resuming from the breakpoint at the given address, in which case the
+ * translator runs the instruction instead of stopping before it. Only succeeds once per ResumeFrom.
+ */
+bool ConsumeResume(VAddr address);
+
+/// Flags a breakpoint or watchpoint as hit, to be reported by ConsumeHit
+void ReportHit();
+
+/**
+ * Watches the accesses to a range of memory. The CPU stops after an access that matches.
+ * @return false if the range isn't backed by memory, or if fastmem is enabled
+ */
+bool AddWatchpoint(VAddr start, u32 size, bool on_read, bool on_write);
+
+/// Removes the watchpoint starting at the given address
+void RemoveWatchpoint(VAddr start);
+
+/// Returns whether a breakpoint or watchpoint was hit since the last call, and clears the hit
+bool ConsumeHit();
+
+/// Removes the watchpoints when the emulated system is shut down. Code breakpoints are kept.
+void Shutdown();
+
+} // namespace
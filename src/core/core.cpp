@@ -2,18 +2,28 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+
 #include "common/common_types.h"
 #include "common/logging/log.h"
 
+#include "core/breakpoints.h"
 #include "core/core.h"
 #include "core/core_timing.h"
+#include "core/rewind.h"
+#include "core/savestate.h"
 
 #include "core/settings.h"
 #include "core/arm/arm_interface.h"
 #include "core/arm/disassembler/arm_disasm.h"
 #include "core/arm/dyncom/arm_dyncom.h"
+#include "core/arm/dyncom/arm_dyncom_interpreter.h"
+#include "core/arm/dyncom/arm_dyncom_profile.h"
+#include "core/arm/jit/arm_jit.h"
+#include "core/hle/function_hooks.h"
 #include "core/hle/hle.h"
 #include "core/hle/kernel/thread.h"
+#include "core/hw/gpu.h"
 #include "core/hw/hw.h"
 
 namespace Core {
@@ -23,6 +33,9 @@ ARM_Interface*     g_sys_core = nullptr;  ///< ARM11 system (OS) core
 
 /// Run the core CPU loop
 void RunLoop(int tight_loop) {
+    Breakpoints::ProcessRequests();
+    FunctionHooks::ProcessRequests();
+
     // If we don't have a currently active thread then don't execute instructions,
     // instead advance to the next event and try to yield to the next thread
     if (Kernel::GetCurrentThread() == nullptr) {
@@ -31,13 +44,29 @@ void RunLoop(int tight_loop) {
         CoreTiming::Advance();
         HLE::Reschedule(__func__);
     } else {
-        g_app_core->Run(tight_loop);
+        // Stop at the end of the slice instead of overshooting the next event
+        const s64 slice_remaining = std::max<s64>(g_app_core->down_count, 1);
+        g_app_core->Run((int)std::min<s64>(tight_loop, slice_remaining));
     }
 
     HW::Update();
     if (HLE::g_reschedule) {
         Kernel::Reschedule();
     }
+
+    // Between two runs of the CPU nothing is left half done, states are captured and restored here
+    SaveState::ProcessRequests();
+    Rewind::ProcessRequests();
+}
+
+bool RunFrame() {
+    const u64 frame = GPU::GetFrameCount();
+    while (GPU::GetFrameCount() == frame) {
+        RunLoop();
+        if (Breakpoints::ConsumeHit())
+            return true;
+    }
+    return false;
 }
 
 /// Step the CPU one instruction
@@ -58,15 +87,39 @@ void Stop() {
 /// Initialize the core
 int Init() {
     g_sys_core = new ARM_DynCom(USER32MODE);
+#if defined(__x86_64__) || defined(_M_X64)
+    if (Settings::values.use_cpu_jit) {
+        g_app_core = new ARM_JIT(USER32MODE);
+    } else {
+        g_app_core = new ARM_DynCom(USER32MODE);
+    }
+#else
+    if (Settings::values.use_cpu_jit)
+        LOG_WARNING(Core, "The CPU JIT is only available on x86-64 hosts, using the interpreter");
     g_app_core = new ARM_DynCom(USER32MODE);
+#endif
+
+    GetExecutionProfile().SetEnabled(Settings::values.profile_cpu);
+    ResetIdleLoopStatistics();
 
     LOG_DEBUG(Core, "Initialized OK");
     return 0;
 }
 
-void Shutdown() {
+void Shutdown(bool keep_host_resources) {
+    const IdleLoopStatistics& idle_loops = GetIdleLoopStatistics();
+    LOG_INFO(Core_ARM11, "Idle loops: skipped %llu cycles in %llu loops",
+             (unsigned long long)idle_loops.cycles_skipped, (unsigned long long)idle_loops.loops_skipped);
+
+    SaveState::Shutdown();
+
     delete g_app_core;
     delete g_sys_core;
+    g_app_core = g_sys_core = nullptr;
+#if defined(__x86_64__) || defined(_M_X64)
+    if (!keep_host_resources)
+        ARM_JIT::FreeSpareCodeBuffer();
+#endif
 
     LOG_DEBUG(Core, "Shutdown OK");
 }
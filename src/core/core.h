@@ -38,9 +38,16 @@ void Start();
  * required to do a full dispatch with each instruction. NOTE: the number of instructions requested
  * is not guaranteed to run, as this will be interrupted preemptively if a hardware update is
  * requested (e.g. on a thread switch).
+ * The run is cut short when the current CoreTiming slice ends earlier, so that events fire on time.
  */
 void RunLoop(int tight_loop=1000);
 
+/**
+ * Runs the core until the next VBlank, or until a breakpoint or watchpoint is hit
+ * @return true if the run stopped at a breakpoint or watchpoint
+ */
+bool RunFrame();
+
 /// Step the CPU one instruction
 void SingleStep();
 
@@ -53,7 +60,11 @@ void Stop();
 /// Initialize the core
 int Init();
 
-/// Shutdown the core
-void Shutdown();
+/**
+ * Shutdown the core
+ * @param keep_host_resources Whether to keep the JIT's code buffer for the next Init, when the
+ *                            emulated system is only reset
+ */
+void Shutdown(bool keep_host_resources = false);
 
 } // namespace
@@ -2,23 +2,33 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <cstddef>
 #include <cstdio>
-#include <mutex>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #include "common/assert.h"
 #include "common/chunk_file.h"
+#include "common/math_util.h"
+#include "common/profiler.h"
 
 #include "core/arm/arm_interface.h"
 #include "core/core.h"
 #include "core/core_timing.h"
+#include "core/settings.h"
 
 int g_clock_rate_arm11 = 268123480;
 
 // is this really necessary?
 #define INITIAL_SLICE_LENGTH 20000
 #define MAX_SLICE_LENGTH 100000000
+#define MIN_MAX_SLICE_LENGTH 1000
 
 namespace CoreTiming
 {
@@ -42,28 +52,116 @@ struct BaseEvent
     int type;
 };
 
-typedef LinkedListItem<BaseEvent> Event;
+/// An event in the main queue. Events scheduled for the same time fire in the order they were
+/// scheduled in, which is what fifo_order keeps track of.
+struct QueuedEvent
+{
+    s64 time;
+    u64 fifo_order;
+    u64 userdata;
+    int type;
+};
+
+static bool operator>(const QueuedEvent& left, const QueuedEvent& right) {
+    return std::tie(left.time, left.fifo_order) > std::tie(right.time, right.fifo_order);
+}
 
-static Event* first;
-static Event* ts_first;
-static Event* ts_last;
+/// Main event queue, a binary min-heap on (time, fifo_order). The next event is at the front.
+static std::vector<QueuedEvent> event_queue;
+static u64 event_fifo_id;
 
-// event pools
-static Event* event_pool = nullptr;
-static Event* event_ts_pool = nullptr;
-static int allocated_ts_events = 0;
+/**
+ * Queue of events scheduled from other threads, drained into the main queue by MoveEvents on the
+ * CPU thread. This is a bounded lock-free multi-producer single-consumer ring buffer (after Dmitry
+ * Vyukov's bounded MPMC queue): each slot has a sequence number telling producers whether the slot
+ * is free and the consumer whether it has been filled, in the current lap around the ring.
+ */
+class ThreadsafeEventQueue {
+public:
+    ThreadsafeEventQueue() {
+        Reset();
+    }
+
+    /// Empties the queue. Must not be called concurrently with Push or Pop.
+    void Reset() {
+        for (size_t i = 0; i < CAPACITY; ++i)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+        head = 0;
+    }
+
+    /// Adds an event to the queue. May be called from any thread.
+    void Push(const BaseEvent& event) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[position & (CAPACITY - 1)];
+            const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t difference = (std::ptrdiff_t)sequence - (std::ptrdiff_t)position;
+            if (difference == 0) {
+                // The slot is free, try to claim it
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.event = event;
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return;
+                }
+            } else if (difference < 0) {
+                // The queue is full, wait for the CPU thread to drain it
+                std::this_thread::yield();
+                position = tail.load(std::memory_order_relaxed);
+            } else {
+                // Another producer claimed the slot first
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Takes the oldest event off the queue. Must only be called from the CPU thread.
+     * @return false if the queue is empty, or the oldest event is still being written
+     */
+    bool Pop(BaseEvent& event) {
+        Slot& slot = slots[head & (CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+            return false;
+
+        event = slot.event;
+        slot.sequence.store(head + CAPACITY, std::memory_order_release);
+        ++head;
+        return true;
+    }
+
+private:
+    /// Number of slots, must be a power of two
+    static const size_t CAPACITY = 1024;
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        BaseEvent event;
+    };
+
+    std::array<Slot, CAPACITY> slots;
+    /// Position the next event will be pushed to
+    std::atomic<size_t> tail;
+    /// Position of the next event to pop, only accessed by the consumer
+    size_t head;
+};
+
+static ThreadsafeEventQueue ts_queue;
 // Optimization to skip MoveEvents when possible.
 static std::atomic<bool> has_ts_events(false);
 
 int g_slice_length;
+/// Longest slice to run without checking for events, from the settings
+static int max_slice_length;
+
+static Common::Profiling::SampleCategory profile_slices("CPU slice length (cycles)",
+                                                        "CoreTiming::Advance calls");
 
 static s64 global_timer;
 static s64 idled_cycles;
 static s64 last_global_time_ticks;
 static s64 last_global_time_us;
 
-static std::recursive_mutex external_event_section;
-
 // Warning: not included in save state.
 using AdvanceCallback = void(int cycles_executed);
 static AdvanceCallback* advance_callback = nullptr;
@@ -97,37 +195,6 @@ u64 GetGlobalTimeUs() {
     return last_global_time_us + us_since_last;
 }
 
-static Event* GetNewEvent() {
-    if (!event_pool)
-        return new Event;
-
-    Event* event = event_pool;
-    event_pool = event->next;
-    return event;
-}
-
-static Event* GetNewTsEvent() {
-    allocated_ts_events++;
-
-    if (!event_ts_pool)
-        return new Event;
-
-    Event* event = event_ts_pool;
-    event_ts_pool = event->next;
-    return event;
-}
-
-static void FreeEvent(Event* event) {
-    event->next = event_pool;
-    event_pool = event;
-}
-
-static void FreeTsEvent(Event* event) {
-    event->next = event_ts_pool;
-    event_ts_pool = event;
-    allocated_ts_events--;
-}
-
 int RegisterEvent(const char* name, TimedCallback callback) {
     event_types.emplace_back(callback, name);
     return (int)event_types.size() - 1;
@@ -146,14 +213,20 @@ void RestoreRegisterEvent(int event_type, const char* name, TimedCallback callba
 }
 
 void UnregisterAllEvents() {
-    if (first)
+    if (!event_queue.empty())
         LOG_ERROR(Core_Timing, "Cannot unregister events with events pending");
     event_types.clear();
 }
 
+void ReloadSettings() {
+    max_slice_length = MathUtil::Clamp(Settings::values.max_slice_length, MIN_MAX_SLICE_LENGTH,
+                                       MAX_SLICE_LENGTH);
+}
+
 void Init() {
     Core::g_app_core->down_count = INITIAL_SLICE_LENGTH;
     g_slice_length = INITIAL_SLICE_LENGTH;
+    ReloadSettings();
     global_timer = 0;
     idled_cycles = 0;
     last_global_time_ticks = 0;
@@ -161,13 +234,9 @@ void Init() {
     has_ts_events = 0;
     mhz_change_callbacks.clear();
 
-    first = nullptr;
-    ts_first = nullptr;
-    ts_last = nullptr;
-
-    event_pool = nullptr;
-    event_ts_pool = nullptr;
-    allocated_ts_events = 0;
+    event_queue.clear();
+    event_fifo_id = 0;
+    ts_queue.Reset();
 
     advance_callback = nullptr;
 }
@@ -176,19 +245,6 @@ void Shutdown() {
     MoveEvents();
     ClearPendingEvents();
     UnregisterAllEvents();
-
-    while (event_pool) {
-        Event* event = event_pool;
-        event_pool = event->next;
-        delete event;
-    }
-
-    std::lock_guard<std::recursive_mutex> lock(external_event_section);
-    while (event_ts_pool) {
-        Event* event = event_ts_pool;
-        event_ts_pool = event->next;
-        delete event;
-    }
 }
 
 u64 GetTicks() {
@@ -203,19 +259,15 @@ u64 GetIdleTicks() {
 // This is to be called when outside threads, such as the graphics thread, wants to
 // schedule things to be executed on the main thread.
 void ScheduleEvent_Threadsafe(s64 cycles_into_future, int event_type, u64 userdata) {
-    std::lock_guard<std::recursive_mutex> lock(external_event_section);
-    Event* new_event = GetNewTsEvent();
-    new_event->time = GetTicks() + cycles_into_future;
-    new_event->type = event_type;
-    new_event->next = 0;
-    new_event->userdata = userdata;
-    if (!ts_first)
-        ts_first = new_event;
-    if (ts_last)
-        ts_last->next = new_event;
-    ts_last = new_event;
+    BaseEvent new_event;
+    new_event.time = GetTicks() + cycles_into_future;
+    new_event.type = event_type;
+    new_event.userdata = userdata;
+    ts_queue.Push(new_event);
 
-    has_ts_events = true;
+    // This has to be a read-modify-write, so that MoveEvents synchronizes with every producer
+    // that set the flag since it was last cleared, not only with the last one.
+    has_ts_events.exchange(true, std::memory_order_release);
 }
 
 // Same as ScheduleEvent_Threadsafe(0, ...) EXCEPT if we are already on the CPU thread
@@ -223,7 +275,6 @@ void ScheduleEvent_Threadsafe(s64 cycles_into_future, int event_type, u64 userda
 void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata) {
     if (false) //Core::IsCPUThread())
     {
-        std::lock_guard<std::recursive_mutex> lock(external_event_section);
         event_types[event_type].callback(userdata, 0);
     }
     else
@@ -231,115 +282,60 @@ void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata) {
 }
 
 void ClearPendingEvents() {
-    while (first) {
-        Event* event = first->next;
-        FreeEvent(first);
-        first = event;
-    }
+    event_queue.clear();
 }
 
-static void AddEventToQueue(Event* new_event) {
-    Event* prev_event = nullptr;
-    Event** next_event = &first;
-    for (;;) {
-        Event*& next = *next_event;
-        if (!next || new_event->time < next->time) {
-            new_event->next = next;
-            next = new_event;
-            break;
-        }
-        prev_event = next;
-        next_event = &prev_event->next;
-    }
+static void AddEventToQueue(s64 time, int event_type, u64 userdata) {
+    QueuedEvent new_event;
+    new_event.time = time;
+    new_event.fifo_order = event_fifo_id++;
+    new_event.userdata = userdata;
+    new_event.type = event_type;
+    event_queue.push_back(new_event);
+    std::push_heap(event_queue.begin(), event_queue.end(), std::greater<QueuedEvent>());
+}
+
+/// Removes all events matching a predicate from the main queue
+template <typename Predicate>
+static void RemoveQueuedEvents(Predicate predicate) {
+    auto new_end = std::remove_if(event_queue.begin(), event_queue.end(), predicate);
+    if (new_end == event_queue.end())
+        return;
+
+    event_queue.erase(new_end, event_queue.end());
+    std::make_heap(event_queue.begin(), event_queue.end(), std::greater<QueuedEvent>());
 }
 
 void ScheduleEvent(s64 cycles_into_future, int event_type, u64 userdata) {
-    Event* new_event = GetNewEvent();
-    new_event->userdata = userdata;
-    new_event->type = event_type;
-    new_event->time = GetTicks() + cycles_into_future;
-    AddEventToQueue(new_event);
+    AddEventToQueue(GetTicks() + cycles_into_future, event_type, userdata);
 }
 
 s64 UnscheduleEvent(int event_type, u64 userdata) {
-    s64 result = 0;
-    if (!first)
-        return result;
-    while (first) {
-        if (first->type == event_type && first->userdata == userdata) {
-            result = first->time - GetTicks();
-
-            Event* next = first->next;
-            FreeEvent(first);
-            first = next;
-        } else {
-            break;
-        }
-    }
-    if (!first)
-        return result;
-
-    Event* prev_event = first;
-    Event* ptr = prev_event->next;
-
-    while (ptr) {
-        if (ptr->type == event_type && ptr->userdata == userdata) {
-            result = ptr->time - GetTicks();
-
-            prev_event->next = ptr->next;
-            FreeEvent(ptr);
-            ptr = prev_event->next;
-        } else {
-            prev_event = ptr;
-            ptr = ptr->next;
+    auto matches = [event_type, userdata](const QueuedEvent& event) {
+        return event.type == event_type && event.userdata == userdata;
+    };
+
+    // If there are several matching events, report the time left until the last of them
+    bool found = false;
+    s64 last_time = 0;
+    for (const QueuedEvent& event : event_queue) {
+        if (matches(event) && (!found || event.time > last_time)) {
+            last_time = event.time;
+            found = true;
         }
     }
+    if (!found)
+        return 0;
 
-    return result;
+    RemoveQueuedEvents(matches);
+    return last_time - GetTicks();
 }
 
 s64 UnscheduleThreadsafeEvent(int event_type, u64 userdata) {
-    s64 result = 0;
-    std::lock_guard<std::recursive_mutex> lock(external_event_section);
-    if (!ts_first)
-        return result;
-
-    while (ts_first) {
-        if (ts_first->type == event_type && ts_first->userdata == userdata) {
-            result = ts_first->time - GetTicks();
-
-            Event* next = ts_first->next;
-            FreeTsEvent(ts_first);
-            ts_first = next;
-        } else {
-            break;
-        }
-    }
-
-    if (!ts_first)
-    {
-        ts_last = nullptr;
-        return result;
-    }
-
-    Event* prev_event = ts_first;
-    Event* next = prev_event->next;
-    while (next) {
-        if (next->type == event_type && next->userdata == userdata) {
-            result = next->time - GetTicks();
-
-            prev_event->next = next->next;
-            if (next == ts_last)
-                ts_last = prev_event;
-            FreeTsEvent(next);
-            next = prev_event->next;
-        } else {
-            prev_event = next;
-            next = next->next;
-        }
-    }
-
-    return result;
+    // Events can't be taken out of the middle of the lock-free queue, so move them all into the
+    // main queue first. This has to be called from the CPU thread.
+    MoveEvents();
+    return UnscheduleEvent(event_type, userdata);
 }
 
 // Warning: not included in save state.
@@ -352,79 +348,21 @@ void RegisterMHzChangeCallback(MHzChangeCallback callback) {
 }
 
 bool IsScheduled(int event_type) {
-    if (!first)
-        return false;
-    Event* event = first;
-    while (event) {
-        if (event->type == event_type)
-            return true;
-        event = event->next;
-    }
-    return false;
+    return std::any_of(event_queue.begin(), event_queue.end(), [event_type](const QueuedEvent& event) {
+        return event.type == event_type;
+    });
 }
 
 void RemoveEvent(int event_type) {
-    if (!first)
-        return;
-    while (first) {
-        if (first->type == event_type) {
-            Event *next = first->next;
-            FreeEvent(first);
-            first = next;
-        } else {
-            break;
-        }
-    }
-    if (!first)
-        return;
-    Event* prev = first;
-    Event* next = prev->next;
-    while (next) {
-        if (next->type == event_type) {
-            prev->next = next->next;
-            FreeEvent(next);
-            next = prev->next;
-        } else {
-            prev = next;
-            next = next->next;
-        }
-    }
+    RemoveQueuedEvents([event_type](const QueuedEvent& event) {
+        return event.type == event_type;
+    });
 }
 
 void RemoveThreadsafeEvent(int event_type) {
-    std::lock_guard<std::recursive_mutex> lock(external_event_section);
-    if (!ts_first)
-        return;
-
-    while (ts_first) {
-        if (ts_first->type == event_type) {
-            Event* next = ts_first->next;
-            FreeTsEvent(ts_first);
-            ts_first = next;
-        } else {
-            break;
-        }
-    }
-
-    if (!ts_first) {
-        ts_last = nullptr;
-        return;
-    }
-
-    Event* prev = ts_first;
-    Event* next = prev->next;
-    while (next) {
-        if (next->type == event_type) {
-            prev->next = next->next;
-            if (next == ts_last)
-                ts_last = prev;
-            FreeTsEvent(next);
-            next = prev->next;
-        } else {
-            prev = next;
-            next = next->next;
-        }
-    }
+    // See UnscheduleThreadsafeEvent
+    MoveEvents();
+    RemoveEvent(event_type);
 }
 
 void RemoveAllEvents(int event_type) {
@@ -434,38 +372,24 @@ void RemoveAllEvents(int event_type) {
 
 // This raise only the events required while the fifo is processing data
 void ProcessFifoWaitEvents() {
-    while (first) {
-        if (first->time <= (s64)GetTicks()) {
-            Event* evt = first;
-            first = first->next;
-            event_types[evt->type].callback(evt->userdata, (int)(GetTicks() - evt->time));
-            FreeEvent(evt);
-        } else {
-            break;
-        }
+    while (!event_queue.empty() && event_queue.front().time <= (s64)GetTicks()) {
+        // Take the event off the queue before calling back, the callback may schedule new events
+        const QueuedEvent evt = event_queue.front();
+        std::pop_heap(event_queue.begin(), event_queue.end(), std::greater<QueuedEvent>());
+        event_queue.pop_back();
+        event_types[evt.type].callback(evt.userdata, (int)(GetTicks() - evt.time));
     }
 }
 
 void MoveEvents() {
-    has_ts_events = false;
+    // Producers set the flag after pushing, so clearing it before draining can't lose an event:
+    // one that is still being pushed sets it again when it's done.
+    has_ts_events.exchange(false, std::memory_order_acquire);
 
-    std::lock_guard<std::recursive_mutex> lock(external_event_section);
     // Move events from async queue into main queue
-    while (ts_first) {
-        Event* next = ts_first->next;
-        AddEventToQueue(ts_first);
-        ts_first = next;
-    }
-    ts_last = nullptr;
-
-    // Move free events to threadsafe pool
-    while (allocated_ts_events > 0 && event_pool) {
-        Event* event = event_pool;
-        event_pool = event->next;
-        event->next = event_ts_pool;
-        event_ts_pool = event;
-        allocated_ts_events--;
-    }
+    BaseEvent event;
+    while (ts_queue.Pop(event))
+        AddEventToQueue(event.time, event.type, event.userdata);
 }
 
 void ForceCheck() {
@@ -481,35 +405,89 @@ void Advance() {
     s64 cycles_executed = g_slice_length - Core::g_app_core->down_count;
     global_timer += cycles_executed;
     Core::g_app_core->down_count = g_slice_length;
+    profile_slices.AddSample(cycles_executed);
 
-    if (has_ts_events)
+    if (has_ts_events.load(std::memory_order_relaxed))
         MoveEvents();
     ProcessFifoWaitEvents();
 
-    if (!first) {
-        if (g_slice_length < 10000) {
-            g_slice_length += 10000;
-            Core::g_app_core->down_count += g_slice_length;
-        }
-    } else {
-        // Note that events can eat cycles as well.
-        int target = (int)(first->time - global_timer);
-        if (target > MAX_SLICE_LENGTH)
-            target = MAX_SLICE_LENGTH;
-
-        const int diff = target - g_slice_length;
-        g_slice_length += diff;
-        Core::g_app_core->down_count += diff;
-    }
+    // Run until the next event is due, but not longer than the configured maximum so that the CPU
+    // thread still checks for threadsafe events and returns to the frontend regularly.
+    // Note that events can eat cycles as well.
+    int target = max_slice_length;
+    if (!event_queue.empty())
+        target = (int)std::min<s64>(event_queue.front().time - global_timer, target);
+
+    const int diff = target - g_slice_length;
+    g_slice_length += diff;
+    Core::g_app_core->down_count += diff;
     if (advance_callback)
         advance_callback(cycles_executed);
 }
 
+/// Returns the index of an event type among the types of the same name, in registration order
+static u32 GetEventTypeOccurrence(int event_type) {
+    u32 occurrence = 0;
+    for (int i = 0; i < event_type; ++i) {
+        if (std::strcmp(event_types[i].name, event_types[event_type].name) == 0)
+            ++occurrence;
+    }
+    return occurrence;
+}
+
+/// Finds the event type registered with a name as the given occurrence of it, -1 if there is none
+static int FindEventType(const std::string& name, u32 occurrence) {
+    for (size_t i = 0; i < event_types.size(); ++i) {
+        if (name == event_types[i].name && occurrence-- == 0)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+void DoState(PointerWrap& p) {
+    MoveEvents();
+
+    u32 num_events = static_cast<u32>(event_queue.size());
+    p.Do(num_events);
+    std::vector<QueuedEvent> events = event_queue;
+    events.resize(num_events);
+    for (QueuedEvent& event : events) {
+        std::string name = (p.GetMode() != PointerWrap::MODE_READ) ? event_types[event.type].name : "";
+        u32 occurrence = (p.GetMode() != PointerWrap::MODE_READ) ? GetEventTypeOccurrence(event.type) : 0;
+        p.Do(event.time);
+        p.Do(event.fifo_order);
+        p.Do(event.userdata);
+        p.Do(name);
+        p.Do(occurrence);
+        if (p.GetMode() != PointerWrap::MODE_READ)
+            continue;
+
+        event.type = FindEventType(name, occurrence);
+        if (event.type < 0) {
+            LOG_ERROR(Core_Timing, "Save state has an event of the unknown type %s", name.c_str());
+            p.SetError(PointerWrap::ERROR_FAILURE);
+            return;
+        }
+    }
+    p.Do(event_fifo_id);
+
+    p.Do(global_timer);
+    p.Do(idled_cycles);
+    p.Do(last_global_time_ticks);
+    p.Do(last_global_time_us);
+    p.Do(g_slice_length);
+    p.Do(Core::g_app_core->down_count);
+    p.DoMarker("CoreTiming");
+
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        // The saved queue is a valid heap with the same ordering
+        event_queue = std::move(events);
+    }
+}
+
 void LogPendingEvents() {
-    Event* event = first;
-    while (event) {
-        //LOG_TRACE(Core_Timing, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, next->time, next->type);
-        event = event->next;
+    for (size_t i = 0; i < event_queue.size(); ++i) {
+        //LOG_TRACE(Core_Timing, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, event_queue[i].time, event_queue[i].type);
     }
 }
 
@@ -518,9 +496,9 @@ void Idle(int max_idle) {
     if (max_idle != 0 && cycles_down > max_idle)
         cycles_down = max_idle;
 
-    if (first && cycles_down > 0) {
+    if (!event_queue.empty() && cycles_down > 0) {
         s64 cycles_executed = g_slice_length - Core::g_app_core->down_count;
-        s64 cycles_next_event = first->time - global_timer;
+        s64 cycles_next_event = event_queue.front().time - global_timer;
 
         if (cycles_next_event < cycles_executed + cycles_down) {
             cycles_down = cycles_next_event - cycles_executed;
@@ -539,19 +517,23 @@ void Idle(int max_idle) {
 }
 
 std::string GetScheduledEventsSummary() {
-    Event* event = first;
+    // List the events in the order they will fire in
+    std::vector<QueuedEvent> events = event_queue;
+    std::sort(events.begin(), events.end(), [](const QueuedEvent& left, const QueuedEvent& right) {
+        return right > left;
+    });
+
     std::string text = "Scheduled events\n";
     text.reserve(1000);
-    while (event) {
-        unsigned int t = event->type;
+    for (const QueuedEvent& event : events) {
+        unsigned int t = event.type;
         if (t >= event_types.size())
             LOG_ERROR(Core_Timing, "Invalid event type"); // %i", t);
-        const char* name = event_types[event->type].name;
+        const char* name = event_types[event.type].name;
         if (!name)
             name = "[unknown]";
-        text += Common::StringFromFormat("%s : %i %08x%08x\n", name, (int)event->time,
-                (u32)(event->userdata >> 32), (u32)(event->userdata));
-        event = event->next;
+        text += Common::StringFromFormat("%s : %i %08x%08x\n", name, (int)event.time,
+                (u32)(event.userdata >> 32), (u32)(event.userdata));
     }
     return text;
 }
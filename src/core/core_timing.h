@@ -23,6 +23,8 @@
 
 #include "common/common_types.h"
 
+class PointerWrap;
+
 extern int g_clock_rate_arm11;
 
 inline s64 msToCycles(int ms) {
@@ -66,6 +68,9 @@ namespace CoreTiming
 void Init();
 void Shutdown();
 
+/// Reads the settings timing depends on again, after they were overridden for the booted title
+void ReloadSettings();
+
 typedef void(*MHzChangeCallback)();
 typedef std::function<void(u64 userdata, int cycles_late)> TimedCallback;
 
@@ -96,6 +101,7 @@ void UnregisterAllEvents();
  */
 void ScheduleEvent(s64 cycles_into_future, int event_type, u64 userdata = 0);
 
+/// Like ScheduleEvent, but can be called from any thread. Doesn't block the CPU thread.
 void ScheduleEvent_Threadsafe(s64 cycles_into_future, int event_type, u64 userdata = 0);
 void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata = 0);
 
@@ -107,6 +113,7 @@ void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata = 0);
  */
 s64 UnscheduleEvent(int event_type, u64 userdata);
 
+/// Unschedules events scheduled with ScheduleEvent_Threadsafe. Must be called from the CPU thread.
 s64 UnscheduleThreadsafeEvent(int event_type, u64 userdata);
 
 void RemoveEvent(int event_type);
@@ -127,6 +134,13 @@ void ClearPendingEvents();
 
 void LogPendingEvents();
 
+/**
+ * Saves or restores the time and the scheduled events. Events refer to their type by name, so that
+ * a state can be restored as long as the same event types have been registered. Must be called
+ * from the CPU thread, while no other thread schedules events.
+ */
+void DoState(PointerWrap& p);
+
 /// Warning: not included in save states.
 void RegisterAdvanceCallback(void(*callback)(int cycles_executed));
 void RegisterMHzChangeCallback(MHzChangeCallback callback);
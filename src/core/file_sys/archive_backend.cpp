@@ -4,6 +4,7 @@
 
 #include <sstream>
 
+#include "common/chunk_file.h"
 #include "common/logging/log.h"
 #include "common/string_util.h"
 
@@ -124,4 +125,14 @@ const std::vector<u8> Path::AsBinary() const {
     }
 }
 
+void Path::DoState(PointerWrap& p) {
+    p.Do(type);
+    p.Do(binary);
+    p.Do(string);
+    std::vector<u16> characters(u16str.begin(), u16str.end());
+    p.Do(characters);
+    if (p.GetMode() == PointerWrap::MODE_READ)
+        u16str.assign(characters.begin(), characters.end());
+}
+
 }
@@ -14,6 +14,7 @@
 
 #include "core/hle/result.h"
 
+class PointerWrap;
 
 namespace FileSys {
 
@@ -55,6 +56,12 @@ public:
     const std::u16string AsU16Str() const;
     const std::vector<u8> AsBinary() const;
 
+    void DoState(PointerWrap& p);
+
+    bool operator==(const Path& other) const {
+        return type == other.type && binary == other.binary && string == other.string && u16str == other.u16str;
+    }
+
 private:
     LowPathType type;
     std::vector<u8> binary;
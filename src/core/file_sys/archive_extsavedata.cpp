@@ -77,7 +77,7 @@ ResultVal<std::unique_ptr<ArchiveBackend>> ArchiveFactory_ExtSaveData::Open(cons
         return ResultCode(ErrorDescription::FS_NotFormatted, ErrorModule::FS,
             ErrorSummary::InvalidState, ErrorLevel::Status);
     }
-    auto archive = Common::make_unique<DiskArchive>(fullpath);
+    auto archive = Common::make_unique<DiskArchive>(fullpath, DiskArchiveType::ExtSaveData);
     return MakeResult<std::unique_ptr<ArchiveBackend>>(std::move(archive));
 }
 
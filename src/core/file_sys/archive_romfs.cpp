@@ -5,9 +5,9 @@
 #include <memory>
 
 #include "common/common_types.h"
-#include "common/file_util.h"
 #include "common/logging/log.h"
 #include "common/make_unique.h"
+#include "common/positional_file.h"
 
 #include "core/file_sys/archive_romfs.h"
 
@@ -16,16 +16,22 @@
 
 namespace FileSys {
 
-ArchiveFactory_RomFS::ArchiveFactory_RomFS(const Loader::AppLoader& app_loader)
-        : romfs_data(std::make_shared<std::vector<u8>>()) {
-    // Load the RomFS from the app
-    if (Loader::ResultStatus::Success != app_loader.ReadRomFS(*romfs_data)) {
+ArchiveFactory_RomFS::ArchiveFactory_RomFS(const Loader::AppLoader& app_loader) {
+    // Locate the RomFS of the app, it is only read from when files are
+    std::shared_ptr<Common::PositionalFile> romfs_file;
+    u64 data_offset = 0;
+    u64 data_size = 0;
+    if (Loader::ResultStatus::Success != app_loader.ReadRomFS(romfs_file, data_offset, data_size)) {
         LOG_ERROR(Service_FS, "Unable to read RomFS!");
+        romfs_file = std::make_shared<Common::PositionalFile>();
+        data_offset = 0;
+        data_size = 0;
     }
+    romfs = std::make_shared<BlobSource>(romfs_file, data_offset, data_size);
 }
 
 ResultVal<std::unique_ptr<ArchiveBackend>> ArchiveFactory_RomFS::Open(const Path& path) {
-    auto archive = Common::make_unique<IVFCArchive>(romfs_data);
+    auto archive = Common::make_unique<IVFCArchive>(romfs);
     return MakeResult<std::unique_ptr<ArchiveBackend>>(std::move(archive));
 }
 
@@ -11,6 +11,7 @@
 
 #include "core/file_sys/archive_savedata.h"
 #include "core/file_sys/disk_archive.h"
+#include "core/file_sys/write_back.h"
 #include "core/hle/kernel/process.h"
 #include "core/hle/service/fs/archive.h"
 #include "core/settings.h"
@@ -47,12 +48,14 @@ ResultVal<std::unique_ptr<ArchiveBackend>> ArchiveFactory_SaveData::Open(const P
             ErrorSummary::InvalidState, ErrorLevel::Status);
     }
 
-    auto archive = Common::make_unique<DiskArchive>(std::move(concrete_mount_point));
+    auto archive = Common::make_unique<DiskArchive>(std::move(concrete_mount_point), DiskArchiveType::SaveData);
     return MakeResult<std::unique_ptr<ArchiveBackend>>(std::move(archive));
 }
 
 ResultCode ArchiveFactory_SaveData::Format(const Path& path) {
     std::string concrete_mount_point = GetSaveDataPath(mount_point, Kernel::g_current_process->program_id);
+    // Pending commits would recreate the files
+    WriteBack::WaitForCommits();
     FileUtil::DeleteDirRecursively(concrete_mount_point);
     FileUtil::CreateFullPath(concrete_mount_point);
     return RESULT_SUCCESS;
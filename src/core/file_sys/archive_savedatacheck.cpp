@@ -5,6 +5,7 @@
 #include "common/file_util.h"
 #include "common/logging/log.h"
 #include "common/make_unique.h"
+#include "common/positional_file.h"
 
 #include "core/file_sys/archive_savedatacheck.h"
 #include "core/hle/service/fs/archive.h"
@@ -31,17 +32,21 @@ ResultVal<std::unique_ptr<ArchiveBackend>> ArchiveFactory_SaveDataCheck::Open(co
     auto vec = path.AsBinary();
     const u32* data = reinterpret_cast<u32*>(vec.data());
     std::string file_path = GetSaveDataCheckPath(mount_point, data[1], data[0]);
-    FileUtil::IOFile file(file_path, "rb");
 
-    if (!file.IsOpen()) {
-        return ResultCode(-1); // TODO(Subv): Find the right error code
+    std::shared_ptr<BlobSource> source = open_sources[file_path].lock();
+    if (source == nullptr) {
+        auto file = std::make_shared<Common::PositionalFile>();
+
+        if (!file->Open(file_path, Common::PositionalFile::Mode::Read)) {
+            return ResultCode(-1); // TODO(Subv): Find the right error code
+        }
+        auto size = file->GetSize();
+
+        source = std::make_shared<BlobSource>(file, 0, size);
+        open_sources[file_path] = source;
     }
-    auto size = file.GetSize();
-    auto raw_data = std::make_shared<std::vector<u8>>(size);
-    file.ReadBytes(raw_data->data(), size);
-    file.Close();
 
-    auto archive = Common::make_unique<IVFCArchive>(std::move(raw_data));
+    auto archive = Common::make_unique<IVFCArchive>(source);
     return MakeResult<std::unique_ptr<ArchiveBackend>>(std::move(archive));
 }
 
@@ -4,6 +4,9 @@
 
 #pragma once
 
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "common/common_types.h"
@@ -28,6 +31,8 @@ public:
 
 private:
     std::string mount_point;
+    /// Contents of the archives that are open, by host path, so that reopening one shares them
+    std::unordered_map<std::string, std::weak_ptr<BlobSource>> open_sources;
 };
 
 } // namespace FileSys
@@ -37,7 +37,7 @@ bool ArchiveFactory_SDMC::Initialize() {
 }
 
 ResultVal<std::unique_ptr<ArchiveBackend>> ArchiveFactory_SDMC::Open(const Path& path) {
-    auto archive = Common::make_unique<DiskArchive>(sdmc_directory);
+    auto archive = Common::make_unique<DiskArchive>(sdmc_directory, DiskArchiveType::SDMC);
     return MakeResult<std::unique_ptr<ArchiveBackend>>(std::move(archive));
 }
 
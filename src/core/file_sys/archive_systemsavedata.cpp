@@ -57,7 +57,7 @@ ResultVal<std::unique_ptr<ArchiveBackend>> ArchiveFactory_SystemSaveData::Open(c
         return ResultCode(ErrorDescription::FS_NotFormatted, ErrorModule::FS,
             ErrorSummary::InvalidState, ErrorLevel::Status);
     }
-    auto archive = Common::make_unique<DiskArchive>(fullpath);
+    auto archive = Common::make_unique<DiskArchive>(fullpath, DiskArchiveType::SystemSaveData);
     return MakeResult<std::unique_ptr<ArchiveBackend>>(std::move(archive));
 }
 
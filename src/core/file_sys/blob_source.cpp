@@ -0,0 +1,78 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstring>
+
+#include "core/file_sys/blob_source.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// FileSys namespace
+
+namespace FileSys {
+
+static const size_t CHUNK_SIZE = 0x10000;
+/// Chunks kept per source, RomFS metadata and small files tend to be read over and over
+static const size_t MAX_CACHED_CHUNKS = 16;
+
+BlobSource::BlobSource(std::shared_ptr<Common::PositionalFile> file, u64 offset, u64 size)
+        : file(file), offset(offset), size(size) {
+}
+
+size_t BlobSource::ReadFile(u64 file_offset, size_t length, u8* buffer) const {
+    if (!file->IsOpen())
+        return 0;
+    return file->ReadAt(offset + file_offset, buffer, length);
+}
+
+const BlobSource::Chunk& BlobSource::GetChunk(u64 index) {
+    auto it = chunk_map.find(index);
+    if (it != chunk_map.end()) {
+        chunks.splice(chunks.begin(), chunks, it->second);
+        return chunks.front();
+    }
+
+    if (chunks.size() >= MAX_CACHED_CHUNKS) {
+        memory_usage.Set(memory_usage.Get() - chunks.back().data.capacity());
+        chunk_map.erase(chunks.back().index);
+        chunks.pop_back();
+    }
+
+    const u64 chunk_offset = index * CHUNK_SIZE;
+    chunks.push_front(Chunk());
+    Chunk& chunk = chunks.front();
+    chunk.index = index;
+    chunk.data.resize(static_cast<size_t>(std::min<u64>(CHUNK_SIZE, size - chunk_offset)));
+    chunk.data.resize(ReadFile(chunk_offset, chunk.data.size(), chunk.data.data()));
+    memory_usage.Add(chunk.data.capacity());
+    chunk_map[index] = chunks.begin();
+    return chunk;
+}
+
+size_t BlobSource::Read(u64 read_offset, size_t length, u8* buffer) {
+    if (read_offset >= size)
+        return 0;
+    length = static_cast<size_t>(std::min<u64>(length, size - read_offset));
+
+    if (length >= CHUNK_SIZE)
+        return ReadFile(read_offset, length, buffer);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size_t done = 0;
+    while (done < length) {
+        const u64 position = read_offset + done;
+        const Chunk& chunk = GetChunk(position / CHUNK_SIZE);
+        const size_t chunk_offset = static_cast<size_t>(position % CHUNK_SIZE);
+        if (chunk_offset >= chunk.data.size())
+            break;
+
+        const size_t copy = std::min(length - done, chunk.data.size() - chunk_offset);
+        std::memcpy(buffer + done, chunk.data.data() + chunk_offset, copy);
+        done += copy;
+    }
+    return done;
+}
+
+} // namespace FileSys
@@ -0,0 +1,72 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/memory_accounting.h"
+#include "common/positional_file.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// FileSys namespace
+
+namespace FileSys {
+
+/**
+ * Read-only region of a host file holding the contents of an archive, e.g. the RomFS of an app.
+ * It is shared by every archive and file opened over the same contents, so that they share one
+ * host handle and one cache. Small reads are served from a cache of recently read chunks, large
+ * ones go straight to the caller's buffer without taking the cache's lock, as the host file is read
+ * with positional reads. Reads may come from the FS I/O thread.
+ */
+class BlobSource {
+public:
+    /**
+     * @param file File the contents are read from on demand
+     * @param offset Offset of the contents in the file
+     * @param size Size of the contents in bytes
+     */
+    BlobSource(std::shared_ptr<Common::PositionalFile> file, u64 offset, u64 size);
+
+    /**
+     * Reads part of the contents, reads past the end are truncated
+     * @return Number of bytes read
+     */
+    size_t Read(u64 offset, size_t length, u8* buffer);
+
+    u64 GetSize() const {
+        return size;
+    }
+
+private:
+    struct Chunk {
+        u64 index;
+        std::vector<u8> data;
+    };
+
+    /// Returns a chunk of the contents, reading it if it isn't cached. Called with the lock held.
+    const Chunk& GetChunk(u64 index);
+
+    /// Reads from the host file, reporting failures as reading nothing
+    size_t ReadFile(u64 offset, size_t length, u8* buffer) const;
+
+    std::mutex mutex;
+    std::shared_ptr<Common::PositionalFile> file;
+    u64 offset;
+    u64 size;
+
+    /// Cached chunks, most recently used first
+    std::list<Chunk> chunks;
+    std::unordered_map<u64, std::list<Chunk>::iterator> chunk_map;
+    /// Bytes of the cached chunks
+    Common::MemoryAccounting::ScopedUsage memory_usage{Common::MemoryAccounting::Tag::RomData};
+};
+
+} // namespace FileSys
@@ -2,12 +2,15 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <cstring>
 #include <sys/stat.h>
 
 #include "common/common_types.h"
 #include "common/file_util.h"
 #include "common/logging/log.h"
 #include "common/make_unique.h"
+#include "common/profiler.h"
 
 #include "core/file_sys/disk_archive.h"
 #include "core/settings.h"
@@ -17,6 +20,80 @@
 
 namespace FileSys {
 
+/// Granularity of the read caches of disk files
+static const u32 CACHE_PAGE_SIZE = 4096;
+/// Number of pages each open file keeps cached, the least recently used ones are dropped first
+static const size_t MAX_CACHED_PAGES = 64;
+/// Reads larger than this go straight to the host file, they gain nothing from the cache
+static const u32 MAX_CACHED_READ_SIZE = 64 * 1024;
+
+// Indexed by DiskArchiveType
+static Common::Profiling::SampleCategory profile_cache_hit_rates[] = {
+    { "SDMC read cache hit rate (%)", "SDMC pages read" },
+    { "SaveData read cache hit rate (%)", "SaveData pages read" },
+    { "ExtSaveData read cache hit rate (%)", "ExtSaveData pages read" },
+    { "SystemSaveData read cache hit rate (%)", "SystemSaveData pages read" },
+};
+static Common::Profiling::SampleCategory profile_cache_bytes_served[] = {
+    { "SDMC bytes read from cache per read", "SDMC reads" },
+    { "SaveData bytes read from cache per read", "SaveData reads" },
+    { "ExtSaveData bytes read from cache per read", "ExtSaveData reads" },
+    { "SystemSaveData bytes read from cache per read", "SystemSaveData reads" },
+};
+
+DiskArchiveCache::EntryType DiskArchiveCache::GetEntryType(const std::string& host_path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entry_types.find(host_path);
+    if (it != entry_types.end())
+        return it->second;
+
+    EntryType type = EntryType::Missing;
+    if (FileUtil::Exists(host_path))
+        type = FileUtil::IsDirectory(host_path) ? EntryType::Directory : EntryType::File;
+    entry_types.emplace(host_path, type);
+    return type;
+}
+
+FileUtil::FSTEntry DiskArchiveCache::GetDirectoryTree(const std::string& host_path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = directory_trees.find(host_path);
+    if (it == directory_trees.end()) {
+        it = directory_trees.emplace(host_path, FileUtil::FSTEntry()).first;
+        FileUtil::ScanDirectoryTree(host_path, it->second);
+    }
+    return it->second;
+}
+
+void DiskArchiveCache::Invalidate() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entry_types.clear();
+    directory_trees.clear();
+}
+
+void DiskArchiveCache::InvalidateListings() {
+    std::lock_guard<std::mutex> lock(mutex);
+    directory_trees.clear();
+}
+
+bool DiskArchive::IsWriteBack() const {
+    return Settings::values.write_back_save_data &&
+           (type == DiskArchiveType::SaveData || type == DiskArchiveType::ExtSaveData);
+}
+
+void DiskArchive::SyncWriteBack() const {
+    if (IsWriteBack())
+        WriteBack::WaitForCommits();
+}
+
+bool DiskArchive::RenameEntry(const std::string& src_path, const std::string& dest_path) const {
+    if (!FileUtil::Rename(src_path, dest_path))
+        return false;
+    // The files open under the old path are committed to the new one
+    if (IsWriteBack())
+        WriteBack::RenameOpenFiles(src_path, dest_path);
+    return true;
+}
+
 std::unique_ptr<FileBackend> DiskArchive::OpenFile(const Path& path, const Mode mode) const {
     LOG_DEBUG(Service_FS, "called path=%s mode=%01X", path.DebugStr().c_str(), mode.hex);
     auto file = Common::make_unique<DiskFile>(*this, path, mode);
@@ -26,23 +103,41 @@ std::unique_ptr<FileBackend> DiskArchive::OpenFile(const Path& path, const Mode
 }
 
 bool DiskArchive::DeleteFile(const Path& path) const {
-    return FileUtil::Delete(mount_point + path.AsString());
+    SyncWriteBack();
+    cache->Invalidate();
+    const std::string full_path = mount_point + path.AsString();
+    if (!FileUtil::Delete(full_path))
+        return false;
+    if (IsWriteBack())
+        WriteBack::DeleteOpenFiles(full_path);
+    return true;
 }
 
 bool DiskArchive::RenameFile(const Path& src_path, const Path& dest_path) const {
-    return FileUtil::Rename(mount_point + src_path.AsString(), mount_point + dest_path.AsString());
+    SyncWriteBack();
+    cache->Invalidate();
+    return RenameEntry(mount_point + src_path.AsString(), mount_point + dest_path.AsString());
 }
 
 bool DiskArchive::DeleteDirectory(const Path& path) const {
-    return FileUtil::DeleteDir(mount_point + path.AsString());
+    SyncWriteBack();
+    cache->Invalidate();
+    const std::string full_path = mount_point + path.AsString();
+    if (!FileUtil::DeleteDir(full_path))
+        return false;
+    if (IsWriteBack())
+        WriteBack::DeleteOpenFiles(full_path);
+    return true;
 }
 
 ResultCode DiskArchive::CreateFile(const FileSys::Path& path, u32 size) const {
+    SyncWriteBack();
     std::string full_path = mount_point + path.AsString();
 
-    if (FileUtil::Exists(full_path))
+    if (cache->GetEntryType(full_path) != DiskArchiveCache::EntryType::Missing)
         return ResultCode(ErrorDescription::AlreadyExists, ErrorModule::FS, ErrorSummary::NothingHappened, ErrorLevel::Info);
 
+    cache->Invalidate();
     if (size == 0) {
         FileUtil::CreateEmptyFile(full_path);
         return RESULT_SUCCESS;
@@ -59,15 +154,20 @@ ResultCode DiskArchive::CreateFile(const FileSys::Path& path, u32 size) const {
 
 
 bool DiskArchive::CreateDirectory(const Path& path) const {
+    cache->Invalidate();
     return FileUtil::CreateDir(mount_point + path.AsString());
 }
 
 bool DiskArchive::RenameDirectory(const Path& src_path, const Path& dest_path) const {
-    return FileUtil::Rename(mount_point + src_path.AsString(), mount_point + dest_path.AsString());
+    SyncWriteBack();
+    cache->Invalidate();
+    return RenameEntry(mount_point + src_path.AsString(), mount_point + dest_path.AsString());
 }
 
 std::unique_ptr<DirectoryBackend> DiskArchive::OpenDirectory(const Path& path) const {
     LOG_DEBUG(Service_FS, "called path=%s", path.DebugStr().c_str());
+    // The listing has the sizes of the files
+    SyncWriteBack();
     auto directory = Common::make_unique<DiskDirectory>(*this, path);
     if (!directory->Open())
         return nullptr;
@@ -82,54 +182,252 @@ DiskFile::DiskFile(const DiskArchive& archive, const Path& path, const Mode mode
     // For example, opening /../../etc/passwd can give the emulated program your users list.
     this->path = archive.mount_point + path.AsString();
     this->mode.hex = mode.hex;
+    this->archive_type = archive.type;
+    this->archive_cache = archive.cache;
+    this->write_back = archive.IsWriteBack();
+}
+
+DiskFile::~DiskFile() {
+    // Handles that are dropped without being closed still commit their writes
+    if (buffered != nullptr)
+        WriteBack::Commit(buffered);
 }
 
 bool DiskFile::Open() {
-    if (!mode.create_flag && !FileUtil::Exists(path)) {
+    if (!mode.create_flag && archive_cache->GetEntryType(path) == DiskArchiveCache::EntryType::Missing) {
         LOG_ERROR(Service_FS, "Non-existing file %s can't be open without mode create.", path.c_str());
         return false;
     }
 
-    std::string mode_string;
+    if (write_back) {
+        buffered = WriteBack::Open(path, mode.create_flag);
+        if (buffered == nullptr) {
+            LOG_ERROR(Service_FS, "Can't read %s", path.c_str());
+            return false;
+        }
+        if (mode.create_flag) {
+            // The file shows up on the host right away, emptying it is left to the commit
+            if (!FileUtil::Exists(path))
+                FileUtil::CreateEmptyFile(path);
+            WriteBack::Commit(buffered);
+            archive_cache->Invalidate();
+        }
+        return true;
+    }
+
+    Common::PositionalFile::Mode file_mode = Common::PositionalFile::Mode::Read;
     if (mode.create_flag)
-        mode_string = "w+";
+        file_mode = Common::PositionalFile::Mode::Create;
     else if (mode.write_flag)
-        mode_string = "r+"; // Files opened with Write access can be read from
-    else if (mode.read_flag)
-        mode_string = "r";
+        file_mode = Common::PositionalFile::Mode::ReadWrite; // Files opened with Write access can be read from
 
-    // Open the file in binary mode, to avoid problems with CR/LF on Windows systems
-    mode_string += "b";
+    file = Common::make_unique<Common::PositionalFile>();
+    file->Open(path, file_mode);
+    ClearCache();
 
-    file = Common::make_unique<FileUtil::IOFile>(path, mode_string.c_str());
+    // Creating the file or truncating it changes the archive's entries
+    if (mode.create_flag)
+        archive_cache->Invalidate();
     return true;
 }
 
+bool DiskFile::IsWritable() const {
+    return mode.write_flag || mode.create_flag;
+}
+
+DiskFile::CachedPage* DiskFile::FindCachedPage(u64 index) const {
+    auto it = cached_page_map.find(index);
+    if (it == cached_page_map.end())
+        return nullptr;
+
+    cached_pages.splice(cached_pages.begin(), cached_pages, it->second);
+    return &*it->second;
+}
+
+DiskFile::CachedPage* DiskFile::LoadPages(u64 first_index, u64 last_index) const {
+    const size_t run_size = static_cast<size_t>(last_index - first_index + 1) * CACHE_PAGE_SIZE;
+    std::vector<u8> data(run_size);
+    const size_t read = file->ReadAt(first_index * CACHE_PAGE_SIZE, data.data(), run_size);
+
+    // Inserted from the last page on, so that the first one ends up the most recently used
+    CachedPage* first_page = nullptr;
+    for (u64 index = last_index + 1; index-- > first_index;) {
+        const size_t page_start = static_cast<size_t>(index - first_index) * CACHE_PAGE_SIZE;
+        if (page_start >= read)
+            continue;
+
+        const size_t page_size = std::min<size_t>(CACHE_PAGE_SIZE, read - page_start);
+        cached_pages.push_front({ index, std::vector<u8>(data.begin() + page_start, data.begin() + page_start + page_size) });
+        cached_page_map[index] = cached_pages.begin();
+        first_page = &cached_pages.front();
+
+        if (cached_pages.size() > MAX_CACHED_PAGES) {
+            cached_page_map.erase(cached_pages.back().index);
+            cached_pages.pop_back();
+        }
+    }
+    return first_page;
+}
+
+void DiskFile::ClearCache() const {
+    cached_pages.clear();
+    cached_page_map.clear();
+}
+
 size_t DiskFile::Read(const u64 offset, const u32 length, u8* buffer) const {
-    file->Seek(offset, SEEK_SET);
-    return file->ReadBytes(buffer, length);
+    if (length == 0)
+        return 0;
+
+    if (buffered != nullptr) {
+        std::lock_guard<std::mutex> lock(buffered->mutex);
+        if (offset >= buffered->data.size())
+            return 0;
+        const size_t read = static_cast<size_t>(std::min<u64>(length, buffered->data.size() - offset));
+        std::memcpy(buffer, buffered->data.data() + offset, read);
+        return read;
+    }
+
+    if (length > MAX_CACHED_READ_SIZE) {
+        return file->ReadAt(offset, buffer, length);
+    }
+
+    const u64 end = offset + length;
+    const u64 first_index = offset / CACHE_PAGE_SIZE;
+    const u64 last_index = (end - 1) / CACHE_PAGE_SIZE;
+    // Pages before this one were found in the cache or loaded by this read
+    u64 loaded_index = first_index;
+    u32 page_hits = 0;
+    size_t bytes_from_cache = 0;
+    size_t read = 0;
+
+    for (u64 index = first_index; index <= last_index; ++index) {
+        CachedPage* page = FindCachedPage(index);
+        const bool hit = page != nullptr && index >= loaded_index;
+        if (page == nullptr) {
+            // Load the run of missing pages starting here with a single host read
+            u64 run_last = index;
+            while (run_last < last_index && cached_page_map.count(run_last + 1) == 0)
+                ++run_last;
+            page = LoadPages(index, run_last);
+            loaded_index = run_last + 1;
+            if (page == nullptr)
+                break;
+        }
+
+        const u64 page_start = index * CACHE_PAGE_SIZE;
+        const u64 copy_start = std::max(offset, page_start);
+        const u64 copy_end = std::min(end, page_start + page->data.size());
+        if (copy_end <= copy_start)
+            break;
+        std::memcpy(buffer + (copy_start - offset), page->data.data() + (copy_start - page_start),
+                    static_cast<size_t>(copy_end - copy_start));
+        read += static_cast<size_t>(copy_end - copy_start);
+
+        if (hit) {
+            ++page_hits;
+            bytes_from_cache += static_cast<size_t>(copy_end - copy_start);
+        }
+
+        // A partial page is the end of the file
+        if (page->data.size() < CACHE_PAGE_SIZE)
+            break;
+    }
+
+    const size_t type_index = static_cast<size_t>(archive_type);
+    profile_cache_hit_rates[type_index].AddSamples(last_index - first_index + 1, 100 * page_hits);
+    profile_cache_bytes_served[type_index].AddSample(bytes_from_cache);
+    return read;
 }
 
 size_t DiskFile::Write(const u64 offset, const u32 length, const u32 flush, const u8* buffer) const {
-    file->Seek(offset, SEEK_SET);
-    size_t written = file->WriteBytes(buffer, length);
-    if (flush)
-        file->Flush();
+    if (buffered != nullptr) {
+        // Like the host file of an unbuffered handle, the contents are read-only without write access
+        if (!IsWritable())
+            return 0;
+        {
+            std::lock_guard<std::mutex> lock(buffered->mutex);
+            if (offset + length > buffered->data.size())
+                buffered->data.resize(static_cast<size_t>(offset + length));
+            std::memcpy(buffered->data.data() + offset, buffer, length);
+            buffered->dirty = true;
+        }
+        archive_cache->InvalidateListings();
+        if (flush)
+            WriteBack::Commit(buffered);
+        return length;
+    }
+
+    // Positional writes aren't buffered, they reach the host as they are made, flushed or not
+    const size_t written = file->WriteAt(offset, buffer, length);
+    if (written != 0)
+        archive_cache->InvalidateListings();
+
+    // Write the data through to the cached pages. A page at the end of the file is dropped if the
+    // file grows past it, the gap in between might be filled with zeros.
+    const u64 end = offset + written;
+    for (auto it = cached_pages.begin(); it != cached_pages.end();) {
+        const u64 page_start = it->index * CACHE_PAGE_SIZE;
+        const u64 page_end = page_start + it->data.size();
+        if (it->data.size() < CACHE_PAGE_SIZE && end > page_end) {
+            cached_page_map.erase(it->index);
+            it = cached_pages.erase(it);
+            continue;
+        }
+
+        const u64 copy_start = std::max(offset, page_start);
+        const u64 copy_end = std::min(end, page_end);
+        if (copy_start < copy_end) {
+            std::memcpy(it->data.data() + (copy_start - page_start), buffer + (copy_start - offset),
+                        static_cast<size_t>(copy_end - copy_start));
+        }
+        ++it;
+    }
     return written;
 }
 
 size_t DiskFile::GetSize() const {
+    if (buffered != nullptr) {
+        std::lock_guard<std::mutex> lock(buffered->mutex);
+        return buffered->data.size();
+    }
     return static_cast<size_t>(file->GetSize());
 }
 
 bool DiskFile::SetSize(const u64 size) const {
-    file->Resize(size);
-    file->Flush();
-    return true;
+    if (buffered != nullptr) {
+        if (!IsWritable())
+            return false;
+        {
+            std::lock_guard<std::mutex> lock(buffered->mutex);
+            buffered->data.resize(static_cast<size_t>(size));
+            buffered->dirty = true;
+        }
+        archive_cache->InvalidateListings();
+        WriteBack::Commit(buffered);
+        return true;
+    }
+
+    ClearCache();
+    archive_cache->InvalidateListings();
+    return file->Resize(size);
 }
 
 bool DiskFile::Close() const {
-    return file->Close();
+    if (buffered != nullptr) {
+        WriteBack::Commit(buffered);
+        buffered.reset();
+        return true;
+    }
+
+    ClearCache();
+    const bool was_open = file->IsOpen();
+    file->Close();
+    return was_open;
+}
+
+void DiskFile::Flush() const {
+    if (buffered != nullptr)
+        WriteBack::Commit(buffered);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -139,12 +437,13 @@ DiskDirectory::DiskDirectory(const DiskArchive& archive, const Path& path) {
     // the root directory we set while opening the archive.
     // For example, opening /../../usr/bin can give the emulated program your installed programs.
     this->path = archive.mount_point + path.AsString();
+    this->archive_cache = archive.cache;
 }
 
 bool DiskDirectory::Open() {
-    if (!FileUtil::IsDirectory(path))
+    if (archive_cache->GetEntryType(path) != DiskArchiveCache::EntryType::Directory)
         return false;
-    FileUtil::ScanDirectoryTree(path, directory);
+    directory = archive_cache->GetDirectoryTree(path);
     children_iterator = directory.children.begin();
     return true;
 }
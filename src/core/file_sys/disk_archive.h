@@ -4,12 +4,21 @@
 
 #pragma once
 
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "common/common_types.h"
 #include "common/file_util.h"
+#include "common/positional_file.h"
 
 #include "core/file_sys/archive_backend.h"
 #include "core/file_sys/directory_backend.h"
 #include "core/file_sys/file_backend.h"
+#include "core/file_sys/write_back.h"
 #include "core/loader/loader.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -17,6 +26,46 @@
 
 namespace FileSys {
 
+/// Kinds of disk archives, the read caches of their files are profiled separately for each
+enum class DiskArchiveType {
+    SDMC,
+    SaveData,
+    ExtSaveData,
+    SystemSaveData,
+};
+
+/**
+ * Host filesystem metadata looked up by a disk archive, shared with the files and directories
+ * opened from it. The archive is assumed to be the only one changing its directory on the host
+ * while it is open, so entries are only dropped when it makes changes itself. Files may be
+ * accessed from the FS I/O thread, hence the lock.
+ */
+class DiskArchiveCache {
+public:
+    enum class EntryType {
+        Missing,
+        File,
+        Directory,
+    };
+
+    /// Returns whether a host path exists, and as what
+    EntryType GetEntryType(const std::string& host_path);
+
+    /// Returns the recursive listing of a host directory, as built by FileUtil::ScanDirectoryTree
+    FileUtil::FSTEntry GetDirectoryTree(const std::string& host_path);
+
+    /// Forgets everything, after entries were created, renamed or deleted
+    void Invalidate();
+
+    /// Forgets the directory listings, after the size of a file changed
+    void InvalidateListings();
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, EntryType> entry_types;
+    std::unordered_map<std::string, FileUtil::FSTEntry> directory_trees;
+};
+
 /**
  * Helper which implements a backend accessing the host machine's filesystem.
  * This should be subclassed by concrete archive types, which will provide the
@@ -24,7 +73,8 @@ namespace FileSys {
  */
 class DiskArchive : public ArchiveBackend {
 public:
-    DiskArchive(const std::string& mount_point_) : mount_point(mount_point_) {}
+    DiskArchive(const std::string& mount_point_, DiskArchiveType type_)
+        : mount_point(mount_point_), type(type_), cache(std::make_shared<DiskArchiveCache>()) {}
 
     virtual std::string GetName() const override { return "DiskArchive: " + mount_point; }
 
@@ -41,13 +91,25 @@ protected:
     friend class DiskFile;
     friend class DiskDirectory;
 
+    /// Whether the files of the archive are write-back buffered, see WriteBack
+    bool IsWriteBack() const;
+
+    /// Waits for the write-back of the files before the host filesystem is accessed directly
+    void SyncWriteBack() const;
+
+    /// Renames a file or directory on the host, along with its write-back buffered open files
+    bool RenameEntry(const std::string& src_path, const std::string& dest_path) const;
+
     std::string mount_point;
+    DiskArchiveType type;
+    std::shared_ptr<DiskArchiveCache> cache;
 };
 
 class DiskFile : public FileBackend {
 public:
     DiskFile();
     DiskFile(const DiskArchive& archive, const Path& path, const Mode mode);
+    ~DiskFile() override;
 
     bool Open() override;
     size_t Read(const u64 offset, const u32 length, u8* buffer) const override;
@@ -56,14 +118,45 @@ public:
     bool SetSize(const u64 size) const override;
     bool Close() const override;
 
-    void Flush() const override {
-        file->Flush();
-    }
+    void Flush() const override;
 
 protected:
     std::string path;
     Mode mode;
-    std::unique_ptr<FileUtil::IOFile> file;
+    std::unique_ptr<Common::PositionalFile> file;
+
+private:
+    /// Page of the file held by the read cache, it is shorter than a page at the end of the file
+    struct CachedPage {
+        u64 index;
+        std::vector<u8> data;
+    };
+
+    /// Whether the handle was opened with write access
+    bool IsWritable() const;
+
+    /// Returns the cached page with the given index and makes it the most recently used one
+    CachedPage* FindCachedPage(u64 index) const;
+
+    /**
+     * Reads a run of pages from the host file into the read cache
+     * @return The first page of the run, nullptr if it is past the end of the file
+     */
+    CachedPage* LoadPages(u64 first_index, u64 last_index) const;
+
+    /// Forgets all cached pages
+    void ClearCache() const;
+
+    DiskArchiveType archive_type;
+    std::shared_ptr<DiskArchiveCache> archive_cache;
+
+    /// Contents of the file while it is open, if it is write-back buffered. It has no host file then.
+    mutable std::shared_ptr<WriteBack::BufferedFile> buffered;
+    bool write_back;
+
+    // Cached pages from the most to the least recently used one, and their positions by page index
+    mutable std::list<CachedPage> cached_pages;
+    mutable std::unordered_map<u64, std::list<CachedPage>::iterator> cached_page_map;
 };
 
 class DiskDirectory : public DirectoryBackend {
@@ -84,6 +177,7 @@ public:
 
 protected:
     std::string path;
+    std::shared_ptr<DiskArchiveCache> archive_cache;
     u32 total_entries_in_directory;
     FileUtil::FSTEntry directory;
 
@@ -10,6 +10,7 @@
 #include "common/common_types.h"
 
 #include "core/file_sys/archive_backend.h"
+#include "core/file_sys/blob_source.h"
 #include "core/file_sys/directory_backend.h"
 #include "core/file_sys/file_backend.h"
 #include "core/loader/loader.h"
@@ -22,11 +23,12 @@ namespace FileSys {
 /**
  * Helper which implements an interface to deal with IVFC images used in some archives
  * This should be subclassed by concrete archive types, which will provide the
- * input data (load the raw IVFC archive) and override any required methods
+ * input data (the contents of the raw IVFC archive) and override any required methods
  */
 class IVFCArchive : public ArchiveBackend {
 public:
-    IVFCArchive(std::shared_ptr<const std::vector<u8>> data);
+    /// @param source Contents of the IVFC image, shared with the other archives opened over it
+    IVFCArchive(std::shared_ptr<BlobSource> source);
 
     std::string GetName() const override;
 
@@ -40,12 +42,12 @@ public:
     std::unique_ptr<DirectoryBackend> OpenDirectory(const Path& path) const override;
 
 protected:
-    std::shared_ptr<const std::vector<u8>> data;
+    std::shared_ptr<BlobSource> source;
 };
 
 class IVFCFile : public FileBackend {
 public:
-    IVFCFile(std::shared_ptr<const std::vector<u8>> data) : data(data) {}
+    IVFCFile(std::shared_ptr<BlobSource> source) : source(source) {}
 
     bool Open() override { return true; }
     size_t Read(const u64 offset, const u32 length, u8* buffer) const override;
@@ -56,7 +58,7 @@ public:
     void Flush() const override { }
 
 private:
-    std::shared_ptr<const std::vector<u8>> data;
+    std::shared_ptr<BlobSource> source;
 };
 
 class IVFCDirectory : public DirectoryBackend {
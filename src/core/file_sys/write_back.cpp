@@ -0,0 +1,248 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <condition_variable>
+#include <deque>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
+#include "common/file_util.h"
+#include "common/logging/log.h"
+#include "common/make_unique.h"
+#include "common/profiler.h"
+#include "common/string_util.h"
+#include "common/thread.h"
+#include "common/thread_policy.h"
+
+#include "core/file_sys/write_back.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// FileSys namespace
+
+namespace FileSys {
+namespace WriteBack {
+
+static Common::Profiling::TimingCategory profile_commit("Save Data Commit");
+
+/// Protects the open files and the commit queue
+static std::mutex mutex;
+static std::condition_variable work_available;
+static std::condition_variable work_done;
+static std::unordered_map<std::string, std::weak_ptr<BufferedFile>> open_files;
+static std::deque<std::shared_ptr<BufferedFile>> queued_commits;
+static bool committing = false;
+static bool stopping = false;
+static std::unique_ptr<std::thread> writer_thread;
+
+/**
+ * Writes the latest contents of a file to disk in a temporary file and renames it over the file
+ * @param path Set to the host path the file was written to
+ * @return Whether the file was replaced, its directory has to be synced for the rename to be durable
+ */
+static bool WriteFile(BufferedFile& file, std::string& path) {
+    Common::Profiling::ScopeTimer timer(profile_commit);
+
+    std::vector<u8> data;
+    {
+        std::lock_guard<std::mutex> lock(file.mutex);
+        file.commit_queued = false;
+        if (!file.dirty || file.deleted)
+            return false;
+        data = file.data;
+        path = file.path;
+        file.dirty = false;
+    }
+
+    // The contents have to be on disk before the rename, or a crash could leave the renamed file
+    // empty or truncated
+    const std::string temp_path = path + ".tmp";
+    bool written;
+    {
+        FileUtil::IOFile temp_file(temp_path, "wb");
+        written = temp_file.IsOpen() && temp_file.WriteBytes(data.data(), data.size()) == data.size();
+        written = temp_file.Sync() && written;
+        written = temp_file.Close() && written;
+    }
+    written = written && FileUtil::Replace(temp_path, path);
+
+    if (!written) {
+        LOG_ERROR(Service_FS, "Failed to write back %s", path.c_str());
+        FileUtil::Delete(temp_path);
+    }
+    return written;
+}
+
+/// Makes the renames of the written files durable, once per directory
+static void SyncDirectories(const std::vector<std::string>& paths) {
+    std::set<std::string> directories;
+    for (const std::string& path : paths) {
+        std::string directory;
+        Common::SplitPath(path, &directory, nullptr, nullptr);
+        directories.insert(directory);
+    }
+    for (const std::string& directory : directories)
+        FileUtil::SyncDirectory(directory);
+}
+
+static void ThreadLoop() {
+    Common::RegisterCurrentThread("SaveDataWriter", Common::ThreadClass::Worker);
+
+    std::vector<std::string> written_paths;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_available.wait(lock, [] { return !queued_commits.empty() || stopping; });
+        if (queued_commits.empty())
+            break;
+
+        // The commits queued so far are written as one batch, which syncs each directory once
+        std::deque<std::shared_ptr<BufferedFile>> batch;
+        batch.swap(queued_commits);
+        committing = true;
+        lock.unlock();
+        for (auto& file : batch) {
+            std::string path;
+            if (WriteFile(*file, path))
+                written_paths.push_back(std::move(path));
+        }
+        SyncDirectories(written_paths);
+        written_paths.clear();
+        // The last handles may be gone, the files are forgotten once their contents are on disk
+        batch.clear();
+        lock.lock();
+        committing = false;
+        work_done.notify_all();
+    }
+}
+
+void Init() {
+    stopping = false;
+    writer_thread = Common::make_unique<std::thread>(ThreadLoop);
+}
+
+void Shutdown() {
+    if (writer_thread == nullptr)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_one();
+    writer_thread->join();
+    writer_thread.reset();
+}
+
+std::shared_ptr<BufferedFile> Open(const std::string& path, bool truncate) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<BufferedFile> file = open_files[path].lock();
+    if (file == nullptr) {
+        file = std::make_shared<BufferedFile>(path);
+        if (!truncate) {
+            FileUtil::IOFile host_file(path, "rb");
+            if (!host_file.IsOpen())
+                return nullptr;
+            file->data.resize(static_cast<size_t>(host_file.GetSize()));
+            if (host_file.ReadBytes(file->data.data(), file->data.size()) != file->data.size())
+                return nullptr;
+        }
+        open_files[path] = file;
+    }
+
+    if (truncate) {
+        std::lock_guard<std::mutex> file_lock(file->mutex);
+        file->data.clear();
+        file->dirty = true;
+    }
+    return file;
+}
+
+void Commit(const std::shared_ptr<BufferedFile>& file) {
+    {
+        std::lock_guard<std::mutex> file_lock(file->mutex);
+        if (!file->dirty || file->commit_queued || file->deleted)
+            return;
+        file->commit_queued = true;
+    }
+
+    if (writer_thread == nullptr) {
+        std::string path;
+        if (WriteFile(*file, path))
+            SyncDirectories({ path });
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued_commits.push_back(file);
+    }
+    work_available.notify_one();
+}
+
+void WaitForCommits() {
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [] { return queued_commits.empty() && !committing; });
+
+    // Forget the files whose last handle is gone
+    for (auto it = open_files.begin(); it != open_files.end();) {
+        if (it->second.expired())
+            it = open_files.erase(it);
+        else
+            ++it;
+    }
+}
+
+/// Whether path is entry_path or inside the directory at entry_path
+static bool IsInEntry(const std::string& path, const std::string& entry_path) {
+    return path.compare(0, entry_path.size(), entry_path) == 0 &&
+           (path.size() == entry_path.size() || path[entry_path.size()] == '/');
+}
+
+/// Forgets the open files at or inside path and stops committing them, the mutex has to be held
+static void DetachOpenFiles(const std::string& path) {
+    for (auto it = open_files.begin(); it != open_files.end();) {
+        if (!IsInEntry(it->first, path)) {
+            ++it;
+            continue;
+        }
+
+        if (std::shared_ptr<BufferedFile> file = it->second.lock()) {
+            std::lock_guard<std::mutex> file_lock(file->mutex);
+            file->deleted = true;
+        }
+        it = open_files.erase(it);
+    }
+}
+
+void RenameOpenFiles(const std::string& src_path, const std::string& dest_path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::pair<std::string, std::weak_ptr<BufferedFile>>> renamed;
+    for (auto it = open_files.begin(); it != open_files.end();) {
+        if (!IsInEntry(it->first, src_path)) {
+            ++it;
+            continue;
+        }
+
+        const std::string path = dest_path + it->first.substr(src_path.size());
+        if (std::shared_ptr<BufferedFile> file = it->second.lock()) {
+            std::lock_guard<std::mutex> file_lock(file->mutex);
+            file->path = path;
+        }
+        renamed.emplace_back(path, std::move(it->second));
+        it = open_files.erase(it);
+    }
+    // The host may have replaced a file at the destination
+    DetachOpenFiles(dest_path);
+    for (auto& entry : renamed)
+        open_files[entry.first] = std::move(entry.second);
+}
+
+void DeleteOpenFiles(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    DetachOpenFiles(path);
+}
+
+} // namespace
+
+} // namespace FileSys
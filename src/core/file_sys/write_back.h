@@ -0,0 +1,83 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common/common_types.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// FileSys namespace
+
+namespace FileSys {
+
+/**
+ * Write-back buffering of the files of the save data archives. While a file is open, its contents
+ * are held in memory, shared by all the handles to it, and the guest's reads and writes are served
+ * from there. Flushing or closing the file only schedules a commit: a background thread writes the
+ * contents to a temporary file next to it, syncs it to disk and renames it over the file, so that
+ * the host file is always either the previous or the new version, even after a crash. The commits
+ * queued together are written as a batch, which syncs the renames of each directory once. Commits
+ * of a file that pile up are coalesced, only its latest contents are written.
+ *
+ * The archives wait for the pending commits before touching the host filesystem themselves, so the
+ * commits never land out of order with the deletions, renames or listings the guest requests.
+ */
+namespace WriteBack {
+
+/// Contents of an open file, shared by its handles
+struct BufferedFile {
+    explicit BufferedFile(const std::string& path_) : path(path_) {}
+
+    /// Protects the members below, files can be accessed from the FS I/O thread
+    std::mutex mutex;
+    /// Host path the contents are committed to, it follows renames of the file
+    std::string path;
+    std::vector<u8> data;
+    /// Whether the contents changed since they were last committed
+    bool dirty = false;
+    /// Whether a commit is queued for the writer thread
+    bool commit_queued = false;
+    /// Whether the file was deleted while open, its contents are no longer committed then
+    bool deleted = false;
+};
+
+/// Starts the writer thread
+void Init();
+
+/// Writes the pending commits and stops the writer thread, later commits are written right away
+void Shutdown();
+
+/**
+ * Returns the contents of a host file, loaded the first time the file is opened
+ * @param truncate Whether the file is opened for (re)creation, which empties the contents
+ * @return nullptr if the host file can't be read
+ */
+std::shared_ptr<BufferedFile> Open(const std::string& path, bool truncate);
+
+/// Schedules writing the contents of a file back to the host, if they changed
+void Commit(const std::shared_ptr<BufferedFile>& file);
+
+/// Blocks until all the commits scheduled so far are written
+void WaitForCommits();
+
+/**
+ * Makes the open files follow the rename of a file or directory on the host, so that their later
+ * commits go to the new path
+ */
+void RenameOpenFiles(const std::string& src_path, const std::string& dest_path);
+
+/**
+ * Detaches the open files from a file or directory deleted on the host, so that their later commits
+ * don't recreate it. Their handles keep working on the contents.
+ */
+void DeleteOpenFiles(const std::string& path);
+
+} // namespace
+
+} // namespace FileSys
@@ -0,0 +1,105 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <chrono>
+#include <thread>
+
+#include "common/common_types.h"
+#include "common/logging/log.h"
+
+#include "core/core_timing.h"
+#include "core/frame_limiter.h"
+#include "core/settings.h"
+
+namespace FrameLimiter {
+
+using Clock = std::chrono::steady_clock;
+
+/// Emulated time of one frame at 60 FPS, in microseconds
+static const s64 FRAME_US = 1000000 / 60;
+/// Lag behind the host after which it is forgotten instead of caught up with, e.g. after pausing
+static const s64 MAX_LAG_US = 100000;
+/// Frames skipped in a row at most, so that something is shown even while emulation can't keep up
+static const unsigned MAX_SKIPPED_FRAMES = 4;
+/// Host time between two speed reports
+static const s64 REPORT_INTERVAL_US = 1000000;
+
+// Emulated and host time pacing started at, moved forward when lag is dropped
+static u64 emulated_start_us;
+static Clock::time_point host_start;
+
+static unsigned skipped_frames;
+
+// Times and frame count the speed was last reported at
+static u64 report_emulated_us;
+static Clock::time_point report_host_time;
+static u64 report_frames;
+static u64 frames;
+
+static s64 MicrosecondsSince(Clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - time).count();
+}
+
+void Init() {
+    emulated_start_us = CoreTiming::GetGlobalTimeUs();
+    host_start = Clock::now();
+    skipped_frames = 0;
+
+    report_emulated_us = emulated_start_us;
+    report_host_time = host_start;
+    report_frames = 0;
+    frames = 0;
+}
+
+/// Logs the emulation speed and frame rate relative to the host every report interval
+static void ReportSpeed(u64 emulated_us) {
+    const s64 host_us = MicrosecondsSince(report_host_time);
+    if (host_us < REPORT_INTERVAL_US)
+        return;
+
+    const double speed_percent = 100.0 * (emulated_us - report_emulated_us) / host_us;
+    const double fps = 1000000.0 * (frames - report_frames) / host_us;
+    LOG_INFO(Core_Timing, "Emulation speed: %.0f%%, %.1f FPS", speed_percent, fps);
+
+    report_emulated_us = emulated_us;
+    report_host_time = Clock::now();
+    report_frames = frames;
+}
+
+bool EndFrame() {
+    ++frames;
+
+    const u64 emulated_us = CoreTiming::GetGlobalTimeUs();
+    ReportSpeed(emulated_us);
+
+    // Unthrottled, emulation is never behind the host
+    const int speed_limit = Settings::values.speed_limit;
+    if (speed_limit <= 0)
+        return false;
+
+    // Host time the emulated time should be reached at, at the target speed
+    const s64 target_us = static_cast<s64>(emulated_us - emulated_start_us) * 100 / speed_limit;
+    const s64 host_us = MicrosecondsSince(host_start);
+
+    if (target_us > host_us) {
+        std::this_thread::sleep_for(std::chrono::microseconds(target_us - host_us));
+        skipped_frames = 0;
+        return false;
+    }
+
+    // Don't run fast for a long while to make up for a pause or a slow section
+    if (host_us - target_us > MAX_LAG_US)
+        host_start += std::chrono::microseconds(host_us - target_us - MAX_LAG_US);
+
+    // Skip the next frame if this one ended more than a frame late
+    if (host_us - target_us > FRAME_US && skipped_frames < MAX_SKIPPED_FRAMES) {
+        ++skipped_frames;
+        return true;
+    }
+
+    skipped_frames = 0;
+    return false;
+}
+
+} // namespace
@@ -0,0 +1,24 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+/**
+ * Paces the emulated frames against the host clock. The emulated time of CoreTiming is kept at the
+ * configured percentage of the host's, and when emulation falls behind it can skip the rendering
+ * of frames to catch up.
+ */
+namespace FrameLimiter {
+
+/// Starts pacing from the current emulated and host time
+void Init();
+
+/**
+ * Called at the end of each emulated frame. Waits until the host time has caught up with the
+ * emulated one and reports the emulation speed from time to time.
+ * @return True if the next frame should not be rendered, since emulation is behind the host
+ */
+bool EndFrame();
+
+} // namespace
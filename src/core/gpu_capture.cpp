@@ -0,0 +1,438 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "common/chunk_file.h"
+#include "common/common_types.h"
+#include "common/compression.h"
+#include "common/file_util.h"
+#include "common/hash.h"
+#include "common/logging/log.h"
+#include "common/scm_rev.h"
+
+#include "core/core_timing.h"
+#include "core/gpu_capture.h"
+#include "core/memory.h"
+#include "core/savestate.h"
+#include "core/hle/service/gsp_gpu.h"
+#include "core/hw/gpu.h"
+#include "core/hw/hw.h"
+#include "core/loader/loader.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/gpu_thread.h"
+#include "video_core/hwrasterizer_base.h"
+#include "video_core/pica.h"
+#include "video_core/renderer_base.h"
+#include "video_core/video_core.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace GPUCapture
+
+namespace GPUCapture {
+
+static const u32 CAPTURE_MAGIC = Loader::MakeMagic('C', 'G', 'P', 'U');
+/// Version of the layout of a capture, to be bumped whenever the events change
+static const u32 CAPTURE_VERSION = 1;
+
+struct CaptureHeader {
+    u32 magic;
+    u32 version;
+    /// Hash of the revision of the build the capture was made by, like for save states the layout
+    /// of the GPU state is only known to that build
+    u64 build_id;
+    u32 num_frames;
+    u32 reserved;
+    /// Uncompressed size of the state of the GPU and its memory when the capture started
+    u64 state_size;
+    /// Uncompressed size of the events that follow the state
+    u64 events_size;
+    u64 compressed_size;
+};
+static_assert(sizeof(CaptureHeader) == 48, "CaptureHeader has incorrect size");
+
+enum class EventType : u32 {
+    RegisterWrite,
+    Memory,
+    DMA,
+    Frame,
+};
+
+struct RegisterWriteEvent {
+    u32 index;
+    u32 value;
+};
+
+/// Followed by size bytes of memory contents
+struct MemoryEvent {
+    VAddr address;
+    u32 size;
+};
+
+struct DMAEvent {
+    VAddr source_address;
+    VAddr dest_address;
+    u32 size;
+};
+
+struct FrameEvent {
+    u32 swapped;
+};
+
+struct Region {
+    VAddr base;
+    u32 size;
+};
+
+/// The memory the GPU can access, whose physical addresses map to these virtual ones
+static const Region gpu_regions[] = {
+    { Memory::VRAM_VADDR,        Memory::VRAM_SIZE },
+    { Memory::LINEAR_HEAP_VADDR, Memory::LINEAR_HEAP_SIZE },
+};
+
+static std::mutex request_mutex;
+static std::atomic<bool> request_pending(false);
+static std::string request_path;
+static u32 request_frames;
+
+static bool capturing = false;
+static std::string capture_path;
+static u32 frames_left;
+static u32 captured_frames;
+static std::vector<u8> captured_state;
+static std::vector<u8> captured_events;
+
+static std::vector<u8> replay_state;
+static std::vector<u8> replay_events;
+static u32 replay_num_frames;
+static size_t replay_position;
+
+static u64 GetBuildId() {
+    return Common::ComputeHash64(Common::g_scm_rev, std::strlen(Common::g_scm_rev));
+}
+
+static bool IsZeroPage(const u8* page) {
+    return std::all_of(page, page + Memory::PAGE_SIZE, [](u8 byte) { return byte == 0; });
+}
+
+/// Saves or restores the registers of the GPU, the Pica state and the memory the GPU can access
+static void DoGPUState(PointerWrap& p) {
+    HW::DoState(p);
+    Pica::DoState(p);
+    Pica::CommandProcessor::DoState(p);
+
+    // Only the pages that aren't all zeros are stored, the others are cleared when restoring
+    for (const Region& region : gpu_regions) {
+        u8* memory = Memory::GetPointer(region.base);
+        const u32 num_pages = region.size / Memory::PAGE_SIZE;
+
+        std::vector<u32> pages;
+        if (p.GetMode() != PointerWrap::MODE_READ) {
+            for (u32 page = 0; page < num_pages; ++page) {
+                if (!IsZeroPage(memory + page * Memory::PAGE_SIZE))
+                    pages.push_back(page);
+            }
+        }
+        p.Do(pages);
+
+        if (p.GetMode() == PointerWrap::MODE_READ) {
+            if (std::any_of(pages.begin(), pages.end(), [num_pages](u32 page) { return page >= num_pages; })) {
+                p.SetError(PointerWrap::ERROR_FAILURE);
+                return;
+            }
+            std::memset(memory, 0, region.size);
+        }
+        for (u32 page : pages)
+            p.DoVoid(memory + page * Memory::PAGE_SIZE, Memory::PAGE_SIZE);
+    }
+    p.DoMarker("GPUCapture");
+}
+
+template <typename T>
+static void AppendEvent(EventType type, const T& event) {
+    const u8* type_bytes = reinterpret_cast<const u8*>(&type);
+    const u8* event_bytes = reinterpret_cast<const u8*>(&event);
+    captured_events.insert(captured_events.end(), type_bytes, type_bytes + sizeof(type));
+    captured_events.insert(captured_events.end(), event_bytes, event_bytes + sizeof(event));
+}
+
+/// Stores the memory the CPU wrote since the last time, before the GPU is given work that may read it
+static void RecordWrittenMemory() {
+    for (const Memory::DirtyRange& range : Memory::CollectDirtyRanges(Memory::DIRTY_TRACKER_GPU_CAPTURE)) {
+        for (const Region& region : gpu_regions) {
+            const VAddr start = std::max(range.start, region.base);
+            const VAddr end = std::min(range.start + range.size, region.base + region.size);
+            if (start >= end)
+                continue;
+
+            AppendEvent(EventType::Memory, MemoryEvent{ start, end - start });
+            const u8* memory = Memory::GetPointer(start);
+            captured_events.insert(captured_events.end(), memory, memory + (end - start));
+        }
+    }
+}
+
+/// Whether writing the register submits work to the GPU
+static bool IsSubmission(u32 index) {
+    return index == GPU_REG_INDEX_WORKAROUND(memory_fill_config[0].trigger, 0x00004 + 0x3) ||
+           index == GPU_REG_INDEX_WORKAROUND(memory_fill_config[1].trigger, 0x00008 + 0x3) ||
+           index == GPU_REG_INDEX(display_transfer_config.trigger) ||
+           index == GPU_REG_INDEX(command_processor_config.trigger);
+}
+
+static void StartCapture(const std::string& path, u32 num_frames) {
+    // The renderer may hold the latest contents of the memory, they're written back before it's
+    // stored
+    GPUThread::Run([] {
+        VideoCore::g_renderer->hw_rasterizer->NotifyPreRead(Memory::VRAM_PADDR, Memory::VRAM_SIZE);
+        VideoCore::g_renderer->hw_rasterizer->NotifyPreRead(Memory::FCRAM_PADDR, Memory::FCRAM_SIZE);
+    });
+    GPUThread::WaitIdle();
+
+    u8* ptr = nullptr;
+    PointerWrap measure(&ptr, PointerWrap::MODE_MEASURE);
+    DoGPUState(measure);
+
+    captured_state.resize(reinterpret_cast<size_t>(ptr));
+    ptr = captured_state.data();
+    PointerWrap write(&ptr, PointerWrap::MODE_WRITE);
+    DoGPUState(write);
+    if (write.error != PointerWrap::ERROR_NONE) {
+        LOG_ERROR(HW_GPU, "Could not capture the state of the GPU");
+        captured_state.clear();
+        return;
+    }
+
+    // The memory as it is now is part of the state, only what's written from here on is recorded
+    Memory::EnableDirtyTracking(Memory::DIRTY_TRACKER_GPU_CAPTURE);
+    Memory::CollectDirtyRanges(Memory::DIRTY_TRACKER_GPU_CAPTURE);
+
+    capture_path = path;
+    frames_left = num_frames;
+    captured_frames = 0;
+    captured_events.clear();
+    capturing = true;
+    LOG_INFO(HW_GPU, "Capturing %u frames of GPU work to %s", num_frames, path.c_str());
+}
+
+static void FinishCapture() {
+    capturing = false;
+    Memory::DisableDirtyTracking(Memory::DIRTY_TRACKER_GPU_CAPTURE);
+
+    std::vector<u8> payload;
+    payload.reserve(captured_state.size() + captured_events.size());
+    payload.insert(payload.end(), captured_state.begin(), captured_state.end());
+    payload.insert(payload.end(), captured_events.begin(), captured_events.end());
+    const std::vector<u8> compressed = Common::CompressLZ4(payload.data(), payload.size());
+
+    CaptureHeader header = {};
+    header.magic = CAPTURE_MAGIC;
+    header.version = CAPTURE_VERSION;
+    header.build_id = GetBuildId();
+    header.num_frames = captured_frames;
+    header.state_size = captured_state.size();
+    header.events_size = captured_events.size();
+    header.compressed_size = compressed.size();
+
+    FileUtil::IOFile file(capture_path, "wb");
+    file.WriteBytes(&header, sizeof(header));
+    file.WriteBytes(compressed.data(), compressed.size());
+    if (!file.IsGood()) {
+        LOG_ERROR(HW_GPU, "Could not write the GPU capture to %s", capture_path.c_str());
+    } else {
+        LOG_INFO(HW_GPU, "Captured %u frames to %s (%u KB)", captured_frames, capture_path.c_str(),
+                 (unsigned)(compressed.size() / 1024));
+    }
+
+    captured_state.clear();
+    captured_state.shrink_to_fit();
+    captured_events.clear();
+    captured_events.shrink_to_fit();
+}
+
+void RequestCapture(const std::string& path, u32 num_frames) {
+    std::lock_guard<std::mutex> lock(request_mutex);
+    request_path = path;
+    request_frames = std::max(num_frames, 1u);
+    request_pending = true;
+}
+
+void Shutdown() {
+    request_pending = false;
+    if (capturing) {
+        LOG_WARNING(HW_GPU, "GPU capture to %s was stopped after %u frames", capture_path.c_str(), captured_frames);
+        capturing = false;
+        Memory::DisableDirtyTracking(Memory::DIRTY_TRACKER_GPU_CAPTURE);
+        captured_state.clear();
+        captured_events.clear();
+    }
+    UnloadCapture();
+}
+
+bool IsCapturing() {
+    return capturing;
+}
+
+void OnRegisterWrite(u32 index, u32 value) {
+    if (IsSubmission(index))
+        RecordWrittenMemory();
+    AppendEvent(EventType::RegisterWrite, RegisterWriteEvent{ index, value });
+}
+
+void OnDMA(VAddr source_address, VAddr dest_address, u32 size) {
+    RecordWrittenMemory();
+    AppendEvent(EventType::DMA, DMAEvent{ source_address, dest_address, size });
+}
+
+void OnFrame(bool swapped) {
+    if (capturing) {
+        AppendEvent(EventType::Frame, FrameEvent{ swapped });
+        ++captured_frames;
+        if (--frames_left == 0)
+            FinishCapture();
+        return;
+    }
+
+    if (request_pending.exchange(false)) {
+        std::lock_guard<std::mutex> lock(request_mutex);
+        StartCapture(request_path, request_frames);
+    }
+}
+
+bool LoadCapture(const std::string& path) {
+    FileUtil::IOFile file(path, "rb");
+    CaptureHeader header;
+    if (!file.IsOpen() || file.ReadBytes(&header, sizeof(header)) != sizeof(header)) {
+        LOG_ERROR(HW_GPU, "Could not read the GPU capture from %s", path.c_str());
+        return false;
+    }
+    if (header.magic != CAPTURE_MAGIC || header.version != CAPTURE_VERSION) {
+        LOG_ERROR(HW_GPU, "%s is not a GPU capture of a supported version", path.c_str());
+        return false;
+    }
+    if (header.build_id != GetBuildId()) {
+        LOG_ERROR(HW_GPU, "%s was captured by a different build", path.c_str());
+        return false;
+    }
+
+    std::vector<u8> compressed(static_cast<size_t>(header.compressed_size));
+    if (file.ReadBytes(compressed.data(), compressed.size()) != compressed.size()) {
+        LOG_ERROR(HW_GPU, "GPU capture %s is truncated", path.c_str());
+        return false;
+    }
+
+    std::vector<u8> payload(static_cast<size_t>(header.state_size + header.events_size));
+    if (!Common::DecompressLZ4(compressed.data(), compressed.size(), payload.data(), payload.size())) {
+        LOG_ERROR(HW_GPU, "GPU capture %s is corrupted", path.c_str());
+        return false;
+    }
+
+    const auto events_start = payload.begin() + static_cast<size_t>(header.state_size);
+    replay_state.assign(payload.begin(), events_start);
+    replay_events.assign(events_start, payload.end());
+    replay_num_frames = header.num_frames;
+    replay_position = 0;
+    RestartReplay();
+    return true;
+}
+
+u32 GetNumFrames() {
+    return replay_num_frames;
+}
+
+void RestartReplay() {
+    GPUThread::WaitIdle();
+
+    u8* ptr = replay_state.data();
+    PointerWrap read(&ptr, PointerWrap::MODE_READ);
+    DoGPUState(read);
+    if (read.error != PointerWrap::ERROR_NONE || ptr != replay_state.data() + replay_state.size())
+        LOG_ERROR(HW_GPU, "The state of the GPU capture could not be restored");
+
+    // Every frame of the capture is rendered, whether it was skipped when it was captured or not
+    GPU::g_skip_frame = false;
+    SaveState::InvalidateMemoryCaches();
+    replay_position = 0;
+}
+
+/// Reads the next event of the replayed capture
+template <typename T>
+static bool ReadEvent(T& event) {
+    if (replay_events.size() - replay_position < sizeof(T))
+        return false;
+    std::memcpy(&event, &replay_events[replay_position], sizeof(T));
+    replay_position += sizeof(T);
+    return true;
+}
+
+bool ReplayFrame() {
+    EventType type;
+    while (ReadEvent(type)) {
+        switch (type) {
+        case EventType::RegisterWrite:
+        {
+            RegisterWriteEvent event;
+            if (!ReadEvent(event))
+                break;
+            GPU::Write<u32>(HW::VADDR_GPU + event.index * 4, event.value);
+            continue;
+        }
+
+        case EventType::Memory:
+        {
+            MemoryEvent event;
+            if (!ReadEvent(event) || replay_events.size() - replay_position < event.size)
+                break;
+            Memory::WriteBlock(event.address, &replay_events[replay_position], event.size);
+            replay_position += event.size;
+            continue;
+        }
+
+        case EventType::DMA:
+        {
+            DMAEvent event;
+            if (!ReadEvent(event))
+                break;
+            GSP_GPU::PerformDMA(event.source_address, event.dest_address, event.size);
+            continue;
+        }
+
+        case EventType::Frame:
+        {
+            FrameEvent event;
+            if (!ReadEvent(event))
+                break;
+            if (event.swapped)
+                GPU::PresentFrame();
+
+            // Nothing runs the interrupts and the other events the GPU schedules for the CPU
+            CoreTiming::MoveEvents();
+            CoreTiming::ClearPendingEvents();
+            return true;
+        }
+        }
+
+        LOG_ERROR(HW_GPU, "GPU capture is corrupted at offset %u", (unsigned)replay_position);
+        break;
+    }
+
+    replay_position = replay_events.size();
+    return false;
+}
+
+void UnloadCapture() {
+    replay_state.clear();
+    replay_state.shrink_to_fit();
+    replay_events.clear();
+    replay_events.shrink_to_fit();
+    replay_num_frames = 0;
+    replay_position = 0;
+}
+
+} // namespace
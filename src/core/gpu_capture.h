@@ -0,0 +1,69 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace GPUCapture
+
+/**
+ * Captures of everything the GPU is given to do over a number of frames, for replaying them without
+ * the emulated CPU. A capture holds the state of the GPU and the memory it can access when it
+ * starts, followed by the GPU register writes, DMAs and buffer swaps in the order they happened.
+ * The memory the CPU wrote is stored before each piece of work that may read it, so command lists,
+ * vertices, textures and shaders can be read back as they were.
+ */
+namespace GPUCapture {
+
+/**
+ * Asks the emulation thread to capture the next frames, starting at the next VBlank. Thread-safe.
+ * @param path File the capture is written to once it's complete
+ * @param num_frames Number of VBlanks to capture
+ */
+void RequestCapture(const std::string& path, u32 num_frames);
+
+/// Drops a capture that is still unfinished and the loaded one, when the emulated system is shut down
+void Shutdown();
+
+/// Whether work submitted to the GPU is being captured
+bool IsCapturing();
+
+/// Records a write to a GPU register, called before the write takes effect
+void OnRegisterWrite(u32 index, u32 value);
+
+/// Records a GSP DMA, called before the copy is made
+void OnDMA(VAddr source_address, VAddr dest_address, u32 size);
+
+/**
+ * Starts, continues or completes a capture on VBlank
+ * @param swapped Whether the frame was presented
+ */
+void OnFrame(bool swapped);
+
+/**
+ * Reads a capture for replaying it, into a system that doesn't run a title
+ * @return Whether the capture could be read
+ */
+bool LoadCapture(const std::string& path);
+
+/// Number of frames of the loaded capture
+u32 GetNumFrames();
+
+/// Puts the GPU and its memory back into the state they were in when the capture started
+void RestartReplay();
+
+/**
+ * Replays the work of the next frame of the capture, up to and including its buffer swap
+ * @return Whether there was a frame left to replay
+ */
+bool ReplayFrame();
+
+/// Frees the loaded capture
+void UnloadCapture();
+
+} // namespace
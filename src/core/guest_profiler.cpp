@@ -0,0 +1,122 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <tuple>
+
+#include "common/common_types.h"
+#include "common/file_util.h"
+#include "common/logging/log.h"
+#include "common/string_util.h"
+#include "common/symbols.h"
+
+#include "core/core.h"
+#include "core/core_timing.h"
+#include "core/guest_profiler.h"
+#include "core/settings.h"
+#include "core/arm/arm_interface.h"
+#include "core/hle/kernel/thread.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace GuestProfiler
+
+namespace GuestProfiler {
+
+/// Sampled state of the application core. A thread ID of 0 stands for no running thread.
+struct Sample {
+    u32 thread_id;
+    u32 pc;
+    u32 lr;
+
+    bool operator<(const Sample& other) const {
+        return std::tie(thread_id, pc, lr) < std::tie(other.thread_id, other.pc, other.lr);
+    }
+};
+
+static int sample_event;
+static bool sampling = false;
+static s64 sample_interval;
+/// Number of times each distinct state was sampled. Symbolized when exported, since the symbol
+/// table can be loaded after sampling starts.
+static std::map<Sample, u64> samples;
+
+static void TakeSample(u64 userdata, int cycles_late) {
+    const Kernel::Thread* thread = Kernel::GetCurrentThread();
+    Sample sample = {};
+    if (thread != nullptr) {
+        sample.thread_id = thread->GetThreadId();
+        sample.pc = Core::g_app_core->GetPC();
+        sample.lr = Core::g_app_core->GetReg(14);
+    }
+    ++samples[sample];
+
+    CoreTiming::ScheduleEvent(sample_interval - cycles_late, sample_event);
+}
+
+/// Names the function an address belongs to, falling back to the address itself
+static std::string GetFrameName(u32 address) {
+    const TSymbol symbol = Symbols::GetContainingSymbol(address);
+    if (!symbol.name.empty())
+        return symbol.name;
+    return Common::StringFromFormat("0x%08X", address);
+}
+
+void Init() {
+    sample_event = CoreTiming::RegisterEvent("GuestProfiler::TakeSample", TakeSample);
+
+    if (Settings::values.guest_profile_file.empty())
+        return;
+
+    sample_interval = std::max(Settings::values.guest_profile_interval, 1000);
+    sampling = true;
+    CoreTiming::ScheduleEvent(sample_interval, sample_event);
+}
+
+void Shutdown() {
+    if (!sampling)
+        return;
+
+    sampling = false;
+    CoreTiming::UnscheduleEvent(sample_event, 0);
+    if (ExportFolded(Settings::values.guest_profile_file))
+        LOG_INFO(Core, "Guest profile written to %s", Settings::values.guest_profile_file.c_str());
+    samples.clear();
+}
+
+bool ExportFolded(const std::string& path) {
+    // Samples of different addresses in the same functions merge into one stack
+    std::map<std::string, u64> stacks;
+    for (const auto& entry : samples) {
+        const Sample& sample = entry.first;
+        std::string stack;
+        if (sample.thread_id == 0) {
+            stack = "idle";
+        } else {
+            stack = Common::StringFromFormat("thread_%u;", sample.thread_id);
+            // Thumb return addresses have bit 0 set
+            stack += GetFrameName(sample.lr & ~1) + ";" + GetFrameName(sample.pc);
+        }
+        stacks[stack] += entry.second;
+    }
+
+    FileUtil::IOFile file(path, "w");
+    if (!file.IsOpen()) {
+        LOG_ERROR(Core, "Failed to open %s", path.c_str());
+        return false;
+    }
+
+    for (const auto& stack : stacks) {
+        const std::string line = Common::StringFromFormat("%s %llu\n", stack.first.c_str(),
+                                                          (unsigned long long)stack.second);
+        if (file.WriteBytes(line.data(), line.size()) != line.size()) {
+            LOG_ERROR(Core, "Failed to write %s", path.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
@@ -0,0 +1,34 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace GuestProfiler
+
+/**
+ * Sampling profiler of the emulated program. Every guest_profile_interval emulated cycles, a
+ * CoreTiming event records the current thread, PC and LR of the application core. The samples are
+ * aggregated by function with the symbol table and exported in the folded stack format of the
+ * flame graph tools, with the function LR points into as the caller of the sampled one. The LR of
+ * a function that already called another one is stale, so the callers are only a hint.
+ */
+namespace GuestProfiler {
+
+/// Starts sampling if a guest_profile_file is set
+void Init();
+
+/// Writes the samples to the guest_profile_file and stops sampling
+void Shutdown();
+
+/**
+ * Writes the samples collected so far in the folded stack format, one line per distinct stack:
+ * "thread;caller;function count"
+ * @return true on success
+ */
+bool ExportFolded(const std::string& path);
+
+} // namespace
@@ -0,0 +1,210 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define DSP_SSE2
+#endif
+
+#include "common/chunk_file.h"
+#include "common/logging/log.h"
+#include "common/math_util.h"
+#include "common/ring_buffer.h"
+
+#include "core/core_timing.h"
+#include "core/hle/dsp/dsp.h"
+#include "core/hle/dsp/shared_memory.h"
+#include "core/hle/dsp/source.h"
+#include "core/hle/service/dsp_dsp.h"
+#include "core/memory.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace DSP
+
+namespace DSP {
+
+const std::array<u16, 16> AUDIO_PIPE_STRUCTURE_ADDRESSES = {{
+    15, // Number of structures
+    FRAME_COUNTER_ADDRESS, SOURCE_CONFIGURATION_ADDRESS, SOURCE_STATUS_ADDRESS,
+    ADPCM_COEFFICIENTS_ADDRESS, DSP_CONFIGURATION_ADDRESS, DSP_STATUS_ADDRESS,
+    FINAL_SAMPLES_ADDRESS, INTERMEDIATE_SAMPLES_ADDRESS, COMPRESSOR_ADDRESS, DEBUG_ADDRESS,
+    UNKNOWN_10_ADDRESS, UNKNOWN_11_ADDRESS, UNKNOWN_12_ADDRESS, UNKNOWN_13_ADDRESS,
+    UNKNOWN_14_ADDRESS,
+}};
+
+/// ARM11 cycles per audio frame of 160 samples at 32728 Hz
+static const s64 AUDIO_FRAME_TICKS = 1310252;
+
+/// DSP word addresses are translated to application addresses as in ConvertProcessAddressFromDspDram
+static const VAddr DSP_WORD_ADDRESS_BASE = Memory::DSP_RAM_VADDR + 0x40000;
+/// Offset between the DSP word addresses of the two regions
+static const u32 REGION_SPACING = 0x10000;
+
+// Enough output for about 125ms, ahead of the host's audio device
+static const size_t OUTPUT_BUFFER_SAMPLES = 0x1000;
+
+static int audio_frame_event;
+static bool audio_running;
+
+static std::vector<Source> sources;
+static float master_volume;
+static DspConfiguration::OutputFormat output_format;
+
+/// Interleaved stereo output, produced on the CPU thread and consumed on the host's audio thread
+static Common::RingBuffer<s16, 2 * OUTPUT_BUFFER_SAMPLES> output_buffer;
+
+static u8* GetRegion(size_t index) {
+    return Memory::GetContiguousPointer(DSP_WORD_ADDRESS_BASE + 2 * (REGION_BASE_ADDRESS + index * REGION_SPACING),
+                                        REGION_SIZE);
+}
+
+template <typename T>
+static T& GetStructure(u8* region, u16 address) {
+    return *reinterpret_cast<T*>(region + 2 * (address - REGION_BASE_ADDRESS));
+}
+
+/**
+ * The application fills the two regions alternately, incrementing the frame counter of the one it
+ * just filled. That one is read from, and the statuses and samples go to the other.
+ */
+static size_t CurrentRegionIndex(u16 frame_counter_0, u16 frame_counter_1) {
+    // Account for the counters wrapping around
+    if (frame_counter_0 == 0xFFFF && frame_counter_1 != 0xFFFE)
+        return 1;
+    if (frame_counter_1 == 0xFFFF && frame_counter_0 != 0xFFFE)
+        return 0;
+    return frame_counter_0 > frame_counter_1 ? 0 : 1;
+}
+
+/// Scales the mix by the master volume and converts it to interleaved 16-bit samples
+static void FinalizeMix(const StereoFrame& mix, float volume, s16* output) {
+    size_t i = 0;
+
+#ifdef DSP_SSE2
+    const __m128 scale = _mm_set1_ps(volume);
+    for (; i + 4 <= SAMPLES_PER_FRAME; i += 4) {
+        // Conversion rounds, and the packing saturates to the range of s16
+        const __m128i left = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(&mix.left[i]), scale));
+        const __m128i right = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(&mix.right[i]), scale));
+        const __m128i left16 = _mm_packs_epi32(left, left);
+        const __m128i right16 = _mm_packs_epi32(right, right);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 2 * i), _mm_unpacklo_epi16(left16, right16));
+    }
+#endif
+
+    for (; i < SAMPLES_PER_FRAME; ++i) {
+        output[2 * i] = static_cast<s16>(MathUtil::Clamp<float>(std::round(mix.left[i] * volume), -32768, 32767));
+        output[2 * i + 1] = static_cast<s16>(MathUtil::Clamp<float>(std::round(mix.right[i] * volume), -32768, 32767));
+    }
+}
+
+/// Mixes one audio frame from the configuration the application last wrote
+static void ProcessFrame() {
+    u8* regions[2] = { GetRegion(0), GetRegion(1) };
+    if (regions[0] == nullptr || regions[1] == nullptr)
+        return;
+
+    const size_t current = CurrentRegionIndex(GetStructure<u16_le>(regions[0], FRAME_COUNTER_ADDRESS),
+                                              GetStructure<u16_le>(regions[1], FRAME_COUNTER_ADDRESS));
+    u8* read_region = regions[current];
+    u8* write_region = regions[1 - current];
+
+    auto& dsp_configuration = GetStructure<DspConfiguration>(read_region, DSP_CONFIGURATION_ADDRESS);
+    if (dsp_configuration.master_volume_dirty)
+        master_volume = dsp_configuration.master_volume;
+    if (dsp_configuration.output_format_dirty)
+        output_format = dsp_configuration.output_format;
+    dsp_configuration.dirty_raw = 0;
+
+    auto& source_configurations = GetStructure<SourceConfiguration>(read_region, SOURCE_CONFIGURATION_ADDRESS);
+    const auto& adpcm_coefficients = GetStructure<AdpcmCoefficients>(read_region, ADPCM_COEFFICIENTS_ADDRESS);
+    auto& source_statuses = GetStructure<SourceStatus>(write_region, SOURCE_STATUS_ADDRESS);
+
+    StereoFrame mix;
+    mix.left.fill(0.0f);
+    mix.right.fill(0.0f);
+    for (size_t i = 0; i < NUM_SOURCES; ++i) {
+        sources[i].ParseConfig(source_configurations.config[i], adpcm_coefficients.coeff[i]);
+        sources[i].MixFrame(mix);
+        sources[i].WriteStatus(source_statuses.status[i]);
+    }
+
+    if (output_format == DspConfiguration::OutputFormat::Mono) {
+        for (size_t i = 0; i < SAMPLES_PER_FRAME; ++i)
+            mix.left[i] = mix.right[i] = (mix.left[i] + mix.right[i]) * 0.5f;
+    }
+
+    std::array<s16, 2 * SAMPLES_PER_FRAME> samples;
+    FinalizeMix(mix, master_volume, samples.data());
+
+    auto& final_samples = GetStructure<FinalMixSamples>(write_region, FINAL_SAMPLES_ADDRESS);
+    std::memcpy(final_samples.pcm16, samples.data(), sizeof(final_samples.pcm16));
+
+    // Frames are dropped whole when the host's audio device falls behind, or there is none
+    if (output_buffer.Capacity() - output_buffer.Size() >= samples.size())
+        output_buffer.Push(samples.data(), samples.size());
+}
+
+static void AudioFrameCallback(u64 userdata, int cycles_late) {
+    if (audio_running)
+        ProcessFrame();
+
+    // Applications expect an interrupt for every frame even when they don't use the audio pipe
+    DSP_DSP::SignalInterrupt();
+
+    CoreTiming::ScheduleEvent(AUDIO_FRAME_TICKS - cycles_late, audio_frame_event);
+}
+
+void StartAudio() {
+    for (auto& source : sources)
+        source.Reset();
+    master_volume = 1.0f;
+    output_format = DspConfiguration::OutputFormat::Stereo;
+    audio_running = true;
+}
+
+void StopAudio() {
+    audio_running = false;
+    for (auto& source : sources)
+        source.Reset();
+}
+
+size_t PopOutput(s16* buffer, size_t num_samples) {
+    const size_t popped = output_buffer.Pop(buffer, 2 * num_samples);
+    std::fill(buffer + popped, buffer + 2 * num_samples, 0);
+    return popped / 2;
+}
+
+void Init() {
+    sources.clear();
+    for (size_t i = 0; i < NUM_SOURCES; ++i)
+        sources.emplace_back(i);
+    audio_running = false;
+
+    audio_frame_event = CoreTiming::RegisterEvent("DSP::AudioFrame", AudioFrameCallback);
+    CoreTiming::ScheduleEvent(AUDIO_FRAME_TICKS, audio_frame_event);
+}
+
+void Shutdown() {
+    audio_running = false;
+    sources.clear();
+}
+
+void DoState(PointerWrap& p) {
+    p.Do(audio_running);
+    p.Do(master_volume);
+    p.Do(output_format);
+
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        for (auto& source : sources)
+            source.Reset();
+    }
+}
+
+} // namespace
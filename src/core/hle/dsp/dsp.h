@@ -0,0 +1,51 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "common/common_types.h"
+
+class PointerWrap;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace DSP
+
+/**
+ * High-level emulation of the audio firmware. Every audio frame, 160 samples at the DSP's rate of
+ * about 32728 Hz, the voices the application configured in DSP RAM are mixed and the result is
+ * queued for the host's audio device.
+ */
+namespace DSP {
+
+/// Sample rate of the output, in Hz
+const unsigned OUTPUT_SAMPLE_RATE = 32728;
+
+/// Reply of the audio pipe to the application initializing it: the DSP addresses of the structures
+extern const std::array<u16, 16> AUDIO_PIPE_STRUCTURE_ADDRESSES;
+
+/// Starts processing the shared memory, when the application initializes the audio pipe
+void StartAudio();
+
+/// Stops processing the shared memory and silences every voice
+void StopAudio();
+
+/**
+ * Takes mixed samples for the host's audio device. Called from the host's audio thread, this never
+ * blocks. Missing samples are filled with silence.
+ * @param buffer Receives interleaved stereo samples
+ * @param num_samples Number of stereo samples wanted
+ * @return Number of stereo samples that were available
+ */
+size_t PopOutput(s16* buffer, size_t num_samples);
+
+void Init();
+void Shutdown();
+
+/// Saves or restores the mixer's settings. The voices start over after a restore.
+void DoState(PointerWrap& p);
+
+} // namespace
@@ -0,0 +1,255 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+#include "common/bit_field.h"
+#include "common/common_funcs.h"
+#include "common/common_types.h"
+#include "common/swap.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace DSP
+
+/**
+ * Structures the application and the audio firmware exchange through DSP RAM. There are two copies
+ * of them, the application fills one while the DSP processes the other, see frame_counter. The
+ * layouts are as reverse engineered by the homebrew community and aren't complete.
+ *
+ * The DSP addresses memory in 16-bit words. Its 32-bit values are stored with the most significant
+ * word first (u32_dsp), values written by the application are plain little-endian.
+ */
+namespace DSP {
+
+#define INSERT_PADDING_DSPWORDS(num_words) INSERT_PADDING_BYTES(2 * (num_words))
+
+/// Number of voices the audio firmware mixes
+const size_t NUM_SOURCES = 24;
+/// Number of stereo samples produced by each audio frame
+const size_t SAMPLES_PER_FRAME = 160;
+
+struct u32_dsp {
+    operator u32() const {
+        return Convert(storage);
+    }
+
+    void operator=(u32 new_value) {
+        storage = Convert(new_value);
+    }
+
+private:
+    static u32 Convert(u32 value) {
+        return (value << 16) | (value >> 16);
+    }
+
+    u32_le storage;
+};
+static_assert(sizeof(u32_dsp) == 4, "u32_dsp has incorrect size");
+
+/// Filled in by the DSP
+struct DspStatus {
+    u16_le unknown;
+    u16_le dropped_frames;
+    INSERT_PADDING_DSPWORDS(0xE);
+};
+
+/// The final mix of the DSP, as sent to the speakers. Filled in by the DSP.
+struct FinalMixSamples {
+    s16_le pcm16[2 * SAMPLES_PER_FRAME];
+};
+
+/// Playback state of each voice. Filled in by the DSP.
+struct SourceStatus {
+    struct Status {
+        u8 is_enabled;
+        u8 current_buffer_id_dirty; ///< Set when current_buffer_id changed this frame
+        u16_le sync;                ///< Copy of SourceConfiguration::Configuration::sync
+        u32_dsp buffer_position;    ///< Samples into the current buffer
+        u16_le current_buffer_id;
+        INSERT_PADDING_DSPWORDS(1);
+    };
+
+    Status status[NUM_SOURCES];
+};
+
+/// Global mixer settings. Written by the application.
+struct DspConfiguration {
+    union {
+        u32_le dirty_raw;
+
+        BitField<16, 1, u32_le> master_volume_dirty;
+        BitField<26, 1, u32_le> output_format_dirty;
+    };
+
+    float_le master_volume;
+    std::array<float_le, 2> aux_return_volume;
+    u16_le output_buffer_count;
+    INSERT_PADDING_DSPWORDS(2);
+
+    enum class OutputFormat : u16 {
+        Mono = 0,
+        Stereo = 1,
+        Surround = 2,
+    };
+    OutputFormat output_format;
+
+    u16_le limiter_enabled;
+    u16_le headphones_connected;
+
+    // The effect settings that follow aren't emulated
+    INSERT_PADDING_DSPWORDS(0x5E - 14);
+};
+
+/// Settings and buffer queue of each voice. Written by the application.
+struct SourceConfiguration {
+    struct Configuration {
+        /// Which fields were changed by the application since the DSP last looked at them
+        union {
+            u32_le dirty_raw;
+
+            BitField<0, 1, u32_le> format_dirty;
+            BitField<1, 1, u32_le> mono_or_stereo_dirty;
+            BitField<2, 1, u32_le> adpcm_coefficients_dirty;
+            BitField<4, 1, u32_le> partial_reset_flag;
+            BitField<16, 1, u32_le> enable_dirty;
+            BitField<17, 1, u32_le> interpolation_dirty;
+            BitField<18, 1, u32_le> rate_multiplier_dirty;
+            BitField<19, 1, u32_le> buffer_queue_dirty;
+            BitField<21, 1, u32_le> play_position_dirty;
+            BitField<25, 1, u32_le> gain_0_dirty;
+            BitField<28, 1, u32_le> sync_dirty;
+            BitField<29, 1, u32_le> reset_flag;
+            BitField<30, 1, u32_le> embedded_buffer_dirty;
+        };
+
+        /// Mix of the voice into the main output (0) and the two auxiliary busses, each for the
+        /// front left, front right, back left and back right channels
+        std::array<float_le, 4> gain[3];
+
+        /// Playback rate relative to the DSP's sample rate
+        float_le rate_multiplier;
+
+        enum class InterpolationMode : u8 {
+            Polyphase = 0,
+            Linear = 1,
+            None = 2,
+        };
+        InterpolationMode interpolation_mode;
+        INSERT_PADDING_BYTES(1);
+
+        // Per-voice filters, not emulated
+        u16_le filters_enabled;
+        INSERT_PADDING_DSPWORDS(2 + 5);
+
+        struct Buffer {
+            u32_dsp physical_address;
+            u32_dsp length; ///< In samples
+            u8 adpcm_ps;
+            std::array<s16_le, 2> adpcm_yn;
+            u8 adpcm_dirty; ///< Whether adpcm_ps and adpcm_yn are valid
+            u8 is_looping;
+            u16_le buffer_id;
+            INSERT_PADDING_DSPWORDS(1);
+        };
+
+        u16_le buffers_dirty; ///< Which of the buffers were queued, one bit each
+        std::array<Buffer, 4> buffers;
+
+        u32_dsp loop_related;
+        u8 enable;
+        INSERT_PADDING_BYTES(1);
+        u16_le sync; ///< Passed back through SourceStatus::Status::sync
+        u32_dsp play_position; ///< Sample the embedded buffer starts playing at
+        INSERT_PADDING_DSPWORDS(2);
+
+        // The embedded buffer, usually the first one played after the voice is set up
+
+        u32_dsp physical_address;
+        u32_dsp length; ///< In samples
+
+        enum class MonoOrStereo : u16 {
+            Mono = 1,
+            Stereo = 2,
+        };
+
+        enum class Format : u16 {
+            PCM8 = 0,
+            PCM16 = 1,
+            ADPCM = 2,
+        };
+
+        union {
+            u16_le flags1_raw;
+
+            BitField<0, 2, MonoOrStereo> mono_or_stereo;
+            BitField<2, 2, Format> format;
+        };
+
+        u16_le adpcm_ps;
+        std::array<s16_le, 2> adpcm_yn;
+
+        union {
+            u16_le flags2_raw;
+
+            BitField<0, 1, u16_le> adpcm_dirty;
+            BitField<1, 1, u16_le> is_looping;
+        };
+
+        u16_le buffer_id;
+    };
+
+    Configuration config[NUM_SOURCES];
+};
+
+/// Coefficients of the ADPCM predictors of each voice. Written by the application.
+struct AdpcmCoefficients {
+    std::array<s16_le, 16> coeff[NUM_SOURCES];
+};
+
+#define ASSERT_DSP_STRUCT(name, size) \
+    static_assert(std::is_standard_layout<name>::value, "DSP structure " #name " doesn't use standard layout"); \
+    static_assert(sizeof(name) == (size), "DSP structure " #name " has incorrect size")
+
+ASSERT_DSP_STRUCT(DspStatus, 32);
+ASSERT_DSP_STRUCT(FinalMixSamples, 640);
+ASSERT_DSP_STRUCT(SourceStatus::Status, 12);
+ASSERT_DSP_STRUCT(DspConfiguration, 188);
+ASSERT_DSP_STRUCT(SourceConfiguration::Configuration, 192);
+ASSERT_DSP_STRUCT(SourceConfiguration::Configuration::Buffer, 20);
+ASSERT_DSP_STRUCT(AdpcmCoefficients, 768);
+
+#undef ASSERT_DSP_STRUCT
+
+/**
+ * DSP word addresses of the structures in the first region, in the order the audio pipe reports
+ * them to the application. The addresses of the second region are 0x10000 words higher.
+ */
+enum StructureAddress : u16 {
+    FRAME_COUNTER_ADDRESS         = 0xBFFF,
+    SOURCE_CONFIGURATION_ADDRESS  = 0x9E8E,
+    SOURCE_STATUS_ADDRESS         = 0x8680,
+    ADPCM_COEFFICIENTS_ADDRESS    = 0xA78E,
+    DSP_CONFIGURATION_ADDRESS     = 0x9430,
+    DSP_STATUS_ADDRESS            = 0x8400,
+    FINAL_SAMPLES_ADDRESS         = 0x8540,
+    INTERMEDIATE_SAMPLES_ADDRESS  = 0x948E,
+    COMPRESSOR_ADDRESS            = 0x8710,
+    DEBUG_ADDRESS                 = 0x8410,
+    UNKNOWN_10_ADDRESS            = 0xA90E,
+    UNKNOWN_11_ADDRESS            = 0xAA0E,
+    UNKNOWN_12_ADDRESS            = 0xAACE,
+    UNKNOWN_13_ADDRESS            = 0xAC4E,
+    UNKNOWN_14_ADDRESS            = 0xAC58,
+};
+
+/// DSP word address each region starts at
+const u16 REGION_BASE_ADDRESS = 0x8000;
+/// Size of one region in bytes
+const size_t REGION_SIZE = 0x8000;
+
+} // namespace
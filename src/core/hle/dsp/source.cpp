@@ -0,0 +1,352 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define DSP_SSE2
+#endif
+
+#include "common/logging/log.h"
+#include "common/math_util.h"
+
+#include "core/hle/dsp/source.h"
+#include "core/mem_map.h"
+#include "core/memory.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace DSP
+
+namespace DSP {
+
+/// Samples encoded in each 8-byte ADPCM frame, after its header byte
+static const u32 ADPCM_SAMPLES_PER_FRAME = 14;
+
+Source::Source(size_t source_id) : source_id(source_id) {
+    Reset();
+}
+
+void Source::Reset() {
+    enabled = false;
+    sync = 0;
+    rate_multiplier = 1.0f;
+    interpolation_mode = InterpolationMode::Polyphase;
+    gain.fill(0.0f);
+    format = Format::ADPCM;
+    mono_or_stereo = MonoOrStereo::Mono;
+    adpcm_coeffs.fill(0);
+    adpcm_yn.fill(0);
+
+    input_queue = decltype(input_queue)();
+    current_samples.clear();
+    playing = false;
+    current_buffer_id = 0;
+    current_buffer_id_dirty = false;
+    position = 0.0;
+}
+
+void Source::ParseConfig(SourceConfiguration::Configuration& config, const std::array<s16_le, 16>& coeffs) {
+    if (config.dirty_raw == 0)
+        return;
+
+    if (config.reset_flag) {
+        Reset();
+        LOG_TRACE(Service_DSP, "source %u reset", (unsigned)source_id);
+    }
+
+    if (config.partial_reset_flag) {
+        input_queue = decltype(input_queue)();
+        LOG_TRACE(Service_DSP, "source %u partially reset", (unsigned)source_id);
+    }
+
+    if (config.enable_dirty)
+        enabled = config.enable != 0;
+
+    if (config.sync_dirty)
+        sync = config.sync;
+
+    if (config.rate_multiplier_dirty)
+        rate_multiplier = config.rate_multiplier;
+
+    if (config.interpolation_dirty)
+        interpolation_mode = config.interpolation_mode;
+
+    if (config.gain_0_dirty)
+        std::copy(config.gain[0].begin(), config.gain[0].end(), gain.begin());
+
+    if (config.adpcm_coefficients_dirty)
+        std::copy(coeffs.begin(), coeffs.end(), adpcm_coeffs.begin());
+
+    if (config.format_dirty || config.embedded_buffer_dirty)
+        format = config.format;
+
+    if (config.mono_or_stereo_dirty || config.embedded_buffer_dirty)
+        mono_or_stereo = config.mono_or_stereo;
+
+    if (config.embedded_buffer_dirty) {
+        Buffer buffer;
+        buffer.physical_address = config.physical_address;
+        buffer.length = config.length;
+        buffer.format = format;
+        buffer.mono_or_stereo = mono_or_stereo;
+        buffer.adpcm_dirty = config.adpcm_dirty != 0;
+        buffer.adpcm_yn = {{ config.adpcm_yn[0], config.adpcm_yn[1] }};
+        buffer.is_looping = config.is_looping != 0;
+        buffer.buffer_id = config.buffer_id;
+        buffer.play_position = config.play_position_dirty ? (u32)config.play_position : 0;
+        input_queue.push(buffer);
+    }
+
+    if (config.buffer_queue_dirty) {
+        for (size_t i = 0; i < config.buffers.size(); ++i) {
+            if ((config.buffers_dirty & (1 << i)) == 0)
+                continue;
+
+            const auto& queued = config.buffers[i];
+            Buffer buffer;
+            buffer.physical_address = queued.physical_address;
+            buffer.length = queued.length;
+            buffer.format = format;
+            buffer.mono_or_stereo = mono_or_stereo;
+            buffer.adpcm_dirty = queued.adpcm_dirty != 0;
+            buffer.adpcm_yn = {{ queued.adpcm_yn[0], queued.adpcm_yn[1] }};
+            buffer.is_looping = queued.is_looping != 0;
+            buffer.buffer_id = queued.buffer_id;
+            buffer.play_position = 0;
+            input_queue.push(buffer);
+        }
+        config.buffers_dirty = 0;
+    }
+
+    config.dirty_raw = 0;
+}
+
+void Source::DecodeBuffer(const Buffer& buffer) {
+    current_samples.assign(2 * buffer.length, 0);
+
+    const u32 channels = buffer.mono_or_stereo == MonoOrStereo::Stereo ? 2 : 1;
+    u32 size;
+    switch (buffer.format) {
+    case Format::PCM8:
+        size = buffer.length * channels;
+        break;
+    case Format::PCM16:
+        size = buffer.length * channels * sizeof(s16);
+        break;
+    case Format::ADPCM:
+        // ADPCM is always mono
+        size = (buffer.length + ADPCM_SAMPLES_PER_FRAME - 1) / ADPCM_SAMPLES_PER_FRAME * 8;
+        break;
+    default:
+        LOG_ERROR(Service_DSP, "source %u: unknown sample format %u", (unsigned)source_id, (unsigned)buffer.format);
+        return;
+    }
+
+    const u8* data = Memory::GetContiguousPointer(Memory::PhysicalToVirtualAddress(buffer.physical_address), size);
+    if (data == nullptr) {
+        LOG_ERROR(Service_DSP, "source %u: buffer at 0x%08X of 0x%X bytes is not in memory",
+                  (unsigned)source_id, buffer.physical_address, size);
+        return;
+    }
+
+    s16* out = current_samples.data();
+    switch (buffer.format) {
+    case Format::PCM8:
+        for (u32 i = 0; i < buffer.length; ++i) {
+            out[2 * i] = static_cast<s16>(static_cast<s8>(data[i * channels]) << 8);
+            out[2 * i + 1] = static_cast<s16>(static_cast<s8>(data[i * channels + channels - 1]) << 8);
+        }
+        break;
+
+    case Format::PCM16: {
+        const s16* pcm = reinterpret_cast<const s16*>(data);
+        for (u32 i = 0; i < buffer.length; ++i) {
+            out[2 * i] = pcm[i * channels];
+            out[2 * i + 1] = pcm[i * channels + channels - 1];
+        }
+        break;
+    }
+
+    case Format::ADPCM: {
+        if (buffer.adpcm_dirty)
+            adpcm_yn = buffer.adpcm_yn;
+
+        s32 yn1 = adpcm_yn[0];
+        s32 yn2 = adpcm_yn[1];
+        for (u32 i = 0; i < buffer.length; ++i) {
+            const u8* frame = data + i / ADPCM_SAMPLES_PER_FRAME * 8;
+            const u32 nibble_index = i % ADPCM_SAMPLES_PER_FRAME;
+            const u8 header = frame[0];
+            const s32 scale = 1 << (header & 0xF);
+            const size_t predictor = (header >> 4) & 0x7;
+
+            const u8 byte = frame[1 + nibble_index / 2];
+            s32 nibble = (nibble_index % 2 == 0) ? (byte >> 4) : (byte & 0xF);
+            nibble = nibble >= 8 ? nibble - 16 : nibble;
+
+            s32 sample = ((nibble * scale) << 11) + 1024 +
+                         adpcm_coeffs[predictor * 2] * yn1 + adpcm_coeffs[predictor * 2 + 1] * yn2;
+            sample = MathUtil::Clamp(sample >> 11, -32768, 32767);
+
+            yn2 = yn1;
+            yn1 = sample;
+            out[2 * i] = out[2 * i + 1] = static_cast<s16>(sample);
+        }
+        adpcm_yn = {{ static_cast<s16>(yn1), static_cast<s16>(yn2) }};
+        break;
+    }
+    }
+}
+
+bool Source::DequeueBuffer() {
+    if (input_queue.empty()) {
+        if (!playing || !current_buffer.is_looping || current_samples.empty())
+            return false;
+
+        // Looping buffers play until another buffer is queued
+        position = 0.0;
+        return true;
+    }
+
+    current_buffer = input_queue.top();
+    input_queue.pop();
+
+    DecodeBuffer(current_buffer);
+    position = std::min<double>(current_buffer.play_position, current_buffer.length);
+    playing = true;
+
+    if (current_buffer_id != current_buffer.buffer_id) {
+        current_buffer_id = current_buffer.buffer_id;
+        current_buffer_id_dirty = true;
+    }
+    return true;
+}
+
+/**
+ * Resamples stereo samples by linear interpolation, or picks the nearest sample if interpolate is
+ * false, until either the output or the input runs out.
+ * @param input Interleaved stereo samples
+ * @param num_input Number of stereo samples in input
+ * @param position Position in the input to start at, updated to where the output stopped
+ * @param step Input samples advanced per output sample
+ * @return Number of output samples produced
+ */
+static size_t Resample(const s16* input, size_t num_input, double& position, double step, bool interpolate,
+                       float* left, float* right, size_t num_output) {
+    size_t produced = 0;
+
+#ifdef DSP_SSE2
+    // Input samples are fetched one by one, the interpolation is done four output samples at a time.
+    // The last input sample is interpolated with itself, so stop where that could be needed.
+    const __m128 step_offsets = _mm_setr_ps(0.0f, (float)step, (float)(2 * step), (float)(3 * step));
+    while (produced + 4 <= num_output && position + 3 * step + 1 < num_input) {
+        const size_t i0 = (size_t)position;
+        const size_t i1 = (size_t)(position + step);
+        const size_t i2 = (size_t)(position + 2 * step);
+        const size_t i3 = (size_t)(position + 3 * step);
+
+        const __m128 a_left  = _mm_setr_ps(input[2 * i0], input[2 * i1], input[2 * i2], input[2 * i3]);
+        const __m128 a_right = _mm_setr_ps(input[2 * i0 + 1], input[2 * i1 + 1], input[2 * i2 + 1], input[2 * i3 + 1]);
+
+        __m128 out_left = a_left;
+        __m128 out_right = a_right;
+        if (interpolate) {
+            const __m128 b_left  = _mm_setr_ps(input[2 * i0 + 2], input[2 * i1 + 2], input[2 * i2 + 2], input[2 * i3 + 2]);
+            const __m128 b_right = _mm_setr_ps(input[2 * i0 + 3], input[2 * i1 + 3], input[2 * i2 + 3], input[2 * i3 + 3]);
+
+            const float fraction = (float)(position - i0);
+            const __m128 indices = _mm_setr_ps(0.0f, (float)(i1 - i0), (float)(i2 - i0), (float)(i3 - i0));
+            const __m128 t = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(fraction), step_offsets), indices);
+
+            out_left = _mm_add_ps(a_left, _mm_mul_ps(_mm_sub_ps(b_left, a_left), t));
+            out_right = _mm_add_ps(a_right, _mm_mul_ps(_mm_sub_ps(b_right, a_right), t));
+        }
+
+        _mm_storeu_ps(left + produced, out_left);
+        _mm_storeu_ps(right + produced, out_right);
+        produced += 4;
+        position += 4 * step;
+    }
+#endif
+
+    while (produced < num_output && position < num_input) {
+        const size_t i = (size_t)position;
+        const size_t next = std::min(i + 1, num_input - 1);
+        const float t = interpolate ? (float)(position - i) : 0.0f;
+
+        left[produced] = input[2 * i] + (input[2 * next] - input[2 * i]) * t;
+        right[produced] = input[2 * i + 1] + (input[2 * next + 1] - input[2 * i + 1]) * t;
+        ++produced;
+        position += step;
+    }
+
+    return produced;
+}
+
+/// Adds a frame to a mix, scaled by the given gains
+static void MixInto(StereoFrame& mix, const StereoFrame& frame, float left_gain, float right_gain) {
+    size_t i = 0;
+
+#ifdef DSP_SSE2
+    const __m128 left_scale = _mm_set1_ps(left_gain);
+    const __m128 right_scale = _mm_set1_ps(right_gain);
+    for (; i + 4 <= SAMPLES_PER_FRAME; i += 4) {
+        const __m128 left = _mm_mul_ps(_mm_load_ps(&frame.left[i]), left_scale);
+        const __m128 right = _mm_mul_ps(_mm_load_ps(&frame.right[i]), right_scale);
+        _mm_store_ps(&mix.left[i], _mm_add_ps(_mm_load_ps(&mix.left[i]), left));
+        _mm_store_ps(&mix.right[i], _mm_add_ps(_mm_load_ps(&mix.right[i]), right));
+    }
+#endif
+
+    for (; i < SAMPLES_PER_FRAME; ++i) {
+        mix.left[i] += frame.left[i] * left_gain;
+        mix.right[i] += frame.right[i] * right_gain;
+    }
+}
+
+void Source::MixFrame(StereoFrame& mix) {
+    if (!enabled)
+        return;
+
+    StereoFrame frame;
+    const bool interpolate = interpolation_mode != InterpolationMode::None;
+    // TODO: Polyphase interpolation is approximated by linear interpolation
+    const double step = std::max(rate_multiplier, 0.0f);
+
+    size_t produced = 0;
+    while (produced < SAMPLES_PER_FRAME) {
+        const size_t num_input = current_samples.size() / 2;
+        if (!playing || position >= num_input) {
+            if (!DequeueBuffer()) {
+                playing = false;
+                break;
+            }
+            continue;
+        }
+
+        produced += Resample(current_samples.data(), num_input, position, step, interpolate,
+                             &frame.left[produced], &frame.right[produced], SAMPLES_PER_FRAME - produced);
+        if (step == 0.0)
+            break;
+    }
+
+    std::fill(frame.left.begin() + produced, frame.left.end(), 0.0f);
+    std::fill(frame.right.begin() + produced, frame.right.end(), 0.0f);
+
+    // The back channels are folded into the front ones, the output is stereo
+    MixInto(mix, frame, gain[0] + gain[2], gain[1] + gain[3]);
+}
+
+void Source::WriteStatus(SourceStatus::Status& status) {
+    status.is_enabled = enabled;
+    status.current_buffer_id_dirty = current_buffer_id_dirty ? 1 : 0;
+    current_buffer_id_dirty = false;
+    status.current_buffer_id = current_buffer_id;
+    status.buffer_position = playing ? static_cast<u32>(position) : 0;
+    status.sync = sync;
+}
+
+} // namespace
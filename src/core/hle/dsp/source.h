@@ -0,0 +1,105 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <queue>
+#include <vector>
+
+#include "common/common_types.h"
+
+#include "core/hle/dsp/shared_memory.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace DSP
+
+namespace DSP {
+
+/// One audio frame being mixed, kept as separate float channels so it can be processed with SIMD
+struct StereoFrame {
+    alignas(16) std::array<float, SAMPLES_PER_FRAME> left;
+    alignas(16) std::array<float, SAMPLES_PER_FRAME> right;
+};
+
+/**
+ * One of the voices of the audio firmware. It plays the buffers the application queues in order of
+ * their ids, decoding each one when it starts playing and resampling it to the DSP's rate.
+ */
+class Source {
+public:
+    explicit Source(size_t source_id);
+
+    /// Returns the voice to its power-on state
+    void Reset();
+
+    /**
+     * Applies the changes the application made to the configuration of the voice, and marks the
+     * configuration as processed.
+     * @param config Configuration of the voice in the region the application last filled
+     * @param adpcm_coeffs ADPCM predictor coefficients of the voice, from the same region
+     */
+    void ParseConfig(SourceConfiguration::Configuration& config, const std::array<s16_le, 16>& adpcm_coeffs);
+
+    /// Plays the next frame of the voice, adding it to the given mix scaled by its main gain
+    void MixFrame(StereoFrame& mix);
+
+    /// Reports the playback state of the voice to the application
+    void WriteStatus(SourceStatus::Status& status);
+
+private:
+    typedef SourceConfiguration::Configuration::Format Format;
+    typedef SourceConfiguration::Configuration::MonoOrStereo MonoOrStereo;
+    typedef SourceConfiguration::Configuration::InterpolationMode InterpolationMode;
+
+    struct Buffer {
+        PAddr physical_address;
+        u32 length;
+        Format format;
+        MonoOrStereo mono_or_stereo;
+        bool adpcm_dirty;
+        std::array<s16, 2> adpcm_yn;
+        bool is_looping;
+        u16 buffer_id;
+        u32 play_position;
+    };
+
+    struct BufferOrder {
+        bool operator()(const Buffer& a, const Buffer& b) const {
+            // Lowest id first
+            return a.buffer_id > b.buffer_id;
+        }
+    };
+
+    /// Starts playing the next queued buffer, returns false if there is none
+    bool DequeueBuffer();
+
+    /// Decodes a buffer from guest memory into current_samples
+    void DecodeBuffer(const Buffer& buffer);
+
+    size_t source_id;
+
+    bool enabled;
+    u16 sync;
+    float rate_multiplier;
+    InterpolationMode interpolation_mode;
+    std::array<float, 4> gain;
+    Format format;
+    MonoOrStereo mono_or_stereo;
+    std::array<s16, 16> adpcm_coeffs;
+    std::array<s16, 2> adpcm_yn; ///< ADPCM history carried over between buffers
+
+    std::priority_queue<Buffer, std::vector<Buffer>, BufferOrder> input_queue;
+
+    /// The buffer being played, and its samples decoded to interleaved stereo
+    Buffer current_buffer;
+    std::vector<s16> current_samples;
+    bool playing;
+    u16 current_buffer_id;
+    bool current_buffer_id_dirty;
+    /// Position in current_samples in stereo samples, fractional when resampling
+    double position;
+};
+
+} // namespace
@@ -0,0 +1,359 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/file_util.h"
+#include "common/logging/log.h"
+#include "common/symbols.h"
+
+#include "core/memory.h"
+#include "core/settings.h"
+#include "core/hle/function_hooks.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace FunctionHooks
+
+namespace FunctionHooks {
+
+using RoutineFunction = bool (*)(u32 (&regs)[4], unsigned& cycles);
+
+struct Routine {
+    const char* name;
+    RoutineFunction function;
+};
+
+struct Hook {
+    const Routine* routine;
+    u64 calls;
+};
+
+static std::unordered_map<VAddr, Hook> hooks;
+static std::atomic<bool> symbols_pending(false);
+
+/// Whether a range is backed by memory, which the block functions access like the CPU would
+static bool IsMemoryRange(VAddr address, u32 size) {
+    if (address + size < address)
+        return false;
+    while (size != 0) {
+        const u32 span = std::min<u32>(size, Memory::PAGE_SIZE - (address & Memory::PAGE_MASK));
+        if (Memory::GetContiguousPointer(address, span) == nullptr)
+            return false;
+        address += span;
+        size -= span;
+    }
+    return true;
+}
+
+/// Rough cost of a routine working on a number of bytes, a word per cycle after the call overhead
+static unsigned BulkCycles(u32 size) {
+    return 8 + size / 4;
+}
+
+static bool Memcpy(u32 (&regs)[4], unsigned& cycles) {
+    const VAddr dest = regs[0], src = regs[1];
+    const u32 size = regs[2];
+    if (!IsMemoryRange(dest, size) || !IsMemoryRange(src, size))
+        return false;
+
+    Memory::CopyBlock(dest, src, size);
+    cycles = BulkCycles(size);
+    return true;
+}
+
+static bool Fill(VAddr dest, u32 size, u8 value, unsigned& cycles) {
+    if (!IsMemoryRange(dest, size))
+        return false;
+
+    if (value == 0) {
+        Memory::ZeroBlock(dest, size);
+    } else {
+        u8 buffer[Memory::PAGE_SIZE];
+        std::memset(buffer, value, sizeof(buffer));
+        for (u32 offset = 0; offset < size; offset += sizeof(buffer))
+            Memory::WriteBlock(dest + offset, buffer, std::min<u32>(sizeof(buffer), size - offset));
+    }
+    cycles = BulkCycles(size);
+    return true;
+}
+
+/// memset(dest, value, size), returns dest
+static bool Memset(u32 (&regs)[4], unsigned& cycles) {
+    return Fill(regs[0], regs[2], static_cast<u8>(regs[1]), cycles);
+}
+
+/// __aeabi_memset(dest, size, value), the EABI variant has its last two arguments swapped
+static bool AeabiMemset(u32 (&regs)[4], unsigned& cycles) {
+    return Fill(regs[0], regs[1], static_cast<u8>(regs[2]), cycles);
+}
+
+/// __aeabi_memclr(dest, size)
+static bool AeabiMemclr(u32 (&regs)[4], unsigned& cycles) {
+    return Fill(regs[0], regs[1], 0, cycles);
+}
+
+static bool Strlen(u32 (&regs)[4], unsigned& cycles) {
+    VAddr address = regs[0];
+    u32 length = 0;
+    while (true) {
+        const u32 span = Memory::PAGE_SIZE - (address & Memory::PAGE_MASK);
+        const u8* data = Memory::GetContiguousPointer(address, span);
+        if (data == nullptr)
+            return false;
+
+        const u8* end = static_cast<const u8*>(std::memchr(data, 0, span));
+        if (end != nullptr) {
+            length += static_cast<u32>(end - data);
+            break;
+        }
+        length += span;
+        address += span;
+    }
+
+    regs[0] = length;
+    cycles = BulkCycles(length);
+    return true;
+}
+
+// The soft-float helpers of the run-time ABI pass doubles in r0-r1 and r2-r3, low word first, and
+// floats in r0 and r1. The host's IEEE arithmetic rounds the same, only the NaNs it generates
+// differ: the ARM libraries return the default NaN, which is positive.
+
+static double GetDouble(u32 low, u32 high) {
+    const u64 bits = (static_cast<u64>(high) << 32) | low;
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void SetDouble(u32 (&regs)[4], double value, bool inputs_nan) {
+    u64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    if (std::isnan(value) && !inputs_nan)
+        bits = 0x7FF8000000000000ULL;
+    regs[0] = static_cast<u32>(bits);
+    regs[1] = static_cast<u32>(bits >> 32);
+}
+
+static float GetFloat(u32 bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void SetFloat(u32 (&regs)[4], float value, bool inputs_nan) {
+    u32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    if (std::isnan(value) && !inputs_nan)
+        bits = 0x7FC00000;
+    regs[0] = bits;
+}
+
+template <typename Op>
+static bool DoubleOp(u32 (&regs)[4], unsigned& cycles, Op op) {
+    const double a = GetDouble(regs[0], regs[1]), b = GetDouble(regs[2], regs[3]);
+    SetDouble(regs, op(a, b), std::isnan(a) || std::isnan(b));
+    cycles = 20;
+    return true;
+}
+
+template <typename Op>
+static bool FloatOp(u32 (&regs)[4], unsigned& cycles, Op op) {
+    const float a = GetFloat(regs[0]), b = GetFloat(regs[1]);
+    SetFloat(regs, op(a, b), std::isnan(a) || std::isnan(b));
+    cycles = 15;
+    return true;
+}
+
+static bool Dadd(u32 (&regs)[4], unsigned& cycles) {
+    return DoubleOp(regs, cycles, [](double a, double b) { return a + b; });
+}
+
+static bool Dsub(u32 (&regs)[4], unsigned& cycles) {
+    return DoubleOp(regs, cycles, [](double a, double b) { return a - b; });
+}
+
+static bool Dmul(u32 (&regs)[4], unsigned& cycles) {
+    return DoubleOp(regs, cycles, [](double a, double b) { return a * b; });
+}
+
+static bool Ddiv(u32 (&regs)[4], unsigned& cycles) {
+    return DoubleOp(regs, cycles, [](double a, double b) { return a / b; });
+}
+
+static bool Fadd(u32 (&regs)[4], unsigned& cycles) {
+    return FloatOp(regs, cycles, [](float a, float b) { return a + b; });
+}
+
+static bool Fsub(u32 (&regs)[4], unsigned& cycles) {
+    return FloatOp(regs, cycles, [](float a, float b) { return a - b; });
+}
+
+static bool Fmul(u32 (&regs)[4], unsigned& cycles) {
+    return FloatOp(regs, cycles, [](float a, float b) { return a * b; });
+}
+
+static bool Fdiv(u32 (&regs)[4], unsigned& cycles) {
+    return FloatOp(regs, cycles, [](float a, float b) { return a / b; });
+}
+
+static const Routine routines[] = {
+    { "memcpy",           Memcpy },
+    { "__aeabi_memcpy",   Memcpy },
+    { "__aeabi_memcpy4",  Memcpy },
+    { "__aeabi_memcpy8",  Memcpy },
+    { "memset",           Memset },
+    { "__aeabi_memset",   AeabiMemset },
+    { "__aeabi_memset4",  AeabiMemset },
+    { "__aeabi_memset8",  AeabiMemset },
+    { "__aeabi_memclr",   AeabiMemclr },
+    { "__aeabi_memclr4",  AeabiMemclr },
+    { "__aeabi_memclr8",  AeabiMemclr },
+    { "strlen",           Strlen },
+    { "__aeabi_dadd",     Dadd },
+    { "__aeabi_dsub",     Dsub },
+    { "__aeabi_dmul",     Dmul },
+    { "__aeabi_ddiv",     Ddiv },
+    { "__aeabi_fadd",     Fadd },
+    { "__aeabi_fsub",     Fsub },
+    { "__aeabi_fmul",     Fmul },
+    { "__aeabi_fdiv",     Fdiv },
+};
+
+static const Routine* FindRoutine(const std::string& name) {
+    for (const Routine& routine : routines) {
+        if (name == routine.name)
+            return &routine;
+    }
+    return nullptr;
+}
+
+static void AddHook(VAddr address, const Routine* routine) {
+    // Thumb routines have the lowest bit of their address set, the CPU branches to the even address
+    address &= ~1;
+    if (hooks.count(address) != 0)
+        return;
+
+    hooks[address] = { routine, 0 };
+    // Code translated before the hook was added would keep running the guest routine
+    Memory::InvalidateCodeRange(address, 4);
+    LOG_INFO(Core_ARM11, "Hooked %s at 0x%08X", routine->name, address);
+}
+
+void HookSymbols() {
+    symbols_pending = true;
+}
+
+void ProcessRequests() {
+    if (!symbols_pending || !symbols_pending.exchange(false) || !Settings::values.hle_guest_routines)
+        return;
+
+    for (const Routine& routine : routines) {
+        const TSymbol symbol = Symbols::GetSymbolByName(routine.name);
+        if (!symbol.name.empty())
+            AddHook(symbol.address, &routine);
+    }
+}
+
+struct Signature {
+    const Routine* routine;
+    std::vector<u8> bytes;
+    /// Whether each byte has to match, the ?? bytes don't
+    std::vector<bool> mask;
+};
+
+static std::vector<Signature> LoadSignatures() {
+    std::vector<Signature> signatures;
+    const std::string path = FileUtil::GetUserPath(D_SYSDATA_IDX) + "function_signatures.txt";
+    std::ifstream file(path);
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        std::string name, byte;
+        if (!(iss >> name) || name[0] == '#')
+            continue;
+
+        Signature signature;
+        signature.routine = FindRoutine(name);
+        if (signature.routine == nullptr) {
+            LOG_WARNING(Core_ARM11, "%s: no host implementation of %s", path.c_str(), name.c_str());
+            continue;
+        }
+
+        while (iss >> byte) {
+            const bool wildcard = byte == "??";
+            signature.bytes.push_back(wildcard ? 0 : static_cast<u8>(std::stoul(byte, nullptr, 16)));
+            signature.mask.push_back(!wildcard);
+        }
+        if (!signature.bytes.empty())
+            signatures.push_back(std::move(signature));
+    }
+    return signatures;
+}
+
+static bool Matches(const u8* code, const Signature& signature) {
+    for (size_t i = 0; i < signature.bytes.size(); ++i) {
+        if (signature.mask[i] && code[i] != signature.bytes[i])
+            return false;
+    }
+    return true;
+}
+
+void ScanCode(VAddr start, u32 size) {
+    if (!Settings::values.hle_guest_routines)
+        return;
+
+    const std::vector<Signature> signatures = LoadSignatures();
+    if (signatures.empty())
+        return;
+
+    std::vector<u8> code(size);
+    Memory::ReadBlock(start, code.data(), size);
+
+    // Routines start at least on a halfword, Thumb ones included
+    for (const Signature& signature : signatures) {
+        if (signature.bytes.size() > size)
+            continue;
+        for (u32 offset = 0; offset <= size - signature.bytes.size(); offset += 2) {
+            if (Matches(&code[offset], signature))
+                AddHook(start + offset, signature.routine);
+        }
+    }
+}
+
+bool HasHook(VAddr address) {
+    return !hooks.empty() && hooks.count(address) != 0;
+}
+
+bool Call(VAddr address, u32 (&regs)[4], unsigned& cycles) {
+    auto itr = hooks.find(address);
+    if (itr == hooks.end())
+        return false;
+
+    Hook& hook = itr->second;
+    if (!hook.routine->function(regs, cycles))
+        return false;
+    ++hook.calls;
+    return true;
+}
+
+void Clear() {
+    for (const auto& entry : hooks) {
+        LOG_DEBUG(Core_ARM11, "%s at 0x%08X: %llu calls", entry.second.routine->name, entry.first,
+                  static_cast<unsigned long long>(entry.second.calls));
+    }
+    hooks.clear();
+}
+
+} // namespace
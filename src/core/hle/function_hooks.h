@@ -0,0 +1,54 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace FunctionHooks
+
+/**
+ * Host implementations of guest library routines that are hot enough to be worth not emulating,
+ * such as memcpy, memset, strlen and the soft-float helpers of the ARM EABI.
+ *
+ * The routines are found at load time, by name in the symbols of the application (from an ELF
+ * file or a symbol map), or by scanning the loaded code for the signatures listed in
+ * function_signatures.txt in the sysdata directory. Each line of that file holds a routine name
+ * and the bytes its code starts with, in hex, with ?? for bytes that vary.
+ *
+ * The CPU calls a hooked routine instead of translating the block starting at its address: the
+ * host implementation takes its arguments from r0-r3, leaves its result in r0-r1 and returns to
+ * the address in LR. A routine whose arguments point outside of memory, e.g. to I/O registers or
+ * watchpoints, is declined and emulated instead.
+ */
+namespace FunctionHooks {
+
+/**
+ * Hooks the known routines found in the symbols loaded so far, at the next ProcessRequests. Can be
+ * called from any thread, e.g. when a symbol map is loaded from the UI.
+ */
+void HookSymbols();
+
+/// Applies a HookSymbols request. Called before running the CPU.
+void ProcessRequests();
+
+/// Hooks the known routines found by their signature in a range of loaded code
+void ScanCode(VAddr start, u32 size);
+
+/// Whether a routine at the given address is hooked. Called by the CPU cores before translating.
+bool HasHook(VAddr address);
+
+/**
+ * Runs the host implementation of the routine hooked at the given address
+ * @param regs r0-r3 of the caller, the results are written back to them
+ * @param cycles Set to the number of cycles the routine is accounted for
+ * @return false if the call was declined, in which case the routine has to be emulated
+ */
+bool Call(VAddr address, u32 (&regs)[4], unsigned& cycles);
+
+/// Removes the hooks, when the emulated system is shut down
+void Clear();
+
+} // namespace
@@ -9,9 +9,12 @@
 #include "core/core.h"
 #include "core/hle/hle.h"
 #include "core/hle/config_mem.h"
+#include "core/hle/dsp/dsp.h"
+#include "core/hle/function_hooks.h"
 #include "core/hle/shared_page.h"
 #include "core/hle/kernel/thread.h"
 #include "core/hle/service/service.h"
+#include "core/memory_setup.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -35,18 +38,24 @@ void Reschedule(const char *reason) {
 
 void Init() {
     Service::Init();
+    DSP::Init();
     ConfigMem::Init();
     SharedPage::Init();
 
+    // The config memory and shared page are mapped into the fastmem view as copies
+    Memory::RefreshFastmemCopies();
+
     g_reschedule = false;
 
     LOG_DEBUG(Kernel, "initialized OK");
 }
 
 void Shutdown() {
+    DSP::Shutdown();
     ConfigMem::Shutdown();
     SharedPage::Shutdown();
     Service::Shutdown();
+    FunctionHooks::Clear();
 
     LOG_DEBUG(Kernel, "shutdown OK");
 }
@@ -0,0 +1,116 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/bit_field.h"
+#include "common/common_types.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace IPC
+
+namespace IPC {
+
+/// Offset of the command buffer in a thread's TLS
+static const u32 COMMAND_BUFFER_OFFSET = 0x80;
+/// Size of the command buffer in words
+static const size_t COMMAND_BUFFER_LENGTH = 0x40;
+
+/**
+ * First word of a request or response. The normal parameters follow it, then the translate
+ * parameters, which are descriptors of handles and buffers the kernel has to translate between
+ * processes, each followed by its payload.
+ */
+union Header {
+    u32 raw;
+    BitField< 0,  6, u32> translate_params_size;
+    BitField< 6,  6, u32> normal_params;
+    BitField<16, 16, u32> command_id;
+};
+
+inline u32 MakeHeader(u16 command_id, unsigned normal_params, unsigned translate_params_size) {
+    Header header;
+    header.raw = 0;
+    header.command_id = command_id;
+    header.normal_params = normal_params;
+    header.translate_params_size = translate_params_size;
+    return header.raw;
+}
+
+enum DescriptorType : u32 {
+    // Buffer descriptors, identified by the lowest four bits
+    StaticBuffer = 0x02,
+    PXIBuffer    = 0x04,
+    MappedBuffer = 0x08,
+    // Handle descriptors, identified by bits 4 and 5 when none of the above matches
+    CopyHandle   = 0x00,
+    MoveHandle   = 0x10,
+    CallingPid   = 0x20,
+};
+
+inline DescriptorType GetDescriptorType(u32 descriptor) {
+    if ((descriptor & 0xF) == StaticBuffer)
+        return StaticBuffer;
+    if ((descriptor & 0xF) == PXIBuffer || (descriptor & 0xF) == (PXIBuffer | 0x2))
+        return PXIBuffer;
+    if ((descriptor & 0x8) != 0)
+        return MappedBuffer;
+    return static_cast<DescriptorType>(descriptor & 0x30);
+}
+
+/// Descriptor of the given number of handles that stay open in the sending process
+inline u32 CopyHandleDesc(unsigned num_handles = 1) {
+    return CopyHandle | ((num_handles - 1) << 26);
+}
+
+/// Descriptor of the given number of handles that are closed in the sending process
+inline u32 MoveHandleDesc(unsigned num_handles = 1) {
+    return MoveHandle | ((num_handles - 1) << 26);
+}
+
+/// Descriptor that the kernel replaces the following word of with the sender's process id
+inline u32 CallingPidDesc() {
+    return CallingPid;
+}
+
+/// Number of handles following a handle descriptor
+inline unsigned HandleNumberFromDesc(u32 handle_descriptor) {
+    return (handle_descriptor >> 26) + 1;
+}
+
+/// Descriptor of a buffer copied to one of the receiver's static buffers, followed by its address
+inline u32 StaticBufferDesc(u32 size, unsigned buffer_id) {
+    return StaticBuffer | (size << 14) | ((buffer_id & 0xF) << 10);
+}
+
+union StaticBufferDescInfo {
+    u32 raw;
+    BitField<10,  4, u32> buffer_id;
+    BitField<14, 18, u32> size;
+};
+
+union PXIBufferDescInfo {
+    u32 raw;
+    BitField<4,  4, u32> buffer_id;
+    BitField<8, 24, u32> size;
+};
+
+enum MappedBufferPermissions : u32 {
+    R  = 1,
+    W  = 2,
+    RW = R | W,
+};
+
+/// Descriptor of a buffer mapped into the receiver's address space, followed by its address
+inline u32 MappedBufferDesc(u32 size, MappedBufferPermissions permissions) {
+    return MappedBuffer | (size << 4) | (permissions << 1);
+}
+
+union MappedBufferDescInfo {
+    u32 raw;
+    BitField<1,  2, MappedBufferPermissions> permissions;
+    BitField<4, 28, u32> size;
+};
+
+} // namespace
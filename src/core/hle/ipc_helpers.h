@@ -0,0 +1,199 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstring>
+
+#include "common/assert.h"
+#include "common/common_types.h"
+#include "common/logging/log.h"
+
+#include "core/hle/hle.h"
+#include "core/hle/ipc.h"
+#include "core/hle/result.h"
+#include "core/memory.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace IPC
+
+namespace IPC {
+
+/// Cursor over the words of a command buffer, following its header
+class RequestHelperBase {
+protected:
+    RequestHelperBase(u32* command_buffer, u32 command_header) : cmdbuf(command_buffer), index(1) {
+        header.raw = command_header;
+    }
+
+    /// Checks that the given number of words fit within the parameters declared by the header
+    void ValidateSize(unsigned size_in_words) const {
+        DEBUG_ASSERT_MSG(index + size_in_words <= 1 + header.normal_params + header.translate_params_size,
+                         "IPC message of header 0x%08X overflows its parameters", header.raw);
+        DEBUG_ASSERT(index + size_in_words <= COMMAND_BUFFER_LENGTH);
+    }
+
+    u32* cmdbuf;
+    unsigned index;
+    Header header;
+
+public:
+    /// Moves past the given number of words
+    void Skip(unsigned size_in_words) {
+        ValidateSize(size_in_words);
+        index += size_in_words;
+    }
+};
+
+/**
+ * Writes a response into the command buffer of the requesting thread, starting with its header.
+ * Parameters are pushed in the order they appear in the response.
+ */
+class ResponseBuilder : public RequestHelperBase {
+public:
+    ResponseBuilder(u32* command_buffer, u32 command_header)
+            : RequestHelperBase(command_buffer, command_header) {
+        cmdbuf[0] = command_header;
+    }
+
+    ResponseBuilder(u32* command_buffer, u16 command_id, unsigned normal_params, unsigned translate_params_size)
+            : ResponseBuilder(command_buffer, MakeHeader(command_id, normal_params, translate_params_size)) {}
+
+    /// Copies a value of one or more words as it is laid out in memory
+    template <typename T>
+    void Push(const T& value) {
+        static_assert(sizeof(T) % sizeof(u32) == 0, "Parameters are made of whole words");
+        ValidateSize(sizeof(T) / sizeof(u32));
+        std::memcpy(cmdbuf + index, &value, sizeof(T));
+        index += sizeof(T) / sizeof(u32);
+    }
+
+    void Push(bool value) {
+        Push<u32>(value ? 1 : 0);
+    }
+
+    void Push(ResultCode value) {
+        Push(value.raw);
+    }
+
+    /// Pushes handles that stay open in the service
+    void PushCopyHandle(Handle handle) {
+        Push(CopyHandleDesc());
+        Push(handle);
+    }
+
+    /// Pushes handles that the service doesn't keep
+    void PushMoveHandle(Handle handle) {
+        Push(MoveHandleDesc());
+        Push(handle);
+    }
+
+    /// Pushes a buffer that the client receives in one of its static buffers
+    void PushStaticBuffer(VAddr address, u32 size, unsigned buffer_id) {
+        Push(StaticBufferDesc(size, buffer_id));
+        Push(address);
+    }
+
+    void PushMappedBuffer(VAddr address, u32 size, MappedBufferPermissions permissions) {
+        Push(MappedBufferDesc(size, permissions));
+        Push(address);
+    }
+};
+
+/**
+ * Reads the parameters of a request from the command buffer of the requesting thread, in the order
+ * they appear in the request. Buffers are returned as pointers into the client's memory rather than
+ * copied, HLE services run in the same address space.
+ */
+class RequestParser : public RequestHelperBase {
+public:
+    /**
+     * @param command_buffer Command buffer of the requesting thread
+     * @param command_header Header the request is expected to have, as in the function table
+     */
+    RequestParser(u32* command_buffer, u32 command_header)
+            : RequestHelperBase(command_buffer, command_header) {
+        DEBUG_ASSERT_MSG(cmdbuf[0] == command_header, "IPC request has header 0x%08X instead of 0x%08X",
+                         cmdbuf[0], command_header);
+    }
+
+    RequestParser(u32* command_buffer, u16 command_id, unsigned normal_params, unsigned translate_params_size)
+            : RequestParser(command_buffer, MakeHeader(command_id, normal_params, translate_params_size)) {}
+
+    /**
+     * Starts the response in the same command buffer, which the request is read from until then.
+     * Requests are answered in place, the parameters that are still needed have to be popped first.
+     */
+    ResponseBuilder MakeBuilder(unsigned normal_params, unsigned translate_params_size) const {
+        return ResponseBuilder(cmdbuf, static_cast<u16>(header.command_id), normal_params, translate_params_size);
+    }
+
+    /// Copies a value of one or more words as it is laid out in memory
+    template <typename T>
+    T Pop() {
+        static_assert(sizeof(T) % sizeof(u32) == 0, "Parameters are made of whole words");
+        ValidateSize(sizeof(T) / sizeof(u32));
+        T value;
+        std::memcpy(&value, cmdbuf + index, sizeof(T));
+        index += sizeof(T) / sizeof(u32);
+        return value;
+    }
+
+    bool PopBool() {
+        return Pop<u32>() != 0;
+    }
+
+    /// Pops a descriptor of a single handle of the given type and the handle after it
+    Handle PopHandle(DescriptorType type = CopyHandle) {
+        const u32 descriptor = Pop<u32>();
+        if (GetDescriptorType(descriptor) != type || HandleNumberFromDesc(descriptor) != 1) {
+            LOG_ERROR(Service, "IPC request of header 0x%08X has invalid handle descriptor 0x%08X",
+                      header.raw, descriptor);
+        }
+        return Pop<Handle>();
+    }
+
+    /**
+     * Pops a static buffer descriptor and the address of the buffer after it
+     * @param size Set to the size of the buffer in bytes
+     * @return Pointer to the buffer in the client's memory, nullptr if it isn't valid
+     */
+    const u8* PopStaticBuffer(u32* size) {
+        StaticBufferDescInfo descriptor;
+        descriptor.raw = Pop<u32>();
+        const VAddr address = Pop<VAddr>();
+
+        *size = descriptor.size;
+        if (GetDescriptorType(descriptor.raw) != StaticBuffer) {
+            LOG_ERROR(Service, "IPC request of header 0x%08X has invalid static buffer descriptor 0x%08X",
+                      header.raw, descriptor.raw);
+            return nullptr;
+        }
+        return Memory::GetPointer(address);
+    }
+
+    /**
+     * Pops a mapped buffer descriptor and the address of the buffer after it
+     * @param size Set to the size of the buffer in bytes
+     * @param permissions Set to how the service may access the buffer, if not nullptr
+     * @return Pointer to the buffer in the client's memory, nullptr if it isn't valid
+     */
+    u8* PopMappedBuffer(u32* size, MappedBufferPermissions* permissions = nullptr) {
+        MappedBufferDescInfo descriptor;
+        descriptor.raw = Pop<u32>();
+        const VAddr address = Pop<VAddr>();
+
+        *size = descriptor.size;
+        if (permissions != nullptr)
+            *permissions = descriptor.permissions;
+        if (GetDescriptorType(descriptor.raw) != MappedBuffer) {
+            LOG_ERROR(Service, "IPC request of header 0x%08X has invalid mapped buffer descriptor 0x%08X",
+                      header.raw, descriptor.raw);
+            return nullptr;
+        }
+        return Memory::GetPointer(address);
+    }
+};
+
+} // namespace
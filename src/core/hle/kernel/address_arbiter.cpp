@@ -2,6 +2,7 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include "common/chunk_file.h"
 #include "common/common_types.h"
 #include "common/logging/log.h"
 
@@ -85,4 +86,8 @@ ResultCode AddressArbiter::ArbitrateAddress(ArbitrationType type, VAddr address,
     return RESULT_SUCCESS;
 }
 
+void AddressArbiter::DoState(PointerWrap& p) {
+    p.Do(name);
+}
+
 } // namespace Kernel
@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "common/assert.h"
+#include "common/chunk_file.h"
 
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/kernel/event.h"
@@ -51,4 +52,11 @@ void Event::Clear() {
     signaled = false;
 }
 
+void Event::DoState(PointerWrap& p) {
+    p.Do(intitial_reset_type);
+    p.Do(reset_type);
+    p.Do(signaled);
+    p.Do(name);
+}
+
 } // namespace
@@ -7,11 +7,12 @@
 #include "common/common_types.h"
 
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/object_pool.h"
 #include "core/hle/svc.h"
 
 namespace Kernel {
 
-class Event final : public WaitObject {
+class Event final : public WaitObject, public PooledObject<Event> {
 public:
     /**
      * Creates an event
@@ -26,6 +27,8 @@ public:
     static const HandleType HANDLE_TYPE = HandleType::Event;
     HandleType GetHandleType() const override { return HANDLE_TYPE; }
 
+    void DoState(PointerWrap& p) override;
+
     ResetType intitial_reset_type;          ///< ResetType specified at Event initialization
     ResetType reset_type;                   ///< Current ResetType
 
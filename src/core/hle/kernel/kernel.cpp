@@ -3,56 +3,185 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "common/assert.h"
+#include "common/chunk_file.h"
 #include "common/logging/log.h"
 
 #include "core/arm/arm_interface.h"
 #include "core/core.h"
+#include "core/hle/kernel/address_arbiter.h"
+#include "core/hle/kernel/event.h"
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/mutex.h"
 #include "core/hle/kernel/resource_limit.h"
 #include "core/hle/kernel/process.h"
+#include "core/hle/kernel/semaphore.h"
+#include "core/hle/kernel/shared_memory.h"
 #include "core/hle/kernel/thread.h"
 #include "core/hle/kernel/timer.h"
+#include "core/hle/kernel/timer_wheel.h"
 
 namespace Kernel {
 
 unsigned int Object::next_object_id;
 HandleTable g_handle_table;
 
-void WaitObject::AddWaitingThread(SharedPtr<Thread> thread) {
-    auto itr = std::find(waiting_threads.begin(), waiting_threads.end(), thread);
-    if (itr == waiting_threads.end())
-        waiting_threads.push_back(std::move(thread));
+/// Every live object by id
+static std::unordered_map<unsigned int, Object*> object_registry;
+
+Object::Object() {
+    object_registry[object_id] = this;
+}
+
+Object::~Object() {
+    object_registry.erase(object_id);
+}
+
+void Object::RestoreObjectId(unsigned int id) {
+    DEBUG_ASSERT(object_registry.count(id) == 0);
+
+    object_registry.erase(object_id);
+    object_id = id;
+    object_registry[object_id] = this;
+}
+
+Object* FindObjectById(unsigned int id) {
+    auto itr = object_registry.find(id);
+    return (itr == object_registry.end()) ? nullptr : itr->second;
 }
 
-void WaitObject::RemoveWaitingThread(Thread* thread) {
-    auto itr = std::find(waiting_threads.begin(), waiting_threads.end(), thread);
-    if (itr != waiting_threads.end())
-        waiting_threads.erase(itr);
+/// Id saved for references to no object
+static const u32 NO_OBJECT_ID = 0xFFFFFFFF;
+
+void DoObjectReference(PointerWrap& p, SharedPtr<Object>& object, HandleType type) {
+    u32 id = (object != nullptr) ? object->GetObjectId() : NO_OBJECT_ID;
+    p.Do(id);
+    if (p.GetMode() != PointerWrap::MODE_READ)
+        return;
+
+    if (id == NO_OBJECT_ID) {
+        object = nullptr;
+        return;
+    }
+
+    Object* found = FindObjectById(id);
+    if (found == nullptr || (type != HandleType::Unknown && found->GetHandleType() != type)) {
+        LOG_ERROR(Kernel, "Save state refers to object %u, which doesn't exist or is of the wrong type", id);
+        p.SetError(PointerWrap::ERROR_FAILURE);
+        object = nullptr;
+        return;
+    }
+    object = found;
+}
+
+void WaitObject::AddWaitingThread(WaitListEntry* entry) {
+    DEBUG_ASSERT(!entry->linked);
+
+    // Threads mostly wait behind others of the same priority, so searching from the back finds the
+    // insertion point right away
+    const s32 priority = entry->thread->current_priority;
+    WaitListEntry* prev = last_waiting;
+    while (prev != nullptr && prev->thread->current_priority > priority)
+        prev = prev->prev;
+
+    entry->prev = prev;
+    entry->next = (prev != nullptr) ? prev->next : first_waiting;
+    if (entry->next != nullptr)
+        entry->next->prev = entry;
+    else
+        last_waiting = entry;
+    if (prev != nullptr)
+        prev->next = entry;
+    else
+        first_waiting = entry;
+
+    entry->linked = true;
+}
+
+void WaitObject::RemoveWaitingThread(WaitListEntry* entry) {
+    if (!entry->linked)
+        return;
+
+    if (entry->prev != nullptr)
+        entry->prev->next = entry->next;
+    else
+        first_waiting = entry->next;
+    if (entry->next != nullptr)
+        entry->next->prev = entry->prev;
+    else
+        last_waiting = entry->prev;
+
+    entry->prev = nullptr;
+    entry->next = nullptr;
+    entry->linked = false;
 }
 
 SharedPtr<Thread> WaitObject::WakeupNextThread() {
-    if (waiting_threads.empty())
+    if (first_waiting == nullptr)
         return nullptr;
 
-    auto next_thread = std::move(waiting_threads.front());
-    waiting_threads.erase(waiting_threads.begin());
+    WaitListEntry* entry = first_waiting;
+    SharedPtr<Thread> next_thread = entry->thread;
+    RemoveWaitingThread(entry);
 
-    next_thread->ReleaseWaitObject(this);
+    next_thread->ReleaseWaitObject(*entry);
 
     return next_thread;
 }
 
-void WaitObject::WakeupAllWaitingThreads() {
-    auto waiting_threads_copy = waiting_threads;
+void WaitObject::DoWaitListState(PointerWrap& p) {
+    // Entries are stored as the id of their thread and their index in its list of wait objects
+    std::vector<u32> thread_ids;
+    std::vector<u32> indices;
+    for (WaitListEntry* entry = first_waiting; entry != nullptr; entry = entry->next) {
+        const Thread* thread = entry->thread;
+        thread_ids.push_back(thread->GetObjectId());
+        indices.push_back(static_cast<u32>(entry - thread->wait_objects.data()));
+    }
+    p.Do(thread_ids);
+    p.Do(indices);
+    if (p.GetMode() != PointerWrap::MODE_READ)
+        return;
+
+    DEBUG_ASSERT(first_waiting == nullptr);
+    for (size_t i = 0; i < thread_ids.size(); ++i) {
+        Object* object = FindObjectById(thread_ids[i]);
+        Thread* thread = (object != nullptr && object->GetHandleType() == HandleType::Thread) ?
+                         static_cast<Thread*>(object) : nullptr;
+        if (thread == nullptr || i >= indices.size() || indices[i] >= thread->wait_objects.size() ||
+            thread->wait_objects[indices[i]].object != this || thread->wait_objects[indices[i]].linked) {
+            LOG_ERROR(Kernel, "Save state has an invalid waiting thread %u for object %u",
+                      thread_ids[i], GetObjectId());
+            p.SetError(PointerWrap::ERROR_FAILURE);
+            return;
+        }
+
+        // Appended as saved, the list is in priority order already
+        WaitListEntry* entry = &thread->wait_objects[indices[i]];
+        entry->prev = last_waiting;
+        entry->next = nullptr;
+        if (last_waiting != nullptr)
+            last_waiting->next = entry;
+        else
+            first_waiting = entry;
+        last_waiting = entry;
+        entry->linked = true;
+    }
+}
 
-    // We use a copy because ReleaseWaitObject will remove the thread from this object's
-    // waiting_threads list
-    for (auto thread : waiting_threads_copy)
-        thread->ReleaseWaitObject(this);
+void WaitObject::WakeupAllWaitingThreads() {
+    // ReleaseWaitObject doesn't necessarily resume the thread, so take each entry off the list here
+    while (first_waiting != nullptr) {
+        WaitListEntry* entry = first_waiting;
+        RemoveWaitingThread(entry);
 
-    ASSERT_MSG(waiting_threads.empty(), "failed to awaken all waiting threads!");
+        entry->thread->ReleaseWaitObject(*entry);
+    }
 }
 
 HandleTable::HandleTable() {
@@ -133,9 +262,153 @@ void HandleTable::Clear() {
     next_free_slot = 0;
 }
 
+void HandleTable::DoState(PointerWrap& p) {
+    for (auto& object : objects)
+        DoObjectReference(p, object, HandleType::Unknown);
+    p.DoArray(generations.data(), static_cast<int>(generations.size()));
+    p.Do(next_generation);
+    p.Do(next_free_slot);
+}
+
+/// Objects of the save state being saved or restored, kept alive from the list to the kernel state
+static std::vector<SharedPtr<Object>> state_objects;
+
+/// Creates an object of the given type to restore a state into, nullptr if it can't be created
+static SharedPtr<Object> CreateBlankObject(HandleType type) {
+    switch (type) {
+    case HandleType::Event:
+        return Event::Create(RESETTYPE_ONESHOT);
+    case HandleType::Mutex:
+        return Mutex::Create(false);
+    case HandleType::SharedMemory:
+        return SharedMemory::Create(0, MemoryPermission::ReadWrite, MemoryPermission::ReadWrite);
+    case HandleType::Thread:
+        return Thread::CreateUninitialized();
+    case HandleType::AddressArbiter:
+        return AddressArbiter::Create();
+    case HandleType::Semaphore:
+        return Semaphore::Create(0, 1).MoveFrom();
+    case HandleType::Timer:
+        return Timer::Create(RESETTYPE_ONESHOT);
+    case HandleType::ResourceLimit:
+        return ResourceLimit::Create();
+    default:
+        return nullptr;
+    }
+}
+
+void DoObjectListState(PointerWrap& p) {
+    std::vector<u32> ids;
+    std::vector<u32> types;
+    if (p.GetMode() != PointerWrap::MODE_READ) {
+        for (const auto& entry : object_registry)
+            ids.push_back(entry.first);
+        std::sort(ids.begin(), ids.end());
+        for (u32 id : ids)
+            types.push_back(static_cast<u32>(object_registry[id]->GetHandleType()));
+    }
+    p.Do(ids);
+    p.Do(types);
+    if (ids.size() != types.size())
+        p.SetError(PointerWrap::ERROR_FAILURE);
+
+    state_objects.clear();
+    if (p.GetMode() != PointerWrap::MODE_READ) {
+        for (u32 id : ids)
+            state_objects.push_back(object_registry[id]);
+        return;
+    }
+
+    // Objects are matched up before anything is modified, so that a state that doesn't fit this
+    // system fails to load without side effects
+    for (size_t i = 0; i < ids.size(); ++i) {
+        const Object* object = FindObjectById(ids[i]);
+        if (object != nullptr && static_cast<u32>(object->GetHandleType()) != types[i]) {
+            LOG_ERROR(Kernel, "Object %u of the save state has type %u instead of %u", ids[i],
+                      types[i], static_cast<u32>(object->GetHandleType()));
+            p.SetError(PointerWrap::ERROR_FAILURE);
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < ids.size(); ++i) {
+        SharedPtr<Object> object = FindObjectById(ids[i]);
+        if (object == nullptr) {
+            object = CreateBlankObject(static_cast<HandleType>(types[i]));
+            if (object == nullptr)
+                continue;
+            object->RestoreObjectId(ids[i]);
+        }
+        state_objects.push_back(std::move(object));
+    }
+}
+
+void HoldRestoredObject(SharedPtr<Object> object) {
+    state_objects.push_back(std::move(object));
+}
+
+void DoState(PointerWrap& p) {
+    // Objects that couldn't be created blank have been restored in the meantime
+    u32 num_objects = static_cast<u32>(state_objects.size());
+    p.Do(num_objects);
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        std::vector<SharedPtr<Object>> objects(num_objects);
+        for (auto& object : objects)
+            DoObjectReference(p, object, HandleType::Unknown);
+        state_objects.swap(objects);
+    } else {
+        for (auto& object : state_objects)
+            DoObjectReference(p, object, HandleType::Unknown);
+    }
+    if (p.error) {
+        LOG_ERROR(Kernel, "Not all objects of the save state could be restored");
+        state_objects.clear();
+        return;
+    }
+
+    DoTimeoutsState(p);
+
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        // Threads that don't exist in the state mustn't run or stay in any wait list
+        std::unordered_set<Object*> restored(state_objects.size());
+        for (const auto& object : state_objects)
+            restored.insert(object.get());
+        std::vector<SharedPtr<Thread>> stale_threads;
+        for (const auto& entry : object_registry) {
+            if (entry.second->GetHandleType() == HandleType::Thread && restored.count(entry.second) == 0)
+                stale_threads.push_back(static_cast<Thread*>(entry.second));
+        }
+        for (auto& thread : stale_threads) {
+            if (thread->status != THREADSTATUS_DEAD)
+                thread->Stop();
+        }
+    }
+
+    for (auto& object : state_objects) {
+        object->DoState(p);
+        p.DoMarker(object->GetTypeName().c_str());
+    }
+    for (auto& object : state_objects) {
+        if (object->IsWaitable())
+            static_cast<WaitObject*>(object.get())->DoWaitListState(p);
+    }
+
+    g_handle_table.DoState(p);
+    DoObjectReference(p, g_current_process);
+    DoThreadingState(p);
+    p.Do(Object::next_object_id);
+    p.Do(Process::next_process_id);
+    p.DoMarker("Kernel");
+
+    if (p.GetMode() == PointerWrap::MODE_READ)
+        HLE::g_reschedule = false;
+    state_objects.clear();
+}
+
 /// Initialize the kernel
 void Init() {
     Kernel::ResourceLimitsInit();
+    Kernel::TimeoutsInit();
     Kernel::ThreadingInit();
     Kernel::TimersInit();
 
@@ -147,6 +420,7 @@ void Init() {
 
 /// Shutdown the kernel
 void Shutdown() {
+    Kernel::TimeoutsShutdown();
     Kernel::ThreadingShutdown();
     Kernel::TimersShutdown();
     Kernel::ResourceLimitsShutdown();
@@ -154,4 +428,18 @@ void Shutdown() {
     g_current_process = nullptr;
 }
 
+size_t ReportLiveObjects() {
+    std::vector<unsigned int> ids;
+    for (const auto& entry : object_registry)
+        ids.push_back(entry.first);
+    std::sort(ids.begin(), ids.end());
+
+    for (unsigned int id : ids) {
+        const Object* object = object_registry[id];
+        LOG_WARNING(Kernel, "%s %u (%s) outlived the kernel", object->GetTypeName().c_str(), id,
+                    object->GetName().c_str());
+    }
+    return ids.size();
+}
+
 } // namespace
@@ -16,11 +16,13 @@
 #include "core/hle/hle.h"
 #include "core/hle/result.h"
 
+class PointerWrap;
 struct ApplicationInfo;
 
 namespace Kernel {
 
 class Thread;
+struct WaitListEntry;
 
 // TODO: Verify code
 const ResultCode ERR_OUT_OF_HANDLES(ErrorDescription::OutOfMemory, ErrorModule::Kernel,
@@ -56,11 +58,18 @@ enum {
 
 class Object : NonCopyable {
 public:
-    virtual ~Object() {}
+    Object();
+    virtual ~Object();
 
-    /// Returns a unique identifier for the object. For debugging purposes only.
+    /// Returns a unique identifier for the object, which save states refer to it by
     unsigned int GetObjectId() const { return object_id; }
 
+    /**
+     * Changes the id of an object that was created to be restored from a save state, to the one
+     * it was saved with. No other object may have the id.
+     */
+    void RestoreObjectId(unsigned int id);
+
     virtual std::string GetTypeName() const { return "[BAD KERNEL OBJECT TYPE]"; }
     virtual std::string GetName() const { return "[UNKNOWN KERNEL OBJECT]"; }
     virtual Kernel::HandleType GetHandleType() const = 0;
@@ -90,6 +99,12 @@ public:
         }
     }
 
+    /**
+     * Saves or restores the state of the object. A state is only restored into an object of the
+     * same type and id, references to other objects are stored as their ids.
+     */
+    virtual void DoState(PointerWrap& p) {}
+
 public:
     static unsigned int next_object_id;
 
@@ -115,6 +130,22 @@ inline void intrusive_ptr_release(Object* object) {
 template <typename T>
 using SharedPtr = boost::intrusive_ptr<T>;
 
+/// Looks up a live object by its id, nullptr if there is none
+Object* FindObjectById(unsigned int id);
+
+/**
+ * Saves or restores a reference to an object as its id. Restoring fails the state if there is no
+ * object with the id and the given type, HandleType::Unknown accepts any type.
+ */
+void DoObjectReference(PointerWrap& p, SharedPtr<Object>& object, HandleType type);
+
+template <typename T>
+void DoObjectReference(PointerWrap& p, SharedPtr<T>& object) {
+    SharedPtr<Object> generic = object;
+    DoObjectReference(p, generic, T::HANDLE_TYPE);
+    object = boost::static_pointer_cast<T>(std::move(generic));
+}
+
 /// Class that represents a Kernel object that a thread can be waiting on
 class WaitObject : public Object {
 public:
@@ -129,16 +160,18 @@ public:
     virtual void Acquire() = 0;
 
     /**
-     * Add a thread to wait on this object
-     * @param thread Pointer to thread to add
+     * Add a thread to wait on this object. Threads are woken up in order of priority, and in the
+     * order they started waiting within the same priority.
+     * @param entry Entry of the waiting thread, owned by the thread
      */
-    void AddWaitingThread(SharedPtr<Thread> thread);
+    void AddWaitingThread(WaitListEntry* entry);
 
     /**
-     * Removes a thread from waiting on this object (e.g. if it was resumed already)
-     * @param thread Pointer to thread to remove
+     * Removes a thread from waiting on this object (e.g. if it was resumed already). Does nothing
+     * if it isn't waiting.
+     * @param entry Entry of the thread to remove
      */
-    void RemoveWaitingThread(Thread* thread);
+    void RemoveWaitingThread(WaitListEntry* entry);
 
     /**
      * Wake up the next thread waiting on this object
@@ -149,9 +182,28 @@ public:
     /// Wake up all threads waiting on this object
     void WakeupAllWaitingThreads();
 
+    /**
+     * Saves or restores the order of the waiting threads. Their entries have to be restored
+     * already, and not be in any list.
+     */
+    void DoWaitListState(PointerWrap& p);
+
 private:
-    /// Threads waiting for this object to become available
-    std::vector<SharedPtr<Thread>> waiting_threads;
+    /// Threads waiting for this object to become available, highest priority first
+    WaitListEntry* first_waiting = nullptr;
+    WaitListEntry* last_waiting = nullptr;
+};
+
+/**
+ * A thread's entry in the list of threads waiting on a WaitObject. Threads own one entry per object
+ * they wait on, so waiting doesn't need to allocate or to search the list.
+ */
+struct WaitListEntry {
+    SharedPtr<WaitObject> object; ///< Object that is waited on
+    Thread* thread = nullptr;     ///< Thread that is waiting, it owns the entry
+    WaitListEntry* prev = nullptr;
+    WaitListEntry* next = nullptr;
+    bool linked = false;          ///< Whether the entry is in the object's list
 };
 
 /**
@@ -242,6 +294,8 @@ public:
     /// Closes all handles held in this table.
     void Clear();
 
+    void DoState(PointerWrap& p);
+
 private:
     /**
      * This is the maximum limit of handles allowed per process in CTR-OS. It can be further
@@ -279,4 +333,31 @@ void Init();
 /// Shutdown the kernel
 void Shutdown();
 
+/**
+ * Logs the kernel objects that are still alive, which should be none once the services and the
+ * kernel have been shut down. Anything left is held by global state that would leak into the next
+ * title booted in this process.
+ * @return Number of live objects
+ */
+size_t ReportLiveObjects();
+
+/**
+ * Saves or restores the list of kernel objects. Restoring matches the listed objects with the
+ * objects of the same id, which have to be of the same type, or creates blank objects for them.
+ * Objects that can't be created blank, like sessions, have to be restored before the kernel state.
+ */
+void DoObjectListState(PointerWrap& p);
+
+/**
+ * Keeps an object that has been restored outside of the kernel alive until the kernel state has
+ * been restored, which is expected to refer to it
+ */
+void HoldRestoredObject(SharedPtr<Object> object);
+
+/**
+ * Saves or restores the state of the kernel objects and of the scheduler, after the list of
+ * objects. Objects missing from the state are torn down.
+ */
+void DoState(PointerWrap& p);
+
 } // namespace
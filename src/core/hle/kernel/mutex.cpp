@@ -8,6 +8,7 @@
 #include <boost/range/algorithm_ext/erase.hpp>
 
 #include "common/assert.h"
+#include "common/chunk_file.h"
 
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/kernel/mutex.h"
@@ -98,4 +99,10 @@ void Mutex::Release() {
     HLE::Reschedule(__func__);
 }
 
+void Mutex::DoState(PointerWrap& p) {
+    p.Do(lock_count);
+    p.Do(name);
+    DoObjectReference(p, holding_thread);
+}
+
 } // namespace
@@ -9,12 +9,13 @@
 #include "common/common_types.h"
 
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/object_pool.h"
 
 namespace Kernel {
 
 class Thread;
 
-class Mutex final : public WaitObject {
+class Mutex final : public WaitObject, public PooledObject<Mutex> {
 public:
     /**
      * Creates a mutex.
@@ -30,6 +31,8 @@ public:
     static const HandleType HANDLE_TYPE = HandleType::Mutex;
     HandleType GetHandleType() const override { return HANDLE_TYPE; }
 
+    void DoState(PointerWrap& p) override;
+
     int lock_count;                             ///< Number of times the mutex has been acquired
     std::string name;                           ///< Name of mutex (optional)
     SharedPtr<Thread> holding_thread;           ///< Thread that has acquired the mutex
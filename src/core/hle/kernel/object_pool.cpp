@@ -0,0 +1,116 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <mutex>
+
+#include "common/memory_accounting.h"
+
+#include "core/hle/kernel/object_pool.h"
+
+namespace Kernel {
+
+/// Slots allocated at once when a pool runs out
+static const size_t SLOTS_PER_SLAB = 64;
+
+struct PoolRegistry {
+    std::mutex mutex;
+    std::vector<const ObjectPool*> pools;
+};
+
+static PoolRegistry& GetRegistry() {
+    static PoolRegistry registry;
+    return registry;
+}
+
+static const char* GetHandleTypeName(HandleType type) {
+    switch (type) {
+    case HandleType::Port:           return "Port";
+    case HandleType::Session:        return "Session";
+    case HandleType::Event:          return "Event";
+    case HandleType::Mutex:          return "Mutex";
+    case HandleType::SharedMemory:   return "SharedMemory";
+    case HandleType::Redirection:    return "Redirection";
+    case HandleType::Thread:         return "Thread";
+    case HandleType::Process:        return "Process";
+    case HandleType::AddressArbiter: return "AddressArbiter";
+    case HandleType::Semaphore:      return "Semaphore";
+    case HandleType::Timer:          return "Timer";
+    case HandleType::ResourceLimit:  return "ResourceLimit";
+    default:                         return "Unknown";
+    }
+}
+
+ObjectPool::ObjectPool(HandleType type, size_t object_size, size_t object_alignment)
+        : type(type), live_objects(0), peak_live_objects(0), allocated_slots(0) {
+    // Slots are laid out back to back, so their size keeps every one of them aligned
+    const size_t alignment = std::max(object_alignment, alignof(FreeSlot));
+    slot_size = (std::max(object_size, sizeof(FreeSlot)) + alignment - 1) / alignment * alignment;
+
+    PoolRegistry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.pools.push_back(this);
+}
+
+void ObjectPool::Grow() {
+    // Memory from operator new is suitably aligned for any kernel object
+    u8* slab = static_cast<u8*>(::operator new(SLOTS_PER_SLAB * slot_size));
+    slabs.push_back(slab);
+    // Slabs are kept for reuse, so the memory stays accounted
+    Common::MemoryAccounting::Allocate(Common::MemoryAccounting::Tag::KernelObjects, SLOTS_PER_SLAB * slot_size);
+
+    for (size_t i = SLOTS_PER_SLAB; i-- > 0;) {
+        FreeSlot* slot = reinterpret_cast<FreeSlot*>(slab + i * slot_size);
+        slot->next = free_slots;
+        free_slots = slot;
+    }
+    allocated_slots.store(allocated_slots.load(std::memory_order_relaxed) + SLOTS_PER_SLAB, std::memory_order_relaxed);
+}
+
+void* ObjectPool::Allocate() {
+    if (free_slots == nullptr)
+        Grow();
+
+    FreeSlot* slot = free_slots;
+    free_slots = slot->next;
+
+    const size_t live = live_objects.load(std::memory_order_relaxed) + 1;
+    live_objects.store(live, std::memory_order_relaxed);
+    if (live > peak_live_objects.load(std::memory_order_relaxed))
+        peak_live_objects.store(live, std::memory_order_relaxed);
+    return slot;
+}
+
+void ObjectPool::Free(void* object) {
+    FreeSlot* slot = static_cast<FreeSlot*>(object);
+    slot->next = free_slots;
+    free_slots = slot;
+
+    live_objects.store(live_objects.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+}
+
+ObjectPoolStatistics ObjectPool::GetStatistics() const {
+    ObjectPoolStatistics statistics;
+    statistics.type = type;
+    statistics.type_name = GetHandleTypeName(type);
+    statistics.live_objects = live_objects.load(std::memory_order_relaxed);
+    statistics.peak_live_objects = peak_live_objects.load(std::memory_order_relaxed);
+    statistics.allocated_slots = allocated_slots.load(std::memory_order_relaxed);
+    return statistics;
+}
+
+std::vector<ObjectPoolStatistics> GetObjectPoolStatistics() {
+    PoolRegistry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    std::vector<ObjectPoolStatistics> statistics;
+    for (const ObjectPool* pool : registry.pools)
+        statistics.push_back(pool->GetStatistics());
+
+    std::sort(statistics.begin(), statistics.end(), [](const ObjectPoolStatistics& a, const ObjectPoolStatistics& b) {
+        return a.type < b.type;
+    });
+    return statistics;
+}
+
+} // namespace
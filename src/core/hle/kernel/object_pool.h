@@ -0,0 +1,95 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "common/common_types.h"
+
+#include "core/hle/kernel/kernel.h"
+
+namespace Kernel {
+
+/// Allocation counters of the pool of one type of kernel object
+struct ObjectPoolStatistics {
+    HandleType type;
+    const char* type_name;
+    size_t live_objects;
+    size_t peak_live_objects;
+    size_t allocated_slots;
+};
+
+/**
+ * Returns the counters of every pool that has allocated objects. Can be called from any thread, the
+ * counters of a pool may then be from slightly different points in time.
+ */
+std::vector<ObjectPoolStatistics> GetObjectPoolStatistics();
+
+/**
+ * Fixed-size slots for one type of kernel object, carved out of slabs that are allocated as needed
+ * and kept for reuse. Freed slots go on a free list, so creating and destroying objects repeatedly
+ * doesn't go through the general purpose allocator. Only the kernel's thread allocates from pools.
+ */
+class ObjectPool {
+public:
+    ObjectPool(HandleType type, size_t object_size, size_t object_alignment);
+
+    void* Allocate();
+    void Free(void* slot);
+
+    ObjectPoolStatistics GetStatistics() const;
+
+private:
+    /// Allocates a new slab and puts its slots on the free list
+    void Grow();
+
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    HandleType type;
+    size_t slot_size;
+    FreeSlot* free_slots = nullptr;
+    std::vector<u8*> slabs;
+
+    // Only written by the kernel's thread, atomic so that the debugger can read them
+    std::atomic<size_t> live_objects;
+    std::atomic<size_t> peak_live_objects;
+    std::atomic<size_t> allocated_slots;
+};
+
+/**
+ * Makes a kernel object type allocate from its own ObjectPool. The type has to be final, so that
+ * only objects of exactly that type come from its pool.
+ */
+template <typename T>
+class PooledObject {
+public:
+    static void* operator new(size_t size) {
+        if (size != sizeof(T))
+            return ::operator new(size);
+        return GetPool().Allocate();
+    }
+
+    static void operator delete(void* object, size_t size) {
+        if (size != sizeof(T)) {
+            ::operator delete(object);
+            return;
+        }
+        GetPool().Free(object);
+    }
+
+private:
+    static ObjectPool& GetPool() {
+        static ObjectPool pool(T::HANDLE_TYPE, sizeof(T), alignof(T));
+        return pool;
+    }
+};
+
+} // namespace
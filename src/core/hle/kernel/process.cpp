@@ -3,6 +3,7 @@
 // Refer to the license.txt file included.
 
 #include "common/assert.h"
+#include "common/chunk_file.h"
 #include "common/common_funcs.h"
 #include "common/logging/log.h"
 
@@ -91,6 +92,15 @@ void Process::Run(VAddr entry_point, s32 main_thread_priority, u32 stack_size) {
     Kernel::SetupMainThread(entry_point, main_thread_priority);
 }
 
+void Process::DoState(PointerWrap& p) {
+    // Everything else is set up from the executable, only the TLS slots change as threads come
+    // and go
+    std::string slots = used_tls_slots.to_string();
+    p.Do(slots);
+    if (p.GetMode() == PointerWrap::MODE_READ && slots.size() == used_tls_slots.size())
+        used_tls_slots = std::bitset<300>(slots);
+}
+
 Kernel::Process::Process() {}
 Kernel::Process::~Process() {}
 
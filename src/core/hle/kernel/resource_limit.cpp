@@ -4,6 +4,7 @@
 
 #include <cstring>
 
+#include "common/chunk_file.h"
 #include "common/logging/log.h"
 
 #include "core/mem_map.h"
@@ -154,4 +155,16 @@ void ResourceLimitsShutdown() {
 
 }
 
+void ResourceLimit::DoState(PointerWrap& p) {
+    p.Do(current_commit);
+    p.Do(current_threads);
+    p.Do(current_events);
+    p.Do(current_mutexes);
+    p.Do(current_semaphores);
+    p.Do(current_timers);
+    p.Do(current_shared_mems);
+    p.Do(current_address_arbiters);
+    p.Do(current_cpu_time);
+}
+
 } // namespace
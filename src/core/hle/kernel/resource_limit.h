@@ -50,6 +50,8 @@ public:
     static const HandleType HANDLE_TYPE = HandleType::ResourceLimit;
     HandleType GetHandleType() const override { return HANDLE_TYPE; }
 
+    void DoState(PointerWrap& p) override;
+
     /**
      * Gets the current value for the specified resource.
      * @param resource Requested resource type
@@ -3,6 +3,7 @@
 // Refer to the license.txt file included.
 
 #include "common/assert.h"
+#include "common/chunk_file.h"
 
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/kernel/semaphore.h"
@@ -59,4 +60,10 @@ ResultVal<s32> Semaphore::Release(s32 release_count) {
     return MakeResult<s32>(previous_count);
 }
 
+void Semaphore::DoState(PointerWrap& p) {
+    p.Do(max_count);
+    p.Do(available_count);
+    p.Do(name);
+}
+
 } // namespace
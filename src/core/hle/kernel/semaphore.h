@@ -10,10 +10,11 @@
 #include "common/common_types.h"
 
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/object_pool.h"
 
 namespace Kernel {
 
-class Semaphore final : public WaitObject {
+class Semaphore final : public WaitObject, public PooledObject<Semaphore> {
 public:
     /**
      * Creates a semaphore.
@@ -32,6 +33,8 @@ public:
     static const HandleType HANDLE_TYPE = HandleType::Semaphore;
     HandleType GetHandleType() const override { return HANDLE_TYPE; }
 
+    void DoState(PointerWrap& p) override;
+
     s32 max_count;                              ///< Maximum number of simultaneous holders the semaphore can have
     s32 available_count;                        ///< Number of free slots left in the semaphore
     std::string name;                           ///< Name of semaphore (optional)
@@ -4,24 +4,25 @@
 
 #pragma once
 
+#include "core/hle/ipc.h"
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/kernel/thread.h"
 #include "core/memory.h"
 
 namespace Kernel {
 
-static const int kCommandHeaderOffset = 0x80; ///< Offset into command buffer of header
+static const int kCommandHeaderOffset = IPC::COMMAND_BUFFER_OFFSET; ///< Offset into command buffer of header
 
 /**
  * Returns a pointer to the command buffer in the current thread's TLS
  * TODO(Subv): This is not entirely correct, the command buffer should be copied from
  * the thread's TLS to an intermediate buffer in kernel memory, and then copied again to
  * the service handler process' memory.
- * @param offset Optional offset into command buffer
+ * @param offset Optional offset into command buffer, in bytes
  * @return Pointer to command buffer
  */
 inline static u32* GetCommandBuffer(const int offset = 0) {
-    return (u32*)Memory::GetPointer(GetCurrentThread()->GetTLSAddress() + kCommandHeaderOffset + offset);
+    return reinterpret_cast<u32*>(reinterpret_cast<u8*>(GetCurrentThread()->command_buffer) + offset);
 }
 
 /**
@@ -4,6 +4,8 @@
 
 #include <cstring>
 
+#include "common/assert.h"
+#include "common/chunk_file.h"
 #include "common/logging/log.h"
 
 #include "core/memory.h"
@@ -11,7 +13,7 @@
 
 namespace Kernel {
 
-SharedMemory::SharedMemory() {}
+SharedMemory::SharedMemory() : backing_memory(nullptr) {}
 SharedMemory::~SharedMemory() {}
 
 SharedPtr<SharedMemory> SharedMemory::Create(u32 size, MemoryPermission permissions,
@@ -47,16 +49,31 @@ ResultCode SharedMemory::Map(VAddr address, MemoryPermission permissions,
     }
 
     this->base_address = address;
+    backing_memory = Memory::GetPointer(address);
 
     return RESULT_SUCCESS;
 }
 
 u8* SharedMemory::GetPointer(u32 offset) {
-    if (base_address != 0)
-        return Memory::GetPointer(base_address + offset);
+    if (backing_memory != nullptr) {
+        DEBUG_ASSERT_MSG(offset < size, "offset 0x%08X outside of memory block id=%u", offset, GetObjectId());
+        return backing_memory + offset;
+    }
 
     LOG_ERROR(Kernel_SVC, "memory block id=%u not mapped!", GetObjectId());
     return nullptr;
 }
 
+void SharedMemory::DoState(PointerWrap& p) {
+    // The contents are in the memory the block is mapped to, which is saved separately
+    p.Do(base_address);
+    p.Do(size);
+    p.Do(permissions);
+    p.Do(other_permissions);
+    p.Do(name);
+
+    if (p.GetMode() == PointerWrap::MODE_READ)
+        backing_memory = base_address != 0 ? Memory::GetPointer(base_address) : nullptr;
+}
+
 } // namespace
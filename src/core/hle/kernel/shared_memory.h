@@ -41,6 +41,8 @@ public:
     static const HandleType HANDLE_TYPE = HandleType::SharedMemory;
     HandleType GetHandleType() const override { return HANDLE_TYPE; }
 
+    void DoState(PointerWrap& p) override;
+
     /**
      * Maps a shared memory block to an address in system memory
      * @param address Address in system memory to map shared memory block to
@@ -56,6 +58,16 @@ public:
     */
     u8* GetPointer(u32 offset = 0);
 
+    /**
+     * Gets a typed pointer to a structure laid out in the shared memory block, so that services
+     * can access its fields in place
+     * @param offset Offset from the start of the shared memory block to the structure
+     */
+    template <typename T>
+    T* GetPointer(u32 offset = 0) {
+        return reinterpret_cast<T*>(GetPointer(offset));
+    }
+
     /// Address of shared memory block in the process.
     VAddr base_address;
     /// Size of the memory block. Page-aligned.
@@ -68,6 +80,10 @@ public:
     std::string name;
 
 private:
+    /// Host memory backing the block where it's mapped, the mapping of the shared memory region
+    /// never changes while the system runs
+    u8* backing_memory;
+
     SharedMemory();
     ~SharedMemory() override;
 };
@@ -3,10 +3,13 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <limits>
 #include <list>
+#include <unordered_map>
 #include <vector>
 
 #include "common/assert.h"
+#include "common/chunk_file.h"
 #include "common/common_types.h"
 #include "common/logging/log.h"
 #include "common/math_util.h"
@@ -16,6 +19,7 @@
 #include "core/core.h"
 #include "core/core_timing.h"
 #include "core/hle/hle.h"
+#include "core/hle/ipc.h"
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/kernel/process.h"
 #include "core/hle/kernel/thread.h"
@@ -25,9 +29,6 @@
 
 namespace Kernel {
 
-/// Event type for the thread wake up event
-static int ThreadWakeupEventType;
-
 bool Thread::ShouldWait() {
     return status != THREADSTATUS_DEAD;
 }
@@ -42,8 +43,19 @@ static std::vector<SharedPtr<Thread>> thread_list;
 // Lists only ready thread ids.
 static Common::ThreadQueueList<Thread*, THREADPRIO_LOWEST+1> ready_queue;
 
+// Threads waiting to be arbitrated by address, highest priority first and in the order they started
+// waiting among equal priorities
+static std::unordered_map<VAddr, std::vector<Thread*>> arbitration_waiters;
+
 static Thread* current_thread;
 
+// Boost threads that have been ready for longer than this many ticks
+static const u64 boost_timeout = 2000000;
+
+// Ticks at which the longest waiting ready thread becomes starved, or later. No ready thread can be
+// starved before then.
+static u64 earliest_starvation_ticks;
+
 // The first available thread id at startup
 static u32 next_thread_id;
 
@@ -56,7 +68,9 @@ inline static u32 const NewThreadId() {
 }
 
 Thread::Thread() {}
-Thread::~Thread() {}
+Thread::~Thread() {
+    CancelTimeout(wakeup_timeout);
+}
 
 Thread* GetCurrentThread() {
     return current_thread;
@@ -72,18 +86,42 @@ static bool CheckWait_WaitObject(const Thread* thread, WaitObject* wait_object)
     if (thread->status != THREADSTATUS_WAIT_SYNCH)
         return false;
 
-    auto itr = std::find(thread->wait_objects.begin(), thread->wait_objects.end(), wait_object);
-    return itr != thread->wait_objects.end();
+    for (const WaitListEntry& entry : thread->wait_objects) {
+        if (entry.object == wait_object)
+            return true;
+    }
+    return false;
 }
 
 /**
- * Check if the specified thread is waiting on the specified address to be arbitrated
- * @param thread The thread to test
- * @param wait_address The address to test against
- * @return True if the thread is waiting, false otherwise
+ * Takes a thread off the lists of waiting threads of all the objects it waits on, and forgets
+ * about them
  */
-static bool CheckWait_AddressArbiter(const Thread* thread, VAddr wait_address) {
-    return thread->status == THREADSTATUS_WAIT_ARB && wait_address == thread->wait_address;
+static void ClearWaitObjects(Thread* thread) {
+    for (WaitListEntry& entry : thread->wait_objects)
+        entry.object->RemoveWaitingThread(&entry);
+    thread->wait_objects.clear();
+}
+
+/// Adds a thread to the waiters of its arbitration address, behind those of the same priority
+static void AddArbitrationWaiter(Thread* thread) {
+    std::vector<Thread*>& waiters = arbitration_waiters[thread->wait_address];
+    auto position = std::upper_bound(waiters.begin(), waiters.end(), thread, [](const Thread* a, const Thread* b) {
+        return a->current_priority < b->current_priority;
+    });
+    waiters.insert(position, thread);
+}
+
+static void RemoveArbitrationWaiter(Thread* thread) {
+    auto waiters = arbitration_waiters.find(thread->wait_address);
+    if (waiters == arbitration_waiters.end())
+        return;
+
+    auto position = std::find(waiters->second.begin(), waiters->second.end(), thread);
+    if (position != waiters->second.end())
+        waiters->second.erase(position);
+    if (waiters->second.empty())
+        arbitration_waiters.erase(waiters);
 }
 
 void Thread::Stop() {
@@ -91,22 +129,22 @@ void Thread::Stop() {
     ReleaseThreadMutexes(this);
 
     // Cancel any outstanding wakeup events for this thread
-    CoreTiming::UnscheduleEvent(ThreadWakeupEventType, callback_handle);
+    CancelTimeout(wakeup_timeout);
 
     // Clean up thread from ready queue
     // This is only needed when the thread is termintated forcefully (SVC TerminateProcess)
     if (status == THREADSTATUS_READY){
         ready_queue.remove(current_priority, this);
     }
+    if (status == THREADSTATUS_WAIT_ARB)
+        RemoveArbitrationWaiter(this);
 
     status = THREADSTATUS_DEAD;
 
     WakeupAllWaitingThreads();
 
     // Clean up any dangling references in objects that this thread was waiting for
-    for (auto& wait_object : wait_objects) {
-        wait_object->RemoveWaitingThread(this);
-    }
+    ClearWaitObjects(this);
 
     Kernel::g_current_process->used_tls_slots[tls_index] = false;
 
@@ -114,43 +152,44 @@ void Thread::Stop() {
 }
 
 Thread* ArbitrateHighestPriorityThread(u32 address) {
-    Thread* highest_priority_thread = nullptr;
-    s32 priority = THREADPRIO_LOWEST;
+    auto waiters = arbitration_waiters.find(address);
+    if (waiters == arbitration_waiters.end())
+        return nullptr;
 
-    // Iterate through threads, find highest priority thread that is waiting to be arbitrated...
-    for (auto& thread : thread_list) {
-        if (!CheckWait_AddressArbiter(thread.get(), address))
-            continue;
-
-        if (thread == nullptr)
-            continue;
-
-        if(thread->current_priority <= priority) {
-            highest_priority_thread = thread.get();
-            priority = thread->current_priority;
-        }
-    }
-
-    // If a thread was arbitrated, resume it
-    if (nullptr != highest_priority_thread) {
-        highest_priority_thread->ResumeFromWait();
-    }
+    // Resuming removes the thread from the waiters
+    Thread* highest_priority_thread = waiters->second.front();
+    highest_priority_thread->ResumeFromWait();
 
     return highest_priority_thread;
 }
 
 void ArbitrateAllThreads(u32 address) {
-    // Resume all threads found to be waiting on the address
-    for (auto& thread : thread_list) {
-        if (CheckWait_AddressArbiter(thread.get(), address))
-            thread->ResumeFromWait();
+    // Resume all threads waiting on the address in priority order, the waiters of the address are
+    // erased along with the last one
+    for (;;) {
+        auto waiters = arbitration_waiters.find(address);
+        if (waiters == arbitration_waiters.end())
+            break;
+        waiters->second.front()->ResumeFromWait();
     }
 }
 
+/// Adds a thread that just became ready to the starvation tracking
+static void TrackStarvation(const Thread* thread) {
+    earliest_starvation_ticks = std::min(earliest_starvation_ticks,
+                                         thread->last_running_ticks + boost_timeout);
+}
+
 /// Boost low priority threads (temporarily) that have been starved
 static void PriorityBoostStarvedThreads() {
     u64 current_ticks = CoreTiming::GetTicks();
 
+    // Nothing can have starved yet, which is the case for almost every reschedule
+    if (current_ticks <= earliest_starvation_ticks)
+        return;
+
+    earliest_starvation_ticks = std::numeric_limits<u64>::max();
+
     for (auto& thread : thread_list) {
         // TODO(bunnei): Threads that have been waiting to be scheduled for `boost_ticks` (or
         // longer) will have their priority temporarily adjusted to 1 higher than the highest
@@ -158,14 +197,18 @@ static void PriorityBoostStarvedThreads() {
         // on hardware. However, this is almost certainly not perfect, and the real CTR OS scheduler
         // should probably be reversed to verify this.
 
-        const u64 boost_timeout = 2000000;  // Boost threads that have been ready for > this long
+        if (thread->status != THREADSTATUS_READY)
+            continue;
 
         u64 delta = current_ticks - thread->last_running_ticks;
 
-        if (thread->status == THREADSTATUS_READY && delta > boost_timeout) {
+        if (delta > boost_timeout) {
             const s32 priority = std::max(ready_queue.get_first()->current_priority - 1, 0);
             thread->BoostPriority(priority);
         }
+
+        // Boosted threads stay starved until they get to run, like before boosting them
+        TrackStarvation(thread.get());
     }
 }
 
@@ -186,6 +229,7 @@ static void SwitchContext(Thread* new_thread) {
             // yielding execution (i.e. an event triggered, system core time-sliced, etc)
             ready_queue.push_front(previous_thread->current_priority, previous_thread);
             previous_thread->status = THREADSTATUS_READY;
+            TrackStarvation(previous_thread);
         }
     }
 
@@ -238,35 +282,31 @@ void WaitCurrentThread_Sleep() {
     HLE::Reschedule(__func__);
 }
 
-void WaitCurrentThread_WaitSynchronization(std::vector<SharedPtr<WaitObject>> wait_objects, bool wait_set_output, bool wait_all) {
+void WaitCurrentThread_WaitSynchronization(bool wait_set_output, bool wait_all) {
     Thread* thread = GetCurrentThread();
     thread->wait_set_output = wait_set_output;
     thread->wait_all = wait_all;
-    thread->wait_objects = std::move(wait_objects);
     thread->status = THREADSTATUS_WAIT_SYNCH;
+
+    // The entries can't move anymore once they are linked, AddWaitObject is done growing the vector
+    for (WaitListEntry& entry : thread->wait_objects)
+        entry.object->AddWaitingThread(&entry);
 }
 
 void WaitCurrentThread_ArbitrateAddress(VAddr wait_address) {
     Thread* thread = GetCurrentThread();
     thread->wait_address = wait_address;
     thread->status = THREADSTATUS_WAIT_ARB;
+    AddArbitrationWaiter(thread);
 }
 
-// TODO(yuriks): This can be removed if Thread objects are explicitly pooled in the future, allowing
-//               us to simply use a pool index or similar.
-static Kernel::HandleTable wakeup_callback_handle_table;
-
 /**
  * Callback that will wake up the thread it was scheduled for
- * @param thread_handle The handle of the thread that's been awoken
+ * @param entry The wakeup timeout of the thread that's been awoken
  * @param cycles_late The number of CPU cycles that have passed since the desired wakeup time
  */
-static void ThreadWakeupCallback(u64 thread_handle, int cycles_late) {
-    SharedPtr<Thread> thread = wakeup_callback_handle_table.Get<Thread>((Handle)thread_handle);
-    if (thread == nullptr) {
-        LOG_CRITICAL(Kernel, "Callback fired for invalid thread %08X", (Handle)thread_handle);
-        return;
-    }
+static void ThreadWakeupCallback(TimeoutEntry& entry, int cycles_late) {
+    SharedPtr<Thread> thread = static_cast<Thread*>(entry.owner);
 
     if (thread->status == THREADSTATUS_WAIT_SYNCH) {
         thread->SetWaitSynchronizationResult(ResultCode(ErrorDescription::Timeout, ErrorModule::OS,
@@ -285,28 +325,38 @@ void Thread::WakeAfterDelay(s64 nanoseconds) {
         return;
 
     u64 microseconds = nanoseconds / 1000;
-    CoreTiming::ScheduleEvent(usToCycles(microseconds), ThreadWakeupEventType, callback_handle);
+    ScheduleTimeout(wakeup_timeout, usToCycles(microseconds));
+}
+
+void Thread::AddWaitObject(SharedPtr<WaitObject> object) {
+    DEBUG_ASSERT(status != THREADSTATUS_WAIT_SYNCH);
+
+    WaitListEntry entry;
+    entry.object = std::move(object);
+    entry.thread = this;
+    wait_objects.push_back(std::move(entry));
 }
 
-void Thread::ReleaseWaitObject(WaitObject* wait_object) {
+void Thread::ReleaseWaitObject(WaitListEntry& entry) {
     if (status != THREADSTATUS_WAIT_SYNCH || wait_objects.empty()) {
         LOG_CRITICAL(Kernel, "thread is not waiting on any objects!");
         return;
     }
 
     // Remove this thread from the waiting object's thread list
-    wait_object->RemoveWaitingThread(this);
+    WaitObject* wait_object = entry.object.get();
+    wait_object->RemoveWaitingThread(&entry);
 
     unsigned index = 0;
     bool wait_all_failed = false; // Will be set to true if any object is unavailable
 
     // Iterate through all waiting objects to check availability...
     for (auto itr = wait_objects.begin(); itr != wait_objects.end(); ++itr) {
-        if ((*itr)->ShouldWait())
+        if (itr->object->ShouldWait())
             wait_all_failed = true;
 
         // The output should be the last index of wait_object
-        if (*itr == wait_object)
+        if (itr->object == wait_object)
             index = itr - wait_objects.begin();
     }
 
@@ -332,15 +382,16 @@ void Thread::ReleaseWaitObject(WaitObject* wait_object) {
 
 void Thread::ResumeFromWait() {
     // Cancel any outstanding wakeup events for this thread
-    CoreTiming::UnscheduleEvent(ThreadWakeupEventType, callback_handle);
+    CancelTimeout(wakeup_timeout);
 
     switch (status) {
         case THREADSTATUS_WAIT_SYNCH:
             // Remove this thread from all other WaitObjects
-            for (auto wait_object : wait_objects)
-                wait_object->RemoveWaitingThread(this);
+            ClearWaitObjects(this);
             break;
         case THREADSTATUS_WAIT_ARB:
+            RemoveArbitrationWaiter(this);
+            break;
         case THREADSTATUS_WAIT_SLEEP:
             break;
         case THREADSTATUS_RUNNING:
@@ -356,6 +407,7 @@ void Thread::ResumeFromWait() {
 
     ready_queue.push_back(current_priority, this);
     status = THREADSTATUS_READY;
+    TrackStarvation(this);
 }
 
 /**
@@ -398,7 +450,6 @@ ResultVal<SharedPtr<Thread>> Thread::Create(std::string name, VAddr entry_point,
     SharedPtr<Thread> thread(new Thread);
 
     thread_list.push_back(thread);
-    ready_queue.prepare(priority);
 
     thread->thread_id = NewThreadId();
     thread->status = THREADSTATUS_DORMANT;
@@ -412,7 +463,8 @@ ResultVal<SharedPtr<Thread>> Thread::Create(std::string name, VAddr entry_point,
     thread->wait_objects.clear();
     thread->wait_address = 0;
     thread->name = std::move(name);
-    thread->callback_handle = wakeup_callback_handle_table.Create(thread).MoveFrom();
+    thread->wakeup_timeout.callback = ThreadWakeupCallback;
+    thread->wakeup_timeout.owner = thread.get();
     thread->owner_process = g_current_process;
     thread->tls_index = -1;
 
@@ -428,18 +480,100 @@ ResultVal<SharedPtr<Thread>> Thread::Create(std::string name, VAddr entry_point,
 
     ASSERT_MSG(thread->tls_index != -1, "Out of TLS space");
 
+    // The TLS area is always mapped, so the command buffer can be resolved once for all requests
+    thread->command_buffer = reinterpret_cast<u32*>(Memory::GetPointer(thread->GetTLSAddress() +
+                                                                       IPC::COMMAND_BUFFER_OFFSET));
+
     // TODO(peachum): move to ScheduleThread() when scheduler is added so selected core is used
     // to initialize the context
     Core::g_app_core->ResetContext(thread->context, stack_top, entry_point, arg);
 
     ready_queue.push_back(thread->current_priority, thread.get());
     thread->status = THREADSTATUS_READY;
+    TrackStarvation(thread.get());
 
     HLE::Reschedule(__func__);
 
     return MakeResult<SharedPtr<Thread>>(std::move(thread));
 }
 
+SharedPtr<Thread> Thread::CreateUninitialized() {
+    SharedPtr<Thread> thread(new Thread);
+
+    thread->status = THREADSTATUS_DEAD;
+    thread->tls_index = -1;
+    thread->command_buffer = nullptr;
+    thread->wakeup_timeout.callback = ThreadWakeupCallback;
+    thread->wakeup_timeout.owner = thread.get();
+
+    return thread;
+}
+
+void Thread::DoState(PointerWrap& p) {
+    p.Do(context);
+    p.Do(thread_id);
+    p.Do(status);
+    p.Do(entry_point);
+    p.Do(stack_top);
+    p.Do(nominal_priority);
+    p.Do(current_priority);
+    p.Do(last_running_ticks);
+    p.Do(processor_id);
+    p.Do(tls_index);
+    p.Do(wait_address);
+    p.Do(wait_all);
+    p.Do(wait_set_output);
+    p.Do(name);
+    DoObjectReference(p, owner_process);
+
+    u32 num_mutexes = static_cast<u32>(held_mutexes.size());
+    p.Do(num_mutexes);
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        held_mutexes.clear();
+        for (u32 i = 0; i < num_mutexes && !p.error; ++i) {
+            SharedPtr<Mutex> mutex;
+            DoObjectReference(p, mutex);
+            held_mutexes.insert(std::move(mutex));
+        }
+    } else {
+        for (auto mutex : held_mutexes)
+            DoObjectReference(p, mutex);
+    }
+
+    // The entries of the wait objects are linked back into their lists by DoWaitListState
+    u32 num_wait_objects = static_cast<u32>(wait_objects.size());
+    p.Do(num_wait_objects);
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        for (WaitListEntry& entry : wait_objects)
+            entry.object->RemoveWaitingThread(&entry);
+        wait_objects.clear();
+        for (u32 i = 0; i < num_wait_objects && !p.error; ++i) {
+            SharedPtr<Object> object;
+            DoObjectReference(p, object, HandleType::Unknown);
+            if (object != nullptr && !object->IsWaitable()) {
+                p.SetError(PointerWrap::ERROR_FAILURE);
+                break;
+            }
+            WaitListEntry entry;
+            entry.object = boost::static_pointer_cast<WaitObject>(std::move(object));
+            entry.thread = this;
+            wait_objects.push_back(std::move(entry));
+        }
+    } else {
+        for (WaitListEntry& entry : wait_objects) {
+            SharedPtr<Object> object = entry.object;
+            DoObjectReference(p, object, HandleType::Unknown);
+        }
+    }
+
+    DoTimeoutState(p, wakeup_timeout);
+
+    if (p.GetMode() == PointerWrap::MODE_READ && tls_index >= 0) {
+        command_buffer = reinterpret_cast<u32*>(Memory::GetPointer(GetTLSAddress() +
+                                                                   IPC::COMMAND_BUFFER_OFFSET));
+    }
+}
+
 // TODO(peachum): Remove this. Range checking should be done, and an appropriate error should be returned.
 static void ClampPriority(const Thread* thread, s32* priority) {
     if (*priority < THREADPRIO_HIGHEST || *priority > THREADPRIO_LOWEST) {
@@ -460,10 +594,19 @@ void Thread::SetPriority(s32 priority) {
     // If thread was ready, adjust queues
     if (status == THREADSTATUS_READY)
         ready_queue.move(this, current_priority, priority);
-    else
-        ready_queue.prepare(priority);
 
     nominal_priority = current_priority = priority;
+
+    // Keep the lists of waiting threads in priority order
+    if (status == THREADSTATUS_WAIT_SYNCH) {
+        for (WaitListEntry& entry : wait_objects) {
+            entry.object->RemoveWaitingThread(&entry);
+            entry.object->AddWaitingThread(&entry);
+        }
+    } else if (status == THREADSTATUS_WAIT_ARB) {
+        RemoveArbitrationWaiter(this);
+        AddArbitrationWaiter(this);
+    }
 }
 
 void Thread::BoostPriority(s32 priority) {
@@ -523,16 +666,81 @@ VAddr Thread::GetTLSAddress() const {
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 void ThreadingInit() {
-    ThreadWakeupEventType = CoreTiming::RegisterEvent("ThreadWakeupCallback", ThreadWakeupCallback);
-
     current_thread = nullptr;
     next_thread_id = 1;
 
     thread_list.clear();
     ready_queue.clear();
+    arbitration_waiters.clear();
+    earliest_starvation_ticks = std::numeric_limits<u64>::max();
 }
 
 void ThreadingShutdown() {
 }
 
+/// Saves or restores a reference to a thread that doesn't keep it alive
+static void DoThreadPointer(PointerWrap& p, Thread*& thread) {
+    SharedPtr<Thread> reference = thread;
+    DoObjectReference(p, reference);
+    thread = reference.get();
+}
+
+void DoThreadingState(PointerWrap& p) {
+    u32 num_threads = static_cast<u32>(thread_list.size());
+    p.Do(num_threads);
+    if (p.GetMode() == PointerWrap::MODE_READ)
+        thread_list.resize(num_threads);
+    for (auto& thread : thread_list)
+        DoObjectReference(p, thread);
+
+    // Ready threads by priority, in queue order
+    std::vector<std::pair<u32, Thread*>> ready_threads;
+    ready_queue.for_each([&ready_threads](u32 priority, Thread* thread) {
+        ready_threads.emplace_back(priority, thread);
+    });
+    u32 num_ready = static_cast<u32>(ready_threads.size());
+    p.Do(num_ready);
+    if (p.GetMode() == PointerWrap::MODE_READ)
+        ready_threads.resize(num_ready);
+    for (auto& ready : ready_threads) {
+        p.Do(ready.first);
+        DoThreadPointer(p, ready.second);
+    }
+
+    u32 num_addresses = static_cast<u32>(arbitration_waiters.size());
+    p.Do(num_addresses);
+    auto waiters = arbitration_waiters.begin();
+    std::unordered_map<VAddr, std::vector<Thread*>> restored_waiters;
+    for (u32 i = 0; i < num_addresses && !p.error; ++i) {
+        VAddr address = (p.GetMode() == PointerWrap::MODE_READ) ? 0 : waiters->first;
+        std::vector<Thread*> threads;
+        if (p.GetMode() != PointerWrap::MODE_READ)
+            threads = (waiters++)->second;
+        u32 num_waiters = static_cast<u32>(threads.size());
+        p.Do(address);
+        p.Do(num_waiters);
+        threads.resize(num_waiters);
+        for (Thread*& thread : threads)
+            DoThreadPointer(p, thread);
+        restored_waiters.emplace(address, std::move(threads));
+    }
+
+    DoThreadPointer(p, current_thread);
+    p.Do(next_thread_id);
+    p.Do(earliest_starvation_ticks);
+
+    if (p.GetMode() != PointerWrap::MODE_READ)
+        return;
+
+    ready_queue.clear();
+    for (const auto& ready : ready_threads) {
+        if (ready.second == nullptr || ready.first > THREADPRIO_LOWEST) {
+            p.SetError(PointerWrap::ERROR_FAILURE);
+            return;
+        }
+        ready_queue.push_back(ready.first, ready.second);
+    }
+    arbitration_waiters = std::move(restored_waiters);
+}
+
 } // namespace
@@ -14,6 +14,8 @@
 #include "core/core.h"
 
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/object_pool.h"
+#include "core/hle/kernel/timer_wheel.h"
 #include "core/hle/result.h"
 
 enum ThreadPriority : s32{
@@ -46,7 +48,7 @@ namespace Kernel {
 class Mutex;
 class Process;
 
-class Thread final : public WaitObject {
+class Thread final : public WaitObject, public PooledObject<Thread> {
 public:
     /**
      * Creates and returns a new thread. The new thread is immediately scheduled
@@ -62,6 +64,12 @@ public:
     static ResultVal<SharedPtr<Thread>> Create(std::string name, VAddr entry_point, s32 priority,
         u32 arg, s32 processor_id, VAddr stack_top);
 
+    /**
+     * Creates a dead thread that isn't scheduled, to restore the state of a thread from a save
+     * state into
+     */
+    static SharedPtr<Thread> CreateUninitialized();
+
     std::string GetName() const override { return name; }
     std::string GetTypeName() const override { return "Thread"; }
 
@@ -97,9 +105,16 @@ public:
 
     /**
      * Release an acquired wait object
-     * @param wait_object WaitObject to release
+     * @param entry The thread's entry for the WaitObject to release, already taken off its list
+     */
+    void ReleaseWaitObject(WaitListEntry& entry);
+
+    /**
+     * Adds an object for the thread to wait on. The thread is added to the object's list of
+     * waiting threads once it starts waiting, see WaitCurrentThread_WaitSynchronization.
+     * @param object Object to wait on
      */
-    void ReleaseWaitObject(WaitObject* wait_object);
+    void AddWaitObject(SharedPtr<WaitObject> object);
 
     /**
      * Resumes a thread from waiting
@@ -135,6 +150,8 @@ public:
      */
     VAddr GetTLSAddress() const;
 
+    void DoState(PointerWrap& p) override;
+
     Core::ThreadContext context;
 
     u32 thread_id;
@@ -151,12 +168,15 @@ public:
     s32 processor_id;
 
     s32 tls_index; ///< Index of the Thread Local Storage of the thread
+    u32* command_buffer; ///< Host pointer to the IPC command buffer in the thread's TLS
 
     /// Mutexes currently held by this thread, which will be released when it exits.
     boost::container::flat_set<SharedPtr<Mutex>> held_mutexes;
 
     SharedPtr<Process> owner_process; ///< Process that owns this thread
-    std::vector<SharedPtr<WaitObject>> wait_objects; ///< Objects that the thread is waiting on
+    /// Objects that the thread is waiting on. Keeps its capacity between waits, so that waiting
+    /// doesn't allocate once it has been large enough.
+    std::vector<WaitListEntry> wait_objects;
     VAddr wait_address;     ///< If waiting on an AddressArbiter, this is the arbitration address
     bool wait_all;          ///< True if the thread is waiting on all objects before resuming
     bool wait_set_output;   ///< True if the output parameter should be set on thread wakeup
@@ -167,8 +187,8 @@ private:
     Thread();
     ~Thread() override;
 
-    /// Handle used as userdata to reference this object when inserting into the CoreTiming queue.
-    Handle callback_handle;
+    /// Deadline of the timeout of the current wait, if it has one
+    TimeoutEntry wakeup_timeout;
 };
 
 /**
@@ -207,12 +227,12 @@ Thread* GetCurrentThread();
 void WaitCurrentThread_Sleep();
 
 /**
- * Waits the current thread from a WaitSynchronization call
- * @param wait_objects Kernel objects that we are waiting on
+ * Waits the current thread from a WaitSynchronization call, on the objects added to it with
+ * Thread::AddWaitObject
  * @param wait_set_output If true, set the output parameter on thread wakeup (for WaitSynchronizationN only)
  * @param wait_all If true, wait on all objects before resuming (for WaitSynchronizationN only)
  */
-void WaitCurrentThread_WaitSynchronization(std::vector<SharedPtr<WaitObject>> wait_objects, bool wait_set_output, bool wait_all);
+void WaitCurrentThread_WaitSynchronization(bool wait_set_output, bool wait_all);
 
 /**
  * Waits the current thread from an ArbitrateAddress call
@@ -230,4 +250,7 @@ void ThreadingInit();
  */
 void ThreadingShutdown();
 
+/// Saves or restores the state of the scheduler, after that of the threads
+void DoThreadingState(PointerWrap& p);
+
 } // namespace
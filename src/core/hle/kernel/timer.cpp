@@ -3,6 +3,7 @@
 // Refer to the license.txt file included.
 
 #include "common/assert.h"
+#include "common/chunk_file.h"
 #include "common/logging/log.h"
 
 #include "core/core_timing.h"
@@ -12,14 +13,12 @@
 
 namespace Kernel {
 
-/// The event type of the generic timer callback event
-static int timer_callback_event_type;
-// TODO(yuriks): This can be removed if Timer objects are explicitly pooled in the future, allowing
-//               us to simply use a pool index or similar.
-static Kernel::HandleTable timer_callback_handle_table;
+static void TimerCallback(TimeoutEntry& entry, int cycles_late);
 
 Timer::Timer() {}
-Timer::~Timer() {}
+Timer::~Timer() {
+    CancelTimeout(timeout);
+}
 
 SharedPtr<Timer> Timer::Create(ResetType reset_type, std::string name) {
     SharedPtr<Timer> timer(new Timer);
@@ -29,7 +28,8 @@ SharedPtr<Timer> Timer::Create(ResetType reset_type, std::string name) {
     timer->name = std::move(name);
     timer->initial_delay = 0;
     timer->interval_delay = 0;
-    timer->callback_handle = timer_callback_handle_table.Create(timer).MoveFrom();
+    timer->timeout.callback = TimerCallback;
+    timer->timeout.owner = timer.get();
 
     return timer;
 }
@@ -50,14 +50,13 @@ void Timer::Set(s64 initial, s64 interval) {
     interval_delay = interval;
 
     u64 initial_microseconds = initial / 1000;
-    CoreTiming::ScheduleEvent(usToCycles(initial_microseconds),
-            timer_callback_event_type, callback_handle);
+    ScheduleTimeout(timeout, usToCycles(initial_microseconds));
 
     HLE::Reschedule(__func__);
 }
 
 void Timer::Cancel() {
-    CoreTiming::UnscheduleEvent(timer_callback_event_type, callback_handle);
+    CancelTimeout(timeout);
 
     HLE::Reschedule(__func__);
 }
@@ -67,15 +66,10 @@ void Timer::Clear() {
 }
 
 /// The timer callback event, called when a timer is fired
-static void TimerCallback(u64 timer_handle, int cycles_late) {
-    SharedPtr<Timer> timer = timer_callback_handle_table.Get<Timer>(static_cast<Handle>(timer_handle));
-
-    if (timer == nullptr) {
-        LOG_CRITICAL(Kernel, "Callback fired for invalid timer %08lX", timer_handle);
-        return;
-    }
+static void TimerCallback(TimeoutEntry& entry, int cycles_late) {
+    SharedPtr<Timer> timer = static_cast<Timer*>(entry.owner);
 
-    LOG_TRACE(Kernel, "Timer %u fired", timer_handle);
+    LOG_TRACE(Kernel, "Timer %s fired", timer->GetName().c_str());
 
     timer->signaled = true;
 
@@ -88,17 +82,23 @@ static void TimerCallback(u64 timer_handle, int cycles_late) {
     if (timer->interval_delay != 0) {
         // Reschedule the timer with the interval delay
         u64 interval_microseconds = timer->interval_delay / 1000;
-        CoreTiming::ScheduleEvent(usToCycles(interval_microseconds) - cycles_late,
-                timer_callback_event_type, timer_handle);
+        ScheduleTimeout(timer->timeout, usToCycles(interval_microseconds) - cycles_late);
     }
 }
 
 void TimersInit() {
-    timer_callback_handle_table.Clear();
-    timer_callback_event_type = CoreTiming::RegisterEvent("TimerCallback", TimerCallback);
 }
 
 void TimersShutdown() {
 }
 
+void Timer::DoState(PointerWrap& p) {
+    p.Do(reset_type);
+    p.Do(signaled);
+    p.Do(name);
+    p.Do(initial_delay);
+    p.Do(interval_delay);
+    DoTimeoutState(p, timeout);
+}
+
 } // namespace
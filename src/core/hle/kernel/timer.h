@@ -7,11 +7,13 @@
 #include "common/common_types.h"
 
 #include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/object_pool.h"
+#include "core/hle/kernel/timer_wheel.h"
 #include "core/hle/svc.h"
 
 namespace Kernel {
 
-class Timer final : public WaitObject {
+class Timer final : public WaitObject, public PooledObject<Timer> {
 public:
     /**
      * Creates a timer
@@ -27,6 +29,8 @@ public:
     static const HandleType HANDLE_TYPE = HandleType::Timer;
     HandleType GetHandleType() const override { return HANDLE_TYPE; }
 
+    void DoState(PointerWrap& p) override;
+
     ResetType reset_type;                   ///< The ResetType of this timer
 
     bool signaled;                          ///< Whether the timer has been signaled or not
@@ -35,6 +39,8 @@ public:
     u64 initial_delay;                      ///< The delay until the timer fires for the first time
     u64 interval_delay;                     ///< The delay until the timer fires after the first time
 
+    TimeoutEntry timeout;                   ///< Next time the timer fires, while it is running
+
     bool ShouldWait() override;
     void Acquire() override;
 
@@ -51,9 +57,6 @@ public:
 private:
     Timer();
     ~Timer() override;
-
-    /// Handle used as userdata to reference this object when inserting into the CoreTiming queue.
-    Handle callback_handle;
 };
 
 /// Initializes the required variables for timers
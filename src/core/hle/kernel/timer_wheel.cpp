@@ -0,0 +1,259 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <limits>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "common/assert.h"
+#include "common/chunk_file.h"
+
+#include "core/core_timing.h"
+#include "core/hle/kernel/timer_wheel.h"
+
+namespace Kernel {
+
+static unsigned LowestSetBit(u64 value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return index;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+TimingWheel::TimingWheel() {
+    for (auto& level : levels) {
+        level.slots.fill(nullptr);
+        level.occupied = 0;
+    }
+    overflow = nullptr;
+    current = 0;
+}
+
+TimeoutEntry** TimingWheel::GetList(u64 deadline) {
+    const u64 granule = std::max(deadline >> GRANULE_BITS, current);
+
+    // An entry goes to the finest level whose slots can tell it apart from the current time, so each
+    // level only holds deadlines within the slot of the level above that the current time is in
+    for (unsigned level = 0; level < NUM_LEVELS; ++level) {
+        const unsigned shift = LEVEL_BITS * level;
+        if ((granule >> (shift + LEVEL_BITS)) == (current >> (shift + LEVEL_BITS)))
+            return &levels[level].slots[(granule >> shift) & (SLOTS_PER_LEVEL - 1)];
+    }
+    return &overflow;
+}
+
+void TimingWheel::Link(TimeoutEntry& entry) {
+    TimeoutEntry** list = GetList(entry.deadline);
+    entry.list = list;
+    entry.prev = nullptr;
+    entry.next = *list;
+    if (*list != nullptr)
+        (*list)->prev = &entry;
+    *list = &entry;
+
+    for (auto& level : levels) {
+        if (list >= level.slots.data() && list < level.slots.data() + SLOTS_PER_LEVEL)
+            level.occupied |= 1ull << (list - level.slots.data());
+    }
+}
+
+void TimingWheel::Unlink(TimeoutEntry& entry) {
+    TimeoutEntry** list = entry.list;
+    if (entry.prev != nullptr)
+        entry.prev->next = entry.next;
+    else
+        *list = entry.next;
+    if (entry.next != nullptr)
+        entry.next->prev = entry.prev;
+
+    entry.list = nullptr;
+    entry.prev = entry.next = nullptr;
+
+    if (*list != nullptr)
+        return;
+    for (auto& level : levels) {
+        if (list >= level.slots.data() && list < level.slots.data() + SLOTS_PER_LEVEL)
+            level.occupied &= ~(1ull << (list - level.slots.data()));
+    }
+}
+
+void TimingWheel::Insert(TimeoutEntry& entry, u64 deadline) {
+    if (entry.list != nullptr)
+        Unlink(entry);
+
+    entry.deadline = deadline;
+    Link(entry);
+}
+
+void TimingWheel::Remove(TimeoutEntry& entry) {
+    if (entry.list != nullptr)
+        Unlink(entry);
+}
+
+void TimingWheel::Clear() {
+    auto clear_list = [](TimeoutEntry*& list) {
+        while (list != nullptr) {
+            TimeoutEntry* entry = list;
+            list = entry->next;
+            entry->list = nullptr;
+            entry->prev = entry->next = nullptr;
+        }
+    };
+
+    for (auto& level : levels) {
+        for (auto& slot : level.slots)
+            clear_list(slot);
+        level.occupied = 0;
+    }
+    clear_list(overflow);
+}
+
+void TimingWheel::Reset(u64 now) {
+    Clear();
+    current = now >> GRANULE_BITS;
+}
+
+void TimingWheel::Cascade(TimeoutEntry*& list) {
+    TimeoutEntry* entry = list;
+    while (entry != nullptr) {
+        TimeoutEntry* next = entry->next;
+        Unlink(*entry);
+        Link(*entry);
+        entry = next;
+    }
+}
+
+TimeoutEntry* const* TimingWheel::GetEarliestList() const {
+    // Every level only holds deadlines later than those of the levels below it, and its slots
+    // before the one of the current time are empty, so the first occupied slot holds the earliest
+    for (const auto& level : levels) {
+        if (level.occupied != 0)
+            return &level.slots[LowestSetBit(level.occupied)];
+    }
+    return overflow != nullptr ? &overflow : nullptr;
+}
+
+bool TimingWheel::GetEarliestDeadline(u64& deadline) const {
+    TimeoutEntry* const* list = GetEarliestList();
+    if (list == nullptr)
+        return false;
+
+    deadline = std::numeric_limits<u64>::max();
+    for (const TimeoutEntry* entry = *list; entry != nullptr; entry = entry->next)
+        deadline = std::min(deadline, entry->deadline);
+    return true;
+}
+
+void TimingWheel::Advance(u64 now) {
+    // Fire the expired entries from the earliest on. Callbacks may register entries again.
+    for (;;) {
+        TimeoutEntry* const* list = GetEarliestList();
+        if (list == nullptr)
+            break;
+
+        TimeoutEntry* earliest = *list;
+        for (TimeoutEntry* entry = earliest->next; entry != nullptr; entry = entry->next) {
+            if (entry->deadline < earliest->deadline)
+                earliest = entry;
+        }
+        if (earliest->deadline > now)
+            break;
+
+        Unlink(*earliest);
+        earliest->callback(*earliest, static_cast<int>(now - earliest->deadline));
+    }
+
+    const u64 target = now >> GRANULE_BITS;
+    if (target <= current)
+        return;
+
+    // Every entry before the new time has fired, only the slots the new time falls into remain to
+    // be sorted into finer levels, coarsest first
+    const u64 previous = current;
+    current = target;
+    if ((previous >> (LEVEL_BITS * NUM_LEVELS)) != (target >> (LEVEL_BITS * NUM_LEVELS)))
+        Cascade(overflow);
+    for (unsigned level = NUM_LEVELS - 1; level > 0; --level) {
+        const unsigned shift = LEVEL_BITS * level;
+        if ((previous >> shift) != (target >> shift))
+            Cascade(levels[level].slots[(target >> shift) & (SLOTS_PER_LEVEL - 1)]);
+    }
+}
+
+static TimingWheel timing_wheel;
+static int timeout_event_type;
+/// Deadline the CoreTiming event was last scheduled for, if it hasn't fired yet
+static u64 scheduled_deadline;
+
+/// Makes sure the CoreTiming event fires in time for the earliest deadline
+static void ScheduleTimeoutEvent() {
+    u64 deadline;
+    if (!timing_wheel.GetEarliestDeadline(deadline) || deadline >= scheduled_deadline)
+        return;
+
+    // An event scheduled for a later deadline is left to fire, that is cheaper than unscheduling it
+    const u64 now = CoreTiming::GetTicks();
+    CoreTiming::ScheduleEvent(deadline > now ? deadline - now : 0, timeout_event_type, deadline);
+    scheduled_deadline = deadline;
+}
+
+static void TimeoutCallback(u64 deadline, int cycles_late) {
+    if (deadline == scheduled_deadline)
+        scheduled_deadline = std::numeric_limits<u64>::max();
+
+    timing_wheel.Advance(std::max(CoreTiming::GetTicks(), deadline));
+    ScheduleTimeoutEvent();
+}
+
+void ScheduleTimeout(TimeoutEntry& entry, s64 cycles) {
+    DEBUG_ASSERT(entry.callback != nullptr);
+
+    timing_wheel.Insert(entry, CoreTiming::GetTicks() + std::max<s64>(cycles, 0));
+    ScheduleTimeoutEvent();
+}
+
+void CancelTimeout(TimeoutEntry& entry) {
+    timing_wheel.Remove(entry);
+}
+
+void TimeoutsInit() {
+    timing_wheel = TimingWheel();
+    scheduled_deadline = std::numeric_limits<u64>::max();
+    timeout_event_type = CoreTiming::RegisterEvent("Kernel::TimeoutCallback", TimeoutCallback);
+}
+
+void TimeoutsShutdown() {
+    timing_wheel.Clear();
+}
+
+void DoTimeoutsState(PointerWrap& p) {
+    // The CoreTiming event for the scheduled deadline is restored along with the other events
+    p.Do(scheduled_deadline);
+    if (p.GetMode() == PointerWrap::MODE_READ)
+        timing_wheel.Reset(CoreTiming::GetTicks());
+}
+
+void DoTimeoutState(PointerWrap& p, TimeoutEntry& entry) {
+    bool registered = entry.list != nullptr;
+    u64 deadline = entry.deadline;
+    p.Do(registered);
+    p.Do(deadline);
+    if (p.GetMode() != PointerWrap::MODE_READ)
+        return;
+
+    if (registered) {
+        timing_wheel.Insert(entry, deadline);
+        ScheduleTimeoutEvent();
+    } else {
+        timing_wheel.Remove(entry);
+    }
+}
+
+} // namespace
@@ -0,0 +1,120 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+
+#include "common/common_types.h"
+
+class PointerWrap;
+
+namespace Kernel {
+
+/**
+ * A deadline registered with the kernel's timing wheel, embedded in the object it belongs to. The
+ * owner has to cancel it before the entry is destroyed.
+ */
+struct TimeoutEntry {
+    /**
+     * Called when the deadline has passed, the entry isn't registered anymore at that point
+     * @param entry The entry that fired
+     * @param cycles_late Number of cycles since the deadline
+     */
+    typedef void (*Callback)(TimeoutEntry& entry, int cycles_late);
+
+    Callback callback = nullptr;
+    void* owner = nullptr; ///< Object the entry belongs to, for use by the callback
+
+    // Managed by the timing wheel
+    u64 deadline = 0;
+    TimeoutEntry* prev = nullptr;
+    TimeoutEntry* next = nullptr;
+    TimeoutEntry** list = nullptr; ///< Head of the list the entry is in, nullptr if unregistered
+};
+
+/**
+ * Hierarchical timing wheel holding the deadlines of kernel timers and thread timeouts. Deadlines
+ * are sorted into slots of increasingly coarse levels by how far in the future they are, which
+ * makes registering and cancelling constant-time operations. Slots are moved to finer levels as the
+ * time they cover approaches. Only a single CoreTiming event is used, for the earliest deadline.
+ */
+class TimingWheel {
+public:
+    TimingWheel();
+
+    /// Registers an entry, replacing its previous deadline if it was registered already
+    void Insert(TimeoutEntry& entry, u64 deadline);
+
+    /// Unregisters an entry, does nothing if it isn't registered
+    void Remove(TimeoutEntry& entry);
+
+    /// Unregisters every entry without firing them
+    void Clear();
+
+    /// Unregisters every entry and moves the wheel to the given time, which may be in the past
+    void Reset(u64 now);
+
+    /**
+     * Fires the entries whose deadline is at or before the given time, and moves the wheel to that
+     * time. Deadlines registered afterwards must not be earlier.
+     */
+    void Advance(u64 now);
+
+    /// Returns the earliest registered deadline, or false if there is none
+    bool GetEarliestDeadline(u64& deadline) const;
+
+private:
+    // Level 0 slots cover 2^GRANULE_BITS cycles each, every further level covers a whole level below
+    static const unsigned GRANULE_BITS = 12;
+    static const unsigned LEVEL_BITS = 6;
+    static const unsigned SLOTS_PER_LEVEL = 1 << LEVEL_BITS;
+    static const unsigned NUM_LEVELS = 4;
+
+    struct Level {
+        std::array<TimeoutEntry*, SLOTS_PER_LEVEL> slots;
+        u64 occupied; ///< Bit set for each non-empty slot
+    };
+
+    /// Returns the list an entry with the given deadline belongs to at the current time
+    TimeoutEntry** GetList(u64 deadline);
+
+    void Link(TimeoutEntry& entry);
+    void Unlink(TimeoutEntry& entry);
+
+    /// Re-sorts the entries of a list relative to the current time
+    void Cascade(TimeoutEntry*& list);
+
+    /// Returns the list holding the earliest deadline, or nullptr if the wheel is empty
+    TimeoutEntry* const* GetEarliestList() const;
+
+    std::array<Level, NUM_LEVELS> levels;
+    /// Deadlines too far in the future for the highest level
+    TimeoutEntry* overflow;
+    /// Time the wheel has advanced to, in granules
+    u64 current;
+};
+
+/**
+ * Fires the entry's callback after the given number of cycles, replacing its previous deadline if
+ * it had one.
+ */
+void ScheduleTimeout(TimeoutEntry& entry, s64 cycles);
+
+/// Unregisters the entry, so that it won't fire
+void CancelTimeout(TimeoutEntry& entry);
+
+void TimeoutsInit();
+void TimeoutsShutdown();
+
+/**
+ * Saves or restores the state of the timeouts, after that of CoreTiming. Restoring unregisters
+ * every entry, the restored objects register theirs again with DoTimeoutState.
+ */
+void DoTimeoutsState(PointerWrap& p);
+
+/// Saves or restores whether an entry is registered, and its deadline
+void DoTimeoutState(PointerWrap& p, TimeoutEntry& entry);
+
+} // namespace
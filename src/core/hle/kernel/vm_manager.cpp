@@ -34,14 +34,21 @@ VMManager::VMManager() {
 }
 
 void VMManager::Reset() {
+    // Only the mapped areas have pages to clear, the free ones are unmapped in the page table
+    // already. This avoids walking the whole address space.
+    for (auto& entry : vma_map) {
+        VirtualMemoryArea& vma = entry.second;
+        if (vma.type != VMAType::Free) {
+            vma.type = VMAType::Free;
+            UpdatePageTableForVMA(vma);
+        }
+    }
     vma_map.clear();
 
     // Initialize the map with a single free region covering the entire managed space.
     VirtualMemoryArea initial_vma;
     initial_vma.size = MAX_ADDRESS;
     vma_map.emplace(initial_vma.base, initial_vma);
-
-    UpdatePageTableForVMA(initial_vma);
 }
 
 VMManager::VMAHandle VMManager::FindVMA(VAddr target) const {
@@ -122,8 +129,10 @@ void VMManager::Reprotect(VMAHandle vma_handle, VMAPermission new_perms) {
     VMAIter iter = StripIterConstness(vma_handle);
 
     VirtualMemoryArea& vma = iter->second;
+    if (vma.permissions == new_perms)
+        return;
+    // The page table doesn't hold permissions, nothing is remapped
     vma.permissions = new_perms;
-    UpdatePageTableForVMA(vma);
 
     MergeAdjacent(iter);
 }
@@ -237,7 +246,7 @@ void VMManager::UpdatePageTableForVMA(const VirtualMemoryArea& vma) {
         break;
     case VMAType::MMIO:
         // TODO(yuriks): Add support for MMIO handlers.
-        Memory::MapIoRegion(vma.base, vma.size);
+        Memory::MapIoRegion(vma.base, vma.size, nullptr);
         break;
     }
 }
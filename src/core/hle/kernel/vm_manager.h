@@ -193,7 +193,11 @@ private:
      */
     VMAIter MergeAdjacent(VMAIter vma);
 
-    /// Updates the pages corresponding to this VMA so they match the VMA's attributes.
+    /**
+     * Updates the pages corresponding to this VMA so they match the VMA's attributes. Only called
+     * for the exact range whose mapping changed: splitting and merging areas never change what
+     * their pages map to, and neither does reprotecting them.
+     */
     void UpdatePageTableForVMA(const VirtualMemoryArea& vma);
 };
 
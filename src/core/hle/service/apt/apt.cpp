@@ -2,10 +2,13 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include "common/chunk_file.h"
 #include "common/common_paths.h"
 #include "common/file_util.h"
 #include "common/logging/log.h"
+#include "common/mapped_file.h"
 
+#include "core/memory.h"
 #include "core/hle/service/service.h"
 #include "core/hle/service/apt/apt.h"
 #include "core/hle/service/apt/apt_a.h"
@@ -36,7 +39,9 @@ static Kernel::SharedPtr<Kernel::Mutex> lock;
 static Kernel::SharedPtr<Kernel::Event> notification_event; ///< APT notification event
 static Kernel::SharedPtr<Kernel::Event> start_event; ///< APT start event
 
-static std::vector<u8> shared_font;
+/// The shared font file, mapped rather than read so that its pages are only in memory once and
+/// shared between all running emulators
+static Common::MappedFile shared_font;
 
 static u32 cpu_percent; ///< CPU time available to the running application
 
@@ -64,11 +69,13 @@ void Initialize(Service::Interface* self) {
 void GetSharedFont(Service::Interface* self) {
     u32* cmd_buff = Kernel::GetCommandBuffer();
 
-    if (!shared_font.empty()) {
+    if (shared_font.IsOpen()) {
         // TODO(bunnei): This function shouldn't copy the shared font every time it's called.
         // Instead, it should probably map the shared font as RO memory. We don't currently have
         // an easy way to do this, but the copy should be sufficient for now.
-        memcpy(Memory::GetPointer(SHARED_FONT_VADDR), shared_font.data(), shared_font.size());
+        // The font can't be mapped into the linear heap directly, whose memory has to stay
+        // contiguous for the save states.
+        Memory::WriteBlock(SHARED_FONT_VADDR, shared_font.Data(), shared_font.Size());
 
         cmd_buff[0] = 0x00440082;
         cmd_buff[1] = RESULT_SUCCESS.raw; // No error
@@ -290,17 +297,11 @@ void Init() {
     // a homebrew app to do this: https://github.com/citra-emu/3dsutils. Put the resulting file
     // "shared_font.bin" in the Citra "sysdata" directory.
 
-    shared_font.clear();
     std::string filepath = FileUtil::GetUserPath(D_SYSDATA_IDX) + SHARED_FONT;
 
     FileUtil::CreateFullPath(filepath); // Create path if not already created
-    FileUtil::IOFile file(filepath, "rb");
-
-    if (file.IsOpen()) {
-        // Read shared font data
-        shared_font.resize((size_t)file.GetSize());
-        file.ReadBytes(shared_font.data(), (size_t)file.GetSize());
 
+    if (shared_font.Open(filepath)) {
         // Create shared font memory object
         using Kernel::MemoryPermission;
         shared_font_mem = Kernel::SharedMemory::Create(3 * 1024 * 1024, // 3MB
@@ -320,12 +321,20 @@ void Init() {
 }
 
 void Shutdown() {
-    shared_font.clear();
+    shared_font.Close();
     shared_font_mem = nullptr;
     lock = nullptr;
     notification_event = nullptr;
     start_event = nullptr;
 }
 
+void DoState(PointerWrap& p) {
+    Kernel::DoObjectReference(p, shared_font_mem);
+    Kernel::DoObjectReference(p, lock);
+    Kernel::DoObjectReference(p, notification_event);
+    Kernel::DoObjectReference(p, start_event);
+    p.Do(cpu_percent);
+}
+
 } // namespace APT
 } // namespace Service
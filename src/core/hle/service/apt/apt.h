@@ -8,6 +8,8 @@
 #include "core/hle/result.h"
 #include "core/hle/service/service.h"
 
+class PointerWrap;
+
 namespace Service {
 namespace APT {
 
@@ -255,5 +257,11 @@ void Init();
 /// Shutdown the APT service
 void Shutdown();
 
+/**
+ * Saves or restores the shared font memory, the APT lock and events and the CPU time limit. The
+ * font data is mapped from its file again by Init rather than saved.
+ */
+void DoState(PointerWrap& p);
+
 } // namespace APT
 } // namespace Service
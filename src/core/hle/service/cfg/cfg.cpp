@@ -3,6 +3,7 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <unordered_map>
 
 #include "common/logging/log.h"
 #include "common/string_util.h"
@@ -46,6 +47,10 @@ const std::array<float, 8> STEREO_CAMERA_SETTINGS = {
 
 static const u32 CONFIG_SAVEFILE_SIZE = 0x8000;
 static std::array<u8, CONFIG_SAVEFILE_SIZE> cfg_config_file_buffer;
+/// Index of the entry of each block in the config savegame header, by block ID
+static std::unordered_map<u32, u32> cfg_block_index;
+/// Whether the buffer was modified since it was last written to the config savegame file
+static bool cfg_config_dirty = false;
 
 static Service::FS::ArchiveHandle cfg_system_save_data_archive;
 static const std::vector<u8> cfg_system_savedata_id = { 0x00, 0x00, 0x00, 0x00, 0x17, 0x00, 0x01, 0x00 };
@@ -184,16 +189,26 @@ void FormatConfig(Service::Interface* self) {
     cmd_buff[1] = Service::CFG::FormatConfig().raw;
 }
 
+/// Rebuilds the block index from the header of the config savegame buffer
+static void BuildBlockIndex() {
+    const SaveFileConfig* config = reinterpret_cast<const SaveFileConfig*>(cfg_config_file_buffer.data());
+    const u32 total_entries = std::min<u32>(config->total_entries, CONFIG_FILE_MAX_BLOCK_ENTRIES);
+
+    cfg_block_index.clear();
+    // Lookups used to return the first entry of a block
+    for (u32 i = total_entries; i-- > 0;)
+        cfg_block_index[config->block_entries[i].block_id] = i;
+}
+
 ResultCode GetConfigInfoBlock(u32 block_id, u32 size, u32 flag, u8* output) {
-    // Read the header
     SaveFileConfig* config = reinterpret_cast<SaveFileConfig*>(cfg_config_file_buffer.data());
 
-    auto itr = std::find_if(std::begin(config->block_entries), std::end(config->block_entries),
-        [&](const SaveConfigBlockEntry& entry) {
-            return entry.block_id == block_id && (entry.flags & flag);
-        });
+    auto index = cfg_block_index.find(block_id);
+    const SaveConfigBlockEntry* itr = nullptr;
+    if (index != cfg_block_index.end() && (config->block_entries[index->second].flags & flag))
+        itr = &config->block_entries[index->second];
 
-    if (itr == std::end(config->block_entries)) {
+    if (itr == nullptr) {
         LOG_ERROR(Service_CFG, "Config block 0x%X with flags %u and size %u was not found", block_id, flag, size);
         return ResultCode(ErrorDescription::NotFound, ErrorModule::Config, ErrorSummary::WrongArgument, ErrorLevel::Permanent);
     }
@@ -242,7 +257,9 @@ ResultCode CreateConfigInfoBlk(u32 block_id, u16 size, u16 flags, const u8* data
         memcpy(&config->block_entries[config->total_entries].offset_or_data, data, size);
     }
 
+    cfg_block_index.emplace(block_id, config->total_entries);
     ++config->total_entries;
+    cfg_config_dirty = true;
     return RESULT_SUCCESS;
 }
 
@@ -252,6 +269,10 @@ ResultCode DeleteConfigNANDSaveFile() {
 }
 
 ResultCode UpdateConfigNANDSavegame() {
+    // The system settings save the config whenever they are left, usually without changing it
+    if (!cfg_config_dirty)
+        return RESULT_SUCCESS;
+
     FileSys::Mode mode = {};
     mode.write_flag = 1;
     mode.create_flag = 1;
@@ -263,6 +284,7 @@ ResultCode UpdateConfigNANDSavegame() {
 
     auto config = config_result.MoveFrom();
     config->backend->Write(0, CONFIG_SAVEFILE_SIZE, 1, cfg_config_file_buffer.data());
+    cfg_config_dirty = false;
 
     return RESULT_SUCCESS;
 }
@@ -273,6 +295,7 @@ ResultCode FormatConfig() {
         return res;
     // Delete the old data
     cfg_config_file_buffer.fill(0);
+    cfg_block_index.clear();
     // Create the header
     SaveFileConfig* config = reinterpret_cast<SaveFileConfig*>(cfg_config_file_buffer.data());
     // This value is hardcoded, taken from 3dbrew, verified by hardware, it's always the same value
@@ -343,6 +366,8 @@ void Init() {
     if (config_result.Succeeded()) {
         auto config = config_result.MoveFrom();
         config->backend->Read(0, CONFIG_SAVEFILE_SIZE, cfg_config_file_buffer.data());
+        BuildBlockIndex();
+        cfg_config_dirty = false;
         return;
     }
 
@@ -361,6 +386,8 @@ void Init() {
 }
 
 void Shutdown() {
+    cfg_block_index.clear();
+    cfg_config_dirty = false;
 }
 
 } // namespace CFG
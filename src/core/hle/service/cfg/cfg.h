@@ -287,7 +287,8 @@ ResultCode CreateConfigInfoBlk(u32 block_id, u16 size, u16 flags, const u8* data
 ResultCode DeleteConfigNANDSaveFile();
 
 /**
- * Writes the config savegame memory buffer to the config savegame file in the filesystem
+ * Writes the config savegame memory buffer to the config savegame file in the filesystem, if the
+ * buffer was modified since it was last read or written
  * @returns ResultCode indicating the result of the operation, 0 on success
  */
 ResultCode UpdateConfigNANDSavegame();
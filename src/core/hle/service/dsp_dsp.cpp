@@ -2,11 +2,17 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <vector>
+
+#include "common/chunk_file.h"
 #include "common/logging/log.h"
+#include "common/swap.h"
 
 #include "core/hle/hle.h"
+#include "core/hle/dsp/dsp.h"
 #include "core/hle/kernel/event.h"
 #include "core/hle/service/dsp_dsp.h"
+#include "core/memory.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Namespace DSP_DSP
@@ -166,6 +172,17 @@ static void WriteReg0x10(Service::Interface* self) {
     LOG_WARNING(Service_DSP, "(STUBBED) called");
 }
 
+/// Pipe the application controls the audio firmware through
+static const u32 AUDIO_PIPE = 2;
+
+/// Commands the application writes to the audio pipe
+enum class AudioPipeCommand : u32 {
+    Initialize = 0,
+    Shutdown = 1,
+    Wakeup = 2,
+    Sleep = 3,
+};
+
 /**
  * DSP_DSP::WriteProcessPipe service function
  *  Inputs:
@@ -185,10 +202,28 @@ static void WriteProcessPipe(Service::Interface* self) {
     u32 new_size = cmd_buff[3];
     u32 buffer   = cmd_buff[4];
 
+    if (number == AUDIO_PIPE && size >= sizeof(u32)) {
+        switch (static_cast<AudioPipeCommand>(Memory::Read32(buffer))) {
+        case AudioPipeCommand::Initialize:
+        case AudioPipeCommand::Wakeup:
+            // The structure addresses are read back after initializing
+            read_pipe_count = 0;
+            DSP::StartAudio();
+            break;
+        case AudioPipeCommand::Shutdown:
+        case AudioPipeCommand::Sleep:
+            DSP::StopAudio();
+            break;
+        default:
+            LOG_ERROR(Service_DSP, "unknown audio pipe command %u", Memory::Read32(buffer));
+            break;
+        }
+    }
+
     cmd_buff[1] = RESULT_SUCCESS.raw; // No error
 
-    LOG_WARNING(Service_DSP, "(STUBBED) called number=%u, size=0x%X, new_size=0x%X, buffer=0x%08X",
-                number, size, new_size, buffer);
+    LOG_DEBUG(Service_DSP, "called number=%u, size=0x%X, new_size=0x%X, buffer=0x%08X",
+              number, size, new_size, buffer);
 }
 
 /**
@@ -210,24 +245,22 @@ static void ReadPipeIfPossible(Service::Interface* self) {
     u32 size = cmd_buff[3] & 0xFFFF;// Lower 16 bits are size
     VAddr addr = cmd_buff[0x41];
 
-    // Canned DSP responses that games expect. These were taken from HW by 3dmoo team.
-    // TODO: Remove this hack :)
-    static const std::array<u16, 16> canned_read_pipe = {
-        0x000F, 0xBFFF, 0x9E8E, 0x8680, 0xA78E, 0x9430, 0x8400, 0x8540,
-        0x948E, 0x8710, 0x8410, 0xA90E, 0xAA0E, 0xAACE, 0xAC4E, 0xAC58
-    };
+    // TODO: Only the reply of the audio pipe to being initialized is emulated
+    const auto& structure_addresses = DSP::AUDIO_PIPE_STRUCTURE_ADDRESSES;
 
     u32 initial_size = read_pipe_count;
 
+    std::vector<u16_le> pipe_data;
     for (unsigned offset = 0; offset < size; offset += sizeof(u16)) {
-        if (read_pipe_count < canned_read_pipe.size()) {
-            Memory::Write16(addr + offset, canned_read_pipe[read_pipe_count]);
+        if (read_pipe_count < structure_addresses.size()) {
+            pipe_data.push_back(structure_addresses[read_pipe_count]);
             read_pipe_count++;
         } else {
-            LOG_ERROR(Service_DSP, "canned read pipe log exceeded!");
+            LOG_ERROR(Service_DSP, "audio pipe read past the structure addresses!");
             break;
         }
     }
+    Memory::WriteBlock(addr, pipe_data.data(), pipe_data.size() * sizeof(u16));
 
     cmd_buff[1] = 0; // No error
     cmd_buff[2] = (read_pipe_count - initial_size) * sizeof(u16);
@@ -271,6 +304,12 @@ static void GetHeadphoneStatus(Service::Interface* self) {
     LOG_DEBUG(Service_DSP, "(STUBBED) called");
 }
 
+void DoState(PointerWrap& p) {
+    p.Do(read_pipe_count);
+    Kernel::DoObjectReference(p, semaphore_event);
+    Kernel::DoObjectReference(p, interrupt_event);
+}
+
 const Interface::FunctionInfo FunctionTable[] = {
     {0x00010040, nullptr,                          "RecvData"},
     {0x00020040, nullptr,                          "RecvDataIsReady"},
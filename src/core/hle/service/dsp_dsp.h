@@ -6,6 +6,8 @@
 
 #include "core/hle/service/service.h"
 
+class PointerWrap;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Namespace DSP_DSP
 
@@ -23,4 +25,7 @@ public:
 /// Signals that a DSP interrupt has occurred to userland code
 void SignalInterrupt();
 
+/// Saves or restores the semaphore and interrupt events and the count of audio pipe reads
+void DoState(PointerWrap& p);
+
 } // namespace
@@ -2,11 +2,15 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <boost/container/flat_map.hpp>
 
+#include "common/chunk_file.h"
 #include "common/common_types.h"
 #include "common/file_util.h"
 #include "common/logging/log.h"
@@ -21,10 +25,14 @@
 #include "core/file_sys/archive_sdmc.h"
 #include "core/file_sys/archive_systemsavedata.h"
 #include "core/file_sys/directory_backend.h"
+#include "core/file_sys/write_back.h"
+#include "core/ipc_recording.h"
 #include "core/hle/service/service.h"
 #include "core/hle/service/fs/archive.h"
+#include "core/hle/service/fs/file_io.h"
 #include "core/hle/service/fs/fs_user.h"
 #include "core/hle/result.h"
+#include "core/memory.h"
 
 // Specializes std::hash for ArchiveIdCode, so that we can use it in std::unordered_map.
 // Workaroung for libstdc++ bug: https://gcc.gnu.org/bugzilla/show_bug.cgi?id=60970
@@ -79,14 +87,28 @@ enum class DirectoryCommand : u32 {
     Close           = 0x08020000,
 };
 
+/// Every open file session, for save states
+static std::unordered_set<File*> open_files;
+
 File::File(std::unique_ptr<FileSys::FileBackend>&& backend, const FileSys::Path & path)
-    : path(path), priority(0), backend(std::move(backend)) {}
+    : path(path), priority(0), backend(std::move(backend)) {
+    open_files.insert(this);
+}
 
-File::~File() {}
+File::~File() {
+    open_files.erase(this);
+    FileIO::Synchronize(backend.get());
+}
 
 ResultVal<bool> File::SyncRequest() {
+    IPCRecording::ScopedCall recorded_call(this, "File");
     u32* cmd_buff = Kernel::GetCommandBuffer();
     FileCommand cmd = static_cast<FileCommand>(cmd_buff[0]);
+
+    // Other commands access the backend directly, after the queued reads and writes
+    if (cmd != FileCommand::Read && cmd != FileCommand::Write)
+        FileIO::Synchronize(backend.get());
+
     switch (cmd) {
 
         // Read from file...
@@ -97,7 +119,24 @@ ResultVal<bool> File::SyncRequest() {
             u32 address = cmd_buff[5];
             LOG_TRACE(Service_FS, "Read %s %s: offset=0x%llx length=%d address=0x%x",
                       GetTypeName().c_str(), GetName().c_str(), offset, length, address);
-            cmd_buff[2] = static_cast<u32>(backend->Read(offset, length, Memory::GetPointer(address)));
+            if (FileIO::IsEnabled()) {
+                // The reply is written when the read is done
+                FileIO::QueueRead(this, offset, length, address);
+                return MakeResult<bool>(false);
+            }
+            // Read straight into guest memory when the buffer is contiguous on the host
+            size_t read;
+            if (u8* dest = Memory::GetContiguousPointer(address, length)) {
+                read = backend->Read(offset, length, dest);
+                if (read > length)
+                    read = 0;
+                Memory::InvalidateCodeRange(address, static_cast<u32>(read));
+            } else {
+                std::vector<u8> data(length);
+                read = backend->Read(offset, length, data.data());
+                Memory::WriteBlock(address, data.data(), read);
+            }
+            cmd_buff[2] = static_cast<u32>(read);
             break;
         }
 
@@ -110,7 +149,13 @@ ResultVal<bool> File::SyncRequest() {
             u32 address = cmd_buff[6];
             LOG_TRACE(Service_FS, "Write %s %s: offset=0x%llx length=%d address=0x%x, flush=0x%x",
                       GetTypeName().c_str(), GetName().c_str(), offset, length, address, flush);
-            cmd_buff[2] = static_cast<u32>(backend->Write(offset, length, flush, Memory::GetPointer(address)));
+            std::vector<u8> data(length);
+            Memory::ReadBlock(address, data.data(), length);
+            if (FileIO::IsEnabled()) {
+                FileIO::QueueWrite(this, offset, flush, std::move(data));
+                return MakeResult<bool>(false);
+            }
+            cmd_buff[2] = static_cast<u32>(backend->Write(offset, length, flush, data.data()));
             break;
         }
 
@@ -184,6 +229,7 @@ Directory::Directory(std::unique_ptr<FileSys::DirectoryBackend>&& backend, const
 Directory::~Directory() {}
 
 ResultVal<bool> Directory::SyncRequest() {
+    IPCRecording::ScopedCall recorded_call(this, "Directory");
     u32* cmd_buff = Kernel::GetCommandBuffer();
     DirectoryCommand cmd = static_cast<DirectoryCommand>(cmd_buff[0]);
     switch (cmd) {
@@ -237,6 +283,13 @@ static boost::container::flat_map<ArchiveIdCode, std::unique_ptr<ArchiveFactory>
 static std::unordered_map<ArchiveHandle, std::unique_ptr<ArchiveBackend>> handle_map;
 static ArchiveHandle next_handle;
 
+/// How the active archives were opened, to open them again when restoring a save state
+struct ArchiveOrigin {
+    ArchiveIdCode id_code;
+    FileSys::Path path;
+};
+static std::unordered_map<ArchiveHandle, ArchiveOrigin> archive_origins;
+
 static ArchiveBackend* GetArchive(ArchiveHandle handle) {
     auto itr = handle_map.find(handle);
     return (itr == handle_map.end()) ? nullptr : itr->second.get();
@@ -259,10 +312,12 @@ ResultVal<ArchiveHandle> OpenArchive(ArchiveIdCode id_code, FileSys::Path& archi
         ++next_handle;
     }
     handle_map.emplace(next_handle, std::move(res));
+    archive_origins[next_handle] = { id_code, archive_path };
     return MakeResult<ArchiveHandle>(next_handle++);
 }
 
 ResultCode CloseArchive(ArchiveHandle handle) {
+    archive_origins.erase(handle);
     if (handle_map.erase(handle) == 0)
         return ERR_INVALID_HANDLE;
     else
@@ -295,6 +350,8 @@ ResultVal<Kernel::SharedPtr<File>> OpenFileFromArchive(ArchiveHandle archive_han
     }
 
     auto file = Kernel::SharedPtr<File>(new File(std::move(backend), path));
+    file->archive_handle = archive_handle;
+    file->mode = mode.hex;
     return MakeResult<Kernel::SharedPtr<File>>(std::move(file));
 }
 
@@ -493,6 +550,9 @@ ResultCode CreateSystemSaveData(u32 high, u32 low) {
 void ArchiveInit() {
     next_handle = 1;
 
+    FileIO::Init();
+    FileSys::WriteBack::Init();
+
     AddService(new FS::Interface);
 
     // TODO(Subv): Add the other archive types (see here for the known types:
@@ -533,8 +593,116 @@ void ArchiveInit() {
 
 /// Shutdown archives
 void ArchiveShutdown() {
+    FileIO::Shutdown();
     handle_map.clear();
+    archive_origins.clear();
     id_code_map.clear();
+    FileSys::WriteBack::Shutdown();
+}
+
+void DoState(PointerWrap& p) {
+    std::vector<ArchiveHandle> handles;
+    for (const auto& archive : archive_origins)
+        handles.push_back(archive.first);
+    std::sort(handles.begin(), handles.end());
+
+    u32 num_archives = static_cast<u32>(handles.size());
+    p.Do(num_archives);
+    if (p.GetMode() == PointerWrap::MODE_READ)
+        handles.resize(num_archives);
+
+    // Archives that are still open with the same origin are kept, the others are opened again
+    std::unordered_map<ArchiveHandle, std::unique_ptr<ArchiveBackend>> restored_archives;
+    std::unordered_map<ArchiveHandle, ArchiveOrigin> restored_origins;
+    for (ArchiveHandle& handle : handles) {
+        ArchiveOrigin origin;
+        if (p.GetMode() != PointerWrap::MODE_READ)
+            origin = archive_origins[handle];
+        p.Do(handle);
+        p.Do(origin.id_code);
+        origin.path.DoState(p);
+        if (p.GetMode() != PointerWrap::MODE_READ)
+            continue;
+
+        auto open_origin = archive_origins.find(handle);
+        if (open_origin != archive_origins.end() && open_origin->second.id_code == origin.id_code &&
+            open_origin->second.path == origin.path) {
+            restored_archives.emplace(handle, std::move(handle_map[handle]));
+            restored_origins.emplace(handle, std::move(origin));
+            continue;
+        }
+
+        auto factory = id_code_map.find(origin.id_code);
+        auto archive = (factory != id_code_map.end()) ? factory->second->Open(origin.path) :
+                       ResultVal<std::unique_ptr<ArchiveBackend>>(ERR_INVALID_HANDLE);
+        if (archive.Failed()) {
+            LOG_ERROR(Service_FS, "Unable to reopen archive 0x%08X of the save state", origin.id_code);
+            p.SetError(PointerWrap::ERROR_FAILURE);
+            return;
+        }
+        restored_archives.emplace(handle, archive.MoveFrom());
+        restored_origins.emplace(handle, std::move(origin));
+    }
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        handle_map.swap(restored_archives);
+        archive_origins.swap(restored_origins);
+    }
+    p.Do(next_handle);
+
+    std::vector<File*> files(open_files.begin(), open_files.end());
+    std::sort(files.begin(), files.end(), [](const File* a, const File* b) {
+        return a->GetObjectId() < b->GetObjectId();
+    });
+
+    u32 num_files = static_cast<u32>(files.size());
+    p.Do(num_files);
+    for (u32 i = 0; i < num_files && !p.error; ++i) {
+        u32 object_id = 0;
+        ArchiveHandle archive_handle = 0;
+        FileSys::Path path;
+        u32 mode = 0;
+        u32 priority = 0;
+        if (p.GetMode() != PointerWrap::MODE_READ) {
+            object_id = files[i]->GetObjectId();
+            archive_handle = files[i]->archive_handle;
+            path = files[i]->path;
+            mode = files[i]->mode;
+            priority = files[i]->priority;
+        }
+        p.Do(object_id);
+        p.Do(archive_handle);
+        path.DoState(p);
+        p.Do(mode);
+        p.Do(priority);
+        if (p.GetMode() != PointerWrap::MODE_READ)
+            continue;
+
+        // Files that are still open the same way are kept. Other files open in this system are
+        // closed along with their handles, only ids are reused.
+        auto open_file = std::find_if(open_files.begin(), open_files.end(), [object_id](const File* file) {
+            return file->GetObjectId() == object_id;
+        });
+        if (open_file != open_files.end() && (*open_file)->archive_handle == archive_handle &&
+            (*open_file)->path == path && (*open_file)->mode == mode) {
+            (*open_file)->priority = priority;
+            Kernel::HoldRestoredObject(*open_file);
+            continue;
+        }
+
+        FileSys::Mode file_mode;
+        file_mode.hex = mode;
+        auto file = (Kernel::FindObjectById(object_id) == nullptr) ?
+                    OpenFileFromArchive(archive_handle, path, file_mode) : ERR_INVALID_HANDLE;
+        if (file.Failed()) {
+            LOG_ERROR(Service_FS, "Unable to reopen file %s of the save state", path.DebugStr().c_str());
+            p.SetError(PointerWrap::ERROR_FAILURE);
+            return;
+        }
+        (*file)->RestoreObjectId(object_id);
+        (*file)->priority = priority;
+        Kernel::HoldRestoredObject(file.MoveFrom());
+    }
+    p.DoMarker("FS");
 }
 
 } // namespace FS
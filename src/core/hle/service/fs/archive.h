@@ -11,6 +11,8 @@
 #include "core/hle/kernel/session.h"
 #include "core/hle/result.h"
 
+class PointerWrap;
+
 /// The unique system identifier hash, also known as ID0
 extern const std::string SYSTEM_ID;
 /// The scrambled SD card CID, also known as ID1
@@ -54,6 +56,10 @@ public:
     FileSys::Path path; ///< Path of the file
     u32 priority; ///< Priority of the file. TODO(Subv): Find out what this means
     std::unique_ptr<FileSys::FileBackend> backend; ///< File backend interface
+
+    // How the file was opened, to open it again when restoring a save state
+    ArchiveHandle archive_handle = 0;
+    u32 mode = 0;
 };
 
 class Directory : public Kernel::Session {
@@ -214,5 +220,11 @@ void ArchiveInit();
 /// Shutdown archives
 void ArchiveShutdown();
 
+/**
+ * Saves or restores the open archives and files, after the list of kernel objects. Restoring opens
+ * them again, they have to exist on the host still. Directories can't be restored.
+ */
+void DoState(PointerWrap& p);
+
 } // namespace FS
 } // namespace Service
@@ -0,0 +1,289 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/logging/log.h"
+#include "common/make_unique.h"
+#include "common/thread_policy.h"
+
+#include "core/core_timing.h"
+#include "core/memory.h"
+#include "core/settings.h"
+#include "core/file_sys/file_backend.h"
+#include "core/hle/result.h"
+#include "core/hle/kernel/session.h"
+#include "core/hle/kernel/thread.h"
+#include "core/hle/service/fs/archive.h"
+#include "core/hle/service/fs/file_io.h"
+
+namespace Service {
+namespace FS {
+
+namespace FileIO {
+
+/// Bytes read past the end of a read that continues the previous one on the same file
+static const u32 READ_AHEAD_SIZE = 256 * 1024;
+
+struct Request {
+    // Only touched on the CPU thread, the I/O thread just moves the request around
+    Kernel::SharedPtr<File> file;
+    Kernel::SharedPtr<Kernel::Thread> thread;
+
+    FileSys::FileBackend* backend;
+    bool is_write;
+    u64 offset;
+    u32 length;
+    u32 flush;
+    /// Guest address read data is written to
+    VAddr address;
+    /// Data read or to be written
+    std::vector<u8> data;
+    /// Number of bytes read or written
+    size_t result;
+};
+
+/// Data read past the end of the last read of a file, for the next sequential read
+struct ReadAhead {
+    u64 offset = 0;
+    std::vector<u8> data;
+    /// Offset the last read of the file ended at, a read starting there is sequential
+    u64 next_offset = 0;
+};
+
+static std::unique_ptr<std::thread> io_thread;
+
+static std::mutex mutex;
+static std::condition_variable work_available;
+static std::condition_variable work_done;
+static std::deque<std::unique_ptr<Request>> pending_requests;
+static std::deque<std::unique_ptr<Request>> finished_requests;
+static bool busy = false;
+static bool stopping = false;
+
+/// Read-aheads of the files, only accessed by the I/O thread or while it is idle
+static std::unordered_map<const FileSys::FileBackend*, ReadAhead> read_aheads;
+
+static int completion_event;
+
+/// Reads from a backend, reporting failures as reading nothing
+static size_t ReadBackend(FileSys::FileBackend* backend, u64 offset, u32 length, u8* buffer) {
+    const size_t read = backend->Read(offset, length, buffer);
+    return read <= length ? read : 0;
+}
+
+/// Reads the given range of a file, serving and extending its read-ahead
+static size_t ReadWithReadAhead(FileSys::FileBackend* backend, u64 offset, u32 length, u8* buffer) {
+    ReadAhead& read_ahead = read_aheads[backend];
+    const bool sequential = offset == read_ahead.next_offset;
+    read_ahead.next_offset = offset + length;
+
+    size_t done = 0;
+    if (offset >= read_ahead.offset && offset < read_ahead.offset + read_ahead.data.size()) {
+        done = static_cast<size_t>(std::min<u64>(length, read_ahead.offset + read_ahead.data.size() - offset));
+        std::memcpy(buffer, read_ahead.data.data() + (offset - read_ahead.offset), done);
+    }
+    if (done == length)
+        return done;
+
+    const u64 rest_offset = offset + done;
+    const u32 rest_length = length - static_cast<u32>(done);
+    if (!sequential || rest_length >= READ_AHEAD_SIZE) {
+        read_ahead.data.clear();
+        return done + ReadBackend(backend, rest_offset, rest_length, buffer + done);
+    }
+
+    // Streaming, read a whole block and keep what wasn't asked for yet
+    read_ahead.data.resize(READ_AHEAD_SIZE);
+    read_ahead.data.resize(ReadBackend(backend, rest_offset, READ_AHEAD_SIZE, read_ahead.data.data()));
+    read_ahead.offset = rest_offset;
+
+    const size_t used = std::min<size_t>(rest_length, read_ahead.data.size());
+    std::memcpy(buffer + done, read_ahead.data.data(), used);
+    return done + used;
+}
+
+/// Performs a run of requests, coalescing the reads that continue each other on the same file
+static void PerformRequests(std::deque<std::unique_ptr<Request>>& requests) {
+    for (size_t first = 0; first < requests.size();) {
+        Request& request = *requests[first];
+
+        if (request.is_write) {
+            // Other sessions may have the same host file open, so all read-aheads could be stale
+            read_aheads.clear();
+            request.result = request.backend->Write(request.offset, request.length, request.flush,
+                                                    request.data.data());
+            ++first;
+            continue;
+        }
+
+        size_t end = first + 1;
+        u64 run_end = request.offset + request.length;
+        while (end < requests.size() && !requests[end]->is_write && requests[end]->backend == request.backend &&
+               requests[end]->offset == run_end && run_end - request.offset + requests[end]->length <= 0xFFFFFFFF) {
+            run_end += requests[end]->length;
+            ++end;
+        }
+
+        std::vector<u8> data(static_cast<size_t>(run_end - request.offset));
+        const size_t read = ReadWithReadAhead(request.backend, request.offset, static_cast<u32>(data.size()), data.data());
+
+        // Hand every request its part of what was read
+        for (size_t i = first; i < end; ++i) {
+            Request& part = *requests[i];
+            const size_t part_start = static_cast<size_t>(part.offset - request.offset);
+            part.result = part_start < read ? std::min<size_t>(part.length, read - part_start) : 0;
+            part.data.assign(data.begin() + part_start, data.begin() + part_start + part.result);
+        }
+        first = end;
+    }
+}
+
+static void ThreadLoop() {
+    Common::RegisterCurrentThread("FileIOThread", Common::ThreadClass::Worker);
+
+    // Take the whole queue at once, so that adjacent reads can be coalesced
+    std::deque<std::unique_ptr<Request>> batch;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_available.wait(lock, [] { return !pending_requests.empty() || stopping; });
+        if (pending_requests.empty())
+            break;
+
+        batch.swap(pending_requests);
+        busy = true;
+        lock.unlock();
+        PerformRequests(batch);
+        lock.lock();
+
+        for (auto& request : batch)
+            finished_requests.push_back(std::move(request));
+        batch.clear();
+        busy = false;
+        work_done.notify_all();
+
+        CoreTiming::ScheduleEvent_Threadsafe(0, completion_event);
+    }
+}
+
+/// Delivers the replies of the finished requests and wakes up their guest threads, on the CPU thread
+static void CompleteRequests(u64 userdata, int cycles_late) {
+    std::deque<std::unique_ptr<Request>> requests;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.swap(finished_requests);
+    }
+
+    for (auto& request : requests) {
+        if (!request->is_write)
+            Memory::WriteBlock(request->address, request->data.data(), request->result);
+
+        u32* cmd_buff = request->thread->command_buffer;
+        cmd_buff[1] = RESULT_SUCCESS.raw;
+        cmd_buff[2] = static_cast<u32>(request->result);
+
+        request->thread->ResumeFromWait();
+    }
+}
+
+void Init() {
+    completion_event = CoreTiming::RegisterEvent("FS::FileIO::CompleteRequests", CompleteRequests);
+    if (!Settings::values.async_file_io)
+        return;
+
+    stopping = false;
+    busy = false;
+    io_thread = Common::make_unique<std::thread>(ThreadLoop);
+
+    LOG_INFO(Service_FS, "File reads and writes run on a separate thread");
+}
+
+void Shutdown() {
+    if (!IsEnabled())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_one();
+    io_thread->join();
+    io_thread.reset();
+
+    // Releasing the requests may destroy their files, which synchronize with the thread
+    std::deque<std::unique_ptr<Request>> requests;
+    requests.swap(finished_requests);
+    requests.clear();
+    read_aheads.clear();
+}
+
+bool IsEnabled() {
+    return io_thread != nullptr;
+}
+
+bool HasPendingRequests() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !pending_requests.empty() || busy || !finished_requests.empty();
+}
+
+/// Queues a request issued by the current guest thread, which sleeps until its reply
+static void Queue(std::unique_ptr<Request> request) {
+    request->thread = Kernel::GetCurrentThread();
+    request->result = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending_requests.push_back(std::move(request));
+    }
+    work_available.notify_one();
+
+    Kernel::WaitCurrentThread_Sleep();
+}
+
+void QueueRead(Kernel::SharedPtr<File> file, u64 offset, u32 length, VAddr address) {
+    auto request = Common::make_unique<Request>();
+    request->backend = file->backend.get();
+    request->file = std::move(file);
+    request->is_write = false;
+    request->offset = offset;
+    request->length = length;
+    request->flush = 0;
+    request->address = address;
+    Queue(std::move(request));
+}
+
+void QueueWrite(Kernel::SharedPtr<File> file, u64 offset, u32 flush, std::vector<u8> data) {
+    auto request = Common::make_unique<Request>();
+    request->backend = file->backend.get();
+    request->file = std::move(file);
+    request->is_write = true;
+    request->offset = offset;
+    request->length = static_cast<u32>(data.size());
+    request->flush = flush;
+    request->address = 0;
+    request->data = std::move(data);
+    Queue(std::move(request));
+}
+
+void Synchronize(const FileSys::FileBackend* backend) {
+    if (!IsEnabled())
+        return;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [] { return pending_requests.empty() && !busy; });
+    read_aheads.erase(backend);
+}
+
+} // namespace
+
+} // namespace FS
+} // namespace Service
@@ -0,0 +1,65 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include "common/common_types.h"
+
+#include "core/hle/kernel/kernel.h"
+
+namespace FileSys {
+class FileBackend;
+}
+
+namespace Service {
+namespace FS {
+
+class File;
+
+/**
+ * Optional host thread performing the reads and writes of FS file sessions. The guest thread
+ * issuing a request sleeps while the host file is accessed, and is woken up through a CoreTiming
+ * event once the reply has been written to its command buffer. Requests run in submission order,
+ * reads continuing each other on the same file are coalesced and sequential reads are extended
+ * by a read-ahead. While the thread is disabled all requests are performed right away.
+ */
+namespace FileIO {
+
+/// Starts the I/O thread if it is enabled in the settings
+void Init();
+
+/// Finishes the queued requests and stops the I/O thread, replies not delivered yet are dropped
+void Shutdown();
+
+/// Whether file reads and writes are queued for the I/O thread
+bool IsEnabled();
+
+/// Whether any request is still queued, running or waiting for its reply to be delivered
+bool HasPendingRequests();
+
+/**
+ * Queues a read and puts the current guest thread to sleep until it is done
+ * @param file File session the request was sent to, kept alive until the reply
+ * @param address Guest address the data is written to
+ */
+void QueueRead(Kernel::SharedPtr<File> file, u64 offset, u32 length, VAddr address);
+
+/**
+ * Queues a write and puts the current guest thread to sleep until it is done
+ * @param data Data to write, read from guest memory when the request was issued
+ */
+void QueueWrite(Kernel::SharedPtr<File> file, u64 offset, u32 flush, std::vector<u8> data);
+
+/**
+ * Blocks until the I/O thread is done with all queued requests and forgets the read-ahead of a
+ * file, so that it can be accessed directly
+ */
+void Synchronize(const FileSys::FileBackend* backend);
+
+} // namespace
+
+} // namespace FS
+} // namespace Service
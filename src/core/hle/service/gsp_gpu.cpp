@@ -2,10 +2,17 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <atomic>
+#include <cstring>
+
 #include "common/bit_field.h"
+#include "common/chunk_file.h"
 
+#include "core/core_timing.h"
+#include "core/gpu_capture.h"
 #include "core/mem_map.h"
 #include "core/memory.h"
+#include "core/hle/ipc_helpers.h"
 #include "core/hle/kernel/event.h"
 #include "core/hle/kernel/shared_memory.h"
 #include "core/hle/result.h"
@@ -14,7 +21,9 @@
 #include "core/hw/gpu.h"
 #include "core/hw/lcd.h"
 
+#include "video_core/cost_model.h"
 #include "video_core/gpu_debugger.h"
+#include "video_core/gpu_thread.h"
 #include "video_core/video_core.h"
 
 // Main graphics debugger object - TODO: Here is probably not the best place for this
@@ -34,6 +43,12 @@ Kernel::SharedPtr<Kernel::Event> g_interrupt_event;
 Kernel::SharedPtr<Kernel::SharedMemory> g_shared_memory;
 /// Thread index into interrupt relay queue
 u32 g_thread_id = 0;
+/// Event id for CoreTiming, delivering the pending interrupts
+static int interrupt_delivery_event;
+/// Event id for CoreTiming, raising an interrupt after the delay it was signalled with
+static int interrupt_raise_event;
+/// Bit mask of the interrupts raised but not delivered yet, set from the CPU and GPU threads
+static std::atomic<u32> pending_interrupts;
 
 /// Gets a pointer to a thread command buffer in GSP shared memory
 static inline u8* GetCommandBuffer(u32 thread_id) {
@@ -45,14 +60,12 @@ static inline FrameBufferUpdate* GetFrameBufferInfo(u32 thread_id, u32 screen_in
 
     // For each thread there are two FrameBufferUpdate fields
     u32 offset = 0x200 + (2 * thread_id + screen_index) * sizeof(FrameBufferUpdate);
-    u8* ptr = g_shared_memory->GetPointer(offset);
-    return reinterpret_cast<FrameBufferUpdate*>(ptr);
+    return g_shared_memory->GetPointer<FrameBufferUpdate>(offset);
 }
 
 /// Gets a pointer to the interrupt relay queue for a given thread index
 static inline InterruptRelayQueue* GetInterruptRelayQueue(u32 thread_id) {
-    u8* ptr = g_shared_memory->GetPointer(sizeof(InterruptRelayQueue) * thread_id);
-    return reinterpret_cast<InterruptRelayQueue*>(ptr);
+    return g_shared_memory->GetPointer<InterruptRelayQueue>(sizeof(InterruptRelayQueue) * thread_id);
 }
 
 /**
@@ -111,13 +124,15 @@ static void WriteHWRegs(u32 base_address, u32 size_in_bytes, const u32* data) {
  *      4 : pointer to source data array
  */
 static void WriteHWRegs(Service::Interface* self) {
-    u32* cmd_buff = Kernel::GetCommandBuffer();
-    u32 reg_addr = cmd_buff[1];
-    u32 size = cmd_buff[2];
+    IPC::RequestParser rp(Kernel::GetCommandBuffer(), 0x00010082);
+    u32 reg_addr = rp.Pop<u32>();
+    u32 size = rp.Pop<u32>();
 
-    u32* src = (u32*)Memory::GetPointer(cmd_buff[4]);
+    u32 buffer_size;
+    const u32* src = reinterpret_cast<const u32*>(rp.PopStaticBuffer(&buffer_size));
 
-    WriteHWRegs(reg_addr, size, src);
+    if (src != nullptr)
+        WriteHWRegs(reg_addr, size, src);
 }
 
 /**
@@ -164,14 +179,16 @@ static void WriteHWRegsWithMask(u32 base_address, u32 size_in_bytes, const u32*
  *      6 : pointer to mask array
  */
 static void WriteHWRegsWithMask(Service::Interface* self) {
-    u32* cmd_buff = Kernel::GetCommandBuffer();
-    u32 reg_addr = cmd_buff[1];
-    u32 size = cmd_buff[2];
+    IPC::RequestParser rp(Kernel::GetCommandBuffer(), 0x00020084);
+    u32 reg_addr = rp.Pop<u32>();
+    u32 size = rp.Pop<u32>();
 
-    u32* src_data = (u32*)Memory::GetPointer(cmd_buff[4]);
-    u32* mask_data = (u32*)Memory::GetPointer(cmd_buff[6]);
+    u32 buffer_size;
+    const u32* src_data = reinterpret_cast<const u32*>(rp.PopStaticBuffer(&buffer_size));
+    const u32* mask_data = reinterpret_cast<const u32*>(rp.PopStaticBuffer(&buffer_size));
 
-    WriteHWRegsWithMask(reg_addr, size, src_data, mask_data);
+    if (src_data != nullptr && mask_data != nullptr)
+        WriteHWRegsWithMask(reg_addr, size, src_data, mask_data);
 }
 
 /// Read a GSP GPU hardware register
@@ -238,12 +255,12 @@ static void SetBufferSwap(u32 screen_id, const FrameBufferInfo& info) {
  *      1: Result code
  */
 static void SetBufferSwap(Service::Interface* self) {
-    u32* cmd_buff = Kernel::GetCommandBuffer();
-    u32 screen_id = cmd_buff[1];
-    FrameBufferInfo* fb_info = (FrameBufferInfo*)&cmd_buff[2];
-    SetBufferSwap(screen_id, *fb_info);
+    IPC::RequestParser rp(Kernel::GetCommandBuffer(), 0x00050200);
+    u32 screen_id = rp.Pop<u32>();
+    SetBufferSwap(screen_id, rp.Pop<FrameBufferInfo>());
 
-    cmd_buff[1] = 0; // No error
+    IPC::ResponseBuilder rb = rp.MakeBuilder(1, 0);
+    rb.Push(RESULT_SUCCESS);
 }
 
 /**
@@ -260,16 +277,20 @@ static void SetBufferSwap(Service::Interface* self) {
  *      1 : Result of function, 0 on success, otherwise error code
  */
 static void FlushDataCache(Service::Interface* self) {
-    u32* cmd_buff = Kernel::GetCommandBuffer();
-    u32 address = cmd_buff[1];
-    u32 size    = cmd_buff[2];
-    u32 process = cmd_buff[4];
+    IPC::RequestParser rp(Kernel::GetCommandBuffer(), 0x00080082);
+    u32 address = rp.Pop<u32>();
+    u32 size    = rp.Pop<u32>();
+    u32 process = rp.PopHandle();
 
-    VideoCore::g_renderer->hw_rasterizer->NotifyFlush(Memory::VirtualToPhysicalAddress(address), size);
+    const PAddr physical_address = Memory::VirtualToPhysicalAddress(address);
+    GPUThread::Run([physical_address, size] {
+        VideoCore::g_renderer->hw_rasterizer->NotifyFlush(physical_address, size);
+    });
 
     // TODO(purpasmart96): Verify return header on HW
 
-    cmd_buff[1] = RESULT_SUCCESS.raw; // No error
+    IPC::ResponseBuilder rb = rp.MakeBuilder(1, 0);
+    rb.Push(RESULT_SUCCESS);
 
     LOG_DEBUG(Service_GSP, "(STUBBED) called address=0x%08X, size=0x%08X, process=0x%08X",
               address, size, process);
@@ -304,29 +325,29 @@ static void RegisterInterruptRelayQueue(Service::Interface* self) {
 }
 
 /**
- * Signals that the specified interrupt type has occurred to userland code
- * @param interrupt_id ID of interrupt that is being signalled
+ * Writes an interrupt to the interrupt relay queues
  * @todo This should probably take a thread_id parameter and only signal this thread?
  * @todo This probably does not belong in the GSP module, instead move to video_core
  */
-void SignalInterrupt(InterruptId interrupt_id) {
-    if (0 == g_interrupt_event) {
-        LOG_WARNING(Service_GSP, "cannot synchronize until GSP event has been created!");
-        return;
-    }
-    if (nullptr == g_shared_memory) {
-        LOG_WARNING(Service_GSP, "cannot synchronize until GSP shared memory has been created!");
-        return;
-    }
+static void RelayInterrupt(InterruptId interrupt_id) {
     for (int thread_id = 0; thread_id < 0x4; ++thread_id) {
         InterruptRelayQueue* interrupt_relay_queue = GetInterruptRelayQueue(thread_id);
-        u8 next = interrupt_relay_queue->index;
-        next += interrupt_relay_queue->number_interrupts;
-        next = next % 0x34; // 0x34 is the number of interrupt slots
 
-        interrupt_relay_queue->number_interrupts += 1;
+        // The same interrupt waiting to be processed already covers this one
+        bool queued = false;
+        for (unsigned i = 0; i < interrupt_relay_queue->number_interrupts && !queued; ++i)
+            queued = interrupt_relay_queue->slot[(interrupt_relay_queue->index + i) % 0x34] == interrupt_id;
 
-        interrupt_relay_queue->slot[next] = interrupt_id;
+        // 0x34 is the number of interrupt slots
+        if (!queued && interrupt_relay_queue->number_interrupts < 0x34) {
+            u8 next = interrupt_relay_queue->index;
+            next += interrupt_relay_queue->number_interrupts;
+            next = next % 0x34;
+
+            interrupt_relay_queue->number_interrupts += 1;
+
+            interrupt_relay_queue->slot[next] = interrupt_id;
+        }
         interrupt_relay_queue->error_code = 0x0; // No error
 
         // Update framebuffer information if requested
@@ -341,9 +362,84 @@ void SignalInterrupt(InterruptId interrupt_id) {
             }
         }
     }
+}
+
+/// Delivers all pending interrupts at once, on the CPU thread which owns the kernel objects
+static void DeliverInterrupts(u64 userdata, int cycles_late) {
+    const u32 interrupts = pending_interrupts.exchange(0);
+
+    if (0 == g_interrupt_event) {
+        LOG_WARNING(Service_GSP, "cannot synchronize until GSP event has been created!");
+        return;
+    }
+    if (nullptr == g_shared_memory) {
+        LOG_WARNING(Service_GSP, "cannot synchronize until GSP shared memory has been created!");
+        return;
+    }
+
+    for (u32 id = 0; id <= static_cast<u32>(InterruptId::DMA); ++id) {
+        if (interrupts & (1 << id))
+            RelayInterrupt(static_cast<InterruptId>(id));
+    }
     g_interrupt_event->Signal();
 }
 
+/// Adds an interrupt to the pending ones, scheduling their delivery if it isn't already
+static void RaiseInterrupt(InterruptId interrupt_id) {
+    const u32 previous = pending_interrupts.fetch_or(1 << static_cast<u32>(interrupt_id));
+    if (previous != 0)
+        return;
+
+    if (GPUThread::IsCurrentThread()) {
+        CoreTiming::ScheduleEvent_Threadsafe_Immediate(interrupt_delivery_event);
+    } else {
+        // Deferred until the current service call returns, so that a whole batch is delivered together
+        CoreTiming::ScheduleEvent(0, interrupt_delivery_event);
+    }
+}
+
+static void RaiseDelayedInterrupt(u64 userdata, int cycles_late) {
+    RaiseInterrupt(static_cast<InterruptId>(userdata));
+}
+
+void SignalInterrupt(InterruptId interrupt_id, s64 delay) {
+    if (delay > 0 && !GPUThread::IsCurrentThread()) {
+        CoreTiming::ScheduleEvent(delay, interrupt_raise_event, static_cast<u64>(interrupt_id));
+        return;
+    }
+    RaiseInterrupt(interrupt_id);
+}
+
+void PerformDMA(VAddr source_address, VAddr dest_address, u32 size) {
+    // The copy is ordered with the GPU work, its source may still be waiting to be rendered to
+    const PAddr source = Memory::VirtualToPhysicalAddress(source_address);
+    const PAddr dest = Memory::VirtualToPhysicalAddress(dest_address);
+
+    if (dest >= Memory::VRAM_PADDR && dest + size <= Memory::VRAM_PADDR_END &&
+            Memory::GetPhysicalPointer(source) != nullptr) {
+        // VRAM never holds code, so the GPU thread can copy to it without the CPU noticing
+        GPUThread::Run([source, dest, size] {
+            VideoCore::g_renderer->hw_rasterizer->NotifyPreRead(source, size);
+            std::memcpy(Memory::GetPhysicalPointer(dest), Memory::GetPhysicalPointer(source), size);
+            SignalInterrupt(InterruptId::DMA);
+            VideoCore::g_renderer->hw_rasterizer->NotifyFlush(dest, size);
+        });
+        return;
+    }
+
+    GPUThread::Run([source, size] {
+        VideoCore::g_renderer->hw_rasterizer->NotifyPreRead(source, size);
+    });
+    GPUThread::WaitIdle();
+
+    Memory::CopyBlock(dest_address, source_address, size);
+    SignalInterrupt(InterruptId::DMA, Pica::CostModel::DMA(size));
+
+    GPUThread::Run([dest, size] {
+        VideoCore::g_renderer->hw_rasterizer->NotifyFlush(dest, size);
+    });
+}
+
 /// Executes the next GSP command
 static void ExecuteCommand(const Command& command, u32 thread_id) {
     // Utility function to convert register ID to address
@@ -355,16 +451,12 @@ static void ExecuteCommand(const Command& command, u32 thread_id) {
 
     // GX request DMA - typically used for copying memory from GSP heap to VRAM
     case CommandId::REQUEST_DMA:
-        VideoCore::g_renderer->hw_rasterizer->NotifyPreRead(Memory::VirtualToPhysicalAddress(command.dma_request.source_address),
-                                                            command.dma_request.size);
-
-        memcpy(Memory::GetPointer(command.dma_request.dest_address),
-               Memory::GetPointer(command.dma_request.source_address),
-               command.dma_request.size);
-        SignalInterrupt(InterruptId::DMA);
-
-        VideoCore::g_renderer->hw_rasterizer->NotifyFlush(Memory::VirtualToPhysicalAddress(command.dma_request.dest_address),
-                                                          command.dma_request.size);
+        if (GPUCapture::IsCapturing()) {
+            GPUCapture::OnDMA(command.dma_request.source_address, command.dma_request.dest_address,
+                              command.dma_request.size);
+        }
+        PerformDMA(command.dma_request.source_address, command.dma_request.dest_address,
+                   command.dma_request.size);
         break;
 
     // ctrulib homebrew sends all relevant command list data with this command,
@@ -459,9 +551,9 @@ static void ExecuteCommand(const Command& command, u32 thread_id) {
  *      1: Result code
  */
 static void SetLcdForceBlack(Service::Interface* self) {
-    u32* cmd_buff = Kernel::GetCommandBuffer();
+    IPC::RequestParser rp(Kernel::GetCommandBuffer(), 0x000B0040);
 
-    bool enable_black = cmd_buff[1] != 0;
+    bool enable_black = rp.PopBool();
     LCD::Regs::ColorFill data = {0};
 
     // Since data is already zeroed, there is no need to explicitly set
@@ -471,11 +563,19 @@ static void SetLcdForceBlack(Service::Interface* self) {
     LCD::Write(HW::VADDR_LCD + 4 * LCD_REG_INDEX(color_fill_top), data.raw); // Top LCD
     LCD::Write(HW::VADDR_LCD + 4 * LCD_REG_INDEX(color_fill_bottom), data.raw); // Bottom LCD
 
-    cmd_buff[1] = RESULT_SUCCESS.raw;
+    IPC::ResponseBuilder rb = rp.MakeBuilder(1, 0);
+    rb.Push(RESULT_SUCCESS);
 }
 
-/// This triggers handling of the GX command written to the command buffer in shared memory.
+/**
+ * This triggers handling of the GX command written to the command buffer in shared memory.
+ * The commands of all threads are executed as one batch, the interrupts they raise are delivered
+ * after it.
+ */
 static void TriggerCmdReqQueue(Service::Interface* self) {
+    // The surfaces and texture caches are updated once for all the memory the commands write
+    GPUThread::Run([] { VideoCore::g_renderer->hw_rasterizer->BeginNotifyBatch(); });
+
     // Iterate through each thread's command queue...
     for (unsigned thread_id = 0; thread_id < 0x4; ++thread_id) {
         CommandBuffer* command_buffer = (CommandBuffer*)GetCommandBuffer(thread_id);
@@ -492,8 +592,10 @@ static void TriggerCmdReqQueue(Service::Interface* self) {
         }
     }
 
-    u32* cmd_buff = Kernel::GetCommandBuffer();
-    cmd_buff[1] = 0; // No error
+    GPUThread::Run([] { VideoCore::g_renderer->hw_rasterizer->EndNotifyBatch(); });
+
+    IPC::ResponseBuilder rb(Kernel::GetCommandBuffer(), 0x000C, 1, 0);
+    rb.Push(RESULT_SUCCESS);
 }
 
 /**
@@ -542,6 +644,16 @@ static void ImportDisplayCaptureInfo(Service::Interface* self) {
 }
 
 
+void DoState(PointerWrap& p) {
+    Kernel::DoObjectReference(p, g_interrupt_event);
+    Kernel::DoObjectReference(p, g_shared_memory);
+    p.Do(g_thread_id);
+
+    u32 interrupts = pending_interrupts;
+    p.Do(interrupts);
+    pending_interrupts = interrupts;
+}
+
 const Interface::FunctionInfo FunctionTable[] = {
     {0x00010082, WriteHWRegs,                   "WriteHWRegs"},
     {0x00020084, WriteHWRegsWithMask,           "WriteHWRegsWithMask"},
@@ -589,6 +701,10 @@ Interface::Interface() {
             MemoryPermission::ReadWrite, "GSPSharedMem");
 
     g_thread_id = 0;
+
+    pending_interrupts = 0;
+    interrupt_delivery_event = CoreTiming::RegisterEvent("GSP_GPU::DeliverInterrupts", DeliverInterrupts);
+    interrupt_raise_event = CoreTiming::RegisterEvent("GSP_GPU::RaiseDelayedInterrupt", RaiseDelayedInterrupt);
 }
 
 } // namespace
@@ -9,6 +9,8 @@
 #include "common/bit_field.h"
 #include "core/hle/service/service.h"
 
+class PointerWrap;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Namespace GSP_GPU
 
@@ -165,9 +167,22 @@ public:
 };
 
 /**
- * Signals that the specified interrupt type has occurred to userland code
+ * Signals that the specified interrupt type has occurred to userland code. Interrupts are
+ * delivered from a CoreTiming event, together with all others raised until it runs, and an
+ * interrupt that is still pending is only delivered once.
  * @param interrupt_id ID of interrupt that is being signalled
+ * @param delay Cycles until the interrupt is raised, the modelled duration of the operation raising
+ *              it. Ignored on the GPU thread, whose work already takes its own time.
  */
-void SignalInterrupt(InterruptId interrupt_id);
+void SignalInterrupt(InterruptId interrupt_id, s64 delay = 0);
+
+/**
+ * Copies memory on behalf of the GPU, ordered with the work submitted to it before, and signals
+ * the DMA interrupt once the copy is done
+ */
+void PerformDMA(VAddr source_address, VAddr dest_address, u32 size);
+
+/// Saves or restores the interrupt event, the shared memory and the interrupts not delivered yet
+void DoState(PointerWrap& p);
 
 } // namespace
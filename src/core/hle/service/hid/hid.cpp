@@ -2,6 +2,11 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <atomic>
+#include <tuple>
+
+#include "common/chunk_file.h"
 #include "common/logging/log.h"
 
 #include "core/hle/service/service.h"
@@ -10,6 +15,8 @@
 #include "core/hle/service/hid/hid_user.h"
 
 #include "core/core_timing.h"
+#include "core/input_recording.h"
+#include "core/settings.h"
 #include "core/hle/kernel/event.h"
 #include "core/hle/kernel/shared_memory.h"
 #include "core/hle/hle.h"
@@ -34,6 +41,19 @@ static Kernel::SharedPtr<Kernel::Event> event_debug_pad;
 static u32 next_pad_index;
 static u32 next_touch_index;
 
+using TouchState = std::tuple<u16, u16, bool>;
+
+// Input as of the last sample, new entries are only written when it changes
+static u32 last_pad_state;
+static TouchState last_touch_state;
+
+static int periodic_update_event;
+static int input_changed_event;
+static s64 update_ticks;
+
+/// Whether the frontend can request samples, it may do so before the service is initialized
+static std::atomic<bool> input_notifications_enabled(false);
+
 // TODO(peachum):
 // Add a method for setting analog input from joystick device for the circle Pad.
 //
@@ -47,18 +67,11 @@ static u32 next_touch_index;
 //     * Set PadData.current_state.circle_left = 1 if current PadEntry.circle_pad_x <= -41
 //     * Set PadData.current_state.circle_right = 1 if current PadEntry.circle_pad_y <= -41
 
-void Update() {
-    SharedMem* mem = reinterpret_cast<SharedMem*>(shared_mem->GetPointer());
-    const PadState state = VideoCore::g_emu_window->GetPadState();
-
-    if (mem == nullptr) {
-        LOG_DEBUG(Service_HID, "Cannot update HID prior to mapping shared memory!");
-        return;
-    }
-
+/// Writes a new pad entry to shared memory
+static void UpdatePad(SharedMem* mem, PadState state) {
     mem->pad.current_state.hex = state.hex;
     mem->pad.index = next_pad_index;
-    next_touch_index = (next_touch_index + 1) % mem->pad.entries.size();
+    next_pad_index = (next_pad_index + 1) % mem->pad.entries.size();
 
     // Get the previous Pad state
     u32 last_entry_index = (mem->pad.index - 1) % mem->pad.entries.size();
@@ -73,7 +86,7 @@ void Update() {
     // Update entry properties
     pad_entry->current_state.hex = state.hex;
     pad_entry->delta_additions.hex = changed.hex & state.hex;
-    pad_entry->delta_removals.hex = changed.hex & old_state.hex;;
+    pad_entry->delta_removals.hex = changed.hex & old_state.hex;
 
     // Set circle Pad
     pad_entry->circle_pad_x = state.circle_left  ? -MAX_CIRCLEPAD_POS :
@@ -86,7 +99,10 @@ void Update() {
         mem->pad.index_reset_ticks_previous = mem->pad.index_reset_ticks;
         mem->pad.index_reset_ticks = (s64)CoreTiming::GetTicks();
     }
+}
 
+/// Writes a new touch entry to shared memory
+static void UpdateTouch(SharedMem* mem, const TouchState& state) {
     mem->touch.index = next_touch_index;
     next_touch_index = (next_touch_index + 1) % mem->touch.entries.size();
 
@@ -94,7 +110,7 @@ void Update() {
     TouchDataEntry* touch_entry = &mem->touch.entries[mem->touch.index];
     bool pressed = false;
 
-    std::tie(touch_entry->x, touch_entry->y, pressed) = VideoCore::g_emu_window->GetTouchState();
+    std::tie(touch_entry->x, touch_entry->y, pressed) = state;
     touch_entry->valid = pressed ? 1 : 0;
 
     // TODO(bunnei): We're not doing anything with offset 0xA8 + 0x18 of HID SharedMemory, which
@@ -106,12 +122,61 @@ void Update() {
         mem->touch.index_reset_ticks_previous = mem->touch.index_reset_ticks;
         mem->touch.index_reset_ticks = (s64)CoreTiming::GetTicks();
     }
+}
+
+/**
+ * Checks for user input updates. New entries are only written, and the events only signaled, when
+ * the input differs from the last sample, applications waiting for input are woken by actual
+ * changes rather than on every frame.
+ */
+static void Update() {
+    SharedMem* mem = shared_mem->GetPointer<SharedMem>();
+    PadState pad_state = VideoCore::g_emu_window->GetPadState();
+    TouchState touch_state = VideoCore::g_emu_window->GetTouchState();
+
+    if (mem == nullptr) {
+        LOG_DEBUG(Service_HID, "Cannot update HID prior to mapping shared memory!");
+        return;
+    }
+
+    InputRecording::ProcessInput(pad_state, touch_state);
+
+    const bool pad_changed = pad_state.hex != last_pad_state;
+    const bool touch_changed = touch_state != last_touch_state;
+    if (!pad_changed && !touch_changed)
+        return;
+
+    if (pad_changed)
+        UpdatePad(mem, pad_state);
+    if (touch_changed)
+        UpdateTouch(mem, touch_state);
+
+    last_pad_state = pad_state.hex;
+    last_touch_state = touch_state;
 
     // Signal both handles when there's an update to Pad or touch
     event_pad_or_touch_1->Signal();
     event_pad_or_touch_2->Signal();
 }
 
+/// Periodic input sampling, the equivalent of the HID module polling the hardware
+static void PeriodicUpdate(u64 userdata, int cycles_late) {
+    Update();
+
+    CoreTiming::ScheduleEvent(update_ticks - cycles_late, periodic_update_event);
+}
+
+/// Sampling requested by the frontend when its input changed
+static void InputChangedUpdate(u64 userdata, int cycles_late) {
+    Update();
+}
+
+void NotifyInputChanged() {
+    // Replayed input only changes on the periodic samples, at the same emulated times in every run
+    if (input_notifications_enabled && !InputRecording::IsReplaying())
+        CoreTiming::ScheduleEvent_Threadsafe_Immediate(input_changed_event);
+}
+
 void GetIPCHandles(Service::Interface* self) {
     u32* cmd_buff = Kernel::GetCommandBuffer();
 
@@ -189,6 +254,8 @@ void Init() {
 
     next_pad_index = 0;
     next_touch_index = 0;
+    last_pad_state = 0;
+    last_touch_state = TouchState(0, 0, false);
 
     // Create event handles
     event_pad_or_touch_1 = Event::Create(RESETTYPE_ONESHOT, "HID:EventPadOrTouch1");
@@ -196,9 +263,16 @@ void Init() {
     event_accelerometer  = Event::Create(RESETTYPE_ONESHOT, "HID:EventAccelerometer");
     event_gyroscope      = Event::Create(RESETTYPE_ONESHOT, "HID:EventGyroscope");
     event_debug_pad      = Event::Create(RESETTYPE_ONESHOT, "HID:EventDebugPad");
+
+    update_ticks = g_clock_rate_arm11 / std::max(Settings::values.hid_update_rate, 1);
+    periodic_update_event = CoreTiming::RegisterEvent("HID::PeriodicUpdate", PeriodicUpdate);
+    input_changed_event = CoreTiming::RegisterEvent("HID::InputChangedUpdate", InputChangedUpdate);
+    CoreTiming::ScheduleEvent(update_ticks, periodic_update_event);
+    input_notifications_enabled = true;
 }
 
 void Shutdown() {
+    input_notifications_enabled = false;
     shared_mem = nullptr;
     event_pad_or_touch_1 = nullptr;
     event_pad_or_touch_2 = nullptr;
@@ -207,6 +281,22 @@ void Shutdown() {
     event_debug_pad = nullptr;
 }
 
+void DoState(PointerWrap& p) {
+    Kernel::DoObjectReference(p, shared_mem);
+    Kernel::DoObjectReference(p, event_pad_or_touch_1);
+    Kernel::DoObjectReference(p, event_pad_or_touch_2);
+    Kernel::DoObjectReference(p, event_accelerometer);
+    Kernel::DoObjectReference(p, event_gyroscope);
+    Kernel::DoObjectReference(p, event_debug_pad);
+
+    p.Do(next_pad_index);
+    p.Do(next_touch_index);
+    p.Do(last_pad_state);
+    p.Do(std::get<0>(last_touch_state));
+    p.Do(std::get<1>(last_touch_state));
+    p.Do(std::get<2>(last_touch_state));
+}
+
 } // namespace HID
 
 } // namespace Service
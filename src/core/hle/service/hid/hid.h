@@ -8,6 +8,8 @@
 
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/service/service.h"
+
+class PointerWrap;
 #include "common/bit_field.h"
 
 namespace Kernel {
@@ -217,8 +219,11 @@ void DisableGyroscopeLow(Interface* self);
  */
 void GetSoundVolume(Interface* self);
 
-/// Checks for user input updates
-void Update();
+/**
+ * Samples the input right away instead of waiting for the next periodic update, so that changes
+ * reach the application as soon as they happen. Called by the frontend, from any thread.
+ */
+void NotifyInputChanged();
 
 /// Initialize HID service
 void Init();
@@ -226,5 +231,11 @@ void Init();
 /// Shutdown HID service
 void Shutdown();
 
+/**
+ * Saves or restores the shared memory, the input events and the last pad and touch entries, so that
+ * the rings in the shared memory go on where they were. The update rate comes from the settings.
+ */
+void DoState(PointerWrap& p);
+
 }
 }
@@ -2,6 +2,8 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include "common/chunk_file.h"
+
 #include "core/hle/service/service.h"
 #include "core/hle/service/ir/ir.h"
 #include "core/hle/service/ir/ir_rst.h"
@@ -47,6 +49,11 @@ void Shutdown() {
     handle_event = nullptr;
 }
 
+void DoState(PointerWrap& p) {
+    Kernel::DoObjectReference(p, handle_event);
+    Kernel::DoObjectReference(p, shared_memory);
+}
+
 } // namespace IR
 
 } // namespace Service
@@ -7,6 +7,8 @@
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/service/service.h"
 
+class PointerWrap;
+
 namespace Service {
 namespace IR {
 
@@ -26,5 +28,8 @@ void Init();
 /// Shutdown IR service
 void Shutdown();
 
+/// Saves or restores the IR event and shared memory
+void DoState(PointerWrap& p);
+
 } // namespace IR
 } // namespace Service
@@ -2,6 +2,7 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include "common/chunk_file.h"
 #include "common/logging/log.h"
 
 #include "core/hle/hle.h"
@@ -105,6 +106,10 @@ static void Initialize(Service::Interface* self) {
                 unk1, unk2, value, handle);
 }
 
+void DoState(PointerWrap& p) {
+    Kernel::DoObjectReference(p, handle_event);
+}
+
 const Interface::FunctionInfo FunctionTable[] = {
     {0x00030000, Shutdown,                  "Shutdown"},
     {0x000F0404, RecvBeaconBroadcastData,   "RecvBeaconBroadcastData"},
@@ -6,6 +6,8 @@
 
 #include "core/hle/service/service.h"
 
+class PointerWrap;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Namespace NWM_UDS
 
@@ -22,4 +24,7 @@ public:
     }
 };
 
+/// Saves or restores the event handed out by Initialize
+void DoState(PointerWrap& p);
+
 } // namespace
@@ -2,9 +2,15 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+
+#include "common/chunk_file.h"
 #include "common/logging/log.h"
+#include "common/perf_counters.h"
+#include "common/profiler.h"
 #include "common/string_util.h"
 
+#include "core/ipc_recording.h"
 #include "core/hle/service/service.h"
 #include "core/hle/service/ac_u.h"
 #include "core/hle/service/act_u.h"
@@ -51,6 +57,13 @@ namespace Service {
 std::unordered_map<std::string, Kernel::SharedPtr<Interface>> g_kernel_named_ports;
 std::unordered_map<std::string, Kernel::SharedPtr<Interface>> g_srv_services;
 
+/// Command ids below this are looked up in a direct table, the others with a binary search
+static const u32 MAX_DIRECT_COMMAND_ID = 0x1000;
+
+static Common::Profiling::TimingCategory profiler_service("Service Calls");
+
+static Common::Perf::Counter service_calls_counter("Service calls");
+
 /**
  * Creates a function string for logging, complete with the name (or header code, depending
  * on what's passed in) the port name, and all the cmd_buff arguments.
@@ -66,31 +79,86 @@ static std::string MakeFunctionString(const char* name, const char* port_name, c
     return function_string;
 }
 
+Interface::RegisteredFunction* Interface::FindFunction(u32 header) {
+    const u32 command_id = header >> 16;
+    if (command_id < m_function_table.size()) {
+        RegisteredFunction* function = m_function_table[command_id];
+        if (function != nullptr && function->info.id == header)
+            return function;
+    }
+
+    // Headers with the same command id but other parameter counts, and large command ids
+    auto itr = std::lower_bound(m_functions.begin(), m_functions.end(), header,
+            [](const RegisteredFunction& function, u32 id) { return function.info.id < id; });
+    if (itr != m_functions.end() && itr->info.id == header)
+        return &*itr;
+    return nullptr;
+}
+
 ResultVal<bool> Interface::SyncRequest() {
     u32* cmd_buff = Kernel::GetCommandBuffer();
-    auto itr = m_functions.find(cmd_buff[0]);
+    RegisteredFunction* function = FindFunction(cmd_buff[0]);
 
-    if (itr == m_functions.end() || itr->second.func == nullptr) {
-        std::string function_name = (itr == m_functions.end()) ? Common::StringFromFormat("0x%08X", cmd_buff[0]) : itr->second.name;
+    if (function == nullptr || function->info.func == nullptr) {
+        std::string function_name = (function == nullptr) ? Common::StringFromFormat("0x%08X", cmd_buff[0]) : function->info.name;
         LOG_ERROR(Service, "unknown / unimplemented %s", MakeFunctionString(function_name.c_str(), GetPortName().c_str(), cmd_buff).c_str());
 
         // TODO(bunnei): Hack - ignore error
         cmd_buff[1] = 0;
         return MakeResult<bool>(false);
     } else {
-        LOG_TRACE(Service, "%s", MakeFunctionString(itr->second.name, GetPortName().c_str(), cmd_buff).c_str());
+        LOG_TRACE(Service, "%s", MakeFunctionString(function->info.name, GetPortName().c_str(), cmd_buff).c_str());
+    }
+
+    Common::Profiling::ScopeTimer timer_service(profiler_service);
+    const Common::Profiling::Clock::time_point start = Common::Profiling::Clock::now();
+
+    {
+        IPCRecording::ScopedCall recorded_call(this, GetPortName().c_str());
+        function->info.func(this);
     }
 
-    itr->second.func(this);
+    function->time += Common::Profiling::Clock::now() - start;
+    ++function->calls;
+    service_calls_counter.Add();
 
     return MakeResult<bool>(false); // TODO: Implement return from actual function
 }
 
+std::vector<Interface::FunctionStatistics> Interface::GetFunctionStatistics() const {
+    std::vector<FunctionStatistics> statistics;
+    statistics.reserve(m_functions.size());
+    for (const RegisteredFunction& function : m_functions) {
+        FunctionStatistics entry = { function.info.name, function.calls, function.time };
+        statistics.push_back(entry);
+    }
+    return statistics;
+}
+
 void Interface::Register(const FunctionInfo* functions, size_t n) {
-    m_functions.reserve(n);
+    m_functions.reserve(m_functions.size() + n);
     for (size_t i = 0; i < n; ++i) {
-        // Usually this array is sorted by id already, so hint to instead at the end
-        m_functions.emplace_hint(m_functions.cend(), functions[i].id, functions[i]);
+        RegisteredFunction function = { functions[i], 0, Common::Profiling::Duration::zero() };
+        m_functions.push_back(function);
+    }
+    // Usually the array is sorted by id already. Of duplicate ids, the first registered one stays.
+    std::stable_sort(m_functions.begin(), m_functions.end(),
+            [](const RegisteredFunction& a, const RegisteredFunction& b) { return a.info.id < b.info.id; });
+    auto last = std::unique(m_functions.begin(), m_functions.end(),
+            [](const RegisteredFunction& a, const RegisteredFunction& b) { return a.info.id == b.info.id; });
+    m_functions.erase(last, m_functions.end());
+
+    // Build the direct table, it points into m_functions so it has to be rebuilt along with it
+    m_function_table.clear();
+    for (RegisteredFunction& function : m_functions) {
+        const u32 command_id = function.info.id >> 16;
+        if (command_id >= MAX_DIRECT_COMMAND_ID)
+            break;
+        if (command_id >= m_function_table.size())
+            m_function_table.resize(command_id + 1, nullptr);
+        // Of several headers with the same command id, the table holds the first one
+        if (m_function_table[command_id] == nullptr)
+            m_function_table[command_id] = &function;
     }
 }
 
@@ -151,8 +219,42 @@ void Init() {
     LOG_DEBUG(Service, "initialized OK");
 }
 
+/// Logs the service functions that took the most host time
+static void LogFunctionStatistics() {
+    struct Entry {
+        std::string port_name;
+        Interface::FunctionStatistics statistics;
+    };
+    std::vector<Entry> entries;
+
+    auto add_entries = [&entries](const std::unordered_map<std::string, Kernel::SharedPtr<Interface>>& services) {
+        for (const auto& service : services) {
+            for (const auto& statistics : service.second->GetFunctionStatistics()) {
+                if (statistics.calls != 0)
+                    entries.push_back({ service.first, statistics });
+            }
+        }
+    };
+    add_entries(g_kernel_named_ports);
+    add_entries(g_srv_services);
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.statistics.time > b.statistics.time;
+    });
+
+    const size_t num_logged = std::min<size_t>(entries.size(), 10);
+    for (size_t i = 0; i < num_logged; ++i) {
+        const Entry& entry = entries[i];
+        const auto time_us = std::chrono::duration_cast<std::chrono::microseconds>(entry.statistics.time);
+        LOG_INFO(Service, "%s::%s: %llu calls, %llu us", entry.port_name.c_str(), entry.statistics.name,
+                 (unsigned long long)entry.statistics.calls, (unsigned long long)time_us.count());
+    }
+}
+
 /// Shutdown ServiceManager
 void Shutdown() {
+    LogFunctionStatistics();
+
     Service::IR::Shutdown();
     Service::HID::Shutdown();
     Service::PTM::Shutdown();
@@ -165,5 +267,17 @@ void Shutdown() {
     LOG_DEBUG(Service, "shutdown OK");
 }
 
+void DoState(PointerWrap& p) {
+    Service::APT::DoState(p);
+    Service::HID::DoState(p);
+    Service::IR::DoState(p);
+    DSP_DSP::DoState(p);
+    GSP_GPU::DoState(p);
+    NWM_UDS::DoState(p);
+    SRV::DoState(p);
+    Y2R_U::DoState(p);
+    p.DoMarker("Service");
+}
+
 
 }
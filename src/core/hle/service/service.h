@@ -6,14 +6,16 @@
 
 #include <string>
 #include <unordered_map>
-
-#include <boost/container/flat_map.hpp>
+#include <vector>
 
 #include "common/common_types.h"
+#include "common/profiler.h"
 
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/kernel/session.h"
 
+class PointerWrap;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Namespace Service
 
@@ -37,6 +39,13 @@ public:
         const char* name;
     };
 
+    /// Number of calls to a registered function and the host time spent in them
+    struct FunctionStatistics {
+        const char* name;
+        u64 calls;
+        Common::Profiling::Duration time;
+    };
+
     /**
      * Gets the string name used by CTROS for a service
      * @return Port name of service
@@ -47,6 +56,9 @@ public:
 
     ResultVal<bool> SyncRequest() override;
 
+    /// Returns the call statistics of all registered functions, in order of their command header
+    std::vector<FunctionStatistics> GetFunctionStatistics() const;
+
 protected:
 
     /**
@@ -60,7 +72,19 @@ protected:
     void Register(const FunctionInfo* functions, size_t n);
 
 private:
-    boost::container::flat_map<u32, FunctionInfo> m_functions;
+    struct RegisteredFunction {
+        FunctionInfo info;
+        u64 calls;
+        Common::Profiling::Duration time;
+    };
+
+    /// Looks up the function for a command header, nullptr if there is none
+    RegisteredFunction* FindFunction(u32 header);
+
+    /// Registered functions, sorted by command header
+    std::vector<RegisteredFunction> m_functions;
+    /// Function for each command id (the upper half of the header), nullptr for ids without one
+    std::vector<RegisteredFunction*> m_function_table;
 
 };
 
@@ -78,4 +102,12 @@ extern std::unordered_map<std::string, Kernel::SharedPtr<Interface>> g_srv_servi
 /// Adds a service to the services table
 void AddService(Interface* interface_);
 
+/**
+ * Saves or restores the state of the services, after the kernel objects they refer to. The
+ * interfaces themselves are found again by their object ids, they hold no state of their own.
+ * Every service with state has a DoState of its own, which saves its kernel objects as references
+ * with Kernel::DoObjectReference and only restores state that Init doesn't set up again.
+ */
+void DoState(PointerWrap& p);
+
 } // namespace
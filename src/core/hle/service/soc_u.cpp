@@ -30,10 +30,25 @@
 #include <poll.h>
 #endif
 
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common/make_unique.h"
 #include "common/scope_exit.h"
+#include "common/thread_policy.h"
+#include "core/core_timing.h"
 #include "core/hle/hle.h"
+#include "core/hle/kernel/session.h"
+#include "core/hle/kernel/thread.h"
 #include "core/hle/service/soc_u.h"
-#include <unordered_map>
+#include "core/memory.h"
 
 #if EMU_PLATFORM == PLATFORM_WINDOWS
 #    define WSAEAGAIN      WSAEWOULDBLOCK
@@ -146,7 +161,7 @@ static int TranslateError(int error) {
 /// Holds information about a particular socket
 struct SocketHolder {
     u32 socket_fd; ///< The socket descriptor
-    bool blocking; ///< Whether the socket is blocking or not, it is only read on Windows.
+    bool blocking; ///< Whether the socket is blocking for the guest, host sockets never are
 };
 
 /// Structure to represent the 3ds' pollfd structure, which is different than most implementations
@@ -297,6 +312,254 @@ static void CleanupSockets() {
     open_sockets.clear();
 }
 
+/// Sets a host socket non-blocking, blocking guest operations wait on the event loop instead
+static void SetNonBlocking(u32 socket_handle) {
+#if EMU_PLATFORM == PLATFORM_WINDOWS
+    unsigned long non_blocking = 1;
+    ioctlsocket(socket_handle, FIONBIO, &non_blocking);
+#else
+    int flags = ::fcntl(socket_handle, F_GETFL, 0);
+    if (flags != SOCKET_ERROR_VALUE)
+        ::fcntl(socket_handle, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+/// Whether the guest expects operations on a socket to block
+static bool IsBlocking(u32 socket_handle) {
+    auto iter = open_sockets.find(socket_handle);
+    return iter != open_sockets.end() && iter->second.blocking;
+}
+
+/// Whether a host error means that a non-blocking operation would have had to wait
+static bool WouldBlock(int error) {
+    return error == ERRNO(EAGAIN) || error == ERRNO(EWOULDBLOCK) || error == ERRNO(EINPROGRESS);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Event loop
+//
+// Guest threads doing a blocking operation sleep while a host thread polls their sockets. Once a
+// socket is ready a CoreTiming event retries the operation on the CPU thread, writes the reply to
+// the command buffer of the guest thread and wakes it up.
+
+/**
+ * Performs an operation with the parameters in a command buffer, writing the reply to it.
+ * @param timed_out Whether the timeout of the wait ran out
+ * @return False if the operation has to wait for its sockets again, nothing is written then
+ */
+using SocketOperation = std::function<bool(u32* cmd_buffer, bool timed_out)>;
+
+struct PendingOperation {
+    Kernel::SharedPtr<Kernel::Thread> thread;
+    /// Sockets and events the operation waits for
+    std::vector<pollfd> fds;
+    bool has_deadline;
+    std::chrono::steady_clock::time_point deadline;
+    SocketOperation operation;
+    bool timed_out;
+};
+
+static std::unique_ptr<std::thread> event_thread;
+static std::mutex event_mutex;
+static std::condition_variable operations_available;
+static std::list<std::unique_ptr<PendingOperation>> pending_operations;
+static std::list<std::unique_ptr<PendingOperation>> ready_operations;
+static bool event_loop_stopping = false;
+
+/// UDP socket connected to itself, sending to it interrupts the poll of the event loop
+static u32 wakeup_socket = static_cast<u32>(SOCKET_ERROR_VALUE);
+
+static int operations_ready_event;
+
+static void WakeUpEventLoop() {
+    const char byte = 0;
+    ::send(wakeup_socket, &byte, 1, 0);
+}
+
+static void EventLoop() {
+    Common::RegisterCurrentThread("SocketEventLoop", Common::ThreadClass::Worker);
+
+    std::vector<pollfd> fds;
+    std::unique_lock<std::mutex> lock(event_mutex);
+    while (true) {
+        operations_available.wait(lock, [] { return !pending_operations.empty() || event_loop_stopping; });
+        if (event_loop_stopping)
+            break;
+
+        // Poll the sockets of all operations at once, until the nearest deadline
+        fds.clear();
+        fds.push_back({ static_cast<decltype(pollfd().fd)>(wakeup_socket), POLLIN, 0 });
+        const size_t polled_operations = pending_operations.size();
+        bool has_deadline = false;
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        for (auto& op : pending_operations) {
+            fds.insert(fds.end(), op->fds.begin(), op->fds.end());
+            if (op->has_deadline) {
+                has_deadline = true;
+                deadline = std::min(deadline, op->deadline);
+            }
+        }
+        int timeout = -1;
+        if (has_deadline) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            timeout = static_cast<int>(std::max<std::chrono::milliseconds::rep>(remaining.count(), 0));
+        }
+
+        lock.unlock();
+        ::poll(fds.data(), static_cast<unsigned long>(fds.size()), timeout);
+        if (fds[0].revents & POLLIN) {
+            char buffer[64];
+            while (::recv(wakeup_socket, buffer, sizeof(buffer), 0) > 0) {}
+        }
+        lock.lock();
+
+        // Operations queued while polling aren't in the array yet, they are only checked next time
+        const auto now = std::chrono::steady_clock::now();
+        size_t fd_index = 1;
+        bool any_ready = false;
+        auto it = pending_operations.begin();
+        for (size_t polled = 0; polled < polled_operations; ++polled) {
+            PendingOperation& op = **it;
+            bool ready = false;
+            for (size_t i = 0; i < op.fds.size(); ++i)
+                ready = ready || fds[fd_index + i].revents != 0;
+            fd_index += op.fds.size();
+
+            op.timed_out = !ready && op.has_deadline && now >= op.deadline;
+            if (ready || op.timed_out) {
+                ready_operations.push_back(std::move(*it));
+                it = pending_operations.erase(it);
+                any_ready = true;
+            } else {
+                ++it;
+            }
+        }
+
+        if (any_ready)
+            CoreTiming::ScheduleEvent_Threadsafe(0, operations_ready_event);
+    }
+}
+
+/// Queues an operation for the event loop, taking ownership of it
+static void QueueOperation(std::unique_ptr<PendingOperation> op) {
+    {
+        std::lock_guard<std::mutex> lock(event_mutex);
+        pending_operations.push_back(std::move(op));
+    }
+    operations_available.notify_one();
+    WakeUpEventLoop();
+}
+
+/// Retries the operations whose sockets are ready, on the CPU thread
+static void CompleteOperations(u64 userdata, int cycles_late) {
+    std::list<std::unique_ptr<PendingOperation>> operations;
+    {
+        std::lock_guard<std::mutex> lock(event_mutex);
+        operations.swap(ready_operations);
+    }
+
+    for (auto& op : operations) {
+        if (op->operation(op->thread->command_buffer, op->timed_out)) {
+            op->thread->ResumeFromWait();
+        } else {
+            // Woken up spuriously, e.g. another thread read the data first
+            QueueOperation(std::move(op));
+        }
+    }
+}
+
+static bool StartEventLoop() {
+    if (event_thread != nullptr)
+        return true;
+
+    // Loopback socket bound to an ephemeral port, poll() on it works on every platform
+    wakeup_socket = static_cast<u32>(::socket(AF_INET, SOCK_DGRAM, 0));
+    if ((s32)wakeup_socket == SOCKET_ERROR_VALUE) {
+        LOG_ERROR(Service_SOC, "Unable to create the wakeup socket of the event loop");
+        return false;
+    }
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addr_len = sizeof(addr);
+    if (::bind(wakeup_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::getsockname(wakeup_socket, reinterpret_cast<sockaddr*>(&addr), &addr_len) != 0 ||
+        ::connect(wakeup_socket, reinterpret_cast<sockaddr*>(&addr), addr_len) != 0) {
+        LOG_ERROR(Service_SOC, "Unable to set up the wakeup socket of the event loop");
+        closesocket(wakeup_socket);
+        wakeup_socket = static_cast<u32>(SOCKET_ERROR_VALUE);
+        return false;
+    }
+    SetNonBlocking(wakeup_socket);
+
+    event_loop_stopping = false;
+    event_thread = Common::make_unique<std::thread>(EventLoop);
+    return true;
+}
+
+static void StopEventLoop() {
+    if (event_thread == nullptr)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(event_mutex);
+        event_loop_stopping = true;
+    }
+    operations_available.notify_one();
+    WakeUpEventLoop();
+    event_thread->join();
+    event_thread.reset();
+
+    closesocket(wakeup_socket);
+    wakeup_socket = static_cast<u32>(SOCKET_ERROR_VALUE);
+    pending_operations.clear();
+    ready_operations.clear();
+}
+
+/**
+ * Puts the current guest thread to sleep until one of the given sockets is ready or the timeout
+ * runs out, then retries the operation
+ * @param timeout Timeout in milliseconds, negative to wait indefinitely
+ * @return False if the event loop couldn't be started, the thread isn't put to sleep then
+ */
+static bool WaitForSockets(std::vector<pollfd> fds, int timeout, SocketOperation operation) {
+    if (!StartEventLoop())
+        return false;
+
+    auto op = Common::make_unique<PendingOperation>();
+    op->thread = Kernel::GetCurrentThread();
+    op->fds = std::move(fds);
+    op->has_deadline = timeout >= 0;
+    op->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeout, 0));
+    op->operation = std::move(operation);
+    op->timed_out = false;
+    QueueOperation(std::move(op));
+
+    Kernel::WaitCurrentThread_Sleep();
+    return true;
+}
+
+/**
+ * Runs an operation on a socket, putting the current guest thread to sleep until it can be
+ * retried if the operation would block.
+ * @param operation Returns false if it would block, without writing a reply
+ * @param events Events of the socket the operation waits for
+ */
+static void RunBlockingOperation(u32 socket_handle, short events, bool (*operation)(u32* cmd_buffer)) {
+    u32* cmd_buffer = Kernel::GetCommandBuffer();
+    if (operation(cmd_buffer))
+        return;
+
+    pollfd fd = {};
+    fd.fd = socket_handle;
+    fd.events = events;
+    if (!WaitForSockets({ fd }, -1, [operation](u32* cmd_buffer, bool) { return operation(cmd_buffer); })) {
+        cmd_buffer[1] = TranslateError(ERRNO(EWOULDBLOCK));
+        cmd_buffer[2] = static_cast<u32>(SOCKET_ERROR_VALUE);
+    }
+}
+
 static void Socket(Service::Interface* self) {
     u32* cmd_buffer = Kernel::GetCommandBuffer();
     u32 domain = cmd_buffer[1]; // Address family
@@ -321,13 +584,15 @@ static void Socket(Service::Interface* self) {
 
     u32 socket_handle = static_cast<u32>(::socket(domain, type, protocol));
 
-    if ((s32)socket_handle != SOCKET_ERROR_VALUE)
-        open_sockets[socket_handle] = { socket_handle, true };
-
     int result = 0;
     if ((s32)socket_handle == SOCKET_ERROR_VALUE)
         result = TranslateError(GET_ERRNO);
 
+    if ((s32)socket_handle != SOCKET_ERROR_VALUE) {
+        SetNonBlocking(socket_handle);
+        open_sockets[socket_handle] = { socket_handle, true };
+    }
+
     cmd_buffer[1] = result;
     cmd_buffer[2] = socket_handle;
 }
@@ -368,54 +633,20 @@ static void Fcntl(Service::Interface* self) {
             cmd_buffer[2] = posix_ret;
     });
 
+    // Host sockets are always non-blocking, only the mode the guest sees changes
+    auto iter = open_sockets.find(socket_handle);
+    if (iter == open_sockets.end() && (ctr_cmd == 3 || ctr_cmd == 4)) {
+        result = TranslateError(ERRNO(EBADF));
+        posix_ret = -1;
+        return;
+    }
+
     if (ctr_cmd == 3) { // F_GETFL
-#if EMU_PLATFORM == PLATFORM_WINDOWS
         posix_ret = 0;
-        auto iter = open_sockets.find(socket_handle);
-        if (iter != open_sockets.end() && iter->second.blocking == false)
+        if (!iter->second.blocking)
             posix_ret |= 4; // O_NONBLOCK
-#else
-        int ret = ::fcntl(socket_handle, F_GETFL, 0);
-        if (ret == SOCKET_ERROR_VALUE) {
-            result = TranslateError(GET_ERRNO);
-            posix_ret = -1;
-            return;
-        }
-        posix_ret = 0;
-        if (ret & O_NONBLOCK)
-            posix_ret |= 4; // O_NONBLOCK
-#endif
     } else if (ctr_cmd == 4) { // F_SETFL
-#if EMU_PLATFORM == PLATFORM_WINDOWS
-        unsigned long tmp = (ctr_arg & 4 /* O_NONBLOCK */) ? 1 : 0;
-        int ret = ioctlsocket(socket_handle, FIONBIO, &tmp);
-        if (ret == SOCKET_ERROR_VALUE) {
-            result = TranslateError(GET_ERRNO);
-            posix_ret = -1;
-            return;
-        }
-        auto iter = open_sockets.find(socket_handle);
-        if (iter != open_sockets.end())
-            iter->second.blocking = (tmp == 0);
-#else
-        int flags = ::fcntl(socket_handle, F_GETFL, 0);
-        if (flags == SOCKET_ERROR_VALUE) {
-            result = TranslateError(GET_ERRNO);
-            posix_ret = -1;
-            return;
-        }
-
-        flags &= ~O_NONBLOCK;
-        if (ctr_arg & 4) // O_NONBLOCK
-            flags |= O_NONBLOCK;
-
-        int ret = ::fcntl(socket_handle, F_SETFL, flags);
-        if (ret == SOCKET_ERROR_VALUE) {
-            result = TranslateError(GET_ERRNO);
-            posix_ret = -1;
-            return;
-        }
-#endif
+        iter->second.blocking = (ctr_arg & 4 /* O_NONBLOCK */) == 0;
     } else {
         LOG_ERROR(Service_SOC, "Unsupported command (%d) in fcntl call", ctr_cmd);
         result = TranslateError(EINVAL); // TODO: Find the correct error
@@ -438,30 +669,35 @@ static void Listen(Service::Interface* self) {
     cmd_buffer[1] = result;
 }
 
-static void Accept(Service::Interface* self) {
-    // TODO(Subv): Calling this function on a blocking socket will block the emu thread,
-    // preventing graceful shutdown when closing the emulator, this can be fixed by always
-    // performing nonblocking operations and spinlock until the data is available
-    u32* cmd_buffer = Kernel::GetCommandBuffer();
+static bool AcceptImpl(u32* cmd_buffer) {
     u32 socket_handle = cmd_buffer[1];
     socklen_t max_addr_len = static_cast<socklen_t>(cmd_buffer[2]);
     sockaddr addr;
     socklen_t addr_len = sizeof(addr);
     u32 ret = static_cast<u32>(::accept(socket_handle, &addr, &addr_len));
 
-    if ((s32)ret != SOCKET_ERROR_VALUE)
-        open_sockets[ret] = { ret, true };
-
     int result = 0;
     if ((s32)ret == SOCKET_ERROR_VALUE) {
-        result = TranslateError(GET_ERRNO);
+        int error = GET_ERRNO;
+        if (WouldBlock(error) && IsBlocking(socket_handle))
+            return false;
+        result = TranslateError(error);
     } else {
+        SetNonBlocking(ret);
+        open_sockets[ret] = { ret, true };
+
         CTRSockAddr ctr_addr = CTRSockAddr::FromPlatform(addr);
         Memory::WriteBlock(cmd_buffer[0x104 >> 2], (const u8*)&ctr_addr, max_addr_len);
     }
 
     cmd_buffer[2] = ret;
     cmd_buffer[1] = result;
+    return true;
+}
+
+static void Accept(Service::Interface* self) {
+    u32* cmd_buffer = Kernel::GetCommandBuffer();
+    RunBlockingOperation(cmd_buffer[1], POLLIN, AcceptImpl);
 }
 
 static void GetHostId(Service::Interface* self) {
@@ -493,51 +729,63 @@ static void Close(Service::Interface* self) {
     cmd_buffer[1] = result;
 }
 
-static void SendTo(Service::Interface* self) {
-    u32* cmd_buffer = Kernel::GetCommandBuffer();
+static bool SendToImpl(u32* cmd_buffer) {
     u32 socket_handle = cmd_buffer[1];
     u32 len = cmd_buffer[2];
     u32 flags = cmd_buffer[3];
     u32 addr_len = cmd_buffer[4];
 
-    u8* input_buff = Memory::GetPointer(cmd_buffer[8]);
+    std::vector<u8> input_buff(len);
+    Memory::ReadBlock(cmd_buffer[8], input_buff.data(), len);
     CTRSockAddr* ctr_dest_addr = reinterpret_cast<CTRSockAddr*>(Memory::GetPointer(cmd_buffer[10]));
 
     if (ctr_dest_addr == nullptr) {
         cmd_buffer[1] = -1; // TODO(Subv): Find the right error code
-        return;
+        return true;
     }
 
     int ret = -1;
     if (addr_len > 0) {
         sockaddr dest_addr = CTRSockAddr::ToPlatform(*ctr_dest_addr);
-        ret = ::sendto(socket_handle, (const char*)input_buff, len, flags, &dest_addr, sizeof(dest_addr));
+        ret = ::sendto(socket_handle, (const char*)input_buff.data(), len, flags, &dest_addr, sizeof(dest_addr));
     } else {
-        ret = ::sendto(socket_handle, (const char*)input_buff, len, flags, nullptr, 0);
+        ret = ::sendto(socket_handle, (const char*)input_buff.data(), len, flags, nullptr, 0);
     }
 
     int result = 0;
-    if (ret == SOCKET_ERROR_VALUE)
-        result = TranslateError(GET_ERRNO);
+    if (ret == SOCKET_ERROR_VALUE) {
+        int error = GET_ERRNO;
+        if (WouldBlock(error) && IsBlocking(socket_handle))
+            return false;
+        result = TranslateError(error);
+    }
 
     cmd_buffer[2] = ret;
     cmd_buffer[1] = result;
+    return true;
 }
 
-static void RecvFrom(Service::Interface* self) {
-    // TODO(Subv): Calling this function on a blocking socket will block the emu thread,
-    // preventing graceful shutdown when closing the emulator, this can be fixed by always
-    // performing nonblocking operations and spinlock until the data is available
+static void SendTo(Service::Interface* self) {
     u32* cmd_buffer = Kernel::GetCommandBuffer();
+    RunBlockingOperation(cmd_buffer[1], POLLOUT, SendToImpl);
+}
+
+static bool RecvFromImpl(u32* cmd_buffer) {
     u32 socket_handle = cmd_buffer[1];
     u32 len = cmd_buffer[2];
     u32 flags = cmd_buffer[3];
     socklen_t addr_len = static_cast<socklen_t>(cmd_buffer[4]);
 
-    u8* output_buff = Memory::GetPointer(cmd_buffer[0x104 >> 2]);
+    std::vector<u8> output_buff(len);
     sockaddr src_addr;
     socklen_t src_addr_len = sizeof(src_addr);
-    int ret = ::recvfrom(socket_handle, (char*)output_buff, len, flags, &src_addr, &src_addr_len);
+    int ret = ::recvfrom(socket_handle, (char*)output_buff.data(), len, flags, &src_addr, &src_addr_len);
+    int error = ret == SOCKET_ERROR_VALUE ? GET_ERRNO : 0;
+    if (ret == SOCKET_ERROR_VALUE && WouldBlock(error) && IsBlocking(socket_handle))
+        return false;
+
+    if (ret > 0)
+        Memory::WriteBlock(cmd_buffer[0x104 >> 2], output_buff.data(), ret);
 
     if (cmd_buffer[0x1A0 >> 2] != 0) {
         CTRSockAddr* ctr_src_addr = reinterpret_cast<CTRSockAddr*>(Memory::GetPointer(cmd_buffer[0x1A0 >> 2]));
@@ -547,42 +795,71 @@ static void RecvFrom(Service::Interface* self) {
     int result = 0;
     int total_received = ret;
     if (ret == SOCKET_ERROR_VALUE) {
-        result = TranslateError(GET_ERRNO);
+        result = TranslateError(error);
         total_received = 0;
     }
 
     cmd_buffer[1] = result;
     cmd_buffer[2] = ret;
     cmd_buffer[3] = total_received;
+    return true;
 }
 
-static void Poll(Service::Interface* self) {
+static void RecvFrom(Service::Interface* self) {
     u32* cmd_buffer = Kernel::GetCommandBuffer();
+    RunBlockingOperation(cmd_buffer[1], POLLIN, RecvFromImpl);
+}
+
+/**
+ * Polls the sockets of a Poll command without waiting
+ * @return False if no socket is ready and the guest wants to wait, nothing is written then
+ */
+static bool PollImpl(u32* cmd_buffer, bool may_wait) {
     u32 nfds = cmd_buffer[1];
-    int timeout = cmd_buffer[2];
     CTRPollFD* input_fds = reinterpret_cast<CTRPollFD*>(Memory::GetPointer(cmd_buffer[6]));
     CTRPollFD* output_fds = reinterpret_cast<CTRPollFD*>(Memory::GetPointer(cmd_buffer[0x104 >> 2]));
 
     // The 3ds_pollfd and the pollfd structures may be different (Windows/Linux have different sizes)
     // so we have to copy the data
-    pollfd* platform_pollfd = new pollfd[nfds];
+    std::vector<pollfd> platform_pollfd(nfds);
     for (unsigned current_fds = 0; current_fds < nfds; ++current_fds)
         platform_pollfd[current_fds] = CTRPollFD::ToPlatform(input_fds[current_fds]);
 
-    int ret = ::poll(platform_pollfd, nfds, timeout);
+    int ret = ::poll(platform_pollfd.data(), nfds, 0);
+    if (ret == 0 && may_wait)
+        return false;
 
     // Now update the output pollfd structure
     for (unsigned current_fds = 0; current_fds < nfds; ++current_fds)
         output_fds[current_fds] = CTRPollFD::FromPlatform(platform_pollfd[current_fds]);
 
-    delete[] platform_pollfd;
-
     int result = 0;
     if (ret == SOCKET_ERROR_VALUE)
         result = TranslateError(GET_ERRNO);
 
     cmd_buffer[1] = result;
     cmd_buffer[2] = ret;
+    return true;
+}
+
+static void Poll(Service::Interface* self) {
+    u32* cmd_buffer = Kernel::GetCommandBuffer();
+    int timeout = cmd_buffer[2];
+    if (PollImpl(cmd_buffer, timeout != 0))
+        return;
+
+    // Nothing is ready yet, sleep until something is or the timeout runs out
+    u32 nfds = cmd_buffer[1];
+    CTRPollFD* input_fds = reinterpret_cast<CTRPollFD*>(Memory::GetPointer(cmd_buffer[6]));
+    std::vector<pollfd> fds(nfds);
+    for (unsigned current_fds = 0; current_fds < nfds; ++current_fds)
+        fds[current_fds] = CTRPollFD::ToPlatform(input_fds[current_fds]);
+
+    if (!WaitForSockets(std::move(fds), timeout, [](u32* cmd_buffer, bool timed_out) {
+            return PollImpl(cmd_buffer, !timed_out);
+        })) {
+        PollImpl(cmd_buffer, false);
+    }
 }
 
 static void GetSockName(Service::Interface* self) {
@@ -650,10 +927,22 @@ static void GetPeerName(Service::Interface* self) {
     cmd_buffer[1] = result;
 }
 
+/// Reports the outcome of a connection that was in progress, once its socket is writable
+static bool FinishConnect(u32* cmd_buffer, bool timed_out) {
+    u32 socket_handle = cmd_buffer[1];
+
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    int ret = ::getsockopt(socket_handle, SOL_SOCKET, SO_ERROR, (char*)&error, &error_len);
+    if (ret != 0)
+        error = GET_ERRNO;
+
+    cmd_buffer[2] = error == 0 ? 0 : SOCKET_ERROR_VALUE;
+    cmd_buffer[1] = error == 0 ? 0 : TranslateError(error);
+    return true;
+}
+
 static void Connect(Service::Interface* self) {
-    // TODO(Subv): Calling this function on a blocking socket will block the emu thread,
-    // preventing graceful shutdown when closing the emulator, this can be fixed by always
-    // performing nonblocking operations and spinlock until the data is available
     u32* cmd_buffer = Kernel::GetCommandBuffer();
     u32 socket_handle = cmd_buffer[1];
     socklen_t len = cmd_buffer[2];
@@ -667,8 +956,17 @@ static void Connect(Service::Interface* self) {
     sockaddr input_addr = CTRSockAddr::ToPlatform(*ctr_input_addr);
     int ret = ::connect(socket_handle, &input_addr, sizeof(input_addr));
     int result = 0;
-    if (ret != 0)
-        result = TranslateError(GET_ERRNO);
+    if (ret != 0) {
+        int error = GET_ERRNO;
+        if (WouldBlock(error) && IsBlocking(socket_handle)) {
+            pollfd fd = {};
+            fd.fd = socket_handle;
+            fd.events = POLLOUT;
+            if (WaitForSockets({ fd }, -1, FinishConnect))
+                return;
+        }
+        result = TranslateError(error);
+    }
     cmd_buffer[2] = ret;
     cmd_buffer[1] = result;
 }
@@ -730,14 +1028,21 @@ const Interface::FunctionInfo FunctionTable[] = {
     {0x00210002, nullptr,                       "CloseSockets"},
 };
 
+bool HasPendingOperations() {
+    std::lock_guard<std::mutex> lock(event_mutex);
+    return !pending_operations.empty() || !ready_operations.empty();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Interface class
 
 Interface::Interface() {
+    operations_ready_event = CoreTiming::RegisterEvent("SOC_U::CompleteOperations", CompleteOperations);
     Register(FunctionTable);
 }
 
 Interface::~Interface() {
+    StopEventLoop();
     CleanupSockets();
 #if EMU_PLATFORM == PLATFORM_WINDOWS
     WSACleanup();
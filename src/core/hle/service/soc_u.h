@@ -21,4 +21,7 @@ public:
     }
 };
 
+/// Whether any guest thread is waiting for a socket operation, or the event loop is about to wake it
+bool HasPendingOperations();
+
 } // namespace
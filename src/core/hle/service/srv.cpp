@@ -2,9 +2,13 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <cstring>
+
+#include "common/chunk_file.h"
 #include "common/logging/log.h"
 
 #include "core/hle/hle.h"
+#include "core/hle/ipc_helpers.h"
 #include "core/hle/service/srv.h"
 #include "core/hle/kernel/event.h"
 
@@ -16,37 +20,48 @@ namespace SRV {
 static Kernel::SharedPtr<Kernel::Event> event_handle;
 
 static void Initialize(Service::Interface* self) {
-    u32* cmd_buff = Kernel::GetCommandBuffer();
+    IPC::RequestParser rp(Kernel::GetCommandBuffer(), 0x00010002);
 
-    cmd_buff[1] = 0; // No error
+    IPC::ResponseBuilder rb = rp.MakeBuilder(1, 0);
+    rb.Push(RESULT_SUCCESS);
 }
 
 static void GetProcSemaphore(Service::Interface* self) {
-    u32* cmd_buff = Kernel::GetCommandBuffer();
+    IPC::RequestParser rp(Kernel::GetCommandBuffer(), 0x00020000);
 
     // TODO(bunnei): Change to a semaphore once these have been implemented
     event_handle = Kernel::Event::Create(RESETTYPE_ONESHOT, "SRV:Event");
     event_handle->Clear();
 
-    cmd_buff[1] = 0; // No error
-    cmd_buff[3] = Kernel::g_handle_table.Create(event_handle).MoveFrom();
+    IPC::ResponseBuilder rb = rp.MakeBuilder(1, 2);
+    rb.Push(RESULT_SUCCESS);
+    rb.PushCopyHandle(Kernel::g_handle_table.Create(event_handle).MoveFrom());
 }
 
 static void GetServiceHandle(Service::Interface* self) {
-    ResultCode res = RESULT_SUCCESS;
-    u32* cmd_buff = Kernel::GetCommandBuffer();
+    IPC::RequestParser rp(Kernel::GetCommandBuffer(), 0x00050100);
+    const auto name = rp.Pop<std::array<char, Service::kMaxPortSize>>();
 
-    std::string port_name = std::string((const char*)&cmd_buff[1], 0, Service::kMaxPortSize);
+    std::string port_name(name.data(), strnlen(name.data(), name.size()));
     auto it = Service::g_srv_services.find(port_name);
 
     if (it != Service::g_srv_services.end()) {
-        cmd_buff[3] = Kernel::g_handle_table.Create(it->second).MoveFrom();
-        LOG_TRACE(Service_SRV, "called port=%s, handle=0x%08X", port_name.c_str(), cmd_buff[3]);
+        const Handle handle = Kernel::g_handle_table.Create(it->second).MoveFrom();
+        LOG_TRACE(Service_SRV, "called port=%s, handle=0x%08X", port_name.c_str(), handle);
+
+        IPC::ResponseBuilder rb = rp.MakeBuilder(1, 2);
+        rb.Push(RESULT_SUCCESS);
+        rb.PushMoveHandle(handle);
     } else {
         LOG_ERROR(Service_SRV, "(UNIMPLEMENTED) called port=%s", port_name.c_str());
-        res = UnimplementedFunction(ErrorModule::SRV);
+
+        IPC::ResponseBuilder rb = rp.MakeBuilder(1, 0);
+        rb.Push(UnimplementedFunction(ErrorModule::SRV));
     }
-    cmd_buff[1] = res.raw;
+}
+
+void DoState(PointerWrap& p) {
+    Kernel::DoObjectReference(p, event_handle);
 }
 
 const Interface::FunctionInfo FunctionTable[] = {
@@ -4,6 +4,8 @@
 
 #include "core/hle/service/service.h"
 
+class PointerWrap;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Namespace SRV
 
@@ -19,4 +21,7 @@ public:
     }
 };
 
+/// Saves or restores the event handed out by Initialize
+void DoState(PointerWrap& p);
+
 } // namespace
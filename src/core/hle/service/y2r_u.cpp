@@ -2,16 +2,29 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
 #include <cstring>
+#include <vector>
 
+#include "common/chunk_file.h"
+#include "common/color.h"
 #include "common/logging/log.h"
+#include "common/math_util.h"
+#include "common/platform.h"
+#include "common/vector_math.h"
 
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "core/core_timing.h"
 #include "core/hle/hle.h"
 #include "core/hle/kernel/event.h"
 #include "core/hle/service/y2r_u.h"
 #include "core/mem_map.h"
 #include "core/memory.h"
 
+#include "video_core/gpu_thread.h"
 #include "video_core/utils.h"
 #include "video_core/video_core.h"
 
@@ -28,6 +41,7 @@ enum class InputFormat {
 
     YUV422_INDIV_16 = 2,
     YUV420_INDIV_16 = 3,
+    /// 8-bit input, with the components interleaved as Y0 U Y1 V, sent through the Y buffer.
     YUV422_BATCH = 4,
 };
 
@@ -59,7 +73,37 @@ enum class StandardCoefficient {
     ITU_Rec709_Scaling = 3,
 };
 
+/**
+ * Coefficients of the YUV to RGB conversion, as programmed into the hardware:
+ * the Y multiplier, the V multiplier of R, the V and U multipliers of G, the U multiplier of B and
+ * the offsets added to R, G and B.
+ */
+using CoefficientSet = s16[8];
+
+static const CoefficientSet standard_coefficients[4] = {
+    { 0x100, 0x166, 0xB6, 0x58, 0x1C5, -0x166F, 0x10EE, -0x1C5B }, // ITU_Rec601
+    { 0x100, 0x193, 0x77, 0x2F, 0x1DB, -0x1933,  0xA7C, -0x1D51 }, // ITU_Rec709
+    { 0x12A, 0x198, 0xD0, 0x64, 0x204, -0x1BDE, 0x10F2, -0x229B }, // ITU_Rec601_Scaling
+    { 0x12A, 0x1CA, 0x88, 0x36, 0x21C, -0x1F04,  0x99C, -0x2421 }, // ITU_Rec709_Scaling
+};
+
+/// Estimated conversion throughput of the hardware, a 400x240 frame takes about 1.5ms
+static const u64 CONVERSION_CYCLES_PER_PIXEL = 4;
+
 static Kernel::SharedPtr<Kernel::Event> completion_event;
+static int conversion_done_event;
+static bool conversion_busy = false;
+
+/**
+ * A buffer in guest memory the conversion streams data from or to. It is transferred in units of
+ * `transfer_unit` bytes, which are `gap` bytes apart from each other.
+ */
+struct ConversionBuffer {
+    VAddr address;
+    u32 image_size;
+    u16 transfer_unit;
+    u16 gap;
+};
 
 struct ConversionParameters {
     InputFormat input_format;
@@ -68,22 +112,282 @@ struct ConversionParameters {
     BlockAlignment alignment;
     u16 input_line_width;
     u16 input_lines;
+    CoefficientSet coefficients;
+    u8 alpha;
 
-    // Input parameters for the Y (luma) plane
-    VAddr srcY_address;
-    u32 srcY_image_size;
-    u16 srcY_transfer_unit;
-    u16 srcY_stride;
-
-    // Output parameters for the conversion results
-    VAddr dst_address;
-    u32 dst_image_size;
-    u16 dst_transfer_unit;
-    u16 dst_stride;
+    /// Y (luma) plane, also used for the interleaved components of YUV422_BATCH
+    ConversionBuffer src_Y;
+    ConversionBuffer src_U;
+    ConversionBuffer src_V;
+
+    /// Output buffer for the conversion results
+    ConversionBuffer dst;
 };
 
 static ConversionParameters conversion_params;
 
+/// Sequential access to a ConversionBuffer, stepping over the gaps between transfer units
+class BufferStream {
+public:
+    explicit BufferStream(const ConversionBuffer& buffer)
+        : address(buffer.address), transfer_unit(buffer.transfer_unit), gap(buffer.gap),
+          unit_left(buffer.transfer_unit) {}
+
+    void Read(u8* dest, size_t size) {
+        Walk(size, [dest](VAddr address, size_t offset, size_t span) {
+            Memory::ReadBlock(address, dest + offset, span);
+        });
+    }
+
+    void Write(const u8* src, size_t size) {
+        Walk(size, [src](VAddr address, size_t offset, size_t span) {
+            Memory::WriteBlock(address, src + offset, span);
+        });
+    }
+
+    /// Address past the last byte accessed so far
+    VAddr GetEnd() const {
+        return end;
+    }
+
+private:
+    template <typename Func>
+    void Walk(size_t size, Func access) {
+        // Without a transfer unit the buffer is just contiguous
+        if (transfer_unit == 0) {
+            access(address, 0, size);
+            address += static_cast<VAddr>(size);
+            end = address;
+            return;
+        }
+
+        for (size_t offset = 0; offset < size;) {
+            const size_t span = std::min<size_t>(unit_left, size - offset);
+            access(address, offset, span);
+            address += static_cast<VAddr>(span);
+            end = address;
+            offset += span;
+            unit_left -= static_cast<u32>(span);
+            if (unit_left == 0) {
+                address += gap;
+                unit_left = transfer_unit;
+            }
+        }
+    }
+
+    VAddr address;
+    u32 transfer_unit;
+    u32 gap;
+    u32 unit_left;
+    VAddr end = address;
+};
+
+/// Reads a line of 8-bit samples from a plane, which are the low bytes of 16-bit samples if `wide`
+static void ReadSamples(BufferStream& stream, bool wide, u8* dest, size_t count,
+                        std::vector<u8>& scratch) {
+    if (!wide) {
+        stream.Read(dest, count);
+        return;
+    }
+
+    scratch.resize(count * 2);
+    stream.Read(scratch.data(), scratch.size());
+    for (size_t i = 0; i < count; ++i)
+        dest[i] = scratch[i * 2];
+}
+
+/**
+ * Converts a line of pixels, with the chroma samples already upsampled to one per pixel, to
+ * separate R, G and B planes.
+ */
+static void ConvertLine(const CoefficientSet& c, const u8* Y, const u8* U, const u8* V,
+                        size_t width, u8* R, u8* G, u8* B) {
+    // Offset making the final shift round to nearest
+    const s32 rounding_offset = 0x18;
+
+    size_t x = 0;
+#if defined(_M_X64) || defined(__SSE2__)
+    // Multiplies interleaved 16-bit sample pairs with coefficient pairs, giving 32-bit sums
+    auto Pair = [](s16 a, s16 b) {
+        return _mm_set1_epi32(static_cast<int>(static_cast<u16>(a) | (static_cast<u32>(static_cast<u16>(b)) << 16)));
+    };
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i coef_r = Pair(c[0], c[1]);
+    const __m128i coef_y = Pair(c[0], 0);
+    const __m128i coef_g_vu = Pair(c[2], c[3]);
+    const __m128i coef_b = Pair(c[0], c[4]);
+    const __m128i offset_r = _mm_set1_epi32(c[5] + rounding_offset);
+    const __m128i offset_g = _mm_set1_epi32(c[6] + rounding_offset);
+    const __m128i offset_b = _mm_set1_epi32(c[7] + rounding_offset);
+
+    auto Finish = [](__m128i lo, __m128i hi, __m128i offset) {
+        lo = _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(lo, 3), offset), 5);
+        hi = _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(hi, 3), offset), 5);
+        const __m128i words = _mm_packs_epi32(lo, hi);
+        return _mm_packus_epi16(words, words);
+    };
+
+    for (; x + 8 <= width; x += 8) {
+        const __m128i y = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(Y + x)), zero);
+        const __m128i u = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(U + x)), zero);
+        const __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(V + x)), zero);
+
+        const __m128i yv_lo = _mm_unpacklo_epi16(y, v), yv_hi = _mm_unpackhi_epi16(y, v);
+        const __m128i yu_lo = _mm_unpacklo_epi16(y, u), yu_hi = _mm_unpackhi_epi16(y, u);
+        const __m128i vu_lo = _mm_unpacklo_epi16(v, u), vu_hi = _mm_unpackhi_epi16(v, u);
+
+        const __m128i r = Finish(_mm_madd_epi16(yv_lo, coef_r), _mm_madd_epi16(yv_hi, coef_r), offset_r);
+        const __m128i g = Finish(_mm_sub_epi32(_mm_madd_epi16(yv_lo, coef_y), _mm_madd_epi16(vu_lo, coef_g_vu)),
+                                 _mm_sub_epi32(_mm_madd_epi16(yv_hi, coef_y), _mm_madd_epi16(vu_hi, coef_g_vu)),
+                                 offset_g);
+        const __m128i b = Finish(_mm_madd_epi16(yu_lo, coef_b), _mm_madd_epi16(yu_hi, coef_b), offset_b);
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(R + x), r);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(G + x), g);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(B + x), b);
+    }
+#endif
+
+    for (; x < width; ++x) {
+        const s32 cY = c[0] * Y[x];
+        const s32 r = cY + c[1] * V[x];
+        const s32 g = cY - c[2] * V[x] - c[3] * U[x];
+        const s32 b = cY + c[4] * U[x];
+
+        R[x] = static_cast<u8>(MathUtil::Clamp(((r >> 3) + c[5] + rounding_offset) >> 5, 0, 255));
+        G[x] = static_cast<u8>(MathUtil::Clamp(((g >> 3) + c[6] + rounding_offset) >> 5, 0, 255));
+        B[x] = static_cast<u8>(MathUtil::Clamp(((b >> 3) + c[7] + rounding_offset) >> 5, 0, 255));
+    }
+}
+
+static size_t BytesPerPixel(OutputFormat format) {
+    switch (format) {
+    case OutputFormat::Rgb32:
+        return 4;
+    case OutputFormat::Rgb24:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+static void EncodePixel(OutputFormat format, const Math::Vec4<u8>& color, u8* dest) {
+    switch (format) {
+    case OutputFormat::Rgb32:
+        Color::EncodeRGBA8(color, dest);
+        break;
+    case OutputFormat::Rgb24:
+        Color::EncodeRGB8(color, dest);
+        break;
+    case OutputFormat::Rgb16_555:
+        Color::EncodeRGB5A1(color, dest);
+        break;
+    case OutputFormat::Rgb16_565:
+        Color::EncodeRGB565(color, dest);
+        break;
+    }
+}
+
+/**
+ * Runs the conversion set up in conversion_params, reading the input and writing the output
+ * in strips of 8 lines.
+ * @return Address past the last byte written to the output buffer
+ */
+static VAddr PerformConversion() {
+    const ConversionParameters& params = conversion_params;
+    const size_t width = params.input_line_width;
+    const size_t lines = params.input_lines;
+    const size_t bpp = BytesPerPixel(params.output_format);
+    const bool block = params.alignment == BlockAlignment::Block8x8;
+
+    const bool batch = params.input_format == InputFormat::YUV422_BATCH;
+    const bool wide = params.input_format == InputFormat::YUV422_INDIV_16 ||
+                      params.input_format == InputFormat::YUV420_INDIV_16;
+    const bool subsampled_420 = params.input_format == InputFormat::YUV420_Indiv8 ||
+                                params.input_format == InputFormat::YUV420_INDIV_16;
+    const size_t chroma_width = (width + 1) / 2;
+
+    // Tiles cover whole groups of 8 pixels, the padding is converted from zeroed samples
+    const size_t strip_width = (width + 7) / 8 * 8;
+
+    BufferStream stream_Y(params.src_Y);
+    BufferStream stream_U(params.src_U);
+    BufferStream stream_V(params.src_V);
+    BufferStream stream_dst(params.dst);
+
+    std::vector<u8> Y(strip_width), U(strip_width), V(strip_width);
+    std::vector<u8> U_line(chroma_width), V_line(chroma_width);
+    std::vector<u8> scratch;
+    std::vector<u8> R(strip_width * 8), G(strip_width * 8), B(strip_width * 8);
+    std::vector<u8> output(strip_width * 8 * bpp);
+    std::vector<u8> linear_strip(block ? strip_width * 8 * bpp : 0);
+
+    for (size_t strip_line = 0; strip_line < lines; strip_line += 8) {
+        const size_t strip_lines = std::min<size_t>(8, lines - strip_line);
+
+        for (size_t line = 0; line < 8; ++line) {
+            std::fill(Y.begin(), Y.end(), 0);
+            std::fill(U.begin(), U.end(), 0);
+            std::fill(V.begin(), V.end(), 0);
+
+            if (line < strip_lines) {
+                if (batch) {
+                    scratch.resize(width * 2);
+                    stream_Y.Read(scratch.data(), scratch.size());
+                    for (size_t x = 0; x < width; ++x) {
+                        Y[x] = scratch[x * 2];
+                        U[x] = scratch[(x & ~1) * 2 + 1];
+                        V[x] = (x | 1) < width ? scratch[(x & ~1) * 2 + 3] : 0;
+                    }
+                } else {
+                    ReadSamples(stream_Y, wide, Y.data(), width, scratch);
+
+                    // 4:2:0 chroma lines are shared by pairs of lines
+                    if (!subsampled_420 || (strip_line + line) % 2 == 0) {
+                        ReadSamples(stream_U, wide, U_line.data(), chroma_width, scratch);
+                        ReadSamples(stream_V, wide, V_line.data(), chroma_width, scratch);
+                    }
+                    for (size_t x = 0; x < width; ++x) {
+                        U[x] = U_line[x / 2];
+                        V[x] = V_line[x / 2];
+                    }
+                }
+            }
+
+            ConvertLine(params.coefficients, Y.data(), U.data(), V.data(), strip_width,
+                        &R[line * strip_width], &G[line * strip_width], &B[line * strip_width]);
+        }
+
+        if (block) {
+            // Whole tiles, even past the last line, encoded in order before being tiled
+            u8* dest = linear_strip.data();
+            for (size_t pixel = 0; pixel < strip_width * 8; ++pixel) {
+                EncodePixel(params.output_format, { R[pixel], G[pixel], B[pixel], params.alpha }, dest);
+                dest += bpp;
+            }
+            VideoCore::TileImage(output.data(), linear_strip.data(), static_cast<u32>(strip_width), 8, static_cast<u32>(bpp));
+            stream_dst.Write(output.data(), strip_width * 8 * bpp);
+        } else {
+            u8* dest = output.data();
+            for (size_t line = 0; line < strip_lines; ++line) {
+                for (size_t x = 0; x < width; ++x) {
+                    const size_t pixel = line * strip_width + x;
+                    EncodePixel(params.output_format, { R[pixel], G[pixel], B[pixel], params.alpha }, dest);
+                    dest += bpp;
+                }
+            }
+            stream_dst.Write(output.data(), strip_lines * width * bpp);
+        }
+    }
+
+    return stream_dst.GetEnd();
+}
+
+static void ConversionDone(u64 userdata, int cycles_late) {
+    conversion_busy = false;
+    completion_event->Signal();
+}
+
 static void SetInputFormat(Service::Interface* self) {
     u32* cmd_buff = Kernel::GetCommandBuffer();
 
@@ -134,17 +438,46 @@ static void GetTransferEndEvent(Service::Interface* self) {
     LOG_DEBUG(Service_Y2R, "called");
 }
 
+/// Sets up one of the input or output buffers from the parameters of a SetSending or SetReceiving command
+static void SetConversionBuffer(ConversionBuffer& buffer, const u32* cmd_buff, const char* name) {
+    buffer.address = cmd_buff[1];
+    buffer.image_size = cmd_buff[2];
+    buffer.transfer_unit = cmd_buff[3];
+    buffer.gap = cmd_buff[4];
+    u32 process_handle = cmd_buff[6];
+    LOG_DEBUG(Service_Y2R, "called %s image_size=0x%08X, transfer_unit=%hu, transfer_stride=%hu, "
+        "process_handle=0x%08X", name, buffer.image_size, buffer.transfer_unit, buffer.gap,
+        process_handle);
+}
+
 static void SetSendingY(Service::Interface* self) {
     u32* cmd_buff = Kernel::GetCommandBuffer();
 
-    conversion_params.srcY_address = cmd_buff[1];
-    conversion_params.srcY_image_size = cmd_buff[2];
-    conversion_params.srcY_transfer_unit = cmd_buff[3];
-    conversion_params.srcY_stride = cmd_buff[4];
-    u32 src_process_handle = cmd_buff[6];
-    LOG_DEBUG(Service_Y2R, "called image_size=0x%08X, transfer_unit=%hu, transfer_stride=%hu, "
-        "src_process_handle=0x%08X", conversion_params.srcY_image_size,
-        conversion_params.srcY_transfer_unit, conversion_params.srcY_stride, src_process_handle);
+    SetConversionBuffer(conversion_params.src_Y, cmd_buff, "Y");
+
+    cmd_buff[1] = RESULT_SUCCESS.raw;
+}
+
+static void SetSendingU(Service::Interface* self) {
+    u32* cmd_buff = Kernel::GetCommandBuffer();
+
+    SetConversionBuffer(conversion_params.src_U, cmd_buff, "U");
+
+    cmd_buff[1] = RESULT_SUCCESS.raw;
+}
+
+static void SetSendingV(Service::Interface* self) {
+    u32* cmd_buff = Kernel::GetCommandBuffer();
+
+    SetConversionBuffer(conversion_params.src_V, cmd_buff, "V");
+
+    cmd_buff[1] = RESULT_SUCCESS.raw;
+}
+
+static void SetSendingYUYV(Service::Interface* self) {
+    u32* cmd_buff = Kernel::GetCommandBuffer();
+
+    SetConversionBuffer(conversion_params.src_Y, cmd_buff, "YUYV");
 
     cmd_buff[1] = RESULT_SUCCESS.raw;
 }
@@ -152,15 +485,7 @@ static void SetSendingY(Service::Interface* self) {
 static void SetReceiving(Service::Interface* self) {
     u32* cmd_buff = Kernel::GetCommandBuffer();
 
-    conversion_params.dst_address = cmd_buff[1];
-    conversion_params.dst_image_size = cmd_buff[2];
-    conversion_params.dst_transfer_unit = cmd_buff[3];
-    conversion_params.dst_stride = cmd_buff[4];
-    u32 dst_process_handle = cmd_buff[6];
-    LOG_DEBUG(Service_Y2R, "called image_size=0x%08X, transfer_unit=%hu, transfer_stride=%hu, "
-        "dst_process_handle=0x%08X", conversion_params.dst_image_size,
-        conversion_params.dst_transfer_unit, conversion_params.dst_stride,
-        dst_process_handle);
+    SetConversionBuffer(conversion_params.dst, cmd_buff, "output");
 
     cmd_buff[1] = RESULT_SUCCESS.raw;
 }
@@ -183,97 +508,100 @@ static void SetInputLines(Service::Interface* self) {
     cmd_buff[1] = RESULT_SUCCESS.raw;
 }
 
-static void StartConversion(Service::Interface* self) {
+/**
+* Y2R_U::SetCoefficient service function
+*  Inputs:
+*      1-4 : The eight 16-bit coefficients of the conversion
+*  Outputs:
+*      1 : Result of function, 0 on success, otherwise error code
+*/
+static void SetCoefficient(Service::Interface* self) {
     u32* cmd_buff = Kernel::GetCommandBuffer();
 
-    const u8* srcY_buffer = Memory::GetPointer(conversion_params.srcY_address);
-    u8* dst_buffer = Memory::GetPointer(conversion_params.dst_address);
-
-    // TODO: support color and other kinds of conversions
-    ASSERT(conversion_params.input_format == InputFormat::YUV422_Indiv8
-        || conversion_params.input_format == InputFormat::YUV420_Indiv8);
-    ASSERT(conversion_params.output_format == OutputFormat::Rgb24);
-    ASSERT(conversion_params.rotation == Rotation::None);
-    const int bpp = 3;
-
-    switch (conversion_params.alignment) {
-    case BlockAlignment::Linear:
-    {
-        const size_t input_lines = conversion_params.input_lines;
-        const size_t input_line_width = conversion_params.input_line_width;
-        const size_t srcY_stride = conversion_params.srcY_stride;
-        const size_t dst_stride = conversion_params.dst_stride;
-
-        size_t srcY_offset = 0;
-        size_t dst_offset = 0;
-
-        for (size_t line = 0; line < input_lines; ++line) {
-            for (size_t i = 0; i < input_line_width; ++i) {
-                u8 Y = srcY_buffer[srcY_offset];
-                dst_buffer[dst_offset + 0] = Y;
-                dst_buffer[dst_offset + 1] = Y;
-                dst_buffer[dst_offset + 2] = Y;
-
-                srcY_offset += 1;
-                dst_offset += bpp;
-            }
-            srcY_offset += srcY_stride;
-            dst_offset += dst_stride;
-        }
-        break;
+    std::memcpy(conversion_params.coefficients, &cmd_buff[1], sizeof(CoefficientSet));
+    LOG_DEBUG(Service_Y2R, "called coefficients=[%hX, %hX, %hX, %hX, %hX, %hX, %hX, %hX]",
+              conversion_params.coefficients[0], conversion_params.coefficients[1],
+              conversion_params.coefficients[2], conversion_params.coefficients[3],
+              conversion_params.coefficients[4], conversion_params.coefficients[5],
+              conversion_params.coefficients[6], conversion_params.coefficients[7]);
+
+    cmd_buff[1] = RESULT_SUCCESS.raw;
+}
+
+static void SetStandardCoefficient(Service::Interface* self) {
+    u32* cmd_buff = Kernel::GetCommandBuffer();
+
+    const u32 index = cmd_buff[1];
+    LOG_DEBUG(Service_Y2R, "called standard_coefficient=%u", index);
+    if (index >= ARRAY_SIZE(standard_coefficients)) {
+        LOG_ERROR(Service_Y2R, "Unknown standard coefficient %u", index);
+        cmd_buff[1] = -1; // TODO: Find the right error code
+        return;
     }
-    case BlockAlignment::Block8x8:
-    {
-        const size_t input_lines = conversion_params.input_lines;
-        const size_t input_line_width = conversion_params.input_line_width;
-        const size_t srcY_stride = conversion_params.srcY_stride;
-        const size_t dst_transfer_unit = conversion_params.dst_transfer_unit;
-        const size_t dst_stride = conversion_params.dst_stride;
+    std::memcpy(conversion_params.coefficients, standard_coefficients[index], sizeof(CoefficientSet));
 
-        size_t srcY_offset = 0;
-        size_t dst_tile_line_offs = 0;
+    cmd_buff[1] = RESULT_SUCCESS.raw;
+}
 
-        const size_t tile_size = 8 * 8 * bpp;
+static void SetAlpha(Service::Interface* self) {
+    u32* cmd_buff = Kernel::GetCommandBuffer();
 
-        for (size_t line = 0; line < input_lines;) {
-            size_t max_line = line + 8;
+    conversion_params.alpha = static_cast<u8>(cmd_buff[1]);
+    LOG_DEBUG(Service_Y2R, "called alpha=%u", conversion_params.alpha);
 
-            for (; line < max_line; ++line) {
-                for (size_t x = 0; x < input_line_width; ++x) {
-                    size_t tile_x = x / 8;
+    cmd_buff[1] = RESULT_SUCCESS.raw;
+}
 
-                    size_t dst_tile_offs = dst_tile_line_offs + tile_x * tile_size;
-                    size_t tile_i = VideoCore::MortonInterleave((u32)x, (u32)line);
+static void GetAlpha(Service::Interface* self) {
+    u32* cmd_buff = Kernel::GetCommandBuffer();
 
-                    size_t dst_offset = dst_tile_offs + tile_i * bpp;
+    cmd_buff[1] = RESULT_SUCCESS.raw;
+    cmd_buff[2] = conversion_params.alpha;
+    LOG_DEBUG(Service_Y2R, "called");
+}
 
-                    u8 Y = srcY_buffer[srcY_offset];
-                    dst_buffer[dst_offset + 0] = Y;
-                    dst_buffer[dst_offset + 1] = Y;
-                    dst_buffer[dst_offset + 2] = Y;
+/**
+* Y2R_U::StartConversion service function
+*  Converts the whole image right away, but only reports the conversion as finished once the
+*  hardware would have, so that the application can do other work in the meantime.
+*  Outputs:
+*      1 : Result of function, 0 on success, otherwise error code
+*/
+static void StartConversion(Service::Interface* self) {
+    u32* cmd_buff = Kernel::GetCommandBuffer();
 
-                    srcY_offset += 1;
-                }
+    if (conversion_params.rotation != Rotation::None)
+        LOG_ERROR(Service_Y2R, "Unimplemented rotation %u, output is not rotated", conversion_params.rotation);
 
-                srcY_offset += srcY_stride;
-            }
+    if (conversion_busy)
+        CoreTiming::UnscheduleEvent(conversion_done_event, 0);
 
-            dst_tile_line_offs += dst_transfer_unit + dst_stride;
-        }
-        break;
-    }
-    }
+    const VAddr dst_end = PerformConversion();
 
-    // dst_image_size would seem to be perfect for this, but it doesn't include the stride :(
-    u32 total_output_size = conversion_params.input_lines *
-        (conversion_params.dst_transfer_unit + conversion_params.dst_stride);
-    VideoCore::g_renderer->hw_rasterizer->NotifyFlush(
-        Memory::VirtualToPhysicalAddress(conversion_params.dst_address), total_output_size);
+    const u32 total_output_size = dst_end - conversion_params.dst.address;
+    const PAddr dst_address = Memory::VirtualToPhysicalAddress(conversion_params.dst.address);
+    GPUThread::Run([dst_address, total_output_size] {
+        VideoCore::g_renderer->hw_rasterizer->NotifyFlush(dst_address, total_output_size);
+    });
+
+    const u64 pixels = static_cast<u64>(conversion_params.input_line_width) * conversion_params.input_lines;
+    conversion_busy = true;
+    CoreTiming::ScheduleEvent(pixels * CONVERSION_CYCLES_PER_PIXEL, conversion_done_event);
 
     LOG_DEBUG(Service_Y2R, "called");
-    completion_event->Signal();
+    cmd_buff[1] = RESULT_SUCCESS.raw;
+}
+
+static void StopConversion(Service::Interface* self) {
+    u32* cmd_buff = Kernel::GetCommandBuffer();
+
+    if (conversion_busy) {
+        CoreTiming::UnscheduleEvent(conversion_done_event, 0);
+        conversion_busy = false;
+    }
 
     cmd_buff[1] = RESULT_SUCCESS.raw;
+    LOG_DEBUG(Service_Y2R, "called");
 }
 
 /**
@@ -286,7 +614,7 @@ static void IsBusyConversion(Service::Interface* self) {
     u32* cmd_buff = Kernel::GetCommandBuffer();
 
     cmd_buff[1] = RESULT_SUCCESS.raw;
-    cmd_buff[2] = 0; // StartConversion always finishes immediately
+    cmd_buff[2] = conversion_busy ? 1 : 0;
     LOG_DEBUG(Service_Y2R, "called");
 }
 
@@ -298,6 +626,12 @@ static void PingProcess(Service::Interface* self) {
     LOG_WARNING(Service_Y2R, "(STUBBED) called");
 }
 
+void DoState(PointerWrap& p) {
+    Kernel::DoObjectReference(p, completion_event);
+    p.Do(conversion_busy);
+    p.DoVoid(&conversion_params, sizeof(conversion_params));
+}
+
 const Interface::FunctionInfo FunctionTable[] = {
     {0x00010040, SetInputFormat,          "SetInputFormat"},
     {0x00030040, SetOutputFormat,         "SetOutputFormat"},
@@ -306,15 +640,18 @@ const Interface::FunctionInfo FunctionTable[] = {
     {0x000D0040, nullptr,                 "SetTransferEndInterrupt"},
     {0x000F0000, GetTransferEndEvent,     "GetTransferEndEvent"},
     {0x00100102, SetSendingY,             "SetSendingY"},
-    {0x00110102, nullptr,                 "SetSendingU"},
-    {0x00120102, nullptr,                 "SetSendingV"},
+    {0x00110102, SetSendingU,             "SetSendingU"},
+    {0x00120102, SetSendingV,             "SetSendingV"},
+    {0x00130102, SetSendingYUYV,          "SetSendingYUYV"},
     {0x00180102, SetReceiving,            "SetReceiving"},
     {0x001A0040, SetInputLineWidth,       "SetInputLineWidth"},
     {0x001C0040, SetInputLines,           "SetInputLines"},
-    {0x00200040, nullptr,                 "SetStandardCoefficient"},
-    {0x00220040, nullptr,                 "SetAlpha"},
+    {0x001E0100, SetCoefficient,          "SetCoefficient"},
+    {0x00200040, SetStandardCoefficient,  "SetStandardCoefficient"},
+    {0x00220040, SetAlpha,                "SetAlpha"},
+    {0x00230000, GetAlpha,                "GetAlpha"},
     {0x00260000, StartConversion,         "StartConversion"},
-    {0x00270000, nullptr,                 "StopConversion"},
+    {0x00270000, StopConversion,          "StopConversion"},
     {0x00280000, IsBusyConversion,        "IsBusyConversion"},
     {0x002A0000, PingProcess,             "PingProcess"},
     {0x002B0000, nullptr,                 "DriverInitialize"},
@@ -326,7 +663,11 @@ const Interface::FunctionInfo FunctionTable[] = {
 
 Interface::Interface() {
     completion_event = Kernel::Event::Create(RESETTYPE_ONESHOT, "Y2R:Completed");
+    conversion_done_event = CoreTiming::RegisterEvent("Y2R_U::ConversionDone", ConversionDone);
+    conversion_busy = false;
     std::memset(&conversion_params, 0, sizeof(conversion_params));
+    std::memcpy(conversion_params.coefficients, standard_coefficients[static_cast<int>(StandardCoefficient::ITU_Rec601)],
+                sizeof(CoefficientSet));
 
     Register(FunctionTable);
 }
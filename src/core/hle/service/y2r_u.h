@@ -6,6 +6,8 @@
 
 #include "core/hle/service/service.h"
 
+class PointerWrap;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Namespace Y2R_U
 
@@ -20,4 +22,7 @@ public:
     }
 };
 
+/// Saves or restores the completion event and the parameters and progress of the last conversion
+void DoState(PointerWrap& p);
+
 } // namespace
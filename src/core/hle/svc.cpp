@@ -2,8 +2,12 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <atomic>
 #include <map>
 
+#include "common/common_funcs.h"
+#include "common/file_util.h"
 #include "common/logging/log.h"
 #include "common/profiler.h"
 #include "common/string_util.h"
@@ -154,8 +158,8 @@ static ResultCode WaitSynchronization1(Handle handle, s64 nano_seconds) {
     // Check for next thread to schedule
     if (object->ShouldWait()) {
 
-        object->AddWaitingThread(Kernel::GetCurrentThread());
-        Kernel::WaitCurrentThread_WaitSynchronization({ object }, false, false);
+        Kernel::GetCurrentThread()->AddWaitObject(std::move(object));
+        Kernel::WaitCurrentThread_WaitSynchronization(false, false);
 
         // Create an event to wake the thread up after the specified nanosecond delay has passed
         Kernel::GetCurrentThread()->WakeAfterDelay(nano_seconds);
@@ -226,16 +230,11 @@ static ResultCode WaitSynchronizationN(s32* out, Handle* handles, s32 handle_cou
     if (wait_thread) {
 
         // Actually wait the current thread on each object if we decided to wait...
-        std::vector<SharedPtr<Kernel::WaitObject>> wait_objects;
-        wait_objects.reserve(handle_count);
+        Kernel::Thread* thread = Kernel::GetCurrentThread();
+        for (int i = 0; i < handle_count; ++i)
+            thread->AddWaitObject(Kernel::g_handle_table.GetWaitObject(handles[i]));
 
-        for (int i = 0; i < handle_count; ++i) {
-            auto object = Kernel::g_handle_table.GetWaitObject(handles[i]);
-            object->AddWaitingThread(Kernel::GetCurrentThread());
-            wait_objects.push_back(object);
-        }
-
-        Kernel::WaitCurrentThread_WaitSynchronization(std::move(wait_objects), true, wait_all);
+        Kernel::WaitCurrentThread_WaitSynchronization(true, wait_all);
 
         // Create an event to wake the thread up after the specified nanosecond delay has passed
         Kernel::GetCurrentThread()->WakeAfterDelay(nano_seconds);
@@ -803,6 +802,87 @@ static const FunctionDef SVC_Table[] = {
 
 Common::Profiling::TimingCategory profiler_svc("SVC Calls");
 
+/// Counters of a single SVC. They are only written by the emulation thread, but read and reset by
+/// the frontend, which may run on another one.
+struct SVCCounters {
+    std::atomic<u64> calls;
+    std::atomic<u64> total_time_ns;
+    std::atomic<u64> max_time_ns;
+    std::atomic<u64> latency_histogram[NUM_LATENCY_BUCKETS];
+};
+
+static SVCCounters svc_counters[ARRAY_SIZE(SVC_Table)];
+
+static int GetLatencyBucket(u64 time_ns) {
+    if (time_ns == 0)
+        return 0;
+    return std::min(63 - CountLeadingZeros64(time_ns), NUM_LATENCY_BUCKETS - 1);
+}
+
+static void RecordCall(u32 func_num, u64 time_ns) {
+    SVCCounters& counters = svc_counters[func_num];
+    counters.calls.fetch_add(1, std::memory_order_relaxed);
+    counters.total_time_ns.fetch_add(time_ns, std::memory_order_relaxed);
+    if (time_ns > counters.max_time_ns.load(std::memory_order_relaxed))
+        counters.max_time_ns.store(time_ns, std::memory_order_relaxed);
+    counters.latency_histogram[GetLatencyBucket(time_ns)].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<SVCStatistics> GetStatistics() {
+    std::vector<SVCStatistics> statistics;
+    for (u32 func_num = 0; func_num < ARRAY_SIZE(SVC_Table); ++func_num) {
+        const SVCCounters& counters = svc_counters[func_num];
+        const u64 calls = counters.calls.load(std::memory_order_relaxed);
+        if (calls == 0)
+            continue;
+
+        SVCStatistics entry;
+        entry.id = func_num;
+        entry.name = SVC_Table[func_num].name;
+        entry.calls = calls;
+        entry.total_time_ns = counters.total_time_ns.load(std::memory_order_relaxed);
+        entry.max_time_ns = counters.max_time_ns.load(std::memory_order_relaxed);
+        for (int bucket = 0; bucket < NUM_LATENCY_BUCKETS; ++bucket)
+            entry.latency_histogram[bucket] = counters.latency_histogram[bucket].load(std::memory_order_relaxed);
+        statistics.push_back(entry);
+    }
+    return statistics;
+}
+
+void ResetStatistics() {
+    for (SVCCounters& counters : svc_counters) {
+        counters.calls.store(0, std::memory_order_relaxed);
+        counters.total_time_ns.store(0, std::memory_order_relaxed);
+        counters.max_time_ns.store(0, std::memory_order_relaxed);
+        for (auto& bucket : counters.latency_histogram)
+            bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool DumpStatisticsCSV(const std::string& filename) {
+    std::string csv = "id,name,calls,total_ns,avg_ns,max_ns";
+    for (int bucket = 0; bucket < NUM_LATENCY_BUCKETS; ++bucket)
+        csv += Common::StringFromFormat(",ge_%lluns", 1ull << bucket);
+    csv += "\n";
+
+    for (const SVCStatistics& entry : GetStatistics()) {
+        csv += Common::StringFromFormat("0x%02X,%s,%llu,%llu,%llu,%llu", entry.id, entry.name,
+                                (unsigned long long)entry.calls,
+                                (unsigned long long)entry.total_time_ns,
+                                (unsigned long long)(entry.total_time_ns / entry.calls),
+                                (unsigned long long)entry.max_time_ns);
+        for (u64 count : entry.latency_histogram)
+            csv += Common::StringFromFormat(",%llu", (unsigned long long)count);
+        csv += "\n";
+    }
+
+    if (FileUtil::WriteStringToFile(true, csv, filename.c_str()) != csv.size()) {
+        LOG_ERROR(Kernel_SVC, "Failed to write SVC statistics to %s", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
 static const FunctionDef* GetSVCInfo(u32 opcode) {
     u32 func_num = opcode & 0xFFFFFF; // 8 bits
     if (func_num >= ARRAY_SIZE(SVC_Table)) {
@@ -817,11 +897,14 @@ void CallSVC(u32 opcode) {
 
     const FunctionDef *info = GetSVCInfo(opcode);
     if (info) {
+        const auto start = Common::Profiling::Clock::now();
         if (info->func) {
             info->func();
         } else {
             LOG_ERROR(Kernel_SVC, "unimplemented SVC function %s(..)", info->name);
         }
+        const auto duration = Common::Profiling::Clock::now() - start;
+        RecordCall(info - SVC_Table, std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
     }
 }
 
@@ -4,6 +4,10 @@
 
 #pragma once
 
+#include <array>
+#include <string>
+#include <vector>
+
 #include "common/common_types.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -43,4 +47,36 @@ namespace SVC {
 
 void CallSVC(u32 opcode);
 
+/**
+ * Number of buckets in the SVC latency histograms. Bucket i counts the calls that took at least
+ * 2^i and less than 2^(i+1) nanoseconds of host time, the last one also counts all longer calls.
+ */
+const int NUM_LATENCY_BUCKETS = 28;
+
+/// Call count and host time spent in a single SVC
+struct SVCStatistics {
+    u32 id;
+    const char* name;
+    u64 calls;
+    u64 total_time_ns;
+    u64 max_time_ns;
+    std::array<u64, NUM_LATENCY_BUCKETS> latency_histogram;
+};
+
+/**
+ * Returns the statistics of all SVCs that have been called since the last reset, ordered by SVC
+ * id. Can be called from any thread, the counters of an SVC may then be from slightly different
+ * points in time.
+ */
+std::vector<SVCStatistics> GetStatistics();
+
+/// Clears the statistics of all SVCs
+void ResetStatistics();
+
+/**
+ * Writes the statistics of all SVCs that have been called to a CSV file, one SVC per row.
+ * @return true on success
+ */
+bool DumpStatisticsCSV(const std::string& filename);
+
 } // namespace
@@ -2,25 +2,47 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <cstring>
+
+#include "common/chunk_file.h"
 #include "common/color.h"
+#include "common/cpu_detect.h"
+#include "common/memory_accounting.h"
+#include "common/perf_counters.h"
 #include "common/common_types.h"
+#include "common/platform.h"
+#include "common/vector_math.h"
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef HAVE_SSSE3_KERNELS
+#include <tmmintrin.h>
+#endif
 
 #include "core/arm/arm_interface.h"
+#include "core/boot_snapshot.h"
 
 #include "core/settings.h"
 #include "core/core.h"
 #include "core/memory.h"
+#include "core/memory_stats.h"
 #include "core/core_timing.h"
+#include "core/frame_limiter.h"
+#include "core/gpu_capture.h"
+#include "core/rewind.h"
 
 #include "core/hle/hle.h"
 #include "core/hle/service/gsp_gpu.h"
-#include "core/hle/service/dsp_dsp.h"
-#include "core/hle/service/hid/hid.h"
 
 #include "core/hw/hw.h"
 #include "core/hw/gpu.h"
 
 #include "video_core/command_processor.h"
+#include "video_core/cost_model.h"
+#include "video_core/gpu_thread.h"
 #include "video_core/utils.h"
 #include "video_core/video_core.h"
 
@@ -38,6 +60,260 @@ static int vblank_event;
 static u64 frame_count;
 /// True if the last frame was skipped
 static bool last_skip_frame;
+/// Sequence number of the last buffer swap queued on the GPU thread
+static u64 last_swap;
+
+/// Encoding of a framebuffer pixel format, so that transfer kernels convert without switching per pixel
+template <Regs::PixelFormat format>
+struct PixelCodec;
+
+template <>
+struct PixelCodec<Regs::PixelFormat::RGBA8> {
+    static const u32 bytes_per_pixel = 4;
+    static Math::Vec4<u8> Decode(const u8* src) { return Color::DecodeRGBA8(src); }
+    static void Encode(const Math::Vec4<u8>& color, u8* dst) { Color::EncodeRGBA8(color, dst); }
+};
+
+template <>
+struct PixelCodec<Regs::PixelFormat::RGB8> {
+    static const u32 bytes_per_pixel = 3;
+    static Math::Vec4<u8> Decode(const u8* src) { return Color::DecodeRGB8(src); }
+    static void Encode(const Math::Vec4<u8>& color, u8* dst) { Color::EncodeRGB8(color, dst); }
+};
+
+template <>
+struct PixelCodec<Regs::PixelFormat::RGB565> {
+    static const u32 bytes_per_pixel = 2;
+    static Math::Vec4<u8> Decode(const u8* src) { return Color::DecodeRGB565(src); }
+    static void Encode(const Math::Vec4<u8>& color, u8* dst) { Color::EncodeRGB565(color, dst); }
+};
+
+template <>
+struct PixelCodec<Regs::PixelFormat::RGB5A1> {
+    static const u32 bytes_per_pixel = 2;
+    static Math::Vec4<u8> Decode(const u8* src) { return Color::DecodeRGB5A1(src); }
+    static void Encode(const Math::Vec4<u8>& color, u8* dst) { Color::EncodeRGB5A1(color, dst); }
+};
+
+template <>
+struct PixelCodec<Regs::PixelFormat::RGBA4> {
+    static const u32 bytes_per_pixel = 2;
+    static Math::Vec4<u8> Decode(const u8* src) { return Color::DecodeRGBA4(src); }
+    static void Encode(const Math::Vec4<u8>& color, u8* dst) { Color::EncodeRGBA4(color, dst); }
+};
+
+/// Converts the 64 pixels of an 8x8 tile, stored contiguously in both formats
+template <Regs::PixelFormat src_format, Regs::PixelFormat dst_format>
+struct TileConverter {
+    static void Convert(const u8* src, u8* dst) {
+        typedef PixelCodec<src_format> Src;
+        typedef PixelCodec<dst_format> Dst;
+        for (int i = 0; i < 64; ++i)
+            Dst::Encode(Src::Decode(src + i * Src::bytes_per_pixel), dst + i * Dst::bytes_per_pixel);
+    }
+};
+
+/// Decoding and encoding into the same format gives back the input
+template <Regs::PixelFormat format>
+struct TileConverter<format, format> {
+    static void Convert(const u8* src, u8* dst) {
+        memcpy(dst, src, 64 * PixelCodec<format>::bytes_per_pixel);
+    }
+};
+
+#ifdef HAVE_SSSE3_KERNELS
+/**
+ * Converts the first 60 pixels of a tile from RGBA8 to RGB8, dropping the alpha bytes of 4 pixels
+ * at once. Each store writes 4 bytes past its pixels which the next store overwrites, so the last 4
+ * pixels are left to the caller to not write past the tile.
+ */
+static TARGET_SSSE3 void ConvertRGBA8ToRGB8_SSSE3(const u8* src, u8* dst) {
+    const __m128i shuffle = _mm_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1);
+    for (int i = 0; i < 60; i += 4) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3), _mm_shuffle_epi8(data, shuffle));
+    }
+}
+
+/**
+ * Converts the first 60 pixels of a tile from RGB8 to RGBA8. Each load reads 16 bytes for 4 pixels,
+ * so the last 4 pixels are left to the caller to not read past the tile.
+ */
+static TARGET_SSSE3 void ConvertRGB8ToRGBA8_SSSE3(const u8* src, u8* dst) {
+    const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    const __m128i alpha = _mm_set1_epi32(0xFF);
+    for (int i = 0; i < 60; i += 4) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+        data = _mm_or_si128(_mm_shuffle_epi8(data, shuffle), alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), data);
+    }
+}
+
+template <>
+struct TileConverter<Regs::PixelFormat::RGBA8, Regs::PixelFormat::RGB8> {
+    static void Convert(const u8* src, u8* dst) {
+        int i = 0;
+        if (cpu_info.bSSSE3) {
+            ConvertRGBA8ToRGB8_SSSE3(src, dst);
+            i = 60;
+        }
+        for (; i < 64; ++i)
+            Color::EncodeRGB8(Color::DecodeRGBA8(src + i * 4), dst + i * 3);
+    }
+};
+
+template <>
+struct TileConverter<Regs::PixelFormat::RGB8, Regs::PixelFormat::RGBA8> {
+    static void Convert(const u8* src, u8* dst) {
+        int i = 0;
+        if (cpu_info.bSSSE3) {
+            ConvertRGB8ToRGBA8_SSSE3(src, dst);
+            i = 60;
+        }
+        for (; i < 64; ++i)
+            Color::EncodeRGBA8(Color::DecodeRGB8(src + i * 3), dst + i * 4);
+    }
+};
+#endif
+
+#if defined(_M_X64) || defined(__SSE2__)
+template <>
+struct TileConverter<Regs::PixelFormat::RGB565, Regs::PixelFormat::RGBA8> {
+    static void Convert(const u8* src, u8* dst) {
+        const __m128i mask5 = _mm_set1_epi16(0x1F);
+        const __m128i mask6 = _mm_set1_epi16(0x3F);
+        const __m128i alpha = _mm_set1_epi16(0xFF);
+        for (int i = 0; i < 64; i += 8) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+            __m128i r = _mm_and_si128(_mm_srli_epi16(pixels, 11), mask5);
+            __m128i g = _mm_and_si128(_mm_srli_epi16(pixels, 5), mask6);
+            __m128i b = _mm_and_si128(pixels, mask5);
+
+            // Replicate the top bits into the bottom ones, like Color::Convert5To8 and Convert6To8
+            r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+            g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+            b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+            // The bytes of an RGBA8 pixel are stored as A, B, G, R
+            __m128i alpha_blue = _mm_or_si128(alpha, _mm_slli_epi16(b, 8));
+            __m128i green_red = _mm_or_si128(g, _mm_slli_epi16(r, 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_unpacklo_epi16(alpha_blue, green_red));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 16), _mm_unpackhi_epi16(alpha_blue, green_red));
+        }
+    }
+};
+#endif
+
+/// Converts the pixels of a display transfer, specialized for its input and output formats
+typedef void (*TransferKernel)(const Regs::DisplayTransferConfig& config, const u8* src, u8* dst,
+                               u32 output_width, u32 output_height, u32 horizontal_scale, u32 vertical_scale);
+
+template <Regs::PixelFormat src_format, Regs::PixelFormat dst_format>
+static void DisplayTransfer(const Regs::DisplayTransferConfig& config, const u8* src, u8* dst,
+                            u32 output_width, u32 output_height, u32 horizontal_scale, u32 vertical_scale) {
+    typedef PixelCodec<src_format> Src;
+    typedef PixelCodec<dst_format> Dst;
+    const u32 input_width = config.input_width;
+
+    // Unscaled transfers of whole tiles are converted one tile at a time
+    if (horizontal_scale == 1 && vertical_scale == 1 && output_width % 8 == 0 && output_height % 8 == 0) {
+        u8 tile[64 * 4];
+
+        for (u32 tile_y = 0; tile_y < output_height; tile_y += 8) {
+            // Flipped transfers go through the rows of the linear side from the bottom up
+            const u32 linear_y = config.flip_vertically ? output_height - 1 - tile_y : tile_y;
+            const ptrdiff_t direction = config.flip_vertically ? -1 : 1;
+
+            for (u32 tile_x = 0; tile_x < output_width; tile_x += 8) {
+                if (config.output_tiled) {
+                    // Gather the tile from the linear input, then convert it into place
+                    const u8* row = src + (linear_y * input_width + tile_x) * Src::bytes_per_pixel;
+                    VideoCore::TileFromLinear(tile, row, direction * input_width * Src::bytes_per_pixel, Src::bytes_per_pixel);
+                    TileConverter<src_format, dst_format>::Convert(tile, dst + (tile_y * output_width + tile_x * 8) * Dst::bytes_per_pixel);
+                } else {
+                    // Convert the tile of the tiled input, then scatter it into the linear output
+                    TileConverter<src_format, dst_format>::Convert(src + (tile_y * input_width + tile_x * 8) * Src::bytes_per_pixel, tile);
+                    u8* row = dst + (linear_y * output_width + tile_x) * Dst::bytes_per_pixel;
+                    VideoCore::LinearFromTile(row, direction * output_width * Dst::bytes_per_pixel, tile, Dst::bytes_per_pixel);
+                }
+            }
+        }
+        return;
+    }
+
+    // TODO(Subv): Implement the box filter when scaling is enabled
+    // right now we're just skipping the extra pixels.
+    for (u32 y = 0; y < output_height; ++y) {
+        // Flip the y value of the output data,
+        // the [x,y] position of the input image is still calculated from the unflipped
+        // position to account for the scaling options.
+        const u32 output_y = config.flip_vertically ? output_height - y - 1 : y;
+
+        for (u32 x = 0; x < output_width; ++x) {
+            // Calculate the [x,y] position of the input image
+            // based on the current output position and the scale
+            u32 input_x = x * horizontal_scale;
+            u32 input_y = y * vertical_scale;
+
+            u32 src_offset;
+            u32 dst_offset;
+
+            if (config.output_tiled) {
+                // Interpret the input as linear and the output as tiled
+                u32 coarse_y = output_y & ~7;
+                u32 stride = output_width * Dst::bytes_per_pixel;
+
+                src_offset = (input_x + input_y * input_width) * Src::bytes_per_pixel;
+                dst_offset = VideoCore::GetMortonOffset(x, output_y, Dst::bytes_per_pixel) + coarse_y * stride;
+            } else {
+                // Interpret the input as tiled and the output as linear
+                u32 coarse_y = input_y & ~7;
+                u32 stride = input_width * Src::bytes_per_pixel;
+
+                src_offset = VideoCore::GetMortonOffset(input_x, input_y, Src::bytes_per_pixel) + coarse_y * stride;
+                dst_offset = (x + output_y * output_width) * Dst::bytes_per_pixel;
+            }
+
+            Dst::Encode(Src::Decode(src + src_offset), dst + dst_offset);
+        }
+    }
+}
+
+template <Regs::PixelFormat src_format>
+static TransferKernel GetTransferKernel(Regs::PixelFormat dst_format) {
+    switch (dst_format) {
+    case Regs::PixelFormat::RGBA8:
+        return DisplayTransfer<src_format, Regs::PixelFormat::RGBA8>;
+    case Regs::PixelFormat::RGB8:
+        return DisplayTransfer<src_format, Regs::PixelFormat::RGB8>;
+    case Regs::PixelFormat::RGB565:
+        return DisplayTransfer<src_format, Regs::PixelFormat::RGB565>;
+    case Regs::PixelFormat::RGB5A1:
+        return DisplayTransfer<src_format, Regs::PixelFormat::RGB5A1>;
+    case Regs::PixelFormat::RGBA4:
+        return DisplayTransfer<src_format, Regs::PixelFormat::RGBA4>;
+    default:
+        return nullptr;
+    }
+}
+
+/// Selects the transfer kernel for a pair of formats, nullptr if either of them is unknown
+static TransferKernel GetTransferKernel(Regs::PixelFormat src_format, Regs::PixelFormat dst_format) {
+    switch (src_format) {
+    case Regs::PixelFormat::RGBA8:
+        return GetTransferKernel<Regs::PixelFormat::RGBA8>(dst_format);
+    case Regs::PixelFormat::RGB8:
+        return GetTransferKernel<Regs::PixelFormat::RGB8>(dst_format);
+    case Regs::PixelFormat::RGB565:
+        return GetTransferKernel<Regs::PixelFormat::RGB565>(dst_format);
+    case Regs::PixelFormat::RGB5A1:
+        return GetTransferKernel<Regs::PixelFormat::RGB5A1>(dst_format);
+    case Regs::PixelFormat::RGBA4:
+        return GetTransferKernel<Regs::PixelFormat::RGBA4>(dst_format);
+    default:
+        return nullptr;
+    }
+}
 
 template <typename T>
 inline void Read(T &var, const u32 raw_addr) {
@@ -53,6 +329,128 @@ inline void Read(T &var, const u32 raw_addr) {
     var = g_regs[addr / 4];
 }
 
+/// Performs a memory fill and signals its completion
+static void PerformMemoryFill(const Regs::MemoryFillConfig& config, bool is_second_filler) {
+    // Fills of render targets are done on the GPU, leaving 3DS memory to be written when it's read
+    const bool accelerated = VideoCore::g_renderer->hw_rasterizer->AccelerateFill(config);
+
+    if (!accelerated) {
+        u8* start = Memory::GetPhysicalPointer(config.GetStartAddress());
+        u8* end = Memory::GetPhysicalPointer(config.GetEndAddress());
+
+        if (config.fill_24bit) {
+            // fill with 24-bit values, storing a pattern of 16 of them at once
+            u8 pattern[48];
+            for (int i = 0; i < 48; i += 3) {
+                pattern[i] = config.value_24bit_r;
+                pattern[i + 1] = config.value_24bit_g;
+                pattern[i + 2] = config.value_24bit_b;
+            }
+
+            u8* ptr = start;
+            for (; end - ptr >= 48; ptr += 48)
+                memcpy(ptr, pattern, 48);
+
+            for (; ptr < end; ptr += 3) {
+                ptr[0] = config.value_24bit_r;
+                ptr[1] = config.value_24bit_g;
+                ptr[2] = config.value_24bit_b;
+            }
+        } else if (config.fill_32bit) {
+            // fill with 32-bit values, the last one may overlap the end like the ones of the loops above
+            std::fill_n((u32*)start, (end - start + 3) / 4, config.value_32bit);
+        } else {
+            // fill with 16-bit values
+            std::fill_n((u16*)start, (end - start + 1) / 2, config.value_16bit);
+        }
+    }
+
+    LOG_TRACE(HW_GPU, "MemoryFill from 0x%08x to 0x%08x", config.GetStartAddress(), config.GetEndAddress());
+
+    g_regs.memory_fill_config[is_second_filler].trigger = 0;
+    g_regs.memory_fill_config[is_second_filler].finished = 1;
+
+    const s64 cycles = Pica::CostModel::MemoryFill(config.GetEndAddress() - config.GetStartAddress());
+    if (!is_second_filler) {
+        GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PSC0, cycles);
+    } else {
+        GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PSC1, cycles);
+    }
+
+    if (!accelerated)
+        VideoCore::g_renderer->hw_rasterizer->NotifyFlush(config.GetStartAddress(), config.GetEndAddress() - config.GetStartAddress());
+}
+
+/// Performs a display transfer and signals its completion
+static void PerformDisplayTransfer(const Regs::DisplayTransferConfig& config) {
+    u8* src_pointer = Memory::GetPhysicalPointer(config.GetPhysicalInputAddress());
+    u8* dst_pointer = Memory::GetPhysicalPointer(config.GetPhysicalOutputAddress());
+
+    if (config.scaling > config.ScaleXY) {
+        LOG_CRITICAL(HW_GPU, "Unimplemented display transfer scaling mode %u", config.scaling.Value());
+        UNIMPLEMENTED();
+        return;
+    }
+
+    unsigned horizontal_scale = (config.scaling != config.NoScale) ? 2 : 1;
+    unsigned vertical_scale = (config.scaling == config.ScaleXY) ? 2 : 1;
+
+    u32 output_width = config.output_width / horizontal_scale;
+    u32 output_height = config.output_height / vertical_scale;
+
+    u32 input_size = config.input_width * config.input_height * GPU::Regs::BytesPerPixel(config.input_format);
+    u32 output_size = output_width * output_height * GPU::Regs::BytesPerPixel(config.output_format);
+
+    if (!config.raw_copy && VideoCore::g_renderer->hw_rasterizer->AccelerateDisplayTransfer(config)) {
+        LOG_TRACE(HW_GPU, "DisplayTriggerTransfer: 0x%08x bytes from 0x%08x(%ux%u)-> 0x%08x(%ux%u), dst format %x, flags 0x%08X, Accelerated",
+                  output_size,
+                  config.GetPhysicalInputAddress(), config.input_width.Value(), config.input_height.Value(),
+                  config.GetPhysicalOutputAddress(), output_width, output_height,
+                  config.output_format.Value(), config.flags);
+
+        GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PPF, Pica::CostModel::DisplayTransfer(input_size, output_size));
+        return;
+    }
+
+    VideoCore::g_renderer->hw_rasterizer->NotifyPreRead(config.GetPhysicalInputAddress(), input_size);
+    MemoryStats::SampleGPURead(MemoryStats::GPURead::TransferSource, config.GetPhysicalInputAddress(), input_size);
+
+    if (config.raw_copy) {
+        // Raw copies do not perform color conversion nor tiled->linear / linear->tiled conversions
+        // TODO(Subv): Verify if raw copies perform scaling
+        memcpy(dst_pointer, src_pointer, output_size);
+
+        LOG_TRACE(HW_GPU, "DisplayTriggerTransfer: 0x%08x bytes from 0x%08x(%ux%u)-> 0x%08x(%ux%u), output format: %x, flags 0x%08X, Raw copy",
+            output_size,
+            config.GetPhysicalInputAddress(), config.input_width.Value(), config.input_height.Value(),
+            config.GetPhysicalOutputAddress(), config.output_width.Value(), config.output_height.Value(),
+            config.output_format.Value(), config.flags);
+
+        GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PPF, Pica::CostModel::DisplayTransfer(input_size, output_size));
+
+        VideoCore::g_renderer->hw_rasterizer->NotifyFlush(config.GetPhysicalOutputAddress(), output_size);
+        return;
+    }
+
+    const TransferKernel kernel = GetTransferKernel(config.input_format, config.output_format);
+    if (kernel != nullptr) {
+        kernel(config, src_pointer, dst_pointer, output_width, output_height, horizontal_scale, vertical_scale);
+    } else {
+        LOG_ERROR(HW_GPU, "Unknown display transfer formats %x -> %x",
+                  config.input_format.Value(), config.output_format.Value());
+    }
+
+    LOG_TRACE(HW_GPU, "DisplayTriggerTransfer: 0x%08x bytes from 0x%08x(%ux%u)-> 0x%08x(%ux%u), dst format %x, flags 0x%08X",
+              config.output_height * output_width * GPU::Regs::BytesPerPixel(config.output_format),
+              config.GetPhysicalInputAddress(), config.input_width.Value(), config.input_height.Value(),
+              config.GetPhysicalOutputAddress(), output_width, output_height,
+              config.output_format.Value(), config.flags);
+
+    GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PPF, Pica::CostModel::DisplayTransfer(input_size, output_size));
+
+    VideoCore::g_renderer->hw_rasterizer->NotifyFlush(config.GetPhysicalOutputAddress(), output_size);
+}
+
 template <typename T>
 inline void Write(u32 addr, const T data) {
     addr -= HW::VADDR_GPU;
@@ -64,6 +462,9 @@ inline void Write(u32 addr, const T data) {
         return;
     }
 
+    if (GPUCapture::IsCapturing())
+        GPUCapture::OnRegisterWrite(index, static_cast<u32>(data));
+
     g_regs[index] = static_cast<u32>(data);
 
     switch (index) {
@@ -73,191 +474,19 @@ inline void Write(u32 addr, const T data) {
     case GPU_REG_INDEX_WORKAROUND(memory_fill_config[1].trigger, 0x00008 + 0x3):
     {
         const bool is_second_filler = (index != GPU_REG_INDEX(memory_fill_config[0].trigger));
-        auto& config = g_regs.memory_fill_config[is_second_filler];
-
-        if (config.address_start && config.trigger) {
-            u8* start = Memory::GetPhysicalPointer(config.GetStartAddress());
-            u8* end = Memory::GetPhysicalPointer(config.GetEndAddress());
-
-            if (config.fill_24bit) {
-                // fill with 24-bit values
-                for (u8* ptr = start; ptr < end; ptr += 3) {
-                    ptr[0] = config.value_24bit_r;
-                    ptr[1] = config.value_24bit_g;
-                    ptr[2] = config.value_24bit_b;
-                }
-            } else if (config.fill_32bit) {
-                // fill with 32-bit values
-                for (u32* ptr = (u32*)start; ptr < (u32*)end; ++ptr)
-                    *ptr = config.value_32bit;
-            } else {
-                // fill with 16-bit values
-                for (u16* ptr = (u16*)start; ptr < (u16*)end; ++ptr)
-                    *ptr = config.value_16bit;
-            }
+        const auto config = g_regs.memory_fill_config[is_second_filler];
 
-            LOG_TRACE(HW_GPU, "MemoryFill from 0x%08x to 0x%08x", config.GetStartAddress(), config.GetEndAddress());
-
-            config.trigger = 0;
-            config.finished = 1;
-
-            if (!is_second_filler) {
-                GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PSC0);
-            } else {
-                GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PSC1);
-            }
-
-            VideoCore::g_renderer->hw_rasterizer->NotifyFlush(config.GetStartAddress(), config.GetEndAddress() - config.GetStartAddress());
-        }
+        // The registers may be set up for the next fill before the GPU thread gets to this one
+        if (config.address_start && config.trigger)
+            GPUThread::Run([config, is_second_filler] { PerformMemoryFill(config, is_second_filler); });
         break;
     }
 
     case GPU_REG_INDEX(display_transfer_config.trigger):
     {
-        const auto& config = g_regs.display_transfer_config;
-        if (config.trigger & 1) {
-            u8* src_pointer = Memory::GetPhysicalPointer(config.GetPhysicalInputAddress());
-            u8* dst_pointer = Memory::GetPhysicalPointer(config.GetPhysicalOutputAddress());
-
-            if (config.scaling > config.ScaleXY) {
-                LOG_CRITICAL(HW_GPU, "Unimplemented display transfer scaling mode %u", config.scaling.Value());
-                UNIMPLEMENTED();
-                break;
-            }
-
-            unsigned horizontal_scale = (config.scaling != config.NoScale) ? 2 : 1;
-            unsigned vertical_scale = (config.scaling == config.ScaleXY) ? 2 : 1;
-
-            u32 output_width = config.output_width / horizontal_scale;
-            u32 output_height = config.output_height / vertical_scale;
-
-            u32 input_size = config.input_width * config.input_height * GPU::Regs::BytesPerPixel(config.input_format);
-            u32 output_size = output_width * output_height * GPU::Regs::BytesPerPixel(config.output_format);
-
-            VideoCore::g_renderer->hw_rasterizer->NotifyPreRead(config.GetPhysicalInputAddress(), input_size);
-
-            if (config.raw_copy) {
-                // Raw copies do not perform color conversion nor tiled->linear / linear->tiled conversions
-                // TODO(Subv): Verify if raw copies perform scaling
-                memcpy(dst_pointer, src_pointer, output_size);
-
-                LOG_TRACE(HW_GPU, "DisplayTriggerTransfer: 0x%08x bytes from 0x%08x(%ux%u)-> 0x%08x(%ux%u), output format: %x, flags 0x%08X, Raw copy",
-                    output_size,
-                    config.GetPhysicalInputAddress(), config.input_width.Value(), config.input_height.Value(),
-                    config.GetPhysicalOutputAddress(), config.output_width.Value(), config.output_height.Value(),
-                    config.output_format.Value(), config.flags);
-
-                GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PPF);
-
-                VideoCore::g_renderer->hw_rasterizer->NotifyFlush(config.GetPhysicalOutputAddress(), output_size);
-                break;
-            }
-
-            // TODO(Subv): Implement the box filter when scaling is enabled
-            // right now we're just skipping the extra pixels.
-            for (u32 y = 0; y < output_height; ++y) {
-                for (u32 x = 0; x < output_width; ++x) {
-                    Math::Vec4<u8> src_color = { 0, 0, 0, 0 };
-
-                    // Calculate the [x,y] position of the input image
-                    // based on the current output position and the scale
-                    u32 input_x = x * horizontal_scale;
-                    u32 input_y = y * vertical_scale;
-
-                    if (config.flip_vertically) {
-                        // Flip the y value of the output data,
-                        // we do this after calculating the [x,y] position of the input image
-                        // to account for the scaling options.
-                        y = output_height - y - 1;
-                    }
-
-                    u32 dst_bytes_per_pixel = GPU::Regs::BytesPerPixel(config.output_format);
-                    u32 src_bytes_per_pixel = GPU::Regs::BytesPerPixel(config.input_format);
-                    u32 src_offset;
-                    u32 dst_offset;
-
-                    if (config.output_tiled) {
-                        // Interpret the input as linear and the output as tiled
-                        u32 coarse_y = y & ~7;
-                        u32 stride = output_width * dst_bytes_per_pixel;
-
-                        src_offset = (input_x + input_y * config.input_width) * src_bytes_per_pixel;
-                        dst_offset = VideoCore::GetMortonOffset(x, y, dst_bytes_per_pixel) + coarse_y * stride;
-                    } else {
-                        // Interpret the input as tiled and the output as linear
-                        u32 coarse_y = input_y & ~7;
-                        u32 stride = config.input_width * src_bytes_per_pixel;
-
-                        src_offset = VideoCore::GetMortonOffset(input_x, input_y, src_bytes_per_pixel) + coarse_y * stride;
-                        dst_offset = (x + y * output_width) * dst_bytes_per_pixel;
-                    }
-
-                    const u8* src_pixel = src_pointer + src_offset;
-                    switch (config.input_format) {
-                    case Regs::PixelFormat::RGBA8:
-                        src_color = Color::DecodeRGBA8(src_pixel);
-                        break;
-
-                    case Regs::PixelFormat::RGB8:
-                        src_color = Color::DecodeRGB8(src_pixel);
-                        break;
-
-                    case Regs::PixelFormat::RGB565:
-                        src_color = Color::DecodeRGB565(src_pixel);
-                        break;
-
-                    case Regs::PixelFormat::RGB5A1:
-                        src_color = Color::DecodeRGB5A1(src_pixel);
-                        break;
-
-                    case Regs::PixelFormat::RGBA4:
-                        src_color = Color::DecodeRGBA4(src_pixel);
-                        break;
-
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown source framebuffer format %x", config.input_format.Value());
-                        break;
-                    }
-
-                    u8* dst_pixel = dst_pointer + dst_offset;
-                    switch (config.output_format) {
-                    case Regs::PixelFormat::RGBA8:
-                        Color::EncodeRGBA8(src_color, dst_pixel);
-                        break;
-
-                    case Regs::PixelFormat::RGB8:
-                        Color::EncodeRGB8(src_color, dst_pixel);
-                        break;
-
-                    case Regs::PixelFormat::RGB565:
-                        Color::EncodeRGB565(src_color, dst_pixel);
-                        break;
-
-                    case Regs::PixelFormat::RGB5A1:
-                        Color::EncodeRGB5A1(src_color, dst_pixel);
-                        break;
-
-                    case Regs::PixelFormat::RGBA4:
-                        Color::EncodeRGBA4(src_color, dst_pixel);
-                        break;
-
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown destination framebuffer format %x", config.output_format.Value());
-                        break;
-                    }
-                }
-            }
-
-            LOG_TRACE(HW_GPU, "DisplayTriggerTransfer: 0x%08x bytes from 0x%08x(%ux%u)-> 0x%08x(%ux%u), dst format %x, flags 0x%08X",
-                      config.output_height * output_width * GPU::Regs::BytesPerPixel(config.output_format),
-                      config.GetPhysicalInputAddress(), config.input_width.Value(), config.input_height.Value(),
-                      config.GetPhysicalOutputAddress(), output_width, output_height,
-                      config.output_format.Value(), config.flags);
-
-            GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PPF);
-
-            VideoCore::g_renderer->hw_rasterizer->NotifyFlush(config.GetPhysicalOutputAddress(), output_size);
-        }
+        const auto config = g_regs.display_transfer_config;
+        if (config.trigger & 1)
+            GPUThread::Run([config] { PerformDisplayTransfer(config); });
         break;
     }
 
@@ -267,8 +496,13 @@ inline void Write(u32 addr, const T data) {
         const auto& config = g_regs.command_processor_config;
         if (config.trigger & 1)
         {
-            u32* buffer = (u32*)Memory::GetPhysicalPointer(config.GetPhysicalAddress());
-            Pica::CommandProcessor::ProcessCommandList(buffer, config.size);
+            const PAddr address = config.GetPhysicalAddress();
+            const u32 size = config.size;
+            GPUThread::Run([address, size] {
+                u32* buffer = (u32*)Memory::GetPhysicalPointer(address);
+                MemoryStats::SampleGPURead(MemoryStats::GPURead::CommandList, address, size);
+                Pica::CommandProcessor::ProcessCommandList(buffer, size);
+            });
         }
         break;
     }
@@ -290,11 +524,36 @@ template void Write<u32>(u32 addr, const u32 data);
 template void Write<u16>(u32 addr, const u16 data);
 template void Write<u8>(u32 addr, const u8 data);
 
+void PresentFrame() {
+    // Let the GPU thread fall at most one frame behind, the CPU would run away from it otherwise
+    GPUThread::WaitFor(last_swap);
+    last_swap = GPUThread::Run([] { VideoCore::g_renderer->SwapBuffers(); });
+}
+
+#if ENABLE_ALLOCATION_COUNTING
+/// Heap allocations of all threads per emulated frame, which steady emulation shouldn't make
+static Common::Perf::Counter heap_allocations_counter("Heap allocations");
+static Common::Perf::Histogram heap_allocations_histogram("Heap allocations per frame", {
+    0, 1, 4, 16, 64, 256, 1024,
+});
+static u64 last_num_heap_allocations;
+#endif
+
 /// Update hardware
 static void VBlankCallback(u64 userdata, int cycles_late) {
     frame_count++;
+
+#if ENABLE_ALLOCATION_COUNTING
+    const u64 num_heap_allocations = Common::MemoryAccounting::GetNumHeapAllocations();
+    heap_allocations_counter.Add(num_heap_allocations - last_num_heap_allocations);
+    heap_allocations_histogram.AddSample(static_cast<s64>(num_heap_allocations - last_num_heap_allocations));
+    last_num_heap_allocations = num_heap_allocations;
+#endif
+
+    Rewind::OnFrame();
     last_skip_frame = g_skip_frame;
-    g_skip_frame = (frame_count & Settings::values.frame_skip) != 0;
+    if (!Settings::values.dynamic_frame_skip)
+        g_skip_frame = (frame_count & Settings::values.frame_skip) != 0;
 
     // Swap buffers based on the frameskip mode, which is a little bit tricky. When
     // a frame is being skipped, nothing is being rendered to the internal framebuffer(s).
@@ -302,10 +561,25 @@ static void VBlankCallback(u64 userdata, int cycles_late) {
     //  - If frameskip == 0 (disabled), always swap buffers
     //  - If frameskip == 1, swap buffers every other frame (starting from the first frame)
     //  - If frameskip > 1, swap buffers every frameskip^n frames (starting from the second frame)
-    if ((((Settings::values.frame_skip != 1) ^ last_skip_frame) && last_skip_frame != g_skip_frame) ||
-            Settings::values.frame_skip == 0) {
-        VideoCore::g_renderer->SwapBuffers();
-    }
+    // With dynamic frameskip, every frame that was rendered is shown.
+    const bool swap = Settings::values.dynamic_frame_skip ? !last_skip_frame :
+            ((((Settings::values.frame_skip != 1) ^ last_skip_frame) && last_skip_frame != g_skip_frame) ||
+             Settings::values.frame_skip == 0);
+    if (swap)
+        PresentFrame();
+    VideoCore::EndFrame();
+    GPUCapture::OnFrame(swap);
+    BootSnapshot::OnFrame();
+
+    // Window events have to be handled on the thread that created the window
+    if (GPUThread::IsEnabled())
+        VideoCore::g_emu_window->PollEvents();
+
+    // Keep pace with the host once the frame is on its way to the screen, skipping the rendering of
+    // the next one if emulation fell behind
+    const bool behind = FrameLimiter::EndFrame();
+    if (Settings::values.dynamic_frame_skip)
+        g_skip_frame = behind;
 
     // Signal to GSP that GPU interrupt has occurred
     // TODO(yuriks): hwtest to determine if PDC0 is for the Top screen and PDC1 for the Sub
@@ -315,14 +589,6 @@ static void VBlankCallback(u64 userdata, int cycles_late) {
     GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PDC0);
     GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::PDC1);
 
-    // TODO(bunnei): Fake a DSP interrupt on each frame. This does not belong here, but
-    // until we can emulate DSP interrupts, this is probably the only reasonable place to do
-    // this. Certain games expect this to be periodically signaled.
-    DSP_DSP::SignalInterrupt();
-
-    // Check for user input updates
-    Service::HID::Update();
-
     // Reschedule recurrent event
     CoreTiming::ScheduleEvent(frame_ticks - cycles_late, vblank_event);
 }
@@ -360,6 +626,8 @@ void Init() {
     last_skip_frame = false;
     g_skip_frame = false;
     frame_count = 0;
+    last_swap = 0;
+    FrameLimiter::Init();
 
     vblank_event = CoreTiming::RegisterEvent("GPU::VBlankCallback", VBlankCallback);
     CoreTiming::ScheduleEvent(frame_ticks, vblank_event);
@@ -367,9 +635,21 @@ void Init() {
     LOG_DEBUG(HW_GPU, "initialized OK");
 }
 
+u64 GetFrameCount() {
+    return frame_count;
+}
+
 /// Shutdown hardware
 void Shutdown() {
     LOG_DEBUG(HW_GPU, "shutdown OK");
 }
 
+void DoState(PointerWrap& p) {
+    p.DoVoid(&g_regs, sizeof(g_regs));
+    p.Do(g_skip_frame);
+    p.Do(frame_count);
+    p.Do(last_skip_frame);
+    p.DoMarker("GPU");
+}
+
 } // namespace
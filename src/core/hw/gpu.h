@@ -11,6 +11,8 @@
 #include "common/common_funcs.h"
 #include "common/common_types.h"
 
+class PointerWrap;
+
 namespace GPU {
 
 // Returns index corresponding to the Regs member labeled by field_name
@@ -77,7 +79,7 @@ struct Regs {
 
     INSERT_PADDING_WORDS(0x4);
 
-    struct {
+    struct MemoryFillConfig {
         u32 address_start;
         u32 address_end;
 
@@ -164,7 +166,7 @@ struct Regs {
 
     INSERT_PADDING_WORDS(0x169);
 
-    struct {
+    struct DisplayTransferConfig {
         u32 input_address;
         u32 output_address;
 
@@ -288,6 +290,7 @@ ASSERT_REG_POSITION(command_processor_config, 0x00638);
 static_assert(sizeof(Regs) == 0x1000 * sizeof(u32), "Invalid total size of register set");
 
 extern Regs g_regs;
+/// Whether the current frame isn't drawn, the PICA registers are still written and interrupts raised
 extern bool g_skip_frame;
 
 template <typename T>
@@ -299,8 +302,17 @@ void Write(u32 addr, const T data);
 /// Initialize hardware
 void Init();
 
+/// Number of frames emulated since the GPU was initialized, counted on VBlank
+u64 GetFrameCount();
+
+/// Shows the frame rendered last, once the GPU thread is done with the one before it
+void PresentFrame();
+
 /// Shutdown hardware
 void Shutdown();
 
+/// Saves or restores the state of the hardware registers
+void DoState(PointerWrap& p);
+
 
 } // namespace
@@ -2,41 +2,87 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <memory>
+#include <vector>
+
+#include "common/chunk_file.h"
 #include "common/common_types.h"
 #include "common/logging/log.h"
 
+#include "core/memory_setup.h"
+#include "core/mmio.h"
 #include "core/hw/hw.h"
 #include "core/hw/gpu.h"
 #include "core/hw/lcd.h"
 
 namespace HW {
 
+/// Forwards the accesses to an MMIO region to the Read and Write templates of a device
+template <typename Device>
+class DeviceRegion final : public Memory::MMIORegion {
+public:
+    u8 Read8(VAddr addr) override { return Read<u8>(addr); }
+    u16 Read16(VAddr addr) override { return Read<u16>(addr); }
+    u32 Read32(VAddr addr) override { return Read<u32>(addr); }
+    u64 Read64(VAddr addr) override { return Read<u64>(addr); }
+
+    void Write8(VAddr addr, u8 data) override { Device::Write(addr, data); }
+    void Write16(VAddr addr, u16 data) override { Device::Write(addr, data); }
+    void Write32(VAddr addr, u32 data) override { Device::Write(addr, data); }
+    void Write64(VAddr addr, u64 data) override { Device::Write(addr, data); }
+
+private:
+    template <typename T>
+    static T Read(VAddr addr) {
+        T value = 0;
+        Device::Read(value, addr);
+        return value;
+    }
+};
+
+struct GPUDevice {
+    template <typename T> static void Read(T& var, u32 addr) { GPU::Read(var, addr); }
+    template <typename T> static void Write(u32 addr, T data) { GPU::Write(addr, data); }
+};
+
+struct LCDDevice {
+    template <typename T> static void Read(T& var, u32 addr) { LCD::Read(var, addr); }
+    template <typename T> static void Write(u32 addr, T data) { LCD::Write(addr, data); }
+};
+
+struct DeviceMapping {
+    VAddr base;
+    u32 size;
+    Memory::MMIORegionPointer region;
+};
+
+/// Register blocks of the emulated devices, mapped into the address space while the system runs
+static std::vector<DeviceMapping> device_mappings;
+
+static void MapDevice(VAddr base, u32 size, Memory::MMIORegionPointer region) {
+    size = (size + Memory::PAGE_MASK) & ~Memory::PAGE_MASK;
+    Memory::MapIoRegion(base, size, region.get());
+    device_mappings.push_back({ base, size, std::move(region) });
+}
+
 template <typename T>
-inline void Read(T &var, const u32 addr) {
-    switch (addr & 0xFFFFF000) {
-    case VADDR_GPU:
-        GPU::Read(var, addr);
-        break;
-    case VADDR_LCD:
-        LCD::Write(var, addr);
-        break;
-    default:
+void Read(T &var, const u32 addr) {
+    Memory::MMIORegion* region = Memory::GetMMIORegion(addr);
+    if (region == nullptr) {
         LOG_ERROR(HW_Memory, "unknown Read%lu @ 0x%08X", sizeof(var) * 8, addr);
+        return;
     }
+    var = region->Read<T>(addr);
 }
 
 template <typename T>
-inline void Write(u32 addr, const T data) {
-    switch (addr & 0xFFFFF000) {
-    case VADDR_GPU:
-        GPU::Write(addr, data);
-        break;
-    case VADDR_LCD:
-        LCD::Write(addr, data);
-        break;
-    default:
+void Write(u32 addr, const T data) {
+    Memory::MMIORegion* region = Memory::GetMMIORegion(addr);
+    if (region == nullptr) {
         LOG_ERROR(HW_Memory, "unknown Write%lu 0x%08X @ 0x%08X", sizeof(data) * 8, (u32)data, addr);
+        return;
     }
+    region->Write<T>(addr, data);
 }
 
 // Explicitly instantiate template functions because we aren't defining this in the header:
@@ -59,14 +105,25 @@ void Update() {
 void Init() {
     GPU::Init();
     LCD::Init();
+    MapDevice(VADDR_GPU, (u32)(GPU::Regs::NumIds() * sizeof(u32)), std::make_shared<DeviceRegion<GPUDevice>>());
+    MapDevice(VADDR_LCD, (u32)(LCD::Regs::NumIds() * sizeof(u32)), std::make_shared<DeviceRegion<LCDDevice>>());
     LOG_DEBUG(HW, "initialized OK");
 }
 
 /// Shutdown hardware
 void Shutdown() {
+    for (const DeviceMapping& mapping : device_mappings)
+        Memory::UnmapRegion(mapping.base, mapping.size);
+    device_mappings.clear();
+
     GPU::Shutdown();
     LCD::Shutdown();
     LOG_DEBUG(HW, "shutdown OK");
 }
 
+void DoState(PointerWrap& p) {
+    GPU::DoState(p);
+    LCD::DoState(p);
+}
+
 }
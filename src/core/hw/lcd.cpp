@@ -4,6 +4,7 @@
 
 #include <cstring>
 
+#include "common/chunk_file.h"
 #include "common/common_types.h"
 #include "common/logging/log.h"
 
@@ -67,4 +68,9 @@ void Shutdown() {
     LOG_DEBUG(HW_LCD, "shutdown OK");
 }
 
+void DoState(PointerWrap& p) {
+    p.DoVoid(&g_regs, sizeof(g_regs));
+    p.DoMarker("LCD");
+}
+
 } // namespace
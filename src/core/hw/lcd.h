@@ -10,6 +10,8 @@
 #include "common/common_funcs.h"
 #include "common/common_types.h"
 
+class PointerWrap;
+
 #define LCD_REG_INDEX(field_name) (offsetof(LCD::Regs, field_name) / sizeof(u32))
 
 namespace LCD {
@@ -86,4 +88,7 @@ void Init();
 /// Shutdown hardware
 void Shutdown();
 
+/// Saves or restores the state of the hardware registers
+void DoState(PointerWrap& p);
+
 } // namespace
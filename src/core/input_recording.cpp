@@ -0,0 +1,158 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <vector>
+
+#include "common/file_util.h"
+#include "common/logging/log.h"
+
+#include "core/input_recording.h"
+#include "core/hle/service/hid/hid.h"
+#include "core/hw/gpu.h"
+#include "core/loader/loader.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace InputRecording
+
+namespace InputRecording {
+
+static const u32 RECORDING_MAGIC = Loader::MakeMagic('C', 'I', 'N', 'P');
+/// Version of the layout of a recording, to be bumped whenever the entries change
+static const u32 RECORDING_VERSION = 1;
+
+struct RecordingHeader {
+    u32 magic;
+    u32 version;
+};
+static_assert(sizeof(RecordingHeader) == 8, "RecordingHeader has incorrect size");
+
+/// Input from the given frame on, up to the next entry
+struct InputEntry {
+    u64 frame;
+    u32 pad_state;
+    u16 touch_x;
+    u16 touch_y;
+    u32 touch_pressed;
+    u32 reserved;
+};
+static_assert(sizeof(InputEntry) == 24, "InputEntry has incorrect size");
+
+static FileUtil::IOFile recording_file;
+static bool recording = false;
+/// Input the last entry that was recorded holds
+static InputEntry last_recorded;
+
+static std::vector<InputEntry> replay_entries;
+static bool replaying = false;
+/// Entry holding the current input under replay, the one before next_replay_entry
+static size_t next_replay_entry;
+static InputEntry replay_input;
+
+bool StartRecording(const std::string& path) {
+    const RecordingHeader header = { RECORDING_MAGIC, RECORDING_VERSION };
+    if (!recording_file.Open(path, "wb") || recording_file.WriteArray(&header, 1) != 1) {
+        LOG_ERROR(Core, "Can't create the input recording %s", path.c_str());
+        recording_file.Close();
+        return false;
+    }
+
+    // The first sample is always recorded
+    last_recorded = {};
+    last_recorded.frame = ~0ull;
+    recording = true;
+    LOG_INFO(Core, "Recording input to %s", path.c_str());
+    return true;
+}
+
+bool StartReplay(const std::string& path) {
+    FileUtil::IOFile file(path, "rb");
+    RecordingHeader header;
+    if (!file.IsOpen() || file.ReadArray(&header, 1) != 1 || header.magic != RECORDING_MAGIC) {
+        LOG_ERROR(Core, "%s isn't an input recording", path.c_str());
+        return false;
+    }
+    if (header.version != RECORDING_VERSION) {
+        LOG_ERROR(Core, "%s has version %u, this build reads version %u", path.c_str(),
+                  header.version, RECORDING_VERSION);
+        return false;
+    }
+
+    const u64 num_entries = (file.GetSize() - sizeof(header)) / sizeof(InputEntry);
+    replay_entries.resize(static_cast<size_t>(num_entries));
+    if (file.ReadArray(replay_entries.data(), replay_entries.size()) != replay_entries.size()) {
+        LOG_ERROR(Core, "Can't read the input recording %s", path.c_str());
+        replay_entries.clear();
+        return false;
+    }
+
+    // Until the first entry, nothing is pressed
+    replay_input = {};
+    next_replay_entry = 0;
+    replaying = true;
+    LOG_INFO(Core, "Replaying %u input changes from %s", (unsigned)replay_entries.size(), path.c_str());
+    return true;
+}
+
+bool IsReplaying() {
+    return replaying;
+}
+
+u64 GetFirstInputFrame() {
+    for (const InputEntry& entry : replay_entries) {
+        if (entry.pad_state != 0 || entry.touch_pressed != 0)
+            return entry.frame;
+    }
+    return 0;
+}
+
+void ProcessInput(Service::HID::PadState& pad_state, std::tuple<u16, u16, bool>& touch_state) {
+    const u64 frame = GPU::GetFrameCount();
+
+    if (replaying) {
+        while (next_replay_entry < replay_entries.size() && replay_entries[next_replay_entry].frame <= frame) {
+            replay_input = replay_entries[next_replay_entry++];
+            if (next_replay_entry == replay_entries.size())
+                LOG_INFO(Core, "Replayed the last input change, at frame %llu", (unsigned long long)frame);
+        }
+        pad_state.hex = replay_input.pad_state;
+        touch_state = std::make_tuple(replay_input.touch_x, replay_input.touch_y, replay_input.touch_pressed != 0);
+        return;
+    }
+
+    if (!recording)
+        return;
+
+    InputEntry entry = {};
+    entry.frame = frame;
+    entry.pad_state = pad_state.hex;
+    bool pressed;
+    std::tie(entry.touch_x, entry.touch_y, pressed) = touch_state;
+    entry.touch_pressed = pressed ? 1 : 0;
+
+    if (last_recorded.frame != ~0ull && entry.pad_state == last_recorded.pad_state &&
+            entry.touch_x == last_recorded.touch_x && entry.touch_y == last_recorded.touch_y &&
+            entry.touch_pressed == last_recorded.touch_pressed) {
+        return;
+    }
+
+    // Flushed right away, so that a run that crashes still leaves the input that led there
+    if (recording_file.WriteArray(&entry, 1) != 1 || !recording_file.Flush()) {
+        LOG_ERROR(Core, "Failed to write to the input recording, it ends at frame %llu", (unsigned long long)frame);
+        recording_file.Close();
+        recording = false;
+        return;
+    }
+    last_recorded = entry;
+}
+
+void Shutdown() {
+    if (recording) {
+        recording_file.Close();
+        recording = false;
+    }
+    replay_entries.clear();
+    replaying = false;
+}
+
+} // namespace
@@ -0,0 +1,60 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+#include <tuple>
+
+#include "common/common_types.h"
+
+namespace Service {
+namespace HID {
+struct PadState;
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace InputRecording
+
+/**
+ * Recordings of the input the HID service samples, keyed to the emulated frame it was sampled
+ * during, for playing the same input to a title again in later runs, e.g. to compare the
+ * performance of builds on identical workloads.
+ *
+ * While replaying, the frontend's input is ignored and the HID service only samples on its
+ * periodic updates, which happen at the same emulated times in every run. A recorded change takes
+ * effect at the first sample of the frame it was recorded during.
+ */
+namespace InputRecording {
+
+/**
+ * Records the input sampled from now on, until the emulated system is shut down. To be called
+ * before the title boots.
+ * @return Whether the recording file could be created
+ */
+bool StartRecording(const std::string& path);
+
+/**
+ * Replays a recording instead of the frontend's input. To be called before the title boots.
+ * @return Whether the recording could be read
+ */
+bool StartReplay(const std::string& path);
+
+/// Whether a recording is being replayed, the frontend's input is ignored then
+bool IsReplaying();
+
+/// Frame of the first input of the replayed recording that presses anything, 0 if there's none
+u64 GetFirstInputFrame();
+
+/**
+ * Passes the input sampled by the HID service through: records it, or replaces it with the
+ * recorded input when replaying
+ */
+void ProcessInput(Service::HID::PadState& pad_state, std::tuple<u16, u16, bool>& touch_state);
+
+/// Completes the recording, and forgets the replayed one
+void Shutdown();
+
+} // namespace
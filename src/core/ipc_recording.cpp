@@ -0,0 +1,454 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "common/file_util.h"
+#include "common/logging/log.h"
+
+#include "core/core_timing.h"
+#include "core/ipc_recording.h"
+#include "core/mem_map.h"
+#include "core/memory.h"
+#include "core/hle/ipc.h"
+#include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/process.h"
+#include "core/hle/kernel/resource_limit.h"
+#include "core/hle/kernel/session.h"
+#include "core/hle/service/service.h"
+#include "core/loader/loader.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace IPCRecording
+
+namespace IPCRecording {
+
+using Common::Profiling::Clock;
+using Common::Profiling::Duration;
+
+static const u32 RECORDING_MAGIC = Loader::MakeMagic('C', 'I', 'P', 'C');
+/// Version of the layout of a recording, to be bumped whenever the entries change
+static const u32 RECORDING_VERSION = 1;
+
+/// Buffers larger than this are recorded without their contents
+static const u32 MAX_BUFFER_CONTENTS = 16 * 1024 * 1024;
+
+struct RecordingHeader {
+    u32 magic;
+    u32 version;
+    /// Program id of the title that made the calls, the save data archives it opens depend on it
+    u64 program_id;
+};
+static_assert(sizeof(RecordingHeader) == 16, "RecordingHeader has incorrect size");
+
+/// A call, followed by its handles and then its buffers
+struct CallEntry {
+    /// Port name of the service, or the type of the session
+    char name[16];
+    /// Id of the session object the request was sent to
+    u32 session_id;
+    u32 num_handles;
+    u32 num_buffers;
+    u32 reserved;
+    u64 host_time_ns;
+    u32 request[IPC::COMMAND_BUFFER_LENGTH];
+    u32 response[IPC::COMMAND_BUFFER_LENGTH];
+};
+static_assert(sizeof(CallEntry) == 40 + 2 * 4 * IPC::COMMAND_BUFFER_LENGTH, "CallEntry has incorrect size");
+
+/// A handle in the request, or a handle to an object the call created in the response
+struct HandleEntry {
+    /// Index of the word of the command buffer holding the handle
+    u32 word_index;
+    u32 object_id;
+    u32 in_response;
+    u32 reserved;
+};
+static_assert(sizeof(HandleEntry) == 16, "HandleEntry has incorrect size");
+
+/// A buffer described by the request, followed by its contents if the service may read them
+struct BufferEntry {
+    /// Index of the word of the command buffer holding the address of the buffer
+    u32 word_index;
+    u32 size;
+    u32 has_contents;
+    u32 reserved;
+};
+static_assert(sizeof(BufferEntry) == 16, "BufferEntry has incorrect size");
+
+static FileUtil::IOFile recording_file;
+static bool recording = false;
+/// The header is written with the first call, once the title's process exists
+static bool header_written;
+
+/// The call in progress
+static CallEntry current_call;
+static std::vector<HandleEntry> current_handles;
+static std::vector<BufferEntry> current_buffers;
+/// Contents of the buffers which have them, one after the other
+static std::vector<u8> current_contents;
+/// Objects with this id or a larger one were created by the call in progress
+static unsigned int first_new_object_id;
+static Clock::time_point call_start;
+
+struct RecordedCall {
+    CallEntry entry;
+    std::vector<HandleEntry> handles;
+    std::vector<BufferEntry> buffers;
+    /// Offset of the contents of each buffer in replay_data, for the buffers which have them
+    std::vector<size_t> contents_offsets;
+};
+
+static std::vector<u8> replay_data;
+static std::vector<RecordedCall> replay_calls;
+static size_t next_replay_call;
+/// Address of the heap block the buffers of the replayed calls are placed in
+static VAddr scratch_address;
+/// Objects created by the replayed calls, by the id the recorded ones had
+static std::unordered_map<u32, Kernel::SharedPtr<Kernel::Object>> replayed_objects;
+
+/**
+ * Calls on_handle(word_index) for each handle and on_buffer(word_index, size, readable) for each
+ * buffer the translate parameters of a request describe, with the index of the word holding the
+ * handle or the address of the buffer.
+ */
+template <typename HandleFunc, typename BufferFunc>
+static void ForEachTranslateParam(const u32* cmd_buff, HandleFunc on_handle, BufferFunc on_buffer) {
+    IPC::Header header;
+    header.raw = cmd_buff[0];
+    size_t index = 1 + header.normal_params;
+    const size_t end = std::min<size_t>(index + header.translate_params_size, IPC::COMMAND_BUFFER_LENGTH);
+
+    while (index + 1 < end) {
+        const u32 descriptor = cmd_buff[index];
+        switch (IPC::GetDescriptorType(descriptor)) {
+        case IPC::CopyHandle:
+        case IPC::MoveHandle:
+        {
+            const size_t last = std::min<size_t>(index + IPC::HandleNumberFromDesc(descriptor), end - 1);
+            for (size_t word = index + 1; word <= last; ++word)
+                on_handle(word);
+            index = last + 1;
+            break;
+        }
+
+        case IPC::CallingPid:
+            index += 2;
+            break;
+
+        case IPC::StaticBuffer:
+        {
+            IPC::StaticBufferDescInfo info;
+            info.raw = descriptor;
+            on_buffer(index + 1, info.size.Value(), true);
+            index += 2;
+            break;
+        }
+
+        case IPC::PXIBuffer:
+        {
+            IPC::PXIBufferDescInfo info;
+            info.raw = descriptor;
+            on_buffer(index + 1, info.size.Value(), true);
+            index += 2;
+            break;
+        }
+
+        case IPC::MappedBuffer:
+        {
+            IPC::MappedBufferDescInfo info;
+            info.raw = descriptor;
+            on_buffer(index + 1, info.size.Value(), (info.permissions.Value() & IPC::R) != 0);
+            index += 2;
+            break;
+        }
+        }
+    }
+}
+
+bool StartRecording(const std::string& path) {
+    if (!recording_file.Open(path, "wb")) {
+        LOG_ERROR(Service, "Can't create the IPC recording %s", path.c_str());
+        return false;
+    }
+
+    header_written = false;
+    recording = true;
+    LOG_INFO(Service, "Recording service calls to %s", path.c_str());
+    return true;
+}
+
+bool IsRecording() {
+    return recording;
+}
+
+void BeginCall(const Kernel::Session* session, const char* name) {
+    const u32* cmd_buff = Kernel::GetCommandBuffer();
+
+    current_call = {};
+    std::strncpy(current_call.name, name, sizeof(current_call.name) - 1);
+    current_call.session_id = session->GetObjectId();
+    std::memcpy(current_call.request, cmd_buff, sizeof(current_call.request));
+
+    current_handles.clear();
+    current_buffers.clear();
+    current_contents.clear();
+    ForEachTranslateParam(cmd_buff,
+        [cmd_buff](size_t word) {
+            Kernel::SharedPtr<Kernel::Object> object = Kernel::g_handle_table.GetGeneric(cmd_buff[word]);
+            if (object != nullptr)
+                current_handles.push_back({ static_cast<u32>(word), object->GetObjectId(), 0, 0 });
+        },
+        [cmd_buff](size_t word, u32 size, bool readable) {
+            const bool has_contents = readable && size <= MAX_BUFFER_CONTENTS;
+            current_buffers.push_back({ static_cast<u32>(word), size, has_contents, 0 });
+            if (has_contents) {
+                const size_t offset = current_contents.size();
+                current_contents.resize(offset + size);
+                Memory::ReadBlock(cmd_buff[word], current_contents.data() + offset, size);
+            }
+        });
+
+    first_new_object_id = Kernel::Object::next_object_id;
+    call_start = Clock::now();
+}
+
+static void StopRecording() {
+    LOG_ERROR(Service, "Failed to write to the IPC recording, it ends here");
+    recording_file.Close();
+    recording = false;
+}
+
+void EndCall() {
+    current_call.host_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - call_start).count();
+
+    const u32* cmd_buff = Kernel::GetCommandBuffer();
+    std::memcpy(current_call.response, cmd_buff, sizeof(current_call.response));
+
+    // Handles aren't always described in responses, so the words are looked for handles to new objects
+    for (size_t word = 1; word < IPC::COMMAND_BUFFER_LENGTH; ++word) {
+        Kernel::SharedPtr<Kernel::Object> object = Kernel::g_handle_table.GetGeneric(cmd_buff[word]);
+        if (object != nullptr && object->GetObjectId() >= first_new_object_id)
+            current_handles.push_back({ static_cast<u32>(word), object->GetObjectId(), 1, 0 });
+    }
+    current_call.num_handles = static_cast<u32>(current_handles.size());
+    current_call.num_buffers = static_cast<u32>(current_buffers.size());
+
+    if (!header_written) {
+        const u64 program_id = Kernel::g_current_process != nullptr ? Kernel::g_current_process->program_id : 0;
+        const RecordingHeader header = { RECORDING_MAGIC, RECORDING_VERSION, program_id };
+        if (recording_file.WriteArray(&header, 1) != 1)
+            return StopRecording();
+        header_written = true;
+    }
+
+    if (recording_file.WriteArray(&current_call, 1) != 1 ||
+            recording_file.WriteArray(current_handles.data(), current_handles.size()) != current_handles.size())
+        return StopRecording();
+
+    const u8* contents = current_contents.data();
+    for (const BufferEntry& buffer : current_buffers) {
+        if (recording_file.WriteArray(&buffer, 1) != 1)
+            return StopRecording();
+        if (buffer.has_contents) {
+            if (recording_file.WriteBytes(contents, buffer.size) != buffer.size)
+                return StopRecording();
+            contents += buffer.size;
+        }
+    }
+}
+
+void Shutdown() {
+    if (recording) {
+        recording_file.Close();
+        recording = false;
+    }
+
+    replay_data.clear();
+    replay_data.shrink_to_fit();
+    replay_calls.clear();
+    replayed_objects.clear();
+}
+
+/// Reads the next value of the loaded recording
+template <typename T>
+static bool ReadValue(size_t& position, T& value) {
+    if (replay_data.size() - position < sizeof(T))
+        return false;
+    std::memcpy(&value, &replay_data[position], sizeof(T));
+    position += sizeof(T);
+    return true;
+}
+
+/// Space a buffer takes in the scratch heap block, it keeps its offset into the page
+static u32 GetScratchSize(u32 size) {
+    return ((size + Memory::PAGE_MASK) & ~Memory::PAGE_MASK) + Memory::PAGE_SIZE;
+}
+
+bool LoadRecording(const std::string& path) {
+    FileUtil::IOFile file(path, "rb");
+    replay_data.resize(file.IsOpen() ? static_cast<size_t>(file.GetSize()) : 0);
+    if (!file.IsOpen() || file.ReadBytes(replay_data.data(), replay_data.size()) != replay_data.size()) {
+        LOG_ERROR(Service, "Can't read the IPC recording %s", path.c_str());
+        return false;
+    }
+
+    size_t position = 0;
+    RecordingHeader header;
+    if (!ReadValue(position, header) || header.magic != RECORDING_MAGIC) {
+        LOG_ERROR(Service, "%s isn't an IPC recording", path.c_str());
+        return false;
+    }
+    if (header.version != RECORDING_VERSION) {
+        LOG_ERROR(Service, "%s has version %u, this build reads version %u", path.c_str(),
+                  header.version, RECORDING_VERSION);
+        return false;
+    }
+
+    replay_calls.clear();
+    u32 scratch_size = 0;
+    while (position < replay_data.size()) {
+        RecordedCall call;
+        bool complete = ReadValue(position, call.entry);
+        call.handles.resize(complete ? call.entry.num_handles : 0);
+        for (HandleEntry& handle : call.handles)
+            complete = complete && ReadValue(position, handle) && handle.word_index < IPC::COMMAND_BUFFER_LENGTH;
+
+        u32 call_scratch_size = 0;
+        call.buffers.resize(complete ? call.entry.num_buffers : 0);
+        for (BufferEntry& buffer : call.buffers) {
+            complete = complete && ReadValue(position, buffer) && buffer.word_index < IPC::COMMAND_BUFFER_LENGTH;
+            call.contents_offsets.push_back(position);
+            if (complete && buffer.has_contents) {
+                complete = replay_data.size() - position >= buffer.size;
+                position += buffer.size;
+            }
+            call_scratch_size += GetScratchSize(buffer.size);
+        }
+
+        if (!complete) {
+            LOG_WARNING(Service, "IPC recording %s is truncated after %u calls", path.c_str(),
+                        (unsigned)replay_calls.size());
+            break;
+        }
+        scratch_size = std::max(scratch_size, call_scratch_size);
+        replay_calls.push_back(std::move(call));
+    }
+
+    // The calls are made from a process of the title, which exists only for them
+    if (Kernel::g_current_process == nullptr) {
+        Kernel::g_current_process = Kernel::Process::Create("IPC replay", header.program_id);
+        Kernel::g_current_process->svc_access_mask.set();
+        Kernel::g_current_process->resource_limit =
+                Kernel::ResourceLimit::GetForCategory(Kernel::ResourceLimitCategory::APPLICATION);
+        Kernel::g_current_process->Run(Memory::PROCESS_IMAGE_VADDR, 48, Kernel::DEFAULT_STACK_SIZE);
+    }
+
+    scratch_address = 0;
+    if (scratch_size != 0) {
+        // Committed (3) read-write (3) memory
+        scratch_address = Memory::MapBlock_Heap(scratch_size, 3, 3);
+        if (scratch_address == 0) {
+            LOG_ERROR(Service, "Can't allocate 0x%08X bytes for the buffers of the IPC recording", scratch_size);
+            return false;
+        }
+    }
+
+    next_replay_call = 0;
+    replayed_objects.clear();
+    LOG_INFO(Service, "Replaying %u service calls from %s", (unsigned)replay_calls.size(), path.c_str());
+    return true;
+}
+
+size_t GetNumCalls() {
+    return replay_calls.size();
+}
+
+/// The session a recorded call is made to again, nullptr if there is none in this system
+static Kernel::SharedPtr<Kernel::Session> FindSession(const CallEntry& entry, const std::string& name) {
+    auto object = replayed_objects.find(entry.session_id);
+    if (object != replayed_objects.end() && object->second->GetHandleType() == Kernel::HandleType::Session)
+        return boost::static_pointer_cast<Kernel::Session>(object->second);
+
+    auto service = Service::g_srv_services.find(name);
+    if (service != Service::g_srv_services.end())
+        return service->second;
+    auto port = Service::g_kernel_named_ports.find(name);
+    if (port != Service::g_kernel_named_ports.end())
+        return port->second;
+    return nullptr;
+}
+
+bool ReplayNextCall(ReplayedCall& call) {
+    if (next_replay_call >= replay_calls.size())
+        return false;
+
+    const RecordedCall& recorded = replay_calls[next_replay_call++];
+    const CallEntry& entry = recorded.entry;
+    call.name.assign(entry.name, std::find(entry.name, entry.name + sizeof(entry.name), '\0'));
+    call.header = entry.request[0];
+    call.replayed = false;
+    call.result_matches = false;
+    call.host_time = Duration::zero();
+    call.recorded_time = std::chrono::duration_cast<Duration>(std::chrono::nanoseconds(entry.host_time_ns));
+
+    Kernel::SharedPtr<Kernel::Session> session = FindSession(entry, call.name);
+    if (session == nullptr)
+        return true;
+
+    u32* cmd_buff = Kernel::GetCommandBuffer();
+    std::memcpy(cmd_buff, entry.request, sizeof(entry.request));
+
+    // The buffers are placed in the scratch block, at the same offsets into their pages as before
+    VAddr address = scratch_address;
+    for (size_t i = 0; i < recorded.buffers.size(); ++i) {
+        const BufferEntry& buffer = recorded.buffers[i];
+        const VAddr buffer_address = address + (cmd_buff[buffer.word_index] & Memory::PAGE_MASK);
+        if (buffer.has_contents)
+            Memory::WriteBlock(buffer_address, &replay_data[recorded.contents_offsets[i]], buffer.size);
+        cmd_buff[buffer.word_index] = buffer_address;
+        address += GetScratchSize(buffer.size);
+    }
+
+    std::vector<Handle> request_handles;
+    for (const HandleEntry& handle : recorded.handles) {
+        auto object = replayed_objects.find(handle.object_id);
+        if (handle.in_response || object == replayed_objects.end())
+            continue;
+        const Handle replayed_handle = Kernel::g_handle_table.Create(object->second).ValueOr(INVALID_HANDLE);
+        cmd_buff[handle.word_index] = replayed_handle;
+        request_handles.push_back(replayed_handle);
+    }
+
+    const Clock::time_point start = Clock::now();
+    session->SyncRequest();
+    call.host_time = Clock::now() - start;
+    call.replayed = true;
+    call.result_matches = cmd_buff[1] == entry.response[1];
+
+    // The objects the call created stand in for the recorded ones from now on. The replay holds on
+    // to them instead of the handles, so that the handle table doesn't fill up.
+    for (const HandleEntry& handle : recorded.handles) {
+        if (!handle.in_response)
+            continue;
+        Kernel::SharedPtr<Kernel::Object> object = Kernel::g_handle_table.GetGeneric(cmd_buff[handle.word_index]);
+        if (object != nullptr) {
+            replayed_objects[handle.object_id] = object;
+            Kernel::g_handle_table.Close(cmd_buff[handle.word_index]);
+        }
+    }
+    for (Handle handle : request_handles)
+        Kernel::g_handle_table.Close(handle);
+
+    // Nothing runs the events the services schedule for the CPU
+    CoreTiming::MoveEvents();
+    CoreTiming::ClearPendingEvents();
+    return true;
+}
+
+} // namespace
@@ -0,0 +1,104 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+#include "common/profiler.h"
+
+namespace Kernel {
+class Session;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace IPCRecording
+
+/**
+ * Recordings of the requests the HLE services answer, for replaying them to the services without
+ * the emulated CPU, e.g. to optimize a service on a reproducible workload. Each call is recorded
+ * with its command buffer, the contents of the buffers its translate parameters describe, its
+ * response and how long it took.
+ *
+ * Handles are recorded with the id of the object they refer to. Objects a call creates, such as
+ * the sessions of opened files, are found again on replay by their place in the response, so that
+ * later calls to them and handles to them are translated to the replayed ones.
+ *
+ * Buffers only passed as normal parameters are not recorded, and file reads and writes queued for
+ * the I/O thread are recorded before their reply is written.
+ */
+namespace IPCRecording {
+
+/**
+ * Records the calls from now on, until the emulated system is shut down. To be called before the
+ * title boots.
+ * @return Whether the recording file could be created
+ */
+bool StartRecording(const std::string& path);
+
+/// Whether the calls to the services are being recorded
+bool IsRecording();
+
+/**
+ * Records the request in the command buffer, before the session handles it
+ * @param name Port name of the service, or the type of the session if it's not a service
+ */
+void BeginCall(const Kernel::Session* session, const char* name);
+
+/// Records the response in the command buffer, after the session handled the request
+void EndCall();
+
+/// Records the call a session handles during the lifetime of this object, if a recording is running
+class ScopedCall final : NonCopyable {
+public:
+    ScopedCall(const Kernel::Session* session, const char* name) : active(IsRecording()) {
+        if (active)
+            BeginCall(session, name);
+    }
+
+    ~ScopedCall() {
+        if (active)
+            EndCall();
+    }
+
+private:
+    bool active;
+};
+
+/// Completes the recording, and forgets the replayed one
+void Shutdown();
+
+/// A call made again from a recording
+struct ReplayedCall {
+    /// Port name of the service, or the type of the session the call was made to
+    std::string name;
+    /// Header of the request
+    u32 header;
+    /// Whether the call was made, it's skipped if its session can't be found in this system
+    bool replayed;
+    /// Whether the result code in the response is the recorded one
+    bool result_matches;
+    /// Host time the session took to handle the call, now and when it was recorded
+    Common::Profiling::Duration host_time;
+    Common::Profiling::Duration recorded_time;
+};
+
+/**
+ * Reads a recording for replaying it, into a system that doesn't run a title. A process with the
+ * recorded program id is created for the calls to be made from.
+ * @return Whether the recording could be read
+ */
+bool LoadRecording(const std::string& path);
+
+/// Number of calls in the loaded recording
+size_t GetNumCalls();
+
+/**
+ * Makes the next call of the loaded recording to the service layer directly
+ * @return Whether there was a call left to replay
+ */
+bool ReplayNextCall(ReplayedCall& call);
+
+} // namespace
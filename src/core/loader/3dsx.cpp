@@ -3,11 +3,14 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <cstring>
 #include <vector>
 
 #include "common/logging/log.h"
+#include "common/mapped_file.h"
 
 #include "core/file_sys/archive_romfs.h"
+#include "core/hle/function_hooks.h"
 #include "core/hle/kernel/process.h"
 #include "core/hle/kernel/resource_limit.h"
 #include "core/hle/service/fs/archive.h"
@@ -45,7 +48,6 @@ enum THREEDSX_Error {
     ERROR_FILE = 2,
     ERROR_ALLOC = 3
 };
-static const u32 RELOCBUFSIZE = 512;
 
 // File header
 #pragma pack(1)
@@ -98,17 +100,19 @@ static u32 TranslateAddr(u32 addr, const THREEloadinfo *loadinfo, u32* offsets)
     return loadinfo->seg_addrs[2] + addr - offsets[1];
 }
 
-static THREEDSX_Error Load3DSXFile(FileUtil::IOFile& file, u32 base_addr)
+/**
+ * Loads a 3DSX image from a mapped file. The segments are copied straight from the mapping into
+ * emulated memory, and relocated there with the relocation tables read in place from the mapping.
+ */
+static THREEDSX_Error Load3DSXFile(const u8* file, size_t file_size, u32 base_addr)
 {
-    if (!file.IsOpen())
+    if (file == nullptr)
         return ERROR_FILE;
 
-    // Reset read pointer in case this file has been read before.
-    file.Seek(0, SEEK_SET);
-
     THREEDSX_Header hdr;
-    if (file.ReadBytes(&hdr, sizeof(hdr)) != sizeof(hdr))
+    if (file_size < sizeof(hdr))
         return ERROR_READ;
+    memcpy(&hdr, file, sizeof(hdr));
 
     THREEloadinfo loadinfo;
     //loadinfo segments must be a multiple of 0x1000
@@ -119,90 +123,94 @@ static THREEDSX_Error Load3DSXFile(FileUtil::IOFile& file, u32 base_addr)
     u32 data_load_size = (hdr.data_seg_size - hdr.bss_size + 0xFFF) &~0xFFF;
     u32 bss_load_size = loadinfo.seg_sizes[2] - data_load_size;
     u32 n_reloc_tables = hdr.reloc_hdr_size / 4;
-    std::vector<u8> all_mem(loadinfo.seg_sizes[0] + loadinfo.seg_sizes[1] + loadinfo.seg_sizes[2] + 3 * n_reloc_tables);
+    const u32 image_size = loadinfo.seg_sizes[0] + loadinfo.seg_sizes[1] + loadinfo.seg_sizes[2];
+
+    // The image is built where it runs, without a staging copy
+    u8* image = Memory::GetContiguousPointer(base_addr, image_size);
+    if (image == nullptr)
+        return ERROR_ALLOC;
 
     loadinfo.seg_addrs[0] = base_addr;
     loadinfo.seg_addrs[1] = loadinfo.seg_addrs[0] + loadinfo.seg_sizes[0];
     loadinfo.seg_addrs[2] = loadinfo.seg_addrs[1] + loadinfo.seg_sizes[1];
-    loadinfo.seg_ptrs[0] = &all_mem[0];
+    loadinfo.seg_ptrs[0] = image;
     loadinfo.seg_ptrs[1] = loadinfo.seg_ptrs[0] + loadinfo.seg_sizes[0];
     loadinfo.seg_ptrs[2] = loadinfo.seg_ptrs[1] + loadinfo.seg_sizes[1];
 
     // Skip header for future compatibility
-    file.Seek(hdr.header_size, SEEK_SET);
+    size_t pos_in_file = hdr.header_size;
 
-    // Read the relocation headers
-    u32* relocs = (u32*)(loadinfo.seg_ptrs[2] + hdr.data_seg_size);
+    // The relocation headers, one per segment
+    const size_t reloc_hdrs_size = 3 * n_reloc_tables * 4;
+    if (pos_in_file + reloc_hdrs_size > file_size)
+        return ERROR_READ;
+    std::vector<u32> relocs(3 * n_reloc_tables);
+    if (!relocs.empty())
+        memcpy(relocs.data(), file + pos_in_file, reloc_hdrs_size);
+    pos_in_file += reloc_hdrs_size;
 
+    // Copy the segments, the padding between them and the BSS are cleared
+    const u32 file_seg_sizes[3] = { hdr.code_seg_size, hdr.rodata_seg_size, hdr.data_seg_size - hdr.bss_size };
     for (unsigned current_segment : {0, 1, 2}) {
-        size_t size = n_reloc_tables * 4;
-        if (file.ReadBytes(&relocs[current_segment * n_reloc_tables], size) != size)
+        const u32 size = file_seg_sizes[current_segment];
+        if (size > loadinfo.seg_sizes[current_segment] || pos_in_file + size > file_size)
             return ERROR_READ;
+        memcpy(loadinfo.seg_ptrs[current_segment], file + pos_in_file, size);
+        memset(loadinfo.seg_ptrs[current_segment] + size, 0, loadinfo.seg_sizes[current_segment] - size);
+        pos_in_file += size;
     }
 
-    // Read the segments
-    if (file.ReadBytes(loadinfo.seg_ptrs[0], hdr.code_seg_size) != hdr.code_seg_size)
-        return ERROR_READ;
-    if (file.ReadBytes(loadinfo.seg_ptrs[1], hdr.rodata_seg_size) != hdr.rodata_seg_size)
-        return ERROR_READ;
-    if (file.ReadBytes(loadinfo.seg_ptrs[2], hdr.data_seg_size - hdr.bss_size) != hdr.data_seg_size - hdr.bss_size)
-        return ERROR_READ;
-
-    // BSS clear
-    memset((char*)loadinfo.seg_ptrs[2] + hdr.data_seg_size - hdr.bss_size, 0, hdr.bss_size);
-
     // Relocate the segments
     for (unsigned current_segment : {0, 1, 2}) {
         for (unsigned current_segment_reloc_table = 0; current_segment_reloc_table < n_reloc_tables; current_segment_reloc_table++) {
             u32 n_relocs = relocs[current_segment * n_reloc_tables + current_segment_reloc_table];
+            const size_t table_size = n_relocs * sizeof(THREEDSX_Reloc);
+            if (pos_in_file + table_size > file_size)
+                return ERROR_READ;
+            const u8* reloc_table = file + pos_in_file;
+            pos_in_file += table_size;
+
             if (current_segment_reloc_table >= 2) {
                 // We are not using this table - ignore it because we don't know what it dose
-                file.Seek(n_relocs*sizeof(THREEDSX_Reloc), SEEK_CUR);
                 continue;
             }
-            static THREEDSX_Reloc reloc_table[RELOCBUFSIZE];
 
             u32* pos = (u32*)loadinfo.seg_ptrs[current_segment];
             const u32* end_pos = pos + (loadinfo.seg_sizes[current_segment] / 4);
 
-            while (n_relocs) {
-                u32 remaining = std::min(RELOCBUFSIZE, n_relocs);
-                n_relocs -= remaining;
-
-                if (file.ReadBytes(reloc_table, remaining * sizeof(THREEDSX_Reloc)) != remaining * sizeof(THREEDSX_Reloc))
-                    return ERROR_READ;
-
-                for (unsigned current_inprogress = 0; current_inprogress < remaining && pos < end_pos; current_inprogress++) {
-                    const auto& table = reloc_table[current_inprogress];
-                    LOG_TRACE(Loader, "(t=%d,skip=%u,patch=%u)\n", current_segment_reloc_table,
-                              (u32)table.skip, (u32)table.patch);
-                    pos += table.skip;
-                    s32 num_patches = table.patch;
-                    while (0 < num_patches && pos < end_pos) {
-                        u32 in_addr = (char*)pos - (char*)&all_mem[0];
-                        u32 addr = TranslateAddr(*pos, &loadinfo, offsets);
-                        LOG_TRACE(Loader, "Patching %08X <-- rel(%08X,%d) (%08X)\n",
-                                  base_addr + in_addr, addr, current_segment_reloc_table, *pos);
-                        switch (current_segment_reloc_table) {
-                        case 0:
-                            *pos = (addr);
-                            break;
-                        case 1:
-                            *pos = (addr - in_addr);
-                            break;
-                        default:
-                            break; //this should never happen
-                        }
-                        pos++;
-                        num_patches--;
+            for (unsigned current_inprogress = 0; current_inprogress < n_relocs && pos < end_pos; current_inprogress++) {
+                // The file mapping isn't necessarily aligned for the entries
+                THREEDSX_Reloc table;
+                memcpy(&table, reloc_table + current_inprogress * sizeof(THREEDSX_Reloc), sizeof(table));
+                LOG_TRACE(Loader, "(t=%d,skip=%u,patch=%u)\n", current_segment_reloc_table,
+                          (u32)table.skip, (u32)table.patch);
+                pos += table.skip;
+                s32 num_patches = table.patch;
+                while (0 < num_patches && pos < end_pos) {
+                    u32 in_addr = (u32)((u8*)pos - image);
+                    u32 addr = TranslateAddr(*pos, &loadinfo, offsets);
+                    LOG_TRACE(Loader, "Patching %08X <-- rel(%08X,%d) (%08X)\n",
+                              base_addr + in_addr, addr, current_segment_reloc_table, *pos);
+                    switch (current_segment_reloc_table) {
+                    case 0:
+                        *pos = (addr);
+                        break;
+                    case 1:
+                        *pos = (addr - in_addr);
+                        break;
+                    default:
+                        break; //this should never happen
                     }
+                    pos++;
+                    num_patches--;
                 }
             }
         }
     }
 
-    // Write the data
-    memcpy(Memory::GetPointer(base_addr), &all_mem[0], loadinfo.seg_sizes[0] + loadinfo.seg_sizes[1] + loadinfo.seg_sizes[2]);
+    // The image was written behind the back of the CPU
+    Memory::InvalidateCodeRange(base_addr, image_size);
+    FunctionHooks::ScanCode(base_addr, loadinfo.seg_sizes[0]);
 
     LOG_DEBUG(Loader, "CODE:   %u pages\n", loadinfo.seg_sizes[0] / 0x1000);
     LOG_DEBUG(Loader, "RODATA: %u pages\n", loadinfo.seg_sizes[1] / 0x1000);
@@ -238,7 +246,14 @@ ResultStatus AppLoader_THREEDSX::Load() {
     // Attach the default resource limit (APPLICATION) to the process
     Kernel::g_current_process->resource_limit = Kernel::ResourceLimit::GetForCategory(Kernel::ResourceLimitCategory::APPLICATION);
 
-    Load3DSXFile(*file, Memory::PROCESS_IMAGE_VADDR);
+    Common::MappedFile mapped_file;
+    if (!mapped_file.Open(filepath))
+        return ResultStatus::Error;
+
+    if (Load3DSXFile(mapped_file.Data(), mapped_file.Size(), Memory::PROCESS_IMAGE_VADDR) != ERROR_NONE) {
+        LOG_ERROR(Loader, "Failed to load 3DSX file %s", filename.c_str());
+        return ResultStatus::Error;
+    }
 
     Kernel::g_current_process->Run(Memory::PROCESS_IMAGE_VADDR, 48, Kernel::DEFAULT_STACK_SIZE);
 
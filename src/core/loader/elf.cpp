@@ -2,14 +2,18 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
-#include <string>
+#include <algorithm>
+#include <cstring>
 #include <memory>
+#include <string>
 
 #include "common/common_types.h"
 #include "common/file_util.h"
 #include "common/logging/log.h"
+#include "common/mapped_file.h"
 #include "common/symbols.h"
 
+#include "core/hle/function_hooks.h"
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/kernel/resource_limit.h"
 #include "core/loader/elf.h"
@@ -96,6 +100,11 @@ enum ElfSectionFlags
 #define PT_LOPROC  0x70000000
 #define PT_HIPROC  0x7FFFFFFF
 
+// Segment flags
+#define PF_X                1
+#define PF_W                2
+#define PF_R                4
+
 typedef unsigned int   Elf32_Addr;
 typedef unsigned short Elf32_Half;
 typedef unsigned int   Elf32_Off;
@@ -273,7 +282,20 @@ void ElfReader::LoadInto(u32 vaddr) {
 
         if (p->p_type == PT_LOAD) {
             segment_addr[i] = base_addr + p->p_vaddr;
-            memcpy(Memory::GetPointer(segment_addr[i]), GetSegmentPtr(i), p->p_filesz);
+            const u32 size = std::max(p->p_memsz, p->p_filesz);
+            if (size == 0)
+                continue;
+
+            u8* dest = Memory::GetContiguousPointer(segment_addr[i], size);
+            if (dest == nullptr) {
+                LOG_ERROR(Loader, "Segment at %08x doesn't fit in memory, size %08x", segment_addr[i], size);
+                continue;
+            }
+            memcpy(dest, GetSegmentPtr(i), p->p_filesz);
+            memset(dest + p->p_filesz, 0, size - p->p_filesz);
+            Memory::InvalidateCodeRange(segment_addr[i], size);
+            if (p->p_flags & PF_X)
+                FunctionHooks::ScanCode(segment_addr[i], p->p_filesz);
             LOG_DEBUG(Loader, "Loadable Segment Copied to %08x, size %08x", segment_addr[i],
                       p->p_memsz);
         }
@@ -343,12 +365,9 @@ ResultStatus AppLoader_ELF::Load() {
     if (!file->IsOpen())
         return ResultStatus::Error;
 
-    // Reset read pointer in case this file has been read before.
-    file->Seek(0, SEEK_SET);
-
-    u32 size = static_cast<u32>(file->GetSize());
-    std::unique_ptr<u8[]> buffer(new u8[size]);
-    if (file->ReadBytes(&buffer[0], size) != size)
+    // The segments are copied into emulated memory straight from the mapping
+    Common::MappedFile mapped_file;
+    if (!mapped_file.Open(filepath))
         return ResultStatus::Error;
 
     Kernel::g_current_process = Kernel::Process::Create(filename, 0);
@@ -358,8 +377,9 @@ ResultStatus AppLoader_ELF::Load() {
     // Attach the default resource limit (APPLICATION) to the process
     Kernel::g_current_process->resource_limit = Kernel::ResourceLimit::GetForCategory(Kernel::ResourceLimitCategory::APPLICATION);
 
-    ElfReader elf_reader(&buffer[0]);
+    ElfReader elf_reader(mapped_file.Data());
     elf_reader.LoadInto(Memory::PROCESS_IMAGE_VADDR);
+    FunctionHooks::HookSymbols();
     // TODO: Fill application title
 
     Kernel::g_current_process->Run(elf_reader.GetEntryPoint(), 48, Kernel::DEFAULT_STACK_SIZE);
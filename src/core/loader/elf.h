@@ -17,8 +17,8 @@ namespace Loader {
 /// Loads an ELF/AXF file
 class AppLoader_ELF final : public AppLoader {
 public:
-    AppLoader_ELF(std::unique_ptr<FileUtil::IOFile>&& file, std::string filename)
-        : AppLoader(std::move(file)), filename(std::move(filename)) { }
+    AppLoader_ELF(std::unique_ptr<FileUtil::IOFile>&& file, std::string filename, std::string filepath)
+        : AppLoader(std::move(file)), filename(std::move(filename)), filepath(std::move(filepath)) {}
 
     /**
      * Returns the type of the file
@@ -35,6 +35,8 @@ public:
 
 private:
     std::string filename;
+    /// Path of the file, which is mapped rather than read
+    std::string filepath;
 };
 
 } // namespace Loader
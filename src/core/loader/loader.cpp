@@ -2,10 +2,13 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <chrono>
 #include <string>
 
+#include "common/job_system.h"
 #include "common/logging/log.h"
 #include "common/make_unique.h"
+#include "common/profiler.h"
 
 #include "core/file_sys/archive_romfs.h"
 #include "core/hle/kernel/process.h"
@@ -13,11 +16,25 @@
 #include "core/loader/3dsx.h"
 #include "core/loader/elf.h"
 #include "core/loader/ncch.h"
+#include "core/title_profiles.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 namespace Loader {
 
+static Common::Profiling::TimingCategory profile_loader("Loader");
+static Common::Profiling::TimingCategory profile_preload("Loader Preload", &profile_loader);
+
+/// A file being read ahead by PreloadFile
+struct Preload {
+    std::string filename;
+    /// Loader with the code read, null if it couldn't be
+    std::unique_ptr<AppLoader_NCCH> app_loader;
+    Common::JobSystem::JobCounter counter;
+};
+
+static std::unique_ptr<Preload> preload;
+
 const std::initializer_list<Kernel::AddressMapping> default_address_mappings = {
     { 0x1FF50000,   0x8000, true  }, // part of DSP RAM
     { 0x1FF70000,   0x8000, true  }, // part of DSP RAM
@@ -87,7 +104,50 @@ static const char* GetFileTypeString(FileType type) {
     return "unknown";
 }
 
-ResultStatus LoadFile(const std::string& filename) {
+void PreloadFile(const std::string& filename) {
+    DiscardPreload();
+
+    preload = Common::make_unique<Preload>();
+    preload->filename = filename;
+    Preload* const job_preload = preload.get();
+    Common::JobSystem::Spawn([job_preload] {
+        Common::Profiling::ScopeTimer timer(profile_preload);
+
+        std::unique_ptr<FileUtil::IOFile> file(new FileUtil::IOFile(job_preload->filename, "rb"));
+        if (!file->IsOpen())
+            return;
+        const FileType type = IdentifyFile(*file);
+        if (type != FileType::CXI && type != FileType::CCI)
+            return;
+
+        // Failures are reported by LoadFile, which tries again
+        std::unique_ptr<AppLoader_NCCH> app_loader = Common::make_unique<AppLoader_NCCH>(std::move(file), job_preload->filename);
+        if (app_loader->Preload() == ResultStatus::Success)
+            job_preload->app_loader = std::move(app_loader);
+    }, &preload->counter);
+}
+
+void DiscardPreload() {
+    // The counter waits for the job
+    preload.reset();
+}
+
+/// Returns the loader PreloadFile prepared for a file, null if there is none
+static std::unique_ptr<AppLoader_NCCH> TakePreload(const std::string& filename) {
+    if (preload == nullptr)
+        return nullptr;
+
+    preload->counter.Wait();
+    std::unique_ptr<AppLoader_NCCH> app_loader;
+    if (preload->filename == filename)
+        app_loader = std::move(preload->app_loader);
+    preload.reset();
+    return app_loader;
+}
+
+static ResultStatus LoadFileOfAnyType(const std::string& filename) {
+    std::unique_ptr<AppLoader_NCCH> preloaded = TakePreload(filename);
+
     std::unique_ptr<FileUtil::IOFile> file(new FileUtil::IOFile(filename, "rb"));
     if (!file->IsOpen()) {
         LOG_ERROR(Loader, "Failed to load file %s", filename.c_str());
@@ -112,21 +172,23 @@ ResultStatus LoadFile(const std::string& filename) {
 
     //3DSX file format...
     case FileType::THREEDSX:
-        return AppLoader_THREEDSX(std::move(file), filename_filename).Load();
+        return AppLoader_THREEDSX(std::move(file), filename_filename, filename).Load();
 
     // Standard ELF file format...
     case FileType::ELF:
-        return AppLoader_ELF(std::move(file), filename_filename).Load();
+        return AppLoader_ELF(std::move(file), filename_filename, filename).Load();
 
     // NCCH/NCSD container formats...
     case FileType::CXI:
     case FileType::CCI:
     {
-        AppLoader_NCCH app_loader(std::move(file));
+        std::unique_ptr<AppLoader_NCCH> app_loader = std::move(preloaded);
+        if (app_loader == nullptr)
+            app_loader = Common::make_unique<AppLoader_NCCH>(std::move(file), filename);
 
         // Load application and RomFS
-        if (ResultStatus::Success == app_loader.Load()) {
-            Service::FS::RegisterArchiveType(Common::make_unique<FileSys::ArchiveFactory_RomFS>(app_loader), Service::FS::ArchiveIdCode::RomFS);
+        if (ResultStatus::Success == app_loader->Load()) {
+            Service::FS::RegisterArchiveType(Common::make_unique<FileSys::ArchiveFactory_RomFS>(*app_loader), Service::FS::ArchiveIdCode::RomFS);
             return ResultStatus::Success;
         }
         break;
@@ -145,4 +207,18 @@ ResultStatus LoadFile(const std::string& filename) {
     return ResultStatus::Error;
 }
 
+ResultStatus LoadFile(const std::string& filename) {
+    Common::Profiling::ScopeTimer timer(profile_loader);
+    const auto start = std::chrono::steady_clock::now();
+
+    const ResultStatus result = LoadFileOfAnyType(filename);
+    if (result == ResultStatus::Success && Kernel::g_current_process != nullptr)
+        TitleProfiles::Apply(Kernel::g_current_process->program_id);
+
+    // Reported on its own, the loading is over before the profiler shows the first frame
+    const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+    LOG_INFO(Loader, "Loading took %.3f ms", duration.count());
+    return result;
+}
+
 } // namespace Loader
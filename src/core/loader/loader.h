@@ -4,10 +4,12 @@
 
 #pragma once
 
+#include <memory>
 #include <vector>
 
 #include "common/common_types.h"
 #include "common/file_util.h"
+#include "common/positional_file.h"
 
 #include "core/hle/kernel/process.h"
 
@@ -92,11 +94,14 @@ public:
     }
 
     /**
-     * Get the RomFS of the application
-     * @param buffer Reference to buffer to store data
+     * Get the RomFS of the application. It isn't read into memory, instead a file it can be read
+     * from on demand is opened.
+     * @param romfs_file Receives the file the RomFS is stored in
+     * @param offset Receives the offset of the RomFS in the file
+     * @param size Receives the size of the RomFS in bytes
      * @return ResultStatus result of function
      */
-    virtual ResultStatus ReadRomFS(std::vector<u8>& buffer) const {
+    virtual ResultStatus ReadRomFS(std::shared_ptr<Common::PositionalFile>& romfs_file, u64& offset, u64& size) const {
         return ResultStatus::ErrorNotImplemented;
     }
 
@@ -118,4 +123,14 @@ extern const std::initializer_list<Kernel::AddressMapping> default_address_mappi
  */
 ResultStatus LoadFile(const std::string& filename);
 
+/**
+ * Starts reading and decompressing the code of a bootable file on a worker, for the LoadFile of
+ * the same file to pick up. Only NCCH files are read ahead, the others are small.
+ * @param filename String filename of bootable file
+ */
+void PreloadFile(const std::string& filename);
+
+/// Waits for and drops the file started by PreloadFile, if LoadFile didn't take it
+void DiscardPreload();
+
 } // namespace
@@ -3,13 +3,19 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <cstring>
 #include <memory>
 
+#include "common/common_paths.h"
+#include "common/file_util.h"
+#include "common/hash.h"
 #include "common/logging/log.h"
 #include "common/make_unique.h"
 #include "common/string_util.h"
 #include "common/swap.h"
 
+#include "core/block_list.h"
+#include "core/hle/function_hooks.h"
 #include "core/hle/kernel/kernel.h"
 #include "core/hle/kernel/resource_limit.h"
 #include "core/loader/ncch.h"
@@ -23,34 +29,25 @@ namespace Loader {
 static const int kMaxSections = 8;        ///< Maximum number of sections (files) in an ExeFs
 static const int kBlockSize   = 0x200;    ///< Size of ExeFS blocks (in bytes)
 
-/**
- * Get the decompressed size of an LZSS compressed ExeFS file
- * @param buffer Buffer of compressed file
- * @param size Size of compressed buffer
- * @return Size of decompressed buffer
- */
-static u32 LZSS_GetDecompressedSize(const u8* buffer, u32 size) {
+u32 LZSS_GetDecompressedSize(const u8* buffer, u32 size) {
     u32 offset_size = *(u32*)(buffer + size - 4);
     return offset_size + size;
 }
 
-/**
- * Decompress ExeFS file (compressed with LZSS)
- * @param compressed Compressed buffer
- * @param compressed_size Size of compressed buffer
- * @param decompressed Decompressed buffer
- * @param decompressed_size Size of decompressed buffer
- * @return True on success, otherwise false
- */
-static bool LZSS_Decompress(const u8* compressed, u32 compressed_size, u8* decompressed, u32 decompressed_size) {
+bool LZSS_Decompress(const u8* compressed, u32 compressed_size, u8* decompressed, u32 decompressed_size) {
     const u8* footer = compressed + compressed_size - 8;
     u32 buffer_top_and_bottom = *reinterpret_cast<const u32*>(footer);
     u32 out = decompressed_size;
     u32 index = compressed_size - ((buffer_top_and_bottom >> 24) & 0xFF);
     u32 stop_index = compressed_size - (buffer_top_and_bottom & 0xFFFFFF);
 
-    memset(decompressed, 0, decompressed_size);
+    if (decompressed_size < compressed_size)
+        return false;
+
+    // The data is decompressed in place, backwards from its end. Only the part past the
+    // compressed data needs to be cleared.
     memcpy(decompressed, compressed, compressed_size);
+    memset(decompressed + compressed_size, 0, decompressed_size - compressed_size);
 
     while (index > stop_index) {
        u8 control = compressed[--index];
@@ -77,14 +74,18 @@ static bool LZSS_Decompress(const u8* compressed, u32 compressed_size, u8* decom
                 // Check if compression is out of bounds
                 if (out < segment_size)
                     return false;
+                if (out + segment_offset >= decompressed_size)
+                    return false;
 
-                for (unsigned j = 0; j < segment_size; j++) {
-                    // Check if compression is out of bounds
-                    if (out + segment_offset >= decompressed_size)
-                        return false;
-
-                    u8 data = decompressed[out + segment_offset];
-                    decompressed[--out] = data;
+                // Each byte is copied from distance bytes above it. A segment longer than that
+                // repeats the bytes it wrote first, so it's copied in chunks that don't overlap.
+                const u32 distance = segment_offset + 1;
+                u32 remaining = segment_size;
+                while (remaining != 0) {
+                    const u32 chunk = std::min(remaining, distance);
+                    out -= chunk;
+                    memcpy(decompressed + out, decompressed + out + distance, chunk);
+                    remaining -= chunk;
                 }
             } else {
                 // Check if compression is out of bounds
@@ -116,12 +117,44 @@ FileType AppLoader_NCCH::IdentifyType(FileUtil::IOFile& file) {
     return FileType::Error;
 }
 
-ResultStatus AppLoader_NCCH::LoadExec() const {
+/// Directory decompressed ExeFS sections are cached in, so that later boots don't decompress them again
+static std::string GetDecompressedCacheDir() {
+    return FileUtil::GetUserPath(D_CACHE_IDX) + "exefs" DIR_SEP;
+}
+
+/**
+ * Reads a cached decompressed ExeFS section
+ * @param path Path of the cache file
+ * @param buffer Holds the expected decompressed size, receives the section on success
+ * @return True if the cache file was found and has the expected size
+ */
+static bool ReadDecompressedCache(const std::string& path, std::vector<u8>& buffer) {
+    FileUtil::IOFile cache_file(path, "rb");
+    if (!cache_file.IsOpen() || cache_file.GetSize() != buffer.size())
+        return false;
+    return cache_file.ReadBytes(buffer.data(), buffer.size()) == buffer.size();
+}
+
+/// Stores a decompressed ExeFS section in the cache, failing to do so is harmless
+static void WriteDecompressedCache(const std::string& path, const std::vector<u8>& buffer) {
+    if (!FileUtil::CreateFullPath(GetDecompressedCacheDir())) {
+        LOG_WARNING(Loader, "Failed to create the ExeFS cache directory");
+        return;
+    }
+
+    // A partially written file is rejected by ReadDecompressedCache for its size
+    FileUtil::IOFile cache_file(path, "wb");
+    if (!cache_file.IsOpen() || cache_file.WriteBytes(buffer.data(), buffer.size()) != buffer.size())
+        LOG_WARNING(Loader, "Failed to write %s", path.c_str());
+}
+
+ResultStatus AppLoader_NCCH::LoadExec() {
     if (!is_loaded)
         return ResultStatus::ErrorNotLoaded;
 
     std::vector<u8> code;
-    if (ResultStatus::Success == ReadCode(code)) {
+    code.swap(preloaded_code);
+    if (!code.empty() || ResultStatus::Success == ReadCode(code)) {
         std::string process_name = Common::StringFromFixedZeroTerminatedBuffer(
                 (const char*)exheader_header.codeset_info.name, 8);
         u64 program_id = *reinterpret_cast<u64_le const*>(&ncch_header.program_id[0]);
@@ -137,6 +170,8 @@ ResultStatus AppLoader_NCCH::LoadExec() const {
         Kernel::g_current_process->ParseKernelCaps(kernel_caps.data(), kernel_caps.size());
 
         Memory::WriteBlock(entry_point, &code[0], code.size());
+        BlockList::Init(program_id, entry_point, (u32)code.size());
+        FunctionHooks::ScanCode(entry_point, (u32)code.size());
 
         s32 priority = exheader_header.arm11_system_local_caps.priority;
         u32 stack_size = exheader_header.codeset_info.stack_size;
@@ -175,11 +210,21 @@ ResultStatus AppLoader_NCCH::LoadSectionExeFS(const char* name, std::vector<u8>&
                 if (file->ReadBytes(&temp_buffer[0], section.size) != section.size)
                     return ResultStatus::Error;
 
-                // Decompress .code section...
+                // Decompress .code section, unless it was decompressed by an earlier boot. The cache
+                // is keyed by the title and the compressed contents, updates get sections of their own.
                 u32 decompressed_size = LZSS_GetDecompressedSize(&temp_buffer[0], section.size);
                 buffer.resize(decompressed_size);
-                if (!LZSS_Decompress(&temp_buffer[0], section.size, &buffer[0], decompressed_size))
-                    return ResultStatus::ErrorInvalidFormat;
+
+                const u64 program_id = *reinterpret_cast<u64_le const*>(&ncch_header.program_id[0]);
+                const u64 hash = Common::ComputeHash64(&temp_buffer[0], section.size);
+                const std::string cache_path = GetDecompressedCacheDir() +
+                        Common::StringFromFormat("%016llX_%016llX.bin", program_id, hash);
+
+                if (!ReadDecompressedCache(cache_path, buffer)) {
+                    if (!LZSS_Decompress(&temp_buffer[0], section.size, &buffer[0], decompressed_size))
+                        return ResultStatus::ErrorInvalidFormat;
+                    WriteDecompressedCache(cache_path, buffer);
+                }
             } else {
                 // Section is uncompressed...
                 buffer.resize(section.size);
@@ -192,10 +237,7 @@ ResultStatus AppLoader_NCCH::LoadSectionExeFS(const char* name, std::vector<u8>&
     return ResultStatus::ErrorNotUsed;
 }
 
-ResultStatus AppLoader_NCCH::Load() {
-    if (is_loaded)
-        return ResultStatus::ErrorAlreadyLoaded;
-
+ResultStatus AppLoader_NCCH::ReadHeaders() {
     if (!file->IsOpen())
         return ResultStatus::Error;
 
@@ -254,6 +296,30 @@ ResultStatus AppLoader_NCCH::Load() {
     if (file->ReadBytes(&exefs_header, sizeof(ExeFs_Header)) != sizeof(ExeFs_Header))
         return ResultStatus::Error;
 
+    headers_read = true;
+    return ResultStatus::Success;
+}
+
+ResultStatus AppLoader_NCCH::Preload() {
+    if (is_loaded || headers_read)
+        return ResultStatus::ErrorAlreadyLoaded;
+
+    ResultStatus result = ReadHeaders();
+    if (result != ResultStatus::Success)
+        return result;
+    return ReadCode(preloaded_code);
+}
+
+ResultStatus AppLoader_NCCH::Load() {
+    if (is_loaded)
+        return ResultStatus::ErrorAlreadyLoaded;
+
+    if (!headers_read) {
+        ResultStatus result = ReadHeaders();
+        if (result != ResultStatus::Success)
+            return result;
+    }
+
     is_loaded = true; // Set state to loaded
 
     return LoadExec(); // Load the executable into memory for booting
@@ -275,7 +341,7 @@ ResultStatus AppLoader_NCCH::ReadLogo(std::vector<u8>& buffer) const {
     return LoadSectionExeFS("logo", buffer);
 }
 
-ResultStatus AppLoader_NCCH::ReadRomFS(std::vector<u8>& buffer) const {
+ResultStatus AppLoader_NCCH::ReadRomFS(std::shared_ptr<Common::PositionalFile>& romfs_file, u64& offset, u64& size) const {
     if (!file->IsOpen())
         return ResultStatus::Error;
 
@@ -287,12 +353,17 @@ ResultStatus AppLoader_NCCH::ReadRomFS(std::vector<u8>& buffer) const {
         LOG_DEBUG(Loader, "RomFS offset:           0x%08X", romfs_offset);
         LOG_DEBUG(Loader, "RomFS size:             0x%08X", romfs_size);
 
-        buffer.resize(romfs_size);
+        if (file->GetSize() < (u64)romfs_offset + romfs_size)
+            return ResultStatus::Error;
 
-        file->Seek(romfs_offset, SEEK_SET);
-        if (file->ReadBytes(&buffer[0], romfs_size) != romfs_size)
+        // The RomFS is read on demand, through a handle that doesn't share the loader's position
+        romfs_file = std::make_shared<Common::PositionalFile>();
+        if (!romfs_file->Open(filepath, Common::PositionalFile::Mode::Read))
             return ResultStatus::Error;
+        romfs_file->Advise(Common::PositionalFile::AccessHint::Random);
 
+        offset = romfs_offset;
+        size = romfs_size;
         return ResultStatus::Success;
     }
     LOG_DEBUG(Loader, "NCCH has no RomFS");
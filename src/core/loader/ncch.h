@@ -5,6 +5,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
 #include "common/bit_field.h"
 #include "common/common_types.h"
@@ -160,10 +161,29 @@ static_assert(sizeof(ExHeader_Header) == 0x800, "ExHeader structure size is wron
 
 namespace Loader {
 
+/**
+ * Get the decompressed size of an LZSS compressed ExeFS file
+ * @param buffer Buffer of compressed file
+ * @param size Size of compressed buffer
+ * @return Size of decompressed buffer
+ */
+u32 LZSS_GetDecompressedSize(const u8* buffer, u32 size);
+
+/**
+ * Decompress ExeFS file (compressed with LZSS)
+ * @param compressed Compressed buffer
+ * @param compressed_size Size of compressed buffer
+ * @param decompressed Decompressed buffer
+ * @param decompressed_size Size of decompressed buffer
+ * @return True on success, otherwise false
+ */
+bool LZSS_Decompress(const u8* compressed, u32 compressed_size, u8* decompressed, u32 decompressed_size);
+
 /// Loads an NCCH file (e.g. from a CCI, or the first NCCH in a CXI)
 class AppLoader_NCCH final : public AppLoader {
 public:
-    AppLoader_NCCH(std::unique_ptr<FileUtil::IOFile>&& file) : AppLoader(std::move(file)) { }
+    AppLoader_NCCH(std::unique_ptr<FileUtil::IOFile>&& file, const std::string& filepath)
+        : AppLoader(std::move(file)), filepath(filepath) { }
 
     /**
      * Returns the type of the file
@@ -178,6 +198,13 @@ public:
      */
     ResultStatus Load() override;
 
+    /**
+     * Reads the headers and the code ahead of Load, which then only has to load the code into
+     * memory. Doesn't touch the emulated system, so it can run on a worker while it is initialized.
+     * @return ResultStatus result of function
+     */
+    ResultStatus Preload();
+
     /**
      * Get the code (typically .code section) of the application
      * @param buffer Reference to buffer to store data
@@ -208,13 +235,21 @@ public:
 
     /**
      * Get the RomFS of the application
-     * @param buffer Reference to buffer to store data
+     * @param romfs_file Receives a file handle of its own, so that reads don't move the loader's
+     * @param offset Receives the offset of the RomFS in the file
+     * @param size Receives the size of the RomFS in bytes
      * @return ResultStatus result of function
      */
-    ResultStatus ReadRomFS(std::vector<u8>& buffer) const override;
+    ResultStatus ReadRomFS(std::shared_ptr<Common::PositionalFile>& romfs_file, u64& offset, u64& size) const override;
 
 private:
 
+    /**
+     * Reads the NCCH header, the ExHeader and the ExeFS header
+     * @return ResultStatus result of function
+     */
+    ResultStatus ReadHeaders();
+
     /**
      * Reads an application ExeFS section of an NCCH file into AppLoader (e.g. .code, .logo, etc.)
      * @param name Name of section to read out of NCCH file
@@ -227,8 +262,9 @@ private:
      * Loads .code section into memory for booting
      * @return ResultStatus result of function
      */
-    ResultStatus LoadExec() const;
+    ResultStatus LoadExec();
 
+    bool            headers_read = false;
     bool            is_compressed = false;
 
     u32             entry_point = 0;
@@ -244,6 +280,11 @@ private:
     NCCH_Header     ncch_header;
     ExeFs_Header    exefs_header;
     ExHeader_Header exheader_header;
+
+    std::string     filepath;
+
+    /// Code read by Preload, taken by LoadExec
+    std::vector<u8> preloaded_code;
 };
 
 } // namespace Loader
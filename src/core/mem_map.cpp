@@ -4,8 +4,12 @@
 
 #include <map>
 
+#include "common/assert.h"
+#include "common/chunk_file.h"
 #include "common/common_types.h"
 #include "common/logging/log.h"
+#include "common/memory_accounting.h"
+#include "common/memory_util.h"
 
 #include "core/hle/config_mem.h"
 #include "core/hle/kernel/kernel.h"
@@ -16,6 +20,7 @@
 #include "core/mem_map.h"
 #include "core/memory.h"
 #include "core/memory_setup.h"
+#include "core/settings.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -27,17 +32,19 @@ struct MemoryArea {
     u32 base;
     u32 size;
     const char* name;
+    /// Physical address the area is found at by the GPU and DMA, 0 if it isn't physical memory
+    PAddr physical_base;
+    /// Host pages backing the area when fastmem is disabled
+    u8* pages;
 };
 
 // We don't declare the IO regions in here since its handled by other means.
 static MemoryArea memory_areas[] = {
-    {PROCESS_IMAGE_VADDR, PROCESS_IMAGE_MAX_SIZE, "Process Image"}, // ExeFS:/.code is loaded here
-    {HEAP_VADDR,          HEAP_SIZE,              "Heap"},          // Application heap (main memory)
-    {SHARED_MEMORY_VADDR, SHARED_MEMORY_SIZE,     "Shared Memory"}, // Shared memory
-    {LINEAR_HEAP_VADDR,   LINEAR_HEAP_SIZE,       "Linear Heap"},   // Linear heap (main memory)
-    {VRAM_VADDR,          VRAM_SIZE,              "VRAM"},          // Video memory (VRAM)
-    {DSP_RAM_VADDR,       DSP_RAM_SIZE,           "DSP RAM"},       // DSP memory
-    {TLS_AREA_VADDR,      TLS_AREA_SIZE,          "TLS Area"},      // TLS memory
+    {PROCESS_IMAGE_VADDR, PROCESS_IMAGE_MAX_SIZE, "Process Image", 0},             // ExeFS:/.code is loaded here
+    {SHARED_MEMORY_VADDR, SHARED_MEMORY_SIZE,     "Shared Memory", 0},             // Shared memory
+    {VRAM_VADDR,          VRAM_SIZE,              "VRAM",          VRAM_PADDR},    // Video memory (VRAM)
+    {DSP_RAM_VADDR,       DSP_RAM_SIZE,           "DSP RAM",       DSP_RAM_PADDR}, // DSP memory
+    {TLS_AREA_VADDR,      TLS_AREA_SIZE,          "TLS Area",      0},             // TLS memory
 };
 
 /// Represents a block of memory mapped by ControlMemory/MapMemoryBlock
@@ -59,20 +66,78 @@ struct MemoryBlock {
 static std::map<u32, MemoryBlock> heap_map;
 static std::map<u32, MemoryBlock> heap_linear_map;
 
+static_assert(u32(LINEAR_HEAP_SIZE) == u32(FCRAM_SIZE), "The linear heap has to cover all of FCRAM");
+
+/**
+ * Host memory backing all of FCRAM. The linear heap is a view of the whole of it, and the heap
+ * blocks are views of parts of it, allocated from the top of FCRAM down while the linear heap
+ * blocks are allocated from the bottom up, like the kernel does for the application region.
+ */
+static u8* fcram = nullptr;
+/// Whether fcram was allocated with AllocateFastmemMemory, which is freed by ShutdownFastmem
+static bool fcram_is_fastmem = false;
+
+/// FCRAM and the memory areas, which are reserved in full although the OS commits them as they are touched
+static Common::MemoryAccounting::ScopedUsage guest_memory_usage(Common::MemoryAccounting::Tag::GuestMemory);
+
+/// Returns the size of a heap, which is where the next block is allocated
+static u32 GetHeapEnd(const std::map<u32, MemoryBlock>& heap) {
+    if (heap.empty())
+        return 0;
+    const MemoryBlock& last_block = heap.rbegin()->second;
+    return last_block.address + last_block.size;
+}
+
+/// Offset into FCRAM of the memory backing a heap block
+static u32 GetFCRAMOffset(const MemoryBlock& block) {
+    return FCRAM_SIZE - block.address - block.size;
+}
+
+/// Allocates the host pages backing FCRAM or a memory area when fastmem is disabled
+static u8* AllocateGuestPages(size_t size, const char* name) {
+    // Smaller areas would only be padded out to a huge page
+    if (!Settings::values.use_huge_pages || size < HUGE_PAGE_SIZE) {
+        u8* pages = static_cast<u8*>(AllocateMemoryPages(size));
+        ASSERT_MSG(pages != nullptr, "Failed to allocate %s", name);
+        return pages;
+    }
+
+    bool huge_pages;
+    u8* pages = static_cast<u8*>(AllocateHugeMemoryPages(size, false, huge_pages));
+    ASSERT_MSG(pages != nullptr, "Failed to allocate %s", name);
+    if (huge_pages)
+        LOG_INFO(HW_Memory, "%s is backed by huge pages", name);
+    else
+        LOG_WARNING(HW_Memory, "Huge pages are unavailable, %s is backed by normal pages", name);
+    return pages;
+}
+
+}
+
+// TODO(yuriks): Move this into Process
+static Kernel::VMManager address_space;
+
+/// Maps the memory backing a heap block onto its virtual address
+static void MapHeapBlock(const MemoryBlock& block) {
+    address_space.MapBackingMemory(block.GetVirtualAddress(), fcram + GetFCRAMOffset(block),
+                                   block.size, Kernel::MemoryState::Private).Unwrap();
 }
 
 u32 MapBlock_Heap(u32 size, u32 operation, u32 permissions) {
     MemoryBlock block;
 
     block.base_address  = HEAP_VADDR;
-    block.size          = size;
+    block.size          = (size + PAGE_MASK) & ~PAGE_MASK;
     block.operation     = operation;
     block.permissions   = permissions;
+    block.address       = GetHeapEnd(heap_map);
 
-    if (heap_map.size() > 0) {
-        const MemoryBlock last_block = heap_map.rbegin()->second;
-        block.address = last_block.address + last_block.size;
+    if (block.address + block.size > FCRAM_SIZE - GetHeapEnd(heap_linear_map)) {
+        LOG_ERROR(HW_Memory, "Out of FCRAM for a heap block of 0x%08X bytes", size);
+        return 0;
     }
+
+    MapHeapBlock(block);
     heap_map[block.GetVirtualAddress()] = block;
 
     return block.GetVirtualAddress();
@@ -86,10 +151,13 @@ u32 MapBlock_HeapLinear(u32 size, u32 operation, u32 permissions) {
     block.operation     = operation;
     block.permissions   = permissions;
 
-    if (heap_linear_map.size() > 0) {
-        const MemoryBlock last_block = heap_linear_map.rbegin()->second;
-        block.address = last_block.address + last_block.size;
+    block.address       = GetHeapEnd(heap_linear_map);
+
+    if (block.address + block.size > FCRAM_SIZE - GetHeapEnd(heap_map)) {
+        LOG_ERROR(HW_Memory, "Out of FCRAM for a linear heap block of 0x%08X bytes", size);
+        return 0;
     }
+
     heap_linear_map[block.GetVirtualAddress()] = block;
 
     return block.GetVirtualAddress();
@@ -131,17 +199,44 @@ VAddr PhysicalToVirtualAddress(const PAddr addr) {
     return addr | 0x80000000;
 }
 
-// TODO(yuriks): Move this into Process
-static Kernel::VMManager address_space;
+u8* GetFCRAMPointer() {
+    return fcram;
+}
 
 void Init() {
     using namespace Kernel;
 
     InitMemoryMap();
 
+    if (Settings::values.use_fastmem) {
+        size_t fastmem_size = FCRAM_SIZE;
+        for (const MemoryArea& area : memory_areas)
+            fastmem_size += area.size;
+        InitFastmem(fastmem_size);
+    }
+
+    fcram = AllocateFastmemMemory(FCRAM_SIZE);
+    fcram_is_fastmem = fcram != nullptr;
+    if (fcram == nullptr)
+        fcram = AllocateGuestPages(FCRAM_SIZE, "FCRAM");
+    else if (Settings::values.use_huge_pages)
+        LOG_WARNING(HW_Memory, "Huge pages aren't used for guest memory mirrored by fastmem");
+    address_space.MapBackingMemory(LINEAR_HEAP_VADDR, fcram, LINEAR_HEAP_SIZE, MemoryState::Private).Unwrap();
+    MapPhysicalRegion(FCRAM_PADDR, FCRAM_SIZE, fcram);
+    guest_memory_usage.Set(FCRAM_SIZE);
+
     for (MemoryArea& area : memory_areas) {
-        auto block = std::make_shared<std::vector<u8>>(area.size);
-        address_space.MapMemoryBlock(area.base, std::move(block), 0, area.size, MemoryState::Private).Unwrap();
+        guest_memory_usage.Add(area.size);
+        u8* memory = AllocateFastmemMemory(area.size);
+        if (memory == nullptr) {
+            // Anonymous pages read as zero and are only committed by the OS once they are touched,
+            // most of the areas are never used in full. Reserved huge pages are committed upfront.
+            area.pages = AllocateGuestPages(area.size, area.name);
+            memory = area.pages;
+        }
+        address_space.MapBackingMemory(area.base, memory, area.size, MemoryState::Private).Unwrap();
+        if (area.physical_base != 0)
+            MapPhysicalRegion(area.physical_base, area.size, memory);
     }
 
     auto cfg_mem_vma = address_space.MapBackingMemory(CONFIG_MEMORY_VADDR,
@@ -155,10 +250,69 @@ void Init() {
     LOG_DEBUG(HW_Memory, "initialized OK");
 }
 
+std::vector<MemoryRegion> GetStateRegions() {
+    std::vector<MemoryRegion> regions;
+    for (const MemoryArea& area : memory_areas)
+        regions.push_back({ area.base, area.size, area.name });
+    // Includes the heap blocks, which are views of FCRAM
+    regions.push_back({ LINEAR_HEAP_VADDR, FCRAM_SIZE, "FCRAM" });
+    regions.push_back({ CONFIG_MEMORY_VADDR, CONFIG_MEMORY_SIZE, "Config Memory" });
+    regions.push_back({ SHARED_PAGE_VADDR, SHARED_PAGE_SIZE, "Shared Page" });
+    return regions;
+}
+
+static void DoHeapMapState(PointerWrap& p, std::map<u32, MemoryBlock>& heap) {
+    u32 num_blocks = static_cast<u32>(heap.size());
+    p.Do(num_blocks);
+    auto itr = heap.begin();
+    std::map<u32, MemoryBlock> restored;
+    for (u32 i = 0; i < num_blocks; ++i) {
+        MemoryBlock block = (p.GetMode() != PointerWrap::MODE_READ) ? (itr++)->second : MemoryBlock();
+        p.Do(block.handle);
+        p.Do(block.base_address);
+        p.Do(block.address);
+        p.Do(block.size);
+        p.Do(block.operation);
+        p.Do(block.permissions);
+        restored[block.GetVirtualAddress()] = block;
+    }
+    if (p.GetMode() == PointerWrap::MODE_READ)
+        heap.swap(restored);
+}
+
+void DoState(PointerWrap& p) {
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        // Blocks that were mapped next to each other can have been merged into a single area
+        for (const auto& entry : heap_map) {
+            auto vma = address_space.FindVMA(entry.first);
+            if (vma->second.type != Kernel::VMAType::Free)
+                address_space.Unmap(vma);
+        }
+    }
+    DoHeapMapState(p, heap_map);
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        for (const auto& entry : heap_map)
+            MapHeapBlock(entry.second);
+    }
+    DoHeapMapState(p, heap_linear_map);
+    p.DoMarker("Memory");
+}
+
 void Shutdown() {
     heap_map.clear();
     heap_linear_map.clear();
     address_space.Reset();
+    for (MemoryArea& area : memory_areas) {
+        if (area.pages != nullptr)
+            FreeMemoryPages(area.pages, area.size);
+        area.pages = nullptr;
+    }
+    if (fcram != nullptr && !fcram_is_fastmem)
+        FreeMemoryPages(fcram, FCRAM_SIZE);
+    fcram = nullptr;
+    guest_memory_usage.Set(0);
+    ShutdownFastmem();
+    ShutdownMemoryMap();
 
     LOG_DEBUG(HW_Memory, "shutdown OK");
 }
@@ -4,13 +4,30 @@
 
 #pragma once
 
+#include <vector>
+
 #include "common/common_types.h"
 
+class PointerWrap;
+
 namespace Memory {
 
 void Init();
 void Shutdown();
 
+/// Block of emulated memory that is contiguous in host memory
+struct MemoryRegion {
+    VAddr base;
+    u32 size;
+    const char* name;
+};
+
+/// Returns the regions of emulated memory that are part of the state of the system
+std::vector<MemoryRegion> GetStateRegions();
+
+/// Saves or restores the heap allocations, the contents of the memory are saved separately
+void DoState(PointerWrap& p);
+
 /**
  * Maps a block of memory on the heap
  * @param size Size of block in bytes
@@ -27,6 +44,9 @@ u32 MapBlock_Heap(u32 size, u32 operation, u32 permissions);
  */
 u32 MapBlock_HeapLinear(u32 size, u32 operation, u32 permissions);
 
+/// Returns the host memory backing all of FCRAM, which the heaps are views of
+u8* GetFCRAMPointer();
+
 /**
  * Converts a virtual address inside a region with 1:1 mapping to physical memory to a physical
  * address. This should be used by services to translate addresses for use by the hardware.
@@ -2,19 +2,29 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
 #include <array>
+#include <cstring>
+#include <memory>
+#include <vector>
 
 #include "common/assert.h"
 #include "common/common_types.h"
+#include "common/host_memory.h"
 #include "common/logging/log.h"
+#include "common/make_unique.h"
 #include "common/swap.h"
 
+#include "core/core.h"
+#include "core/arm/arm_interface.h"
 #include "core/hle/config_mem.h"
 #include "core/hle/shared_page.h"
 #include "core/hw/hw.h"
 #include "core/mem_map.h"
 #include "core/memory.h"
+#include "core/memory_stats.h"
 #include "core/memory_setup.h"
+#include "core/mmio.h"
 
 namespace Memory {
 
@@ -47,14 +57,186 @@ struct PageTable {
      * the corresponding entry in `pointer` MUST be set to null.
      */
     std::array<PageType, NUM_ENTRIES> attributes;
+
+    /**
+     * Whether the CPU cores hold translated code made from each page. Writes to such pages have to
+     * invalidate the translations.
+     */
+    std::array<bool, NUM_ENTRIES> contains_code;
+
+    /**
+     * Dirty bit of every tracker for each page, set when the page is written and cleared when the
+     * tracker collects it. Only maintained for the trackers in `dirty_tracking`.
+     */
+    std::array<u8, NUM_ENTRIES> dirty;
+
+    /// Whether each page is write-watched (see IsWriteWatched), kept for the inlined FastWrite
+    std::array<bool, NUM_ENTRIES> write_watched;
+
+    /**
+     * Handler of the accesses to each page of type `Special`, nullptr for the other pages and for
+     * I/O pages no device handles.
+     */
+    std::array<MMIORegion*, NUM_ENTRIES> mmio_regions;
+};
+
+/// Range of the physical address space covered by the physical page table, from VRAM to the end of FCRAM
+static const PAddr PHYSICAL_TABLE_PADDR = VRAM_PADDR;
+static const PAddr PHYSICAL_TABLE_PADDR_END = FCRAM_PADDR_END;
+static_assert(DSP_RAM_PADDR >= PHYSICAL_TABLE_PADDR && FCRAM_PADDR >= DSP_RAM_PADDR_END,
+              "The physical page table doesn't cover all of the memory regions");
+
+/// Host memory backing a page of the physical address space
+struct PhysicalPage {
+    /// nullptr if the page isn't backed by memory
+    u8* pointer;
+    /// End of the physical region the page belongs to, which is backed by contiguous host memory
+    PAddr region_end;
 };
 
-/// Singular page table used for the singleton process
-static PageTable main_page_table;
+/**
+ * Translation of physical addresses for the GPU and DMA, which access memory by physical address
+ * and not through the page table of the process. Regions are only mapped in it at startup.
+ */
+static const size_t NUM_PHYSICAL_PAGES = (PHYSICAL_TABLE_PADDR_END - PHYSICAL_TABLE_PADDR) >> PAGE_BITS;
+using PhysicalPageTable = std::array<PhysicalPage, NUM_PHYSICAL_PAGES>;
+static std::unique_ptr<PhysicalPageTable> physical_page_table;
+
+/// Page table of the emulated process, allocated by InitMemoryMap so that it doesn't live in the
+/// host process image and each emulation session starts from a fresh one
+static std::unique_ptr<PageTable> main_page_table;
 /// Currently active page table
-static PageTable* current_page_table = &main_page_table;
+static PageTable* current_page_table = nullptr;
+/// Trackers whose dirty bits are maintained
+static u8 dirty_tracking = 0;
+/// Tables handed out to the CPU cores, pointing into the current page table
+static FastAccessTable fast_access_table = { nullptr, nullptr, nullptr };
+/// Whether the Read and Write functions report the accesses to MemoryStats
+static bool access_sampling = false;
+/// Pointers of no page, handed to the CPU cores instead of the page table's while accesses are sampled
+static std::unique_ptr<std::array<u8*, PageTable::NUM_ENTRIES>> sampling_pointers;
+
+/**
+ * Fastmem state. When enabled, guest memory is allocated from a block of host shared memory that
+ * is additionally mapped into a 4GB host view laid out like the guest address space, so that a
+ * guest access to vaddr is a plain host access to fastmem_base + vaddr. Pages that can't be
+ * accessed directly are left inaccessible in the view and are handled by HandleFastmemFault.
+ * Pages containing translated code are mapped read-only, so writes to them fault as well.
+ */
+static Common::HostMemory fastmem;
+/// Base of the fastmem view, nullptr if fastmem is disabled
+static u8* fastmem_base = nullptr;
+/// Amount of fastmem backing memory handed out by AllocateFastmemMemory
+static size_t fastmem_allocated = 0;
+/// Pages mapped to copies of memory outside of the fastmem backing memory
+static std::vector<u32> fastmem_copied_pages;
+
+/**
+ * Whether writes to a page have to be seen, because code was translated from it or because it's
+ * clean for some tracker. Such pages are mapped read-only in the fastmem view.
+ */
+static bool IsWriteWatched(u32 page) {
+    return current_page_table->contains_code[page] || (dirty_tracking & ~current_page_table->dirty[page]) != 0;
+}
+
+/// Brings the write_watched flags of a range of pages in line with IsWriteWatched
+static void UpdateWriteWatched(u32 base, u32 size) {
+    for (u32 page = base; page != base + size; ++page)
+        current_page_table->write_watched[page] = IsWriteWatched(page);
+}
+
+/**
+ * Brings the write_watched flag of a page and the protection of the page in the fastmem view in line
+ * with IsWriteWatched
+ */
+static void UpdateFastmemProtection(u32 page) {
+    current_page_table->write_watched[page] = IsWriteWatched(page);
+    if (fastmem_base != nullptr && current_page_table->pointers[page] != nullptr)
+        fastmem.Protect(page << PAGE_BITS, PAGE_SIZE, !IsWriteWatched(page));
+}
+
+/// Sets the dirty bits of a page for all trackers
+static void MarkPageDirty(u32 page) {
+    if ((current_page_table->dirty[page] & dirty_tracking) == dirty_tracking)
+        return;
+
+    current_page_table->dirty[page] = dirty_tracking;
+    UpdateFastmemProtection(page);
+}
+
+/// Discards the code translated from the given page number and clears its code flag
+static void InvalidateCodePage(u32 page) {
+    current_page_table->contains_code[page] = false;
+    UpdateFastmemProtection(page);
 
-static void MapPages(u32 base, u32 size, u8* memory, PageType type) {
+    const VAddr page_address = page << PAGE_BITS;
+    if (Core::g_app_core != nullptr)
+        Core::g_app_core->InvalidateCacheRange(page_address, PAGE_SIZE);
+    if (Core::g_sys_core != nullptr)
+        Core::g_sys_core->InvalidateCacheRange(page_address, PAGE_SIZE);
+}
+
+/// Brings the mappings of a range of pages in the fastmem view in line with the page table
+static void UpdateFastmemPages(u32 base, u32 size) {
+    const u32 end = base + size;
+    u32 page = base;
+    while (page != end) {
+        u8* const pointer = current_page_table->pointers[page];
+        const bool writable = !IsWriteWatched(page);
+        const size_t view_offset = (size_t)page << PAGE_BITS;
+
+        u32 run = 1;
+        if (pointer == nullptr) {
+            while (page + run != end && current_page_table->pointers[page + run] == nullptr)
+                ++run;
+            fastmem.Unmap(view_offset, (size_t)run << PAGE_BITS);
+        } else if (fastmem.IsBacking(pointer)) {
+            // Coalesce pages that are contiguous in the backing memory into a single mapping
+            while (page + run != end &&
+                   current_page_table->pointers[page + run] == pointer + run * PAGE_SIZE &&
+                   !IsWriteWatched(page + run) == writable)
+                ++run;
+            fastmem.Map(view_offset, pointer - fastmem.BackingBase(), (size_t)run << PAGE_BITS, writable);
+        } else {
+            // Memory that isn't part of the backing memory can't be aliased. Only a few pages
+            // backed by HLE structures are mapped like this, so they are mapped as copies.
+            fastmem.MapPrivate(view_offset, PAGE_SIZE);
+            std::memcpy(fastmem_base + view_offset, pointer, PAGE_SIZE);
+            if (std::find(fastmem_copied_pages.begin(), fastmem_copied_pages.end(), page) == fastmem_copied_pages.end())
+                fastmem_copied_pages.push_back(page);
+        }
+        page += run;
+    }
+}
+
+/// Handles an access violation at the given offset into the fastmem view
+static bool HandleFastmemFault(size_t view_offset) {
+    const u32 page = static_cast<u32>(view_offset >> PAGE_BITS);
+
+    if (current_page_table->pointers[page] != nullptr) {
+        if (!IsWriteWatched(page))
+            return false;
+
+        // Write to a page that is clean or that translated code was made from, the page is made
+        // writable again
+        current_page_table->dirty[page] = dirty_tracking;
+        if (current_page_table->contains_code[page])
+            InvalidateCodePage(page);
+        else
+            UpdateFastmemProtection(page);
+        return true;
+    }
+
+    // Unmapped pages are backed by scratch memory from now on, reads from them return 0 like they
+    // do without fastmem. Accesses to I/O pages only get here if they bypassed the Read and Write
+    // functions, which dispatch them to the MMIO handlers.
+    LOG_ERROR(HW_Memory, "unmapped or I/O access @ 0x%08X, backing the page with scratch memory",
+              page << PAGE_BITS);
+    fastmem.MapPrivate((size_t)page << PAGE_BITS, PAGE_SIZE);
+    return true;
+}
+
+static void MapPages(u32 base, u32 size, u8* memory, PageType type, MMIORegion* mmio_region) {
     LOG_DEBUG(HW_Memory, "Mapping %p onto %08X-%08X", memory, base * PAGE_SIZE, (base + size) * PAGE_SIZE);
 
     u32 end = base + size;
@@ -67,37 +249,90 @@ static void MapPages(u32 base, u32 size, u8* memory, PageType type) {
         }
         current_page_table->attributes[base] = type;
         current_page_table->pointers[base] = memory;
+        current_page_table->mmio_regions[base] = mmio_region;
+        // Newly mapped memory is considered written
+        current_page_table->dirty[base] = memory != nullptr ? dirty_tracking : 0;
+        if (current_page_table->contains_code[base])
+            InvalidateCodePage(base);
 
         base += 1;
         memory += PAGE_SIZE;
     }
+
+    UpdateWriteWatched(end - size, size);
+    if (fastmem_base != nullptr)
+        UpdateFastmemPages(end - size, size);
 }
 
 void InitMemoryMap() {
-    main_page_table.pointers.fill(nullptr);
-    main_page_table.attributes.fill(PageType::Unmapped);
+    main_page_table = Common::make_unique<PageTable>();
+    main_page_table->pointers.fill(nullptr);
+    main_page_table->attributes.fill(PageType::Unmapped);
+    main_page_table->contains_code.fill(false);
+    main_page_table->dirty.fill(0);
+    main_page_table->write_watched.fill(false);
+    main_page_table->mmio_regions.fill(nullptr);
+    current_page_table = main_page_table.get();
+    fast_access_table.pointers = current_page_table->pointers.data();
+    fast_access_table.write_watched = current_page_table->write_watched.data();
+
+    physical_page_table = Common::make_unique<PhysicalPageTable>();
+    physical_page_table->fill({ nullptr, 0 });
+}
+
+void ShutdownMemoryMap() {
+    access_sampling = false;
+    sampling_pointers.reset();
+    fast_access_table.pointers = nullptr;
+    fast_access_table.write_watched = nullptr;
+    current_page_table = nullptr;
+    main_page_table.reset();
+    physical_page_table.reset();
+}
+
+const FastAccessTable& GetFastAccessTable() {
+    return fast_access_table;
 }
 
 void MapMemoryRegion(VAddr base, u32 size, u8* target) {
     ASSERT_MSG((size & PAGE_MASK) == 0, "non-page aligned size: %08X", size);
     ASSERT_MSG((base & PAGE_MASK) == 0, "non-page aligned base: %08X", base);
-    MapPages(base / PAGE_SIZE, size / PAGE_SIZE, target, PageType::Memory);
+    MapPages(base / PAGE_SIZE, size / PAGE_SIZE, target, PageType::Memory, nullptr);
 }
 
-void MapIoRegion(VAddr base, u32 size) {
+void MapIoRegion(VAddr base, u32 size, MMIORegion* mmio_region) {
     ASSERT_MSG((size & PAGE_MASK) == 0, "non-page aligned size: %08X", size);
     ASSERT_MSG((base & PAGE_MASK) == 0, "non-page aligned base: %08X", base);
-    MapPages(base / PAGE_SIZE, size / PAGE_SIZE, nullptr, PageType::Special);
+    MapPages(base / PAGE_SIZE, size / PAGE_SIZE, nullptr, PageType::Special, mmio_region);
 }
 
 void UnmapRegion(VAddr base, u32 size) {
     ASSERT_MSG((size & PAGE_MASK) == 0, "non-page aligned size: %08X", size);
     ASSERT_MSG((base & PAGE_MASK) == 0, "non-page aligned base: %08X", base);
-    MapPages(base / PAGE_SIZE, size / PAGE_SIZE, nullptr, PageType::Unmapped);
+    MapPages(base / PAGE_SIZE, size / PAGE_SIZE, nullptr, PageType::Unmapped, nullptr);
+}
+
+void MapPhysicalRegion(PAddr base, u32 size, u8* target) {
+    ASSERT_MSG((size & PAGE_MASK) == 0, "non-page aligned size: %08X", size);
+    ASSERT_MSG((base & PAGE_MASK) == 0, "non-page aligned base: %08X", base);
+    ASSERT_MSG(base >= PHYSICAL_TABLE_PADDR && base + size <= PHYSICAL_TABLE_PADDR_END,
+               "physical region out of range at %08X", base);
+    LOG_DEBUG(HW_Memory, "Mapping %p onto physical %08X-%08X", target, base, base + size);
+
+    const u32 first_page = (base - PHYSICAL_TABLE_PADDR) >> PAGE_BITS;
+    for (u32 page = 0; page < size >> PAGE_BITS; ++page)
+        (*physical_page_table)[first_page + page] = { target + page * PAGE_SIZE, base + size };
 }
 
 template <typename T>
 T Read(const VAddr vaddr) {
+    if (access_sampling)
+        MemoryStats::RecordAccess(vaddr, false);
+
+    // I/O pages aren't mapped in the fastmem view, their accesses go to the MMIO handlers
+    if (fastmem_base != nullptr && current_page_table->attributes[vaddr >> PAGE_BITS] != PageType::Special)
+        return *reinterpret_cast<const T*>(fastmem_base + vaddr);
+
     const u8* page_pointer = current_page_table->pointers[vaddr >> PAGE_BITS];
     if (page_pointer) {
         return *reinterpret_cast<const T*>(page_pointer + (vaddr & PAGE_MASK));
@@ -110,9 +345,13 @@ T Read(const VAddr vaddr) {
         return 0;
     case PageType::Memory:
         ASSERT_MSG(false, "Mapped memory page without a pointer @ %08X", vaddr);
-    case PageType::Special:
-        LOG_ERROR(HW_Memory, "I/O reads aren't implemented yet @ %08X", vaddr);
+    case PageType::Special: {
+        MMIORegion* mmio_region = current_page_table->mmio_regions[vaddr >> PAGE_BITS];
+        if (mmio_region != nullptr)
+            return mmio_region->Read<T>(vaddr);
+        LOG_ERROR(HW_Memory, "unhandled I/O Read%lu @ 0x%08X", sizeof(T) * 8, vaddr);
         return 0;
+    }
     default:
         UNREACHABLE();
     }
@@ -120,9 +359,26 @@ T Read(const VAddr vaddr) {
 
 template <typename T>
 void Write(const VAddr vaddr, const T data) {
+    if (access_sampling)
+        MemoryStats::RecordAccess(vaddr, true);
+
+    if (fastmem_base != nullptr && current_page_table->attributes[vaddr >> PAGE_BITS] != PageType::Special) {
+        // Writes to code pages and clean pages fault, which invalidates the code translated from
+        // them and marks them dirty
+        *reinterpret_cast<T*>(fastmem_base + vaddr) = data;
+        return;
+    }
+
     u8* page_pointer = current_page_table->pointers[vaddr >> PAGE_BITS];
     if (page_pointer) {
         *reinterpret_cast<T*>(page_pointer + (vaddr & PAGE_MASK)) = data;
+        if (IsWriteWatched(vaddr >> PAGE_BITS)) {
+            current_page_table->dirty[vaddr >> PAGE_BITS] = dirty_tracking;
+            if (current_page_table->contains_code[vaddr >> PAGE_BITS])
+                InvalidateCodePage(vaddr >> PAGE_BITS);
+            else
+                current_page_table->write_watched[vaddr >> PAGE_BITS] = false;
+        }
         return;
     }
 
@@ -133,14 +389,24 @@ void Write(const VAddr vaddr, const T data) {
         return;
     case PageType::Memory:
         ASSERT_MSG(false, "Mapped memory page without a pointer @ %08X", vaddr);
-    case PageType::Special:
-        LOG_ERROR(HW_Memory, "I/O writes aren't implemented yet @ %08X", vaddr);
+    case PageType::Special: {
+        MMIORegion* mmio_region = current_page_table->mmio_regions[vaddr >> PAGE_BITS];
+        if (mmio_region != nullptr) {
+            mmio_region->Write<T>(vaddr, data);
+            return;
+        }
+        LOG_ERROR(HW_Memory, "unhandled I/O Write%lu 0x%08X @ 0x%08X", sizeof(data) * 8, (u32)data, vaddr);
         return;
+    }
     default:
         UNREACHABLE();
     }
 }
 
+MMIORegion* GetMMIORegion(const VAddr vaddr) {
+    return current_page_table->mmio_regions[vaddr >> PAGE_BITS];
+}
+
 u8* GetPointer(const VAddr vaddr) {
     u8* page_pointer = current_page_table->pointers[vaddr >> PAGE_BITS];
     if (page_pointer) {
@@ -152,7 +418,24 @@ u8* GetPointer(const VAddr vaddr) {
 }
 
 u8* GetPhysicalPointer(PAddr address) {
-    return GetPointer(PhysicalToVirtualAddress(address));
+    u32 size;
+    u8* const pointer = GetPhysicalSpan(address, size);
+    if (pointer == nullptr)
+        LOG_ERROR(HW_Memory, "unknown GetPhysicalPointer @ 0x%08x", address);
+    return pointer;
+}
+
+u8* GetPhysicalSpan(PAddr address, u32& size) {
+    size = 0;
+    if (physical_page_table == nullptr || address < PHYSICAL_TABLE_PADDR || address >= PHYSICAL_TABLE_PADDR_END)
+        return nullptr;
+
+    const PhysicalPage& page = (*physical_page_table)[(address - PHYSICAL_TABLE_PADDR) >> PAGE_BITS];
+    if (page.pointer == nullptr)
+        return nullptr;
+
+    size = page.region_end - address;
+    return page.pointer + (address & PAGE_MASK);
 }
 
 u8 Read8(const VAddr addr) {
@@ -187,20 +470,240 @@ void Write64(const VAddr addr, const u64 data) {
     Write<u64_le>(addr, data);
 }
 
-void WriteBlock(const VAddr addr, const u8* data, const size_t size) {
-    u32 offset = 0;
-    while (offset < (size & ~3)) {
-        Write32(addr + offset, *(u32*)&data[offset]);
-        offset += 4;
+/**
+ * Walks a range of emulated memory, calling `on_memory(host_pointer, offset, size)` for every span
+ * of it that is backed by contiguous host memory and `on_unmapped(vaddr, offset, size)` for every
+ * part of a page that isn't, where `offset` is the offset of the span into the range.
+ */
+template <typename MemoryFunc, typename UnmappedFunc>
+static void WalkBlock(const VAddr vaddr, const size_t size, MemoryFunc on_memory, UnmappedFunc on_unmapped) {
+    size_t offset = 0;
+    while (offset < size) {
+        const VAddr current_vaddr = static_cast<VAddr>(vaddr + offset);
+        const u32 page = current_vaddr >> PAGE_BITS;
+        const u32 page_offset = current_vaddr & PAGE_MASK;
+        size_t span = std::min<size_t>(PAGE_SIZE - page_offset, size - offset);
+
+        u8* const page_pointer = current_page_table->pointers[page];
+        if (page_pointer == nullptr) {
+            on_unmapped(current_vaddr, offset, span);
+            offset += span;
+            continue;
+        }
+
+        // Extend the span over the following pages as long as they continue the same host memory
+        for (u32 next = page + 1; offset + span < size && next < PageTable::NUM_ENTRIES; ++next) {
+            if (current_page_table->pointers[next] != page_pointer + (next - page) * PAGE_SIZE)
+                break;
+            span += std::min<size_t>(PAGE_SIZE, size - offset - span);
+        }
+
+        on_memory(page_pointer + page_offset, offset, span);
+        offset += span;
     }
+}
+
+void ReadBlock(const VAddr src_addr, void* dest_buffer, const size_t size) {
+    u8* dest = static_cast<u8*>(dest_buffer);
+    WalkBlock(src_addr, size,
+        [dest](const u8* src, size_t offset, size_t span) {
+            std::memcpy(dest + offset, src, span);
+        },
+        [dest](VAddr vaddr, size_t offset, size_t span) {
+            LOG_ERROR(HW_Memory, "unmapped or I/O ReadBlock @ 0x%08X (size 0x%X)", vaddr, (unsigned)span);
+            std::memset(dest + offset, 0, span);
+        });
+}
+
+void WriteBlock(const VAddr dest_addr, const void* src_buffer, const size_t size) {
+    const u8* src = static_cast<const u8*>(src_buffer);
+    WalkBlock(dest_addr, size,
+        [src](u8* dest, size_t offset, size_t span) {
+            std::memcpy(dest, src + offset, span);
+        },
+        [](VAddr vaddr, size_t offset, size_t span) {
+            LOG_ERROR(HW_Memory, "unmapped or I/O WriteBlock @ 0x%08X (size 0x%X)", vaddr, (unsigned)span);
+        });
+    InvalidateCodeRange(dest_addr, static_cast<u32>(size));
+}
+
+void ZeroBlock(const VAddr dest_addr, const size_t size) {
+    WalkBlock(dest_addr, size,
+        [](u8* dest, size_t offset, size_t span) {
+            std::memset(dest, 0, span);
+        },
+        [](VAddr vaddr, size_t offset, size_t span) {
+            LOG_ERROR(HW_Memory, "unmapped or I/O ZeroBlock @ 0x%08X (size 0x%X)", vaddr, (unsigned)span);
+        });
+    InvalidateCodeRange(dest_addr, static_cast<u32>(size));
+}
 
-    if (size & 2) {
-        Write16(addr + offset, *(u16*)&data[offset]);
-        offset += 2;
+void CopyBlock(const VAddr dest_addr, const VAddr src_addr, const size_t size) {
+    WalkBlock(src_addr, size,
+        [dest_addr](const u8* src, size_t offset, size_t span) {
+            WriteBlock(static_cast<VAddr>(dest_addr + offset), src, span);
+        },
+        [dest_addr](VAddr vaddr, size_t offset, size_t span) {
+            LOG_ERROR(HW_Memory, "unmapped or I/O CopyBlock @ 0x%08X (size 0x%X)", vaddr, (unsigned)span);
+            ZeroBlock(static_cast<VAddr>(dest_addr + offset), span);
+        });
+}
+
+u8* GetContiguousPointer(const VAddr vaddr, const size_t size) {
+    u8* pointer = nullptr;
+    bool contiguous = true;
+    WalkBlock(vaddr, size,
+        [&](u8* host, size_t offset, size_t span) {
+            contiguous = contiguous && offset == 0;
+            pointer = host;
+        },
+        [&](VAddr, size_t, size_t) {
+            contiguous = false;
+        });
+    return contiguous ? pointer : nullptr;
+}
+
+void MarkCodePage(const VAddr vaddr) {
+    const u32 page = vaddr >> PAGE_BITS;
+    if (current_page_table->contains_code[page])
+        return;
+
+    current_page_table->contains_code[page] = true;
+    UpdateFastmemProtection(page);
+}
+
+void InvalidateCodeRange(const VAddr start, const u32 size) {
+    if (size == 0)
+        return;
+
+    const u32 last_page = (start + size - 1) >> PAGE_BITS;
+    for (u32 page = start >> PAGE_BITS; page <= last_page; ++page) {
+        if (current_page_table->pointers[page] != nullptr)
+            MarkPageDirty(page);
+        if (current_page_table->contains_code[page])
+            InvalidateCodePage(page);
+    }
+}
+
+void EnableDirtyTracking(DirtyTracker tracker) {
+    if (dirty_tracking & tracker)
+        return;
+
+    // Nothing is known about what was written before, every mapped page starts out dirty
+    dirty_tracking |= tracker;
+    for (size_t page = 0; page < PageTable::NUM_ENTRIES; ++page) {
+        if (current_page_table->pointers[page] != nullptr)
+            current_page_table->dirty[page] |= tracker;
     }
+    UpdateWriteWatched(0, PageTable::NUM_ENTRIES);
+}
+
+void DisableDirtyTracking(DirtyTracker tracker) {
+    if (!(dirty_tracking & tracker))
+        return;
+
+    dirty_tracking &= ~tracker;
+    for (size_t page = 0; page < PageTable::NUM_ENTRIES; ++page)
+        current_page_table->dirty[page] &= ~tracker;
+    UpdateWriteWatched(0, PageTable::NUM_ENTRIES);
+    if (fastmem_base != nullptr)
+        UpdateFastmemPages(0, PageTable::NUM_ENTRIES);
+}
+
+std::vector<DirtyRange> CollectDirtyRanges(DirtyTracker tracker) {
+    std::vector<DirtyRange> ranges;
+    if (!(dirty_tracking & tracker))
+        return ranges;
+
+    u32 page = 0;
+    while (page < PageTable::NUM_ENTRIES) {
+        if (!(current_page_table->dirty[page] & tracker)) {
+            ++page;
+            continue;
+        }
+
+        const u32 first = page;
+        for (; page < PageTable::NUM_ENTRIES && (current_page_table->dirty[page] & tracker); ++page) {
+            current_page_table->dirty[page] &= ~tracker;
+            current_page_table->write_watched[page] = true;
+        }
+        ranges.push_back({ first << PAGE_BITS, (page - first) << PAGE_BITS });
+
+        // Only mapped pages are dirty, the whole range is made read-only again at once
+        if (fastmem_base != nullptr)
+            fastmem.Protect((size_t)first << PAGE_BITS, (size_t)(page - first) << PAGE_BITS, false);
+    }
+    return ranges;
+}
+
+void SetAccessSampling(bool enabled) {
+    access_sampling = enabled;
+    if (enabled) {
+        if (sampling_pointers == nullptr) {
+            sampling_pointers = Common::make_unique<std::array<u8*, PageTable::NUM_ENTRIES>>();
+            sampling_pointers->fill(nullptr);
+        }
+        fast_access_table.fastmem_base = nullptr;
+        fast_access_table.pointers = sampling_pointers->data();
+    } else {
+        fast_access_table.fastmem_base = fastmem_base;
+        fast_access_table.pointers = current_page_table != nullptr ? current_page_table->pointers.data() : nullptr;
+        sampling_pointers.reset();
+    }
+}
+
+bool InitFastmem(size_t backing_size) {
+    ASSERT(fastmem_base == nullptr);
+
+    backing_size = (backing_size + PAGE_MASK) & ~PAGE_MASK;
+    if (!fastmem.Init(backing_size, (size_t)1 << 32)) {
+        LOG_WARNING(HW_Memory, "Fastmem isn't available on this host");
+        return false;
+    }
+
+    fastmem_base = fastmem.ViewBase();
+    if (!access_sampling)
+        fast_access_table.fastmem_base = fastmem_base;
+    fastmem_allocated = 0;
+    fastmem.SetFaultHandler(HandleFastmemFault);
+
+    // Mirror anything that has been mapped already
+    UpdateFastmemPages(0, PageTable::NUM_ENTRIES);
+
+    LOG_DEBUG(HW_Memory, "Fastmem view at %p", fastmem_base);
+    return true;
+}
+
+void ShutdownFastmem() {
+    fastmem.Release();
+    fastmem_base = nullptr;
+    fast_access_table.fastmem_base = nullptr;
+    fastmem_allocated = 0;
+    fastmem_copied_pages.clear();
+}
+
+u8* AllocateFastmemMemory(u32 size) {
+    if (fastmem_base == nullptr)
+        return nullptr;
+
+    size = (size + PAGE_MASK) & ~PAGE_MASK;
+    ASSERT_MSG(fastmem_allocated + size <= fastmem.BackingSize(), "Out of fastmem backing memory");
+
+    u8* memory = fastmem.BackingBase() + fastmem_allocated;
+    fastmem_allocated += size;
+    return memory;
+}
+
+void RefreshFastmemCopies() {
+    for (u32 page : fastmem_copied_pages) {
+        const u8* pointer = current_page_table->pointers[page];
+        if (pointer != nullptr && !fastmem.IsBacking(pointer))
+            std::memcpy(fastmem_base + ((size_t)page << PAGE_BITS), pointer, PAGE_SIZE);
+    }
+}
 
-    if (size & 1)
-        Write8(addr + offset, data[offset]);
+u8* GetFastmemBase() {
+    return fastmem_base;
 }
 
 } // namespace
@@ -4,15 +4,21 @@
 
 #pragma once
 
+#include <vector>
+
 #include "common/common_types.h"
 
 namespace Memory {
 
+class MMIORegion;
+
 /**
  * Page size used by the ARM architecture. This is the smallest granularity with which memory can
  * be mapped.
  */
 const u32 PAGE_SIZE = 0x1000;
+const u32 PAGE_MASK = PAGE_SIZE - 1;
+const int PAGE_BITS = 12;
 
 /// Physical memory regions as seen from the ARM11
 enum : PAddr {
@@ -115,15 +121,168 @@ void Write16(VAddr addr, u16 data);
 void Write32(VAddr addr, u32 data);
 void Write64(VAddr addr, u64 data);
 
-void WriteBlock(VAddr addr, const u8* data, size_t size);
+/**
+ * Tables the CPU cores access memory through without calling into memory.cpp, see FastRead and
+ * FastWrite. The tables are owned by the memory map and stay valid while the system is running.
+ */
+struct FastAccessTable {
+    /// Base of the fastmem view, nullptr if fastmem is disabled and the page tables are used
+    u8* fastmem_base;
+    /// Host memory backing each page, nullptr if the page isn't plain memory
+    u8* const* pointers;
+    /// Whether writes to each page have to be seen by the dirty trackers or the code invalidation
+    const bool* write_watched;
+};
+
+/// Returns the fast access table, whose address never changes
+const FastAccessTable& GetFastAccessTable();
+
+/**
+ * Whether an address is in the I/O area, whose pages aren't mapped in the fastmem view. Accesses
+ * to it have to go through the Read and Write functions to reach the MMIO handlers.
+ */
+inline bool IsIOAddress(const VAddr vaddr) {
+    return vaddr - static_cast<u32>(IO_AREA_VADDR) < static_cast<u32>(IO_AREA_SIZE);
+}
+
+/**
+ * Inlined version of the Read functions. Only accesses to I/O and unmapped pages call into
+ * memory.cpp, to be dispatched to the MMIO handlers or logged there, also with fastmem.
+ */
+template <typename T>
+inline T FastRead(const FastAccessTable& table, const VAddr vaddr) {
+    if (table.fastmem_base != nullptr && !IsIOAddress(vaddr))
+        return *reinterpret_cast<const T*>(table.fastmem_base + vaddr);
+
+    const u8* page_pointer = table.pointers[vaddr >> PAGE_BITS];
+    if (page_pointer != nullptr)
+        return *reinterpret_cast<const T*>(page_pointer + (vaddr & PAGE_MASK));
+
+    switch (sizeof(T)) {
+    case 1: return static_cast<T>(Read8(vaddr));
+    case 2: return static_cast<T>(Read16(vaddr));
+    case 4: return static_cast<T>(Read32(vaddr));
+    default: return static_cast<T>(Read64(vaddr));
+    }
+}
+
+/**
+ * Inlined version of the Write functions. Writes that have to be seen by the dirty trackers or
+ * discard translated code, as well as those to I/O and unmapped pages, call into memory.cpp.
+ */
+template <typename T>
+inline void FastWrite(const FastAccessTable& table, const VAddr vaddr, const T data) {
+    if (table.fastmem_base != nullptr && !IsIOAddress(vaddr)) {
+        // Writes to watched pages fault in the fastmem view
+        *reinterpret_cast<T*>(table.fastmem_base + vaddr) = data;
+        return;
+    }
+
+    u8* page_pointer = table.pointers[vaddr >> PAGE_BITS];
+    if (page_pointer != nullptr && !table.write_watched[vaddr >> PAGE_BITS]) {
+        *reinterpret_cast<T*>(page_pointer + (vaddr & PAGE_MASK)) = data;
+        return;
+    }
+
+    switch (sizeof(T)) {
+    case 1: Write8(vaddr, static_cast<u8>(data)); break;
+    case 2: Write16(vaddr, static_cast<u16>(data)); break;
+    case 4: Write32(vaddr, static_cast<u32>(data)); break;
+    default: Write64(vaddr, static_cast<u64>(data)); break;
+    }
+}
+
+/**
+ * Block transfers between emulated memory and host buffers. These can cross page boundaries, doing
+ * one copy per span of contiguous host memory. Parts of the range that aren't mapped to memory are
+ * logged; they read as zero and writes to them are ignored. Writes discard code translated from
+ * the written range.
+ */
+void ReadBlock(VAddr src_addr, void* dest_buffer, size_t size);
+void WriteBlock(VAddr dest_addr, const void* src_buffer, size_t size);
+void ZeroBlock(VAddr dest_addr, size_t size);
+
+/// Copies a block of emulated memory to another, non-overlapping, location in emulated memory
+void CopyBlock(VAddr dest_addr, VAddr src_addr, size_t size);
+
+/**
+ * Notifies the CPU cores that a memory range was modified without going through the Write
+ * functions (e.g. by DMA through a host pointer), discarding code translated from it and marking
+ * it dirty.
+ */
+void InvalidateCodeRange(VAddr start, u32 size);
+
+/**
+ * Users of the dirty page tracking. Each one has its own dirty bit per page, so that collecting
+ * the written pages for one of them doesn't hide them from the others.
+ */
+enum DirtyTracker : u8 {
+    DIRTY_TRACKER_SAVE_STATE  = 1 << 0,
+    DIRTY_TRACKER_VIDEO_CORE  = 1 << 1,
+    DIRTY_TRACKER_REWIND      = 1 << 2,
+    DIRTY_TRACKER_GPU_CAPTURE = 1 << 3,
+};
+
+/// Range of pages of the address space written since they were last collected
+struct DirtyRange {
+    VAddr start;
+    u32 size;
+};
+
+/**
+ * Starts tracking the pages written by the CPU, and by the host through WriteBlock et al. or
+ * ranges passed to InvalidateCodeRange. All mapped pages are dirty to begin with. With fastmem,
+ * pages are write-protected until they are written once after being collected, otherwise the
+ * Write functions mark them.
+ */
+void EnableDirtyTracking(DirtyTracker tracker);
+
+/// Stops tracking the written pages for a tracker
+void DisableDirtyTracking(DirtyTracker tracker);
+
+/**
+ * Returns the pages written since the last call for a tracker, merging neighbouring pages into
+ * ranges, and marks them clean for it
+ */
+std::vector<DirtyRange> CollectDirtyRanges(DirtyTracker tracker);
+
+/**
+ * Sends every access of the CPU cores through the Read and Write functions, bypassing fastmem and
+ * the inlined accesses, so that MemoryStats counts them
+ */
+void SetAccessSampling(bool enabled);
 
 u8* GetPointer(VAddr virtual_address);
 
+/// Returns the handler of the I/O page containing the given address, or nullptr if there is none
+MMIORegion* GetMMIORegion(VAddr virtual_address);
+
+/**
+ * Returns a host pointer to a range of emulated memory if all of it is backed by contiguous host
+ * memory, or nullptr otherwise. Code translated from the range isn't discarded when it's written
+ * through the pointer, see InvalidateCodeRange.
+ */
+u8* GetContiguousPointer(VAddr virtual_address, size_t size);
+
+/**
+ * Returns the base of the fastmem view, in which the emulated address space is mapped 1:1, or
+ * nullptr if fastmem is disabled.
+ */
+u8* GetFastmemBase();
+
 /**
  * Gets a pointer to the memory region beginning at the specified physical address.
  *
- * @note This is currently implemented using PhysicalToVirtualAddress().
+ * @note Looked up in the physical page table, which covers VRAM, DSP RAM and FCRAM.
  */
 u8* GetPhysicalPointer(PAddr address);
 
+/**
+ * Gets the host memory backing a physical address along with the rest of its physical region, which
+ * follows it contiguously. Meant for resolving the pointer to a buffer once, rather than per access.
+ * @param size Set to the number of bytes accessible through the returned pointer, 0 if there are none
+ * @return Host pointer, or nullptr if the address isn't backed by memory
+ */
+u8* GetPhysicalSpan(PAddr address, u32& size);
+
 }
@@ -7,14 +7,16 @@
 #include "common/common_types.h"
 
 #include "core/memory.h"
+#include "core/mmio.h"
 
 namespace Memory {
 
-const u32 PAGE_MASK = PAGE_SIZE - 1;
-const int PAGE_BITS = 12;
-
+/// Allocates the page table of the emulated process, with all of its pages unmapped
 void InitMemoryMap();
 
+/// Frees the page table. Memory can't be accessed until the next call to InitMemoryMap.
+void ShutdownMemoryMap();
+
 /**
  * Maps an allocated buffer onto a region of the emulated process address space.
  *
@@ -25,12 +27,52 @@ void InitMemoryMap();
 void MapMemoryRegion(VAddr base, u32 size, u8* target);
 
 /**
- * Maps a region of the emulated process address space as a IO region.
- * @note Currently this can only be used to mark a region as being IO, since actual memory-mapped
- *       IO isn't yet supported.
+ * Maps a region of the emulated process address space as an IO region.
+ * @param mmio_region Handler of the accesses to the region, or nullptr if no device handles it and
+ *                    accesses are only logged. It has to outlive the mapping.
  */
-void MapIoRegion(VAddr base, u32 size);
+void MapIoRegion(VAddr base, u32 size, MMIORegion* mmio_region);
 
 void UnmapRegion(VAddr base, u32 size);
 
+/**
+ * Maps an allocated buffer onto a region of the physical address space, for GetPhysicalPointer and
+ * GetPhysicalSpan. The region has to lie between VRAM and the end of FCRAM.
+ *
+ * @param base The physical address to start mapping at. Must be page-aligned.
+ * @param size The amount of bytes to map. Must be page-aligned.
+ * @param target Buffer with the memory backing the region. Must be of length at least `size`.
+ */
+void MapPhysicalRegion(PAddr base, u32 size, u8* target);
+
+/**
+ * Flags the page containing the given address as a source of translated CPU code. The next write
+ * to the page discards the translations made from it and clears the flag again.
+ */
+void MarkCodePage(VAddr vaddr);
+
+/**
+ * Enables fastmem, mirroring the emulated address space into a host address space view. Only
+ * memory allocated with AllocateFastmemMemory can be accessed through the view directly; other
+ * memory is mapped as a copy (see RefreshFastmemCopies). Must be called before mapping memory.
+ * @param backing_size Total amount of memory that will be allocated with AllocateFastmemMemory
+ * @return true if fastmem is supported by the host and has been enabled
+ */
+bool InitFastmem(size_t backing_size);
+
+/// Disables fastmem and frees all memory allocated with AllocateFastmemMemory
+void ShutdownFastmem();
+
+/**
+ * Allocates zeroed memory that can back emulated memory regions mapped into the fastmem view.
+ * @return The allocated memory, or nullptr if fastmem is disabled
+ */
+u8* AllocateFastmemMemory(u32 size);
+
+/**
+ * Updates the fastmem view copies of the mapped pages whose host memory can't be aliased. Has to
+ * be called after modifying such memory from the host.
+ */
+void RefreshFastmemCopies();
+
 }
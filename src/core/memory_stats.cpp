@@ -0,0 +1,261 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common/common_funcs.h"
+#include "common/common_types.h"
+#include "common/file_util.h"
+#include "common/logging/log.h"
+#include "common/string_util.h"
+
+#include "core/memory.h"
+#include "core/memory_stats.h"
+#include "core/settings.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace MemoryStats
+
+namespace MemoryStats {
+
+bool g_sampling = false;
+
+/// Regions of the address space the accesses are summarized by
+enum class Region {
+    ProcessImage,
+    IPCMapping,
+    Heap,
+    SharedMemory,
+    LinearHeap,
+    IO,
+    VRAM,
+    DSP,
+    SharedPage,
+    TLS,
+    FCRAM,
+    Other,
+
+    Count,
+};
+
+static const char* const region_names[] = {
+    "process_image", "ipc_mapping", "heap", "shared_memory", "linear_heap", "io", "vram", "dsp",
+    "shared_page", "tls", "fcram", "other",
+};
+static_assert(ARRAY_SIZE(region_names) == static_cast<size_t>(Region::Count), "Missing region names");
+
+static const char* const gpu_read_names[] = {
+    "command_list", "index_array", "vertex_array", "texture", "transfer_source", "scanout",
+};
+static_assert(ARRAY_SIZE(gpu_read_names) == static_cast<size_t>(GPURead::Count), "Missing GPU read names");
+
+static Region GetVirtualRegion(VAddr address) {
+    using namespace Memory;
+    if (address >= PROCESS_IMAGE_VADDR && address < PROCESS_IMAGE_VADDR_END)
+        return Region::ProcessImage;
+    if (address >= IPC_MAPPING_VADDR && address < IPC_MAPPING_VADDR_END)
+        return Region::IPCMapping;
+    if (address >= HEAP_VADDR && address < HEAP_VADDR_END)
+        return Region::Heap;
+    if (address >= SHARED_MEMORY_VADDR && address < SHARED_MEMORY_VADDR_END)
+        return Region::SharedMemory;
+    if (address >= LINEAR_HEAP_VADDR && address < LINEAR_HEAP_VADDR_END)
+        return Region::LinearHeap;
+    if (address >= IO_AREA_VADDR && address < IO_AREA_VADDR_END)
+        return Region::IO;
+    if (address >= VRAM_VADDR && address < VRAM_VADDR_END)
+        return Region::VRAM;
+    if (address >= DSP_RAM_VADDR && address < DSP_RAM_VADDR_END)
+        return Region::DSP;
+    if (address >= CONFIG_MEMORY_VADDR && address < SHARED_PAGE_VADDR_END)
+        return Region::SharedPage;
+    if (address >= TLS_AREA_VADDR && address < TLS_AREA_VADDR_END)
+        return Region::TLS;
+    return Region::Other;
+}
+
+static Region GetPhysicalRegion(PAddr address) {
+    using namespace Memory;
+    if (address >= VRAM_PADDR && address < VRAM_PADDR_END)
+        return Region::VRAM;
+    if (address >= DSP_RAM_PADDR && address < DSP_RAM_PADDR_END)
+        return Region::DSP;
+    if (address >= FCRAM_PADDR && address < FCRAM_PADDR_END)
+        return Region::FCRAM;
+    return Region::Other;
+}
+
+/// Sampled accesses of the CPU to a region or a page
+struct AccessCounts {
+    u32 reads;
+    u32 writes;
+};
+
+/// Reads of the GPU of one kind, with their sizes in power of two buckets
+struct GPUReadCounts {
+    static const int NUM_BUCKETS = 24;
+
+    u64 reads;
+    u64 bytes;
+    /// Reads of up to 2^i bytes, the last bucket counts all the larger ones
+    std::array<u64, NUM_BUCKETS> sizes;
+};
+
+/// Physical pages the GPU reads are counted for, from the start of VRAM to the end of FCRAM
+static const PAddr GPU_PAGES_PADDR = Memory::VRAM_PADDR;
+static const size_t NUM_GPU_PAGES = (Memory::FCRAM_PADDR_END - GPU_PAGES_PADDR) >> Memory::PAGE_BITS;
+
+static int sample_interval;
+/// Accesses left until the next one is recorded
+static int accesses_to_sample;
+static std::array<AccessCounts, static_cast<size_t>(Region::Count)> region_accesses;
+/// Indexed by the virtual page number, allocated when sampling starts
+static std::vector<AccessCounts> page_accesses;
+
+/// Guards the GPU read counts, which the GPU and the vertex shading workers update
+static std::mutex gpu_mutex;
+static std::array<GPUReadCounts, static_cast<size_t>(GPURead::Count)> gpu_reads;
+/// Bytes read from each physical page, indexed from GPU_PAGES_PADDR
+static std::vector<u64> gpu_page_bytes;
+
+void Init() {
+    if (Settings::values.memory_stats_file.empty())
+        return;
+
+    sample_interval = std::max(Settings::values.memory_stats_interval, 1);
+    accesses_to_sample = sample_interval;
+    region_accesses.fill({ 0, 0 });
+    page_accesses.assign(size_t(1) << (32 - Memory::PAGE_BITS), { 0, 0 });
+    {
+        std::lock_guard<std::mutex> lock(gpu_mutex);
+        for (GPUReadCounts& counts : gpu_reads) {
+            counts.reads = counts.bytes = 0;
+            counts.sizes.fill(0);
+        }
+        gpu_page_bytes.assign(NUM_GPU_PAGES, 0);
+    }
+
+    g_sampling = true;
+    Memory::SetAccessSampling(true);
+    LOG_INFO(HW_Memory, "Sampling one in %d memory accesses", sample_interval);
+}
+
+void Shutdown() {
+    if (!g_sampling)
+        return;
+
+    Memory::SetAccessSampling(false);
+    g_sampling = false;
+    if (ExportHeatmap(Settings::values.memory_stats_file))
+        LOG_INFO(HW_Memory, "Memory access statistics written to %s", Settings::values.memory_stats_file.c_str());
+
+    std::vector<AccessCounts>().swap(page_accesses);
+    std::lock_guard<std::mutex> lock(gpu_mutex);
+    std::vector<u64>().swap(gpu_page_bytes);
+}
+
+void RecordAccess(VAddr address, bool is_write) {
+    if (--accesses_to_sample > 0)
+        return;
+    accesses_to_sample = sample_interval;
+
+    AccessCounts& region = region_accesses[static_cast<size_t>(GetVirtualRegion(address))];
+    AccessCounts& page = page_accesses[address >> Memory::PAGE_BITS];
+    if (is_write) {
+        ++region.writes;
+        ++page.writes;
+    } else {
+        ++region.reads;
+        ++page.reads;
+    }
+}
+
+void RecordGPURead(GPURead kind, PAddr address, u32 size) {
+    std::lock_guard<std::mutex> lock(gpu_mutex);
+    if (gpu_page_bytes.empty())
+        return;
+
+    GPUReadCounts& counts = gpu_reads[static_cast<size_t>(kind)];
+    ++counts.reads;
+    counts.bytes += size;
+    int bucket = 0;
+    while (bucket < GPUReadCounts::NUM_BUCKETS - 1 && (u64(1) << bucket) < size)
+        ++bucket;
+    ++counts.sizes[bucket];
+
+    // The bytes are split between the pages the read spans
+    const PAddr end = address + size;
+    while (address < end) {
+        const PAddr page_end = std::min<PAddr>((address | Memory::PAGE_MASK) + 1, end);
+        if (address >= GPU_PAGES_PADDR && address - GPU_PAGES_PADDR < NUM_GPU_PAGES << Memory::PAGE_BITS)
+            gpu_page_bytes[(address - GPU_PAGES_PADDR) >> Memory::PAGE_BITS] += page_end - address;
+        if (page_end <= address)
+            break; // Wrapped around the address space
+        address = page_end;
+    }
+}
+
+bool ExportHeatmap(const std::string& path) {
+    FileUtil::IOFile file(path, "w");
+    if (!file.IsOpen()) {
+        LOG_ERROR(HW_Memory, "Failed to open %s", path.c_str());
+        return false;
+    }
+
+    std::string text = Common::StringFromFormat("# One in %d CPU accesses sampled, all GPU reads counted\n",
+                                                sample_interval);
+
+    text += "[cpu_regions]\nregion,read_samples,write_samples\n";
+    for (size_t region = 0; region < region_accesses.size(); ++region) {
+        text += Common::StringFromFormat("%s,%u,%u\n", region_names[region],
+                                         region_accesses[region].reads, region_accesses[region].writes);
+    }
+
+    text += "[cpu_pages]\naddress,region,read_samples,write_samples\n";
+    for (size_t page = 0; page < page_accesses.size(); ++page) {
+        const AccessCounts& counts = page_accesses[page];
+        if (counts.reads == 0 && counts.writes == 0)
+            continue;
+        const VAddr address = static_cast<VAddr>(page << Memory::PAGE_BITS);
+        text += Common::StringFromFormat("0x%08X,%s,%u,%u\n", address,
+                                         region_names[static_cast<size_t>(GetVirtualRegion(address))],
+                                         counts.reads, counts.writes);
+    }
+
+    std::lock_guard<std::mutex> lock(gpu_mutex);
+    text += "[gpu_reads]\nkind,reads,bytes";
+    for (int bucket = 0; bucket < GPUReadCounts::NUM_BUCKETS - 1; ++bucket)
+        text += Common::StringFromFormat(",le_%llu", (unsigned long long)(u64(1) << bucket));
+    text += ",larger\n";
+    for (size_t kind = 0; kind < gpu_reads.size(); ++kind) {
+        const GPUReadCounts& counts = gpu_reads[kind];
+        text += Common::StringFromFormat("%s,%llu,%llu", gpu_read_names[kind],
+                                         (unsigned long long)counts.reads, (unsigned long long)counts.bytes);
+        for (u64 count : counts.sizes)
+            text += Common::StringFromFormat(",%llu", (unsigned long long)count);
+        text += "\n";
+    }
+
+    text += "[gpu_pages]\naddress,region,bytes\n";
+    for (size_t page = 0; page < gpu_page_bytes.size(); ++page) {
+        if (gpu_page_bytes[page] == 0)
+            continue;
+        const PAddr address = GPU_PAGES_PADDR + static_cast<PAddr>(page << Memory::PAGE_BITS);
+        text += Common::StringFromFormat("0x%08X,%s,%llu\n", address,
+                                         region_names[static_cast<size_t>(GetPhysicalRegion(address))],
+                                         (unsigned long long)gpu_page_bytes[page]);
+    }
+
+    if (file.WriteBytes(text.data(), text.size()) != text.size()) {
+        LOG_ERROR(HW_Memory, "Failed to write %s", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
@@ -0,0 +1,75 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+
+#include "common/common_types.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace MemoryStats
+
+/**
+ * Statistics of the guest's memory accesses, for tuning fastmem, the caches and the invalidation
+ * of translated code and GPU resources. While sampling, the CPU cores access memory through the
+ * Read and Write functions instead of the inlined paths and fastmem, and one in
+ * memory_stats_interval of those accesses is counted by region and page. The GPU reads from
+ * physical memory (command lists, index and vertex arrays, textures, transfer sources and the
+ * scanned out framebuffers) are all counted, by page and by size.
+ *
+ * The statistics are exported as CSV sections laid out for heatmaps, see ExportHeatmap.
+ */
+namespace MemoryStats {
+
+/// What the GPU reads from physical memory for
+enum class GPURead {
+    CommandList,
+    IndexArray,
+    VertexArray,
+    Texture,
+    TransferSource,
+    Scanout,
+
+    Count,
+};
+
+/// Starts sampling if a memory_stats_file is set. To be called after the memory is initialized.
+void Init();
+
+/// Writes the statistics to the memory_stats_file and stops sampling
+void Shutdown();
+
+/// Whether the accesses are being counted, set by Init and Shutdown
+extern bool g_sampling;
+
+inline bool IsSampling() {
+    return g_sampling;
+}
+
+/**
+ * Counts an access of the CPU or the HLE to emulated memory, from the emulation thread. Only one in
+ * memory_stats_interval calls is recorded.
+ */
+void RecordAccess(VAddr address, bool is_write);
+
+/// Counts a read of the GPU from physical memory, from any thread
+void RecordGPURead(GPURead kind, PAddr address, u32 size);
+
+/// Counts a read of the GPU if the accesses are being counted
+inline void SampleGPURead(GPURead kind, PAddr address, u32 size) {
+    if (IsSampling())
+        RecordGPURead(kind, address, size);
+}
+
+/**
+ * Writes the statistics collected so far, as CSV sections each starting with a "[name]" line:
+ * "cpu_regions" and "cpu_pages" with the sampled reads and writes of each region and page in
+ * address order, "gpu_reads" with the number of reads of each kind and their sizes in power of two
+ * buckets, and "gpu_pages" with the bytes the GPU read from each physical page.
+ * @return true on success
+ */
+bool ExportHeatmap(const std::string& path);
+
+} // namespace
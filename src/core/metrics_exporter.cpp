@@ -0,0 +1,560 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/logging/log.h"
+#include "common/make_unique.h"
+#include "common/memory_accounting.h"
+#include "common/perf_counters.h"
+#include "common/platform.h"
+#include "common/profiler_reporting.h"
+#include "common/string_util.h"
+#include "common/thread_policy.h"
+
+#include "core/core.h"
+#include "core/metrics_exporter.h"
+#include "core/settings.h"
+#include "core/arm/arm_interface.h"
+#include "core/hle/svc.h"
+
+#if EMU_PLATFORM == PLATFORM_WINDOWS
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+typedef SOCKET SocketHandle;
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+
+typedef int SocketHandle;
+static const SocketHandle INVALID_SOCKET = -1;
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace MetricsExporter
+
+namespace MetricsExporter {
+
+using Common::Profiling::Duration;
+using Common::Profiling::FrameSamples;
+using Common::Perf::HistogramTotals;
+
+/// Rate the emulated GPU shows frames at
+static const double FULL_SPEED_FPS = 60.0;
+
+/// Interval the gauges are computed over and StatsD is pushed to
+static const std::chrono::milliseconds SAMPLE_INTERVAL(1000);
+/// Longest time the exporter thread waits without checking whether it is stopping
+static const int POLL_INTERVAL_MS = 100;
+
+/// Largest StatsD datagram sent, which stays below the usual MTU
+static const size_t MAX_STATSD_PACKET_SIZE = 1400;
+/// Largest HTTP request header read, longer requests are answered after that much
+static const size_t MAX_REQUEST_SIZE = 8192;
+
+static const std::array<double, 3> PERCENTILES = {{ 0.5, 0.9, 0.99 }};
+
+/// Values of all counters at one point in time
+struct Snapshot {
+    std::chrono::steady_clock::time_point time;
+    u64 frames;
+    std::vector<Duration> time_per_category;
+    std::vector<FrameSamples> samples_per_category;
+    std::vector<u64> counters;
+    std::vector<HistogramTotals> histograms;
+    std::vector<SVC::SVCStatistics> svc_statistics;
+    size_t code_cache_used;
+    size_t code_cache_capacity;
+    std::array<Common::MemoryAccounting::TagUsage, Common::MemoryAccounting::NUM_TAGS> memory_usage;
+};
+
+/// Values computed from the counters' change over the last sample interval
+struct IntervalGauges {
+    double speed;
+    /// Value of each Perf::Histogram's samples at each of PERCENTILES, indexed by the histogram id
+    std::vector<std::array<double, 3>> percentiles;
+};
+
+static std::unique_ptr<std::thread> exporter_thread;
+static std::atomic<bool> stopping(false);
+static SocketHandle http_socket = INVALID_SOCKET;
+static SocketHandle statsd_socket = INVALID_SOCKET;
+
+static void CloseSocket(SocketHandle socket) {
+#if EMU_PLATFORM == PLATFORM_WINDOWS
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+static bool SendAll(SocketHandle socket, const char* data, size_t size) {
+#ifdef MSG_NOSIGNAL
+    // A client hanging up early mustn't kill the process
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    while (size != 0) {
+        const int sent = send(socket, data, static_cast<int>(size), flags);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+static Snapshot TakeSnapshot() {
+    auto& profiler = Common::Profiling::GetProfilingManager();
+
+    Snapshot snapshot;
+    snapshot.time = std::chrono::steady_clock::now();
+    snapshot.time_per_category = profiler.GetTotalTimePerCategory();
+    snapshot.samples_per_category = profiler.GetTotalSamplesPerCategory();
+    snapshot.counters = Common::Perf::GetCounterTotals();
+    snapshot.histograms = Common::Perf::GetHistogramTotals();
+    snapshot.frames = snapshot.histograms[profiler.GetFrameTimeHistogram().GetHistogramId()].count;
+    snapshot.svc_statistics = SVC::GetStatistics();
+    Core::g_app_core->GetCacheUsage(snapshot.code_cache_used, snapshot.code_cache_capacity);
+    snapshot.memory_usage = Common::MemoryAccounting::GetUsage();
+    return snapshot;
+}
+
+static IntervalGauges ComputeGauges(const Snapshot& previous, const Snapshot& current) {
+    const auto& histograms = Common::Perf::GetHistogramsInfo();
+    const double seconds = std::chrono::duration<double>(current.time - previous.time).count();
+    const u64 frames = current.frames - previous.frames;
+
+    IntervalGauges gauges;
+    gauges.speed = seconds > 0.0 ? frames / seconds / FULL_SPEED_FPS : 0.0;
+    gauges.percentiles.resize(current.histograms.size());
+    for (size_t id = 0; id < current.histograms.size(); ++id) {
+        // Only the samples taken during the interval count
+        std::vector<u64> buckets = current.histograms[id].buckets;
+        for (size_t i = 0; i < buckets.size(); ++i)
+            buckets[i] -= previous.histograms[id].buckets[i];
+        for (size_t i = 0; i < PERCENTILES.size(); ++i) {
+            gauges.percentiles[id][i] = Common::Perf::EstimatePercentile(histograms[id].histogram->GetBounds(),
+                                                                         buckets, PERCENTILES[i]);
+        }
+    }
+    return gauges;
+}
+
+/// Escapes a Prometheus label value
+static std::string EscapeLabel(const char* value) {
+    std::string escaped;
+    for (; *value != '\0'; ++value) {
+        if (*value == '\\' || *value == '"')
+            escaped += '\\';
+        escaped += *value;
+    }
+    return escaped;
+}
+
+/// Turns a category name into a metric name component, e.g. "Vertex cache hit rate (%)" into "vertex_cache_hit_rate"
+static std::string SanitizeName(const char* name) {
+    std::string sanitized;
+    for (; *name != '\0'; ++name) {
+        const unsigned char c = static_cast<unsigned char>(*name);
+        if (std::isalnum(c))
+            sanitized += static_cast<char>(std::tolower(c));
+        else if (!sanitized.empty() && sanitized.back() != '_')
+            sanitized += '_';
+    }
+    while (!sanitized.empty() && sanitized.back() == '_')
+        sanitized.pop_back();
+    return sanitized;
+}
+
+static void AppendHeader(std::string& out, const char* name, const char* type, const char* help) {
+    out += Common::StringFromFormat("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/// Formats the current counters and the last gauges in the Prometheus text exposition format
+static std::string FormatPrometheus(const Snapshot& snapshot, const IntervalGauges& gauges) {
+    const auto& profiler = Common::Profiling::GetProfilingManager();
+    std::string out;
+
+    AppendHeader(out, "citra_emulation_speed_ratio", "gauge",
+                 "Frames per second relative to full speed, over the last second");
+    out += Common::StringFromFormat("citra_emulation_speed_ratio %g\n", gauges.speed);
+
+    const auto& counters = Common::Perf::GetCountersInfo();
+    for (size_t id = 0; id < snapshot.counters.size(); ++id) {
+        const std::string name = "citra_" + SanitizeName(counters[id].name) + "_total";
+        AppendHeader(out, name.c_str(), "counter", counters[id].name);
+        out += Common::StringFromFormat("%s %llu\n", name.c_str(), (unsigned long long)snapshot.counters[id]);
+    }
+
+    const auto& histograms = Common::Perf::GetHistogramsInfo();
+    for (size_t id = 0; id < snapshot.histograms.size(); ++id) {
+        const HistogramTotals& totals = snapshot.histograms[id];
+        const std::vector<s64>& bounds = histograms[id].histogram->GetBounds();
+        const std::string name = "citra_" + SanitizeName(histograms[id].name);
+
+        AppendHeader(out, name.c_str(), "histogram", histograms[id].name);
+        u64 cumulative = 0;
+        for (size_t i = 0; i < bounds.size(); ++i) {
+            cumulative += totals.buckets[i];
+            out += Common::StringFromFormat("%s_bucket{le=\"%lld\"} %llu\n", name.c_str(),
+                                            (long long)bounds[i], (unsigned long long)cumulative);
+        }
+        out += Common::StringFromFormat("%s_bucket{le=\"+Inf\"} %llu\n", name.c_str(), (unsigned long long)totals.count);
+        out += Common::StringFromFormat("%s_sum %lld\n", name.c_str(), (long long)totals.sum);
+        out += Common::StringFromFormat("%s_count %llu\n", name.c_str(), (unsigned long long)totals.count);
+
+        if (id >= gauges.percentiles.size())
+            continue;
+        const std::string percentile_name = name + "_percentile";
+        AppendHeader(out, percentile_name.c_str(), "gauge", "Percentiles of the samples of the last second");
+        for (size_t i = 0; i < PERCENTILES.size(); ++i) {
+            out += Common::StringFromFormat("%s{quantile=\"%g\"} %g\n", percentile_name.c_str(),
+                                            PERCENTILES[i], gauges.percentiles[id][i]);
+        }
+    }
+
+    const auto& timing_categories = profiler.GetTimingCategoriesInfo();
+    AppendHeader(out, "citra_timing_seconds_total", "counter", "Host time spent in each profiler category");
+    for (size_t i = 0; i < snapshot.time_per_category.size() && i < timing_categories.size(); ++i) {
+        out += Common::StringFromFormat("citra_timing_seconds_total{category=\"%s\"} %g\n",
+                EscapeLabel(timing_categories[i].name).c_str(),
+                std::chrono::duration<double>(snapshot.time_per_category[i]).count());
+    }
+
+    const auto& sample_categories = profiler.GetSampleCategoriesInfo();
+    AppendHeader(out, "citra_samples_total", "counter", "Samples taken in each profiler sample category");
+    for (size_t i = 0; i < snapshot.samples_per_category.size() && i < sample_categories.size(); ++i) {
+        out += Common::StringFromFormat("citra_samples_total{category=\"%s\"} %llu\n",
+                EscapeLabel(sample_categories[i].name).c_str(),
+                (unsigned long long)snapshot.samples_per_category[i].count);
+    }
+    AppendHeader(out, "citra_sample_values_total", "counter",
+                 "Sum of the sampled values of each profiler sample category, e.g. of cache hit rates");
+    for (size_t i = 0; i < snapshot.samples_per_category.size() && i < sample_categories.size(); ++i) {
+        out += Common::StringFromFormat("citra_sample_values_total{category=\"%s\"} %lld\n",
+                EscapeLabel(sample_categories[i].name).c_str(),
+                (long long)snapshot.samples_per_category[i].sum);
+    }
+
+    AppendHeader(out, "citra_svc_calls_total", "counter", "Calls of each SVC");
+    for (const SVC::SVCStatistics& svc : snapshot.svc_statistics) {
+        out += Common::StringFromFormat("citra_svc_calls_total{svc=\"%s\"} %llu\n",
+                EscapeLabel(svc.name).c_str(), (unsigned long long)svc.calls);
+    }
+    AppendHeader(out, "citra_svc_seconds_total", "counter", "Host time spent in each SVC");
+    for (const SVC::SVCStatistics& svc : snapshot.svc_statistics) {
+        out += Common::StringFromFormat("citra_svc_seconds_total{svc=\"%s\"} %g\n",
+                EscapeLabel(svc.name).c_str(), svc.total_time_ns / 1e9);
+    }
+
+    AppendHeader(out, "citra_code_cache_used_bytes", "gauge", "Bytes of the CPU core's translated code cache in use");
+    out += Common::StringFromFormat("citra_code_cache_used_bytes %llu\n", (unsigned long long)snapshot.code_cache_used);
+    AppendHeader(out, "citra_code_cache_capacity_bytes", "gauge", "Size of the CPU core's translated code cache");
+    out += Common::StringFromFormat("citra_code_cache_capacity_bytes %llu\n",
+                                    (unsigned long long)snapshot.code_cache_capacity);
+
+    using Common::MemoryAccounting::Tag;
+    AppendHeader(out, "citra_memory_bytes", "gauge", "Host memory accounted to each subsystem");
+    for (size_t i = 0; i < snapshot.memory_usage.size(); ++i) {
+        out += Common::StringFromFormat("citra_memory_bytes{subsystem=\"%s\"} %llu\n",
+                Common::MemoryAccounting::GetTagName(static_cast<Tag>(i)),
+                (unsigned long long)snapshot.memory_usage[i].bytes);
+    }
+    AppendHeader(out, "citra_memory_peak_bytes", "gauge", "Most host memory accounted to each subsystem at any time");
+    for (size_t i = 0; i < snapshot.memory_usage.size(); ++i) {
+        out += Common::StringFromFormat("citra_memory_peak_bytes{subsystem=\"%s\"} %llu\n",
+                Common::MemoryAccounting::GetTagName(static_cast<Tag>(i)),
+                (unsigned long long)snapshot.memory_usage[i].peak_bytes);
+    }
+
+    return out;
+}
+
+/// Sends the change of the counters over the last interval and the gauges to the StatsD server
+static void PushStatsD(const Snapshot& previous, const Snapshot& current, const IntervalGauges& gauges) {
+    const auto& profiler = Common::Profiling::GetProfilingManager();
+    std::vector<std::string> lines;
+
+    lines.push_back(Common::StringFromFormat("citra.emulation_speed:%g|g", gauges.speed));
+    lines.push_back(Common::StringFromFormat("citra.frames:%llu|c",
+                                             (unsigned long long)(current.frames - previous.frames)));
+
+    const auto& counters = Common::Perf::GetCountersInfo();
+    for (size_t id = 0; id < current.counters.size(); ++id) {
+        const u64 before = id < previous.counters.size() ? previous.counters[id] : 0;
+        lines.push_back(Common::StringFromFormat("citra.%s:%llu|c", SanitizeName(counters[id].name).c_str(),
+                                                 (unsigned long long)(current.counters[id] - before)));
+    }
+
+    const auto& histograms = Common::Perf::GetHistogramsInfo();
+    for (size_t id = 0; id < gauges.percentiles.size(); ++id) {
+        const std::string name = SanitizeName(histograms[id].name);
+        lines.push_back(Common::StringFromFormat("citra.%s.p50:%g|g", name.c_str(), gauges.percentiles[id][0]));
+        lines.push_back(Common::StringFromFormat("citra.%s.p90:%g|g", name.c_str(), gauges.percentiles[id][1]));
+        lines.push_back(Common::StringFromFormat("citra.%s.p99:%g|g", name.c_str(), gauges.percentiles[id][2]));
+    }
+
+    // Categories can't disappear, but the totals only cover the categories once a frame finished
+    const auto& timing_categories = profiler.GetTimingCategoriesInfo();
+    for (size_t i = 0; i < current.time_per_category.size() && i < timing_categories.size(); ++i) {
+        const Duration before = i < previous.time_per_category.size() ? previous.time_per_category[i] : Duration::zero();
+        const double ms = std::chrono::duration<double, std::milli>(current.time_per_category[i] - before).count();
+        lines.push_back(Common::StringFromFormat("citra.timing.%s_ms:%g|g",
+                SanitizeName(timing_categories[i].name).c_str(), ms));
+    }
+
+    const auto& sample_categories = profiler.GetSampleCategoriesInfo();
+    for (size_t i = 0; i < current.samples_per_category.size() && i < sample_categories.size(); ++i) {
+        FrameSamples before = { 0, 0 };
+        if (i < previous.samples_per_category.size())
+            before = previous.samples_per_category[i];
+        const u64 count = current.samples_per_category[i].count - before.count;
+        if (count == 0)
+            continue;
+        const std::string name = SanitizeName(sample_categories[i].name);
+        lines.push_back(Common::StringFromFormat("citra.samples.%s.avg:%g|g", name.c_str(),
+                (double)(current.samples_per_category[i].sum - before.sum) / count));
+        lines.push_back(Common::StringFromFormat("citra.samples.%s.count:%llu|c", name.c_str(),
+                (unsigned long long)count));
+    }
+
+    for (const SVC::SVCStatistics& svc : current.svc_statistics) {
+        u64 calls = svc.calls;
+        for (const SVC::SVCStatistics& before : previous.svc_statistics) {
+            if (before.id == svc.id)
+                calls -= before.calls;
+        }
+        if (calls != 0) {
+            lines.push_back(Common::StringFromFormat("citra.svc.%s:%llu|c",
+                    SanitizeName(svc.name).c_str(), (unsigned long long)calls));
+        }
+    }
+    lines.push_back(Common::StringFromFormat("citra.code_cache_used_bytes:%llu|g",
+                                             (unsigned long long)current.code_cache_used));
+    for (size_t i = 0; i < current.memory_usage.size(); ++i) {
+        const char* tag_name = Common::MemoryAccounting::GetTagName(static_cast<Common::MemoryAccounting::Tag>(i));
+        lines.push_back(Common::StringFromFormat("citra.memory.%s_bytes:%llu|g", SanitizeName(tag_name).c_str(),
+                                                 (unsigned long long)current.memory_usage[i].bytes));
+    }
+
+    // Lines are packed into datagrams, StatsD servers take several separated by newlines
+    std::string packet;
+    for (const std::string& line : lines) {
+        if (!packet.empty() && packet.size() + 1 + line.size() > MAX_STATSD_PACKET_SIZE) {
+            send(statsd_socket, packet.data(), static_cast<int>(packet.size()), 0);
+            packet.clear();
+        }
+        if (!packet.empty())
+            packet += '\n';
+        packet += line;
+    }
+    if (!packet.empty())
+        send(statsd_socket, packet.data(), static_cast<int>(packet.size()), 0);
+}
+
+/// Reads an HTTP request from a client that connected and answers it
+static void ServeRequest(SocketHandle client, const IntervalGauges& gauges) {
+    // A client that never sends its request mustn't block the exporter
+#if EMU_PLATFORM == PLATFORM_WINDOWS
+    const DWORD timeout = 1000;
+#else
+    const timeval timeout = { 1, 0 };
+#endif
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+
+    std::string request;
+    char buffer[1024];
+    while (request.size() < MAX_REQUEST_SIZE && request.find("\r\n\r\n") == std::string::npos) {
+        const int received = recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+            break;
+        request.append(buffer, received);
+    }
+
+    const bool is_metrics = request.compare(0, 12, "GET /metrics") == 0 &&
+                            (request.size() == 12 || request[12] == ' ' || request[12] == '?');
+    std::string response;
+    if (is_metrics) {
+        const std::string body = FormatPrometheus(TakeSnapshot(), gauges);
+        response = Common::StringFromFormat("HTTP/1.1 200 OK\r\n"
+                                            "Content-Type: text/plain; version=0.0.4\r\n"
+                                            "Content-Length: %u\r\n"
+                                            "Connection: close\r\n\r\n", (unsigned)body.size()) + body;
+    } else {
+        response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    }
+    SendAll(client, response.data(), response.size());
+}
+
+static void ExporterLoop() {
+    Common::RegisterCurrentThread("MetricsExporter", Common::ThreadClass::Worker);
+
+    Snapshot previous = TakeSnapshot();
+    IntervalGauges gauges = {};
+    auto next_sample = previous.time + SAMPLE_INTERVAL;
+
+    while (!stopping) {
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= next_sample) {
+            Snapshot current = TakeSnapshot();
+            gauges = ComputeGauges(previous, current);
+            if (statsd_socket != INVALID_SOCKET)
+                PushStatsD(previous, current, gauges);
+            previous = std::move(current);
+
+            // Intervals missed while the thread was held up are skipped
+            next_sample = std::max(next_sample + SAMPLE_INTERVAL, now);
+            continue;
+        }
+
+        const int timeout_ms = static_cast<int>(std::min<long long>(POLL_INTERVAL_MS,
+                std::chrono::duration_cast<std::chrono::milliseconds>(next_sample - now).count() + 1));
+        if (http_socket == INVALID_SOCKET) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+            continue;
+        }
+
+        pollfd poll_fd;
+        poll_fd.fd = http_socket;
+        poll_fd.events = POLLIN;
+        poll_fd.revents = 0;
+#if EMU_PLATFORM == PLATFORM_WINDOWS
+        const int ready = WSAPoll(&poll_fd, 1, timeout_ms);
+#else
+        const int ready = poll(&poll_fd, 1, timeout_ms);
+#endif
+        if (ready <= 0 || !(poll_fd.revents & POLLIN))
+            continue;
+
+        const SocketHandle client = accept(http_socket, nullptr, nullptr);
+        if (client != INVALID_SOCKET) {
+            ServeRequest(client, gauges);
+            CloseSocket(client);
+        }
+    }
+}
+
+/// Listens for HTTP connections on the given port of all interfaces
+static SocketHandle OpenHttpSocket(int port) {
+    const SocketHandle socket_handle = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (socket_handle == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    // Lets a restarted instance bind the port again right away
+    const int reuse = 1;
+    setsockopt(socket_handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<u16>(port));
+    if (bind(socket_handle, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(socket_handle, 4) != 0) {
+        LOG_ERROR(Core, "Can't serve metrics on port %d", port);
+        CloseSocket(socket_handle);
+        return INVALID_SOCKET;
+    }
+
+    LOG_INFO(Core, "Serving metrics on http://localhost:%d/metrics", port);
+    return socket_handle;
+}
+
+/// Opens a UDP socket sending to a StatsD server, given as host:port
+static SocketHandle OpenStatsDSocket(const std::string& address) {
+    const size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == address.size()) {
+        LOG_ERROR(Core, "Invalid StatsD address %s, expected host:port", address.c_str());
+        return INVALID_SOCKET;
+    }
+    const std::string host = address.substr(0, colon);
+    const std::string port = address.substr(colon + 1);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0 || result == nullptr) {
+        LOG_ERROR(Core, "Can't resolve StatsD address %s", address.c_str());
+        return INVALID_SOCKET;
+    }
+
+    // Connecting a UDP socket only sets where send sends to
+    SocketHandle socket_handle = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (socket_handle != INVALID_SOCKET &&
+            connect(socket_handle, result->ai_addr, static_cast<int>(result->ai_addrlen)) != 0) {
+        CloseSocket(socket_handle);
+        socket_handle = INVALID_SOCKET;
+    }
+    freeaddrinfo(result);
+
+    if (socket_handle == INVALID_SOCKET)
+        LOG_ERROR(Core, "Can't send metrics to StatsD at %s", address.c_str());
+    else
+        LOG_INFO(Core, "Pushing metrics to StatsD at %s", address.c_str());
+    return socket_handle;
+}
+
+void Init() {
+    const int http_port = Settings::values.metrics_http_port;
+    const std::string& statsd_address = Settings::values.metrics_statsd_address;
+    if (http_port == 0 && statsd_address.empty())
+        return;
+
+#if EMU_PLATFORM == PLATFORM_WINDOWS
+    WSADATA data;
+    WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+
+    if (http_port != 0)
+        http_socket = OpenHttpSocket(http_port);
+    if (!statsd_address.empty())
+        statsd_socket = OpenStatsDSocket(statsd_address);
+
+    if (http_socket == INVALID_SOCKET && statsd_socket == INVALID_SOCKET) {
+#if EMU_PLATFORM == PLATFORM_WINDOWS
+        WSACleanup();
+#endif
+        return;
+    }
+
+    stopping = false;
+    exporter_thread = Common::make_unique<std::thread>(ExporterLoop);
+}
+
+void Shutdown() {
+    if (exporter_thread == nullptr)
+        return;
+
+    stopping = true;
+    exporter_thread->join();
+    exporter_thread.reset();
+
+    if (http_socket != INVALID_SOCKET)
+        CloseSocket(http_socket);
+    if (statsd_socket != INVALID_SOCKET)
+        CloseSocket(statsd_socket);
+    http_socket = statsd_socket = INVALID_SOCKET;
+
+#if EMU_PLATFORM == PLATFORM_WINDOWS
+    WSACleanup();
+#endif
+}
+
+} // namespace
@@ -0,0 +1,30 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace MetricsExporter
+
+/**
+ * Publishes performance metrics for monitoring many headless instances: the emulation speed, the
+ * time spent in every profiler TimingCategory, the samples of every SampleCategory (which include
+ * the cache hit rates), every Common::Perf counter and histogram with percentiles of the latter
+ * (which include the service calls and the frame times), the SVC calls, the use of the CPU
+ * core's code cache and the host memory accounted to each subsystem.
+ *
+ * The metrics are served in the Prometheus text format on http://<host>:<metrics_http_port>/metrics
+ * and/or pushed once a second to the StatsD server at metrics_statsd_address. A thread of its own
+ * samples them from counters that don't need locks on the emulation thread's side, so exporting
+ * doesn't slow the emulation down.
+ */
+namespace MetricsExporter {
+
+/// Starts exporting if it is enabled in the settings. Called after the core is initialized.
+void Init();
+
+/// Stops exporting, before the core is shut down
+void Shutdown();
+
+} // namespace
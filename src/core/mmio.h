@@ -0,0 +1,57 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <memory>
+
+#include "common/common_types.h"
+
+namespace Memory {
+
+/**
+ * Handler of the accesses to a range of memory-mapped I/O pages. Devices map their registers with
+ * MapIoRegion, after which accesses to the pages are dispatched to the handler straight from the
+ * page table. The handler gets the virtual address that was accessed.
+ */
+class MMIORegion {
+public:
+    virtual ~MMIORegion() = default;
+
+    virtual u8 Read8(VAddr addr) = 0;
+    virtual u16 Read16(VAddr addr) = 0;
+    virtual u32 Read32(VAddr addr) = 0;
+    virtual u64 Read64(VAddr addr) = 0;
+
+    virtual void Write8(VAddr addr, u8 data) = 0;
+    virtual void Write16(VAddr addr, u16 data) = 0;
+    virtual void Write32(VAddr addr, u32 data) = 0;
+    virtual void Write64(VAddr addr, u64 data) = 0;
+
+    /// Calls the Read function matching the size of T
+    template <typename T>
+    T Read(VAddr addr) {
+        switch (sizeof(T)) {
+        case 1: return static_cast<T>(Read8(addr));
+        case 2: return static_cast<T>(Read16(addr));
+        case 4: return static_cast<T>(Read32(addr));
+        default: return static_cast<T>(Read64(addr));
+        }
+    }
+
+    /// Calls the Write function matching the size of T
+    template <typename T>
+    void Write(VAddr addr, T data) {
+        switch (sizeof(T)) {
+        case 1: Write8(addr, static_cast<u8>(data)); break;
+        case 2: Write16(addr, static_cast<u16>(data)); break;
+        case 4: Write32(addr, static_cast<u32>(data)); break;
+        default: Write64(addr, static_cast<u64>(data)); break;
+        }
+    }
+};
+
+using MMIORegionPointer = std::shared_ptr<MMIORegion>;
+
+} // namespace
@@ -0,0 +1,380 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/compression.h"
+#include "common/logging/log.h"
+#include "common/make_unique.h"
+#include "common/thread_policy.h"
+
+#include "core/mem_map.h"
+#include "core/memory.h"
+#include "core/rewind.h"
+#include "core/savestate.h"
+#include "core/settings.h"
+
+#include "video_core/gpu_thread.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace Rewind
+
+namespace Rewind {
+
+/// Written pages copied by the emulation thread, for the compression thread to make a snapshot of
+struct Capture {
+    std::vector<u8> machine_state;
+    std::vector<VAddr> pages;
+    std::vector<u8> contents;
+};
+
+struct Snapshot {
+    /// Compressed machine state
+    std::vector<u8> machine_state;
+    size_t machine_state_size;
+    /// Pages that changed since the previous snapshot
+    std::vector<VAddr> pages;
+    /// Compressed XOR of the pages with their contents in the previous snapshot
+    std::vector<u8> deltas;
+
+    size_t GetSize() const {
+        return machine_state.size() + pages.size() * sizeof(VAddr) + deltas.size();
+    }
+};
+
+/// Copy of a memory region as of the latest snapshot
+struct ReferenceRegion {
+    VAddr base;
+    u32 size;
+    u8* memory;
+};
+
+static bool enabled = false;
+static unsigned interval;
+static size_t budget;
+
+static unsigned frames_until_snapshot;
+static bool snapshot_due = false;
+static std::atomic<bool> rewind_requested(false);
+
+// Allocated zeroed, so that the host only backs the pages that are ever written. Only accessed by
+// the compression thread while it is busy.
+static std::vector<ReferenceRegion> reference;
+/// Whether the reference is still all zeros, before the first snapshot
+static bool reference_is_blank;
+
+static std::unique_ptr<std::thread> compression_thread;
+static std::mutex mutex;
+static std::condition_variable work_available;
+static std::condition_variable work_done;
+static std::unique_ptr<Capture> pending_capture;
+static bool busy = false;
+static bool stopping = false;
+static std::deque<Snapshot> snapshots;
+static size_t snapshots_size = 0;
+
+/// Returns the copy of a page in the reference, or nullptr if the page isn't part of the state
+static u8* GetReferencePage(VAddr page) {
+    for (const ReferenceRegion& region : reference) {
+        if (page >= region.base && page - region.base < region.size)
+            return region.memory + (page - region.base);
+    }
+    return nullptr;
+}
+
+static void AllocateReference() {
+    for (const Memory::MemoryRegion& region : Memory::GetStateRegions())
+        reference.push_back({ region.base, region.size, static_cast<u8*>(std::calloc(region.size, 1)) });
+    reference_is_blank = true;
+}
+
+static void FreeReference() {
+    for (ReferenceRegion& region : reference)
+        std::free(region.memory);
+    reference.clear();
+}
+
+static bool IsZeroPage(const u8* page) {
+    return std::all_of(page, page + Memory::PAGE_SIZE, [](u8 byte) { return byte == 0; });
+}
+
+/**
+ * Turns the current contents of a page into its delta from the reference, 64 bits at a time, and
+ * moves the reference forward to the current contents
+ */
+static void MakeDelta(u8* current_page, u8* reference_page) {
+    u64* current = reinterpret_cast<u64*>(current_page);
+    u64* reference = reinterpret_cast<u64*>(reference_page);
+    for (size_t i = 0; i < Memory::PAGE_SIZE / sizeof(u64); ++i) {
+        const u64 word = current[i];
+        current[i] = word ^ reference[i];
+        reference[i] = word;
+    }
+}
+
+/// Moves a page of the reference back to its contents before a delta
+static void UndoDelta(u8* reference_page, const u8* delta_page) {
+    u64* reference = reinterpret_cast<u64*>(reference_page);
+    const u64* delta = reinterpret_cast<const u64*>(delta_page);
+    for (size_t i = 0; i < Memory::PAGE_SIZE / sizeof(u64); ++i)
+        reference[i] ^= delta[i];
+}
+
+static Snapshot MakeSnapshot(Capture& capture) {
+    Snapshot snapshot;
+    snapshot.machine_state_size = capture.machine_state.size();
+    snapshot.machine_state = Common::CompressLZ4(capture.machine_state.data(), capture.machine_state.size());
+
+    // The contents are turned into the deltas in place, leaving out the pages that were written
+    // with what they held already
+    size_t num_changed = 0;
+    for (size_t i = 0; i < capture.pages.size(); ++i) {
+        u8* current = &capture.contents[i * Memory::PAGE_SIZE];
+        u8* reference_page = GetReferencePage(capture.pages[i]);
+        if (std::memcmp(current, reference_page, Memory::PAGE_SIZE) == 0)
+            continue;
+
+        u8* delta = &capture.contents[num_changed * Memory::PAGE_SIZE];
+        if (delta != current)
+            std::memcpy(delta, current, Memory::PAGE_SIZE);
+        MakeDelta(delta, reference_page);
+        snapshot.pages.push_back(capture.pages[i]);
+        ++num_changed;
+    }
+    snapshot.deltas = Common::CompressLZ4(capture.contents.data(), num_changed * Memory::PAGE_SIZE);
+    return snapshot;
+}
+
+static void ThreadLoop() {
+    Common::RegisterCurrentThread("RewindThread", Common::ThreadClass::Worker);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_available.wait(lock, [] { return pending_capture != nullptr || stopping; });
+        if (stopping)
+            break;
+
+        std::unique_ptr<Capture> capture = std::move(pending_capture);
+        busy = true;
+        lock.unlock();
+        Snapshot snapshot = MakeSnapshot(*capture);
+        capture.reset();
+        lock.lock();
+
+        // Older snapshots can be dropped freely, going back to one only needs those after it
+        snapshots_size += snapshot.GetSize();
+        snapshots.push_back(std::move(snapshot));
+        while (snapshots.size() > 1 && snapshots_size > budget) {
+            snapshots_size -= snapshots.front().GetSize();
+            snapshots.pop_front();
+        }
+
+        busy = false;
+        work_done.notify_all();
+    }
+}
+
+/// Blocks until the compression thread is done with the last capture
+static void WaitForCompression(std::unique_lock<std::mutex>& lock) {
+    work_done.wait(lock, [] { return pending_capture == nullptr && !busy; });
+}
+
+/// Appends the pages written since the last collection that are part of the state
+static void CollectWrittenPages(std::vector<VAddr>& pages) {
+    for (const Memory::DirtyRange& range : Memory::CollectDirtyRanges(Memory::DIRTY_TRACKER_REWIND)) {
+        for (u32 offset = 0; offset < range.size; offset += Memory::PAGE_SIZE) {
+            if (GetReferencePage(range.start + offset) != nullptr)
+                pages.push_back(range.start + offset);
+        }
+    }
+}
+
+static void TakeSnapshot() {
+    // The video core is part of the machine state
+    GPUThread::WaitIdle();
+
+    auto capture = Common::make_unique<Capture>();
+    capture->machine_state = SaveState::SaveMachineState();
+    if (capture->machine_state.empty())
+        return;
+
+    std::vector<VAddr> pages;
+    CollectWrittenPages(pages);
+    for (VAddr page : pages) {
+        const u8* memory = Memory::GetPointer(page);
+        // Everything is written as far as the first snapshot knows, pages still holding zeros
+        // match the reference already
+        if (reference_is_blank && IsZeroPage(memory))
+            continue;
+        capture->pages.push_back(page);
+        capture->contents.insert(capture->contents.end(), memory, memory + Memory::PAGE_SIZE);
+    }
+    reference_is_blank = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending_capture = std::move(capture);
+    }
+    work_available.notify_one();
+}
+
+static void Rewind() {
+    GPUThread::WaitIdle();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    WaitForCompression(lock);
+    if (snapshots.empty()) {
+        LOG_WARNING(Core, "No snapshot to rewind to yet");
+        return;
+    }
+
+    // Pages written since the latest snapshot go back to how they were in it. Going back further
+    // than it undoes its changes on the reference, unless it's the only one left.
+    std::vector<VAddr> pages;
+    CollectWrittenPages(pages);
+    if (snapshots.size() > 1) {
+        Snapshot& latest = snapshots.back();
+        std::vector<u8> deltas(latest.pages.size() * Memory::PAGE_SIZE);
+        if (!Common::DecompressLZ4(latest.deltas.data(), latest.deltas.size(), deltas.data(), deltas.size())) {
+            LOG_ERROR(Core, "Rewind snapshot is corrupted");
+            return;
+        }
+        for (size_t i = 0; i < latest.pages.size(); ++i) {
+            UndoDelta(GetReferencePage(latest.pages[i]), &deltas[i * Memory::PAGE_SIZE]);
+            pages.push_back(latest.pages[i]);
+        }
+        snapshots_size -= latest.GetSize();
+        snapshots.pop_back();
+    }
+
+    const Snapshot& target = snapshots.back();
+    std::vector<u8> machine_state(target.machine_state_size);
+    if (!Common::DecompressLZ4(target.machine_state.data(), target.machine_state.size(),
+                               machine_state.data(), machine_state.size())) {
+        LOG_ERROR(Core, "Rewind snapshot is corrupted");
+        return;
+    }
+    lock.unlock();
+
+    for (VAddr page : pages) {
+        std::memcpy(Memory::GetPointer(page), GetReferencePage(page), Memory::PAGE_SIZE);
+        // Other users of the dirty pages see the restored pages as written
+        Memory::InvalidateCodeRange(page, Memory::PAGE_SIZE);
+    }
+    if (!SaveState::LoadMachineState(machine_state))
+        return;
+    SaveState::InvalidateMemoryCaches();
+
+    frames_until_snapshot = interval;
+    snapshot_due = false;
+    LOG_INFO(Core, "Rewound, %u snapshots left", (unsigned)snapshots.size());
+}
+
+void Init() {
+    enabled = Settings::values.rewind_enabled;
+    if (!enabled)
+        return;
+
+    interval = std::max(Settings::values.rewind_interval, 1);
+    budget = (size_t)std::max(Settings::values.rewind_buffer_size, 1) * 1024 * 1024;
+    frames_until_snapshot = interval;
+    snapshot_due = false;
+    rewind_requested = false;
+
+    AllocateReference();
+    Memory::EnableDirtyTracking(Memory::DIRTY_TRACKER_REWIND);
+
+    stopping = false;
+    busy = false;
+    compression_thread = Common::make_unique<std::thread>(ThreadLoop);
+
+    LOG_INFO(Core, "Rewind snapshots every %u frames, using up to %u MB", interval,
+             (unsigned)(budget / 1024 / 1024));
+}
+
+void Shutdown() {
+    if (!enabled)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_one();
+    compression_thread->join();
+    compression_thread.reset();
+
+    pending_capture.reset();
+    snapshots.clear();
+    snapshots_size = 0;
+    FreeReference();
+    Memory::DisableDirtyTracking(Memory::DIRTY_TRACKER_REWIND);
+    enabled = false;
+}
+
+void Reset() {
+    if (!enabled)
+        return;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    WaitForCompression(lock);
+    snapshots.clear();
+    snapshots_size = 0;
+
+    // Every page is considered written again, the next snapshot starts from scratch
+    FreeReference();
+    AllocateReference();
+    Memory::DisableDirtyTracking(Memory::DIRTY_TRACKER_REWIND);
+    Memory::EnableDirtyTracking(Memory::DIRTY_TRACKER_REWIND);
+
+    frames_until_snapshot = interval;
+    snapshot_due = false;
+}
+
+void OnFrame() {
+    if (!enabled)
+        return;
+
+    if (--frames_until_snapshot == 0) {
+        frames_until_snapshot = interval;
+        snapshot_due = true;
+    }
+}
+
+void RequestRewind() {
+    rewind_requested = true;
+}
+
+void ProcessRequests() {
+    if (!enabled)
+        return;
+
+    if (rewind_requested.exchange(false)) {
+        Rewind();
+        return;
+    }
+
+    if (!snapshot_due || !SaveState::CanCapture())
+        return;
+    {
+        // Still compressing the previous snapshot, the pages keep being collected until it's done
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending_capture != nullptr || busy)
+            return;
+    }
+    snapshot_due = false;
+    TakeSnapshot();
+}
+
+} // namespace
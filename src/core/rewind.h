@@ -0,0 +1,37 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace Rewind
+
+/**
+ * Ring of snapshots of the last moments of emulation, taken every few frames. A snapshot holds the
+ * machine state and the pages of memory written since the previous one, XORed with their previous
+ * contents. The emulation thread only collects and copies the written pages, the snapshots are
+ * compressed on a thread of their own. Memory written by the GPU isn't tracked, it keeps its
+ * contents when rewinding.
+ */
+namespace Rewind {
+
+/// Starts taking snapshots if rewinding is enabled in the settings
+void Init();
+
+/// Stops taking snapshots and drops them
+void Shutdown();
+
+/// Drops the snapshots, after the whole state of the system was replaced
+void Reset();
+
+/// Counts a frame, a snapshot is taken after every rewind_interval frames. Called on VBlank.
+void OnFrame();
+
+/// Asks the emulation thread to go back by one snapshot before it runs the CPU again. Thread-safe.
+void RequestRewind();
+
+/// Takes the snapshot or rewinds, if it's due. Called from Core::RunLoop.
+void ProcessRequests();
+
+} // namespace
@@ -0,0 +1,472 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "common/chunk_file.h"
+#include "common/common_types.h"
+#include "common/compression.h"
+#include "common/file_util.h"
+#include "common/hash.h"
+#include "common/logging/log.h"
+#include "common/scm_rev.h"
+
+#include "core/core.h"
+#include "core/core_timing.h"
+#include "core/mem_map.h"
+#include "core/memory.h"
+#include "core/rewind.h"
+#include "core/savestate.h"
+#include "core/arm/arm_interface.h"
+#include "core/hle/dsp/dsp.h"
+#include "core/hle/kernel/kernel.h"
+#include "core/hle/kernel/process.h"
+#include "core/hle/kernel/thread.h"
+#include "core/hle/service/service.h"
+#include "core/hle/service/soc_u.h"
+#include "core/hle/service/fs/archive.h"
+#include "core/hle/service/fs/file_io.h"
+#include "core/hw/hw.h"
+#include "core/loader/loader.h"
+
+#include "video_core/command_processor.h"
+#include "video_core/gpu_thread.h"
+#include "video_core/hwrasterizer_base.h"
+#include "video_core/pica.h"
+#include "video_core/renderer_base.h"
+#include "video_core/video_core.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace SaveState
+
+namespace SaveState {
+
+static const u32 STATE_MAGIC = Loader::MakeMagic('C', 'S', 'T', 'A');
+/// Version of the layout of the state, to be bumped whenever a DoState function changes
+static const u32 STATE_VERSION = 2;
+
+struct StateHeader {
+    u32 magic;
+    u32 version;
+    /// Hash of the revision of the build the state was saved by, the layout of a state is only
+    /// known to the build that saved it
+    u64 build_id;
+    u64 program_id;
+    /// Hash of the uncompressed payload
+    u64 state_id;
+    /// state_id of the base state, 0 if this is a full state
+    u64 base_id;
+    u64 uncompressed_size;
+    u64 compressed_size;
+    /// Length of the path of the base state, which follows the header
+    u32 base_path_length;
+    u32 reserved;
+};
+static_assert(sizeof(StateHeader) == 64, "StateHeader has incorrect size");
+
+/// Pages of each memory region, as returned by Memory::GetStateRegions, stored in a state
+using PageLists = std::vector<std::vector<u32>>;
+
+// Base state of the session, the pages a delta stores are those whose hash differs from these
+static std::string base_path;
+static u64 base_id = 0;
+static std::vector<std::vector<u64>> base_hashes;
+
+static std::mutex request_mutex;
+static std::atomic<bool> request_pending(false);
+static bool request_is_load;
+static std::string request_path;
+
+static u64 GetBuildId() {
+    return Common::ComputeHash64(Common::g_scm_rev, std::strlen(Common::g_scm_rev));
+}
+
+static u64 GetProgramId() {
+    return Kernel::g_current_process != nullptr ? Kernel::g_current_process->program_id : 0;
+}
+
+static std::vector<std::vector<u64>> HashPages(const std::vector<Memory::MemoryRegion>& regions) {
+    std::vector<std::vector<u64>> hashes(regions.size());
+    for (size_t i = 0; i < regions.size(); ++i) {
+        const u8* memory = Memory::GetPointer(regions[i].base);
+        for (u32 offset = 0; offset < regions[i].size; offset += Memory::PAGE_SIZE)
+            hashes[i].push_back(Common::ComputeHash64(memory + offset, Memory::PAGE_SIZE));
+    }
+    return hashes;
+}
+
+static bool IsZeroPage(const u8* page) {
+    return std::all_of(page, page + Memory::PAGE_SIZE, [](u8 byte) { return byte == 0; });
+}
+
+/**
+ * Saves or restores the pages of memory listed for each region
+ * @param zero_missing Whether the pages that aren't part of the state are cleared when restoring,
+ *                     which is the case for the full states that only leave out zero pages
+ */
+static void DoMemoryState(PointerWrap& p, PageLists& pages, bool zero_missing) {
+    const auto regions = Memory::GetStateRegions();
+    pages.resize(regions.size());
+
+    for (size_t i = 0; i < regions.size(); ++i) {
+        const Memory::MemoryRegion& region = regions[i];
+        u8* memory = Memory::GetPointer(region.base);
+
+        u32 size = region.size;
+        p.Do(size);
+        p.Do(pages[i]);
+        if (size != region.size) {
+            LOG_ERROR(Core, "Memory region %s has size 0x%08X in the state instead of 0x%08X",
+                      region.name, size, region.size);
+            p.SetError(PointerWrap::ERROR_FAILURE);
+            return;
+        }
+
+        const u32 num_pages = region.size / Memory::PAGE_SIZE;
+        if (std::any_of(pages[i].begin(), pages[i].end(), [num_pages](u32 page) { return page >= num_pages; })) {
+            LOG_ERROR(Core, "Memory region %s has invalid pages in the state", region.name);
+            p.SetError(PointerWrap::ERROR_FAILURE);
+            return;
+        }
+
+        if (zero_missing && p.GetMode() == PointerWrap::MODE_READ)
+            std::memset(memory, 0, region.size);
+        for (u32 page : pages[i])
+            p.DoVoid(memory + page * Memory::PAGE_SIZE, Memory::PAGE_SIZE);
+    }
+    p.DoMarker("Memory pages");
+}
+
+/// Saves or restores everything but the contents of memory, in the order the parts depend on
+static void DoMachineState(PointerWrap& p) {
+    // Objects first, so that everything after can refer to them by id
+    Kernel::DoObjectListState(p);
+    Service::FS::DoState(p);
+    CoreTiming::DoState(p);
+    Memory::DoState(p);
+    Kernel::DoState(p);
+    Service::DoState(p);
+    DSP::DoState(p);
+
+    // The context of the running thread is only in the CPU, Kernel::DoState saved it as it was
+    // when the thread was last switched out. It goes through the thread's own context, the CPU
+    // keeps referring to the context it was loaded from (see ARM_Interface::LoadContext).
+    Kernel::Thread* thread = Kernel::GetCurrentThread();
+    Core::ThreadContext idle_context = {};
+    Core::ThreadContext& context = thread != nullptr ? thread->context : idle_context;
+    u32 tls_register = 0;
+    if (p.GetMode() != PointerWrap::MODE_READ) {
+        if (thread != nullptr)
+            Core::g_app_core->SaveContext(context);
+        tls_register = Core::g_app_core->GetCP15Register(CP15_THREAD_UPRW);
+    }
+    p.Do(context);
+    p.Do(tls_register);
+    if (p.GetMode() == PointerWrap::MODE_READ) {
+        if (thread != nullptr) {
+            Core::g_app_core->LoadContext(context);
+            Core::g_app_core->SetCP15Register(CP15_THREAD_URO, thread->GetTLSAddress());
+        }
+        Core::g_app_core->SetCP15Register(CP15_THREAD_UPRW, tls_register);
+    }
+    p.DoMarker("CPU");
+
+    HW::DoState(p);
+    Pica::DoState(p);
+    Pica::CommandProcessor::DoState(p);
+}
+
+bool CanCapture() {
+    return !Service::FS::FileIO::HasPendingRequests() && !SOC_U::HasPendingOperations();
+}
+
+std::vector<u8> SaveMachineState() {
+    u8* ptr = nullptr;
+    PointerWrap measure(&ptr, PointerWrap::MODE_MEASURE);
+    DoMachineState(measure);
+
+    std::vector<u8> data(reinterpret_cast<size_t>(ptr));
+    ptr = data.data();
+    PointerWrap write(&ptr, PointerWrap::MODE_WRITE);
+    DoMachineState(write);
+    if (write.error != PointerWrap::ERROR_NONE) {
+        LOG_ERROR(Core, "Could not capture the state of the system");
+        return std::vector<u8>();
+    }
+    return data;
+}
+
+bool LoadMachineState(const std::vector<u8>& data) {
+    u8* ptr = const_cast<u8*>(data.data());
+    PointerWrap read(&ptr, PointerWrap::MODE_READ);
+    DoMachineState(read);
+    if (read.error != PointerWrap::ERROR_NONE || ptr != data.data() + data.size()) {
+        LOG_CRITICAL(Core, "The state could not be restored, the system is in an inconsistent state");
+        Core::Halt("invalid state");
+        return false;
+    }
+    return true;
+}
+
+void InvalidateMemoryCaches() {
+    for (const Memory::MemoryRegion& region : Memory::GetStateRegions())
+        Core::g_app_core->InvalidateCacheRange(region.base, region.size);
+    GPUThread::Run([] {
+        VideoCore::g_renderer->hw_rasterizer->Reset();
+        VideoCore::g_renderer->hw_rasterizer->NotifyFlush(Memory::VRAM_PADDR, Memory::VRAM_SIZE);
+        VideoCore::g_renderer->hw_rasterizer->NotifyFlush(Memory::FCRAM_PADDR, Memory::FCRAM_SIZE);
+    });
+}
+
+static bool WriteStateFile(const std::string& path, const StateHeader& header,
+                           const std::string& referenced_base_path, const std::vector<u8>& payload) {
+    FileUtil::IOFile file(path, "wb");
+    if (!file.IsOpen()) {
+        LOG_ERROR(Core, "Could not open %s to save the state", path.c_str());
+        return false;
+    }
+    file.WriteBytes(&header, sizeof(header));
+    file.WriteBytes(referenced_base_path.data(), referenced_base_path.size());
+    file.WriteBytes(payload.data(), payload.size());
+    if (!file.IsGood()) {
+        LOG_ERROR(Core, "Could not write the state to %s", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Reads a state file and checks that it can be loaded into the running system
+ * @param header Receives the header of the state
+ * @param referenced_base_path Receives the path of the base state, if this is a delta
+ * @param payload Receives the decompressed payload
+ */
+static bool ReadStateFile(const std::string& path, StateHeader& header, std::string& referenced_base_path,
+                          std::vector<u8>& payload) {
+    FileUtil::IOFile file(path, "rb");
+    if (!file.IsOpen() || file.ReadBytes(&header, sizeof(header)) != sizeof(header)) {
+        LOG_ERROR(Core, "Could not read the state from %s", path.c_str());
+        return false;
+    }
+    if (header.magic != STATE_MAGIC || header.version != STATE_VERSION) {
+        LOG_ERROR(Core, "%s is not a state of a supported version", path.c_str());
+        return false;
+    }
+    if (header.build_id != GetBuildId()) {
+        LOG_ERROR(Core, "%s was saved by a different build", path.c_str());
+        return false;
+    }
+    if (header.program_id != GetProgramId()) {
+        LOG_ERROR(Core, "%s is a state of title %016llX, not of the running title %016llX", path.c_str(),
+                  (unsigned long long)header.program_id, (unsigned long long)GetProgramId());
+        return false;
+    }
+
+    referenced_base_path.resize(header.base_path_length);
+    std::vector<u8> compressed(static_cast<size_t>(header.compressed_size));
+    if (file.ReadBytes(&referenced_base_path[0], referenced_base_path.size()) != referenced_base_path.size() ||
+        file.ReadBytes(compressed.data(), compressed.size()) != compressed.size()) {
+        LOG_ERROR(Core, "State %s is truncated", path.c_str());
+        return false;
+    }
+
+    payload.resize(static_cast<size_t>(header.uncompressed_size));
+    if (!Common::DecompressLZ4(compressed.data(), compressed.size(), payload.data(), payload.size()) ||
+        Common::ComputeHash64(payload.data(), payload.size()) != header.state_id) {
+        LOG_ERROR(Core, "State %s is corrupted", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Save(const std::string& path) {
+    if (!CanCapture()) {
+        LOG_ERROR(Core, "Can't save the state while file or socket operations are in flight");
+        return false;
+    }
+
+    GPUThread::WaitIdle();
+    CoreTiming::MoveEvents();
+
+    // A state replacing the file of the base can't refer to it, it becomes the new base instead
+    const auto regions = Memory::GetStateRegions();
+    auto hashes = HashPages(regions);
+    const bool is_delta = !base_hashes.empty() && path != base_path;
+
+    PageLists pages(regions.size());
+    for (size_t i = 0; i < regions.size(); ++i) {
+        const u8* memory = Memory::GetPointer(regions[i].base);
+        for (u32 page = 0; page < hashes[i].size(); ++page) {
+            const bool stored = is_delta ? hashes[i][page] != base_hashes[i][page]
+                                         : !IsZeroPage(memory + page * Memory::PAGE_SIZE);
+            if (stored)
+                pages[i].push_back(page);
+        }
+    }
+
+    u8* ptr = nullptr;
+    PointerWrap measure(&ptr, PointerWrap::MODE_MEASURE);
+    DoMemoryState(measure, pages, !is_delta);
+    DoMachineState(measure);
+
+    std::vector<u8> payload(reinterpret_cast<size_t>(ptr));
+    ptr = payload.data();
+    PointerWrap write(&ptr, PointerWrap::MODE_WRITE);
+    DoMemoryState(write, pages, !is_delta);
+    DoMachineState(write);
+    if (write.error != PointerWrap::ERROR_NONE) {
+        LOG_ERROR(Core, "Could not capture the state of the system");
+        return false;
+    }
+
+    const std::string referenced_base_path = is_delta ? base_path : std::string();
+    const std::vector<u8> compressed = Common::CompressLZ4(payload.data(), payload.size());
+
+    StateHeader header = {};
+    header.magic = STATE_MAGIC;
+    header.version = STATE_VERSION;
+    header.build_id = GetBuildId();
+    header.program_id = GetProgramId();
+    header.state_id = Common::ComputeHash64(payload.data(), payload.size());
+    header.base_id = is_delta ? base_id : 0;
+    header.uncompressed_size = payload.size();
+    header.compressed_size = compressed.size();
+    header.base_path_length = static_cast<u32>(referenced_base_path.size());
+    if (!WriteStateFile(path, header, referenced_base_path, compressed))
+        return false;
+
+    if (!is_delta) {
+        base_path = path;
+        base_id = header.state_id;
+        base_hashes = std::move(hashes);
+    }
+
+    LOG_INFO(Core, "Saved %s state to %s, %llu bytes", is_delta ? "delta" : "full", path.c_str(),
+             (unsigned long long)compressed.size());
+    return true;
+}
+
+bool Load(const std::string& path) {
+    StateHeader header;
+    std::string referenced_base_path;
+    std::vector<u8> payload;
+    if (!ReadStateFile(path, header, referenced_base_path, payload))
+        return false;
+
+    const bool is_delta = header.base_id != 0;
+    StateHeader base_header;
+    std::string unused_path;
+    std::vector<u8> base_payload;
+    if (is_delta) {
+        if (!ReadStateFile(referenced_base_path, base_header, unused_path, base_payload))
+            return false;
+        if (base_header.state_id != header.base_id || base_header.base_id != 0) {
+            LOG_ERROR(Core, "%s isn't the base state of %s anymore", referenced_base_path.c_str(), path.c_str());
+            return false;
+        }
+    }
+
+    GPUThread::WaitIdle();
+    CoreTiming::MoveEvents();
+
+    // Nothing has been touched until here, after this point a state that fails to apply leaves the
+    // system half restored
+    PageLists pages;
+    if (is_delta) {
+        u8* ptr = base_payload.data();
+        PointerWrap read_base(&ptr, PointerWrap::MODE_READ);
+        DoMemoryState(read_base, pages, true);
+        if (read_base.error != PointerWrap::ERROR_NONE) {
+            Core::Halt("invalid base state");
+            return false;
+        }
+    }
+    const auto regions = Memory::GetStateRegions();
+    std::vector<std::vector<u64>> hashes;
+    if (is_delta)
+        hashes = HashPages(regions);
+
+    u8* ptr = payload.data();
+    PointerWrap read(&ptr, PointerWrap::MODE_READ);
+    DoMemoryState(read, pages, !is_delta);
+    DoMachineState(read);
+    if (read.error != PointerWrap::ERROR_NONE || ptr != payload.data() + payload.size()) {
+        LOG_CRITICAL(Core, "State %s could not be restored, the system is in an inconsistent state", path.c_str());
+        Core::Halt("invalid state");
+        return false;
+    }
+
+    InvalidateMemoryCaches();
+    // The snapshots taken so far are of another timeline
+    Rewind::Reset();
+
+    // The base of a delta stays the base, a full state that was loaded becomes the base
+    if (!is_delta)
+        hashes = HashPages(regions);
+    base_path = is_delta ? referenced_base_path : path;
+    base_id = is_delta ? header.base_id : header.state_id;
+    base_hashes = std::move(hashes);
+
+    LOG_INFO(Core, "Loaded %s state from %s", is_delta ? "delta" : "full", path.c_str());
+    return true;
+}
+
+void RequestSave(const std::string& path) {
+    std::lock_guard<std::mutex> lock(request_mutex);
+    request_is_load = false;
+    request_path = path;
+    request_pending = true;
+}
+
+void RequestLoad(const std::string& path) {
+    std::lock_guard<std::mutex> lock(request_mutex);
+    request_is_load = true;
+    request_path = path;
+    request_pending = true;
+}
+
+void ProcessRequests() {
+    if (!request_pending)
+        return;
+
+    bool is_load;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(request_mutex);
+        is_load = request_is_load;
+        path = request_path;
+    }
+
+    // Saves wait for the operations in flight to complete, those can't be captured
+    if (!is_load && !CanCapture())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(request_mutex);
+        // Replaced by another request in the meantime, which is handled next time
+        if (request_is_load != is_load || request_path != path)
+            return;
+        request_pending = false;
+    }
+
+    if (is_load)
+        Load(path);
+    else
+        Save(path);
+}
+
+void Shutdown() {
+    base_path.clear();
+    base_id = 0;
+    base_hashes.clear();
+
+    std::lock_guard<std::mutex> lock(request_mutex);
+    request_pending = false;
+}
+
+} // namespace
@@ -0,0 +1,68 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/common_types.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace SaveState
+
+/**
+ * Snapshots of the whole emulated system. The first full state saved or loaded becomes the base of
+ * those saved after it, which only store the pages of memory that changed since the base and refer
+ * to its file. States can only be loaded into a freshly booted instance of the same title, they
+ * don't describe how the title was loaded.
+ */
+namespace SaveState {
+
+/**
+ * Saves the state of the system, on the emulation thread between two runs of the CPU
+ * @param path File the state is written to
+ * @return Whether the state was saved. Fails while file or socket operations are in flight.
+ */
+bool Save(const std::string& path);
+
+/**
+ * Restores the state of the system, on the emulation thread between two runs of the CPU. A state
+ * that is rejected leaves the system untouched, emulation is halted when one fails to apply.
+ * @param path File the state is read from, the file of its base is read as well
+ * @return Whether the state was restored
+ */
+bool Load(const std::string& path);
+
+/// Asks the emulation thread to save the state as soon as nothing is in flight. Thread-safe.
+void RequestSave(const std::string& path);
+
+/// Asks the emulation thread to restore a state before it runs the CPU again. Thread-safe.
+void RequestLoad(const std::string& path);
+
+/// Performs the requested save or load, if any. Called from Core::RunLoop.
+void ProcessRequests();
+
+/// Forgets the base state, when the emulated system is shut down
+void Shutdown();
+
+/// Whether nothing is in flight that a state can't describe, like file or socket operations
+bool CanCapture();
+
+/**
+ * Serializes everything but the contents of memory, on the emulation thread
+ * @return The serialized state, empty if it couldn't be captured
+ */
+std::vector<u8> SaveMachineState();
+
+/**
+ * Restores what SaveMachineState serialized, on the emulation thread. Emulation is halted when
+ * this fails, parts of the system may have been restored already.
+ */
+bool LoadMachineState(const std::vector<u8>& data);
+
+/// Discards what the CPU and the renderer cached of emulated memory, after it was replaced
+void InvalidateMemoryCaches();
+
+} // namespace
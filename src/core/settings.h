@@ -33,24 +33,63 @@ struct Values {
     int pad_cdown_key;
     int pad_cleft_key;
     int pad_cright_key;
+    int hid_update_rate;
 
     // Core
     int frame_skip;
+    bool dynamic_frame_skip;
+    int speed_limit;
+    bool use_cpu_jit;
+    bool threaded_interpreter;
+    int cpu_cache_size;
+    bool persist_cpu_blocks;
+    bool profile_cpu;
+    bool use_fastmem;
+    bool use_huge_pages;
+    int max_slice_length;
+    bool rewind_enabled;
+    int rewind_interval;
+    int rewind_buffer_size;
+    bool pin_threads;
+    int emu_thread_core;
+    int gpu_thread_core;
+    bool raise_thread_priority;
+    bool hle_guest_routines;
 
     // Data Storage
     bool use_virtual_sd;
+    bool async_file_io;
+    bool write_back_save_data;
 
     // System Region
     int region_value;
 
     // Renderer
+    int renderer_backend;
     bool use_hw_renderer;
+    int vertex_cache_size;
+    int texture_cache_size;
+    bool use_shader_jit;
+    bool use_hw_vertex_shaders;
+    int rasterizer_threads;
+    bool use_gpu_thread;
+    bool debug_capture;
+    bool texture_disk_cache;
+    bool show_perf_overlay;
 
     float bg_red;
     float bg_green;
     float bg_blue;
 
     std::string log_filter;
+    std::string svc_statistics_file;
+    std::string trace_file;
+    std::string guest_profile_file;
+    int guest_profile_interval;
+    std::string memory_stats_file;
+    int memory_stats_interval;
+    int metrics_http_port;
+    std::string metrics_statsd_address;
 } extern values;
 
 }
@@ -2,36 +2,202 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "common/cpu_detect.h"
+#include "common/job_system.h"
+#include "common/logging/log.h"
+#include "common/profiler.h"
+#include "common/thread_policy.h"
+
+#include "core/block_list.h"
+#include "core/boot_snapshot.h"
+#include "core/breakpoints.h"
 #include "core/core.h"
 #include "core/core_timing.h"
+#include "core/gpu_capture.h"
+#include "core/guest_profiler.h"
+#include "core/input_recording.h"
+#include "core/ipc_recording.h"
 #include "core/mem_map.h"
+#include "core/memory_stats.h"
+#include "core/metrics_exporter.h"
+#include "core/rewind.h"
+#include "core/settings.h"
 #include "core/system.h"
+#include "core/title_profiles.h"
 #include "core/hw/hw.h"
 #include "core/hle/hle.h"
 #include "core/hle/kernel/kernel.h"
+#include "core/loader/loader.h"
 
 #include "video_core/video_core.h"
 
 namespace System {
 
-void Init(EmuWindow* emu_window) {
-    Core::Init();
-    CoreTiming::Init();
-    Memory::Init();
-    HW::Init();
-    Kernel::Init();
-    HLE::Init();
-    VideoCore::Init(emu_window);
+// Time spent in each phase of the initialization, reported with the first frame
+static Common::Profiling::TimingCategory profile_init("System Init");
+static Common::Profiling::TimingCategory profile_init_core("Core Init", &profile_init);
+static Common::Profiling::TimingCategory profile_init_memory("Memory Init", &profile_init);
+static Common::Profiling::TimingCategory profile_init_hw("HW Init", &profile_init);
+static Common::Profiling::TimingCategory profile_init_kernel("Kernel Init", &profile_init);
+static Common::Profiling::TimingCategory profile_init_hle("HLE Init", &profile_init);
+static Common::Profiling::TimingCategory profile_init_video("Video Core Init", &profile_init);
+
+/// Sets where the emulator threads run from the settings, before any of them is started
+static void ConfigureThreadPlacement() {
+    using Common::ThreadClass;
+    using Common::ThreadPriority;
+
+    Common::ThreadPlacement emulation = { 0, ThreadPriority::Normal };
+    Common::ThreadPlacement gpu = emulation, audio = emulation, worker = emulation;
+
+    if (Settings::values.raise_thread_priority) {
+        emulation.priority = gpu.priority = audio.priority = ThreadPriority::High;
+        worker.priority = ThreadPriority::Low;
+    }
+
+    if (Settings::values.pin_threads) {
+        // A thread pinned to a physical core has its SMT siblings too, so that no other thread
+        // slows it down by sharing the core
+        const std::vector<u64> cores = Common::GetPhysicalCores();
+        const int num_cores = static_cast<int>(cores.size());
+        const int emu_core = Settings::values.emu_thread_core >= 0 ? Settings::values.emu_thread_core : 0;
+        const int gpu_core = Settings::values.gpu_thread_core >= 0 ? Settings::values.gpu_thread_core
+                                                                   : (emu_core == 0 ? 1 : 0);
+        if (num_cores < 3 || emu_core >= num_cores || gpu_core >= num_cores || emu_core == gpu_core) {
+            LOG_WARNING(Core, "Can't pin the threads to cores %d and %d of %d physical cores",
+                        emu_core, gpu_core, num_cores);
+        } else {
+            u64 other_cores = 0;
+            for (int core = 0; core < num_cores; ++core) {
+                if (core != emu_core && core != gpu_core)
+                    other_cores |= cores[core];
+            }
+            emulation.affinity_mask = cores[emu_core];
+            gpu.affinity_mask = cores[gpu_core];
+            audio.affinity_mask = worker.affinity_mask = other_cores;
+        }
+    }
+
+    Common::SetThreadPlacement(ThreadClass::Emulation, emulation);
+    Common::SetThreadPlacement(ThreadClass::GPU, gpu);
+    Common::SetThreadPlacement(ThreadClass::Audio, audio);
+    Common::SetThreadPlacement(ThreadClass::Worker, worker);
 }
 
-void Shutdown() {
-    VideoCore::Shutdown();
+/// Runs a phase of the initialization, accounting its time to its profiler category
+template <typename Func>
+static void RunInitPhase(Common::Profiling::TimingCategory& category, const char* name, Func init) {
+    const auto start = std::chrono::steady_clock::now();
+    {
+        Common::Profiling::ScopeTimer timer(category);
+        init();
+    }
+    const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+    LOG_DEBUG(Core, "%s took %.3f ms", name, duration.count());
+}
+
+/// Initializes the emulated hardware and the operating system, which Reset starts over
+static void InitEmulatedSystem() {
+    RunInitPhase(profile_init_core, "Core init", [] {
+        Core::Init();
+        CoreTiming::Init();
+    });
+    RunInitPhase(profile_init_memory, "Memory init", [] { Memory::Init(); });
+    RunInitPhase(profile_init_hw, "HW init", [] { HW::Init(); });
+    RunInitPhase(profile_init_kernel, "Kernel init", [] { Kernel::Init(); });
+    RunInitPhase(profile_init_hle, "HLE init", [] { HLE::Init(); });
+}
+
+/// Starts the tools that follow the running title, once the video core is up
+static void InitTitleTools() {
+    Rewind::Init();
+    GuestProfiler::Init();
+    MemoryStats::Init();
+}
+
+/// Completes the recordings of the running title and forgets its per-title state
+static void ShutdownTitleTools() {
+    Loader::DiscardPreload();
+    BlockList::Shutdown();
+    BootSnapshot::Shutdown();
+    Breakpoints::Shutdown();
+    GuestProfiler::Shutdown();
+    GPUCapture::Shutdown();
+    InputRecording::Shutdown();
+    IPCRecording::Shutdown();
+    MemoryStats::Shutdown();
+    Rewind::Shutdown();
+    TitleProfiles::Shutdown();
+}
+
+/**
+ * Shuts down the emulated hardware and the operating system, after the video core is done with
+ * the emulated memory
+ * @return Whether no kernel object was left behind
+ */
+static bool ShutdownEmulatedSystem(bool keep_host_resources) {
     HLE::Shutdown();
     Kernel::Shutdown();
+    const bool clean = Kernel::ReportLiveObjects() == 0;
     HW::Shutdown();
     Memory::Shutdown();
     CoreTiming::Shutdown();
-    Core::Shutdown();
+    Core::Shutdown(keep_host_resources);
+    return clean;
+}
+
+void Init(EmuWindow* emu_window, const std::string& boot_filename) {
+    const auto start = std::chrono::steady_clock::now();
+    Common::Profiling::ScopeTimer timer(profile_init);
+
+    LOG_INFO(Core, "Host CPU: %s", cpu_info.Summarize().c_str());
+    ConfigureThreadPlacement();
+    // One worker per logical CPU besides the emulation thread's
+    Common::JobSystem::Init(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+
+    // Reading and decompressing the executable doesn't depend on the emulated system
+    if (!boot_filename.empty())
+        Loader::PreloadFile(boot_filename);
+
+    InitEmulatedSystem();
+    RunInitPhase(profile_init_video, "Video core init", [emu_window] { VideoCore::Init(emu_window); });
+    InitTitleTools();
+    MetricsExporter::Init();
+
+    // Reported on its own, the initialization is over before the profiler shows the first frame
+    const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+    LOG_INFO(Core, "Initialization took %.3f ms", duration.count());
+}
+
+bool Reset(const std::string& boot_filename) {
+    const auto start = std::chrono::steady_clock::now();
+
+    ShutdownTitleTools();
+    VideoCore::Reset();
+    const bool clean = ShutdownEmulatedSystem(true);
+
+    if (!boot_filename.empty())
+        Loader::PreloadFile(boot_filename);
+
+    InitEmulatedSystem();
+    InitTitleTools();
+
+    const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+    LOG_INFO(Core, "Reset took %.3f ms", duration.count());
+    return clean;
+}
+
+void Shutdown() {
+    MetricsExporter::Shutdown();
+    ShutdownTitleTools();
+    VideoCore::Shutdown();
+    ShutdownEmulatedSystem(false);
+    Common::JobSystem::Shutdown();
 }
 
 } // namespace
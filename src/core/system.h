@@ -4,11 +4,31 @@
 
 #pragma once
 
+#include <string>
+
 class EmuWindow;
 
 namespace System {
 
-void Init(EmuWindow* emu_window);
+/**
+ * Initializes the emulated system
+ * @param emu_window Window the video core draws to
+ * @param boot_filename File to be booted by Loader::LoadFile afterwards, if known. It is read on
+ *                      a worker while the system is initialized.
+ */
+void Init(EmuWindow* emu_window, const std::string& boot_filename = "");
+
+/**
+ * Starts the emulated system over for booting another title with Loader::LoadFile, without
+ * restarting the host side: the renderer and its OpenGL context, the compiled host shaders, the
+ * job system's workers and the CPU JIT's code buffer are kept. Everything the previous title could
+ * see is shut down and initialized again, and the recordings and profiles of the previous title
+ * are completed. To be called on the emulation thread, between frames.
+ * @param boot_filename File to be booted next, if known, read on a worker during the reset
+ * @return Whether the previous title left no kernel object behind, see Kernel::ReportLiveObjects
+ */
+bool Reset(const std::string& boot_filename = "");
+
 void Shutdown();
 
 }
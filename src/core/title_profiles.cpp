@@ -0,0 +1,135 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+#include "common/file_util.h"
+#include "common/logging/log.h"
+#include "common/string_util.h"
+
+#include "core/core_timing.h"
+#include "core/settings.h"
+#include "core/title_profiles.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace TitleProfiles
+
+namespace TitleProfiles {
+
+/**
+ * Profiles shipped with the emulator. Entries are only added once the settings were verified to
+ * help the title without breaking it, with a comment saying what they fix.
+ */
+static const char* const SHIPPED_PROFILES = R"(
+# Performance profiles of titles, see core/title_profiles.h for the format
+)";
+
+/// A setting a profile can override
+struct OverridableSetting {
+    const char* name;
+    int Settings::Values::* int_value;
+    bool Settings::Values::* bool_value;
+};
+
+static const OverridableSetting overridable_settings[] = {
+    { "frame_skip",            &Settings::Values::frame_skip,         nullptr },
+    { "dynamic_frame_skip",    nullptr, &Settings::Values::dynamic_frame_skip },
+    { "max_slice_length",      &Settings::Values::max_slice_length,   nullptr },
+    { "hle_guest_routines",    nullptr, &Settings::Values::hle_guest_routines },
+    { "vertex_cache_size",     &Settings::Values::vertex_cache_size,  nullptr },
+    { "texture_cache_size",    &Settings::Values::texture_cache_size, nullptr },
+    { "use_shader_jit",        nullptr, &Settings::Values::use_shader_jit },
+    { "use_hw_vertex_shaders", nullptr, &Settings::Values::use_hw_vertex_shaders },
+    { "rasterizer_threads",    &Settings::Values::rasterizer_threads, nullptr },
+};
+
+/// Global settings, while a profile is applied over them
+static Settings::Values global_values;
+static bool applied = false;
+
+/// Puts back the global values of the settings profiles override, leaving the others as they are
+static void RestoreGlobalValues() {
+    for (const OverridableSetting& setting : overridable_settings) {
+        if (setting.int_value != nullptr)
+            Settings::values.*setting.int_value = global_values.*setting.int_value;
+        else
+            Settings::values.*setting.bool_value = global_values.*setting.bool_value;
+    }
+}
+
+/**
+ * Applies the lines of the section of the given program id in a profile database
+ * @return Number of settings the section overrides
+ */
+static int ApplyDatabase(const std::string& database, const char* source, u64 program_id) {
+    const std::string section = Common::StringFromFormat("[%016llX]", (unsigned long long)program_id);
+    std::istringstream lines(database);
+    std::string line;
+    bool in_section = false;
+    int num_overrides = 0;
+    for (int line_number = 1; std::getline(lines, line); ++line_number) {
+        line = Common::StripSpaces(line);
+        if (line.empty() || line[0] == '#' || line[0] == ';')
+            continue;
+        if (line[0] == '[') {
+            std::transform(line.begin(), line.end(), line.begin(), ::toupper);
+            in_section = line == section;
+            continue;
+        }
+        if (!in_section)
+            continue;
+
+        const size_t separator = line.find('=');
+        const std::string name = Common::StripSpaces(line.substr(0, separator));
+        const std::string value = separator != std::string::npos ? Common::StripSpaces(line.substr(separator + 1)) : "";
+        auto setting = std::find_if(std::begin(overridable_settings), std::end(overridable_settings),
+                                    [&](const OverridableSetting& s) { return name == s.name; });
+        if (separator == std::string::npos || value.empty() || setting == std::end(overridable_settings)) {
+            LOG_WARNING(Core, "%s:%d: ignoring \"%s\", not a setting profiles can override",
+                        source, line_number, line.c_str());
+            continue;
+        }
+
+        if (setting->int_value != nullptr)
+            Settings::values.*setting->int_value = std::atoi(value.c_str());
+        else
+            Settings::values.*setting->bool_value = value == "true" || value == "1";
+        LOG_INFO(Core, "Title profile from %s sets %s = %s", source, name.c_str(), value.c_str());
+        ++num_overrides;
+    }
+    return num_overrides;
+}
+
+void Apply(u64 program_id) {
+    if (applied)
+        RestoreGlobalValues();
+    global_values = Settings::values;
+    applied = true;
+
+    int num_overrides = ApplyDatabase(SHIPPED_PROFILES, "the shipped profiles", program_id);
+
+    const std::string user_path = FileUtil::GetUserPath(D_GAMECONFIG_IDX) + "title_profiles.ini";
+    std::string user_profiles;
+    if (FileUtil::Exists(user_path) && FileUtil::ReadFileToString(true, user_path.c_str(), user_profiles) != 0)
+        num_overrides += ApplyDatabase(user_profiles, user_path.c_str(), program_id);
+
+    if (num_overrides == 0)
+        return;
+
+    LOG_INFO(Core, "Applied %d settings of the profile of title %016llX", num_overrides,
+             (unsigned long long)program_id);
+    CoreTiming::ReloadSettings();
+}
+
+void Shutdown() {
+    if (!applied)
+        return;
+    RestoreGlobalValues();
+    applied = false;
+}
+
+} // namespace
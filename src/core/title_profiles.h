@@ -0,0 +1,37 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Namespace TitleProfiles
+
+/**
+ * Settings overridden for single titles, e.g. a shorter CPU slice for a title that syncs with the
+ * GPU often, or no vertex cache for one that doesn't reuse vertices. Profiles are keyed by the
+ * program id of the booted title and come from the database shipped with the emulator, which
+ * title_profiles.ini in the game config directory extends and overrides. Both are INI files with
+ * a section per program id:
+ *
+ *     [0004000000055D00]
+ *     max_slice_length = 2000
+ *     vertex_cache_size = 0
+ *
+ * Only settings that take effect while a title runs can be overridden, the others are decoded
+ * when the system is initialized, before the program id is known.
+ */
+namespace TitleProfiles {
+
+/**
+ * Merges the profile of a title over the settings, keeping the global ones to be restored. Called
+ * once the title is loaded, before its code runs.
+ */
+void Apply(u64 program_id);
+
+/// Puts back the global settings, when the emulated system is shut down
+void Shutdown();
+
+} // namespace
@@ -2,9 +2,11 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
-#include <boost/container/static_vector.hpp>
+#include <array>
+#include <cstddef>
 
 #include "clipper.h"
+#include "derived_state.h"
 #include "pica.h"
 #include "rasterizer.h"
 #include "vertex_shader.h"
@@ -33,12 +35,13 @@ public:
         return !IsInside(vertex);
     }
 
-    OutputVertex GetIntersection(const OutputVertex& v0, const OutputVertex& v1) const {
+    /// Intersection of the edge with the line from v0 to v1, with the given attributes interpolated
+    OutputVertex GetIntersection(const OutputVertex& v0, const OutputVertex& v1, u32 attributes) const {
         float24 dp = Math::Dot(v0.pos + bias, coeffs);
         float24 dp_prev = Math::Dot(v1.pos + bias, coeffs);
         float24 factor = dp_prev / (dp_prev - dp);
 
-        return OutputVertex::Lerp(factor, v0, v1);
+        return OutputVertex::Lerp(factor, v0, v1, attributes);
     }
 
 private:
@@ -47,30 +50,20 @@ private:
     Math::Vec4<float24> bias;
 };
 
-static void InitScreenCoordinates(OutputVertex& vtx)
+static void InitScreenCoordinates(OutputVertex& vtx, u32 attributes)
 {
-    struct {
-        float24 halfsize_x;
-        float24 offset_x;
-        float24 halfsize_y;
-        float24 offset_y;
-        float24 zscale;
-        float24 offset_z;
-    } viewport;
-
-    const auto& regs = g_state.regs;
-    viewport.halfsize_x = float24::FromRawFloat24(regs.viewport_size_x);
-    viewport.halfsize_y = float24::FromRawFloat24(regs.viewport_size_y);
-    viewport.offset_x   = float24::FromFloat32(static_cast<float>(regs.viewport_corner.x));
-    viewport.offset_y   = float24::FromFloat32(static_cast<float>(regs.viewport_corner.y));
-    viewport.zscale     = float24::FromRawFloat24(regs.viewport_depth_range);
-    viewport.offset_z   = float24::FromRawFloat24(regs.viewport_depth_far_plane);
+    const DerivedState::Viewport& viewport = DerivedState::GetViewport();
 
+    // Attributes the shader doesn't output are never read, they don't need the perspective divide
     float24 inv_w = float24::FromFloat32(1.f) / vtx.pos.w;
-    vtx.color *= inv_w;
-    vtx.tc0 *= inv_w;
-    vtx.tc1 *= inv_w;
-    vtx.tc2 *= inv_w;
+    if (attributes & OutputVertex::ATTRIBUTE_COLOR)
+        vtx.color *= inv_w;
+    if (attributes & OutputVertex::ATTRIBUTE_TC0)
+        vtx.tc0 *= inv_w;
+    if (attributes & OutputVertex::ATTRIBUTE_TC1)
+        vtx.tc1 *= inv_w;
+    if (attributes & OutputVertex::ATTRIBUTE_TC2)
+        vtx.tc2 *= inv_w;
     vtx.pos.w = inv_w;
 
     vtx.screenpos[0] = (vtx.pos.x * inv_w + float24::FromFloat32(1.0)) * viewport.halfsize_x + viewport.offset_x;
@@ -78,30 +71,41 @@ static void InitScreenCoordinates(OutputVertex& vtx)
     vtx.screenpos[2] = viewport.offset_z + vtx.pos.z * inv_w * viewport.zscale;
 }
 
-void ProcessTriangle(OutputVertex &v0, OutputVertex &v1, OutputVertex &v2) {
-    using boost::container::static_vector;
-
-    // Clipping a planar n-gon against a plane will remove at least 1 vertex and introduces 2 at
-    // the new edge (or less in degenerate cases). As such, we can say that each clipping plane
-    // introduces at most 1 new vertex to the polygon. Since we start with a triangle and have a
-    // fixed 6 clipping planes, the maximum number of vertices of the clipped polygon is 3 + 6 = 9.
-    static const size_t MAX_VERTICES = 9;
-    static_vector<OutputVertex, MAX_VERTICES> buffer_a = { v0, v1, v2 };
-    static_vector<OutputVertex, MAX_VERTICES> buffer_b;
-    auto* output_list = &buffer_a;
-    auto* input_list  = &buffer_b;
+/// Bit mask of the clipping edges the given vertex is outside of
+template <size_t N>
+static unsigned GetOutcode(const std::array<ClippingEdge, N>& edges, const OutputVertex& vertex) {
+    unsigned outcode = 0;
+    for (size_t i = 0; i < N; ++i) {
+        if (edges[i].IsOutSide(vertex))
+            outcode |= 1 << i;
+    }
+    return outcode;
+}
 
+void ProcessTriangle(OutputVertex &v0, OutputVertex &v1, OutputVertex &v2) {
     // NOTE: We clip against a w=epsilon plane to guarantee that the output has a positive w value.
     // TODO: Not sure if this is a valid approach. Also should probably instead use the smallest
     //       epsilon possible within float24 accuracy.
     static const float24 EPSILON = float24::FromFloat32(0.00001);
     static const float24 f0 = float24::FromFloat32(0.0);
     static const float24 f1 = float24::FromFloat32(1.0);
-    static const std::array<ClippingEdge, 7> clipping_edges = {{
+    static const size_t NUM_CLIPPING_EDGES = 7;
+    static const size_t NUM_VIEWPORT_EDGES = 4;
+    static const std::array<ClippingEdge, NUM_VIEWPORT_EDGES> viewport_edges = {{
         { Math::MakeVec( f1,  f0,  f0, -f1) },  // x = +w
         { Math::MakeVec(-f1,  f0,  f0, -f1) },  // x = -w
         { Math::MakeVec( f0,  f1,  f0, -f1) },  // y = +w
         { Math::MakeVec( f0, -f1,  f0, -f1) },  // y = -w
+    }};
+
+    // Guard-band clipping: the rasterizer only visits pixels inside the viewport, so x and y only
+    // need to be clipped where the window coordinates would leave its fixed-point range.
+    const DerivedState::Viewport& viewport = DerivedState::GetViewport();
+    const std::array<ClippingEdge, NUM_CLIPPING_EDGES> clipping_edges = {{
+        { Math::MakeVec( f1,  f0,  f0, -viewport.guard_band_max_x) }, // x = max_x * w
+        { Math::MakeVec(-f1,  f0,  f0,  viewport.guard_band_min_x) }, // x = min_x * w
+        { Math::MakeVec( f0,  f1,  f0, -viewport.guard_band_max_y) }, // y = max_y * w
+        { Math::MakeVec( f0, -f1,  f0,  viewport.guard_band_min_y) }, // y = min_y * w
         { Math::MakeVec( f0,  f0,  f1,  f0) },  // z =  0
         { Math::MakeVec( f0,  f0, -f1, -f1) },  // z = -w
         { Math::MakeVec( f0,  f0,  f0, -f1), Math::Vec4<float24>(f0, f0, f0, EPSILON) }, // w = EPSILON
@@ -111,49 +115,95 @@ void ProcessTriangle(OutputVertex &v0, OutputVertex &v1, OutputVertex &v2) {
     //       drop the whole primitive instead of clipping the primitive properly. We should test if
     //       this happens on the 3DS, too.
 
+    // Trivial reject: All vertices are outside of the same edge of the viewport
+    if (GetOutcode(viewport_edges, v0) & GetOutcode(viewport_edges, v1) & GetOutcode(viewport_edges, v2))
+        return;
+
+    const u32 attributes = DerivedState::GetOutputLayout().attributes;
+
+    const unsigned outcode0 = GetOutcode(clipping_edges, v0);
+    const unsigned outcode1 = GetOutcode(clipping_edges, v1);
+    const unsigned outcode2 = GetOutcode(clipping_edges, v2);
+
+    // All vertices are outside of the same clipping edge
+    if (outcode0 & outcode1 & outcode2)
+        return;
+
+    // Clipping a planar n-gon against a plane will remove at least 1 vertex and introduces 2 at
+    // the new edge (or less in degenerate cases). As such, we can say that each clipping plane
+    // introduces at most 1 new vertex to the polygon. Since we start with a triangle and have a
+    // fixed 7 clipping planes, the maximum number of vertices of the clipped polygon is 3 + 7 = 10.
+    // The intersections are stored in a scratch buffer though, which receives up to 2 of them per
+    // clipping plane, and the polygon only refers to vertices by their index in that buffer.
+    static const size_t MAX_VERTICES = 3 + NUM_CLIPPING_EDGES;
+    static const size_t MAX_SCRATCH_VERTICES = 3 + 2 * NUM_CLIPPING_EDGES;
+    std::array<OutputVertex, MAX_SCRATCH_VERTICES> vertices;
+    vertices[0] = v0;
+    vertices[1] = v1;
+    vertices[2] = v2;
+    size_t num_vertices = 3;
+
+    std::array<size_t, MAX_VERTICES> buffer_a = {{ 0, 1, 2 }};
+    std::array<size_t, MAX_VERTICES> buffer_b;
+    size_t* output_list = buffer_a.data();
+    size_t* input_list = buffer_b.data();
+    size_t output_size = 3;
+
+    // Polygons clipped against a plane all their vertices are inside of stay the same, and since
+    // the new vertices lie on the edges of the triangle, this holds for the clipped polygon, too.
+    // Triangles inside all of the clipping edges hence skip clipping entirely.
+    const unsigned clip_mask = outcode0 | outcode1 | outcode2;
+
     // Simple implementation of the Sutherland-Hodgman clipping algorithm.
-    // TODO: Make this less inefficient (currently lots of useless buffering overhead happens here)
-    for (auto edge : clipping_edges) {
+    for (size_t edge_index = 0; edge_index < NUM_CLIPPING_EDGES; ++edge_index) {
+        if (!(clip_mask & (1 << edge_index)))
+            continue;
+
+        const ClippingEdge& edge = clipping_edges[edge_index];
 
         std::swap(input_list, output_list);
-        output_list->clear();
+        const size_t input_size = output_size;
+        output_size = 0;
 
-        const OutputVertex* reference_vertex = &input_list->back();
+        size_t reference_vertex = input_list[input_size - 1];
+        bool reference_inside = edge.IsInside(vertices[reference_vertex]);
+
+        for (size_t i = 0; i < input_size; ++i) {
+            const size_t vertex = input_list[i];
+            const bool inside = edge.IsInside(vertices[vertex]);
 
-        for (const auto& vertex : *input_list) {
             // NOTE: This algorithm changes vertex order in some cases!
-            if (edge.IsInside(vertex)) {
-                if (edge.IsOutSide(*reference_vertex)) {
-                    output_list->push_back(edge.GetIntersection(vertex, *reference_vertex));
-                }
-
-                output_list->push_back(vertex);
-            } else if (edge.IsInside(*reference_vertex)) {
-                output_list->push_back(edge.GetIntersection(vertex, *reference_vertex));
+            if (inside != reference_inside) {
+                vertices[num_vertices] = edge.GetIntersection(vertices[vertex], vertices[reference_vertex], attributes);
+                output_list[output_size++] = num_vertices++;
             }
-            reference_vertex = &vertex;
+            if (inside)
+                output_list[output_size++] = vertex;
+
+            reference_vertex = vertex;
+            reference_inside = inside;
         }
 
         // Need to have at least a full triangle to continue...
-        if (output_list->size() < 3)
+        if (output_size < 3)
             return;
     }
 
-    InitScreenCoordinates((*output_list)[0]);
-    InitScreenCoordinates((*output_list)[1]);
+    InitScreenCoordinates(vertices[output_list[0]], attributes);
+    InitScreenCoordinates(vertices[output_list[1]], attributes);
 
-    for (size_t i = 0; i < output_list->size() - 2; i ++) {
-        OutputVertex& vtx0 = (*output_list)[0];
-        OutputVertex& vtx1 = (*output_list)[i+1];
-        OutputVertex& vtx2 = (*output_list)[i+2];
+    for (size_t i = 0; i < output_size - 2; i ++) {
+        OutputVertex& vtx0 = vertices[output_list[0]];
+        OutputVertex& vtx1 = vertices[output_list[i+1]];
+        OutputVertex& vtx2 = vertices[output_list[i+2]];
 
-        InitScreenCoordinates(vtx2);
+        InitScreenCoordinates(vtx2, attributes);
 
         LOG_TRACE(Render_Software,
                   "Triangle %lu/%lu at position (%.3f, %.3f, %.3f, %.3f), "
                   "(%.3f, %.3f, %.3f, %.3f), (%.3f, %.3f, %.3f, %.3f) and "
                   "screen position (%.2f, %.2f, %.2f), (%.2f, %.2f, %.2f), (%.2f, %.2f, %.2f)",
-                  i, output_list->size(),
+                  i, output_size,
                   vtx0.pos.x.ToFloat32(), vtx0.pos.y.ToFloat32(), vtx0.pos.z.ToFloat32(), vtx0.pos.w.ToFloat32(),
                   vtx1.pos.x.ToFloat32(), vtx1.pos.y.ToFloat32(), vtx1.pos.z.ToFloat32(), vtx1.pos.w.ToFloat32(),
                   vtx2.pos.x.ToFloat32(), vtx2.pos.y.ToFloat32(), vtx2.pos.z.ToFloat32(), vtx2.pos.w.ToFloat32(),
@@ -2,17 +2,31 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
-#include <boost/range/algorithm/fill.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "common/chunk_file.h"
+#include "common/job_system.h"
 #include "common/profiler.h"
 
 #include "clipper.h"
 #include "command_processor.h"
+#include "cost_model.h"
+#include "derived_state.h"
 #include "math.h"
 #include "pica.h"
 #include "primitive_assembly.h"
+#include "rasterizer.h"
+#include "vertex_loader.h"
 #include "vertex_shader.h"
+#include "vertex_shader_jit.h"
 #include "video_core.h"
+#include "core/memory_stats.h"
 #include "core/hle/service/gsp_gpu.h"
 #include "core/hw/gpu.h"
 #include "core/settings.h"
@@ -33,350 +47,635 @@ static u32 default_attr_write_buffer[3];
 
 Common::Profiling::TimingCategory category_drawing("Drawing");
 
-static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
+static Common::Profiling::SampleCategory profile_vertex_cache("Vertex cache hit rate (%)", "Indexed vertices");
+
+/// Largest number of entries of the vertex cache, enough to hold every vertex a 16 bit index can address
+static const size_t MAX_VERTEX_CACHE_SIZE = 0x10000;
+
+/**
+ * Post-transform vertex cache for indexed draws. It's direct-mapped by vertex index and only
+ * reused within a single draw, during which the vertex data and shader setup can't change, so it
+ * yields exactly the output that running the shader again would.
+ */
+struct VertexCacheEntry {
+    /// Draw the entry was filled in, entries from earlier draws are stale
+    u32 draw;
+    u32 vertex;
+    VertexShader::OutputVertex output;
+    DebugUtils::GeometryDumper::Vertex dumped_vertex;
+    /// Index the hardware renderer queued the output with
+    u32 hw_vertex;
+};
+
+static std::vector<VertexCacheEntry> vertex_cache;
+static u32 vertex_cache_draw = 0;
+
+/// Indexed draws of at least this many vertices shade their vertices on the job system's workers
+static const u32 PARALLEL_SHADING_MIN_VERTICES = 1024;
+/// Number of unique vertices each job of a parallel draw loads and shades
+static const unsigned PARALLEL_SHADING_GRAIN = 128;
+
+/// Slot of a vertex index among the unique vertices of the draw it was stamped with
+struct ParallelShadingSlot {
+    u32 draw;
+    u32 slot;
+};
+
+static std::vector<ParallelShadingSlot> parallel_slots;
+static u32 parallel_draw = 0;
+/// Vertex index of each unique vertex of the draw, in the order of their first use
+static std::vector<u32> parallel_vertices;
+static std::vector<VertexShader::OutputVertex> parallel_outputs;
+/// Slot in parallel_vertices of each index of the draw
+static std::vector<u32> parallel_index_slots;
+
+/// Performs the side effects of writing a register, after its new value has been stored
+using RegisterHandler = void (*)(u32 id, u32 value);
+
+static void TriggerIrq(u32 id, u32 value) {
+    GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::P3D, CostModel::TakeCommandListCycles());
+}
+
+static void JumpToCommandBuffer(u32 id, u32 value) {
     auto& regs = g_state.regs;
 
-    if (id >= regs.NumIds())
-        return;
+    unsigned index = id - PICA_REG_INDEX(command_buffer.trigger[0]);
+    u32* head_ptr = (u32*)Memory::GetPhysicalPointer(regs.command_buffer.GetPhysicalAddress(index));
+    g_state.cmd_list.head_ptr = g_state.cmd_list.current_ptr = head_ptr;
+    g_state.cmd_list.length = regs.command_buffer.GetSize(index) / sizeof(u32);
+    MemoryStats::SampleGPURead(MemoryStats::GPURead::CommandList, regs.command_buffer.GetPhysicalAddress(index),
+                               regs.command_buffer.GetSize(index));
+}
 
-    // If we're skipping this frame, only allow trigger IRQ
-    if (GPU::g_skip_frame && id != PICA_REG_INDEX(trigger_irq))
-        return;
+/// Loads the shader input of a vertex
+static void LoadInputVertex(const VertexLoader& vertex_loader, u32 vertex, VertexShader::InputVertex& input) {
+    // Load a debugging token to check whether this gets loaded by the running
+    // application or not.
+    static const float24 debug_token = float24::FromRawFloat24(0x00abcdef);
+    input.attr[0].w = debug_token;
+
+    vertex_loader.LoadVertex(vertex, input);
+
+    // HACK: Some games do not initialize the vertex position's w component. This leads
+    //       to critical issues since it messes up perspective division. As a
+    //       workaround, we force the fourth component to 1.0 if we find this to be the
+    //       case.
+    //       To do this, we additionally have to assume that the first input attribute
+    //       is the vertex position, since there's no information about this other than
+    //       the empiric observation that this is usually the case.
+    if (input.attr[0].w == debug_token)
+        input.attr[0].w = float24::FromFloat32(1.0);
+}
 
-    // TODO: Figure out how register masking acts on e.g. vs_uniform_setup.set_value
-    u32 old_value = regs[id];
-    regs[id] = (old_value & ~mask) | (value & mask);
+/**
+ * Loads and shades each vertex an indexed draw uses once, in ranges spread over the job system's
+ * workers. Fills parallel_outputs with the shaded vertices and parallel_index_slots with the slot
+ * of each index of the draw, for the primitives to be assembled in order afterwards.
+ * @return Number of unique vertices
+ */
+static u32 ShadeIndexedVerticesInParallel(const VertexLoader& vertex_loader, const u8* index_address_8,
+                                          bool index_u16, u32 num_indices, int num_attributes) {
+    // Starting a new draw invalidates all slots, only clear them when the counter wraps
+    if (parallel_slots.empty() || ++parallel_draw == 0) {
+        parallel_slots.assign(MAX_VERTEX_CACHE_SIZE, ParallelShadingSlot());
+        parallel_draw = 1;
+    }
 
-    if (g_debug_context)
-        g_debug_context->OnEvent(DebugContext::Event::CommandLoaded, reinterpret_cast<void*>(&id));
-
-    DebugUtils::OnPicaRegWrite(id, regs[id]);
-
-    switch(id) {
-        // Trigger IRQ
-        case PICA_REG_INDEX(trigger_irq):
-            GSP_GPU::SignalInterrupt(GSP_GPU::InterruptId::P3D);
-            break;
-
-        case PICA_REG_INDEX_WORKAROUND(command_buffer.trigger[0], 0x23c):
-        case PICA_REG_INDEX_WORKAROUND(command_buffer.trigger[1], 0x23d):
-        {
-            unsigned index = id - PICA_REG_INDEX(command_buffer.trigger[0]);
-            u32* head_ptr = (u32*)Memory::GetPhysicalPointer(regs.command_buffer.GetPhysicalAddress(index));
-            g_state.cmd_list.head_ptr = g_state.cmd_list.current_ptr = head_ptr;
-            g_state.cmd_list.length = regs.command_buffer.GetSize(index) / sizeof(u32);
-            break;
+    const u16* index_address_16 = reinterpret_cast<const u16*>(index_address_8);
+    parallel_vertices.clear();
+    parallel_index_slots.resize(num_indices);
+    for (u32 index = 0; index < num_indices; ++index) {
+        const u32 vertex = index_u16 ? index_address_16[index] : index_address_8[index];
+        ParallelShadingSlot& slot = parallel_slots[vertex];
+        if (slot.draw != parallel_draw) {
+            slot.draw = parallel_draw;
+            slot.slot = static_cast<u32>(parallel_vertices.size());
+            parallel_vertices.push_back(vertex);
         }
+        parallel_index_slots[index] = slot.slot;
+    }
 
-        // It seems like these trigger vertex rendering
-        case PICA_REG_INDEX(trigger_draw):
-        case PICA_REG_INDEX(trigger_draw_indexed):
-        {
-            Common::Profiling::ScopeTimer scope_timer(category_drawing);
+    const u32 num_vertices = static_cast<u32>(parallel_vertices.size());
+    parallel_outputs.resize(num_vertices);
 
-            DebugUtils::DumpTevStageConfig(regs.GetTevStages());
+    auto shade_range = [&vertex_loader, num_attributes](unsigned first, unsigned last) {
+        VertexShader::InputVertex inputs[PARALLEL_SHADING_GRAIN];
+        for (unsigned i = first; i < last; ++i)
+            LoadInputVertex(vertex_loader, parallel_vertices[i], inputs[i - first]);
+        VertexShader::RunShaderBatch(inputs, last - first, num_attributes, &parallel_outputs[first]);
+    };
 
-            if (g_debug_context)
-                g_debug_context->OnEvent(DebugContext::Event::IncomingPrimitiveBatch, nullptr);
-
-            const auto& attribute_config = regs.vertex_attributes;
-            const u32 base_address = attribute_config.GetPhysicalBaseAddress();
-
-            // Information about internal vertex attributes
-            u32 vertex_attribute_sources[16];
-            boost::fill(vertex_attribute_sources, 0xdeadbeef);
-            u32 vertex_attribute_strides[16] = {};
-            Regs::VertexAttributeFormat vertex_attribute_formats[16] = {};
-
-            u32 vertex_attribute_elements[16] = {};
-            u32 vertex_attribute_element_size[16] = {};
-
-            // Setup attribute data from loaders
-            for (int loader = 0; loader < 12; ++loader) {
-                const auto& loader_config = attribute_config.attribute_loaders[loader];
-
-                u32 load_address = base_address + loader_config.data_offset;
-
-                // TODO: What happens if a loader overwrites a previous one's data?
-                for (unsigned component = 0; component < loader_config.component_count; ++component) {
-                    u32 attribute_index = loader_config.GetComponent(component);
-                    vertex_attribute_sources[attribute_index] = load_address;
-                    vertex_attribute_strides[attribute_index] = static_cast<u32>(loader_config.byte_count);
-                    vertex_attribute_formats[attribute_index] = attribute_config.GetFormat(attribute_index);
-                    vertex_attribute_elements[attribute_index] = attribute_config.GetNumElements(attribute_index);
-                    vertex_attribute_element_size[attribute_index] = attribute_config.GetElementSizeInBytes(attribute_index);
-                    load_address += attribute_config.GetStride(attribute_index);
-                }
-            }
+    // The first range is shaded before the workers start: it compiles the shader and updates the
+    // derived state it reads, which the workers then only read
+    const u32 first_range_end = std::min<u32>(num_vertices, PARALLEL_SHADING_GRAIN);
+    shade_range(0, first_range_end);
+    if (first_range_end < num_vertices)
+        Common::JobSystem::ParallelFor(first_range_end, num_vertices, PARALLEL_SHADING_GRAIN, shade_range);
 
-            // Load vertices
-            bool is_indexed = (id == PICA_REG_INDEX(trigger_draw_indexed));
+    return num_vertices;
+}
 
-            const auto& index_info = regs.index_array;
-            const u8* index_address_8 = Memory::GetPhysicalPointer(base_address + index_info.offset);
-            const u16* index_address_16 = (u16*)index_address_8;
-            bool index_u16 = index_info.format != 0;
+// It seems like these trigger vertex rendering
+static void TriggerDraw(u32 id, u32 value) {
+    auto& regs = g_state.regs;
 
-            DebugUtils::GeometryDumper geometry_dumper;
-            PrimitiveAssembler<VertexShader::OutputVertex> primitive_assembler(regs.triangle_topology.Value());
-            PrimitiveAssembler<DebugUtils::GeometryDumper::Vertex> dumping_primitive_assembler(regs.triangle_topology.Value());
+    Common::Profiling::ScopeTimer scope_timer(category_drawing);
+    CostModel::AddDraw(regs.num_vertices);
 
-            for (unsigned int index = 0; index < regs.num_vertices; ++index)
-            {
-                unsigned int vertex = is_indexed ? (index_u16 ? index_address_16[index] : index_address_8[index]) : index;
+    // Skipped frames still apply every register write, so that the next frame is drawn with the
+    // state set up during this one, and only leave out the drawing itself
+    if (GPU::g_skip_frame)
+        return;
 
-                if (is_indexed) {
-                    // TODO: Implement some sort of vertex cache!
-                }
+    // Capturing the geometry, shader and texture combiner setup writes files for every
+    // draw, so it's only done when asked for
+    const bool debug_capture = Settings::values.debug_capture;
+    if (debug_capture) {
+        const auto& vs = g_state.vs;
+        DebugUtils::DumpTevStageConfig(DerivedState::GetTevStages());
+        DebugUtils::DumpShader(vs.program_code.data(), vs.program_code.size(),
+                               vs.swizzle_data.data(), vs.swizzle_data.size(),
+                               regs.vs_main_offset, regs.vs_output_attributes);
+    }
 
-                // Initialize data for the current vertex
-                VertexShader::InputVertex input;
-
-                // Load a debugging token to check whether this gets loaded by the running
-                // application or not.
-                static const float24 debug_token = float24::FromRawFloat24(0x00abcdef);
-                input.attr[0].w = debug_token;
-
-                for (int i = 0; i < attribute_config.GetNumTotalAttributes(); ++i) {
-                    // Load the default attribute if we're configured to do so, this data will be overwritten by the loader data if it's set
-                    if (attribute_config.IsDefaultAttribute(i)) {
-                        input.attr[i] = g_state.vs.default_attributes[i];
-                        LOG_TRACE(HW_GPU, "Loaded default attribute %x for vertex %x (index %x): (%f, %f, %f, %f)",
-                                  i, vertex, index,
-                                  input.attr[i][0].ToFloat32(), input.attr[i][1].ToFloat32(),
-                                  input.attr[i][2].ToFloat32(), input.attr[i][3].ToFloat32());
-                    }
+    if (g_debug_context)
+        g_debug_context->OnEvent(DebugContext::Event::IncomingPrimitiveBatch, nullptr);
 
-                    // Load per-vertex data from the loader arrays
-                    for (unsigned int comp = 0; comp < vertex_attribute_elements[i]; ++comp) {
-                        const u8* srcdata = Memory::GetPhysicalPointer(vertex_attribute_sources[i] + vertex_attribute_strides[i] * vertex + comp * vertex_attribute_element_size[i]);
-
-                        const float srcval = (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::BYTE) ? *(s8*)srcdata :
-                            (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::UBYTE) ? *(u8*)srcdata :
-                            (vertex_attribute_formats[i] == Regs::VertexAttributeFormat::SHORT) ? *(s16*)srcdata :
-                            *(float*)srcdata;
-
-                        input.attr[i][comp] = float24::FromFloat32(srcval);
-                        LOG_TRACE(HW_GPU, "Loaded component %x of attribute %x for vertex %x (index %x) from 0x%08x + 0x%08lx + 0x%04lx: %f",
-                            comp, i, vertex, index,
-                            attribute_config.GetPhysicalBaseAddress(),
-                            vertex_attribute_sources[i] - base_address,
-                            vertex_attribute_strides[i] * vertex + comp * vertex_attribute_element_size[i],
-                            input.attr[i][comp].ToFloat32());
-                    }
-                }
+    const auto& attribute_config = regs.vertex_attributes;
+    const u32 base_address = attribute_config.GetPhysicalBaseAddress();
 
-                // HACK: Some games do not initialize the vertex position's w component. This leads
-                //       to critical issues since it messes up perspective division. As a
-                //       workaround, we force the fourth component to 1.0 if we find this to be the
-                //       case.
-                //       To do this, we additionally have to assume that the first input attribute
-                //       is the vertex position, since there's no information about this other than
-                //       the empiric observation that this is usually the case.
-                if (input.attr[0].w == debug_token)
-                    input.attr[0].w = float24::FromFloat32(1.0);
-
-                if (g_debug_context)
-                    g_debug_context->OnEvent(DebugContext::Event::VertexLoaded, (void*)&input);
-
-                // NOTE: When dumping geometry, we simply assume that the first input attribute
-                //       corresponds to the position for now.
-                DebugUtils::GeometryDumper::Vertex dumped_vertex = {
-                    input.attr[0][0].ToFloat32(), input.attr[0][1].ToFloat32(), input.attr[0][2].ToFloat32()
-                };
-                using namespace std::placeholders;
-                dumping_primitive_assembler.SubmitVertex(dumped_vertex,
-                                                         std::bind(&DebugUtils::GeometryDumper::AddTriangle,
-                                                                   &geometry_dumper, _1, _2, _3));
+    const VertexLoader& vertex_loader = DerivedState::GetVertexLoader();
 
-                // Send to vertex shader
-                VertexShader::OutputVertex output = VertexShader::RunShader(input, attribute_config.GetNumTotalAttributes());
+    // Load vertices
+    bool is_indexed = (id == PICA_REG_INDEX(trigger_draw_indexed));
 
-                if (is_indexed) {
-                    // TODO: Add processed vertex to vertex cache!
-                }
+    // The host GPU running the vertex shader skips the CPU pipeline, which captures and
+    // debugger events rely on
+    const bool use_hw_renderer = Settings::values.use_hw_renderer;
+    auto* hw_rasterizer = VideoCore::g_renderer->hw_rasterizer.get();
+    const bool debugging = g_debug_context && g_debug_context->AnyBreakPointArmed();
+    if (use_hw_renderer && !debug_capture && !debugging && hw_rasterizer->AccelerateDrawBatch(is_indexed))
+        return;
 
-                if (Settings::values.use_hw_renderer) {
-                    // Send to hardware renderer
-                    static auto AddHWTriangle = [](const Pica::VertexShader::OutputVertex& v0,
-                                                   const Pica::VertexShader::OutputVertex& v1,
-                                                   const Pica::VertexShader::OutputVertex& v2) {
-                        VideoCore::g_renderer->hw_rasterizer->AddTriangle(v0, v1, v2);
-                    };
-
-                    primitive_assembler.SubmitVertex(output, AddHWTriangle);
-                } else {
-                    // Send to triangle clipper
-                    primitive_assembler.SubmitVertex(output, Clipper::ProcessTriangle);
-                }
+    const auto& index_info = regs.index_array;
+    const u8* index_address_8 = Memory::GetPhysicalPointer(base_address + index_info.offset);
+    const u16* index_address_16 = (u16*)index_address_8;
+    bool index_u16 = index_info.format != 0;
+    if (is_indexed) {
+        MemoryStats::SampleGPURead(MemoryStats::GPURead::IndexArray, base_address + index_info.offset,
+                                   regs.num_vertices * (index_u16 ? 2 : 1));
+    }
+
+    DebugUtils::GeometryDumper geometry_dumper;
+    PrimitiveAssembler<VertexShader::OutputVertex> primitive_assembler(regs.triangle_topology.Value());
+    PrimitiveAssembler<DebugUtils::GeometryDumper::Vertex> dumping_primitive_assembler(regs.triangle_topology.Value());
+    // The hardware renderer assembles triangles from the indices of the vertices it queued, so
+    // that vertices shared by triangles are only converted and uploaded once
+    PrimitiveAssembler<u32> hw_primitive_assembler(regs.triangle_topology.Value());
+    if (use_hw_renderer)
+        hw_rasterizer->BeginTriangles(regs.num_vertices);
+
+    // Cached vertices skip loading, so don't use the cache while stopping at every loaded vertex
+    const bool use_vertex_cache = is_indexed && Settings::values.vertex_cache_size > 0 &&
+            !(g_debug_context && g_debug_context->GetBreakPoint(DebugContext::Event::VertexLoaded).enabled);
+    if (use_vertex_cache) {
+        const size_t cache_size = std::min<size_t>(Settings::values.vertex_cache_size, MAX_VERTEX_CACHE_SIZE);
+        // Starting a new draw invalidates all entries, only clear them when the counter wraps
+        if (vertex_cache.size() != cache_size || ++vertex_cache_draw == 0) {
+            vertex_cache.assign(cache_size, VertexCacheEntry());
+            vertex_cache_draw = 1;
+        }
+    }
+    unsigned int vertex_cache_hits = 0;
+
+    const int num_attributes = attribute_config.GetNumTotalAttributes();
+    const unsigned int batch_size = VertexShader::SHADER_BATCH_SIZE;
+
+    // Large indexed draws shade their unique vertices on the workers up front, the loop below
+    // then only assembles the primitives. Nothing may stop at or record single vertices then.
+    const bool shade_in_parallel = is_indexed && regs.num_vertices >= PARALLEL_SHADING_MIN_VERTICES &&
+            Common::JobSystem::GetNumWorkers() > 0 && !debug_capture && !debugging;
+    u32 first_parallel_hw_vertex = 0;
+    if (shade_in_parallel) {
+        const u32 num_shaded = ShadeIndexedVerticesInParallel(vertex_loader, index_address_8, index_u16,
+                                                              regs.num_vertices, num_attributes);
+        if (use_hw_renderer)
+            first_parallel_hw_vertex = hw_rasterizer->AddVertices(parallel_outputs.data(), num_shaded);
+        vertex_cache_hits = regs.num_vertices - num_shaded;
+    }
+
+    for (unsigned int batch_start = 0; batch_start < regs.num_vertices; batch_start += batch_size)
+    {
+        const unsigned int batch_end = std::min<unsigned int>(batch_start + batch_size, regs.num_vertices);
+
+        VertexShader::OutputVertex outputs[batch_size];
+        DebugUtils::GeometryDumper::Vertex dumped_vertices[batch_size];
+        u32 hw_vertices[batch_size];
+
+        // Vertices of the batch that weren't found in the cache are shaded together. For
+        // each vertex of the batch, input_slots holds the index of its shader input.
+        VertexShader::InputVertex inputs[batch_size];
+        VertexShader::OutputVertex shaded_outputs[batch_size];
+        DebugUtils::GeometryDumper::Vertex shaded_dumped_vertices[batch_size];
+        unsigned int shaded_vertices[batch_size];
+        int input_slots[batch_size];
+        int num_inputs = 0;
+
+        for (unsigned int index = batch_start; index < batch_end; ++index) {
+            const unsigned int i = index - batch_start;
+            unsigned int vertex = is_indexed ? (index_u16 ? index_address_16[index] : index_address_8[index]) : index;
+
+            input_slots[i] = -1;
+            if (shade_in_parallel) {
+                const u32 slot = parallel_index_slots[index];
+                if (use_hw_renderer)
+                    hw_vertices[i] = first_parallel_hw_vertex + slot;
+                else
+                    outputs[i] = parallel_outputs[slot];
+                continue;
             }
 
-            if (Settings::values.use_hw_renderer) {
-                VideoCore::g_renderer->hw_rasterizer->DrawTriangles();
+            if (use_vertex_cache) {
+                const VertexCacheEntry& cache_entry = vertex_cache[vertex % vertex_cache.size()];
+                if (cache_entry.draw == vertex_cache_draw && cache_entry.vertex == vertex) {
+                    // Copies, since the triangle handlers may modify the vertices passed to them
+                    if (use_hw_renderer)
+                        hw_vertices[i] = cache_entry.hw_vertex;
+                    else
+                        outputs[i] = cache_entry.output;
+                    if (debug_capture)
+                        dumped_vertices[i] = cache_entry.dumped_vertex;
+                    ++vertex_cache_hits;
+                    continue;
+                }
+
+                // A vertex repeated within the batch is only shaded once
+                for (int slot = 0; slot < num_inputs; ++slot) {
+                    if (shaded_vertices[slot] == vertex) {
+                        input_slots[i] = slot;
+                        ++vertex_cache_hits;
+                        break;
+                    }
+                }
+                if (input_slots[i] != -1)
+                    continue;
             }
 
-            geometry_dumper.Dump();
+            // Initialize data for the current vertex
+            VertexShader::InputVertex& input = inputs[num_inputs];
+            LoadInputVertex(vertex_loader, vertex, input);
 
             if (g_debug_context)
-                g_debug_context->OnEvent(DebugContext::Event::FinishedPrimitiveBatch, nullptr);
+                g_debug_context->OnEvent(DebugContext::Event::VertexLoaded, (void*)&input);
 
-            break;
-        }
+            // NOTE: When dumping geometry, we simply assume that the first input attribute
+            //       corresponds to the position for now.
+            if (debug_capture) {
+                shaded_dumped_vertices[num_inputs] = {
+                    input.attr[0][0].ToFloat32(), input.attr[0][1].ToFloat32(), input.attr[0][2].ToFloat32()
+                };
+            }
 
-        case PICA_REG_INDEX(vs_bool_uniforms):
-            for (unsigned i = 0; i < 16; ++i)
-                g_state.vs.uniforms.b[i] = (regs.vs_bool_uniforms.Value() & (1 << i)) != 0;
-
-            break;
-
-        case PICA_REG_INDEX_WORKAROUND(vs_int_uniforms[0], 0x2b1):
-        case PICA_REG_INDEX_WORKAROUND(vs_int_uniforms[1], 0x2b2):
-        case PICA_REG_INDEX_WORKAROUND(vs_int_uniforms[2], 0x2b3):
-        case PICA_REG_INDEX_WORKAROUND(vs_int_uniforms[3], 0x2b4):
-        {
-            int index = (id - PICA_REG_INDEX_WORKAROUND(vs_int_uniforms[0], 0x2b1));
-            auto values = regs.vs_int_uniforms[index];
-            g_state.vs.uniforms.i[index] = Math::Vec4<u8>(values.x, values.y, values.z, values.w);
-            LOG_TRACE(HW_GPU, "Set integer uniform %d to %02x %02x %02x %02x",
-                      index, values.x.Value(), values.y.Value(), values.z.Value(), values.w.Value());
-            break;
+            shaded_vertices[num_inputs] = vertex;
+            input_slots[i] = num_inputs++;
         }
 
-        case PICA_REG_INDEX_WORKAROUND(vs_uniform_setup.set_value[0], 0x2c1):
-        case PICA_REG_INDEX_WORKAROUND(vs_uniform_setup.set_value[1], 0x2c2):
-        case PICA_REG_INDEX_WORKAROUND(vs_uniform_setup.set_value[2], 0x2c3):
-        case PICA_REG_INDEX_WORKAROUND(vs_uniform_setup.set_value[3], 0x2c4):
-        case PICA_REG_INDEX_WORKAROUND(vs_uniform_setup.set_value[4], 0x2c5):
-        case PICA_REG_INDEX_WORKAROUND(vs_uniform_setup.set_value[5], 0x2c6):
-        case PICA_REG_INDEX_WORKAROUND(vs_uniform_setup.set_value[6], 0x2c7):
-        case PICA_REG_INDEX_WORKAROUND(vs_uniform_setup.set_value[7], 0x2c8):
-        {
-            auto& uniform_setup = regs.vs_uniform_setup;
-
-            // TODO: Does actual hardware indeed keep an intermediate buffer or does
-            //       it directly write the values?
-            uniform_write_buffer[float_regs_counter++] = value;
-
-            // Uniforms are written in a packed format such that four float24 values are encoded in
-            // three 32-bit numbers. We write to internal memory once a full such vector is
-            // written.
-            if ((float_regs_counter >= 4 && uniform_setup.IsFloat32()) ||
-                (float_regs_counter >= 3 && !uniform_setup.IsFloat32())) {
-                float_regs_counter = 0;
-
-                auto& uniform = g_state.vs.uniforms.f[uniform_setup.index];
-
-                if (uniform_setup.index > 95) {
-                    LOG_ERROR(HW_GPU, "Invalid VS uniform index %d", (int)uniform_setup.index);
-                    break;
-                }
+        // Send to vertex shader
+        VertexShader::RunShaderBatch(inputs, num_inputs, num_attributes, shaded_outputs);
 
-                // NOTE: The destination component order indeed is "backwards"
-                if (uniform_setup.IsFloat32()) {
-                    for (auto i : {0,1,2,3})
-                        uniform[3 - i] = float24::FromFloat32(*(float*)(&uniform_write_buffer[i]));
-                } else {
-                    // TODO: Untested
-                    uniform.w = float24::FromRawFloat24(uniform_write_buffer[0] >> 8);
-                    uniform.z = float24::FromRawFloat24(((uniform_write_buffer[0] & 0xFF)<<16) | ((uniform_write_buffer[1] >> 16) & 0xFFFF));
-                    uniform.y = float24::FromRawFloat24(((uniform_write_buffer[1] & 0xFFFF)<<8) | ((uniform_write_buffer[2] >> 24) & 0xFF));
-                    uniform.x = float24::FromRawFloat24(uniform_write_buffer[2] & 0xFFFFFF);
-                }
+        // Shaded vertices go to the hardware renderer right away, triangles refer to them by index
+        const u32 first_hw_vertex = use_hw_renderer ? hw_rasterizer->AddVertices(shaded_outputs, num_inputs) : 0;
 
-                LOG_TRACE(HW_GPU, "Set uniform %x to (%f %f %f %f)", (int)uniform_setup.index,
-                          uniform.x.ToFloat32(), uniform.y.ToFloat32(), uniform.z.ToFloat32(),
-                          uniform.w.ToFloat32());
+        for (int slot = 0; use_vertex_cache && slot < num_inputs; ++slot) {
+            VertexCacheEntry& cache_entry = vertex_cache[shaded_vertices[slot] % vertex_cache.size()];
+            cache_entry.draw = vertex_cache_draw;
+            cache_entry.vertex = shaded_vertices[slot];
+            cache_entry.output = shaded_outputs[slot];
+            cache_entry.hw_vertex = first_hw_vertex + slot;
+            if (debug_capture)
+                cache_entry.dumped_vertex = shaded_dumped_vertices[slot];
+        }
 
-                // TODO: Verify that this actually modifies the register!
-                uniform_setup.index = uniform_setup.index + 1;
+        for (unsigned int i = 0; i < batch_end - batch_start; ++i) {
+            if (input_slots[i] != -1) {
+                if (use_hw_renderer)
+                    hw_vertices[i] = first_hw_vertex + input_slots[i];
+                else
+                    outputs[i] = shaded_outputs[input_slots[i]];
+                if (debug_capture)
+                    dumped_vertices[i] = shaded_dumped_vertices[input_slots[i]];
             }
-            break;
         }
 
-        // Load default vertex input attributes
-        case PICA_REG_INDEX_WORKAROUND(vs_default_attributes_setup.set_value[0], 0x233):
-        case PICA_REG_INDEX_WORKAROUND(vs_default_attributes_setup.set_value[1], 0x234):
-        case PICA_REG_INDEX_WORKAROUND(vs_default_attributes_setup.set_value[2], 0x235):
-        {
-            // TODO: Does actual hardware indeed keep an intermediate buffer or does
-            //       it directly write the values?
-            default_attr_write_buffer[default_attr_counter++] = value;
-
-            // Default attributes are written in a packed format such that four float24 values are encoded in
-            // three 32-bit numbers. We write to internal memory once a full such vector is
-            // written.
-            if (default_attr_counter >= 3) {
-                default_attr_counter = 0;
-
-                auto& setup = regs.vs_default_attributes_setup;
-
-                if (setup.index >= 16) {
-                    LOG_ERROR(HW_GPU, "Invalid VS default attribute index %d", (int)setup.index);
-                    break;
-                }
+        // Assemble the triangles of the whole batch at once
+        const size_t num_outputs = batch_end - batch_start;
+        if (debug_capture) {
+            dumping_primitive_assembler.SubmitVertices(dumped_vertices, num_outputs,
+                    [&geometry_dumper](DebugUtils::GeometryDumper::Vertex& v0,
+                                       DebugUtils::GeometryDumper::Vertex& v1,
+                                       DebugUtils::GeometryDumper::Vertex& v2) {
+                        geometry_dumper.AddTriangle(v0, v1, v2);
+                    });
+        }
 
-                Math::Vec4<float24>& attribute = g_state.vs.default_attributes[setup.index];
+        if (use_hw_renderer) {
+            // Send to hardware renderer
+            hw_primitive_assembler.SubmitVertices(hw_vertices, num_outputs,
+                    [hw_rasterizer](u32 v0, u32 v1, u32 v2) {
+                        hw_rasterizer->AddTriangle(v0, v1, v2);
+                    });
+        } else {
+            // Send to triangle clipper
+            primitive_assembler.SubmitVertices(outputs, num_outputs, Clipper::ProcessTriangle);
+        }
+    }
 
-                // NOTE: The destination component order indeed is "backwards"
-                attribute.w = float24::FromRawFloat24(default_attr_write_buffer[0] >> 8);
-                attribute.z = float24::FromRawFloat24(((default_attr_write_buffer[0] & 0xFF) << 16) | ((default_attr_write_buffer[1] >> 16) & 0xFFFF));
-                attribute.y = float24::FromRawFloat24(((default_attr_write_buffer[1] & 0xFFFF) << 8) | ((default_attr_write_buffer[2] >> 24) & 0xFF));
-                attribute.x = float24::FromRawFloat24(default_attr_write_buffer[2] & 0xFFFFFF);
+    if (use_vertex_cache || shade_in_parallel)
+        profile_vertex_cache.AddSamples(regs.num_vertices, 100 * vertex_cache_hits);
 
-                LOG_TRACE(HW_GPU, "Set default VS attribute %x to (%f %f %f %f)", (int)setup.index,
-                          attribute.x.ToFloat32(), attribute.y.ToFloat32(), attribute.z.ToFloat32(),
-                          attribute.w.ToFloat32());
+    if (use_hw_renderer) {
+        hw_rasterizer->DrawTriangles();
+    } else {
+        // Finish the draw right away, anything after it may read the framebuffer or
+        // change the registers the queued triangles are drawn with
+        Rasterizer::Flush();
+    }
 
-                // TODO: Verify that this actually modifies the register!
-                setup.index = setup.index + 1;
-            }
-            break;
-        }
+    if (debug_capture)
+        geometry_dumper.Dump();
 
-        // Load shader program code
-        case PICA_REG_INDEX_WORKAROUND(vs_program.set_word[0], 0x2cc):
-        case PICA_REG_INDEX_WORKAROUND(vs_program.set_word[1], 0x2cd):
-        case PICA_REG_INDEX_WORKAROUND(vs_program.set_word[2], 0x2ce):
-        case PICA_REG_INDEX_WORKAROUND(vs_program.set_word[3], 0x2cf):
-        case PICA_REG_INDEX_WORKAROUND(vs_program.set_word[4], 0x2d0):
-        case PICA_REG_INDEX_WORKAROUND(vs_program.set_word[5], 0x2d1):
-        case PICA_REG_INDEX_WORKAROUND(vs_program.set_word[6], 0x2d2):
-        case PICA_REG_INDEX_WORKAROUND(vs_program.set_word[7], 0x2d3):
-        {
-            g_state.vs.program_code[regs.vs_program.offset] = value;
-            regs.vs_program.offset++;
-            break;
-        }
+    if (g_debug_context)
+        g_debug_context->OnEvent(DebugContext::Event::FinishedPrimitiveBatch, nullptr);
+}
+
+static void SetBoolUniforms(u32 id, u32 value) {
+    auto& regs = g_state.regs;
+
+    for (unsigned i = 0; i < 16; ++i)
+        g_state.vs.uniforms.b[i] = (regs.vs_bool_uniforms.Value() & (1 << i)) != 0;
+    VertexShader::InvalidateShaderUniforms();
+}
+
+static void SetIntUniform(u32 id, u32 value) {
+    auto& regs = g_state.regs;
+
+    int index = (id - PICA_REG_INDEX_WORKAROUND(vs_int_uniforms[0], 0x2b1));
+    auto values = regs.vs_int_uniforms[index];
+    g_state.vs.uniforms.i[index] = Math::Vec4<u8>(values.x, values.y, values.z, values.w);
+    VertexShader::InvalidateShaderUniforms();
+    LOG_TRACE(HW_GPU, "Set integer uniform %d to %02x %02x %02x %02x",
+              index, values.x.Value(), values.y.Value(), values.z.Value(), values.w.Value());
+}
+
+/**
+ * Decodes a vector of four float24 values packed into three 32-bit words.
+ * NOTE: The destination component order indeed is "backwards"
+ */
+static Math::Vec4<float24> UnpackFloat24Vector(const u32* words) {
+    const u32 x = words[2] & 0xFFFFFF;
+    const u32 y = ((words[1] & 0xFFFF) << 8) | ((words[2] >> 24) & 0xFF);
+    const u32 z = ((words[0] & 0xFF) << 16) | ((words[1] >> 16) & 0xFFFF);
+    const u32 w = words[0] >> 8;
+
+#if defined(_M_X64) || defined(__SSE2__)
+    // Same conversion as float24::RawFloat24ToRawFloat32, for all four components at once
+    const __m128i raw = _mm_setr_epi32(x, y, z, w);
+    const __m128i sign = _mm_slli_epi32(_mm_and_si128(raw, _mm_set1_epi32(0x800000)), 8);
+    const __m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_and_si128(_mm_srli_epi32(raw, 16), _mm_set1_epi32(0x7F)),
+                                                          _mm_set1_epi32(127 - 63)), 23);
+    const __m128i mantissa = _mm_slli_epi32(_mm_and_si128(raw, _mm_set1_epi32(0xFFFF)), 7);
+    const __m128i zero = _mm_cmpeq_epi32(_mm_and_si128(raw, _mm_set1_epi32(0xFFFFFF)), _mm_setzero_si128());
+    const __m128i bits = _mm_andnot_si128(zero, _mm_or_si128(sign, _mm_or_si128(exponent, mantissa)));
+
+    u32 converted[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(converted), bits);
+    return Math::MakeVec(float24::FromRawFloat32(converted[0]), float24::FromRawFloat32(converted[1]),
+                         float24::FromRawFloat32(converted[2]), float24::FromRawFloat32(converted[3]));
+#else
+    return Math::MakeVec(float24::FromRawFloat24(x), float24::FromRawFloat24(y),
+                         float24::FromRawFloat24(z), float24::FromRawFloat24(w));
+#endif
+}
+
+/**
+ * Decodes a vector of four float32 values.
+ * NOTE: The destination component order indeed is "backwards"
+ */
+static Math::Vec4<float24> UnpackFloat32Vector(const u32* words) {
+    return Math::MakeVec(float24::FromRawFloat32(words[3]), float24::FromRawFloat32(words[2]),
+                         float24::FromRawFloat32(words[1]), float24::FromRawFloat32(words[0]));
+}
+
+/// Writes a fully uploaded vector to the uniform selected by the uniform setup and selects the next one
+static void SetFloatUniform(const u32* words) {
+    auto& uniform_setup = g_state.regs.vs_uniform_setup;
+
+    if (uniform_setup.index > 95) {
+        LOG_ERROR(HW_GPU, "Invalid VS uniform index %d", (int)uniform_setup.index);
+        return;
+    }
+
+    auto& uniform = g_state.vs.uniforms.f[uniform_setup.index];
+    // TODO: The float24 path is untested
+    uniform = uniform_setup.IsFloat32() ? UnpackFloat32Vector(words) : UnpackFloat24Vector(words);
+
+    LOG_TRACE(HW_GPU, "Set uniform %x to (%f %f %f %f)", (int)uniform_setup.index,
+              uniform.x.ToFloat32(), uniform.y.ToFloat32(), uniform.z.ToFloat32(),
+              uniform.w.ToFloat32());
+
+    // TODO: Verify that this actually modifies the register!
+    uniform_setup.index = uniform_setup.index + 1;
+}
+
+static void WriteFloatUniformWord(u32 id, u32 value) {
+    auto& uniform_setup = g_state.regs.vs_uniform_setup;
+
+    // TODO: Does actual hardware indeed keep an intermediate buffer or does
+    //       it directly write the values?
+    uniform_write_buffer[float_regs_counter++] = value;
+
+    // Uniforms are written in a packed format such that four float24 values are encoded in
+    // three 32-bit numbers. We write to internal memory once a full such vector is
+    // written.
+    if ((float_regs_counter >= 4 && uniform_setup.IsFloat32()) ||
+        (float_regs_counter >= 3 && !uniform_setup.IsFloat32())) {
+        float_regs_counter = 0;
+        SetFloatUniform(uniform_write_buffer);
+    }
+}
+
+/// Uploads many uniform words at once, decoding whole vectors straight from the command list
+static void WriteFloatUniformWords(u32 id, const u32* values, unsigned count) {
+    const unsigned words_per_vector = g_state.regs.vs_uniform_setup.IsFloat32() ? 4 : 3;
+
+    // Complete the vector started by an earlier command first
+    for (; count > 0 && float_regs_counter != 0; --count)
+        WriteFloatUniformWord(id, *values++);
+
+    for (; count >= words_per_vector; count -= words_per_vector, values += words_per_vector)
+        SetFloatUniform(values);
+
+    for (; count > 0; --count)
+        WriteFloatUniformWord(id, *values++);
+}
+
+// Load default vertex input attributes
+static void WriteDefaultAttributeWord(u32 id, u32 value) {
+    auto& regs = g_state.regs;
+
+    // TODO: Does actual hardware indeed keep an intermediate buffer or does
+    //       it directly write the values?
+    default_attr_write_buffer[default_attr_counter++] = value;
+
+    // Default attributes are written in a packed format such that four float24 values are encoded in
+    // three 32-bit numbers. We write to internal memory once a full such vector is
+    // written.
+    if (default_attr_counter >= 3) {
+        default_attr_counter = 0;
 
-        // Load swizzle pattern data
-        case PICA_REG_INDEX_WORKAROUND(vs_swizzle_patterns.set_word[0], 0x2d6):
-        case PICA_REG_INDEX_WORKAROUND(vs_swizzle_patterns.set_word[1], 0x2d7):
-        case PICA_REG_INDEX_WORKAROUND(vs_swizzle_patterns.set_word[2], 0x2d8):
-        case PICA_REG_INDEX_WORKAROUND(vs_swizzle_patterns.set_word[3], 0x2d9):
-        case PICA_REG_INDEX_WORKAROUND(vs_swizzle_patterns.set_word[4], 0x2da):
-        case PICA_REG_INDEX_WORKAROUND(vs_swizzle_patterns.set_word[5], 0x2db):
-        case PICA_REG_INDEX_WORKAROUND(vs_swizzle_patterns.set_word[6], 0x2dc):
-        case PICA_REG_INDEX_WORKAROUND(vs_swizzle_patterns.set_word[7], 0x2dd):
-        {
-            g_state.vs.swizzle_data[regs.vs_swizzle_patterns.offset] = value;
-            regs.vs_swizzle_patterns.offset++;
-            break;
+        auto& setup = regs.vs_default_attributes_setup;
+
+        if (setup.index >= 16) {
+            LOG_ERROR(HW_GPU, "Invalid VS default attribute index %d", (int)setup.index);
+            return;
         }
 
-        default:
-            break;
+        Math::Vec4<float24>& attribute = g_state.vs.default_attributes[setup.index];
+
+        attribute = UnpackFloat24Vector(default_attr_write_buffer);
+
+        LOG_TRACE(HW_GPU, "Set default VS attribute %x to (%f %f %f %f)", (int)setup.index,
+                  attribute.x.ToFloat32(), attribute.y.ToFloat32(), attribute.z.ToFloat32(),
+                  attribute.w.ToFloat32());
+
+        // TODO: Verify that this actually modifies the register!
+        setup.index = setup.index + 1;
+    }
+}
+
+// Load shader program code
+static void WriteProgramWord(u32 id, u32 value) {
+    auto& regs = g_state.regs;
+
+    g_state.vs.program_code[regs.vs_program.offset] = value;
+    regs.vs_program.offset++;
+    VertexShader::InvalidateShaderProgram();
+}
+
+// Load swizzle pattern data
+static void WriteSwizzleWord(u32 id, u32 value) {
+    auto& regs = g_state.regs;
+
+    g_state.vs.swizzle_data[regs.vs_swizzle_patterns.offset] = value;
+    regs.vs_swizzle_patterns.offset++;
+    VertexShader::InvalidateShaderProgram();
+}
+
+static std::vector<RegisterHandler> BuildRegisterHandlers() {
+    std::vector<RegisterHandler> handlers(Regs::NumIds(), nullptr);
+
+    handlers[PICA_REG_INDEX(trigger_irq)] = TriggerIrq;
+    for (unsigned i = 0; i < 2; ++i)
+        handlers[PICA_REG_INDEX_WORKAROUND(command_buffer.trigger[0], 0x23c) + i] = JumpToCommandBuffer;
+    handlers[PICA_REG_INDEX(trigger_draw)] = TriggerDraw;
+    handlers[PICA_REG_INDEX(trigger_draw_indexed)] = TriggerDraw;
+    handlers[PICA_REG_INDEX(vs_bool_uniforms)] = SetBoolUniforms;
+    for (unsigned i = 0; i < 4; ++i)
+        handlers[PICA_REG_INDEX_WORKAROUND(vs_int_uniforms[0], 0x2b1) + i] = SetIntUniform;
+    for (unsigned i = 0; i < 8; ++i)
+        handlers[PICA_REG_INDEX_WORKAROUND(vs_uniform_setup.set_value[0], 0x2c1) + i] = WriteFloatUniformWord;
+    for (unsigned i = 0; i < 3; ++i)
+        handlers[PICA_REG_INDEX_WORKAROUND(vs_default_attributes_setup.set_value[0], 0x233) + i] = WriteDefaultAttributeWord;
+    for (unsigned i = 0; i < 8; ++i)
+        handlers[PICA_REG_INDEX_WORKAROUND(vs_program.set_word[0], 0x2cc) + i] = WriteProgramWord;
+    for (unsigned i = 0; i < 8; ++i)
+        handlers[PICA_REG_INDEX_WORKAROUND(vs_swizzle_patterns.set_word[0], 0x2d6) + i] = WriteSwizzleWord;
+
+    return handlers;
+}
+
+/// Side effects of each register, null for the registers which only store their value
+static const std::vector<RegisterHandler> register_handlers = BuildRegisterHandlers();
+
+/**
+ * Writes a PICA register and performs the side effects of the write
+ * @tparam debugging Whether to notify the debugger and the PICA tracer, only leave this out if neither is active
+ */
+template <bool debugging>
+static inline void WritePicaReg(u32 id, u32 value, u32 mask) {
+    auto& regs = g_state.regs;
+
+    if (id >= regs.NumIds())
+        return;
+
+    // TODO: Figure out how register masking acts on e.g. vs_uniform_setup.set_value
+    u32 old_value = regs[id];
+    regs[id] = (old_value & ~mask) | (value & mask);
+    DerivedState::NotifyRegisterWritten(id);
+
+    if (debugging) {
+        if (g_debug_context)
+            g_debug_context->OnEvent(DebugContext::Event::CommandLoaded, reinterpret_cast<void*>(&id));
+
+        DebugUtils::OnPicaRegWrite(id, regs[id]);
     }
 
+    const RegisterHandler handler = register_handlers[id];
+    if (handler != nullptr)
+        handler(id, value);
+
     VideoCore::g_renderer->hw_rasterizer->NotifyPicaRegisterChanged(id);
 
-    if (g_debug_context)
+    if (debugging && g_debug_context)
         g_debug_context->OnEvent(DebugContext::Event::CommandProcessed, reinterpret_cast<void*>(&id));
 }
 
+/**
+ * Writes the parameters of a command repeatedly writing the same register all at once. This is
+ * done for the shader code and uniform uploads, which make up the bulk of most command lists.
+ * @return False if the register isn't uploaded to in bulk, nothing has been written then
+ */
+static bool WritePicaRegBulk(u32 id, const u32* values, unsigned count) {
+    auto& regs = g_state.regs;
+
+    if (id >= regs.NumIds())
+        return false;
+
+    const RegisterHandler handler = register_handlers[id];
+    if (handler == WriteProgramWord || handler == WriteSwizzleWord) {
+        const bool is_program = (handler == WriteProgramWord);
+        auto& data = is_program ? g_state.vs.program_code : g_state.vs.swizzle_data;
+        u32& offset = is_program ? regs.vs_program.offset : regs.vs_swizzle_patterns.offset;
+
+        if (offset + count > data.size()) {
+            LOG_ERROR(HW_GPU, "Shader upload of %u words at offset %u exceeds the shader memory", count, offset);
+            count = offset < data.size() ? static_cast<unsigned>(data.size() - offset) : 0;
+        }
+        std::memcpy(&data[offset], values, count * sizeof(u32));
+        offset += count;
+        VertexShader::InvalidateShaderProgram();
+    } else if (handler == WriteFloatUniformWord) {
+        WriteFloatUniformWords(id, values, count);
+    } else {
+        return false;
+    }
+
+    if (count > 0)
+        regs[id] = values[count - 1];
+    DerivedState::NotifyRegisterWritten(id);
+    VideoCore::g_renderer->hw_rasterizer->NotifyPicaRegisterChanged(id);
+    return true;
+}
+
 void ProcessCommandList(const u32* list, u32 size) {
+    CostModel::AddCommandList(size);
     g_state.cmd_list.head_ptr = g_state.cmd_list.current_ptr = list;
     g_state.cmd_list.length = size / sizeof(u32);
 
+    // Without anyone looking at the individual register writes, they are done with as little overhead as possible
+    const bool tracing = DebugUtils::BeginPicaTraceCommandList();
+    const bool debugging = (g_debug_context && g_debug_context->AnyBreakPointArmed()) || tracing;
+
     while (g_state.cmd_list.current_ptr < g_state.cmd_list.head_ptr + g_state.cmd_list.length) {
         // Expand a 4-bit mask to 4-byte mask, e.g. 0b0101 -> 0x00FF00FF
         static const u32 expand_bits_to_bytes[] = {
@@ -395,13 +694,48 @@ void ProcessCommandList(const u32* list, u32 size) {
         const u32 write_mask = expand_bits_to_bytes[header.parameter_mask];
         u32 cmd = header.cmd_id;
 
-        WritePicaReg(cmd, value, write_mask);
+        if (debugging) {
+            WritePicaReg<true>(cmd, value, write_mask);
+
+            for (unsigned i = 0; i < header.extra_data_length; ++i) {
+                u32 cmd = header.cmd_id + (header.group_commands ? i + 1 : 0);
+                WritePicaReg<true>(cmd, *g_state.cmd_list.current_ptr++, write_mask);
+            }
+            continue;
+        }
+
+        WritePicaReg<false>(cmd, value, write_mask);
+
+        // The extra parameters of uploads follow the header in one piece
+        const unsigned extra_length = header.extra_data_length;
+        if (extra_length > 0 && !header.group_commands && write_mask == 0xFFFFFFFF &&
+                WritePicaRegBulk(cmd, g_state.cmd_list.current_ptr, extra_length)) {
+            g_state.cmd_list.current_ptr += extra_length;
+            continue;
+        }
 
-        for (unsigned i = 0; i < header.extra_data_length; ++i) {
+        for (unsigned i = 0; i < extra_length; ++i) {
             u32 cmd = header.cmd_id + (header.group_commands ? i + 1 : 0);
-            WritePicaReg(cmd, *g_state.cmd_list.current_ptr++, write_mask);
-         }
+            WritePicaReg<false>(cmd, *g_state.cmd_list.current_ptr++, write_mask);
+        }
     }
+
+    if (tracing)
+        DebugUtils::EndPicaTraceCommandList();
+
+    VideoCore::g_renderer->hw_rasterizer->NotifyCommandListProcessed();
+}
+
+void DoState(PointerWrap& p) {
+    p.Do(float_regs_counter);
+    p.DoArray(uniform_write_buffer, ARRAY_SIZE(uniform_write_buffer));
+    p.Do(default_attr_counter);
+    p.DoArray(default_attr_write_buffer, ARRAY_SIZE(default_attr_write_buffer));
+    p.DoMarker("CommandProcessor");
+
+    // Compiled shaders are looked up by the hash of the program, which has to be computed again
+    if (p.GetMode() == PointerWrap::MODE_READ)
+        VertexShader::InvalidateShaderProgram();
 }
 
 } // namespace
@@ -9,6 +9,8 @@
 
 #include "pica.h"
 
+class PointerWrap;
+
 namespace Pica {
 
 namespace CommandProcessor {
@@ -37,6 +39,9 @@ static_assert(sizeof(CommandHeader) == sizeof(u32), "CommandHeader has incorrect
 
 void ProcessCommandList(const u32* list, u32 size);
 
+/// Saves or restores the partially written uniforms and default attributes, after the Pica state
+void DoState(PointerWrap& p);
+
 } // namespace
 
 } // namespace
@@ -0,0 +1,50 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "video_core/cost_model.h"
+
+namespace Pica {
+
+namespace CostModel {
+
+// Fills only touch VRAM, while transfers and DMAs mostly go through the slower FCRAM
+static const u32 FILL_BYTES_PER_CYCLE = 8;
+static const u32 COPY_BYTES_PER_CYCLE = 4;
+
+static const s64 CYCLES_PER_COMMAND_WORD = 1;
+static const s64 CYCLES_PER_DRAW = 200;
+static const s64 CYCLES_PER_VERTEX = 8;
+
+/// Command list work accounted for since the last interrupt, only touched by the video core's thread
+static s64 command_list_cycles = 0;
+
+s64 MemoryFill(u32 size) {
+    return size / FILL_BYTES_PER_CYCLE;
+}
+
+s64 DisplayTransfer(u32 input_size, u32 output_size) {
+    return (static_cast<s64>(input_size) + output_size) / COPY_BYTES_PER_CYCLE;
+}
+
+s64 DMA(u32 size) {
+    return size / COPY_BYTES_PER_CYCLE;
+}
+
+void AddCommandList(u32 size) {
+    command_list_cycles += size / sizeof(u32) * CYCLES_PER_COMMAND_WORD;
+}
+
+void AddDraw(u32 num_vertices) {
+    command_list_cycles += CYCLES_PER_DRAW + num_vertices * CYCLES_PER_VERTEX;
+}
+
+s64 TakeCommandListCycles() {
+    const s64 cycles = command_list_cycles;
+    command_list_cycles = 0;
+    return cycles;
+}
+
+} // namespace
+
+} // namespace
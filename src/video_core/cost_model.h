@@ -0,0 +1,38 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+namespace Pica {
+
+/**
+ * Rough estimates of how long the GPU takes for its work, in ARM11 cycles. The GPU interrupts are
+ * raised that long after the work is submitted, instead of in the same instant, so that the guest
+ * sees timings resembling the hardware's. The GPU runs at the clock rate of the ARM11.
+ */
+namespace CostModel {
+
+/// Cycles a memory fill of the given number of bytes takes
+s64 MemoryFill(u32 size);
+
+/// Cycles a display transfer or texture copy reading and writing the given numbers of bytes takes
+s64 DisplayTransfer(u32 input_size, u32 output_size);
+
+/// Cycles a DMA of the given number of bytes takes
+s64 DMA(u32 size);
+
+/// Accounts for a command list of the given size in bytes being processed
+void AddCommandList(u32 size);
+
+/// Accounts for a draw call of the current command list
+void AddDraw(u32 num_vertices);
+
+/// Takes the cycles accounted for since the last call, when the command list raises its interrupt
+s64 TakeCommandListCycles();
+
+} // namespace
+
+} // namespace
@@ -3,12 +3,14 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <list>
 #include <map>
 #include <fstream>
 #include <mutex>
 #include <string>
+#include <thread>
 
 #ifdef HAVE_PNG
 #include <png.h>
@@ -18,10 +20,17 @@
 
 #include "common/assert.h"
 #include "common/color.h"
+#include "common/cpu_detect.h"
 #include "common/file_util.h"
+#include "common/job_system.h"
 #include "common/math_util.h"
+#include "common/platform.h"
 #include "common/vector_math.h"
 
+#ifdef HAVE_SSSE3_KERNELS
+#include <tmmintrin.h>
+#endif
+
 #include "video_core/pica.h"
 #include "video_core/utils.h"
 #include "video_core/video_core.h"
@@ -34,15 +43,27 @@ using nihstro::DVLPHeader;
 
 namespace Pica {
 
-void DebugContext::OnEvent(Event event, void* data) {
-    if (!breakpoints[event].enabled)
+static Common::LockStats breakpoint_lock_stats("PICA breakpoints");
+
+DebugContext::DebugContext() : breakpoint_mutex(breakpoint_lock_stats) {
+}
+
+void DebugContext::HandleEvent(Event event, void* data) {
+    if (logged_events.load(std::memory_order_relaxed) & EventBit(event)) {
+        const bool is_command = event == Event::CommandLoaded || event == Event::CommandProcessed;
+        const u64 index = event_log_end.load(std::memory_order_relaxed);
+        event_log[index % EVENT_LOG_SIZE] = { index, event, is_command ? *static_cast<u32*>(data) : 0 };
+        event_log_end.store(index + 1, std::memory_order_release);
         return;
+    }
 
     {
-        std::unique_lock<std::mutex> lock(breakpoint_mutex);
+        std::unique_lock<Common::InstrumentedMutex> lock(breakpoint_mutex);
 
-        // Commit the hardware renderer's framebuffer so it will show on debug widgets
-        VideoCore::g_renderer->hw_rasterizer->CommitFramebuffer();
+        // Commit the hardware renderer's framebuffer so it will show on debug widgets. It's a
+        // readback of the whole framebuffer, so it's skipped while nobody looks at it.
+        if (framebuffer_viewers > 0)
+            VideoCore::g_renderer->hw_rasterizer->CommitFramebuffer();
 
         // TODO: Should stop the CPU thread here once we multithread emulation.
 
@@ -59,9 +80,56 @@ void DebugContext::OnEvent(Event event, void* data) {
     }
 }
 
+DebugContext::BreakPoint DebugContext::GetBreakPoint(Event event) const {
+    BreakPoint breakpoint;
+    breakpoint.enabled = (armed_events & EventBit(event)) != 0;
+    breakpoint.log_only = (logged_events & EventBit(event)) != 0;
+    return breakpoint;
+}
+
+void DebugContext::SetBreakPoint(Event event, const BreakPoint& breakpoint) {
+    // The logging bit is set first, so that enabling a logging breakpoint never halts
+    if (breakpoint.log_only) {
+        logged_events |= EventBit(event);
+    }
+    if (breakpoint.enabled) {
+        armed_events |= EventBit(event);
+    } else {
+        armed_events &= ~EventBit(event);
+    }
+    if (!breakpoint.log_only) {
+        logged_events &= ~EventBit(event);
+    }
+}
+
+u64 DebugContext::ReadEventLog(u64 since, std::vector<LoggedEvent>& events) const {
+    const u64 end = event_log_end.load(std::memory_order_acquire);
+    const u64 begin = std::max(since, end > EVENT_LOG_SIZE ? end - EVENT_LOG_SIZE : 0);
+    const size_t first = events.size();
+    for (u64 index = begin; index < end; ++index)
+        events.push_back(event_log[index % EVENT_LOG_SIZE]);
+
+    // Entries the logging thread overwrote while they were being copied are dropped
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const u64 new_end = event_log_end.load(std::memory_order_relaxed);
+    if (new_end > EVENT_LOG_SIZE && new_end - EVENT_LOG_SIZE > begin) {
+        const u64 overwritten = std::min(new_end - EVENT_LOG_SIZE, end) - begin;
+        events.erase(events.begin() + first, events.begin() + first + static_cast<size_t>(overwritten));
+    }
+    return end;
+}
+
+void DebugContext::SetFramebufferViewed(bool viewed) {
+    if (viewed) {
+        ++framebuffer_viewers;
+    } else {
+        --framebuffer_viewers;
+    }
+}
+
 void DebugContext::Resume() {
     {
-        std::unique_lock<std::mutex> lock(breakpoint_mutex);
+        std::unique_lock<Common::InstrumentedMutex> lock(breakpoint_mutex);
 
         // Tell all observers that we are about to resume
         for (auto& breakpoint_observer : breakpoint_observers) {
@@ -89,10 +157,6 @@ void GeometryDumper::AddTriangle(Vertex& v0, Vertex& v1, Vertex& v2) {
 }
 
 void GeometryDumper::Dump() {
-    // NOTE: Permanently enabling this just trashes the hard disk for no reason.
-    //       Hence, this is currently disabled.
-    return;
-
     static int index = 0;
     std::string filename = std::string("geometry_dump") + std::to_string(++index) + ".obj";
 
@@ -115,10 +179,6 @@ void GeometryDumper::Dump() {
 void DumpShader(const u32* binary_data, u32 binary_size, const u32* swizzle_data, u32 swizzle_size,
                 u32 main_offset, const Regs::VSOutputAttributes* output_attributes)
 {
-    // NOTE: Permanently enabling this just trashes hard disks for no reason.
-    //       Hence, this is currently disabled.
-    return;
-
     struct StuffToWrite {
         u8* pointer;
         u32 size;
@@ -256,9 +316,17 @@ void DumpShader(const u32* binary_data, u32 binary_size, const u32* swizzle_data
     }
 }
 
+// The trace is only written by the thread processing command lists, between the begin and end of
+// a traced command list. Outside of those it belongs to the thread starting and finishing traces.
 static std::unique_ptr<PicaTrace> pica_trace;
-static std::mutex pica_trace_mutex;
-static int is_pica_tracing = false;
+static std::atomic<bool> is_pica_tracing(false);
+/// Set while a traced command list is processed, FinishPicaTracing waits for it to be cleared
+static std::atomic<bool> in_traced_command_list(false);
+/// Whether the command list being processed is traced, only accessed by the command processor
+static bool tracing_command_list = false;
+
+/// Number of register writes space is reserved for up front, about a frame's worth
+static const size_t PICA_TRACE_RESERVED_WRITES = 0x10000;
 
 void StartPicaTracing()
 {
@@ -267,30 +335,45 @@ void StartPicaTracing()
         return;
     }
 
-    pica_trace_mutex.lock();
     pica_trace = std::unique_ptr<PicaTrace>(new PicaTrace);
+    pica_trace->writes.reserve(PICA_TRACE_RESERVED_WRITES);
 
     is_pica_tracing = true;
-    pica_trace_mutex.unlock();
 }
 
 bool IsPicaTracing()
 {
-    return is_pica_tracing != 0;
+    return is_pica_tracing;
 }
 
-void OnPicaRegWrite(u32 id, u32 value)
+bool BeginPicaTraceCommandList()
 {
-    // Double check for is_pica_tracing to avoid pointless locking overhead
-    if (!is_pica_tracing)
-        return;
+    // Without tracing this is the only cost per command list
+    if (!is_pica_tracing.load(std::memory_order_relaxed))
+        return false;
 
-    std::unique_lock<std::mutex> lock(pica_trace_mutex);
+    // Announce the traced command list before checking the flag again, so that
+    // FinishPicaTracing either sees the announcement or this sees the flag cleared
+    in_traced_command_list = true;
+    if (!is_pica_tracing) {
+        in_traced_command_list = false;
+        return false;
+    }
 
-    if (!is_pica_tracing)
-        return;
+    tracing_command_list = true;
+    return true;
+}
 
-    pica_trace->writes.emplace_back(id, value);
+void EndPicaTraceCommandList()
+{
+    tracing_command_list = false;
+    in_traced_command_list = false;
+}
+
+void OnPicaRegWrite(u32 id, u32 value)
+{
+    if (tracing_command_list)
+        pica_trace->writes.emplace_back(id, value);
 }
 
 std::unique_ptr<PicaTrace> FinishPicaTracing()
@@ -303,13 +386,138 @@ std::unique_ptr<PicaTrace> FinishPicaTracing()
     // signalize that no further tracing should be performed
     is_pica_tracing = false;
 
-    // Wait until running tracing is finished
-    pica_trace_mutex.lock();
-    std::unique_ptr<PicaTrace> ret(std::move(pica_trace));
-    pica_trace_mutex.unlock();
-    return std::move(ret);
+    // Wait until the command list being traced, if any, is finished
+    while (in_traced_command_list)
+        std::this_thread::yield();
+
+    return std::move(pica_trace);
 }
 
+static const std::array<std::array<u8, 2>, 8> etc1_modifier_table = {{
+    {  2,  8 }, {  5, 17 }, {  9,  29 }, { 13,  42 },
+    { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+}};
+
+/// A 4x4 block of an ETC1 texture
+union ETC1Tile {
+    // Each of these two is a collection of 16 bits (one per lookup value)
+    BitField< 0, 16, u64> table_subindexes;
+    BitField<16, 16, u64> negation_flags;
+
+    unsigned GetTableSubIndex(unsigned index) const {
+        return (table_subindexes >> index) & 1;
+    }
+
+    bool GetNegationFlag(unsigned index) const {
+        return ((negation_flags >> index) & 1) == 1;
+    }
+
+    BitField<32, 1, u64> flip;
+    BitField<33, 1, u64> differential_mode;
+
+    BitField<34, 3, u64> table_index_2;
+    BitField<37, 3, u64> table_index_1;
+
+    union {
+        // delta value + base value
+        BitField<40, 3, s64> db;
+        BitField<43, 5, u64> b;
+
+        BitField<48, 3, s64> dg;
+        BitField<51, 5, u64> g;
+
+        BitField<56, 3, s64> dr;
+        BitField<59, 5, u64> r;
+    } differential;
+
+    union {
+        BitField<40, 4, u64> b2;
+        BitField<44, 4, u64> b1;
+
+        BitField<48, 4, u64> g2;
+        BitField<52, 4, u64> g1;
+
+        BitField<56, 4, u64> r2;
+        BitField<60, 4, u64> r1;
+    } separate;
+
+    /// Returns the base color of the left/bottom (0) or right/top (1) half of the block
+    Math::Vec3<int> GetBaseColor(unsigned subblock) const {
+        Math::Vec3<int> ret;
+        if (differential_mode) {
+            ret.r() = differential.r;
+            ret.g() = differential.g;
+            ret.b() = differential.b;
+            if (subblock == 1) {
+                ret.r() += differential.dr;
+                ret.g() += differential.dg;
+                ret.b() += differential.db;
+            }
+            ret.r() = Color::Convert5To8(ret.r());
+            ret.g() = Color::Convert5To8(ret.g());
+            ret.b() = Color::Convert5To8(ret.b());
+        } else {
+            if (subblock == 0) {
+                ret.r() = Color::Convert4To8(separate.r1);
+                ret.g() = Color::Convert4To8(separate.g1);
+                ret.b() = Color::Convert4To8(separate.b1);
+            } else {
+                ret.r() = Color::Convert4To8(separate.r2);
+                ret.g() = Color::Convert4To8(separate.g2);
+                ret.b() = Color::Convert4To8(separate.b2);
+            }
+        }
+        return ret;
+    }
+
+    /// Applies the modifier of the given texel to the base color of its half of the block
+    const Math::Vec3<u8> Modify(Math::Vec3<int> ret, unsigned subblock, int texel) const {
+        unsigned table_index = (subblock == 0) ? table_index_1.Value() : table_index_2.Value();
+
+        int modifier = etc1_modifier_table.at(table_index).at(GetTableSubIndex(texel));
+        if (GetNegationFlag(texel))
+            modifier *= -1;
+
+        ret.r() = MathUtil::Clamp(ret.r() + modifier, 0, 255);
+        ret.g() = MathUtil::Clamp(ret.g() + modifier, 0, 255);
+        ret.b() = MathUtil::Clamp(ret.b() + modifier, 0, 255);
+
+        return ret.Cast<u8>();
+    }
+
+    const Math::Vec3<u8> GetRGB(int x, int y) const {
+        const unsigned subblock = ((flip ? y : x) >= 2) ? 1 : 0;
+        return Modify(GetBaseColor(subblock), subblock, 4 * x + y);
+    }
+
+    /// Decodes all texels of the block, extracting its fields only once
+    void DecodeAll(Math::Vec3<u8> (&texels)[16]) const {
+        const Math::Vec3<int> base[2] = { GetBaseColor(0), GetBaseColor(1) };
+        const std::array<u8, 2>* modifiers[2] = {
+            &etc1_modifier_table[table_index_1], &etc1_modifier_table[table_index_2]
+        };
+        const unsigned subindexes = static_cast<unsigned>(table_subindexes);
+        const unsigned negations = static_cast<unsigned>(negation_flags);
+        const bool flipped = flip != 0;
+
+        for (int y = 0; y < 4; ++y) {
+            for (int x = 0; x < 4; ++x) {
+                const unsigned subblock = ((flipped ? y : x) >= 2) ? 1 : 0;
+                const int texel = 4 * x + y;
+
+                // Negated without a branch, the flags are about as random as texture data gets
+                const int negate = -static_cast<int>((negations >> texel) & 1);
+                const int modifier = ((*modifiers[subblock])[(subindexes >> texel) & 1] ^ negate) - negate;
+
+                const Math::Vec3<int>& color = base[subblock];
+                texels[x + 4 * y] = Math::MakeVec(MathUtil::Clamp(color.r() + modifier, 0, 255),
+                                                  MathUtil::Clamp(color.g() + modifier, 0, 255),
+                                                  MathUtil::Clamp(color.b() + modifier, 0, 255)).Cast<u8>();
+            }
+        }
+    }
+};
+
 const Math::Vec4<u8> LookupTexture(const u8* source, int x, int y, const TextureInfo& info, bool disable_alpha) {
     const unsigned int coarse_x = x & ~7;
     const unsigned int coarse_y = y & ~7;
@@ -445,109 +653,223 @@ const Math::Vec4<u8> LookupTexture(const u8* source, int x, int y, const Texture
             source_ptr++;
         }
 
-        union ETC1Tile {
-            // Each of these two is a collection of 16 bits (one per lookup value)
-            BitField< 0, 16, u64> table_subindexes;
-            BitField<16, 16, u64> negation_flags;
-
-            unsigned GetTableSubIndex(unsigned index) const {
-                return (table_subindexes >> index) & 1;
-            }
+        const ETC1Tile* etc1_tile = reinterpret_cast<const ETC1Tile*>(source_ptr);
 
-            bool GetNegationFlag(unsigned index) const {
-                return ((negation_flags >> index) & 1) == 1;
-            }
+        alpha >>= 4 * ((x & 3) * 4 + (y & 3));
+        return Math::MakeVec(etc1_tile->GetRGB(x & 3, y & 3),
+                             disable_alpha ? (u8)255 : Color::Convert4To8(alpha & 0xF));
+    }
 
-            BitField<32, 1, u64> flip;
-            BitField<33, 1, u64> differential_mode;
+    default:
+        LOG_ERROR(HW_GPU, "Unknown texture format: %x", (u32)info.format);
+        DEBUG_ASSERT(false);
+        return {};
+    }
+}
 
-            BitField<34, 3, u64> table_index_2;
-            BitField<37, 3, u64> table_index_1;
+#ifdef HAVE_SSSE3_KERNELS
+static TARGET_SSSE3 void DecodeTileRGBA8_SSSE3(const u8* source, Math::Vec4<u8> (&texels)[64]) {
+    const __m128i shuffle = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    for (int i = 0; i < 64; i += 4) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&texels[i]), _mm_shuffle_epi8(data, shuffle));
+    }
+}
 
-            union {
-                // delta value + base value
-                BitField<40, 3, s64> db;
-                BitField<43, 5, u64> b;
+/**
+ * Decodes the first 60 texels of an RGB8 tile. Each load reads 16 bytes for 4 texels, so the last
+ * 4 texels are left to the caller to not read past the end of the tile.
+ */
+static TARGET_SSSE3 void DecodeTileRGB8_SSSE3(const u8* source, Math::Vec4<u8> (&texels)[64]) {
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+    for (int i = 0; i < 60; i += 4) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i * 3));
+        data = _mm_or_si128(_mm_shuffle_epi8(data, shuffle), alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&texels[i]), data);
+    }
+}
 
-                BitField<48, 3, s64> dg;
-                BitField<51, 5, u64> g;
+static TARGET_SSSE3 void DecodeTileIA8_SSSE3(const u8* source, Math::Vec4<u8> (&texels)[64]) {
+    const __m128i shuffle_low = _mm_setr_epi8(1, 1, 1, 0, 3, 3, 3, 2, 5, 5, 5, 4, 7, 7, 7, 6);
+    const __m128i shuffle_high = _mm_setr_epi8(9, 9, 9, 8, 11, 11, 11, 10, 13, 13, 13, 12, 15, 15, 15, 14);
+    for (int i = 0; i < 64; i += 8) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i * 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&texels[i]), _mm_shuffle_epi8(data, shuffle_low));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&texels[i + 4]), _mm_shuffle_epi8(data, shuffle_high));
+    }
+}
+#endif
 
-                BitField<56, 3, s64> dr;
-                BitField<59, 5, u64> r;
-            } differential;
+/**
+ * Decodes the 64 texels of an 8x8 tile in the order they are stored in, i.e. indexed by their
+ * Morton offset within the tile.
+ */
+static void DecodeTile(const u8* source, Regs::TextureFormat format, Math::Vec4<u8> (&texels)[64]) {
+    switch (format) {
+    case Regs::TextureFormat::RGBA8:
+#ifdef HAVE_SSSE3_KERNELS
+        if (cpu_info.bSSSE3) {
+            DecodeTileRGBA8_SSSE3(source, texels);
+            break;
+        }
+#endif
+        for (int i = 0; i < 64; ++i)
+            texels[i] = Color::DecodeRGBA8(source + i * 4);
+        break;
 
-            union {
-                BitField<40, 4, u64> b2;
-                BitField<44, 4, u64> b1;
+    case Regs::TextureFormat::RGB8:
+    {
+        int i = 0;
+#ifdef HAVE_SSSE3_KERNELS
+        if (cpu_info.bSSSE3) {
+            DecodeTileRGB8_SSSE3(source, texels);
+            i = 60;
+        }
+#endif
+        for (; i < 64; ++i)
+            texels[i] = Color::DecodeRGB8(source + i * 3);
+        break;
+    }
 
-                BitField<48, 4, u64> g2;
-                BitField<52, 4, u64> g1;
+    case Regs::TextureFormat::RGB5A1:
+        for (int i = 0; i < 64; ++i)
+            texels[i] = Color::DecodeRGB5A1(source + i * 2);
+        break;
 
-                BitField<56, 4, u64> r2;
-                BitField<60, 4, u64> r1;
-            } separate;
+    case Regs::TextureFormat::RGB565:
+        for (int i = 0; i < 64; ++i)
+            texels[i] = Color::DecodeRGB565(source + i * 2);
+        break;
 
-            const Math::Vec3<u8> GetRGB(int x, int y) const {
-                int texel = 4 * x + y;
+    case Regs::TextureFormat::RGBA4:
+        for (int i = 0; i < 64; ++i)
+            texels[i] = Color::DecodeRGBA4(source + i * 2);
+        break;
 
-                if (flip)
-                    std::swap(x, y);
+    case Regs::TextureFormat::IA8:
+#ifdef HAVE_SSSE3_KERNELS
+        if (cpu_info.bSSSE3) {
+            DecodeTileIA8_SSSE3(source, texels);
+            break;
+        }
+#endif
+        for (int i = 0; i < 64; ++i) {
+            const u8* source_ptr = source + i * 2;
+            texels[i] = { source_ptr[1], source_ptr[1], source_ptr[1], source_ptr[0] };
+        }
+        break;
 
-                // Lookup base value
-                Math::Vec3<int> ret;
-                if (differential_mode) {
-                    ret.r() = differential.r;
-                    ret.g() = differential.g;
-                    ret.b() = differential.b;
-                    if (x >= 2) {
-                        ret.r() += differential.dr;
-                        ret.g() += differential.dg;
-                        ret.b() += differential.db;
-                    }
-                    ret.r() = Color::Convert5To8(ret.r());
-                    ret.g() = Color::Convert5To8(ret.g());
-                    ret.b() = Color::Convert5To8(ret.b());
-                } else {
-                    if (x < 2) {
-                        ret.r() = Color::Convert4To8(separate.r1);
-                        ret.g() = Color::Convert4To8(separate.g1);
-                        ret.b() = Color::Convert4To8(separate.b1);
-                    } else {
-                        ret.r() = Color::Convert4To8(separate.r2);
-                        ret.g() = Color::Convert4To8(separate.g2);
-                        ret.b() = Color::Convert4To8(separate.b2);
-                    }
-                }
+    case Regs::TextureFormat::I8:
+        for (int i = 0; i < 64; ++i)
+            texels[i] = { source[i], source[i], source[i], 255 };
+        break;
 
-                // Add modifier
-                unsigned table_index = (x < 2) ? table_index_1.Value() : table_index_2.Value();
+    case Regs::TextureFormat::A8:
+        for (int i = 0; i < 64; ++i)
+            texels[i] = { 0, 0, 0, source[i] };
+        break;
 
-                static const std::array<std::array<u8, 2>, 8> etc1_modifier_table = {{
-                    {  2,  8 }, {  5, 17 }, {  9,  29 }, { 13,  42 },
-                    { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
-                }};
+    case Regs::TextureFormat::IA4:
+        for (int i = 0; i < 64; ++i) {
+            u8 intensity = Color::Convert4To8((source[i] & 0xF0) >> 4);
+            u8 alpha = Color::Convert4To8(source[i] & 0xF);
+            texels[i] = { intensity, intensity, intensity, alpha };
+        }
+        break;
 
-                int modifier = etc1_modifier_table.at(table_index).at(GetTableSubIndex(texel));
-                if (GetNegationFlag(texel))
-                    modifier *= -1;
+    case Regs::TextureFormat::I4:
+        for (int i = 0; i < 64; i += 2) {
+            u8 low = Color::Convert4To8(source[i / 2] & 0xF);
+            u8 high = Color::Convert4To8((source[i / 2] & 0xF0) >> 4);
+            texels[i] = { low, low, low, 255 };
+            texels[i + 1] = { high, high, high, 255 };
+        }
+        break;
 
-                ret.r() = MathUtil::Clamp(ret.r() + modifier, 0, 255);
-                ret.g() = MathUtil::Clamp(ret.g() + modifier, 0, 255);
-                ret.b() = MathUtil::Clamp(ret.b() + modifier, 0, 255);
+    case Regs::TextureFormat::A4:
+        for (int i = 0; i < 64; i += 2) {
+            texels[i] = { 0, 0, 0, Color::Convert4To8(source[i / 2] & 0xF) };
+            texels[i + 1] = { 0, 0, 0, Color::Convert4To8((source[i / 2] & 0xF0) >> 4) };
+        }
+        break;
 
-                return ret.Cast<u8>();
+    case Regs::TextureFormat::ETC1:
+    case Regs::TextureFormat::ETC1A4:
+    {
+        bool has_alpha = (format == Regs::TextureFormat::ETC1A4);
+
+        // The four 4x4 subtiles are stored in the same order as the texels of a 2x2 tile, so
+        // texel (x, y) of subtile n has the Morton offset n * 16 + MortonInterleave(x, y)
+        const u64* source_ptr = reinterpret_cast<const u64*>(source);
+        for (int subtile = 0; subtile < 4; ++subtile) {
+            u64 alpha = 0xFFFFFFFFFFFFFFFF;
+            if (has_alpha) {
+                alpha = *source_ptr;
+                source_ptr++;
             }
-        } const *etc1_tile = reinterpret_cast<const ETC1Tile*>(source_ptr);
 
-        alpha >>= 4 * ((x & 3) * 4 + (y & 3));
-        return Math::MakeVec(etc1_tile->GetRGB(x & 3, y & 3),
-                             disable_alpha ? (u8)255 : Color::Convert4To8(alpha & 0xF));
+            Math::Vec3<u8> rgb[16];
+            reinterpret_cast<const ETC1Tile*>(source_ptr)->DecodeAll(rgb);
+            source_ptr++;
+
+            for (unsigned y = 0; y < 4; ++y) {
+                for (unsigned x = 0; x < 4; ++x) {
+                    u8 a = Color::Convert4To8((alpha >> (4 * (x * 4 + y))) & 0xF);
+                    texels[subtile * 16 + VideoCore::MortonInterleave(x, y)] = Math::MakeVec(rgb[x + 4 * y], a);
+                }
+            }
+        }
+        break;
     }
 
     default:
-        LOG_ERROR(HW_GPU, "Unknown texture format: %x", (u32)info.format);
+        LOG_ERROR(HW_GPU, "Unknown texture format: %x", (u32)format);
         DEBUG_ASSERT(false);
-        return {};
+        std::fill(std::begin(texels), std::end(texels), Math::Vec4<u8>(0, 0, 0, 0));
+        break;
+    }
+}
+
+/// Textures of at least this many texels are decoded in parallel
+static const int PARALLEL_DECODE_MIN_TEXELS = 128 * 128;
+/// Texels decoded by each of the threads decoding a texture in parallel, at least
+static const int PARALLEL_DECODE_RANGE_TEXELS = 64 * 64;
+
+void DecodeTexture(const u8* source, const TextureInfo& info, Math::Vec4<u8>* dest) {
+    // TODO: Assert that width/height are multiples of block dimensions
+    DEBUG_ASSERT(info.width % 8 == 0 && info.height % 8 == 0);
+
+    // The decoded tiles are copied into the texture as 4 byte pixels
+    static_assert(sizeof(Math::Vec4<u8>) == 4, "Math::Vec4<u8> is expected to be packed");
+
+    // Tiles are stored one after another, row by row. Like in LookupTexture, ETC textures ignore
+    // the stride.
+    const unsigned tile_bytes = 64 * Regs::NibblesPerPixel(info.format) / 2;
+    const bool is_etc = (info.format == Regs::TextureFormat::ETC1 ||
+                         info.format == Regs::TextureFormat::ETC1A4);
+    const unsigned row_bytes = is_etc ? tile_bytes * (info.width / 8) : info.stride * 8;
+
+    const auto decode_rows = [&](unsigned first_row, unsigned last_row) {
+        Math::Vec4<u8> texels[64];
+        for (int y = first_row * 8; y < (int)last_row * 8; y += 8) {
+            const u8* tile_source = source + (y / 8) * row_bytes;
+            for (int x = 0; x < info.width; x += 8) {
+                DecodeTile(tile_source, info.format, texels);
+                tile_source += tile_bytes;
+
+                VideoCore::LinearFromTile(reinterpret_cast<u8*>(dest + x + y * info.width), info.width * sizeof(Math::Vec4<u8>),
+                                          reinterpret_cast<const u8*>(texels), sizeof(Math::Vec4<u8>));
+            }
+        }
+    };
+
+    // Large textures are decoded by several threads, a few rows of tiles each
+    const unsigned num_rows = info.height / 8;
+    if (info.width * info.height >= PARALLEL_DECODE_MIN_TEXELS) {
+        Common::JobSystem::ParallelFor(0, num_rows, PARALLEL_DECODE_RANGE_TEXELS / (info.width * 8), decode_rows);
+    } else {
+        decode_rows(0, num_rows);
     }
 }
 
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <condition_variable>
 #include <list>
 #include <map>
@@ -12,6 +13,7 @@
 #include <mutex>
 #include <vector>
 
+#include "common/instrumented_mutex.h"
 #include "common/vector_math.h"
 
 #include "video_core/pica.h"
@@ -44,14 +46,14 @@ public:
     public:
         /// Constructs the object such that it observes events of the given DebugContext.
         BreakPointObserver(std::shared_ptr<DebugContext> debug_context) : context_weak(debug_context) {
-            std::unique_lock<std::mutex> lock(debug_context->breakpoint_mutex);
+            std::unique_lock<Common::InstrumentedMutex> lock(debug_context->breakpoint_mutex);
             debug_context->breakpoint_observers.push_back(this);
         }
 
         virtual ~BreakPointObserver() {
             auto context = context_weak.lock();
             if (context) {
-                std::unique_lock<std::mutex> lock(context->breakpoint_mutex);
+                std::unique_lock<Common::InstrumentedMutex> lock(context->breakpoint_mutex);
                 context->breakpoint_observers.remove(this);
 
                 // If we are the last observer to be destroyed, tell the debugger context that
@@ -91,6 +93,17 @@ public:
      */
     struct BreakPoint {
         bool enabled = false;
+        /// Records the event in the event log instead of halting
+        bool log_only = false;
+    };
+
+    /// Event recorded by a logging breakpoint
+    struct LoggedEvent {
+        /// Position of the event in the log, counting from the first event ever logged
+        u64 index;
+        Event event;
+        /// Register id for the command events, 0 for the others
+        u32 payload;
     };
 
     /**
@@ -104,11 +117,15 @@ public:
      * Used by the emulation core when a given event has happened. If a breakpoint has been set
      * for this event, OnEvent calls the event handlers of the registered breakpoint observers.
      * The current thread then is halted until Resume() is called from another thread (or until
-     * emulation is stopped).
+     * emulation is stopped). Logging breakpoints only record the event.
      * @param event Event which has happened
      * @param data Optional data pointer (pass nullptr if unused). Needs to remain valid until Resume() is called.
      */
-    void OnEvent(Event event, void* data);
+    void OnEvent(Event event, void* data) {
+        // Events without a breakpoint cost a load and a branch
+        if (armed_events.load(std::memory_order_relaxed) & EventBit(event))
+            HandleEvent(event, data);
+    }
 
     /**
      * Resume from the current breakpoint.
@@ -120,12 +137,35 @@ public:
      * Delete all set breakpoints and resume emulation.
      */
     void ClearBreakpoints() {
-        breakpoints.clear();
+        armed_events = 0;
+        logged_events = 0;
         Resume();
     }
 
+    BreakPoint GetBreakPoint(Event event) const;
+
+    /// Sets the breakpoint of an event, safe to call while the emulation is running
+    void SetBreakPoint(Event event, const BreakPoint& breakpoint);
+
+    /// Whether any breakpoint, logging or not, is enabled. The command processor skips the debugger events otherwise.
+    bool AnyBreakPointArmed() const {
+        return armed_events.load(std::memory_order_relaxed) != 0;
+    }
+
+    /**
+     * Copies the events logged since a position of the log, or since the oldest event still in the
+     * log if that's later. Doesn't block the logging thread.
+     * @return Position to read the next events from
+     */
+    u64 ReadEventLog(u64 since, std::vector<LoggedEvent>& events) const;
+
+    /**
+     * Tells whether a widget showing the framebuffer is visible. Breakpoints only copy the hardware
+     * renderer's framebuffer to emulated memory while one is.
+     */
+    void SetFramebufferViewed(bool viewed);
+
     // TODO: Evaluate if access to these members should be hidden behind a public interface.
-    std::map<Event, BreakPoint> breakpoints;
     Event active_breakpoint;
     bool at_breakpoint = false;
 
@@ -134,13 +174,33 @@ private:
      * Private default constructor to make sure people always construct this through Construct()
      * instead.
      */
-    DebugContext() = default;
+    DebugContext();
+
+    static u32 EventBit(Event event) {
+        return 1u << static_cast<u32>(event);
+    }
+
+    /// Slow path of OnEvent, for events with a breakpoint
+    void HandleEvent(Event event, void* data);
+
+    /// Events with an enabled breakpoint, and those of them which only log
+    std::atomic<u32> armed_events{0};
+    std::atomic<u32> logged_events{0};
+
+    static const size_t EVENT_LOG_SIZE = 4096;
+
+    /// Ring buffer of logged events, written by the thread the events happen on only
+    std::array<LoggedEvent, EVENT_LOG_SIZE> event_log;
+    /// Number of events ever logged, the next one goes to event_log[event_log_end % EVENT_LOG_SIZE]
+    std::atomic<u64> event_log_end{0};
+
+    std::atomic<int> framebuffer_viewers{0};
 
     /// Mutex protecting current breakpoint state and the observer list.
-    std::mutex breakpoint_mutex;
+    Common::InstrumentedMutex breakpoint_mutex;
 
     /// Used by OnEvent to wait for resumption.
-    std::condition_variable resume_from_breakpoint;
+    std::condition_variable_any resume_from_breakpoint;
 
     /// List of registered observers
     std::list<BreakPointObserver*> breakpoint_observers;
@@ -150,7 +210,10 @@ extern std::shared_ptr<DebugContext> g_debug_context; // TODO: Get rid of this g
 
 namespace DebugUtils {
 
-// Simple utility class for dumping geometry data to an OBJ file
+/**
+ * Simple utility class for dumping geometry data to an OBJ file. Only used when
+ * Settings::values.debug_capture is enabled, since it writes a file for every draw.
+ */
 class GeometryDumper {
 public:
     struct Vertex {
@@ -170,6 +233,7 @@ private:
     std::vector<Face> faces;
 };
 
+/// Writes the given shader to a new shbin file, to be used only when debug capture is enabled
 void DumpShader(const u32* binary_data, u32 binary_size, const u32* swizzle_data, u32 swizzle_size,
                 u32 main_offset, const Regs::VSOutputAttributes* output_attributes);
 
@@ -190,6 +254,17 @@ struct PicaTrace {
 
 void StartPicaTracing();
 bool IsPicaTracing();
+
+/**
+ * Called by the command processor before each command list. Whether the writes of a command list
+ * are traced is only decided here, so that OnPicaRegWrite needs no synchronization.
+ * @return True if the register writes of the command list are to be passed to OnPicaRegWrite
+ */
+bool BeginPicaTraceCommandList();
+
+/// Called by the command processor after each command list BeginPicaTraceCommandList returned true for
+void EndPicaTraceCommandList();
+
 void OnPicaRegWrite(u32 id, u32 value);
 std::unique_ptr<PicaTrace> FinishPicaTracing();
 
@@ -215,6 +290,15 @@ struct TextureInfo {
 const Math::Vec4<u8> LookupTexture(const u8* source, int s, int t, const TextureInfo& info,
                                    bool disable_alpha = false);
 
+/**
+ * Decodes a whole texture one 8x8 tile at a time, giving the same texels as calling LookupTexture
+ * for each of them but much faster.
+ * @param source Source pointer to read data from
+ * @param info TextureInfo object describing the texture setup
+ * @param dest Receives info.width * info.height texels, the one at (s, t) at index s + t * info.width
+ */
+void DecodeTexture(const u8* source, const TextureInfo& info, Math::Vec4<u8>* dest);
+
 void DumpTexture(const Pica::Regs::TextureConfig& texture_config, u8* data);
 
 void DumpTevStageConfig(const std::array<Pica::Regs::TevStageConfig,6>& stages);
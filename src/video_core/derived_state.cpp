@@ -0,0 +1,208 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <new>
+#include <utility>
+
+#include "derived_state.h"
+#include "pica.h"
+#include "vertex_loader.h"
+#include "vertex_shader.h"
+
+namespace Pica {
+
+namespace DerivedState {
+
+static void AddToGroup(std::array<u8, NUM_REGISTERS>& groups, size_t first, size_t count, Group group) {
+    for (size_t id = first; id < first + count; ++id)
+        groups[id] |= group;
+}
+
+static std::array<u8, NUM_REGISTERS> BuildRegisterGroups() {
+    std::array<u8, NUM_REGISTERS> groups = {};
+
+#define ADD_FIELD(field_name, index, group) \
+    AddToGroup(groups, PICA_REG_INDEX_WORKAROUND(field_name, index), sizeof(Regs().field_name) / sizeof(u32), group)
+
+    ADD_FIELD(viewport_size_x, 0x41, GROUP_VIEWPORT);
+    ADD_FIELD(viewport_size_y, 0x43, GROUP_VIEWPORT);
+    ADD_FIELD(viewport_depth_range, 0x4d, GROUP_VIEWPORT);
+    ADD_FIELD(viewport_depth_far_plane, 0x4e, GROUP_VIEWPORT);
+    ADD_FIELD(viewport_corner, 0x68, GROUP_VIEWPORT);
+
+    ADD_FIELD(texture0_enable, 0x80, GROUP_TEXTURES);
+    ADD_FIELD(texture0, 0x81, GROUP_TEXTURES);
+    ADD_FIELD(texture0_format, 0x8e, GROUP_TEXTURES);
+    ADD_FIELD(texture1, 0x91, GROUP_TEXTURES);
+    ADD_FIELD(texture1_format, 0x96, GROUP_TEXTURES);
+    ADD_FIELD(texture2, 0x99, GROUP_TEXTURES);
+    ADD_FIELD(texture2_format, 0x9e, GROUP_TEXTURES);
+
+    ADD_FIELD(tev_stage0, 0xc0, GROUP_TEV_STAGES);
+    ADD_FIELD(tev_stage1, 0xc8, GROUP_TEV_STAGES);
+    ADD_FIELD(tev_stage2, 0xd0, GROUP_TEV_STAGES);
+    ADD_FIELD(tev_stage3, 0xd8, GROUP_TEV_STAGES);
+    ADD_FIELD(tev_stage4, 0xf0, GROUP_TEV_STAGES);
+    ADD_FIELD(tev_stage5, 0xf8, GROUP_TEV_STAGES);
+
+    ADD_FIELD(framebuffer, 0x110, GROUP_FRAMEBUFFER);
+
+    ADD_FIELD(vs_output_attributes, 0x50, GROUP_OUTPUT_LAYOUT);
+
+    ADD_FIELD(vertex_attributes, 0x200, GROUP_VERTEX_LAYOUT);
+
+#undef ADD_FIELD
+
+    return groups;
+}
+
+const std::array<u8, NUM_REGISTERS> register_groups = BuildRegisterGroups();
+
+u8 dirty_groups = GROUP_ALL;
+
+static Viewport viewport;
+static std::array<Regs::FullTextureConfig, 3> textures;
+static std::array<Regs::TevStageConfig, 6> tev_stages;
+static Framebuffer framebuffer;
+static OutputLayout output_layout;
+static VertexLoader vertex_loader;
+
+/// BitFields can't be assigned to, so decoded register copies are constructed in place again
+template <typename T>
+static void Reconstruct(T& object, const T& value) {
+    object.~T();
+    new (&object) T(value);
+}
+
+/// Returns whether a group is dirty, and considers it decoded from then on
+static bool TakeDirty(Group group) {
+    if (!(dirty_groups & group))
+        return false;
+    dirty_groups &= ~group;
+    return true;
+}
+
+void Invalidate() {
+    dirty_groups = GROUP_ALL;
+}
+
+/// Largest window coordinate the software rasterizer handles. Its 12.4 fixed-point edge functions
+/// multiply two coordinates, which doesn't overflow for coordinates below 2048 pixels. One pixel
+/// is left for float24 rounding errors.
+static const float GUARD_BAND_LIMIT = 2047.0f;
+
+/// Normalized device coordinates which are mapped to window coordinates 0 and GUARD_BAND_LIMIT
+static void GetGuardBand(float halfsize, float offset, float24& min, float24& max) {
+    if (halfsize == 0.0f) {
+        min = float24::FromFloat32(-1.0f);
+        max = float24::FromFloat32(1.0f);
+        return;
+    }
+
+    const float center = offset + halfsize;
+    const float bound0 = -center / halfsize;
+    const float bound1 = (GUARD_BAND_LIMIT - center) / halfsize;
+    min = float24::FromFloat32(std::min(bound0, bound1));
+    max = float24::FromFloat32(std::max(bound0, bound1));
+}
+
+const Viewport& GetViewport() {
+    if (TakeDirty(GROUP_VIEWPORT)) {
+        const auto& regs = g_state.regs;
+        viewport.halfsize_x = float24::FromRawFloat24(regs.viewport_size_x);
+        viewport.halfsize_y = float24::FromRawFloat24(regs.viewport_size_y);
+        viewport.offset_x   = float24::FromFloat32(static_cast<float>(regs.viewport_corner.x));
+        viewport.offset_y   = float24::FromFloat32(static_cast<float>(regs.viewport_corner.y));
+        viewport.zscale     = float24::FromRawFloat24(regs.viewport_depth_range);
+        viewport.offset_z   = float24::FromRawFloat24(regs.viewport_depth_far_plane);
+
+        GetGuardBand(viewport.halfsize_x.ToFloat32(), viewport.offset_x.ToFloat32(),
+                     viewport.guard_band_min_x, viewport.guard_band_max_x);
+        GetGuardBand(viewport.halfsize_y.ToFloat32(), viewport.offset_y.ToFloat32(),
+                     viewport.guard_band_min_y, viewport.guard_band_max_y);
+    }
+    return viewport;
+}
+
+const std::array<Regs::FullTextureConfig, 3>& GetTextures() {
+    if (TakeDirty(GROUP_TEXTURES))
+        Reconstruct(textures, g_state.regs.GetTextures());
+    return textures;
+}
+
+const std::array<Regs::TevStageConfig, 6>& GetTevStages() {
+    if (TakeDirty(GROUP_TEV_STAGES))
+        Reconstruct(tev_stages, g_state.regs.GetTevStages());
+    return tev_stages;
+}
+
+const Framebuffer& GetFramebuffer() {
+    if (TakeDirty(GROUP_FRAMEBUFFER)) {
+        const auto& config = g_state.regs.framebuffer;
+        framebuffer.color_address = config.GetColorBufferPhysicalAddress();
+        framebuffer.depth_address = config.GetDepthBufferPhysicalAddress();
+        framebuffer.width = config.GetWidth();
+        framebuffer.height = config.GetHeight();
+        framebuffer.color_bytes_per_pixel = Regs::BytesPerColorPixel(config.color_format);
+        framebuffer.depth_bytes_per_pixel = Regs::BytesPerDepthPixel(config.depth_format);
+    }
+    return framebuffer;
+}
+
+const OutputLayout& GetOutputLayout() {
+    using VertexShader::OutputVertex;
+
+    if (TakeDirty(GROUP_OUTPUT_LAYOUT)) {
+        // Slots of the attributes which are interpolated, as bit masks
+        static const std::pair<u32, u32> attribute_slots[] = {
+            { OutputVertex::ATTRIBUTE_COLOR, 0xF << 8 },
+            { OutputVertex::ATTRIBUTE_TC0,   0x3 << 12 },
+            { OutputVertex::ATTRIBUTE_TC1,   0x3 << 14 },
+            { OutputVertex::ATTRIBUTE_TC2,   0x3 << 22 },
+        };
+
+        // TODO(neobrain): Under some circumstances, up to 16 attributes may be output. We need to
+        // figure out what those circumstances are and enable the remaining outputs then.
+        u32 written_slots = 0;
+        output_layout.num_outputs = 0;
+        for (u8 i = 0; i < 7; ++i) {
+            const auto& output_register_map = g_state.regs.vs_output_attributes[i];
+            const u32 semantics[4] = {
+                output_register_map.map_x, output_register_map.map_y,
+                output_register_map.map_z, output_register_map.map_w
+            };
+
+            for (u8 comp = 0; comp < 4; ++comp) {
+                if (semantics[comp] >= output_layout.unused_slots.size())
+                    continue;
+                output_layout.outputs[output_layout.num_outputs++] = { i, comp, static_cast<u8>(semantics[comp]) };
+                written_slots |= 1 << semantics[comp];
+            }
+        }
+
+        output_layout.num_unused_slots = 0;
+        for (u8 slot = 0; slot < output_layout.unused_slots.size(); ++slot) {
+            if (!(written_slots & (1 << slot)))
+                output_layout.unused_slots[output_layout.num_unused_slots++] = slot;
+        }
+
+        output_layout.attributes = 0;
+        for (const auto& attribute : attribute_slots) {
+            if (written_slots & attribute.second)
+                output_layout.attributes |= attribute.first;
+        }
+    }
+    return output_layout;
+}
+
+const VertexLoader& GetVertexLoader() {
+    if (TakeDirty(GROUP_VERTEX_LAYOUT))
+        vertex_loader = VertexLoader(g_state.regs);
+    return vertex_loader;
+}
+
+} // namespace DerivedState
+
+} // namespace Pica
@@ -0,0 +1,120 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+
+#include "common/common_types.h"
+
+#include "pica.h"
+#include "vertex_loader.h"
+
+namespace Pica {
+
+/**
+ * State decoded from the registers into host-friendly structures, read by the software pipeline
+ * and the renderers instead of decoding the same BitFields for every draw, vertex or pixel.
+ * Register writes mark the groups of state decoded from the written register dirty, and each
+ * group is decoded again the next time it is read. Only to be used on the thread processing
+ * command lists, the debugger widgets read the registers themselves.
+ */
+namespace DerivedState {
+
+/// Groups of derived state, each decoded from its own set of registers
+enum Group : u8 {
+    GROUP_VIEWPORT      = 1 << 0,
+    GROUP_TEXTURES      = 1 << 1,
+    GROUP_TEV_STAGES    = 1 << 2,
+    GROUP_FRAMEBUFFER   = 1 << 3,
+    GROUP_VERTEX_LAYOUT = 1 << 4,
+    GROUP_OUTPUT_LAYOUT = 1 << 5,
+
+    GROUP_ALL           = (1 << 6) - 1,
+};
+
+/// Transform from normalized device coordinates to window coordinates
+struct Viewport {
+    float24 halfsize_x;
+    float24 halfsize_y;
+    float24 offset_x;
+    float24 offset_y;
+    float24 zscale;
+    float24 offset_z;
+
+    /**
+     * Guard band: range of normalized device coordinates whose window coordinates still fit into
+     * the software rasterizer's fixed-point format. Only primitives reaching beyond it need to be
+     * clipped in x and y, the rasterizer skips pixels outside of the viewport by itself.
+     */
+    float24 guard_band_min_x;
+    float24 guard_band_max_x;
+    float24 guard_band_min_y;
+    float24 guard_band_max_y;
+};
+
+/// Buffers drawn to, as set up by the framebuffer registers
+struct Framebuffer {
+    PAddr color_address;
+    PAddr depth_address;
+    u32 width;
+    u32 height;
+    u32 color_bytes_per_pixel;
+    u32 depth_bytes_per_pixel;
+};
+
+/// Where the components of the vertex shader output registers go in VertexShader::OutputVertex
+struct OutputLayout {
+    struct Output {
+        u8 register_index;
+        u8 component;
+        /// Index of the float24 in the output vertex
+        u8 slot;
+    };
+
+    /// Components which are output, in register order
+    std::array<Output, 7 * 4> outputs;
+    u32 num_outputs;
+
+    /// Slots of the shader outputs no component is written to, zeroed so that they don't hold denormals
+    std::array<u8, 24> unused_slots;
+    u32 num_unused_slots;
+
+    /// Attributes the shader outputs, as a mask of VertexShader::OutputVertex::Attribute. The
+    /// clipper and rasterizer only interpolate these.
+    u32 attributes;
+};
+
+const size_t NUM_REGISTERS = sizeof(Regs) / sizeof(u32);
+
+/// Groups decoded from each register, by register id
+extern const std::array<u8, NUM_REGISTERS> register_groups;
+
+/// Groups which have to be decoded again before they are read
+extern u8 dirty_groups;
+
+/// Marks the state decoded from a register dirty, to be called after the register is written
+inline void NotifyRegisterWritten(u32 id) {
+    dirty_groups |= register_groups[id];
+}
+
+/// Marks all state dirty, after the registers have been replaced as a whole
+void Invalidate();
+
+const Viewport& GetViewport();
+
+const std::array<Regs::FullTextureConfig, 3>& GetTextures();
+
+const std::array<Regs::TevStageConfig, 6>& GetTevStages();
+
+const Framebuffer& GetFramebuffer();
+
+const OutputLayout& GetOutputLayout();
+
+/// Attribute loaders of the vertex attribute registers, with their host pointers resolved
+const VertexLoader& GetVertexLoader();
+
+} // namespace DerivedState
+
+} // namespace Pica
@@ -0,0 +1,139 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/instrumented_mutex.h"
+#include "common/logging/log.h"
+#include "common/make_unique.h"
+#include "common/thread_policy.h"
+
+#include "core/settings.h"
+
+#include "video_core/gpu_thread.h"
+
+namespace GPUThread {
+
+static std::unique_ptr<std::thread> gpu_thread;
+static std::thread::id gpu_thread_id;
+
+static Common::LockStats queue_lock_stats("GPU thread queue");
+static Common::InstrumentedMutex mutex(queue_lock_stats);
+static std::condition_variable_any work_available;
+static std::condition_variable_any work_done;
+/// Work not taken by the GPU thread yet, in submission order. Swapped with the GPU thread's batch,
+/// both keep their capacity so that queueing work doesn't allocate once they've grown.
+static std::vector<std::function<void()>> work_queue;
+/// Number of work items queued and finished since the thread was started
+static u64 submitted_work = 0;
+static u64 finished_work = 0;
+static bool stopping = false;
+
+static void ThreadLoop(std::function<void()> init) {
+    Common::RegisterCurrentThread("GPUThread", Common::ThreadClass::GPU);
+    init();
+
+    // Take the whole queue at once so that the CPU thread isn't held up while the work runs
+    std::vector<std::function<void()>> batch;
+    std::unique_lock<Common::InstrumentedMutex> lock(mutex);
+    while (true) {
+        work_available.wait(lock, [] { return !work_queue.empty() || stopping; });
+        if (work_queue.empty())
+            break;
+
+        batch.swap(work_queue);
+        lock.unlock();
+        for (auto& work : batch)
+            work();
+        lock.lock();
+
+        finished_work += batch.size();
+        batch.clear();
+        work_done.notify_all();
+    }
+}
+
+void Init(std::function<void()> init) {
+    if (!Settings::values.use_gpu_thread) {
+        init();
+        return;
+    }
+
+    stopping = false;
+    submitted_work = 0;
+    finished_work = 0;
+    gpu_thread = Common::make_unique<std::thread>(ThreadLoop, init);
+    gpu_thread_id = gpu_thread->get_id();
+
+    // Everything else expects the renderer to be set up once the video core is initialized
+    Run([] {});
+    WaitIdle();
+
+    LOG_INFO(HW_GPU, "Video core runs on a separate thread");
+}
+
+void Shutdown(std::function<void()> shutdown) {
+    if (!IsEnabled()) {
+        shutdown();
+        return;
+    }
+
+    Run(shutdown);
+    {
+        std::lock_guard<Common::InstrumentedMutex> lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_one();
+    gpu_thread->join();
+    gpu_thread.reset();
+    gpu_thread_id = std::thread::id();
+}
+
+u64 Run(std::function<void()> work) {
+    if (!IsEnabled() || IsCurrentThread()) {
+        work();
+        return 0;
+    }
+
+    u64 sequence;
+    {
+        std::lock_guard<Common::InstrumentedMutex> lock(mutex);
+        work_queue.push_back(std::move(work));
+        sequence = ++submitted_work;
+    }
+    work_available.notify_one();
+    return sequence;
+}
+
+void WaitFor(u64 sequence) {
+    if (!IsEnabled() || IsCurrentThread())
+        return;
+
+    std::unique_lock<Common::InstrumentedMutex> lock(mutex);
+    work_done.wait(lock, [sequence] { return finished_work >= sequence; });
+}
+
+void WaitIdle() {
+    if (!IsEnabled() || IsCurrentThread())
+        return;
+
+    std::unique_lock<Common::InstrumentedMutex> lock(mutex);
+    const u64 sequence = submitted_work;
+    work_done.wait(lock, [sequence] { return finished_work >= sequence; });
+}
+
+bool IsEnabled() {
+    return gpu_thread != nullptr;
+}
+
+bool IsCurrentThread() {
+    return std::this_thread::get_id() == gpu_thread_id;
+}
+
+} // namespace
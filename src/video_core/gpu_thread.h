@@ -0,0 +1,49 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <functional>
+
+#include "common/common_types.h"
+
+/**
+ * Optional thread running the video core next to the emulated CPU. Command lists, DMAs, memory
+ * fills and display transfers are queued in submission order and the CPU learns about their
+ * completion through the GPU interrupts, like on the real hardware. While the thread is disabled
+ * all work runs right away on the calling thread.
+ */
+namespace GPUThread {
+
+/**
+ * Starts the GPU thread if it is enabled in the settings
+ * @param init Video core initialization, run on the thread that is going to own the renderer
+ */
+void Init(std::function<void()> init);
+
+/**
+ * Finishes all queued work and stops the GPU thread
+ * @param shutdown Video core shutdown, run on the thread that owns the renderer
+ */
+void Shutdown(std::function<void()> shutdown);
+
+/**
+ * Runs work on the GPU thread after everything queued before it, or right away if it is disabled
+ * @return Sequence number to wait for the work with, 0 if it has already been done
+ */
+u64 Run(std::function<void()> work);
+
+/// Blocks until the work with the given sequence number and everything before it has finished
+void WaitFor(u64 sequence);
+
+/// Blocks until all work queued so far has finished
+void WaitIdle();
+
+/// Whether the video core runs on a thread of its own
+bool IsEnabled();
+
+/// Whether the calling thread is the GPU thread
+bool IsCurrentThread();
+
+} // namespace
@@ -4,7 +4,12 @@
 
 #pragma once
 
+#include <cstddef>
+
 #include "common/emu_window.h"
+
+#include "core/hw/gpu.h"
+
 #include "video_core/vertex_shader.h"
 
 class HWRasterizer {
@@ -18,12 +23,23 @@ public:
     /// Reset the rasterizer, such as flushing all caches and updating all state
     virtual void Reset() = 0;
 
-    /// Queues the primitive formed by the given vertices for rendering
-    virtual void AddTriangle(const Pica::VertexShader::OutputVertex& v0,
-                             const Pica::VertexShader::OutputVertex& v1,
-                             const Pica::VertexShader::OutputVertex& v2) = 0;
+    /**
+     * Starts queueing the vertices and triangles of a draw. The PICA registers don't change until
+     * DrawTriangles is called.
+     * @param max_vertices Upper bound of the number of vertices added, which also bounds the number of triangles
+     */
+    virtual void BeginTriangles(u32 max_vertices) = 0;
+
+    /**
+     * Queues shaded vertices, converting them to the format they are drawn from
+     * @return Index of the first of the vertices for AddTriangle, the others follow consecutively
+     */
+    virtual u32 AddVertices(const Pica::VertexShader::OutputVertex* vertices, size_t count) = 0;
 
-    /// Draw the current batch of triangles
+    /// Queues the triangle formed by the queued vertices with the given indices for rendering
+    virtual void AddTriangle(u32 v0, u32 v1, u32 v2) = 0;
+
+    /// Draw the triangles queued since BeginTriangles
     virtual void DrawTriangles() = 0;
 
     /// Commit the rasterizer's framebuffer contents immediately to the current 3DS memory framebuffer
@@ -32,9 +48,50 @@ public:
     /// Notify rasterizer that the specified PICA register has been changed
     virtual void NotifyPicaRegisterChanged(u32 id) = 0;
 
+    /// Notify rasterizer that a command list has been processed completely
+    virtual void NotifyCommandListProcessed() = 0;
+
     /// Notify rasterizer that the specified 3DS memory region will be read from after this notification
     virtual void NotifyPreRead(PAddr addr, u32 size) = 0;
 
     /// Notify rasterizer that a 3DS memory region has been changed
     virtual void NotifyFlush(PAddr addr, u32 size) = 0;
+
+    /**
+     * Starts a batch of notifications, during which the rasterizer may defer the work of NotifyFlush
+     * and apply it once for the merged regions, by EndNotifyBatch at the latest. Anything reading
+     * the rasterizer's copies of flushed regions in the meantime still sees them flushed.
+     */
+    virtual void BeginNotifyBatch() {
+    }
+
+    /// Ends the batch of notifications started by BeginNotifyBatch, applying the deferred flushes
+    virtual void EndNotifyBatch() {
+    }
+
+    /**
+     * Performs the current draw with the vertex shader running on the host GPU, reading the vertex
+     * attributes straight from 3DS memory, if the rasterizer supports the shader program
+     * @param is_indexed Whether the draw was triggered as an indexed one
+     * @return True if the draw is done, false if its vertices have to be processed on the CPU
+     */
+    virtual bool AccelerateDrawBatch(bool is_indexed) {
+        return false;
+    }
+
+    /**
+     * Performs a display transfer without going through 3DS memory, if the rasterizer holds its input
+     * @return True if the transfer is done, including the notification of changes to its output region
+     */
+    virtual bool AccelerateDisplayTransfer(const GPU::Regs::DisplayTransferConfig& config) {
+        return false;
+    }
+
+    /**
+     * Performs a memory fill without going through 3DS memory, if the rasterizer holds the filled region
+     * @return True if the fill is done, the region then needs no flush notification
+     */
+    virtual bool AccelerateFill(const GPU::Regs::MemoryFillConfig& config) {
+        return false;
+    }
 };
@@ -4,6 +4,9 @@
 
 #include <string.h>
 
+#include "common/chunk_file.h"
+
+#include "derived_state.h"
 #include "pica.h"
 
 namespace Pica {
@@ -11,10 +14,20 @@ namespace Pica {
 State g_state;
 
 void Init() {
+    DerivedState::Invalidate();
 }
 
 void Shutdown() {
     memset(&g_state, 0, sizeof(State));
+    DerivedState::Invalidate();
+}
+
+void DoState(PointerWrap& p) {
+    p.DoVoid(&g_state.regs, sizeof(g_state.regs));
+    if (p.GetMode() == PointerWrap::MODE_READ)
+        DerivedState::Invalidate();
+    p.DoVoid(&g_state.vs, sizeof(g_state.vs));
+    p.DoMarker("Pica");
 }
 
 }
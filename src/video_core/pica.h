@@ -6,6 +6,7 @@
 
 #include <array>
 #include <cstddef>
+#include <cstring>
 #include <initializer_list>
 #include <map>
 #include <vector>
@@ -17,6 +18,8 @@
 #include "common/logging/log.h"
 #include "common/vector_math.h"
 
+class PointerWrap;
+
 namespace Pica {
 
 // Returns index corresponding to the Regs member labeled by field_name
@@ -194,12 +197,15 @@ struct Regs {
         case TextureFormat::IA8:
             return 4;
 
+        case TextureFormat::I4:
         case TextureFormat::A4:
+        case TextureFormat::ETC1:
             return 1;
 
         case TextureFormat::I8:
         case TextureFormat::A8:
         case TextureFormat::IA4:
+        case TextureFormat::ETC1A4:
         default:  // placeholder for yet unknown formats
             return 2;
         }
@@ -222,9 +228,9 @@ struct Regs {
     INSERT_PADDING_WORDS(0x21);
 
     struct FullTextureConfig {
-        const bool enabled;
-        const TextureConfig config;
-        const TextureFormat format;
+        bool enabled;
+        TextureConfig config;
+        TextureFormat format;
     };
     const std::array<FullTextureConfig, 3> GetTextures() const {
         return {{
@@ -290,6 +296,7 @@ struct Regs {
         };
 
         union {
+            u32 sources_raw;
             BitField< 0, 4, Source> color_source1;
             BitField< 4, 4, Source> color_source2;
             BitField< 8, 4, Source> color_source3;
@@ -299,6 +306,7 @@ struct Regs {
         };
 
         union {
+            u32 modifiers_raw;
             BitField< 0, 4, ColorModifier> color_modifier1;
             BitField< 4, 4, ColorModifier> color_modifier2;
             BitField< 8, 4, ColorModifier> color_modifier3;
@@ -308,11 +316,13 @@ struct Regs {
         };
 
         union {
+            u32 ops_raw;
             BitField< 0, 4, Operation> color_op;
             BitField<16, 4, Operation> alpha_op;
         };
 
         union {
+            u32 const_color;
             BitField< 0, 8, u32> const_r;
             BitField< 8, 8, u32> const_g;
             BitField<16, 8, u32> const_b;
@@ -320,6 +330,7 @@ struct Regs {
         };
 
         union {
+            u32 scales_raw;
             BitField< 0, 2, u32> color_scale;
             BitField<16, 2, u32> alpha_scale;
         };
@@ -1004,21 +1015,30 @@ struct float24 {
         return ret;
     }
 
+    static float24 FromRawFloat32(u32 hex) {
+        float24 ret;
+        std::memcpy(&ret.value, &hex, sizeof(ret.value));
+        return ret;
+    }
+
     // 16 bit mantissa, 7 bit exponent, 1 bit sign
     // TODO: No idea if this works as intended
     static float24 FromRawFloat24(u32 hex) {
-        float24 ret;
-        if ((hex & 0xFFFFFF) == 0) {
-            ret.value = 0;
-        } else {
-            u32 mantissa = hex & 0xFFFF;
-            u32 exponent = (hex >> 16) & 0x7F;
-            u32 sign = hex >> 23;
-            ret.value = powf(2.0f, (float)exponent-63.0f) * (1.0f + mantissa * powf(2.0f, -16.f));
-            if (sign)
-                ret.value = -ret.value;
-        }
-        return ret;
+        return FromRawFloat32(RawFloat24ToRawFloat32(hex));
+    }
+
+    /**
+     * Converts the bits of a float24 to those of the float32 with the same value. Every float24
+     * value is a normal float32, there are no denormals, infinities or NaNs, and only the
+     * all-zero pattern (ignoring the sign) is zero.
+     */
+    static u32 RawFloat24ToRawFloat32(u32 hex) {
+        const u32 sign = (hex & 0x800000) << 8;
+        const u32 exponent = (((hex >> 16) & 0x7F) + 127 - 63) << 23;
+        const u32 mantissa = (hex & 0xFFFF) << 7;
+        // All bits set unless zero, computed without a branch
+        const u32 nonzero_mask = 0u - static_cast<u32>((hex & 0xFFFFFF) != 0);
+        return (sign | exponent | mantissa) & nonzero_mask;
     }
 
     // Not recommended for anything but logging
@@ -1096,6 +1116,16 @@ private:
     float value;
 };
 
+} // namespace
+
+#ifdef DEFINE_VEC4_SSE_OPS
+namespace Math {
+DEFINE_VEC4_SSE_OPS(Pica::float24)
+} // namespace
+#endif
+
+namespace Pica {
+
 /// Struct used to describe current Pica state
 struct State {
     /// Pica registers
@@ -1129,6 +1159,9 @@ void Init();
 /// Shutdown Pica state
 void Shutdown();
 
+/// Saves or restores the registers and shader memory, the command list isn't part of the state
+void DoState(PointerWrap& p);
+
 extern State g_state; ///< Current Pica state
 
 } // namespace
@@ -4,7 +4,9 @@
 
 #pragma once
 
-#include <functional>
+#include <cstddef>
+
+#include "common/logging/log.h"
 
 #include "video_core/pica.h"
 
@@ -18,21 +20,89 @@ namespace Pica {
  */
 template<typename VertexType>
 struct PrimitiveAssembler {
-    using TriangleHandler = std::function<void(VertexType& v0,
-                                               VertexType& v1,
-                                               VertexType& v2)>;
-
     PrimitiveAssembler(Regs::TriangleTopology topology);
 
     /*
      * Queues a vertex, builds primitives from the vertex queue according to the given
      * triangle topology, and calls triangle_handler for each generated primitive.
      * NOTE: We could specify the triangle handler in the constructor, but this way we can
-     * keep event and handler code next to each other.
+     * keep event and handler code next to each other. The handler is called directly, not
+     * through a std::function, so that submitting doesn't allocate.
+     */
+    template<typename Handler>
+    void SubmitVertex(VertexType& vtx, const Handler& triangle_handler) {
+        SubmitVertices(&vtx, 1, triangle_handler);
+    }
+
+    /*
+     * Queues a batch of vertices and calls triangle_handler for each primitive built from them,
+     * in the same order as submitting the vertices one by one. The topology is only looked at
+     * once per batch and the handler is called directly, so lambdas and function pointers can be
+     * inlined into the assembly loop.
      */
-    void SubmitVertex(VertexType& vtx, TriangleHandler triangle_handler);
+    template<typename Handler>
+    void SubmitVertices(VertexType* vertices, size_t count, const Handler& triangle_handler) {
+        switch (topology) {
+            case Regs::TriangleTopology::List:
+            case Regs::TriangleTopology::ListIndexed:
+                AssembleList(vertices, count, triangle_handler);
+                break;
+
+            case Regs::TriangleTopology::Strip:
+                AssembleStripOrFan<true>(vertices, count, triangle_handler);
+                break;
+
+            case Regs::TriangleTopology::Fan:
+                AssembleStripOrFan<false>(vertices, count, triangle_handler);
+                break;
+
+            default:
+                LOG_ERROR(HW_GPU, "Unknown triangle topology %x:", (int)topology);
+                break;
+        }
+    }
 
 private:
+    template<typename Handler>
+    void AssembleList(VertexType* vertices, size_t count, const Handler& triangle_handler) {
+        size_t i = 0;
+
+        // Complete a triangle started by the previous batch
+        for (; i < count && buffer_index != 0; ++i) {
+            if (buffer_index < 2) {
+                buffer[buffer_index++] = vertices[i];
+            } else {
+                buffer_index = 0;
+                triangle_handler(buffer[0], buffer[1], vertices[i]);
+            }
+        }
+
+        // Whole triangles in the batch are passed on without buffering any of their vertices
+        for (; i + 2 < count; i += 3)
+            triangle_handler(vertices[i], vertices[i + 1], vertices[i + 2]);
+
+        for (; i < count; ++i)
+            buffer[buffer_index++] = vertices[i];
+    }
+
+    template<bool is_strip, typename Handler>
+    void AssembleStripOrFan(VertexType* vertices, size_t count, const Handler& triangle_handler) {
+        for (size_t i = 0; i < count; ++i) {
+            if (strip_ready)
+                triangle_handler(buffer[0], buffer[1], vertices[i]);
+
+            buffer[buffer_index] = vertices[i];
+
+            if (is_strip) {
+                strip_ready |= (buffer_index == 1);
+                buffer_index = !buffer_index;
+            } else {
+                buffer_index = 1;
+                strip_ready = true;
+            }
+        }
+    }
+
     Regs::TriangleTopology topology;
 
     int buffer_index;
@@ -3,19 +3,33 @@
 // Refer to the license.txt file included.
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "common/color.h"
 #include "common/common_types.h"
 #include "common/math_util.h"
 #include "common/profiler.h"
+#include "common/job_system.h"
 
 #include "core/hw/gpu.h"
 #include "core/memory.h"
+#include "core/settings.h"
 
 #include "debug_utils/debug_utils.h"
+#include "derived_state.h"
 #include "math.h"
 #include "pica.h"
 #include "rasterizer.h"
+#include "texture_cache.h"
 #include "vertex_shader.h"
 #include "video_core/utils.h"
 
@@ -23,138 +37,209 @@ namespace Pica {
 
 namespace Rasterizer {
 
-static void DrawPixel(int x, int y, const Math::Vec4<u8>& color) {
-    const auto& framebuffer = g_state.regs.framebuffer;
-    const PAddr addr = framebuffer.GetColorBufferPhysicalAddress();
+/**
+ * Color and depth buffers of a draw, resolved from the framebuffer registers once per draw so that
+ * accessing a pixel only has to compute its offset.
+ */
+struct RenderTarget {
+    typedef const Math::Vec4<u8> (*DecodeColorFunc)(const u8* bytes);
+    typedef void (*EncodeColorFunc)(const Math::Vec4<u8>& color, u8* bytes);
+    typedef u32 (*DecodeDepthFunc)(const u8* bytes);
+    typedef void (*EncodeDepthFunc)(u32 value, u8* bytes);
+
+    /// The framebuffer height register, which contains the actual height minus one
+    int height;
+
+    u8* color_buffer;
+    u32 color_bytes_per_pixel;
+    /// Size of a row of pixels in the color buffer
+    u32 color_stride;
+    DecodeColorFunc decode_color;
+    EncodeColorFunc encode_color;
+
+    u8* depth_buffer;
+    u32 depth_bytes_per_pixel;
+    u32 depth_stride;
+    DecodeDepthFunc decode_depth;
+    EncodeDepthFunc encode_depth;
+
+    /// Width of the framebuffer in pixels
+    unsigned width;
+    unsigned num_depth_tiles_x;
+    unsigned num_depth_tiles_y;
+    /**
+     * Hierarchical depth buffer: an upper bound of the depth values in each 8x8 pixel tile of the
+     * depth buffer. A tile's bound is computed when the draw first tests a block inside it and is
+     * raised by the depth writes. Tiles are only accessed by the thread drawing the screen tile
+     * they are part of.
+     */
+    std::vector<u32> tile_max_depth;
+    std::vector<u8> tile_max_depth_valid;
+};
 
-    // Similarly to textures, the render framebuffer is laid out from bottom to top, too.
-    // NOTE: The framebuffer height register contains the actual FB height minus one.
-    y = framebuffer.height - y;
+static u32 DecodeD24S8Depth(const u8* bytes) {
+    return Color::DecodeD24S8(bytes).x;
+}
 
-    const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = GPU::Regs::BytesPerPixel(GPU::Regs::PixelFormat(framebuffer.color_format.Value()));
-    u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * framebuffer.width * bytes_per_pixel;
-    u8* dst_pixel = Memory::GetPhysicalPointer(addr) + dst_offset;
+static void EncodeD24S8Depth(u32 value, u8* bytes) {
+    // TODO(Subv): Implement the stencil buffer
+    Color::EncodeD24S8(value, 0, bytes);
+}
+
+// Stand-ins for the formats that aren't implemented, which are reported once per draw
+static const Math::Vec4<u8> DecodeUnknownColor(const u8* bytes) {
+    return {0, 0, 0, 0};
+}
+
+static void EncodeUnknownColor(const Math::Vec4<u8>& color, u8* bytes) {
+}
+
+static u32 DecodeUnknownDepth(const u8* bytes) {
+    return 0;
+}
+
+static void EncodeUnknownDepth(u32 value, u8* bytes) {
+}
+
+/// Resolves the buffers the current framebuffer registers point to
+static void ResolveRenderTarget(RenderTarget& target) {
+    const auto& framebuffer = g_state.regs.framebuffer;
+    const DerivedState::Framebuffer& buffers = DerivedState::GetFramebuffer();
+    target.height = framebuffer.height;
+
+    target.color_buffer = Memory::GetPhysicalPointer(buffers.color_address);
+    target.color_bytes_per_pixel = buffers.color_bytes_per_pixel;
+    target.color_stride = buffers.width * target.color_bytes_per_pixel;
 
     switch (framebuffer.color_format) {
     case Regs::ColorFormat::RGBA8:
-        Color::EncodeRGBA8(color, dst_pixel);
+        target.decode_color = Color::DecodeRGBA8;
+        target.encode_color = Color::EncodeRGBA8;
         break;
 
     case Regs::ColorFormat::RGB8:
-        Color::EncodeRGB8(color, dst_pixel);
+        target.decode_color = Color::DecodeRGB8;
+        target.encode_color = Color::EncodeRGB8;
         break;
 
     case Regs::ColorFormat::RGB5A1:
-        Color::EncodeRGB5A1(color, dst_pixel);
+        target.decode_color = Color::DecodeRGB5A1;
+        target.encode_color = Color::EncodeRGB5A1;
         break;
 
     case Regs::ColorFormat::RGB565:
-        Color::EncodeRGB565(color, dst_pixel);
+        target.decode_color = Color::DecodeRGB565;
+        target.encode_color = Color::EncodeRGB565;
         break;
 
     case Regs::ColorFormat::RGBA4:
-        Color::EncodeRGBA4(color, dst_pixel);
+        target.decode_color = Color::DecodeRGBA4;
+        target.encode_color = Color::EncodeRGBA4;
         break;
 
     default:
         LOG_CRITICAL(Render_Software, "Unknown framebuffer color format %x", framebuffer.color_format.Value());
         UNIMPLEMENTED();
+        target.decode_color = DecodeUnknownColor;
+        target.encode_color = EncodeUnknownColor;
+        break;
     }
-}
-
-static const Math::Vec4<u8> GetPixel(int x, int y) {
-    const auto& framebuffer = g_state.regs.framebuffer;
-    const PAddr addr = framebuffer.GetColorBufferPhysicalAddress();
-
-    y = framebuffer.height - y;
-
-    const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = GPU::Regs::BytesPerPixel(GPU::Regs::PixelFormat(framebuffer.color_format.Value()));
-    u32 src_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * framebuffer.width * bytes_per_pixel;
-    u8* src_pixel = Memory::GetPhysicalPointer(addr) + src_offset;
 
-    switch (framebuffer.color_format) {
-    case Regs::ColorFormat::RGBA8:
-        return Color::DecodeRGBA8(src_pixel);
-
-    case Regs::ColorFormat::RGB8:
-        return Color::DecodeRGB8(src_pixel);
+    target.depth_buffer = Memory::GetPhysicalPointer(buffers.depth_address);
+    target.depth_bytes_per_pixel = buffers.depth_bytes_per_pixel;
+    target.depth_stride = buffers.width * target.depth_bytes_per_pixel;
 
-    case Regs::ColorFormat::RGB5A1:
-        return Color::DecodeRGB5A1(src_pixel);
+    switch (framebuffer.depth_format) {
+    case Regs::DepthFormat::D16:
+        target.decode_depth = Color::DecodeD16;
+        target.encode_depth = Color::EncodeD16;
+        break;
 
-    case Regs::ColorFormat::RGB565:
-        return Color::DecodeRGB565(src_pixel);
+    case Regs::DepthFormat::D24:
+        target.decode_depth = Color::DecodeD24;
+        target.encode_depth = Color::EncodeD24;
+        break;
 
-    case Regs::ColorFormat::RGBA4:
-        return Color::DecodeRGBA4(src_pixel);
+    case Regs::DepthFormat::D24S8:
+        target.decode_depth = DecodeD24S8Depth;
+        target.encode_depth = EncodeD24S8Depth;
+        break;
 
     default:
-        LOG_CRITICAL(Render_Software, "Unknown framebuffer color format %x", framebuffer.color_format.Value());
+        LOG_CRITICAL(HW_GPU, "Unimplemented depth format %u", framebuffer.depth_format);
         UNIMPLEMENTED();
+        target.decode_depth = DecodeUnknownDepth;
+        target.encode_depth = EncodeUnknownDepth;
+        break;
     }
 
-    return {0, 0, 0, 0};
+    // The depth buffer may have been written since the last draw
+    target.width = buffers.width;
+    target.num_depth_tiles_x = (buffers.width + 7) / 8;
+    target.num_depth_tiles_y = (buffers.height + 7) / 8;
+    const size_t num_tiles = target.num_depth_tiles_x * target.num_depth_tiles_y;
+    target.tile_max_depth.resize(num_tiles);
+    target.tile_max_depth_valid.assign(num_tiles, 0);
 }
 
-static u32 GetDepth(int x, int y) {
-    const auto& framebuffer = g_state.regs.framebuffer;
-    const PAddr addr = framebuffer.GetDepthBufferPhysicalAddress();
-    u8* depth_buffer = Memory::GetPhysicalPointer(addr);
-
-    y = framebuffer.height - y;
+/// Returns the offset of a pixel into a buffer of the render target
+static inline u32 GetPixelOffset(const RenderTarget& target, int x, int y, u32 bytes_per_pixel, u32 stride) {
+    // Similarly to textures, the render framebuffer is laid out from bottom to top, too.
+    y = target.height - y;
 
     const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = Regs::BytesPerDepthPixel(framebuffer.depth_format);
-    u32 stride = framebuffer.width * bytes_per_pixel;
-
-    u32 src_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * stride;
-    u8* src_pixel = depth_buffer + src_offset;
+    return VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * stride;
+}
 
-    switch (framebuffer.depth_format) {
-        case Regs::DepthFormat::D16:
-            return Color::DecodeD16(src_pixel);
-        case Regs::DepthFormat::D24:
-            return Color::DecodeD24(src_pixel);
-        case Regs::DepthFormat::D24S8:
-            return Color::DecodeD24S8(src_pixel).x;
-        default:
-            LOG_CRITICAL(HW_GPU, "Unimplemented depth format %u", framebuffer.depth_format);
-            UNIMPLEMENTED();
-            return 0;
-    }
+static void DrawPixel(const RenderTarget& target, int x, int y, const Math::Vec4<u8>& color) {
+    u32 dst_offset = GetPixelOffset(target, x, y, target.color_bytes_per_pixel, target.color_stride);
+    target.encode_color(color, target.color_buffer + dst_offset);
 }
 
-static void SetDepth(int x, int y, u32 value) {
-    const auto& framebuffer = g_state.regs.framebuffer;
-    const PAddr addr = framebuffer.GetDepthBufferPhysicalAddress();
-    u8* depth_buffer = Memory::GetPhysicalPointer(addr);
+static const Math::Vec4<u8> GetPixel(const RenderTarget& target, int x, int y) {
+    u32 src_offset = GetPixelOffset(target, x, y, target.color_bytes_per_pixel, target.color_stride);
+    return target.decode_color(target.color_buffer + src_offset);
+}
 
-    y = framebuffer.height - y;
+static u32 GetDepth(const RenderTarget& target, int x, int y) {
+    u32 src_offset = GetPixelOffset(target, x, y, target.depth_bytes_per_pixel, target.depth_stride);
+    return target.decode_depth(target.depth_buffer + src_offset);
+}
 
-    const u32 coarse_y = y & ~7;
-    u32 bytes_per_pixel = Regs::BytesPerDepthPixel(framebuffer.depth_format);
-    u32 stride = framebuffer.width * bytes_per_pixel;
+/**
+ * Looks up the hierarchical depth buffer bound of the tile containing the given pixel.
+ * @return false if the tile lies outside of the framebuffer
+ */
+static bool GetTileMaxDepth(RenderTarget& target, int x, int y, u32& max_depth) {
+    const unsigned tile_x = x / 8;
+    const unsigned tile_y = y / 8;
+    if (x < 0 || y < 0 || tile_x >= target.num_depth_tiles_x || tile_y >= target.num_depth_tiles_y)
+        return false;
+
+    const unsigned tile = tile_y * target.num_depth_tiles_x + tile_x;
+    if (!target.tile_max_depth_valid[tile]) {
+        const unsigned height = target.height + 1;
+        u32 tile_max = 0;
+        for (unsigned pixel_y = tile_y * 8; pixel_y < std::min(tile_y * 8 + 8, height); ++pixel_y) {
+            for (unsigned pixel_x = tile_x * 8; pixel_x < std::min(tile_x * 8 + 8, target.width); ++pixel_x)
+                tile_max = std::max(tile_max, GetDepth(target, pixel_x, pixel_y));
+        }
+        target.tile_max_depth[tile] = tile_max;
+        target.tile_max_depth_valid[tile] = 1;
+    }
+    max_depth = target.tile_max_depth[tile];
+    return true;
+}
 
-    u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * stride;
-    u8* dst_pixel = depth_buffer + dst_offset;
+static void SetDepth(RenderTarget& target, int x, int y, u32 value) {
+    u32 dst_offset = GetPixelOffset(target, x, y, target.depth_bytes_per_pixel, target.depth_stride);
+    target.encode_depth(value, target.depth_buffer + dst_offset);
 
-    switch (framebuffer.depth_format) {
-        case Regs::DepthFormat::D16:
-            Color::EncodeD16(value, dst_pixel);
-            break;
-        case Regs::DepthFormat::D24:
-            Color::EncodeD24(value, dst_pixel);
-            break;
-        case Regs::DepthFormat::D24S8:
-            // TODO(Subv): Implement the stencil buffer
-            Color::EncodeD24S8(value, 0, dst_pixel);
-            break;
-        default:
-            LOG_CRITICAL(HW_GPU, "Unimplemented depth format %u", framebuffer.depth_format);
-            UNIMPLEMENTED();
-            break;
+    const unsigned tile_x = x / 8;
+    const unsigned tile_y = y / 8;
+    if (x >= 0 && y >= 0 && tile_x < target.num_depth_tiles_x && tile_y < target.num_depth_tiles_y) {
+        const unsigned tile = tile_y * target.num_depth_tiles_x + tile_x;
+        target.tile_max_depth[tile] = std::max(target.tile_max_depth[tile], value);
     }
 }
 
@@ -193,765 +278,1814 @@ static int SignedArea (const Math::Vec2<Fix12P4>& vtx1,
     return Math::Cross(vec1, vec2).z;
 };
 
-static Common::Profiling::TimingCategory rasterization_category("Rasterization");
+/// Width and height of the blocks of pixels tested against a triangle as a whole, at most 32
+static const int BLOCK_SIZE = 8;
 
 /**
- * Helper function for ProcessTriangle with the "reversed" flag to allow for implementing
- * culling via recursion.
+ * The signed area spanned by a triangle edge and a pixel plus the filling rule bias, i.e. one of
+ * the barycentric coordinates of the pixel. It's linear in the pixel coordinates, so it's set up
+ * once per triangle and then stepped from pixel to pixel.
  */
-static void ProcessTriangleInternal(const VertexShader::OutputVertex& v0,
-                                    const VertexShader::OutputVertex& v1,
-                                    const VertexShader::OutputVertex& v2,
-                                    bool reversed = false)
-{
-    const auto& regs = g_state.regs;
-    Common::Profiling::ScopeTimer timer(rasterization_category);
+struct EdgeFunction {
+    /// @param origin_x,origin_y Center of the pixel the others are addressed relative to
+    EdgeFunction(const Math::Vec2<Fix12P4>& vtx1, const Math::Vec2<Fix12P4>& vtx2, int bias,
+                 u16 origin_x, u16 origin_y)
+        : origin(bias + SignedArea(vtx1, vtx2, { origin_x, origin_y })),
+          step_x(-((int)vtx2.y - (int)vtx1.y) * 0x10),
+          step_y(((int)vtx2.x - (int)vtx1.x) * 0x10) {
+    }
 
-    // vertex positions in rasterizer coordinates
-    static auto FloatToFix = [](float24 flt) {
-        // TODO: Rounding here is necessary to prevent garbage pixels at
-        //       triangle borders. Is it that the correct solution, though?
-        return Fix12P4(static_cast<unsigned short>(round(flt.ToFloat32() * 16.0f)));
-    };
-    static auto ScreenToRasterizerCoordinates = [](const Math::Vec3<float24>& vec) {
-        return Math::Vec3<Fix12P4>{FloatToFix(vec.x), FloatToFix(vec.y), FloatToFix(vec.z)};
-    };
+    /// Value at the center of the given pixel, relative to the origin
+    int At(int pixel_x, int pixel_y) const {
+        return origin + pixel_x * step_x + pixel_y * step_y;
+    }
 
-    Math::Vec3<Fix12P4> vtxpos[3]{ ScreenToRasterizerCoordinates(v0.screenpos),
-                                   ScreenToRasterizerCoordinates(v1.screenpos),
-                                   ScreenToRasterizerCoordinates(v2.screenpos) };
+    int origin;
+    /// Differences between horizontally and vertically adjacent pixels
+    int step_x, step_y;
+};
 
-    if (regs.cull_mode == Regs::CullMode::KeepAll) {
-        // Make sure we always end up with a triangle wound counter-clockwise
-        if (!reversed && SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) <= 0) {
-            ProcessTriangleInternal(v0, v2, v1, true);
-            return;
-        }
-    } else {
-        if (!reversed && regs.cull_mode == Regs::CullMode::KeepClockWise) {
-            // Reverse vertex order and use the CCW code path.
-            ProcessTriangleInternal(v0, v2, v1, true);
-            return;
+/**
+ * Returns which pixels of a row of BLOCK_SIZE pixels are covered by the triangle, i.e. have no
+ * negative barycentric coordinate. Bit i is set if the pixel at first_x + i is covered.
+ */
+static u32 GetRowCoverage(const EdgeFunction (&edges)[3], int first_x, int pixel_y) {
+    u32 coverage = 0;
+#if defined(_M_X64) || defined(__SSE2__)
+    // Tests four pixels at a time, a pixel is covered if the sign bits of all its coordinates are clear
+    for (int group = 0; group < BLOCK_SIZE; group += 4) {
+        __m128i combined = _mm_setzero_si128();
+        for (const EdgeFunction& edge : edges) {
+            const int first = edge.At(first_x + group, pixel_y);
+            const __m128i steps = _mm_setr_epi32(0, edge.step_x, 2 * edge.step_x, 3 * edge.step_x);
+            combined = _mm_or_si128(combined, _mm_add_epi32(_mm_set1_epi32(first), steps));
         }
+        const u32 outside = static_cast<u32>(_mm_movemask_ps(_mm_castsi128_ps(combined)));
+        coverage |= (~outside & 0xF) << group;
+    }
+#else
+    for (int i = 0; i < BLOCK_SIZE; ++i) {
+        if ((edges[0].At(first_x + i, pixel_y) | edges[1].At(first_x + i, pixel_y) |
+             edges[2].At(first_x + i, pixel_y)) >= 0)
+            coverage |= 1 << i;
+    }
+#endif
+    return coverage;
+}
 
-        // Cull away triangles which are wound clockwise.
-        if (SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) <= 0)
-            return;
+/**
+ * Per-draw setup of the fragment pipeline. The texture combiner, alpha test, depth test and
+ * blending configuration is decoded once into lookup indices and function pointers specialized
+ * for each mode, so the pixel loop doesn't have to look at the registers or switch on their
+ * contents for every fragment.
+ */
+namespace FragmentPipeline {
+
+using Source = Regs::TevStageConfig::Source;
+using ColorModifier = Regs::TevStageConfig::ColorModifier;
+using AlphaModifier = Regs::TevStageConfig::AlphaModifier;
+using Operation = Regs::TevStageConfig::Operation;
+
+/// Values the texture combiner stages can take their inputs from, for each fragment
+enum Input : u8 {
+    INPUT_PRIMARY_COLOR,
+    INPUT_ZERO,
+    INPUT_TEXTURE0,
+    INPUT_TEXTURE1,
+    INPUT_TEXTURE2,
+    INPUT_BUFFER,
+    INPUT_CONSTANT,
+    INPUT_PREVIOUS,
+
+    NUM_INPUTS
+};
+
+template <ColorModifier factor>
+static Math::Vec3<u8> GetColorModifier(const Math::Vec4<u8>& values) {
+    switch (factor) {
+    case ColorModifier::SourceColor:
+        return values.rgb();
+
+    case ColorModifier::OneMinusSourceColor:
+        return (Math::Vec3<u8>(255, 255, 255) - values.rgb()).Cast<u8>();
+
+    case ColorModifier::SourceAlpha:
+        return values.aaa();
+
+    case ColorModifier::OneMinusSourceAlpha:
+        return (Math::Vec3<u8>(255, 255, 255) - values.aaa()).Cast<u8>();
+
+    case ColorModifier::SourceRed:
+        return values.rrr();
+
+    case ColorModifier::OneMinusSourceRed:
+        return (Math::Vec3<u8>(255, 255, 255) - values.rrr()).Cast<u8>();
+
+    case ColorModifier::SourceGreen:
+        return values.ggg();
+
+    case ColorModifier::OneMinusSourceGreen:
+        return (Math::Vec3<u8>(255, 255, 255) - values.ggg()).Cast<u8>();
+
+    case ColorModifier::SourceBlue:
+        return values.bbb();
+
+    case ColorModifier::OneMinusSourceBlue:
+        return (Math::Vec3<u8>(255, 255, 255) - values.bbb()).Cast<u8>();
     }
+}
 
-    // TODO: Proper scissor rect test!
-    u16 min_x = std::min({vtxpos[0].x, vtxpos[1].x, vtxpos[2].x});
-    u16 min_y = std::min({vtxpos[0].y, vtxpos[1].y, vtxpos[2].y});
-    u16 max_x = std::max({vtxpos[0].x, vtxpos[1].x, vtxpos[2].x});
-    u16 max_y = std::max({vtxpos[0].y, vtxpos[1].y, vtxpos[2].y});
+template <AlphaModifier factor>
+static u8 GetAlphaModifier(const Math::Vec4<u8>& values) {
+    switch (factor) {
+    case AlphaModifier::SourceAlpha:
+        return values.a();
 
-    min_x &= Fix12P4::IntMask();
-    min_y &= Fix12P4::IntMask();
-    max_x = ((max_x + Fix12P4::FracMask()) & Fix12P4::IntMask());
-    max_y = ((max_y + Fix12P4::FracMask()) & Fix12P4::IntMask());
+    case AlphaModifier::OneMinusSourceAlpha:
+        return 255 - values.a();
 
-    // Triangle filling rules: Pixels on the right-sided edge or on flat bottom edges are not
-    // drawn. Pixels on any other triangle border are drawn. This is implemented with three bias
-    // values which are added to the barycentric coordinates w0, w1 and w2, respectively.
-    // NOTE: These are the PSP filling rules. Not sure if the 3DS uses the same ones...
-    auto IsRightSideOrFlatBottomEdge = [](const Math::Vec2<Fix12P4>& vtx,
-                                          const Math::Vec2<Fix12P4>& line1,
-                                          const Math::Vec2<Fix12P4>& line2)
+    case AlphaModifier::SourceRed:
+        return values.r();
+
+    case AlphaModifier::OneMinusSourceRed:
+        return 255 - values.r();
+
+    case AlphaModifier::SourceGreen:
+        return values.g();
+
+    case AlphaModifier::OneMinusSourceGreen:
+        return 255 - values.g();
+
+    case AlphaModifier::SourceBlue:
+        return values.b();
+
+    case AlphaModifier::OneMinusSourceBlue:
+        return 255 - values.b();
+    }
+}
+
+template <Operation op>
+static Math::Vec3<u8> ColorCombine(const Math::Vec3<u8> input[3]) {
+    switch (op) {
+    case Operation::Replace:
+        return input[0];
+
+    case Operation::Modulate:
+        return ((input[0] * input[1]) / 255).Cast<u8>();
+
+    case Operation::Add:
     {
-        if (line1.y == line2.y) {
-            // just check if vertex is above us => bottom line parallel to x-axis
-            return vtx.y < line1.y;
-        } else {
-            // check if vertex is on our left => right side
-            // TODO: Not sure how likely this is to overflow
-            return (int)vtx.x < (int)line1.x + ((int)line2.x - (int)line1.x) * ((int)vtx.y - (int)line1.y) / ((int)line2.y - (int)line1.y);
-        }
-    };
-    int bias0 = IsRightSideOrFlatBottomEdge(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) ? -1 : 0;
-    int bias1 = IsRightSideOrFlatBottomEdge(vtxpos[1].xy(), vtxpos[2].xy(), vtxpos[0].xy()) ? -1 : 0;
-    int bias2 = IsRightSideOrFlatBottomEdge(vtxpos[2].xy(), vtxpos[0].xy(), vtxpos[1].xy()) ? -1 : 0;
+        auto result = input[0] + input[1];
+        result.r() = std::min(255, result.r());
+        result.g() = std::min(255, result.g());
+        result.b() = std::min(255, result.b());
+        return result.Cast<u8>();
+    }
 
-    auto w_inverse = Math::MakeVec(v0.pos.w, v1.pos.w, v2.pos.w);
+    case Operation::AddSigned:
+    {
+        // TODO(bunnei): Verify that the color conversion from (float) 0.5f to (byte) 128 is correct
+        auto result = input[0].Cast<int>() + input[1].Cast<int>() - Math::MakeVec<int>(128, 128, 128);
+        result.r() = MathUtil::Clamp<int>(result.r(), 0, 255);
+        result.g() = MathUtil::Clamp<int>(result.g(), 0, 255);
+        result.b() = MathUtil::Clamp<int>(result.b(), 0, 255);
+        return result.Cast<u8>();
+    }
 
-    auto textures = regs.GetTextures();
-    auto tev_stages = regs.GetTevStages();
+    case Operation::Lerp:
+        return ((input[0] * input[2] + input[1] * (Math::MakeVec<u8>(255, 255, 255) - input[2]).Cast<u8>()) / 255).Cast<u8>();
 
-    // Enter rasterization loop, starting at the center of the topleft bounding box corner.
-    // TODO: Not sure if looping through x first might be faster
-    for (u16 y = min_y + 8; y < max_y; y += 0x10) {
-        for (u16 x = min_x + 8; x < max_x; x += 0x10) {
+    case Operation::Subtract:
+    {
+        auto result = input[0].Cast<int>() - input[1].Cast<int>();
+        result.r() = std::max(0, result.r());
+        result.g() = std::max(0, result.g());
+        result.b() = std::max(0, result.b());
+        return result.Cast<u8>();
+    }
 
-            // Calculate the barycentric coordinates w0, w1 and w2
-            int w0 = bias0 + SignedArea(vtxpos[1].xy(), vtxpos[2].xy(), {x, y});
-            int w1 = bias1 + SignedArea(vtxpos[2].xy(), vtxpos[0].xy(), {x, y});
-            int w2 = bias2 + SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), {x, y});
-            int wsum = w0 + w1 + w2;
+    case Operation::MultiplyThenAdd:
+    {
+        auto result = (input[0] * input[1] + 255 * input[2].Cast<int>()) / 255;
+        result.r() = std::min(255, result.r());
+        result.g() = std::min(255, result.g());
+        result.b() = std::min(255, result.b());
+        return result.Cast<u8>();
+    }
 
-            // If current pixel is not covered by the current primitive
-            if (w0 < 0 || w1 < 0 || w2 < 0)
-                continue;
+    case Operation::AddThenMultiply:
+    {
+        auto result = input[0] + input[1];
+        result.r() = std::min(255, result.r());
+        result.g() = std::min(255, result.g());
+        result.b() = std::min(255, result.b());
+        result = (result * input[2].Cast<int>()) / 255;
+        return result.Cast<u8>();
+    }
 
-            auto baricentric_coordinates = Math::MakeVec(float24::FromFloat32(static_cast<float>(w0)),
-                                                float24::FromFloat32(static_cast<float>(w1)),
-                                                float24::FromFloat32(static_cast<float>(w2)));
-            float24 interpolated_w_inverse = float24::FromFloat32(1.0f) / Math::Dot(w_inverse, baricentric_coordinates);
-
-            // Perspective correct attribute interpolation:
-            // Attribute values cannot be calculated by simple linear interpolation since
-            // they are not linear in screen space. For example, when interpolating a
-            // texture coordinate across two vertices, something simple like
-            //     u = (u0*w0 + u1*w1)/(w0+w1)
-            // will not work. However, the attribute value divided by the
-            // clipspace w-coordinate (u/w) and and the inverse w-coordinate (1/w) are linear
-            // in screenspace. Hence, we can linearly interpolate these two independently and
-            // calculate the interpolated attribute by dividing the results.
-            // I.e.
-            //     u_over_w   = ((u0/v0.pos.w)*w0 + (u1/v1.pos.w)*w1)/(w0+w1)
-            //     one_over_w = (( 1/v0.pos.w)*w0 + ( 1/v1.pos.w)*w1)/(w0+w1)
-            //     u = u_over_w / one_over_w
-            //
-            // The generalization to three vertices is straightforward in baricentric coordinates.
-            auto GetInterpolatedAttribute = [&](float24 attr0, float24 attr1, float24 attr2) {
-                auto attr_over_w = Math::MakeVec(attr0, attr1, attr2);
-                float24 interpolated_attr_over_w = Math::Dot(attr_over_w, baricentric_coordinates);
-                return interpolated_attr_over_w * interpolated_w_inverse;
-            };
+    default:
+        return {0, 0, 0};
+    }
+}
 
-            Math::Vec4<u8> primary_color{
-                (u8)(GetInterpolatedAttribute(v0.color.r(), v1.color.r(), v2.color.r()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.g(), v1.color.g(), v2.color.g()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.b(), v1.color.b(), v2.color.b()).ToFloat32() * 255),
-                (u8)(GetInterpolatedAttribute(v0.color.a(), v1.color.a(), v2.color.a()).ToFloat32() * 255)
-            };
+template <Operation op>
+static u8 AlphaCombine(const std::array<u8,3>& input) {
+    switch (op) {
+    case Operation::Replace:
+        return input[0];
 
-            Math::Vec2<float24> uv[3];
-            uv[0].u() = GetInterpolatedAttribute(v0.tc0.u(), v1.tc0.u(), v2.tc0.u());
-            uv[0].v() = GetInterpolatedAttribute(v0.tc0.v(), v1.tc0.v(), v2.tc0.v());
-            uv[1].u() = GetInterpolatedAttribute(v0.tc1.u(), v1.tc1.u(), v2.tc1.u());
-            uv[1].v() = GetInterpolatedAttribute(v0.tc1.v(), v1.tc1.v(), v2.tc1.v());
-            uv[2].u() = GetInterpolatedAttribute(v0.tc2.u(), v1.tc2.u(), v2.tc2.u());
-            uv[2].v() = GetInterpolatedAttribute(v0.tc2.v(), v1.tc2.v(), v2.tc2.v());
+    case Operation::Modulate:
+        return input[0] * input[1] / 255;
 
-            Math::Vec4<u8> texture_color[3]{};
-            for (int i = 0; i < 3; ++i) {
-                const auto& texture = textures[i];
-                if (!texture.enabled)
-                    continue;
+    case Operation::Add:
+        return std::min(255, input[0] + input[1]);
 
-                DEBUG_ASSERT(0 != texture.config.address);
-
-                int s = (int)(uv[i].u() * float24::FromFloat32(static_cast<float>(texture.config.width))).ToFloat32();
-                int t = (int)(uv[i].v() * float24::FromFloat32(static_cast<float>(texture.config.height))).ToFloat32();
-                static auto GetWrappedTexCoord = [](Regs::TextureConfig::WrapMode mode, int val, unsigned size) {
-                    switch (mode) {
-                        case Regs::TextureConfig::ClampToEdge:
-                            val = std::max(val, 0);
-                            val = std::min(val, (int)size - 1);
-                            return val;
-
-                        case Regs::TextureConfig::Repeat:
-                            return (int)((unsigned)val % size);
-
-                        case Regs::TextureConfig::MirroredRepeat:
-                        {
-                            unsigned int coord = ((unsigned)val % (2 * size));
-                            if (coord >= size)
-                                coord = 2 * size - 1 - coord;
-                            return (int)coord;
-                        }
-
-                        default:
-                            LOG_ERROR(HW_GPU, "Unknown texture coordinate wrapping mode %x\n", (int)mode);
-                            UNIMPLEMENTED();
-                            return 0;
-                    }
-                };
+    case Operation::AddSigned:
+    {
+        // TODO(bunnei): Verify that the color conversion from (float) 0.5f to (byte) 128 is correct
+        auto result = static_cast<int>(input[0]) + static_cast<int>(input[1]) - 128;
+        return static_cast<u8>(MathUtil::Clamp<int>(result, 0, 255));
+    }
 
-                // Textures are laid out from bottom to top, hence we invert the t coordinate.
-                // NOTE: This may not be the right place for the inversion.
-                // TODO: Check if this applies to ETC textures, too.
-                s = GetWrappedTexCoord(texture.config.wrap_s, s, texture.config.width);
-                t = texture.config.height - 1 - GetWrappedTexCoord(texture.config.wrap_t, t, texture.config.height);
+    case Operation::Lerp:
+        return (input[0] * input[2] + input[1] * (255 - input[2])) / 255;
 
-                u8* texture_data = Memory::GetPhysicalPointer(texture.config.GetPhysicalAddress());
-                auto info = DebugUtils::TextureInfo::FromPicaRegister(texture.config, texture.format);
+    case Operation::Subtract:
+        return std::max(0, (int)input[0] - (int)input[1]);
 
-                texture_color[i] = DebugUtils::LookupTexture(texture_data, s, t, info);
-                DebugUtils::DumpTexture(texture.config, texture_data);
-            }
+    case Operation::MultiplyThenAdd:
+        return std::min(255, (input[0] * input[1] + 255 * input[2]) / 255);
 
-            // Texture environment - consists of 6 stages of color and alpha combining.
-            //
-            // Color combiners take three input color values from some source (e.g. interpolated
-            // vertex color, texture color, previous stage, etc), perform some very simple
-            // operations on each of them (e.g. inversion) and then calculate the output color
-            // with some basic arithmetic. Alpha combiners can be configured separately but work
-            // analogously.
-            Math::Vec4<u8> combiner_output;
-            Math::Vec4<u8> combiner_buffer = {
-                regs.tev_combiner_buffer_color.r, regs.tev_combiner_buffer_color.g,
-                regs.tev_combiner_buffer_color.b, regs.tev_combiner_buffer_color.a
-            };
+    case Operation::AddThenMultiply:
+        return (std::min(255, (input[0] + input[1])) * input[2]) / 255;
 
-            for (unsigned tev_stage_index = 0; tev_stage_index < tev_stages.size(); ++tev_stage_index) {
-                const auto& tev_stage = tev_stages[tev_stage_index];
-                using Source = Regs::TevStageConfig::Source;
-                using ColorModifier = Regs::TevStageConfig::ColorModifier;
-                using AlphaModifier = Regs::TevStageConfig::AlphaModifier;
-                using Operation = Regs::TevStageConfig::Operation;
+    default:
+        return 0;
+    }
+}
 
-                auto GetSource = [&](Source source) -> Math::Vec4<u8> {
-                    switch (source) {
-                    case Source::PrimaryColor:
+template <Regs::CompareFunc func>
+static bool Compare(u32 value, u32 ref) {
+    switch (func) {
+    case Regs::CompareFunc::Never:
+        return false;
 
-                    // HACK: Until we implement fragment lighting, use primary_color
-                    case Source::PrimaryFragmentColor:
-                        return primary_color;
+    case Regs::CompareFunc::Always:
+        return true;
 
-                    // HACK: Until we implement fragment lighting, use zero
-                    case Source::SecondaryFragmentColor:
-                        return {0, 0, 0, 0};
+    case Regs::CompareFunc::Equal:
+        return value == ref;
 
-                    case Source::Texture0:
-                        return texture_color[0];
+    case Regs::CompareFunc::NotEqual:
+        return value != ref;
 
-                    case Source::Texture1:
-                        return texture_color[1];
+    case Regs::CompareFunc::LessThan:
+        return value < ref;
 
-                    case Source::Texture2:
-                        return texture_color[2];
+    case Regs::CompareFunc::LessThanOrEqual:
+        return value <= ref;
 
-                    case Source::PreviousBuffer:
-                        return combiner_buffer;
+    case Regs::CompareFunc::GreaterThan:
+        return value > ref;
 
-                    case Source::Constant:
-                        return {tev_stage.const_r, tev_stage.const_g, tev_stage.const_b, tev_stage.const_a};
+    case Regs::CompareFunc::GreaterThanOrEqual:
+        return value >= ref;
+    }
+}
 
-                    case Source::Previous:
-                        return combiner_output;
+template <Regs::BlendFactor factor>
+static Math::Vec3<u8> LookupFactorRGB(const Math::Vec4<u8>& source, const Math::Vec4<u8>& dest,
+                                      const Math::Vec4<u8>& constant) {
+    switch (factor) {
+    case Regs::BlendFactor::Zero :
+        return Math::Vec3<u8>(0, 0, 0);
 
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown color combiner source %d\n", (int)source);
-                        UNIMPLEMENTED();
-                        return {0, 0, 0, 0};
-                    }
-                };
+    case Regs::BlendFactor::One :
+        return Math::Vec3<u8>(255, 255, 255);
 
-                static auto GetColorModifier = [](ColorModifier factor, const Math::Vec4<u8>& values) -> Math::Vec3<u8> {
-                    switch (factor) {
-                    case ColorModifier::SourceColor:
-                        return values.rgb();
+    case Regs::BlendFactor::SourceColor:
+        return source.rgb();
 
-                    case ColorModifier::OneMinusSourceColor:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.rgb()).Cast<u8>();
+    case Regs::BlendFactor::OneMinusSourceColor:
+        return Math::Vec3<u8>(255 - source.r(), 255 - source.g(), 255 - source.b());
 
-                    case ColorModifier::SourceAlpha:
-                        return values.aaa();
+    case Regs::BlendFactor::DestColor:
+        return dest.rgb();
 
-                    case ColorModifier::OneMinusSourceAlpha:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.aaa()).Cast<u8>();
+    case Regs::BlendFactor::OneMinusDestColor:
+        return Math::Vec3<u8>(255 - dest.r(), 255 - dest.g(), 255 - dest.b());
 
-                    case ColorModifier::SourceRed:
-                        return values.rrr();
+    case Regs::BlendFactor::SourceAlpha:
+        return Math::Vec3<u8>(source.a(), source.a(), source.a());
 
-                    case ColorModifier::OneMinusSourceRed:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.rrr()).Cast<u8>();
+    case Regs::BlendFactor::OneMinusSourceAlpha:
+        return Math::Vec3<u8>(255 - source.a(), 255 - source.a(), 255 - source.a());
 
-                    case ColorModifier::SourceGreen:
-                        return values.ggg();
+    case Regs::BlendFactor::DestAlpha:
+        return Math::Vec3<u8>(dest.a(), dest.a(), dest.a());
 
-                    case ColorModifier::OneMinusSourceGreen:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.ggg()).Cast<u8>();
+    case Regs::BlendFactor::OneMinusDestAlpha:
+        return Math::Vec3<u8>(255 - dest.a(), 255 - dest.a(), 255 - dest.a());
 
-                    case ColorModifier::SourceBlue:
-                        return values.bbb();
+    case Regs::BlendFactor::ConstantColor:
+        return constant.rgb();
 
-                    case ColorModifier::OneMinusSourceBlue:
-                        return (Math::Vec3<u8>(255, 255, 255) - values.bbb()).Cast<u8>();
-                    }
-                };
+    case Regs::BlendFactor::OneMinusConstantColor:
+        return Math::Vec3<u8>(255 - constant.r(), 255 - constant.g(), 255 - constant.b());
 
-                static auto GetAlphaModifier = [](AlphaModifier factor, const Math::Vec4<u8>& values) -> u8 {
-                    switch (factor) {
-                    case AlphaModifier::SourceAlpha:
-                        return values.a();
+    case Regs::BlendFactor::ConstantAlpha:
+        return Math::Vec3<u8>(constant.a(), constant.a(), constant.a());
 
-                    case AlphaModifier::OneMinusSourceAlpha:
-                        return 255 - values.a();
+    case Regs::BlendFactor::OneMinusConstantAlpha:
+        return Math::Vec3<u8>(255 - constant.a(), 255 - constant.a(), 255 - constant.a());
 
-                    case AlphaModifier::SourceRed:
-                        return values.r();
+    default:
+        return Math::Vec3<u8>(0, 0, 0);
+    }
+}
 
-                    case AlphaModifier::OneMinusSourceRed:
-                        return 255 - values.r();
+template <Regs::BlendFactor factor>
+static u8 LookupFactorA(const Math::Vec4<u8>& source, const Math::Vec4<u8>& dest,
+                        const Math::Vec4<u8>& constant) {
+    switch (factor) {
+    case Regs::BlendFactor::Zero:
+        return 0;
 
-                    case AlphaModifier::SourceGreen:
-                        return values.g();
+    case Regs::BlendFactor::One:
+        return 255;
 
-                    case AlphaModifier::OneMinusSourceGreen:
-                        return 255 - values.g();
+    case Regs::BlendFactor::SourceAlpha:
+        return source.a();
 
-                    case AlphaModifier::SourceBlue:
-                        return values.b();
+    case Regs::BlendFactor::OneMinusSourceAlpha:
+        return 255 - source.a();
 
-                    case AlphaModifier::OneMinusSourceBlue:
-                        return 255 - values.b();
-                    }
-                };
+    case Regs::BlendFactor::DestAlpha:
+        return dest.a();
 
-                static auto ColorCombine = [](Operation op, const Math::Vec3<u8> input[3]) -> Math::Vec3<u8> {
-                    switch (op) {
-                    case Operation::Replace:
-                        return input[0];
-
-                    case Operation::Modulate:
-                        return ((input[0] * input[1]) / 255).Cast<u8>();
-
-                    case Operation::Add:
-                    {
-                        auto result = input[0] + input[1];
-                        result.r() = std::min(255, result.r());
-                        result.g() = std::min(255, result.g());
-                        result.b() = std::min(255, result.b());
-                        return result.Cast<u8>();
-                    }
+    case Regs::BlendFactor::OneMinusDestAlpha:
+        return 255 - dest.a();
 
-                    case Operation::AddSigned:
-                    {
-                        // TODO(bunnei): Verify that the color conversion from (float) 0.5f to (byte) 128 is correct
-                        auto result = input[0].Cast<int>() + input[1].Cast<int>() - Math::MakeVec<int>(128, 128, 128);
-                        result.r() = MathUtil::Clamp<int>(result.r(), 0, 255);
-                        result.g() = MathUtil::Clamp<int>(result.g(), 0, 255);
-                        result.b() = MathUtil::Clamp<int>(result.b(), 0, 255);
-                        return result.Cast<u8>();
-                    }
+    case Regs::BlendFactor::ConstantAlpha:
+        return constant.a();
 
-                    case Operation::Lerp:
-                        return ((input[0] * input[2] + input[1] * (Math::MakeVec<u8>(255, 255, 255) - input[2]).Cast<u8>()) / 255).Cast<u8>();
+    case Regs::BlendFactor::OneMinusConstantAlpha:
+        return 255 - constant.a();
 
-                    case Operation::Subtract:
-                    {
-                        auto result = input[0].Cast<int>() - input[1].Cast<int>();
-                        result.r() = std::max(0, result.r());
-                        result.g() = std::max(0, result.g());
-                        result.b() = std::max(0, result.b());
-                        return result.Cast<u8>();
-                    }
+    default:
+        return 0;
+    }
+}
 
-                    case Operation::MultiplyThenAdd:
-                    {
-                        auto result = (input[0] * input[1] + 255 * input[2].Cast<int>()) / 255;
-                        result.r() = std::min(255, result.r());
-                        result.g() = std::min(255, result.g());
-                        result.b() = std::min(255, result.b());
-                        return result.Cast<u8>();
-                    }
+template <Regs::BlendEquation equation>
+static Math::Vec4<u8> EvaluateBlendEquation(const Math::Vec4<u8>& src, const Math::Vec4<u8>& srcfactor,
+                                            const Math::Vec4<u8>& dest, const Math::Vec4<u8>& destfactor) {
+    Math::Vec4<int> result;
 
-                    case Operation::AddThenMultiply:
-                    {
-                        auto result = input[0] + input[1];
-                        result.r() = std::min(255, result.r());
-                        result.g() = std::min(255, result.g());
-                        result.b() = std::min(255, result.b());
-                        result = (result * input[2].Cast<int>()) / 255;
-                        return result.Cast<u8>();
-                    }
+    auto src_result = (src  *  srcfactor).Cast<int>();
+    auto dst_result = (dest * destfactor).Cast<int>();
 
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown color combiner operation %d\n", (int)op);
-                        UNIMPLEMENTED();
-                        return {0, 0, 0};
-                    }
-                };
+    switch (equation) {
+    case Regs::BlendEquation::Add:
+        result = (src_result + dst_result) / 255;
+        break;
 
-                static auto AlphaCombine = [](Operation op, const std::array<u8,3>& input) -> u8 {
-                    switch (op) {
-                    case Operation::Replace:
-                        return input[0];
+    case Regs::BlendEquation::Subtract:
+        result = (src_result - dst_result) / 255;
+        break;
 
-                    case Operation::Modulate:
-                        return input[0] * input[1] / 255;
+    case Regs::BlendEquation::ReverseSubtract:
+        result = (dst_result - src_result) / 255;
+        break;
 
-                    case Operation::Add:
-                        return std::min(255, input[0] + input[1]);
+    // TODO: How do these two actually work?
+    //       OpenGL doesn't include the blend factors in the min/max computations,
+    //       but is this what the 3DS actually does?
+    case Regs::BlendEquation::Min:
+        result.r() = std::min(src.r(), dest.r());
+        result.g() = std::min(src.g(), dest.g());
+        result.b() = std::min(src.b(), dest.b());
+        result.a() = std::min(src.a(), dest.a());
+        break;
 
-                    case Operation::AddSigned:
-                    {
-                        // TODO(bunnei): Verify that the color conversion from (float) 0.5f to (byte) 128 is correct
-                        auto result = static_cast<int>(input[0]) + static_cast<int>(input[1]) - 128;
-                        return static_cast<u8>(MathUtil::Clamp<int>(result, 0, 255));
-                    }
+    case Regs::BlendEquation::Max:
+        result.r() = std::max(src.r(), dest.r());
+        result.g() = std::max(src.g(), dest.g());
+        result.b() = std::max(src.b(), dest.b());
+        result.a() = std::max(src.a(), dest.a());
+        break;
+    }
 
-                    case Operation::Lerp:
-                        return (input[0] * input[2] + input[1] * (255 - input[2])) / 255;
+    return Math::Vec4<u8>(MathUtil::Clamp(result.r(), 0, 255),
+                          MathUtil::Clamp(result.g(), 0, 255),
+                          MathUtil::Clamp(result.b(), 0, 255),
+                          MathUtil::Clamp(result.a(), 0, 255));
+}
 
-                    case Operation::Subtract:
-                        return std::max(0, (int)input[0] - (int)input[1]);
+template <Regs::LogicOp op>
+static u8 LogicOp(u8 src, u8 dest) {
+    switch (op) {
+    case Regs::LogicOp::Clear:
+        return 0;
 
-                    case Operation::MultiplyThenAdd:
-                        return std::min(255, (input[0] * input[1] + 255 * input[2]) / 255);
+    case Regs::LogicOp::And:
+        return src & dest;
 
-                    case Operation::AddThenMultiply:
-                        return (std::min(255, (input[0] + input[1])) * input[2]) / 255;
+    case Regs::LogicOp::AndReverse:
+        return src & ~dest;
 
-                    default:
-                        LOG_ERROR(HW_GPU, "Unknown alpha combiner operation %d\n", (int)op);
-                        UNIMPLEMENTED();
-                        return 0;
-                    }
-                };
+    case Regs::LogicOp::Copy:
+        return src;
 
-                // color combiner
-                // NOTE: Not sure if the alpha combiner might use the color output of the previous
-                //       stage as input. Hence, we currently don't directly write the result to
-                //       combiner_output.rgb(), but instead store it in a temporary variable until
-                //       alpha combining has been done.
-                Math::Vec3<u8> color_result[3] = {
-                    GetColorModifier(tev_stage.color_modifier1, GetSource(tev_stage.color_source1)),
-                    GetColorModifier(tev_stage.color_modifier2, GetSource(tev_stage.color_source2)),
-                    GetColorModifier(tev_stage.color_modifier3, GetSource(tev_stage.color_source3))
-                };
-                auto color_output = ColorCombine(tev_stage.color_op, color_result);
+    case Regs::LogicOp::Set:
+        return 255;
 
-                // alpha combiner
-                std::array<u8,3> alpha_result = {
-                    GetAlphaModifier(tev_stage.alpha_modifier1, GetSource(tev_stage.alpha_source1)),
-                    GetAlphaModifier(tev_stage.alpha_modifier2, GetSource(tev_stage.alpha_source2)),
-                    GetAlphaModifier(tev_stage.alpha_modifier3, GetSource(tev_stage.alpha_source3))
-                };
-                auto alpha_output = AlphaCombine(tev_stage.alpha_op, alpha_result);
+    case Regs::LogicOp::CopyInverted:
+        return ~src;
 
-                combiner_output[0] = std::min((unsigned)255, color_output.r() * tev_stage.GetColorMultiplier());
-                combiner_output[1] = std::min((unsigned)255, color_output.g() * tev_stage.GetColorMultiplier());
-                combiner_output[2] = std::min((unsigned)255, color_output.b() * tev_stage.GetColorMultiplier());
-                combiner_output[3] = std::min((unsigned)255, alpha_output * tev_stage.GetAlphaMultiplier());
+    case Regs::LogicOp::NoOp:
+        return dest;
 
-                if (regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferColor(tev_stage_index)) {
-                    combiner_buffer.r() = combiner_output.r();
-                    combiner_buffer.g() = combiner_output.g();
-                    combiner_buffer.b() = combiner_output.b();
-                }
+    case Regs::LogicOp::Invert:
+        return ~dest;
 
-                if (regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferAlpha(tev_stage_index)) {
-                    combiner_buffer.a() = combiner_output.a();
-                }
-            }
+    case Regs::LogicOp::Nand:
+        return ~(src & dest);
 
-            const auto& output_merger = regs.output_merger;
-            if (output_merger.alpha_test.enable) {
-                bool pass = false;
+    case Regs::LogicOp::Or:
+        return src | dest;
 
-                switch (output_merger.alpha_test.func) {
-                case Regs::CompareFunc::Never:
-                    pass = false;
-                    break;
+    case Regs::LogicOp::Nor:
+        return ~(src | dest);
 
-                case Regs::CompareFunc::Always:
-                    pass = true;
-                    break;
+    case Regs::LogicOp::Xor:
+        return src ^ dest;
 
-                case Regs::CompareFunc::Equal:
-                    pass = combiner_output.a() == output_merger.alpha_test.ref;
-                    break;
+    case Regs::LogicOp::Equiv:
+        return ~(src ^ dest);
 
-                case Regs::CompareFunc::NotEqual:
-                    pass = combiner_output.a() != output_merger.alpha_test.ref;
-                    break;
+    case Regs::LogicOp::AndInverted:
+        return ~src & dest;
 
-                case Regs::CompareFunc::LessThan:
-                    pass = combiner_output.a() < output_merger.alpha_test.ref;
-                    break;
+    case Regs::LogicOp::OrReverse:
+        return src | ~dest;
 
-                case Regs::CompareFunc::LessThanOrEqual:
-                    pass = combiner_output.a() <= output_merger.alpha_test.ref;
-                    break;
+    case Regs::LogicOp::OrInverted:
+        return ~src | dest;
+    }
+}
 
-                case Regs::CompareFunc::GreaterThan:
-                    pass = combiner_output.a() > output_merger.alpha_test.ref;
-                    break;
+template <Regs::TextureConfig::WrapMode mode>
+static int GetWrappedTexCoord(int val, unsigned size) {
+    switch (mode) {
+        case Regs::TextureConfig::ClampToEdge:
+            val = std::max(val, 0);
+            val = std::min(val, (int)size - 1);
+            return val;
+
+        case Regs::TextureConfig::Repeat:
+            return (int)((unsigned)val % size);
+
+        case Regs::TextureConfig::MirroredRepeat:
+        {
+            unsigned int coord = ((unsigned)val % (2 * size));
+            if (coord >= size)
+                coord = 2 * size - 1 - coord;
+            return (int)coord;
+        }
 
-                case Regs::CompareFunc::GreaterThanOrEqual:
-                    pass = combiner_output.a() >= output_merger.alpha_test.ref;
-                    break;
-                }
+        default:
+            return 0;
+    }
+}
 
-                if (!pass)
-                    continue;
-            }
+#if defined(_M_X64) || defined(__SSE2__)
+// SSE2 versions of the texture combiner functions, used by CombineSpan. They work on two fragments
+// at a time, with each RGBA component extended to a 16-bit lane.
+
+/// Replicates the given component of both fragments to their other components
+template <int component>
+static __m128i ReplicateComponent(__m128i values) {
+    const __m128i low = _mm_shufflelo_epi16(values, _MM_SHUFFLE(component, component, component, component));
+    return _mm_shufflehi_epi16(low, _MM_SHUFFLE(component, component, component, component));
+}
+
+static __m128i OneMinus(__m128i values) {
+    return _mm_sub_epi16(_mm_set1_epi16(255), values);
+}
 
-            // TODO: Does depth indeed only get written even if depth testing is enabled?
-            if (output_merger.depth_test_enable) {
-                unsigned num_bits = Regs::DepthBitsPerPixel(regs.framebuffer.depth_format);
-                u32 z = (u32)((v0.screenpos[2].ToFloat32() * w0 +
-                               v1.screenpos[2].ToFloat32() * w1 +
-                               v2.screenpos[2].ToFloat32() * w2) * ((1 << num_bits) - 1) / wsum);
-                u32 ref_z = GetDepth(x >> 4, y >> 4);
+/// x / 255 rounded down, exact for the products of two components
+static __m128i DivideBy255(__m128i x) {
+    const __m128i x_plus_one = _mm_add_epi16(x, _mm_set1_epi16(1));
+    return _mm_srli_epi16(_mm_add_epi16(x_plus_one, _mm_srli_epi16(x_plus_one, 8)), 8);
+}
 
-                bool pass = false;
+template <ColorModifier factor>
+static __m128i GetSpanColorModifier(__m128i values) {
+    switch (factor) {
+    case ColorModifier::SourceColor:         return values;
+    case ColorModifier::OneMinusSourceColor: return OneMinus(values);
+    case ColorModifier::SourceAlpha:         return ReplicateComponent<3>(values);
+    case ColorModifier::OneMinusSourceAlpha: return OneMinus(ReplicateComponent<3>(values));
+    case ColorModifier::SourceRed:           return ReplicateComponent<0>(values);
+    case ColorModifier::OneMinusSourceRed:   return OneMinus(ReplicateComponent<0>(values));
+    case ColorModifier::SourceGreen:         return ReplicateComponent<1>(values);
+    case ColorModifier::OneMinusSourceGreen: return OneMinus(ReplicateComponent<1>(values));
+    case ColorModifier::SourceBlue:          return ReplicateComponent<2>(values);
+    case ColorModifier::OneMinusSourceBlue:  return OneMinus(ReplicateComponent<2>(values));
+    }
+}
 
-                switch (output_merger.depth_test_func) {
-                case Regs::CompareFunc::Never:
-                    pass = false;
-                    break;
+/// Only the alpha lanes of the result are used
+template <AlphaModifier factor>
+static __m128i GetSpanAlphaModifier(__m128i values) {
+    switch (factor) {
+    case AlphaModifier::SourceAlpha:         return values;
+    case AlphaModifier::OneMinusSourceAlpha: return OneMinus(values);
+    case AlphaModifier::SourceRed:           return ReplicateComponent<0>(values);
+    case AlphaModifier::OneMinusSourceRed:   return OneMinus(ReplicateComponent<0>(values));
+    case AlphaModifier::SourceGreen:         return ReplicateComponent<1>(values);
+    case AlphaModifier::OneMinusSourceGreen: return OneMinus(ReplicateComponent<1>(values));
+    case AlphaModifier::SourceBlue:          return ReplicateComponent<2>(values);
+    case AlphaModifier::OneMinusSourceBlue:  return OneMinus(ReplicateComponent<2>(values));
+    }
+}
 
-                case Regs::CompareFunc::Always:
-                    pass = true;
-                    break;
+/// Color and alpha operations are the same on each lane, they only differ in the lanes that are used
+template <Operation op>
+static __m128i SpanCombine(const __m128i input[3]) {
+    const __m128i max = _mm_set1_epi16(255);
 
-                case Regs::CompareFunc::Equal:
-                    pass = z == ref_z;
-                    break;
+    switch (op) {
+    case Operation::Replace:
+        return input[0];
 
-                case Regs::CompareFunc::NotEqual:
-                    pass = z != ref_z;
-                    break;
+    case Operation::Modulate:
+        return DivideBy255(_mm_mullo_epi16(input[0], input[1]));
 
-                case Regs::CompareFunc::LessThan:
-                    pass = z < ref_z;
-                    break;
+    case Operation::Add:
+        return _mm_min_epi16(_mm_add_epi16(input[0], input[1]), max);
 
-                case Regs::CompareFunc::LessThanOrEqual:
-                    pass = z <= ref_z;
-                    break;
+    case Operation::AddSigned:
+    {
+        const __m128i result = _mm_sub_epi16(_mm_add_epi16(input[0], input[1]), _mm_set1_epi16(128));
+        return _mm_min_epi16(_mm_max_epi16(result, _mm_setzero_si128()), max);
+    }
 
-                case Regs::CompareFunc::GreaterThan:
-                    pass = z > ref_z;
-                    break;
+    case Operation::Lerp:
+        return DivideBy255(_mm_add_epi16(_mm_mullo_epi16(input[0], input[2]),
+                                         _mm_mullo_epi16(input[1], OneMinus(input[2]))));
 
-                case Regs::CompareFunc::GreaterThanOrEqual:
-                    pass = z >= ref_z;
-                    break;
-                }
+    case Operation::Subtract:
+        return _mm_subs_epu16(input[0], input[1]);
 
-                if (!pass)
-                    continue;
+    case Operation::MultiplyThenAdd:
+        // (a * b + 255 * c) / 255 would overflow the lanes, but equals a * b / 255 + c
+        return _mm_min_epi16(_mm_add_epi16(DivideBy255(_mm_mullo_epi16(input[0], input[1])), input[2]), max);
+
+    case Operation::AddThenMultiply:
+        return DivideBy255(_mm_mullo_epi16(_mm_min_epi16(_mm_add_epi16(input[0], input[1]), max), input[2]));
+
+    default:
+        return _mm_setzero_si128();
+    }
+}
+
+typedef __m128i (*SpanModifierFunc)(__m128i values);
+typedef __m128i (*SpanCombineFunc)(const __m128i input[3]);
+#endif
+
+typedef Math::Vec3<u8> (*ColorModifierFunc)(const Math::Vec4<u8>& values);
+typedef u8 (*AlphaModifierFunc)(const Math::Vec4<u8>& values);
+typedef Math::Vec3<u8> (*ColorCombineFunc)(const Math::Vec3<u8> input[3]);
+typedef u8 (*AlphaCombineFunc)(const std::array<u8,3>& input);
+typedef bool (*CompareFunc)(u32 value, u32 ref);
+typedef Math::Vec3<u8> (*BlendFactorRGBFunc)(const Math::Vec4<u8>& source, const Math::Vec4<u8>& dest,
+                                             const Math::Vec4<u8>& constant);
+typedef u8 (*BlendFactorAFunc)(const Math::Vec4<u8>& source, const Math::Vec4<u8>& dest,
+                               const Math::Vec4<u8>& constant);
+typedef Math::Vec4<u8> (*BlendEquationFunc)(const Math::Vec4<u8>& src, const Math::Vec4<u8>& srcfactor,
+                                            const Math::Vec4<u8>& dest, const Math::Vec4<u8>& destfactor);
+typedef u8 (*LogicOpFunc)(u8 src, u8 dest);
+typedef int (*WrapFunc)(int val, unsigned size);
+
+/// A texture combiner stage that doesn't just pass on the output of the previous one
+struct TevStage {
+    Input color_inputs[3];
+    Input alpha_inputs[3];
+    ColorModifierFunc color_modifiers[3];
+    AlphaModifierFunc alpha_modifiers[3];
+    ColorCombineFunc color_combine;
+    AlphaCombineFunc alpha_combine;
+    unsigned color_multiplier;
+    unsigned alpha_multiplier;
+    Math::Vec4<u8> constant;
+    bool updates_buffer_color;
+    bool updates_buffer_alpha;
+#if defined(_M_X64) || defined(__SSE2__)
+    SpanModifierFunc span_color_modifiers[3];
+    SpanModifierFunc span_alpha_modifiers[3];
+    SpanCombineFunc span_color_combine;
+    SpanCombineFunc span_alpha_combine;
+#endif
+};
+
+struct Texture {
+    /// Whether any of the stages reads the texture, only then it is sampled
+    bool used;
+    unsigned width;
+    unsigned height;
+    /// Decoded texels, bound again for every draw since the texture cache may have dropped them
+    const TextureCache::CachedTexture* cached;
+    /// Texture size in float24, texture coordinates are scaled with it
+    float24 scale_s;
+    float24 scale_t;
+    WrapFunc wrap_s;
+    WrapFunc wrap_t;
+};
+
+/// Register words the pipeline is set up from: texturing, combiners, output merger and framebuffer formats
+static const u32 FIRST_REGISTER = PICA_REG_INDEX_WORKAROUND(texture0_enable, 0x80);
+static const u32 NUM_REGISTERS = PICA_REG_INDEX_WORKAROUND(framebuffer.depth_buffer_address, 0x11c) - FIRST_REGISTER;
+
+struct Setup {
+    /// The register words this was set up from, to tell hash collisions apart
+    std::array<u32, NUM_REGISTERS> registers;
+
+    Texture textures[3];
+
+    TevStage stages[6];
+    unsigned num_stages;
+    Math::Vec4<u8> buffer_color;
+
+    bool alpha_test_enable;
+    CompareFunc alpha_test_func;
+    u32 alpha_test_ref;
+
+    bool depth_test_enable;
+    CompareFunc depth_test_func;
+    /// Whether the depth test only passes smaller depth values, so that whole blocks of pixels can
+    /// be rejected with the hierarchical depth buffer
+    bool hierarchical_depth_test;
+    /// Whether the depth test also passes equal depth values
+    bool depth_test_or_equal;
+    bool depth_write_enable;
+    /// Largest depth value that fits the depth buffer format
+    int depth_scale;
+
+    bool alphablend_enable;
+    BlendFactorRGBFunc factor_source_rgb;
+    BlendFactorRGBFunc factor_dest_rgb;
+    BlendFactorAFunc factor_source_a;
+    BlendFactorAFunc factor_dest_a;
+    BlendEquationFunc blend_equation_rgb;
+    BlendEquationFunc blend_equation_a;
+    Math::Vec4<u8> blend_const;
+    LogicOpFunc logic_op;
+
+    bool write_red, write_green, write_blue, write_alpha;
+};
+
+static Input GetInput(Source source) {
+    switch (source) {
+    case Source::PrimaryColor:
+
+    // HACK: Until we implement fragment lighting, use primary_color
+    case Source::PrimaryFragmentColor:
+        return INPUT_PRIMARY_COLOR;
+
+    // HACK: Until we implement fragment lighting, use zero
+    case Source::SecondaryFragmentColor:
+        return INPUT_ZERO;
+
+    case Source::Texture0:
+        return INPUT_TEXTURE0;
 
-                if (output_merger.depth_write_enable)
-                    SetDepth(x >> 4, y >> 4, z);
+    case Source::Texture1:
+        return INPUT_TEXTURE1;
+
+    case Source::Texture2:
+        return INPUT_TEXTURE2;
+
+    case Source::PreviousBuffer:
+        return INPUT_BUFFER;
+
+    case Source::Constant:
+        return INPUT_CONSTANT;
+
+    case Source::Previous:
+        return INPUT_PREVIOUS;
+
+    default:
+        LOG_ERROR(HW_GPU, "Unknown color combiner source %d\n", (int)source);
+        UNIMPLEMENTED();
+        return INPUT_ZERO;
+    }
+}
+
+static ColorModifierFunc GetColorModifierFunc(ColorModifier factor) {
+    switch (factor) {
+    case ColorModifier::SourceColor:         return &GetColorModifier<ColorModifier::SourceColor>;
+    case ColorModifier::OneMinusSourceColor: return &GetColorModifier<ColorModifier::OneMinusSourceColor>;
+    case ColorModifier::SourceAlpha:         return &GetColorModifier<ColorModifier::SourceAlpha>;
+    case ColorModifier::OneMinusSourceAlpha: return &GetColorModifier<ColorModifier::OneMinusSourceAlpha>;
+    case ColorModifier::SourceRed:           return &GetColorModifier<ColorModifier::SourceRed>;
+    case ColorModifier::OneMinusSourceRed:   return &GetColorModifier<ColorModifier::OneMinusSourceRed>;
+    case ColorModifier::SourceGreen:         return &GetColorModifier<ColorModifier::SourceGreen>;
+    case ColorModifier::OneMinusSourceGreen: return &GetColorModifier<ColorModifier::OneMinusSourceGreen>;
+    case ColorModifier::SourceBlue:          return &GetColorModifier<ColorModifier::SourceBlue>;
+    case ColorModifier::OneMinusSourceBlue:  return &GetColorModifier<ColorModifier::OneMinusSourceBlue>;
+    default:
+        LOG_ERROR(HW_GPU, "Unknown color modifier %d\n", (int)factor);
+        UNIMPLEMENTED();
+        return &GetColorModifier<ColorModifier::SourceColor>;
+    }
+}
+
+static AlphaModifierFunc GetAlphaModifierFunc(AlphaModifier factor) {
+    switch (factor) {
+    case AlphaModifier::SourceAlpha:         return &GetAlphaModifier<AlphaModifier::SourceAlpha>;
+    case AlphaModifier::OneMinusSourceAlpha: return &GetAlphaModifier<AlphaModifier::OneMinusSourceAlpha>;
+    case AlphaModifier::SourceRed:           return &GetAlphaModifier<AlphaModifier::SourceRed>;
+    case AlphaModifier::OneMinusSourceRed:   return &GetAlphaModifier<AlphaModifier::OneMinusSourceRed>;
+    case AlphaModifier::SourceGreen:         return &GetAlphaModifier<AlphaModifier::SourceGreen>;
+    case AlphaModifier::OneMinusSourceGreen: return &GetAlphaModifier<AlphaModifier::OneMinusSourceGreen>;
+    case AlphaModifier::SourceBlue:          return &GetAlphaModifier<AlphaModifier::SourceBlue>;
+    case AlphaModifier::OneMinusSourceBlue:  return &GetAlphaModifier<AlphaModifier::OneMinusSourceBlue>;
+    default:
+        LOG_ERROR(HW_GPU, "Unknown alpha modifier %d\n", (int)factor);
+        UNIMPLEMENTED();
+        return &GetAlphaModifier<AlphaModifier::SourceAlpha>;
+    }
+}
+
+#if defined(_M_X64) || defined(__SSE2__)
+static SpanModifierFunc GetSpanColorModifierFunc(ColorModifier factor) {
+    switch (factor) {
+    case ColorModifier::SourceColor:         return &GetSpanColorModifier<ColorModifier::SourceColor>;
+    case ColorModifier::OneMinusSourceColor: return &GetSpanColorModifier<ColorModifier::OneMinusSourceColor>;
+    case ColorModifier::SourceAlpha:         return &GetSpanColorModifier<ColorModifier::SourceAlpha>;
+    case ColorModifier::OneMinusSourceAlpha: return &GetSpanColorModifier<ColorModifier::OneMinusSourceAlpha>;
+    case ColorModifier::SourceRed:           return &GetSpanColorModifier<ColorModifier::SourceRed>;
+    case ColorModifier::OneMinusSourceRed:   return &GetSpanColorModifier<ColorModifier::OneMinusSourceRed>;
+    case ColorModifier::SourceGreen:         return &GetSpanColorModifier<ColorModifier::SourceGreen>;
+    case ColorModifier::OneMinusSourceGreen: return &GetSpanColorModifier<ColorModifier::OneMinusSourceGreen>;
+    case ColorModifier::SourceBlue:          return &GetSpanColorModifier<ColorModifier::SourceBlue>;
+    case ColorModifier::OneMinusSourceBlue:  return &GetSpanColorModifier<ColorModifier::OneMinusSourceBlue>;
+    default:                                 return &GetSpanColorModifier<ColorModifier::SourceColor>;
+    }
+}
+
+static SpanModifierFunc GetSpanAlphaModifierFunc(AlphaModifier factor) {
+    switch (factor) {
+    case AlphaModifier::SourceAlpha:         return &GetSpanAlphaModifier<AlphaModifier::SourceAlpha>;
+    case AlphaModifier::OneMinusSourceAlpha: return &GetSpanAlphaModifier<AlphaModifier::OneMinusSourceAlpha>;
+    case AlphaModifier::SourceRed:           return &GetSpanAlphaModifier<AlphaModifier::SourceRed>;
+    case AlphaModifier::OneMinusSourceRed:   return &GetSpanAlphaModifier<AlphaModifier::OneMinusSourceRed>;
+    case AlphaModifier::SourceGreen:         return &GetSpanAlphaModifier<AlphaModifier::SourceGreen>;
+    case AlphaModifier::OneMinusSourceGreen: return &GetSpanAlphaModifier<AlphaModifier::OneMinusSourceGreen>;
+    case AlphaModifier::SourceBlue:          return &GetSpanAlphaModifier<AlphaModifier::SourceBlue>;
+    case AlphaModifier::OneMinusSourceBlue:  return &GetSpanAlphaModifier<AlphaModifier::OneMinusSourceBlue>;
+    default:                                 return &GetSpanAlphaModifier<AlphaModifier::SourceAlpha>;
+    }
+}
+
+static SpanCombineFunc GetSpanCombineFunc(Operation op) {
+    switch (op) {
+    case Operation::Replace:         return &SpanCombine<Operation::Replace>;
+    case Operation::Modulate:        return &SpanCombine<Operation::Modulate>;
+    case Operation::Add:             return &SpanCombine<Operation::Add>;
+    case Operation::AddSigned:       return &SpanCombine<Operation::AddSigned>;
+    case Operation::Lerp:            return &SpanCombine<Operation::Lerp>;
+    case Operation::Subtract:        return &SpanCombine<Operation::Subtract>;
+    case Operation::MultiplyThenAdd: return &SpanCombine<Operation::MultiplyThenAdd>;
+    case Operation::AddThenMultiply: return &SpanCombine<Operation::AddThenMultiply>;
+    default:                         return &SpanCombine<static_cast<Operation>(~0u)>;
+    }
+}
+#endif
+
+static ColorCombineFunc GetColorCombineFunc(Operation op) {
+    switch (op) {
+    case Operation::Replace:         return &ColorCombine<Operation::Replace>;
+    case Operation::Modulate:        return &ColorCombine<Operation::Modulate>;
+    case Operation::Add:             return &ColorCombine<Operation::Add>;
+    case Operation::AddSigned:       return &ColorCombine<Operation::AddSigned>;
+    case Operation::Lerp:            return &ColorCombine<Operation::Lerp>;
+    case Operation::Subtract:        return &ColorCombine<Operation::Subtract>;
+    case Operation::MultiplyThenAdd: return &ColorCombine<Operation::MultiplyThenAdd>;
+    case Operation::AddThenMultiply: return &ColorCombine<Operation::AddThenMultiply>;
+    default:
+        LOG_ERROR(HW_GPU, "Unknown color combiner operation %d\n", (int)op);
+        UNIMPLEMENTED();
+        return &ColorCombine<static_cast<Operation>(~0u)>;
+    }
+}
+
+static AlphaCombineFunc GetAlphaCombineFunc(Operation op) {
+    switch (op) {
+    case Operation::Replace:         return &AlphaCombine<Operation::Replace>;
+    case Operation::Modulate:        return &AlphaCombine<Operation::Modulate>;
+    case Operation::Add:             return &AlphaCombine<Operation::Add>;
+    case Operation::AddSigned:       return &AlphaCombine<Operation::AddSigned>;
+    case Operation::Lerp:            return &AlphaCombine<Operation::Lerp>;
+    case Operation::Subtract:        return &AlphaCombine<Operation::Subtract>;
+    case Operation::MultiplyThenAdd: return &AlphaCombine<Operation::MultiplyThenAdd>;
+    case Operation::AddThenMultiply: return &AlphaCombine<Operation::AddThenMultiply>;
+    default:
+        LOG_ERROR(HW_GPU, "Unknown alpha combiner operation %d\n", (int)op);
+        UNIMPLEMENTED();
+        return &AlphaCombine<static_cast<Operation>(~0u)>;
+    }
+}
+
+static CompareFunc GetCompareFunc(Regs::CompareFunc func) {
+    switch (func) {
+    case Regs::CompareFunc::Never:              return &Compare<Regs::CompareFunc::Never>;
+    case Regs::CompareFunc::Always:             return &Compare<Regs::CompareFunc::Always>;
+    case Regs::CompareFunc::Equal:              return &Compare<Regs::CompareFunc::Equal>;
+    case Regs::CompareFunc::NotEqual:           return &Compare<Regs::CompareFunc::NotEqual>;
+    case Regs::CompareFunc::LessThan:           return &Compare<Regs::CompareFunc::LessThan>;
+    case Regs::CompareFunc::LessThanOrEqual:    return &Compare<Regs::CompareFunc::LessThanOrEqual>;
+    case Regs::CompareFunc::GreaterThan:        return &Compare<Regs::CompareFunc::GreaterThan>;
+    case Regs::CompareFunc::GreaterThanOrEqual: return &Compare<Regs::CompareFunc::GreaterThanOrEqual>;
+    }
+    UNREACHABLE();
+}
+
+static BlendFactorRGBFunc GetBlendFactorRGBFunc(Regs::BlendFactor factor) {
+    switch (factor) {
+    case Regs::BlendFactor::Zero:                  return &LookupFactorRGB<Regs::BlendFactor::Zero>;
+    case Regs::BlendFactor::One:                   return &LookupFactorRGB<Regs::BlendFactor::One>;
+    case Regs::BlendFactor::SourceColor:           return &LookupFactorRGB<Regs::BlendFactor::SourceColor>;
+    case Regs::BlendFactor::OneMinusSourceColor:   return &LookupFactorRGB<Regs::BlendFactor::OneMinusSourceColor>;
+    case Regs::BlendFactor::DestColor:             return &LookupFactorRGB<Regs::BlendFactor::DestColor>;
+    case Regs::BlendFactor::OneMinusDestColor:     return &LookupFactorRGB<Regs::BlendFactor::OneMinusDestColor>;
+    case Regs::BlendFactor::SourceAlpha:           return &LookupFactorRGB<Regs::BlendFactor::SourceAlpha>;
+    case Regs::BlendFactor::OneMinusSourceAlpha:   return &LookupFactorRGB<Regs::BlendFactor::OneMinusSourceAlpha>;
+    case Regs::BlendFactor::DestAlpha:             return &LookupFactorRGB<Regs::BlendFactor::DestAlpha>;
+    case Regs::BlendFactor::OneMinusDestAlpha:     return &LookupFactorRGB<Regs::BlendFactor::OneMinusDestAlpha>;
+    case Regs::BlendFactor::ConstantColor:         return &LookupFactorRGB<Regs::BlendFactor::ConstantColor>;
+    case Regs::BlendFactor::OneMinusConstantColor: return &LookupFactorRGB<Regs::BlendFactor::OneMinusConstantColor>;
+    case Regs::BlendFactor::ConstantAlpha:         return &LookupFactorRGB<Regs::BlendFactor::ConstantAlpha>;
+    case Regs::BlendFactor::OneMinusConstantAlpha: return &LookupFactorRGB<Regs::BlendFactor::OneMinusConstantAlpha>;
+    default:
+        LOG_CRITICAL(HW_GPU, "Unknown color blend factor %x", factor);
+        UNIMPLEMENTED();
+        return &LookupFactorRGB<Regs::BlendFactor::Zero>;
+    }
+}
+
+static BlendFactorAFunc GetBlendFactorAFunc(Regs::BlendFactor factor) {
+    switch (factor) {
+    case Regs::BlendFactor::Zero:                  return &LookupFactorA<Regs::BlendFactor::Zero>;
+    case Regs::BlendFactor::One:                   return &LookupFactorA<Regs::BlendFactor::One>;
+    case Regs::BlendFactor::SourceAlpha:           return &LookupFactorA<Regs::BlendFactor::SourceAlpha>;
+    case Regs::BlendFactor::OneMinusSourceAlpha:   return &LookupFactorA<Regs::BlendFactor::OneMinusSourceAlpha>;
+    case Regs::BlendFactor::DestAlpha:             return &LookupFactorA<Regs::BlendFactor::DestAlpha>;
+    case Regs::BlendFactor::OneMinusDestAlpha:     return &LookupFactorA<Regs::BlendFactor::OneMinusDestAlpha>;
+    case Regs::BlendFactor::ConstantAlpha:         return &LookupFactorA<Regs::BlendFactor::ConstantAlpha>;
+    case Regs::BlendFactor::OneMinusConstantAlpha: return &LookupFactorA<Regs::BlendFactor::OneMinusConstantAlpha>;
+    default:
+        LOG_CRITICAL(HW_GPU, "Unknown alpha blend factor %x", factor);
+        UNIMPLEMENTED();
+        return &LookupFactorA<Regs::BlendFactor::Zero>;
+    }
+}
+
+static BlendEquationFunc GetBlendEquationFunc(Regs::BlendEquation equation) {
+    switch (equation) {
+    case Regs::BlendEquation::Add:             return &EvaluateBlendEquation<Regs::BlendEquation::Add>;
+    case Regs::BlendEquation::Subtract:        return &EvaluateBlendEquation<Regs::BlendEquation::Subtract>;
+    case Regs::BlendEquation::ReverseSubtract: return &EvaluateBlendEquation<Regs::BlendEquation::ReverseSubtract>;
+    case Regs::BlendEquation::Min:             return &EvaluateBlendEquation<Regs::BlendEquation::Min>;
+    case Regs::BlendEquation::Max:             return &EvaluateBlendEquation<Regs::BlendEquation::Max>;
+    default:
+        LOG_CRITICAL(HW_GPU, "Unknown RGB blend equation %x", equation);
+        UNIMPLEMENTED();
+        return &EvaluateBlendEquation<Regs::BlendEquation::Add>;
+    }
+}
+
+static LogicOpFunc GetLogicOpFunc(Regs::LogicOp op) {
+    switch (op) {
+    case Regs::LogicOp::Clear:        return &LogicOp<Regs::LogicOp::Clear>;
+    case Regs::LogicOp::And:          return &LogicOp<Regs::LogicOp::And>;
+    case Regs::LogicOp::AndReverse:   return &LogicOp<Regs::LogicOp::AndReverse>;
+    case Regs::LogicOp::Copy:         return &LogicOp<Regs::LogicOp::Copy>;
+    case Regs::LogicOp::Set:          return &LogicOp<Regs::LogicOp::Set>;
+    case Regs::LogicOp::CopyInverted: return &LogicOp<Regs::LogicOp::CopyInverted>;
+    case Regs::LogicOp::NoOp:         return &LogicOp<Regs::LogicOp::NoOp>;
+    case Regs::LogicOp::Invert:       return &LogicOp<Regs::LogicOp::Invert>;
+    case Regs::LogicOp::Nand:         return &LogicOp<Regs::LogicOp::Nand>;
+    case Regs::LogicOp::Or:           return &LogicOp<Regs::LogicOp::Or>;
+    case Regs::LogicOp::Nor:          return &LogicOp<Regs::LogicOp::Nor>;
+    case Regs::LogicOp::Xor:          return &LogicOp<Regs::LogicOp::Xor>;
+    case Regs::LogicOp::Equiv:        return &LogicOp<Regs::LogicOp::Equiv>;
+    case Regs::LogicOp::AndInverted:  return &LogicOp<Regs::LogicOp::AndInverted>;
+    case Regs::LogicOp::OrReverse:    return &LogicOp<Regs::LogicOp::OrReverse>;
+    case Regs::LogicOp::OrInverted:   return &LogicOp<Regs::LogicOp::OrInverted>;
+    }
+    UNREACHABLE();
+}
+
+static WrapFunc GetWrapFunc(Regs::TextureConfig::WrapMode mode) {
+    switch (mode) {
+    case Regs::TextureConfig::ClampToEdge:    return &GetWrappedTexCoord<Regs::TextureConfig::ClampToEdge>;
+    case Regs::TextureConfig::Repeat:         return &GetWrappedTexCoord<Regs::TextureConfig::Repeat>;
+    case Regs::TextureConfig::MirroredRepeat: return &GetWrappedTexCoord<Regs::TextureConfig::MirroredRepeat>;
+    default:
+        LOG_ERROR(HW_GPU, "Unknown texture coordinate wrapping mode %x\n", (int)mode);
+        UNIMPLEMENTED();
+        return &GetWrappedTexCoord<static_cast<Regs::TextureConfig::WrapMode>(1)>;
+    }
+}
+
+/// Whether a stage passes on the output of the previous stage unchanged
+static bool IsPassThrough(const Regs::TevStageConfig& stage, bool updates_buffer) {
+    return stage.color_source1 == Source::Previous && stage.color_modifier1 == ColorModifier::SourceColor &&
+           stage.color_op == Operation::Replace && stage.GetColorMultiplier() == 1 &&
+           stage.alpha_source1 == Source::Previous && stage.alpha_modifier1 == AlphaModifier::SourceAlpha &&
+           stage.alpha_op == Operation::Replace && stage.GetAlphaMultiplier() == 1 &&
+           !updates_buffer;
+}
+
+static void Decode(const Regs& regs, Setup& setup) {
+    const auto& tev_stages = DerivedState::GetTevStages();
+    const auto& buffer_input = regs.tev_combiner_buffer_input;
+
+    bool texture_used[3] = {};
+    setup.num_stages = 0;
+    for (unsigned index = 0; index < tev_stages.size(); ++index) {
+        const auto& config = tev_stages[index];
+        const bool updates_buffer_color = buffer_input.TevStageUpdatesCombinerBufferColor(index);
+        const bool updates_buffer_alpha = buffer_input.TevStageUpdatesCombinerBufferAlpha(index);
+        if (IsPassThrough(config, updates_buffer_color || updates_buffer_alpha))
+            continue;
+
+        TevStage& stage = setup.stages[setup.num_stages++];
+        const Source color_sources[3] = { config.color_source1, config.color_source2, config.color_source3 };
+        const Source alpha_sources[3] = { config.alpha_source1, config.alpha_source2, config.alpha_source3 };
+        const ColorModifier color_modifiers[3] = { config.color_modifier1, config.color_modifier2, config.color_modifier3 };
+        const AlphaModifier alpha_modifiers[3] = { config.alpha_modifier1, config.alpha_modifier2, config.alpha_modifier3 };
+        for (int i = 0; i < 3; ++i) {
+            stage.color_inputs[i] = GetInput(color_sources[i]);
+            stage.alpha_inputs[i] = GetInput(alpha_sources[i]);
+            stage.color_modifiers[i] = GetColorModifierFunc(color_modifiers[i]);
+            stage.alpha_modifiers[i] = GetAlphaModifierFunc(alpha_modifiers[i]);
+        }
+        stage.color_combine = GetColorCombineFunc(config.color_op);
+        stage.alpha_combine = GetAlphaCombineFunc(config.alpha_op);
+#if defined(_M_X64) || defined(__SSE2__)
+        for (int i = 0; i < 3; ++i) {
+            stage.span_color_modifiers[i] = GetSpanColorModifierFunc(color_modifiers[i]);
+            stage.span_alpha_modifiers[i] = GetSpanAlphaModifierFunc(alpha_modifiers[i]);
+        }
+        stage.span_color_combine = GetSpanCombineFunc(config.color_op);
+        stage.span_alpha_combine = GetSpanCombineFunc(config.alpha_op);
+#endif
+        stage.color_multiplier = config.GetColorMultiplier();
+        stage.alpha_multiplier = config.GetAlphaMultiplier();
+        stage.constant = { (u8)config.const_r, (u8)config.const_g, (u8)config.const_b, (u8)config.const_a };
+        stage.updates_buffer_color = updates_buffer_color;
+        stage.updates_buffer_alpha = updates_buffer_alpha;
+
+        for (int i = 0; i < 3; ++i) {
+            for (Input input : { stage.color_inputs[i], stage.alpha_inputs[i] }) {
+                if (input >= INPUT_TEXTURE0 && input <= INPUT_TEXTURE2)
+                    texture_used[input - INPUT_TEXTURE0] = true;
             }
+        }
+    }
+    setup.buffer_color = {
+        (u8)regs.tev_combiner_buffer_color.r, (u8)regs.tev_combiner_buffer_color.g,
+        (u8)regs.tev_combiner_buffer_color.b, (u8)regs.tev_combiner_buffer_color.a
+    };
 
-            auto dest = GetPixel(x >> 4, y >> 4);
-            Math::Vec4<u8> blend_output = combiner_output;
+    // Disabled textures read as zero
+    const auto& textures = DerivedState::GetTextures();
+    for (unsigned i = 0; i < textures.size(); ++i) {
+        const auto& config = textures[i];
+        Texture& texture = setup.textures[i];
+        texture.used = config.enabled && texture_used[i];
+        if (!config.enabled) {
+            for (unsigned stage = 0; stage < setup.num_stages; ++stage) {
+                for (int input = 0; input < 3; ++input) {
+                    if (setup.stages[stage].color_inputs[input] == INPUT_TEXTURE0 + i)
+                        setup.stages[stage].color_inputs[input] = INPUT_ZERO;
+                    if (setup.stages[stage].alpha_inputs[input] == INPUT_TEXTURE0 + i)
+                        setup.stages[stage].alpha_inputs[input] = INPUT_ZERO;
+                }
+            }
+        }
+        if (!texture.used)
+            continue;
+
+        DEBUG_ASSERT(0 != config.config.address);
+        texture.width = config.config.width;
+        texture.height = config.config.height;
+        texture.scale_s = float24::FromFloat32(static_cast<float>(config.config.width));
+        texture.scale_t = float24::FromFloat32(static_cast<float>(config.config.height));
+        texture.wrap_s = GetWrapFunc(config.config.wrap_s);
+        texture.wrap_t = GetWrapFunc(config.config.wrap_t);
+        DebugUtils::DumpTexture(config.config, Memory::GetPhysicalPointer(config.config.GetPhysicalAddress()));
+    }
 
-            if (output_merger.alphablend_enable) {
-                auto params = output_merger.alpha_blending;
+    const auto& output_merger = regs.output_merger;
+    setup.alpha_test_enable = output_merger.alpha_test.enable != 0;
+    setup.alpha_test_func = GetCompareFunc(output_merger.alpha_test.func);
+    setup.alpha_test_ref = output_merger.alpha_test.ref;
+
+    setup.depth_test_enable = output_merger.depth_test_enable != 0;
+    setup.depth_test_func = GetCompareFunc(output_merger.depth_test_func);
+    setup.hierarchical_depth_test = setup.depth_test_enable &&
+        (output_merger.depth_test_func == Regs::CompareFunc::LessThan ||
+         output_merger.depth_test_func == Regs::CompareFunc::LessThanOrEqual);
+    setup.depth_test_or_equal = output_merger.depth_test_func == Regs::CompareFunc::LessThanOrEqual;
+    setup.depth_write_enable = output_merger.depth_write_enable != 0;
+    if (setup.depth_test_enable)
+        setup.depth_scale = (1 << Regs::DepthBitsPerPixel(regs.framebuffer.depth_format)) - 1;
+
+    setup.alphablend_enable = output_merger.alphablend_enable != 0;
+    if (setup.alphablend_enable) {
+        const auto& params = output_merger.alpha_blending;
+        setup.factor_source_rgb = GetBlendFactorRGBFunc(params.factor_source_rgb);
+        setup.factor_dest_rgb = GetBlendFactorRGBFunc(params.factor_dest_rgb);
+        setup.factor_source_a = GetBlendFactorAFunc(params.factor_source_a);
+        setup.factor_dest_a = GetBlendFactorAFunc(params.factor_dest_a);
+        setup.blend_equation_rgb = GetBlendEquationFunc(params.blend_equation_rgb);
+        setup.blend_equation_a = GetBlendEquationFunc(params.blend_equation_a);
+        setup.blend_const = {
+            (u8)output_merger.blend_const.r, (u8)output_merger.blend_const.g,
+            (u8)output_merger.blend_const.b, (u8)output_merger.blend_const.a
+        };
+    } else {
+        setup.logic_op = GetLogicOpFunc(output_merger.logic_op);
+    }
 
-                auto LookupFactorRGB = [&](Regs::BlendFactor factor) -> Math::Vec3<u8> {
-                    switch (factor) {
-                    case Regs::BlendFactor::Zero :
-                        return Math::Vec3<u8>(0, 0, 0);
+    setup.write_red = output_merger.red_enable != 0;
+    setup.write_green = output_merger.green_enable != 0;
+    setup.write_blue = output_merger.blue_enable != 0;
+    setup.write_alpha = output_merger.alpha_enable != 0;
+}
 
-                    case Regs::BlendFactor::One :
-                        return Math::Vec3<u8>(255, 255, 255);
+/// Combiner inputs that vary per fragment, for the fragments of a row of a block
+struct Span {
+    unsigned count;
+    Math::Vec4<u8> primary_color[BLOCK_SIZE];
+    Math::Vec4<u8> textures[3][BLOCK_SIZE];
+};
 
-                    case Regs::BlendFactor::SourceColor:
-                        return combiner_output.rgb();
+#if defined(_M_X64) || defined(__SSE2__)
+/// Loads the components of two fragments into 16-bit lanes
+static __m128i LoadFragments(const Math::Vec4<u8>* colors) {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(colors)), _mm_setzero_si128());
+}
 
-                    case Regs::BlendFactor::OneMinusSourceColor:
-                        return Math::Vec3<u8>(255 - combiner_output.r(), 255 - combiner_output.g(), 255 - combiner_output.b());
+static __m128i BroadcastColor(const Math::Vec4<u8>& color) {
+    return _mm_set_epi16(color.a(), color.b(), color.g(), color.r(), color.a(), color.b(), color.g(), color.r());
+}
 
-                    case Regs::BlendFactor::DestColor:
-                        return dest.rgb();
+/// Blends the alpha lanes of alpha into color
+static __m128i SelectAlpha(__m128i color, __m128i alpha, __m128i alpha_mask) {
+    return _mm_or_si128(_mm_andnot_si128(alpha_mask, color), _mm_and_si128(alpha_mask, alpha));
+}
+#endif
 
-                    case Regs::BlendFactor::OneMinusDestColor:
-                        return Math::Vec3<u8>(255 - dest.r(), 255 - dest.g(), 255 - dest.b());
+/**
+ * Runs the texture combiner stages on a span of fragments, writing their outputs.
+ *
+ * Texture environment - consists of 6 stages of color and alpha combining.
+ *
+ * Color combiners take three input color values from some source (e.g. interpolated vertex color,
+ * texture color, previous stage, etc), perform some very simple operations on each of them (e.g.
+ * inversion) and then calculate the output color with some basic arithmetic. Alpha combiners can
+ * be configured separately but work analogously. Stages passing on the previous output unchanged
+ * have been left out.
+ */
+static void CombineSpan(const Setup& setup, const Span& span, Math::Vec4<u8> output[BLOCK_SIZE]) {
+#if defined(_M_X64) || defined(__SSE2__)
+    static_assert(sizeof(Math::Vec4<u8>) == 4, "Fragments have to be packed for LoadFragments");
+    static_assert(BLOCK_SIZE % 2 == 0, "Spans are combined two fragments at a time");
+
+    // Each register holds two fragments. Lanes are unsigned components, their sums and products
+    // fit as long as they are divided by 255 right away.
+    const __m128i alpha_mask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    for (unsigned first = 0; first < span.count; first += 2) {
+        __m128i inputs[NUM_INPUTS];
+        inputs[INPUT_PRIMARY_COLOR] = LoadFragments(&span.primary_color[first]);
+        inputs[INPUT_ZERO] = _mm_setzero_si128();
+        for (int i = 0; i < 3; ++i) {
+            if (setup.textures[i].used)
+                inputs[INPUT_TEXTURE0 + i] = LoadFragments(&span.textures[i][first]);
+        }
+        inputs[INPUT_BUFFER] = BroadcastColor(setup.buffer_color);
+        inputs[INPUT_PREVIOUS] = _mm_setzero_si128();
 
-                    case Regs::BlendFactor::SourceAlpha:
-                        return Math::Vec3<u8>(combiner_output.a(), combiner_output.a(), combiner_output.a());
+        for (unsigned stage_index = 0; stage_index < setup.num_stages; ++stage_index) {
+            const auto& tev_stage = setup.stages[stage_index];
+            inputs[INPUT_CONSTANT] = BroadcastColor(tev_stage.constant);
 
-                    case Regs::BlendFactor::OneMinusSourceAlpha:
-                        return Math::Vec3<u8>(255 - combiner_output.a(), 255 - combiner_output.a(), 255 - combiner_output.a());
+            __m128i arguments[3];
+            for (int i = 0; i < 3; ++i) {
+                arguments[i] = SelectAlpha(tev_stage.span_color_modifiers[i](inputs[tev_stage.color_inputs[i]]),
+                                           tev_stage.span_alpha_modifiers[i](inputs[tev_stage.alpha_inputs[i]]),
+                                           alpha_mask);
+            }
 
-                    case Regs::BlendFactor::DestAlpha:
-                        return Math::Vec3<u8>(dest.a(), dest.a(), dest.a());
+            __m128i result = tev_stage.span_color_combine(arguments);
+            if (tev_stage.span_alpha_combine != tev_stage.span_color_combine)
+                result = SelectAlpha(result, tev_stage.span_alpha_combine(arguments), alpha_mask);
+
+            const short color_multiplier = tev_stage.color_multiplier;
+            const short alpha_multiplier = tev_stage.alpha_multiplier;
+            const __m128i multipliers = _mm_set_epi16(alpha_multiplier, color_multiplier, color_multiplier, color_multiplier,
+                                                      alpha_multiplier, color_multiplier, color_multiplier, color_multiplier);
+            inputs[INPUT_PREVIOUS] = _mm_min_epi16(_mm_mullo_epi16(result, multipliers), _mm_set1_epi16(255));
+
+            const short update_color = tev_stage.updates_buffer_color ? -1 : 0;
+            const short update_alpha = tev_stage.updates_buffer_alpha ? -1 : 0;
+            const __m128i update_mask = _mm_set_epi16(update_alpha, update_color, update_color, update_color,
+                                                      update_alpha, update_color, update_color, update_color);
+            inputs[INPUT_BUFFER] = _mm_or_si128(_mm_andnot_si128(update_mask, inputs[INPUT_BUFFER]),
+                                                _mm_and_si128(update_mask, inputs[INPUT_PREVIOUS]));
+        }
 
-                    case Regs::BlendFactor::OneMinusDestAlpha:
-                        return Math::Vec3<u8>(255 - dest.a(), 255 - dest.a(), 255 - dest.a());
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&output[first]),
+                         _mm_packus_epi16(inputs[INPUT_PREVIOUS], inputs[INPUT_PREVIOUS]));
+    }
+#else
+    for (unsigned fragment = 0; fragment < span.count; ++fragment) {
+        Math::Vec4<u8> inputs[NUM_INPUTS];
+        inputs[INPUT_PRIMARY_COLOR] = span.primary_color[fragment];
+        inputs[INPUT_ZERO] = {0, 0, 0, 0};
+        for (int i = 0; i < 3; ++i) {
+            if (setup.textures[i].used)
+                inputs[INPUT_TEXTURE0 + i] = span.textures[i][fragment];
+        }
+        inputs[INPUT_BUFFER] = setup.buffer_color;
+        inputs[INPUT_PREVIOUS] = {0, 0, 0, 0};
+
+        Math::Vec4<u8>& combiner_output = inputs[INPUT_PREVIOUS];
+        Math::Vec4<u8>& combiner_buffer = inputs[INPUT_BUFFER];
+
+        for (unsigned stage_index = 0; stage_index < setup.num_stages; ++stage_index) {
+            const auto& tev_stage = setup.stages[stage_index];
+            inputs[INPUT_CONSTANT] = tev_stage.constant;
+
+            // color combiner
+            // NOTE: Not sure if the alpha combiner might use the color output of the previous
+            //       stage as input. Hence, we currently don't directly write the result to
+            //       combiner_output.rgb(), but instead store it in a temporary variable until
+            //       alpha combining has been done.
+            Math::Vec3<u8> color_result[3] = {
+                tev_stage.color_modifiers[0](inputs[tev_stage.color_inputs[0]]),
+                tev_stage.color_modifiers[1](inputs[tev_stage.color_inputs[1]]),
+                tev_stage.color_modifiers[2](inputs[tev_stage.color_inputs[2]])
+            };
+            auto color_output = tev_stage.color_combine(color_result);
+
+            // alpha combiner
+            std::array<u8,3> alpha_result = {{
+                tev_stage.alpha_modifiers[0](inputs[tev_stage.alpha_inputs[0]]),
+                tev_stage.alpha_modifiers[1](inputs[tev_stage.alpha_inputs[1]]),
+                tev_stage.alpha_modifiers[2](inputs[tev_stage.alpha_inputs[2]])
+            }};
+            auto alpha_output = tev_stage.alpha_combine(alpha_result);
+
+            combiner_output[0] = std::min((unsigned)255, color_output.r() * tev_stage.color_multiplier);
+            combiner_output[1] = std::min((unsigned)255, color_output.g() * tev_stage.color_multiplier);
+            combiner_output[2] = std::min((unsigned)255, color_output.b() * tev_stage.color_multiplier);
+            combiner_output[3] = std::min((unsigned)255, alpha_output * tev_stage.alpha_multiplier);
+
+            if (tev_stage.updates_buffer_color) {
+                combiner_buffer.r() = combiner_output.r();
+                combiner_buffer.g() = combiner_output.g();
+                combiner_buffer.b() = combiner_output.b();
+            }
 
-                    case Regs::BlendFactor::ConstantColor:
-                        return Math::Vec3<u8>(output_merger.blend_const.r, output_merger.blend_const.g, output_merger.blend_const.b);
+            if (tev_stage.updates_buffer_alpha) {
+                combiner_buffer.a() = combiner_output.a();
+            }
+        }
 
-                    case Regs::BlendFactor::OneMinusConstantColor:
-                        return Math::Vec3<u8>(255 - output_merger.blend_const.r, 255 - output_merger.blend_const.g, 255 - output_merger.blend_const.b);
+        output[fragment] = combiner_output;
+    }
+#endif
+}
 
-                    case Regs::BlendFactor::ConstantAlpha:
-                        return Math::Vec3<u8>(output_merger.blend_const.a, output_merger.blend_const.a, output_merger.blend_const.a);
+/// Largest number of setups kept around, the cache is cleared when it grows beyond that
+static const size_t MAX_CACHED_SETUPS = 256;
 
-                    case Regs::BlendFactor::OneMinusConstantAlpha:
-                        return Math::Vec3<u8>(255 - output_merger.blend_const.a, 255 - output_merger.blend_const.a, 255 - output_merger.blend_const.a);
+/// Setups of the fragment pipeline, by a hash of the register words they were decoded from
+static std::unordered_map<u64, std::unique_ptr<Setup>> setup_cache;
 
-                    default:
-                        LOG_CRITICAL(HW_GPU, "Unknown color blend factor %x", factor);
-                        UNIMPLEMENTED();
-                        break;
-                    }
-                };
+/// Decoded textures are dropped once they take more memory than this, nothing holds on to them between draws
+static const size_t MAX_CACHED_TEXTURE_BYTES = 64 * 1024 * 1024;
+
+/// Returns the setup for the current registers, decoding it if it isn't cached yet
+static Setup& LookupSetup() {
+    const u32* registers = &g_state.regs[FIRST_REGISTER];
+
+    // FNV-1a
+    u64 hash = 0xCBF29CE484222325ULL;
+    for (u32 i = 0; i < NUM_REGISTERS; ++i)
+        hash = (hash ^ registers[i]) * 0x100000001B3ULL;
+
+    std::unique_ptr<Setup>& setup = setup_cache[hash];
+    if (setup != nullptr && std::equal(setup->registers.begin(), setup->registers.end(), registers))
+        return *setup;
+
+    if (setup_cache.size() > MAX_CACHED_SETUPS) {
+        setup_cache.clear();
+        return LookupSetup();
+    }
+
+    if (setup == nullptr)
+        setup.reset(new Setup);
+    std::copy(registers, registers + NUM_REGISTERS, setup->registers.begin());
+    Decode(g_state.regs, *setup);
+    return *setup;
+}
+
+/// Returns the setup for the current registers with its textures bound to their decoded texels
+static const Setup& GetSetup() {
+    Setup& setup = LookupSetup();
 
-                auto LookupFactorA = [&](Regs::BlendFactor factor) -> u8 {
-                    switch (factor) {
-                    case Regs::BlendFactor::Zero:
-                        return 0;
+    if (TextureCache::GetCachedSize() > MAX_CACHED_TEXTURE_BYTES)
+        TextureCache::FullFlush();
 
-                    case Regs::BlendFactor::One:
-                        return 255;
+    const auto& textures = DerivedState::GetTextures();
+    for (unsigned i = 0; i < textures.size(); ++i) {
+        if (setup.textures[i].used)
+            setup.textures[i].cached = &TextureCache::GetTexture(textures[i]);
+    }
+    return setup;
+}
 
-                    case Regs::BlendFactor::SourceAlpha:
-                        return combiner_output.a();
+} // namespace FragmentPipeline
 
-                    case Regs::BlendFactor::OneMinusSourceAlpha:
-                        return 255 - combiner_output.a();
+/// A triangle that passed culling, set up for drawing its pixels
+struct Triangle {
+    // Per-vertex values the pixels interpolate, gathered per attribute. Only the texture
+    // coordinates of the textures the pipeline samples are set.
+    Math::Vec3<float24> w_inverse;
+    Math::Vec3<float24> depth;
+    Math::Vec3<float24> color_attributes[4];
+    Math::Vec3<float24> uv_attributes[3][2];
 
-                    case Regs::BlendFactor::DestAlpha:
-                        return dest.a();
+    // Vertex positions in rasterizer coordinates
+    Math::Vec3<Fix12P4> vtxpos[3];
 
-                    case Regs::BlendFactor::OneMinusDestAlpha:
-                        return 255 - dest.a();
+    // Biases implementing the triangle filling rules
+    int bias0, bias1, bias2;
 
-                    case Regs::BlendFactor::ConstantAlpha:
-                        return output_merger.blend_const.a;
+    // Bounding box in rasterizer coordinates
+    u16 min_x, min_y, max_x, max_y;
 
-                    case Regs::BlendFactor::OneMinusConstantAlpha:
-                        return 255 - output_merger.blend_const.a;
+    const FragmentPipeline::Setup* pipeline;
+    RenderTarget* target;
+};
 
-                    default:
-                        LOG_CRITICAL(HW_GPU, "Unknown alpha blend factor %x", factor);
-                        UNIMPLEMENTED();
-                        break;
-                    }
+/**
+ * Draws the pixels of a triangle that lie inside the given rectangle, which is in rasterizer
+ * coordinates and has to be aligned to whole pixels.
+ */
+static void DrawTriangle(const Triangle& triangle, u16 min_x, u16 min_y, u16 max_x, u16 max_y) {
+    const auto& w_inverse = triangle.w_inverse;
+    const auto& depth = triangle.depth;
+    const auto& color_attributes = triangle.color_attributes;
+    const auto& uv_attributes = triangle.uv_attributes;
+    const auto& vtxpos = triangle.vtxpos;
+    const int bias0 = triangle.bias0;
+    const int bias1 = triangle.bias1;
+    const int bias2 = triangle.bias2;
+    const auto& pipeline = *triangle.pipeline;
+    RenderTarget& target = *triangle.target;
+
+    // Pixels are addressed relative to the center of the topleft bounding box corner
+    const u16 origin_x = min_x + 8;
+    const u16 origin_y = min_y + 8;
+    const int num_pixels_x = (max_x > min_x) ? (max_x - min_x) >> 4 : 0;
+    const int num_pixels_y = (max_y > min_y) ? (max_y - min_y) >> 4 : 0;
+
+    // The barycentric coordinates w0, w1 and w2 of each pixel
+    const EdgeFunction edges[3] = {
+        EdgeFunction(vtxpos[1].xy(), vtxpos[2].xy(), bias0, origin_x, origin_y),
+        EdgeFunction(vtxpos[2].xy(), vtxpos[0].xy(), bias1, origin_x, origin_y),
+        EdgeFunction(vtxpos[0].xy(), vtxpos[1].xy(), bias2, origin_x, origin_y),
+    };
+
+    // Depth of the pixel with the given barycentric coordinates, scaled to the depth buffer format
+    const int wsum = edges[0].At(0, 0) + edges[1].At(0, 0) + edges[2].At(0, 0);
+    auto GetDepthAt = [&](int w0, int w1, int w2) {
+        return (depth[0].ToFloat32() * w0 +
+                depth[1].ToFloat32() * w1 +
+                depth[2].ToFloat32() * w2) * pipeline.depth_scale / wsum;
+    };
+
+    // Blocks are aligned to the 8x8 pixel tiles of the hierarchical depth buffer, the first and last
+    // ones are clipped to the pixels inside the bounding box
+    const int first_pixel_x = origin_x >> 4;
+    const int first_pixel_y = origin_y >> 4;
+    for (int block_y = -(first_pixel_y % BLOCK_SIZE); block_y < num_pixels_y; block_y += BLOCK_SIZE) {
+        const int start_y = std::max(block_y, 0);
+        const int end_y = std::min(block_y + BLOCK_SIZE, num_pixels_y);
+
+        for (int block_x = -(first_pixel_x % BLOCK_SIZE); block_x < num_pixels_x; block_x += BLOCK_SIZE) {
+            const int start_x = std::max(block_x, 0);
+            const int end_x = std::min(block_x + BLOCK_SIZE, num_pixels_x);
+
+            // Since the edge functions are linear, they take their largest value inside the block
+            // at one of its corners. If that is negative, the block is entirely outside the triangle.
+            const int last_x = end_x - 1;
+            const int last_y = end_y - 1;
+            bool block_outside = false;
+            for (const EdgeFunction& edge : edges) {
+                const int largest = std::max({ edge.At(start_x, start_y), edge.At(last_x, start_y),
+                                               edge.At(start_x, last_y), edge.At(last_x, last_y) });
+                block_outside |= largest < 0;
+            }
+            if (block_outside)
+                continue;
+
+            // The depth is linear too, so the block is occluded if the depth test fails for its
+            // smallest corner depth against the largest depth of the tile
+            u32 tile_max_depth;
+            if (pipeline.hierarchical_depth_test &&
+                    GetTileMaxDepth(target, first_pixel_x + start_x, first_pixel_y + start_y, tile_max_depth)) {
+                auto DepthAtPixel = [&](int pixel_x, int pixel_y) {
+                    return GetDepthAt(edges[0].At(pixel_x, pixel_y), edges[1].At(pixel_x, pixel_y),
+                                      edges[2].At(pixel_x, pixel_y));
                 };
+                const float smallest = std::min({ DepthAtPixel(start_x, start_y), DepthAtPixel(last_x, start_y),
+                                                  DepthAtPixel(start_x, last_y), DepthAtPixel(last_x, last_y) });
+                // One less to make up for the rounding of the depth values of the pixels
+                const u32 block_min_depth = (u32)std::max(smallest - 1.0f, 0.0f);
+                if (pipeline.depth_test_or_equal ? block_min_depth > tile_max_depth
+                                                 : block_min_depth >= tile_max_depth)
+                    continue;
+            }
 
-                static auto EvaluateBlendEquation = [](const Math::Vec4<u8>& src, const Math::Vec4<u8>& srcfactor,
-                                                       const Math::Vec4<u8>& dest, const Math::Vec4<u8>& destfactor,
-                                                       Regs::BlendEquation equation) {
-                    Math::Vec4<int> result;
-
-                    auto src_result = (src  *  srcfactor).Cast<int>();
-                    auto dst_result = (dest * destfactor).Cast<int>();
-
-                    switch (equation) {
-                    case Regs::BlendEquation::Add:
-                        result = (src_result + dst_result) / 255;
-                        break;
-
-                    case Regs::BlendEquation::Subtract:
-                        result = (src_result - dst_result) / 255;
-                        break;
-
-                    case Regs::BlendEquation::ReverseSubtract:
-                        result = (dst_result - src_result) / 255;
-                        break;
-
-                    // TODO: How do these two actually work?
-                    //       OpenGL doesn't include the blend factors in the min/max computations,
-                    //       but is this what the 3DS actually does?
-                    case Regs::BlendEquation::Min:
-                        result.r() = std::min(src.r(), dest.r());
-                        result.g() = std::min(src.g(), dest.g());
-                        result.b() = std::min(src.b(), dest.b());
-                        result.a() = std::min(src.a(), dest.a());
-                        break;
-
-                    case Regs::BlendEquation::Max:
-                        result.r() = std::max(src.r(), dest.r());
-                        result.g() = std::max(src.g(), dest.g());
-                        result.b() = std::max(src.b(), dest.b());
-                        result.a() = std::max(src.a(), dest.a());
-                        break;
-
-                    default:
-                        LOG_CRITICAL(HW_GPU, "Unknown RGB blend equation %x", equation);
-                        UNIMPLEMENTED();
+            for (int pixel_y = start_y; pixel_y < end_y; ++pixel_y) {
+                const u16 y = origin_y + pixel_y * 0x10;
+                const u32 coverage = GetRowCoverage(edges, block_x, pixel_y);
+
+                // The fragments of the row are gathered into a span, which goes through the texture
+                // combiners at once before the output merger handles each fragment again
+                FragmentPipeline::Span span;
+                span.count = 0;
+                u16 span_x[BLOCK_SIZE];
+                u32 span_z[BLOCK_SIZE];
+
+                int w0 = edges[0].At(start_x, pixel_y);
+                int w1 = edges[1].At(start_x, pixel_y);
+                int w2 = edges[2].At(start_x, pixel_y);
+
+                for (int pixel_x = start_x; pixel_x < end_x;
+                     ++pixel_x, w0 += edges[0].step_x, w1 += edges[1].step_x, w2 += edges[2].step_x) {
+                    const u16 x = origin_x + pixel_x * 0x10;
+
+                    // If current pixel is not covered by the current primitive
+                    if (!(coverage & (1 << (pixel_x - block_x))))
+                        continue;
+
+                    // The depth test doesn't depend on the texturing and the texture combiners, so
+                    // occluded pixels are rejected before those run. Depth is only written once the
+                    // pixel passed the alpha test too.
+                    u32 z = 0;
+                    if (pipeline.depth_test_enable) {
+                        z = (u32)GetDepthAt(w0, w1, w2);
+                        u32 ref_z = GetDepth(target, x >> 4, y >> 4);
+
+                        if (!pipeline.depth_test_func(z, ref_z))
+                            continue;
                     }
 
-                    return Math::Vec4<u8>(MathUtil::Clamp(result.r(), 0, 255),
-                                    MathUtil::Clamp(result.g(), 0, 255),
-                                    MathUtil::Clamp(result.b(), 0, 255),
-                                    MathUtil::Clamp(result.a(), 0, 255));
-                };
+                    auto baricentric_coordinates = Math::MakeVec(float24::FromFloat32(static_cast<float>(w0)),
+                                                        float24::FromFloat32(static_cast<float>(w1)),
+                                                        float24::FromFloat32(static_cast<float>(w2)));
+                    float24 interpolated_w_inverse = float24::FromFloat32(1.0f) / Math::Dot(w_inverse, baricentric_coordinates);
+
+                    // Perspective correct attribute interpolation:
+                    // Attribute values cannot be calculated by simple linear interpolation since
+                    // they are not linear in screen space. For example, when interpolating a
+                    // texture coordinate across two vertices, something simple like
+                    //     u = (u0*w0 + u1*w1)/(w0+w1)
+                    // will not work. However, the attribute value divided by the
+                    // clipspace w-coordinate (u/w) and and the inverse w-coordinate (1/w) are linear
+                    // in screenspace. Hence, we can linearly interpolate these two independently and
+                    // calculate the interpolated attribute by dividing the results.
+                    // I.e.
+                    //     u_over_w   = ((u0/v0.pos.w)*w0 + (u1/v1.pos.w)*w1)/(w0+w1)
+                    //     one_over_w = (( 1/v0.pos.w)*w0 + ( 1/v1.pos.w)*w1)/(w0+w1)
+                    //     u = u_over_w / one_over_w
+                    //
+                    // The generalization to three vertices is straightforward in baricentric coordinates.
+                    auto GetInterpolatedAttribute = [&](const Math::Vec3<float24>& attr_over_w) {
+                        float24 interpolated_attr_over_w = Math::Dot(attr_over_w, baricentric_coordinates);
+                        return interpolated_attr_over_w * interpolated_w_inverse;
+                    };
+
+                    const unsigned fragment = span.count++;
+                    span_x[fragment] = x;
+                    span_z[fragment] = z;
+                    span.primary_color[fragment] = {
+                        (u8)(GetInterpolatedAttribute(color_attributes[0]).ToFloat32() * 255),
+                        (u8)(GetInterpolatedAttribute(color_attributes[1]).ToFloat32() * 255),
+                        (u8)(GetInterpolatedAttribute(color_attributes[2]).ToFloat32() * 255),
+                        (u8)(GetInterpolatedAttribute(color_attributes[3]).ToFloat32() * 255)
+                    };
+
+                    auto GetInterpolatedUV = [&](int i) {
+                        return Math::MakeVec(GetInterpolatedAttribute(uv_attributes[i][0]),
+                                             GetInterpolatedAttribute(uv_attributes[i][1]));
+                    };
+
+                    for (int i = 0; i < 3; ++i) {
+                        const auto& texture = pipeline.textures[i];
+                        if (!texture.used)
+                            continue;
+
+                        const auto uv = GetInterpolatedUV(i);
+                        int s = (int)(uv.u() * texture.scale_s).ToFloat32();
+                        int t = (int)(uv.v() * texture.scale_t).ToFloat32();
+
+                        // Textures are laid out from bottom to top, hence we invert the t coordinate.
+                        // NOTE: This may not be the right place for the inversion.
+                        // TODO: Check if this applies to ETC textures, too.
+                        s = texture.wrap_s(s, texture.width);
+                        t = texture.height - 1 - texture.wrap_t(t, texture.height);
+
+                        span.textures[i][fragment] = texture.cached->Lookup(s, t);
+                    }
+                }
 
-                auto srcfactor = Math::MakeVec(LookupFactorRGB(params.factor_source_rgb),
-                                               LookupFactorA(params.factor_source_a));
-                auto dstfactor = Math::MakeVec(LookupFactorRGB(params.factor_dest_rgb),
-                                               LookupFactorA(params.factor_dest_a));
+                if (span.count == 0)
+                    continue;
 
-                blend_output     = EvaluateBlendEquation(combiner_output, srcfactor, dest, dstfactor, params.blend_equation_rgb);
-                blend_output.a() = EvaluateBlendEquation(combiner_output, srcfactor, dest, dstfactor, params.blend_equation_a).a();
-            } else {
-                static auto LogicOp = [](u8 src, u8 dest, Regs::LogicOp op) -> u8 {
-                    switch (op) {
-                    case Regs::LogicOp::Clear:
-                        return 0;
+                Math::Vec4<u8> combiner_outputs[BLOCK_SIZE];
+                FragmentPipeline::CombineSpan(pipeline, span, combiner_outputs);
+
+                for (unsigned fragment = 0; fragment < span.count; ++fragment) {
+                    const u16 x = span_x[fragment];
+                    const Math::Vec4<u8>& combiner_output = combiner_outputs[fragment];
+
+                    if (pipeline.alpha_test_enable && !pipeline.alpha_test_func(combiner_output.a(), pipeline.alpha_test_ref))
+                        continue;
+
+                    // TODO: Does depth indeed only get written even if depth testing is enabled?
+                    if (pipeline.depth_test_enable && pipeline.depth_write_enable)
+                        SetDepth(target, x >> 4, y >> 4, span_z[fragment]);
+
+                    auto dest = GetPixel(target, x >> 4, y >> 4);
+                    Math::Vec4<u8> blend_output = combiner_output;
+
+                    if (pipeline.alphablend_enable) {
+                        const auto& constant = pipeline.blend_const;
+                        auto srcfactor = Math::MakeVec(pipeline.factor_source_rgb(combiner_output, dest, constant),
+                                                       pipeline.factor_source_a(combiner_output, dest, constant));
+                        auto dstfactor = Math::MakeVec(pipeline.factor_dest_rgb(combiner_output, dest, constant),
+                                                       pipeline.factor_dest_a(combiner_output, dest, constant));
+
+                        blend_output     = pipeline.blend_equation_rgb(combiner_output, srcfactor, dest, dstfactor);
+                        blend_output.a() = pipeline.blend_equation_a(combiner_output, srcfactor, dest, dstfactor).a();
+                    } else {
+                        blend_output = Math::MakeVec(
+                            pipeline.logic_op(combiner_output.r(), dest.r()),
+                            pipeline.logic_op(combiner_output.g(), dest.g()),
+                            pipeline.logic_op(combiner_output.b(), dest.b()),
+                            pipeline.logic_op(combiner_output.a(), dest.a()));
+                    }
 
-                    case Regs::LogicOp::And:
-                        return src & dest;
+                    const Math::Vec4<u8> result = {
+                        pipeline.write_red   ? blend_output.r() : dest.r(),
+                        pipeline.write_green ? blend_output.g() : dest.g(),
+                        pipeline.write_blue  ? blend_output.b() : dest.b(),
+                        pipeline.write_alpha ? blend_output.a() : dest.a()
+                    };
 
-                    case Regs::LogicOp::AndReverse:
-                        return src & ~dest;
+                    DrawPixel(target, x >> 4, y >> 4, result);
+                }
+            }
+        }
+    }
+}
 
-                    case Regs::LogicOp::Copy:
-                        return src;
+static Common::Profiling::TimingCategory rasterization_category("Rasterization");
 
-                    case Regs::LogicOp::Set:
-                        return 255;
+/// Width and height of the screen tiles triangles are binned into, in pixels
+static const unsigned TILE_SIZE = 32;
 
-                    case Regs::LogicOp::CopyInverted:
-                        return ~src;
+/// Draws with fewer triangles are drawn on the emulation thread alone, waking up the workers costs more
+static const size_t MIN_TRIANGLES_FOR_WORKERS = 16;
 
-                    case Regs::LogicOp::NoOp:
-                        return dest;
+/**
+ * Draws triangles with jobs of the shared job system. Triangles are binned into the screen tiles
+ * their bounding box touches and only drawn on Flush, when every job draws whole tiles. Each tile
+ * draws its triangles in the order they were submitted and every pixel is part of exactly one
+ * tile, so the result is the same as drawing all triangles one after another.
+ */
+class TiledRasterizer {
+public:
+    /// @param num_workers Number of jobs drawing tiles, the thread calling Flush draws tiles as well
+    explicit TiledRasterizer(unsigned num_workers) : num_workers(num_workers) {
+    }
 
-                    case Regs::LogicOp::Invert:
-                        return ~dest;
+    unsigned GetNumWorkers() const {
+        return num_workers;
+    }
 
-                    case Regs::LogicOp::Nand:
-                        return ~(src & dest);
+    void AddTriangle(const Triangle& triangle) {
+        // The registers can't change before the next flush, so the first triangle sets up the grid
+        if (triangles.empty()) {
+            const auto& framebuffer = g_state.regs.framebuffer;
+            tiles_x = std::max(1u, (framebuffer.GetWidth() + TILE_SIZE - 1) / TILE_SIZE);
+            tiles_y = std::max(1u, (framebuffer.GetHeight() + TILE_SIZE - 1) / TILE_SIZE);
+            if (bins.size() < tiles_x * tiles_y)
+                bins.resize(tiles_x * tiles_y);
+        }
 
-                    case Regs::LogicOp::Or:
-                        return src | dest;
+        // Empty bounding boxes don't cover any pixels
+        if (triangle.max_x <= triangle.min_x || triangle.max_y <= triangle.min_y)
+            return;
 
-                    case Regs::LogicOp::Nor:
-                        return ~(src | dest);
+        // Pixels are 16 units wide in rasterizer coordinates. Pixels outside the framebuffer
+        // belong to the tiles on its right and bottom borders.
+        const unsigned first_x = std::min(triangle.min_x / 16u / TILE_SIZE, tiles_x - 1);
+        const unsigned last_x = std::min((triangle.max_x - 1u) / 16u / TILE_SIZE, tiles_x - 1);
+        const unsigned first_y = std::min(triangle.min_y / 16u / TILE_SIZE, tiles_y - 1);
+        const unsigned last_y = std::min((triangle.max_y - 1u) / 16u / TILE_SIZE, tiles_y - 1);
+
+        const u32 index = static_cast<u32>(triangles.size());
+        triangles.push_back(triangle);
+        for (unsigned tile_y = first_y; tile_y <= last_y; ++tile_y) {
+            for (unsigned tile_x = first_x; tile_x <= last_x; ++tile_x)
+                bins[tile_y * tiles_x + tile_x].push_back(index);
+        }
+    }
 
-                    case Regs::LogicOp::Xor:
-                        return src ^ dest;
+    /// Draws all triangles added so far and waits for them to be finished
+    void Flush() {
+        if (triangles.empty())
+            return;
 
-                    case Regs::LogicOp::Equiv:
-                        return ~(src ^ dest);
+        Common::Profiling::ScopeTimer timer(rasterization_category);
 
-                    case Regs::LogicOp::AndInverted:
-                        return ~src & dest;
+        next_tile = 0;
+        Common::JobSystem::JobCounter counter;
+        if (triangles.size() >= MIN_TRIANGLES_FOR_WORKERS) {
+            for (unsigned i = 0; i < num_workers; ++i)
+                Common::JobSystem::Spawn([this] { DrawTiles(); }, &counter);
+        }
 
-                    case Regs::LogicOp::OrReverse:
-                        return src | ~dest;
+        DrawTiles();
+        counter.Wait();
 
-                    case Regs::LogicOp::OrInverted:
-                        return ~src | dest;
-                    }
-                };
+        triangles.clear();
+        for (unsigned tile = 0; tile < tiles_x * tiles_y; ++tile)
+            bins[tile].clear();
+    }
 
-                blend_output = Math::MakeVec(
-                    LogicOp(combiner_output.r(), dest.r(), output_merger.logic_op),
-                    LogicOp(combiner_output.g(), dest.g(), output_merger.logic_op),
-                    LogicOp(combiner_output.b(), dest.b(), output_merger.logic_op),
-                    LogicOp(combiner_output.a(), dest.a(), output_merger.logic_op));
+private:
+    /// Draws tiles not taken by any other thread until all of them are done
+    void DrawTiles() {
+        const unsigned num_tiles = tiles_x * tiles_y;
+        for (unsigned tile = next_tile++; tile < num_tiles; tile = next_tile++) {
+            const unsigned tile_x = tile % tiles_x;
+            const unsigned tile_y = tile / tiles_x;
+
+            // Tiles on the right and bottom border extend to the end of the coordinate range
+            const u16 min_x = static_cast<u16>(tile_x * TILE_SIZE * 16);
+            const u16 min_y = static_cast<u16>(tile_y * TILE_SIZE * 16);
+            const unsigned end_x = (tile_x == tiles_x - 1) ? 0x10000 : (tile_x + 1) * TILE_SIZE * 16;
+            const unsigned end_y = (tile_y == tiles_y - 1) ? 0x10000 : (tile_y + 1) * TILE_SIZE * 16;
+
+            for (u32 index : bins[tile]) {
+                const Triangle& triangle = triangles[index];
+                DrawTriangle(triangle,
+                             std::max(triangle.min_x, min_x), std::max(triangle.min_y, min_y),
+                             static_cast<u16>(std::min<unsigned>(triangle.max_x, end_x)),
+                             static_cast<u16>(std::min<unsigned>(triangle.max_y, end_y)));
             }
+        }
+    }
 
-            const Math::Vec4<u8> result = {
-                output_merger.red_enable   ? blend_output.r() : dest.r(),
-                output_merger.green_enable ? blend_output.g() : dest.g(),
-                output_merger.blue_enable  ? blend_output.b() : dest.b(),
-                output_merger.alpha_enable ? blend_output.a() : dest.a()
-            };
+    std::vector<Triangle> triangles;
+
+    /// Indices of the triangles touching each tile, in submission order
+    std::vector<std::vector<u32>> bins;
+    unsigned tiles_x = 1;
+    unsigned tiles_y = 1;
+
+    /// Next tile to be taken by a thread during a flush
+    std::atomic<unsigned> next_tile;
+
+    unsigned num_workers;
+};
+
+/// Only exists while more than one rasterizer thread is configured
+static std::unique_ptr<TiledRasterizer> tiled_rasterizer;
+
+/// Fragment pipeline of the current draw, until it is flushed
+static const FragmentPipeline::Setup* current_pipeline = nullptr;
+/// Buffers of the current draw, valid while current_pipeline is set
+static RenderTarget current_target;
+
+/// Rectangle in rasterizer coordinates, aligned to whole pixels, which pixels are drawn inside of
+struct ScissorRect {
+    u16 min_x, min_y, max_x, max_y;
+};
+
+/// Pixels of the current draw inside both the viewport and the framebuffer, valid while
+/// current_pipeline is set
+static ScissorRect current_scissor;
+
+/**
+ * The clipper only clips triangles at the guard band, so the pixels outside of the viewport are
+ * skipped by clamping the bounding boxes of the triangles to it. There's no separate scissor
+ * test register yet, the framebuffer bounds are what keeps the writes inside the buffers.
+ */
+static ScissorRect GetScissorRect() {
+    const DerivedState::Viewport& viewport = DerivedState::GetViewport();
+    const DerivedState::Framebuffer& buffers = DerivedState::GetFramebuffer();
+
+    auto GetBounds = [](float24 halfsize, float24 offset, u32 buffer_size, u16& min, u16& max) {
+        const float edge0 = offset.ToFloat32();
+        const float edge1 = edge0 + 2.0f * halfsize.ToFloat32();
+        const float limit = static_cast<float>(buffer_size);
+        const float low = std::max(0.0f, std::min(std::floor(std::min(edge0, edge1)), limit));
+        const float high = std::max(0.0f, std::min(std::ceil(std::max(edge0, edge1)), limit));
+        min = static_cast<u16>(low) * 16;
+        max = static_cast<u16>(high) * 16;
+    };
+
+    ScissorRect scissor;
+    GetBounds(viewport.halfsize_x, viewport.offset_x, buffers.width, scissor.min_x, scissor.max_x);
+    GetBounds(viewport.halfsize_y, viewport.offset_y, buffers.height, scissor.min_y, scissor.max_y);
+    return scissor;
+}
+
+
+/**
+ * Helper function for ProcessTriangle with the "reversed" flag to allow for implementing
+ * culling via recursion.
+ */
+static void ProcessTriangleInternal(const VertexShader::OutputVertex& v0,
+                                    const VertexShader::OutputVertex& v1,
+                                    const VertexShader::OutputVertex& v2,
+                                    bool reversed)
+{
+    const auto& regs = g_state.regs;
+    FINE_SCOPE_TIMER(timer, rasterization_category);
+
+    // vertex positions in rasterizer coordinates
+    static auto FloatToFix = [](float24 flt) {
+        // TODO: Rounding here is necessary to prevent garbage pixels at
+        //       triangle borders. Is it that the correct solution, though?
+        return Fix12P4(static_cast<unsigned short>(round(flt.ToFloat32() * 16.0f)));
+    };
+    static auto ScreenToRasterizerCoordinates = [](const Math::Vec3<float24>& vec) {
+        return Math::Vec3<Fix12P4>{FloatToFix(vec.x), FloatToFix(vec.y), FloatToFix(vec.z)};
+    };
+
+    Math::Vec3<Fix12P4> vtxpos[3]{ ScreenToRasterizerCoordinates(v0.screenpos),
+                                   ScreenToRasterizerCoordinates(v1.screenpos),
+                                   ScreenToRasterizerCoordinates(v2.screenpos) };
 
-            DrawPixel(x >> 4, y >> 4, result);
+    if (regs.cull_mode == Regs::CullMode::KeepAll) {
+        // Make sure we always end up with a triangle wound counter-clockwise
+        if (!reversed && SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) <= 0) {
+            ProcessTriangleInternal(v0, v2, v1, true);
+            return;
+        }
+    } else {
+        if (!reversed && regs.cull_mode == Regs::CullMode::KeepClockWise) {
+            // Reverse vertex order and use the CCW code path.
+            ProcessTriangleInternal(v0, v2, v1, true);
+            return;
         }
+
+        // Cull away triangles which are wound clockwise.
+        if (SignedArea(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) <= 0)
+            return;
+    }
+
+    // The registers can't change during a draw, so its first triangle sets up the pipeline
+    if (current_pipeline == nullptr) {
+        current_pipeline = &FragmentPipeline::GetSetup();
+        ResolveRenderTarget(current_target);
+        current_scissor = GetScissorRect();
+    }
+
+    u16 min_x = std::min({vtxpos[0].x, vtxpos[1].x, vtxpos[2].x});
+    u16 min_y = std::min({vtxpos[0].y, vtxpos[1].y, vtxpos[2].y});
+    u16 max_x = std::max({vtxpos[0].x, vtxpos[1].x, vtxpos[2].x});
+    u16 max_y = std::max({vtxpos[0].y, vtxpos[1].y, vtxpos[2].y});
+
+    min_x &= Fix12P4::IntMask();
+    min_y &= Fix12P4::IntMask();
+    max_x = ((max_x + Fix12P4::FracMask()) & Fix12P4::IntMask());
+    max_y = ((max_y + Fix12P4::FracMask()) & Fix12P4::IntMask());
+
+    min_x = std::max(min_x, current_scissor.min_x);
+    min_y = std::max(min_y, current_scissor.min_y);
+    max_x = std::min(max_x, current_scissor.max_x);
+    max_y = std::min(max_y, current_scissor.max_y);
+
+    // Triangles inside the guard band but outside of the viewport don't cover any pixels
+    if (max_x <= min_x || max_y <= min_y)
+        return;
+
+    // Triangle filling rules: Pixels on the right-sided edge or on flat bottom edges are not
+    // drawn. Pixels on any other triangle border are drawn. This is implemented with three bias
+    // values which are added to the barycentric coordinates w0, w1 and w2, respectively.
+    // NOTE: These are the PSP filling rules. Not sure if the 3DS uses the same ones...
+    auto IsRightSideOrFlatBottomEdge = [](const Math::Vec2<Fix12P4>& vtx,
+                                          const Math::Vec2<Fix12P4>& line1,
+                                          const Math::Vec2<Fix12P4>& line2)
+    {
+        if (line1.y == line2.y) {
+            // just check if vertex is above us => bottom line parallel to x-axis
+            return vtx.y < line1.y;
+        } else {
+            // check if vertex is on our left => right side
+            // TODO: Not sure how likely this is to overflow
+            return (int)vtx.x < (int)line1.x + ((int)line2.x - (int)line1.x) * ((int)vtx.y - (int)line1.y) / ((int)line2.y - (int)line1.y);
+        }
+    };
+    int bias0 = IsRightSideOrFlatBottomEdge(vtxpos[0].xy(), vtxpos[1].xy(), vtxpos[2].xy()) ? -1 : 0;
+    int bias1 = IsRightSideOrFlatBottomEdge(vtxpos[1].xy(), vtxpos[2].xy(), vtxpos[0].xy()) ? -1 : 0;
+    int bias2 = IsRightSideOrFlatBottomEdge(vtxpos[2].xy(), vtxpos[0].xy(), vtxpos[1].xy()) ? -1 : 0;
+
+    // Every pixel interpolates the same vertex attributes, so gather them once. Binned triangles
+    // are kept until the draw is flushed, so they don't hold on to the whole vertices.
+    Triangle triangle;
+    triangle.w_inverse = Math::MakeVec(v0.pos.w, v1.pos.w, v2.pos.w);
+    triangle.depth = Math::MakeVec(v0.screenpos.z, v1.screenpos.z, v2.screenpos.z);
+    for (int i = 0; i < 4; ++i)
+        triangle.color_attributes[i] = Math::MakeVec(v0.color[i], v1.color[i], v2.color[i]);
+    const Math::Vec2<float24> VertexShader::OutputVertex::* const texcoords[3] = {
+        &VertexShader::OutputVertex::tc0, &VertexShader::OutputVertex::tc1, &VertexShader::OutputVertex::tc2
+    };
+    for (int i = 0; i < 3; ++i) {
+        if (!current_pipeline->textures[i].used)
+            continue;
+        const auto tc = texcoords[i];
+        triangle.uv_attributes[i][0] = Math::MakeVec((v0.*tc).u(), (v1.*tc).u(), (v2.*tc).u());
+        triangle.uv_attributes[i][1] = Math::MakeVec((v0.*tc).v(), (v1.*tc).v(), (v2.*tc).v());
+    }
+    for (int i = 0; i < 3; ++i)
+        triangle.vtxpos[i] = vtxpos[i];
+    triangle.bias0 = bias0;
+    triangle.bias1 = bias1;
+    triangle.bias2 = bias2;
+    triangle.min_x = min_x;
+    triangle.min_y = min_y;
+    triangle.max_x = max_x;
+    triangle.max_y = max_y;
+    triangle.pipeline = current_pipeline;
+    triangle.target = &current_target;
+
+    if (tiled_rasterizer != nullptr) {
+        tiled_rasterizer->AddTriangle(triangle);
+    } else {
+        DrawTriangle(triangle, min_x, min_y, max_x, max_y);
     }
 }
 
 void ProcessTriangle(const VertexShader::OutputVertex& v0,
                      const VertexShader::OutputVertex& v1,
                      const VertexShader::OutputVertex& v2) {
-    ProcessTriangleInternal(v0, v1, v2);
+    // Drawing on the emulation thread alone doesn't need the tiled rasterizer
+    const unsigned num_workers = static_cast<unsigned>(std::max(Settings::values.rasterizer_threads, 1) - 1);
+    if (tiled_rasterizer == nullptr ? num_workers != 0 : tiled_rasterizer->GetNumWorkers() != num_workers) {
+        Flush();
+        tiled_rasterizer.reset(num_workers != 0 ? new TiledRasterizer(num_workers) : nullptr);
+    }
+
+    ProcessTriangleInternal(v0, v1, v2, false);
+}
+
+void Flush() {
+    if (tiled_rasterizer != nullptr)
+        tiled_rasterizer->Flush();
+
+    // Textures rendered to by this draw have to be decoded again when they are sampled
+    if (current_pipeline != nullptr) {
+        const DerivedState::Framebuffer& buffers = DerivedState::GetFramebuffer();
+        const u32 num_pixels = buffers.width * buffers.height;
+        TextureCache::NotifyFlush(buffers.color_address, buffers.color_bytes_per_pixel * num_pixels);
+        TextureCache::NotifyFlush(buffers.depth_address, buffers.depth_bytes_per_pixel * num_pixels);
+    }
+    current_pipeline = nullptr;
+}
+
+void Shutdown() {
+    tiled_rasterizer.reset();
+    current_pipeline = nullptr;
+    FragmentPipeline::setup_cache.clear();
+    TextureCache::FullFlush();
 }
 
 } // namespace Rasterizer
@@ -12,10 +12,20 @@ namespace VertexShader {
 
 namespace Rasterizer {
 
+/**
+ * Draws a triangle to the framebuffer. When more than one rasterizer thread is configured, the
+ * triangle is only queued and drawn by the next call to Flush.
+ */
 void ProcessTriangle(const VertexShader::OutputVertex& v0,
                      const VertexShader::OutputVertex& v1,
                      const VertexShader::OutputVertex& v2);
 
+/// Draws all queued triangles, needs to be called before the framebuffer is read or reconfigured
+void Flush();
+
+/// Stops the rasterizer threads
+void Shutdown();
+
 } // namespace Rasterizer
 
 } // namespace Pica
@@ -0,0 +1,59 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "common/emu_window.h"
+#include "common/logging/log.h"
+#include "common/profiler_reporting.h"
+
+#include "core/settings.h"
+
+#include "video_core/gpu_thread.h"
+#include "video_core/video_core.h"
+#include "video_core/renderer_null/renderer_null.h"
+
+NullRasterizer::NullRasterizer() : num_queued_vertices(0) {
+}
+
+void NullRasterizer::BeginTriangles(u32 max_vertices) {
+    num_queued_vertices = 0;
+}
+
+u32 NullRasterizer::AddVertices(const Pica::VertexShader::OutputVertex* vertices, size_t count) {
+    const u32 first = num_queued_vertices;
+    num_queued_vertices += static_cast<u32>(count);
+    return first;
+}
+
+RendererNull::RendererNull() : render_window(nullptr) {
+    hw_rasterizer.reset(new NullRasterizer());
+}
+
+void RendererNull::SwapBuffers() {
+    auto& profiler = Common::Profiling::GetProfilingManager();
+    profiler.FinishFrame();
+    {
+        auto aggregator = Common::Profiling::GetTimingResultsAggregator();
+        aggregator->AddFrame(profiler.GetPreviousFrameResults());
+    }
+
+    // With a GPU thread, window events are polled on the thread which created the window
+    if (!GPUThread::IsEnabled())
+        render_window->PollEvents();
+
+    m_current_frame++;
+    profiler.BeginFrame();
+
+    Settings::values.use_hw_renderer = VideoCore::g_hw_renderer_enabled;
+}
+
+void RendererNull::SetWindow(EmuWindow* window) {
+    render_window = window;
+}
+
+void RendererNull::Init() {
+    LOG_INFO(Render, "Using the null renderer, nothing will be presented");
+}
+
+void RendererNull::ShutDown() {
+}
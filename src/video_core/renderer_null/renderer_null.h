@@ -0,0 +1,54 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "video_core/hwrasterizer_base.h"
+#include "video_core/renderer_base.h"
+
+class EmuWindow;
+
+/**
+ * Rasterizer of the null backend, which drops the triangles it is given. Enabling the hardware
+ * renderer with it skips rasterization entirely, while vertices are still shaded on the CPU.
+ */
+class NullRasterizer : public HWRasterizer {
+public:
+    NullRasterizer();
+
+    void InitObjects() override {}
+    void Reset() override {}
+    void BeginTriangles(u32 max_vertices) override;
+    u32 AddVertices(const Pica::VertexShader::OutputVertex* vertices, size_t count) override;
+    void AddTriangle(u32 v0, u32 v1, u32 v2) override {}
+    void DrawTriangles() override {}
+    void CommitFramebuffer() override {}
+    void NotifyPicaRegisterChanged(u32 id) override {}
+    void NotifyCommandListProcessed() override {}
+    void NotifyPreRead(PAddr addr, u32 size) override {}
+    void NotifyFlush(PAddr addr, u32 size) override {}
+
+private:
+    u32 num_queued_vertices;
+};
+
+/**
+ * Renderer that presents nothing and needs no graphics context, for measuring the CPU side of
+ * emulation on machines without a display. The GPU registers and interrupts keep their timing,
+ * as they don't depend on the renderer.
+ */
+class RendererNull : public RendererBase {
+public:
+    RendererNull();
+
+    void SwapBuffers() override;
+    void SetWindow(EmuWindow* window) override;
+    void Init() override;
+    void ShutDown() override;
+
+private:
+    EmuWindow* render_window;
+};
@@ -0,0 +1,92 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <chrono>
+#include <cstring>
+
+#include "common/logging/log.h"
+
+#include "video_core/renderer_opengl/gl_gpu_timer.h"
+
+// Core in OpenGL 3.3, the 3.2 loader doesn't define it
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
+GPUTimer::GPUTimer() : supported(false), current_frame(0), depth(0) {
+}
+
+GPUTimer::~GPUTimer() {
+    Release();
+}
+
+void GPUTimer::Init() {
+    supported = false;
+#if ENABLE_PROFILING
+    GLint major_version = 0, minor_version = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major_version);
+    glGetIntegerv(GL_MINOR_VERSION, &minor_version);
+    supported = major_version > 3 || (major_version == 3 && minor_version >= 3);
+
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for (GLint i = 0; i < num_extensions && !supported; ++i) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (std::strcmp(extension, "GL_ARB_timer_query") == 0)
+            supported = true;
+    }
+
+    if (!supported)
+        LOG_INFO(Render_OpenGL, "Timer queries are unsupported, GPU time won't be profiled");
+#endif
+}
+
+void GPUTimer::Release() {
+    for (Frame& frame : frames) {
+        if (!frame.queries.empty())
+            glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+        frame.queries.clear();
+        frame.categories.clear();
+    }
+    depth = 0;
+}
+
+void GPUTimer::Begin(Common::Profiling::TimingCategory& category) {
+    if (!supported || depth++ != 0)
+        return;
+
+    Frame& frame = frames[current_frame];
+    if (frame.categories.size() == frame.queries.size()) {
+        GLuint query;
+        glGenQueries(1, &query);
+        frame.queries.push_back(query);
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.categories.size()]);
+    frame.categories.push_back(&category);
+}
+
+void GPUTimer::End() {
+    if (!supported || --depth != 0)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+}
+
+void GPUTimer::EndFrame() {
+    if (!supported)
+        return;
+
+    // The oldest frame is reused next, by now its results are available without waiting
+    current_frame = (current_frame + 1) % NUM_FRAMES;
+    Frame& frame = frames[current_frame];
+    for (size_t i = 0; i < frame.categories.size(); ++i) {
+        // Elapsed times are in nanoseconds, 32 bits are enough for any single measurement
+        GLuint elapsed = 0;
+        glGetQueryObjectuiv(frame.queries[i], GL_QUERY_RESULT, &elapsed);
+        frame.categories[i]->AddTime(std::chrono::duration_cast<Common::Profiling::Duration>(
+                std::chrono::nanoseconds(elapsed)));
+    }
+    frame.categories.clear();
+}
@@ -0,0 +1,75 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/profiler.h"
+
+#include "generated/gl_3_2_core.h"
+
+/**
+ * Measures how long the GPU takes to execute groups of GL commands with GL_TIME_ELAPSED queries,
+ * and accounts the time to profiler TimingCategories like the CPU timers do. The results are read
+ * back a couple of frames later, when the GPU has long finished with them, so that measuring never
+ * waits for the GPU. Queries are made on the context current when GL objects are created.
+ */
+class GPUTimer : public NonCopyable {
+public:
+    GPUTimer();
+    ~GPUTimer();
+
+    /// Checks for timer query support, with the context current
+    void Init();
+
+    /// Deletes the queries, with the context current
+    void Release();
+
+    /**
+     * Starts measuring the GL commands issued from now on. Only one measurement can run at a time,
+     * a Begin while one is running is ignored along with its End.
+     */
+    void Begin(Common::Profiling::TimingCategory& category);
+
+    /// Stops the measurement started by the matching Begin
+    void End();
+
+    /// Ends the measurements of a frame and accounts those of an earlier frame to their categories
+    void EndFrame();
+
+private:
+    /// Number of frames of measurements that are in flight
+    static const size_t NUM_FRAMES = 3;
+
+    struct Frame {
+        /// Queries of the frame, reused by later frames
+        std::vector<GLuint> queries;
+        /// Category of each query used in the frame
+        std::vector<Common::Profiling::TimingCategory*> categories;
+    };
+
+    bool supported;
+    std::array<Frame, NUM_FRAMES> frames;
+    size_t current_frame;
+    /// Depth of the Begin calls, only the outermost one measures
+    unsigned depth;
+};
+
+/// Measures the GL commands issued in a scope with a GPUTimer
+class GPUScopeTimer : public NonCopyable {
+public:
+    GPUScopeTimer(GPUTimer& timer, Common::Profiling::TimingCategory& category) : timer(timer) {
+        timer.Begin(category);
+    }
+
+    ~GPUScopeTimer() {
+        timer.End();
+    }
+
+private:
+    GPUTimer& timer;
+};
@@ -0,0 +1,196 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+
+#include "common/profiler_reporting.h"
+#include "common/string_util.h"
+
+#include "core/core.h"
+#include "core/arm/arm_interface.h"
+
+#include "video_core/renderer_opengl/gl_perf_overlay.h"
+
+/// Rate the emulated GPU shows frames at
+static const double FULL_SPEED_FPS = 60.0;
+
+static const unsigned GLYPH_WIDTH = 5;
+static const unsigned GLYPH_HEIGHT = 7;
+/// Size of a character including the spacing to its neighbours
+static const unsigned CELL_WIDTH = GLYPH_WIDTH + 1;
+static const unsigned CELL_HEIGHT = GLYPH_HEIGHT + 2;
+/// Distance of the text to the edges of the image
+static const unsigned PADDING = 4;
+
+static const char FIRST_GLYPH = ' ';
+static const char LAST_GLYPH = 'Z';
+
+/// Rows of the 5x7 glyphs of the characters from FIRST_GLYPH to LAST_GLYPH, the leftmost pixel in bit 4
+static const u8 font[LAST_GLYPH - FIRST_GLYPH + 1][GLYPH_HEIGHT] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ' '
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // '!'
+    { 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '"'
+    { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A }, // '#'
+    { 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 }, // '$'
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // '%'
+    { 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D }, // '&'
+    { 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '''
+    { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // '('
+    { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // ')'
+    { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 }, // '*'
+    { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 }, // '+'
+    { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 }, // ','
+    { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // '-'
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // '.'
+    { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // '/'
+    { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // '0'
+    { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // '1'
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // '2'
+    { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // '3'
+    { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // '4'
+    { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // '5'
+    { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // '6'
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // '7'
+    { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // '8'
+    { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // '9'
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // ':'
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 }, // ';'
+    { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // '<'
+    { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 }, // '='
+    { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // '>'
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // '?'
+    { 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E }, // '@'
+    { 0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11 }, // 'A'
+    { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // 'B'
+    { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // 'C'
+    { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // 'D'
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // 'E'
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // 'F'
+    { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // 'G'
+    { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // 'H'
+    { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 'I'
+    { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // 'J'
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // 'K'
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // 'L'
+    { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // 'M'
+    { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // 'N'
+    { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // 'O'
+    { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // 'P'
+    { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // 'Q'
+    { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // 'R'
+    { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // 'S'
+    { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // 'T'
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // 'U'
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // 'V'
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // 'W'
+    { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // 'X'
+    { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 }, // 'Y'
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // 'Z'
+};
+
+static const std::array<u8, 4> text_color = {{ 255, 255, 255, 255 }};
+static const std::array<u8, 4> background_color = {{ 0, 0, 0, 160 }};
+
+PerfOverlay::PerfOverlay() : pixels(WIDTH * HEIGHT * 4), version(0),
+        interval_start(Common::Profiling::Clock::now()), interval_frames(0),
+        interval_cpu_time(Common::Profiling::Duration::zero()),
+        interval_gpu_time(Common::Profiling::Duration::zero()), interval_draw_calls(0),
+        interval_texture_uploads(0), interval_texture_evictions(0), interval_shader_cache_misses(0) {
+
+    // The GPU's work is measured by the GPU timer in the categories named after it
+    const auto& categories = Common::Profiling::GetProfilingManager().GetTimingCategoriesInfo();
+    for (unsigned i = 0; i < categories.size(); ++i) {
+        if (std::strncmp(categories[i].name, "GPU ", 4) == 0)
+            gpu_categories.push_back(i);
+    }
+}
+
+/// Events a counter counted in a frame, counters that didn't exist yet when it finished counted none
+static u64 GetFrameCount(const Common::Profiling::ProfilingFrameResult& frame, unsigned counter_id) {
+    return counter_id < frame.counts_per_counter.size() ? frame.counts_per_counter[counter_id] : 0;
+}
+
+void PerfOverlay::AddFrame(const RasterizerCounterIds& counter_ids) {
+    using namespace Common::Profiling;
+
+    const ProfilingFrameResult& frame = GetProfilingManager().GetPreviousFrameResults();
+    ++interval_frames;
+    interval_draw_calls += GetFrameCount(frame, counter_ids.draw_calls);
+    interval_texture_uploads += GetFrameCount(frame, counter_ids.texture_uploads);
+    interval_texture_evictions += GetFrameCount(frame, counter_ids.texture_evictions);
+    interval_shader_cache_misses += GetFrameCount(frame, counter_ids.shader_cache_misses);
+    interval_cpu_time += frame.frame_time;
+    for (unsigned id : gpu_categories) {
+        if (id < frame.time_per_category.size())
+            interval_gpu_time += frame.time_per_category[id];
+    }
+
+    const Clock::time_point now = Clock::now();
+    const double seconds = std::chrono::duration<double>(now - interval_start).count();
+    if (seconds < 1.0)
+        return;
+
+    const double fps = interval_frames / seconds;
+    const double ms_per_frame = 1000.0 / interval_frames;
+    const double cpu_ms = std::chrono::duration<double>(interval_cpu_time).count() * ms_per_frame;
+    const double gpu_ms = std::chrono::duration<double>(interval_gpu_time).count() * ms_per_frame;
+
+    std::vector<std::string> lines;
+    lines.push_back(Common::StringFromFormat("FPS %.1f (%.0f%%)", fps, fps * 100.0 / FULL_SPEED_FPS));
+    lines.push_back(Common::StringFromFormat("CPU %.1f MS GPU %.1f MS", cpu_ms, gpu_ms));
+    lines.push_back(Common::StringFromFormat("DRAWS %.0f PER FRAME", interval_draw_calls / (double)interval_frames));
+    lines.push_back(Common::StringFromFormat("TEX UP %.0f/S EVICT %.0f/S",
+            interval_texture_uploads / seconds, interval_texture_evictions / seconds));
+    lines.push_back(Common::StringFromFormat("SHADER MISSES %.0f/S", interval_shader_cache_misses / seconds));
+    if (Core::g_app_core != nullptr) {
+        size_t used_bytes, capacity_bytes;
+        Core::g_app_core->GetCacheUsage(used_bytes, capacity_bytes);
+        if (capacity_bytes != 0) {
+            lines.push_back(Common::StringFromFormat("CODE CACHE %.0f%% OF %uMB",
+                    used_bytes * 100.0 / capacity_bytes, (unsigned)(capacity_bytes >> 20)));
+        }
+    }
+    Redraw(lines);
+
+    interval_start = now;
+    interval_frames = 0;
+    interval_cpu_time = Duration::zero();
+    interval_gpu_time = Duration::zero();
+    interval_draw_calls = interval_texture_uploads = interval_texture_evictions = interval_shader_cache_misses = 0;
+}
+
+void PerfOverlay::Redraw(const std::vector<std::string>& lines) {
+    for (size_t i = 0; i < pixels.size(); i += 4)
+        std::copy(background_color.begin(), background_color.end(), &pixels[i]);
+
+    // Text that doesn't fit is cut off
+    const unsigned max_lines = (HEIGHT - 2 * PADDING) / CELL_HEIGHT;
+    const unsigned max_columns = (WIDTH - 2 * PADDING) / CELL_WIDTH;
+    for (unsigned line = 0; line < std::min<size_t>(lines.size(), max_lines); ++line) {
+        const std::string& text = lines[line];
+        for (unsigned column = 0; column < std::min<size_t>(text.size(), max_columns); ++column) {
+            const char c = static_cast<char>(std::toupper(static_cast<unsigned char>(text[column])));
+            if (c < FIRST_GLYPH || c > LAST_GLYPH)
+                continue;
+
+            const u8* glyph = font[c - FIRST_GLYPH];
+            const unsigned left = PADDING + column * CELL_WIDTH;
+            const unsigned top = PADDING + line * CELL_HEIGHT;
+            for (unsigned y = 0; y < GLYPH_HEIGHT; ++y) {
+                for (unsigned x = 0; x < GLYPH_WIDTH; ++x) {
+                    if ((glyph[y] >> (GLYPH_WIDTH - 1 - x)) & 1) {
+                        u8* pixel = &pixels[((top + y) * WIDTH + left + x) * 4];
+                        std::copy(text_color.begin(), text_color.end(), pixel);
+                    }
+                }
+            }
+        }
+    }
+
+    ++version;
+}
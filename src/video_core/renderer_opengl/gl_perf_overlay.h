@@ -0,0 +1,70 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/profiler.h"
+
+/// Ids of the Perf::Counters of the rasterizer's work, the overlay shows how much they counted
+struct RasterizerCounterIds {
+    unsigned draw_calls;
+    unsigned texture_uploads;
+    unsigned texture_evictions;
+    unsigned shader_cache_misses;
+};
+
+/**
+ * Statistics drawn over the emulated screens: the emulation speed, how long the CPU and the GPU
+ * took per frame, and what the caches of the renderer and the CPU core are doing. The statistics
+ * are averaged over a second and drawn into a small image, which is all that has to be uploaded
+ * when they change.
+ */
+class PerfOverlay : NonCopyable {
+public:
+    /// Size of the image in pixels
+    static const unsigned WIDTH = 160;
+    static const unsigned HEIGHT = 62;
+
+    PerfOverlay();
+
+    /**
+     * Accounts the last finished frame to the statistics, with the events the given counters
+     * counted in it. The image is redrawn once a second has passed since its last update.
+     */
+    void AddFrame(const RasterizerCounterIds& counter_ids);
+
+    /// Incremented whenever the image is redrawn
+    u64 GetVersion() const {
+        return version;
+    }
+
+    /// RGBA8 pixels of the image, top row first. Text is opaque, the background translucent.
+    const u8* GetPixels() const {
+        return pixels.data();
+    }
+
+private:
+    /// Draws the lines of text into the image
+    void Redraw(const std::vector<std::string>& lines);
+
+    std::vector<u8> pixels;
+    u64 version;
+
+    /// Start of the second being averaged
+    Common::Profiling::Clock::time_point interval_start;
+    unsigned interval_frames;
+    Common::Profiling::Duration interval_cpu_time;
+    Common::Profiling::Duration interval_gpu_time;
+    u64 interval_draw_calls;
+    u64 interval_texture_uploads;
+    u64 interval_texture_evictions;
+    u64 interval_shader_cache_misses;
+
+    /// Ids of the timing categories of the GPU's work
+    std::vector<unsigned> gpu_categories;
+};
@@ -3,12 +3,20 @@
 // Refer to the license.txt file included.
 
 #include "common/color.h"
+#include "common/make_unique.h"
+#include "common/perf_counters.h"
+#include "common/profiler.h"
 
+#include "core/memory.h"
+#include "core/memory_stats.h"
 #include "core/settings.h"
 #include "core/hw/gpu.h"
 
+#include "video_core/derived_state.h"
 #include "video_core/pica.h"
+#include "video_core/texture_cache.h"
 #include "video_core/utils.h"
+#include "video_core/video_core.h"
 #include "video_core/renderer_opengl/gl_rasterizer.h"
 #include "video_core/renderer_opengl/gl_shaders.h"
 #include "video_core/renderer_opengl/gl_shader_util.h"
@@ -16,55 +24,149 @@
 
 #include "generated/gl_3_2_core.h"
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
 
-static bool IsPassThroughTevStage(const Pica::Regs::TevStageConfig& stage) {
-    return (stage.color_op == Pica::Regs::TevStageConfig::Operation::Replace &&
-            stage.alpha_op == Pica::Regs::TevStageConfig::Operation::Replace &&
-            stage.color_source1 == Pica::Regs::TevStageConfig::Source::Previous &&
-            stage.alpha_source1 == Pica::Regs::TevStageConfig::Source::Previous &&
-            stage.color_modifier1 == Pica::Regs::TevStageConfig::ColorModifier::SourceColor &&
-            stage.alpha_modifier1 == Pica::Regs::TevStageConfig::AlphaModifier::SourceAlpha &&
-            stage.GetColorMultiplier() == 1 &&
-            stage.GetAlphaMultiplier() == 1);
+/// Size of the buffer the vertices of draws are streamed into, in bytes
+static const GLsizeiptr VERTEX_BUFFER_SIZE = 4 * 1024 * 1024;
+
+/// Size of the buffer the indices of draws with translated vertex shaders are streamed into, in bytes
+static const GLsizeiptr INDEX_BUFFER_SIZE = 1024 * 1024;
+
+/// Texture unit the tiled framebuffer data is bound to while detiling, not used by any other shader
+static const unsigned DETILE_TEXTURE_UNIT = 3;
+
+/// Number of surfaces kept resident before the oldest ones are committed to 3DS memory and dropped
+static const size_t MAX_SURFACES = 32;
+
+/// Number of separately recorded memory writes between two presented frames
+static const size_t MAX_WRITTEN_RANGES = 64;
+
+static Common::Profiling::TimingCategory gpu_drawing_category("GPU Drawing");
+static Common::Profiling::TimingCategory gpu_reload_category("GPU Framebuffer Reload");
+static Common::Profiling::TimingCategory gpu_commit_category("GPU Framebuffer Commit");
+
+static Common::Perf::Counter draw_calls_counter("Draw calls");
+static Common::Perf::Counter shader_cache_misses_counter("Shader cache misses");
+static Common::Perf::Counter display_output_commits_counter("Display output commits");
+
+/// Whether two ranges of 3DS memory share any bytes, unlike MathUtil::IntervalsIntersect adjacent ranges don't
+static bool RangesOverlap(PAddr addr0, u32 size0, PAddr addr1, u32 size1) {
+    return addr0 < addr1 + size1 && addr1 < addr0 + size0;
+}
+
+/// Whether a display transfer to the given address writes one of the framebuffers the LCDs show
+static bool IsDisplayFramebuffer(PAddr addr) {
+    for (const auto& framebuffer : GPU::g_regs.framebuffer_config) {
+        if (addr == framebuffer.address_left1 || addr == framebuffer.address_left2)
+            return true;
+    }
+    return false;
 }
 
-RasterizerOpenGL::RasterizerOpenGL() : last_fb_color_addr(0), last_fb_depth_addr(0) { }
-RasterizerOpenGL::~RasterizerOpenGL() { }
+/// Points the samplers and the uniform block of a hardware fragment shader program, which has to be in use, at their bindings
+static void SetupShaderBindings(GLuint program) {
+    // Query each element, unused samplers are removed from the generated shaders
+    glUniform1i(glGetUniformLocation(program, "tex[0]"), 0);
+    glUniform1i(glGetUniformLocation(program, "tex[1]"), 1);
+    glUniform1i(glGetUniformLocation(program, "tex[2]"), 2);
 
-void RasterizerOpenGL::InitObjects() {
-    // Create the hardware shader program and get attrib/uniform locations
-    shader.Create(GLShaders::g_vertex_shader_hw, GLShaders::g_fragment_shader_hw);
-    attrib_position = glGetAttribLocation(shader.handle, "vert_position");
-    attrib_color = glGetAttribLocation(shader.handle, "vert_color");
-    attrib_texcoords = glGetAttribLocation(shader.handle, "vert_texcoords");
+    // All other fragment shader uniforms are sourced from a single uniform buffer at binding point 0
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "shader_data"), 0);
+}
 
-    uniform_alphatest_enabled = glGetUniformLocation(shader.handle, "alphatest_enabled");
-    uniform_alphatest_func = glGetUniformLocation(shader.handle, "alphatest_func");
-    uniform_alphatest_ref = glGetUniformLocation(shader.handle, "alphatest_ref");
+/// Returns the number of bytes that can be accessed linearly through the host pointer of a physical address
+static u32 GetContiguousHostSize(PAddr address) {
+    if (address >= Memory::VRAM_PADDR && address < Memory::VRAM_PADDR_END)
+        return Memory::VRAM_PADDR_END - address;
+    if (address >= Memory::FCRAM_PADDR && address < Memory::FCRAM_PADDR_END)
+        return Memory::FCRAM_PADDR_END - address;
+    return 0;
+}
 
-    uniform_tex = glGetUniformLocation(shader.handle, "tex");
+/// Returns the OpenGL type of a PICA vertex attribute component format
+static GLenum GetAttributeType(Pica::Regs::VertexAttributeFormat format) {
+    switch (format) {
+    case Pica::Regs::VertexAttributeFormat::BYTE:
+        return GL_BYTE;
+    case Pica::Regs::VertexAttributeFormat::UBYTE:
+        return GL_UNSIGNED_BYTE;
+    case Pica::Regs::VertexAttributeFormat::SHORT:
+        return GL_SHORT;
+    default:
+        return GL_FLOAT;
+    }
+}
 
-    uniform_tev_combiner_buffer_color = glGetUniformLocation(shader.handle, "tev_combiner_buffer_color");
+/**
+ * Encodes a linear image read back from OpenGL into the 8x8 Morton tiles of a PICA framebuffer.
+ * The four texels of a 2x2 block are adjacent in a tile, so each block is written as two pairs
+ * of texels taken from consecutive rows of the source.
+ * @param encode_pair Function encoding two horizontally adjacent texels, called as (src, dst)
+ */
+template <u32 src_bpp, u32 dst_bpp, typename Encoder>
+static void EncodeMortonTiles(u8* dst, const u8* src, u32 width, u32 height, Encoder encode_pair) {
+    const u32 src_stride = width * src_bpp;
+
+    for (u32 tile_y = 0; tile_y < height; tile_y += 8) {
+        for (u32 tile_x = 0; tile_x < width; tile_x += 8) {
+            u8* tile = dst + (tile_y * width + tile_x * 8) * dst_bpp;
+            const u8* tile_src = src + tile_y * src_stride + tile_x * src_bpp;
+
+            for (u32 y = 0; y < 8; y += 2) {
+                for (u32 x = 0; x < 8; x += 2) {
+                    const u8* block_src = tile_src + y * src_stride + x * src_bpp;
+                    u8* block = tile + VideoCore::morton_offsets[dst_bpp][x + y * 8];
+
+                    encode_pair(block_src, block);
+                    encode_pair(block_src + src_stride, block + 2 * dst_bpp);
+                }
+            }
+        }
+    }
+}
 
-    const auto tev_stages = Pica::g_state.regs.GetTevStages();
-    for (unsigned tev_stage_index = 0; tev_stage_index < tev_stages.size(); ++tev_stage_index) {
-        auto& uniform_tev_cfg = uniform_tev_cfgs[tev_stage_index];
+RasterizerOpenGL::RasterizerOpenGL() : fb_color(nullptr), fb_depth(nullptr),
+                                       attached_color_texture(0), attached_depth_texture(0),
+                                       uniform_block_data(), uniform_block_data_dirty(true),
+                                       vs_uniform_data(), vs_uniforms_dirty(true),
+                                       vs_program_hash(0), vs_program_dirty(true),
+                                       mapped_vertices(nullptr), mapped_indices(nullptr),
+                                       mapped_vertices_offset(0), mapped_indices_offset(0),
+                                       mapping_failed(false), num_queued_vertices(0), num_queued_indices(0),
+                                       draw_first_vertex(0), draw_first_index(0), index_type(GL_UNSIGNED_SHORT),
+                                       batch_pending(false), batch_vertices_offset(0), batch_indices_offset(0),
+                                       batch_samples_surface(false), num_frame_draws(0), num_frame_draw_calls(0),
+                                       notify_batch_open(false), parallel_shader_compile(false) { }
+RasterizerOpenGL::~RasterizerOpenGL() {
+    for (auto& surface : surfaces)
+        DiscardReadback(surface->readback_fence);
+}
 
-        std::string tev_ref_str = "tev_cfgs[" + std::to_string(tev_stage_index) + "]";
-        uniform_tev_cfg.enabled = glGetUniformLocation(shader.handle, (tev_ref_str + ".enabled").c_str());
-        uniform_tev_cfg.color_sources = glGetUniformLocation(shader.handle, (tev_ref_str + ".color_sources").c_str());
-        uniform_tev_cfg.alpha_sources = glGetUniformLocation(shader.handle, (tev_ref_str + ".alpha_sources").c_str());
-        uniform_tev_cfg.color_modifiers = glGetUniformLocation(shader.handle, (tev_ref_str + ".color_modifiers").c_str());
-        uniform_tev_cfg.alpha_modifiers = glGetUniformLocation(shader.handle, (tev_ref_str + ".alpha_modifiers").c_str());
-        uniform_tev_cfg.color_alpha_op = glGetUniformLocation(shader.handle, (tev_ref_str + ".color_alpha_op").c_str());
-        uniform_tev_cfg.color_alpha_multiplier = glGetUniformLocation(shader.handle, (tev_ref_str + ".color_alpha_multiplier").c_str());
-        uniform_tev_cfg.const_color = glGetUniformLocation(shader.handle, (tev_ref_str + ".const_color").c_str());
-        uniform_tev_cfg.updates_combiner_buffer_color_alpha = glGetUniformLocation(shader.handle, (tev_ref_str + ".updates_combiner_buffer_color_alpha").c_str());
+void RasterizerOpenGL::InitObjects() {
+    // Let the driver build programs on threads of its own, they are then only used once they are ready
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    parallel_shader_compile = false;
+    for (GLint i = 0; i < num_extensions; ++i) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0 ||
+            strcmp(extension, "GL_ARB_parallel_shader_compile") == 0)
+            parallel_shader_compile = true;
     }
 
+    gpu_timer.Init();
+    res_cache.Init();
+
+    // Create the hardware shader program and get attrib/uniform locations
+    shader.Create(GLShaders::g_vertex_shader_hw, GLShaders::g_fragment_shader_hw);
+    attrib_position = glGetAttribLocation(shader.handle, "vert_position");
+    attrib_color = glGetAttribLocation(shader.handle, "vert_color");
+    attrib_texcoords = glGetAttribLocation(shader.handle, "vert_texcoords");
+
     // Generate VBO and VAO
-    vertex_buffer.Create();
+    vertex_buffer.Create(GL_ARRAY_BUFFER);
     vertex_array.Create();
 
     // Update OpenGL state
@@ -74,14 +176,25 @@ void RasterizerOpenGL::InitObjects() {
 
     state.Apply();
 
-    // Set the texture samplers to correspond to different texture units
-    glUniform1i(uniform_tex, 0);
-    glUniform1i(uniform_tex + 1, 1);
-    glUniform1i(uniform_tex + 2, 2);
+    vertex_buffer.Allocate(VERTEX_BUFFER_SIZE);
+
+    // Allocate the uniform buffer of translated vertex shaders, which has a binding point of its own
+    vs_uniform_buffer.Create();
+    glBindBuffer(GL_UNIFORM_BUFFER, vs_uniform_buffer.handle);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(VSUniformData), nullptr, GL_STREAM_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, GLShader::VS_UNIFORM_BLOCK_BINDING, vs_uniform_buffer.handle);
+
+    // Allocate the uniform buffer, its contents are uploaded before the first draw
+    uniform_buffer.Create();
+    glBindBuffer(GL_UNIFORM_BUFFER, uniform_buffer.handle);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(UniformData), nullptr, GL_STREAM_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, uniform_buffer.handle);
+
+    SetupShaderBindings(shader.handle);
 
     // Set vertex attributes
     glVertexAttribPointer(attrib_position, 4, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, position));
-    glVertexAttribPointer(attrib_color, 4, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, color));
+    glVertexAttribPointer(attrib_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, color));
     glVertexAttribPointer(attrib_texcoords, 2, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, tex_coord0));
     glVertexAttribPointer(attrib_texcoords + 1, 2, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, tex_coord1));
     glVertexAttribPointer(attrib_texcoords + 2, 2, GL_FLOAT, GL_FALSE, sizeof(HardwareVertex), (GLvoid*)offsetof(HardwareVertex, tex_coord2));
@@ -91,46 +204,47 @@ void RasterizerOpenGL::InitObjects() {
     glEnableVertexAttribArray(attrib_texcoords + 1);
     glEnableVertexAttribArray(attrib_texcoords + 2);
 
-    // Create textures for OGL framebuffer that will be rendered to, initially 1x1 to succeed in framebuffer creation
-    fb_color_texture.texture.Create();
-    ReconfigureColorTexture(fb_color_texture, Pica::Regs::ColorFormat::RGBA8, 1, 1);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Both vertex arrays draw from the index buffer, so it is bound to each of them
+    index_buffer.Create(GL_ELEMENT_ARRAY_BUFFER);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer.handle);
+    index_buffer.Allocate(INDEX_BUFFER_SIZE);
 
-    fb_depth_texture.texture.Create();
-    ReconfigureDepthTexture(fb_depth_texture, Pica::Regs::DepthFormat::D16, 1, 1);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    // Vertex array of translated vertex shaders, the attributes are pointed at the vertex data of each draw
+    vs_vertex_array.Create();
+    state.draw.vertex_array = vs_vertex_array.handle;
+    state.Apply();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer.handle);
+    state.draw.vertex_array = vertex_array.handle;
+    state.Apply();
+
+    // Programs and buffer texture for loading tiled framebuffers on the GPU
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texture_buffer_size);
+    InitDetileShader(detile_color_shader, GLShaders::g_fragment_shader_detile_color);
+    InitDetileShader(detile_depth_shader, GLShaders::g_fragment_shader_detile_depth);
 
-    // Configure OpenGL framebuffer
+    // The buffer only exists once it was bound, glTexBuffer fails before
+    detile_buffer.Create();
+    glBindBuffer(GL_TEXTURE_BUFFER, detile_buffer.handle);
+    detile_buffer_texture.Create();
+    OpenGLState::SetActiveTexture(DETILE_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, detile_buffer_texture.handle);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R8UI, detile_buffer.handle);
+
+    // Configure OpenGL framebuffer, the surfaces are attached before the first draw
     framebuffer.Create();
+    copy_read_framebuffer.Create();
+    copy_draw_framebuffer.Create();
 
     state.draw.framebuffer = framebuffer.handle;
-
-    // Unbind texture to allow binding to framebuffer
     state.texture_units[0].enabled_2d = true;
-    state.texture_units[0].texture_2d = 0;
     state.Apply();
-
-    glActiveTexture(GL_TEXTURE0);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fb_color_texture.texture.handle, 0);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, fb_depth_texture.texture.handle, 0);
-
-    ASSERT_MSG(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE,
-               "OpenGL rasterizer framebuffer setup failed, status %X", glCheckFramebufferStatus(GL_FRAMEBUFFER));
 }
 
 void RasterizerOpenGL::Reset() {
     const auto& regs = Pica::g_state.regs;
 
+    FlushBatch();
+
     SyncCullMode();
     SyncBlendEnabled();
     SyncBlendFuncs();
@@ -185,32 +299,322 @@ void RasterizerOpenGL::Reset() {
     SyncCombinerColor();
     SyncCombinerWriteFlags();
 
+    // Whatever was drawn before the reset isn't committed anymore, nor do the flushes matter
+    notify_batch_open = false;
+    pending_flushes.clear();
+    for (auto& surface : surfaces)
+        DiscardReadback(surface->readback_fence);
+    surfaces.clear();
+    display_outputs.clear();
+    fb_color = nullptr;
+    fb_depth = nullptr;
+    attached_color_texture = 0;
+    attached_depth_texture = 0;
+
+    vs_uniforms_dirty = true;
+    vs_program_dirty = true;
+
     res_cache.FullFlush();
 }
 
-void RasterizerOpenGL::AddTriangle(const Pica::VertexShader::OutputVertex& v0,
-                                   const Pica::VertexShader::OutputVertex& v1,
-                                   const Pica::VertexShader::OutputVertex& v2) {
-    vertex_batch.push_back(HardwareVertex(v0));
-    vertex_batch.push_back(HardwareVertex(v1));
-    vertex_batch.push_back(HardwareVertex(v2));
+bool RasterizerOpenGL::CanExtendBatch(u32 max_vertices) const {
+    if (batch_samples_surface)
+        return false;
+
+    if (index_type == GL_UNSIGNED_SHORT && num_queued_vertices + max_vertices > 0x10000)
+        return false;
+
+    // The buffers can't be orphaned while the batch is pending, its triangles would be lost with them
+    const GLsizeiptr index_size = index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    return vertex_buffer.Fits(max_vertices * sizeof(HardwareVertex), sizeof(HardwareVertex)) &&
+           index_buffer.Fits(max_vertices * 3 * index_size, index_size);
+}
+
+void RasterizerOpenGL::BeginTriangles(u32 max_vertices) {
+    ApplyPendingFlushes();
+
+    // The registers are the same as for the pending draws, since NotifyPicaRegisterChanged flushes
+    // the batch otherwise
+    if (batch_pending && !CanExtendBatch(max_vertices))
+        FlushBatch();
+
+    ++num_frame_draws;
+    mapped_vertices = nullptr;
+    mapped_indices = nullptr;
+    mapping_failed = false;
+
+    if (!batch_pending) {
+        // Syncing may draw through the same buffers itself, so it's done before they are mapped. The
+        // registers stay the same until DrawTriangles.
+        SyncFramebuffer();
+        SyncDrawState();
+        std::copy(&Pica::g_state.regs[0], &Pica::g_state.regs[0] + NUM_BATCH_REGISTERS, batch_registers.begin());
+
+        num_queued_vertices = 0;
+        num_queued_indices = 0;
+
+        // Each vertex completes at most one triangle
+        index_type = max_vertices <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    }
+    draw_first_vertex = num_queued_vertices;
+    draw_first_index = num_queued_indices;
+    if (max_vertices == 0)
+        return;
+
+    const GLsizeiptr index_size = index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    // The vertex offset is aligned to whole vertices, since it is passed as the base vertex
+    mapped_vertices = reinterpret_cast<HardwareVertex*>(vertex_buffer.Map(max_vertices * sizeof(HardwareVertex),
+                                                                          sizeof(HardwareVertex), &mapped_vertices_offset));
+    mapped_indices = index_buffer.Map(max_vertices * 3 * index_size, index_size, &mapped_indices_offset);
+    if (mapped_vertices == nullptr || mapped_indices == nullptr) {
+        LOG_ERROR(Render_OpenGL, "Failed to map the vertex or index buffer");
+        mapping_failed = true;
+    }
+
+    if (!batch_pending) {
+        batch_vertices_offset = mapped_vertices_offset;
+        batch_indices_offset = mapped_indices_offset;
+    }
+}
+
+/// Converts a color component to a normalized byte, values outside of [0, 1] are clamped
+static GLubyte ColorComponentToUByte(Pica::float24 component) {
+    const float value = std::min(std::max(0.0f, component.ToFloat32()), 1.0f);
+    return static_cast<GLubyte>(value * 255.0f + 0.5f);
+}
+
+u32 RasterizerOpenGL::AddVertices(const Pica::VertexShader::OutputVertex* vertices, size_t count) {
+    const u32 first = num_queued_vertices;
+    num_queued_vertices += static_cast<u32>(count);
+    if (mapped_vertices == nullptr)
+        return first;
+
+    for (size_t i = 0; i < count; ++i) {
+        const auto& v = vertices[i];
+        HardwareVertex& out = mapped_vertices[first - draw_first_vertex + i];
+        out.position[0] = v.pos.x.ToFloat32();
+        out.position[1] = v.pos.y.ToFloat32();
+        out.position[2] = v.pos.z.ToFloat32();
+        out.position[3] = v.pos.w.ToFloat32();
+        out.color[0] = ColorComponentToUByte(v.color.x);
+        out.color[1] = ColorComponentToUByte(v.color.y);
+        out.color[2] = ColorComponentToUByte(v.color.z);
+        out.color[3] = ColorComponentToUByte(v.color.w);
+        out.tex_coord0[0] = v.tc0.x.ToFloat32();
+        out.tex_coord0[1] = v.tc0.y.ToFloat32();
+        out.tex_coord1[0] = v.tc1.x.ToFloat32();
+        out.tex_coord1[1] = v.tc1.y.ToFloat32();
+        out.tex_coord2[0] = v.tc2.x.ToFloat32();
+        out.tex_coord2[1] = v.tc2.y.ToFloat32();
+    }
+    return first;
+}
+
+void RasterizerOpenGL::AddTriangle(u32 v0, u32 v1, u32 v2) {
+    if (mapped_indices == nullptr)
+        return;
+
+    if (index_type == GL_UNSIGNED_SHORT) {
+        GLushort* indices = reinterpret_cast<GLushort*>(mapped_indices) + (num_queued_indices - draw_first_index);
+        indices[0] = static_cast<GLushort>(v0);
+        indices[1] = static_cast<GLushort>(v1);
+        indices[2] = static_cast<GLushort>(v2);
+    } else {
+        GLuint* indices = reinterpret_cast<GLuint*>(mapped_indices) + (num_queued_indices - draw_first_index);
+        indices[0] = v0;
+        indices[1] = v1;
+        indices[2] = v2;
+    }
+    num_queued_indices += 3;
 }
 
 void RasterizerOpenGL::DrawTriangles() {
+    MarkFramebufferDrawn();
+
+    // Both buffers were mapped by the same vertex array, which is still bound
+    const GLsizeiptr index_size = index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    if (mapped_vertices != nullptr)
+        vertex_buffer.Unmap((num_queued_vertices - draw_first_vertex) * sizeof(HardwareVertex));
+    if (mapped_indices != nullptr)
+        index_buffer.Unmap((num_queued_indices - draw_first_index) * index_size);
+
+    mapped_vertices = nullptr;
+    mapped_indices = nullptr;
+
+    if (mapping_failed) {
+        // Later draws wouldn't follow the ones before in the buffers anymore
+        num_queued_vertices = draw_first_vertex;
+        num_queued_indices = draw_first_index;
+        FlushBatch();
+        return;
+    }
+    batch_pending = true;
+}
+
+void RasterizerOpenGL::FlushBatch() {
+    if (!batch_pending)
+        return;
+    batch_pending = false;
+
+    if (num_queued_indices == 0)
+        return;
+
+    state.Apply();
+    GPUScopeTimer gpu_scope_timer(gpu_timer, gpu_drawing_category);
+    glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)num_queued_indices, index_type,
+                             reinterpret_cast<const GLvoid*>(batch_indices_offset),
+                             (GLint)(batch_vertices_offset / sizeof(HardwareVertex)));
+    ++num_frame_draw_calls;
+    draw_calls_counter.Add();
+}
+
+void RasterizerOpenGL::EndFrame() {
+    ApplyPendingFlushes();
+    FlushBatch();
+
+    if (num_frame_draws != 0)
+        LOG_DEBUG(Render_OpenGL, "Drew %u draws with %u draw calls", num_frame_draws, num_frame_draw_calls);
+    num_frame_draws = 0;
+    num_frame_draw_calls = 0;
+
+    res_cache.EndFrame(state);
+    gpu_timer.EndFrame();
+}
+
+RasterizerCounterIds RasterizerOpenGL::GetCounterIds() {
+    RasterizerCounterIds ids;
+    ids.draw_calls = draw_calls_counter.GetCounterId();
+    ids.texture_uploads = RasterizerCacheOpenGL::GetUploadsCounterId();
+    ids.texture_evictions = RasterizerCacheOpenGL::GetEvictionsCounterId();
+    ids.shader_cache_misses = shader_cache_misses_counter.GetCounterId();
+    return ids;
+}
+
+bool RasterizerOpenGL::AccelerateDrawBatch(bool is_indexed) {
+    const auto& regs = Pica::g_state.regs;
+
+    if (!Settings::values.use_hw_vertex_shaders)
+        return false;
+
+    ApplyPendingFlushes();
+    FlushBatch();
+
+    GLenum mode;
+    switch (regs.triangle_topology.Value()) {
+    case Pica::Regs::TriangleTopology::List:
+    case Pica::Regs::TriangleTopology::ListIndexed:
+        mode = GL_TRIANGLES;
+        break;
+    case Pica::Regs::TriangleTopology::Strip:
+        mode = GL_TRIANGLE_STRIP;
+        break;
+    case Pica::Regs::TriangleTopology::Fan:
+        mode = GL_TRIANGLE_FAN;
+        break;
+    default:
+        return false;
+    }
+
+    OGLShader* program = GetVertexShaderProgram();
+    if (program == nullptr)
+        return false;
+
+    // Only the vertices up to the highest index are uploaded for indexed draws
+    const PAddr index_address = regs.vertex_attributes.GetPhysicalBaseAddress() + regs.index_array.offset;
+    const bool index_u16 = regs.index_array.format != 0;
+    const u32 index_size = regs.num_vertices * (index_u16 ? 2 : 1);
+    const u8* index_data = nullptr;
+    u32 vertex_count = regs.num_vertices;
+    if (is_indexed) {
+        if (GetContiguousHostSize(index_address) < index_size)
+            return false;
+        index_data = Memory::GetPhysicalPointer(index_address);
+        if (index_data == nullptr)
+            return false;
+        MemoryStats::SampleGPURead(MemoryStats::GPURead::IndexArray, index_address, index_size);
+
+        u32 max_index = 0;
+        for (u32 i = 0; i < regs.num_vertices; ++i) {
+            const u32 index = index_u16 ? reinterpret_cast<const u16*>(index_data)[i] : index_data[i];
+            max_index = std::max(max_index, index);
+        }
+        vertex_count = regs.num_vertices != 0 ? max_index + 1 : 0;
+    }
+
     SyncFramebuffer();
     SyncDrawState();
 
-    glBufferData(GL_ARRAY_BUFFER, vertex_batch.size() * sizeof(HardwareVertex), vertex_batch.data(), GL_STREAM_DRAW);
-    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)vertex_batch.size());
+    state.draw.vertex_array = vs_vertex_array.handle;
+    state.draw.shader_program = program->handle;
+    state.Apply();
 
-    vertex_batch.clear();
+    if (SetupVertexArrays(vertex_count)) {
+        UploadVSUniforms();
+        MarkFramebufferDrawn();
+
+        GPUScopeTimer gpu_scope_timer(gpu_timer, gpu_drawing_category);
+        if (!is_indexed) {
+            glDrawArrays(mode, 0, (GLsizei)regs.num_vertices);
+        } else if (index_size != 0) {
+            // The index buffer is part of the vertex array state, so it is still bound
+            GLintptr offset;
+            u8* indices = index_buffer.Map(index_size, 4, &offset);
+            if (indices != nullptr) {
+                memcpy(indices, index_data, index_size);
+                index_buffer.Unmap(index_size);
+                glDrawElements(mode, (GLsizei)regs.num_vertices, index_u16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE,
+                               reinterpret_cast<const GLvoid*>(offset));
+            } else {
+                LOG_ERROR(Render_OpenGL, "Failed to map the index buffer");
+            }
+        }
+    }
 
-    // TODO: Flush the resource cache at the current depth and color framebuffer addresses for render-to-texture
+    state.draw.vertex_array = vertex_array.handle;
+    state.Apply();
+    return true;
+}
+
+void RasterizerOpenGL::MarkFramebufferDrawn() {
+    // Readbacks and sample copies made before this draw no longer hold the surface contents
+    for (Surface* surface : { fb_color, fb_depth }) {
+        if (surface != nullptr) {
+            DiscardReadback(surface->readback_fence);
+            surface->dirty = true;
+            surface->sample_texture_valid = false;
+        }
+    }
 }
 
 void RasterizerOpenGL::CommitFramebuffer() {
-    CommitColorBuffer();
-    CommitDepthBuffer();
+    ApplyPendingFlushes();
+    FlushBatch();
+
+    if (fb_color != nullptr)
+        CommitSurface(*fb_color);
+
+    if (fb_depth != nullptr)
+        CommitSurface(*fb_depth);
+
+    for (auto& output : display_outputs)
+        CommitDisplayOutput(*output);
+}
+
+void RasterizerOpenGL::NotifyCommandListProcessed() {
+    if (!Settings::values.use_hw_renderer)
+        return;
+
+    ApplyPendingFlushes();
+    FlushBatch();
+
+    // Textures set up but not drawn with by the end of the list probably won't be
+    res_cache.DiscardPrefetches();
+
+    // Games usually transfer their render targets out once their command list is done, so start
+    // copying them now and let the GPU finish the copies while the CPU carries on until the transfer
+    for (auto& surface : surfaces)
+        StartSurfaceReadback(*surface);
 }
 
 void RasterizerOpenGL::NotifyPicaRegisterChanged(u32 id) {
@@ -219,7 +623,48 @@ void RasterizerOpenGL::NotifyPicaRegisterChanged(u32 id) {
     if (!Settings::values.use_hw_renderer)
         return;
 
+    // Textures are prefetched and the draws set up from memory flushed by the GSP commands before the list
+    ApplyPendingFlushes();
+
+    // The pending draws have to be drawn before the new value is synced. Games often write the
+    // same values again before each draw, which doesn't end the batch.
+    if (batch_pending && id < NUM_BATCH_REGISTERS && regs[id] != batch_registers[id])
+        FlushBatch();
+
+    // Shader program uploads, which translated vertex shaders are looked up by
+    if ((id >= PICA_REG_INDEX_WORKAROUND(vs_program.set_word[0], 0x2cc) &&
+         id <= PICA_REG_INDEX_WORKAROUND(vs_program.set_word[7], 0x2d3)) ||
+        (id >= PICA_REG_INDEX_WORKAROUND(vs_swizzle_patterns.set_word[0], 0x2d6) &&
+         id <= PICA_REG_INDEX_WORKAROUND(vs_swizzle_patterns.set_word[7], 0x2dd))) {
+        vs_program_dirty = true;
+        return;
+    }
+
+    // Vertex shader uniforms
+    if (id == PICA_REG_INDEX(vs_bool_uniforms) ||
+        (id >= PICA_REG_INDEX_WORKAROUND(vs_int_uniforms[0], 0x2b1) &&
+         id <= PICA_REG_INDEX_WORKAROUND(vs_int_uniforms[3], 0x2b4)) ||
+        (id >= PICA_REG_INDEX_WORKAROUND(vs_uniform_setup.set_value[0], 0x2c1) &&
+         id <= PICA_REG_INDEX_WORKAROUND(vs_uniform_setup.set_value[7], 0x2c8))) {
+        vs_uniforms_dirty = true;
+        return;
+    }
+
     switch(id) {
+    // Texture setup, well before the draws sampling the textures
+    case PICA_REG_INDEX(texture0.address):
+    case PICA_REG_INDEX(texture0_format):
+        PrefetchTexture(0);
+        break;
+    case PICA_REG_INDEX(texture1.address):
+    case PICA_REG_INDEX(texture1_format):
+        PrefetchTexture(1);
+        break;
+    case PICA_REG_INDEX(texture2.address):
+    case PICA_REG_INDEX(texture2_format):
+        PrefetchTexture(2);
+        break;
+
     // Culling
     case PICA_REG_INDEX(cull_mode):
         SyncCullMode();
@@ -371,220 +816,400 @@ void RasterizerOpenGL::NotifyPicaRegisterChanged(u32 id) {
 }
 
 void RasterizerOpenGL::NotifyPreRead(PAddr addr, u32 size) {
-    const auto& regs = Pica::g_state.regs;
-
     if (!Settings::values.use_hw_renderer)
         return;
 
-    PAddr cur_fb_color_addr = regs.framebuffer.GetColorBufferPhysicalAddress();
-    u32 cur_fb_color_size = Pica::Regs::BytesPerColorPixel(regs.framebuffer.color_format)
-                            * regs.framebuffer.GetWidth() * regs.framebuffer.GetHeight();
-
-    PAddr cur_fb_depth_addr = regs.framebuffer.GetDepthBufferPhysicalAddress();
-    u32 cur_fb_depth_size = Pica::Regs::BytesPerDepthPixel(regs.framebuffer.depth_format)
-                            * regs.framebuffer.GetWidth() * regs.framebuffer.GetHeight();
+    // Deferred flushes elsewhere can wait, surfaces merely read from don't change
+    if (PendingFlushesOverlap(addr, size))
+        ApplyPendingFlushes();
 
-    // If source memory region overlaps 3DS framebuffers, commit them before the copy happens
-    if (MathUtil::IntervalsIntersect(addr, size, cur_fb_color_addr, cur_fb_color_size))
-        CommitColorBuffer();
+    FlushBatch();
 
-    if (MathUtil::IntervalsIntersect(addr, size, cur_fb_depth_addr, cur_fb_depth_size))
-        CommitDepthBuffer();
+    // If source memory region overlaps surfaces, commit them before the copy happens
+    for (auto& surface : surfaces) {
+        if (RangesOverlap(addr, size, surface->addr, surface->size))
+            CommitSurface(*surface);
+    }
+    CommitDisplayOutputs(addr, size);
 }
 
 void RasterizerOpenGL::NotifyFlush(PAddr addr, u32 size) {
-    const auto& regs = Pica::g_state.regs;
+    RecordWrittenRange(addr, size);
 
-    if (!Settings::values.use_hw_renderer)
+    // Bursts of small DMAs and transfers reload each surface and walk the caches once for all of them
+    if (notify_batch_open && Settings::values.use_hw_renderer) {
+        QueueFlush(addr, size);
         return;
+    }
 
-    PAddr cur_fb_color_addr = regs.framebuffer.GetColorBufferPhysicalAddress();
-    u32 cur_fb_color_size = Pica::Regs::BytesPerColorPixel(regs.framebuffer.color_format)
-                            * regs.framebuffer.GetWidth() * regs.framebuffer.GetHeight();
+    ApplyFlush(addr, size);
+}
+
+void RasterizerOpenGL::ApplyFlush(PAddr addr, u32 size) {
+    // The software rasterizer keeps decoded textures around too, whichever renderer is in use
+    Pica::TextureCache::NotifyFlush(addr, size);
 
-    PAddr cur_fb_depth_addr = regs.framebuffer.GetDepthBufferPhysicalAddress();
-    u32 cur_fb_depth_size = Pica::Regs::BytesPerDepthPixel(regs.framebuffer.depth_format)
-                            * regs.framebuffer.GetWidth() * regs.framebuffer.GetHeight();
+    if (!Settings::values.use_hw_renderer)
+        return;
 
-    // If modified memory region overlaps 3DS framebuffers, reload their contents into OpenGL
-    if (MathUtil::IntervalsIntersect(addr, size, cur_fb_color_addr, cur_fb_color_size))
-        ReloadColorBuffer();
+    FlushBatch();
 
-    if (MathUtil::IntervalsIntersect(addr, size, cur_fb_depth_addr, cur_fb_depth_size))
-        ReloadDepthBuffer();
+    // Presenting the display outputs there would hide the new contents
+    RemoveDisplayOutputs(addr, size, false);
+
+    // Reload the surfaces of the current framebuffer from the modified memory region, drop any other
+    // surface there so that it is loaded again if it is used
+    for (auto it = surfaces.begin(); it != surfaces.end();) {
+        Surface& surface = **it;
+        if (!RangesOverlap(addr, size, surface.addr, surface.size)) {
+            ++it;
+        } else if (&surface == fb_color || &surface == fb_depth) {
+            ReloadSurface(surface);
+            ++it;
+        } else {
+            it = RemoveSurface(it);
+        }
+    }
 
     // Notify cache of flush in case the region touches a cached resource
     res_cache.NotifyFlush(addr, size);
 }
 
-void RasterizerOpenGL::ReconfigureColorTexture(TextureInfo& texture, Pica::Regs::ColorFormat format, u32 width, u32 height) {
-    GLint internal_format;
+void RasterizerOpenGL::BeginNotifyBatch() {
+    notify_batch_open = true;
+}
 
-    texture.format = format;
-    texture.width = width;
-    texture.height = height;
+void RasterizerOpenGL::EndNotifyBatch() {
+    notify_batch_open = false;
+    ApplyPendingFlushes();
+}
 
-    switch (format) {
-    case Pica::Regs::ColorFormat::RGBA8:
-        internal_format = GL_RGBA;
-        texture.gl_format = GL_RGBA;
-        texture.gl_type = GL_UNSIGNED_INT_8_8_8_8;
-        break;
+void RasterizerOpenGL::QueueFlush(PAddr addr, u32 size) {
+    PAddr start = addr;
+    PAddr end = addr + size;
+    for (auto it = pending_flushes.begin(); it != pending_flushes.end();) {
+        if (it->first > end || it->first + it->second < start) {
+            ++it;
+            continue;
+        }
+        start = std::min(start, it->first);
+        end = std::max(end, it->first + it->second);
+        it = pending_flushes.erase(it);
+    }
+    pending_flushes.emplace_back(start, end - start);
+}
 
-    case Pica::Regs::ColorFormat::RGB8:
-        // This pixel format uses BGR since GL_UNSIGNED_BYTE specifies byte-order, unlike every
-        // specific OpenGL type used in this function using native-endian (that is, little-endian
-        // mostly everywhere) for words or half-words.
-        // TODO: check how those behave on big-endian processors.
-        internal_format = GL_RGB;
-        texture.gl_format = GL_BGR;
-        texture.gl_type = GL_UNSIGNED_BYTE;
-        break;
+void RasterizerOpenGL::ApplyPendingFlushes() {
+    if (pending_flushes.empty())
+        return;
 
-    case Pica::Regs::ColorFormat::RGB5A1:
-        internal_format = GL_RGBA;
-        texture.gl_format = GL_RGBA;
-        texture.gl_type = GL_UNSIGNED_SHORT_5_5_5_1;
-        break;
+    for (const auto& range : pending_flushes)
+        ApplyFlush(range.first, range.second);
+    pending_flushes.clear();
+}
 
-    case Pica::Regs::ColorFormat::RGB565:
-        internal_format = GL_RGB;
-        texture.gl_format = GL_RGB;
-        texture.gl_type = GL_UNSIGNED_SHORT_5_6_5;
-        break;
+bool RasterizerOpenGL::PendingFlushesOverlap(PAddr addr, u32 size) const {
+    auto overlaps_pending = [this](PAddr range_addr, u32 range_size) {
+        for (const auto& range : pending_flushes) {
+            if (RangesOverlap(range_addr, range_size, range.first, range.second))
+                return true;
+        }
+        return false;
+    };
+
+    if (pending_flushes.empty())
+        return false;
+    if (overlaps_pending(addr, size))
+        return true;
+    for (const auto& surface : surfaces) {
+        if (RangesOverlap(addr, size, surface->addr, surface->size) && overlaps_pending(surface->addr, surface->size))
+            return true;
+    }
+    for (const auto& output : display_outputs) {
+        if (RangesOverlap(addr, size, output->addr, output->size) && overlaps_pending(output->addr, output->size))
+            return true;
+    }
+    return false;
+}
 
-    case Pica::Regs::ColorFormat::RGBA4:
-        internal_format = GL_RGBA;
-        texture.gl_format = GL_RGBA;
-        texture.gl_type = GL_UNSIGNED_SHORT_4_4_4_4;
-        break;
+bool RasterizerOpenGL::WasRangeWritten(PAddr addr, u32 size) const {
+    for (const auto& range : written_ranges) {
+        if (RangesOverlap(addr, size, range.first, range.second))
+            return true;
+    }
+    return false;
+}
 
-    default:
-        LOG_CRITICAL(Render_OpenGL, "Unknown framebuffer texture color format %x", format);
-        UNIMPLEMENTED();
-        break;
+void RasterizerOpenGL::ClearWrittenRanges() {
+    written_ranges.clear();
+}
+
+bool RasterizerOpenGL::CopyDisplayOutput(PAddr addr, u32 width, u32 height, u32 stride, u32 format, GLuint texture) {
+    ApplyPendingFlushes();
+
+    const u32 size = stride * height;
+    for (auto& output : display_outputs) {
+        if (!RangesOverlap(addr, size, output->addr, output->size))
+            continue;
+
+        // The screen texture has the rows of 3DS memory too, so the output is copied as it is
+        if (output->addr == addr && output->format == format && output->width == (GLsizei)width &&
+            output->height == (GLsizei)height && width * GPU::Regs::BytesPerPixel((GPU::Regs::PixelFormat)format) == stride) {
+            BlitTexture(output->texture.handle, width, height, texture, width, height, false, GL_NEAREST);
+            return true;
+        }
+
+        CommitDisplayOutput(*output);
     }
+    return false;
+}
 
-    state.texture_units[0].enabled_2d = true;
-    state.texture_units[0].texture_2d = texture.texture.handle;
-    state.Apply();
+void RasterizerOpenGL::RecordWrittenRange(PAddr addr, u32 size) {
+    written_ranges.emplace_back(addr, size);
+    if (written_ranges.size() <= MAX_WRITTEN_RANGES)
+        return;
 
-    glActiveTexture(GL_TEXTURE0);
-    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, texture.width, texture.height, 0,
-                 texture.gl_format, texture.gl_type, nullptr);
+    // Keep the checks cheap, at worst unchanged screens are uploaded again
+    PAddr start = addr;
+    PAddr end = addr + size;
+    for (const auto& range : written_ranges) {
+        start = std::min(start, range.first);
+        end = std::max(end, range.first + range.second);
+    }
+    written_ranges.clear();
+    written_ranges.emplace_back(start, end - start);
 }
 
-void RasterizerOpenGL::ReconfigureDepthTexture(DepthTextureInfo& texture, Pica::Regs::DepthFormat format, u32 width, u32 height) {
-    GLint internal_format;
+RasterizerOpenGL::Surface* RasterizerOpenGL::GetSurface(PAddr addr, bool is_depth, u32 format, u32 width, u32 height) {
+    const u32 bytes_per_pixel = is_depth ? Pica::Regs::BytesPerDepthPixel((Pica::Regs::DepthFormat)format)
+                                         : Pica::Regs::BytesPerColorPixel((Pica::Regs::ColorFormat)format);
+    const u32 size = width * height * bytes_per_pixel;
+
+    // Surfaces never overlap, so an exact match is the only surface in the range
+    for (auto it = surfaces.begin(); it != surfaces.end();) {
+        Surface& surface = **it;
+        if (surface.addr == addr && surface.is_depth == is_depth && surface.format == format &&
+            surface.width == (GLsizei)width && surface.height == (GLsizei)height) {
+            return &surface;
+        }
 
-    texture.format = format;
-    texture.width = width;
-    texture.height = height;
+        if (RangesOverlap(addr, size, surface.addr, surface.size)) {
+            CommitSurface(surface);
+            it = RemoveSurface(it);
+        } else {
+            ++it;
+        }
+    }
 
-    switch (format) {
-    case Pica::Regs::DepthFormat::D16:
-        internal_format = GL_DEPTH_COMPONENT16;
-        texture.gl_format = GL_DEPTH_COMPONENT;
-        texture.gl_type = GL_UNSIGNED_SHORT;
-        break;
+    // Make room by dropping the oldest surface that isn't part of the current framebuffer
+    if (surfaces.size() >= MAX_SURFACES) {
+        for (auto it = surfaces.begin(); it != surfaces.end(); ++it) {
+            if (it->get() != fb_color && it->get() != fb_depth) {
+                CommitSurface(**it);
+                RemoveSurface(it);
+                break;
+            }
+        }
+    }
 
-    case Pica::Regs::DepthFormat::D24:
-        internal_format = GL_DEPTH_COMPONENT24;
-        texture.gl_format = GL_DEPTH_COMPONENT;
-        texture.gl_type = GL_UNSIGNED_INT_24_8;
-        break;
+    // Drawing to the surface would change the memory of the outputs without them noticing
+    RemoveDisplayOutputs(addr, size, true);
 
-    case Pica::Regs::DepthFormat::D24S8:
-        internal_format = GL_DEPTH24_STENCIL8;
-        texture.gl_format = GL_DEPTH_STENCIL;
-        texture.gl_type = GL_UNSIGNED_INT_24_8;
-        break;
+    std::unique_ptr<Surface> new_surface = CreateSurface(addr, is_depth, format, width, height);
+    Surface& surface = *new_surface;
+    surfaces.push_back(std::move(new_surface));
 
-    default:
-        LOG_CRITICAL(Render_OpenGL, "Unknown framebuffer texture depth format %x", format);
-        UNIMPLEMENTED();
-        break;
+    ReloadSurface(surface);
+    return &surface;
+}
+
+std::unique_ptr<RasterizerOpenGL::Surface> RasterizerOpenGL::CreateSurface(PAddr addr, bool is_depth, u32 format, u32 width, u32 height) {
+    const u32 bytes_per_pixel = is_depth ? Pica::Regs::BytesPerDepthPixel((Pica::Regs::DepthFormat)format)
+                                         : Pica::Regs::BytesPerColorPixel((Pica::Regs::ColorFormat)format);
+    const u32 size = width * height * bytes_per_pixel;
+
+    std::unique_ptr<Surface> new_surface = Common::make_unique<Surface>();
+    Surface& surface = *new_surface;
+
+    surface.addr = addr;
+    surface.size = size;
+    surface.is_depth = is_depth;
+    surface.format = format;
+    surface.width = width;
+    surface.height = height;
+    surface.dirty = false;
+    surface.readback_fence = nullptr;
+    surface.sample_texture_valid = false;
+
+    GLint internal_format = GL_RGBA;
+
+    if (!is_depth) {
+        surface.gl_size = size;
+
+        switch ((Pica::Regs::ColorFormat)format) {
+        case Pica::Regs::ColorFormat::RGBA8:
+            internal_format = GL_RGBA;
+            surface.gl_format = GL_RGBA;
+            surface.gl_type = GL_UNSIGNED_INT_8_8_8_8;
+            break;
+
+        case Pica::Regs::ColorFormat::RGB8:
+            // This pixel format uses BGR since GL_UNSIGNED_BYTE specifies byte-order, unlike every
+            // specific OpenGL type used in this function using native-endian (that is, little-endian
+            // mostly everywhere) for words or half-words.
+            // TODO: check how those behave on big-endian processors.
+            internal_format = GL_RGB;
+            surface.gl_format = GL_BGR;
+            surface.gl_type = GL_UNSIGNED_BYTE;
+            break;
+
+        case Pica::Regs::ColorFormat::RGB5A1:
+            internal_format = GL_RGBA;
+            surface.gl_format = GL_RGBA;
+            surface.gl_type = GL_UNSIGNED_SHORT_5_5_5_1;
+            break;
+
+        case Pica::Regs::ColorFormat::RGB565:
+            internal_format = GL_RGB;
+            surface.gl_format = GL_RGB;
+            surface.gl_type = GL_UNSIGNED_SHORT_5_6_5;
+            break;
+
+        case Pica::Regs::ColorFormat::RGBA4:
+            internal_format = GL_RGBA;
+            surface.gl_format = GL_RGBA;
+            surface.gl_type = GL_UNSIGNED_SHORT_4_4_4_4;
+            break;
+
+        default:
+            LOG_CRITICAL(Render_OpenGL, "Unknown framebuffer texture color format %x", format);
+            UNIMPLEMENTED();
+            break;
+        }
+    } else {
+        // OpenGL needs 4 bpp alignment for D24
+        surface.gl_size = width * height * (bytes_per_pixel == 3 ? 4 : bytes_per_pixel);
+
+        switch ((Pica::Regs::DepthFormat)format) {
+        case Pica::Regs::DepthFormat::D16:
+            internal_format = GL_DEPTH_COMPONENT16;
+            surface.gl_format = GL_DEPTH_COMPONENT;
+            surface.gl_type = GL_UNSIGNED_SHORT;
+            break;
+
+        case Pica::Regs::DepthFormat::D24:
+            internal_format = GL_DEPTH_COMPONENT24;
+            surface.gl_format = GL_DEPTH_COMPONENT;
+            surface.gl_type = GL_UNSIGNED_INT_24_8;
+            break;
+
+        case Pica::Regs::DepthFormat::D24S8:
+            internal_format = GL_DEPTH24_STENCIL8;
+            surface.gl_format = GL_DEPTH_STENCIL;
+            surface.gl_type = GL_UNSIGNED_INT_24_8;
+            break;
+
+        default:
+            LOG_CRITICAL(Render_OpenGL, "Unknown framebuffer texture depth format %x", format);
+            UNIMPLEMENTED();
+            break;
+        }
     }
 
+    surface.texture.Create();
+    surface.readback_buffer.Create();
+    // The texture, and the readback buffer once the surface is committed
+    surface.memory_usage.Set(2 * surface.gl_size);
+
     state.texture_units[0].enabled_2d = true;
-    state.texture_units[0].texture_2d = texture.texture.handle;
+    state.texture_units[0].texture_2d = surface.texture.handle;
     state.Apply();
 
-    glActiveTexture(GL_TEXTURE0);
-    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, texture.width, texture.height, 0,
-                 texture.gl_format, texture.gl_type, nullptr);
+    OpenGLState::SetActiveTexture(0);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, surface.width, surface.height, 0,
+                 surface.gl_format, surface.gl_type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (is_depth) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    }
+
+    return new_surface;
 }
 
-void RasterizerOpenGL::SyncFramebuffer() {
-    const auto& regs = Pica::g_state.regs;
+std::vector<std::unique_ptr<RasterizerOpenGL::Surface>>::iterator RasterizerOpenGL::RemoveSurface(std::vector<std::unique_ptr<Surface>>::iterator it) {
+    Surface& surface = **it;
 
-    PAddr cur_fb_color_addr = regs.framebuffer.GetColorBufferPhysicalAddress();
-    Pica::Regs::ColorFormat new_fb_color_format = regs.framebuffer.color_format;
+    DiscardReadback(surface.readback_fence);
 
-    PAddr cur_fb_depth_addr = regs.framebuffer.GetDepthBufferPhysicalAddress();
-    Pica::Regs::DepthFormat new_fb_depth_format = regs.framebuffer.depth_format;
+    if (&surface == fb_color)
+        fb_color = nullptr;
+    if (&surface == fb_depth)
+        fb_depth = nullptr;
 
-    bool fb_size_changed = fb_color_texture.width != regs.framebuffer.GetWidth() ||
-                           fb_color_texture.height != regs.framebuffer.GetHeight();
+    // The texture names may be reused by new surfaces, which have to be attached again
+    if (surface.texture.handle == attached_color_texture)
+        attached_color_texture = 0;
+    if (surface.texture.handle == attached_depth_texture)
+        attached_depth_texture = 0;
 
-    bool color_fb_prop_changed = fb_color_texture.format != new_fb_color_format ||
-                                 fb_size_changed;
+    // OpenGL unbinds deleted textures, keep the state in sync with that
+    for (auto& texture_unit : state.texture_units) {
+        if (texture_unit.texture_2d == surface.texture.handle || texture_unit.texture_2d == surface.sample_texture.handle)
+            texture_unit.texture_2d = 0;
+    }
 
-    bool depth_fb_prop_changed = fb_depth_texture.format != new_fb_depth_format ||
-                                 fb_size_changed;
+    auto next = surfaces.erase(it);
+    state.Apply();
+    return next;
+}
 
-    bool color_fb_modified = last_fb_color_addr != cur_fb_color_addr ||
-                             color_fb_prop_changed;
+void RasterizerOpenGL::SyncFramebuffer() {
+    const auto& regs = Pica::g_state.regs;
 
-    bool depth_fb_modified = last_fb_depth_addr != cur_fb_depth_addr ||
-                             depth_fb_prop_changed;
+    // Switching framebuffers keeps the previous surfaces resident, they are only committed once their memory is read
+    fb_color = GetSurface(regs.framebuffer.GetColorBufferPhysicalAddress(), false, (u32)regs.framebuffer.color_format.Value(),
+                          regs.framebuffer.GetWidth(), regs.framebuffer.GetHeight());
+    fb_depth = GetSurface(regs.framebuffer.GetDepthBufferPhysicalAddress(), true, (u32)regs.framebuffer.depth_format,
+                          regs.framebuffer.GetWidth(), regs.framebuffer.GetHeight());
 
-    // Commit if framebuffer modified in any way
-    if (color_fb_modified)
-        CommitColorBuffer();
+    // Looking up the depth surface drops the color surface if the buffers overlap
+    const GLuint color_texture = fb_color != nullptr ? fb_color->texture.handle : 0;
+    const GLuint depth_texture = fb_depth->texture.handle;
 
-    if (depth_fb_modified)
-        CommitDepthBuffer();
+    state.draw.framebuffer = framebuffer.handle;
+    state.Apply();
 
-    // Reconfigure framebuffer textures if any property has changed
-    if (color_fb_prop_changed) {
-        ReconfigureColorTexture(fb_color_texture, new_fb_color_format,
-                                regs.framebuffer.GetWidth(), regs.framebuffer.GetHeight());
+    if (color_texture != attached_color_texture) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_texture, 0);
+        attached_color_texture = color_texture;
     }
 
-    if (depth_fb_prop_changed) {
-        ReconfigureDepthTexture(fb_depth_texture, new_fb_depth_format,
-                                regs.framebuffer.GetWidth(), regs.framebuffer.GetHeight());
+    if (depth_texture != attached_depth_texture) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_texture, 0);
 
         // Only attach depth buffer as stencil if it supports stencil
-        switch (new_fb_depth_format) {
+        switch ((Pica::Regs::DepthFormat)fb_depth->format) {
         case Pica::Regs::DepthFormat::D16:
         case Pica::Regs::DepthFormat::D24:
             glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
             break;
 
         case Pica::Regs::DepthFormat::D24S8:
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, fb_depth_texture.texture.handle, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth_texture, 0);
             break;
 
         default:
-            LOG_CRITICAL(Render_OpenGL, "Unknown framebuffer depth format %x", new_fb_depth_format);
+            LOG_CRITICAL(Render_OpenGL, "Unknown framebuffer depth format %x", fb_depth->format);
             UNIMPLEMENTED();
             break;
         }
-    }
-
-    // Load buffer data again if fb modified in any way
-    if (color_fb_modified) {
-        last_fb_color_addr = cur_fb_color_addr;
-
-        ReloadColorBuffer();
-    }
-
-    if (depth_fb_modified) {
-        last_fb_depth_addr = cur_fb_depth_addr;
 
-        ReloadDepthBuffer();
+        attached_depth_texture = depth_texture;
     }
 }
 
@@ -635,9 +1260,10 @@ void RasterizerOpenGL::SyncBlendColor() {
 
 void RasterizerOpenGL::SyncAlphaTest() {
     const auto& regs = Pica::g_state.regs;
-    glUniform1i(uniform_alphatest_enabled, regs.output_merger.alpha_test.enable);
-    glUniform1i(uniform_alphatest_func, (GLint)regs.output_merger.alpha_test.func.Value());
-    glUniform1f(uniform_alphatest_ref, regs.output_merger.alpha_test.ref / 255.0f);
+    uniform_block_data.alphatest_enabled = regs.output_merger.alpha_test.enable;
+    uniform_block_data.alphatest_func = (GLint)regs.output_merger.alpha_test.func.Value();
+    uniform_block_data.alphatest_ref = regs.output_merger.alpha_test.ref / 255.0f;
+    uniform_block_data_dirty = true;
 }
 
 void RasterizerOpenGL::SyncLogicOp() {
@@ -656,161 +1282,555 @@ void RasterizerOpenGL::SyncDepthTest() {
 }
 
 void RasterizerOpenGL::SyncTevSources(unsigned stage_index, const Pica::Regs::TevStageConfig& config) {
-    GLint color_srcs[3] = { (GLint)config.color_source1.Value(),
-                            (GLint)config.color_source2.Value(),
-                            (GLint)config.color_source3.Value() };
-    GLint alpha_srcs[3] = { (GLint)config.alpha_source1.Value(),
-                            (GLint)config.alpha_source2.Value(),
-                            (GLint)config.alpha_source3.Value() };
-
-    glUniform3iv(uniform_tev_cfgs[stage_index].color_sources, 1, color_srcs);
-    glUniform3iv(uniform_tev_cfgs[stage_index].alpha_sources, 1, alpha_srcs);
+    auto& tev_cfg = uniform_block_data.tev_cfgs[stage_index];
+    tev_cfg.color_sources[0] = (GLint)config.color_source1.Value();
+    tev_cfg.color_sources[1] = (GLint)config.color_source2.Value();
+    tev_cfg.color_sources[2] = (GLint)config.color_source3.Value();
+    tev_cfg.alpha_sources[0] = (GLint)config.alpha_source1.Value();
+    tev_cfg.alpha_sources[1] = (GLint)config.alpha_source2.Value();
+    tev_cfg.alpha_sources[2] = (GLint)config.alpha_source3.Value();
+    uniform_block_data_dirty = true;
 }
 
 void RasterizerOpenGL::SyncTevModifiers(unsigned stage_index, const Pica::Regs::TevStageConfig& config) {
-    GLint color_mods[3] = { (GLint)config.color_modifier1.Value(),
-                            (GLint)config.color_modifier2.Value(),
-                            (GLint)config.color_modifier3.Value() };
-    GLint alpha_mods[3] = { (GLint)config.alpha_modifier1.Value(),
-                            (GLint)config.alpha_modifier2.Value(),
-                            (GLint)config.alpha_modifier3.Value() };
-
-    glUniform3iv(uniform_tev_cfgs[stage_index].color_modifiers, 1, color_mods);
-    glUniform3iv(uniform_tev_cfgs[stage_index].alpha_modifiers, 1, alpha_mods);
+    auto& tev_cfg = uniform_block_data.tev_cfgs[stage_index];
+    tev_cfg.color_modifiers[0] = (GLint)config.color_modifier1.Value();
+    tev_cfg.color_modifiers[1] = (GLint)config.color_modifier2.Value();
+    tev_cfg.color_modifiers[2] = (GLint)config.color_modifier3.Value();
+    tev_cfg.alpha_modifiers[0] = (GLint)config.alpha_modifier1.Value();
+    tev_cfg.alpha_modifiers[1] = (GLint)config.alpha_modifier2.Value();
+    tev_cfg.alpha_modifiers[2] = (GLint)config.alpha_modifier3.Value();
+    uniform_block_data_dirty = true;
 }
 
 void RasterizerOpenGL::SyncTevOps(unsigned stage_index, const Pica::Regs::TevStageConfig& config) {
-    glUniform2i(uniform_tev_cfgs[stage_index].color_alpha_op, (GLint)config.color_op.Value(), (GLint)config.alpha_op.Value());
+    auto& tev_cfg = uniform_block_data.tev_cfgs[stage_index];
+    tev_cfg.color_alpha_op[0] = (GLint)config.color_op.Value();
+    tev_cfg.color_alpha_op[1] = (GLint)config.alpha_op.Value();
+    uniform_block_data_dirty = true;
 }
 
 void RasterizerOpenGL::SyncTevColor(unsigned stage_index, const Pica::Regs::TevStageConfig& config) {
     auto const_color = PicaToGL::ColorRGBA8((u8*)&config.const_r);
-    glUniform4fv(uniform_tev_cfgs[stage_index].const_color, 1, const_color.data());
+    std::copy(const_color.begin(), const_color.end(), uniform_block_data.tev_cfgs[stage_index].const_color);
+    uniform_block_data_dirty = true;
 }
 
 void RasterizerOpenGL::SyncTevMultipliers(unsigned stage_index, const Pica::Regs::TevStageConfig& config) {
-    glUniform2i(uniform_tev_cfgs[stage_index].color_alpha_multiplier, config.GetColorMultiplier(), config.GetAlphaMultiplier());
+    auto& tev_cfg = uniform_block_data.tev_cfgs[stage_index];
+    tev_cfg.color_alpha_multiplier[0] = config.GetColorMultiplier();
+    tev_cfg.color_alpha_multiplier[1] = config.GetAlphaMultiplier();
+    uniform_block_data_dirty = true;
 }
 
 void RasterizerOpenGL::SyncCombinerColor() {
     auto combiner_color = PicaToGL::ColorRGBA8((u8*)&Pica::g_state.regs.tev_combiner_buffer_color.r);
-    glUniform4fv(uniform_tev_combiner_buffer_color, 1, combiner_color.data());
+    std::copy(combiner_color.begin(), combiner_color.end(), uniform_block_data.tev_combiner_buffer_color);
+    uniform_block_data_dirty = true;
 }
 
 void RasterizerOpenGL::SyncCombinerWriteFlags() {
     const auto& regs = Pica::g_state.regs;
-    const auto tev_stages = regs.GetTevStages();
+    const auto& tev_stages = Pica::DerivedState::GetTevStages();
     for (unsigned tev_stage_index = 0; tev_stage_index < tev_stages.size(); ++tev_stage_index) {
-        glUniform2i(uniform_tev_cfgs[tev_stage_index].updates_combiner_buffer_color_alpha,
-                    regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferColor(tev_stage_index),
-                    regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferAlpha(tev_stage_index));
+        auto& tev_cfg = uniform_block_data.tev_cfgs[tev_stage_index];
+        tev_cfg.updates_combiner_buffer_color_alpha[0] = regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferColor(tev_stage_index);
+        tev_cfg.updates_combiner_buffer_color_alpha[1] = regs.tev_combiner_buffer_input.TevStageUpdatesCombinerBufferAlpha(tev_stage_index);
     }
+    uniform_block_data_dirty = true;
 }
 
 void RasterizerOpenGL::SyncDrawState() {
-    const auto& regs = Pica::g_state.regs;
-
-    // Sync the viewport
-    GLsizei viewport_width = (GLsizei)Pica::float24::FromRawFloat24(regs.viewport_size_x).ToFloat32() * 2;
-    GLsizei viewport_height = (GLsizei)Pica::float24::FromRawFloat24(regs.viewport_size_y).ToFloat32() * 2;
-
-    // OpenGL uses different y coordinates, so negate corner offset and flip origin
-    // TODO: Ensure viewport_corner.x should not be negated or origin flipped
-    // TODO: Use floating-point viewports for accuracy if supported
-    glViewport((GLsizei)static_cast<float>(regs.viewport_corner.x),
-                -(GLsizei)static_cast<float>(regs.viewport_corner.y)
-                    + regs.framebuffer.GetHeight() - viewport_height,
-                viewport_width, viewport_height);
-
-    // Sync bound texture(s), upload if not cached
-    const auto pica_textures = regs.GetTextures();
+    // Sync bound texture(s), sampling render targets directly and uploading others if not cached
+    batch_samples_surface = false;
+    GLint flipped_textures = 0;
+    const auto& pica_textures = Pica::DerivedState::GetTextures();
     for (unsigned texture_index = 0; texture_index < pica_textures.size(); ++texture_index) {
         const auto& texture = pica_textures[texture_index];
 
         if (texture.enabled) {
             state.texture_units[texture_index].enabled_2d = true;
-            res_cache.LoadAndBindTexture(state, texture_index, texture);
+            if (BindSurfaceTexture(texture_index, texture))
+                batch_samples_surface = true;
+            else if (res_cache.LoadAndBindTexture(state, texture_index, texture))
+                flipped_textures |= 1 << texture_index;
         } else {
             state.texture_units[texture_index].enabled_2d = false;
         }
     }
+    if (uniform_block_data.flipped_textures != flipped_textures) {
+        uniform_block_data.flipped_textures = flipped_textures;
+        uniform_block_data_dirty = true;
+    }
+
+    // Sync the viewport, after the textures since decoding them draws with a viewport of their own
+    const Pica::DerivedState::Viewport& viewport = Pica::DerivedState::GetViewport();
+    GLsizei viewport_width = (GLsizei)viewport.halfsize_x.ToFloat32() * 2;
+    GLsizei viewport_height = (GLsizei)viewport.halfsize_y.ToFloat32() * 2;
+
+    // OpenGL uses different y coordinates, so negate corner offset and flip origin
+    // TODO: Ensure viewport_corner.x should not be negated or origin flipped
+    // TODO: Use floating-point viewports for accuracy if supported
+    glViewport((GLsizei)viewport.offset_x.ToFloat32(),
+                -(GLsizei)viewport.offset_y.ToFloat32()
+                    + Pica::DerivedState::GetFramebuffer().height - viewport_height,
+                viewport_width, viewport_height);
 
     // Skip processing TEV stages that simply pass the previous stage results through
-    const auto tev_stages = regs.GetTevStages();
+    const auto& tev_stages = Pica::DerivedState::GetTevStages();
     for (unsigned tev_stage_index = 0; tev_stage_index < tev_stages.size(); ++tev_stage_index) {
-        glUniform1i(uniform_tev_cfgs[tev_stage_index].enabled, !IsPassThroughTevStage(tev_stages[tev_stage_index]));
+        GLint enabled = !GLShader::IsPassThroughTevStage(tev_stages[tev_stage_index]);
+        if (uniform_block_data.tev_cfgs[tev_stage_index].enabled != enabled) {
+            uniform_block_data.tev_cfgs[tev_stage_index].enabled = enabled;
+            uniform_block_data_dirty = true;
+        }
     }
 
+    SetShader();
+
     state.Apply();
+
+    UploadUniforms();
 }
 
-void RasterizerOpenGL::ReloadColorBuffer() {
-    u8* color_buffer = Memory::GetPhysicalPointer(Pica::g_state.regs.framebuffer.GetColorBufferPhysicalAddress());
+void RasterizerOpenGL::PrefetchTexture(unsigned texture_unit) {
+    const auto& texture = Pica::DerivedState::GetTextures()[texture_unit];
+    if (!texture.enabled)
+        return;
 
-    if (color_buffer == nullptr)
+    // Textures overlapping surfaces are sampled from them, or loaded once they are committed
+    const PAddr addr = texture.config.GetPhysicalAddress();
+    const u32 size = texture.config.width * texture.config.height * Pica::Regs::NibblesPerPixel(texture.format) / 2;
+    for (auto& surface : surfaces) {
+        if (RangesOverlap(addr, size, surface->addr, surface->size))
+            return;
+    }
+    for (auto& output : display_outputs) {
+        if (RangesOverlap(addr, size, output->addr, output->size))
+            return;
+    }
+
+    res_cache.PrefetchTexture(texture);
+}
+
+bool RasterizerOpenGL::BindSurfaceTexture(unsigned texture_unit, const Pica::Regs::FullTextureConfig& config) {
+    const PAddr addr = config.config.GetPhysicalAddress();
+    const u32 size = config.config.width * config.config.height * Pica::Regs::NibblesPerPixel(config.format) / 2;
+
+    // Textures are loaded from 3DS memory unless they're a surface
+    CommitDisplayOutputs(addr, size);
+
+    // Color buffer formats share their values with the texture formats they can be sampled as
+    Surface* match = nullptr;
+    for (auto& surface : surfaces) {
+        if (!RangesOverlap(addr, size, surface->addr, surface->size))
+            continue;
+
+        if (!surface->is_depth && surface->addr == addr && surface->format == (u32)config.format &&
+            surface->width == (GLsizei)config.config.width && surface->height == (GLsizei)config.config.height) {
+            match = surface.get();
+        } else {
+            CommitSurface(*surface);
+        }
+    }
+
+    if (match == nullptr)
+        return false;
+
+    if (!match->sample_texture_valid)
+        UpdateSampleTexture(*match, texture_unit, config);
+
+    state.texture_units[texture_unit].texture_2d = match->sample_texture.handle;
+    return true;
+}
+
+/// Value of KHR_parallel_shader_compile, which the generated GL loader doesn't know about
+static const GLenum GL_COMPLETION_STATUS_KHR = 0x91B1;
+
+bool RasterizerOpenGL::IsProgramPending(GLuint program) const {
+    // Without the extension, asking for the link status waits for the program instead
+    if (!parallel_shader_compile)
+        return false;
+
+    GLint completed = GL_FALSE;
+    glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed != GL_TRUE;
+}
+
+void RasterizerOpenGL::SetShader() {
+    const PicaShaderConfig config = PicaShaderConfig::CurrentConfig();
+
+    auto cached_shader = shader_cache.find(config);
+    if (cached_shader == shader_cache.end()) {
+        auto pending_shader = pending_shaders.find(config);
+        if (pending_shader == pending_shaders.end()) {
+            std::unique_ptr<OGLShader> program(new OGLShader);
+            shader_cache_misses_counter.Add();
+            const std::string fragment_shader = GLShader::GenerateFragmentShader(config);
+            program->handle = ShaderUtil::CompileShaders(GLShaders::g_vertex_shader_hw, fragment_shader.c_str());
+
+            // The vertex array is shared by all programs
+            glBindAttribLocation(program->handle, attrib_position, "vert_position");
+            glBindAttribLocation(program->handle, attrib_color, "vert_color");
+            glBindAttribLocation(program->handle, attrib_texcoords, "vert_texcoords");
+            glLinkProgram(program->handle);
+
+            pending_shader = pending_shaders.emplace(config, std::move(program)).first;
+        }
+
+        // Draw with the uber shader while the driver builds the program in the background
+        if (IsProgramPending(pending_shader->second->handle)) {
+            state.draw.shader_program = shader.handle;
+            return;
+        }
+
+        std::unique_ptr<OGLShader> program = std::move(pending_shader->second);
+        pending_shaders.erase(pending_shader);
+
+        if (ShaderUtil::CheckProgram(program->handle)) {
+            state.draw.shader_program = program->handle;
+            state.Apply();
+            SetupShaderBindings(program->handle);
+        } else {
+            // Keep drawing with the uber shader, and don't retry the same configuration
+            LOG_ERROR(Render_OpenGL, "Failed to build a specialized fragment shader, using the generic one");
+            program.reset();
+        }
+
+        cached_shader = shader_cache.emplace(config, std::move(program)).first;
+    }
+
+    state.draw.shader_program = cached_shader->second ? cached_shader->second->handle : shader.handle;
+}
+
+void RasterizerOpenGL::UploadUniforms() {
+    if (!uniform_block_data_dirty)
         return;
 
-    u32 bytes_per_pixel = Pica::Regs::BytesPerColorPixel(fb_color_texture.format);
+    // The buffer stays bound to GL_UNIFORM_BUFFER since InitObjects, UploadVSUniforms binds it back
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(UniformData), &uniform_block_data);
+    uniform_block_data_dirty = false;
+}
+
+OGLShader* RasterizerOpenGL::GetVertexShaderProgram() {
+    if (vs_program_dirty) {
+        const auto& vs = Pica::g_state.vs;
+        const u64 hashes[] = {
+            Common::ComputeHash64(vs.program_code.data(), sizeof(vs.program_code)),
+            Common::ComputeHash64(vs.swizzle_data.data(), sizeof(vs.swizzle_data)),
+        };
+        vs_program_hash = Common::ComputeHash64(hashes, sizeof(hashes));
+        vs_program_dirty = false;
+    }
 
-    std::unique_ptr<u8[]> temp_fb_color_buffer(new u8[fb_color_texture.width * fb_color_texture.height * bytes_per_pixel]);
+    const PicaVSConfig vs_config = PicaVSConfig::CurrentConfig(vs_program_hash);
+    auto cached_source = vs_source_cache.find(vs_config);
+    if (cached_source == vs_source_cache.end()) {
+        std::unique_ptr<std::string> source(new std::string);
+        if (!GLShader::GenerateVertexShader(vs_config, *source))
+            source.reset();
+        cached_source = vs_source_cache.emplace(vs_config, std::move(source)).first;
+    }
+    if (cached_source->second == nullptr)
+        return nullptr;
+
+    // Both configurations are zero-padded, so their bytes can be hashed together
+    const PicaShaderConfig fs_config = PicaShaderConfig::CurrentConfig();
+    u8 key_data[sizeof(PicaVSConfig) + sizeof(PicaShaderConfig)];
+    memcpy(key_data, &vs_config, sizeof(PicaVSConfig));
+    memcpy(key_data + sizeof(PicaVSConfig), &fs_config, sizeof(PicaShaderConfig));
+    const u64 key = Common::ComputeHash64(key_data, sizeof(key_data));
+
+    auto cached_program = vs_program_cache.find(key);
+    if (cached_program == vs_program_cache.end()) {
+        auto pending_program = pending_vs_programs.find(key);
+        if (pending_program == pending_vs_programs.end()) {
+            std::unique_ptr<OGLShader> program(new OGLShader);
+            shader_cache_misses_counter.Add();
+            const std::string fragment_shader = GLShader::GenerateFragmentShader(fs_config);
+            program->handle = ShaderUtil::CompileShaders(cached_source->second->c_str(), fragment_shader.c_str());
+
+            // Input attribute i is sourced from vertex attribute array i
+            for (u32 i = 0; i < vs_config.num_attributes; ++i)
+                glBindAttribLocation(program->handle, i, ("vs_in_attr" + std::to_string(i)).c_str());
+            glLinkProgram(program->handle);
+
+            pending_program = pending_vs_programs.emplace(key, std::move(program)).first;
+        }
 
-    // Directly copy pixels. Internal OpenGL color formats are consistent so no conversion is necessary.
-    for (int y = 0; y < fb_color_texture.height; ++y) {
-        for (int x = 0; x < fb_color_texture.width; ++x) {
-            const u32 coarse_y = y & ~7;
-            u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * fb_color_texture.width * bytes_per_pixel;
-            u32 gl_px_idx = x * bytes_per_pixel + y * fb_color_texture.width * bytes_per_pixel;
+        // Run the shader on the CPU while the driver builds the program in the background
+        if (IsProgramPending(pending_program->second->handle))
+            return nullptr;
+
+        std::unique_ptr<OGLShader> program = std::move(pending_program->second);
+        pending_vs_programs.erase(pending_program);
+
+        if (ShaderUtil::CheckProgram(program->handle)) {
+            state.draw.shader_program = program->handle;
+            state.Apply();
+            SetupShaderBindings(program->handle);
+            glUniformBlockBinding(program->handle, glGetUniformBlockIndex(program->handle, "vs_uniforms"),
+                                  GLShader::VS_UNIFORM_BLOCK_BINDING);
+        } else {
+            // Keep running the shader on the CPU, and don't retry the same configuration
+            LOG_ERROR(Render_OpenGL, "Failed to build a translated vertex shader, running it on the CPU");
+            program.reset();
+        }
+
+        cached_program = vs_program_cache.emplace(key, std::move(program)).first;
+    }
+
+    return cached_program->second.get();
+}
+
+bool RasterizerOpenGL::SetupVertexArrays(u32 vertex_count) {
+    const auto& attribute_config = Pica::g_state.regs.vertex_attributes;
+    const PAddr base_address = attribute_config.GetPhysicalBaseAddress();
+    const int num_attributes = attribute_config.GetNumTotalAttributes();
+
+    struct LoaderData {
+        const u8* source;
+        u32 size;
+        GLintptr offset;
+    };
+    LoaderData loaders[12];
+    u32 loaded_attributes = 0;
+    GLsizeiptr total_size = 0;
+
+    // Every loader is copied as a whole, the attributes are pointed into its interleaved data
+    for (int loader = 0; loader < 12; ++loader) {
+        const auto& loader_config = attribute_config.attribute_loaders[loader];
+        loaders[loader].size = 0;
+        if (loader_config.component_count == 0 || vertex_count == 0)
+            continue;
+
+        u32 record_size = 0;
+        for (unsigned component = 0; component < loader_config.component_count; ++component) {
+            const int attribute_index = loader_config.GetComponent(component);
+            // Padding components and attributes partially filled in from default ones aren't supported
+            if (attribute_index >= 12 || attribute_index >= num_attributes)
+                return false;
+            if (attribute_config.IsDefaultAttribute(attribute_index) && attribute_config.GetNumElements(attribute_index) < 4)
+                return false;
+            record_size += attribute_config.GetStride(attribute_index);
+        }
+
+        const u32 stride = static_cast<u32>(loader_config.byte_count);
+        if (stride == 0)
+            return false;
+
+        const PAddr source = base_address + loader_config.data_offset;
+        const u32 size = stride * (vertex_count - 1) + record_size;
+        if (GetContiguousHostSize(source) < size)
+            return false;
+
+        loaders[loader].source = Memory::GetPhysicalPointer(source);
+        if (loaders[loader].source == nullptr)
+            return false;
+        MemoryStats::SampleGPURead(MemoryStats::GPURead::VertexArray, source, size);
+        loaders[loader].size = size;
+        loaders[loader].offset = total_size;
+        total_size += (size + 3) / 4 * 4;
+    }
+
+    GLintptr buffer_offset = 0;
+    u8* buffer = nullptr;
+    if (total_size != 0) {
+        buffer = vertex_buffer.Map(total_size, 4, &buffer_offset);
+        if (buffer == nullptr) {
+            LOG_ERROR(Render_OpenGL, "Failed to map the vertex buffer");
+            return false;
+        }
+    }
 
-            u8* pixel = color_buffer + dst_offset;
-            memcpy(&temp_fb_color_buffer[gl_px_idx], pixel, bytes_per_pixel);
+    for (int loader = 0; loader < 12; ++loader) {
+        if (loaders[loader].size == 0)
+            continue;
+
+        const auto& loader_config = attribute_config.attribute_loaders[loader];
+        memcpy(buffer + loaders[loader].offset, loaders[loader].source, loaders[loader].size);
+
+        GLintptr attribute_offset = buffer_offset + loaders[loader].offset;
+        for (unsigned component = 0; component < loader_config.component_count; ++component) {
+            const int attribute_index = loader_config.GetComponent(component);
+            glVertexAttribPointer(attribute_index, attribute_config.GetNumElements(attribute_index),
+                                  GetAttributeType(attribute_config.GetFormat(attribute_index)), GL_FALSE,
+                                  (GLsizei)loader_config.byte_count, reinterpret_cast<const GLvoid*>(attribute_offset));
+            attribute_offset += attribute_config.GetStride(attribute_index);
+            loaded_attributes |= 1 << attribute_index;
         }
     }
 
+    if (buffer != nullptr)
+        vertex_buffer.Unmap(total_size);
+
+    // Attributes without loader data are constant, missing components read as (0, 0, 0, 1) like
+    // the first attribute in the CPU vertex loading
+    for (int i = 0; i < num_attributes; ++i) {
+        if (loaded_attributes & (1 << i)) {
+            glEnableVertexAttribArray(i);
+            continue;
+        }
+
+        glDisableVertexAttribArray(i);
+        if (attribute_config.IsDefaultAttribute(i)) {
+            const auto& attribute = Pica::g_state.vs.default_attributes[i];
+            glVertexAttrib4f(i, attribute.x.ToFloat32(), attribute.y.ToFloat32(),
+                             attribute.z.ToFloat32(), attribute.w.ToFloat32());
+        } else {
+            glVertexAttrib4f(i, 0.0f, 0.0f, 0.0f, 1.0f);
+        }
+    }
+
+    return true;
+}
+
+void RasterizerOpenGL::UploadVSUniforms() {
+    if (!vs_uniforms_dirty)
+        return;
+
+    const auto& uniforms = Pica::g_state.vs.uniforms;
+    for (int i = 0; i < 96; ++i) {
+        for (int comp = 0; comp < 4; ++comp)
+            vs_uniform_data.float_uniforms[i][comp] = uniforms.f[i][comp].ToFloat32();
+    }
+    for (int i = 0; i < 4; ++i) {
+        for (int comp = 0; comp < 4; ++comp)
+            vs_uniform_data.int_uniforms[i][comp] = uniforms.i[i][comp];
+    }
+    vs_uniform_data.bool_uniforms = 0;
+    for (int i = 0; i < 16; ++i)
+        vs_uniform_data.bool_uniforms |= uniforms.b[i] ? (1 << i) : 0;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, vs_uniform_buffer.handle);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(VSUniformData), &vs_uniform_data);
+    glBindBuffer(GL_UNIFORM_BUFFER, uniform_buffer.handle);
+    vs_uniforms_dirty = false;
+}
+
+void RasterizerOpenGL::InitDetileShader(DetileShader& detile_shader, const char* fragment_shader) {
+    detile_shader.shader.Create(GLShaders::g_vertex_shader_fullscreen, fragment_shader);
+    detile_shader.uniform_format = glGetUniformLocation(detile_shader.shader.handle, "format");
+    detile_shader.uniform_width = glGetUniformLocation(detile_shader.shader.handle, "width");
+
+    OpenGLState init_state = state;
+    init_state.draw.shader_program = detile_shader.shader.handle;
+    init_state.Apply();
+    glUniform1i(glGetUniformLocation(detile_shader.shader.handle, "tiled_data"), DETILE_TEXTURE_UNIT);
+    state.Apply();
+}
+
+bool RasterizerOpenGL::DetileSurface(const DetileShader& detile_shader, Surface& surface, const u8* tiled_data) {
+    if (surface.size > (u32)max_texture_buffer_size)
+        return false;
+
+    glBindBuffer(GL_TEXTURE_BUFFER, detile_buffer.handle);
+    glBufferData(GL_TEXTURE_BUFFER, surface.size, tiled_data, GL_STREAM_DRAW);
+
+    // Draw with a plain state into the surface alone, it need not be attached to the PICA framebuffer
+    OpenGLState detile_state;
+    detile_state.draw.framebuffer = copy_draw_framebuffer.handle;
+    detile_state.draw.vertex_array = vertex_array.handle;
+    detile_state.draw.vertex_buffer = vertex_buffer.handle;
+    detile_state.draw.shader_program = detile_shader.shader.handle;
+    if (surface.is_depth) {
+        detile_state.depth.test_enabled = true;
+        detile_state.depth.test_func = GL_ALWAYS;
+        detile_state.depth.write_mask = GL_TRUE;
+    }
+    detile_state.Apply();
+
+    const GLenum attachment = surface.is_depth ? GL_DEPTH_ATTACHMENT : GL_COLOR_ATTACHMENT0;
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, surface.texture.handle, 0);
+
+    // A framebuffer without color attachment is only complete without a draw buffer
+    if (surface.is_depth)
+        glDrawBuffer(GL_NONE);
+
+    glUniform1i(detile_shader.uniform_format, surface.format);
+    glUniform1i(detile_shader.uniform_width, surface.width);
+
+    // The viewport is synced again before every draw
+    glViewport(0, 0, surface.width, surface.height);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    if (surface.is_depth)
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, 0, 0);
+
+    state.Apply();
+    return true;
+}
+
+void RasterizerOpenGL::ReloadColorSurface(Surface& surface) {
+    u8* color_buffer = Memory::GetPhysicalPointer(surface.addr);
+
+    if (color_buffer == nullptr)
+        return;
+
+    if (DetileSurface(detile_color_shader, surface, color_buffer))
+        return;
+
+    u32 bytes_per_pixel = Pica::Regs::BytesPerColorPixel((Pica::Regs::ColorFormat)surface.format);
+
+    u8* temp_fb_color_buffer = VideoCore::g_frame_arena.AllocateArray<u8>(surface.width * surface.height * bytes_per_pixel);
+
+    // Directly copy pixels. Internal OpenGL color formats are consistent so no conversion is necessary.
+    VideoCore::UntileImage(temp_fb_color_buffer, color_buffer, surface.width, surface.height, bytes_per_pixel);
+
     state.texture_units[0].enabled_2d = true;
-    state.texture_units[0].texture_2d = fb_color_texture.texture.handle;
+    state.texture_units[0].texture_2d = surface.texture.handle;
     state.Apply();
 
-    glActiveTexture(GL_TEXTURE0);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, fb_color_texture.width, fb_color_texture.height,
-                    fb_color_texture.gl_format, fb_color_texture.gl_type, temp_fb_color_buffer.get());
+    OpenGLState::SetActiveTexture(0);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, surface.width, surface.height,
+                    surface.gl_format, surface.gl_type, temp_fb_color_buffer);
 }
 
-void RasterizerOpenGL::ReloadDepthBuffer() {
+void RasterizerOpenGL::ReloadDepthSurface(Surface& surface) {
     // TODO: Appears to work, but double-check endianness of depth values and order of depth-stencil
-    u8* depth_buffer = Memory::GetPhysicalPointer(Pica::g_state.regs.framebuffer.GetDepthBufferPhysicalAddress());
+    u8* depth_buffer = Memory::GetPhysicalPointer(surface.addr);
 
     if (depth_buffer == nullptr) {
         return;
     }
 
-    u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(fb_depth_texture.format);
+    const auto format = (Pica::Regs::DepthFormat)surface.format;
+
+    // Only D16 is loaded on the GPU. Fragment shaders can't write stencil values here, and D24 keeps
+    // the CPU path until the placement of its depth bits in OpenGL is verified (see the TODO above).
+    if (format == Pica::Regs::DepthFormat::D16 && DetileSurface(detile_depth_shader, surface, depth_buffer))
+        return;
+
+    u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(format);
 
-    // OpenGL needs 4 bpp alignment for D24
-    u32 gl_bpp = bytes_per_pixel == 3 ? 4 : bytes_per_pixel;
+    u8* temp_fb_depth_buffer = VideoCore::g_frame_arena.AllocateArray<u8>(surface.gl_size);
 
-    std::unique_ptr<u8[]> temp_fb_depth_buffer(new u8[fb_depth_texture.width * fb_depth_texture.height * gl_bpp]);
+    // Untiled first, then converted pixel by pixel in order
+    u8* linear_depth_buffer = VideoCore::g_frame_arena.AllocateArray<u8>(surface.width * surface.height * bytes_per_pixel);
+    VideoCore::UntileImage(linear_depth_buffer, depth_buffer, surface.width, surface.height, bytes_per_pixel);
 
-    for (int y = 0; y < fb_depth_texture.height; ++y) {
-        for (int x = 0; x < fb_depth_texture.width; ++x) {
-            const u32 coarse_y = y & ~7;
-            u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * fb_depth_texture.width * bytes_per_pixel;
-            u32 gl_px_idx = x + y * fb_depth_texture.width;
+    for (int y = 0; y < surface.height; ++y) {
+        for (int x = 0; x < surface.width; ++x) {
+            u32 gl_px_idx = x + y * surface.width;
+            const u8* pixel = &linear_depth_buffer[gl_px_idx * bytes_per_pixel];
 
-            switch (fb_depth_texture.format) {
+            switch (format) {
             case Pica::Regs::DepthFormat::D16:
-                ((u16*)temp_fb_depth_buffer.get())[gl_px_idx] = Color::DecodeD16(depth_buffer + dst_offset);
+                ((u16*)temp_fb_depth_buffer)[gl_px_idx] = Color::DecodeD16(pixel);
                 break;
             case Pica::Regs::DepthFormat::D24:
-                ((u32*)temp_fb_depth_buffer.get())[gl_px_idx] = Color::DecodeD24(depth_buffer + dst_offset);
+                ((u32*)temp_fb_depth_buffer)[gl_px_idx] = Color::DecodeD24(pixel);
                 break;
             case Pica::Regs::DepthFormat::D24S8:
             {
-                Math::Vec2<u32> depth_stencil = Color::DecodeD24S8(depth_buffer + dst_offset);
-                ((u32*)temp_fb_depth_buffer.get())[gl_px_idx] = (depth_stencil.x << 8) | depth_stencil.y;
+                Math::Vec2<u32> depth_stencil = Color::DecodeD24S8(pixel);
+                ((u32*)temp_fb_depth_buffer)[gl_px_idx] = (depth_stencil.x << 8) | depth_stencil.y;
                 break;
             }
             default:
-                LOG_CRITICAL(Render_OpenGL, "Unknown memory framebuffer depth format %x", fb_depth_texture.format);
+                LOG_CRITICAL(Render_OpenGL, "Unknown memory framebuffer depth format %x", format);
                 UNIMPLEMENTED();
                 break;
             }
@@ -818,91 +1838,441 @@ void RasterizerOpenGL::ReloadDepthBuffer() {
     }
 
     state.texture_units[0].enabled_2d = true;
-    state.texture_units[0].texture_2d = fb_depth_texture.texture.handle;
+    state.texture_units[0].texture_2d = surface.texture.handle;
     state.Apply();
 
-    glActiveTexture(GL_TEXTURE0);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, fb_depth_texture.width, fb_depth_texture.height,
-                    fb_depth_texture.gl_format, fb_depth_texture.gl_type, temp_fb_depth_buffer.get());
+    OpenGLState::SetActiveTexture(0);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, surface.width, surface.height,
+                    surface.gl_format, surface.gl_type, temp_fb_depth_buffer);
 }
 
-void RasterizerOpenGL::CommitColorBuffer() {
-    if (last_fb_color_addr != 0) {
-        u8* color_buffer = Memory::GetPhysicalPointer(last_fb_color_addr);
+void RasterizerOpenGL::ReloadSurface(Surface& surface) {
+    // The texture matches 3DS memory again after this
+    DiscardReadback(surface.readback_fence);
+    surface.dirty = false;
+    surface.sample_texture_valid = false;
+
+    GPUScopeTimer gpu_scope_timer(gpu_timer, gpu_reload_category);
+    if (surface.is_depth) {
+        ReloadDepthSurface(surface);
+    } else {
+        ReloadColorSurface(surface);
+    }
+}
+
+void RasterizerOpenGL::DiscardReadback(GLsync& fence) {
+    if (fence != nullptr) {
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+}
 
-        if (color_buffer != nullptr) {
-            u32 bytes_per_pixel = Pica::Regs::BytesPerColorPixel(fb_color_texture.format);
+void RasterizerOpenGL::StartSurfaceReadback(Surface& surface) {
+    if (!surface.dirty || surface.readback_fence != nullptr)
+        return;
 
-            std::unique_ptr<u8[]> temp_gl_color_buffer(new u8[fb_color_texture.width * fb_color_texture.height * bytes_per_pixel]);
+    // The CPU side of committing waits for the copy
+    GPUScopeTimer gpu_scope_timer(gpu_timer, gpu_commit_category);
 
-            state.texture_units[0].enabled_2d = true;
-            state.texture_units[0].texture_2d = fb_color_texture.texture.handle;
-            state.Apply();
+    state.texture_units[0].enabled_2d = true;
+    state.texture_units[0].texture_2d = surface.texture.handle;
+    state.Apply();
 
-            glActiveTexture(GL_TEXTURE0);
-            glGetTexImage(GL_TEXTURE_2D, 0, fb_color_texture.gl_format, fb_color_texture.gl_type, temp_gl_color_buffer.get());
+    // Orphan the previous contents, so that a mapping still in use by the driver doesn't stall us
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, surface.readback_buffer.handle);
+    glBufferData(GL_PIXEL_PACK_BUFFER, surface.gl_size, nullptr, GL_STREAM_READ);
 
-            // Directly copy pixels. Internal OpenGL color formats are consistent so no conversion is necessary.
-            for (int y = 0; y < fb_color_texture.height; ++y) {
-                for (int x = 0; x < fb_color_texture.width; ++x) {
-                    const u32 coarse_y = y & ~7;
-                    u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * fb_color_texture.width * bytes_per_pixel;
-                    u32 gl_px_idx = x * bytes_per_pixel + y * fb_color_texture.width * bytes_per_pixel;
+    OpenGLState::SetActiveTexture(0);
+    glGetTexImage(GL_TEXTURE_2D, 0, surface.gl_format, surface.gl_type, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
-                    u8* pixel = color_buffer + dst_offset;
-                    memcpy(pixel, &temp_gl_color_buffer[gl_px_idx], bytes_per_pixel);
-                }
-            }
+    surface.readback_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+const u8* RasterizerOpenGL::MapReadback(Surface& surface) {
+    glClientWaitSync(surface.readback_fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    DiscardReadback(surface.readback_fence);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, surface.readback_buffer.handle);
+    const u8* data = (const u8*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, surface.gl_size, GL_MAP_READ_BIT);
+    if (data == nullptr)
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return data;
+}
+
+void RasterizerOpenGL::UnmapReadback() {
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void RasterizerOpenGL::CommitSurface(Surface& surface) {
+    // Nothing was drawn since the 3DS buffer was last written or loaded
+    if (!surface.dirty)
+        return;
+
+    // TODO: Depth output seems correct visually, but doesn't quite match sw renderer output. One of them is wrong.
+    u8* dst_buffer = Memory::GetPhysicalPointer(surface.addr);
+    if (dst_buffer == nullptr)
+        return;
+
+    StartSurfaceReadback(surface);
+
+    const u8* gl_buffer = MapReadback(surface);
+    if (gl_buffer == nullptr) {
+        LOG_ERROR(Render_OpenGL, "Failed to map the surface readback");
+        return;
+    }
+
+    const u32 width = surface.width;
+    const u32 height = surface.height;
+
+    if (!surface.is_depth) {
+        // Directly copy pixels. Internal OpenGL color formats are consistent so no conversion is necessary.
+        const u32 bytes_per_pixel = Pica::Regs::BytesPerColorPixel((Pica::Regs::ColorFormat)surface.format);
+        if (bytes_per_pixel >= 2 && bytes_per_pixel <= 4) {
+            VideoCore::TileImage(dst_buffer, gl_buffer, width, height, bytes_per_pixel);
+        } else {
+            LOG_CRITICAL(Render_OpenGL, "Unknown framebuffer color format %x", surface.format);
+            UNIMPLEMENTED();
+        }
+    } else {
+        switch ((Pica::Regs::DepthFormat)surface.format) {
+        case Pica::Regs::DepthFormat::D16:
+            EncodeMortonTiles<2, 2>(dst_buffer, gl_buffer, width, height, [](const u8* src, u8* dst) {
+                Color::EncodeD16(((const u16*)src)[0], dst);
+                Color::EncodeD16(((const u16*)src)[1], dst + 2);
+            });
+            break;
+        case Pica::Regs::DepthFormat::D24:
+            EncodeMortonTiles<4, 3>(dst_buffer, gl_buffer, width, height, [](const u8* src, u8* dst) {
+                Color::EncodeD24(((const u32*)src)[0], dst);
+                Color::EncodeD24(((const u32*)src)[1], dst + 3);
+            });
+            break;
+        case Pica::Regs::DepthFormat::D24S8:
+            EncodeMortonTiles<4, 4>(dst_buffer, gl_buffer, width, height, [](const u8* src, u8* dst) {
+                u32 depth_stencil0 = ((const u32*)src)[0];
+                u32 depth_stencil1 = ((const u32*)src)[1];
+                Color::EncodeD24S8(depth_stencil0 >> 8, depth_stencil0 & 0xFF, dst);
+                Color::EncodeD24S8(depth_stencil1 >> 8, depth_stencil1 & 0xFF, dst + 4);
+            });
+            break;
+        default:
+            LOG_CRITICAL(Render_OpenGL, "Unknown framebuffer depth format %x", surface.format);
+            UNIMPLEMENTED();
+            break;
         }
     }
+
+    UnmapReadback();
+    surface.dirty = false;
+
+    // Textures cached from this memory are outdated now
+    RecordWrittenRange(surface.addr, surface.size);
+    res_cache.NotifyFlush(surface.addr, surface.size);
+    Pica::TextureCache::NotifyFlush(surface.addr, surface.size);
 }
 
-void RasterizerOpenGL::CommitDepthBuffer() {
-    if (last_fb_depth_addr != 0) {
-        // TODO: Output seems correct visually, but doesn't quite match sw renderer output. One of them is wrong.
-        u8* depth_buffer = Memory::GetPhysicalPointer(last_fb_depth_addr);
+void RasterizerOpenGL::UpdateSampleTexture(Surface& surface, unsigned texture_unit, const Pica::Regs::FullTextureConfig& config) {
+    if (surface.sample_texture.handle == 0) {
+        surface.sample_texture.Create();
+        state.texture_units[texture_unit].texture_2d = surface.sample_texture.handle;
+        state.Apply();
+
+        // Same sampling parameters as the textures of the texture cache
+        OpenGLState::SetActiveTexture(texture_unit);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, surface.width, surface.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        surface.memory_usage.Add(surface.width * surface.height * 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, PicaToGL::WrapMode(config.config.wrap_s));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, PicaToGL::WrapMode(config.config.wrap_t));
+    }
 
-        if (depth_buffer != nullptr) {
-            u32 bytes_per_pixel = Pica::Regs::BytesPerDepthPixel(fb_depth_texture.format);
+    // Cached textures are uploaded bottom row first while surfaces keep the rows of 3DS memory, so flip the copy
+    BlitTexture(surface.texture.handle, surface.width, surface.height,
+                surface.sample_texture.handle, surface.width, surface.height, true, GL_NEAREST);
 
-            // OpenGL needs 4 bpp alignment for D24
-            u32 gl_bpp = bytes_per_pixel == 3 ? 4 : bytes_per_pixel;
+    surface.sample_texture_valid = true;
+}
 
-            std::unique_ptr<u8[]> temp_gl_depth_buffer(new u8[fb_depth_texture.width * fb_depth_texture.height * gl_bpp]);
+void RasterizerOpenGL::BlitTexture(GLuint src_texture, GLsizei src_width, GLsizei src_height,
+                                   GLuint dst_texture, GLsizei dst_width, GLsizei dst_height, bool flip, GLenum filter) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, copy_read_framebuffer.handle);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, src_texture, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copy_draw_framebuffer.handle);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dst_texture, 0);
 
-            state.texture_units[0].enabled_2d = true;
-            state.texture_units[0].texture_2d = fb_depth_texture.texture.handle;
-            state.Apply();
+    glBlitFramebuffer(0, 0, src_width, src_height,
+                      0, flip ? dst_height : 0, dst_width, flip ? 0 : dst_height,
+                      GL_COLOR_BUFFER_BIT, filter);
 
-            glActiveTexture(GL_TEXTURE0);
-            glGetTexImage(GL_TEXTURE_2D, 0, fb_depth_texture.gl_format, fb_depth_texture.gl_type, temp_gl_depth_buffer.get());
-
-            for (int y = 0; y < fb_depth_texture.height; ++y) {
-                for (int x = 0; x < fb_depth_texture.width; ++x) {
-                    const u32 coarse_y = y & ~7;
-                    u32 dst_offset = VideoCore::GetMortonOffset(x, y, bytes_per_pixel) + coarse_y * fb_depth_texture.width * bytes_per_pixel;
-                    u32 gl_px_idx = x + y * fb_depth_texture.width;
-
-                    switch (fb_depth_texture.format) {
-                    case Pica::Regs::DepthFormat::D16:
-                        Color::EncodeD16(((u16*)temp_gl_depth_buffer.get())[gl_px_idx], depth_buffer + dst_offset);
-                        break;
-                    case Pica::Regs::DepthFormat::D24:
-                        Color::EncodeD24(((u32*)temp_gl_depth_buffer.get())[gl_px_idx], depth_buffer + dst_offset);
-                        break;
-                    case Pica::Regs::DepthFormat::D24S8:
-                    {
-                        u32 depth_stencil = ((u32*)temp_gl_depth_buffer.get())[gl_px_idx];
-                        Color::EncodeD24S8((depth_stencil >> 8), depth_stencil & 0xFF, depth_buffer + dst_offset);
-                        break;
-                    }
-                    default:
-                        LOG_CRITICAL(Render_OpenGL, "Unknown framebuffer depth format %x", fb_depth_texture.format);
-                        UNIMPLEMENTED();
-                        break;
-                    }
-                }
+    // Go back to the framebuffer the state has bound
+    glBindFramebuffer(GL_FRAMEBUFFER, OpenGLState::GetCurState().draw.framebuffer);
+}
+
+bool RasterizerOpenGL::AccelerateDisplayTransfer(const GPU::Regs::DisplayTransferConfig& config) {
+    // Only transfers out of a render target are done on the GPU, linear inputs were written by the CPU
+    if (!Settings::values.use_hw_renderer || config.output_tiled)
+        return false;
+
+    ApplyPendingFlushes();
+    FlushBatch();
+
+    const u32 horizontal_scale = (config.scaling != config.NoScale) ? 2 : 1;
+    const u32 vertical_scale = (config.scaling == config.ScaleXY) ? 2 : 1;
+    const u32 output_width = config.output_width / horizontal_scale;
+    const u32 output_height = config.output_height / vertical_scale;
+
+    const PAddr src_addr = config.GetPhysicalInputAddress();
+    const PAddr dst_addr = config.GetPhysicalOutputAddress();
+    const u32 output_size = output_width * output_height * GPU::Regs::BytesPerPixel(config.output_format);
+
+    // Pixel formats share their values with the color buffer formats
+    Surface* src_surface = nullptr;
+    for (auto& surface : surfaces) {
+        if (!surface->is_depth && surface->addr == src_addr && surface->format == (u32)config.input_format.Value() &&
+            surface->width == (GLsizei)config.input_width && surface->height == (GLsizei)config.input_height) {
+            src_surface = surface.get();
+            break;
+        }
+    }
+
+    if (src_surface == nullptr || output_width * horizontal_scale > config.input_width ||
+        output_height * vertical_scale > config.input_height ||
+        RangesOverlap(src_addr, src_surface->size, dst_addr, output_size))
+        return false;
+
+    u8* dst_pointer = Memory::GetPhysicalPointer(dst_addr);
+    if (dst_pointer == nullptr)
+        return false;
+
+    // Transfers to the LCD framebuffers stay on the GPU to be presented from there, unless a surface
+    // would read their output from 3DS memory
+    bool keep_output = IsDisplayFramebuffer(dst_addr);
+    for (auto& surface : surfaces) {
+        if (RangesOverlap(dst_addr, output_size, surface->addr, surface->size))
+            keep_output = false;
+    }
+
+    const u32 output_format = (u32)config.output_format.Value();
+    Surface* target;
+    if (keep_output) {
+        // The output of the last transfer to the same framebuffer is reused, other ones partially
+        // overwritten keep the rest of their contents in 3DS memory
+        std::unique_ptr<Surface> output;
+        for (auto it = display_outputs.begin(); it != display_outputs.end(); ++it) {
+            Surface& candidate = **it;
+            if (candidate.addr == dst_addr && candidate.format == output_format &&
+                candidate.width == (GLsizei)output_width && candidate.height == (GLsizei)output_height) {
+                output = std::move(*it);
+                display_outputs.erase(it);
+                break;
             }
         }
+        RemoveDisplayOutputs(dst_addr, output_size, true);
+        if (output == nullptr)
+            output = CreateSurface(dst_addr, false, output_format, output_width, output_height);
+        target = output.get();
+        display_outputs.push_back(std::move(output));
+    } else {
+        // Reuse the conversion target while the transfers keep their output format and size
+        if (transfer_surface == nullptr || transfer_surface->format != output_format ||
+            transfer_surface->width != (GLsizei)output_width || transfer_surface->height != (GLsizei)output_height) {
+            transfer_surface = CreateSurface(dst_addr, false, output_format, output_width, output_height);
+        }
+        target = transfer_surface.get();
+    }
+
+    // Linear filtering of a surface at half its size averages 2x2 blocks, which is the box filter of the scaling modes
+    BlitTexture(src_surface->texture.handle, output_width * horizontal_scale, output_height * vertical_scale,
+                target->texture.handle, output_width, output_height, config.flip_vertically != 0,
+                config.scaling != config.NoScale ? GL_LINEAR : GL_NEAREST);
+
+    if (keep_output) {
+        target->dirty = true;
+
+        // What NotifyFlush does, minus reloading surfaces, none of which overlaps the output
+        RecordWrittenRange(dst_addr, output_size);
+        Pica::TextureCache::NotifyFlush(dst_addr, output_size);
+        res_cache.NotifyFlush(dst_addr, output_size);
+        return true;
+    }
+
+    ReadLinearSurface(*target, dst_pointer);
+    NotifyFlush(dst_addr, output_size);
+    return true;
+}
+
+void RasterizerOpenGL::ReadLinearSurface(const Surface& surface, u8* dst_pointer) {
+    // Surfaces keep the rows of 3DS memory, so the image is read back in the order of the linear output
+    state.texture_units[0].enabled_2d = true;
+    state.texture_units[0].texture_2d = surface.texture.handle;
+    state.Apply();
+
+    OpenGLState::SetActiveTexture(0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, surface.gl_format, surface.gl_type, dst_pointer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+}
+
+void RasterizerOpenGL::CommitDisplayOutput(Surface& output) {
+    if (!output.dirty)
+        return;
+    output.dirty = false;
+
+    u8* dst_pointer = Memory::GetPhysicalPointer(output.addr);
+    if (dst_pointer == nullptr)
+        return;
+
+    display_output_commits_counter.Add();
+    ReadLinearSurface(output, dst_pointer);
+}
+
+void RasterizerOpenGL::CommitDisplayOutputs(PAddr addr, u32 size) {
+    for (auto& output : display_outputs) {
+        if (RangesOverlap(addr, size, output->addr, output->size))
+            CommitDisplayOutput(*output);
+    }
+}
+
+void RasterizerOpenGL::RemoveDisplayOutputs(PAddr addr, u32 size, bool commit) {
+    for (auto it = display_outputs.begin(); it != display_outputs.end();) {
+        if (!RangesOverlap(addr, size, (*it)->addr, (*it)->size)) {
+            ++it;
+            continue;
+        }
+        if (commit)
+            CommitDisplayOutput(**it);
+        it = display_outputs.erase(it);
+    }
+}
+
+bool RasterizerOpenGL::AccelerateFill(const GPU::Regs::MemoryFillConfig& config) {
+    if (!Settings::values.use_hw_renderer)
+        return false;
+
+    const PAddr addr = config.GetStartAddress();
+    const u32 size = config.GetEndAddress() - addr;
+
+    // Reloading a surface flushed before the fill would undo the clear
+    if (PendingFlushesOverlap(addr, size))
+        ApplyPendingFlushes();
+
+    FlushBatch();
+
+    // Only fills of exactly one surface are cleared, anything else has to be in 3DS memory
+    Surface* surface = nullptr;
+    for (auto& cached_surface : surfaces) {
+        if (cached_surface->addr == addr && cached_surface->size == size) {
+            surface = cached_surface.get();
+            break;
+        }
+    }
+
+    if (surface == nullptr)
+        return false;
+
+    // The value written by the CPU fill, which has to write whole pixels of the surface
+    u8 fill_data[4];
+    u32 fill_bytes_per_pixel;
+    if (config.fill_24bit) {
+        fill_data[0] = config.value_24bit_r;
+        fill_data[1] = config.value_24bit_g;
+        fill_data[2] = config.value_24bit_b;
+        fill_bytes_per_pixel = 3;
+    } else if (config.fill_32bit) {
+        const u32 value = config.value_32bit;
+        memcpy(fill_data, &value, sizeof(value));
+        fill_bytes_per_pixel = 4;
+    } else {
+        const u16 value = config.value_16bit;
+        memcpy(fill_data, &value, sizeof(value));
+        fill_bytes_per_pixel = 2;
     }
+
+    const u32 bytes_per_pixel = surface->is_depth ? Pica::Regs::BytesPerDepthPixel((Pica::Regs::DepthFormat)surface->format)
+                                                  : Pica::Regs::BytesPerColorPixel((Pica::Regs::ColorFormat)surface->format);
+    if (fill_bytes_per_pixel != bytes_per_pixel)
+        return false;
+
+    // Clear with a plain state, which enables all writes
+    OpenGLState clear_state;
+    clear_state.draw.framebuffer = copy_draw_framebuffer.handle;
+    clear_state.Apply();
+
+    if (!surface->is_depth) {
+        Math::Vec4<u8> color = { 0, 0, 0, 0 };
+        switch ((Pica::Regs::ColorFormat)surface->format) {
+        case Pica::Regs::ColorFormat::RGBA8:
+            color = Color::DecodeRGBA8(fill_data);
+            break;
+        case Pica::Regs::ColorFormat::RGB8:
+            color = Color::DecodeRGB8(fill_data);
+            break;
+        case Pica::Regs::ColorFormat::RGB5A1:
+            color = Color::DecodeRGB5A1(fill_data);
+            break;
+        case Pica::Regs::ColorFormat::RGB565:
+            color = Color::DecodeRGB565(fill_data);
+            break;
+        case Pica::Regs::ColorFormat::RGBA4:
+            color = Color::DecodeRGBA4(fill_data);
+            break;
+        default:
+            LOG_CRITICAL(Render_OpenGL, "Unknown framebuffer color format %x", surface->format);
+            UNIMPLEMENTED();
+            break;
+        }
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, surface->texture.handle, 0);
+        glClearColor(color.r() / 255.0f, color.g() / 255.0f, color.b() / 255.0f, color.a() / 255.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    } else {
+        const bool has_stencil = (Pica::Regs::DepthFormat)surface->format == Pica::Regs::DepthFormat::D24S8;
+
+        switch ((Pica::Regs::DepthFormat)surface->format) {
+        case Pica::Regs::DepthFormat::D16:
+            glClearDepth(Color::DecodeD16(fill_data) / 65535.0);
+            break;
+        case Pica::Regs::DepthFormat::D24:
+            glClearDepth(Color::DecodeD24(fill_data) / 16777215.0);
+            break;
+        case Pica::Regs::DepthFormat::D24S8:
+        {
+            Math::Vec2<u32> depth_stencil = Color::DecodeD24S8(fill_data);
+            glClearDepth(depth_stencil.x / 16777215.0);
+            glClearStencil(depth_stencil.y);
+            break;
+        }
+        default:
+            LOG_CRITICAL(Render_OpenGL, "Unknown framebuffer depth format %x", surface->format);
+            UNIMPLEMENTED();
+            break;
+        }
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, surface->texture.handle, 0);
+        if (has_stencil)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, surface->texture.handle, 0);
+
+        // A framebuffer without color attachment is only complete without a draw buffer
+        glDrawBuffer(GL_NONE);
+        glClear(GL_DEPTH_BUFFER_BIT | (has_stencil ? GL_STENCIL_BUFFER_BIT : 0));
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+        if (has_stencil)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+    }
+
+    state.Apply();
+
+    // 3DS memory now holds the contents from before the fill until the surface is committed
+    DiscardReadback(surface->readback_fence);
+    surface->dirty = true;
+    surface->sample_texture_valid = false;
+    return true;
 }
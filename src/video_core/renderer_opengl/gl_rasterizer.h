@@ -4,10 +4,21 @@
 
 #pragma once
 
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "common/memory_accounting.h"
+
 #include "video_core/hwrasterizer_base.h"
 
+#include "gl_gpu_timer.h"
+#include "gl_perf_overlay.h"
 #include "gl_state.h"
 #include "gl_rasterizer_cache.h"
+#include "gl_shader_gen.h"
+#include "gl_vertex_shader_gen.h"
 
 class RasterizerOpenGL : public HWRasterizer {
 public:
@@ -21,93 +32,184 @@ public:
     /// Reset the rasterizer, such as flushing all caches and updating all state
     void Reset() override;
 
-    /// Queues the primitive formed by the given vertices for rendering
-    void AddTriangle(const Pica::VertexShader::OutputVertex& v0,
-                     const Pica::VertexShader::OutputVertex& v1,
-                     const Pica::VertexShader::OutputVertex& v2) override;
+    /// Starts queueing the vertices and triangles of a draw, mapping the buffers they are written to
+    void BeginTriangles(u32 max_vertices) override;
+
+    /// Queues shaded vertices, writing them to the vertex buffer in the hardware vertex format
+    u32 AddVertices(const Pica::VertexShader::OutputVertex* vertices, size_t count) override;
 
-    /// Draw the current batch of triangles
+    /// Queues the triangle formed by the queued vertices with the given indices for rendering
+    void AddTriangle(u32 v0, u32 v1, u32 v2) override;
+
+    /**
+     * Ends the draw of the triangles queued since BeginTriangles. The draw call is deferred, so that
+     * the triangles of the following draws can be drawn with it while the state stays the same.
+     */
     void DrawTriangles() override;
 
+    /// Draws the triangles of the draws merged so far, before anything changes the state they are drawn with
+    void FlushBatch();
+
+    /// Draws the pending triangles at the end of a frame and logs how many draw calls merging saved
+    void EndFrame();
+
+    /// Measures the GPU time of the rendering context, shared with the renderer
+    GPUTimer& GetGPUTimer() {
+        return gpu_timer;
+    }
+
+    /// Ids of the Perf::Counters of the rasterizer's work, for the performance overlay
+    static RasterizerCounterIds GetCounterIds();
+
+    /// Performs the current draw with the PICA vertex shader translated to GLSL
+    bool AccelerateDrawBatch(bool is_indexed) override;
+
     /// Commit the rasterizer's framebuffer contents immediately to the current 3DS memory framebuffer
     void CommitFramebuffer() override;
 
     /// Notify rasterizer that the specified PICA register has been changed
     void NotifyPicaRegisterChanged(u32 id) override;
 
+    /// Notify rasterizer that a command list has been processed completely
+    void NotifyCommandListProcessed() override;
+
     /// Notify rasterizer that the specified 3DS memory region will be read from after this notification
     void NotifyPreRead(PAddr addr, u32 size) override;
 
     /// Notify rasterizer that a 3DS memory region has been changed
     void NotifyFlush(PAddr addr, u32 size) override;
 
+    /// Defers the work of the flushes until EndNotifyBatch or until something depends on the flushed regions
+    void BeginNotifyBatch() override;
+
+    /// Applies the flushes deferred since BeginNotifyBatch
+    void EndNotifyBatch() override;
+
+    /// Performs a display transfer out of a render target as a blit on the GPU
+    bool AccelerateDisplayTransfer(const GPU::Regs::DisplayTransferConfig& config) override;
+
+    /// Performs a memory fill of a render target as a clear on the GPU
+    bool AccelerateFill(const GPU::Regs::MemoryFillConfig& config) override;
+
+    /// Whether the given 3DS memory region was flushed or written by a surface since the last ClearWrittenRanges
+    bool WasRangeWritten(PAddr addr, u32 size) const;
+
+    /// Forgets about the memory writes recorded so far
+    void ClearWrittenRanges();
+
+    /**
+     * Copies the output of an accelerated display transfer held on the GPU into a screen texture,
+     * if it is exactly the given LCD framebuffer. Outputs overlapping the framebuffer in any other
+     * way are committed to 3DS memory, for the framebuffer to be loaded from there.
+     * @param format Raw value of the GPU::Regs::PixelFormat of the framebuffer
+     * @return True if the texture was filled
+     */
+    bool CopyDisplayOutput(PAddr addr, u32 width, u32 height, u32 stride, u32 format, GLuint texture);
+
 private:
-    /// Structure used for managing texture environment states
-    struct TEVConfigUniforms {
-        GLuint enabled;
-        GLuint color_sources;
-        GLuint alpha_sources;
-        GLuint color_modifiers;
-        GLuint alpha_modifiers;
-        GLuint color_alpha_op;
-        GLuint color_alpha_multiplier;
-        GLuint const_color;
-        GLuint updates_combiner_buffer_color_alpha;
+    /// Texture environment state of one TEV stage, laid out like TEVConfig in the shader_data uniform block (std140)
+    struct TEVConfigUniformData {
+        GLint enabled;
+        GLint padding0[3];
+        GLint color_sources[3];
+        GLint padding1;
+        GLint alpha_sources[3];
+        GLint padding2;
+        GLint color_modifiers[3];
+        GLint padding3;
+        GLint alpha_modifiers[3];
+        GLint padding4;
+        GLint color_alpha_op[2];
+        GLint color_alpha_multiplier[2];
+        GLfloat const_color[4];
+        GLint updates_combiner_buffer_color_alpha[2];
+        GLint padding5[2];
     };
+    static_assert(sizeof(TEVConfigUniformData) == 128, "TEVConfigUniformData does not match the std140 layout");
+
+    /// Contents of the shader_data uniform block of the hardware fragment shader (std140)
+    struct UniformData {
+        TEVConfigUniformData tev_cfgs[6];
+        GLfloat tev_combiner_buffer_color[4];
+        GLint alphatest_enabled;
+        GLint alphatest_func;
+        GLfloat alphatest_ref;
+        /// Bit i is set if the texture bound to unit i is stored upside down
+        GLint flipped_textures;
+    };
+    static_assert(sizeof(UniformData) == 800, "UniformData does not match the std140 layout");
+
+    /// Contents of the vs_uniforms uniform block of translated vertex shaders (std140)
+    struct VSUniformData {
+        GLfloat float_uniforms[96][4];
+        GLint int_uniforms[4][4];
+        /// Bit i is set if boolean uniform i is
+        GLint bool_uniforms;
+        GLint padding[3];
+    };
+    static_assert(sizeof(VSUniformData) == 1616, "VSUniformData does not match the std140 layout");
 
-    /// Structure used for storing information about color textures
-    struct TextureInfo {
-        OGLTexture texture;
-        GLsizei width;
-        GLsizei height;
-        Pica::Regs::ColorFormat format;
-        GLenum gl_format;
-        GLenum gl_type;
+    /// Fullscreen pass program loading Morton-tiled framebuffer data into a framebuffer texture
+    struct DetileShader {
+        OGLShader shader;
+        GLint uniform_format;
+        GLint uniform_width;
     };
 
-    /// Structure used for storing information about depth textures
-    struct DepthTextureInfo {
+    /// A PICA color or depth buffer kept resident on the GPU as an OpenGL texture
+    struct Surface {
         OGLTexture texture;
+        PAddr addr;
+        /// Size of the buffer in 3DS memory, in bytes
+        u32 size;
+        bool is_depth;
+        /// Raw value of the Pica::Regs::ColorFormat or Pica::Regs::DepthFormat of the buffer
+        u32 format;
         GLsizei width;
         GLsizei height;
-        Pica::Regs::DepthFormat format;
         GLenum gl_format;
         GLenum gl_type;
+        /// Size of the texture image read back from OpenGL, in bytes
+        u32 gl_size;
+
+        /// Whether the texture was drawn to since it was last committed to or reloaded from 3DS memory
+        bool dirty;
+
+        // Readback into 3DS memory, the fence is null while no readback is pending
+        OGLBuffer readback_buffer;
+        GLsync readback_fence;
+
+        /// Copy of a color surface in the orientation of texture cache textures, for sampling it
+        OGLTexture sample_texture;
+        bool sample_texture_valid;
+
+        Common::MemoryAccounting::ScopedUsage memory_usage{Common::MemoryAccounting::Tag::Surfaces};
     };
 
-    /// Structure that the hardware rendered vertices are composed of
+    /// Structure that the hardware rendered vertices are composed of, the color is normalized
     struct HardwareVertex {
-        HardwareVertex(const Pica::VertexShader::OutputVertex& v) {
-            position[0] = v.pos.x.ToFloat32();
-            position[1] = v.pos.y.ToFloat32();
-            position[2] = v.pos.z.ToFloat32();
-            position[3] = v.pos.w.ToFloat32();
-            color[0] = v.color.x.ToFloat32();
-            color[1] = v.color.y.ToFloat32();
-            color[2] = v.color.z.ToFloat32();
-            color[3] = v.color.w.ToFloat32();
-            tex_coord0[0] = v.tc0.x.ToFloat32();
-            tex_coord0[1] = v.tc0.y.ToFloat32();
-            tex_coord1[0] = v.tc1.x.ToFloat32();
-            tex_coord1[1] = v.tc1.y.ToFloat32();
-            tex_coord2[0] = v.tc2.x.ToFloat32();
-            tex_coord2[1] = v.tc2.y.ToFloat32();
-        }
-
         GLfloat position[4];
-        GLfloat color[4];
+        GLubyte color[4];
         GLfloat tex_coord0[2];
         GLfloat tex_coord1[2];
         GLfloat tex_coord2[2];
     };
+    static_assert(sizeof(HardwareVertex) == 44, "HardwareVertex has padding");
+
+    /**
+     * Looks up the surface holding the given PICA buffer, creating it from 3DS memory if needed.
+     * Surfaces overlapping the buffer in any other way are committed and removed first.
+     * @param format Raw value of the Pica::Regs::ColorFormat or Pica::Regs::DepthFormat of the buffer
+     */
+    Surface* GetSurface(PAddr addr, bool is_depth, u32 format, u32 width, u32 height);
 
-    /// Reconfigure the OpenGL color texture to use the given format and dimensions
-    void ReconfigureColorTexture(TextureInfo& texture, Pica::Regs::ColorFormat format, u32 width, u32 height);
+    /// Creates a surface with an uninitialized texture, without adding it to the cache
+    std::unique_ptr<Surface> CreateSurface(PAddr addr, bool is_depth, u32 format, u32 width, u32 height);
 
-    /// Reconfigure the OpenGL depth texture to use the given format and dimensions
-    void ReconfigureDepthTexture(DepthTextureInfo& texture, Pica::Regs::DepthFormat format, u32 width, u32 height);
+    /// Drops a surface from the cache without committing it, returns the iterator following it
+    std::vector<std::unique_ptr<Surface>>::iterator RemoveSurface(std::vector<std::unique_ptr<Surface>>::iterator surface);
 
-    /// Syncs the state and contents of the OpenGL framebuffer to match the current PICA framebuffer
+    /// Syncs the OpenGL framebuffer attachments to the surfaces of the current PICA framebuffer
     void SyncFramebuffer();
 
     /// Syncs the cull mode to match the PICA register
@@ -158,53 +260,255 @@ private:
     /// Syncs the remaining OpenGL drawing state to match the current PICA state
     void SyncDrawState();
 
-    /// Copies the 3DS color framebuffer into the OpenGL color framebuffer texture
-    void ReloadColorBuffer();
+    /// Starts loading the texture of a texture unit ahead of the draws, after its registers were written
+    void PrefetchTexture(unsigned texture_unit);
+
+    /**
+     * Binds the surface holding the given PICA texture to a texture unit, if there is one.
+     * Dirty surfaces merely overlapping the texture are committed so that it can be loaded from 3DS memory.
+     * @return True if a surface was bound
+     */
+    bool BindSurfaceTexture(unsigned texture_unit, const Pica::Regs::FullTextureConfig& config);
+
+    /// Whether a draw of up to the given number of vertices can be added to the pending batch
+    bool CanExtendBatch(u32 max_vertices) const;
+
+    /// Whether the driver is still building a program that was linked before, always false without parallel_shader_compile
+    bool IsProgramPending(GLuint program) const;
+
+    /**
+     * Selects the fragment shader specialized for the current PICA state, generating it on first use.
+     * The uber shader is used while the specialized one is being built.
+     */
+    void SetShader();
+
+    /**
+     * Looks up the program running the current PICA vertex shader together with the current fragment
+     * shader, translating and linking it on first use
+     * @return The program, or nullptr if the vertex shader can't be run on the host GPU or the program is still being built
+     */
+    OGLShader* GetVertexShaderProgram();
+
+    /**
+     * Streams the vertex attribute data of the current draw into the vertex buffer and points the
+     * inputs of translated vertex shaders at it
+     * @param vertex_count Number of vertices the draw reads, starting at the first one
+     * @return False if the attribute configuration isn't supported, nothing is set up then
+     */
+    bool SetupVertexArrays(u32 vertex_count);
+
+    /// Uploads the PICA vertex shader uniforms if any of them were changed since the last draw
+    void UploadVSUniforms();
+
+    /// Notes that the current framebuffer surfaces are drawn to, which outdates their readbacks and sample copies
+    void MarkFramebufferDrawn();
+
+    /// Uploads the uniform block data if any of it was changed since the last draw
+    void UploadUniforms();
+
+    /// Initializes a fullscreen detiling program from its fragment shader source
+    void InitDetileShader(DetileShader& detile_shader, const char* fragment_shader);
+
+    /**
+     * Loads Morton-tiled framebuffer data into a surface with a fullscreen pass
+     * @param detile_shader Program decoding the data for the type of the surface
+     * @param tiled_data Framebuffer data in 3DS memory
+     * @return False if the data is too large for a buffer texture, nothing is drawn then
+     */
+    bool DetileSurface(const DetileShader& detile_shader, Surface& surface, const u8* tiled_data);
+
+    /// Copies the contents of the 3DS color buffer of a surface into its texture
+    void ReloadColorSurface(Surface& surface);
+
+    /// Copies the contents of the 3DS depth buffer of a surface into its texture
+    void ReloadDepthSurface(Surface& surface);
 
-    /// Copies the 3DS depth framebuffer into the OpenGL depth framebuffer texture
-    void ReloadDepthBuffer();
+    /// Copies the contents of the 3DS buffer of a surface into its texture, leaving it clean
+    void ReloadSurface(Surface& surface);
+
+    /// Deletes the fence of a pending readback, dropping the readback
+    void DiscardReadback(GLsync& fence);
+
+    /// Starts copying the texture of a surface into its pixel buffer object if it is dirty
+    void StartSurfaceReadback(Surface& surface);
+
+    /// Waits for the readback of a surface to finish and maps its buffer, which stays bound until UnmapReadback
+    const u8* MapReadback(Surface& surface);
+
+    /// Unmaps the readback buffer mapped by MapReadback
+    void UnmapReadback();
 
     /**
-     * Save the current OpenGL color framebuffer to the current PICA framebuffer in 3DS memory
-     * Loads the OpenGL framebuffer textures into temporary buffers
-     * Then copies into the 3DS framebuffer using proper Morton order
+     * Save a dirty surface to its buffer in 3DS memory
+     * Waits for the surface texture readback, starting it if needed
+     * Then copies into the 3DS buffer using proper Morton order
      */
-    void CommitColorBuffer();
+    void CommitSurface(Surface& surface);
+
+    /// Copies the whole of a color texture into another one, scaling it to the destination size
+    void BlitTexture(GLuint src_texture, GLsizei src_width, GLsizei src_height,
+                     GLuint dst_texture, GLsizei dst_width, GLsizei dst_height, bool flip, GLenum filter);
+
+    /// Reloads or drops the surfaces and cached textures of a 3DS memory region that was changed
+    void ApplyFlush(PAddr addr, u32 size);
+
+    /// Adds a flush to the deferred ones, merging it with those it overlaps or touches
+    void QueueFlush(PAddr addr, u32 size);
+
+    /// Applies the deferred flushes, before anything depending on the flushed regions
+    void ApplyPendingFlushes();
 
     /**
-     * Save the current OpenGL depth framebuffer to the current PICA framebuffer in 3DS memory
-     * Loads the OpenGL framebuffer textures into temporary buffers
-     * Then copies into the 3DS framebuffer using proper Morton order
+     * Whether a deferred flush overlaps a 3DS memory region or the surfaces and display outputs
+     * overlapping it, which committing them for a read of the region would write over
      */
-    void CommitDepthBuffer();
+    bool PendingFlushesOverlap(PAddr addr, u32 size) const;
+
+    /// Records a write to 3DS memory for WasRangeWritten
+    void RecordWrittenRange(PAddr addr, u32 size);
+
+    /// Reads the whole of a linear color surface back into 3DS memory, waiting for it
+    void ReadLinearSurface(const Surface& surface, u8* dst_pointer);
+
+    /// Writes a display output to 3DS memory if it was transferred to since it was last written
+    void CommitDisplayOutput(Surface& output);
+
+    /// Commits the display outputs overlapping a 3DS memory region, they stay valid for presenting
+    void CommitDisplayOutputs(PAddr addr, u32 size);
+
+    /**
+     * Drops the display outputs overlapping a 3DS memory region
+     * @param commit Whether they are committed first, rather than having been overwritten in 3DS memory
+     */
+    void RemoveDisplayOutputs(PAddr addr, u32 size, bool commit);
+
+    /// Copies a color surface into its sample texture, flipping it to the orientation of cached textures
+    void UpdateSampleTexture(Surface& surface, unsigned texture_unit, const Pica::Regs::FullTextureConfig& config);
 
     RasterizerCacheOpenGL res_cache;
 
-    std::vector<HardwareVertex> vertex_batch;
+    // Regions of the vertex and index buffers mapped by BeginTriangles, nullptr if mapping failed
+    HardwareVertex* mapped_vertices;
+    u8* mapped_indices;
+    GLintptr mapped_vertices_offset;
+    GLintptr mapped_indices_offset;
+    /// Whether mapping the buffers for the current draw failed, its triangles are dropped then
+    bool mapping_failed;
+    /// Vertices and indices queued by the draws of the batch
+    u32 num_queued_vertices;
+    u32 num_queued_indices;
+    /// First vertex and index of the current draw within the batch
+    u32 draw_first_vertex;
+    u32 draw_first_index;
+    /// Indices are 16-bit unless the first draw of the batch may have more vertices than that can address
+    GLenum index_type;
+
+    /// Registers below the geometry pipeline ones, which the state draws are made with is synced from
+    static const u32 NUM_BATCH_REGISTERS = 0x200;
+
+    /**
+     * Whether queued triangles are waiting for FlushBatch. Consecutive draws are drawn with one draw
+     * call as long as none of the registers the state is synced from changes and no memory is
+     * flushed in between. The draws of a batch are consecutive in the vertex and index buffers.
+     */
+    bool batch_pending;
+    GLintptr batch_vertices_offset;
+    GLintptr batch_indices_offset;
+    /// Whether a texture of the batch is sampled from a render target, which a following draw could write to
+    bool batch_samples_surface;
+    /// The registers as of the first draw of the batch
+    std::array<u32, NUM_BATCH_REGISTERS> batch_registers;
+
+    /// Draws and draw calls since the last EndFrame
+    u32 num_frame_draws;
+    u32 num_frame_draw_calls;
+
+    /// 3DS memory ranges written since the last ClearWrittenRanges, merged into one once there are too many
+    std::vector<std::pair<PAddr, u32>> written_ranges;
+
+    /// Whether NotifyFlush defers its work, between BeginNotifyBatch and EndNotifyBatch
+    bool notify_batch_open;
+    /// Regions flushed during the notification batch whose surfaces and textures weren't updated yet
+    std::vector<std::pair<PAddr, u32>> pending_flushes;
 
     OpenGLState state;
 
-    PAddr last_fb_color_addr;
-    PAddr last_fb_depth_addr;
+    /// Render targets resident on the GPU, their 3DS memory ranges never overlap
+    std::vector<std::unique_ptr<Surface>> surfaces;
+
+    /// Target of accelerated display transfers, not part of the cache since their output is linear
+    std::unique_ptr<Surface> transfer_surface;
+
+    /**
+     * Outputs of accelerated display transfers to the LCD framebuffers, which are presented straight
+     * from them. They are dirty until committed, which only happens once something reads their
+     * 3DS memory. Their ranges never overlap each other or a surface.
+     */
+    std::vector<std::unique_ptr<Surface>> display_outputs;
+
+    // Surfaces of the current PICA framebuffer, null until the first draw
+    Surface* fb_color;
+    Surface* fb_depth;
+
+    // Textures attached to the OpenGL framebuffer, reset when the surface holding one is removed
+    GLuint attached_color_texture;
+    GLuint attached_depth_texture;
 
     // Hardware rasterizer
-    TextureInfo fb_color_texture;
-    DepthTextureInfo fb_depth_texture;
     OGLShader shader;
     OGLVertexArray vertex_array;
-    OGLBuffer vertex_buffer;
+    OGLStreamBuffer vertex_buffer;
     OGLFramebuffer framebuffer;
 
+    // Framebuffers the surface sample textures are blitted through
+    OGLFramebuffer copy_read_framebuffer;
+    OGLFramebuffer copy_draw_framebuffer;
+
+    // Framebuffer detiling
+    DetileShader detile_color_shader;
+    DetileShader detile_depth_shader;
+    OGLBuffer detile_buffer;
+    OGLTexture detile_buffer_texture;
+    GLint max_texture_buffer_size;
+
     // Hardware vertex shader
     GLuint attrib_position;
     GLuint attrib_color;
     GLuint attrib_texcoords;
 
     // Hardware fragment shader
-    GLuint uniform_alphatest_enabled;
-    GLuint uniform_alphatest_func;
-    GLuint uniform_alphatest_ref;
-    GLuint uniform_tex;
-    GLuint uniform_tev_combiner_buffer_color;
-    TEVConfigUniforms uniform_tev_cfgs[6];
+    OGLBuffer uniform_buffer;
+
+    /// Specialized fragment shader programs, null where building one failed and the uber shader is used
+    std::unordered_map<PicaShaderConfig, std::unique_ptr<OGLShader>> shader_cache;
+    /// Specialized fragment shader programs the driver is still building
+    std::unordered_map<PicaShaderConfig, std::unique_ptr<OGLShader>> pending_shaders;
+
+    /// Whether the driver supports KHR_parallel_shader_compile, so that programs can be built without waiting for them
+    bool parallel_shader_compile;
+
+    GPUTimer gpu_timer;
+
+    /// Uniforms written by the Sync functions, uploaded to uniform_buffer once per draw when dirty
+    UniformData uniform_block_data;
+    bool uniform_block_data_dirty;
+
+    // Translated vertex shaders
+    OGLVertexArray vs_vertex_array;
+    OGLStreamBuffer index_buffer;
+    OGLBuffer vs_uniform_buffer;
+    VSUniformData vs_uniform_data;
+    bool vs_uniforms_dirty;
+
+    /// Hash of the PICA shader program code and swizzle patterns, recomputed when they were written to
+    u64 vs_program_hash;
+    bool vs_program_dirty;
+
+    /// GLSL sources of translated vertex shaders, null where the PICA shader can't be translated
+    std::unordered_map<PicaVSConfig, std::unique_ptr<std::string>> vs_source_cache;
+
+    /// Translated vertex shaders linked with fragment shaders, by the hash of both configurations; null where linking failed
+    std::unordered_map<u64, std::unique_ptr<OGLShader>> vs_program_cache;
+    /// Translated vertex shader programs the driver is still building
+    std::unordered_map<u64, std::unique_ptr<OGLShader>> pending_vs_programs;
 };
@@ -2,76 +2,523 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <algorithm>
+#include <cstring>
+
+#include "common/hash.h"
+#include "common/logging/log.h"
 #include "common/make_unique.h"
 #include "common/math_util.h"
+#include "common/perf_counters.h"
+#include "common/swap.h"
 #include "common/vector_math.h"
 
 #include "core/memory.h"
+#include "core/memory_stats.h"
+#include "core/settings.h"
 
 #include "video_core/renderer_opengl/gl_rasterizer_cache.h"
+#include "video_core/renderer_opengl/gl_shaders.h"
 #include "video_core/renderer_opengl/pica_to_gl.h"
+#include "video_core/texture_disk_cache.h"
+#include "video_core/video_core.h"
 #include "video_core/debug_utils/debug_utils.h"
 
+// Core in OpenGL 4.3, the 3.2 loader doesn't define it
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_RGB8_ETC2 0x9274
+#endif
+
+/// Initial size of the upload buffer, enough for a 1024x1024 texture
+static const GLsizeiptr UPLOAD_BUFFER_SIZE = 4 * 1024 * 1024;
+
+/// Texture unit the tiled texture data is bound to while decoding, after the ones of the rasterizer
+static const unsigned DECODE_TEXTURE_UNIT = 4;
+
+static Common::Perf::Counter texture_uploads_counter("Texture uploads");
+static Common::Perf::Counter texture_evictions_counter("Texture evictions");
+
+RasterizerCacheOpenGL::RasterizerCacheOpenGL()
+        : cached_bytes(0), current_frame(0),
+          uniform_decode_format(-1), uniform_decode_width(-1), uniform_decode_height(-1),
+          max_texture_buffer_size(0), etc2_supported(false) {
+}
+
+void RasterizerCacheOpenGL::Init() {
+    GLint major_version = 0, minor_version = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major_version);
+    glGetIntegerv(GL_MINOR_VERSION, &minor_version);
+    etc2_supported = major_version > 4 || (major_version == 4 && minor_version >= 3);
+
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for (GLint i = 0; i < num_extensions && !etc2_supported; ++i) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (std::strcmp(extension, "GL_ARB_ES3_compatibility") == 0)
+            etc2_supported = true;
+    }
+
+    LOG_INFO(Render_OpenGL, "ETC1 textures are %s", etc2_supported ? "uploaded compressed" : "decoded");
+}
+
+unsigned RasterizerCacheOpenGL::GetUploadsCounterId() {
+    return texture_uploads_counter.GetCounterId();
+}
+
+unsigned RasterizerCacheOpenGL::GetEvictionsCounterId() {
+    return texture_evictions_counter.GetCounterId();
+}
+
+void RasterizerCacheOpenGL::UploadTexture(const u8* texture_src_data, const Pica::DebugUtils::TextureInfo& info) {
+    std::unique_ptr<Math::Vec4<u8>[]> temp_texture_buffer_rgba(new Math::Vec4<u8>[info.width * info.height]);
+
+    Pica::TextureDiskCache::DecodeTexture(texture_src_data, info, temp_texture_buffer_rgba.get());
+    UploadDecodedTexture(temp_texture_buffer_rgba.get(), info);
+}
+
+void RasterizerCacheOpenGL::BindUploadBuffer() {
+    if (upload_buffer.handle == 0) {
+        upload_buffer.Create(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_buffer.handle);
+        upload_buffer.Allocate(UPLOAD_BUFFER_SIZE);
+    } else {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_buffer.handle);
+    }
+}
+
+void RasterizerCacheOpenGL::UploadDecodedTexture(Math::Vec4<u8>* texels, const Pica::DebugUtils::TextureInfo& info) {
+    BindUploadBuffer();
+
+    const size_t row_size = info.width * sizeof(Math::Vec4<u8>);
+    const GLsizeiptr size = row_size * info.height;
+    GLintptr offset;
+    u8* mapped = upload_buffer.Map(size, 4, &offset);
+    if (mapped != nullptr) {
+        // OpenGL expects the rows from bottom to top
+        for (int y = 0; y < info.height; ++y)
+            memcpy(mapped + row_size * y, &texels[info.width * (info.height - 1 - y)], row_size);
+        upload_buffer.Unmap(size);
+
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, info.width, info.height, GL_RGBA, GL_UNSIGNED_BYTE,
+                        reinterpret_cast<const void*>(offset));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+
+    LOG_WARNING(Render_OpenGL, "Failed to map the texture upload buffer, uploading synchronously");
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    for (int y = 0; y < info.height / 2; ++y) {
+        Math::Vec4<u8>* row = &texels[info.width * y];
+        std::swap_ranges(row, row + info.width, &texels[info.width * (info.height - 1 - y)]);
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, info.width, info.height, GL_RGBA, GL_UNSIGNED_BYTE,
+                    texels);
+}
+
+bool RasterizerCacheOpenGL::IsUploadedCompressed(const Pica::DebugUtils::TextureInfo& info) const {
+    // Textures are made of whole 8x8 tiles
+    return etc2_supported && info.format == Pica::Regs::TextureFormat::ETC1 &&
+           info.width % 8 == 0 && info.height % 8 == 0 && info.width > 0 && info.height > 0;
+}
+
+/**
+ * Copies the 4x4 blocks of a PICA ETC1 texture into the order OpenGL expects them in. In 3DS memory,
+ * each 8x8 tile holds four blocks in Morton order, and each block is a little endian 64-bit word
+ * with the same bit layout as the big endian blocks of ETC1 and ETC2.
+ * The rows of blocks stay in the order of 3DS memory, from the top of the texture to the bottom,
+ * because flipping a block vertically can overflow its differential colors. OpenGL then sees the
+ * texture upside down, and it is sampled with flipped t coordinates.
+ */
+static void ConvertETC1Blocks(const u8* source, u8* dest, int width, int height) {
+    const int blocks_per_row = width / 4;
+    for (int tile_y = 0; tile_y < height / 8; ++tile_y) {
+        for (int tile_x = 0; tile_x < width / 8; ++tile_x) {
+            for (int block = 0; block < 4; ++block) {
+                const int block_x = tile_x * 2 + (block & 1);
+                const int block_y = tile_y * 2 + (block >> 1);
+
+                u64 value;
+                std::memcpy(&value, source, sizeof(value));
+                value = Common::swap64(value);
+                std::memcpy(dest + (block_y * blocks_per_row + block_x) * sizeof(value), &value, sizeof(value));
+                source += sizeof(value);
+            }
+        }
+    }
+}
+
+void RasterizerCacheOpenGL::UploadCompressedTexture(const u8* texture_src_data, const Pica::DebugUtils::TextureInfo& info,
+                                                    bool allocate) {
+    const GLsizei size = info.width * info.height / 2;
+    auto upload = [&](const void* data) {
+        if (allocate)
+            glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGB8_ETC2, info.width, info.height, 0, size, data);
+        else
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, info.width, info.height, GL_COMPRESSED_RGB8_ETC2, size, data);
+    };
+
+    BindUploadBuffer();
+    GLintptr offset;
+    u8* mapped = upload_buffer.Map(size, 8, &offset);
+    if (mapped != nullptr) {
+        ConvertETC1Blocks(texture_src_data, mapped, info.width, info.height);
+        upload_buffer.Unmap(size);
+        upload(reinterpret_cast<const void*>(offset));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+
+    LOG_WARNING(Render_OpenGL, "Failed to map the texture upload buffer, uploading synchronously");
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    u8* blocks = VideoCore::g_frame_arena.AllocateArray<u8>(size);
+    ConvertETC1Blocks(texture_src_data, blocks, info.width, info.height);
+    upload(blocks);
+}
+
+void RasterizerCacheOpenGL::InitDecoder(OpenGLState& state) {
+    decode_shader.Create(GLShaders::g_vertex_shader_fullscreen, GLShaders::g_fragment_shader_decode_texture);
+    uniform_decode_format = glGetUniformLocation(decode_shader.handle, "format");
+    uniform_decode_width = glGetUniformLocation(decode_shader.handle, "width");
+    uniform_decode_height = glGetUniformLocation(decode_shader.handle, "height");
+
+    OpenGLState init_state = state;
+    init_state.draw.shader_program = decode_shader.handle;
+    init_state.Apply();
+    glUniform1i(glGetUniformLocation(decode_shader.handle, "tiled_data"), DECODE_TEXTURE_UNIT);
+    state.Apply();
+
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texture_buffer_size);
+    // The buffer only exists once it was bound, glTexBuffer fails before
+    decode_buffer.Create();
+    glBindBuffer(GL_TEXTURE_BUFFER, decode_buffer.handle);
+    decode_buffer_texture.Create();
+    OpenGLState::SetActiveTexture(DECODE_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, decode_buffer_texture.handle);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R8UI, decode_buffer.handle);
+
+    decode_framebuffer.Create();
+}
+
+bool RasterizerCacheOpenGL::DecodeTexture(OpenGLState& state, GLuint texture, const u8* texture_src_data,
+                                          const Pica::DebugUtils::TextureInfo& info) {
+    if (decode_shader.handle == 0)
+        InitDecoder(state);
+
+    const u32 size = info.width * info.height * Pica::Regs::NibblesPerPixel(info.format) / 2;
+    if (!IsDecodedOnGPU(size))
+        return false;
+
+    glBindBuffer(GL_TEXTURE_BUFFER, decode_buffer.handle);
+    glBufferData(GL_TEXTURE_BUFFER, size, texture_src_data, GL_STREAM_DRAW);
+
+    // Draw with a plain state into the texture alone. The destination isn't bound to any unit, so
+    // that it is not sampled while it is drawn to.
+    OpenGLState decode_state;
+    decode_state.draw.framebuffer = decode_framebuffer.handle;
+    decode_state.draw.vertex_array = state.draw.vertex_array;
+    decode_state.draw.vertex_buffer = state.draw.vertex_buffer;
+    decode_state.draw.shader_program = decode_shader.handle;
+    decode_state.Apply();
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+
+    glUniform1i(uniform_decode_format, (GLint)info.format);
+    glUniform1i(uniform_decode_width, info.width);
+    glUniform1i(uniform_decode_height, info.height);
+
+    // The viewport is synced again before every draw
+    glViewport(0, 0, info.width, info.height);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+
+    state.Apply();
+    return true;
+}
+
+bool RasterizerCacheOpenGL::IsDecodedOnGPU(u32 size) const {
+    // Until the decoder is created, the first texture creates it, textures are assumed to fit
+    return size != 0 && (decode_shader.handle == 0 || size <= (u32)max_texture_buffer_size);
+}
+
 RasterizerCacheOpenGL::~RasterizerCacheOpenGL() {
     FullFlush();
 }
 
-void RasterizerCacheOpenGL::LoadAndBindTexture(OpenGLState &state, unsigned texture_unit, const Pica::Regs::FullTextureConfig& config) {
+/// Whether a region lies entirely within the memory textures are read from
+static bool IsTextureMemory(PAddr addr, u32 size) {
+    const u64 end = (u64)addr + size;
+    return (addr >= Memory::VRAM_PADDR && end <= Memory::VRAM_PADDR_END) ||
+           (addr >= Memory::FCRAM_PADDR && end <= Memory::FCRAM_PADDR_END);
+}
+
+void RasterizerCacheOpenGL::PrefetchTexture(const Pica::Regs::FullTextureConfig& config) {
+    // Without workers the job would run right away, for a texture that might not even be drawn
+    if (Common::JobSystem::GetNumWorkers() == 0)
+        return;
+
+    const PAddr texture_addr = config.config.GetPhysicalAddress();
+    const TextureKey key(texture_addr, config.format, config.config.width, config.config.height);
+    if (prefetches.count(key) != 0)
+        return;
+
+    const auto cached_texture = texture_cache.find(key);
+    const bool is_cached = cached_texture != texture_cache.end();
+    if (is_cached && !cached_texture->second->suspect)
+        return;
+
+    // The registers may be halfway through being written, so the texture isn't trusted to be valid
+    const auto info = Pica::DebugUtils::TextureInfo::FromPicaRegister(config.config, config.format);
+    const u32 size = info.width * info.height * Pica::Regs::NibblesPerPixel(info.format) / 2;
+    if (size == 0 || !IsTextureMemory(texture_addr, size))
+        return;
+    const u8* texture_src_data = Memory::GetPhysicalPointer(texture_addr);
+    if (texture_src_data == nullptr)
+        return;
+
+    // Textures decoded on the GPU or uploaded compressed only have their hash computed ahead
+    const bool decode = !IsUploadedCompressed(info) && !IsDecodedOnGPU(size);
+    const u64 cached_hash = is_cached ? cached_texture->second->hash : 0;
+
+    std::unique_ptr<Prefetch> prefetch = Common::make_unique<Prefetch>();
+    prefetch->addr = texture_addr;
+    prefetch->size = size;
+    Prefetch* const job_prefetch = prefetch.get();
+    Common::JobSystem::Spawn([job_prefetch, texture_src_data, info, decode, is_cached, cached_hash] {
+        job_prefetch->hash = Common::ComputeHash64(texture_src_data, job_prefetch->size);
+        if (decode && (!is_cached || job_prefetch->hash != cached_hash)) {
+            job_prefetch->texels.reset(new Math::Vec4<u8>[info.width * info.height]);
+            Pica::TextureDiskCache::DecodeTexture(texture_src_data, info, job_prefetch->texels.get());
+        }
+    }, &prefetch->counter);
+    prefetches.emplace(key, std::move(prefetch));
+}
+
+std::unique_ptr<RasterizerCacheOpenGL::Prefetch> RasterizerCacheOpenGL::TakePrefetch(const TextureKey& key) {
+    auto it = prefetches.find(key);
+    if (it == prefetches.end())
+        return nullptr;
+
+    std::unique_ptr<Prefetch> prefetch = std::move(it->second);
+    prefetches.erase(it);
+    prefetch->counter.Wait();
+    return prefetch;
+}
+
+void RasterizerCacheOpenGL::DiscardPrefetches() {
+    // The jobs write to the prefetches, they can only go once they are done
+    for (auto& entry : prefetches)
+        entry.second->counter.Wait();
+    prefetches.clear();
+}
+
+bool RasterizerCacheOpenGL::LoadAndBindTexture(OpenGLState &state, unsigned texture_unit, const Pica::Regs::FullTextureConfig& config) {
     PAddr texture_addr = config.config.GetPhysicalAddress();
+    const TextureKey key(texture_addr, config.format, config.config.width, config.config.height);
 
-    const auto cached_texture = texture_cache.find(texture_addr);
+    const auto cached_texture = texture_cache.find(key);
 
     if (cached_texture != texture_cache.end()) {
-        state.texture_units[texture_unit].texture_2d = cached_texture->second->texture.handle;
+        CachedTexture& texture = *cached_texture->second;
+        texture.last_used_frame = current_frame;
+        state.texture_units[texture_unit].texture_2d = texture.texture->handle;
         state.Apply();
+
+        // Its memory was written to since, but games often just upload the same data again
+        if (texture.suspect) {
+            texture.suspect = false;
+
+            const std::unique_ptr<Prefetch> prefetch = TakePrefetch(key);
+            const u8* texture_src_data = Memory::GetPhysicalPointer(texture_addr);
+            MemoryStats::SampleGPURead(MemoryStats::GPURead::Texture, texture_addr, texture.size);
+            const u64 hash = prefetch != nullptr ? prefetch->hash : Common::ComputeHash64(texture_src_data, texture.size);
+            if (hash != texture.hash) {
+                texture.hash = hash;
+                texture_uploads_counter.Add();
+                const auto info = Pica::DebugUtils::TextureInfo::FromPicaRegister(config.config, config.format);
+                if (texture.compressed)
+                    UploadCompressedTexture(texture_src_data, info, false);
+                else if (prefetch != nullptr && prefetch->texels != nullptr)
+                    UploadDecodedTexture(prefetch->texels.get(), info);
+                else if (!DecodeTexture(state, texture.texture->handle, texture_src_data, info))
+                    UploadTexture(texture_src_data, info);
+            }
+        }
+        return texture.compressed;
     } else {
         std::unique_ptr<CachedTexture> new_texture = Common::make_unique<CachedTexture>();
+        const auto info = Pica::DebugUtils::TextureInfo::FromPicaRegister(config.config, config.format);
+        const bool compressed = IsUploadedCompressed(info);
 
-        new_texture->texture.Create();
-        state.texture_units[texture_unit].texture_2d = new_texture->texture.handle;
+        // Pooled textures already have storage of the right size, their contents are overwritten below.
+        // The pool only holds RGBA8 textures.
+        if (!compressed)
+            new_texture->texture = texture_pool.Acquire(info.width, info.height);
+        const bool has_storage = new_texture->texture != nullptr;
+        if (!has_storage) {
+            new_texture->texture = Common::make_unique<OGLTexture>();
+            new_texture->texture->Create();
+        }
+        state.texture_units[texture_unit].texture_2d = new_texture->texture->handle;
         state.Apply();
 
-        // TODO: Need to choose filters that correspond to PICA once register is declared
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        if (!has_storage) {
+            // TODO: Need to choose filters that correspond to PICA once register is declared
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+            // Compressed storage is created along with its contents
+            if (!compressed)
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, info.width, info.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, PicaToGL::WrapMode(config.config.wrap_s));
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, PicaToGL::WrapMode(config.config.wrap_t));
 
-        const auto info = Pica::DebugUtils::TextureInfo::FromPicaRegister(config.config, config.format);
-
+        new_texture->key = key;
         new_texture->width = info.width;
         new_texture->height = info.height;
-        new_texture->size = info.width * info.height * Pica::Regs::NibblesPerPixel(info.format);
+        new_texture->compressed = compressed;
+        new_texture->memory_usage.Set(compressed ? info.width * info.height / 2 : info.width * info.height * 4);
+        new_texture->last_used_frame = current_frame;
+        cached_bytes += new_texture->memory_usage.Get();
+        new_texture->addr = texture_addr;
+        new_texture->size = info.width * info.height * Pica::Regs::NibblesPerPixel(info.format) / 2;
 
-        u8* texture_src_data = Memory::GetPhysicalPointer(texture_addr);
-        std::unique_ptr<Math::Vec4<u8>[]> temp_texture_buffer_rgba(new Math::Vec4<u8>[info.width * info.height]);
+        const std::unique_ptr<Prefetch> prefetch = TakePrefetch(key);
+        const u8* texture_src_data = Memory::GetPhysicalPointer(texture_addr);
+        MemoryStats::SampleGPURead(MemoryStats::GPURead::Texture, texture_addr, new_texture->size);
+        new_texture->hash = prefetch != nullptr ? prefetch->hash : Common::ComputeHash64(texture_src_data, new_texture->size);
+        new_texture->suspect = false;
+        texture_uploads_counter.Add();
+        if (compressed)
+            UploadCompressedTexture(texture_src_data, info, true);
+        else if (prefetch != nullptr && prefetch->texels != nullptr)
+            UploadDecodedTexture(prefetch->texels.get(), info);
+        else if (!DecodeTexture(state, new_texture->texture->handle, texture_src_data, info))
+            UploadTexture(texture_src_data, info);
 
-        for (int y = 0; y < info.height; ++y) {
-            for (int x = 0; x < info.width; ++x) {
-                temp_texture_buffer_rgba[x + info.width * y] = Pica::DebugUtils::LookupTexture(texture_src_data, x, info.height - 1 - y, info);
-            }
+        if (new_texture->size != 0) {
+            const u32 last_page = (texture_addr + new_texture->size - 1) >> PAGE_BITS;
+            for (u32 page = texture_addr >> PAGE_BITS; page <= last_page; ++page)
+                page_index[page].push_back(new_texture.get());
         }
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, info.width, info.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, temp_texture_buffer_rgba.get());
-
-        texture_cache.emplace(texture_addr, std::move(new_texture));
+        texture_cache.emplace(key, std::move(new_texture));
+        return compressed;
     }
 }
 
 void RasterizerCacheOpenGL::NotifyFlush(PAddr addr, u32 size) {
-    // Flush any texture that falls in the flushed region
-    // TODO: Optimize by also inserting upper bound (addr + size) of each texture into the same map and also narrow using lower_bound
-    auto cache_upper_bound = texture_cache.upper_bound(addr + size);
-    for (auto it = texture_cache.begin(); it != cache_upper_bound;) {
-        if (MathUtil::IntervalsIntersect(addr, size, it->first, it->second->size)) {
-            it = texture_cache.erase(it);
+    if (size == 0)
+        return;
+
+    // Prefetches read the memory before it was written to
+    for (auto it = prefetches.begin(); it != prefetches.end();) {
+        if (MathUtil::IntervalsIntersect(addr, size, it->second->addr, it->second->size)) {
+            it->second->counter.Wait();
+            it = prefetches.erase(it);
         } else {
             ++it;
         }
     }
+
+    const u32 first_page = addr >> PAGE_BITS;
+    const u32 last_page = (addr + size - 1) >> PAGE_BITS;
+
+    // Textures are only marked here, they are hashed again when they are bound the next time.
+    // Textures spanning several pages are listed in each of them, which marking doesn't mind.
+    auto mark_bucket = [&](const std::vector<CachedTexture*>& bucket) {
+        for (CachedTexture* texture : bucket) {
+            if (MathUtil::IntervalsIntersect(addr, size, texture->addr, texture->size))
+                texture->suspect = true;
+        }
+    };
+
+    // Flushes of large regions, e.g. all of VRAM, are cheaper to check against the pages in use
+    if (last_page - first_page >= page_index.size()) {
+        for (const auto& bucket : page_index) {
+            if (bucket.first >= first_page && bucket.first <= last_page)
+                mark_bucket(bucket.second);
+        }
+    } else {
+        for (u32 page = first_page; page <= last_page; ++page) {
+            auto bucket = page_index.find(page);
+            if (bucket != page_index.end())
+                mark_bucket(bucket->second);
+        }
+    }
 }
 
 void RasterizerCacheOpenGL::FullFlush() {
+    DiscardPrefetches();
+    page_index.clear();
+    texture_evictions_counter.Add(texture_cache.size());
+    for (auto& entry : texture_cache) {
+        CachedTexture& texture = *entry.second;
+        if (!texture.compressed)
+            texture_pool.Release(texture.width, texture.height, std::move(texture.texture));
+    }
     texture_cache.clear();
+    cached_bytes = 0;
+}
+
+void RasterizerCacheOpenGL::EvictTexture(std::map<TextureKey, std::unique_ptr<CachedTexture>>::iterator it,
+                                         OpenGLState& state) {
+    CachedTexture& texture = *it->second;
+    if (texture.size != 0) {
+        const u32 last_page = (texture.addr + texture.size - 1) >> PAGE_BITS;
+        for (u32 page = texture.addr >> PAGE_BITS; page <= last_page; ++page) {
+            auto bucket = page_index.find(page);
+            if (bucket == page_index.end())
+                continue;
+            auto& textures = bucket->second;
+            textures.erase(std::remove(textures.begin(), textures.end(), &texture), textures.end());
+            if (textures.empty())
+                page_index.erase(bucket);
+        }
+    }
+
+    // Deleting the texture unbinds it, the states have to forget about it too
+    const GLuint handle = texture.texture->handle;
+    for (auto& texture_unit : state.texture_units) {
+        if (texture_unit.texture_2d == handle)
+            texture_unit.texture_2d = 0;
+    }
+    OpenGLState::ResetTexture(handle);
+
+    // The memory is given back to the driver rather than kept in the pool
+    cached_bytes -= texture.memory_usage.Get();
+    texture_evictions_counter.Add();
+    texture_cache.erase(it);
+}
+
+void RasterizerCacheOpenGL::EndFrame(OpenGLState& state) {
+    const u64 budget = static_cast<u64>(std::max(Settings::values.texture_cache_size, 0)) * 1024 * 1024;
+    const u64 frame = current_frame++;
+    if (budget == 0 || cached_bytes <= budget)
+        return;
+
+    std::vector<std::map<TextureKey, std::unique_ptr<CachedTexture>>::iterator> candidates;
+    for (auto it = texture_cache.begin(); it != texture_cache.end(); ++it) {
+        if (it->second->last_used_frame != frame)
+            candidates.push_back(it);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const decltype(candidates)::value_type& a,
+                                                       const decltype(candidates)::value_type& b) {
+        return a->second->last_used_frame < b->second->last_used_frame;
+    });
+
+    // Evicted textures are decoded again from memory if they are drawn with again
+    size_t num_evicted = 0;
+    for (const auto& it : candidates) {
+        if (cached_bytes <= budget)
+            break;
+        EvictTexture(it, state);
+        ++num_evicted;
+    }
+    LOG_DEBUG(Render_OpenGL, "Evicted %u textures over the texture cache budget, %u KB remain cached",
+              (unsigned)num_evicted, (unsigned)(cached_bytes / 1024));
 }
@@ -6,31 +6,165 @@
 
 #include "gl_state.h"
 #include "gl_resource_manager.h"
+#include "common/job_system.h"
+#include "common/memory_accounting.h"
+#include "common/vector_math.h"
 #include "video_core/pica.h"
+#include "video_core/debug_utils/debug_utils.h"
 
 #include <memory>
 #include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 
 class RasterizerCacheOpenGL : NonCopyable {
 public:
+    RasterizerCacheOpenGL();
     ~RasterizerCacheOpenGL();
 
-    /// Loads a texture from 3DS memory to OpenGL and caches it (if not already cached)
-    void LoadAndBindTexture(OpenGLState &state, unsigned texture_unit, const Pica::Regs::FullTextureConfig& config);
+    /// Checks the capabilities of the OpenGL context, which has to be current
+    void Init();
 
-    /// Flush any cached resource that touches the flushed region
+    /**
+     * Loads a texture from 3DS memory to OpenGL and caches it (if not already cached)
+     * @return Whether the texture is stored upside down, so that its t coordinates have to be flipped.
+     *         This is the case for ETC1 textures uploaded compressed, whose blocks can't be flipped.
+     */
+    bool LoadAndBindTexture(OpenGLState &state, unsigned texture_unit, const Pica::Regs::FullTextureConfig& config);
+
+    /**
+     * Starts hashing a texture that isn't cached or may have changed on a worker thread, and
+     * decoding it if it is decoded on the CPU, so that the draw sampling it only waits for what
+     * isn't done by then. Called when the texture registers are written, ahead of the draws.
+     */
+    void PrefetchTexture(const Pica::Regs::FullTextureConfig& config);
+
+    /// Drops the prefetched textures that weren't drawn with, once their jobs are done
+    void DiscardPrefetches();
+
+    /// Marks cached resources that touch the flushed region to be checked for changes before their next use
     void NotifyFlush(PAddr addr, u32 size);
 
     /// Flush all cached OpenGL resources tracked by this cache manager
     void FullFlush();
 
+    /**
+     * Ends a frame of draws. While the cached textures take more than Settings::values.texture_cache_size,
+     * the ones used the longest ago are evicted, those used during the frame are kept.
+     * @param state State of the rasterizer, evicted textures are unbound from it
+     */
+    void EndFrame(OpenGLState& state);
+
+    /// Id of the Perf::Counter of the textures uploaded, because they weren't cached or their data changed
+    static unsigned GetUploadsCounterId();
+
+    /// Id of the Perf::Counter of the textures dropped from the cache
+    static unsigned GetEvictionsCounterId();
+
 private:
+    /// Binds upload_buffer to GL_PIXEL_UNPACK_BUFFER, creating it the first time
+    void BindUploadBuffer();
+
+    /// Decodes the texture and uploads it to the currently bound OpenGL texture through upload_buffer
+    void UploadTexture(const u8* texture_src_data, const Pica::DebugUtils::TextureInfo& info);
+
+    /// Uploads decoded texels to the currently bound OpenGL texture, they may be modified
+    void UploadDecodedTexture(Math::Vec4<u8>* texels, const Pica::DebugUtils::TextureInfo& info);
+
+    /// Whether textures of the given format and dimensions are uploaded as they are, by UploadCompressedTexture
+    bool IsUploadedCompressed(const Pica::DebugUtils::TextureInfo& info) const;
+
+    /**
+     * Uploads the blocks of an ETC1 texture to the currently bound OpenGL texture as ETC2, which ETC1
+     * is a subset of, without decoding them
+     * @param allocate Whether the texture's storage has to be created, rather than overwritten
+     */
+    void UploadCompressedTexture(const u8* texture_src_data, const Pica::DebugUtils::TextureInfo& info,
+                                 bool allocate);
+
+    /// Creates the program and buffer texture of DecodeTexture
+    void InitDecoder(OpenGLState& state);
+
+    /**
+     * Uploads the tiled texture data as it is and decodes it into the given texture with a draw,
+     * which spares the CPU decoding it and uploads several times fewer bytes for small formats
+     * @return Whether the texture was decoded, UploadTexture has to be used instead otherwise
+     */
+    bool DecodeTexture(OpenGLState& state, GLuint texture, const u8* texture_src_data,
+                       const Pica::DebugUtils::TextureInfo& info);
+
+    /// Textures are identified by their address, format and dimensions
+    typedef std::tuple<PAddr, Pica::Regs::TextureFormat, u32, u32> TextureKey;
+
+    /// Work of a worker thread on a texture, from PrefetchTexture
+    struct Prefetch {
+        PAddr addr;
+        u32 size;
+        u64 hash;
+        /// Decoded texels, only if the texture is decoded on the CPU and differs from the cached one
+        std::unique_ptr<Math::Vec4<u8>[]> texels;
+        Common::JobSystem::JobCounter counter;
+    };
+
+    /// Waits for the prefetch of the texture, if there is one, and takes it from the pending ones
+    std::unique_ptr<Prefetch> TakePrefetch(const TextureKey& key);
+
+    /// Whether textures of the given size are decoded on the GPU, by DecodeTexture
+    bool IsDecodedOnGPU(u32 size) const;
+
     struct CachedTexture {
-        OGLTexture texture;
+        std::unique_ptr<OGLTexture> texture;
+        TextureKey key;
         GLuint width;
         GLuint height;
+        PAddr addr;
         u32 size;
+        /// Hash of the texture data the OpenGL texture was uploaded from
+        u64 hash;
+        /// Whether the texture's memory may have changed since it was last hashed
+        bool suspect;
+        /// Whether the texture is stored compressed and upside down, see UploadCompressedTexture
+        bool compressed;
+        /// Frame the texture was last bound in, for evicting the least recently used textures
+        u64 last_used_frame;
+        Common::MemoryAccounting::ScopedUsage memory_usage{Common::MemoryAccounting::Tag::TextureCache};
     };
 
-    std::map<PAddr, std::unique_ptr<CachedTexture>> texture_cache;
+    /// Size of the memory pages cached textures are indexed by
+    static const unsigned PAGE_BITS = 12;
+
+    /// Removes a texture from the cache and deletes its OpenGL texture
+    void EvictTexture(std::map<TextureKey, std::unique_ptr<CachedTexture>>::iterator it, OpenGLState& state);
+
+    std::map<TextureKey, std::unique_ptr<CachedTexture>> texture_cache;
+    /// Bytes of OpenGL texture memory taken by the cached textures
+    u64 cached_bytes;
+    /// Number of frames ended so far
+    u64 current_frame;
+
+    /// Cached textures by the pages of memory they overlap, so that flushes only look at textures they can touch
+    std::unordered_map<u32, std::vector<CachedTexture*>> page_index;
+
+    /// Prefetches the draws haven't used yet
+    std::map<TextureKey, std::unique_ptr<Prefetch>> prefetches;
+
+    /// Textures of flushed cache entries, reused for new entries of the same size
+    OGLTexturePool texture_pool;
+
+    /// Pixel buffer the decoded textures are written to, which lets the driver copy them asynchronously
+    OGLStreamBuffer upload_buffer;
+
+    // Decoding textures on the GPU
+    OGLShader decode_shader;
+    GLint uniform_decode_format;
+    GLint uniform_decode_width;
+    GLint uniform_decode_height;
+    OGLBuffer decode_buffer;
+    OGLTexture decode_buffer_texture;
+    OGLFramebuffer decode_framebuffer;
+    GLint max_texture_buffer_size;
+
+    /// Whether the context supports ETC2 textures, through OpenGL 4.3 or ARB_ES3_compatibility
+    bool etc2_supported;
 };
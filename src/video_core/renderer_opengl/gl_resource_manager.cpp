@@ -26,6 +26,37 @@ void OGLTexture::Release() {
     handle = 0;
 }
 
+// Texture pool
+OGLTexturePool::OGLTexturePool() : num_textures(0) {
+}
+
+std::unique_ptr<OGLTexture> OGLTexturePool::Acquire(GLsizei width, GLsizei height) {
+    auto bucket = textures.find(std::make_pair(width, height));
+    if (bucket == textures.end() || bucket->second.empty())
+        return nullptr;
+
+    std::unique_ptr<OGLTexture> texture = std::move(bucket->second.back());
+    bucket->second.pop_back();
+    --num_textures;
+    memory_usage.Set(memory_usage.Get() - width * height * 4);
+    return texture;
+}
+
+void OGLTexturePool::Release(GLsizei width, GLsizei height, std::unique_ptr<OGLTexture> texture) {
+    if (num_textures >= MAX_POOLED_TEXTURES)
+        return;
+
+    textures[std::make_pair(width, height)].push_back(std::move(texture));
+    ++num_textures;
+    memory_usage.Add(width * height * 4);
+}
+
+void OGLTexturePool::Clear() {
+    textures.clear();
+    num_textures = 0;
+    memory_usage.Set(0);
+}
+
 // Shaders
 OGLShader::OGLShader() : handle(0) {
 }
@@ -68,6 +99,67 @@ void OGLBuffer::Release() {
     handle = 0;
 }
 
+// Stream buffer objects
+OGLStreamBuffer::OGLStreamBuffer() : handle(0), target(GL_ARRAY_BUFFER), buffer_size(0), position(0) {
+}
+
+OGLStreamBuffer::~OGLStreamBuffer() {
+    Release();
+}
+
+void OGLStreamBuffer::Create(GLenum target) {
+    if (handle != 0) {
+        return;
+    }
+
+    glGenBuffers(1, &handle);
+    this->target = target;
+}
+
+void OGLStreamBuffer::Release() {
+    glDeleteBuffers(1, &handle);
+    handle = 0;
+    buffer_size = 0;
+    position = 0;
+    memory_usage.Set(0);
+}
+
+void OGLStreamBuffer::Allocate(GLsizeiptr size) {
+    glBufferData(target, size, nullptr, GL_STREAM_DRAW);
+    buffer_size = size;
+    position = 0;
+    memory_usage.Set(size);
+}
+
+u8* OGLStreamBuffer::Map(GLsizeiptr size, GLintptr alignment, GLintptr* offset) {
+    if (size > buffer_size)
+        Allocate(size);
+
+    // Writing to regions that haven't been used since the storage was orphaned can't interfere
+    // with pending draws, so the driver doesn't need to synchronize
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+
+    position = (position + alignment - 1) / alignment * alignment;
+    if (position + size > buffer_size) {
+        // Get fresh storage, the driver keeps the old one alive until the GPU is done with it
+        access |= GL_MAP_INVALIDATE_BUFFER_BIT;
+        position = 0;
+    }
+
+    *offset = position;
+    return static_cast<u8*>(glMapBufferRange(target, position, size, access));
+}
+
+bool OGLStreamBuffer::Fits(GLsizeiptr size, GLintptr alignment) const {
+    const GLintptr aligned_position = (position + alignment - 1) / alignment * alignment;
+    return aligned_position + size <= buffer_size;
+}
+
+void OGLStreamBuffer::Unmap(GLsizeiptr used_size) {
+    glUnmapBuffer(target);
+    position += used_size;
+}
+
 // Vertex array objects
 OGLVertexArray::OGLVertexArray() : handle(0) {
 }
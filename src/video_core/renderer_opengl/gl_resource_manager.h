@@ -4,7 +4,13 @@
 
 #pragma once
 
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
 #include "common/common_types.h"
+#include "common/memory_accounting.h"
 
 #include "generated/gl_3_2_core.h"
 
@@ -22,6 +28,34 @@ public:
     GLuint handle;
 };
 
+/**
+ * Keeps textures that are no longer used around to be used again by textures of the same size, as
+ * deleting textures and creating their storage anew is slow on many drivers. The pooled textures
+ * all have RGBA8 storage, whose contents are undefined when they are acquired again.
+ */
+class OGLTexturePool : public NonCopyable {
+public:
+    OGLTexturePool();
+
+    /// Returns a pooled texture of the given size, or nullptr if there is none
+    std::unique_ptr<OGLTexture> Acquire(GLsizei width, GLsizei height);
+
+    /// Adds a texture of the given size to the pool, deleting it if the pool is full
+    void Release(GLsizei width, GLsizei height, std::unique_ptr<OGLTexture> texture);
+
+    /// Deletes all pooled textures
+    void Clear();
+
+private:
+    /// Largest number of textures kept in the pool
+    static const size_t MAX_POOLED_TEXTURES = 256;
+
+    std::map<std::pair<GLsizei, GLsizei>, std::vector<std::unique_ptr<OGLTexture>>> textures;
+    size_t num_textures;
+    /// The pooled textures are RGBA8 textures of the texture cache
+    Common::MemoryAccounting::ScopedUsage memory_usage{Common::MemoryAccounting::Tag::TextureCache};
+};
+
 class OGLShader : public NonCopyable {
 public:
     OGLShader();
@@ -50,6 +84,51 @@ public:
     GLuint handle;
 };
 
+/**
+ * A buffer that data for draws is streamed into. Each Map returns a region following the one
+ * mapped before without waiting for draws reading the earlier regions, and the buffer storage is
+ * orphaned whenever the end of the buffer is reached. The buffer has to be bound to its target
+ * when calling Allocate, Map and Unmap.
+ */
+class OGLStreamBuffer : public NonCopyable {
+public:
+    OGLStreamBuffer();
+    ~OGLStreamBuffer();
+
+    /// Creates a new internal OpenGL resource and stores the handle
+    void Create(GLenum target);
+
+    /// Deletes the internal OpenGL resource
+    void Release();
+
+    /// Sets up the storage of the bound buffer, size being the number of bytes in it
+    void Allocate(GLsizeiptr size);
+
+    /**
+     * Maps a region of the buffer for writing
+     * @param size Number of bytes to map, the buffer is reallocated if it is smaller than that
+     * @param alignment The offset of the region will be a multiple of this
+     * @param offset Receives the offset of the region in the buffer
+     * @return Pointer to the mapped region, or nullptr if it couldn't be mapped
+     */
+    u8* Map(GLsizeiptr size, GLintptr alignment, GLintptr* offset);
+
+    /// Whether a Map with the given parameters would return a region of the current storage, instead of orphaning it
+    bool Fits(GLsizeiptr size, GLintptr alignment) const;
+
+    /// Unmaps the region mapped last, of which used_size bytes were written to
+    void Unmap(GLsizeiptr used_size);
+
+    GLuint handle;
+
+private:
+    GLenum target;
+    GLsizeiptr buffer_size;
+    /// Offset of the first byte not written to since the storage was last orphaned
+    GLintptr position;
+    Common::MemoryAccounting::ScopedUsage memory_usage{Common::MemoryAccounting::Tag::GPUBuffers};
+};
+
 class OGLVertexArray : public NonCopyable {
 public:
     OGLVertexArray();
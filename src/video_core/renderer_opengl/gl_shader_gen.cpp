@@ -0,0 +1,262 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "video_core/renderer_opengl/gl_shader_gen.h"
+
+using Pica::Regs;
+using TevStageConfig = Regs::TevStageConfig;
+
+namespace GLShader {
+
+bool IsPassThroughTevStage(const TevStageConfig& stage) {
+    return (stage.color_op == TevStageConfig::Operation::Replace &&
+            stage.alpha_op == TevStageConfig::Operation::Replace &&
+            stage.color_source1 == TevStageConfig::Source::Previous &&
+            stage.alpha_source1 == TevStageConfig::Source::Previous &&
+            stage.color_modifier1 == TevStageConfig::ColorModifier::SourceColor &&
+            stage.alpha_modifier1 == TevStageConfig::AlphaModifier::SourceAlpha &&
+            stage.GetColorMultiplier() == 1 &&
+            stage.GetAlphaMultiplier() == 1);
+}
+
+/// Returns the GLSL expression of a TEV source color
+static std::string GetSource(TevStageConfig::Source source, unsigned stage_index) {
+    using Source = TevStageConfig::Source;
+    switch (source) {
+    case Source::PrimaryColor:
+        return "o[2]";
+    case Source::PrimaryFragmentColor:
+        // HACK: Until we implement fragment lighting, use primary_color
+        return "o[2]";
+    case Source::SecondaryFragmentColor:
+        // HACK: Until we implement fragment lighting, use zero
+        return "vec4(0.0)";
+    case Source::Texture0:
+        return "texture(tex[0], TexCoord(o[3].xy, 0))";
+    case Source::Texture1:
+        return "texture(tex[1], TexCoord(o[3].zw, 1))";
+    case Source::Texture2:
+        // TODO: Unverified
+        return "texture(tex[2], TexCoord(o[5].zw, 2))";
+    case Source::PreviousBuffer:
+        return "combiner_buffer";
+    case Source::Constant:
+        return "tev_cfgs[" + std::to_string(stage_index) + "].const_color";
+    case Source::Previous:
+        return "last_tex_env_out";
+    default:
+        // TODO: no 4th texture?
+        return "vec4(0.0)";
+    }
+}
+
+/// Returns the GLSL expression of a TEV color modifier applied to a source
+static std::string GetColorModifier(TevStageConfig::ColorModifier factor, const std::string& source) {
+    using ColorModifier = TevStageConfig::ColorModifier;
+    switch (factor) {
+    case ColorModifier::SourceColor:
+        return source + ".rgb";
+    case ColorModifier::OneMinusSourceColor:
+        return "(vec3(1.0) - " + source + ".rgb)";
+    case ColorModifier::SourceAlpha:
+        return source + ".aaa";
+    case ColorModifier::OneMinusSourceAlpha:
+        return "(vec3(1.0) - " + source + ".aaa)";
+    case ColorModifier::SourceRed:
+        return source + ".rrr";
+    case ColorModifier::OneMinusSourceRed:
+        return "(vec3(1.0) - " + source + ".rrr)";
+    case ColorModifier::SourceGreen:
+        return source + ".ggg";
+    case ColorModifier::OneMinusSourceGreen:
+        return "(vec3(1.0) - " + source + ".ggg)";
+    case ColorModifier::SourceBlue:
+        return source + ".bbb";
+    case ColorModifier::OneMinusSourceBlue:
+        return "(vec3(1.0) - " + source + ".bbb)";
+    default:
+        return "vec3(0.0)";
+    }
+}
+
+/// Returns the GLSL expression of a TEV alpha modifier applied to a source
+static std::string GetAlphaModifier(TevStageConfig::AlphaModifier factor, const std::string& source) {
+    using AlphaModifier = TevStageConfig::AlphaModifier;
+    switch (factor) {
+    case AlphaModifier::SourceAlpha:
+        return source + ".a";
+    case AlphaModifier::OneMinusSourceAlpha:
+        return "(1.0 - " + source + ".a)";
+    case AlphaModifier::SourceRed:
+        return source + ".r";
+    case AlphaModifier::OneMinusSourceRed:
+        return "(1.0 - " + source + ".r)";
+    case AlphaModifier::SourceGreen:
+        return source + ".g";
+    case AlphaModifier::OneMinusSourceGreen:
+        return "(1.0 - " + source + ".g)";
+    case AlphaModifier::SourceBlue:
+        return source + ".b";
+    case AlphaModifier::OneMinusSourceBlue:
+        return "(1.0 - " + source + ".b)";
+    default:
+        return "0.0";
+    }
+}
+
+/**
+ * Returns the GLSL expression combining three operands with a TEV operation
+ * @param op TEV combiner operation
+ * @param operands GLSL variable names of the three operands
+ * @param one GLSL constant one of the operand type, "vec3(1.0)" or "1.0"
+ * @param zero GLSL constant zero of the operand type, "vec3(0.0)" or "0.0"
+ */
+static std::string Combine(TevStageConfig::Operation op, const std::string operands[3],
+                           const std::string& one, const std::string& zero) {
+    using Operation = TevStageConfig::Operation;
+    const std::string& a = operands[0];
+    const std::string& b = operands[1];
+    const std::string& c = operands[2];
+    switch (op) {
+    case Operation::Replace:
+        return a;
+    case Operation::Modulate:
+        return a + " * " + b;
+    case Operation::Add:
+        return "min(" + a + " + " + b + ", 1.0)";
+    case Operation::AddSigned:
+        return "clamp(" + a + " + " + b + " - 0.5, 0.0, 1.0)";
+    case Operation::Lerp:
+        return a + " * " + c + " + " + b + " * (" + one + " - " + c + ")";
+    case Operation::Subtract:
+        return "max(" + a + " - " + b + ", 0.0)";
+    case Operation::MultiplyThenAdd:
+        return "min(" + a + " * " + b + " + " + c + ", 1.0)";
+    case Operation::AddThenMultiply:
+        return "min(" + a + " + " + b + ", 1.0) * " + c;
+    default:
+        return zero;
+    }
+}
+
+/// Writes the GLSL statements evaluating one TEV stage into last_tex_env_out
+static void WriteTevStage(std::string& out, const TevStageConfig& stage, unsigned stage_index) {
+    const std::string index_str = std::to_string(stage_index);
+
+    const TevStageConfig::Source color_sources[3] = { stage.color_source1, stage.color_source2, stage.color_source3 };
+    const TevStageConfig::ColorModifier color_modifiers[3] = { stage.color_modifier1, stage.color_modifier2, stage.color_modifier3 };
+    const TevStageConfig::Source alpha_sources[3] = { stage.alpha_source1, stage.alpha_source2, stage.alpha_source3 };
+    const TevStageConfig::AlphaModifier alpha_modifiers[3] = { stage.alpha_modifier1, stage.alpha_modifier2, stage.alpha_modifier3 };
+
+    std::string color_operands[3];
+    std::string alpha_operands[3];
+    for (unsigned i = 0; i < 3; ++i) {
+        color_operands[i] = "color_results_" + index_str + "_" + std::to_string(i);
+        alpha_operands[i] = "alpha_results_" + index_str + "_" + std::to_string(i);
+
+        out += "    vec3 " + color_operands[i] + " = " +
+               GetColorModifier(color_modifiers[i], GetSource(color_sources[i], stage_index)) + ";\n";
+        out += "    float " + alpha_operands[i] + " = " +
+               GetAlphaModifier(alpha_modifiers[i], GetSource(alpha_sources[i], stage_index)) + ";\n";
+    }
+
+    out += "    last_tex_env_out = vec4(min((" + Combine(stage.color_op, color_operands, "vec3(1.0)", "vec3(0.0)") +
+           ") * " + std::to_string(stage.GetColorMultiplier()) + ".0, 1.0), min((" +
+           Combine(stage.alpha_op, alpha_operands, "1.0", "0.0") +
+           ") * " + std::to_string(stage.GetAlphaMultiplier()) + ".0, 1.0));\n";
+}
+
+/// Returns the GLSL condition under which the alpha test discards a fragment, empty if it never does
+static std::string GetAlphaTestDiscardCondition(Regs::CompareFunc func) {
+    using CompareFunc = Regs::CompareFunc;
+    switch (func) {
+    case CompareFunc::Never:
+        return "true";
+    case CompareFunc::Equal:
+        return "last_tex_env_out.a != alphatest_ref";
+    case CompareFunc::NotEqual:
+        return "last_tex_env_out.a == alphatest_ref";
+    case CompareFunc::LessThan:
+        return "last_tex_env_out.a >= alphatest_ref";
+    case CompareFunc::LessThanOrEqual:
+        return "last_tex_env_out.a > alphatest_ref";
+    case CompareFunc::GreaterThan:
+        return "last_tex_env_out.a <= alphatest_ref";
+    case CompareFunc::GreaterThanOrEqual:
+        return "last_tex_env_out.a < alphatest_ref";
+    default:
+        return "";
+    }
+}
+
+std::string GenerateFragmentShader(const PicaShaderConfig& config) {
+    // The declarations must match the uber shader in gl_shaders.h, both share the vertex shader
+    // and the contents of the uniform buffer
+    std::string out = R"(
+#version 150 core
+
+#define NUM_VTX_ATTR 7
+#define NUM_TEV_STAGES 6
+
+in vec4 o[NUM_VTX_ATTR];
+out vec4 color;
+
+uniform sampler2D tex[3];
+
+struct TEVConfig
+{
+    bool enabled;
+    ivec3 color_sources;
+    ivec3 alpha_sources;
+    ivec3 color_modifiers;
+    ivec3 alpha_modifiers;
+    ivec2 color_alpha_op;
+    ivec2 color_alpha_multiplier;
+    vec4 const_color;
+    bvec2 updates_combiner_buffer_color_alpha;
+};
+
+layout (std140) uniform shader_data {
+    TEVConfig tev_cfgs[NUM_TEV_STAGES];
+    vec4 tev_combiner_buffer_color;
+    bool alphatest_enabled;
+    int alphatest_func;
+    float alphatest_ref;
+    int flipped_textures;
+};
+
+// Textures stored upside down, see RasterizerCacheOpenGL::LoadAndBindTexture
+vec2 TexCoord(vec2 coord, int unit) {
+    return ((flipped_textures >> unit) & 1) != 0 ? vec2(coord.x, 1.0 - coord.y) : coord;
+}
+
+void main(void) {
+    vec4 combiner_buffer = tev_combiner_buffer_color;
+    vec4 last_tex_env_out = vec4(0.0);
+
+)";
+
+    for (unsigned stage_index = 0; stage_index < config.tev_stages.size(); ++stage_index) {
+        const TevStageConfig stage = config.GetTevStage(stage_index);
+
+        if (!IsPassThroughTevStage(stage))
+            WriteTevStage(out, stage, stage_index);
+
+        if (config.TevStageUpdatesCombinerBufferColor(stage_index))
+            out += "    combiner_buffer.rgb = last_tex_env_out.rgb;\n";
+
+        if (config.TevStageUpdatesCombinerBufferAlpha(stage_index))
+            out += "    combiner_buffer.a = last_tex_env_out.a;\n";
+    }
+
+    const std::string discard_condition = GetAlphaTestDiscardCondition(config.alpha_test_func);
+    if (!discard_condition.empty())
+        out += "\n    if (" + discard_condition + ") {\n        discard;\n    }\n";
+
+    out += "\n    color = last_tex_env_out;\n}\n";
+
+    return out;
+}
+
+} // namespace
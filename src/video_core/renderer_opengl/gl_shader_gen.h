@@ -0,0 +1,113 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <functional>
+#include <string>
+
+#include "common/hash.h"
+
+#include "video_core/derived_state.h"
+#include "video_core/pica.h"
+
+/**
+ * The PICA state a generated fragment shader is specialized for. Uniform values such as the TEV
+ * constant colors are not part of it, so that their changes do not require a new program.
+ */
+struct PicaShaderConfig {
+    /// Raw register values of the TEV stage state that is compiled into the shader
+    struct TevStage {
+        u32 sources_raw;
+        u32 modifiers_raw;
+        u32 ops_raw;
+        u32 scales_raw;
+    };
+
+    /// Construct the configuration from the current PICA register state
+    static PicaShaderConfig CurrentConfig() {
+        const auto& regs = Pica::g_state.regs;
+
+        // Zero the whole structure, padding included, since it is compared and hashed bytewise
+        PicaShaderConfig res;
+        std::memset(&res, 0, sizeof(PicaShaderConfig));
+
+        res.alpha_test_func = regs.output_merger.alpha_test.enable ?
+                              regs.output_merger.alpha_test.func.Value() : Pica::Regs::CompareFunc::Always;
+
+        const auto& tev_stages = Pica::DerivedState::GetTevStages();
+        for (unsigned stage_index = 0; stage_index < tev_stages.size(); ++stage_index) {
+            res.tev_stages[stage_index].sources_raw = tev_stages[stage_index].sources_raw;
+            res.tev_stages[stage_index].modifiers_raw = tev_stages[stage_index].modifiers_raw;
+            res.tev_stages[stage_index].ops_raw = tev_stages[stage_index].ops_raw;
+            res.tev_stages[stage_index].scales_raw = tev_stages[stage_index].scales_raw;
+        }
+
+        res.combiner_buffer_update_rgb = regs.tev_combiner_buffer_input.update_mask_rgb;
+        res.combiner_buffer_update_a = regs.tev_combiner_buffer_input.update_mask_a;
+
+        return res;
+    }
+
+    /// Returns the TEV stage configuration register values the shader was specialized for
+    Pica::Regs::TevStageConfig GetTevStage(unsigned stage_index) const {
+        Pica::Regs::TevStageConfig stage;
+        std::memset(&stage, 0, sizeof(stage));
+        stage.sources_raw = tev_stages[stage_index].sources_raw;
+        stage.modifiers_raw = tev_stages[stage_index].modifiers_raw;
+        stage.ops_raw = tev_stages[stage_index].ops_raw;
+        stage.scales_raw = tev_stages[stage_index].scales_raw;
+        return stage;
+    }
+
+    bool TevStageUpdatesCombinerBufferColor(unsigned stage_index) const {
+        return (stage_index < 4) && (combiner_buffer_update_rgb & (1 << stage_index));
+    }
+
+    bool TevStageUpdatesCombinerBufferAlpha(unsigned stage_index) const {
+        return (stage_index < 4) && (combiner_buffer_update_a & (1 << stage_index));
+    }
+
+    bool operator==(const PicaShaderConfig& o) const {
+        return std::memcmp(this, &o, sizeof(PicaShaderConfig)) == 0;
+    }
+
+    /// Comparison function of the alpha test, Always if the alpha test is disabled
+    Pica::Regs::CompareFunc alpha_test_func;
+    std::array<TevStage, 6> tev_stages;
+    u8 combiner_buffer_update_rgb;
+    u8 combiner_buffer_update_a;
+};
+
+namespace std {
+
+template <>
+struct hash<PicaShaderConfig> {
+    size_t operator()(const PicaShaderConfig& k) const {
+        return (size_t)Common::ComputeHash64(&k, sizeof(PicaShaderConfig));
+    }
+};
+
+} // namespace
+
+namespace GLShader {
+
+/**
+ * Checks whether a TEV stage simply passes the result of the previous stage through
+ * @param stage TEV stage configuration
+ * @return True if the stage can be skipped
+ */
+bool IsPassThroughTevStage(const Pica::Regs::TevStageConfig& stage);
+
+/**
+ * Generates the GLSL source of a hardware fragment shader specialized for the given configuration.
+ * It reads the same shader_data uniform block as the uber shader in gl_shaders.h.
+ * @param config PICA state to specialize the shader for
+ * @return GLSL source of the fragment shader
+ */
+std::string GenerateFragmentShader(const PicaShaderConfig& config);
+
+} // namespace
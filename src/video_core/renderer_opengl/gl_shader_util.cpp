@@ -11,61 +11,72 @@
 namespace ShaderUtil {
 
 GLuint LoadShaders(const char* vertex_shader, const char* fragment_shader) {
+    GLuint program_id = CompileShaders(vertex_shader, fragment_shader);
+
+    // Link the program
+    LOG_DEBUG(Render_OpenGL, "Linking program...");
+    glLinkProgram(program_id);
+
+    CheckProgram(program_id);
+    return program_id;
+}
+
+GLuint CompileShaders(const char* vertex_shader, const char* fragment_shader) {
 
     // Create the shaders
     GLuint vertex_shader_id = glCreateShader(GL_VERTEX_SHADER);
     GLuint fragment_shader_id = glCreateShader(GL_FRAGMENT_SHADER);
 
-    GLint result = GL_FALSE;
-    int info_log_length;
-
     // Compile Vertex Shader
     LOG_DEBUG(Render_OpenGL, "Compiling vertex shader...");
 
     glShaderSource(vertex_shader_id, 1, &vertex_shader, nullptr);
     glCompileShader(vertex_shader_id);
 
-    // Check Vertex Shader
-    glGetShaderiv(vertex_shader_id, GL_COMPILE_STATUS, &result);
-    glGetShaderiv(vertex_shader_id, GL_INFO_LOG_LENGTH, &info_log_length);
-
-    if (info_log_length > 1) {
-        std::vector<char> vertex_shader_error(info_log_length);
-        glGetShaderInfoLog(vertex_shader_id, info_log_length, nullptr, &vertex_shader_error[0]);
-        if (result) {
-            LOG_DEBUG(Render_OpenGL, "%s", &vertex_shader_error[0]);
-        } else {
-            LOG_ERROR(Render_OpenGL, "Error compiling vertex shader:\n%s", &vertex_shader_error[0]);
-        }
-    }
-
     // Compile Fragment Shader
     LOG_DEBUG(Render_OpenGL, "Compiling fragment shader...");
 
     glShaderSource(fragment_shader_id, 1, &fragment_shader, nullptr);
     glCompileShader(fragment_shader_id);
 
-    // Check Fragment Shader
-    glGetShaderiv(fragment_shader_id, GL_COMPILE_STATUS, &result);
-    glGetShaderiv(fragment_shader_id, GL_INFO_LOG_LENGTH, &info_log_length);
+    GLuint program_id = glCreateProgram();
+    glAttachShader(program_id, vertex_shader_id);
+    glAttachShader(program_id, fragment_shader_id);
+
+    return program_id;
+}
+
+/// Logs the compile messages of a shader
+static void CheckShader(GLuint shader_id) {
+    GLint result = GL_FALSE;
+    int info_log_length;
+    GLint type;
+
+    glGetShaderiv(shader_id, GL_COMPILE_STATUS, &result);
+    glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &info_log_length);
+    glGetShaderiv(shader_id, GL_SHADER_TYPE, &type);
+    const char* name = type == GL_VERTEX_SHADER ? "vertex" : "fragment";
 
     if (info_log_length > 1) {
-        std::vector<char> fragment_shader_error(info_log_length);
-        glGetShaderInfoLog(fragment_shader_id, info_log_length, nullptr, &fragment_shader_error[0]);
+        std::vector<char> shader_error(info_log_length);
+        glGetShaderInfoLog(shader_id, info_log_length, nullptr, &shader_error[0]);
         if (result) {
-            LOG_DEBUG(Render_OpenGL, "%s", &fragment_shader_error[0]);
+            LOG_DEBUG(Render_OpenGL, "%s", &shader_error[0]);
         } else {
-            LOG_ERROR(Render_OpenGL, "Error compiling fragment shader:\n%s", &fragment_shader_error[0]);
+            LOG_ERROR(Render_OpenGL, "Error compiling %s shader:\n%s", name, &shader_error[0]);
         }
     }
+}
 
-    // Link the program
-    LOG_DEBUG(Render_OpenGL, "Linking program...");
+bool CheckProgram(GLuint program_id) {
+    GLuint shader_ids[2];
+    GLsizei num_shaders = 0;
+    glGetAttachedShaders(program_id, 2, &num_shaders, shader_ids);
+    for (GLsizei i = 0; i < num_shaders; ++i)
+        CheckShader(shader_ids[i]);
 
-    GLuint program_id = glCreateProgram();
-    glAttachShader(program_id, vertex_shader_id);
-    glAttachShader(program_id, fragment_shader_id);
-    glLinkProgram(program_id);
+    GLint result = GL_FALSE;
+    int info_log_length;
 
     // Check the program
     glGetProgramiv(program_id, GL_LINK_STATUS, &result);
@@ -81,10 +92,11 @@ GLuint LoadShaders(const char* vertex_shader, const char* fragment_shader) {
         }
     }
 
-    glDeleteShader(vertex_shader_id);
-    glDeleteShader(fragment_shader_id);
+    // The shaders stay attached, so that the program can be linked again, and are deleted along with it
+    for (GLsizei i = 0; i < num_shaders; ++i)
+        glDeleteShader(shader_ids[i]);
 
-    return program_id;
+    return result == GL_TRUE;
 }
 
 }
@@ -10,4 +10,18 @@ namespace ShaderUtil {
 
 GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path);
 
+/**
+ * Starts compiling a program from the given shaders, without waiting for the driver. The caller
+ * links it with glLinkProgram once it has bound its attribute locations.
+ * @return Handle of the program, with the shaders attached
+ */
+GLuint CompileShaders(const char* vertex_shader, const char* fragment_shader);
+
+/**
+ * Logs the compile and link messages of a program set up with CompileShaders and releases its
+ * shaders. This waits for the driver if the program isn't done linking yet.
+ * @return Whether the program was linked successfully
+ */
+bool CheckProgram(GLuint program_id);
+
 }
@@ -121,14 +121,8 @@ const char g_fragment_shader_hw[] = R"(
 in vec4 o[NUM_VTX_ATTR];
 out vec4 color;
 
-uniform bool alphatest_enabled;
-uniform int alphatest_func;
-uniform float alphatest_ref;
-
 uniform sampler2D tex[3];
 
-uniform vec4 tev_combiner_buffer_color;
-
 struct TEVConfig
 {
     bool enabled;
@@ -142,7 +136,20 @@ struct TEVConfig
     bvec2 updates_combiner_buffer_color_alpha;
 };
 
-uniform TEVConfig tev_cfgs[NUM_TEV_STAGES];
+// Must match the layout of RasterizerOpenGL::UniformData
+layout (std140) uniform shader_data {
+    TEVConfig tev_cfgs[NUM_TEV_STAGES];
+    vec4 tev_combiner_buffer_color;
+    bool alphatest_enabled;
+    int alphatest_func;
+    float alphatest_ref;
+    int flipped_textures;
+};
+
+// Textures stored upside down, see RasterizerCacheOpenGL::LoadAndBindTexture
+vec2 TexCoord(vec2 coord, int unit) {
+    return ((flipped_textures >> unit) & 1) != 0 ? vec2(coord.x, 1.0 - coord.y) : coord;
+}
 
 vec4 g_combiner_buffer;
 vec4 g_last_tex_env_out;
@@ -158,12 +165,12 @@ vec4 GetSource(int source) {
         // HACK: Until we implement fragment lighting, use zero
         return vec4(0.0, 0.0, 0.0, 0.0);
     } else if (source == SOURCE_TEXTURE0) {
-        return texture(tex[0], o[3].xy);
+        return texture(tex[0], TexCoord(o[3].xy, 0));
     } else if (source == SOURCE_TEXTURE1) {
-        return texture(tex[1], o[3].zw);
+        return texture(tex[1], TexCoord(o[3].zw, 1));
     } else if (source == SOURCE_TEXTURE2) {
         // TODO: Unverified
-        return texture(tex[2], o[5].zw);
+        return texture(tex[2], TexCoord(o[5].zw, 2));
     } else if (source == SOURCE_TEXTURE3) {
         // TODO: no 4th texture?
     } else if (source == SOURCE_PREVIOUSBUFFER) {
@@ -334,4 +341,247 @@ void main(void) {
 }
 )";
 
+// Covers the whole viewport with a single triangle, without any vertex attributes
+const char g_vertex_shader_fullscreen[] = R"(
+#version 150 core
+
+void main() {
+    gl_Position = vec4(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0, 0.0, 1.0);
+}
+)";
+
+// Loads a PICA color framebuffer from its Morton-tiled bytes in 3DS memory. The format values
+// match Pica::Regs::ColorFormat, and the results match the CPU upload with the gl_format and
+// gl_type chosen in RasterizerOpenGL::ReconfigureColorTexture.
+const char g_fragment_shader_detile_color[] = R"(
+#version 150 core
+
+#define FORMAT_RGBA8  0
+#define FORMAT_RGB8   1
+#define FORMAT_RGB5A1 2
+#define FORMAT_RGB565 3
+#define FORMAT_RGBA4  4
+
+uniform usamplerBuffer tiled_data;
+uniform int format;
+uniform int width;
+
+out vec4 color;
+
+// Byte offset of the current pixel in the tiled data, see VideoCore::GetMortonOffset
+int GetTiledOffset(int bytes_per_pixel) {
+    ivec2 pos = ivec2(gl_FragCoord.xy);
+    int morton = (pos.x & 1) | ((pos.y & 1) << 1) | ((pos.x & 2) << 1) |
+                 ((pos.y & 2) << 2) | ((pos.x & 4) << 2) | ((pos.y & 4) << 3);
+    return (morton + (pos.x & ~7) * 8 + (pos.y & ~7) * width) * bytes_per_pixel;
+}
+
+uint GetByte(int offset) {
+    return texelFetch(tiled_data, offset).r;
+}
+
+void main() {
+    if (format == FORMAT_RGBA8) {
+        int offset = GetTiledOffset(4);
+        color = vec4(GetByte(offset + 3), GetByte(offset + 2), GetByte(offset + 1), GetByte(offset)) / 255.0;
+    } else if (format == FORMAT_RGB8) {
+        int offset = GetTiledOffset(3);
+        color = vec4(vec3(GetByte(offset + 2), GetByte(offset + 1), GetByte(offset)) / 255.0, 1.0);
+    } else {
+        int offset = GetTiledOffset(2);
+        uint value = GetByte(offset) | (GetByte(offset + 1) << 8);
+
+        if (format == FORMAT_RGB5A1) {
+            color = vec4(vec3((value >> 11) & 31u, (value >> 6) & 31u, (value >> 1) & 31u) / 31.0, value & 1u);
+        } else if (format == FORMAT_RGB565) {
+            color = vec4(((value >> 11) & 31u) / 31.0, ((value >> 5) & 63u) / 63.0, (value & 31u) / 31.0, 1.0);
+        } else if (format == FORMAT_RGBA4) {
+            color = vec4((value >> 12) & 15u, (value >> 8) & 15u, (value >> 4) & 15u, value & 15u) / 15.0;
+        } else {
+            color = vec4(0.0);
+        }
+    }
+}
+)";
+
+// Loads a PICA D16 depth framebuffer from its Morton-tiled bytes in 3DS memory
+const char g_fragment_shader_detile_depth[] = R"(
+#version 150 core
+
+uniform usamplerBuffer tiled_data;
+uniform int width;
+
+// Byte offset of the current pixel in the tiled data, see VideoCore::GetMortonOffset
+int GetTiledOffset(int bytes_per_pixel) {
+    ivec2 pos = ivec2(gl_FragCoord.xy);
+    int morton = (pos.x & 1) | ((pos.y & 1) << 1) | ((pos.x & 2) << 1) |
+                 ((pos.y & 2) << 2) | ((pos.x & 4) << 2) | ((pos.y & 4) << 3);
+    return (morton + (pos.x & ~7) * 8 + (pos.y & ~7) * width) * bytes_per_pixel;
+}
+
+uint GetByte(int offset) {
+    return texelFetch(tiled_data, offset).r;
+}
+
+void main() {
+    int offset = GetTiledOffset(2);
+    gl_FragDepth = float(GetByte(offset) | (GetByte(offset + 1) << 8)) / 65535.0;
+}
+)";
+
+
+// Decodes a PICA texture from its tiled bytes in 3DS memory into an RGBA8 texture. The format values
+// match Pica::Regs::TextureFormat, and the results match Pica::DebugUtils::DecodeTexture followed by
+// the bottom-to-top upload of RasterizerCacheOpenGL::UploadTexture.
+const char g_fragment_shader_decode_texture[] = R"(
+#version 150 core
+
+#define FORMAT_RGBA8  0
+#define FORMAT_RGB8   1
+#define FORMAT_RGB5A1 2
+#define FORMAT_RGB565 3
+#define FORMAT_RGBA4  4
+#define FORMAT_IA8    5
+#define FORMAT_I8     7
+#define FORMAT_A8     8
+#define FORMAT_IA4    9
+#define FORMAT_I4     10
+#define FORMAT_A4     11
+#define FORMAT_ETC1   12
+#define FORMAT_ETC1A4 13
+
+uniform usamplerBuffer tiled_data;
+uniform int format;
+uniform int width;
+uniform int height;
+
+out vec4 color;
+
+const int etc1_modifier_table[16] = int[](2, 8, 5, 17, 9, 29, 13, 42, 18, 60, 24, 80, 33, 106, 47, 183);
+
+uint GetByte(int offset) {
+    return texelFetch(tiled_data, offset).r;
+}
+
+uint GetWord(int offset) {
+    return GetByte(offset) | (GetByte(offset + 1) << 8) | (GetByte(offset + 2) << 16) | (GetByte(offset + 3) << 24);
+}
+
+uint Convert4To8(uint value) {
+    return (value << 4) | value;
+}
+
+uint Convert5To8(uint value) {
+    return ((value << 3) | (value >> 2)) & 255u;
+}
+
+uint Convert6To8(uint value) {
+    return (value << 2) | (value >> 4);
+}
+
+// Decodes the texel at (x, y), with y counted from the top of the texture like in 3DS memory
+uvec4 DecodeETC1(ivec2 pos, bool has_alpha) {
+    // Each 8x8 tile is made of four 4x4 blocks in Morton order, the alpha of a block precedes it
+    int block_size = has_alpha ? 16 : 8;
+    int tile_index = (pos.x >> 3) + (pos.y >> 3) * (width >> 3);
+    int block_index = ((pos.x >> 2) & 1) | (((pos.y >> 2) & 1) << 1);
+    int offset = (tile_index * 4 + block_index) * block_size;
+
+    int x = pos.x & 3;
+    int y = pos.y & 3;
+    int texel = x * 4 + y;
+
+    uint alpha = 255u;
+    if (has_alpha) {
+        uint alpha_word = GetWord(offset + (texel >= 8 ? 4 : 0));
+        alpha = Convert4To8((alpha_word >> (4 * (texel & 7))) & 15u);
+        offset += 8;
+    }
+
+    uint low = GetWord(offset);
+    uint high = GetWord(offset + 4);
+
+    bool flip = (high & 1u) != 0u;
+    bool differential = (high & 2u) != 0u;
+    int subblock = ((flip ? y : x) >= 2) ? 1 : 0;
+
+    ivec3 base;
+    if (differential) {
+        ivec3 value = ivec3((high >> 27) & 31u, (high >> 19) & 31u, (high >> 11) & 31u);
+        if (subblock == 1) {
+            // Sign-extended 3-bit deltas
+            ivec3 delta = ivec3((high >> 24) & 7u, (high >> 16) & 7u, (high >> 8) & 7u);
+            value += delta - ((delta & 4) << 1);
+        }
+        base = ivec3(Convert5To8(uint(value.r) & 255u), Convert5To8(uint(value.g) & 255u),
+                     Convert5To8(uint(value.b) & 255u));
+    } else {
+        int shift = subblock == 0 ? 4 : 0;
+        base = ivec3(Convert4To8((high >> (24 + shift)) & 15u), Convert4To8((high >> (16 + shift)) & 15u),
+                     Convert4To8((high >> (8 + shift)) & 15u));
+    }
+
+    int table_index = int(subblock == 0 ? (high >> 5) & 7u : (high >> 2) & 7u);
+    int modifier = etc1_modifier_table[table_index * 2 + int((low >> texel) & 1u)];
+    if (((low >> (16 + texel)) & 1u) != 0u)
+        modifier = -modifier;
+
+    return uvec4(clamp(base + modifier, 0, 255), alpha);
+}
+
+uvec4 Decode(ivec2 pos) {
+    if (format == FORMAT_ETC1 || format == FORMAT_ETC1A4)
+        return DecodeETC1(pos, format == FORMAT_ETC1A4);
+
+    // Texels are stored in 8x8 tiles one after another, row by row, see VideoCore::GetMortonOffset
+    int morton = (pos.x & 1) | ((pos.y & 1) << 1) | ((pos.x & 2) << 1) |
+                 ((pos.y & 2) << 2) | ((pos.x & 4) << 2) | ((pos.y & 4) << 3);
+    int index = ((pos.x >> 3) + (pos.y >> 3) * (width >> 3)) * 64 + morton;
+
+    if (format == FORMAT_RGBA8) {
+        int offset = index * 4;
+        return uvec4(GetByte(offset + 3), GetByte(offset + 2), GetByte(offset + 1), GetByte(offset));
+    } else if (format == FORMAT_RGB8) {
+        int offset = index * 3;
+        return uvec4(GetByte(offset + 2), GetByte(offset + 1), GetByte(offset), 255u);
+    } else if (format == FORMAT_RGB5A1) {
+        uint value = GetByte(index * 2) | (GetByte(index * 2 + 1) << 8);
+        return uvec4(Convert5To8((value >> 11) & 31u), Convert5To8((value >> 6) & 31u),
+                     Convert5To8((value >> 1) & 31u), (value & 1u) * 255u);
+    } else if (format == FORMAT_RGB565) {
+        uint value = GetByte(index * 2) | (GetByte(index * 2 + 1) << 8);
+        return uvec4(Convert5To8((value >> 11) & 31u), Convert6To8((value >> 5) & 63u),
+                     Convert5To8(value & 31u), 255u);
+    } else if (format == FORMAT_RGBA4) {
+        uint value = GetByte(index * 2) | (GetByte(index * 2 + 1) << 8);
+        return uvec4(Convert4To8((value >> 12) & 15u), Convert4To8((value >> 8) & 15u),
+                     Convert4To8((value >> 4) & 15u), Convert4To8(value & 15u));
+    } else if (format == FORMAT_IA8) {
+        uint intensity = GetByte(index * 2 + 1);
+        return uvec4(uvec3(intensity), GetByte(index * 2));
+    } else if (format == FORMAT_I8) {
+        return uvec4(uvec3(GetByte(index)), 255u);
+    } else if (format == FORMAT_A8) {
+        return uvec4(0u, 0u, 0u, GetByte(index));
+    } else if (format == FORMAT_IA4) {
+        uint value = GetByte(index);
+        return uvec4(uvec3(Convert4To8(value >> 4)), Convert4To8(value & 15u));
+    } else {
+        // Even texels are in the low nibble
+        uint value = (GetByte(index >> 1) >> ((index & 1) * 4)) & 15u;
+        if (format == FORMAT_I4)
+            return uvec4(uvec3(Convert4To8(value)), 255u);
+        if (format == FORMAT_A4)
+            return uvec4(0u, 0u, 0u, Convert4To8(value));
+        return uvec4(0u);
+    }
+}
+
+void main() {
+    // The texture is uploaded from bottom to top
+    ivec2 pos = ivec2(gl_FragCoord.x, float(height) - gl_FragCoord.y);
+    color = vec4(Decode(pos)) / 255.0;
+}
+)";
+
 }
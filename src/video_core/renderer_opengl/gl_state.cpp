@@ -2,10 +2,15 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include "common/profiler.h"
+
 #include "video_core/renderer_opengl/gl_state.h"
 #include "video_core/pica.h"
 
 OpenGLState OpenGLState::cur_state;
+unsigned OpenGLState::active_texture_unit = 0;
+
+static Common::Profiling::SampleCategory profile_state_calls("GL calls per state apply", "State applies");
 
 OpenGLState::OpenGLState() {
     // These all match default OpenGL values
@@ -46,6 +51,9 @@ OpenGLState::OpenGLState() {
 }
 
 void OpenGLState::Apply() {
+    // Number of GL calls issued, for profiling the driver overhead of state changes
+    unsigned num_calls = 0;
+
     // Culling
     if (cull.enabled != cur_state.cull.enabled) {
         if (cull.enabled) {
@@ -53,10 +61,12 @@ void OpenGLState::Apply() {
         } else {
             glDisable(GL_CULL_FACE);
         }
+        ++num_calls;
     }
 
     if (cull.mode != cur_state.cull.mode) {
         glCullFace(cull.mode);
+        ++num_calls;
     }
 
     // Depth test
@@ -66,15 +76,18 @@ void OpenGLState::Apply() {
         } else {
             glDisable(GL_DEPTH_TEST);
         }
+        ++num_calls;
     }
 
     if (depth.test_func != cur_state.depth.test_func) {
         glDepthFunc(depth.test_func);
+        ++num_calls;
     }
 
     // Depth mask
     if (depth.write_mask != cur_state.depth.write_mask) {
         glDepthMask(depth.write_mask);
+        ++num_calls;
     }
 
     // Stencil test
@@ -84,17 +97,20 @@ void OpenGLState::Apply() {
         } else {
             glDisable(GL_STENCIL_TEST);
         }
+        ++num_calls;
     }
 
     if (stencil.test_func != cur_state.stencil.test_func ||
         stencil.test_ref != cur_state.stencil.test_ref ||
         stencil.test_mask != cur_state.stencil.test_mask) {
         glStencilFunc(stencil.test_func, stencil.test_ref, stencil.test_mask);
+        ++num_calls;
     }
 
     // Stencil mask
     if (stencil.write_mask != cur_state.stencil.write_mask) {
         glStencilMask(stencil.write_mask);
+        ++num_calls;
     }
 
     // Blending
@@ -105,9 +121,11 @@ void OpenGLState::Apply() {
             cur_state.logic_op = GL_COPY;
             glLogicOp(cur_state.logic_op);
             glDisable(GL_COLOR_LOGIC_OP);
+            num_calls += 3;
         } else {
             glDisable(GL_BLEND);
             glEnable(GL_COLOR_LOGIC_OP);
+            num_calls += 2;
         }
     }
 
@@ -116,6 +134,7 @@ void OpenGLState::Apply() {
         blend.color.blue != cur_state.blend.color.blue ||
         blend.color.alpha != cur_state.blend.color.alpha) {
         glBlendColor(blend.color.red, blend.color.green, blend.color.blue, blend.color.alpha);
+        ++num_calls;
     }
 
     if (blend.src_rgb_func != cur_state.blend.src_rgb_func ||
@@ -123,49 +142,80 @@ void OpenGLState::Apply() {
         blend.src_a_func != cur_state.blend.src_a_func ||
         blend.dst_a_func != cur_state.blend.dst_a_func) {
         glBlendFuncSeparate(blend.src_rgb_func, blend.dst_rgb_func, blend.src_a_func, blend.dst_a_func);
+        ++num_calls;
     }
 
     if (logic_op != cur_state.logic_op) {
         glLogicOp(logic_op);
+        ++num_calls;
     }
 
     // Textures
     for (unsigned texture_index = 0; texture_index < ARRAY_SIZE(texture_units); ++texture_index) {
-        if (texture_units[texture_index].enabled_2d != cur_state.texture_units[texture_index].enabled_2d) {
-            glActiveTexture(GL_TEXTURE0 + texture_index);
+        const bool enable_changed = texture_units[texture_index].enabled_2d != cur_state.texture_units[texture_index].enabled_2d;
+        const bool binding_changed = texture_units[texture_index].texture_2d != cur_state.texture_units[texture_index].texture_2d;
+        if (!enable_changed && !binding_changed)
+            continue;
+
+        if (active_texture_unit != texture_index) {
+            SetActiveTexture(texture_index);
+            ++num_calls;
+        }
 
+        if (enable_changed) {
             if (texture_units[texture_index].enabled_2d) {
                 glEnable(GL_TEXTURE_2D);
             } else {
                 glDisable(GL_TEXTURE_2D);
             }
+            ++num_calls;
         }
 
-        if (texture_units[texture_index].texture_2d != cur_state.texture_units[texture_index].texture_2d) {
-            glActiveTexture(GL_TEXTURE0 + texture_index);
+        if (binding_changed) {
             glBindTexture(GL_TEXTURE_2D, texture_units[texture_index].texture_2d);
+            ++num_calls;
         }
     }
 
     // Framebuffer
     if (draw.framebuffer != cur_state.draw.framebuffer) {
         glBindFramebuffer(GL_FRAMEBUFFER, draw.framebuffer);
+        ++num_calls;
     }
 
     // Vertex array
     if (draw.vertex_array != cur_state.draw.vertex_array) {
         glBindVertexArray(draw.vertex_array);
+        ++num_calls;
     }
 
     // Vertex buffer
     if (draw.vertex_buffer != cur_state.draw.vertex_buffer) {
         glBindBuffer(GL_ARRAY_BUFFER, draw.vertex_buffer);
+        ++num_calls;
     }
 
     // Shader program
     if (draw.shader_program != cur_state.draw.shader_program) {
         glUseProgram(draw.shader_program);
+        ++num_calls;
     }
 
     cur_state = *this;
+
+    profile_state_calls.AddSample(num_calls);
+}
+
+void OpenGLState::SetActiveTexture(unsigned unit) {
+    if (active_texture_unit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        active_texture_unit = unit;
+    }
+}
+
+void OpenGLState::ResetTexture(GLuint handle) {
+    for (auto& texture_unit : cur_state.texture_units) {
+        if (texture_unit.texture_2d == handle)
+            texture_unit.texture_2d = 0;
+    }
 }
@@ -67,6 +67,15 @@ public:
     /// Apply this state as the current OpenGL state
     void Apply();
 
+    /// Select the texture unit used by direct texture calls, skipping the GL call if it's already active
+    static void SetActiveTexture(unsigned unit);
+
+    /// Forgets the bindings of a texture that is being deleted, which unbinds it from its units
+    static void ResetTexture(GLuint handle);
+
 private:
     static OpenGLState cur_state;
+
+    /// Texture unit last selected by glActiveTexture
+    static unsigned active_texture_unit;
 };
@@ -0,0 +1,584 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <nihstro/shader_bytecode.h>
+
+#include "common/logging/log.h"
+
+#include "video_core/renderer_opengl/gl_vertex_shader_gen.h"
+
+using nihstro::OpCode;
+using nihstro::Instruction;
+using nihstro::RegisterType;
+using nihstro::SourceRegister;
+using nihstro::SwizzlePattern;
+
+using Pica::Regs;
+
+namespace GLShader {
+
+/// Most instructions translated into one shader, counting inlined subroutines and branches
+static const int MAX_TRANSLATED_INSTRUCTIONS = 2048;
+/// Deepest nesting of IF, CALL and LOOP bodies
+static const int MAX_NESTING_DEPTH = 8;
+
+/**
+ * Translates a PICA vertex shader program into the body of a GLSL function. The control flow is
+ * structured the same way the JIT compiles it: subroutines are inlined, IF and LOOP become their
+ * GLSL counterparts, and programs using jumps are rejected.
+ */
+class ShaderTranslator {
+public:
+    /// Translates the program starting at main_offset into the body of exec_shader
+    bool Translate(u32 main_offset) {
+        return TranslateRange(main_offset, NO_END, 0, 0);
+    }
+
+    std::string body;
+
+private:
+    static const u32 NO_END = 0xFFFFFFFF;
+
+    void AddLine(int nesting, const std::string& line) {
+        body.append(4 * (nesting + 1), ' ');
+        body += line;
+        body += '\n';
+    }
+
+    /**
+     * Translates instructions starting at begin until the program counter reaches end, the way the
+     * interpreter runs a call stack element.
+     * @param end Offset ending the range, or NO_END to translate until an END instruction
+     * @param nesting Number of IF, CALL and LOOP bodies that enclose this range
+     * @param loop_depth Number of LOOP bodies that enclose this range
+     */
+    bool TranslateRange(u32 begin, u32 end, int nesting, int loop_depth) {
+        if (nesting > MAX_NESTING_DEPTH)
+            return false;
+
+        u32 pc = begin;
+        while (pc != end) {
+            if (pc >= Pica::g_state.vs.program_code.size())
+                return false;
+            if (++num_translated_instructions > MAX_TRANSLATED_INSTRUCTIONS)
+                return false;
+
+            const Instruction& instr = *(const Instruction*)&Pica::g_state.vs.program_code[pc];
+            if (instr.opcode.Value() == OpCode::Id::END) {
+                AddLine(nesting, "return;");
+                if (end == NO_END)
+                    return true;
+                ++pc;
+                continue;
+            }
+
+            if (!TranslateInstruction(instr, pc, nesting, loop_depth))
+                return false;
+
+            // Jumping past the end of the range leaves it running forever in the interpreter
+            if (end != NO_END && pc > end)
+                return false;
+        }
+        return true;
+    }
+
+    /// Translates the instruction at pc and advances pc to the instruction executed after it
+    bool TranslateInstruction(const Instruction& instr, u32& pc, int nesting, int loop_depth) {
+        switch (instr.opcode.Value().GetInfo().type) {
+        case OpCode::Type::Arithmetic:
+            ++pc;
+            return TranslateArithmetic(instr, nesting);
+
+        case OpCode::Type::MultiplyAdd:
+            ++pc;
+            return TranslateMultiplyAdd(instr, nesting);
+
+        default:
+            return TranslateFlowControl(instr, pc, nesting, loop_depth);
+        }
+    }
+
+    /**
+     * Returns the GLSL expression of a swizzled and optionally negated source register.
+     * @param address_register Index of the address register added to the register index, 0 for none
+     * @return The expression, or an empty string if the source can't be translated
+     */
+    static std::string GetSource(const SourceRegister& source, int address_register,
+                                 const u8 (&selectors)[4], bool negate) {
+        const std::string index = std::to_string(source.GetIndex());
+
+        std::string value;
+        switch (source.GetRegisterType()) {
+        case RegisterType::Input:
+            if (address_register != 0)
+                return "";
+            value = "input_regs[" + index + "]";
+            break;
+
+        case RegisterType::Temporary:
+            if (address_register != 0)
+                return "";
+            value = "temp_regs[" + index + "]";
+            break;
+
+        case RegisterType::FloatUniform:
+            if (address_register == 0) {
+                value = "float_uniforms[" + index + "]";
+            } else {
+                static const char address_components[] = "xyz";
+                value = std::string("GetFloatUniform(") + index + " + address_regs." +
+                        address_components[address_register - 1] + ")";
+            }
+            break;
+
+        default:
+            if (address_register != 0)
+                return "";
+            value = "vec4(0.0)";
+            break;
+        }
+
+        static const char components[] = "xyzw";
+        if (selectors[0] != 0 || selectors[1] != 1 || selectors[2] != 2 || selectors[3] != 3) {
+            value += '.';
+            for (int i = 0; i < 4; ++i)
+                value += components[selectors[i]];
+        }
+
+        return negate ? "-" + value : value;
+    }
+
+    /// Returns the GLSL name of a destination register, or an empty string if writes to it are discarded
+    template <typename DestRegister>
+    static std::string GetDest(const DestRegister& dest) {
+        if (dest < 0x10)
+            return "output_regs[" + std::to_string(dest.GetIndex()) + "]";
+        if (dest < 0x20)
+            return "temp_regs[" + std::to_string(dest.GetIndex()) + "]";
+        return "";
+    }
+
+    static unsigned GetDestMask(const SwizzlePattern& swizzle) {
+        unsigned mask = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (swizzle.DestComponentEnabled(i))
+                mask |= 1 << i;
+        }
+        return mask;
+    }
+
+    /// Writes the enabled components of a vec4 expression to a destination register
+    void StoreDest(int nesting, const std::string& dest, unsigned mask, const std::string& value) {
+        if (dest.empty() || mask == 0)
+            return;
+
+        if (mask == 0xF) {
+            AddLine(nesting, dest + " = " + value + ";");
+            return;
+        }
+
+        static const char components[] = "xyzw";
+        std::string swizzle = ".";
+        for (int i = 0; i < 4; ++i) {
+            if (mask & (1 << i))
+                swizzle += components[i];
+        }
+        AddLine(nesting, dest + swizzle + " = (" + value + ")" + swizzle + ";");
+    }
+
+    bool TranslateArithmetic(const Instruction& instr, int nesting) {
+        const SwizzlePattern& swizzle = *(SwizzlePattern*)&Pica::g_state.vs.swizzle_data[instr.common.operand_desc_id];
+        const bool is_inverted = (0 != (instr.opcode.Value().GetInfo().subtype & OpCode::Info::SrcInversed));
+        const OpCode::Id opcode = instr.opcode.Value().EffectiveOpCode();
+
+        bool uses_src2;
+        switch (opcode) {
+        case OpCode::Id::ADD: case OpCode::Id::MUL: case OpCode::Id::MAX: case OpCode::Id::MIN:
+        case OpCode::Id::DP3: case OpCode::Id::DP4: case OpCode::Id::SLT: case OpCode::Id::SLTI:
+        case OpCode::Id::CMP:
+            uses_src2 = true;
+            break;
+
+        case OpCode::Id::FLR: case OpCode::Id::RCP: case OpCode::Id::RSQ: case OpCode::Id::MOVA:
+        case OpCode::Id::MOV:
+            uses_src2 = false;
+            break;
+
+        default:
+            LOG_DEBUG(Render_OpenGL, "Can't translate arithmetic instruction 0x%02x (%s)",
+                      (int)opcode, instr.opcode.Value().GetInfo().name);
+            return false;
+        }
+
+        // The address register offsets the non-inverted source, which is src1 normally
+        const int address_register = instr.common.address_register_index;
+        const u8 selectors1[4] = {
+            (u8)swizzle.GetSelectorSrc1(0), (u8)swizzle.GetSelectorSrc1(1),
+            (u8)swizzle.GetSelectorSrc1(2), (u8)swizzle.GetSelectorSrc1(3),
+        };
+        const u8 selectors2[4] = {
+            (u8)swizzle.GetSelectorSrc2(0), (u8)swizzle.GetSelectorSrc2(1),
+            (u8)swizzle.GetSelectorSrc2(2), (u8)swizzle.GetSelectorSrc2(3),
+        };
+
+        const std::string src1 = GetSource(instr.common.GetSrc1(is_inverted), is_inverted ? 0 : address_register,
+                                           selectors1, (bool)swizzle.negate_src1);
+        const std::string src2 = uses_src2 ? GetSource(instr.common.GetSrc2(is_inverted), is_inverted ? address_register : 0,
+                                                       selectors2, (bool)swizzle.negate_src2) : "";
+        if (src1.empty() || (uses_src2 && src2.empty()))
+            return false;
+
+        const std::string dest = GetDest(instr.common.dest.Value());
+        unsigned mask = GetDestMask(swizzle);
+
+        std::string value;
+        switch (opcode) {
+        case OpCode::Id::ADD:
+            value = src1 + " + " + src2;
+            break;
+
+        case OpCode::Id::MUL:
+            value = src1 + " * " + src2;
+            break;
+
+        case OpCode::Id::FLR:
+            value = "floor(" + src1 + ")";
+            break;
+
+        case OpCode::Id::MAX:
+            value = "max(" + src1 + ", " + src2 + ")";
+            break;
+
+        case OpCode::Id::MIN:
+            value = "min(" + src1 + ", " + src2 + ")";
+            break;
+
+        case OpCode::Id::DP3:
+            value = "vec4(dot((" + src1 + ").xyz, (" + src2 + ").xyz))";
+            mask &= 0x7;
+            break;
+
+        case OpCode::Id::DP4:
+            value = "vec4(dot(" + src1 + ", " + src2 + "))";
+            break;
+
+        case OpCode::Id::RCP:
+            value = "vec4(1.0) / " + src1;
+            break;
+
+        case OpCode::Id::RSQ:
+            value = "inversesqrt(" + src1 + ")";
+            break;
+
+        case OpCode::Id::MOVA:
+            // TODO: Figure out how the rounding is done on hardware
+            if (mask & 1)
+                AddLine(nesting, "address_regs.x = int((" + src1 + ").x);");
+            if (mask & 2)
+                AddLine(nesting, "address_regs.y = int((" + src1 + ").y);");
+            return true;
+
+        case OpCode::Id::MOV:
+            value = src1;
+            break;
+
+        case OpCode::Id::SLT:
+        case OpCode::Id::SLTI:
+            value = "vec4(lessThan(" + src1 + ", " + src2 + "))";
+            break;
+
+        case OpCode::Id::CMP:
+            return TranslateCompare(instr, src1, src2, nesting);
+
+        default:
+            return false;
+        }
+
+        StoreDest(nesting, dest, mask, value);
+        return true;
+    }
+
+    /// Compares the x and y components of two sources into the conditional codes
+    bool TranslateCompare(const Instruction& instr, const std::string& src1, const std::string& src2, int nesting) {
+        std::string results[2];
+        for (int i = 0; i < 2; ++i) {
+            auto compare_op = instr.common.compare_op;
+            auto op = (i == 0) ? compare_op.x.Value() : compare_op.y.Value();
+
+            const char* glsl_op;
+            switch (op) {
+            case compare_op.Equal:        glsl_op = " == "; break;
+            case compare_op.NotEqual:     glsl_op = " != "; break;
+            case compare_op.LessThan:     glsl_op = " < ";  break;
+            case compare_op.LessEqual:    glsl_op = " <= "; break;
+            case compare_op.GreaterThan:  glsl_op = " > ";  break;
+            case compare_op.GreaterEqual: glsl_op = " >= "; break;
+            default:
+                return false;
+            }
+
+            const char* component = (i == 0) ? ".x" : ".y";
+            results[i] = "cmp_src1" + std::string(component) + glsl_op + "cmp_src2" + component;
+        }
+
+        AddLine(nesting, "{");
+        AddLine(nesting + 1, "vec4 cmp_src1 = " + src1 + ";");
+        AddLine(nesting + 1, "vec4 cmp_src2 = " + src2 + ";");
+        AddLine(nesting + 1, "conditional_code = bvec2(" + results[0] + ", " + results[1] + ");");
+        AddLine(nesting, "}");
+        return true;
+    }
+
+    bool TranslateMultiplyAdd(const Instruction& instr, int nesting) {
+        const OpCode::Id opcode = instr.opcode.Value().EffectiveOpCode();
+        if (opcode != OpCode::Id::MAD && opcode != OpCode::Id::MADI) {
+            LOG_DEBUG(Render_OpenGL, "Can't translate multiply-add instruction 0x%02x (%s)",
+                      (int)opcode, instr.opcode.Value().GetInfo().name);
+            return false;
+        }
+
+        const SwizzlePattern& swizzle = *(SwizzlePattern*)&Pica::g_state.vs.swizzle_data[instr.mad.operand_desc_id];
+        const bool is_inverted = (opcode == OpCode::Id::MADI);
+
+        const u8 selectors1[4] = {
+            (u8)swizzle.GetSelectorSrc1(0), (u8)swizzle.GetSelectorSrc1(1),
+            (u8)swizzle.GetSelectorSrc1(2), (u8)swizzle.GetSelectorSrc1(3),
+        };
+        const u8 selectors2[4] = {
+            (u8)swizzle.GetSelectorSrc2(0), (u8)swizzle.GetSelectorSrc2(1),
+            (u8)swizzle.GetSelectorSrc2(2), (u8)swizzle.GetSelectorSrc2(3),
+        };
+        const u8 selectors3[4] = {
+            (u8)swizzle.GetSelectorSrc3(0), (u8)swizzle.GetSelectorSrc3(1),
+            (u8)swizzle.GetSelectorSrc3(2), (u8)swizzle.GetSelectorSrc3(3),
+        };
+
+        const std::string src1 = GetSource(instr.mad.GetSrc1(is_inverted), 0, selectors1, (bool)swizzle.negate_src1);
+        const std::string src2 = GetSource(instr.mad.GetSrc2(is_inverted), 0, selectors2, (bool)swizzle.negate_src2);
+        const std::string src3 = GetSource(instr.mad.GetSrc3(is_inverted), 0, selectors3, (bool)swizzle.negate_src3);
+        if (src1.empty() || src2.empty() || src3.empty())
+            return false;
+
+        StoreDest(nesting, GetDest(instr.mad.dest.Value()), GetDestMask(swizzle),
+                  src1 + " * " + src2 + " + " + src3);
+        return true;
+    }
+
+    /// Returns the GLSL condition of a flow control instruction depending on the conditional codes
+    static std::string GetCondition(const Instruction& instr) {
+        const Instruction::FlowControlType flow_control = instr.flow_control;
+        const std::string result_x = instr.flow_control.refx ? "conditional_code.x" : "!conditional_code.x";
+        const std::string result_y = instr.flow_control.refy ? "conditional_code.y" : "!conditional_code.y";
+
+        switch (flow_control.op) {
+        case flow_control.Or:
+            return result_x + " || " + result_y;
+
+        case flow_control.And:
+            return result_x + " && " + result_y;
+
+        case flow_control.JustX:
+            return result_x;
+
+        case flow_control.JustY:
+        default:
+            return result_y;
+        }
+    }
+
+    /// Returns the GLSL condition of a flow control instruction depending on a boolean uniform
+    static std::string GetBoolUniformCondition(const Instruction& instr) {
+        return "(bool_uniforms & " + std::to_string(1u << instr.flow_control.bool_uniform_id) + ") != 0";
+    }
+
+    /**
+     * Translates a call stack element of the interpreter: the range [offset, offset + num_instructions)
+     * runs and execution continues at return_offset.
+     */
+    bool TranslateCall(u32 offset, u32 num_instructions, u32 return_offset, u32& pc, int nesting, int loop_depth) {
+        if (!TranslateRange(offset, offset + num_instructions, nesting + 1, loop_depth))
+            return false;
+        pc = return_offset;
+        return true;
+    }
+
+    /// Translates a subroutine call that only happens if the given condition holds
+    bool TranslateConditionalCall(const Instruction& instr, const std::string& condition, u32& pc,
+                                  int nesting, int loop_depth) {
+        AddLine(nesting, "if (" + condition + ") {");
+        if (!TranslateCall(instr.flow_control.dest_offset, instr.flow_control.num_instructions,
+                           pc + 1, pc, nesting, loop_depth))
+            return false;
+        AddLine(nesting, "}");
+        return true;
+    }
+
+    /// Translates an IF, running one of two ranges depending on the given condition
+    bool TranslateIf(const Instruction& instr, const std::string& condition, u32& pc, int nesting, int loop_depth) {
+        const u32 dest = instr.flow_control.dest_offset;
+        const u32 num = instr.flow_control.num_instructions;
+        const u32 binary_offset = pc;
+
+        u32 then_pc, else_pc;
+        AddLine(nesting, "if (" + condition + ") {");
+        if (!TranslateCall(binary_offset + 1, dest - binary_offset - 1, dest + num, then_pc, nesting, loop_depth))
+            return false;
+        AddLine(nesting, "} else {");
+        if (!TranslateCall(dest, num, dest + num, else_pc, nesting, loop_depth))
+            return false;
+        AddLine(nesting, "}");
+
+        pc = then_pc;
+        return true;
+    }
+
+    bool TranslateFlowControl(const Instruction& instr, u32& pc, int nesting, int loop_depth) {
+        const u32 binary_offset = pc;
+
+        switch (instr.opcode.Value()) {
+        case OpCode::Id::NOP:
+            ++pc;
+            return true;
+
+        case OpCode::Id::CALL:
+            return TranslateCall(instr.flow_control.dest_offset, instr.flow_control.num_instructions,
+                                 binary_offset + 1, pc, nesting, loop_depth);
+
+        case OpCode::Id::CALLU:
+            return TranslateConditionalCall(instr, GetBoolUniformCondition(instr), pc, nesting, loop_depth);
+
+        case OpCode::Id::CALLC:
+            return TranslateConditionalCall(instr, GetCondition(instr), pc, nesting, loop_depth);
+
+        case OpCode::Id::IFU:
+            return TranslateIf(instr, GetBoolUniformCondition(instr), pc, nesting, loop_depth);
+
+        case OpCode::Id::IFC:
+            return TranslateIf(instr, GetCondition(instr), pc, nesting, loop_depth);
+
+        case OpCode::Id::LOOP:
+        {
+            const std::string int_uniform = "int_uniforms[" + std::to_string(instr.flow_control.int_uniform_id) + "]";
+            const std::string counter = "loop" + std::to_string(loop_depth);
+            const u32 dest = instr.flow_control.dest_offset;
+
+            // aL starts at y, the body repeats x + 1 times and z is added to aL after each iteration
+            AddLine(nesting, "address_regs.z = " + int_uniform + ".y;");
+            AddLine(nesting, "for (int " + counter + " = 0; " + counter + " <= " + int_uniform + ".x; ++" + counter + ") {");
+            if (!TranslateRange(binary_offset + 1, dest + 2, nesting + 1, loop_depth + 1))
+                return false;
+            AddLine(nesting + 1, "address_regs.z += " + int_uniform + ".z;");
+            AddLine(nesting, "}");
+
+            pc = dest + 1;
+            return true;
+        }
+
+        default:
+            // Jumps can leave the structure the rest of the program is translated in
+            LOG_DEBUG(Render_OpenGL, "Can't translate flow control instruction 0x%02x (%s)",
+                      (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name);
+            return false;
+        }
+    }
+
+    int num_translated_instructions = 0;
+};
+
+bool GenerateVertexShader(const PicaVSConfig& config, std::string& source) {
+    ShaderTranslator translator;
+    if (!translator.Translate(config.main_offset)) {
+        LOG_DEBUG(Render_OpenGL, "Vertex shader at offset 0x%x can't be translated to GLSL", config.main_offset);
+        return false;
+    }
+
+    // The outputs must match the inputs of the hardware fragment shaders in gl_shaders.h and
+    // gl_shader_gen.cpp
+    source = R"(
+#version 150 core
+
+#define NUM_VTX_ATTR 7
+
+out vec4 o[NUM_VTX_ATTR];
+
+layout (std140) uniform vs_uniforms {
+    vec4 float_uniforms[96];
+    ivec4 int_uniforms[4];
+    int bool_uniforms;
+};
+
+vec4 input_regs[16];
+vec4 temp_regs[16];
+vec4 output_regs[16];
+ivec3 address_regs;
+bvec2 conditional_code;
+
+// Relative accesses past the float uniforms read zero
+vec4 GetFloatUniform(int index) {
+    return (index >= 0 && index < 96) ? float_uniforms[index] : vec4(0.0);
+}
+
+)";
+
+    for (u32 i = 0; i < config.num_attributes; ++i)
+        source += "in vec4 vs_in_attr" + std::to_string(i) + ";\n";
+
+    source += "\nvoid exec_shader() {\n" + translator.body + "}\n";
+
+    source += R"(
+void main() {
+    for (int i = 0; i < 16; ++i) {
+        input_regs[i] = vec4(0.0);
+        temp_regs[i] = vec4(0.0);
+        output_regs[i] = vec4(0.0);
+    }
+    address_regs = ivec3(0);
+    conditional_code = bvec2(false);
+
+)";
+
+    for (u32 i = 0; i < config.num_attributes; ++i) {
+        const u32 reg = (config.input_register_map >> (4 * i)) & 0xF;
+        source += "    input_regs[" + std::to_string(reg) + "] = vs_in_attr" + std::to_string(i) + ";\n";
+    }
+
+    source += R"(
+    exec_shader();
+
+    vec4 position = vec4(0.0);
+    for (int i = 0; i < NUM_VTX_ATTR; ++i)
+        o[i] = vec4(0.0);
+)";
+
+    // Attributes which aren't output stay zero, the same as in the output vertices of the CPU
+    static const char components[] = "xyzw";
+    for (int i = 0; i < 7; ++i) {
+        Regs::VSOutputAttributes output_register_map;
+        std::memcpy(&output_register_map, &config.output_attributes[i], sizeof(u32));
+
+        const u32 semantics[4] = {
+            output_register_map.map_x, output_register_map.map_y,
+            output_register_map.map_z, output_register_map.map_w
+        };
+
+        for (int comp = 0; comp < 4; ++comp) {
+            const u32 semantic = semantics[comp];
+            if (semantic >= 4 * 7)
+                continue;
+
+            const std::string value = "output_regs[" + std::to_string(i) + "]." + components[comp];
+            if (semantic < 4) {
+                source += std::string("    position.") + components[semantic] + " = " + value + ";\n";
+            } else {
+                source += "    o[" + std::to_string(semantic / 4) + "]." + components[semantic % 4] +
+                          " = " + value + ";\n";
+            }
+        }
+    }
+
+    source += "\n    gl_Position = vec4(position.x, -position.y, -position.z, position.w);\n}\n";
+    return true;
+}
+
+} // namespace
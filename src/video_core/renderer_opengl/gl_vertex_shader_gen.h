@@ -0,0 +1,80 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <cstring>
+#include <functional>
+#include <string>
+
+#include "common/common_types.h"
+#include "common/hash.h"
+
+#include "video_core/pica.h"
+
+/**
+ * The PICA state a vertex shader translated to GLSL is specialized for. The program itself is only
+ * represented by a hash, it is read from the PICA state when the shader is generated.
+ */
+struct PicaVSConfig {
+    /**
+     * Construct the configuration from the current PICA register state
+     * @param program_hash Hash of the shader program code and swizzle patterns
+     */
+    static PicaVSConfig CurrentConfig(u64 program_hash) {
+        const auto& regs = Pica::g_state.regs;
+
+        // Zero the whole structure, padding included, since it is compared and hashed bytewise
+        PicaVSConfig res;
+        std::memset(&res, 0, sizeof(PicaVSConfig));
+
+        res.program_hash = program_hash;
+        res.main_offset = regs.vs_main_offset;
+        res.num_attributes = regs.vertex_attributes.GetNumTotalAttributes();
+        std::memcpy(&res.input_register_map, &regs.vs_input_register_map, sizeof(res.input_register_map));
+        std::memcpy(res.output_attributes, regs.vs_output_attributes, sizeof(res.output_attributes));
+
+        return res;
+    }
+
+    bool operator==(const PicaVSConfig& o) const {
+        return std::memcmp(this, &o, sizeof(PicaVSConfig)) == 0;
+    }
+
+    u64 program_hash;
+    u32 main_offset;
+    u32 num_attributes;
+    /// Raw value of the register mapping the input attributes to input registers
+    u64 input_register_map;
+    /// Raw values of the registers mapping the output registers to output vertex semantics
+    u32 output_attributes[7];
+};
+
+namespace std {
+
+template <>
+struct hash<PicaVSConfig> {
+    size_t operator()(const PicaVSConfig& k) const {
+        return (size_t)Common::ComputeHash64(&k, sizeof(PicaVSConfig));
+    }
+};
+
+} // namespace
+
+namespace GLShader {
+
+/// Binding point of the uniform block holding the PICA vertex shader uniforms
+const unsigned VS_UNIFORM_BLOCK_BINDING = 1;
+
+/**
+ * Generates the GLSL source of a vertex shader running the PICA vertex shader program, swizzle
+ * patterns and entry point that are currently set up. Input attribute i is read from the vertex
+ * attribute named "vs_in_attr<i>", the outputs are written in the layout the hardware fragment
+ * shaders expect and the uniforms are read from the "vs_uniforms" uniform block.
+ * @param source Receives the GLSL source
+ * @return False if the program uses instructions or control flow that can't be translated
+ */
+bool GenerateVertexShader(const PicaVSConfig& config, std::string& source);
+
+} // namespace
@@ -6,18 +6,29 @@
 #include "core/hw/hw.h"
 #include "core/hw/lcd.h"
 #include "core/memory.h"
+#include "core/memory_stats.h"
 #include "core/settings.h"
 
 #include "common/emu_window.h"
 #include "common/logging/log.h"
+#include "common/make_unique.h"
+#include "common/profiler.h"
 #include "common/profiler_reporting.h"
+#include "common/thread_policy.h"
 
+#include "video_core/gpu_thread.h"
 #include "video_core/video_core.h"
 #include "video_core/renderer_opengl/renderer_opengl.h"
 #include "video_core/renderer_opengl/gl_shader_util.h"
 #include "video_core/renderer_opengl/gl_shaders.h"
 
 #include <algorithm>
+#include <cstring>
+
+static Common::Profiling::TimingCategory gpu_screens_category("GPU Screen Drawing");
+
+/// Size of the buffer the LCD framebuffers are streamed into, room for a few uploads of both screens
+static const GLsizeiptr UPLOAD_BUFFER_SIZE = 4 * 1024 * 1024;
 
 /**
  * Vertex structure that the drawn screen rectangles are composed of.
@@ -56,19 +67,61 @@ RendererOpenGL::RendererOpenGL() {
     hw_rasterizer.reset(new RasterizerOpenGL());
     resolution_width  = std::max(VideoCore::kScreenTopWidth, VideoCore::kScreenBottomWidth);
     resolution_height = VideoCore::kScreenTopHeight + VideoCore::kScreenBottomHeight;
+
+    for (auto& frame : frames) {
+        for (auto& texture : frame.textures) {
+            texture.width = 0;
+            texture.height = 0;
+            texture.version = 0;
+        }
+        frame.overlay.width = PerfOverlay::WIDTH;
+        frame.overlay.height = PerfOverlay::HEIGHT;
+        frame.overlay.version = 0;
+        frame.show_overlay = false;
+        frame.render_fence = nullptr;
+        frame.present_fence = nullptr;
+    }
+    render_frame = 0;
+
+    // Nothing has been uploaded yet, so every texture is outdated
+    for (int i : {0, 1}) {
+        std::memset(&screen_sources[i], 0, sizeof(ScreenSource));
+        screen_versions[i] = 1;
+        queued_versions[i] = 0;
+    }
+    queued_overlay_version = 0;
+
+    ready_frame = -1;
+    presenting_frame = -1;
+    stop_presenting = false;
 }
 
 /// RendererOpenGL destructor
 RendererOpenGL::~RendererOpenGL() {
+    if (present_thread != nullptr) {
+        {
+            std::lock_guard<std::mutex> lock(present_mutex);
+            stop_presenting = true;
+        }
+        frame_ready.notify_one();
+        present_thread->join();
+    }
 }
 
 /// Swap buffers (render frame)
 void RendererOpenGL::SwapBuffers() {
+    // The draws of the frame that are still pending are made with the rasterizer's state
+    auto* gl_rasterizer = static_cast<RasterizerOpenGL*>(hw_rasterizer.get());
+    gl_rasterizer->EndFrame();
+
     // Maintain the rasterizer's state as a priority
     OpenGLState prev_state = OpenGLState::GetCurState();
     state.Apply();
 
-    for(int i : {0, 1}) {
+    // Find out which screens may show something new, from their configuration and the memory
+    // written since the last swap
+    u32 color_fill_raws[2];
+    for (int i : {0, 1}) {
         const auto& framebuffer = GPU::g_regs.framebuffer_config[i];
 
         // Main LCD (0): 0x1ED02204, Sub LCD (1): 0x1ED02A04
@@ -76,31 +129,111 @@ void RendererOpenGL::SwapBuffers() {
         lcd_color_addr = HW::VADDR_LCD + 4 * lcd_color_addr;
         LCD::Regs::ColorFill color_fill = {0};
         LCD::Read(color_fill.raw, lcd_color_addr);
+        color_fill_raws[i] = color_fill.raw;
+
+        ScreenSource source;
+        source.address = framebuffer.active_fb == 0 ? framebuffer.address_left1 : framebuffer.address_left2;
+        source.width = framebuffer.width;
+        source.height = framebuffer.height;
+        source.stride = framebuffer.stride;
+        source.format = framebuffer.color_format;
+        source.color_fill = color_fill.is_enabled ? color_fill.raw : 0;
+
+        if (!(source == screen_sources[i]) ||
+            (!color_fill.is_enabled && gl_rasterizer->WasRangeWritten(source.address, source.stride * source.height))) {
+            screen_sources[i] = source;
+            ++screen_versions[i];
+        }
+    }
+    gl_rasterizer->ClearWrittenRanges();
 
-        if (color_fill.is_enabled) {
-            LoadColorToActiveGLTexture(color_fill.color_r, color_fill.color_g, color_fill.color_b, textures[i]);
+    // The overlay's image changes once a second at most, it is uploaded like a screen then
+    u64 overlay_version = 0;
+    if (Settings::values.show_perf_overlay) {
+        perf_overlay.AddFrame(RasterizerOpenGL::GetCounterIds());
+        overlay_version = perf_overlay.GetVersion();
+    }
 
-            // Resize the texture in case the framebuffer size has changed
-            textures[i].width = 1;
-            textures[i].height = 1;
-        } else {
-            if (textures[i].width != (GLsizei)framebuffer.width ||
-                textures[i].height != (GLsizei)framebuffer.height ||
-                textures[i].format != framebuffer.color_format) {
-                // Reallocate texture if the framebuffer size has changed.
-                // This is expected to not happen very often and hence should not be a
-                // performance problem.
-                ConfigureFramebufferTexture(textures[i], framebuffer);
+    // The presentation thread keeps showing the last frame as long as nothing changed
+    if (present_thread == nullptr || screen_versions != queued_versions ||
+            overlay_version != queued_overlay_version) {
+        Frame& frame = frames[render_frame];
+        auto& textures = frame.textures;
+
+        // The presentation thread may still be drawing the screens of the frame from its last time
+        if (frame.present_fence != nullptr) {
+            glWaitSync(frame.present_fence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(frame.present_fence);
+            frame.present_fence = nullptr;
+        }
+        if (frame.render_fence != nullptr) {
+            glDeleteSync(frame.render_fence);
+            frame.render_fence = nullptr;
+        }
+
+        for (int i : {0, 1}) {
+            // Textures already holding the current contents of their screen are left alone
+            if (textures[i].version == screen_versions[i])
+                continue;
+            textures[i].version = screen_versions[i];
+
+            const auto& framebuffer = GPU::g_regs.framebuffer_config[i];
+            LCD::Regs::ColorFill color_fill = {0};
+            color_fill.raw = color_fill_raws[i];
+
+            if (color_fill.is_enabled) {
+                LoadColorToActiveGLTexture(color_fill.color_r, color_fill.color_g, color_fill.color_b, textures[i]);
+
+                // Resize the texture in case the framebuffer size has changed
+                textures[i].width = 1;
+                textures[i].height = 1;
+            } else {
+                if (textures[i].width != (GLsizei)framebuffer.width ||
+                    textures[i].height != (GLsizei)framebuffer.height ||
+                    textures[i].format != framebuffer.color_format) {
+                    // Reallocate texture if the framebuffer size has changed.
+                    // This is expected to not happen very often and hence should not be a
+                    // performance problem.
+                    ConfigureFramebufferTexture(textures[i], framebuffer);
+                }
+
+                // Screens the GPU transferred to are copied on the GPU, rather than reading them back
+                // into 3DS memory and uploading them again
+                const PAddr framebuffer_addr = framebuffer.active_fb == 0 ? framebuffer.address_left1
+                                                                          : framebuffer.address_left2;
+                if (!gl_rasterizer->CopyDisplayOutput(framebuffer_addr, framebuffer.width, framebuffer.height,
+                                                      framebuffer.stride, (u32)framebuffer.color_format.Value(),
+                                                      textures[i].handle)) {
+                    LoadFBToActiveGLTexture(framebuffer, textures[i]);
+                }
+
+                // Resize the texture in case the framebuffer size has changed
+                textures[i].width = framebuffer.width;
+                textures[i].height = framebuffer.height;
             }
-            LoadFBToActiveGLTexture(framebuffer, textures[i]);
+        }
+
+        frame.show_overlay = overlay_version != 0;
+        if (frame.show_overlay && frame.overlay.version != overlay_version) {
+            frame.overlay.version = overlay_version;
 
-            // Resize the texture in case the framebuffer size has changed
-            textures[i].width = framebuffer.width;
-            textures[i].height = framebuffer.height;
+            state.texture_units[0].enabled_2d = true;
+            state.texture_units[0].texture_2d = frame.overlay.handle;
+            state.Apply();
+
+            OpenGLState::SetActiveTexture(0);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame.overlay.width, frame.overlay.height,
+                            GL_RGBA, GL_UNSIGNED_BYTE, perf_overlay.GetPixels());
         }
-    }
 
-    DrawScreens();
+        if (present_thread != nullptr) {
+            queued_versions = screen_versions;
+            queued_overlay_version = overlay_version;
+            QueueFrame();
+        } else {
+            DrawScreens(frame);
+        }
+    }
 
     auto& profiler = Common::Profiling::GetProfilingManager();
     profiler.FinishFrame();
@@ -109,9 +242,11 @@ void RendererOpenGL::SwapBuffers() {
         aggregator->AddFrame(profiler.GetPreviousFrameResults());
     }
 
-    // Swap buffers
-    render_window->PollEvents();
-    render_window->SwapBuffers();
+    // Swap buffers. With a GPU thread, window events are polled on the thread which created the window.
+    if (!GPUThread::IsEnabled())
+        render_window->PollEvents();
+    if (present_thread == nullptr)
+        render_window->SwapBuffers();
 
     prev_state.Apply();
 
@@ -128,6 +263,32 @@ void RendererOpenGL::SwapBuffers() {
     }
 }
 
+/**
+ * Hands the frame whose screens were just uploaded to the presentation thread, replacing the one
+ * waiting to be presented if it wasn't picked up yet.
+ */
+void RendererOpenGL::QueueFrame() {
+    frames[render_frame].render_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // The fence has to reach the GPU before the presentation thread's context can wait for it
+    glFlush();
+
+    m_current_frame++;
+
+    {
+        std::lock_guard<std::mutex> lock(present_mutex);
+        ready_frame = render_frame;
+
+        // One of the three frames is neither presented nor waiting to be
+        for (unsigned i = 0; i < frames.size(); ++i) {
+            if ((int)i != ready_frame && (int)i != presenting_frame) {
+                render_frame = i;
+                break;
+            }
+        }
+    }
+    frame_ready.notify_one();
+}
+
 /**
  * Loads framebuffer from emulated memory into the active OpenGL texture.
  */
@@ -143,6 +304,44 @@ void RendererOpenGL::LoadFBToActiveGLTexture(const GPU::Regs::FramebufferConfig&
         (int)framebuffer.height, (int)framebuffer.format);
 
     const u8* framebuffer_data = Memory::GetPhysicalPointer(framebuffer_addr);
+    if (framebuffer_data == nullptr) {
+        LOG_ERROR(Render_OpenGL, "Framebuffer at 0x%08x is not in 3DS memory", framebuffer_addr);
+        return;
+    }
+    MemoryStats::SampleGPURead(MemoryStats::GPURead::Scanout, framebuffer_addr, framebuffer.stride * framebuffer.height);
+
+    state.texture_units[0].enabled_2d = true;
+    state.texture_units[0].texture_2d = texture.handle;
+    state.Apply();
+
+    OpenGLState::SetActiveTexture(0);
+
+    // The rows are packed into the upload buffer, which takes care of strides that aren't a whole
+    // number of pixels. The driver copies from there into the texture while the CPU carries on,
+    // and the ring only reuses storage the GPU is done with.
+    const u32 row_size = framebuffer.width * GPU::Regs::BytesPerPixel(framebuffer.color_format);
+    const u32 upload_size = row_size * framebuffer.height;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_buffer.handle);
+    GLintptr upload_offset;
+    u8* upload_data = upload_buffer.Map(upload_size, 4, &upload_offset);
+    if (upload_data != nullptr) {
+        if (row_size == framebuffer.stride) {
+            std::memcpy(upload_data, framebuffer_data, upload_size);
+        } else {
+            for (u32 y = 0; y < framebuffer.height; ++y)
+                std::memcpy(upload_data + y * row_size, framebuffer_data + y * framebuffer.stride, row_size);
+        }
+        upload_buffer.Unmap(upload_size);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, framebuffer.width, framebuffer.height,
+                        texture.gl_format, texture.gl_type, reinterpret_cast<const GLvoid*>(upload_offset));
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    LOG_ERROR(Render_OpenGL, "Failed to map the framebuffer upload buffer");
 
     int bpp = GPU::Regs::BytesPerPixel(framebuffer.color_format);
     size_t pixel_stride = framebuffer.stride / bpp;
@@ -154,11 +353,6 @@ void RendererOpenGL::LoadFBToActiveGLTexture(const GPU::Regs::FramebufferConfig&
     // only allows rows to have a memory alignement of 4.
     ASSERT(pixel_stride % 4 == 0);
 
-    state.texture_units[0].enabled_2d = true;
-    state.texture_units[0].texture_2d = texture.handle;
-    state.Apply();
-
-    glActiveTexture(GL_TEXTURE0);
     glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)pixel_stride);
 
     // Update existing texture
@@ -183,13 +377,22 @@ void RendererOpenGL::LoadColorToActiveGLTexture(u8 color_r, u8 color_g, u8 color
     state.texture_units[0].texture_2d = texture.handle;
     state.Apply();
 
-    glActiveTexture(GL_TEXTURE0);
+    OpenGLState::SetActiveTexture(0);
     u8 framebuffer_data[3] = { color_r, color_g, color_b };
 
     // Update existing texture
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, framebuffer_data);
 }
 
+/// Sets up the vertex attributes of the bound vertex array to read screen rectangles from the bound buffer
+static void AttachScreenVertexData(GLuint attrib_position, GLuint attrib_tex_coord) {
+    glBufferData(GL_ARRAY_BUFFER, sizeof(ScreenRectVertex) * 4, nullptr, GL_STREAM_DRAW);
+    glVertexAttribPointer(attrib_position,  2, GL_FLOAT, GL_FALSE, sizeof(ScreenRectVertex), (GLvoid*)offsetof(ScreenRectVertex, position));
+    glVertexAttribPointer(attrib_tex_coord, 2, GL_FLOAT, GL_FALSE, sizeof(ScreenRectVertex), (GLvoid*)offsetof(ScreenRectVertex, tex_coord));
+    glEnableVertexAttribArray(attrib_position);
+    glEnableVertexAttribArray(attrib_tex_coord);
+}
+
 /**
  * Initializes the OpenGL state and creates persistent objects.
  */
@@ -214,29 +417,47 @@ void RendererOpenGL::InitOpenGLObjects() {
     state.Apply();
 
     // Attach vertex data to VAO
-    glBufferData(GL_ARRAY_BUFFER, sizeof(ScreenRectVertex) * 4, nullptr, GL_STREAM_DRAW);
-    glVertexAttribPointer(attrib_position,  2, GL_FLOAT, GL_FALSE, sizeof(ScreenRectVertex), (GLvoid*)offsetof(ScreenRectVertex, position));
-    glVertexAttribPointer(attrib_tex_coord, 2, GL_FLOAT, GL_FALSE, sizeof(ScreenRectVertex), (GLvoid*)offsetof(ScreenRectVertex, tex_coord));
-    glEnableVertexAttribArray(attrib_position);
-    glEnableVertexAttribArray(attrib_tex_coord);
-
-    // Allocate textures for each screen
-    for (auto& texture : textures) {
-        glGenTextures(1, &texture.handle);
-
-        // Allocation of storage is deferred until the first frame, when we
-        // know the framebuffer size.
+    AttachScreenVertexData(attrib_position, attrib_tex_coord);
+
+    upload_buffer.Create(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_buffer.handle);
+    upload_buffer.Allocate(UPLOAD_BUFFER_SIZE);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // Allocate textures for each screen of each frame
+    for (auto& frame : frames) {
+        for (auto& texture : frame.textures) {
+            glGenTextures(1, &texture.handle);
+
+            // Allocation of storage is deferred until the first frame, when we
+            // know the framebuffer size.
+
+            state.texture_units[0].enabled_2d = true;
+            state.texture_units[0].texture_2d = texture.handle;
+            state.Apply();
+
+            OpenGLState::SetActiveTexture(0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
 
+        // The overlay is drawn at an integer scale, so its text stays sharp without filtering
+        glGenTextures(1, &frame.overlay.handle);
         state.texture_units[0].enabled_2d = true;
-        state.texture_units[0].texture_2d = texture.handle;
+        state.texture_units[0].texture_2d = frame.overlay.handle;
         state.Apply();
 
-        glActiveTexture(GL_TEXTURE0);
+        OpenGLState::SetActiveTexture(0);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, frame.overlay.width, frame.overlay.height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
     }
 
     hw_rasterizer->InitObjects();
@@ -294,21 +515,40 @@ void RendererOpenGL::ConfigureFramebufferTexture(TextureInfo& texture,
     state.texture_units[0].texture_2d = texture.handle;
     state.Apply();
 
-    glActiveTexture(GL_TEXTURE0);
+    OpenGLState::SetActiveTexture(0);
     glTexImage2D(GL_TEXTURE_2D, 0, internal_format, texture.width, texture.height, 0,
             texture.gl_format, texture.gl_type, nullptr);
 }
 
-/**
- * Draws a single texture to the emulator window, rotating the texture to correct for the 3DS's LCD rotation.
- */
-void RendererOpenGL::DrawSingleScreenRotated(const TextureInfo& texture, float x, float y, float w, float h) {
-    std::array<ScreenRectVertex, 4> vertices = {
+/// Returns the vertices of a screen rectangle, rotating the texture to correct for the 3DS's LCD rotation
+static std::array<ScreenRectVertex, 4> MakeRotatedScreenRect(float x, float y, float w, float h) {
+    return {{
         ScreenRectVertex(x,   y,   1.f, 0.f),
         ScreenRectVertex(x+w, y,   1.f, 1.f),
         ScreenRectVertex(x,   y+h, 0.f, 0.f),
         ScreenRectVertex(x+w, y+h, 0.f, 1.f),
-    };
+    }};
+}
+
+/// Returns the vertices of the performance overlay in the top left corner of the window
+static std::array<ScreenRectVertex, 4> MakeOverlayRect(const EmuWindow::FramebufferLayout& layout) {
+    // Doubled in large windows to stay readable
+    const float scale = layout.width >= 800 ? 2.f : 1.f;
+    const float x = 4.f, y = 4.f;
+    const float w = PerfOverlay::WIDTH * scale, h = PerfOverlay::HEIGHT * scale;
+    return {{
+        ScreenRectVertex(x,   y,   0.f, 0.f),
+        ScreenRectVertex(x+w, y,   1.f, 0.f),
+        ScreenRectVertex(x,   y+h, 0.f, 1.f),
+        ScreenRectVertex(x+w, y+h, 1.f, 1.f),
+    }};
+}
+
+/**
+ * Draws a single texture to the emulator window, rotating the texture to correct for the 3DS's LCD rotation.
+ */
+void RendererOpenGL::DrawSingleScreenRotated(const TextureInfo& texture, float x, float y, float w, float h) {
+    const std::array<ScreenRectVertex, 4> vertices = MakeRotatedScreenRect(x, y, w, h);
 
     state.texture_units[0].enabled_2d = true;
     state.texture_units[0].texture_2d = texture.handle;
@@ -321,7 +561,11 @@ void RendererOpenGL::DrawSingleScreenRotated(const TextureInfo& texture, float x
 /**
  * Draws the emulated screens to the emulator window.
  */
-void RendererOpenGL::DrawScreens() {
+void RendererOpenGL::DrawScreens(const Frame& frame) {
+    const auto& textures = frame.textures;
+    auto* gl_rasterizer = static_cast<RasterizerOpenGL*>(hw_rasterizer.get());
+    GPUScopeTimer gpu_scope_timer(gl_rasterizer->GetGPUTimer(), gpu_screens_category);
+
     auto layout = render_window->GetFramebufferLayout();
 
     glViewport(0, 0, layout.width, layout.height);
@@ -336,7 +580,7 @@ void RendererOpenGL::DrawScreens() {
     glUniformMatrix3x2fv(uniform_modelview_matrix, 1, GL_FALSE, ortho_matrix.data());
 
     // Bind texture in Texture Unit 0
-    glActiveTexture(GL_TEXTURE0);
+    OpenGLState::SetActiveTexture(0);
     glUniform1i(uniform_color_texture, 0);
 
     DrawSingleScreenRotated(textures[0], (float)layout.top_screen.left, (float)layout.top_screen.top,
@@ -344,9 +588,112 @@ void RendererOpenGL::DrawScreens() {
     DrawSingleScreenRotated(textures[1], (float)layout.bottom_screen.left,(float)layout.bottom_screen.top,
         (float)layout.bottom_screen.GetWidth(), (float)layout.bottom_screen.GetHeight());
 
+    if (frame.show_overlay) {
+        const std::array<ScreenRectVertex, 4> vertices = MakeOverlayRect(layout);
+
+        state.blend.enabled = true;
+        state.blend.src_rgb_func = GL_SRC_ALPHA;
+        state.blend.dst_rgb_func = GL_ONE_MINUS_SRC_ALPHA;
+        state.blend.src_a_func = GL_ONE;
+        state.blend.dst_a_func = GL_ONE_MINUS_SRC_ALPHA;
+        state.texture_units[0].texture_2d = frame.overlay.handle;
+        state.Apply();
+
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices.data());
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        state.blend.enabled = false;
+        state.Apply();
+    }
+
     m_current_frame++;
 }
 
+/**
+ * Draws the emulated screens to the emulator window on the presentation thread. The OpenGLState
+ * cache belongs to the rendering context, so the GL state is set up directly.
+ */
+void RendererOpenGL::PresentScreens(const Frame& frame, GLuint vertex_buffer) {
+    auto layout = render_window->GetFramebufferLayout();
+
+    glViewport(0, 0, layout.width, layout.height);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glUseProgram(program_id);
+    std::array<GLfloat, 3 * 2> ortho_matrix = MakeOrthographicMatrix((float)layout.width,
+        (float)layout.height);
+    glUniformMatrix3x2fv(uniform_modelview_matrix, 1, GL_FALSE, ortho_matrix.data());
+
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(uniform_color_texture, 0);
+
+    const MathUtil::Rectangle<unsigned> screens[2] = { layout.top_screen, layout.bottom_screen };
+    for (int i : {0, 1}) {
+        const std::array<ScreenRectVertex, 4> vertices = MakeRotatedScreenRect(
+                (float)screens[i].left, (float)screens[i].top,
+                (float)screens[i].GetWidth(), (float)screens[i].GetHeight());
+
+        glBindTexture(GL_TEXTURE_2D, frame.textures[i].handle);
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices.data());
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+
+    if (frame.show_overlay) {
+        const std::array<ScreenRectVertex, 4> vertices = MakeOverlayRect(layout);
+
+        glEnable(GL_BLEND);
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        glBindTexture(GL_TEXTURE_2D, frame.overlay.handle);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices.data());
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glDisable(GL_BLEND);
+    }
+}
+
+/**
+ * Presents the frames handed over by QueueFrame on the window's context, so that waiting for the
+ * host's swap interval never holds up the emulation.
+ */
+void RendererOpenGL::PresentLoop() {
+    Common::RegisterCurrentThread("PresentThread", Common::ThreadClass::Worker);
+    render_window->MakeCurrent();
+
+    // Vertex arrays aren't shared between contexts
+    GLuint present_vertex_array, present_vertex_buffer;
+    glGenVertexArrays(1, &present_vertex_array);
+    glGenBuffers(1, &present_vertex_buffer);
+    glBindVertexArray(present_vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, present_vertex_buffer);
+    AttachScreenVertexData(attrib_position, attrib_tex_coord);
+
+    glClearColor(Settings::values.bg_red, Settings::values.bg_green, Settings::values.bg_blue, 0.0f);
+
+    std::unique_lock<std::mutex> lock(present_mutex);
+    while (true) {
+        frame_ready.wait(lock, [this] { return ready_frame != -1 || stop_presenting; });
+        if (stop_presenting)
+            break;
+
+        presenting_frame = ready_frame;
+        ready_frame = -1;
+        Frame& frame = frames[presenting_frame];
+        lock.unlock();
+
+        glWaitSync(frame.render_fence, 0, GL_TIMEOUT_IGNORED);
+        PresentScreens(frame, present_vertex_buffer);
+        frame.present_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        render_window->SwapBuffers();
+
+        lock.lock();
+    }
+    lock.unlock();
+
+    glDeleteBuffers(1, &present_vertex_buffer);
+    glDeleteVertexArrays(1, &present_vertex_array);
+    render_window->DoneCurrent();
+}
+
 /// Updates the framerate
 void RendererOpenGL::UpdateFramerate() {
 }
@@ -361,7 +708,11 @@ void RendererOpenGL::SetWindow(EmuWindow* window) {
 
 /// Initialize the renderer
 void RendererOpenGL::Init() {
-    render_window->MakeCurrent();
+    // Render on a context of its own if the frontend provides one, leaving the window's context
+    // to the presentation thread
+    const bool separate_present = render_window->MakeSharedContextCurrent();
+    if (!separate_present)
+        render_window->MakeCurrent();
 
     int err = ogl_LoadFunctions();
     if (ogl_LOAD_SUCCEEDED != err) {
@@ -371,6 +722,9 @@ void RendererOpenGL::Init() {
 
     LOG_INFO(Render_OpenGL, "GL_VERSION: %s", glGetString(GL_VERSION));
     InitOpenGLObjects();
+
+    if (separate_present)
+        present_thread = Common::make_unique<std::thread>(&RendererOpenGL::PresentLoop, this);
 }
 
 /// Shutdown the renderer
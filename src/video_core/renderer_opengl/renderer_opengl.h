@@ -5,6 +5,10 @@
 #pragma once
 
 #include <array>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include "generated/gl_3_2_core.h"
 
@@ -13,6 +17,8 @@
 #include "core/hw/gpu.h"
 
 #include "video_core/renderer_base.h"
+#include "video_core/renderer_opengl/gl_perf_overlay.h"
+#include "video_core/renderer_opengl/gl_resource_manager.h"
 #include "video_core/renderer_opengl/gl_state.h"
 #include "video_core/renderer_opengl/gl_rasterizer.h"
 
@@ -48,12 +54,40 @@ private:
         GPU::Regs::PixelFormat format;
         GLenum gl_format;
         GLenum gl_type;
+        u64 version; ///< Version of the screen contents the texture holds
+    };
+
+    /// Configuration a screen was shown with, compared each swap to find out whether it changed
+    struct ScreenSource {
+        PAddr address;
+        u32 width;
+        u32 height;
+        u32 stride;
+        GPU::Regs::PixelFormat format;
+        u32 color_fill;                       ///< Raw LCD color fill register, 0 if no fill is enabled
+
+        bool operator==(const ScreenSource& o) const {
+            return address == o.address && width == o.width && height == o.height &&
+                   stride == o.stride && format == o.format && color_fill == o.color_fill;
+        }
+    };
+
+    /// Screen textures of a finished frame, handed to the presentation thread
+    struct Frame {
+        std::array<TextureInfo, 2> textures;  ///< Textures for top and bottom screens respectively
+        TextureInfo overlay;                  ///< Image of the performance overlay
+        bool show_overlay;                    ///< Whether the overlay is drawn over the screens
+        GLsync render_fence;                  ///< Signaled once the screens have been uploaded
+        GLsync present_fence;                 ///< Signaled once the screens have been drawn to the window
     };
 
     void InitOpenGLObjects();
     void ConfigureFramebufferTexture(TextureInfo& texture,
                                      const GPU::Regs::FramebufferConfig& framebuffer);
-    void DrawScreens();
+    void DrawScreens(const Frame& frame);
+    void PresentLoop();
+    void PresentScreens(const Frame& frame, GLuint vertex_buffer);
+    void QueueFrame();
     void DrawSingleScreenRotated(const TextureInfo& texture, float x, float y, float w, float h);
     void UpdateFramerate();
 
@@ -79,11 +113,35 @@ private:
     GLuint vertex_array_handle;
     GLuint vertex_buffer_handle;
     GLuint program_id;
-    std::array<TextureInfo, 2> textures;          ///< Textures for top and bottom screens respectively
+    /// Ring the LCD framebuffers are copied into, for the texture uploads to run asynchronously
+    OGLStreamBuffer upload_buffer;
+    /**
+     * Mailbox of frames between the emulation and the presentation thread. One is presented, one
+     * waits to be presented next and the last one is rendered to, so neither side ever waits.
+     * Frames which are not picked up before the next one is finished are dropped.
+     */
+    std::array<Frame, 3> frames;
+    unsigned render_frame;                        ///< Frame the screens are uploaded to next
+
+    std::array<ScreenSource, 2> screen_sources;   ///< Configuration of each screen at the last swap
+    /// Incremented whenever the contents of a screen may have changed, to only upload changed screens
+    std::array<u64, 2> screen_versions;
+    std::array<u64, 2> queued_versions;           ///< Screen versions of the last frame handed to the presentation thread
+
+    PerfOverlay perf_overlay;
+    u64 queued_overlay_version;                   ///< Overlay version of the last frame handed to the presentation thread, 0 if hidden
     // Shader uniform location indices
     GLuint uniform_modelview_matrix;
     GLuint uniform_color_texture;
     // Shader attribute input indices
     GLuint attrib_position;
     GLuint attrib_tex_coord;
+
+    // Presentation thread, only running if the frontend provides a shared context to render on
+    std::unique_ptr<std::thread> present_thread;
+    std::mutex present_mutex;
+    std::condition_variable frame_ready;
+    int ready_frame;                              ///< Frame to be presented next, -1 if none
+    int presenting_frame;                         ///< Frame being presented, -1 if none
+    bool stop_presenting;
 };
@@ -0,0 +1,84 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <map>
+#include <memory>
+
+#include "common/make_unique.h"
+#include "common/math_util.h"
+
+#include "core/memory.h"
+#include "core/memory_stats.h"
+
+#include "debug_utils/debug_utils.h"
+#include "texture_cache.h"
+#include "texture_disk_cache.h"
+
+namespace Pica {
+
+namespace TextureCache {
+
+static std::map<PAddr, std::unique_ptr<CachedTexture>> texture_cache;
+static size_t cached_size = 0;
+
+static void Decode(CachedTexture& texture, const Regs::FullTextureConfig& config) {
+    const auto info = DebugUtils::TextureInfo::FromPicaRegister(config.config, config.format);
+    const u8* source = Memory::GetPhysicalPointer(texture.address);
+
+    cached_size -= texture.texels.size() * sizeof(Math::Vec4<u8>);
+
+    texture.format = info.format;
+    texture.width = info.width;
+    texture.height = info.height;
+    texture.size = info.width * info.height * Regs::NibblesPerPixel(info.format) / 2;
+    texture.texels.resize(info.width * info.height);
+    MemoryStats::SampleGPURead(MemoryStats::GPURead::Texture, texture.address, texture.size);
+    TextureDiskCache::DecodeTexture(source, info, texture.texels.data());
+
+    cached_size += texture.texels.size() * sizeof(Math::Vec4<u8>);
+}
+
+const CachedTexture& GetTexture(const Regs::FullTextureConfig& config) {
+    const PAddr address = config.config.GetPhysicalAddress();
+
+    auto& texture = texture_cache[address];
+    if (texture == nullptr) {
+        texture = Common::make_unique<CachedTexture>();
+        texture->address = address;
+        Decode(*texture, config);
+    } else if (texture->format != config.format || texture->width != config.config.width ||
+               texture->height != config.config.height) {
+        // The same memory is read as a different texture now
+        Decode(*texture, config);
+    }
+
+    return *texture;
+}
+
+void NotifyFlush(PAddr addr, u32 size) {
+    // Textures are keyed by their start address, so only the ones starting before the end of the
+    // region can overlap it
+    auto cache_upper_bound = texture_cache.lower_bound(addr + size);
+    for (auto it = texture_cache.begin(); it != cache_upper_bound;) {
+        if (MathUtil::IntervalsIntersect(addr, size, it->first, it->second->size)) {
+            cached_size -= it->second->texels.size() * sizeof(Math::Vec4<u8>);
+            it = texture_cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void FullFlush() {
+    texture_cache.clear();
+    cached_size = 0;
+}
+
+size_t GetCachedSize() {
+    return cached_size;
+}
+
+} // namespace
+
+} // namespace
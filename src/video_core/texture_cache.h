@@ -0,0 +1,54 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include "common/common_types.h"
+#include "common/vector_math.h"
+
+#include "pica.h"
+
+namespace Pica {
+
+/**
+ * Textures decoded to linear RGBA8 for the software rasterizer, so that sampling doesn't have to
+ * go through the Morton swizzle and format decoding for every texel.
+ */
+namespace TextureCache {
+
+struct CachedTexture {
+    PAddr address;
+    /// Number of bytes the encoded texture occupies in emulated memory
+    u32 size;
+    Regs::TextureFormat format;
+    unsigned width;
+    unsigned height;
+    /// Decoded texels, indexed by s + t * width in the coordinates LookupTexture takes
+    std::vector<Math::Vec4<u8>> texels;
+
+    const Math::Vec4<u8>& Lookup(int s, int t) const {
+        return texels[s + t * width];
+    }
+};
+
+/**
+ * Returns the given texture decoded, decoding it if it isn't cached yet.
+ * The reference stays valid until the next call to NotifyFlush or FullFlush.
+ */
+const CachedTexture& GetTexture(const Regs::FullTextureConfig& config);
+
+/// Drops all cached textures that overlap the given region of memory
+void NotifyFlush(PAddr addr, u32 size);
+
+/// Drops all cached textures
+void FullFlush();
+
+/// Returns the number of bytes used by decoded texels
+size_t GetCachedSize();
+
+} // namespace
+
+} // namespace
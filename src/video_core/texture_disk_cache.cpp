@@ -0,0 +1,149 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common_paths.h"
+#include "common/file_util.h"
+#include "common/hash.h"
+#include "common/linear_disk_cache.h"
+#include "common/logging/log.h"
+#include "common/string_util.h"
+
+#include "core/settings.h"
+#include "core/hle/kernel/process.h"
+
+#include "pica.h"
+#include "texture_disk_cache.h"
+
+namespace Pica {
+
+namespace TextureDiskCache {
+
+/// Identifies a texture by its contents, as stored in the cache file
+struct Key {
+    u64 hash;
+    u32 format;
+    u16 width;
+    u16 height;
+
+    bool operator==(const Key& other) const {
+        return hash == other.hash && format == other.format && width == other.width && height == other.height;
+    }
+};
+
+struct KeyHash {
+    size_t operator()(const Key& key) const {
+        return static_cast<size_t>(key.hash);
+    }
+};
+
+/// Decoded texels of all textures in the cache file, as bytes of RGBA8 texels
+static std::unordered_map<Key, std::vector<u8>, KeyHash> textures;
+
+static LinearDiskCache<Key, u8> disk_cache;
+
+/// Protects the cache, textures may be decoded by prefetching worker threads
+static std::mutex cache_mutex;
+
+/// Title whose cache file is open, if any
+static bool is_open = false;
+static u64 open_program_id;
+
+class Reader : public LinearDiskCacheReader<Key, u8> {
+public:
+    void Read(const Key& key, const u8* value, u32 value_size) override {
+        if (value_size == u32(key.width) * key.height * sizeof(Math::Vec4<u8>))
+            textures[key].assign(value, value + value_size);
+    }
+};
+
+static void CloseCache() {
+    if (is_open) {
+        disk_cache.Sync();
+        disk_cache.Close();
+    }
+    textures.clear();
+    is_open = false;
+}
+
+/// Makes sure the cache file of the running title is open. Called with the lock held.
+static bool OpenForRunningTitle() {
+    if (Kernel::g_current_process == nullptr)
+        return false;
+
+    const u64 program_id = Kernel::g_current_process->program_id;
+    if (is_open && open_program_id == program_id)
+        return true;
+
+    CloseCache();
+
+    const std::string dir = FileUtil::GetUserPath(D_CACHE_IDX) + "textures" DIR_SEP;
+    if (!FileUtil::CreateFullPath(dir))
+        return false;
+
+    const std::string filename = dir + Common::StringFromFormat("%016llX.cache", program_id);
+    Reader reader;
+    const u32 num_entries = disk_cache.OpenAndRead(filename.c_str(), reader);
+    LOG_INFO(Render, "Loaded %u cached textures from %s", num_entries, filename.c_str());
+
+    is_open = true;
+    open_program_id = program_id;
+    return true;
+}
+
+void DecodeTexture(const u8* source, const DebugUtils::TextureInfo& info, Math::Vec4<u8>* dest) {
+    if (!Settings::values.texture_disk_cache ||
+        (info.format != Regs::TextureFormat::ETC1 && info.format != Regs::TextureFormat::ETC1A4)) {
+        DebugUtils::DecodeTexture(source, info, dest);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(cache_mutex);
+    const bool open = OpenForRunningTitle();
+    lock.unlock();
+    if (!open) {
+        DebugUtils::DecodeTexture(source, info, dest);
+        return;
+    }
+
+    Key key;
+    std::memset(&key, 0, sizeof(key));
+    key.hash = Common::ComputeHash64(source, info.width * info.height * Regs::NibblesPerPixel(info.format) / 2);
+    key.format = static_cast<u32>(info.format);
+    key.width = static_cast<u16>(info.width);
+    key.height = static_cast<u16>(info.height);
+
+    const size_t num_bytes = info.width * info.height * sizeof(Math::Vec4<u8>);
+
+    lock.lock();
+    auto cached = textures.find(key);
+    if (cached != textures.end()) {
+        std::memcpy(dest, cached->second.data(), num_bytes);
+        return;
+    }
+    lock.unlock();
+
+    // Decoded without the lock, a texture decoded by two threads at once is only cached once
+    DebugUtils::DecodeTexture(source, info, dest);
+
+    const u8* texel_bytes = reinterpret_cast<const u8*>(dest);
+    lock.lock();
+    if (!is_open || textures.count(key) != 0)
+        return;
+    textures[key].assign(texel_bytes, texel_bytes + num_bytes);
+    disk_cache.Append(key, texel_bytes, static_cast<u32>(num_bytes));
+}
+
+void Shutdown() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    CloseCache();
+}
+
+} // namespace
+
+} // namespace
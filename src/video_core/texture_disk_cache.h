@@ -0,0 +1,35 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+#include "common/vector_math.h"
+
+#include "debug_utils/debug_utils.h"
+
+namespace Pica {
+
+/**
+ * Decoded textures persisted per title under the user's cache directory, so that they don't have
+ * to be decoded again the next time the title is run. Only compressed formats are stored, for
+ * all others decoding is about as fast as reading the decoded texels back from disk.
+ */
+namespace TextureDiskCache {
+
+/**
+ * Decodes a texture like DebugUtils::DecodeTexture, but takes the decoded texels from the disk
+ * cache of the running title if they are in there, or adds them to it if they aren't.
+ * @param source Source pointer to read data from
+ * @param info TextureInfo object describing the texture setup
+ * @param dest Receives info.width * info.height texels, the one at (s, t) at index s + t * info.width
+ */
+void DecodeTexture(const u8* source, const DebugUtils::TextureInfo& info, Math::Vec4<u8>* dest);
+
+/// Closes the cache file of the running title
+void Shutdown();
+
+} // namespace
+
+} // namespace
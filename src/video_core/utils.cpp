@@ -2,13 +2,227 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
+#include <cstring>
 #include <stdio.h>
 #include <string.h>
 
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "common/assert.h"
+
 #include "video_core/utils.h"
 
 namespace VideoCore {
 
+#define MORTON_ROW(bpp, a, b, c, d, e, f, g, h) \
+    a * bpp, b * bpp, c * bpp, d * bpp, e * bpp, f * bpp, g * bpp, h * bpp
+
+#define MORTON_TABLE(bpp) {                                 \
+    MORTON_ROW(bpp,  0,  1,  4,  5, 16, 17, 20, 21),        \
+    MORTON_ROW(bpp,  2,  3,  6,  7, 18, 19, 22, 23),        \
+    MORTON_ROW(bpp,  8,  9, 12, 13, 24, 25, 28, 29),        \
+    MORTON_ROW(bpp, 10, 11, 14, 15, 26, 27, 30, 31),        \
+    MORTON_ROW(bpp, 32, 33, 36, 37, 48, 49, 52, 53),        \
+    MORTON_ROW(bpp, 34, 35, 38, 39, 50, 51, 54, 55),        \
+    MORTON_ROW(bpp, 40, 41, 44, 45, 56, 57, 60, 61),        \
+    MORTON_ROW(bpp, 42, 43, 46, 47, 58, 59, 62, 63),        \
+}
+
+// The rows of the tables go from y = 0 to y = 7, the opposite of the picture in GetMortonOffset
+const u8 morton_offsets[5][64] = {
+    {},
+    MORTON_TABLE(1),
+    MORTON_TABLE(2),
+    MORTON_TABLE(3),
+    MORTON_TABLE(4),
+};
+
+#undef MORTON_TABLE
+#undef MORTON_ROW
+
+/**
+ * Copies tiles between the linear and the Morton layouts. The two pixels of a row of a 2x2 block are
+ * adjacent in a tile too, so a block is copied as two pairs of pixels from consecutive rows.
+ */
+template <u32 bpp>
+struct TileCopier {
+    static void ToTile(u8* tile, const u8* linear, ptrdiff_t stride) {
+        for (int y = 0; y < 8; y += 2) {
+            const u8* row = linear + y * stride;
+            for (u32 x = 0; x < 8; x += 2) {
+                u8* block = tile + morton_offsets[bpp][x + y * 8];
+                std::memcpy(block, row + x * bpp, 2 * bpp);
+                std::memcpy(block + 2 * bpp, row + stride + x * bpp, 2 * bpp);
+            }
+        }
+    }
+
+    static void ToLinear(u8* linear, ptrdiff_t stride, const u8* tile) {
+        for (int y = 0; y < 8; y += 2) {
+            u8* row = linear + y * stride;
+            for (u32 x = 0; x < 8; x += 2) {
+                const u8* block = tile + morton_offsets[bpp][x + y * 8];
+                std::memcpy(row + x * bpp, block, 2 * bpp);
+                std::memcpy(row + stride + x * bpp, block + 2 * bpp, 2 * bpp);
+            }
+        }
+    }
+};
+
+#if defined(_M_X64) || defined(__SSE2__)
+// Interleaving the pairs of pixels of two rows gives the 2x2 blocks of consecutive x, whose
+// offsets are consecutive as well: the blocks at x = 0 and 2 are adjacent, and so are x = 4 and 6.
+
+template <>
+struct TileCopier<1> {
+    static void ToTile(u8* tile, const u8* linear, ptrdiff_t stride) {
+        for (int y = 0; y < 8; y += 2) {
+            const u8* row = linear + y * stride;
+            __m128i row0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row));
+            __m128i row1 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + stride));
+            __m128i blocks = _mm_unpacklo_epi16(row0, row1);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(tile + morton_offsets[1][y * 8]), blocks);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(tile + morton_offsets[1][4 + y * 8]), _mm_srli_si128(blocks, 8));
+        }
+    }
+
+    static void ToLinear(u8* linear, ptrdiff_t stride, const u8* tile) {
+        for (int y = 0; y < 8; y += 2) {
+            u8* row = linear + y * stride;
+            __m128i low = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(tile + morton_offsets[1][y * 8]));
+            __m128i high = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(tile + morton_offsets[1][4 + y * 8]));
+            // Gather the pairs of pixels of each row into a 64-bit half
+            __m128i blocks = _mm_unpacklo_epi64(low, high);
+            blocks = _mm_shufflelo_epi16(blocks, _MM_SHUFFLE(3, 1, 2, 0));
+            blocks = _mm_shufflehi_epi16(blocks, _MM_SHUFFLE(3, 1, 2, 0));
+            blocks = _mm_shuffle_epi32(blocks, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(row), blocks);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(row + stride), _mm_srli_si128(blocks, 8));
+        }
+    }
+};
+
+template <>
+struct TileCopier<2> {
+    static void ToTile(u8* tile, const u8* linear, ptrdiff_t stride) {
+        for (int y = 0; y < 8; y += 2) {
+            const u8* row = linear + y * stride;
+            __m128i row0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row));
+            __m128i row1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + stride));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(tile + morton_offsets[2][y * 8]), _mm_unpacklo_epi32(row0, row1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(tile + morton_offsets[2][4 + y * 8]), _mm_unpackhi_epi32(row0, row1));
+        }
+    }
+
+    static void ToLinear(u8* linear, ptrdiff_t stride, const u8* tile) {
+        for (int y = 0; y < 8; y += 2) {
+            u8* row = linear + y * stride;
+            __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tile + morton_offsets[2][y * 8]));
+            __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tile + morton_offsets[2][4 + y * 8]));
+            low = _mm_shuffle_epi32(low, _MM_SHUFFLE(3, 1, 2, 0));
+            high = _mm_shuffle_epi32(high, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row), _mm_unpacklo_epi64(low, high));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row + stride), _mm_unpackhi_epi64(low, high));
+        }
+    }
+};
+
+template <>
+struct TileCopier<4> {
+    static void ToTile(u8* tile, const u8* linear, ptrdiff_t stride) {
+        for (int y = 0; y < 8; y += 2) {
+            const u8* row = linear + y * stride;
+            for (u32 x = 0; x < 8; x += 4) {
+                __m128i row0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4));
+                __m128i row1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + stride + x * 4));
+                u8* blocks = tile + morton_offsets[4][x + y * 8];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(blocks), _mm_unpacklo_epi64(row0, row1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(blocks + 16), _mm_unpackhi_epi64(row0, row1));
+            }
+        }
+    }
+
+    static void ToLinear(u8* linear, ptrdiff_t stride, const u8* tile) {
+        for (int y = 0; y < 8; y += 2) {
+            u8* row = linear + y * stride;
+            for (u32 x = 0; x < 8; x += 4) {
+                const u8* blocks = tile + morton_offsets[4][x + y * 8];
+                __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks));
+                __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x * 4), _mm_unpacklo_epi64(low, high));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(row + stride + x * 4), _mm_unpackhi_epi64(low, high));
+            }
+        }
+    }
+};
+#endif
+
+void TileFromLinear(u8* tile, const u8* linear, ptrdiff_t stride, u32 bytes_per_pixel) {
+    switch (bytes_per_pixel) {
+    case 1: TileCopier<1>::ToTile(tile, linear, stride); break;
+    case 2: TileCopier<2>::ToTile(tile, linear, stride); break;
+    case 3: TileCopier<3>::ToTile(tile, linear, stride); break;
+    case 4: TileCopier<4>::ToTile(tile, linear, stride); break;
+    default: UNREACHABLE();
+    }
+}
+
+void LinearFromTile(u8* linear, ptrdiff_t stride, const u8* tile, u32 bytes_per_pixel) {
+    switch (bytes_per_pixel) {
+    case 1: TileCopier<1>::ToLinear(linear, stride, tile); break;
+    case 2: TileCopier<2>::ToLinear(linear, stride, tile); break;
+    case 3: TileCopier<3>::ToLinear(linear, stride, tile); break;
+    case 4: TileCopier<4>::ToLinear(linear, stride, tile); break;
+    default: UNREACHABLE();
+    }
+}
+
+template <u32 bpp>
+static void TileImage(u8* tiled, const u8* linear, u32 width, u32 height) {
+    const ptrdiff_t stride = width * bpp;
+    for (u32 tile_y = 0; tile_y < height; tile_y += 8) {
+        for (u32 tile_x = 0; tile_x < width; tile_x += 8) {
+            TileCopier<bpp>::ToTile(tiled + (tile_y * width + tile_x * 8) * bpp,
+                                    linear + tile_y * stride + tile_x * bpp, stride);
+        }
+    }
+}
+
+template <u32 bpp>
+static void UntileImage(u8* linear, const u8* tiled, u32 width, u32 height) {
+    const ptrdiff_t stride = width * bpp;
+    for (u32 tile_y = 0; tile_y < height; tile_y += 8) {
+        for (u32 tile_x = 0; tile_x < width; tile_x += 8) {
+            TileCopier<bpp>::ToLinear(linear + tile_y * stride + tile_x * bpp, stride,
+                                      tiled + (tile_y * width + tile_x * 8) * bpp);
+        }
+    }
+}
+
+void TileImage(u8* tiled, const u8* linear, u32 width, u32 height, u32 bytes_per_pixel) {
+    DEBUG_ASSERT(width % 8 == 0 && height % 8 == 0);
+    switch (bytes_per_pixel) {
+    case 1: TileImage<1>(tiled, linear, width, height); break;
+    case 2: TileImage<2>(tiled, linear, width, height); break;
+    case 3: TileImage<3>(tiled, linear, width, height); break;
+    case 4: TileImage<4>(tiled, linear, width, height); break;
+    default: UNREACHABLE();
+    }
+}
+
+void UntileImage(u8* linear, const u8* tiled, u32 width, u32 height, u32 bytes_per_pixel) {
+    DEBUG_ASSERT(width % 8 == 0 && height % 8 == 0);
+    switch (bytes_per_pixel) {
+    case 1: UntileImage<1>(linear, tiled, width, height); break;
+    case 2: UntileImage<2>(linear, tiled, width, height); break;
+    case 3: UntileImage<3>(linear, tiled, width, height); break;
+    case 4: UntileImage<4>(linear, tiled, width, height); break;
+    default: UNREACHABLE();
+    }
+}
+
 /**
  * Dumps a texture to TGA
  * @param filename String filename to dump texture to
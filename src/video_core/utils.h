@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 #include "common/common_types.h"
@@ -35,17 +36,20 @@ struct TGAHeader {
  */
 void DumpTGA(std::string filename, short width, short height, u8* raw_data);
 
+/**
+ * Byte offsets of the pixels of an 8x8 tile in Morton order, by bytes per pixel (1 to 4) and by the
+ * position x + y * 8 of the pixel in the tile. See GetMortonOffset for the layout.
+ */
+extern const u8 morton_offsets[5][64];
+
 /**
  * Interleave the lower 3 bits of each coordinate to get the intra-block offsets, which are
  * arranged in a Z-order curve. More details on the bit manipulation at:
  * https://fgiesen.wordpress.com/2009/12/13/decoding-morton-codes/
+ * The interleaving is precomputed in morton_offsets.
  */
 static inline u32 MortonInterleave(u32 x, u32 y) {
-    u32 i = (x & 7) | ((y & 7) << 8); // ---- -210
-    i = (i ^ (i << 2)) & 0x1313;      // ---2 --10
-    i = (i ^ (i << 1)) & 0x1515;      // ---2 -1-0
-    i = (i | (i >> 7)) & 0x3F;
-    return i;
+    return morton_offsets[1][(x & 7) + (y & 7) * 8];
 }
 
 /**
@@ -75,11 +79,31 @@ static inline u32 GetMortonOffset(u32 x, u32 y, u32 bytes_per_pixel) {
     const unsigned int block_height = 8;
     const unsigned int coarse_x = x & ~7;
 
-    u32 i = VideoCore::MortonInterleave(x, y);
+    const unsigned int offset = coarse_x * block_height * bytes_per_pixel;
 
-    const unsigned int offset = coarse_x * block_height;
-
-    return (i + offset) * bytes_per_pixel;
+    return morton_offsets[bytes_per_pixel][(x & 7) + (y & 7) * 8] + offset;
 }
 
+/**
+ * Copies an 8x8 tile of a linear image into Morton order
+ * @param tile Receives the 64 pixels of the tile, in Morton order
+ * @param linear First row of the tile in the linear image
+ * @param stride Distance in bytes from a row of the linear image to the next one, negative to read
+ *               the rows of the tile from the bottom up
+ * @param bytes_per_pixel Size of a pixel, 1 to 4 bytes
+ */
+void TileFromLinear(u8* tile, const u8* linear, ptrdiff_t stride, u32 bytes_per_pixel);
+
+/// Copies an 8x8 tile in Morton order into a linear image, the reverse of TileFromLinear
+void LinearFromTile(u8* linear, ptrdiff_t stride, const u8* tile, u32 bytes_per_pixel);
+
+/**
+ * Copies a linear image, with its rows one after another, into tiles stored row by row the way
+ * the PICA lays out its framebuffers and textures. Both dimensions are multiples of 8.
+ */
+void TileImage(u8* tiled, const u8* linear, u32 width, u32 height, u32 bytes_per_pixel);
+
+/// Copies a tiled image into a linear one, the reverse of TileImage
+void UntileImage(u8* linear, const u8* tiled, u32 width, u32 height, u32 bytes_per_pixel);
+
 } // namespace
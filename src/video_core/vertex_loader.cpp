@@ -0,0 +1,122 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include "common/logging/log.h"
+
+#include "core/memory.h"
+#include "core/memory_stats.h"
+
+#include "vertex_loader.h"
+#include "vertex_shader.h"
+
+namespace Pica {
+
+typedef void (*LoadFunction)(const u8* source, Math::Vec4<float24>& attribute);
+
+/**
+ * Converts the first num_components components of an attribute. The component count is a template
+ * parameter so that the loop is fully unrolled.
+ */
+template <typename T, int num_components>
+static void LoadAttribute(const u8* source, Math::Vec4<float24>& attribute) {
+    const T* components = reinterpret_cast<const T*>(source);
+    for (int i = 0; i < num_components; ++i)
+        attribute[i] = float24::FromFloat32(static_cast<float>(components[i]));
+}
+
+template <typename T>
+static LoadFunction GetLoadFunction(int num_components) {
+    switch (num_components) {
+    case 1: return LoadAttribute<T, 1>;
+    case 2: return LoadAttribute<T, 2>;
+    case 3: return LoadAttribute<T, 3>;
+    case 4: return LoadAttribute<T, 4>;
+    default: return nullptr;
+    }
+}
+
+VertexLoader::VertexLoader(const Regs& regs) {
+    const auto& attribute_config = regs.vertex_attributes;
+    const u32 base_address = attribute_config.GetPhysicalBaseAddress();
+
+    num_attributes = attribute_config.GetNumTotalAttributes();
+    default_attribute_mask = 0;
+    for (int i = 0; i < 16; ++i) {
+        attributes[i] = {};
+        if (attribute_config.IsDefaultAttribute(i))
+            default_attribute_mask |= 1 << i;
+    }
+
+    for (int loader = 0; loader < 12; ++loader) {
+        const auto& loader_config = attribute_config.attribute_loaders[loader];
+
+        u32 load_address = base_address + loader_config.data_offset;
+
+        // TODO: What happens if a loader overwrites a previous one's data?
+        for (unsigned component = 0; component < loader_config.component_count; ++component) {
+            u32 attribute_index = loader_config.GetComponent(component);
+            Attribute& attribute = attributes[attribute_index];
+            const int num_elements = attribute_config.GetNumElements(attribute_index);
+
+            attribute.source = load_address;
+            attribute.stride = static_cast<u32>(loader_config.byte_count);
+            attribute.size = attribute_config.GetStride(attribute_index);
+
+            switch (attribute_config.GetFormat(attribute_index)) {
+            case Regs::VertexAttributeFormat::BYTE:
+                attribute.load = GetLoadFunction<s8>(num_elements);
+                break;
+            case Regs::VertexAttributeFormat::UBYTE:
+                attribute.load = GetLoadFunction<u8>(num_elements);
+                break;
+            case Regs::VertexAttributeFormat::SHORT:
+                attribute.load = GetLoadFunction<s16>(num_elements);
+                break;
+            default:
+                attribute.load = GetLoadFunction<float>(num_elements);
+                break;
+            }
+
+            attribute.host_source = Memory::GetPhysicalSpan(load_address, attribute.host_size);
+
+            load_address += attribute.size;
+        }
+    }
+}
+
+void VertexLoader::LoadVertex(u32 vertex, VertexShader::InputVertex& input) const {
+    for (int i = 0; i < num_attributes; ++i) {
+        // Load the default attribute if we're configured to do so, this data will be overwritten by the loader data if it's set
+        if (default_attribute_mask & (1 << i)) {
+            input.attr[i] = g_state.vs.default_attributes[i];
+            LOG_TRACE(HW_GPU, "Loaded default attribute %x for vertex %x: (%f, %f, %f, %f)",
+                      i, vertex,
+                      input.attr[i][0].ToFloat32(), input.attr[i][1].ToFloat32(),
+                      input.attr[i][2].ToFloat32(), input.attr[i][3].ToFloat32());
+        }
+
+        // Load per-vertex data from the loader arrays
+        const Attribute& attribute = attributes[i];
+        if (attribute.load == nullptr)
+            continue;
+
+        const u32 offset = attribute.stride * vertex;
+        const u8* source;
+        if (offset < attribute.host_size && attribute.host_size - offset >= attribute.size) {
+            source = attribute.host_source + offset;
+        } else {
+            // Outside of the memory region the attribute starts in, look it up the slow way
+            source = Memory::GetPhysicalPointer(attribute.source + offset);
+        }
+
+        attribute.load(source, input.attr[i]);
+        MemoryStats::SampleGPURead(MemoryStats::GPURead::VertexArray, attribute.source + offset, attribute.size);
+        LOG_TRACE(HW_GPU, "Loaded attribute %x for vertex %x from 0x%08x: (%f, %f, %f, %f)",
+                  i, vertex, attribute.source + offset,
+                  input.attr[i][0].ToFloat32(), input.attr[i][1].ToFloat32(),
+                  input.attr[i][2].ToFloat32(), input.attr[i][3].ToFloat32());
+    }
+}
+
+} // namespace
@@ -0,0 +1,56 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "pica.h"
+
+namespace Pica {
+
+namespace VertexShader {
+struct InputVertex;
+}
+
+/**
+ * Loads the input attributes of vertices from the attribute loaders set up in the registers. The
+ * loader configuration is decoded once per draw: host pointers to the attribute data are resolved
+ * up front and each attribute gets a conversion function specialized on its format and number of
+ * components, so loading a vertex only indexes into memory.
+ */
+class VertexLoader {
+public:
+    /// Loads no attributes at all
+    VertexLoader() : num_attributes(0), default_attribute_mask(0) {
+    }
+
+    /// Decodes the attribute loader configuration of the given registers
+    explicit VertexLoader(const Regs& regs);
+
+    /// Loads the attributes of the vertex with the given index, after default attributes
+    void LoadVertex(u32 vertex, VertexShader::InputVertex& input) const;
+
+private:
+    typedef void (*LoadFunction)(const u8* source, Math::Vec4<float24>& attribute);
+
+    struct Attribute {
+        /// Physical address of the attribute of the first vertex
+        PAddr source;
+        /// Host pointer corresponding to source, or nullptr if it couldn't be resolved
+        const u8* host_source;
+        /// Number of bytes accessible through host_source
+        u32 host_size;
+        u32 stride;
+        /// Size of the attribute in bytes
+        u32 size;
+        LoadFunction load;
+    };
+
+    int num_attributes;
+    u32 default_attribute_mask;
+    Attribute attributes[16];
+};
+
+} // namespace
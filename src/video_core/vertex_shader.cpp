@@ -2,7 +2,8 @@
 // Licensed under GPLv2 or any later version
 // Refer to the license.txt file included.
 
-#include <stack>
+#include <algorithm>
+#include <array>
 
 #include <boost/range/algorithm.hpp>
 
@@ -12,22 +13,25 @@
 
 #include "common/profiler.h"
 
+#include "core/settings.h"
+
+#include "derived_state.h"
 #include "pica.h"
 #include "vertex_shader.h"
-#include "debug_utils/debug_utils.h"
+#include "vertex_shader_batch.h"
+#include "vertex_shader_ir.h"
+#include "vertex_shader_jit.h"
+#include "vertex_shader_transform.h"
 
 using nihstro::OpCode;
 using nihstro::Instruction;
-using nihstro::RegisterType;
-using nihstro::SourceRegister;
-using nihstro::SwizzlePattern;
 
 namespace Pica {
 
 namespace VertexShader {
 
 struct VertexShaderState {
-    const u32* program_counter;
+    u32 program_counter;
 
     const float24* input_register_table[16];
     Math::Vec4<float24> output_registers[16];
@@ -52,34 +56,102 @@ struct VertexShaderState {
         u32 loop_address;   // The address where we'll return to after each loop iteration
     };
 
-    // TODO: Is there a maximal size for this?
-    std::stack<CallStackElement> call_stack;
-
-    struct {
-        u32 max_offset; // maximum program counter ever reached
-        u32 max_opdesc_id; // maximum swizzle pattern index ever used
-    } debug;
+    // Fixed capacity, so that interpreting a vertex doesn't allocate. The hardware nests at most
+    // 4 calls, 4 loops and 8 conditionals, each of which takes an element.
+    // TODO: What does the hardware do with a shader nesting deeper?
+    static const size_t MAX_CALL_STACK_DEPTH = 16;
+    std::array<CallStackElement, MAX_CALL_STACK_DEPTH> call_stack;
+    size_t call_stack_size = 0;
 };
 
 static void ProcessShaderCode(VertexShaderState& state) {
     const auto& uniforms = g_state.vs.uniforms;
-    const auto& swizzle_data = g_state.vs.swizzle_data;
-    const auto& program_code = g_state.vs.program_code;
+    const IRProgram& program = GetIRProgram();
 
     // Placeholder for invalid inputs
     static float24 dummy_vec4_float24[4];
 
+    auto LookupSourceRegister = [&](const IRRegister& reg) -> const float24* {
+        switch (reg.file) {
+        case IRRegisterFile::Input:
+            return state.input_register_table[reg.index];
+
+        case IRRegisterFile::Temporary:
+            return &state.temporary_registers[reg.index].x;
+
+        case IRRegisterFile::FloatUniform:
+            return &uniforms.f[reg.index].x;
+
+        default:
+            return dummy_vec4_float24;
+        }
+    };
+
+    // Swizzles and negates a source operand
+    auto LoadSource = [&](const IRSource& source, float24 (&values)[4]) {
+        const float24* reg;
+        if (source.address_register != 0) {
+            reg = LookupSourceRegister(ResolveSourceRegister(source.id + state.address_registers[source.address_register - 1]));
+        } else {
+            reg = LookupSourceRegister(source.reg);
+        }
+
+        for (int i = 0; i < 4; ++i)
+            values[i] = reg[source.selectors[i]];
+
+        if (source.negate) {
+            for (int i = 0; i < 4; ++i)
+                values[i] = values[i] * float24::FromFloat32(-1);
+        }
+    };
+
+    auto call = [&state](u32 offset, u32 num_instructions, u32 return_offset, u8 repeat_count, u8 loop_increment) {
+        if (state.call_stack_size == state.call_stack.size()) {
+            LOG_ERROR(HW_GPU, "Shader call stack overflow at 0x%03x, the call is skipped", state.program_counter);
+            return;
+        }
+        state.program_counter = offset - 1; // -1 to make sure when incrementing the PC we end up at the correct offset
+        state.call_stack[state.call_stack_size++] = { offset + num_instructions, return_offset, repeat_count, loop_increment, offset };
+    };
+
+    auto evaluate_condition = [&state](const IRInstruction& instr) {
+        bool results[2] = { instr.refx == state.conditional_code[0],
+                            instr.refy == state.conditional_code[1] };
+
+        switch (instr.condition) {
+        case IRCondition::Or:
+            return results[0] || results[1];
+
+        case IRCondition::And:
+            return results[0] && results[1];
+
+        case IRCondition::JustX:
+            return results[0];
+
+        case IRCondition::JustY:
+        default:
+            return results[1];
+        }
+    };
+
+    auto LogUnhandled = [](const char* kind, const IRInstruction& instr) {
+        Instruction raw;
+        raw.hex = instr.hex;
+        LOG_ERROR(HW_GPU, "Unhandled %sinstruction: 0x%02x (%s): 0x%08x",
+                  kind, (int)instr.opcode, raw.opcode.Value().GetInfo().name, instr.hex);
+    };
+
     while (true) {
-        if (!state.call_stack.empty()) {
-            auto& top = state.call_stack.top();
-            if (state.program_counter - program_code.data() == top.final_address) {
+        if (state.call_stack_size != 0) {
+            auto& top = state.call_stack[state.call_stack_size - 1];
+            if (state.program_counter == top.final_address) {
                 state.address_registers[2] += top.loop_increment;
 
                 if (top.repeat_counter-- == 0) {
-                    state.program_counter = &program_code[top.return_address];
-                    state.call_stack.pop();
+                    state.program_counter = top.return_address;
+                    --state.call_stack_size;
                 } else {
-                    state.program_counter = &program_code[top.loop_address];
+                    state.program_counter = top.loop_address;
                 }
 
                 // TODO: Is "trying again" accurate to hardware?
@@ -87,85 +159,31 @@ static void ProcessShaderCode(VertexShaderState& state) {
             }
         }
 
-        bool exit_loop = false;
-        const Instruction& instr = *(const Instruction*)state.program_counter;
-        const SwizzlePattern& swizzle = *(SwizzlePattern*)&swizzle_data[instr.common.operand_desc_id];
-
-        static auto call = [&program_code](VertexShaderState& state, u32 offset, u32 num_instructions,
-                              u32 return_offset, u8 repeat_count, u8 loop_increment) {
-            state.program_counter = &program_code[offset] - 1; // -1 to make sure when incrementing the PC we end up at the correct offset
-            state.call_stack.push({ offset + num_instructions, return_offset, repeat_count, loop_increment, offset });
-        };
-        u32 binary_offset = state.program_counter - program_code.data();
-
-        state.debug.max_offset = std::max<u32>(state.debug.max_offset, 1 + binary_offset);
-
-        auto LookupSourceRegister = [&](const SourceRegister& source_reg) -> const float24* {
-            switch (source_reg.GetRegisterType()) {
-            case RegisterType::Input:
-                return state.input_register_table[source_reg.GetIndex()];
-
-            case RegisterType::Temporary:
-                return &state.temporary_registers[source_reg.GetIndex()].x;
-
-            case RegisterType::FloatUniform:
-                return &uniforms.f[source_reg.GetIndex()].x;
+        if (state.program_counter >= program.size()) {
+            LOG_ERROR(HW_GPU, "Vertex shader ran past the end of the program memory");
+            break;
+        }
 
-            default:
-                return dummy_vec4_float24;
-            }
-        };
+        bool exit_loop = false;
+        const IRInstruction& instr = program[state.program_counter];
+        const u32 binary_offset = state.program_counter;
 
-        switch (instr.opcode.Value().GetInfo().type) {
+        switch (instr.type) {
         case OpCode::Type::Arithmetic:
         {
-            const bool is_inverted = (0 != (instr.opcode.Value().GetInfo().subtype & OpCode::Info::SrcInversed));
-
-            const int address_offset = (instr.common.address_register_index == 0)
-                                       ? 0 : state.address_registers[instr.common.address_register_index - 1];
-
-            const float24* src1_ = LookupSourceRegister(instr.common.GetSrc1(is_inverted) + (!is_inverted * address_offset));
-            const float24* src2_ = LookupSourceRegister(instr.common.GetSrc2(is_inverted) + ( is_inverted * address_offset));
-
-            const bool negate_src1 = ((bool)swizzle.negate_src1 != false);
-            const bool negate_src2 = ((bool)swizzle.negate_src2 != false);
-
-            float24 src1[4] = {
-                src1_[(int)swizzle.GetSelectorSrc1(0)],
-                src1_[(int)swizzle.GetSelectorSrc1(1)],
-                src1_[(int)swizzle.GetSelectorSrc1(2)],
-                src1_[(int)swizzle.GetSelectorSrc1(3)],
-            };
-            if (negate_src1) {
-                src1[0] = src1[0] * float24::FromFloat32(-1);
-                src1[1] = src1[1] * float24::FromFloat32(-1);
-                src1[2] = src1[2] * float24::FromFloat32(-1);
-                src1[3] = src1[3] * float24::FromFloat32(-1);
-            }
-            float24 src2[4] = {
-                src2_[(int)swizzle.GetSelectorSrc2(0)],
-                src2_[(int)swizzle.GetSelectorSrc2(1)],
-                src2_[(int)swizzle.GetSelectorSrc2(2)],
-                src2_[(int)swizzle.GetSelectorSrc2(3)],
-            };
-            if (negate_src2) {
-                src2[0] = src2[0] * float24::FromFloat32(-1);
-                src2[1] = src2[1] * float24::FromFloat32(-1);
-                src2[2] = src2[2] * float24::FromFloat32(-1);
-                src2[3] = src2[3] * float24::FromFloat32(-1);
-            }
-
-            float24* dest = (instr.common.dest.Value() < 0x10) ? &state.output_registers[instr.common.dest.Value().GetIndex()][0]
-                        : (instr.common.dest.Value() < 0x20) ? &state.temporary_registers[instr.common.dest.Value().GetIndex()][0]
-                        : dummy_vec4_float24;
+            float24 src1[4], src2[4];
+            LoadSource(instr.src[0], src1);
+            LoadSource(instr.src[1], src2);
 
-            state.debug.max_opdesc_id = std::max<u32>(state.debug.max_opdesc_id, 1+instr.common.operand_desc_id);
+            float24* dest = (instr.dest.file == IRRegisterFile::Output) ? &state.output_registers[instr.dest.index][0]
+                          : (instr.dest.file == IRRegisterFile::Temporary) ? &state.temporary_registers[instr.dest.index][0]
+                          : dummy_vec4_float24;
 
-            switch (instr.opcode.Value().EffectiveOpCode()) {
+            switch (instr.opcode) {
             case OpCode::Id::ADD:
             {
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!instr.DestComponentEnabled(i))
                         continue;
 
                     dest[i] = src1[i] + src2[i];
@@ -177,7 +195,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
             case OpCode::Id::MUL:
             {
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!instr.DestComponentEnabled(i))
                         continue;
 
                     dest[i] = src1[i] * src2[i];
@@ -188,7 +206,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
 
             case OpCode::Id::FLR:
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!instr.DestComponentEnabled(i))
                         continue;
 
                     dest[i] = float24::FromFloat32(std::floor(src1[i].ToFloat32()));
@@ -197,7 +215,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
 
             case OpCode::Id::MAX:
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!instr.DestComponentEnabled(i))
                         continue;
 
                     dest[i] = std::max(src1[i], src2[i]);
@@ -206,7 +224,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
 
             case OpCode::Id::MIN:
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!instr.DestComponentEnabled(i))
                         continue;
 
                     dest[i] = std::min(src1[i], src2[i]);
@@ -217,12 +235,12 @@ static void ProcessShaderCode(VertexShaderState& state) {
             case OpCode::Id::DP4:
             {
                 float24 dot = float24::FromFloat32(0.f);
-                int num_components = (instr.opcode.Value() == OpCode::Id::DP3) ? 3 : 4;
+                int num_components = (instr.opcode == OpCode::Id::DP3) ? 3 : 4;
                 for (int i = 0; i < num_components; ++i)
                     dot = dot + src1[i] * src2[i];
 
                 for (int i = 0; i < num_components; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!instr.DestComponentEnabled(i))
                         continue;
 
                     dest[i] = dot;
@@ -234,7 +252,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
             case OpCode::Id::RCP:
             {
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!instr.DestComponentEnabled(i))
                         continue;
 
                     // TODO: Be stable against division by zero!
@@ -249,7 +267,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
             case OpCode::Id::RSQ:
             {
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!instr.DestComponentEnabled(i))
                         continue;
 
                     // TODO: Be stable against division by zero!
@@ -263,7 +281,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
             case OpCode::Id::MOVA:
             {
                 for (int i = 0; i < 2; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!instr.DestComponentEnabled(i))
                         continue;
 
                     // TODO: Figure out how the rounding is done on hardware
@@ -276,7 +294,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
             case OpCode::Id::MOV:
             {
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!instr.DestComponentEnabled(i))
                         continue;
 
                     dest[i] = src1[i];
@@ -287,7 +305,7 @@ static void ProcessShaderCode(VertexShaderState& state) {
             case OpCode::Id::SLT:
             case OpCode::Id::SLTI:
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!instr.DestComponentEnabled(i))
                         continue;
 
                     dest[i] = (src1[i] < src2[i]) ? float24::FromFloat32(1.0f) : float24::FromFloat32(0.0f);
@@ -298,44 +316,40 @@ static void ProcessShaderCode(VertexShaderState& state) {
                 for (int i = 0; i < 2; ++i) {
                     // TODO: Can you restrict to one compare via dest masking?
 
-                    auto compare_op = instr.common.compare_op;
-                    auto op = (i == 0) ? compare_op.x.Value() : compare_op.y.Value();
-
-                    switch (op) {
-                        case compare_op.Equal:
+                    switch (instr.compare_op[i]) {
+                        case IRCompareOp::Equal:
                             state.conditional_code[i] = (src1[i] == src2[i]);
                             break;
 
-                        case compare_op.NotEqual:
+                        case IRCompareOp::NotEqual:
                             state.conditional_code[i] = (src1[i] != src2[i]);
                             break;
 
-                        case compare_op.LessThan:
+                        case IRCompareOp::LessThan:
                             state.conditional_code[i] = (src1[i] <  src2[i]);
                             break;
 
-                        case compare_op.LessEqual:
+                        case IRCompareOp::LessEqual:
                             state.conditional_code[i] = (src1[i] <= src2[i]);
                             break;
 
-                        case compare_op.GreaterThan:
+                        case IRCompareOp::GreaterThan:
                             state.conditional_code[i] = (src1[i] >  src2[i]);
                             break;
 
-                        case compare_op.GreaterEqual:
+                        case IRCompareOp::GreaterEqual:
                             state.conditional_code[i] = (src1[i] >= src2[i]);
                             break;
 
                         default:
-                            LOG_ERROR(HW_GPU, "Unknown compare mode %x", static_cast<int>(op));
+                            LOG_ERROR(HW_GPU, "Unknown compare mode in instruction 0x%08x", instr.hex);
                             break;
                     }
                 }
                 break;
 
             default:
-                LOG_ERROR(HW_GPU, "Unhandled arithmetic instruction: 0x%02x (%s): 0x%08x",
-                          (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name, instr.hex);
+                LogUnhandled("arithmetic ", instr);
                 DEBUG_ASSERT(false);
                 break;
             }
@@ -345,135 +359,61 @@ static void ProcessShaderCode(VertexShaderState& state) {
 
         case OpCode::Type::MultiplyAdd:
         {
-            if ((instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MAD) ||
-                (instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MADI)) {
-                const SwizzlePattern& swizzle = *(SwizzlePattern*)&swizzle_data[instr.mad.operand_desc_id];
-
-                bool is_inverted = (instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MADI);
-
-                const float24* src1_ = LookupSourceRegister(instr.mad.GetSrc1(is_inverted));
-                const float24* src2_ = LookupSourceRegister(instr.mad.GetSrc2(is_inverted));
-                const float24* src3_ = LookupSourceRegister(instr.mad.GetSrc3(is_inverted));
-
-                const bool negate_src1 = ((bool)swizzle.negate_src1 != false);
-                const bool negate_src2 = ((bool)swizzle.negate_src2 != false);
-                const bool negate_src3 = ((bool)swizzle.negate_src3 != false);
-
-                float24 src1[4] = {
-                    src1_[(int)swizzle.GetSelectorSrc1(0)],
-                    src1_[(int)swizzle.GetSelectorSrc1(1)],
-                    src1_[(int)swizzle.GetSelectorSrc1(2)],
-                    src1_[(int)swizzle.GetSelectorSrc1(3)],
-                };
-                if (negate_src1) {
-                    src1[0] = src1[0] * float24::FromFloat32(-1);
-                    src1[1] = src1[1] * float24::FromFloat32(-1);
-                    src1[2] = src1[2] * float24::FromFloat32(-1);
-                    src1[3] = src1[3] * float24::FromFloat32(-1);
-                }
-                float24 src2[4] = {
-                    src2_[(int)swizzle.GetSelectorSrc2(0)],
-                    src2_[(int)swizzle.GetSelectorSrc2(1)],
-                    src2_[(int)swizzle.GetSelectorSrc2(2)],
-                    src2_[(int)swizzle.GetSelectorSrc2(3)],
-                };
-                if (negate_src2) {
-                    src2[0] = src2[0] * float24::FromFloat32(-1);
-                    src2[1] = src2[1] * float24::FromFloat32(-1);
-                    src2[2] = src2[2] * float24::FromFloat32(-1);
-                    src2[3] = src2[3] * float24::FromFloat32(-1);
-                }
-                float24 src3[4] = {
-                    src3_[(int)swizzle.GetSelectorSrc3(0)],
-                    src3_[(int)swizzle.GetSelectorSrc3(1)],
-                    src3_[(int)swizzle.GetSelectorSrc3(2)],
-                    src3_[(int)swizzle.GetSelectorSrc3(3)],
-                };
-                if (negate_src3) {
-                    src3[0] = src3[0] * float24::FromFloat32(-1);
-                    src3[1] = src3[1] * float24::FromFloat32(-1);
-                    src3[2] = src3[2] * float24::FromFloat32(-1);
-                    src3[3] = src3[3] * float24::FromFloat32(-1);
-                }
+            if ((instr.opcode == OpCode::Id::MAD) || (instr.opcode == OpCode::Id::MADI)) {
+                float24 src1[4], src2[4], src3[4];
+                LoadSource(instr.src[0], src1);
+                LoadSource(instr.src[1], src2);
+                LoadSource(instr.src[2], src3);
 
-                float24* dest = (instr.mad.dest.Value() < 0x10) ? &state.output_registers[instr.mad.dest.Value().GetIndex()][0]
-                            : (instr.mad.dest.Value() < 0x20) ? &state.temporary_registers[instr.mad.dest.Value().GetIndex()][0]
-                            : dummy_vec4_float24;
+                float24* dest = (instr.dest.file == IRRegisterFile::Output) ? &state.output_registers[instr.dest.index][0]
+                              : (instr.dest.file == IRRegisterFile::Temporary) ? &state.temporary_registers[instr.dest.index][0]
+                              : dummy_vec4_float24;
 
                 for (int i = 0; i < 4; ++i) {
-                    if (!swizzle.DestComponentEnabled(i))
+                    if (!instr.DestComponentEnabled(i))
                         continue;
 
                     dest[i] = src1[i] * src2[i] + src3[i];
                 }
             } else {
-                LOG_ERROR(HW_GPU, "Unhandled multiply-add instruction: 0x%02x (%s): 0x%08x",
-                          (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name, instr.hex);
+                LogUnhandled("multiply-add ", instr);
             }
             break;
         }
 
         default:
         {
-            static auto evaluate_condition = [](const VertexShaderState& state, bool refx, bool refy, Instruction::FlowControlType flow_control) {
-                bool results[2] = { refx == state.conditional_code[0],
-                                    refy == state.conditional_code[1] };
-
-                switch (flow_control.op) {
-                case flow_control.Or:
-                    return results[0] || results[1];
-
-                case flow_control.And:
-                    return results[0] && results[1];
-
-                case flow_control.JustX:
-                    return results[0];
-
-                case flow_control.JustY:
-                    return results[1];
-                }
-            };
-
             // Handle each instruction on its own
-            switch (instr.opcode.Value()) {
+            switch (instr.opcode) {
             case OpCode::Id::END:
                 exit_loop = true;
                 break;
 
             case OpCode::Id::JMPC:
-                if (evaluate_condition(state, instr.flow_control.refx, instr.flow_control.refy, instr.flow_control)) {
-                    state.program_counter = &program_code[instr.flow_control.dest_offset] - 1;
+                if (evaluate_condition(instr)) {
+                    state.program_counter = instr.dest_offset - 1;
                 }
                 break;
 
             case OpCode::Id::JMPU:
-                if (uniforms.b[instr.flow_control.bool_uniform_id]) {
-                    state.program_counter = &program_code[instr.flow_control.dest_offset] - 1;
+                if (uniforms.b[instr.bool_uniform_id]) {
+                    state.program_counter = instr.dest_offset - 1;
                 }
                 break;
 
             case OpCode::Id::CALL:
-                call(state,
-                     instr.flow_control.dest_offset,
-                     instr.flow_control.num_instructions,
-                     binary_offset + 1, 0, 0);
+                call(instr.dest_offset, instr.dest_end - instr.dest_offset, binary_offset + 1, 0, 0);
                 break;
 
             case OpCode::Id::CALLU:
-                if (uniforms.b[instr.flow_control.bool_uniform_id]) {
-                    call(state,
-                        instr.flow_control.dest_offset,
-                        instr.flow_control.num_instructions,
-                        binary_offset + 1, 0, 0);
+                if (uniforms.b[instr.bool_uniform_id]) {
+                    call(instr.dest_offset, instr.dest_end - instr.dest_offset, binary_offset + 1, 0, 0);
                 }
                 break;
 
             case OpCode::Id::CALLC:
-                if (evaluate_condition(state, instr.flow_control.refx, instr.flow_control.refy, instr.flow_control)) {
-                    call(state,
-                        instr.flow_control.dest_offset,
-                        instr.flow_control.num_instructions,
-                        binary_offset + 1, 0, 0);
+                if (evaluate_condition(instr)) {
+                    call(instr.dest_offset, instr.dest_end - instr.dest_offset, binary_offset + 1, 0, 0);
                 }
                 break;
 
@@ -481,16 +421,10 @@ static void ProcessShaderCode(VertexShaderState& state) {
                 break;
 
             case OpCode::Id::IFU:
-                if (uniforms.b[instr.flow_control.bool_uniform_id]) {
-                    call(state,
-                         binary_offset + 1,
-                         instr.flow_control.dest_offset - binary_offset - 1,
-                         instr.flow_control.dest_offset + instr.flow_control.num_instructions, 0, 0);
+                if (uniforms.b[instr.bool_uniform_id]) {
+                    call(binary_offset + 1, instr.dest_offset - binary_offset - 1, instr.dest_end, 0, 0);
                 } else {
-                    call(state,
-                         instr.flow_control.dest_offset,
-                         instr.flow_control.num_instructions,
-                         instr.flow_control.dest_offset + instr.flow_control.num_instructions, 0, 0);
+                    call(instr.dest_offset, instr.dest_end - instr.dest_offset, instr.dest_end, 0, 0);
                 }
 
                 break;
@@ -499,16 +433,10 @@ static void ProcessShaderCode(VertexShaderState& state) {
             {
                 // TODO: Do we need to consider swizzlers here?
 
-                if (evaluate_condition(state, instr.flow_control.refx, instr.flow_control.refy, instr.flow_control)) {
-                    call(state,
-                         binary_offset + 1,
-                         instr.flow_control.dest_offset - binary_offset - 1,
-                         instr.flow_control.dest_offset + instr.flow_control.num_instructions, 0, 0);
+                if (evaluate_condition(instr)) {
+                    call(binary_offset + 1, instr.dest_offset - binary_offset - 1, instr.dest_end, 0, 0);
                 } else {
-                    call(state,
-                         instr.flow_control.dest_offset,
-                         instr.flow_control.num_instructions,
-                         instr.flow_control.dest_offset + instr.flow_control.num_instructions, 0, 0);
+                    call(instr.dest_offset, instr.dest_end - instr.dest_offset, instr.dest_end, 0, 0);
                 }
 
                 break;
@@ -516,20 +444,19 @@ static void ProcessShaderCode(VertexShaderState& state) {
 
             case OpCode::Id::LOOP:
             {
-                state.address_registers[2] = uniforms.i[instr.flow_control.int_uniform_id].y;
-
-                call(state,
-                     binary_offset + 1,
-                     instr.flow_control.dest_offset - binary_offset + 1,
-                     instr.flow_control.dest_offset + 1,
-                     uniforms.i[instr.flow_control.int_uniform_id].x,
-                     uniforms.i[instr.flow_control.int_uniform_id].z);
+                const auto& int_uniform = uniforms.i[instr.int_uniform_id];
+                state.address_registers[2] = int_uniform.y;
+
+                call(binary_offset + 1,
+                     instr.dest_offset - binary_offset + 1,
+                     instr.dest_offset + 1,
+                     int_uniform.x,
+                     int_uniform.z);
                 break;
             }
 
             default:
-                LOG_ERROR(HW_GPU, "Unhandled instruction: 0x%02x (%s): 0x%08x",
-                          (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name, instr.hex);
+                LogUnhandled("", instr);
                 break;
             }
 
@@ -546,17 +473,75 @@ static void ProcessShaderCode(VertexShaderState& state) {
 
 static Common::Profiling::TimingCategory shader_category("Vertex Shader");
 
-OutputVertex RunShader(const InputVertex& input, int num_attributes) {
-    Common::Profiling::ScopeTimer timer(shader_category);
+/// Assembles the output vertex from the output registers as mapped by the output attribute registers
+static OutputVertex GetOutputVertex(const Math::Vec4<float24> (&output_registers)[16]) {
+    const DerivedState::OutputLayout& layout = DerivedState::GetOutputLayout();
 
+    OutputVertex ret;
+    float24* slots = reinterpret_cast<float24*>(&ret);
+    for (u32 i = 0; i < layout.num_outputs; ++i) {
+        const auto& output = layout.outputs[i];
+        slots[output.slot] = output_registers[output.register_index][output.component];
+    }
+    // Zero attributes which aren't output, so that they won't have denormals in them, which would
+    // slow us down later.
+    for (u32 i = 0; i < layout.num_unused_slots; ++i)
+        slots[layout.unused_slots[i]] = float24::FromFloat32(0.0f);
+
+    LOG_TRACE(Render_Software, "Output vertex: pos (%.2f, %.2f, %.2f, %.2f), col(%.2f, %.2f, %.2f, %.2f), tc0(%.2f, %.2f)",
+        ret.pos.x.ToFloat32(), ret.pos.y.ToFloat32(), ret.pos.z.ToFloat32(), ret.pos.w.ToFloat32(),
+        ret.color.x.ToFloat32(), ret.color.y.ToFloat32(), ret.color.z.ToFloat32(), ret.color.w.ToFloat32(),
+        ret.tc0.u().ToFloat32(), ret.tc0.v().ToFloat32());
+
+    return ret;
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+/// Runs the shader through compiled code, returns false if the current program can't be compiled
+static bool RunCompiledShader(const InputVertex& input, int num_attributes, OutputVertex& output) {
+    CompiledShader shader = GetCompiledShader();
+    if (shader == nullptr)
+        return false;
+
+    const auto& attribute_register_map = g_state.regs.vs_input_register_map;
+    JitState state;
+    memset(state.input_registers, 0, sizeof(state.input_registers));
+    for (int i = 0; i < num_attributes; ++i)
+        state.input_registers[attribute_register_map.GetRegisterForAttribute(i)] = input.attr[i];
+    memset(state.address_registers, 0, sizeof(state.address_registers));
+    state.conditional_code[0] = false;
+    state.conditional_code[1] = false;
+
+    shader(&state);
+
+    output = GetOutputVertex(state.output_registers);
+    return true;
+}
+#endif
+
+/// Assembles the output vertices of a batch
+static void GetOutputVertices(const BatchRegister (&output_registers)[16], int num_vertices,
+                              OutputVertex* outputs) {
+    const DerivedState::OutputLayout& layout = DerivedState::GetOutputLayout();
+
+    for (int lane = 0; lane < num_vertices; ++lane) {
+        float24* slots = reinterpret_cast<float24*>(&outputs[lane]);
+        for (u32 i = 0; i < layout.num_outputs; ++i) {
+            const auto& output = layout.outputs[i];
+            slots[output.slot] = float24::FromFloat32(output_registers[output.register_index].comp[output.component][lane]);
+        }
+        // Zero attributes which aren't output, so that they won't have denormals in them, which
+        // would slow us down later.
+        for (u32 i = 0; i < layout.num_unused_slots; ++i)
+            slots[layout.unused_slots[i]] = float24::FromFloat32(0.0f);
+    }
+}
+
+static OutputVertex InterpretShader(const InputVertex& input, int num_attributes) {
     const auto& regs = g_state.regs;
-    const auto& vs = g_state.vs;
     VertexShaderState state;
 
-    const u32* main = &vs.program_code[regs.vs_main_offset];
-    state.program_counter = (u32*)main;
-    state.debug.max_offset = 0;
-    state.debug.max_opdesc_id = 0;
+    state.program_counter = regs.vs_main_offset;
 
     // Setup input register table
     const auto& attribute_register_map = regs.vs_input_register_map;
@@ -584,42 +569,67 @@ OutputVertex RunShader(const InputVertex& input, int num_attributes) {
     state.conditional_code[1] = false;
 
     ProcessShaderCode(state);
-    DebugUtils::DumpShader(vs.program_code.data(), state.debug.max_offset, vs.swizzle_data.data(),
-                           state.debug.max_opdesc_id, regs.vs_main_offset,
-                           regs.vs_output_attributes);
 
-    // Setup output data
-    OutputVertex ret;
-    // TODO(neobrain): Under some circumstances, up to 16 attributes may be output. We need to
-    // figure out what those circumstances are and enable the remaining outputs then.
-    for (int i = 0; i < 7; ++i) {
-        const auto& output_register_map = regs.vs_output_attributes[i];
-
-        u32 semantics[4] = {
-            output_register_map.map_x, output_register_map.map_y,
-            output_register_map.map_z, output_register_map.map_w
-        };
-
-        for (int comp = 0; comp < 4; ++comp) {
-            float24* out = ((float24*)&ret) + semantics[comp];
-            if (semantics[comp] != Regs::VSOutputAttributes::INVALID) {
-                *out = state.output_registers[i][comp];
-            } else {
-                // Zero output so that attributes which aren't output won't have denormals in them,
-                // which would slow us down later.
-                memset(out, 0, sizeof(*out));
-            }
-        }
+    return GetOutputVertex(state.output_registers);
+}
+
+OutputVertex RunShader(const InputVertex& input, int num_attributes) {
+    FINE_SCOPE_TIMER(timer, shader_category);
+
+    if (const TransformShader* transform = GetTransformShader()) {
+        OutputVertex output;
+        RunTransformShader(*transform, &input, 1, num_attributes, &output);
+        return output;
     }
 
-    LOG_TRACE(Render_Software, "Output vertex: pos (%.2f, %.2f, %.2f, %.2f), col(%.2f, %.2f, %.2f, %.2f), tc0(%.2f, %.2f)",
-        ret.pos.x.ToFloat32(), ret.pos.y.ToFloat32(), ret.pos.z.ToFloat32(), ret.pos.w.ToFloat32(),
-        ret.color.x.ToFloat32(), ret.color.y.ToFloat32(), ret.color.z.ToFloat32(), ret.color.w.ToFloat32(),
-        ret.tc0.u().ToFloat32(), ret.tc0.v().ToFloat32());
+#if defined(__x86_64__) || defined(_M_X64)
+    OutputVertex compiled_output;
+    if (Settings::values.use_shader_jit && RunCompiledShader(input, num_attributes, compiled_output))
+        return compiled_output;
+#endif
 
-    return ret;
+    return InterpretShader(input, num_attributes);
 }
 
+void RunShaderBatch(const InputVertex* inputs, int num_vertices, int num_attributes, OutputVertex* outputs) {
+    Common::Profiling::ScopeTimer timer(shader_category);
+
+    // Shaders which only move and transform their inputs don't need to be run at all
+    if (const TransformShader* transform = GetTransformShader()) {
+        RunTransformShader(*transform, inputs, num_vertices, num_attributes, outputs);
+        return;
+    }
+
+#if defined(__x86_64__) || defined(_M_X64)
+    if (Settings::values.use_shader_jit && GetCompiledShader() != nullptr) {
+        for (int i = 0; i < num_vertices; ++i)
+            RunCompiledShader(inputs[i], num_attributes, outputs[i]);
+        return;
+    }
+#endif
+
+    for (int start = 0; start < num_vertices; start += SHADER_BATCH_SIZE) {
+        const int batch_size = std::min(num_vertices - start, SHADER_BATCH_SIZE);
+
+        BatchRegister output_registers[16];
+        if (InterpretBatch(inputs + start, batch_size, num_attributes, output_registers)) {
+            GetOutputVertices(output_registers, batch_size, outputs + start);
+        } else {
+            for (int i = start; i < start + batch_size; ++i)
+                outputs[i] = InterpretShader(inputs[i], num_attributes);
+        }
+    }
+}
+
+void InvalidateShaderProgram() {
+    InvalidateCompiledShader();
+    InvalidateIRProgram();
+    InvalidateTransformShader();
+}
+
+void InvalidateShaderUniforms() {
+    InvalidateCompiledShaderUniforms();
+}
 
 } // namespace
 
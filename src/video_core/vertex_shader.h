@@ -22,6 +22,16 @@ struct InputVertex {
 struct OutputVertex {
     OutputVertex() = default;
 
+    /// Attributes which are interpolated across primitives, besides the position
+    enum Attribute : u32 {
+        ATTRIBUTE_COLOR = 1 << 0,
+        ATTRIBUTE_TC0   = 1 << 1,
+        ATTRIBUTE_TC1   = 1 << 2,
+        ATTRIBUTE_TC2   = 1 << 3,
+
+        ATTRIBUTE_ALL   = (1 << 4) - 1,
+    };
+
     // VS output attributes
     Math::Vec4<float24> pos;
     Math::Vec4<float24> dummy; // quaternions (not implemented, yet)
@@ -40,34 +50,63 @@ struct OutputVertex {
     Math::Vec3<float24> screenpos;
     float24 pad3;
 
-    // Linear interpolation
+    // Linear interpolation of the given attributes, the others keep their value
     // factor: 0=this, 1=vtx
-    void Lerp(float24 factor, const OutputVertex& vtx) {
-        pos = pos * factor + vtx.pos * (float24::FromFloat32(1) - factor);
+    void Lerp(float24 factor, const OutputVertex& vtx, u32 attributes = ATTRIBUTE_ALL) {
+        const float24 vtx_factor = float24::FromFloat32(1) - factor;
+
+        pos = pos * factor + vtx.pos * vtx_factor;
 
         // TODO: Should perform perspective correct interpolation here...
-        tc0 = tc0 * factor + vtx.tc0 * (float24::FromFloat32(1) - factor);
-        tc1 = tc1 * factor + vtx.tc1 * (float24::FromFloat32(1) - factor);
-        tc2 = tc2 * factor + vtx.tc2 * (float24::FromFloat32(1) - factor);
+        if (attributes & ATTRIBUTE_TC0)
+            tc0 = tc0 * factor + vtx.tc0 * vtx_factor;
+        if (attributes & ATTRIBUTE_TC1)
+            tc1 = tc1 * factor + vtx.tc1 * vtx_factor;
+        if (attributes & ATTRIBUTE_TC2)
+            tc2 = tc2 * factor + vtx.tc2 * vtx_factor;
 
-        screenpos = screenpos * factor + vtx.screenpos * (float24::FromFloat32(1) - factor);
+        screenpos = screenpos * factor + vtx.screenpos * vtx_factor;
 
-        color = color * factor + vtx.color * (float24::FromFloat32(1) - factor);
+        if (attributes & ATTRIBUTE_COLOR)
+            color = color * factor + vtx.color * vtx_factor;
     }
 
     // Linear interpolation
     // factor: 0=v0, 1=v1
-    static OutputVertex Lerp(float24 factor, const OutputVertex& v0, const OutputVertex& v1) {
+    static OutputVertex Lerp(float24 factor, const OutputVertex& v0, const OutputVertex& v1,
+                             u32 attributes = ATTRIBUTE_ALL) {
         OutputVertex ret = v0;
-        ret.Lerp(factor, v1);
+        ret.Lerp(factor, v1, attributes);
         return ret;
     }
 };
 static_assert(std::is_pod<OutputVertex>::value, "Structure is not POD");
 static_assert(sizeof(OutputVertex) == 32 * sizeof(float), "OutputVertex has invalid size");
 
+/// Number of vertices RunShaderBatch interprets in lockstep
+const int SHADER_BATCH_SIZE = 4;
+
 OutputVertex RunShader(const InputVertex& input, int num_attributes);
 
+/**
+ * Runs the vertex shader for a number of vertices. Without the JIT, SHADER_BATCH_SIZE vertices at a
+ * time are interpreted in lockstep, which decodes each instruction once per batch and lets the
+ * compiler vectorize the arithmetic across the vertices.
+ */
+void RunShaderBatch(const InputVertex* inputs, int num_vertices, int num_attributes, OutputVertex* outputs);
+
+/**
+ * Notes that the shader program or swizzle patterns were written to. They are compiled or
+ * translated again, or looked up in the caches, before the next vertex is shaded.
+ */
+void InvalidateShaderProgram();
+
+/**
+ * Notes that the boolean or integer uniforms were written to. The compiled shaders are specialized
+ * for their values, the variant for the new values is looked up before the next vertex is shaded.
+ */
+void InvalidateShaderUniforms();
+
 } // namespace
 
 } // namespace
@@ -0,0 +1,490 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <nihstro/shader_bytecode.h>
+
+#include "common/common_funcs.h"
+#include "common/logging/log.h"
+
+#include "pica.h"
+#include "vertex_shader_batch.h"
+#include "vertex_shader_ir.h"
+
+using nihstro::OpCode;
+using nihstro::Instruction;
+
+namespace Pica {
+
+namespace VertexShader {
+
+/// Bit i is set for the i-th vertex of a batch
+typedef u32 LaneMask;
+
+static const int LANES = SHADER_BATCH_SIZE;
+static const LaneMask ALL_LANES = (1 << LANES) - 1;
+
+/// Deepest nesting of IF, CALL and LOOP bodies followed before giving up on the batch
+static const int MAX_NESTING_DEPTH = 16;
+
+/// Values of a source operand for all vertices in a batch, after swizzling and negation
+typedef float SourceValues[4][LANES];
+
+struct BatchState {
+    BatchRegister input_registers[16];
+    BatchRegister temporary_registers[16];
+    BatchRegister output_registers[16];
+
+    s32 address_registers[3][LANES];
+    bool conditional_code[2][LANES];
+
+    /// Vertices that haven't reached an END instruction yet
+    LaneMask running;
+};
+
+/**
+ * Runs a shader the way ProcessShaderCode does, but with the call stack replaced by recursion:
+ * each call stack element the interpreter would push is a RunRange call here, so divergent
+ * branches can run one after the other with the vertices that take them.
+ */
+class BatchInterpreter {
+public:
+    explicit BatchInterpreter(BatchState& state) : state(state), program(GetIRProgram()) {}
+
+    bool Run(u32 main_offset) {
+        return RunRange(main_offset, NO_END, ALL_LANES, 0);
+    }
+
+private:
+    static const u32 NO_END = 0xFFFFFFFF;
+
+    /// Runs instructions from pc on until the program counter reaches end or no vertex is left
+    bool RunRange(u32 pc, u32 end, LaneMask active, int nesting) {
+        if (nesting > MAX_NESTING_DEPTH)
+            return false;
+
+        while (pc != end) {
+            active &= state.running;
+            if (active == 0)
+                return true;
+
+            if (pc >= program.size())
+                return false;
+
+            const IRInstruction& instr = program[pc];
+            switch (instr.type) {
+            case OpCode::Type::Arithmetic:
+                if (!RunArithmetic(instr, active))
+                    return false;
+                ++pc;
+                break;
+
+            case OpCode::Type::MultiplyAdd:
+                RunMultiplyAdd(instr, active);
+                ++pc;
+                break;
+
+            default:
+                if (!RunFlowControl(instr, pc, active, nesting))
+                    return false;
+                break;
+            }
+        }
+        return true;
+    }
+
+    /// Reads one component of a register for one vertex, offset by an address register
+    float ReadLane(const IRRegister& reg, int component, int lane) const {
+        switch (reg.file) {
+        case IRRegisterFile::Input:
+            return state.input_registers[reg.index].comp[component][lane];
+
+        case IRRegisterFile::Temporary:
+            return state.temporary_registers[reg.index].comp[component][lane];
+
+        case IRRegisterFile::FloatUniform:
+            return g_state.vs.uniforms.f[reg.index][component].ToFloat32();
+
+        default:
+            return 0.0f;
+        }
+    }
+
+    /// Loads a swizzled and optionally negated source operand
+    void LoadSource(SourceValues& values, const IRSource& source) const {
+        const u8* selectors = source.selectors;
+
+        if (source.address_register != 0) {
+            // Each vertex can address a different register
+            for (int lane = 0; lane < LANES; ++lane) {
+                const IRRegister offset_reg = ResolveSourceRegister(source.id + state.address_registers[source.address_register - 1][lane]);
+                for (int i = 0; i < 4; ++i)
+                    values[i][lane] = ReadLane(offset_reg, selectors[i], lane);
+            }
+        } else {
+            switch (source.reg.file) {
+            case IRRegisterFile::Input:
+            case IRRegisterFile::Temporary:
+            {
+                const BatchRegister& reg = (source.reg.file == IRRegisterFile::Input)
+                                           ? state.input_registers[source.reg.index]
+                                           : state.temporary_registers[source.reg.index];
+                for (int i = 0; i < 4; ++i)
+                    std::copy(reg.comp[selectors[i]], reg.comp[selectors[i]] + LANES, values[i]);
+                break;
+            }
+
+            case IRRegisterFile::FloatUniform:
+            {
+                const auto& uniform = g_state.vs.uniforms.f[source.reg.index];
+                for (int i = 0; i < 4; ++i)
+                    std::fill(values[i], values[i] + LANES, uniform[selectors[i]].ToFloat32());
+                break;
+            }
+
+            default:
+                for (int i = 0; i < 4; ++i)
+                    std::fill(values[i], values[i] + LANES, 0.0f);
+                break;
+            }
+        }
+
+        if (source.negate) {
+            for (int i = 0; i < 4; ++i)
+                for (int lane = 0; lane < LANES; ++lane)
+                    values[i][lane] = values[i][lane] * -1.0f;
+        }
+    }
+
+    /// Writes the enabled components of the active vertices to the destination register
+    void StoreDest(const IRInstruction& instr, const SourceValues& result, int num_components, LaneMask active) {
+        if (instr.dest.file == IRRegisterFile::None)
+            return;
+
+        BatchRegister& dest = (instr.dest.file == IRRegisterFile::Output)
+                              ? state.output_registers[instr.dest.index]
+                              : state.temporary_registers[instr.dest.index];
+        for (int i = 0; i < num_components; ++i) {
+            if (!instr.DestComponentEnabled(i))
+                continue;
+
+            if (active == ALL_LANES) {
+                std::copy(result[i], result[i] + LANES, dest.comp[i]);
+            } else {
+                for (int lane = 0; lane < LANES; ++lane) {
+                    if (active & (1 << lane))
+                        dest.comp[i][lane] = result[i][lane];
+                }
+            }
+        }
+    }
+
+    bool RunArithmetic(const IRInstruction& instr, LaneMask active) {
+        SourceValues src1, src2;
+        LoadSource(src1, instr.src[0]);
+        LoadSource(src2, instr.src[1]);
+
+        SourceValues result;
+        int num_components = 4;
+
+        switch (instr.opcode) {
+        case OpCode::Id::ADD:
+            for (int i = 0; i < 4; ++i)
+                for (int lane = 0; lane < LANES; ++lane)
+                    result[i][lane] = src1[i][lane] + src2[i][lane];
+            break;
+
+        case OpCode::Id::MUL:
+            for (int i = 0; i < 4; ++i)
+                for (int lane = 0; lane < LANES; ++lane)
+                    result[i][lane] = src1[i][lane] * src2[i][lane];
+            break;
+
+        case OpCode::Id::FLR:
+            for (int i = 0; i < 4; ++i)
+                for (int lane = 0; lane < LANES; ++lane)
+                    result[i][lane] = std::floor(src1[i][lane]);
+            break;
+
+        case OpCode::Id::MAX:
+            for (int i = 0; i < 4; ++i)
+                for (int lane = 0; lane < LANES; ++lane)
+                    result[i][lane] = std::max(src1[i][lane], src2[i][lane]);
+            break;
+
+        case OpCode::Id::MIN:
+            for (int i = 0; i < 4; ++i)
+                for (int lane = 0; lane < LANES; ++lane)
+                    result[i][lane] = std::min(src1[i][lane], src2[i][lane]);
+            break;
+
+        case OpCode::Id::DP3:
+        case OpCode::Id::DP4:
+        {
+            num_components = (instr.opcode == OpCode::Id::DP3) ? 3 : 4;
+            for (int lane = 0; lane < LANES; ++lane) {
+                float dot = 0.0f;
+                for (int i = 0; i < num_components; ++i)
+                    dot = dot + src1[i][lane] * src2[i][lane];
+                for (int i = 0; i < 4; ++i)
+                    result[i][lane] = dot;
+            }
+            break;
+        }
+
+        case OpCode::Id::RCP:
+            for (int i = 0; i < 4; ++i)
+                for (int lane = 0; lane < LANES; ++lane)
+                    result[i][lane] = 1.0f / src1[i][lane];
+            break;
+
+        case OpCode::Id::RSQ:
+            for (int i = 0; i < 4; ++i)
+                for (int lane = 0; lane < LANES; ++lane)
+                    result[i][lane] = 1.0f / sqrt(src1[i][lane]);
+            break;
+
+        case OpCode::Id::MOVA:
+            for (int i = 0; i < 2; ++i) {
+                if (!instr.DestComponentEnabled(i))
+                    continue;
+
+                for (int lane = 0; lane < LANES; ++lane) {
+                    if (active & (1 << lane))
+                        state.address_registers[i][lane] = static_cast<s32>(src1[i][lane]);
+                }
+            }
+            return true;
+
+        case OpCode::Id::MOV:
+            for (int i = 0; i < 4; ++i)
+                std::copy(src1[i], src1[i] + LANES, result[i]);
+            break;
+
+        case OpCode::Id::SLT:
+        case OpCode::Id::SLTI:
+            for (int i = 0; i < 4; ++i)
+                for (int lane = 0; lane < LANES; ++lane)
+                    result[i][lane] = (src1[i][lane] < src2[i][lane]) ? 1.0f : 0.0f;
+            break;
+
+        case OpCode::Id::CMP:
+            for (int i = 0; i < 2; ++i) {
+                for (int lane = 0; lane < LANES; ++lane) {
+                    if (!(active & (1 << lane)))
+                        continue;
+
+                    const float a = src1[i][lane];
+                    const float b = src2[i][lane];
+                    bool& cc = state.conditional_code[i][lane];
+                    switch (instr.compare_op[i]) {
+                    case IRCompareOp::Equal:        cc = (a == b); break;
+                    case IRCompareOp::NotEqual:     cc = (a != b); break;
+                    case IRCompareOp::LessThan:     cc = (a <  b); break;
+                    case IRCompareOp::LessEqual:    cc = (a <= b); break;
+                    case IRCompareOp::GreaterThan:  cc = (a >  b); break;
+                    case IRCompareOp::GreaterEqual: cc = (a >= b); break;
+                    default:
+                        // Leaves the conditional code as it is, like the interpreter
+                        break;
+                    }
+                }
+            }
+            return true;
+
+        default:
+            // Let the interpreter report it
+            return false;
+        }
+
+        StoreDest(instr, result, num_components, active);
+        return true;
+    }
+
+    static void LogUnhandled(const char* kind, const IRInstruction& instr) {
+        Instruction raw;
+        raw.hex = instr.hex;
+        LOG_ERROR(HW_GPU, "Unhandled %sinstruction: 0x%02x (%s): 0x%08x",
+                  kind, (int)instr.opcode, raw.opcode.Value().GetInfo().name, instr.hex);
+    }
+
+    void RunMultiplyAdd(const IRInstruction& instr, LaneMask active) {
+        if (instr.opcode != OpCode::Id::MAD && instr.opcode != OpCode::Id::MADI) {
+            LogUnhandled("multiply-add ", instr);
+            return;
+        }
+
+        SourceValues src1, src2, src3;
+        LoadSource(src1, instr.src[0]);
+        LoadSource(src2, instr.src[1]);
+        LoadSource(src3, instr.src[2]);
+
+        SourceValues result;
+        for (int i = 0; i < 4; ++i)
+            for (int lane = 0; lane < LANES; ++lane)
+                result[i][lane] = src1[i][lane] * src2[i][lane] + src3[i][lane];
+
+        StoreDest(instr, result, 4, active);
+    }
+
+    /// Returns the active vertices for which the condition of a flow control instruction holds
+    LaneMask EvaluateCondition(const IRInstruction& instr, LaneMask active) const {
+        LaneMask result = 0;
+        for (int lane = 0; lane < LANES; ++lane) {
+            const bool results[2] = { instr.refx == state.conditional_code[0][lane],
+                                      instr.refy == state.conditional_code[1][lane] };
+
+            bool taken = false;
+            switch (instr.condition) {
+            case IRCondition::Or:    taken = results[0] || results[1]; break;
+            case IRCondition::And:   taken = results[0] && results[1]; break;
+            case IRCondition::JustX: taken = results[0]; break;
+            case IRCondition::JustY: taken = results[1]; break;
+            }
+
+            if (taken)
+                result |= 1 << lane;
+        }
+        return result & active;
+    }
+
+    /// Runs an IF with the vertices for which its condition holds and those for which it doesn't
+    bool RunIf(const IRInstruction& instr, u32& pc, LaneMask then_lanes, LaneMask else_lanes, int nesting) {
+        if (then_lanes != 0 && !RunRange(pc + 1, instr.dest_offset, then_lanes, nesting + 1))
+            return false;
+        if (else_lanes != 0 && !RunRange(instr.dest_offset, instr.dest_end, else_lanes, nesting + 1))
+            return false;
+
+        pc = instr.dest_end;
+        return true;
+    }
+
+    bool RunFlowControl(const IRInstruction& instr, u32& pc, LaneMask active, int nesting) {
+        const auto& uniforms = g_state.vs.uniforms;
+        const u32 dest = instr.dest_offset;
+
+        switch (instr.opcode) {
+        case OpCode::Id::END:
+            state.running &= ~active;
+            return true;
+
+        case OpCode::Id::JMPC:
+        {
+            // Lockstep execution can't follow vertices jumping to different places
+            const LaneMask taken = EvaluateCondition(instr, active);
+            if (taken != 0 && taken != active)
+                return false;
+            pc = (taken != 0) ? dest : pc + 1;
+            return true;
+        }
+
+        case OpCode::Id::JMPU:
+            pc = uniforms.b[instr.bool_uniform_id] ? dest : pc + 1;
+            return true;
+
+        case OpCode::Id::CALL:
+            if (!RunRange(dest, instr.dest_end, active, nesting + 1))
+                return false;
+            ++pc;
+            return true;
+
+        case OpCode::Id::CALLU:
+            if (uniforms.b[instr.bool_uniform_id] && !RunRange(dest, instr.dest_end, active, nesting + 1))
+                return false;
+            ++pc;
+            return true;
+
+        case OpCode::Id::CALLC:
+        {
+            const LaneMask taken = EvaluateCondition(instr, active);
+            if (taken != 0 && !RunRange(dest, instr.dest_end, taken, nesting + 1))
+                return false;
+            ++pc;
+            return true;
+        }
+
+        case OpCode::Id::NOP:
+            ++pc;
+            return true;
+
+        case OpCode::Id::IFU:
+            if (uniforms.b[instr.bool_uniform_id])
+                return RunIf(instr, pc, active, 0, nesting);
+            return RunIf(instr, pc, 0, active, nesting);
+
+        case OpCode::Id::IFC:
+        {
+            // TODO: Do we need to consider swizzlers here?
+            const LaneMask taken = EvaluateCondition(instr, active);
+            return RunIf(instr, pc, taken, active & ~taken, nesting);
+        }
+
+        case OpCode::Id::LOOP:
+        {
+            const auto& int_uniform = uniforms.i[instr.int_uniform_id];
+            for (int lane = 0; lane < LANES; ++lane) {
+                if (active & (1 << lane))
+                    state.address_registers[2][lane] = int_uniform.y;
+            }
+
+            // The body runs x + 1 times, and z is added to the loop counter after each iteration
+            for (u32 iteration = 0; iteration <= int_uniform.x; ++iteration) {
+                if (!RunRange(pc + 1, dest + 2, active, nesting + 1))
+                    return false;
+
+                active &= state.running;
+                for (int lane = 0; lane < LANES; ++lane) {
+                    if (active & (1 << lane))
+                        state.address_registers[2][lane] += int_uniform.z;
+                }
+            }
+
+            pc = dest + 1;
+            return true;
+        }
+
+        default:
+            LogUnhandled("", instr);
+            ++pc;
+            return true;
+        }
+    }
+
+    BatchState& state;
+    const IRProgram& program;
+};
+
+bool InterpretBatch(const InputVertex* inputs, int num_vertices, int num_attributes,
+                    BatchRegister (&output_registers)[16]) {
+    const auto& regs = g_state.regs;
+
+    BatchState state;
+    memset(&state, 0, sizeof(state));
+    state.running = ALL_LANES;
+
+    // Unused lanes repeat the last vertex, so that they never take a branch the others don't
+    const auto& attribute_register_map = regs.vs_input_register_map;
+    for (int i = 0; i < num_attributes; ++i) {
+        BatchRegister& reg = state.input_registers[attribute_register_map.GetRegisterForAttribute(i)];
+        for (int lane = 0; lane < LANES; ++lane) {
+            const auto& attribute = inputs[std::min(lane, num_vertices - 1)].attr[i];
+            for (int comp = 0; comp < 4; ++comp)
+                reg.comp[comp][lane] = attribute[comp].ToFloat32();
+        }
+    }
+
+    BatchInterpreter interpreter(state);
+    if (!interpreter.Run(regs.vs_main_offset))
+        return false;
+
+    memcpy(output_registers, state.output_registers, sizeof(state.output_registers));
+    return true;
+}
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,30 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "vertex_shader.h"
+
+namespace Pica {
+
+namespace VertexShader {
+
+/// A vector register of all vertices in a batch, stored component by component
+struct BatchRegister {
+    float comp[4][SHADER_BATCH_SIZE];
+};
+
+/**
+ * Interprets the current vertex shader for up to SHADER_BATCH_SIZE vertices in lockstep. Branches
+ * depending on the conditional codes are followed with a mask of the vertices taking them.
+ * @param output_registers Receives the output registers of all vertices
+ * @return false if the vertices took a conditional jump in different directions, which can't be
+ *         followed in lockstep. The batch then has to be interpreted one vertex at a time.
+ */
+bool InterpretBatch(const InputVertex* inputs, int num_vertices, int num_attributes,
+                    BatchRegister (&output_registers)[16]);
+
+} // namespace
+
+} // namespace
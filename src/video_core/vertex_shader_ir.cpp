@@ -0,0 +1,188 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "common/hash.h"
+#include "common/logging/log.h"
+
+#include "vertex_shader_ir.h"
+
+using nihstro::OpCode;
+using nihstro::Instruction;
+using nihstro::SwizzlePattern;
+
+namespace Pica {
+
+namespace VertexShader {
+
+/// Translated programs kept before all of them are dropped to make space for new ones
+static const size_t MAX_CACHED_PROGRAMS = 32;
+
+/// Translated programs by the hashes of their program code and swizzle patterns
+static std::map<std::pair<u64, u64>, std::unique_ptr<IRProgram>> program_cache;
+
+static bool program_dirty = true;
+static const IRProgram* current_program = nullptr;
+
+static IRRegister ResolveDestRegister(u32 id) {
+    if (id < 0x10)
+        return { IRRegisterFile::Output, static_cast<u8>(id) };
+    if (id < 0x20)
+        return { IRRegisterFile::Temporary, static_cast<u8>(id - 0x10) };
+    return { IRRegisterFile::None, 0 };
+}
+
+static IRSource TranslateSource(u32 id, int address_register, const SwizzlePattern& swizzle, int source_index) {
+    IRSource source;
+    source.reg = ResolveSourceRegister(id);
+    source.id = static_cast<u8>(id);
+    source.address_register = static_cast<u8>(address_register);
+
+    for (int i = 0; i < 4; ++i) {
+        const SwizzlePattern::Selector selector = (source_index == 0) ? swizzle.GetSelectorSrc1(i)
+                                                : (source_index == 1) ? swizzle.GetSelectorSrc2(i)
+                                                : swizzle.GetSelectorSrc3(i);
+        source.selectors[i] = static_cast<u8>(selector);
+    }
+
+    source.negate = (source_index == 0) ? (bool)swizzle.negate_src1
+                  : (source_index == 1) ? (bool)swizzle.negate_src2
+                  : (bool)swizzle.negate_src3;
+    return source;
+}
+
+static u8 GetDestMask(const SwizzlePattern& swizzle) {
+    u8 mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (swizzle.DestComponentEnabled(i))
+            mask |= 1 << i;
+    }
+    return mask;
+}
+
+template <typename CompareOpType>
+static IRCompareOp TranslateCompareOp(const CompareOpType& compare_op, int component) {
+    switch ((component == 0) ? compare_op.x.Value() : compare_op.y.Value()) {
+    case compare_op.Equal:        return IRCompareOp::Equal;
+    case compare_op.NotEqual:     return IRCompareOp::NotEqual;
+    case compare_op.LessThan:     return IRCompareOp::LessThan;
+    case compare_op.LessEqual:    return IRCompareOp::LessEqual;
+    case compare_op.GreaterThan:  return IRCompareOp::GreaterThan;
+    case compare_op.GreaterEqual: return IRCompareOp::GreaterEqual;
+    default:                      return IRCompareOp::Invalid;
+    }
+}
+
+static IRCondition TranslateCondition(const Instruction::FlowControlType& flow_control) {
+    switch (flow_control.op) {
+    case flow_control.Or:    return IRCondition::Or;
+    case flow_control.And:   return IRCondition::And;
+    case flow_control.JustX: return IRCondition::JustX;
+    default:                 return IRCondition::JustY;
+    }
+}
+
+static IRInstruction TranslateInstruction(u32 hex) {
+    const auto& swizzle_data = g_state.vs.swizzle_data;
+
+    Instruction instr;
+    instr.hex = hex;
+
+    IRInstruction ir = {};
+    ir.type = instr.opcode.Value().GetInfo().type;
+    ir.hex = hex;
+
+    switch (ir.type) {
+    case OpCode::Type::Arithmetic:
+    {
+        const SwizzlePattern& swizzle = *(SwizzlePattern*)&swizzle_data[instr.common.operand_desc_id];
+        const bool is_inverted = (0 != (instr.opcode.Value().GetInfo().subtype & OpCode::Info::SrcInversed));
+        const int address_register = instr.common.address_register_index;
+
+        ir.opcode = instr.opcode.Value().EffectiveOpCode();
+        ir.src[0] = TranslateSource(instr.common.GetSrc1(is_inverted), is_inverted ? 0 : address_register, swizzle, 0);
+        ir.src[1] = TranslateSource(instr.common.GetSrc2(is_inverted), is_inverted ? address_register : 0, swizzle, 1);
+        ir.dest = ResolveDestRegister(instr.common.dest.Value());
+        ir.dest_mask = GetDestMask(swizzle);
+        ir.compare_op[0] = TranslateCompareOp(instr.common.compare_op, 0);
+        ir.compare_op[1] = TranslateCompareOp(instr.common.compare_op, 1);
+        break;
+    }
+
+    case OpCode::Type::MultiplyAdd:
+    {
+        const SwizzlePattern& swizzle = *(SwizzlePattern*)&swizzle_data[instr.mad.operand_desc_id];
+        const bool is_inverted = (instr.opcode.Value().EffectiveOpCode() == OpCode::Id::MADI);
+
+        ir.opcode = instr.opcode.Value().EffectiveOpCode();
+        ir.src[0] = TranslateSource(instr.mad.GetSrc1(is_inverted), 0, swizzle, 0);
+        ir.src[1] = TranslateSource(instr.mad.GetSrc2(is_inverted), 0, swizzle, 1);
+        ir.src[2] = TranslateSource(instr.mad.GetSrc3(is_inverted), 0, swizzle, 2);
+        ir.dest = ResolveDestRegister(instr.mad.dest.Value());
+        ir.dest_mask = GetDestMask(swizzle);
+        break;
+    }
+
+    default:
+        ir.opcode = instr.opcode.Value();
+        ir.condition = TranslateCondition(instr.flow_control);
+        ir.refx = instr.flow_control.refx != 0;
+        ir.refy = instr.flow_control.refy != 0;
+        ir.bool_uniform_id = static_cast<u8>(instr.flow_control.bool_uniform_id);
+        ir.int_uniform_id = static_cast<u8>(instr.flow_control.int_uniform_id);
+        ir.dest_offset = instr.flow_control.dest_offset;
+        ir.dest_end = instr.flow_control.dest_offset + instr.flow_control.num_instructions;
+        break;
+    }
+
+    return ir;
+}
+
+static std::unique_ptr<IRProgram> TranslateProgram() {
+    const auto& program_code = g_state.vs.program_code;
+
+    std::unique_ptr<IRProgram> program(new IRProgram);
+    for (size_t offset = 0; offset < program_code.size(); ++offset)
+        (*program)[offset] = TranslateInstruction(program_code[offset]);
+    return program;
+}
+
+const IRProgram& GetIRProgram() {
+    if (!program_dirty && current_program != nullptr)
+        return *current_program;
+
+    const auto key = std::make_pair(
+            Common::ComputeHash64(g_state.vs.program_code.data(), sizeof(g_state.vs.program_code)),
+            Common::ComputeHash64(g_state.vs.swizzle_data.data(), sizeof(g_state.vs.swizzle_data)));
+    program_dirty = false;
+
+    auto it = program_cache.find(key);
+    if (it == program_cache.end()) {
+        if (program_cache.size() >= MAX_CACHED_PROGRAMS)
+            program_cache.clear();
+
+        LOG_DEBUG(HW_GPU, "Translating vertex shader program %016llx", static_cast<unsigned long long>(key.first));
+        it = program_cache.emplace(key, TranslateProgram()).first;
+    }
+
+    current_program = it->second.get();
+    return *current_program;
+}
+
+void InvalidateIRProgram() {
+    program_dirty = true;
+}
+
+void ClearIRCache() {
+    program_cache.clear();
+    current_program = nullptr;
+    program_dirty = true;
+}
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,143 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <array>
+
+#include <nihstro/shader_bytecode.h>
+
+#include "common/common_funcs.h"
+#include "common/common_types.h"
+
+#include "pica.h"
+
+namespace Pica {
+
+namespace VertexShader {
+
+/// Register file an operand of a pre-decoded instruction refers to
+enum class IRRegisterFile : u8 {
+    Input,
+    Temporary,
+    FloatUniform,
+    Output,
+    None,       ///< Reads as zero, writes are discarded
+};
+
+enum class IRCompareOp : u8 {
+    Equal,
+    NotEqual,
+    LessThan,
+    LessEqual,
+    GreaterThan,
+    GreaterEqual,
+    Invalid,    ///< Leaves the conditional code as it is
+};
+
+/// How the two conditional codes are combined by conditional flow control
+enum class IRCondition : u8 {
+    Or,
+    And,
+    JustX,
+    JustY,
+};
+
+/// Register file and index of a register
+struct IRRegister {
+    IRRegisterFile file;
+    u8 index;
+};
+
+/**
+ * Resolves the register id of a source operand, as encoded in an instruction and offset by an
+ * address register, to the register it refers to.
+ */
+inline IRRegister ResolveSourceRegister(u32 id) {
+    if (id < 0x10)
+        return { IRRegisterFile::Input, static_cast<u8>(id) };
+    if (id < 0x20)
+        return { IRRegisterFile::Temporary, static_cast<u8>(id - 0x10) };
+    if (id < 0x20 + ARRAY_SIZE(g_state.vs.uniforms.f))
+        return { IRRegisterFile::FloatUniform, static_cast<u8>(id - 0x20) };
+    return { IRRegisterFile::None, 0 };
+}
+
+struct IRSource {
+    /// Register read when no address register offsets the operand
+    IRRegister reg;
+
+    /// Register id as encoded in the instruction, to offset by the address register
+    u8 id;
+
+    /// Index plus one of the address register offsetting the register, 0 for none
+    u8 address_register;
+
+    bool negate;
+
+    /// Component of the register read for each component of the operand
+    u8 selectors[4];
+};
+
+/**
+ * An instruction of a shader program with its swizzle pattern applied and all of its fields
+ * extracted, so that interpreting it doesn't have to decode any BitFields.
+ */
+struct IRInstruction {
+    nihstro::OpCode::Type type;
+
+    /// Effective opcode of arithmetic and multiply-add instructions, the opcode of all others
+    nihstro::OpCode::Id opcode;
+
+    /// Original encoding, for error messages
+    u32 hex;
+
+    IRSource src[3];
+
+    IRRegister dest;
+
+    /// Bit i is set if component i of the destination is written
+    u8 dest_mask;
+
+    /// Comparisons of CMP for the x and y components
+    IRCompareOp compare_op[2];
+
+    // Flow control
+    IRCondition condition;
+    bool refx;
+    bool refy;
+    u8 bool_uniform_id;
+    u8 int_uniform_id;
+
+    /// Target of jumps and calls, start of the ELSE body of IFs and last instruction of LOOP bodies
+    u32 dest_offset;
+
+    /// End of the instructions called or of the ELSE body, dest_offset + num_instructions
+    u32 dest_end;
+
+    bool DestComponentEnabled(int i) const {
+        return (dest_mask & (1 << i)) != 0;
+    }
+};
+
+/// Pre-decoded instructions of the whole program memory, indexed like program_code
+typedef std::array<IRInstruction, sizeof(g_state.vs.program_code) / sizeof(u32)> IRProgram;
+
+/**
+ * Returns the shader program and swizzle patterns that are currently set up, translated to pre-
+ * decoded instructions. Programs are translated the first time they are used after an upload and
+ * cached by a hash of their code, so switching back and forth between programs doesn't translate
+ * them again.
+ */
+const IRProgram& GetIRProgram();
+
+/// Notes that the shader program or swizzle patterns were written to
+void InvalidateIRProgram();
+
+/// Frees all translated programs
+void ClearIRCache();
+
+} // namespace
+
+} // namespace
@@ -0,0 +1,942 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include <nihstro/shader_bytecode.h>
+
+#include "common/assert.h"
+#include "common/logging/log.h"
+#include "common/memory_util.h"
+#include "common/x64_emitter.h"
+
+#include "pica.h"
+#include "vertex_shader_jit.h"
+
+using nihstro::OpCode;
+using nihstro::Instruction;
+using nihstro::RegisterType;
+using nihstro::SourceRegister;
+using nihstro::SwizzlePattern;
+
+using Common::AluOp;
+using Common::Condition;
+using Common::MemOperand;
+using Common::ShiftOp;
+using Common::SSEOp;
+using Common::X64Emitter;
+using Common::X64Reg;
+using Common::XmmReg;
+
+namespace Pica {
+
+namespace VertexShader {
+
+static const size_t CODE_BUFFER_SIZE = 8 * 1024 * 1024;
+
+/// Most instructions compiled into one shader, counting inlined subroutines and branches
+static const int MAX_COMPILED_INSTRUCTIONS = 2048;
+/// Upper bound of the code size of one compiled instruction
+static const size_t MAX_INSTRUCTION_CODE_SIZE = 512;
+static const size_t MAX_SHADER_CODE_SIZE = MAX_COMPILED_INSTRUCTIONS * MAX_INSTRUCTION_CODE_SIZE;
+/// Deepest nesting of IF, CALL and LOOP bodies
+static const int MAX_NESTING_DEPTH = 8;
+
+/// Number of float uniforms, relative accesses past them read zero
+static const u32 NUM_FLOAT_UNIFORMS = 96;
+
+/// Variants compiled for different uniform values of one program, before one reading them is compiled
+static const size_t MAX_SHADER_VARIANTS = 8;
+/// Most iterations of a LOOP unrolled by a specialized shader, and most instructions in its body
+static const u32 MAX_UNROLLED_ITERATIONS = 4;
+static const u32 MAX_UNROLLED_BODY_SIZE = 32;
+
+// The JitState pointer is passed in the first argument register. Everything else the compiled code
+// uses is caller-saved in both the System V and the Windows calling convention.
+#ifdef _WIN32
+static const X64Reg STATE = X64Reg::RCX;
+#else
+static const X64Reg STATE = X64Reg::RDI;
+#endif
+static const X64Reg UNIFORMS = X64Reg::R8;
+
+static const XmmReg XMM0 = XmmReg::XMM0;
+static const XmmReg XMM1 = XmmReg::XMM1;
+static const XmmReg XMM2 = XmmReg::XMM2;
+static const XmmReg XMM3 = XmmReg::XMM3;
+// Scratch register of StoreDest
+static const XmmReg XMM4 = XmmReg::XMM4;
+
+// CMPPS predicates
+static const u8 CMP_EQ = 0;
+static const u8 CMP_LT = 1;
+static const u8 CMP_LE = 2;
+static const u8 CMP_NEQ = 4;
+
+/// Constants referenced by the compiled code, placed at the start of the code buffer
+struct JitConstants {
+    u32 sign_mask[4];
+    u32 abs_mask[4];
+    float one[4];
+    float two_pow_23[4];
+    /// Per destination mask, all bits set in the enabled components
+    u32 component_masks[16][4];
+};
+
+/**
+ * A shader compiled with the boolean and integer uniforms its flow control reads baked in as
+ * constants: the IFU, CALLU and JMPU not taken are left out, and the short LOOPs are unrolled. It
+ * is used as long as those uniforms keep their values, the other uniforms don't matter to it. A
+ * variant without specialization reads the uniforms at run time and is used for any values.
+ */
+struct ShaderVariant {
+    /// Boolean uniforms the code is specialized for, and their values
+    u16 bool_mask;
+    u16 bool_values;
+    /// Integer uniforms the code is specialized for, LOOP reads x, y and z of them
+    u8 int_mask;
+    Math::Vec4<u8> int_values[4];
+
+    /// nullptr if the program can't be compiled
+    CompiledShader shader;
+};
+
+static u8* code_buffer = nullptr;
+static JitConstants* constants = nullptr;
+static X64Emitter emit;
+
+/// Compiled variants by the hash of their program, the unspecialized one last
+static std::unordered_map<u64, std::vector<ShaderVariant>> shader_cache;
+
+static bool program_dirty = true;
+static bool uniforms_dirty = true;
+static u64 program_hash;
+static u32 current_main_offset;
+static CompiledShader current_shader = nullptr;
+
+static MemOperand StateOperand(size_t offset) {
+    return MemOperand::Disp(STATE, static_cast<s32>(offset));
+}
+
+static MemOperand InputRegister(int index) {
+    return StateOperand(offsetof(JitState, input_registers) + index * sizeof(Math::Vec4<float24>));
+}
+
+static MemOperand TemporaryRegister(int index) {
+    return StateOperand(offsetof(JitState, temporary_registers) + index * sizeof(Math::Vec4<float24>));
+}
+
+static MemOperand AddressRegister(int index) {
+    return StateOperand(offsetof(JitState, address_registers) + index * sizeof(s32));
+}
+
+static MemOperand LoopCounter(int depth) {
+    return StateOperand(offsetof(JitState, loop_counters) + depth * sizeof(u32));
+}
+
+static MemOperand ConditionalCode(int index) {
+    return StateOperand(offsetof(JitState, conditional_code) + index);
+}
+
+/// Returns the offset of a uniform member relative to the uniforms base register
+static s32 UniformOffset(const void* member) {
+    return static_cast<s32>(static_cast<const u8*>(member) -
+                            reinterpret_cast<const u8*>(&g_state.vs.uniforms));
+}
+
+/**
+ * Returns the offset of a destination register in the JitState, or -1 if writes to it are
+ * discarded, matching which registers the interpreter writes to.
+ */
+template <typename DestRegister>
+static int GetDestOffset(const DestRegister& dest) {
+    if (dest < 0x10)
+        return offsetof(JitState, output_registers) + dest.GetIndex() * sizeof(Math::Vec4<float24>);
+    if (dest < 0x20)
+        return offsetof(JitState, temporary_registers) + dest.GetIndex() * sizeof(Math::Vec4<float24>);
+    return -1;
+}
+
+/// Returns the boolean uniforms as a bit mask
+static u16 GetBoolUniforms() {
+    u16 values = 0;
+    for (unsigned i = 0; i < 16; ++i)
+        values |= g_state.vs.uniforms.b[i] ? (1 << i) : 0;
+    return values;
+}
+
+/// Checks whether the uniforms a variant is specialized for have the values it was compiled with
+static bool MatchesUniforms(const ShaderVariant& variant) {
+    if ((GetBoolUniforms() & variant.bool_mask) != variant.bool_values)
+        return false;
+
+    for (unsigned i = 0; i < 4; ++i) {
+        if (!(variant.int_mask & (1 << i)))
+            continue;
+        const Math::Vec4<u8>& values = g_state.vs.uniforms.i[i];
+        const Math::Vec4<u8>& compiled = variant.int_values[i];
+        if (values.x != compiled.x || values.y != compiled.y || values.z != compiled.z)
+            return false;
+    }
+    return true;
+}
+
+class ShaderCompiler {
+public:
+    /**
+     * @param variant Variant to note the uniforms the code is specialized for in, or nullptr to
+     *                compile code reading all uniforms at run time
+     */
+    explicit ShaderCompiler(ShaderVariant* variant) : variant(variant) {}
+
+    /// Compiles the program starting at main_offset into the emitter's buffer
+    bool Compile(u32 main_offset) {
+        emit.MOV64(UNIFORMS, reinterpret_cast<u64>(&g_state.vs.uniforms));
+        return CompileRange(main_offset, NO_END, 0, 0);
+    }
+
+private:
+    static const u32 NO_END = 0xFFFFFFFF;
+
+    /**
+     * Compiles instructions starting at begin until the program counter reaches end, the way the
+     * interpreter runs a call stack element.
+     * @param end Offset ending the range, or NO_END to compile until an END instruction
+     * @param nesting Number of IF, CALL and LOOP bodies that enclose this range
+     * @param loop_depth Number of LOOP bodies that enclose this range
+     */
+    bool CompileRange(u32 begin, u32 end, int nesting, int loop_depth) {
+        if (nesting > MAX_NESTING_DEPTH)
+            return false;
+
+        u32 pc = begin;
+        while (pc != end) {
+            if (pc >= g_state.vs.program_code.size())
+                return false;
+            if (++num_compiled_instructions > MAX_COMPILED_INSTRUCTIONS)
+                return false;
+            if (emit.GetSpaceLeft() < MAX_INSTRUCTION_CODE_SIZE)
+                return false;
+
+            const Instruction& instr = *(const Instruction*)&g_state.vs.program_code[pc];
+            if (instr.opcode.Value() == OpCode::Id::END) {
+                emit.RET();
+                if (end == NO_END)
+                    return true;
+                ++pc;
+                continue;
+            }
+
+            if (!CompileInstruction(instr, pc, nesting, loop_depth))
+                return false;
+
+            // Jumping past the end of the range leaves it running forever in the interpreter
+            if (end != NO_END && pc > end)
+                return false;
+        }
+        return true;
+    }
+
+    /// Compiles the instruction at pc and advances pc to the instruction executed after it
+    bool CompileInstruction(const Instruction& instr, u32& pc, int nesting, int loop_depth) {
+        switch (instr.opcode.Value().GetInfo().type) {
+        case OpCode::Type::Arithmetic:
+            ++pc;
+            return CompileArithmetic(instr);
+
+        case OpCode::Type::MultiplyAdd:
+            ++pc;
+            return CompileMultiplyAdd(instr);
+
+        default:
+            return CompileFlowControl(instr, pc, nesting, loop_depth);
+        }
+    }
+
+    /**
+     * Loads a swizzled and optionally negated source register.
+     * @param address_register Index of the address register added to the register index, 0 for none
+     */
+    bool LoadSource(XmmReg dst, const SourceRegister& source, int address_register,
+                    const u8 (&selectors)[4], bool negate) {
+        const int index = source.GetIndex();
+
+        switch (source.GetRegisterType()) {
+        case RegisterType::Input:
+            if (address_register != 0)
+                return false;
+            emit.MOVUPS(dst, InputRegister(index));
+            break;
+
+        case RegisterType::Temporary:
+            if (address_register != 0)
+                return false;
+            emit.MOVUPS(dst, TemporaryRegister(index));
+            break;
+
+        case RegisterType::FloatUniform:
+        {
+            if (address_register == 0) {
+                emit.MOVUPS(dst, MemOperand::Disp(UNIFORMS, UniformOffset(&g_state.vs.uniforms.f[index])));
+                break;
+            }
+
+            emit.MOV_Load(X64Reg::RAX, AddressRegister(address_register - 1));
+            emit.ALU(AluOp::ADD, X64Reg::RAX, static_cast<u32>(index));
+            emit.ALU(AluOp::CMP, X64Reg::RAX, NUM_FLOAT_UNIFORMS);
+            u8* out_of_range = emit.J_CC(Condition::AE);
+            emit.Shift(ShiftOp::SHL, X64Reg::RAX, 4);
+            emit.MOVUPS(dst, MemOperand::Indexed(UNIFORMS, X64Reg::RAX,
+                                                 UniformOffset(&g_state.vs.uniforms.f[0])));
+            u8* done = emit.JMP();
+            emit.SetJumpTarget(out_of_range);
+            emit.SSE(SSEOp::XORPS, dst, dst);
+            emit.SetJumpTarget(done);
+            break;
+        }
+
+        default:
+            if (address_register != 0)
+                return false;
+            emit.SSE(SSEOp::XORPS, dst, dst);
+            break;
+        }
+
+        const u8 shuffle = selectors[0] | (selectors[1] << 2) | (selectors[2] << 4) | (selectors[3] << 6);
+        if (shuffle != 0xE4)
+            emit.SHUFPS(dst, dst, shuffle);
+
+        if (negate)
+            emit.SSE(SSEOp::XORPS, dst, MemOperand::Rip(constants->sign_mask));
+
+        return true;
+    }
+
+    /// Stores the enabled components of value to a destination register, clobbering value
+    void StoreDest(XmmReg value, int dest_offset, unsigned mask) {
+        if (dest_offset < 0 || mask == 0)
+            return;
+
+        const MemOperand dest = StateOperand(dest_offset);
+        if (mask != 0xF) {
+            emit.MOVUPS(XMM4, dest);
+            emit.SSE(SSEOp::ANDPS, value, MemOperand::Rip(constants->component_masks[mask]));
+            emit.SSE(SSEOp::ANDPS, XMM4, MemOperand::Rip(constants->component_masks[mask ^ 0xF]));
+            emit.SSE(SSEOp::ORPS, value, XMM4);
+        }
+        emit.MOVUPS(dest, value);
+    }
+
+    static unsigned GetDestMask(const SwizzlePattern& swizzle) {
+        unsigned mask = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (swizzle.DestComponentEnabled(i))
+                mask |= 1 << i;
+        }
+        return mask;
+    }
+
+    /// Computes the dot product of the first num_components components of XMM1 and XMM2 into all of XMM0
+    void CompileDotProduct(int num_components) {
+        // Sum up in the same order as the interpreter so that the result is rounded the same way
+        emit.SSE(SSEOp::MULPS, XMM1, XMM2);
+        emit.SSE(SSEOp::XORPS, XMM0, XMM0);
+        emit.ADDSS(XMM0, XMM1);
+        for (int i = 1; i < num_components; ++i) {
+            emit.MOVAPS(XMM2, XMM1);
+            emit.SHUFPS(XMM2, XMM2, static_cast<u8>(i * 0x55));
+            emit.ADDSS(XMM0, XMM2);
+        }
+        emit.SHUFPS(XMM0, XMM0, 0);
+    }
+
+    /// Computes floor(XMM1) into XMM0 with SSE2, which lacks roundps
+    void CompileFloor() {
+        // Truncate, then subtract one where that rounded up
+        emit.CVTTPS2DQ(XMM0, XMM1);
+        emit.CVTDQ2PS(XMM0, XMM0);
+        emit.MOVAPS(XMM2, XMM1);
+        emit.CMPPS(XMM2, XMM0, CMP_LT);
+        emit.SSE(SSEOp::ANDPS, XMM2, MemOperand::Rip(constants->one));
+        emit.SSE(SSEOp::SUBPS, XMM0, XMM2);
+
+        // Values of 2^23 and more are integers already and don't fit the conversion, neither do NaNs
+        emit.MOVAPS(XMM2, XMM1);
+        emit.SSE(SSEOp::ANDPS, XMM2, MemOperand::Rip(constants->abs_mask));
+        emit.MOVUPS(XMM3, MemOperand::Rip(constants->two_pow_23));
+        emit.CMPPS(XMM2, XMM3, CMP_LT);
+        emit.SSE(SSEOp::ANDPS, XMM0, XMM2);
+        emit.SSE(SSEOp::ANDNPS, XMM2, XMM1);
+        emit.SSE(SSEOp::ORPS, XMM0, XMM2);
+
+        // floor(-0.0) is -0.0
+        emit.MOVAPS(XMM2, XMM1);
+        emit.SSE(SSEOp::ANDPS, XMM2, MemOperand::Rip(constants->sign_mask));
+        emit.SSE(SSEOp::ORPS, XMM0, XMM2);
+    }
+
+    bool CompileArithmetic(const Instruction& instr) {
+        const SwizzlePattern& swizzle = *(SwizzlePattern*)&g_state.vs.swizzle_data[instr.common.operand_desc_id];
+        const bool is_inverted = (0 != (instr.opcode.Value().GetInfo().subtype & OpCode::Info::SrcInversed));
+        const OpCode::Id opcode = instr.opcode.Value().EffectiveOpCode();
+
+        bool uses_src2;
+        switch (opcode) {
+        case OpCode::Id::ADD: case OpCode::Id::MUL: case OpCode::Id::MAX: case OpCode::Id::MIN:
+        case OpCode::Id::DP3: case OpCode::Id::DP4: case OpCode::Id::SLT: case OpCode::Id::SLTI:
+        case OpCode::Id::CMP:
+            uses_src2 = true;
+            break;
+
+        case OpCode::Id::FLR: case OpCode::Id::RCP: case OpCode::Id::RSQ: case OpCode::Id::MOVA:
+        case OpCode::Id::MOV:
+            uses_src2 = false;
+            break;
+
+        default:
+            LOG_DEBUG(HW_GPU, "Can't compile arithmetic instruction 0x%02x (%s)",
+                      (int)opcode, instr.opcode.Value().GetInfo().name);
+            return false;
+        }
+
+        // The address register offsets the non-inverted source, which is src1 normally
+        const int address_register = instr.common.address_register_index;
+        const u8 selectors1[4] = {
+            (u8)swizzle.GetSelectorSrc1(0), (u8)swizzle.GetSelectorSrc1(1),
+            (u8)swizzle.GetSelectorSrc1(2), (u8)swizzle.GetSelectorSrc1(3),
+        };
+        const u8 selectors2[4] = {
+            (u8)swizzle.GetSelectorSrc2(0), (u8)swizzle.GetSelectorSrc2(1),
+            (u8)swizzle.GetSelectorSrc2(2), (u8)swizzle.GetSelectorSrc2(3),
+        };
+
+        if (!LoadSource(XMM1, instr.common.GetSrc1(is_inverted), is_inverted ? 0 : address_register,
+                        selectors1, (bool)swizzle.negate_src1))
+            return false;
+        if (uses_src2 && !LoadSource(XMM2, instr.common.GetSrc2(is_inverted), is_inverted ? address_register : 0,
+                                     selectors2, (bool)swizzle.negate_src2))
+            return false;
+
+        const int dest_offset = GetDestOffset(instr.common.dest.Value());
+        unsigned mask = GetDestMask(swizzle);
+
+        switch (opcode) {
+        case OpCode::Id::ADD:
+            emit.MOVAPS(XMM0, XMM1);
+            emit.SSE(SSEOp::ADDPS, XMM0, XMM2);
+            break;
+
+        case OpCode::Id::MUL:
+            emit.MOVAPS(XMM0, XMM1);
+            emit.SSE(SSEOp::MULPS, XMM0, XMM2);
+            break;
+
+        case OpCode::Id::FLR:
+            CompileFloor();
+            break;
+
+        // std::max and std::min return their first argument when the arguments are unordered,
+        // maxps and minps their second operand.
+        case OpCode::Id::MAX:
+            emit.MOVAPS(XMM0, XMM2);
+            emit.SSE(SSEOp::MAXPS, XMM0, XMM1);
+            break;
+
+        case OpCode::Id::MIN:
+            emit.MOVAPS(XMM0, XMM2);
+            emit.SSE(SSEOp::MINPS, XMM0, XMM1);
+            break;
+
+        case OpCode::Id::DP3:
+            CompileDotProduct(3);
+            mask &= 0x7;
+            break;
+
+        case OpCode::Id::DP4:
+            CompileDotProduct(4);
+            break;
+
+        case OpCode::Id::RCP:
+            emit.MOVUPS(XMM0, MemOperand::Rip(constants->one));
+            emit.SSE(SSEOp::DIVPS, XMM0, XMM1);
+            break;
+
+        case OpCode::Id::RSQ:
+            emit.SSE(SSEOp::SQRTPS, XMM1, XMM1);
+            emit.MOVUPS(XMM0, MemOperand::Rip(constants->one));
+            emit.SSE(SSEOp::DIVPS, XMM0, XMM1);
+            break;
+
+        case OpCode::Id::MOVA:
+            // TODO: Figure out how the rounding is done on hardware
+            emit.CVTTPS2DQ(XMM0, XMM1);
+            if (mask & 1) {
+                emit.MOVD(X64Reg::RAX, XMM0);
+                emit.MOV_Store(AddressRegister(0), X64Reg::RAX);
+            }
+            if (mask & 2) {
+                emit.SHUFPS(XMM0, XMM0, 0x55);
+                emit.MOVD(X64Reg::RAX, XMM0);
+                emit.MOV_Store(AddressRegister(1), X64Reg::RAX);
+            }
+            return true;
+
+        case OpCode::Id::MOV:
+            emit.MOVAPS(XMM0, XMM1);
+            break;
+
+        case OpCode::Id::SLT:
+        case OpCode::Id::SLTI:
+            emit.MOVAPS(XMM0, XMM1);
+            emit.CMPPS(XMM0, XMM2, CMP_LT);
+            emit.SSE(SSEOp::ANDPS, XMM0, MemOperand::Rip(constants->one));
+            break;
+
+        case OpCode::Id::CMP:
+            return CompileCompare(instr);
+
+        default:
+            UNREACHABLE();
+        }
+
+        StoreDest(XMM0, dest_offset, mask);
+        return true;
+    }
+
+    /// Compares the x and y components of XMM1 and XMM2 into the conditional codes
+    bool CompileCompare(const Instruction& instr) {
+        for (int i = 0; i < 2; ++i) {
+            auto compare_op = instr.common.compare_op;
+            auto op = (i == 0) ? compare_op.x.Value() : compare_op.y.Value();
+
+            // Greater comparisons are done as less comparisons with swapped operands
+            bool swap = false;
+            u8 predicate;
+            switch (op) {
+            case compare_op.Equal:        predicate = CMP_EQ;  break;
+            case compare_op.NotEqual:     predicate = CMP_NEQ; break;
+            case compare_op.LessThan:     predicate = CMP_LT;  break;
+            case compare_op.LessEqual:    predicate = CMP_LE;  break;
+            case compare_op.GreaterThan:  predicate = CMP_LT; swap = true; break;
+            case compare_op.GreaterEqual: predicate = CMP_LE; swap = true; break;
+            default:
+                return false;
+            }
+
+            emit.MOVAPS(XMM0, swap ? XMM2 : XMM1);
+            emit.CMPPS(XMM0, swap ? XMM1 : XMM2, predicate);
+            emit.MOVMSKPS(X64Reg::RAX, XMM0);
+            if (i != 0)
+                emit.Shift(ShiftOp::SHR, X64Reg::RAX, static_cast<u8>(i));
+            emit.ALU(AluOp::AND, X64Reg::RAX, 1u);
+            emit.MOV8_Store(ConditionalCode(i), X64Reg::RAX);
+        }
+        return true;
+    }
+
+    bool CompileMultiplyAdd(const Instruction& instr) {
+        const OpCode::Id opcode = instr.opcode.Value().EffectiveOpCode();
+        if (opcode != OpCode::Id::MAD && opcode != OpCode::Id::MADI) {
+            LOG_DEBUG(HW_GPU, "Can't compile multiply-add instruction 0x%02x (%s)",
+                      (int)opcode, instr.opcode.Value().GetInfo().name);
+            return false;
+        }
+
+        const SwizzlePattern& swizzle = *(SwizzlePattern*)&g_state.vs.swizzle_data[instr.mad.operand_desc_id];
+        const bool is_inverted = (opcode == OpCode::Id::MADI);
+
+        const u8 selectors1[4] = {
+            (u8)swizzle.GetSelectorSrc1(0), (u8)swizzle.GetSelectorSrc1(1),
+            (u8)swizzle.GetSelectorSrc1(2), (u8)swizzle.GetSelectorSrc1(3),
+        };
+        const u8 selectors2[4] = {
+            (u8)swizzle.GetSelectorSrc2(0), (u8)swizzle.GetSelectorSrc2(1),
+            (u8)swizzle.GetSelectorSrc2(2), (u8)swizzle.GetSelectorSrc2(3),
+        };
+        const u8 selectors3[4] = {
+            (u8)swizzle.GetSelectorSrc3(0), (u8)swizzle.GetSelectorSrc3(1),
+            (u8)swizzle.GetSelectorSrc3(2), (u8)swizzle.GetSelectorSrc3(3),
+        };
+
+        if (!LoadSource(XMM1, instr.mad.GetSrc1(is_inverted), 0, selectors1, (bool)swizzle.negate_src1) ||
+            !LoadSource(XMM2, instr.mad.GetSrc2(is_inverted), 0, selectors2, (bool)swizzle.negate_src2) ||
+            !LoadSource(XMM3, instr.mad.GetSrc3(is_inverted), 0, selectors3, (bool)swizzle.negate_src3))
+            return false;
+
+        emit.MOVAPS(XMM0, XMM1);
+        emit.SSE(SSEOp::MULPS, XMM0, XMM2);
+        emit.SSE(SSEOp::ADDPS, XMM0, XMM3);
+        StoreDest(XMM0, GetDestOffset(instr.mad.dest.Value()), GetDestMask(swizzle));
+        return true;
+    }
+
+    /// Emits a jump taken if the condition of a flow control instruction doesn't hold
+    u8* CompileSkipUnlessCondition(const Instruction& instr) {
+        const Instruction::FlowControlType flow_control = instr.flow_control;
+        const bool refx = instr.flow_control.refx;
+        const bool refy = instr.flow_control.refy;
+
+        // (ref == cc) is (cc ^ ref ^ 1) for 0/1 values
+        auto load_result = [](X64Reg reg, int index, bool ref) {
+            emit.MOVZX8_Load(reg, ConditionalCode(index));
+            if (!ref)
+                emit.ALU(AluOp::XOR, reg, 1u);
+        };
+
+        switch (flow_control.op) {
+        case flow_control.Or:
+            load_result(X64Reg::RAX, 0, refx);
+            load_result(X64Reg::RDX, 1, refy);
+            emit.ALU(AluOp::OR, X64Reg::RAX, X64Reg::RDX);
+            break;
+
+        case flow_control.And:
+            load_result(X64Reg::RAX, 0, refx);
+            load_result(X64Reg::RDX, 1, refy);
+            emit.ALU(AluOp::AND, X64Reg::RAX, X64Reg::RDX);
+            break;
+
+        case flow_control.JustX:
+            load_result(X64Reg::RAX, 0, refx);
+            break;
+
+        case flow_control.JustY:
+            load_result(X64Reg::RAX, 1, refy);
+            break;
+        }
+
+        emit.TEST(X64Reg::RAX, X64Reg::RAX);
+        return emit.J_CC(Condition::E);
+    }
+
+    /// Reads the boolean uniform a flow control instruction refers to, for the code to be specialized for
+    bool GetBoolUniform(const Instruction& instr) {
+        const u32 id = instr.flow_control.bool_uniform_id;
+        variant->bool_mask |= 1 << id;
+        return g_state.vs.uniforms.b[id];
+    }
+
+    /// Reads the integer uniform a LOOP refers to, for the code to be specialized for
+    const Math::Vec4<u8>& GetIntUniform(const Instruction& instr) {
+        const u32 id = instr.flow_control.int_uniform_id;
+        variant->int_mask |= 1 << id;
+        variant->int_values[id] = g_state.vs.uniforms.i[id];
+        return g_state.vs.uniforms.i[id];
+    }
+
+    /// Loads a component of an integer uniform, which is a constant if the code is specialized
+    void LoadIntUniform(X64Reg dst, const u8& component) {
+        if (variant != nullptr) {
+            emit.MOV(dst, component);
+        } else {
+            emit.MOVZX8_Load(dst, MemOperand::Disp(UNIFORMS, UniformOffset(&component)));
+        }
+    }
+
+    /// Emits a jump taken if the boolean uniform a flow control instruction refers to isn't set
+    u8* CompileSkipUnlessBoolUniform(const Instruction& instr) {
+        const u32 id = instr.flow_control.bool_uniform_id;
+        emit.MOVZX8_Load(X64Reg::RAX, MemOperand::Disp(UNIFORMS, UniformOffset(&g_state.vs.uniforms.b[id])));
+        emit.TEST(X64Reg::RAX, X64Reg::RAX);
+        return emit.J_CC(Condition::E);
+    }
+
+    /**
+     * Compiles a call stack element of the interpreter: the range [offset, offset + num_instructions)
+     * runs and execution continues at return_offset.
+     */
+    bool CompileCall(u32 offset, u32 num_instructions, u32 return_offset, u32& pc, int nesting, int loop_depth) {
+        if (!CompileRange(offset, offset + num_instructions, nesting + 1, loop_depth))
+            return false;
+        pc = return_offset;
+        return true;
+    }
+
+    /// Compiles an IF, running one of two ranges depending on a condition emitted before
+    bool CompileIf(const Instruction& instr, u8* skip_then, u32& pc, int nesting, int loop_depth) {
+        const u32 dest = instr.flow_control.dest_offset;
+        const u32 num = instr.flow_control.num_instructions;
+        const u32 binary_offset = pc;
+
+        u32 then_pc, else_pc;
+        if (!CompileCall(binary_offset + 1, dest - binary_offset - 1, dest + num, then_pc, nesting, loop_depth))
+            return false;
+        u8* skip_else = emit.JMP();
+
+        emit.SetJumpTarget(skip_then);
+        if (!CompileCall(dest, num, dest + num, else_pc, nesting, loop_depth))
+            return false;
+        emit.SetJumpTarget(skip_else);
+
+        pc = then_pc;
+        return true;
+    }
+
+    /// Compiles the body of an IF taken or not depending on a uniform known at compile time
+    bool CompileConstantIf(const Instruction& instr, bool condition, u32& pc, int nesting, int loop_depth) {
+        const u32 dest = instr.flow_control.dest_offset;
+        const u32 num = instr.flow_control.num_instructions;
+        const u32 binary_offset = pc;
+
+        if (condition)
+            return CompileCall(binary_offset + 1, dest - binary_offset - 1, dest + num, pc, nesting, loop_depth);
+        return CompileCall(dest, num, dest + num, pc, nesting, loop_depth);
+    }
+
+    /**
+     * Compiles the iterations of a LOOP one after the other, with the loop counter aL set to a
+     * constant before each of them
+     */
+    bool CompileUnrolledLoop(const Instruction& instr, const Math::Vec4<u8>& int_uniform, u32& pc,
+                             int nesting, int loop_depth) {
+        const u32 binary_offset = pc;
+        const u32 dest = instr.flow_control.dest_offset;
+
+        for (u32 iteration = 0; iteration <= int_uniform.x; ++iteration) {
+            emit.MOV(X64Reg::RAX, int_uniform.y + iteration * int_uniform.z);
+            emit.MOV_Store(AddressRegister(2), X64Reg::RAX);
+            if (!CompileRange(binary_offset + 1, dest + 2, nesting + 1, loop_depth))
+                return false;
+        }
+        emit.MOV(X64Reg::RAX, int_uniform.y + (int_uniform.x + 1) * int_uniform.z);
+        emit.MOV_Store(AddressRegister(2), X64Reg::RAX);
+
+        pc = dest + 1;
+        return true;
+    }
+
+    bool CompileFlowControl(const Instruction& instr, u32& pc, int nesting, int loop_depth) {
+        const u32 binary_offset = pc;
+
+        switch (instr.opcode.Value()) {
+        case OpCode::Id::NOP:
+            ++pc;
+            return true;
+
+        case OpCode::Id::CALL:
+            return CompileCall(instr.flow_control.dest_offset, instr.flow_control.num_instructions,
+                               binary_offset + 1, pc, nesting, loop_depth);
+
+        case OpCode::Id::CALLU:
+            if (variant != nullptr) {
+                if (!GetBoolUniform(instr)) {
+                    ++pc;
+                    return true;
+                }
+                return CompileCall(instr.flow_control.dest_offset, instr.flow_control.num_instructions,
+                                   binary_offset + 1, pc, nesting, loop_depth);
+            }
+            // Fall through
+        case OpCode::Id::CALLC:
+        {
+            u8* skip = (instr.opcode.Value() == OpCode::Id::CALLU)
+                       ? CompileSkipUnlessBoolUniform(instr) : CompileSkipUnlessCondition(instr);
+            if (!CompileCall(instr.flow_control.dest_offset, instr.flow_control.num_instructions,
+                             binary_offset + 1, pc, nesting, loop_depth))
+                return false;
+            emit.SetJumpTarget(skip);
+            return true;
+        }
+
+        case OpCode::Id::IFU:
+            if (variant != nullptr)
+                return CompileConstantIf(instr, GetBoolUniform(instr), pc, nesting, loop_depth);
+            return CompileIf(instr, CompileSkipUnlessBoolUniform(instr), pc, nesting, loop_depth);
+
+        case OpCode::Id::IFC:
+            return CompileIf(instr, CompileSkipUnlessCondition(instr), pc, nesting, loop_depth);
+
+        case OpCode::Id::LOOP:
+        {
+            const auto& int_uniform = g_state.vs.uniforms.i[instr.flow_control.int_uniform_id];
+            const u32 dest = instr.flow_control.dest_offset;
+
+            if (variant != nullptr) {
+                GetIntUniform(instr);
+                if (int_uniform.x < MAX_UNROLLED_ITERATIONS && dest + 1 - binary_offset <= MAX_UNROLLED_BODY_SIZE)
+                    return CompileUnrolledLoop(instr, int_uniform, pc, nesting, loop_depth);
+            }
+
+            if (loop_depth >= JIT_MAX_LOOP_DEPTH)
+                return false;
+
+            // aL starts at y, the body repeats x + 1 times and z is added to aL after each iteration
+            LoadIntUniform(X64Reg::RAX, int_uniform.y);
+            emit.MOV_Store(AddressRegister(2), X64Reg::RAX);
+            LoadIntUniform(X64Reg::RAX, int_uniform.x);
+            emit.MOV_Store(LoopCounter(loop_depth), X64Reg::RAX);
+
+            const u8* loop_start = emit.GetCodePtr();
+            if (!CompileRange(binary_offset + 1, dest + 2, nesting + 1, loop_depth + 1))
+                return false;
+
+            LoadIntUniform(X64Reg::RAX, int_uniform.z);
+            emit.ADD_Store(AddressRegister(2), X64Reg::RAX);
+            emit.MOV_Load(X64Reg::RAX, LoopCounter(loop_depth));
+            emit.ALU(AluOp::SUB, X64Reg::RAX, 1u);
+            emit.MOV_Store(LoopCounter(loop_depth), X64Reg::RAX);
+            // The subtraction borrows once the counter was zero
+            u8* loop_end = emit.J_CC(Condition::B);
+            emit.JMP(loop_start);
+            emit.SetJumpTarget(loop_end);
+
+            pc = dest + 1;
+            return true;
+        }
+
+        case OpCode::Id::JMPU:
+            // With the uniform known, a jump forward skips instructions like an IF without ELSE
+            if (variant != nullptr) {
+                if (!GetBoolUniform(instr)) {
+                    ++pc;
+                    return true;
+                }
+                if (instr.flow_control.dest_offset > binary_offset) {
+                    pc = instr.flow_control.dest_offset;
+                    return true;
+                }
+            }
+            // Fall through
+        default:
+            // Jumps can leave the structure the rest of the program is compiled in
+            LOG_DEBUG(HW_GPU, "Can't compile flow control instruction 0x%02x (%s)",
+                      (int)instr.opcode.Value().EffectiveOpCode(), instr.opcode.Value().GetInfo().name);
+            return false;
+        }
+    }
+
+    ShaderVariant* variant;
+    int num_compiled_instructions = 0;
+};
+
+/// 64-bit FNV-1a hash
+static u64 HashData(const void* data, size_t size, u64 hash = 0xCBF29CE484222325ULL) {
+    const u8* bytes = static_cast<const u8*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/// Discards all compiled shaders and starts emitting code right after the constants again
+static void ClearCodeBuffer() {
+    shader_cache.clear();
+    current_shader = nullptr;
+    emit.SetCodePtr(code_buffer + sizeof(JitConstants), code_buffer + CODE_BUFFER_SIZE);
+}
+
+static bool InitCodeBuffer() {
+    code_buffer = static_cast<u8*>(AllocateExecutableMemory(CODE_BUFFER_SIZE, false));
+    if (code_buffer == nullptr)
+        return false;
+
+    constants = reinterpret_cast<JitConstants*>(code_buffer);
+    for (int i = 0; i < 4; ++i) {
+        constants->sign_mask[i] = 0x80000000;
+        constants->abs_mask[i] = 0x7FFFFFFF;
+        constants->one[i] = 1.0f;
+        constants->two_pow_23[i] = 8388608.0f;
+    }
+    for (unsigned mask = 0; mask < 16; ++mask) {
+        for (int i = 0; i < 4; ++i)
+            constants->component_masks[mask][i] = (mask & (1 << i)) ? 0xFFFFFFFF : 0;
+    }
+
+    ClearCodeBuffer();
+    return true;
+}
+
+/**
+ * Compiles the current program for the current uniforms
+ * @param specialize Whether to bake the boolean and integer uniforms into the code
+ */
+static ShaderVariant CompileShader(u32 main_offset, bool specialize) {
+    ShaderVariant variant = {};
+    if (code_buffer == nullptr && !InitCodeBuffer()) {
+        LOG_ERROR(HW_GPU, "Failed to allocate memory for the vertex shader JIT");
+        return variant;
+    }
+
+    if (emit.GetSpaceLeft() < MAX_SHADER_CODE_SIZE)
+        ClearCodeBuffer();
+
+    u8* start = emit.GetCodePtr();
+    ShaderCompiler compiler(specialize ? &variant : nullptr);
+    const bool compiled = compiler.Compile(main_offset);
+    // Compiling fails the same way as long as the uniforms read before the failure keep their values
+    variant.bool_values = GetBoolUniforms() & variant.bool_mask;
+    if (!compiled) {
+        LOG_DEBUG(HW_GPU, "Vertex shader at offset 0x%x can't be compiled, interpreting it", main_offset);
+        emit.SetCodePtr(start, code_buffer + CODE_BUFFER_SIZE);
+        return variant;
+    }
+
+    LOG_DEBUG(HW_GPU, "Compiled vertex shader at offset 0x%x into %u bytes, specialized for bool uniforms "
+              "0x%04x and int uniforms 0x%x", main_offset, static_cast<unsigned>(emit.GetCodePtr() - start),
+              variant.bool_mask, variant.int_mask);
+    variant.shader = reinterpret_cast<CompiledShader>(start);
+    return variant;
+}
+
+CompiledShader GetCompiledShader() {
+    const u32 main_offset = g_state.regs.vs_main_offset;
+    if (!program_dirty && !uniforms_dirty && main_offset == current_main_offset)
+        return current_shader;
+
+    if (program_dirty) {
+        program_hash = HashData(g_state.vs.program_code.data(), sizeof(g_state.vs.program_code));
+        program_hash = HashData(g_state.vs.swizzle_data.data(), sizeof(g_state.vs.swizzle_data), program_hash);
+        program_dirty = false;
+    }
+
+    uniforms_dirty = false;
+    current_main_offset = main_offset;
+    const u64 key = HashData(&main_offset, sizeof(main_offset), program_hash);
+
+    size_t num_variants = 0;
+    auto it = shader_cache.find(key);
+    if (it != shader_cache.end()) {
+        for (const ShaderVariant& variant : it->second) {
+            if (MatchesUniforms(variant)) {
+                current_shader = variant.shader;
+                return current_shader;
+            }
+        }
+        num_variants = it->second.size();
+    }
+
+    // A program whose uniforms keep changing ends up with a variant matching any values. Compiling
+    // may clear the cache, the variant is only added afterwards.
+    const ShaderVariant variant = CompileShader(main_offset, num_variants < MAX_SHADER_VARIANTS);
+    shader_cache[key].push_back(variant);
+    current_shader = variant.shader;
+    return current_shader;
+}
+
+void InvalidateCompiledShader() {
+    program_dirty = true;
+}
+
+void InvalidateCompiledShaderUniforms() {
+    uniforms_dirty = true;
+}
+
+void ShutdownJit() {
+    if (code_buffer != nullptr) {
+        FreeMemoryPages(code_buffer, CODE_BUFFER_SIZE);
+        code_buffer = nullptr;
+        constants = nullptr;
+    }
+    shader_cache.clear();
+    current_shader = nullptr;
+    program_dirty = true;
+    uniforms_dirty = true;
+}
+
+} // namespace
+
+} // namespace
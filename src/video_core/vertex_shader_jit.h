@@ -0,0 +1,56 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "math.h"
+#include "pica.h"
+
+namespace Pica {
+
+namespace VertexShader {
+
+/// Deepest nesting of LOOP instructions a compiled shader may have
+const int JIT_MAX_LOOP_DEPTH = 4;
+
+/// Registers of a vertex shader invocation run by compiled code
+struct JitState {
+    Math::Vec4<float24> input_registers[16];
+    Math::Vec4<float24> temporary_registers[16];
+    Math::Vec4<float24> output_registers[16];
+
+    // Two address registers and the loop counter aL
+    s32 address_registers[3];
+    // Remaining iterations of each active LOOP
+    u32 loop_counters[JIT_MAX_LOOP_DEPTH];
+    u8 conditional_code[2];
+};
+
+typedef void (*CompiledShader)(JitState* state);
+
+/**
+ * Returns x86-64 code running the vertex shader program, swizzle patterns and entry point that are
+ * currently set up. Programs are compiled the first time they are used and cached by a hash of
+ * their code, so switching back and forth between programs doesn't recompile them. The code is
+ * specialized for the values of the boolean and integer uniforms the program's flow control reads,
+ * and a few variants are cached for each program before one reading them at run time is compiled.
+ * @return The compiled shader, or nullptr if the program uses instructions or control flow the
+ *         compiler doesn't support. It has to be interpreted then.
+ */
+CompiledShader GetCompiledShader();
+
+/// Notes that the shader program or swizzle patterns were written to, called by InvalidateShaderProgram
+void InvalidateCompiledShader();
+
+/// Notes that the boolean or integer uniforms were written to, called by InvalidateShaderUniforms
+void InvalidateCompiledShaderUniforms();
+
+/// Frees all compiled shaders
+void ShutdownJit();
+
+} // namespace
+
+} // namespace
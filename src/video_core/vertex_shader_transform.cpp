@@ -0,0 +1,295 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+#include <nihstro/shader_bytecode.h>
+
+#include "common/logging/log.h"
+
+#include "derived_state.h"
+#include "pica.h"
+#include "vertex_shader_ir.h"
+#include "vertex_shader_transform.h"
+
+using nihstro::OpCode;
+
+namespace Pica {
+
+namespace VertexShader {
+
+static bool transform_dirty = true;
+static u32 transform_main_offset;
+static bool transform_matched;
+static TransformShader current_transform;
+
+/// Values of the registers of a program as it is matched, all input registers hold themselves
+struct MatchState {
+    TransformTerm input_registers[16][4];
+    TransformTerm temporary_registers[16][4];
+    TransformTerm output_registers[16][4];
+};
+
+static TransformTerm MakeTerm(TransformTerm::Kind kind, u8 reg = 0, u8 component = 0) {
+    TransformTerm term = {};
+    term.kind = kind;
+    if (kind == TransformTerm::Kind::Input) {
+        term.input_register[0] = reg;
+        term.input_component[0] = component;
+    } else if (kind == TransformTerm::Kind::Uniform) {
+        term.uniform_register[0] = reg;
+        term.uniform_component[0] = component;
+    }
+    return term;
+}
+
+/// Loads a swizzled and optionally negated source operand, returns false if it isn't supported
+static bool LoadSource(const MatchState& state, const IRSource& source, TransformTerm (&values)[4]) {
+    // Relative addressing would make the register depend on the vertex
+    if (source.address_register != 0)
+        return false;
+
+    for (int i = 0; i < 4; ++i) {
+        const u8 selector = source.selectors[i];
+        switch (source.reg.file) {
+        case IRRegisterFile::Input:
+            values[i] = state.input_registers[source.reg.index][selector];
+            break;
+
+        case IRRegisterFile::Temporary:
+            values[i] = state.temporary_registers[source.reg.index][selector];
+            break;
+
+        case IRRegisterFile::FloatUniform:
+            values[i] = MakeTerm(TransformTerm::Kind::Uniform, source.reg.index, selector);
+            break;
+
+        default:
+            values[i] = MakeTerm(TransformTerm::Kind::Zero);
+            break;
+        }
+        if (source.negate)
+            values[i].negate = !values[i].negate;
+    }
+    return true;
+}
+
+/// Builds the dot product of two operands, which has to multiply uniforms by inputs
+static bool MakeDot(const TransformTerm (&src1)[4], const TransformTerm (&src2)[4], TransformTerm& dot) {
+    dot = MakeTerm(TransformTerm::Kind::Dot);
+    for (int i = 0; i < 4; ++i) {
+        const TransformTerm* input = &src1[i];
+        const TransformTerm* uniform = &src2[i];
+        if (input->kind == TransformTerm::Kind::Uniform)
+            std::swap(input, uniform);
+        if (input->kind != TransformTerm::Kind::Input || uniform->kind != TransformTerm::Kind::Uniform)
+            return false;
+
+        dot.input_register[i] = input->input_register[0];
+        dot.input_component[i] = input->input_component[0];
+        dot.uniform_register[i] = uniform->uniform_register[0];
+        dot.uniform_component[i] = uniform->uniform_component[0];
+        dot.negate_product[i] = input->negate != uniform->negate;
+    }
+    return true;
+}
+
+/// Follows the program from its entry point, returns false on anything but MOV, DP4, NOP and END
+static bool MatchProgram(const IRProgram& program, u32 main_offset, MatchState& state) {
+    for (u32 pc = main_offset; pc < program.size(); ++pc) {
+        const IRInstruction& instr = program[pc];
+
+        if (instr.type != OpCode::Type::Arithmetic) {
+            if (instr.type == OpCode::Type::MultiplyAdd)
+                return false;
+            if (instr.opcode == OpCode::Id::END)
+                return true;
+            if (instr.opcode != OpCode::Id::NOP)
+                return false;
+            continue;
+        }
+
+        TransformTerm src1[4], src2[4];
+        TransformTerm result[4];
+        switch (instr.opcode) {
+        case OpCode::Id::MOV:
+            if (!LoadSource(state, instr.src[0], src1))
+                return false;
+            for (int i = 0; i < 4; ++i)
+                result[i] = src1[i];
+            break;
+
+        case OpCode::Id::DP4:
+            if (!LoadSource(state, instr.src[0], src1) || !LoadSource(state, instr.src[1], src2))
+                return false;
+            if (!MakeDot(src1, src2, result[0]))
+                return false;
+            for (int i = 1; i < 4; ++i)
+                result[i] = result[0];
+            break;
+
+        default:
+            return false;
+        }
+
+        TransformTerm (*dest)[4];
+        switch (instr.dest.file) {
+        case IRRegisterFile::Output:    dest = state.output_registers; break;
+        case IRRegisterFile::Temporary: dest = state.temporary_registers; break;
+        default:                        continue;
+        }
+        for (int i = 0; i < 4; ++i) {
+            if (instr.DestComponentEnabled(i))
+                dest[instr.dest.index][i] = result[i];
+        }
+    }
+    return false;
+}
+
+const TransformShader* GetTransformShader() {
+    const u32 main_offset = g_state.regs.vs_main_offset;
+    if (!transform_dirty && main_offset == transform_main_offset)
+        return transform_matched ? &current_transform : nullptr;
+
+    transform_dirty = false;
+    transform_main_offset = main_offset;
+
+    // Registers which aren't written read as zero, like in the batch interpreter
+    MatchState state = {};
+    for (u8 reg = 0; reg < 16; ++reg) {
+        for (u8 comp = 0; comp < 4; ++comp)
+            state.input_registers[reg][comp] = MakeTerm(TransformTerm::Kind::Input, reg, comp);
+    }
+
+    transform_matched = MatchProgram(GetIRProgram(), main_offset, state);
+    if (!transform_matched)
+        return nullptr;
+
+    current_transform.transforms = false;
+    for (int reg = 0; reg < 16; ++reg) {
+        for (int comp = 0; comp < 4; ++comp) {
+            current_transform.outputs[reg][comp] = state.output_registers[reg][comp];
+            if (state.output_registers[reg][comp].kind == TransformTerm::Kind::Dot)
+                current_transform.transforms = true;
+        }
+    }
+    LOG_DEBUG(HW_GPU, "Vertex shader at offset 0x%x is a %s shader", main_offset,
+              current_transform.transforms ? "transform" : "pass-through");
+    return &current_transform;
+}
+
+void InvalidateTransformShader() {
+    transform_dirty = true;
+}
+
+/// Index of the zero attribute the input registers without an attribute read from
+static const u8 NO_ATTRIBUTE = 16;
+
+/// An output slot with its term resolved for the uniforms and attributes of the draw
+struct PreparedOutput {
+    u8 slot;
+    TransformTerm::Kind kind;
+    /// Attribute and component of the input, or of the input of each product of a Dot
+    u8 attribute[4];
+    u8 component[4];
+    /// Uniforms of the products of a Dot with the negations applied, the value of Zero and Uniform
+    /// terms, and -1 or 1 for Input terms
+    float coefficients[4];
+};
+
+static PreparedOutput PrepareOutput(const TransformTerm& term, u8 slot, const u8 (&register_attributes)[16]) {
+    const auto& uniforms = g_state.vs.uniforms.f;
+
+    PreparedOutput output = {};
+    output.slot = slot;
+    output.kind = term.kind;
+    switch (term.kind) {
+    case TransformTerm::Kind::Zero:
+        output.coefficients[0] = term.negate ? -0.0f : 0.0f;
+        break;
+
+    case TransformTerm::Kind::Input:
+        output.attribute[0] = register_attributes[term.input_register[0]];
+        output.component[0] = term.input_component[0];
+        output.coefficients[0] = term.negate ? -1.0f : 1.0f;
+        break;
+
+    case TransformTerm::Kind::Uniform:
+    {
+        const float value = uniforms[term.uniform_register[0]][term.uniform_component[0]].ToFloat32();
+        output.coefficients[0] = term.negate ? -value : value;
+        break;
+    }
+
+    case TransformTerm::Kind::Dot:
+        // Negating a factor negates the product exactly, so the signs go to the uniforms
+        for (int i = 0; i < 4; ++i) {
+            const float value = uniforms[term.uniform_register[i]][term.uniform_component[i]].ToFloat32();
+            output.attribute[i] = register_attributes[term.input_register[i]];
+            output.component[i] = term.input_component[i];
+            output.coefficients[i] = (term.negate_product[i] != term.negate) ? -value : value;
+        }
+        break;
+    }
+    return output;
+}
+
+void RunTransformShader(const TransformShader& shader, const InputVertex* inputs, int num_vertices,
+                        int num_attributes, OutputVertex* outputs) {
+    const DerivedState::OutputLayout& layout = DerivedState::GetOutputLayout();
+    const auto& attribute_register_map = g_state.regs.vs_input_register_map;
+
+    // Later attributes mapped to the same register win, like when the interpreters load them
+    u8 register_attributes[16];
+    std::fill(std::begin(register_attributes), std::end(register_attributes), NO_ATTRIBUTE);
+    for (int i = 0; i < num_attributes; ++i)
+        register_attributes[attribute_register_map.GetRegisterForAttribute(i)] = static_cast<u8>(i);
+
+    PreparedOutput prepared[7 * 4];
+    for (u32 i = 0; i < layout.num_outputs; ++i) {
+        const auto& output = layout.outputs[i];
+        prepared[i] = PrepareOutput(shader.outputs[output.register_index][output.component], output.slot,
+                                    register_attributes);
+    }
+
+    for (int vertex = 0; vertex < num_vertices; ++vertex) {
+        // The inputs without an attribute read from the zeroed last one
+        float input[NO_ATTRIBUTE + 1][4] = {};
+        for (int i = 0; i < num_attributes; ++i) {
+            for (int comp = 0; comp < 4; ++comp)
+                input[i][comp] = inputs[vertex].attr[i][comp].ToFloat32();
+        }
+
+        float24* slots = reinterpret_cast<float24*>(&outputs[vertex]);
+        for (u32 i = 0; i < layout.num_outputs; ++i) {
+            const PreparedOutput& output = prepared[i];
+            float value;
+            switch (output.kind) {
+            case TransformTerm::Kind::Input:
+                value = input[output.attribute[0]][output.component[0]] * output.coefficients[0];
+                break;
+
+            case TransformTerm::Kind::Dot:
+                // Summed in the order DP4 sums the products in
+                value = 0.0f;
+                for (int j = 0; j < 4; ++j)
+                    value = value + output.coefficients[j] * input[output.attribute[j]][output.component[j]];
+                break;
+
+            default:
+                value = output.coefficients[0];
+                break;
+            }
+            slots[output.slot] = float24::FromFloat32(value);
+        }
+        for (u32 i = 0; i < layout.num_unused_slots; ++i)
+            slots[layout.unused_slots[i]] = float24::FromFloat32(0.0f);
+    }
+}
+
+} // namespace
+
+} // namespace
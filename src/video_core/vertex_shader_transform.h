@@ -0,0 +1,66 @@
+// Copyright 2015 Citra Emulator Project
+// Licensed under GPLv2 or any later version
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/common_types.h"
+
+#include "vertex_shader.h"
+
+namespace Pica {
+
+namespace VertexShader {
+
+/// Value of a register component of a transform shader, in terms of the inputs and float uniforms
+struct TransformTerm {
+    enum class Kind : u8 {
+        Zero,
+        Input,      ///< A component of an input register
+        Uniform,    ///< A component of a float uniform
+        Dot,        ///< Sum of the products of four uniform components and input components
+    };
+
+    Kind kind;
+    bool negate;
+
+    // Input and uniform read, for each product of a Dot and only the first for Input and Uniform
+    u8 input_register[4];
+    u8 input_component[4];
+    u8 uniform_register[4];
+    u8 uniform_component[4];
+
+    /// Products of a Dot which are negated
+    bool negate_product[4];
+};
+
+/**
+ * A vertex shader that only moves input attributes and uniforms to its outputs and transforms the
+ * inputs by uniform matrices with DP4, like the shaders of most 2D and UI draws. Its outputs are
+ * resolved to expressions of the inputs, which are evaluated without interpreting the program.
+ */
+struct TransformShader {
+    /// Value of each component of the output registers
+    TransformTerm outputs[16][4];
+
+    /// Whether any output is a dot product, otherwise the shader passes its inputs through
+    bool transforms;
+};
+
+/**
+ * Matches the vertex shader program and entry point currently set up against a transform shader.
+ * The match is cached until the program or the entry point change.
+ * @return The transform shader, or nullptr if the program does more than moves and DP4 transforms
+ */
+const TransformShader* GetTransformShader();
+
+/// Notes that the shader program or swizzle patterns were written to, called by InvalidateShaderProgram
+void InvalidateTransformShader();
+
+/// Shades a number of vertices with a transform shader, giving the same outputs as interpreting it
+void RunTransformShader(const TransformShader& shader, const InputVertex* inputs, int num_vertices,
+                        int num_attributes, OutputVertex* outputs);
+
+} // namespace
+
+} // namespace
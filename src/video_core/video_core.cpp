@@ -6,13 +6,21 @@
 #include "common/emu_window.h"
 
 #include "core/core.h"
+#include "core/memory.h"
 #include "core/settings.h"
 
 #include "video_core.h"
+#include "gpu_thread.h"
 #include "renderer_base.h"
+#include "renderer_null/renderer_null.h"
 #include "renderer_opengl/renderer_opengl.h"
 
 #include "pica.h"
+#include "rasterizer.h"
+#include "texture_cache.h"
+#include "texture_disk_cache.h"
+#include "vertex_shader_ir.h"
+#include "vertex_shader_jit.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Video Core namespace
@@ -22,27 +30,81 @@ namespace VideoCore {
 EmuWindow*      g_emu_window    = nullptr;     ///< Frontend emulator window
 RendererBase*   g_renderer      = nullptr;     ///< Renderer plugin
 
+Common::FrameArena g_frame_arena;
+
 std::atomic<bool> g_hw_renderer_enabled;
 
+/// Creates the renderer of the configured backend
+static RendererBase* CreateRenderer() {
+    switch (static_cast<RendererBackend>(Settings::values.renderer_backend)) {
+    case RendererBackend::OpenGL:
+        return new RendererOpenGL();
+    case RendererBackend::Null:
+        return new RendererNull();
+    }
+
+    LOG_ERROR(Render, "Unknown renderer backend %d, falling back to OpenGL", Settings::values.renderer_backend);
+    return new RendererOpenGL();
+}
+
 /// Initialize the video core
 void Init(EmuWindow* emu_window) {
     Pica::Init();
 
     g_emu_window = emu_window;
-    g_renderer = new RendererOpenGL();
+    g_renderer = CreateRenderer();
     g_renderer->SetWindow(g_emu_window);
-    g_renderer->Init();
+
+    // The renderer makes the OpenGL context current on the thread it is initialized on
+    if (Settings::values.use_gpu_thread)
+        g_emu_window->DoneCurrent();
+    GPUThread::Init([] { g_renderer->Init(); });
 
     LOG_DEBUG(Render, "initialized OK");
 }
 
 /// Shutdown the video core
 void Shutdown() {
-    Pica::Shutdown();
+    const bool threaded = GPUThread::IsEnabled();
+    GPUThread::Shutdown([threaded] {
+        Pica::Rasterizer::Shutdown();
+        Pica::Shutdown();
+        Pica::VertexShader::ShutdownJit();
+        Pica::VertexShader::ClearIRCache();
+
+        delete g_renderer;
+        Pica::TextureDiskCache::Shutdown();
+
+        if (threaded)
+            g_emu_window->DoneCurrent();
+    });
 
-    delete g_renderer;
+    // Hand the OpenGL context back to the thread that created the video core
+    if (threaded)
+        g_emu_window->MakeCurrent();
 
     LOG_DEBUG(Render, "shutdown OK");
 }
 
+void Reset() {
+    GPUThread::Run([] {
+        Pica::Rasterizer::Flush();
+        Pica::TextureCache::FullFlush();
+        Pica::Shutdown();
+        Pica::Init();
+
+        g_renderer->hw_rasterizer->Reset();
+        g_renderer->hw_rasterizer->NotifyFlush(Memory::VRAM_PADDR, Memory::VRAM_SIZE);
+        g_renderer->hw_rasterizer->NotifyFlush(Memory::FCRAM_PADDR, Memory::FCRAM_SIZE);
+        g_frame_arena.Reset();
+    });
+    GPUThread::WaitIdle();
+
+    LOG_DEBUG(Render, "reset OK");
+}
+
+void EndFrame() {
+    GPUThread::Run([] { g_frame_arena.Reset(); });
+}
+
 } // namespace
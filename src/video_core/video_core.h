@@ -5,6 +5,7 @@
 #pragma once
 
 #include "common/emu_window.h"
+#include "common/frame_arena.h"
 
 #include "renderer_base.h"
 
@@ -30,9 +31,20 @@ static const int kScreenBottomHeight    = 240;  ///< 3DS bottom screen height
 //  Video core renderer
 // ---------------------
 
+/// Values of Settings::values.renderer_backend. Backends implement RendererBase and HWRasterizer.
+enum class RendererBackend : int {
+    OpenGL = 0,
+    /// Presents nothing and drops the triangles of the hardware renderer, needs no graphics context
+    Null = 1,
+};
+
 extern RendererBase*   g_renderer;              ///< Renderer plugin
 extern EmuWindow*      g_emu_window;            ///< Emu window
 
+/// Scratch memory of the draws of the current frame, only used on the thread processing command
+/// lists. Reset by EndFrame.
+extern Common::FrameArena g_frame_arena;
+
 // TODO: Wrap this in a user settings struct along with any other graphics settings (often set from qt ui)
 extern std::atomic<bool> g_hw_renderer_enabled;
 
@@ -45,4 +57,14 @@ void Init(EmuWindow* emu_window);
 /// Shutdown the video core
 void Shutdown();
 
+/**
+ * Forgets the GPU state and the resources cached from emulated memory, for booting another title.
+ * The renderer, its OpenGL context and the compiled host shaders are kept. Returns once the GPU
+ * is idle, so that the emulated memory can be unmapped afterwards.
+ */
+void Reset();
+
+/// Frees the per-frame data of the video core, at VBlank. Runs on the GPU thread if there is one.
+void EndFrame();
+
 } // namespace